@@ -173,60 +173,425 @@ uint32_t PacketRead(ethInt *ethernetif, uint8_t *buffer, uint32_t bytesToCopy) {
     return bytesCopied;
 }
 
-static err_t PacketWrite(ethInt *ethernetif, uint8_t *buffer, uint32_t length) {
-    uint16_t startIndex = *ethernetif->txBuffIndex;
-    uint16_t endIndex = *ethernetif->txBuffIndex;
+/**
+    \brief Locate the next complete frame in the RX descriptors.
+
+    \param ethernetif       An Ethernet interface reference structure.
+    \param startOffset      Returns the offset of the SF RX buffer from the
+                            current RX index.
+    \param bufferCount      Returns the number of RX buffers in the frame.
+
+    \return The length of the frame in bytes, or 0 if no complete frame has
+    been received.
+**/
+static uint32_t PacketFind(ethInt *ethernetif, uint8_t *startOffset,
+                           uint8_t *bufferCount) {
+    uint8_t startFrameOffset = RX_BUFF_CNT;
+    uint8_t index = *(ethernetif->rxBuffIndex);
+
+    for (uint8_t i = 0; i < RX_BUFF_CNT; i++) {
+        // The OWN bit indicates software has ownership of this buffer.
+        if (!ethernetif->rxDesc[index].bit.OWN) {
+            break;
+        }
+        // The SF bit indicates this RX buffer is the first in the frame.
+        if (ethernetif->rxDesc[index].bit.SF) {
+            startFrameOffset = i;
+        }
+        // THE EF bit indicates this RX buffer is the last in the frame.
+        if (ethernetif->rxDesc[index].bit.EF && startFrameOffset != RX_BUFF_CNT) {
+            *startOffset = startFrameOffset;
+            *bufferCount = i - startFrameOffset + 1;
+            return ethernetif->rxDesc[index].bit.LEN;
+        }
+        // Increment the local index, treating RX buffers as circular.
+        index = (index + 1) % RX_BUFF_CNT;
+    }
+    return 0;
+}
+
+#if ETHERNET_RX_ZERO_COPY
+#if ETH_PAD_SIZE
+#error "The zero-copy receive path does not support ETH_PAD_SIZE"
+#endif
+
+/**
+    \brief A receive buffer wrapped as a custom pbuf.
+**/
+typedef struct rxPbuf {
+    struct pbuf_custom pc;      /* LwIP custom pbuf; must be first */
+    uint8_t *buffer;            /* The receive buffer */
+    struct rxPbuf *next;        /* Next wrapper in the free list */
+} rxPbuf;
+
+// Wrappers for the buffers in the descriptor ring plus the spare buffers.
+static rxPbuf rxPbufPool[RX_BUFF_CNT + RX_SPARE_BUFF_CNT];
+static uint8_t rxSpareBuffer[RX_SPARE_BUFF_CNT][RX_BUFFER_SIZE]
+__attribute__((aligned(4)));
+// The wrapper of the buffer currently assigned to each RX descriptor.
+static rxPbuf *rxDescPbuf[RX_BUFF_CNT];
+// Wrappers of the buffers that are neither in the ring nor held by LwIP.
+static rxPbuf *rxPbufFree = NULL;
+static uint8_t rxPbufFreeCnt = 0;
+
+/**
+    \brief Return a receive buffer to the spare list once LwIP frees it.
+
+    \param p   The custom pbuf being freed.
+**/
+static void RxPbufFree(packetBuf *p) {
+    rxPbuf *wrapper = (rxPbuf *)p;
+    wrapper->next = rxPbufFree;
+    rxPbufFree = wrapper;
+    rxPbufFreeCnt++;
+}
+
+/**
+    \brief Set up the receive buffer wrappers.
+
+    Must be called after the RX descriptors have been assigned their buffers
+    and before receive is enabled.
+
+    \param ethernetif   An Ethernet interface reference structure.
+**/
+void RxZeroCopyInit(ethInt *ethernetif) {
+    rxPbufFree = NULL;
+    rxPbufFreeCnt = 0;
+    for (uint8_t i = 0; i < RX_BUFF_CNT + RX_SPARE_BUFF_CNT; i++) {
+        rxPbuf *wrapper = &rxPbufPool[i];
+        wrapper->pc.custom_free_function = RxPbufFree;
+        if (i < RX_BUFF_CNT) {
+            // Mask to ignore the lowest 2 bits that are not part of the address.
+            wrapper->buffer =
+                (uint8_t *)(ethernetif->rxDesc[i].reg[0] & 0xFFFFFFFC);
+            rxDescPbuf[i] = wrapper;
+        }
+        else {
+            wrapper->buffer = rxSpareBuffer[i - RX_BUFF_CNT];
+            RxPbufFree((packetBuf *)wrapper);
+        }
+    }
+}
+
+/**
+    \brief Wrap the RX buffers of a frame as a chain of custom pbufs.
+
+    Each RX buffer of the frame is handed to LwIP as is and a spare buffer
+    takes its place in the descriptor, which is then given back to the GMAC.
+    The caller must ensure enough spare buffers are available.
+
+    \param ethernetif       An Ethernet interface reference structure.
+    \param startOffset      The offset of the SF RX buffer from the current RX
+                            index, as found by PacketFind().
+    \param bufferCount      The number of RX buffers in the frame.
+    \param length           The length of the frame in bytes.
+
+    \return The pbuf chain holding the frame.
+**/
+static packetBuf *PacketWrap(ethInt *ethernetif, uint8_t startOffset,
+                             uint8_t bufferCount, uint32_t length) {
+    packetBuf *p = NULL;
+
+    // Give any RX buffers ahead of the start of frame back to hardware.
+    for (uint8_t i = 0; i < startOffset; i++) {
+        ethernetif->rxDesc[*(ethernetif->rxBuffIndex)].bit.OWN = 0;
+        *ethernetif->rxBuffIndex = (*(ethernetif->rxBuffIndex) + 1) % RX_BUFF_CNT;
+    }
+
+    for (uint8_t i = 0; i < bufferCount; i++) {
+        uint8_t index = *(ethernetif->rxBuffIndex);
+        GMAC_RX_DESC *desc = &ethernetif->rxDesc[index];
+        uint16_t bytes = min(length, RX_BUFFER_SIZE);
+        length -= bytes;
+
+        if (bytes == 0) {
+            // Nothing of the frame in this buffer; give it back as is.
+            desc->bit.OWN = 0;
+        }
+        else {
+            rxPbuf *wrapper = rxDescPbuf[index];
+            rxPbuf *spare = rxPbufFree;
+            rxPbufFree = spare->next;
+            rxPbufFreeCnt--;
+
+            // Swap in the spare buffer, keeping WRAP, and clear OWN to give
+            // the descriptor back to hardware in the same write.
+            rxDescPbuf[index] = spare;
+            desc->reg[0] = (uint32_t)spare->buffer | (desc->reg[0] & 0x2);
+
+            packetBuf *q = pbuf_alloced_custom(PBUF_RAW, bytes, PBUF_REF,
+                                               &wrapper->pc, wrapper->buffer,
+                                               RX_BUFFER_SIZE);
+            if (p == NULL) {
+                p = q;
+            }
+            else {
+                pbuf_cat(p, q);
+            }
+        }
+        // Increment the buffer index, treating RX buffers as circular.
+        *ethernetif->rxBuffIndex = (*(ethernetif->rxBuffIndex) + 1) % RX_BUFF_CNT;
+    }
+    return p;
+}
+#endif // ETHERNET_RX_ZERO_COPY
+
+#if ETHERNET_TX_ZERO_COPY
+// The TX buffer each descriptor was assigned at initialization.
+static uint8_t *txDescBuffer[TX_BUFF_CNT];
+// The pbuf each frame was sent from, held at the frame's first descriptor
+// until the GMAC has finished with it.
+static packetBuf *txDescPbuf[TX_BUFF_CNT];
+
+/**
+    \brief Record the TX buffers of the descriptors.
+
+    Must be called after the TX descriptors have been assigned their buffers.
+
+    \param ethernetif   An Ethernet interface reference structure.
+**/
+void TxZeroCopyInit(ethInt *ethernetif) {
+    for (uint8_t i = 0; i < TX_BUFF_CNT; i++) {
+        txDescBuffer[i] = (uint8_t *)ethernetif->txDesc[i].reg[0];
+        txDescPbuf[i] = NULL;
+    }
+}
+#endif // ETHERNET_TX_ZERO_COPY
+
+/**
+    \brief Reclaim the TX buffers of a transmitted frame.
+
+    GMAC only returns the first TX buffer descriptor to ownership on
+    transmission complete. Reclaim the remaining TX buffers of the frame and
+    release the pbuf it was sent from, if any.
 
-    // Check that enough TX buffers are available to fit the entire frame.
-    // Start at the current TX index.
+    \param ethernetif   An Ethernet interface reference structure.
+    \param index        The index of the frame's first TX buffer.
+    \param release      Release the pbuf of the frame. A pbuf left in place is
+                        released the next time LwIP reclaims the buffer.
+**/
+static void PacketReclaim(ethInt *ethernetif, uint8_t index, bool release) {
+#if ETHERNET_TX_ZERO_COPY
+    if (release && txDescPbuf[index] != NULL) {
+        pbuf_free(txDescPbuf[index]);
+        txDescPbuf[index] = NULL;
+    }
+#else
+    (void)release;
+#endif
+    uint8_t buffLb;
+    do {
+        buffLb = ethernetif->txDesc[index].bit.LB;
+        // Reclaim TX buffers that should belong to software.
+        ethernetif->txDesc[index].bit.LB = 1;
+        ethernetif->txDesc[index].bit.OWN = 1;
+        index = (index + 1) % TX_BUFF_CNT;
+    } while (buffLb == 0);
+}
+
+/**
+    \brief Reserve the TX buffers for the next frame.
+
+    Checks that the TX buffers of the frame, plus the one that must remain
+    empty, have been returned by the GMAC and reclaims them. Must be called
+    with interrupts disabled, and they must stay disabled until the frame has
+    been handed to the GMAC, since raw frames may be sent from interrupts.
+
+    \param ethernetif   An Ethernet interface reference structure.
+    \param bufferCount  The number of TX buffers in the frame.
+    \param release      Release the pbufs of reclaimed frames; see
+                        PacketReclaim().
+
+    \return True if the TX buffers are available.
+**/
+static bool TxReserve(ethInt *ethernetif, uint8_t bufferCount, bool release) {
     uint8_t index = *ethernetif->txBuffIndex;
-    for (uint16_t i = 0; i < TX_BUFF_CNT; i++) {
+    for (uint8_t i = 0; i <= bufferCount; i++) {
         uint8_t tempIndex = (index + i) % TX_BUFF_CNT;
+        if (ethernetif->txDesc[tempIndex].bit.OWN != 1) {
+            return false;
+        }
+        PacketReclaim(ethernetif, tempIndex, release);
+    }
+    return true;
+}
+
+/**
+    \brief Wait for the TX buffers for the next frame and reserve them.
+
+    Returns with interrupts disabled; the caller enables them once the frame
+    has been handed to the GMAC.
+
+    \param ethernetif   An Ethernet interface reference structure.
+    \param bufferCount  The number of TX buffers in the frame.
+**/
+static void TxAcquire(ethInt *ethernetif, uint8_t bufferCount) {
+    while (true) {
+        __disable_irq();
+        if (TxReserve(ethernetif, bufferCount, true)) {
+            return;
+        }
         // LwIP recommends just waiting for something to be available..
-        while (ethernetif->txDesc[tempIndex].bit.OWN != 1) {
+        __enable_irq();
+    }
+}
+
+#if ETHERNET_TX_ZERO_COPY
+/**
+    \brief Release the pbufs of frames the GMAC has finished transmitting.
+
+    \param ethernetif   An Ethernet interface reference structure.
+**/
+void PacketReap(ethInt *ethernetif) {
+    for (uint8_t i = 0; i < TX_BUFF_CNT; i++) {
+        __disable_irq();
+        if (txDescPbuf[i] != NULL && ethernetif->txDesc[i].bit.OWN) {
+            PacketReclaim(ethernetif, i, true);
+        }
+        __enable_irq();
+    }
+}
+
+/**
+    \brief Count the TX buffers needed to send a pbuf chain in place.
+
+    \param p   The pbuf chain to send.
+
+    \return The number of non-empty pbufs in the chain, or 0 if the chain
+    cannot be sent in place because a payload is outside RAM or the chain
+    needs too many TX buffers.
+**/
+static uint8_t PacketZeroCopyCount(packetBuf *p) {
+    uint8_t count = 0;
+    for (packetBuf *q = p; q != NULL; q = q->next) {
+        if (q->len == 0) {
             continue;
         }
-        // GMAC only returns the first TX buffer descriptor to ownership
-        // on transmission complete. Reclaim remaining TX buffers.
-        uint8_t buffLb;
-        do {
-            buffLb = ethernetif->txDesc[tempIndex].bit.LB;
-            // Reclaim TX buffers that should belong to software.
-            ethernetif->txDesc[tempIndex].bit.LB = 1;
-            ethernetif->txDesc[tempIndex].bit.OWN = 1;
-            tempIndex = (tempIndex + 1) % TX_BUFF_CNT;
-        } while (buffLb == 0);
+        uint32_t address = (uint32_t)q->payload;
+        // The payload may be in flash, e.g. a PBUF_ROM from TCP.
+        if (address < HSRAM_ADDR || address + q->len > HSRAM_ADDR + HSRAM_SIZE) {
+            return 0;
+        }
         // Require that one additional buffer always remain available/empty.
-        if (length < TX_BUFFER_SIZE * i) {
-            break;
+        if (++count >= TX_BUFF_CNT) {
+            return 0;
         }
     }
+    return count;
+}
 
-    // Write into the transmit buffer(s).
-    for (uint32_t i = 0; i < TX_BUFF_CNT; i++) {
-        uint32_t bufferLength = min(length, TX_BUFFER_SIZE);
-        memcpy((void *)(ethernetif->txDesc[*ethernetif->txBuffIndex].reg[0]),
-               buffer + (i * TX_BUFFER_SIZE), bufferLength);
-        length -= bufferLength;
+/**
+    \brief Send a pbuf chain by pointing the TX buffer descriptors at the
+    payloads.
 
+    The pbuf is referenced until the frame has been transmitted; see
+    PacketReap().
+
+    \param ethernetif   An Ethernet interface reference structure.
+    \param p           The pbuf chain to send.
+    \param bufferCount The number of TX buffers needed, from
+                        PacketZeroCopyCount().
+**/
+static err_t PacketWriteZeroCopy(ethInt *ethernetif, packetBuf *p,
+                                 uint8_t bufferCount) {
+    TxAcquire(ethernetif, bufferCount);
+
+    uint16_t startIndex = *ethernetif->txBuffIndex;
+    uint16_t endIndex = startIndex;
+
+    // Point the transmit buffer(s) at the payloads.
+    for (packetBuf *q = p; q != NULL; q = q->next) {
+        if (q->len == 0) {
+            continue;
+        }
+        ethernetif->txDesc[*ethernetif->txBuffIndex].reg[0] = (uint32_t)q->payload;
         // Clear all fields except OWN or WRAP.
         ethernetif->txDesc[*ethernetif->txBuffIndex].reg[1] &= (0xC0000000);
         // Set only LEN.
-        ethernetif->txDesc[*ethernetif->txBuffIndex].bit.LEN = bufferLength;
-
-        if (length <= 0) {
-            // Indicate last buffer of this frame.
-            ethernetif->txDesc[*ethernetif->txBuffIndex].bit.LB = 1;
-            endIndex = *ethernetif->txBuffIndex;
-        }
+        ethernetif->txDesc[*ethernetif->txBuffIndex].bit.LEN = q->len;
+        endIndex = *ethernetif->txBuffIndex;
 
         // Increment the TX buffer index.
         *ethernetif->txBuffIndex = (*ethernetif->txBuffIndex + 1) % TX_BUFF_CNT;
+    }
+    // Indicate last buffer of this frame.
+    ethernetif->txDesc[endIndex].bit.LB = 1;
 
-        if (length <= 0) {
-            break;
-        }
+    // Hold the pbuf until the GMAC is done with the payloads.
+    pbuf_ref(p);
+    txDescPbuf[startIndex] = p;
+
+    // Pass the transmit buffers for this frame to the GMAC.
+    for (uint32_t i = endIndex; i != startIndex; i = (i + TX_BUFF_CNT - 1) % TX_BUFF_CNT) {
+        ethernetif->txDesc[i].bit.OWN = 0;
     }
+    // Final hand-off to the GMAC.
+    ethernetif->txDesc[startIndex].bit.OWN = 0;
+
+    // Activate the transmit.
+    GMAC->NCR.bit.TSTART = 1;
+    __enable_irq();
+
+    return ERR_OK;
+}
+#endif // ETHERNET_TX_ZERO_COPY
+
+/**
+    \brief Copy a frame into the reserved TX buffers and send it.
+
+    The frame is an optional header followed by the contents of buffer.
+
+    \param ethernetif   An Ethernet interface reference structure.
+    \param header       The start of the frame, or NULL.
+    \param headerLength The length of the header in bytes.
+    \param buffer       The rest of the frame.
+    \param length       The length of the rest of the frame in bytes.
+**/
+static void PacketFill(ethInt *ethernetif, const uint8_t *header,
+                       uint32_t headerLength, const uint8_t *buffer,
+                       uint32_t length) {
+    uint16_t startIndex = *ethernetif->txBuffIndex;
+    uint16_t endIndex = startIndex;
+    uint32_t remaining = headerLength + length;
+
+    // Write into the transmit buffer(s).
+    do {
+        uint16_t index = *ethernetif->txBuffIndex;
+        uint32_t bufferLength = min(remaining, TX_BUFFER_SIZE);
+#if ETHERNET_TX_ZERO_COPY
+        // Restore the TX buffer in case the descriptor last sent in place.
+        ethernetif->txDesc[index].reg[0] = (uint32_t)txDescBuffer[index];
+#endif
+        uint8_t *dest = (uint8_t *)(ethernetif->txDesc[index].reg[0]);
+        uint32_t copied = 0;
+        while (copied < bufferLength) {
+            uint32_t bytes;
+            if (headerLength > 0) {
+                bytes = min(headerLength, bufferLength - copied);
+                memcpy(dest + copied, header, bytes);
+                header += bytes;
+                headerLength -= bytes;
+            }
+            else {
+                bytes = bufferLength - copied;
+                memcpy(dest + copied, buffer, bytes);
+                buffer += bytes;
+            }
+            copied += bytes;
+        }
+        remaining -= bufferLength;
+
+        // Clear all fields except OWN or WRAP.
+        ethernetif->txDesc[index].reg[1] &= (0xC0000000);
+        // Set only LEN.
+        ethernetif->txDesc[index].bit.LEN = bufferLength;
+        endIndex = index;
+
+        // Increment the TX buffer index.
+        *ethernetif->txBuffIndex = (index + 1) % TX_BUFF_CNT;
+    } while (remaining > 0);
+    // Indicate last buffer of this frame.
+    ethernetif->txDesc[endIndex].bit.LB = 1;
 
     // Pass the transmit buffers for this frame to the GMAC.
     for (uint32_t i = endIndex; i != startIndex; i = (i + TX_BUFF_CNT - 1) % TX_BUFF_CNT) {
@@ -237,10 +602,222 @@ static err_t PacketWrite(ethInt *ethernetif, uint8_t *buffer, uint32_t length) {
 
     // Activate the transmit.
     GMAC->NCR.bit.TSTART = 1;
+}
+
+static err_t PacketWrite(ethInt *ethernetif, uint8_t *buffer, uint32_t length) {
+    TxAcquire(ethernetif, (length + TX_BUFFER_SIZE - 1) / TX_BUFFER_SIZE);
+    PacketFill(ethernetif, NULL, 0, buffer, length);
+    __enable_irq();
 
     return ERR_OK;
 }
 
+#if ETHERNET_RAW_MAX
+// The raw EtherType channels. Entries are packed at the front; the GMAC
+// interrupt reads them, so changes are made with interrupts disabled.
+typedef struct {
+    uint16_t type;
+    ethRawHandler handler;
+    void *arg;
+} rawChannel;
+static rawChannel rawChannels[ETHERNET_RAW_MAX];
+static volatile uint8_t rawChannelCnt = 0;
+// Holds a raw frame that spans more than one RX buffer. Only used with the
+// GMAC interrupt masked, or from it.
+static uint8_t rawFrame[ETHERNET_RAW_FRAME_MAX];
+
+/**
+    \brief Register the handler for frames of an EtherType.
+
+    \param type     The EtherType. IPv4 and ARP belong to LwIP.
+    \param handler  Called with each frame received of the EtherType.
+    \param arg      Passed to the handler.
+
+    \return True if the handler was registered.
+**/
+bool RawRegister(uint16_t type, ethRawHandler handler, void *arg) {
+    if (type == ETHTYPE_IP || type == ETHTYPE_ARP || handler == NULL) {
+        return false;
+    }
+    bool registered = false;
+    __disable_irq();
+    bool found = false;
+    for (uint8_t i = 0; i < rawChannelCnt; i++) {
+        found |= (rawChannels[i].type == type);
+    }
+    if (!found && rawChannelCnt < ETHERNET_RAW_MAX) {
+        rawChannels[rawChannelCnt].type = type;
+        rawChannels[rawChannelCnt].handler = handler;
+        rawChannels[rawChannelCnt].arg = arg;
+        rawChannelCnt++;
+        registered = true;
+    }
+    __enable_irq();
+    return registered;
+}
+
+/**
+    \brief Remove the handler for frames of an EtherType.
+
+    Frames of the EtherType are passed to LwIP again, which drops them.
+
+    \param type     The EtherType.
+**/
+void RawUnregister(uint16_t type) {
+    __disable_irq();
+    for (uint8_t i = 0; i < rawChannelCnt; i++) {
+        if (rawChannels[i].type == type) {
+            rawChannels[i] = rawChannels[--rawChannelCnt];
+            break;
+        }
+    }
+    __enable_irq();
+}
+
+/**
+    \brief Send a raw frame without waiting.
+
+    Safe to call from an interrupt; the frame is dropped rather than waiting
+    for TX buffers.
+
+    \param ethernetif   An Ethernet interface reference structure.
+    \param header       The Ethernet header of the frame.
+    \param payload      The payload of the frame.
+    \param length       The length of the payload in bytes.
+
+    \return True if the frame was handed to the GMAC.
+**/
+bool RawSend(ethInt *ethernetif, const struct eth_hdr *header,
+             const uint8_t *payload, uint16_t length) {
+    uint32_t frameLength = SIZEOF_ETH_HDR + length;
+    uint8_t bufferCount = (frameLength + TX_BUFFER_SIZE - 1) / TX_BUFFER_SIZE;
+    if (bufferCount >= TX_BUFF_CNT) {
+        return false;
+    }
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    // Reclaiming here must not release pbufs; that is left to LwIP.
+    bool reserved = TxReserve(ethernetif, bufferCount, false);
+    if (reserved) {
+        PacketFill(ethernetif, (const uint8_t *)header, SIZEOF_ETH_HDR,
+                   payload, length);
+    }
+    __set_PRIMASK(primask);
+    return reserved;
+}
+
+/**
+    \brief Pass the raw frames at the front of the RX descriptors to their
+    handlers.
+
+    Stops at the first frame of an EtherType without a handler, which is left
+    for LwIP. Called from the GMAC interrupt, or with it masked.
+
+    \param ethernetif   An Ethernet interface reference structure.
+**/
+void RawDispatch(ethInt *ethernetif) {
+    while (rawChannelCnt) {
+        uint8_t startOffset;
+        uint8_t bufferCount;
+        uint32_t length = PacketFind(ethernetif, &startOffset, &bufferCount);
+        if (length < SIZEOF_ETH_HDR) {
+            return;
+        }
+
+        uint8_t index = (*ethernetif->rxBuffIndex + startOffset) % RX_BUFF_CNT;
+        // Mask to ignore the lowest 2 bits that are not part of the address.
+        const uint8_t *frame =
+            (const uint8_t *)(ethernetif->rxDesc[index].reg[0] & 0xFFFFFFFC);
+        uint16_t type = htons(((const struct eth_hdr *)frame)->type);
+        rawChannel *channel = NULL;
+        for (uint8_t i = 0; i < rawChannelCnt; i++) {
+            if (rawChannels[i].type == type) {
+                channel = &rawChannels[i];
+                break;
+            }
+        }
+        if (channel == NULL) {
+            return;
+        }
+
+        length = min(length, ETHERNET_RAW_FRAME_MAX);
+        if (bufferCount > 1) {
+            // Gather the frame so the handler sees it in one piece.
+            uint32_t copied = 0;
+            for (uint8_t i = 0; i < bufferCount && copied < length; i++) {
+                uint8_t bufferIndex = (index + i) % RX_BUFF_CNT;
+                uint32_t bytes = min(length - copied, RX_BUFFER_SIZE);
+                memcpy(rawFrame + copied,
+                       (void *)(ethernetif->rxDesc[bufferIndex].reg[0] & 0xFFFFFFFC),
+                       bytes);
+                copied += bytes;
+            }
+            frame = rawFrame;
+        }
+        channel->handler(channel->arg, frame, length);
+
+        // Give the frame's RX buffers, and any ahead of it, back to hardware.
+        for (uint8_t i = 0; i < startOffset + bufferCount; i++) {
+            ethernetif->rxDesc[*(ethernetif->rxBuffIndex)].bit.OWN = 0;
+            *ethernetif->rxBuffIndex = (*(ethernetif->rxBuffIndex) + 1) % RX_BUFF_CNT;
+        }
+    }
+}
+#endif // ETHERNET_RAW_MAX
+
+#if LWIP_IGMP
+// The number of groups using each of the 64 bits of the GMAC hash filter.
+// Groups may share a bit, so a bit is only cleared once its last group leaves.
+static uint8_t macHashRefs[64];
+
+/**
+    Compute the GMAC hash filter index of a MAC address. Each bit of the 6-bit
+    index is the XOR of every sixth bit of the address, with bit 0 being the
+    first bit on the wire (the LSB of the first byte).
+**/
+static uint8_t MacHashIndex(const uint8_t *mac) {
+    uint8_t index = 0;
+    for (uint8_t bit = 0; bit < 48; bit++) {
+        if ((mac[bit >> 3] >> (bit & 7)) & 1) {
+            index ^= 1 << (bit % 6);
+        }
+    }
+    return index;
+}
+
+/**
+    Add or remove an IPv4 multicast group from the GMAC hash filter.
+    Registered with the netif so LwIP calls it as groups are joined and left.
+
+    @param netif the lwip network interface structure for this ethernetif
+    @param group the multicast group address
+    @param action whether to add or remove the group
+    @return ERR_OK
+**/
+static err_t igmp_mac_filter(netInt *netif, const ip4_addr_t *group,
+                             enum netif_mac_filter_action action) {
+    LWIP_UNUSED_ARG(netif);
+    // IPv4 multicast MAC: 01:00:5E followed by the low 23 bits of the group
+    uint8_t mac[6] = {0x01, 0x00, 0x5E,
+                      (uint8_t)(ip4_addr2(group) & 0x7F),
+                      ip4_addr3(group), ip4_addr4(group)
+                     };
+    uint8_t index = MacHashIndex(mac);
+    volatile uint32_t *hashReg = (index < 32) ? &GMAC->HRB.reg : &GMAC->HRT.reg;
+    uint32_t hashBit = 1UL << (index & 31);
+
+    if (action == NETIF_ADD_MAC_FILTER) {
+        if (macHashRefs[index]++ == 0) {
+            *hashReg |= hashBit;
+        }
+    }
+    else if (macHashRefs[index] && --macHashRefs[index] == 0) {
+        *hashReg &= ~hashBit;
+    }
+    return ERR_OK;
+}
+#endif // LWIP_IGMP
+
 /**
     In this function, the hardware should be initialized.
     Called from ethernetif_init().
@@ -255,6 +832,21 @@ static void low_level_init(netInt *netif) {
     // Specific Address Top stores the last two bytes.
     memcpy((void *)&GMAC->Sa[0].SAT.reg, netif->hwaddr + 4, 2);
 
+#if GMAC_CHECKSUM_OFFLOAD
+    // Generate TX checksums and drop RX frames with bad checksums in hardware
+    GMAC->DCFGR.bit.TXCOEN = 1;
+    GMAC->NCFGR.bit.RXCOEN = 1;
+#endif
+
+#if LWIP_IGMP
+    // Accept the multicast groups that hash into the GMAC hash filter
+    GMAC->HRB.reg = 0;
+    GMAC->HRT.reg = 0;
+    memset(macHashRefs, 0, sizeof(macHashRefs));
+    GMAC->NCFGR.bit.MTIHEN = 1;
+    netif_set_igmp_mac_filter(netif, igmp_mac_filter);
+#endif
+
 #if LWIP_IPV6 && LWIP_IPV6_MLD
   // May need to implement something here if we are using MAC filtering.
 #endif
@@ -288,6 +880,13 @@ static err_t low_level_output(netInt *netif, packetBuf *p) {
     pbuf_header(p, -ETH_PAD_SIZE); // Drop the padding word.
 #endif
 
+#if ETHERNET_TX_ZERO_COPY
+    uint8_t bufferCount = PacketZeroCopyCount(p);
+    if (bufferCount != 0) {
+        err = PacketWriteZeroCopy(ethernetif, p, bufferCount);
+    }
+    else
+#endif
     if (p->tot_len == p->len) {
         err = PacketWrite(ethernetif, (uint8_t *)p->payload, p->tot_len);
     }
@@ -324,18 +923,38 @@ static err_t low_level_output(netInt *netif, packetBuf *p) {
     @return a pbuf filled with the received packet (including MAC header)
         NULL on memory error
 **/
-static packetBuf *low_level_input(netInt *netif) {
+static packetBuf *PacketInput(netInt *netif) {
     ethInt *ethernetif;
     packetBuf *p;
     uint32_t length;
     ethernetif = (ethInt *)netif->state;
 
+#if ETHERNET_RX_ZERO_COPY
+    uint8_t startOffset;
+    uint8_t bufferCount;
+
+    // Obtain the size of the packet.
+    length = PacketFind(ethernetif, &startOffset, &bufferCount);
+
+    if (length == 0) {
+        return NULL;
+    }
+
+    if (bufferCount <= rxPbufFreeCnt) {
+        p = PacketWrap(ethernetif, startOffset, bufferCount, length);
+        LINK_STATS_INC(link.recv);
+        return p;
+    }
+    // LwIP still holds too many earlier frames to swap out all of this
+    // frame's buffers, so copy it instead.
+#else
     // Obtain the size of the packet.
     length = PacketLength(ethernetif);
 
     if (length == 0) {
         return NULL;
     }
+#endif
 
     // Allow room for Ethernet padding.
 #if ETH_PAD_SIZE
@@ -366,6 +985,27 @@ static packetBuf *low_level_input(netInt *netif) {
     return p;
 }
 
+/**
+    Returns the next received frame for LwIP, after handing any raw frames
+    ahead of it to their handlers.
+
+    @param netif the lwip network interface structure for this ethernetif
+    @return a pbuf filled with the received packet (including MAC header)
+        NULL on memory error
+**/
+static packetBuf *low_level_input(netInt *netif) {
+#if ETHERNET_RAW_MAX
+    // The GMAC interrupt takes raw frames off the RX descriptors too.
+    NVIC_DisableIRQ(GMAC_IRQn);
+    RawDispatch((ethInt *)netif->state);
+    packetBuf *p = PacketInput(netif);
+    NVIC_EnableIRQ(GMAC_IRQn);
+    return p;
+#else
+    return PacketInput(netif);
+#endif
+}
+
 /**
     This function should be called when a packet is ready to be read
     from the interface. Then the type of the received packet is determined and
@@ -414,6 +1054,9 @@ err_t ethernetif_init(netInt *netif) {
     // flags to set device capabilities
     netif->flags = NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP |
                    NETIF_FLAG_ETHERNET;
+#if LWIP_IGMP
+    netif->flags |= NETIF_FLAG_IGMP;
+#endif
     // maximum transfer unit
     netif->mtu = 1536;
 
@@ -18,6 +18,76 @@
 #define NO_SYS 1
 #endif
 
+// <o> Memory profile
+// <0=> Default
+// <1=> Throughput: large TCP windows and send buffers
+// <2=> Low RAM: a single TCP connection and small pools, e.g. UDP-only nodes
+// <3=> Many connections: more TCP PCBs with default-sized windows
+// <i> Selects the defaults for the pool and buffer sizes below. Settings
+// <i> defined explicitly take precedence over the profile.
+// <i> Default: 0
+// <id> lwip_mem_profile
+#define LWIP_MEM_PROFILE_DEFAULT 0
+#define LWIP_MEM_PROFILE_THROUGHPUT 1
+#define LWIP_MEM_PROFILE_LOW_RAM 2
+#define LWIP_MEM_PROFILE_MANY_CONNECTIONS 3
+#ifndef LWIP_MEM_PROFILE
+#define LWIP_MEM_PROFILE LWIP_MEM_PROFILE_DEFAULT
+#endif
+
+#if LWIP_MEM_PROFILE == LWIP_MEM_PROFILE_THROUGHPUT
+#ifndef MEM_SIZE
+#define MEM_SIZE 16384
+#endif
+#ifndef PBUF_POOL_SIZE
+#define PBUF_POOL_SIZE 24
+#endif
+#ifndef TCP_WND_MUL
+#define TCP_WND_MUL 8
+#endif
+#ifndef TCP_SND_BUF_MUL
+#define TCP_SND_BUF_MUL 8
+#endif
+#ifndef MEMP_NUM_TCP_SEG
+#define MEMP_NUM_TCP_SEG 32
+#endif
+#elif LWIP_MEM_PROFILE == LWIP_MEM_PROFILE_LOW_RAM
+#ifndef MEM_SIZE
+#define MEM_SIZE 2048
+#endif
+#ifndef PBUF_POOL_SIZE
+#define PBUF_POOL_SIZE 8
+#endif
+#ifndef TCP_WND_MUL
+#define TCP_WND_MUL 2
+#endif
+#ifndef MEMP_NUM_TCP_PCB
+#define MEMP_NUM_TCP_PCB 1
+#endif
+#ifndef MEMP_NUM_TCP_PCB_LISTEN
+#define MEMP_NUM_TCP_PCB_LISTEN 1
+#endif
+#ifndef MEMP_NUM_TCP_SEG
+#define MEMP_NUM_TCP_SEG 8
+#endif
+#ifndef MEMP_NUM_ARP_QUEUE
+#define MEMP_NUM_ARP_QUEUE 8
+#endif
+#elif LWIP_MEM_PROFILE == LWIP_MEM_PROFILE_MANY_CONNECTIONS
+#ifndef MEM_SIZE
+#define MEM_SIZE 8192
+#endif
+#ifndef PBUF_POOL_SIZE
+#define PBUF_POOL_SIZE 24
+#endif
+#ifndef MEMP_NUM_TCP_PCB
+#define MEMP_NUM_TCP_PCB 16
+#endif
+#ifndef MEMP_NUM_TCP_SEG
+#define MEMP_NUM_TCP_SEG 32
+#endif
+#endif
+
 // <o> The size of the heap memory <0-100000>
 // <i> Defines size of the heap memory
 // <i> Default: 4096
@@ -59,7 +129,7 @@
 // <q> Enables IGMP
 // <id> lwip_igmp
 #ifndef LWIP_IGMP
-#define LWIP_IGMP 0
+#define LWIP_IGMP 1
 #endif
 
 // <q> Enables SLIP interface
@@ -91,6 +161,25 @@
 #define PPPOS_SUPPORT 0
 #endif
 
+// <q> Let the GMAC generate and verify IP, TCP and UDP checksums
+// <id> gmac_checksum_offload
+#ifndef GMAC_CHECKSUM_OFFLOAD
+#define GMAC_CHECKSUM_OFFLOAD 1
+#endif
+
+#if GMAC_CHECKSUM_OFFLOAD
+// The GMAC fills in the IP header, TCP and UDP checksums of outgoing frames
+// and discards incoming frames whose checksums are bad. ICMP checksums are
+// not offloaded. UDP checksums of fragmented datagrams are neither filled
+// in (they are sent as 0, meaning none) nor verified.
+#define CHECKSUM_GEN_IP 0
+#define CHECKSUM_GEN_UDP 0
+#define CHECKSUM_GEN_TCP 0
+#define CHECKSUM_CHECK_IP 0
+#define CHECKSUM_CHECK_UDP 0
+#define CHECKSUM_CHECK_TCP 0
+#endif
+
 // </h>
 
 // <e> Advanced Configuration
@@ -155,6 +244,16 @@
 #define MEMP_NUM_TCP_SEG 16
 #endif
 
+// <o> the number of simultaneously active timeouts<0-1000>
+// <i> The stack's own timeouts plus one per TCP connection for the send
+// <i> coalescing of EthernetTcpClient::SendCoalesce(), and one for the
+// <i> SntpManager poll
+// <id> lwip_memp_num_sys_timeout
+#ifndef MEMP_NUM_SYS_TIMEOUT
+#define MEMP_NUM_SYS_TIMEOUT \
+    (LWIP_NUM_SYS_TIMEOUT_INTERNAL + MEMP_NUM_TCP_PCB + 1)
+#endif
+
 // <o> Number of bytes added before the ethernet header CPU<0-100000>
 // <i> Ensure alignment of payload after that header
 // <i> Default:  2 can speed up 32-bit-platforms
@@ -306,6 +405,13 @@
 
 #define PBUF_POOL_BUFSIZE LWIP_MEM_ALIGN_SIZE(TCP_MSS + 40 + PBUF_LINK_HLEN + PBUF_POOL_BUFSIZE_ADDED)
 
+// <q> Support custom pbufs with application-defined free functions
+// <i> Used by the zero-copy Ethernet receive path
+// <id> lwip_support_custom_pbuf
+#ifndef LWIP_SUPPORT_CUSTOM_PBUF
+#define LWIP_SUPPORT_CUSTOM_PBUF 1
+#endif
+
 // <o> the number of multicast groups<0-1000>
 // <i> the number of multicast groups
 // <i> Default: 8
@@ -388,9 +494,11 @@
 #endif
 
 // <q> Enables statistics collection in lwip_stats
+// <i> Only the heap and pool statistics reported by EthernetManager are
+// <i> enabled by default.
 // <id> lwip_stats
 #ifndef LWIP_STATS
-#define LWIP_STATS 0
+#define LWIP_STATS 1
 #endif
 
 // <q> Compile in the statistics output functions
@@ -447,10 +555,23 @@
 #define TCP_STATS 0
 #endif
 
+// <q> Enable SNMP MIB2 stats
+// <i> Counts the TCP retransmissions reported by EthernetManager.
+// <id> lwip_mib2_stats
+#ifndef MIB2_STATS
+#define MIB2_STATS 1
+#endif
+
 // <q> Enable memp.c stats
 // <id> lwip_memp_stats
 #ifndef MEMP_STATS
-#define MEMP_STATS 0
+#define MEMP_STATS 1
+#endif
+
+// <q> Enable mem.c stats
+// <id> lwip_mem_stats
+#ifndef MEM_STATS
+#define MEM_STATS 1
 #endif
 
 // <q> Enable system stats
@@ -0,0 +1,361 @@
+/*
+ * Title: EthernetBenchmark
+ *
+ * Objective:
+ *    This example measures the throughput and latency of the ClearCore's
+ *    Ethernet stack, giving a baseline to compare configuration changes
+ *    against.
+ *
+ * Description:
+ *    Tests are started by sending a single character over the USB serial port
+ *    and report their results back over the same port:
+ *    r - TCP receive: accepts one connection on port 5001 and discards
+ *        everything the client sends until it closes the connection.
+ *    t - TCP transmit: accepts one connection on port 5002 and sends data to
+ *        the client as fast as possible for 10 seconds.
+ *    e - UDP echo latency: sends 1000 small packets, one at a time, to a UDP
+ *        echo service on the PC and times each round trip with the CPU cycle
+ *        counter. Prints the minimum, mean, and maximum, and a histogram with
+ *        power-of-two microsecond buckets.
+ *    p - UDP packet rate: sends minimum size packets to the PC's discard port
+ *        for 5 seconds, then counts the packets received on port 5003 for 5
+ *        seconds.
+ *
+ * Requirements:
+ * ** A PC on the same network as the ClearCore. Set remoteIp below to the PC's
+ *    IP address. Tools such as iperf, netcat, or socat can act as the other
+ *    end of each test, for example:
+ *      r: nc <ClearCore IP> 5001 < largefile
+ *      t: nc <ClearCore IP> 5002 > /dev/null
+ *      e: socat UDP4-RECVFROM:7,fork EXEC:cat
+ *      p: iperf -u -c <ClearCore IP> -p 5003 -l 18 -b 100M
+ * ** A serial terminal connected to the ClearCore's USB port. PuTTY is one
+ *    such application: https://www.putty.org/
+ *
+ * Links:
+ * ** ClearCore Documentation: https://teknic-inc.github.io/ClearCore-library/
+ * ** ClearCore Manual: https://www.teknic.com/files/downloads/clearcore_user_manual.pdf
+ *
+ * 
+ * Copyright (c) 2020 Teknic Inc. This work is free to use, copy and distribute under the terms of
+ * the standard MIT permissive software license which can be found at https://opensource.org/licenses/MIT
+ */
+#include <sam.h>
+#include <stdio.h>
+#include "ClearCore.h"
+#include "EthernetTcpServer.h"
+#include "EthernetUdp.h"
+
+// Change the IP address below to match your ClearCore's IP address.
+IpAddress ip = IpAddress(192, 168, 1, 177);
+
+// Change the IP address below to match the PC running the other end of the
+// tests.
+IpAddress remoteIp = IpAddress(192, 168, 1, 100);
+
+// Set this false if not using DHCP to configure the local IP address.
+bool usingDhcp = true;
+
+// Test ports
+#define TCP_RX_PORT 5001
+#define TCP_TX_PORT 5002
+#define UDP_RX_PORT 5003
+#define UDP_LOCAL_PORT 5004
+#define UDP_ECHO_PORT 7
+#define UDP_DISCARD_PORT 9
+
+// Test durations and sizes
+#define TCP_TX_TIME_MS 10000
+#define UDP_RATE_TIME_MS 5000
+#define ECHO_COUNT 1000
+#define ECHO_TIMEOUT_MS 100
+#define ECHO_SIZE 64
+#define RATE_SIZE 18
+#define RATE_BATCH 8
+#define BUFFER_SIZE 1460
+
+// Power-of-two latency buckets: bucket n counts round trips of less than
+// 2^n microseconds; the last bucket holds everything longer.
+#define HISTOGRAM_BUCKETS 16
+
+uint8_t buffer[BUFFER_SIZE];
+char line[80];
+
+EthernetTcpServer rxServer = EthernetTcpServer(TCP_RX_PORT);
+EthernetTcpServer txServer = EthernetTcpServer(TCP_TX_PORT);
+EthernetUdp udp;
+
+void TcpReceiveTest();
+void TcpTransmitTest();
+void UdpEchoTest();
+void UdpRateTest();
+EthernetTcpClient WaitForClient(EthernetTcpServer &server);
+void PrintRate(const char *label, uint64_t bytes, uint32_t elapsedMs);
+
+int main() {
+    // Set up serial communication over USB and wait up to 5 seconds for a
+    // terminal to open the port.
+    ConnectorUsb.Mode(Connector::USB_CDC);
+    ConnectorUsb.Speed(9600);
+    ConnectorUsb.PortOpen();
+
+    uint32_t timeout = 5000;
+    uint32_t startTime = Milliseconds();
+    while (!ConnectorUsb && Milliseconds() - startTime < timeout) {
+        continue;
+    }
+
+    // Make sure the physical link is up before continuing.
+    while (!EthernetMgr.PhyLinkActive()) {
+        ConnectorUsb.SendLine("The Ethernet cable is unplugged...");
+        Delay_ms(1000);
+    }
+
+    // Run the setup for the ClearCore Ethernet manager.
+    EthernetMgr.Setup();
+
+    if (usingDhcp) {
+        // Use DHCP to configure the local IP address.
+        bool dhcpSuccess = EthernetMgr.DhcpBegin();
+        if (dhcpSuccess) {
+            ConnectorUsb.Send("DHCP successfully assigned an IP address: ");
+            ConnectorUsb.SendLine(EthernetMgr.LocalIp().StringValue());
+        }
+        else {
+            ConnectorUsb.SendLine("DHCP configuration was unsuccessful!");
+            while (true) {
+                // The tests will not work without a configured IP address.
+                continue;
+            }
+        }
+    }
+    else {
+        EthernetMgr.LocalIp(ip);
+    }
+
+    rxServer.Begin();
+    txServer.Begin();
+    // Reserve buffers to send the packet rate test in batches.
+    udp.Begin(UDP_LOCAL_PORT, RATE_BATCH, RATE_SIZE);
+
+    while (true) {
+        ConnectorUsb.SendLine();
+        ConnectorUsb.SendLine("r: TCP receive, t: TCP transmit, "
+                              "e: UDP echo latency, p: UDP packet rate");
+
+        int16_t command = -1;
+        while (command < 0) {
+            // Keep the stack serviced while waiting for a command.
+            EthernetMgr.Refresh();
+            command = ConnectorUsb.CharGet();
+        }
+
+        switch (command) {
+            case 'r':
+                TcpReceiveTest();
+                break;
+            case 't':
+                TcpTransmitTest();
+                break;
+            case 'e':
+                UdpEchoTest();
+                break;
+            case 'p':
+                UdpRateTest();
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+// Wait for a client to connect to the server, or for any key to cancel.
+EthernetTcpClient WaitForClient(EthernetTcpServer &server) {
+    while (ConnectorUsb.CharGet() < 0) {
+        EthernetMgr.Refresh();
+        EthernetTcpClient client = server.Accept();
+        if (client.Connected()) {
+            ConnectorUsb.Send("Connected to ");
+            ConnectorUsb.SendLine(client.RemoteIp().StringValue());
+            return client;
+        }
+    }
+    return EthernetTcpClient();
+}
+
+// Print a transfer total and rate in kilobits per second.
+void PrintRate(const char *label, uint64_t bytes, uint32_t elapsedMs) {
+    uint32_t kbps = elapsedMs ? (bytes * 8) / elapsedMs : 0;
+    snprintf(line, sizeof(line), "%s: %lu bytes in %lu ms, %lu kbit/s",
+             label, static_cast<unsigned long>(bytes),
+             static_cast<unsigned long>(elapsedMs),
+             static_cast<unsigned long>(kbps));
+    ConnectorUsb.SendLine(line);
+}
+
+void TcpReceiveTest() {
+    ConnectorUsb.SendLine("Waiting for a connection on port 5001...");
+    EthernetTcpClient client = WaitForClient(rxServer);
+    if (!client.ConnectionState()) {
+        return;
+    }
+
+    // Time from the first byte received to the connection being closed.
+    uint64_t bytes = 0;
+    uint32_t startMs = 0;
+    while (client.Connected() || client.BytesAvailable() > 0) {
+        EthernetMgr.Refresh();
+        int16_t bytesRead = client.Read(buffer, sizeof(buffer));
+        if (bytesRead > 0) {
+            if (!bytes) {
+                startMs = Milliseconds();
+            }
+            bytes += bytesRead;
+        }
+    }
+    uint32_t elapsedMs = Milliseconds() - startMs;
+    client.Close();
+    PrintRate("TCP receive", bytes, elapsedMs);
+}
+
+void TcpTransmitTest() {
+    ConnectorUsb.SendLine("Waiting for a connection on port 5002...");
+    EthernetTcpClient client = WaitForClient(txServer);
+    if (!client.ConnectionState()) {
+        return;
+    }
+    for (uint16_t i = 0; i < sizeof(buffer); i++) {
+        buffer[i] = i;
+    }
+
+    // Only send as much as fits the send buffer so the loop never blocks.
+    uint64_t bytes = 0;
+    uint32_t startMs = Milliseconds();
+    while (client.Connected() && Milliseconds() - startMs < TCP_TX_TIME_MS) {
+        EthernetMgr.Refresh();
+        uint32_t space = client.SendSpace();
+        if (space) {
+            bytes += client.Send(buffer, min(space, sizeof(buffer)));
+        }
+    }
+    uint32_t elapsedMs = Milliseconds() - startMs;
+    client.Close();
+    PrintRate("TCP transmit", bytes, elapsedMs);
+}
+
+void UdpEchoTest() {
+    uint32_t histogram[HISTOGRAM_BUCKETS] = {0};
+    uint32_t minUs = UINT32_MAX, maxUs = 0, lost = 0;
+    uint64_t totalUs = 0;
+
+    ConnectorUsb.SendLine("Timing UDP echoes...");
+    for (uint32_t seq = 0; seq < ECHO_COUNT; seq++) {
+        // Each packet carries its sequence number so a late echo of an
+        // earlier packet isn't mistaken for this one.
+        memset(buffer, 0, ECHO_SIZE);
+        memcpy(buffer, &seq, sizeof(seq));
+
+        // Discard anything left over from the last round trip.
+        while (udp.PacketParse()) {
+            continue;
+        }
+
+        uint32_t startCycles = DWT->CYCCNT;
+        udp.Connect(remoteIp, UDP_ECHO_PORT);
+        udp.PacketWrite(buffer, ECHO_SIZE);
+        udp.PacketSend();
+
+        bool echoed = false;
+        while (!echoed && (DWT->CYCCNT - startCycles) <
+                ECHO_TIMEOUT_MS * CYCLES_PER_MILLISECOND) {
+            if (udp.PacketParse() == ECHO_SIZE) {
+                uint32_t echoSeq;
+                udp.PacketRead(buffer, ECHO_SIZE);
+                memcpy(&echoSeq, buffer, sizeof(echoSeq));
+                echoed = echoSeq == seq;
+            }
+        }
+        uint32_t elapsedUs =
+            (DWT->CYCCNT - startCycles) / CYCLES_PER_MICROSECOND;
+        if (!echoed) {
+            lost++;
+            continue;
+        }
+
+        uint8_t bucket = 0;
+        while (bucket < HISTOGRAM_BUCKETS - 1 &&
+                elapsedUs >= (1UL << bucket)) {
+            bucket++;
+        }
+        histogram[bucket]++;
+        minUs = min(minUs, elapsedUs);
+        maxUs = max(maxUs, elapsedUs);
+        totalUs += elapsedUs;
+    }
+
+    uint32_t received = ECHO_COUNT - lost;
+    if (!received) {
+        ConnectorUsb.SendLine("No echoes were received.");
+        return;
+    }
+    snprintf(line, sizeof(line),
+             "%lu echoes, %lu lost; min %lu us, mean %lu us, max %lu us",
+             static_cast<unsigned long>(received),
+             static_cast<unsigned long>(lost),
+             static_cast<unsigned long>(minUs),
+             static_cast<unsigned long>(totalUs / received),
+             static_cast<unsigned long>(maxUs));
+    ConnectorUsb.SendLine(line);
+    for (uint8_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        if (!histogram[i]) {
+            continue;
+        }
+        if (i < HISTOGRAM_BUCKETS - 1) {
+            snprintf(line, sizeof(line), "  < %6lu us: %lu",
+                     1UL << i, static_cast<unsigned long>(histogram[i]));
+        }
+        else {
+            snprintf(line, sizeof(line), " >= %6lu us: %lu",
+                     1UL << (i - 1),
+                     static_cast<unsigned long>(histogram[i]));
+        }
+        ConnectorUsb.SendLine(line);
+    }
+}
+
+void UdpRateTest() {
+    ConnectorUsb.SendLine("Sending to the discard port...");
+    uint32_t sent = 0;
+    uint32_t startMs = Milliseconds();
+    while (Milliseconds() - startMs < UDP_RATE_TIME_MS) {
+        EthernetMgr.Refresh();
+        // Queue as many packets as are free, then hand them off together.
+        uint8_t *payload;
+        while ((payload = udp.BatchPacketBegin())) {
+            memset(payload, 0, RATE_SIZE);
+            memcpy(payload, &sent, sizeof(sent));
+            udp.BatchPacketQueue(remoteIp, UDP_DISCARD_PORT, RATE_SIZE);
+        }
+        sent += udp.BatchSend();
+    }
+    snprintf(line, sizeof(line), "UDP transmit: %lu packets/s",
+             static_cast<unsigned long>(sent * 1000UL / UDP_RATE_TIME_MS));
+    ConnectorUsb.SendLine(line);
+
+    // Only the newest packet is kept between calls to PacketParse(), so this
+    // counts the packets the application is able to see.
+    ConnectorUsb.SendLine("Counting packets received on port 5003...");
+    EthernetUdp rxUdp;
+    rxUdp.Begin(UDP_RX_PORT);
+    uint32_t received = 0;
+    startMs = Milliseconds();
+    while (Milliseconds() - startMs < UDP_RATE_TIME_MS) {
+        if (rxUdp.PacketParse()) {
+            received++;
+        }
+    }
+    rxUdp.End();
+    snprintf(line, sizeof(line), "UDP receive: %lu packets/s",
+             static_cast<unsigned long>(received * 1000UL / UDP_RATE_TIME_MS));
+    ConnectorUsb.SendLine(line);
+}
@@ -0,0 +1,297 @@
+/*
+ * Title: MotionBenchmark
+ *
+ * Objective:
+ *    This example measures how many CPU cycles the motor connectors take in
+ *    the sample rate interrupt, giving a baseline to compare library changes
+ *    and motion features against.
+ *
+ * Description:
+ *    Each scenario runs on 1 to 4 axes at once: idle, cruising at constant
+ *    velocity, accelerating, starting short triangle profile moves, and
+ *    reversing a velocity move. While it runs, every motor connector times
+ *    its refresh and the StepGenerator's share of it with the CPU cycle
+ *    counter. When all scenarios have run, a table is printed over the USB
+ *    serial port with columns:
+ *    Steps - StepGenerator step calculation, per axis
+ *    Refresh - the whole motor connector refresh, per axis
+ *    ISR - the whole sample rate interrupt
+ *    Each shows the mean and maximum cycles; per-axis columns show the
+ *    slowest axis. At 120 MHz and 5 kHz, the interrupt has 24000 cycles per
+ *    sample.
+ *    Send any character over the serial port to run the table again.
+ *
+ * Requirements:
+ * ** The library built with CLEARCORE_ISR_PROFILE set to 1. Add it to the
+ *    symbols of both the ClearCore project and this one; this project
+ *    already has it.
+ * ** No motors need to be connected; the step outputs run regardless.
+ *    Anything that is connected to M-0 through M-3 will move.
+ * ** A serial terminal connected to the ClearCore's USB port. PuTTY is one
+ *    such application: https://www.putty.org/
+ *
+ * Links:
+ * ** ClearCore Documentation: https://teknic-inc.github.io/ClearCore-library/
+ * ** ClearCore Manual: https://www.teknic.com/files/downloads/clearcore_user_manual.pdf
+ *
+ * 
+ * Copyright (c) 2020 Teknic Inc. This work is free to use, copy and distribute under the terms of
+ * the standard MIT permissive software license which can be found at https://opensource.org/licenses/MIT
+ */
+#include <stdio.h>
+#include "ClearCore.h"
+
+#if !CLEARCORE_ISR_PROFILE
+#error "MotionBenchmark needs the library built with CLEARCORE_ISR_PROFILE=1"
+#endif
+
+// Profile settings
+#define VEL_FAST 100000        // pulses per sec
+#define ACCEL_FAST 2000000     // pulses per sec^2
+#define ACCEL_SLOW 20000       // pulses per sec^2, for a long ramp
+#define TRIANGLE_DIST 2000     // pulses; too short to reach VEL_FAST
+#define WINDOW_MS 500          // how long each steady scenario is measured
+#define MOVE_REPEATS 20        // triangle moves and reversals per scenario
+
+MotorDriver *const motors[MOTOR_CON_CNT] = {
+    &ConnectorM0, &ConnectorM1, &ConnectorM2, &ConnectorM3
+};
+
+// The combined statistics of one scenario
+typedef struct {
+    uint32_t StepsMean;
+    uint32_t StepsMax;
+    uint32_t RefreshMean;
+    uint32_t RefreshMax;
+    uint32_t IsrMean;
+    uint32_t IsrMax;
+} Result;
+
+char line[100];
+
+void RunAll();
+void StatsReset();
+void StatsMerge(Result &result);
+void AxesStop(uint8_t axes);
+void WaitForSteps(uint8_t axes);
+void MeasureIdle(uint8_t axes, Result &result);
+void MeasureCruise(uint8_t axes, Result &result);
+void MeasureAccel(uint8_t axes, Result &result);
+void MeasureMoveStart(uint8_t axes, Result &result);
+void MeasureReversal(uint8_t axes, Result &result);
+void PrintResult(const char *label, uint8_t axes, const Result &result);
+
+int main() {
+    MotorMgr.MotorInputClocking(MotorManager::CLOCK_RATE_HIGH);
+    MotorMgr.MotorModeSet(MotorManager::MOTOR_ALL,
+                          Connector::CPM_MODE_STEP_AND_DIR);
+    for (uint8_t i = 0; i < MOTOR_CON_CNT; i++) {
+        motors[i]->HlfbMode(MotorDriver::HLFB_MODE_STATIC);
+        motors[i]->EnableRequest(true);
+    }
+
+    // Set up serial communication over USB and wait up to 5 seconds for a
+    // terminal to open the port.
+    ConnectorUsb.Mode(Connector::USB_CDC);
+    ConnectorUsb.Speed(9600);
+    ConnectorUsb.PortOpen();
+    uint32_t timeout = 5000;
+    uint32_t startTime = Milliseconds();
+    while (!ConnectorUsb && Milliseconds() - startTime < timeout) {
+        continue;
+    }
+
+    // Let the enables settle before the first move
+    Delay_ms(1000);
+
+    while (true) {
+        RunAll();
+        ConnectorUsb.SendLine("Send any character to run again.");
+        while (ConnectorUsb.CharPeek() < 0) {
+            continue;
+        }
+        ConnectorUsb.FlushInput();
+    }
+}
+
+/*------------------------------------------------------------------------------
+ * RunAll
+ *
+ *    Runs every scenario on 1 to 4 axes and prints the table.
+ */
+void RunAll() {
+    ConnectorUsb.SendLine("Motion ISR cycles (mean/max)");
+    ConnectorUsb.SendLine("Scenario     Axes  Steps         Refresh       "
+                          "ISR");
+    for (uint8_t axes = 1; axes <= MOTOR_CON_CNT; axes++) {
+        Result result;
+        MeasureIdle(axes, result);
+        PrintResult("Idle", axes, result);
+        MeasureCruise(axes, result);
+        PrintResult("Cruise", axes, result);
+        MeasureAccel(axes, result);
+        PrintResult("Accel", axes, result);
+        MeasureMoveStart(axes, result);
+        PrintResult("Move start", axes, result);
+        MeasureReversal(axes, result);
+        PrintResult("Reversal", axes, result);
+    }
+}
+
+/*------------------------------------------------------------------------------
+ * StatsReset
+ *
+ *    Discards the statistics gathered so far.
+ */
+void StatsReset() {
+    SysTiming::IsrStageStats refresh, steps, isr;
+    for (uint8_t i = 0; i < MOTOR_CON_CNT; i++) {
+        motors[i]->RefreshCyclesGet(refresh, steps);
+    }
+    TimingMgr.IsrDurationGet(isr);
+}
+
+/*------------------------------------------------------------------------------
+ * StatsMerge
+ *
+ *    Reads the statistics gathered since the last StatsReset() into result,
+ *    keeping the slowest axis' means and maximums.
+ */
+void StatsMerge(Result &result) {
+    SysTiming::IsrStageStats refresh, steps, isr;
+    for (uint8_t i = 0; i < MOTOR_CON_CNT; i++) {
+        motors[i]->RefreshCyclesGet(refresh, steps);
+        if (steps.Count) {
+            uint32_t mean = steps.TotalCycles / steps.Count;
+            result.StepsMean = max(result.StepsMean, mean);
+            result.StepsMax = max(result.StepsMax, steps.MaxCycles);
+        }
+        if (refresh.Count) {
+            uint32_t mean = refresh.TotalCycles / refresh.Count;
+            result.RefreshMean = max(result.RefreshMean, mean);
+            result.RefreshMax = max(result.RefreshMax, refresh.MaxCycles);
+        }
+    }
+    TimingMgr.IsrDurationGet(isr);
+    if (isr.Count) {
+        result.IsrMean = max(result.IsrMean,
+                             static_cast<uint32_t>(isr.TotalCycles /
+                                                   isr.Count));
+        result.IsrMax = max(result.IsrMax, isr.MaxCycles);
+    }
+}
+
+/*------------------------------------------------------------------------------
+ * AxesStop
+ *
+ *    Stops the first "axes" motors and waits for their steps to finish.
+ */
+void AxesStop(uint8_t axes) {
+    for (uint8_t i = 0; i < axes; i++) {
+        motors[i]->MoveStopAbrupt();
+    }
+    WaitForSteps(axes);
+}
+
+/*------------------------------------------------------------------------------
+ * WaitForSteps
+ *
+ *    Waits for the first "axes" motors to finish their moves.
+ */
+void WaitForSteps(uint8_t axes) {
+    for (uint8_t i = 0; i < axes; i++) {
+        while (!motors[i]->StepsComplete()) {
+            continue;
+        }
+    }
+}
+
+void MeasureIdle(uint8_t axes, Result &result) {
+    result = Result();
+    AxesStop(axes);
+    StatsReset();
+    Delay_ms(WINDOW_MS);
+    StatsMerge(result);
+}
+
+void MeasureCruise(uint8_t axes, Result &result) {
+    result = Result();
+    for (uint8_t i = 0; i < axes; i++) {
+        motors[i]->AccelMax(ACCEL_FAST);
+        motors[i]->MoveVelocity(VEL_FAST);
+    }
+    // Wait out the ramp, with some margin
+    Delay_ms(1000 * VEL_FAST / ACCEL_FAST + 10);
+    StatsReset();
+    Delay_ms(WINDOW_MS);
+    StatsMerge(result);
+    AxesStop(axes);
+}
+
+void MeasureAccel(uint8_t axes, Result &result) {
+    result = Result();
+    // The ramp to VEL_FAST lasts VEL_FAST / ACCEL_SLOW seconds, longer than
+    // the window
+    for (uint8_t i = 0; i < axes; i++) {
+        motors[i]->AccelMax(ACCEL_SLOW);
+        motors[i]->MoveVelocity(VEL_FAST);
+    }
+    Delay_ms(10);
+    StatsReset();
+    Delay_ms(WINDOW_MS);
+    StatsMerge(result);
+    AxesStop(axes);
+}
+
+void MeasureMoveStart(uint8_t axes, Result &result) {
+    result = Result();
+    for (uint8_t i = 0; i < axes; i++) {
+        motors[i]->VelMax(VEL_FAST);
+        motors[i]->AccelMax(ACCEL_FAST);
+    }
+    // The maximum catches the sample that plans each move
+    for (uint16_t rep = 0; rep < MOVE_REPEATS; rep++) {
+        int32_t dist = (rep & 1) ? -TRIANGLE_DIST : TRIANGLE_DIST;
+        StatsReset();
+        for (uint8_t i = 0; i < axes; i++) {
+            motors[i]->Move(dist);
+        }
+        WaitForSteps(axes);
+        StatsMerge(result);
+    }
+}
+
+void MeasureReversal(uint8_t axes, Result &result) {
+    result = Result();
+    for (uint8_t i = 0; i < axes; i++) {
+        motors[i]->AccelMax(ACCEL_FAST);
+        motors[i]->MoveVelocity(VEL_FAST);
+    }
+    Delay_ms(1000 * VEL_FAST / ACCEL_FAST + 10);
+    int32_t vel = VEL_FAST;
+    for (uint16_t rep = 0; rep < MOVE_REPEATS; rep++) {
+        vel = -vel;
+        StatsReset();
+        for (uint8_t i = 0; i < axes; i++) {
+            motors[i]->MoveVelocity(vel);
+        }
+        // Slow down, turn around, and get back up to speed
+        Delay_ms(2000 * VEL_FAST / ACCEL_FAST + 10);
+        StatsMerge(result);
+    }
+    AxesStop(axes);
+}
+
+/*------------------------------------------------------------------------------
+ * PrintResult
+ *
+ *    Prints one row of the table.
+ */
+void PrintResult(const char *label, uint8_t axes, const Result &result) {
+    snprintf(line, sizeof(line), "%-12s %-5u %5lu/%-7lu %5lu/%-7lu %5lu/%lu",
+             label, axes, result.StepsMean, result.StepsMax,
+             result.RefreshMean, result.RefreshMax, result.IsrMean,
+             result.IsrMax);
+    ConnectorUsb.SendLine(line);
+}
+//------------------------------------------------------------------------------
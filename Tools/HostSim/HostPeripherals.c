@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * HostPeripherals.c
+ *
+ * The RAM that stands in for the SAME53 peripheral and core registers in
+ * host builds. See include/sam.h.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sam.h>
+
+#define HOST_SIM_DEFINE(type, name)                                         \
+    uint32_t HostSim_##name[(sizeof(type) + 3) / 4];
+HOST_SIM_PERIPHERALS(HOST_SIM_DEFINE)
+#undef HOST_SIM_DEFINE
+
+NVIC_Type HostSim_NVIC;
+SCB_Type HostSim_SCB;
+SysTick_Type HostSim_SysTick;
+ITM_Type HostSim_ITM;
+DWT_Type HostSim_DWT;
+CoreDebug_Type HostSim_CoreDebug;
+uint32_t HostSim_PRIMASK;
+uint32_t HostSim_IPSR;
+
+void HostSimReset(void) {
+#define HOST_SIM_CLEAR(type, name)                                          \
+    memset(HostSim_##name, 0, sizeof(HostSim_##name));
+    HOST_SIM_PERIPHERALS(HOST_SIM_CLEAR)
+#undef HOST_SIM_CLEAR
+    memset((void *)&HostSim_NVIC, 0, sizeof(HostSim_NVIC));
+    memset((void *)&HostSim_SCB, 0, sizeof(HostSim_SCB));
+    memset((void *)&HostSim_SysTick, 0, sizeof(HostSim_SysTick));
+    memset((void *)&HostSim_ITM, 0, sizeof(HostSim_ITM));
+    memset((void *)&HostSim_DWT, 0, sizeof(HostSim_DWT));
+    memset((void *)&HostSim_CoreDebug, 0, sizeof(HostSim_CoreDebug));
+    HostSim_PRIMASK = 0;
+    HostSim_IPSR = 0;
+}
+
+__attribute__((weak)) void HostSimSystemReset(void) {
+    exit(0);
+}
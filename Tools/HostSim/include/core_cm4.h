@@ -0,0 +1,342 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * core_cm4.h
+ *
+ * Host replacement for the CMSIS Cortex-M4 core header, found by the
+ * device header ahead of the real one in host builds (see sam.h). The core
+ * registers the library uses are RAM-backed like the simulated
+ * peripherals, the NVIC functions keep their state in the simulated NVIC,
+ * and the intrinsics are plain C instead of ARM assembly. __disable_irq()
+ * and __enable_irq() only track PRIMASK; a host build runs interrupt
+ * handlers only when the test calls them.
+ */
+
+#ifndef __CORE_CM4_H_GENERIC
+#define __CORE_CM4_H_GENERIC
+#define __CORE_CM4_H_DEPENDANT
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define __CM4_CMSIS_VERSION_MAIN 5U
+#define __CM4_CMSIS_VERSION_SUB 0U
+#define __CORTEX_M 4U
+
+#ifdef __cplusplus
+#define __I volatile
+#else
+#define __I volatile const
+#endif
+#define __O volatile
+#define __IO volatile
+#define __IM volatile const
+#define __OM volatile
+#define __IOM volatile
+
+#ifndef __STATIC_INLINE
+#define __STATIC_INLINE static inline
+#endif
+#ifndef __STATIC_FORCEINLINE
+#define __STATIC_FORCEINLINE static inline
+#endif
+#ifndef __ASM
+#define __ASM __asm
+#endif
+#ifndef __INLINE
+#define __INLINE inline
+#endif
+#ifndef __WEAK
+#define __WEAK __attribute__((weak))
+#endif
+#ifndef __PACKED
+#define __PACKED __attribute__((packed))
+#endif
+#ifndef __ALIGNED
+#define __ALIGNED(x) __attribute__((aligned(x)))
+#endif
+
+typedef struct {
+    __IOM uint32_t ISER[8U];
+    uint32_t RESERVED0[24U];
+    __IOM uint32_t ICER[8U];
+    uint32_t RESERVED1[24U];
+    __IOM uint32_t ISPR[8U];
+    uint32_t RESERVED2[24U];
+    __IOM uint32_t ICPR[8U];
+    uint32_t RESERVED3[24U];
+    __IOM uint32_t IABR[8U];
+    uint32_t RESERVED4[56U];
+    __IOM uint8_t IP[240U];
+    uint32_t RESERVED5[644U];
+    __OM uint32_t STIR;
+} NVIC_Type;
+
+typedef struct {
+    __IM uint32_t CPUID;
+    __IOM uint32_t ICSR;
+    __IOM uint32_t VTOR;
+    __IOM uint32_t AIRCR;
+    __IOM uint32_t SCR;
+    __IOM uint32_t CCR;
+    __IOM uint8_t SHP[12U];
+    __IOM uint32_t SHCSR;
+    __IOM uint32_t CFSR;
+    __IOM uint32_t HFSR;
+    __IOM uint32_t DFSR;
+    __IOM uint32_t MMFAR;
+    __IOM uint32_t BFAR;
+    __IOM uint32_t AFSR;
+    __IM uint32_t PFR[2U];
+    __IM uint32_t DFR;
+    __IM uint32_t ADR;
+    __IM uint32_t MMFR[4U];
+    __IM uint32_t ISAR[5U];
+    uint32_t RESERVED0[5U];
+    __IOM uint32_t CPACR;
+} SCB_Type;
+
+#define SCB_ICSR_PENDSVSET_Msk (1UL << 28U)
+#define SCB_ICSR_VECTACTIVE_Msk (0x1FFUL)
+
+typedef struct {
+    __IOM uint32_t CTRL;
+    __IOM uint32_t LOAD;
+    __IOM uint32_t VAL;
+    __IM uint32_t CALIB;
+} SysTick_Type;
+
+#define SysTick_CTRL_CLKSOURCE_Msk (1UL << 2U)
+#define SysTick_CTRL_TICKINT_Msk (1UL << 1U)
+#define SysTick_CTRL_ENABLE_Msk (1UL)
+#define SysTick_LOAD_RELOAD_Msk (0xFFFFFFUL)
+
+typedef struct {
+    __OM union {
+        __OM uint8_t u8;
+        __OM uint16_t u16;
+        __OM uint32_t u32;
+    } PORT[32U];
+    uint32_t RESERVED0[864U];
+    __IOM uint32_t TER;
+    uint32_t RESERVED1[15U];
+    __IOM uint32_t TPR;
+    uint32_t RESERVED2[15U];
+    __IOM uint32_t TCR;
+} ITM_Type;
+
+#define ITM_TCR_ITMENA_Msk (1UL)
+
+typedef struct {
+    __IOM uint32_t CTRL;
+    __IOM uint32_t CYCCNT;
+    __IOM uint32_t CPICNT;
+    __IOM uint32_t EXCCNT;
+    __IOM uint32_t SLEEPCNT;
+    __IOM uint32_t LSUCNT;
+    __IOM uint32_t FOLDCNT;
+    __IM uint32_t PCSR;
+} DWT_Type;
+
+#define DWT_CTRL_CYCCNTENA_Msk (1UL)
+
+typedef struct {
+    __IOM uint32_t DHCSR;
+    __OM uint32_t DCRSR;
+    __IOM uint32_t DCRDR;
+    __IOM uint32_t DEMCR;
+} CoreDebug_Type;
+
+#define CoreDebug_DEMCR_TRCENA_Msk (1UL << 24U)
+
+extern NVIC_Type HostSim_NVIC;
+extern SCB_Type HostSim_SCB;
+extern SysTick_Type HostSim_SysTick;
+extern ITM_Type HostSim_ITM;
+extern DWT_Type HostSim_DWT;
+extern CoreDebug_Type HostSim_CoreDebug;
+extern uint32_t HostSim_PRIMASK;
+extern uint32_t HostSim_IPSR;
+
+/*
+ * Called by NVIC_SystemReset(); a host build has nothing to reset into,
+ * so the default ends the program.
+ */
+void HostSimSystemReset(void);
+
+#define NVIC (&HostSim_NVIC)
+#define SCB (&HostSim_SCB)
+#define SysTick (&HostSim_SysTick)
+#define ITM (&HostSim_ITM)
+#define DWT (&HostSim_DWT)
+#define CoreDebug (&HostSim_CoreDebug)
+
+__STATIC_INLINE void __disable_irq(void) {
+    HostSim_PRIMASK = 1U;
+}
+
+__STATIC_INLINE void __enable_irq(void) {
+    HostSim_PRIMASK = 0U;
+}
+
+__STATIC_INLINE uint32_t __get_PRIMASK(void) {
+    return HostSim_PRIMASK;
+}
+
+__STATIC_INLINE void __set_PRIMASK(uint32_t priMask) {
+    HostSim_PRIMASK = priMask & 1U;
+}
+
+/*
+ * Nonzero while a test runs code as if from the interrupt it names.
+ */
+__STATIC_INLINE uint32_t __get_IPSR(void) {
+    return HostSim_IPSR;
+}
+
+__STATIC_INLINE uint32_t __get_MSP(void) {
+    return (uint32_t)(uintptr_t)__builtin_frame_address(0);
+}
+
+__STATIC_INLINE void __DMB(void) {
+    __sync_synchronize();
+}
+
+__STATIC_INLINE void __DSB(void) {
+    __sync_synchronize();
+}
+
+__STATIC_INLINE void __ISB(void) {
+    __sync_synchronize();
+}
+
+__STATIC_INLINE void __NOP(void) {}
+
+__STATIC_INLINE void __WFI(void) {}
+
+__STATIC_INLINE void __WFE(void) {}
+
+__STATIC_INLINE void __SEV(void) {}
+
+__STATIC_INLINE uint8_t __CLZ(uint32_t value) {
+    return value ? (uint8_t)__builtin_clz(value) : 32U;
+}
+
+__STATIC_INLINE uint32_t __REV(uint32_t value) {
+    return __builtin_bswap32(value);
+}
+
+__STATIC_INLINE uint32_t __REV16(uint32_t value) {
+    return ((value & 0xFF00FF00UL) >> 8) | ((value & 0x00FF00FFUL) << 8);
+}
+
+__STATIC_INLINE uint32_t __RBIT(uint32_t value) {
+    uint32_t result = 0;
+    for (uint8_t i = 0; i < 32U; i++) {
+        result = (result << 1) | ((value >> i) & 1U);
+    }
+    return result;
+}
+
+__STATIC_INLINE void NVIC_EnableIRQ(IRQn_Type IRQn) {
+    if ((int32_t)IRQn >= 0) {
+        NVIC->ISER[(uint32_t)IRQn >> 5] |= 1UL << ((uint32_t)IRQn & 0x1FU);
+    }
+}
+
+__STATIC_INLINE void NVIC_DisableIRQ(IRQn_Type IRQn) {
+    if ((int32_t)IRQn >= 0) {
+        NVIC->ISER[(uint32_t)IRQn >> 5] &= ~(1UL << ((uint32_t)IRQn & 0x1FU));
+    }
+}
+
+__STATIC_INLINE uint32_t NVIC_GetEnableIRQ(IRQn_Type IRQn) {
+    if ((int32_t)IRQn < 0) {
+        return 0U;
+    }
+    return (NVIC->ISER[(uint32_t)IRQn >> 5] >> ((uint32_t)IRQn & 0x1FU)) & 1U;
+}
+
+__STATIC_INLINE void NVIC_SetPendingIRQ(IRQn_Type IRQn) {
+    if ((int32_t)IRQn >= 0) {
+        NVIC->ISPR[(uint32_t)IRQn >> 5] |= 1UL << ((uint32_t)IRQn & 0x1FU);
+    }
+}
+
+__STATIC_INLINE void NVIC_ClearPendingIRQ(IRQn_Type IRQn) {
+    if ((int32_t)IRQn >= 0) {
+        NVIC->ISPR[(uint32_t)IRQn >> 5] &= ~(1UL << ((uint32_t)IRQn & 0x1FU));
+    }
+}
+
+__STATIC_INLINE uint32_t NVIC_GetPendingIRQ(IRQn_Type IRQn) {
+    if ((int32_t)IRQn < 0) {
+        return 0U;
+    }
+    return (NVIC->ISPR[(uint32_t)IRQn >> 5] >> ((uint32_t)IRQn & 0x1FU)) & 1U;
+}
+
+__STATIC_INLINE void NVIC_SetPriority(IRQn_Type IRQn, uint32_t priority) {
+    uint8_t value = (uint8_t)(priority << (8U - __NVIC_PRIO_BITS));
+    if ((int32_t)IRQn >= 0) {
+        NVIC->IP[(uint32_t)IRQn] = value;
+    }
+    else {
+        SCB->SHP[((uint32_t)IRQn & 0xFU) - 4U] = value;
+    }
+}
+
+__STATIC_INLINE uint32_t NVIC_GetPriority(IRQn_Type IRQn) {
+    uint8_t value;
+    if ((int32_t)IRQn >= 0) {
+        value = NVIC->IP[(uint32_t)IRQn];
+    }
+    else {
+        value = SCB->SHP[((uint32_t)IRQn & 0xFU) - 4U];
+    }
+    return (uint32_t)value >> (8U - __NVIC_PRIO_BITS);
+}
+
+__STATIC_INLINE void NVIC_SystemReset(void) {
+    HostSimSystemReset();
+}
+
+__STATIC_INLINE uint32_t SysTick_Config(uint32_t ticks) {
+    if (ticks - 1UL > SysTick_LOAD_RELOAD_Msk) {
+        return 1UL;
+    }
+    SysTick->LOAD = ticks - 1UL;
+    SysTick->VAL = 0UL;
+    SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_TICKINT_Msk |
+                    SysTick_CTRL_ENABLE_Msk;
+    return 0UL;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __CORE_CM4_H_GENERIC
@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * sam.h
+ *
+ * Host build seam for the SAME53 device header. On target, libClearCore
+ * reaches every peripheral through the device pack's instance macros
+ * (SERCOM0, TCC0, ADC0, PORT, ...), which are fixed addresses. A host
+ * build puts this directory first on the include path, so the same
+ * sources compile against the same register structures but with each
+ * instance macro pointing at a block of RAM instead. The target build does
+ * not use this directory and still accesses the registers directly.
+ *
+ * The simulated registers are plain memory: a write is kept and read back,
+ * and nothing happens on its own. A benchmark or test stands in for the
+ * hardware by setting the registers a driver reads, such as ADC RESULT,
+ * SERCOM DATA and INTFLAG, or PORT IN, and by calling the driver's update
+ * or interrupt handler itself. The core header next to this one does the
+ * same for DWT, SysTick, SCB, ITM and the NVIC, and replaces the ARM
+ * intrinsics.
+ *
+ * Build with a host C/C++ compiler, from the repository root:
+ *   -DCLEARCORE_HOST_SIM -ITools/HostSim/include -I<SAME53_DFP>/include
+ *   -IlibClearCore/inc ... Tools/HostSim/HostPeripherals.c
+ * where <SAME53_DFP> is the device pack the Atmel Studio project uses. Do
+ * not add the CMSIS core include path; core_cm4.h here replaces it.
+ *
+ * Code that reads absolute addresses outside the peripherals (the NVM
+ * user page and serial number, linker symbols, the stack) is not covered.
+ */
+
+#ifndef __HOST_SIM_SAM_H__
+#define __HOST_SIM_SAM_H__
+
+#ifndef CLEARCORE_HOST_SIM
+#error "Tools/HostSim/include is only for host builds with CLEARCORE_HOST_SIM"
+#endif
+
+#include <stdint.h>
+
+#ifndef __SAME53N19A__
+#define __SAME53N19A__
+#endif
+#include <same53.h>
+
+/*
+ * The peripheral instances given simulated registers, as (type, instance).
+ */
+#define HOST_SIM_PERIPHERALS(X)                                             \
+    X(Ac, AC) X(Adc, ADC0) X(Adc, ADC1) X(Aes, AES) X(Ccl, CCL)             \
+    X(Cmcc, CMCC) X(Dac, DAC) X(Dmac, DMAC) X(Dsu, DSU) X(Eic, EIC)         \
+    X(Evsys, EVSYS) X(Gclk, GCLK) X(Gmac, GMAC) X(I2s, I2S) X(Mclk, MCLK)   \
+    X(Nvmctrl, NVMCTRL) X(Oscctrl, OSCCTRL) X(Osc32kctrl, OSC32KCTRL)       \
+    X(Pac, PAC) X(Pcc, PCC) X(Pdec, PDEC) X(Pm, PM) X(Port, PORT)           \
+    X(Ramecc, RAMECC) X(Rstc, RSTC) X(Rtc, RTC)                             \
+    X(Sercom, SERCOM0) X(Sercom, SERCOM1) X(Sercom, SERCOM2)                \
+    X(Sercom, SERCOM3) X(Sercom, SERCOM4) X(Sercom, SERCOM5)                \
+    X(Sercom, SERCOM6) X(Sercom, SERCOM7) X(Supc, SUPC)                     \
+    X(Tc, TC0) X(Tc, TC1) X(Tc, TC2) X(Tc, TC3)                             \
+    X(Tc, TC4) X(Tc, TC5) X(Tc, TC6) X(Tc, TC7)                             \
+    X(Tcc, TCC0) X(Tcc, TCC1) X(Tcc, TCC2) X(Tcc, TCC3) X(Tcc, TCC4)        \
+    X(Trng, TRNG) X(Usb, USB) X(Wdt, WDT)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HOST_SIM_DECLARE(type, name) extern uint32_t HostSim_##name[];
+HOST_SIM_PERIPHERALS(HOST_SIM_DECLARE)
+#undef HOST_SIM_DECLARE
+
+/*
+ * Clear every simulated peripheral and core register, and the NVIC.
+ */
+void HostSimReset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#undef AC
+#define AC ((Ac *)HostSim_AC)
+#undef ADC0
+#define ADC0 ((Adc *)HostSim_ADC0)
+#undef ADC1
+#define ADC1 ((Adc *)HostSim_ADC1)
+#undef AES
+#define AES ((Aes *)HostSim_AES)
+#undef CCL
+#define CCL ((Ccl *)HostSim_CCL)
+#undef CMCC
+#define CMCC ((Cmcc *)HostSim_CMCC)
+#undef DAC
+#define DAC ((Dac *)HostSim_DAC)
+#undef DMAC
+#define DMAC ((Dmac *)HostSim_DMAC)
+#undef DSU
+#define DSU ((Dsu *)HostSim_DSU)
+#undef EIC
+#define EIC ((Eic *)HostSim_EIC)
+#undef EVSYS
+#define EVSYS ((Evsys *)HostSim_EVSYS)
+#undef GCLK
+#define GCLK ((Gclk *)HostSim_GCLK)
+#undef GMAC
+#define GMAC ((Gmac *)HostSim_GMAC)
+#undef I2S
+#define I2S ((I2s *)HostSim_I2S)
+#undef MCLK
+#define MCLK ((Mclk *)HostSim_MCLK)
+#undef NVMCTRL
+#define NVMCTRL ((Nvmctrl *)HostSim_NVMCTRL)
+#undef OSCCTRL
+#define OSCCTRL ((Oscctrl *)HostSim_OSCCTRL)
+#undef OSC32KCTRL
+#define OSC32KCTRL ((Osc32kctrl *)HostSim_OSC32KCTRL)
+#undef PAC
+#define PAC ((Pac *)HostSim_PAC)
+#undef PCC
+#define PCC ((Pcc *)HostSim_PCC)
+#undef PDEC
+#define PDEC ((Pdec *)HostSim_PDEC)
+#undef PM
+#define PM ((Pm *)HostSim_PM)
+#undef PORT
+#define PORT ((Port *)HostSim_PORT)
+#undef RAMECC
+#define RAMECC ((Ramecc *)HostSim_RAMECC)
+#undef RSTC
+#define RSTC ((Rstc *)HostSim_RSTC)
+#undef RTC
+#define RTC ((Rtc *)HostSim_RTC)
+#undef SERCOM0
+#define SERCOM0 ((Sercom *)HostSim_SERCOM0)
+#undef SERCOM1
+#define SERCOM1 ((Sercom *)HostSim_SERCOM1)
+#undef SERCOM2
+#define SERCOM2 ((Sercom *)HostSim_SERCOM2)
+#undef SERCOM3
+#define SERCOM3 ((Sercom *)HostSim_SERCOM3)
+#undef SERCOM4
+#define SERCOM4 ((Sercom *)HostSim_SERCOM4)
+#undef SERCOM5
+#define SERCOM5 ((Sercom *)HostSim_SERCOM5)
+#undef SERCOM6
+#define SERCOM6 ((Sercom *)HostSim_SERCOM6)
+#undef SERCOM7
+#define SERCOM7 ((Sercom *)HostSim_SERCOM7)
+#undef SUPC
+#define SUPC ((Supc *)HostSim_SUPC)
+#undef TC0
+#define TC0 ((Tc *)HostSim_TC0)
+#undef TC1
+#define TC1 ((Tc *)HostSim_TC1)
+#undef TC2
+#define TC2 ((Tc *)HostSim_TC2)
+#undef TC3
+#define TC3 ((Tc *)HostSim_TC3)
+#undef TC4
+#define TC4 ((Tc *)HostSim_TC4)
+#undef TC5
+#define TC5 ((Tc *)HostSim_TC5)
+#undef TC6
+#define TC6 ((Tc *)HostSim_TC6)
+#undef TC7
+#define TC7 ((Tc *)HostSim_TC7)
+#undef TCC0
+#define TCC0 ((Tcc *)HostSim_TCC0)
+#undef TCC1
+#define TCC1 ((Tcc *)HostSim_TCC1)
+#undef TCC2
+#define TCC2 ((Tcc *)HostSim_TCC2)
+#undef TCC3
+#define TCC3 ((Tcc *)HostSim_TCC3)
+#undef TCC4
+#define TCC4 ((Tcc *)HostSim_TCC4)
+#undef TRNG
+#define TRNG ((Trng *)HostSim_TRNG)
+#undef USB
+#define USB ((Usb *)HostSim_USB)
+#undef WDT
+#define WDT ((Wdt *)HostSim_WDT)
+
+#endif // __HOST_SIM_SAM_H__
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * StepGeneratorSim.cpp
+ *
+ * Host-side simulation of the ClearCore step generator. Runs the same
+ * per-sample profile calculation that MotorDriver::Refresh() performs in the
+ * sample rate interrupt, dumps the commanded position and velocity of every
+ * sample, and reports the time spent per sample.
+ *
+ * Build from the repository root with any host C++11 compiler:
+ *   g++ -std=gnu++11 -O2 -DCLEARCORE_HOST_SIM -IlibClearCore/inc
+ *       Tools/StepGeneratorSim/StepGeneratorSim.cpp
+ *       libClearCore/src/StepGenerator.cpp -o StepGeneratorSim
+ *
+ * Usage:
+ *   StepGeneratorSim [dist [velMax [accelMax [jerkMax [stepsPerSample]]]]]
+ *
+ * The per-sample CSV (sample, position, velocity in steps/sec) goes to
+ * stdout; the timing summary goes to stderr.
+ */
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "StepGenerator.h"
+#include "SysTiming.h"
+
+namespace ClearCore {
+
+// The simulation drives no pins
+class SimAxis : public StepGenerator {
+    friend class TestIO;
+    virtual void OutputDirection() override {}
+};
+
+// The StepGenerator's test hook
+class TestIO {
+public:
+    struct Sample {
+        int32_t Posn;
+        int32_t Vel;
+    };
+
+    static int Run(int32_t dist, uint32_t velMax, uint32_t accelMax,
+                   uint32_t jerkMax, uint32_t stepsPerSample) {
+        // Cap the simulated move at a minute of samples
+        const uint32_t sampleLimit = 60 * _CLEARCORE_SAMPLE_RATE_HZ;
+        std::vector<Sample> samples;
+        samples.reserve(sampleLimit);
+
+        SimAxis axis;
+        axis.StepsPerSampleMaxSet(stepsPerSample);
+        axis.VelMax(velMax);
+        axis.AccelMax(accelMax);
+        axis.JerkMax(jerkMax);
+        if (!axis.Move(dist)) {
+            fprintf(stderr, "Move rejected\n");
+            return 1;
+        }
+
+        // Same order as MotorDriver::Refresh(): profile, then compensation
+        uint64_t stepsSent = 0;
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        do {
+            axis.StepsCalculated();
+            stepsSent += axis.StepsCompensated();
+            Sample sample = {axis.m_posnAbsolute,
+                             axis.VelocityRefCommanded()};
+            samples.push_back(sample);
+        } while (!axis.StepsComplete() && samples.size() < sampleLimit);
+        std::chrono::steady_clock::time_point end =
+            std::chrono::steady_clock::now();
+
+        printf("sample,position,velocity\n");
+        for (size_t i = 0; i < samples.size(); i++) {
+            printf("%u,%d,%d\n", static_cast<unsigned>(i), samples[i].Posn,
+                   samples[i].Vel);
+        }
+
+        double ns = std::chrono::duration<double, std::nano>(end - start)
+                    .count();
+        fprintf(stderr, "%u samples, %llu steps, final position %d\n",
+                static_cast<unsigned>(samples.size()),
+                static_cast<unsigned long long>(stepsSent),
+                axis.m_posnAbsolute);
+        fprintf(stderr, "%.1f ns/sample\n", ns / samples.size());
+        if (!axis.StepsComplete()) {
+            fprintf(stderr, "Move did not complete\n");
+            return 1;
+        }
+        return 0;
+    }
+};
+
+} // ClearCore namespace
+
+int main(int argc, char *argv[]) {
+    int32_t dist = argc > 1 ? strtol(argv[1], NULL, 0) : 100000;
+    uint32_t velMax = argc > 2 ? strtoul(argv[2], NULL, 0) : 50000;
+    uint32_t accelMax = argc > 3 ? strtoul(argv[3], NULL, 0) : 200000;
+    uint32_t jerkMax = argc > 4 ? strtoul(argv[4], NULL, 0) : 0;
+    // 100 steps per sample matches the default CLOCK_RATE_NORMAL input clock
+    uint32_t stepsPerSample = argc > 5 ? strtoul(argv[5], NULL, 0) : 100;
+
+    return ClearCore::TestIO::Run(dist, velMax, accelMax, jerkMax,
+                                  stepsPerSample);
+}
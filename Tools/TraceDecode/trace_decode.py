@@ -0,0 +1,160 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2020 Teknic, Inc.
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+#
+# trace_decode.py
+#
+# Decodes ClearCore TraceManager dumps into CSV.
+#
+# Usage:
+#   trace_decode.py capture.bin          # dumps from TraceMgr.Dump()
+#   trace_decode.py --itm capture.bin    # raw ITM stimulus port words
+#
+# A capture may hold any number of dumps back to back. Times are in
+# microseconds from the first event, with the 32-bit cycle counter unwrapped
+# on the assumption that events are less than one counter period apart.
+
+import argparse
+import struct
+import sys
+
+CPU_CLK_DEFAULT = 120000000
+LOST_ID = 0xFFFF
+
+GROUPS = {
+    0x00: None,
+    0x01: 'ccio refresh',
+    0x02: 'motor move',
+    0x03: None,
+    0x04: 'ethernet refresh',
+    0x1F: 'user',
+}
+
+EVENTS = {
+    0x0000: 'fast update begin',
+    0x0001: 'fast update end',
+    0x0300: 'serial tx irq',
+    0x0301: 'serial rx irq',
+}
+
+# SERCOM base addresses, to name the port of a serial event
+SERCOMS = {
+    0x40003000: 'SERCOM0', 0x40003400: 'SERCOM1', 0x41012000: 'SERCOM2',
+    0x41014000: 'SERCOM3', 0x43000000: 'SERCOM4', 0x43000400: 'SERCOM5',
+    0x43000800: 'SERCOM6', 0x43000C00: 'SERCOM7',
+}
+
+# ClearCore connector numbers, to name the motor of a move event
+MOTORS = {14: 'M-0', 15: 'M-1', 16: 'M-2', 17: 'M-3'}
+
+
+def event_name(event_id):
+    if event_id in EVENTS:
+        return EVENTS[event_id]
+    group = GROUPS.get(event_id >> 8)
+    if group == 'motor move':
+        return '%s %s' % (group, MOTORS.get(event_id & 0xFF, event_id & 0xFF))
+    if group:
+        return '%s %d' % (group, event_id & 0xFF)
+    return 'id 0x%04x' % event_id
+
+
+def arg_text(event_id, arg):
+    if event_id in (0x0300, 0x0301):
+        return SERCOMS.get(arg, '0x%08x' % arg)
+    if event_id >> 8 == 0x02:
+        return str(struct.unpack('<i', struct.pack('<I', arg))[0])
+    return str(arg)
+
+
+def dumps(data):
+    """Yield (cpu clock, [(cycles, arg, id, seq)]) for each dump in data."""
+    pos = 0
+    while True:
+        pos = data.find(b'CCTR', pos)
+        if pos < 0 or pos + 12 > len(data):
+            return
+        clock, count = struct.unpack_from('<II', data, pos + 4)
+        pos += 12
+        records = []
+        for _ in range(count):
+            if pos + 12 > len(data):
+                break
+            cycles, arg, word = struct.unpack_from('<III', data, pos)
+            records.append((cycles, arg, word & 0xFFFF, word >> 16))
+            pos += 12
+        yield clock, records
+
+
+def itm_records(data):
+    """Records from a raw capture of the stimulus port's 32-bit words."""
+    records = []
+    for pos in range(0, len(data) - 11, 12):
+        word, cycles, arg = struct.unpack_from('<III', data, pos)
+        records.append((cycles, arg, word & 0xFFFF, word >> 16))
+    return records
+
+
+def decode(records, clock, out, state):
+    for cycles, arg, event_id, seq in records:
+        if event_id == LOST_ID:
+            out.write(',,lost,\n')
+            state['last_seq'] = None
+            continue
+        if state['last_seq'] is not None and \
+                (seq - state['last_seq']) & 0xFFFF != 1:
+            out.write(',,gap of %d,\n' % (((seq - state['last_seq'])
+                                            & 0xFFFF) - 1))
+        state['last_seq'] = seq
+        if state['last_cycles'] is None:
+            state['last_cycles'] = cycles
+        state['elapsed'] += (cycles - state['last_cycles']) & 0xFFFFFFFF
+        state['last_cycles'] = cycles
+        out.write('%.3f,%d,%s,%s\n' % (state['elapsed'] * 1e6 / clock, seq,
+                                       event_name(event_id),
+                                       arg_text(event_id, arg)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('capture', help='binary capture file')
+    parser.add_argument('--itm', action='store_true',
+                        help='the capture holds raw ITM port words')
+    parser.add_argument('--clock', type=int, default=CPU_CLK_DEFAULT,
+                        help='CPU clock for ITM captures (Hz)')
+    args = parser.parse_args()
+
+    with open(args.capture, 'rb') as capture:
+        data = capture.read()
+
+    out = sys.stdout
+    out.write('time_us,sequence,event,arg\n')
+    state = {'last_seq': None, 'last_cycles': None, 'elapsed': 0}
+    if args.itm:
+        decode(itm_records(data), args.clock, out, state)
+    else:
+        for clock, records in dumps(data):
+            decode(records, clock, out, state)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
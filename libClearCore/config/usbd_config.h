@@ -16,6 +16,14 @@
 
 // ---- USB Device Stack CDC ACM Options ----
 
+// <o> Number of CDC ACM ports <1-3>
+// <i> Each port is a separate serial port on the host, with its own
+// <i> interface pair and endpoints. More than one makes the device composite.
+// <id> usb_cdcd_acm_ports
+#ifndef CONF_USB_CDCD_ACM_PORTS
+#define CONF_USB_CDCD_ACM_PORTS 1
+#endif
+
 // <e> Enable String Descriptors
 // <id> usb_cdcd_acm_str_en
 #ifndef CONF_USB_CDCD_ACM_STR_EN
@@ -359,6 +367,126 @@
 #endif
 // </h>
 
+// <h> CDC ACM Port 1 Endpoints
+// <i> Used when there are two or more CDC ACM ports. The interfaces
+// <i> follow those of port 0, and the packet sizes are those of port 0.
+
+// <o> Interrupt IN Endpoint Address
+// <id> usb_cdcd_acm1_comm_int_epaddr
+#ifndef CONF_USB_CDCD_ACM1_COMM_INT_EPADDR
+#define CONF_USB_CDCD_ACM1_COMM_INT_EPADDR 0x85
+#endif
+
+// <o> BULK IN Endpoint Address
+// <id> usb_cdcd_acm1_data_bulkin_epaddr
+#ifndef CONF_USB_CDCD_ACM1_DATA_BULKIN_EPADDR
+#define CONF_USB_CDCD_ACM1_DATA_BULKIN_EPADDR 0x86
+#endif
+
+// <o> BULK OUT Endpoint Address
+// <id> usb_cdcd_acm1_data_bulkout_epaddr
+#ifndef CONF_USB_CDCD_ACM1_DATA_BULKOUT_EPADDR
+#define CONF_USB_CDCD_ACM1_DATA_BULKOUT_EPADDR 0x5
+#endif
+// </h>
+
+// <h> CDC ACM Port 2 Endpoints
+// <i> Used when there are three CDC ACM ports. There are only seven IN
+// <i> endpoints, so by default port 2 takes the vendor interface's.
+
+// <o> Interrupt IN Endpoint Address
+// <id> usb_cdcd_acm2_comm_int_epaddr
+#ifndef CONF_USB_CDCD_ACM2_COMM_INT_EPADDR
+#define CONF_USB_CDCD_ACM2_COMM_INT_EPADDR 0x87
+#endif
+
+// <o> BULK IN Endpoint Address
+// <id> usb_cdcd_acm2_data_bulkin_epaddr
+#ifndef CONF_USB_CDCD_ACM2_DATA_BULKIN_EPADDR
+#define CONF_USB_CDCD_ACM2_DATA_BULKIN_EPADDR 0x83
+#endif
+
+// <o> BULK OUT Endpoint Address
+// <id> usb_cdcd_acm2_data_bulkout_epaddr
+#ifndef CONF_USB_CDCD_ACM2_DATA_BULKOUT_EPADDR
+#define CONF_USB_CDCD_ACM2_DATA_BULKOUT_EPADDR 0x6
+#endif
+// </h>
+
+// <e> Vendor Bulk Interface
+// <i> Adds a vendor-specific bulk IN/OUT interface alongside CDC ACM,
+// <i> making the device composite.
+// <id> usb_vendor_en
+#ifndef CONF_USB_VENDOR_EN
+#define CONF_USB_VENDOR_EN 0
+#endif
+
+// <o> bInterfaceNumber <0x00-0xFF>
+// <i> Follows the CDC ACM interfaces.
+// <id> usb_vendor_bifcnum
+#ifndef CONF_USB_VENDOR_BIFCNUM
+#define CONF_USB_VENDOR_BIFCNUM (0x2 * CONF_USB_CDCD_ACM_PORTS)
+#endif
+
+// <o> BULK IN Endpoint Address
+// <0x83=> EndpointAddress = 0x83
+// <id> usb_vendor_bulkin_epaddr
+#ifndef CONF_USB_VENDOR_BULKIN_EPADDR
+#define CONF_USB_VENDOR_BULKIN_EPADDR 0x83
+#endif
+
+// <o> BULK OUT Endpoint Address
+// <0x03=> EndpointAddress = 0x03
+// <id> usb_vendor_bulkout_epaddr
+#ifndef CONF_USB_VENDOR_BULKOUT_EPADDR
+#define CONF_USB_VENDOR_BULKOUT_EPADDR 0x3
+#endif
+
+// <o> BULK Endpoint wMaxPacketSize
+// <0x0040=> 64 bytes
+// <id> usb_vendor_bulk_maxpksz
+#ifndef CONF_USB_VENDOR_BULK_MAXPKSZ
+#define CONF_USB_VENDOR_BULK_MAXPKSZ 0x40
+#endif
+// </e>
+
+// <e> Mass Storage Interface
+// <i> Adds a Mass Storage Bulk-Only interface exposing the SD card
+// <i> alongside CDC ACM, making the device composite.
+// <id> usb_msc_en
+#ifndef CONF_USB_MSC_EN
+#define CONF_USB_MSC_EN 0
+#endif
+
+// <o> bInterfaceNumber <0x00-0xFF>
+// <i> Follows the vendor interface when that is enabled.
+// <id> usb_msc_bifcnum
+#ifndef CONF_USB_MSC_BIFCNUM
+#define CONF_USB_MSC_BIFCNUM (0x2 * CONF_USB_CDCD_ACM_PORTS + CONF_USB_VENDOR_EN)
+#endif
+
+// <o> BULK IN Endpoint Address
+// <0x84=> EndpointAddress = 0x84
+// <id> usb_msc_bulkin_epaddr
+#ifndef CONF_USB_MSC_BULKIN_EPADDR
+#define CONF_USB_MSC_BULKIN_EPADDR 0x84
+#endif
+
+// <o> BULK OUT Endpoint Address
+// <0x04=> EndpointAddress = 0x04
+// <id> usb_msc_bulkout_epaddr
+#ifndef CONF_USB_MSC_BULKOUT_EPADDR
+#define CONF_USB_MSC_BULKOUT_EPADDR 0x4
+#endif
+
+// <o> BULK Endpoint wMaxPacketSize
+// <0x0040=> 64 bytes
+// <id> usb_msc_bulk_maxpksz
+#ifndef CONF_USB_MSC_BULK_MAXPKSZ
+#define CONF_USB_MSC_BULK_MAXPKSZ 0x40
+#endif
+// </e>
+
 // <<< end of configuration section >>>
 
 #endif // USBD_CONFIG_H
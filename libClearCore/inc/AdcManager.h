@@ -31,10 +31,18 @@
 #define __ADCMANAGER_H__
 
 #include <stdint.h>
+#include "DspFilter.h"
 #include "IirFilter.h"
+#include "InputManager.h"
+#include "PidController.h"
 
 namespace ClearCore {
 
+class Connector;
+class MotorDriver;
+class PidLoop;
+class StepGenerator;
+
 /**
     \brief ADC Peripheral Manager for the ClearCore Board
 
@@ -46,6 +54,9 @@ namespace ClearCore {
     Uses DMAC Channels: 0,1
 **/
 class AdcManager {
+    friend class PidLoop;
+    friend class ReplayManager;
+
 public:
     /**
         \enum AdcChannels
@@ -81,6 +92,33 @@ public:
         FILTER_UNIT_SAMPLES,
     } FilterUnits;
 
+    /**
+        \enum CaptureMotionEvent
+        \brief Motion events that can start a triggered capture.
+    **/
+    typedef enum {
+        /** The axis finishes its move. **/
+        CAPTURE_EVENT_MOVE_DONE,
+        /** The axis' commanded position reaches or passes a position. **/
+        CAPTURE_EVENT_POSN_CROSS,
+    } CaptureMotionEvent;
+
+    /**
+        \enum AlarmModes
+        \brief The condition on a channel's filtered result that asserts its
+        alarm.
+    **/
+    typedef enum {
+        /** The result is above the high limit. **/
+        ALARM_ABOVE,
+        /** The result is below the low limit. **/
+        ALARM_BELOW,
+        /** The result is within the low and high limits. **/
+        ALARM_INSIDE,
+        /** The result is below the low limit or above the high limit. **/
+        ALARM_OUTSIDE,
+    } AlarmModes;
+
     /**
         The default resolution of the ADC, in bits.
     **/
@@ -93,6 +131,10 @@ public:
         The default ADC filter time constant, in milliseconds.
     **/
     static const uint32_t ADC_IIR_FILTER_TC_MS = 2;
+    /**
+        The largest number of conversions accumulated for one result.
+    **/
+    static const uint16_t ADC_OVERSAMPLING_MAX = 1024;
 
 #ifndef HIDE_FROM_DOXYGEN
     // Max voltage that a channel can read.
@@ -171,6 +213,295 @@ public:
         return m_AdcResolution;
     }
 
+    /**
+        \brief Set the conversion resolution of one ADC channel.
+
+        Lets slow or coarse channels convert at fewer bits than
+        AdcResolution(), or the reverse. Oversampled channels ignore the
+        setting.
+
+        \code{.cpp}
+        // Convert the 5V off-board monitor at 8 bits
+        AdcMgr.AdcChannelResolution(AdcManager::ADC_5VOB_MON, 8);
+        \endcode
+
+        \param[in] adcChannel ADC channel to configure.
+        \param[in] resolution 8, 10, or 12 bits, or 0 to follow
+        AdcResolution().
+
+        \return Success
+    **/
+    bool AdcChannelResolution(AdcChannels adcChannel, uint8_t resolution);
+
+    /**
+        \brief Convert an ADC channel in only one of every \a divider
+        conversion sequences.
+
+        A sequence normally runs every sample time, so a divider of 50 samples
+        a channel at 100 Hz. Channels left out of a sequence shorten it,
+        giving the remaining channels their results sooner. Between
+        conversions a channel's converted result holds and its filter keeps
+        running on the held value.
+
+        \code{.cpp}
+        // Check the supply monitors at 100 Hz
+        AdcMgr.AdcSampleDivider(AdcManager::ADC_VSUPPLY_MON, 50);
+        AdcMgr.AdcSampleDivider(AdcManager::ADC_5VOB_MON, 50);
+        \endcode
+
+        \param[in] adcChannel ADC channel to configure.
+        \param[in] divider The number of sequences per conversion, 1 or more.
+
+        \return Success
+    **/
+    bool AdcSampleDivider(AdcChannels adcChannel, uint16_t divider);
+
+    /**
+        \brief Returns the sample divider of an ADC channel.
+
+        \note For performance reasons, does not perform any bounds checking.
+    **/
+    uint16_t AdcSampleDivider(AdcChannels adcChannel) {
+        return m_sampleDivider[adcChannel];
+    }
+
+    /**
+        \brief Configure hardware oversampling for an ADC channel.
+
+        The ADC accumulates \a samples 12-bit conversions of the channel for
+        each result and decimates the sum, gaining one bit of resolution for
+        every 4x of oversampling, up to 16 bits at 256 samples or more. The
+        channel converts at 12 bits regardless of AdcResolution(). No CPU time
+        is spent; the conversions are part of the DMA sequence.
+
+        Every conversion lengthens the sequence, which normally completes
+        within one sample time. Longer sequences update the results less
+        often, and the ADC timeout is extended to match.
+
+        \code{.cpp}
+        // Read the load cell on A-9 at 14 bits
+        AdcMgr.AdcOversampling(AdcManager::ADC_AIN09, 16);
+        \endcode
+
+        \param[in] adcChannel ADC channel to configure.
+        \param[in] samples The number of conversions per result: a power of
+        two up to #ADC_OVERSAMPLING_MAX. 1 turns oversampling off.
+
+        \return Success
+    **/
+    bool AdcOversampling(AdcChannels adcChannel, uint16_t samples);
+
+    /**
+        \brief Returns the number of conversions per result of an ADC channel.
+
+        \code{.cpp}
+        uint16_t samples = AdcMgr.AdcOversampling(AdcManager::ADC_AIN09);
+        \endcode
+
+        \note For performance reasons, does not perform any bounds checking.
+    **/
+    uint16_t AdcOversampling(AdcChannels adcChannel) {
+        return 1U << m_oversampleLog2[adcChannel];
+    }
+
+    /**
+        \brief Returns the resolution of an ADC channel's results, in bits.
+
+        This is AdcResolution() unless the channel is oversampled or has its
+        own AdcChannelResolution(). The Q15
+        converted and filtered results hold at most 15 of these bits.
+
+        \code{.cpp}
+        uint8_t bits = AdcMgr.ChannelResolution(AdcManager::ADC_AIN09);
+        \endcode
+
+        \note For performance reasons, does not perform any bounds checking.
+    **/
+    volatile const uint8_t &ChannelResolution(AdcChannels adcChannel) {
+        return m_channelResolution[adcChannel];
+    }
+
+    /**
+        \brief Start a continuous capture of one or more ADC channels.
+
+        The ADC stops its regular conversions and converts the capture
+        channels in turn, paced by a hardware timer, while DMA fills
+        \a buffer as a double buffer of two blocks. Each block holds
+        \a frames frames, and each frame holds one 12-bit result for each
+        channel in the order given. Read full blocks with CaptureBlock().
+
+        While capturing, the converted and filtered results of every channel,
+        including the supply monitors, hold their last values and the ADC
+        timeout is not checked.
+
+        A triggered capture is armed but doesn't convert until
+        CaptureTrigger() is called, for example from an input interrupt
+        handler or right after commanding a move, so that acquisition lines
+        up with the event.
+
+        \code{.cpp}
+        // Capture A-9 and A-10 at 20 kHz each, 256 frames per block
+        AdcManager::AdcChannels channels[] = {AdcManager::ADC_AIN09,
+                                              AdcManager::ADC_AIN10};
+        uint16_t captureBuffer[2 * 256 * 2];
+        AdcMgr.CaptureStart(channels, 2, 20000, captureBuffer, 256);
+        \endcode
+
+        \param[in] channels The channels to capture, without repeats.
+        \param[in] channelCount The number of channels.
+        \param[in] rateHz The conversion rate of each channel, in Hz. The
+        rate actually used is CaptureRate().
+        \param[in] buffer Room for 2 * \a frames * \a channelCount results.
+        \param[in] frames The number of frames in each block.
+        \param[in] triggered True to wait for CaptureTrigger() to start.
+
+        \return True if the capture started. Fails if a capture is already
+        running, an argument is invalid, or the combined conversion rate is
+        more than the ADC can convert.
+    **/
+    bool CaptureStart(const AdcChannels *channels, uint8_t channelCount,
+                      uint32_t rateHz, uint16_t *buffer, uint16_t frames,
+                      bool triggered = false);
+
+    /**
+        \brief Start converting an armed, triggered capture.
+
+        May be called from an interrupt handler.
+
+        \code{.cpp}
+        void InputEdge() {
+            AdcMgr.CaptureTrigger();
+        }
+        \endcode
+
+        \return True if an armed capture was started.
+    **/
+    bool CaptureTrigger();
+
+    /**
+        \brief Start an armed, triggered capture from an input edge.
+
+        The input's edges are routed through the event system to start the
+        pacing timer, so the first conversion follows the edge by no more than
+        one conversion period regardless of interrupt latency.
+
+        \code{.cpp}
+        // Take one block of A-9 readings when DI-6 rises
+        AdcMgr.CaptureStart(channels, 1, 50000, captureBuffer, 128, true);
+        AdcMgr.CaptureTriggerInput(ConnectorDI6, InputManager::RISING);
+        \endcode
+
+        \param[in] input A connector with an external interrupt line: DI-6
+        through A-12.
+        \param[in] edge The input state condition that starts the capture.
+        \param[in] burst True to stop converting once the first block is
+        full, so that the block holds the readings right after the edge.
+
+        \return True if the trigger was set. Fails unless a triggered capture
+        is armed and no other trigger is set.
+    **/
+    bool CaptureTriggerInput(Connector &input,
+                             InputManager::InterruptTrigger edge,
+                             bool burst = true);
+
+    /**
+        \brief Start an armed, triggered capture on a motion event.
+
+        The event is checked in the sample interrupt right after the motors
+        are refreshed, so the capture starts in the sample in which the event
+        happens.
+
+        \code{.cpp}
+        // Take one block of A-10 readings as M-0 passes position 20000
+        AdcMgr.CaptureStart(channels, 1, 50000, captureBuffer, 128, true);
+        AdcMgr.CaptureTriggerMotion(ConnectorM0,
+                                    AdcManager::CAPTURE_EVENT_POSN_CROSS,
+                                    20000);
+        ConnectorM0.Move(40000);
+        \endcode
+
+        \param[in] axis The motor connector or other step generator.
+        \param[in] event The motion event that starts the capture.
+        \param[in] posn The position for #CAPTURE_EVENT_POSN_CROSS.
+        \param[in] burst True to stop converting once the first block is
+        full.
+
+        \return True if the trigger was set. Fails unless a triggered capture
+        is armed and no other trigger is set.
+    **/
+    bool CaptureTriggerMotion(StepGenerator &axis, CaptureMotionEvent event,
+                              int32_t posn = 0, bool burst = true);
+
+    /**
+        \brief Stop the capture and resume the regular conversions.
+
+        \code{.cpp}
+        AdcMgr.CaptureStop();
+        \endcode
+    **/
+    void CaptureStop();
+
+    /**
+        \brief Get the oldest full block of the capture.
+
+        The block stays valid until CaptureBlockRelease(), as long as that is
+        within one block time; after that DMA overwrites it. If both blocks
+        filled before this call, the older one has been overwritten and is
+        skipped and counted by CaptureOverruns().
+
+        \code{.cpp}
+        const uint16_t *block = AdcMgr.CaptureBlock();
+        if (block) {
+            // Process 256 frames of A-9, A-10 pairs
+            AdcMgr.CaptureBlockRelease();
+        }
+        \endcode
+
+        \return The block, or nullptr if no block is ready.
+    **/
+    const uint16_t *CaptureBlock();
+
+    /**
+        \brief Release the block returned by CaptureBlock().
+    **/
+    void CaptureBlockRelease();
+
+    /**
+        \brief Whether a capture is armed or running.
+    **/
+    bool CaptureActive() {
+        return m_captureState != CAPTURE_IDLE;
+    }
+
+    /**
+        \brief The conversion rate of each captured channel, in Hz.
+    **/
+    uint32_t CaptureRate() {
+        return m_captureRateHz;
+    }
+
+    /**
+        \brief The Microseconds() time of the capture's first conversion.
+    **/
+    uint32_t CaptureStartUs() {
+        return m_captureStartUs;
+    }
+
+    /**
+        \brief The sample tick count when the capture started converting.
+    **/
+    uint32_t CaptureStartTick() {
+        return m_captureStartTick;
+    }
+
+    /**
+        \brief The number of blocks skipped because they were overwritten
+        before being read.
+    **/
+    uint32_t CaptureOverruns() {
+        return m_captureOverruns;
+    }
+
     /**
         \brief Returns the filtered ADC result of a specific channel.
 
@@ -257,12 +588,210 @@ public:
         if (adcChannel >= ADC_CHANNEL_COUNT) {
             return false;
         }
-        m_analogFilter[adcChannel].Reset(newSetting);
+        m_analogFilter.Reset(adcChannel, newSetting);
+        if (m_customFilter[adcChannel]) {
+            m_customFilter[adcChannel]->Reset(newSetting);
+        }
         m_AdcResultsConvertedFiltered[adcChannel] =
-            m_analogFilter[adcChannel].LastOutput();
+            m_analogFilter.LastOutput(adcChannel);
         return true;
     }
 
+    /**
+        \brief Filter an ADC channel with a biquad cascade, FIR, or other
+        DspFilter in place of its IIR filter.
+
+        The filter runs in the sample interrupt on the channel's Q15 result
+        and its output becomes the channel's FilteredResult(). Design the
+        filter for the sample rate, #_CLEARCORE_SAMPLE_RATE_HZ. The filter is
+        reset to the channel's present filtered value before it takes over.
+
+        \code{.cpp}
+        // Remove 60 Hz pickup from A-10
+        Biquad<int16_t, 1> notch60;
+        notch60.Section(0, BiquadNotch(60, 10));
+        AdcMgr.FilterCustom(AdcManager::ADC_AIN10, &notch60);
+        \endcode
+
+        \param[in] adcChannel ADC channel to filter.
+        \param[in] filter The filter, which must outlive its use, or NULL to
+        return to the IIR filter.
+        \return Success.
+    **/
+    bool FilterCustom(AdcChannels adcChannel, DspFilter<int16_t> *filter);
+
+    /**
+        \brief Running statistics of one channel's converted results, in Q15
+        counts like ConvertedResult().
+
+        Scale by #ADC_CHANNEL_MAX_FLOAT / 32768 for volts.
+    **/
+    typedef struct {
+        /// The number of results accumulated
+        uint32_t Count;
+        /// The smallest result
+        uint16_t Min;
+        /// The largest result
+        uint16_t Max;
+        /// The mean of the results
+        float Mean;
+        /// The root mean square of the results
+        float Rms;
+        /// The standard deviation of the results; the RMS of the AC part
+        float StdDev;
+    } AdcStats;
+
+    /**
+        \brief Read the running statistics of an ADC channel.
+
+        Every conversion result is accumulated in the sample interrupt as it
+        completes, so no results are missed between reads. With a window set
+        by StatsWindow(), the statistics of the last complete window are
+        returned instead.
+
+        \code{.cpp}
+        // RMS current of the M-2 screwdriver monitor since the last read
+        AdcManager::AdcStats stats;
+        AdcMgr.StatsGet(AdcManager::ADC_SDRVR2_IMON, stats, true);
+        float rmsVolts = stats.Rms * AdcManager::ADC_CHANNEL_MAX_FLOAT[
+                             AdcManager::ADC_SDRVR2_IMON] / 32768;
+        \endcode
+
+        \param[in] adcChannel ADC channel to read.
+        \param[out] stats The channel's statistics.
+        \param[in] reset True to restart the accumulation after reading. Has
+        no effect on a windowed channel.
+        \return True if the channel is valid and has results.
+    **/
+    bool StatsGet(AdcChannels adcChannel, AdcStats &stats, bool reset = false);
+
+    /**
+        \brief Restart the statistics of an ADC channel.
+
+        \param[in] adcChannel ADC channel to reset.
+        \return Success.
+    **/
+    bool StatsReset(AdcChannels adcChannel);
+
+    /**
+        \brief Accumulate the statistics of every channel in fixed windows.
+
+        When a window of \a results results completes, it becomes the one
+        read by StatsGet() and the next window starts.
+
+        \code{.cpp}
+        // Report statistics over 0.1 second windows
+        AdcMgr.StatsWindow(_CLEARCORE_SAMPLE_RATE_HZ / 10);
+        \endcode
+
+        \param[in] results The results per window, or 0 to accumulate until
+        reset.
+    **/
+    void StatsWindow(uint32_t results);
+
+    /**
+        \brief Monitor a channel's filtered result against limits.
+
+        The limits are checked every sample as the results are filtered, so
+        an alarm asserts within a sample of the condition being met however
+        long the main loop takes. Read the alarms with AlarmsRT(),
+        AlarmsRisen() and AlarmsFallen(), and act on them directly with
+        AlarmMotorStop() and AlarmOutput().
+
+        The limits are in Q15 counts like FilteredResult(); scale volts by
+        32768 / #ADC_CHANNEL_MAX_FLOAT.
+
+        \code{.cpp}
+        // Alarm when A-9 rises above 8 V and stays there for 1 ms, and clear
+        // once it falls below 7.5 V
+        uint16_t high = 8.0 * 32768 / 10.0;
+        uint16_t hysteresis = 0.5 * 32768 / 10.0;
+        AdcMgr.AlarmSet(AdcManager::ADC_AIN09, AdcManager::ALARM_ABOVE,
+                        0, high, hysteresis, 5);
+        \endcode
+
+        \param[in] adcChannel ADC channel to monitor.
+        \param[in] mode The condition that asserts the alarm.
+        \param[in] low The low limit.
+        \param[in] high The high limit.
+        \param[in] hysteresis How far back past a limit the result must come
+        to deassert the alarm.
+        \param[in] samples The consecutive samples the condition must hold
+        before the alarm asserts, at least 1.
+        \return True if the channel, mode and limits are valid.
+    **/
+    bool AlarmSet(AdcChannels adcChannel, AlarmModes mode, uint16_t low,
+                  uint16_t high, uint16_t hysteresis = 0,
+                  uint16_t samples = 1);
+
+    /**
+        \brief Stop monitoring a channel. Its alarm deasserts, and its output
+        and motor stop are released.
+
+        \param[in] adcChannel ADC channel to stop monitoring.
+        \return Success.
+    **/
+    bool AlarmClear(AdcChannels adcChannel);
+
+    /**
+        \brief Stop a motor's move when a channel's alarm asserts.
+
+        \param[in] adcChannel ADC channel whose alarm stops the motor.
+        \param[in] motor The motor to stop, or nullptr for none.
+        \param[in] abrupt True to stop with MoveStopAbrupt(); false to stop
+        with MoveStopDecel().
+        \return Success.
+    **/
+    bool AlarmMotorStop(AdcChannels adcChannel, MotorDriver *motor,
+                        bool abrupt = false);
+
+    /**
+        \brief Drive a digital output from a channel's alarm.
+
+        The output is written with Connector::State() each time the alarm
+        changes.
+
+        \param[in] adcChannel ADC channel whose alarm drives the output.
+        \param[in] output The output, or nullptr for none.
+        \param[in] activeState The state written while the alarm is
+        asserted.
+        \return True if the channel is valid and the output is writable.
+    **/
+    bool AlarmOutput(AdcChannels adcChannel, Connector *output,
+                     bool activeState = true);
+
+    /**
+        \brief The channels whose alarms are asserted, one bit per
+        #AdcChannels value.
+
+        \param[in] mask (optional) The channels to check.
+    **/
+    uint8_t AlarmsRT(uint8_t mask = UINT8_MAX) {
+        return m_alarmsRT & mask;
+    }
+
+    /**
+        \brief Clear on read accessor for the alarms that have asserted since
+        the previous call, one bit per #AdcChannels value.
+
+        \code{.cpp}
+        if (AdcMgr.AlarmsRisen(1 << AdcManager::ADC_AIN09)) {
+            // A-9 has gone over its limit since the last check
+        }
+        \endcode
+
+        \param[in] mask (optional) The channels to check and clear.
+    **/
+    uint8_t AlarmsRisen(uint8_t mask = UINT8_MAX);
+
+    /**
+        \brief Clear on read accessor for the alarms that have deasserted
+        since the previous call, one bit per #AdcChannels value.
+
+        \param[in] mask (optional) The channels to check and clear.
+    **/
+    uint8_t AlarmsFallen(uint8_t mask = UINT8_MAX);
+
     /**
         \brief Configure the ADC conversion timeout.
 
@@ -296,6 +825,40 @@ public:
         return m_AdcTimeout;
     }
 
+    /**
+        \brief Convert continuously, paced by a timer, rather than restarting
+        the conversion sequence every sample.
+
+        Every channel is converted once per sample time, with its conversion
+        started at an even spacing through the sample, into each of two
+        result buffers in turn. The sample update only reads the buffer that
+        finished last, so it no longer restarts the sequence or waits on one
+        in progress, and AdcTimeout() trips only if the conversions stop.
+
+        The sample dividers of AdcSampleDivider() do not apply while
+        converting continuously, and a channel's oversampling must fit in its
+        share of the sample time. A capture still takes over the ADC while it
+        runs, and continuous conversion resumes once it ends.
+
+        \code{.cpp}
+        AdcMgr.ContinuousMode(true);
+        \endcode
+
+        \param[in] enable True to convert continuously, false to go back to
+        one sequence per sample.
+
+        \return True if the mode was set; false if the ADC is not initialized
+        or a channel's oversampling is too long to convert continuously.
+    **/
+    bool ContinuousMode(bool enable);
+
+    /**
+        \brief Whether the ADC is converting continuously.
+    **/
+    bool ContinuousMode() {
+        return m_continuous;
+    }
+
     /**
         \brief Returns the filtered ADC result of a specific channel in volts.
 
@@ -310,7 +873,8 @@ public:
         \note For performance reasons, does not perform any bounds checking.
     **/
     float AnalogVoltage(AdcChannels adcChannel) {
-        uint16_t maxReading = INT16_MAX & ~(INT16_MAX >> m_AdcResolution);
+        uint16_t maxReading =
+            INT16_MAX & ~(INT16_MAX >> m_channelResolution[adcChannel]);
         float voltage = ADC_CHANNEL_MAX_FLOAT[adcChannel] *
                         m_AdcResultsConvertedFiltered[adcChannel] / maxReading;
         return voltage;
@@ -331,6 +895,31 @@ public:
     volatile const uint32_t &ShiftRegSnapshot() {
         return m_shiftRegSnapshot;
     }
+
+    /**
+        \brief Count a filled capture block. Called from the DMA interrupt.
+    **/
+    void IrqHandlerCapture();
+
+    /**
+        \brief Count a filled continuous result buffer. Called from the DMA
+        interrupt.
+    **/
+    void IrqHandlerContinuous() {
+        m_continuousBlocks++;
+    }
+
+    /**
+        \brief Check the motion trigger of an armed capture. Called from the
+        fast update after the motors are refreshed.
+    **/
+    void CaptureMotionCheck();
+
+    /**
+        \brief Run the PID process loops on the latest results. Called from
+        the fast update before the motors are refreshed.
+    **/
+    void PidRefresh();
 #endif
 private:
 
@@ -353,7 +942,47 @@ private:
     // ADC state holders in Q15. ADC logic has already been performed
     volatile uint16_t m_AdcResultsConverted[ADC_CHANNEL_COUNT] = {0};
     volatile uint16_t m_AdcResultsConvertedFiltered[ADC_CHANNEL_COUNT] = {0};
-    Iir16 m_analogFilter[ADC_CHANNEL_COUNT];
+    Iir16Bank<ADC_CHANNEL_COUNT> m_analogFilter;
+    // Optional per-channel replacements for the IIR filter
+    DspFilter<int16_t> *volatile m_customFilter[ADC_CHANNEL_COUNT] = {0};
+    // Converted results that stand in for the conversions during a replay
+    const volatile uint16_t *volatile m_replayResults = nullptr;
+
+    // Limit monitoring of the filtered results; a channel's alarm is
+    // checked only while its bit is set in m_alarmsEnabled
+    typedef struct {
+        AlarmModes Mode;
+        uint16_t Low;
+        uint16_t High;
+        uint16_t Hysteresis;
+        uint16_t Samples;
+        uint16_t Count;
+        MotorDriver *Motor;
+        bool Abrupt;
+        Connector *Output;
+        bool OutputActive;
+    } Alarm;
+    Alarm m_alarms[ADC_CHANNEL_COUNT];
+    volatile uint8_t m_alarmsEnabled;
+    volatile uint8_t m_alarmsRT;
+    volatile uint8_t m_alarmsRisen;
+    volatile uint8_t m_alarmsFallen;
+
+    // Process loops run each sample
+    PidLoop *m_pidLoops[PID_LOOP_MAX] = {0};
+    volatile uint8_t m_pidLoopCount = 0;
+
+    // Raw statistics accumulators; the completed window when windowed
+    typedef struct {
+        uint32_t Count;
+        uint16_t Min;
+        uint16_t Max;
+        uint64_t Sum;
+        uint64_t SumSq;
+    } StatsAccum;
+    StatsAccum m_statsRun[ADC_CHANNEL_COUNT];
+    StatsAccum m_statsDone[ADC_CHANNEL_COUNT];
+    uint32_t m_statsWindow;
 
     bool m_initialized;
 
@@ -372,6 +1001,66 @@ private:
     /** Count of samples since last ADC conversion. **/
     uint32_t m_AdcBusyCount;
 
+    /** Number of conversions that fit in one sample time **/
+    static const uint32_t ADC_CONVERSIONS_PER_SAMPLE = 40;
+
+    /** Per-channel oversampling, as log2 of the conversions per result **/
+    uint8_t m_oversampleLog2[ADC_CHANNEL_COUNT] = {0};
+    uint8_t m_oversamplePending[ADC_CHANNEL_COUNT] = {0};
+    // Per-channel resolutions, 0 to follow m_AdcResolution
+    uint8_t m_resolutionPending[ADC_CHANNEL_COUNT] = {0};
+    // Sequences per conversion, and the sequences left until the next one
+    volatile uint16_t m_sampleDivider[ADC_CHANNEL_COUNT];
+    volatile uint16_t m_divideCount[ADC_CHANNEL_COUNT];
+    volatile uint8_t m_channelResolution[ADC_CHANNEL_COUNT] = {0};
+    typedef enum {
+        CAPTURE_IDLE,
+        CAPTURE_STARTING,
+        CAPTURE_ARMED,
+        CAPTURE_RUNNING,
+        CAPTURE_STOPPING,
+    } CaptureState;
+
+    volatile CaptureState m_captureState;
+    // The capture request, applied from Update() between sequences
+    uint16_t *m_captureBuffer;
+    uint32_t m_captureBlockLength;
+    uint8_t m_captureChannelCount;
+    uint16_t m_capturePeriod;
+    uint8_t m_captureSampLen;
+    bool m_captureTriggered;
+    uint32_t m_captureRateHz;
+    uint32_t m_captureStartUs;
+    volatile uint32_t m_captureStartTick;
+    // The trigger of an armed capture: an input line or a motion event
+    volatile int8_t m_triggerExtInt;
+    StepGenerator *volatile m_triggerAxis;
+    CaptureMotionEvent m_triggerEvent;
+    int32_t m_triggerPosn;
+    // The side of the trigger position, or the move state, when armed
+    int8_t m_triggerLast;
+    bool m_captureBurst;
+    // Blocks filled by DMA and blocks released by the application
+    volatile uint32_t m_captureWritten;
+    volatile uint32_t m_captureRead;
+    uint32_t m_captureOverruns;
+
+    /** Sample times the conversion sequence takes beyond the first **/
+    uint32_t m_AdcSequenceSamples;
+    volatile bool m_sequenceChange;
+    // The channels of the sequence in progress, in conversion order
+    uint8_t m_seqChannels[ADC_CHANNEL_COUNT];
+    uint8_t m_seqCount;
+
+    // The continuous conversions: the mode in use and the one requested,
+    // the result buffers filled by DMA and the count last read, and whether
+    // to drop the next buffer because the sequence changed during it
+    volatile bool m_continuous;
+    volatile bool m_continuousPending;
+    volatile uint32_t m_continuousBlocks;
+    uint32_t m_continuousRead;
+    bool m_continuousSkip;
+
     /**
         \brief Constructor for AdcManager.
 
@@ -384,6 +1073,32 @@ private:
     void DmaInit();
     void DmaUpdate();
 
+    /**
+        \brief Run each channel's IIR filter, or its custom filter in its
+        place. Called every sample whether or not the results were updated.
+    **/
+    void FilterUpdate();
+
+    /**
+        \brief Add a result to a channel's statistics, closing the window
+        when it is full.
+    **/
+    void StatsUpdate(uint8_t channel, uint16_t result);
+
+    /**
+        \brief Check each monitored channel's filtered result against its
+        limits and act on the alarms that change.
+    **/
+    void AlarmUpdate();
+
+    static void StatsClear(StatsAccum &accum) {
+        accum.Count = 0;
+        accum.Min = UINT16_MAX;
+        accum.Max = 0;
+        accum.Sum = 0;
+        accum.SumSq = 0;
+    }
+
     /**
         \brief Apply the ADC conversion resolution change.
 
@@ -394,6 +1109,70 @@ private:
     **/
     bool AdcResChange();
 
+    /**
+        \brief Rebuild the resolution and oversampling of each channel in the
+        DMA sequence.
+    **/
+    void SequenceUpdate();
+
+    /**
+        \brief Pick the channels due for the next sequence and point the DMA
+        descriptors at them.
+    **/
+    void SequenceSchedule();
+
+    /**
+        \brief Switch the ADC, its DMA channels, and the pacing timer over to
+        the requested capture. Called from Update() while the ADC is idle.
+    **/
+    void CaptureBegin();
+
+    /**
+        \brief Stop the capture and restore the regular conversion sequence.
+    **/
+    void CaptureEnd();
+
+    /**
+        \brief Disable the ADC and its DMA channels so they can be
+        reconfigured.
+    **/
+    void AdcHalt();
+
+    /**
+        \brief Restore the regular conversion sequence as set up by
+        Initialize(). Called with the ADC halted.
+    **/
+    void RegularBegin();
+
+    /**
+        \brief Switch the ADC, its DMA channels, and the pacing timer over to
+        the continuous conversions. Called with the ADC idle.
+    **/
+    void ContinuousBegin();
+
+    /**
+        \brief Take the results of the last continuous buffer to complete.
+    **/
+    void ContinuousUpdate();
+
+    /**
+        \brief Normalize a channel's raw result to Q15 and add it to the
+        channel's statistics.
+    **/
+    void ResultConvert(uint8_t channel, uint16_t raw);
+
+    /**
+        \brief Register a process loop to be run each sample.
+    **/
+    bool PidLoopAdd(PidLoop *loop);
+
+    /**
+        \brief Which side of the trigger position \a posn is on: -1, 0, or 1.
+    **/
+    static int8_t TriggerSide(int32_t posn, int32_t triggerPosn) {
+        return posn > triggerPosn ? 1 : posn < triggerPosn ? -1 : 0;
+    }
+
 }; // AdcManager
 
 } // ClearCore namespace
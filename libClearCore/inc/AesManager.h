@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    \file AesManager.h
+    \brief ClearCore AES-GCM authenticated encryption on the AES peripheral.
+**/
+
+#ifndef __AESMANAGER_H__
+#define __AESMANAGER_H__
+
+#include <stdint.h>
+
+namespace ClearCore {
+
+/// The AES block size, in bytes
+#define AES_BLOCK_SIZE 16
+/// The size of a GCM initialization vector, in bytes
+#define AES_GCM_IV_SIZE 12
+/// The size of a GCM authentication tag, in bytes
+#define AES_GCM_TAG_SIZE 16
+
+/// Messages of at least this many blocks stream through the AES over DMA
+#ifndef AES_DMA_MIN_BLOCKS
+#define AES_DMA_MIN_BLOCKS 8
+#endif
+
+/**
+    \class AesManager
+    \brief ClearCore AES-GCM authenticated encryption on the AES peripheral.
+
+    GCM (Galois/Counter Mode) encrypts with AES in counter mode and
+    authenticates the ciphertext and any additional data with a 16-byte tag.
+    The AES peripheral does both in hardware, a block every few dozen clock
+    cycles, so encryption keeps up with the Ethernet port.
+
+    Each message is encrypted under a 12-byte initialization vector that must
+    never be used twice with the same key; SecureChannel builds them from a
+    random session and a counter, under a key derived for each session.
+    Long messages are moved through the peripheral by two DMA channels,
+    claimed from DmaManager the first time they are needed. Word-aligned
+    buffers let the DMA take them.
+
+    The peripheral runs one message at a time from the main loop; a call
+    made while it is busy, such as from an interrupt, fails.
+
+    \code{.cpp}
+    AesManager::Key key;
+    AesMgr.KeyExpand(key, keyBytes, 16);
+
+    uint8_t iv[AES_GCM_IV_SIZE];   // unique for every message
+    uint8_t tag[AES_GCM_TAG_SIZE];
+    AesMgr.GcmEncrypt(key, iv, nullptr, 0, plain, cipher, length, tag);
+    if (!AesMgr.GcmDecrypt(key, iv, nullptr, 0, cipher, plain, length, tag)) {
+        // Forged or corrupted
+    }
+    \endcode
+**/
+class AesManager {
+    friend class SysManager;
+
+public:
+    /**
+        \brief An AES key with its GCM hash subkey.
+    **/
+    typedef struct {
+        /// The key words, as loaded into the peripheral
+        uint32_t Words[8];
+        /// The hash subkey H, the key's encryption of a zero block
+        uint32_t Hash[4];
+        /// The key length in bytes: 16, 24 or 32, or 0 if not set
+        uint8_t Length;
+    } Key;
+
+#ifndef HIDE_FROM_DOXYGEN
+    /**
+        Public accessor for singleton instance
+    **/
+    static AesManager &Instance();
+#endif
+
+    /**
+        \brief Prepare a key for GcmEncrypt() and GcmDecrypt().
+
+        \param[out] key The prepared key.
+        \param[in] bytes The key.
+        \param[in] length The key length: 16, 24 or 32 bytes.
+
+        \return True if the key was prepared.
+    **/
+    bool KeyExpand(Key &key, const uint8_t *bytes, uint8_t length);
+
+    /**
+        \brief Encrypt and authenticate a message.
+
+        \param[in] key The key.
+        \param[in] iv The #AES_GCM_IV_SIZE byte initialization vector.
+        \param[in] aad Additional data authenticated but not encrypted, or
+        null.
+        \param[in] aadLength The number of bytes of additional data.
+        \param[in] in The plaintext.
+        \param[out] out The ciphertext, the same length. It may be \a in.
+        \param[in] length The number of bytes to encrypt.
+        \param[out] tag The #AES_GCM_TAG_SIZE byte authentication tag.
+
+        \return False if the key is not set or the peripheral is busy.
+    **/
+    bool GcmEncrypt(const Key &key, const uint8_t *iv, const uint8_t *aad,
+                    uint16_t aadLength, const uint8_t *in, uint8_t *out,
+                    uint16_t length, uint8_t *tag);
+
+    /**
+        \brief Check and decrypt a message.
+
+        \param[in] key The key.
+        \param[in] iv The initialization vector the message was sent with.
+        \param[in] aad The additional data sent with the message, or null.
+        \param[in] aadLength The number of bytes of additional data.
+        \param[in] in The ciphertext.
+        \param[out] out The plaintext, the same length. It may be \a in.
+        It is cleared if the tag does not match.
+        \param[in] length The number of bytes to decrypt.
+        \param[in] tag The tag sent with the message.
+
+        \return True if the message is authentic.
+    **/
+    bool GcmDecrypt(const Key &key, const uint8_t *iv, const uint8_t *aad,
+                    uint16_t aadLength, const uint8_t *in, uint8_t *out,
+                    uint16_t length, const uint8_t *tag);
+
+    /**
+        \brief A 32-bit word from the true random number generator.
+    **/
+    uint32_t Random();
+
+private:
+    volatile bool m_busy;
+    // The channels feeding and draining the AES, once claimed
+    uint8_t m_dmaWrite;
+    uint8_t m_dmaRead;
+
+    /**
+        Construct
+    **/
+    AesManager();
+
+    /**
+        Clock the AES and the random number generator
+    **/
+    void Initialize();
+
+    void Configure(const Key &key, uint32_t mode, bool encrypt);
+    void BlockRun(const uint8_t *in, uint8_t *out, uint8_t length,
+                  uint32_t control);
+    bool BlocksDma(const uint8_t *in, uint8_t *out, uint16_t blocks);
+    bool Gcm(const Key &key, const uint8_t *iv, const uint8_t *aad,
+             uint16_t aadLength, const uint8_t *in, uint8_t *out,
+             uint16_t length, bool encrypt, uint8_t *tag);
+}; // AesManager
+
+} // ClearCore namespace
+
+#endif // __AESMANAGER_H__
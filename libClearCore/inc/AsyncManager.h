@@ -0,0 +1,277 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    \file AsyncManager.h
+    \brief ClearCore stackless coroutines for waiting without blocking.
+
+    Lets a sequence of steps that waits on delays, connections and other
+    slow operations be written top to bottom, while the main loop keeps
+    running between the steps.
+**/
+
+#ifndef __ASYNCMANAGER_H__
+#define __ASYNCMANAGER_H__
+
+#include <stdint.h>
+#include "SysTiming.h"
+
+namespace ClearCore {
+
+/// The maximum number of coroutines the AsyncManager can run at once
+#ifndef ASYNC_MANAGER_MAX_COROUTINES
+#define ASYNC_MANAGER_MAX_COROUTINES 8
+#endif
+
+/// The coroutine ID returned when a coroutine could not be started
+#define ASYNC_INVALID (-1)
+
+/**
+    \brief The result of one step of a coroutine.
+**/
+typedef enum {
+    /// The coroutine is waiting and should be stepped again
+    ASYNC_PENDING,
+    /// The coroutine ran to its end
+    ASYNC_DONE,
+} AsyncStatus;
+
+/**
+    \brief The state a coroutine keeps between its steps.
+
+    Local variables of a coroutine function do not survive a wait; keep
+    anything needed after one in the object \a Arg points to, or in a
+    static.
+**/
+typedef struct {
+    /// Where the coroutine resumes; 0 starts it from the beginning
+    uint16_t Resume;
+    /// Set by ASYNC_AWAIT_MS() when its wait ended by timing out
+    bool TimedOut;
+    /// When the current timed wait started, from Milliseconds()
+    uint32_t StartMs;
+    /// The argument the coroutine was started with
+    void *Arg;
+} AsyncContext;
+
+/**
+    \brief Begin the body of a coroutine function.
+
+    Local variables must be declared before ASYNC_BEGIN(). A coroutine
+    must not wait from inside a switch statement of its own, and may wait
+    only once per source line.
+**/
+#define ASYNC_BEGIN(ctx) switch ((ctx).Resume) { case 0:
+
+/**
+    \brief End the body of a coroutine function; it returns #ASYNC_DONE.
+**/
+#define ASYNC_END(ctx) } (ctx).Resume = 0; return ASYNC_DONE
+
+/**
+    \brief Return until \a cond is true, resuming at this point.
+**/
+#define ASYNC_AWAIT(ctx, cond)                                              \
+    do {                                                                    \
+        (ctx).Resume = __LINE__; case __LINE__:                             \
+        if (!(cond)) {                                                      \
+            return ASYNC_PENDING;                                           \
+        }                                                                   \
+    } while (0)
+
+/**
+    \brief Return until \a cond is true or \a ms milliseconds pass; the
+    context's TimedOut tells which.
+**/
+#define ASYNC_AWAIT_MS(ctx, cond, ms)                                       \
+    do {                                                                    \
+        (ctx).StartMs = Milliseconds();                                     \
+        ASYNC_AWAIT(ctx, !((ctx).TimedOut = !(cond)) ||                     \
+                    Milliseconds() - (ctx).StartMs >= (ms));                \
+    } while (0)
+
+/**
+    \brief Return for \a ms milliseconds; the awaitable Delay_ms().
+**/
+#define ASYNC_DELAY_MS(ctx, ms)                                             \
+    do {                                                                    \
+        (ctx).StartMs = Milliseconds();                                     \
+        ASYNC_AWAIT(ctx, Milliseconds() - (ctx).StartMs >= (ms));           \
+    } while (0)
+
+/**
+    \brief Return once, resuming at this point on the next step.
+**/
+#define ASYNC_YIELD(ctx)                                                    \
+    do {                                                                    \
+        (ctx).Resume = __LINE__;                                            \
+        return ASYNC_PENDING;                                               \
+        case __LINE__:;                                                     \
+    } while (0)
+
+/**
+    \brief Finish the coroutine now.
+**/
+#define ASYNC_EXIT(ctx)                                                     \
+    do {                                                                    \
+        (ctx).Resume = 0;                                                   \
+        return ASYNC_DONE;                                                  \
+    } while (0)
+
+/**
+    \class AsyncManager
+    \brief ClearCore stackless coroutine executor.
+
+    A coroutine is a function taking an AsyncContext that waits with the
+    ASYNC_ macros instead of blocking. Each wait returns #ASYNC_PENDING and
+    records where to resume, so all coroutines share the main stack and a
+    waiting coroutine costs only its context. Run() steps every running
+    coroutine once, from the main loop or as a TaskManager task.
+
+    The blocking calls of the library have nonblocking counterparts that
+    make them awaitable:
+    - Delay_ms(): ASYNC_DELAY_MS()
+    - EthernetTcpClient::Connect(): EthernetTcpClient::ConnectAsync(), then
+      await EthernetTcpClient::ConnectStatus()
+    - EthernetManager::DhcpBegin(): EthernetManager::DhcpBeginAsync(), then
+      await EthernetManager::DhcpState()
+    - CcioBoardManager::CcioDiscover():
+      CcioBoardManager::CcioDiscoverStart(), then await
+      CcioBoardManager::CcioDiscoverBusy()
+    - NvmManager::FinishNvmWrite(): NvmManager::BlockWriteAsync(), then
+      await NvmManager::AsyncWriteActive()
+    - SerialBase::WaitForTransmitIdle(): await SerialBase::TransmitDone()
+
+    \code{.cpp}
+    EthernetTcpClient client;
+
+    AsyncStatus Report(AsyncContext &ctx) {
+        ASYNC_BEGIN(ctx);
+        EthernetMgr.Setup();
+        EthernetMgr.DhcpBeginAsync();
+        ASYNC_AWAIT(ctx, EthernetMgr.DhcpState() >=
+                         EthernetManager::DHCP_STATUS_BOUND);
+        while (true) {
+            client.ConnectAsync(IpAddress(192, 168, 0, 10), 8888);
+            ASYNC_AWAIT(ctx, client.ConnectStatus() >=
+                             EthernetTcpClient::CONNECT_CONNECTED);
+            if (client.Connected()) {
+                client.Send("hello");
+                ConnectorUsb.SendLine("sent");
+                ASYNC_AWAIT(ctx, ConnectorUsb.TransmitDone());
+                client.Close();
+            }
+            ASYNC_DELAY_MS(ctx, 1000);
+        }
+        ASYNC_END(ctx);
+    }
+
+    void AsyncTask() {
+        EthernetMgr.Refresh();
+        AsyncMgr.Run();
+    }
+
+    int main() {
+        AsyncMgr.Start(Report);
+        TaskMgr.TaskAddPeriodic(AsyncTask, 1);
+        while (true) {
+            TaskMgr.Run();
+        }
+    }
+    \endcode
+**/
+class AsyncManager {
+    friend class SysManager;
+
+public:
+    /**
+        The function run by a coroutine.
+    **/
+    typedef AsyncStatus (*AsyncFunction)(AsyncContext &ctx);
+
+#ifndef HIDE_FROM_DOXYGEN
+    /**
+        Public accessor for singleton instance.
+    **/
+    static AsyncManager &Instance();
+#endif
+
+    /**
+        \brief Start a coroutine; its first step runs in the next Run().
+
+        \param[in] function The coroutine function.
+        \param[in] arg Passed to the coroutine in its context's Arg.
+
+        \return The coroutine ID, or #ASYNC_INVALID if the executor is full
+        or the function is null.
+    **/
+    int8_t Start(AsyncFunction function, void *arg = nullptr);
+
+    /**
+        \brief Stop a coroutine without running the rest of it.
+
+        \param[in] id The ID returned by Start().
+
+        \return True if the coroutine was running.
+    **/
+    bool Cancel(int8_t id);
+
+    /**
+        \brief Check whether a coroutine is still running.
+
+        \param[in] id The ID returned by Start().
+    **/
+    bool Running(int8_t id);
+
+    /**
+        \brief The number of coroutines that are running.
+    **/
+    uint8_t RunningCount() {
+        return m_runningCount;
+    }
+
+    /**
+        \brief Step every running coroutine once.
+
+        Call repeatedly from the main loop, or from a TaskManager task.
+        A coroutine that finishes frees its slot.
+    **/
+    void Run();
+
+private:
+    struct Coroutine {
+        AsyncFunction Function;
+        AsyncContext Context;
+    };
+
+    Coroutine m_coroutines[ASYNC_MANAGER_MAX_COROUTINES];
+    uint8_t m_runningCount;
+
+    /**
+        Construct
+    **/
+    AsyncManager();
+}; // AsyncManager
+
+} // ClearCore namespace
+
+#endif // __ASYNCMANAGER_H__
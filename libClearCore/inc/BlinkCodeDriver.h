@@ -33,6 +33,7 @@
 #define BLINKCODEDRIVER_H_
 
 #include <stdint.h>
+#include "SysTiming.h"
 
 #ifndef HIDE_FROM_DOXYGEN
 namespace ClearCore {
@@ -145,12 +146,12 @@ private:
           m_blinkCnt(0),
           m_ledOn(false),
           m_patternWrap(false),
-          m_strobeOnOffTicks(250),
-          m_blinkTicks(2500),
-          m_prestartTicks(5000),
-          m_startTicks(11500),
-          m_pregroupTicks(5000),
-          m_precodeTicks(2500) {}
+          m_strobeOnOffTicks(MS_TO_LED_UPDATES(50)),
+          m_blinkTicks(MS_TO_LED_UPDATES(500)),
+          m_prestartTicks(MS_TO_LED_UPDATES(1000)),
+          m_startTicks(MS_TO_LED_UPDATES(2300)),
+          m_pregroupTicks(MS_TO_LED_UPDATES(1000)),
+          m_precodeTicks(MS_TO_LED_UPDATES(500)) {}
 
     /**
         Activate the given blink code.
@@ -160,7 +161,7 @@ private:
     }
 
     /**
-        Update the blink codes.
+        Update the blink codes. Called at #LED_UPDATE_RATE_HZ.
     **/
     void Update();
 
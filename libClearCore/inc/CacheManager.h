@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    \file CacheManager.h
+    \brief ClearCore Cortex-M cache controller (CMCC) manager.
+
+    Turns the processor's flash cache on or off and counts its hits.
+**/
+
+#ifndef __CACHEMANAGER_H__
+#define __CACHEMANAGER_H__
+
+#include <stdint.h>
+
+namespace ClearCore {
+
+/**
+    \class CacheManager
+    \brief ClearCore Cortex-M cache controller (CMCC) manager.
+
+    The CMCC caches the processor's instruction and data reads from flash, so
+    code and constant tables run without the flash wait states once they are
+    in the cache. It is turned on at start-up when CONF_CMCC_ENABLE is set in
+    hpl_cmcc_config.h, sized and split between instructions and data by the
+    other settings in that file.
+
+    Only the code region is cached. SRAM, where every DMA buffer and
+    descriptor lives (ADC results, SPI blocks, Ethernet descriptors and
+    frames), is reached over the system bus and never cached, so the DMA
+    needs no cache maintenance. The cache must be invalidated after flash is
+    programmed or erased, as the KeyValueStore does, so later reads do not
+    return the old contents.
+
+    The cache's monitor counts one kind of event at a time: cycles with the
+    cache enabled, instruction hits, or data hits.
+
+    \code{.cpp}
+    CacheMgr.MonitorStart(CacheManager::MONITOR_INSTRUCTION_HIT);
+    // ... run the code to measure ...
+    uint32_t hitsPerKiloCycle = CacheMgr.MonitorRate();
+    \endcode
+**/
+class CacheManager {
+    friend class SysManager;
+
+public:
+    /**
+        The events the cache monitor can count.
+    **/
+    typedef enum {
+        /// CPU cycles with the cache enabled
+        MONITOR_CYCLE,
+        /// Instruction reads that hit the cache
+        MONITOR_INSTRUCTION_HIT,
+        /// Data reads that hit the cache
+        MONITOR_DATA_HIT,
+    } MonitorEvent;
+
+#ifndef HIDE_FROM_DOXYGEN
+    /**
+        Public accessor for singleton instance.
+    **/
+    static CacheManager &Instance();
+#endif
+
+    /**
+        \brief Turn the cache on or off.
+
+        The cache is emptied when it is turned on.
+
+        \code{.cpp}
+        // Measure the loop time without the cache
+        CacheMgr.Enable(false);
+        \endcode
+
+        \param[in] enable True to turn the cache on.
+    **/
+    void Enable(bool enable);
+
+    /**
+        \brief Check whether the cache is on.
+    **/
+    bool Enabled();
+
+    /**
+        \brief Discard the cache's contents.
+
+        Call after programming or erasing flash outside of the library. Does
+        nothing if the cache is off.
+    **/
+    void Invalidate();
+
+    /**
+        \brief Start counting an event, clearing the count.
+
+        \code{.cpp}
+        CacheMgr.MonitorStart(CacheManager::MONITOR_DATA_HIT);
+        \endcode
+
+        \param[in] event The event to count.
+    **/
+    void MonitorStart(MonitorEvent event);
+
+    /**
+        \brief Stop counting.
+    **/
+    void MonitorStop();
+
+    /**
+        \brief The number of events counted since MonitorStart().
+    **/
+    uint32_t MonitorCount();
+
+    /**
+        \brief The events counted per thousand CPU cycles since
+        MonitorStart().
+
+        For hits, this is the share of the elapsed cycles in which a read was
+        served from the cache, which is how the hit rate is read when the
+        monitor cannot count misses.
+
+        \return The events per thousand cycles, or 0 if no cycles have
+        passed.
+    **/
+    uint32_t MonitorRate();
+
+private:
+    // DWT cycle count when the monitor started
+    uint32_t m_monitorStartCycles;
+
+    /**
+        Construct
+    **/
+    CacheManager();
+
+    /**
+        Configure and enable the cache if set up to in hpl_cmcc_config.h.
+    **/
+    void Initialize();
+}; // CacheManager
+
+} // ClearCore namespace
+
+#endif // __CACHEMANAGER_H__
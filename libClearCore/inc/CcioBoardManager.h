@@ -54,6 +54,16 @@ namespace ClearCore {
 #define CCIO_PIN_CNT (CCIO_PINS_PER_BOARD * MAX_CCIO_DEVICES)
 #endif
 
+/** The CCIO-8 link SPI clock rate. **/
+#ifndef CCIO_DEFAULT_BAUD_RATE
+#define CCIO_DEFAULT_BAUD_RATE 500000
+#endif
+
+/** The CCIO-8 link SPI clock rate in the high-speed link mode. **/
+#ifndef CCIO_FAST_BAUD_RATE
+#define CCIO_FAST_BAUD_RATE 2500000
+#endif
+
 /** The maximum number of times to attempt to flush data through the chain of
     connected  CCIO-8 boards during the discover process before bailing out. **/
 #ifndef MAX_FLUSH_ATTEMPTS
@@ -85,12 +95,24 @@ namespace ClearCore {
     accessed through this class, in addition to the individual access available
     through the CcioPin class.
 
+    Two independent chains of up to #MAX_CCIO_DEVICES boards each can be run,
+    one on each COM port. CcioMgr manages the first port put in CCIO mode,
+    with the pins from #CLEARCORE_PIN_CCIOA0; CcioMgr1 manages the other,
+    with the pins from CLEARCORE_PIN_CCIO1(0). Each chain has its own SPI
+    transfers, which run in the background at the same time, so a second
+    chain adds to the I/O without slowing the first chain's refresh. The
+    masks taken and returned by each manager cover its own chain, bit 0
+    being its first pin. The process image, logic engine and replay cover
+    the first chain.
+
     For more detailed information on the CCIO-8 system, check out the \ref
     CCIOMain informational page.
 **/
 class CcioBoardManager {
     friend class SysManager;
     friend class CcioPin;
+    friend class ProcessImage;
+    friend class ReplayManager;
 
 public:
 #ifndef HIDE_FROM_DOXYGEN
@@ -98,8 +120,41 @@ public:
         Public accessor for singleton instance
     **/
     static CcioBoardManager &Instance();
+
+    /**
+        Public accessor for the second chain's instance
+    **/
+    static CcioBoardManager &Instance1();
+
+    /**
+        The manager for a COM port put in CCIO mode: the one already
+        running on it, else the first chain if it is free, else the second.
+    **/
+    static CcioBoardManager &ChainByPort(SerialDriver *comInstance);
 #endif
 
+    /**
+        \brief The manager of the chain a CCIO-8 pin is on.
+
+        \code{.cpp}
+        CcioBoardManager *chain =
+            CcioBoardManager::ChainByPin(CLEARCORE_PIN_CCIO1(3));
+        // chain is &CcioMgr1
+        \endcode
+
+        \param[in] pin The pin.
+        \return CcioMgr or CcioMgr1, or NULL if \a pin is not a CCIO-8 pin.
+    **/
+    static CcioBoardManager *ChainByPin(ClearCorePins pin);
+
+    /**
+        \brief The index of the chain's first pin, #CLEARCORE_PIN_CCIOA0 or
+        CLEARCORE_PIN_CCIO1(0).
+    **/
+    ClearCorePins PinBase() {
+        return m_pinBase;
+    }
+
     /**
         \brief Read the digital state of the specified CCIO-8 pin.
 
@@ -195,6 +250,89 @@ public:
         return m_pulseActive;
     }
 
+    /**
+        \brief One step of a CCIO-8 output sequence.
+    **/
+    typedef struct {
+        /// The outputs the step sets
+        uint64_t Mask;
+        /// The states of the outputs in \a Mask
+        uint64_t Value;
+        /// How long the step lasts before the next one [ms]
+        uint32_t DurationMs;
+    } OutputStep;
+
+    /**
+        \brief Stage output states to be written together by OutputsCommit().
+
+        Several calls may be staged before a commit; a later call overrides
+        the states of the pins it shares with an earlier one.
+
+        \code{.cpp}
+        // Switch the first CCIO-8 board's connectors 0-3 on, and 4-7 off,
+        // all on the same link refresh
+        CcioMgr.OutputsStage(0xff, 0x0f);
+        CcioMgr.OutputsCommit();
+        \endcode
+
+        \param[in] mask The CCIO-8 pins to set, with the LSB being the first
+        pin on the first CCIO-8 in the chain.
+        \param[in] value The states of the pins in \a mask.
+    **/
+    void OutputsStage(uint64_t mask, uint64_t value);
+
+    /**
+        \brief Write the staged output states in one step.
+
+        Every staged output changes on the same link refresh. Pins that are
+        not in output mode are left alone, and any output pulses running on
+        the staged pins stop.
+    **/
+    void OutputsCommit();
+
+    /**
+        \brief Play a sequence of output states.
+
+        Each step sets its outputs on the same link refresh, then holds them
+        for the step's duration before the next step. The sequence runs from
+        the sample rate update, so its timing is independent of the main
+        loop. Once the last pass ends the outputs keep the states of the final
+        step. Output pulses running on any pin the sequence sets are stopped.
+
+        \code{.cpp}
+        // Step through three valves, 250 ms each, 10 times
+        static const CcioBoardManager::OutputStep steps[] = {
+            {0x07, 0x01, 250},
+            {0x07, 0x02, 250},
+            {0x07, 0x04, 250},
+        };
+        CcioMgr.OutputSequenceStart(steps, 3, 10);
+        \endcode
+
+        \param[in] steps The steps, which must remain valid while the
+        sequence plays.
+        \param[in] count The number of steps.
+        \param[in] passes (optional) The number of times to play the steps.
+        Default: 0 (repeat until OutputSequenceStop()).
+        \return True if the sequence was started.
+    **/
+    bool OutputSequenceStart(const OutputStep *steps, uint16_t count,
+                             uint16_t passes = 0);
+
+    /**
+        \brief Stop the output sequence, leaving the outputs as they are.
+    **/
+    void OutputSequenceStop();
+
+    /**
+        \brief Check whether an output sequence is playing.
+
+        \return True while the sequence plays.
+    **/
+    bool OutputSequenceActive() {
+        return m_seqSteps != NULL;
+    }
+
     /**
         \brief Polls for and discovers all CCIO-8 boards connected to the
         ClearCore.
@@ -213,9 +351,55 @@ public:
         \param[in] comInstance A pointer to the SerialDriver that controls the
                                serial port that the CCIO-8 is plugged into
         \return Number of CCIO-8 devices connected.
+
+        \note This waits for the discovery to finish; see
+        CcioDiscoverStart() to discover without waiting.
     **/
     uint8_t CcioDiscover(SerialDriver *comInstance);
 
+    /**
+        \brief Start discovering the CCIO-8 boards connected to the ClearCore
+        without waiting for the result.
+
+        The system tick runs one step of the discovery each millisecond, so
+        the main loop keeps running while the link is probed. The boards of
+        a link that broke hold their outputs while it is rediscovered, and
+        once the link is rebuilt the connectors keep their modes and output
+        states, so the boards that were already known carry on where they
+        left off.
+
+        \code{.cpp}
+        void CcioFound(uint8_t count) {
+            // count CCIO-8 boards are online
+        }
+
+        ConnectorCOM1.Mode(Connector::CCIO);
+        ConnectorCOM1.PortOpen();
+        CcioMgr.CcioDiscoverStart(&ConnectorCOM1, CcioFound);
+        \endcode
+
+        \param[in] comInstance A pointer to the SerialDriver that controls the
+                               serial port that the CCIO-8 is plugged into
+        \param[in] callback Called from the system tick with the number of
+        boards found once the discovery finishes, or NULL. Automatic
+        rediscovery calls it too.
+
+        \return True if the discovery started; false if the link is already
+        up, or it is broken with automatic rediscovery disabled.
+    **/
+    bool CcioDiscoverStart(SerialDriver *comInstance,
+                           void (*callback)(uint8_t count) = NULL);
+
+    /**
+        \brief Check whether a discovery is running.
+
+        \return True until a discovery started by CcioDiscoverStart() or by
+        automatic rediscovery finishes.
+    **/
+    bool CcioDiscoverBusy() {
+        return m_discoverAsync;
+    }
+
 #ifndef HIDE_FROM_DOXYGEN
     /**
         Cleanly closes the CCIO-8 connection.
@@ -228,6 +412,44 @@ public:
     void LinkClose();
 #endif
 
+    /**
+        \brief Enable or disable the high-speed CCIO-8 link mode.
+
+        The high-speed mode runs the link's SPI clock at
+        #CCIO_FAST_BAUD_RATE rather than #CCIO_DEFAULT_BAUD_RATE, which lets
+        the link refresh every sample time even with eight CCIO-8 boards.
+        Each refresh also starts the SPI transfer prepared by the previous
+        refresh right away and processes the data of the transfer before it
+        while the new one runs, rather than waiting for the transfer to
+        finish. Outputs and inputs are one refresh later in this pipeline,
+        so the time from an input changing to it being seen drops from up to
+        four sample times to two.
+
+        If the link is up it is rebuilt at the new rate. If the link breaks
+        in the high-speed mode, when the cabling cannot carry the faster
+        clock for instance, the next rediscover falls back to the standard
+        rate until the mode is enabled again.
+
+        \code{.cpp}
+        // Refresh the CCIO-8 link every sample
+        CcioMgr.LinkFast(true);
+        ConnectorCOM0.Mode(Connector::CCIO);
+        ConnectorCOM0.PortOpen();
+        \endcode
+
+        \param[in] enable True to use the high-speed link mode.
+    **/
+    void LinkFast(bool enable);
+
+    /**
+        \brief Check whether the link runs in the high-speed mode.
+
+        \return True if the link was discovered at #CCIO_FAST_BAUD_RATE.
+    **/
+    bool LinkFast() {
+        return m_linkFastActive;
+    }
+
     /**
         \brief Accessor for the number of CCIO-8 boards connected to the
         ClearCore.
@@ -399,11 +621,22 @@ public:
         \brief Accessor for the CCIO-8 link refresh rate
 
         Calculates and returns the refresh rate based on the number
-        of CCIO-8 boards currently connected.
+        of CCIO-8 boards currently connected. The link is refreshed after
+        enough samples for half of a 5 kHz sample time (100 us) per board.
+        In the high-speed link mode, the link is refreshed after enough
+        samples to spend at most half of each sample time transferring.
     **/
     uint8_t RefreshRate() {
-        uint8_t cnt = CcioCount();
-        return (cnt > 1) ? (cnt >> 1) : 1;
+        if (m_linkFastActive) {
+            uint32_t bits = (2 * static_cast<uint32_t>(CcioCount()) + 1) * 8;
+            uint8_t cnt = (2 * bits * _CLEARCORE_SAMPLE_RATE_HZ +
+                           CCIO_FAST_BAUD_RATE - 1) / CCIO_FAST_BAUD_RATE;
+            return (cnt > 1) ? cnt : 1;
+        }
+        uint8_t cnt =
+            static_cast<uint32_t>(CcioCount()) * _CLEARCORE_SAMPLE_RATE_HZ /
+            10000;
+        return (cnt > 1) ? cnt : 1;
     }
 
 private:
@@ -432,8 +665,16 @@ private:
         CCIO_FOUND
     } CcioDiscoverState;
 
+    // The index of the chain's first pin
+    ClearCorePins m_pinBase;
+
     CcioBuf m_writeBuf;
     CcioBuf m_readBuf;
+    // The second buffer pair of the high-speed link's transfer pipeline
+    CcioBuf m_writeBufAlt;
+    CcioBuf m_readBufAlt;
+    // True when the Alt buffers hold the next transfer to start
+    bool m_bufAlt;
 
     // Reference for the discovery state of the CCIO-8 link network
     CcioDiscoverState m_discoverState;
@@ -448,6 +689,10 @@ private:
     uint8_t m_ccioRefreshDelay;
     // Currently overloaded outputs
     uint64_t m_throttledOutputs;
+    // Outputs whose overload delay timer is counting down
+    uint64_t m_overloadTripping;
+    // Inputs whose filter is counting down
+    uint64_t m_filtering;
 
     // Storage for inputs/outputs (max 64 pins to a serial port)
     // LSB corresponds to 1st pin on 1st CCIO-8 in the chain
@@ -466,6 +711,18 @@ private:
     uint64_t m_pulseValue;
     uint64_t m_pulseStopPending;
 
+    // Batched output writes, staged by the application
+    uint64_t m_stagedMask;
+    uint64_t m_stagedValue;
+
+    // Output sequence control variables
+    const OutputStep *volatile m_seqSteps;
+    uint16_t m_seqCount;
+    uint16_t m_seqIndex;
+    uint16_t m_seqPasses;
+    uint16_t m_seqPass;
+    uint32_t m_seqTicksLeft;
+
     uint16_t m_consGlitchCnt;   // count of consecutive glitches detected
     bool m_ccioLinkBroken;
     uint64_t m_ccioOverloaded;
@@ -476,13 +733,32 @@ private:
     uint32_t m_faultLed;
     bool m_autoRediscover;
     uint32_t m_lastDiscoverTime;
+    // Discovery run by the system tick, and the progress of any discovery
+    volatile bool m_discoverAsync;
+    bool m_discoverSend;
+    bool m_discoverFlush0;
+    uint8_t m_discoverFlushCnt;
+    void (*m_discoverCallback)(uint8_t count);
+    // High-speed link mode: requested, in use, and failed on this link
+    bool m_linkFast;
+    bool m_linkFastActive;
+    bool m_linkFastFailed;
+    // The filtered inputs come from a replay instead of the link
+    volatile bool m_inputsReplay;
 
     CcioPin m_ccioPins[CCIO_PIN_CNT];
 
     /**
         Constructor
     **/
-    CcioBoardManager();
+    explicit CcioBoardManager(ClearCorePins pinBase);
+
+    /**
+        Check whether a pin is on this chain.
+    **/
+    bool PinOnChain(ClearCorePins pin) {
+        return pin >= m_pinBase && pin < m_pinBase + CCIO_PIN_CNT;
+    }
 
     /**
         Initializes the CCIO-8 manager and the CcioPin objects.
@@ -499,11 +775,48 @@ private:
     **/
     void RefreshSlow();
 
+    /**
+        Move the output sequence to its next step. Called from Refresh.
+    **/
+    void OutputSequenceNext();
+
+    /**
+        Set up the port to probe the link. Returns false if there is no
+        port.
+    **/
+    bool DiscoverBegin(SerialDriver *comInstance);
+
+    /**
+        Run one transfer of the discovery. Returns true until the discovery
+        finishes.
+    **/
+    bool DiscoverStep();
+
+    /**
+        Mark the link broken after a failed discovery.
+    **/
+    void DiscoverFail();
+
+    /**
+        Bring up a link of \a numFound boards and finish the discovery.
+    **/
+    void DiscoverFinish(uint8_t numFound);
+
+    /**
+        Start an asynchronous transfer of the link data.
+    **/
+    void LinkTransferStart(CcioBuf &writeBuf, CcioBuf &readBuf);
+
     /**
         Set the current output overload bits
     **/
     void IoOverloadRT(uint64_t overloadState);
 
+    /**
+        Set the filtered inputs, latching their rise/fall.
+    **/
+    void InputsApply(uint64_t inputs);
+
     /*
         Fill a buffer with len bytes of the given val
     */
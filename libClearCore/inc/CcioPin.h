@@ -38,6 +38,8 @@
 
 namespace ClearCore {
 
+class CcioBoardManager;
+
 /**
     \class CcioPin
     \brief Connector class for an individual CCIO-8 pin.
@@ -167,10 +169,7 @@ public:
 
         \note One sample time is 200 microseconds.
     **/
-    void FilterLength(uint16_t samples) {
-        m_filterLength = samples;
-        m_filterTicksLeft = samples;
-    }
+    void FilterLength(uint16_t samples);
 
     /**
         \brief Set the connector's digital filter length in ms.
@@ -298,7 +297,8 @@ protected:
 #endif
 
 private:
-    // Port access
+    // Port access, through the manager of the chain the pin is on
+    CcioBoardManager *m_mgr;
     uint64_t m_dataBit;
 
     // Stability filter
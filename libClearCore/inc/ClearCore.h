@@ -25,24 +25,69 @@
 
 // Header files from the ClearCore hardware that define connectors available
 #include "AdcManager.h"
+#include "AesManager.h"
+#include "AsyncManager.h"
+#include "CacheManager.h"
 #include "CcioBoardManager.h"
+#include "CommandBatch.h"
+#include "CrashManager.h"
+#include "CrcManager.h"
+#include "DataLogger.h"
+#include "DeltaTelemetry.h"
 #include "DigitalIn.h"
 #include "DigitalInAnalogIn.h"
 #include "DigitalInOut.h"
 #include "DigitalInOutAnalogOut.h"
 #include "DigitalInOutHBridge.h"
+#include "DspFilter.h"
+#include "EthernetIpAdapter.h"
 #include "EthernetManager.h"
+#include "EventManager.h"
+#include "FatFileSystem.h"
+#include "FirmwareUpdate.h"
+#include "HttpServer.h"
 #include "InputManager.h"
+#include "KeyValueStore.h"
 #include "LedDriver.h"
+#include "LogCompressor.h"
+#include "LogicEngine.h"
+#include "MemoryManager.h"
+#include "MemoryPool.h"
 #include "EncoderInput.h"
+#include "ModbusRtu.h"
+#include "ModbusTcpServer.h"
+#include "MotionGroup.h"
+#include "MotionUnits.h"
 #include "MotorDriver.h"
 #include "MotorManager.h"
+#include "NumberFormat.h"
+#include "PidController.h"
+#include "PositionCapture.h"
+#include "PositionCompare.h"
+#include "ProcessImage.h"
+#include "ProgramPlayer.h"
+#include "PtpManager.h"
+#include "QuadratureDecoder.h"
+#include "RegisterMap.h"
+#include "ReplayManager.h"
+#include "RingBuffer.h"
+#include "ScopeCapture.h"
 #include "SdCardDriver.h"
+#include "SecureChannel.h"
 #include "SerialDriver.h"
+#include "SerialPacket.h"
 #include "SerialUsb.h"
+#include "SntpManager.h"
 #include "StatusManager.h"
+#include "SyncManager.h"
 #include "SysManager.h"
 #include "SysTiming.h"
+#include "TaskManager.h"
+#include "TelemetrySchema.h"
+#include "TraceManager.h"
+#include "UdpProcessData.h"
+#include "UsbMassStorage.h"
+#include "XBeeApi.h"
 #include "XBeeDriver.h"
 
 
@@ -79,6 +124,10 @@ extern MotorDriver ConnectorM3;             ///< M-3 connector instance
 
 // Serial Port connectors
 extern SerialUsb    ConnectorUsb;           ///< USB connector instance
+// The second and third USB serial ports, present when the library is built
+// with CONF_USB_CDCD_ACM_PORTS set to 2 or 3
+extern SerialUsb    ConnectorUsb1;          ///< USB port 1 instance
+extern SerialUsb    ConnectorUsb2;          ///< USB port 2 instance
 extern SerialDriver ConnectorCOM0;          ///< COM-0 connector instance
 extern SerialDriver ConnectorCOM1;          ///< COM-1 connector instance
 
@@ -88,6 +137,9 @@ extern EthernetManager &EthernetMgr;
 /// CCIO-8 manager
 extern CcioBoardManager &CcioMgr;
 
+/// CCIO-8 manager of the second chain
+extern CcioBoardManager &CcioMgr1;
+
 /// Motor connector manager
 extern MotorManager &MotorMgr;
 
@@ -109,9 +161,72 @@ extern StatusManager &StatusMgr;
 /// Timing manager
 extern SysTiming &TimingMgr;
 
+/// Main loop task scheduler
+extern TaskManager &TaskMgr;
+
+/// Main loop coroutine executor
+extern AsyncManager &AsyncMgr;
+
+/// Flash cache controller
+extern CacheManager &CacheMgr;
+
+/// RAM budget and usage report
+extern MemoryManager &MemoryMgr;
+
+/// Real-time event trace
+extern TraceManager &TraceMgr;
+
+/// Hard fault and watchdog crash snapshot
+extern CrashManager &CrashMgr;
+
+/// I/O process image
+extern ProcessImage &ProcessImg;
+
+/// Binary command batch interpreter
+extern CommandBatch &CmdBatch;
+
+/// Record and replay of the sampled inputs and commands
+extern ReplayManager &ReplayMgr;
+
+/// Journaled key/value store in flash
+extern KeyValueStore &KvStore;
+
+/// PTP time synchronization
+extern PtpManager &PtpMgr;
+
+/// SNTP wall-clock time
+extern SntpManager &SntpMgr;
+
+/// Multi-board sample tick synchronization
+extern SyncManager &SyncMgr;
+
+/// Sample rate I/O logic engine
+extern LogicEngine &LogicEng;
+
+/// Sample rate triggered capture
+extern ScopeCapture &Scope;
+
 /// SD card
 extern SdCardDriver SdCard;
 
+/// FAT32 file system on the SD card
+extern FatFileSystem &FileSys;
+
+/// Sample rate data logger to the SD card
+extern DataLogger &DataLog;
+
+/// USB mass storage access to the SD card
+extern UsbMassStorage &UsbMsc;
+
+/// DSU-backed CRC service
+extern CrcManager &CrcMgr;
+
+/// AES-GCM on the AES peripheral
+extern AesManager &AesMgr;
+
+/// Event System channel manager
+extern EventManager &EventMgr;
+
 /// System manager
 extern SysManager SysMgr;
 }
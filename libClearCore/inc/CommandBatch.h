@@ -0,0 +1,303 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+    \file CommandBatch.h
+    \brief ClearCore binary command batch interpreter.
+
+    Runs a host-supplied list of binary commands at a sample boundary and
+    answers the whole list with one response packet.
+**/
+
+#ifndef __COMMANDBATCH_H__
+#define __COMMANDBATCH_H__
+
+#include <stdint.h>
+
+namespace ClearCore {
+
+/// The largest batch request, in bytes
+#ifndef BATCH_REQUEST_MAX
+#define BATCH_REQUEST_MAX 256
+#endif
+
+/// The largest batch response, in bytes
+#ifndef BATCH_RESPONSE_MAX
+#define BATCH_RESPONSE_MAX 512
+#endif
+
+/// The size of the header that starts every batch request, in bytes
+#define BATCH_REQUEST_HEADER_LEN 2
+
+/// The size of the header that starts every batch response, in bytes
+#define BATCH_RESPONSE_HEADER_LEN 8
+
+/**
+    \class CommandBatch
+    \brief ClearCore binary command batch interpreter.
+
+    A host that would otherwise make a round trip for every command (set
+    the outputs, start a move, read the state) sends them together as one
+    batch. The batch is checked when it is submitted and then run by the
+    sample rate update, before anything else in the sample is refreshed,
+    so every command up to the first wait takes effect in the same sample.
+    A wait holds the rest of the batch until its event, checked once a
+    sample. Its response, with the data of every read, is ready once the
+    last command has run.
+
+    The transport is up to the application: a batch can arrive in a TCP
+    stream, a SerialPacket frame or a UDP datagram, and its response goes
+    back the same way.
+
+    A batch request is little-endian, a 2 byte header followed by the
+    commands back to back:
+    - Byte 0: A sequence number, echoed in the response.
+    - Byte 1: The number of commands.
+
+    Each command is an opcode byte followed by its fields:
+    - #BATCH_OP_MOVE: the motor connector number (uint8_t), the
+      StepGenerator::MoveTarget (uint8_t) and the distance or position in
+      step pulses (int32_t). See MotorDriver::Move().
+    - #BATCH_OP_MOVE_VELOCITY: the motor connector number (uint8_t) and the
+      velocity in step pulses per second (int32_t). See
+      MotorDriver::MoveVelocity().
+    - #BATCH_OP_OUTPUTS_WRITE: the IO-n connectors to write and their
+      states (uint32_t each), as ProcessImage::OutputsWrite().
+    - #BATCH_OP_SNAPSHOT_READ: the #ReadFlags of the data to add to the
+      response (uint8_t).
+    - #BATCH_OP_WAIT: the #WaitEvents event (uint8_t), its argument
+      (uint32_t), and the timeout in samples, or 0 to wait forever
+      (uint32_t).
+
+    The response is an 8 byte header followed by the data of the reads, in
+    the order they ran:
+    - Byte 0: The request's sequence number.
+    - Byte 1: The #BatchStatuses result.
+    - Byte 2: The number of commands that ran; on failure, the index of the
+      command that failed.
+    - Byte 3: Reserved, 0.
+    - Bytes 4-7: The sample tick the batch finished in.
+
+    Each read adds the ProcessImage::InputImage of the last sample for
+    #BATCH_READ_INPUTS, then the MotorManager::MotorsSnapshot of the last
+    sample for #BATCH_READ_MOTORS, then the CrashManager::CrashSnapshot for
+    #BATCH_READ_CRASH, each as its struct's bytes.
+
+    A command that is refused when it runs, such as a move into an asserted
+    limit, ends the batch there. The commands before it in the same sample
+    have already taken effect.
+
+    \code{.cpp}
+    // In the main loop: run each batch received and send back its result
+    uint8_t request[BATCH_REQUEST_MAX];
+    uint8_t response[BATCH_RESPONSE_MAX];
+    uint16_t length = ReceiveFromHost(request, sizeof(request));
+    if (length && !CmdBatch.Submit(request, length)) {
+        // Malformed, or the previous batch has not finished
+    }
+    length = CmdBatch.Response(response, sizeof(response));
+    if (length) {
+        SendToHost(response, length);
+    }
+    \endcode
+**/
+class CommandBatch {
+    friend class ReplayManager;
+    friend class SysManager;
+
+public:
+    /**
+        \enum Opcodes
+        \brief The batch commands.
+    **/
+    typedef enum {
+        /// Start a positional move
+        BATCH_OP_MOVE = 1,
+        /// Start a velocity move
+        BATCH_OP_MOVE_VELOCITY,
+        /// Write IO-n digital outputs together
+        BATCH_OP_OUTPUTS_WRITE,
+        /// Add state to the response
+        BATCH_OP_SNAPSHOT_READ,
+        /// Hold the rest of the batch until an event
+        BATCH_OP_WAIT,
+    } Opcodes;
+
+    /**
+        \enum ReadFlags
+        \brief The data added to the response by #BATCH_OP_SNAPSHOT_READ.
+    **/
+    typedef enum {
+        /// The ProcessImage input image
+        BATCH_READ_INPUTS = 0x01,
+        /// The MotorManager motor snapshot
+        BATCH_READ_MOTORS = 0x02,
+        /// The CrashManager snapshot from before the last reset
+        BATCH_READ_CRASH = 0x04,
+    } ReadFlags;
+
+    /**
+        \enum WaitEvents
+        \brief The events a #BATCH_OP_WAIT waits for.
+    **/
+    typedef enum {
+        /// The argument's number of samples have passed
+        BATCH_WAIT_SAMPLES,
+        /// Every connector in the argument's mask is asserted, as
+        /// InputManager::InputsRT()
+        BATCH_WAIT_INPUTS_ON,
+        /// Every connector in the argument's mask is deasserted
+        BATCH_WAIT_INPUTS_OFF,
+        /// Each motor whose bit is set in the argument has finished its
+        /// moves, as StepGenerator::StepsComplete()
+        BATCH_WAIT_MOVES_DONE,
+        /// The number of wait events
+        BATCH_WAIT_COUNT,
+    } WaitEvents;
+
+    /**
+        \enum BatchStatuses
+        \brief The result of a batch.
+    **/
+    typedef enum {
+        /// Every command ran
+        BATCH_DONE,
+        /// A command was refused
+        BATCH_FAILED,
+        /// A wait timed out
+        BATCH_TIMEOUT,
+        /// The batch was stopped with Abort()
+        BATCH_ABORTED,
+    } BatchStatuses;
+
+#ifndef HIDE_FROM_DOXYGEN
+    /**
+        Public accessor for singleton instance.
+    **/
+    static CommandBatch &Instance();
+#endif
+
+    /**
+        \brief Check a batch and queue it to run in the next sample.
+
+        The batch is copied, so \a request may be reused once this returns.
+
+        \param[in] request The batch request.
+        \param[in] length The request's length in bytes.
+
+        \return True if the batch was queued; false if a batch is still
+        running or its response has not been read, ReplayMgr is replaying,
+        or the request is malformed, names an invalid motor, connector or
+        event, or has a response longer than #BATCH_RESPONSE_MAX.
+    **/
+    bool Submit(const uint8_t *request, uint16_t length);
+
+    /**
+        \brief Check whether a batch is queued or running.
+    **/
+    bool Busy() {
+        return m_state == BATCH_STATE_RUNNING;
+    }
+
+    /**
+        \brief Take the response of the finished batch.
+
+        \param[out] buffer The buffer to copy the response to.
+        \param[in] size The buffer's size in bytes.
+
+        \return The response's length, or 0 if no batch has finished since
+        the last call or the response does not fit in \a size.
+    **/
+    uint16_t Response(uint8_t *buffer, uint16_t size);
+
+    /**
+        \brief Stop the running batch in the next sample. Its response has
+        the status #BATCH_ABORTED.
+    **/
+    void Abort();
+
+private:
+    typedef enum {
+        BATCH_STATE_IDLE,
+        BATCH_STATE_RUNNING,
+        BATCH_STATE_DONE,
+    } BatchStates;
+
+    volatile BatchStates m_state;
+    volatile bool m_abort;
+
+    // The request being run, and the position reached in it
+    uint8_t m_request[BATCH_REQUEST_MAX];
+    uint16_t m_length;
+    // The batch has yet to be handed to ReplayMgr for recording
+    bool m_recordPending;
+    uint8_t m_count;
+    uint8_t m_index;
+    uint16_t m_offset;
+    // The tick the current wait started in, if one is waiting
+    bool m_waiting;
+    uint32_t m_waitStart;
+
+    uint8_t m_response[BATCH_RESPONSE_MAX];
+    uint16_t m_responseLength;
+
+    /**
+        Construct
+    **/
+    CommandBatch();
+
+    /**
+        Check a batch and queue it, for Submit() or a replay.
+    **/
+    bool Load(const uint8_t *request, uint16_t length);
+
+    /**
+        Run the queued batch's commands that are due. Called at the start of
+        the sample rate update.
+    **/
+    void Update();
+
+    /**
+        Run one command other than a wait.
+    **/
+    bool Execute(const uint8_t *command);
+
+    /**
+        Check a wait's event, timing it out.
+    **/
+    bool WaitMet(const uint8_t *command, bool &timedOut);
+
+    /**
+        Fill in the response header and hand the response to the main loop.
+    **/
+    void Finish(BatchStatuses status);
+
+    /**
+        The length of a command with \a opcode, or 0 if it is not valid.
+    **/
+    static uint8_t CommandLength(uint8_t opcode);
+}; // CommandBatch
+
+} // ClearCore namespace
+
+#endif // __COMMANDBATCH_H__
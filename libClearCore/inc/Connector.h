@@ -161,7 +161,16 @@ public:
         /**
             [17] Serial port mode for USB.
         **/
-        USB_CDC
+        USB_CDC,
+        /**
+            [18] Pulse counting mode, counting the input's rising edges in
+            hardware and measuring their frequency.
+            \note Only one connector at a time can be in this mode, and only
+            connectors DI-6 through A-12 support it. The counter's timer
+            also paces IO-0's analog output waveform, so the two cannot run
+            at once.
+        **/
+        INPUT_COUNTER
     } ConnectorModes;
 
     /**
@@ -0,0 +1,223 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+    \file CrashManager.h
+    \brief ClearCore hard fault and watchdog crash snapshot.
+
+    Records the processor state of a hard fault or a watchdog reset in RAM
+    that is not cleared at startup, and reports it after the reboot.
+**/
+
+#ifndef __CRASHMANAGER_H__
+#define __CRASHMANAGER_H__
+
+#include <stdint.h>
+#include "TraceManager.h"
+
+namespace ClearCore {
+
+/// The number of the latest trace records kept in a crash snapshot
+#ifndef CRASH_TRACE_RECORDS
+#define CRASH_TRACE_RECORDS 8
+#endif
+
+class ISerial;
+
+/**
+    \class CrashManager
+    \brief ClearCore hard fault and watchdog crash snapshot.
+
+    When the processor hard faults, or the watchdog started with
+    TaskManager::WatchdogStart() gives its early warning, the handler saves
+    a CrashSnapshot to the .noinit RAM section: the registers stacked by the
+    exception and the callee-saved registers, the fault status registers,
+    the uptime and sample tick, the sample rate interrupt timing counters,
+    the main loop call that was blocking, and the latest trace records. A
+    hard fault then resets the board; after a watchdog warning the reset
+    follows from the watchdog itself.
+
+    The handlers run only on those exceptions, so recording costs nothing
+    while the board runs normally. After the reboot, a snapshot whose reset
+    cause matches is reported: Available() is true, the
+    StatusManager::StatusRegister CrashRecovered bit is set, Report() prints
+    it, and CommandBatch adds it to a response for
+    CommandBatch::BATCH_READ_CRASH, so it can be asked for over USB or
+    Ethernet.
+
+    The snapshot stays available until Clear() or the next crash. Trace
+    records are only kept while TraceManager records to RAM.
+
+    \code{.cpp}
+    if (CrashMgr.Available()) {
+        // Print the fault address and state, then forget it
+        CrashMgr.Report(ConnectorUsb);
+        CrashMgr.Clear();
+    }
+    \endcode
+**/
+class CrashManager {
+    friend class SysManager;
+
+public:
+    /**
+        \enum CrashCauses
+        \brief What recorded a snapshot.
+    **/
+    typedef enum {
+        /// No snapshot
+        CRASH_NONE,
+        /// A hard fault, or a configurable fault escalated to one
+        CRASH_HARD_FAULT,
+        /// The watchdog's early warning, just before the watchdog reset
+        CRASH_WATCHDOG,
+    } CrashCauses;
+
+    /**
+        \brief The state saved by a crash.
+    **/
+    typedef struct {
+        /// The CrashCauses of the snapshot
+        uint32_t Cause;
+        /// The stacked R0
+        uint32_t R0;
+        /// The stacked R1
+        uint32_t R1;
+        /// The stacked R2
+        uint32_t R2;
+        /// The stacked R3
+        uint32_t R3;
+        /// The stacked R12
+        uint32_t R12;
+        /// The link register of the interrupted code
+        uint32_t Lr;
+        /// The address the interrupted code was at; for a fault, usually
+        /// the faulting instruction
+        uint32_t Pc;
+        /// The stacked program status register
+        uint32_t Xpsr;
+        /// R4 through R11
+        uint32_t R4To11[8];
+        /// The address of the stacked registers
+        uint32_t Sp;
+        /// The exception return value, telling the stack and mode that were
+        /// in use
+        uint32_t ExcReturn;
+        /// The configurable fault status register; see the Cortex-M4 SCB
+        uint32_t Cfsr;
+        /// The hard fault status register
+        uint32_t Hfsr;
+        /// The memory manage fault address
+        uint32_t Mmfar;
+        /// The bus fault address
+        uint32_t Bfar;
+        /// Milliseconds() at the crash
+        uint32_t UptimeMs;
+        /// The sample tick at the crash
+        uint32_t Tick;
+        /// The CPU cycle counter at the crash
+        uint32_t Cycles;
+        /// The CPU cycle counter at the start of the last sample rate
+        /// interrupt
+        uint32_t IsrStartCycles;
+        /// The cycles the last sample rate interrupt took
+        uint32_t IsrLastCycles;
+        /// The fewest cycles a sample rate interrupt has taken
+        uint32_t IsrMinCycles;
+        /// The most cycles a sample rate interrupt has taken
+        uint32_t IsrMaxCycles;
+        /// The SysTiming::LoopBlockers call the main loop was in
+        uint32_t LoopBlocker;
+        /// The number of records in \a Trace, newest first
+        uint32_t TraceCount;
+        /// The latest trace records
+        TraceRecord Trace[CRASH_TRACE_RECORDS];
+    } CrashSnapshot;
+
+#ifndef HIDE_FROM_DOXYGEN
+    /**
+        Public accessor for singleton instance.
+    **/
+    static CrashManager &Instance();
+
+    /**
+        Save a snapshot from an exception handler.
+
+        \param[in] cause The CrashCauses.
+        \param[in] frame The registers stacked by the exception.
+        \param[in] excReturn The exception return value.
+        \param[in] callee R4 through R11.
+    **/
+    void Record(CrashCauses cause, const uint32_t *frame, uint32_t excReturn,
+                const uint32_t *callee);
+#endif
+
+    /**
+        \brief Check whether a snapshot from before the last reset is
+        available.
+    **/
+    bool Available() {
+        return m_available;
+    }
+
+    /**
+        \brief The snapshot from before the last reset.
+
+        \code{.cpp}
+        if (CrashMgr.Available() &&
+                CrashMgr.Snapshot().Cause == CrashManager::CRASH_WATCHDOG) {
+            // The main loop stalled at CrashMgr.Snapshot().Pc
+        }
+        \endcode
+
+        \return The snapshot; its Cause is #CRASH_NONE if none is available.
+    **/
+    const CrashSnapshot &Snapshot();
+
+    /**
+        \brief Forget the snapshot, clearing Available() and the
+        CrashRecovered status bit.
+    **/
+    void Clear() {
+        m_available = false;
+    }
+
+    /**
+        \brief Print the snapshot to a serial port as text.
+
+        \param[in] port Where to print the snapshot.
+    **/
+    void Report(ISerial &port);
+
+private:
+    volatile bool m_available;
+
+    /**
+        Construct, and check for a snapshot from before the last reset
+    **/
+    CrashManager();
+}; // CrashManager
+
+} // ClearCore namespace
+
+#endif // __CRASHMANAGER_H__
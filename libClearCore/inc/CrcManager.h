@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    \file CrcManager.h
+    \brief ClearCore CRC service on the Device Service Unit (DSU).
+
+    Computes CRC-32 checksums of RAM and flash with the DSU's CRC hardware,
+    and Modbus CRC-16 checksums from a table.
+**/
+
+#ifndef __CRCMANAGER_H__
+#define __CRCMANAGER_H__
+
+#include <stdint.h>
+
+namespace ClearCore {
+
+/// Blocks shorter than this are checked in software, which is quicker than
+/// starting the DSU for them
+#ifndef CRC_DSU_MIN_BYTES
+#define CRC_DSU_MIN_BYTES 64
+#endif
+
+/**
+    \class CrcManager
+    \brief ClearCore CRC service on the Device Service Unit (DSU).
+
+    The DSU reads memory over the bus on its own and folds each word into a
+    CRC-32 (the IEEE 802.3 polynomial, as used by Ethernet and zip), at about
+    a word per bus cycle: a 256 KB flash bank is checked in milliseconds.
+    Crc32() uses it for the word-aligned middle of a block and does the odd
+    bytes at either end in software. The DSU is shared, so a CRC asked for
+    while it is busy, such as from an interrupt, is done in software
+    instead; either way the result is the same.
+
+    Crc32Start() runs a large CRC in the background while the main loop
+    carries on. The result is picked up from the SysTick update, which then
+    calls an optional callback.
+
+    Crc16() is the Modbus CRC-16, one table lookup per byte.
+
+    \code{.cpp}
+    // Check a received block
+    uint32_t crc = CrcMgr.Crc32(block, length);
+    // Continue a CRC over a second block
+    crc = CrcMgr.Crc32(block2, length2, crc);
+
+    // Check the upper flash bank in the background
+    const void *bank = reinterpret_cast<const void *>(FLASH_SIZE / 2);
+    CrcMgr.Crc32Start(bank, FLASH_SIZE / 2);
+    while (CrcMgr.Crc32Busy()) {
+        // ... other work ...
+    }
+    uint32_t bankCrc = CrcMgr.Crc32Result();
+    \endcode
+**/
+class CrcManager {
+    friend class SysManager;
+
+public:
+    /**
+        \brief Function called when a background CRC-32 completes, with its
+        result. Called from the SysTick interrupt, so it must return promptly.
+    **/
+    typedef void (*Crc32Callback)(uint32_t crc);
+
+#ifndef HIDE_FROM_DOXYGEN
+    /**
+        Public accessor for singleton instance
+    **/
+    static CrcManager &Instance();
+#endif
+
+    /**
+        \brief Compute the CRC-32 of a block of RAM or flash.
+
+        \param[in] data The data.
+        \param[in] length The number of bytes.
+        \param[in] crc The CRC of the data before this block, to continue a
+        CRC over several blocks, or 0 to start one.
+
+        \return The CRC.
+    **/
+    uint32_t Crc32(const void *data, uint32_t length, uint32_t crc = 0);
+
+    /**
+        \brief Compute the CRC-32 of a block in software, without the DSU.
+
+        \param[in] data The data.
+        \param[in] length The number of bytes.
+        \param[in] crc The CRC of the data before this block, or 0.
+
+        \return The CRC.
+    **/
+    static uint32_t Crc32Software(const void *data, uint32_t length,
+                                  uint32_t crc = 0);
+
+    /**
+        \brief Start computing the CRC-32 of a block in the background.
+
+        The block must stay unchanged until the CRC completes. A block the
+        DSU can't take, being short or asked for while the DSU is busy, is
+        done before this returns, callback and all.
+
+        \param[in] data The data.
+        \param[in] length The number of bytes.
+        \param[in] crc The CRC of the data before this block, or 0.
+        \param[in] callback Optional function to call with the result.
+
+        \return False if a background CRC is already running.
+    **/
+    bool Crc32Start(const void *data, uint32_t length, uint32_t crc = 0,
+                    Crc32Callback callback = nullptr);
+
+    /**
+        \brief Check whether a background CRC-32 is running.
+    **/
+    bool Crc32Busy() {
+        return m_asyncActive;
+    }
+
+    /**
+        \brief The result of the last background CRC-32.
+    **/
+    uint32_t Crc32Result() {
+        return m_asyncResult;
+    }
+
+    /**
+        \brief Compute the Modbus CRC-16 (polynomial 0xA001 reflected) of a
+        block.
+
+        \param[in] data The data.
+        \param[in] length The number of bytes.
+        \param[in] crc The CRC of the data before this block, or 0xFFFF to
+        start one.
+
+        \return The CRC. Modbus sends the low byte first.
+    **/
+    static uint16_t Crc16(const void *data, uint32_t length,
+                          uint16_t crc = 0xFFFF);
+
+private:
+    // Held by whichever CRC is using the DSU
+    volatile bool m_dsuLock;
+    volatile bool m_asyncActive;
+    // Set while the DSU runs a background CRC
+    volatile bool m_asyncDsu;
+    volatile uint32_t m_asyncResult;
+    Crc32Callback m_asyncCallback;
+    // The words handed to the DSU, redone in software on a bus error
+    const uint32_t *m_asyncWords;
+    uint32_t m_asyncWordCount;
+    uint32_t m_asyncCrc;
+    // The odd bytes after the words
+    const uint8_t *m_asyncTail;
+    uint8_t m_asyncTailLength;
+
+    /**
+        Construct
+    **/
+    CrcManager();
+
+    /**
+        Lift the DSU's write protection
+    **/
+    void Initialize();
+
+    /**
+        Finish a background CRC. Called from the SysTick update.
+    **/
+    void Refresh();
+
+    bool DsuClaim();
+    void DsuRelease();
+}; // CrcManager
+
+} // ClearCore namespace
+
+#endif // __CRCMANAGER_H__
@@ -0,0 +1,252 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    \file DataLogger.h
+    \brief ClearCore sample rate data logger to the SD card.
+
+    Records fixed-size binary records, taken in the sample rate interrupt, to
+    a file on the SD card.
+**/
+
+#ifndef __DATALOGGER_H__
+#define __DATALOGGER_H__
+
+#include <stdint.h>
+#include "FatFileSystem.h"
+#include "LogCompressor.h"
+
+namespace ClearCore {
+
+/// The size of the RAM ring that holds records until they are written, in
+/// bytes; a power of two
+#ifndef DATA_LOG_BUFFER_SIZE
+#define DATA_LOG_BUFFER_SIZE 16384
+#endif
+
+/// The size of each write to the card, in bytes; a multiple of the card's
+/// block size that divides #DATA_LOG_BUFFER_SIZE
+#ifndef DATA_LOG_WRITE_SIZE
+#define DATA_LOG_WRITE_SIZE 4096
+#endif
+
+/// How often the file's length is updated on the card, in milliseconds
+#ifndef DATA_LOG_SYNC_MS
+#define DATA_LOG_SYNC_MS 1000
+#endif
+
+/// The largest record, in bytes
+#define DATA_LOG_RECORD_MAX 64
+
+/**
+    \class DataLogger
+    \brief ClearCore sample rate data logger to the SD card.
+
+    While logging, records are added to a ring buffer in RAM, either by the
+    record function given to Start(), which is called from the sample rate
+    interrupt, or by calls to Push(). Neither waits on the card: a record that
+    finds the ring full is dropped and counted. Refresh(), called from the
+    main loop, writes the ring to the file in #DATA_LOG_WRITE_SIZE pieces,
+    which the file system sends to the card with multi-block writes.
+
+    The file holds the records back to back, with no header, or the blocks
+    of the LogCompressor given to Compression(). Reserving the file's length
+    at Start() keeps cluster allocation out of the writes.
+
+    \code{.cpp}
+    struct Sample {
+        int32_t Posn;
+        uint16_t Adc;
+        uint16_t Flags;
+    };
+
+    void TakeSample(uint8_t *record) {
+        Sample *sample = reinterpret_cast<Sample *>(record);
+        sample->Posn = ConnectorM0.PositionRefCommanded();
+        sample->Adc = ConnectorA9.State();
+        sample->Flags = ConnectorM0.HlfbState();
+    }
+
+    // Log every sample into a file reserved for 8 MB
+    DataLog.Start("RUN.BIN", sizeof(Sample), TakeSample, 1, 8UL << 20);
+    while (machineRunning) {
+        DataLog.Refresh();
+        ...
+    }
+    DataLog.Stop();
+    \endcode
+**/
+class DataLogger {
+    friend class SysManager;
+
+public:
+    /**
+        Fills in a record of the size given to Start(). Called from the
+        sample rate interrupt, so it must be short.
+    **/
+    typedef void (*RecordFunction)(uint8_t *record);
+
+#ifndef HIDE_FROM_DOXYGEN
+    /**
+        Public accessor for singleton instance.
+    **/
+    static DataLogger &Instance();
+#endif
+
+    /**
+        \brief Create the log file and start logging.
+
+        Mounts the file system if it is not mounted yet. An existing file
+        with the same name is replaced.
+
+        \param[in] path The path of the log file.
+        \param[in] recordSize The size of each record, in bytes, up to
+        #DATA_LOG_RECORD_MAX.
+        \param[in] source The function that fills in a record each
+        \a decimation samples, or NULL to add records with Push().
+        \param[in] decimation The number of samples per record.
+        \param[in] reserveBytes The length to reserve for the file, or 0.
+
+        \return True if logging started; false if a compressor in
+        #LogCompressor::COMPRESS_DELTA mode is set for another record size.
+    **/
+    bool Start(const char *path, uint8_t recordSize,
+               RecordFunction source = NULL, uint16_t decimation = 1,
+               uint32_t reserveBytes = 0);
+
+    /**
+        \brief Stop logging, write the records still in RAM, and close the
+        file.
+
+        \return True if every record taken was written.
+    **/
+    bool Stop();
+
+    /**
+        \brief Compress the records before they are written to the file.
+
+        The compressor's sink is replaced with the log file while logging.
+        Compression runs in Refresh() and Stop(), in the main loop.
+
+        \param[in] compressor The compressor, or NULL to write the records
+        as they are.
+
+        \return True if the compressor was set; false while logging or if
+        the compressor is not LogCompressor::Valid().
+    **/
+    bool Compression(LogCompressor *compressor);
+
+    /**
+        \brief Check whether records are being taken.
+
+        \return True from Start() until Stop() or a card error.
+    **/
+    bool Active() {
+        return m_active;
+    }
+
+    /**
+        \brief Check whether a write to the card failed.
+
+        Logging stops at the first failed write.
+    **/
+    bool Failed() {
+        return m_failed;
+    }
+
+    /**
+        \brief Add a record.
+
+        Records must be added from one context only, such as one interrupt
+        handler, and not while a record function is in use.
+
+        \param[in] record The record, of the size given to Start().
+
+        \return True if the record was added; false if logging is stopped or
+        the ring is full.
+    **/
+    bool Push(const void *record);
+
+    /**
+        \brief Write the records in RAM to the card.
+
+        Call regularly from the main loop, often enough to keep the ring from
+        filling.
+    **/
+    void Refresh();
+
+    /**
+        \brief The number of records added since Start().
+    **/
+    uint32_t RecordCount() {
+        return m_recordCount;
+    }
+
+    /**
+        \brief The number of records dropped because the ring was full.
+    **/
+    uint32_t DropCount() {
+        return m_dropCount;
+    }
+
+private:
+    uint8_t m_buffer[DATA_LOG_BUFFER_SIZE] __attribute__((aligned(4)));
+    // Free-running byte counts added to and taken from the ring
+    volatile uint32_t m_head;
+    volatile uint32_t m_tail;
+    volatile uint32_t m_recordCount;
+    volatile uint32_t m_dropCount;
+    FatFile m_file;
+    LogCompressor *m_compressor;
+    RecordFunction m_source;
+    uint16_t m_decimation;
+    uint16_t m_decimationCnt;
+    uint8_t m_recordSize;
+    volatile bool m_active;
+    bool m_failed;
+    uint32_t m_syncMs;
+
+    /**
+        Construct
+    **/
+    DataLogger();
+
+    /**
+        Take a record from the record function. Called from the sample rate
+        interrupt.
+    **/
+    void Sample();
+
+    /**
+        Write bytes from the ring to the file.
+    **/
+    bool BytesWrite(uint32_t length);
+
+    /**
+        Write a compressed block to the file.
+    **/
+    static bool BlockSink(const uint8_t *data, uint16_t length);
+}; // DataLogger
+
+} // ClearCore namespace
+
+#endif // __DATALOGGER_H__
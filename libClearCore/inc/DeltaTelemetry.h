@@ -0,0 +1,313 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    \file DeltaTelemetry.h
+    \brief Change-only telemetry encoding with per-field deadbands.
+
+    Encodes the fields of a snapshot struct that changed since the last frame
+    into a compact frame, with a periodic full keyframe.
+**/
+
+#ifndef __DELTATELEMETRY_H__
+#define __DELTATELEMETRY_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace ClearCore {
+
+/// The most values a field table may describe; each array element is one
+#ifndef DELTA_TELEMETRY_VALUES_MAX
+#define DELTA_TELEMETRY_VALUES_MAX 64
+#endif
+
+/// The default time between keyframes, in milliseconds
+#ifndef DELTA_TELEMETRY_KEYFRAME_MS
+#define DELTA_TELEMETRY_KEYFRAME_MS 1000
+#endif
+
+/// The first byte of a keyframe
+#define DELTA_TELEMETRY_KEYFRAME 0x4B
+/// The first byte of a delta frame
+#define DELTA_TELEMETRY_DELTA 0x44
+
+/**
+    Build a DeltaTelemetry::Field for one field of a snapshot struct. The
+    offset and size are worked out by the compiler.
+
+    \param[in] type The snapshot struct.
+    \param[in] field The field of \a type.
+    \param[in] kind The DeltaTelemetry::FieldKinds of the field.
+    \param[in] deadband The change that must be exceeded before the field
+    is sent again; 0 sends every change.
+**/
+#define TELEMETRY_FIELD(type, field, kind, deadband)                  \
+    {offsetof(type, field), sizeof(reinterpret_cast<type *>(0)->field), \
+     1, kind, deadband}
+
+/**
+    Build a DeltaTelemetry::Field for an array field of a snapshot struct;
+    each element is encoded as its own value.
+
+    \param[in] type The snapshot struct.
+    \param[in] field The array field of \a type.
+    \param[in] kind The DeltaTelemetry::FieldKinds of the elements.
+    \param[in] deadband The change that must be exceeded before an element
+    is sent again; 0 sends every change.
+**/
+#define TELEMETRY_ARRAY(type, field, kind, deadband)                    \
+    {offsetof(type, field), sizeof(reinterpret_cast<type *>(0)->field[0]), \
+     sizeof(reinterpret_cast<type *>(0)->field) /                         \
+     sizeof(reinterpret_cast<type *>(0)->field[0]), kind, deadband}
+
+/**
+    \class DeltaTelemetry
+    \brief Change-only telemetry encoding with per-field deadbands.
+
+    A constant field table, made with #TELEMETRY_FIELD and #TELEMETRY_ARRAY,
+    names the fields of a snapshot struct to send, such as a
+    ProcessImage::InputImage, a MotorManager::MotorsSnapshot or an
+    application struct filled by RegisterMap::Gather(). Encode() compares
+    each field with the value last sent and puts only the ones that moved by
+    more than their deadband into the frame. Every #DELTA_TELEMETRY_KEYFRAME_MS
+    or on request, a keyframe carries every field, so a receiver that joined
+    late or lost a frame gets back in step. The frame goes out on whatever
+    link the application uses; EthernetUdp, SerialPacket or XBeeApi.
+
+    The deadband is measured from the last value sent, not from the previous
+    snapshot, so a slowly drifting value is sent once it has drifted by the
+    deadband, and the receiver is never further off than that.
+
+    A frame is, with multi-byte values little-endian:
+    - Byte 0: #DELTA_TELEMETRY_KEYFRAME or #DELTA_TELEMETRY_DELTA.
+    - Byte 1: The sequence number, one more than the last frame's.
+    - A delta frame then has a bitmap of the values it carries, one bit per
+      value in table order, LSB first, in (values + 7) / 8 bytes.
+    - Then each value carried, in table order. A keyframe carries every
+      value as it is; a delta frame carries the change from the value last
+      sent. #TELEMETRY_SIGNED values, and every change of an integer, are
+      zigzag encoded. Integers are LEB128 varints, 7 bits per byte with the
+      MSB set on every byte but the last, and #TELEMETRY_FLOAT values are the
+      4 bytes of the float.
+
+    A delta only applies on top of the frame before it, so Decode() drops
+    delta frames after a missing sequence number until the next keyframe.
+
+    \code{.cpp}
+    // Send the inputs, without the tick, over UDP only when they change
+    constexpr DeltaTelemetry::Field Fields[] = {
+        TELEMETRY_FIELD(ProcessImage::InputImage, Ccio,
+                        DeltaTelemetry::TELEMETRY_BITS, 0),
+        TELEMETRY_FIELD(ProcessImage::InputImage, Digital,
+                        DeltaTelemetry::TELEMETRY_BITS, 0),
+        TELEMETRY_ARRAY(ProcessImage::InputImage, Analog,
+                        DeltaTelemetry::TELEMETRY_UNSIGNED, 8),
+    };
+    static_assert(DeltaTelemetryValid(Fields, 3,
+                                      sizeof(ProcessImage::InputImage)),
+                  "Bad telemetry fields");
+
+    DeltaTelemetry Telemetry(Fields, 3);
+    uint8_t frame[64];
+
+    void TelemetryTask() {
+        uint16_t length =
+            Telemetry.Encode(&ProcessImg.InputsRead(), frame, sizeof(frame));
+        if (length) {
+            Udp.Connect(hostIp, 8890);
+            Udp.PacketWrite(frame, length);
+            Udp.PacketSend();
+        }
+    }
+    \endcode
+**/
+class DeltaTelemetry {
+public:
+    /**
+        \brief How a field is compared and encoded.
+    **/
+    typedef enum {
+        /// A signed integer of 1, 2, 4 or 8 bytes
+        TELEMETRY_SIGNED,
+        /// An unsigned integer of 1, 2, 4 or 8 bytes
+        TELEMETRY_UNSIGNED,
+        /// A bit field of 1, 2, 4 or 8 bytes; every change is sent, as the
+        /// bits that changed, and the deadband is not used
+        TELEMETRY_BITS,
+        /// A 4 byte float
+        TELEMETRY_FLOAT,
+        /// The number of field kinds
+        TELEMETRY_KIND_COUNT,
+    } FieldKinds;
+
+    /**
+        \brief One field of the snapshot. Build with #TELEMETRY_FIELD or
+        #TELEMETRY_ARRAY.
+    **/
+    typedef struct {
+        /// The byte offset of the field in the snapshot
+        uint16_t Offset;
+        /// The size of each value in bytes
+        uint8_t Size;
+        /// The number of values; more than 1 for an array
+        uint8_t Count;
+        /// The FieldKinds of the values
+        uint8_t Kind;
+        /// The change that must be exceeded before a value is sent again
+        float Deadband;
+    } Field;
+
+    /**
+        \brief Construct an encoder, or a decoder, for a field table.
+
+        The table is used in place, so it must stay valid while the object
+        is used. An object either encodes or decodes, not both.
+
+        \param[in] fields The field table, checked with DeltaTelemetryValid().
+        \param[in] count The number of entries in the table.
+        \param[in] keyframeMs The time between keyframes, in milliseconds.
+    **/
+    DeltaTelemetry(const Field *fields, uint8_t count,
+                   uint32_t keyframeMs = DELTA_TELEMETRY_KEYFRAME_MS);
+
+    /**
+        \brief Encode the changes in a snapshot.
+
+        \param[in] snapshot The snapshot struct.
+        \param[out] frame Where to put the frame.
+        \param[in] size The size of \a frame; at least FrameSizeMax().
+
+        \return The length of the frame, or 0 if nothing changed by more
+        than its deadband and no keyframe is due, or \a frame is too small.
+    **/
+    uint16_t Encode(const void *snapshot, uint8_t *frame, uint16_t size);
+
+    /**
+        \brief Apply a received frame to a snapshot.
+
+        \param[in] frame The frame.
+        \param[in] length The length of the frame.
+        \param[in,out] snapshot The snapshot struct the frames are applied
+        to. Only the fields in the table are written.
+
+        \return True if the frame was applied; false if it is malformed, or
+        it is a delta frame and a frame was missed since the last keyframe.
+    **/
+    bool Decode(const uint8_t *frame, uint16_t length, void *snapshot);
+
+    /**
+        \brief Make the next frame a keyframe.
+
+        Call when the receiver asks for one, such as after a reconnect.
+    **/
+    void KeyframeRequest() {
+        m_keyframeRequested = true;
+    }
+
+    /**
+        \brief The longest frame the field table can produce.
+    **/
+    uint16_t FrameSizeMax() {
+        return m_frameSizeMax;
+    }
+
+    /**
+        \brief The number of frames encoded or applied.
+    **/
+    uint32_t FrameCount() {
+        return m_frameCount;
+    }
+
+    /**
+        \brief The number of keyframes encoded or applied.
+    **/
+    uint32_t KeyframeCount() {
+        return m_keyframeCount;
+    }
+
+    /**
+        \brief The total length of the frames encoded or applied.
+    **/
+    uint32_t ByteCount() {
+        return m_byteCount;
+    }
+
+private:
+    const Field *m_fields;
+    uint8_t m_count;
+    uint16_t m_values;
+    uint16_t m_frameSizeMax;
+    // The value last sent or received of each value, as raw bits; signed
+    // values are sign extended
+    uint64_t m_last[DELTA_TELEMETRY_VALUES_MAX];
+    uint8_t m_sequence;
+    // A keyframe has been sent, or received since the last missed frame
+    bool m_synced;
+    bool m_keyframeRequested;
+    uint32_t m_keyframeMs;
+    uint32_t m_keyframeLastMs;
+
+    uint32_t m_frameCount;
+    uint32_t m_keyframeCount;
+    uint32_t m_byteCount;
+
+    static bool Changed(const Field &field, uint64_t value, uint64_t last);
+    static uint8_t *ValuePut(uint8_t *out, const Field &field,
+                             uint64_t value, uint64_t last, bool keyframe);
+    static const uint8_t *ValueGet(const uint8_t *in, const uint8_t *end,
+                                   const Field &field, uint64_t &value,
+                                   bool keyframe);
+}; // DeltaTelemetry
+
+/**
+    \brief Check a field table at compile time.
+
+    Every field must have a valid kind and size and lie within the snapshot,
+    and the table must describe at most #DELTA_TELEMETRY_VALUES_MAX values.
+
+    \param[in] fields The field table.
+    \param[in] count The number of entries in the table.
+    \param[in] snapshotSize The size of the snapshot struct in bytes.
+    \param[in] values Leave at 0; the values counted so far.
+
+    \return True if the table is valid.
+**/
+constexpr bool DeltaTelemetryValid(const DeltaTelemetry::Field *fields,
+                                   uint8_t count, uint16_t snapshotSize,
+                                   uint16_t values = 0) {
+    return !count ? values <= DELTA_TELEMETRY_VALUES_MAX :
+           (fields[0].Kind < DeltaTelemetry::TELEMETRY_KIND_COUNT &&
+            fields[0].Count &&
+            (fields[0].Kind == DeltaTelemetry::TELEMETRY_FLOAT ?
+             fields[0].Size == 4 :
+             (fields[0].Size == 1 || fields[0].Size == 2 ||
+              fields[0].Size == 4 || fields[0].Size == 8)) &&
+            fields[0].Offset + fields[0].Size * fields[0].Count <=
+            snapshotSize &&
+            DeltaTelemetryValid(fields + 1, count - 1, snapshotSize,
+                                values + fields[0].Count));
+}
+
+} // ClearCore namespace
+
+#endif // __DELTATELEMETRY_H__
@@ -68,6 +68,8 @@ typedef void (*voidFuncPtr)(void);
     out the \ref ConnectorMain informational page.
 **/
 class DigitalIn : public Connector {
+    friend class PositionCapture;
+    friend class QuadratureDecoder;
     friend class SysManager;
     friend class TestIO;
 
@@ -120,12 +122,7 @@ public:
         (default) or milliseconds.
     **/
     void FilterLength(uint16_t length,
-                      FilterUnits units = FILTER_UNIT_SAMPLES) {
-        // 1 ms = 1000 us = 5 * (200 us) = 5 sample times
-        uint16_t samples = (units == FILTER_UNIT_MS) ? 5 * length : length;
-        m_filterLength = samples;
-        m_filterTicksLeft = samples;
-    }
+                      FilterUnits units = FILTER_UNIT_SAMPLES);
 
     /**
         \brief Get the connector's digital filter length in samples. The default
@@ -147,6 +144,38 @@ public:
         return m_filterLength;
     }
 
+    /**
+        \brief Debounce the input in the external interrupt controller
+        instead of the per-sample software filter.
+
+        While enabled the FilterLength() setting is not used: the state is
+        read from the debounced pin, so the filter costs nothing per sample
+        and interrupts trigger on debounced edges, well within a sample of
+        the change. The debounce time is shared by all hardware-filtered
+        inputs and set with InputManager::HardwareFilterUs().
+
+        \code{.cpp}
+        // Debounce the DI-7 limit switch in hardware
+        ConnectorDI7.FilterHardware(true);
+        \endcode
+
+        \param[in] enable True to use the hardware filter, false to return
+        to the software filter.
+        \return False if the connector has no external interrupt.
+
+        \note Only connectors DI-6 through A-12 support the hardware filter.
+    **/
+    bool FilterHardware(bool enable);
+
+    /**
+        \brief Check whether the input uses the hardware filter.
+
+        \return True if FilterHardware() is enabled.
+    **/
+    bool FilterHardware() {
+        return m_filterHardware;
+    }
+
     /**
         \brief Get the connector's operational mode.
 
@@ -166,18 +195,12 @@ public:
         \brief Set the connector's operational mode.
 
         \param[in] newMode The new mode to be set.
-        The only valid mode for this connector type is: #INPUT_DIGITAL.
+        The valid modes for this connector type are:
+        - #INPUT_DIGITAL
+        - #INPUT_COUNTER (DI-6 through DI-8 only).
         \return Returns false if the mode is invalid or setup fails.
     **/
-    virtual bool Mode(ConnectorModes newMode) override {
-        if (newMode == ConnectorModes::INPUT_DIGITAL) {
-            m_mode = newMode;
-            return true;
-        }
-        else {
-            return false;
-        }
-    }
+    virtual bool Mode(ConnectorModes newMode) override;
 
     /**
         \brief Get connector type.
@@ -358,6 +381,79 @@ public:
     **/
     void InterruptEnable(bool enable);
 
+    /**
+        \brief Record each edge of this input in the InputManager event FIFO
+        from the external interrupt, as it happens.
+
+        The entries are unfiltered and carry the cycle count of the
+        interrupt, so edges closer together than a sample are kept apart. A
+        callback registered with InterruptHandlerSet() keeps running, but the
+        interrupt triggers on both edges.
+
+        \code{.cpp}
+        // Time the DI-6 sensor's edges to the CPU cycle
+        ConnectorDI6.EventEdgeTimed(true);
+        \endcode
+
+        \param[in] enable True to record edges, false to stop.
+        \return True if the input has an external interrupt.
+
+        \note Only connectors DI-6 through A-12 can trigger interrupts.
+    **/
+    bool EventEdgeTimed(bool enable);
+
+    /**
+        \brief The number of rising edges counted in #INPUT_COUNTER mode.
+
+        The edges are counted by a timer through the event system, so
+        counting costs no CPU time per pulse. The digital state and its
+        filter keep working in this mode.
+
+        \code{.cpp}
+        ConnectorDI6.Mode(Connector::INPUT_COUNTER);
+        uint32_t litres = ConnectorDI6.Count() / pulsesPerLitre;
+        \endcode
+
+        \return The count since entering the mode or the last CountReset(),
+        or 0 if the connector is not in #INPUT_COUNTER mode.
+    **/
+    uint32_t Count();
+
+    /**
+        \brief Restart Count() from zero. Frequency() is not disturbed.
+    **/
+    void CountReset();
+
+    /**
+        \brief The pulse frequency measured over the last full gate time in
+        #INPUT_COUNTER mode.
+
+        \code{.cpp}
+        float rpm = ConnectorDI6.Frequency() * 60 / pulsesPerRev;
+        \endcode
+
+        \return The frequency in Hz, or 0 if the connector is not in
+        #INPUT_COUNTER mode or no gate time has completed yet.
+    **/
+    float Frequency();
+
+    /**
+        \brief Set the gate time Frequency() counts pulses over.
+
+        A longer gate time gives a finer frequency resolution (1 / gate time)
+        but reacts more slowly. The default is
+        #INPUT_COUNTER_GATE_MS_DEFAULT.
+
+        \code{.cpp}
+        // Resolve the flow meter to 1 Hz
+        ConnectorDI6.FrequencyGateMs(1000);
+        \endcode
+
+        \param[in] gateMs The gate time, in milliseconds.
+        \return False if \a gateMs is 0.
+    **/
+    bool FrequencyGateMs(uint16_t gateMs);
+
 protected:
     // LED associated with input
     ShiftRegister::Masks m_ledMask;
@@ -382,6 +478,11 @@ protected:
     uint16_t m_filterLength;
     // Set to filter length on input state change
     uint16_t m_filterTicksLeft;
+    // Debounced by the EIC rather than the software filter
+    bool m_filterHardware;
+    // This connector's bit when the InputManager filter bank counts down
+    // its software filter, else 0
+    uint32_t m_filterBankMask;
 
     /**
         Construct, wire in pads and LED shift register object.
@@ -105,7 +105,8 @@ public:
         \param[in] newMode The new mode to be set.
         The valid modes for this connector type are:
         - #INPUT_DIGITAL
-        - #INPUT_ANALOG.
+        - #INPUT_ANALOG
+        - #INPUT_COUNTER.
         \return Returns false if the mode is invalid or setup fails.
     **/
     bool Mode(ConnectorModes newMode) override;
@@ -38,6 +38,96 @@
 
 namespace ClearCore {
 
+/// The slowest PWM carrier, in Hz, with an 8-bit counter
+#define PWM_CARRIER_MIN_HZ 8
+/// The fastest PWM carrier, in Hz, with an 8-bit counter; it leaves 16 steps
+#define PWM_CARRIER_MAX_HZ 128000
+/// The fastest PWM carrier, in Hz, with a 16-bit counter
+#define PWM_CARRIER_16BIT_MAX_HZ 31
+
+/**
+    \class FastOutput
+
+    \brief Direct register access to the pin of a digital output connector.
+
+    Each write is a single store to the port's set, clear, or toggle
+    register, with the connector's logic inversion resolved when the handle
+    is taken, so it can be used from interrupts and callbacks to bit-bang
+    pulses or handshakes far faster than DigitalInOut::State().
+
+    \code{.cpp}
+    FastOutput strobe;
+    ConnectorIO1.Mode(Connector::OUTPUT_DIGITAL);
+    ConnectorIO1.FastOutputGet(strobe);
+    strobe.Set();
+    strobe.Clear();
+    \endcode
+
+    \note Fast writes are not seen by DigitalInOut::State(), which reports
+    the last state written through the connector. The connector still
+    checks the pin for overloads each sample, but a fast write can drive the
+    pin again while an overload holds it off.
+**/
+class FastOutput {
+    friend class DigitalInOut;
+
+public:
+    /**
+        Construct a handle that is not attached to a pin; its writes go
+        nowhere until DigitalInOut::FastOutputGet() attaches it.
+    **/
+    FastOutput()
+        : m_set(&m_sink),
+          m_clr(&m_sink),
+          m_tgl(&m_sink),
+          m_mask(0),
+          m_sink(0) {}
+
+    /**
+        \brief Assert the output.
+    **/
+    void Set() {
+        *m_set = m_mask;
+    }
+
+    /**
+        \brief Deassert the output.
+    **/
+    void Clear() {
+        *m_clr = m_mask;
+    }
+
+    /**
+        \brief Invert the output.
+    **/
+    void Toggle() {
+        *m_tgl = m_mask;
+    }
+
+    /**
+        \brief Write the output.
+
+        \param[in] state True to assert the output.
+    **/
+    void Write(bool state) {
+        *(state ? m_set : m_clr) = m_mask;
+    }
+
+    /**
+        \brief Check whether the handle is attached to a pin.
+    **/
+    bool Attached() {
+        return m_mask != 0;
+    }
+
+private:
+    volatile uint32_t *m_set;
+    volatile uint32_t *m_clr;
+    volatile uint32_t *m_tgl;
+    uint32_t m_mask;
+    volatile uint32_t m_sink;
+};
+
 /**
     \class DigitalInOut
 
@@ -271,6 +361,81 @@ public:
     **/
     bool PwmDuty(uint8_t newDuty);
 
+    /**
+        \brief Set the PWM duty on the I/O pin with 16-bit resolution.
+
+        The duty is scaled to the steps of the carrier set by PwmCarrier(),
+        so finer carriers resolve it more closely. The pin must be in
+        #OUTPUT_PWM mode.
+
+        \code{.cpp}
+        // Drive a proportional valve on IO-2 at 40.0% duty
+        ConnectorIO2.PwmCarrier(20, true);
+        ConnectorIO2.Mode(Connector::OUTPUT_PWM);
+        ConnectorIO2.PwmDuty16(UINT16_MAX * 0.4);
+        \endcode
+
+        \param[in] newDuty The PWM duty cycle, from 0 to 65535 (UINT16_MAX).
+        \return Successfully set the PWM duty value.
+    **/
+    bool PwmDuty16(uint16_t newDuty);
+
+    /**
+        \brief Set the PWM carrier frequency and counter resolution.
+
+        Each timer drives a pair of connectors, which share its carrier:
+        IO-0 and IO-1, IO-2 and IO-3, and IO-4 and IO-5. The duty of both
+        connectors is kept across the change. The default is an 8-bit counter
+        at about 500 Hz with 255 steps.
+
+        The timers run from a 2.048 MHz clock shared with the HLFB and
+        capture timers. With the 8-bit counter, the carrier is set to within
+        a step from #PWM_CARRIER_MIN_HZ to #PWM_CARRIER_MAX_HZ, with
+        2048000 / frequency steps up to 255. With the 16-bit counter, every
+        duty has 65536 steps and the carrier is the fastest one of 31.25 Hz
+        divided by a power of two that does not exceed \a frequencyHz, up to
+        #PWM_CARRIER_16BIT_MAX_HZ.
+
+        \code{.cpp}
+        // Run IO-4 and IO-5 at 20 kHz for an LED driver
+        ConnectorIO4.PwmCarrier(20000);
+        \endcode
+
+        \param[in] frequencyHz The carrier frequency.
+        \param[in] counter16 True for a 16-bit counter; false for 8-bit.
+        \return True if the carrier is in range for the counter.
+    **/
+    bool PwmCarrier(uint32_t frequencyHz, bool counter16 = false);
+
+    /**
+        \brief The PWM carrier frequency of this connector's timer, in Hz.
+    **/
+    float PwmCarrierHz();
+
+    /**
+        \brief The number of duty steps in each PWM period of this
+        connector's timer.
+    **/
+    uint32_t PwmSteps();
+
+    /**
+        \brief Attach a FastOutput handle to this connector's pin.
+
+        The connector must be in #OUTPUT_DIGITAL mode. The handle stays valid
+        until the connector changes mode; take it again afterward.
+
+        \code{.cpp}
+        FastOutput io2;
+        if (ConnectorIO2.FastOutputGet(io2)) {
+            io2.Toggle();
+        }
+        \endcode
+
+        \param[out] fast The handle to attach.
+        \return True if the handle was attached.
+    **/
+    bool FastOutputGet(FastOutput &fast);
+
 protected:
     // Port access
     uint32_t m_outputPort;
@@ -326,6 +491,12 @@ private:
                           val != m_logicInversion);
     }
 
+    // The state driven on the pin, including any FastOutput writes
+    bool OutputPinState() {
+        bool high = PORT->Group[m_outputPort].OUT.reg & m_outputDataMask;
+        return high != m_logicInversion;
+    }
+
     /**
         \brief Sets whether the connector is in a hardware fault state.
 
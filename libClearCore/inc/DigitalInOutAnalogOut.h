@@ -32,11 +32,28 @@
 #include <stdint.h>
 #include "Connector.h"
 #include "DigitalInOut.h"
+#include "DmaManager.h"
 #include "PeripheralRoute.h"
 #include "ShiftRegister.h"
 
 namespace ClearCore {
 
+/// The resolution of the analog output, in bits
+#define DAC_BITS    11
+/// The largest value DigitalInOutAnalogOut::AnalogWrite() accepts
+#define DAC_MAX_VALUE   (UINT16_MAX >> (16 - DAC_BITS))
+
+/// The most points DigitalInOutAnalogOut::WaveLoad() accepts. Each point
+/// takes 2 bytes of RAM.
+#ifndef DAC_WAVE_POINTS_MAX
+#define DAC_WAVE_POINTS_MAX 512
+#endif
+
+/// The fastest waveform playback rate
+#define DAC_WAVE_RATE_MAX_HZ 100000
+/// The slowest waveform playback rate
+#define DAC_WAVE_RATE_MIN_HZ 2
+
 /**
     \brief ClearCore digital input/output with analog current output
     Connector class.
@@ -187,6 +204,85 @@ public:
     **/
     void OutputCurrent(uint16_t currentuA);
 
+    /**
+        \brief Load a waveform for playback in #OUTPUT_ANALOG mode.
+
+        Each value is an 11-bit analog output level, as for AnalogWrite().
+        The DAC calibration is applied to the whole table here, so playback
+        streams it to the DAC by DMA with no CPU time per point. Loading stops
+        any waveform that is playing. A calibration stored afterwards with
+        DacStoreCalibration() takes effect on the next load.
+
+        \code{.cpp}
+        // Ramp from 4 mA to 20 mA over one second, then hold
+        uint16_t ramp[500];
+        for (int i = 0; i < 500; i++) {
+            ramp[i] = 410 + (2047 - 410) * i / 499;
+        }
+        ConnectorIO0.Mode(Connector::OUTPUT_ANALOG);
+        ConnectorIO0.WaveLoad(ramp, 500);
+        ConnectorIO0.WaveRate(500);
+        ConnectorIO0.WaveStart(false);
+        \endcode
+
+        \param[in] values The output levels (0 to 2047).
+        \param[in] count The number of values, up to #DAC_WAVE_POINTS_MAX.
+        \return True if the waveform was loaded.
+    **/
+    bool WaveLoad(const uint16_t *values, uint16_t count);
+
+    /**
+        \brief Set the waveform playback rate.
+
+        Each point is output for one period of this rate. The rate is
+        clamped to #DAC_WAVE_RATE_MIN_HZ to #DAC_WAVE_RATE_MAX_HZ, and takes
+        effect on the next WaveStart(). Default: 1000 Hz.
+
+        \param[in] rateHz The number of points output per second.
+    **/
+    void WaveRate(uint32_t rateHz) {
+        m_waveRateHz = rateHz;
+    }
+
+    /**
+        \brief The waveform playback rate.
+
+        \return The number of points output per second.
+    **/
+    uint32_t WaveRate() {
+        return m_waveRateHz;
+    }
+
+    /**
+        \brief Start playing the loaded waveform.
+
+        Playback is paced by TCC2, which is shared with the #INPUT_COUNTER
+        mode, so only one of them may run at a time.
+
+        \param[in] loop (optional) True to repeat the waveform until
+        WaveStop(); false to play it once and hold the last value.
+        Default: true.
+        \return False if the connector is not in #OUTPUT_ANALOG mode, no
+        waveform is loaded, or the timer is in use.
+    **/
+    bool WaveStart(bool loop = true);
+
+    /**
+        \brief Stop waveform playback, holding the present output value.
+
+        AnalogWrite(), OutputCurrent() and leaving #OUTPUT_ANALOG mode also
+        stop playback.
+    **/
+    void WaveStop();
+
+    /**
+        \brief Check whether a waveform is playing.
+
+        \return True while the waveform plays; false once a single pass has
+        finished.
+    **/
+    bool WaveActive();
+
 #ifndef HIDE_FROM_DOXYGEN
     /**
         \brief This function should only be used for calibration purposes.
@@ -227,6 +323,11 @@ private:
     uint16_t m_dacZero;
     uint16_t m_dacSpan;
 
+    // Waveform playback state; the table lives in a static buffer
+    uint16_t m_wavePoints;
+    uint32_t m_waveRateHz;
+    bool m_waveTimer;
+
 #ifndef HIDE_FROM_DOXYGEN
     /**
         Construct and wire in the Input/Output pair.
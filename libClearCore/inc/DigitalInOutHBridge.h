@@ -38,12 +38,24 @@
 #include <stdint.h>
 #include "Connector.h"
 #include "DigitalInOut.h"
+#include "DmaManager.h"
 #include "PeripheralRoute.h"
 #include "ShiftRegister.h"
 #include "StatusManager.h"
 
 namespace ClearCore {
 
+/// The H-bridge PWM rate, which is also the tone and waveform sample rate
+#define TONE_RATE_HZ (22050)
+/// The highest tone frequency
+#define TONE_MAXIMUM_FREQ_HZ (TONE_RATE_HZ / 4)
+
+/// The most points DigitalInOutHBridge::WaveLoad() accepts. Each point takes
+/// 24 bytes of RAM per connector.
+#ifndef HBRIDGE_WAVE_POINTS_MAX
+#define HBRIDGE_WAVE_POINTS_MAX 128
+#endif
+
 /**
     \brief ClearCore H-Bridge digital output connector class.
 
@@ -260,6 +272,78 @@ public:
         return m_toneState;
     }
 
+    /**
+        \brief Load a waveform for playback in #OUTPUT_WAVE mode.
+
+        Each sample is an H-bridge output level, as for State() in
+        #OUTPUT_H_BRIDGE mode, and is played for one PWM period (1 /
+        #TONE_RATE_HZ). The samples are converted to PWM duty cycles here, so
+        playback streams them to the timer by DMA with no CPU time per
+        sample. Loading stops any waveform that is playing.
+
+        \code{.cpp}
+        // A 441 Hz triangle wave: 50 samples per cycle at 22050 Hz
+        int16_t triangle[50];
+        for (int i = 0; i < 50; i++) {
+            triangle[i] = (i < 25 ? i : 50 - i) * (INT16_MAX / 25) -
+                          INT16_MAX / 2;
+        }
+        ConnectorIO4.Mode(Connector::OUTPUT_WAVE);
+        ConnectorIO4.WaveLoad(triangle, 50);
+        ConnectorIO4.WaveStart();
+        \endcode
+
+        \param[in] samples The output levels (-INT16_MAX to INT16_MAX).
+        \param[in] count The number of samples, up to
+        #HBRIDGE_WAVE_POINTS_MAX.
+        \return True if the waveform was loaded.
+    **/
+    bool WaveLoad(const int16_t *samples, uint16_t count);
+
+    /**
+        \brief Load a sine sweep for playback in #OUTPUT_WAVE mode.
+
+        The frequency changes linearly from \a startFreq to \a endFreq over
+        \a count samples, at the ToneAmplitude() amplitude.
+
+        \code{.cpp}
+        // Sweep 500 Hz to 2 kHz over the longest table, then repeat
+        ConnectorIO4.WaveChirp(500, 2000, HBRIDGE_WAVE_POINTS_MAX);
+        ConnectorIO4.WaveStart();
+        \endcode
+
+        \param[in] startFreq The starting frequency (Hz).
+        \param[in] endFreq The ending frequency (Hz).
+        \param[in] count The number of samples, up to
+        #HBRIDGE_WAVE_POINTS_MAX.
+        \return True if the sweep was loaded.
+    **/
+    bool WaveChirp(uint16_t startFreq, uint16_t endFreq, uint16_t count);
+
+    /**
+        \brief Start playing the loaded waveform.
+
+        \param[in] loop (optional) True to repeat the waveform until
+        WaveStop(); false to play it once, then output 0. Default: true.
+        \return False if the connector is not in #OUTPUT_WAVE mode or no
+        waveform is loaded.
+    **/
+    bool WaveStart(bool loop = true);
+
+    /**
+        \brief Stop waveform playback and output 0.
+    **/
+    void WaveStop();
+
+    /**
+        \brief Check whether a waveform is playing.
+
+        \return True while the waveform plays.
+    **/
+    bool WaveActive() {
+        return m_waveActive;
+    }
+
     /**
         \brief Get connector's last sampled value.
 
@@ -355,6 +439,12 @@ private:
     bool m_inFault;
     bool m_forceToneDuration;
 
+    // Waveform playback state; the tables live in a static buffer per
+    // connector
+    uint16_t m_wavePoints;
+    volatile bool m_waveActive;
+    bool m_waveLoop;
+
     /**
         Initialize hardware and/or internal state.
     **/
@@ -377,6 +467,13 @@ private:
     **/
     inline void ToneFrequency(uint16_t frequency);
 
+    /**
+        The DMA channel and buffer index of this connector's waveform.
+    **/
+    uint8_t WaveIndex() {
+        return m_clearCorePin == CLEARCORE_PIN_IO4 ? 0 : 1;
+    }
+
     /**
         \brief Sets the fault flag and disables the H-Bridge output when faulted
 
@@ -44,10 +44,63 @@ typedef enum {
     DMA_SERCOM0_SPI_TX, ///< COM1 SPI streaming output
     DMA_SERCOM7_SPI_RX, ///< COM0 SPI streaming input
     DMA_SERCOM7_SPI_TX, ///< COM0 SPI streaming output
+    DMA_HLFB_M0,        ///< M-0 HLFB period and width captures
+    DMA_HLFB_M1,        ///< M-1 HLFB period and width captures
+    DMA_HLFB_M2,        ///< M-2 HLFB period and width captures
+    DMA_HLFB_M3,        ///< M-3 HLFB period and width captures
+    DMA_WAVE_IO4,       ///< IO-4 H-bridge waveform playback
+    DMA_WAVE_IO5,       ///< IO-5 H-bridge waveform playback
+    DMA_WAVE_IO0,       ///< IO-0 analog output waveform playback
+    DMA_SERCOM4_SPI_RX, ///< SD card SPI block input
+    DMA_SERCOM4_SPI_TX, ///< SD card SPI block output
     DMA_CHANNEL_COUNT,  // Keep at end
     DMA_INVALID_CHANNEL // Placeholder for unset values
 } DmaChannels;
 
+/* Channels past the fixed ones that ChannelAllocate() hands out */
+#ifndef DMA_DYNAMIC_CHANNELS
+#define DMA_DYNAMIC_CHANNELS 8
+#endif
+
+/* Linked descriptors shared by the allocated channels' chains */
+#ifndef DMA_DESCRIPTOR_POOL
+#define DMA_DESCRIPTOR_POOL 16
+#endif
+
+#define DMA_CHANNEL_TOTAL (DMA_CHANNEL_COUNT + DMA_DYNAMIC_CHANNELS)
+
+/* Returned by ChannelAllocate() when no channel is free */
+#define DMA_CHANNEL_NONE 0xFF
+
+/* MemCopyAsync() and MemSetAsync() hand transfers at least this long to the
+   DMA; the CPU does shorter ones */
+#ifndef DMA_MEMCPY_THRESHOLD
+#define DMA_MEMCPY_THRESHOLD 256
+#endif
+
+/**
+    Called from the DMA interrupt for an allocated channel when a block
+    marked for an interrupt finishes, when a chain ends, or on a bus error.
+**/
+typedef void (*DmaCallback)(uint8_t channel, bool error);
+
+/**
+    One block of a descriptor chain. Addresses are the first beat of the
+    block; the builder converts them to the end addresses the DMAC expects.
+**/
+typedef struct {
+    const volatile void *Source;
+    volatile void *Destination;
+    /* Number of beats in the block */
+    uint16_t BeatCount;
+    /* DMAC_BTCTRL_BEATSIZE_BYTE_Val, _HWORD_Val, or _WORD_Val */
+    uint8_t BeatSize;
+    bool SourceIncrement;
+    bool DestinationIncrement;
+    /* Run the channel's callback when this block finishes */
+    bool Interrupt;
+} DmaBlock;
+
 /**
     \brief DMA Peripheral Manager for the ClearCore Board
 
@@ -59,6 +112,124 @@ class DmaManager {
 public:
     static DmacChannel *Channel(DmaChannels index);
     static DmacDescriptor *BaseDescriptor(DmaChannels index);
+    static DmacDescriptor *WriteBackDescriptor(DmaChannels index);
+    static IRQn_Type Irq(DmaChannels index);
+
+    /**
+        Claim a channel that no fixed DmaChannels user has.
+
+        \param[in] priority The channel's arbitration level, 0 (lowest) to
+        3.
+        \param[in] callback Run from the DMA interrupt at block interrupts,
+        the end of the chain, and bus errors; may be NULL.
+
+        \return The channel number, or #DMA_CHANNEL_NONE if none is free.
+    **/
+    static uint8_t ChannelAllocate(uint8_t priority,
+                                   DmaCallback callback = NULL);
+
+    /**
+        Stop a claimed channel and give it and its descriptors back.
+    **/
+    static void ChannelFree(uint8_t channel);
+
+    /**
+        Set what starts each transfer on a claimed channel. A trigger source
+        of 0 leaves the channel to be started from software.
+
+        \param[in] channel A channel from ChannelAllocate().
+        \param[in] triggerSource The peripheral trigger, such as
+        SERCOM2_DMAC_ID_TX.
+        \param[in] triggerAction The DMAC_CHCTRLA_TRIGACT_*_Val amount moved
+        per trigger.
+        \param[in] burstBeats The beats in a burst, 1 to 16.
+
+        \return True if the channel was set up; it must not be running.
+    **/
+    static bool ChannelTrigger(uint8_t channel, uint8_t triggerSource,
+                               uint8_t triggerAction =
+                                   DMAC_CHCTRLA_TRIGACT_BURST_Val,
+                               uint8_t burstBeats = 1);
+
+    /**
+        Build a descriptor chain for a claimed channel, replacing its last
+        one. The first block uses the channel's own descriptor and the rest
+        come from the shared pool.
+
+        A list of blocks run once is a scatter-gather transfer. A circular
+        chain restarts at the first block after the last; two circular
+        blocks that each interrupt make a ping-pong buffer.
+
+        \param[in] channel A channel from ChannelAllocate().
+        \param[in] blocks The blocks, in order.
+        \param[in] count The number of blocks.
+        \param[in] circular True to link the last block back to the first.
+
+        \return True if the chain was built; false if the channel is
+        running or the pool is short of descriptors.
+    **/
+    static bool ChainBuild(uint8_t channel, const DmaBlock *blocks,
+                           uint8_t count, bool circular = false);
+
+    /**
+        Enable a claimed channel, triggering it from software if it has no
+        trigger source.
+    **/
+    static bool ChannelStart(uint8_t channel);
+
+    /**
+        Disable a claimed channel, abandoning any transfer in progress.
+    **/
+    static void ChannelStop(uint8_t channel);
+
+    /**
+        Check whether a claimed channel is still enabled. A chain that is not
+        circular disables its channel when it ends.
+    **/
+    static bool ChannelBusy(uint8_t channel);
+
+    /**
+        Copy memory in the background.
+
+        Copies of at least #DMA_MEMCPY_THRESHOLD bytes are made by a DMA
+        channel while the CPU carries on. Shorter copies, and copies asked
+        for while the last one is still running, are made by the CPU before
+        returning. Either way, \a done is set once the copy is complete.
+        Neither buffer may be touched until then.
+
+        \param[out] dst Where to copy to.
+        \param[in] src Where to copy from.
+        \param[in] len The number of bytes to copy.
+        \param[out] done Set false now and true when the copy is complete.
+
+        \return True if the DMA is making the copy.
+    **/
+    static bool MemCopyAsync(void *dst, const void *src, uint32_t len,
+                             volatile bool *done);
+
+    /**
+        Fill memory in the background, like MemCopyAsync().
+
+        \param[out] dst The memory to fill.
+        \param[in] value The byte to fill it with.
+        \param[in] len The number of bytes to fill.
+        \param[out] done Set false now and true when the fill is complete.
+
+        \return True if the DMA is making the fill.
+    **/
+    static bool MemSetAsync(void *dst, uint8_t value, uint32_t len,
+                            volatile bool *done);
+
+    /**
+        Check whether a background copy or fill is still running.
+    **/
+    static bool MemBusy();
+
+    /**
+        Run the callbacks of the allocated channels that interrupted. Called
+        from the shared channel 4 and up DMA vector.
+    **/
+    static void IrqHandler();
 
     /**
         Public accessor for singleton instance
@@ -66,10 +237,18 @@ public:
     static DmaManager &Instance();
 private:
 
-    static DmacDescriptor writeBackDescriptor[DMA_CHANNEL_COUNT] __attribute__((
+    // The channels handed out at run time have their descriptors after the
+    // fixed channels', where the DMAC looks for them by channel number
+    static DmacDescriptor writeBackDescriptor[DMA_CHANNEL_TOTAL] __attribute__((
                 aligned(16)));
-    static DmacDescriptor descriptorBase[DMA_CHANNEL_COUNT] __attribute__((aligned(
+    static DmacDescriptor descriptorBase[DMA_CHANNEL_TOTAL] __attribute__((aligned(
                 16)));
+    static DmacDescriptor descriptorPool[DMA_DESCRIPTOR_POOL]
+    __attribute__((aligned(16)));
+    // The channel each pool descriptor belongs to, or DMA_CHANNEL_NONE
+    static uint8_t poolOwner[DMA_DESCRIPTOR_POOL];
+    static DmaCallback callbacks[DMA_DYNAMIC_CHANNELS];
+    static volatile uint32_t allocatedMask;
 
     /**
         \brief Constructor for DmaManager
@@ -87,6 +266,15 @@ private:
         Controller).
     **/
     static void Initialize();
+
+    static bool Allocated(uint8_t channel);
+    static void DescriptorsRelease(uint8_t channel);
+
+    /**
+        Start a background copy or fill on the memory channel.
+    **/
+    static bool MemTransferStart(void *dst, const void *src, uint32_t len,
+                                 bool srcIncrement, volatile bool *done);
 }; // DmaManager
 
 } // ClearCore namespace
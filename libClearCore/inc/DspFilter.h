@@ -0,0 +1,511 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    \file DspFilter.h
+    \brief Fixed-point biquad cascade and FIR filter templates.
+
+    Filters sized at compile time that run once per sample in an interrupt,
+    with design helpers that compute their coefficients at compile time.
+**/
+
+#ifndef __DSPFILTER_H__
+#define __DSPFILTER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "SysTiming.h"
+
+namespace ClearCore {
+
+#ifndef HIDE_FROM_DOXYGEN
+/// Number of series terms used by the compile-time sine
+#define DSP_SIN_TERMS 12
+
+/// Pi, for the compile-time filter design helpers
+#define DSP_PI 3.14159265358979323846
+
+// Sum the Taylor series of sin(x) term by term. C++11 constexpr functions
+// are limited to a single return statement, hence the recursion.
+constexpr double DspSinSeries(double x2, double term, double sum, int k) {
+    return k > DSP_SIN_TERMS ? sum :
+           DspSinSeries(x2, -term * x2 / ((2 * k) * (2 * k + 1)),
+                        sum + term, k + 1);
+}
+
+// Reduce an angle to [-pi, pi] so the series converges quickly
+constexpr double DspAngleReduce(double x) {
+    return x - 2 * DSP_PI *
+           static_cast<int32_t>(x / (2 * DSP_PI) + (x < 0 ? -0.5 : 0.5));
+}
+
+constexpr double DspSinReduced(double x) {
+    return DspSinSeries(x * x, x, 0.0, 1);
+}
+#endif
+
+/**
+    \brief Compile-time sine.
+**/
+constexpr double DspSin(double x) {
+    return DspSinReduced(DspAngleReduce(x));
+}
+
+/**
+    \brief Compile-time cosine.
+**/
+constexpr double DspCos(double x) {
+    return DspSin(DSP_PI / 2 - x);
+}
+
+/**
+    \brief Convert a coefficient to signed fixed point with \a frac fractional
+    bits, rounding to nearest.
+**/
+constexpr int32_t DspFixed(double value, uint8_t frac) {
+    return static_cast<int32_t>(value * (1LL << frac) +
+                                (value < 0 ? -0.5 : 0.5));
+}
+
+/**
+    \brief Convert a value in [-1, 1) to Q15.
+**/
+constexpr int16_t DspQ15(double value) {
+    return value >= 1.0 ? INT16_MAX :
+           static_cast<int16_t>(DspFixed(value, 15));
+}
+
+/**
+    \brief Convert a value in [-1, 1) to Q31.
+**/
+constexpr int32_t DspQ31(double value) {
+    return value >= 1.0 ? INT32_MAX : DspFixed(value, 31);
+}
+
+/**
+    \brief Coefficients of one biquad section, normalized so a0 is 1.
+
+    The section computes:
+    y[n] = B0*x[n] + B1*x[n-1] + B2*x[n-2] - A1*y[n-1] - A2*y[n-2]
+
+    Each coefficient is held in Q30 (two integer bits) so the poles of
+    low-frequency sections, where A1 approaches -2, are representable.
+**/
+struct BiquadCoeffs {
+    int32_t B0; ///< Feed-forward coefficient of x[n]
+    int32_t B1; ///< Feed-forward coefficient of x[n-1]
+    int32_t B2; ///< Feed-forward coefficient of x[n-2]
+    int32_t A1; ///< Feedback coefficient of y[n-1]
+    int32_t A2; ///< Feedback coefficient of y[n-2]
+};
+
+#ifndef HIDE_FROM_DOXYGEN
+/// Normalize a section's coefficients by a0 and convert them to Q30
+constexpr BiquadCoeffs BiquadNormalize(double b0, double b1, double b2,
+                                       double a0, double a1, double a2) {
+    return BiquadCoeffs {DspFixed(b0 / a0, 30), DspFixed(b1 / a0, 30),
+                         DspFixed(b2 / a0, 30), DspFixed(a1 / a0, 30),
+                         DspFixed(a2 / a0, 30)};
+}
+
+constexpr BiquadCoeffs BiquadLowPassW(double cosW, double alpha) {
+    return BiquadNormalize((1 - cosW) / 2, 1 - cosW, (1 - cosW) / 2,
+                           1 + alpha, -2 * cosW, 1 - alpha);
+}
+
+constexpr BiquadCoeffs BiquadHighPassW(double cosW, double alpha) {
+    return BiquadNormalize((1 + cosW) / 2, -(1 + cosW), (1 + cosW) / 2,
+                           1 + alpha, -2 * cosW, 1 - alpha);
+}
+
+constexpr BiquadCoeffs BiquadNotchW(double cosW, double alpha) {
+    return BiquadNormalize(1, -2 * cosW, 1, 1 + alpha, -2 * cosW, 1 - alpha);
+}
+
+constexpr double BiquadOmega(double freqHz, double sampleHz) {
+    return 2 * DSP_PI * freqHz / sampleHz;
+}
+#endif
+
+/**
+    \brief Design a second-order low-pass section.
+
+    \code{.cpp}
+    // 100 Hz Butterworth low-pass at the ClearCore sample rate
+    constexpr BiquadCoeffs lp100 = BiquadLowPass(100, 0.7071);
+    \endcode
+
+    \param[in] freqHz The corner frequency, below half of \a sampleHz.
+    \param[in] q The quality factor; 0.7071 for Butterworth.
+    \param[in] sampleHz The rate the filter is updated at.
+**/
+constexpr BiquadCoeffs BiquadLowPass(double freqHz, double q,
+                                     double sampleHz =
+                                         _CLEARCORE_SAMPLE_RATE_HZ) {
+    return BiquadLowPassW(DspCos(BiquadOmega(freqHz, sampleHz)),
+                          DspSin(BiquadOmega(freqHz, sampleHz)) / (2 * q));
+}
+
+/**
+    \brief Design a second-order high-pass section.
+
+    \param[in] freqHz The corner frequency, below half of \a sampleHz.
+    \param[in] q The quality factor; 0.7071 for Butterworth.
+    \param[in] sampleHz The rate the filter is updated at.
+**/
+constexpr BiquadCoeffs BiquadHighPass(double freqHz, double q,
+                                      double sampleHz =
+                                          _CLEARCORE_SAMPLE_RATE_HZ) {
+    return BiquadHighPassW(DspCos(BiquadOmega(freqHz, sampleHz)),
+                           DspSin(BiquadOmega(freqHz, sampleHz)) / (2 * q));
+}
+
+/**
+    \brief Design a notch section.
+
+    \code{.cpp}
+    // Reject 60 Hz pickup with a notch about 6 Hz wide
+    constexpr BiquadCoeffs notch60 = BiquadNotch(60, 10);
+    \endcode
+
+    \param[in] freqHz The notch frequency, below half of \a sampleHz.
+    \param[in] q The quality factor; the notch is \a freqHz / \a q wide.
+    \param[in] sampleHz The rate the filter is updated at.
+**/
+constexpr BiquadCoeffs BiquadNotch(double freqHz, double q,
+                                   double sampleHz =
+                                       _CLEARCORE_SAMPLE_RATE_HZ) {
+    return BiquadNotchW(DspCos(BiquadOmega(freqHz, sampleHz)),
+                        DspSin(BiquadOmega(freqHz, sampleHz)) / (2 * q));
+}
+
+#ifndef HIDE_FROM_DOXYGEN
+// Windowed-sinc low-pass tap before normalization, with a Hamming window
+constexpr double FirSinc(double x) {
+    return x == 0 ? 1.0 : DspSin(DSP_PI * x) / (DSP_PI * x);
+}
+
+constexpr double FirLowPassRaw(uint16_t n, uint16_t taps, double fc) {
+    return 2 * fc * FirSinc(2 * fc * (n - (taps - 1) / 2.0)) *
+           (taps > 1 ? 0.54 - 0.46 * DspCos(2 * DSP_PI * n / (taps - 1)) :
+            1.0);
+}
+
+constexpr double FirLowPassSum(uint16_t n, uint16_t taps, double fc) {
+    return n >= taps ? 0.0 :
+           FirLowPassRaw(n, taps, fc) + FirLowPassSum(n + 1, taps, fc);
+}
+#endif
+
+/**
+    \brief Design one tap of a windowed-sinc low-pass FIR with unity DC gain.
+
+    \code{.cpp}
+    // 5-tap, 500 Hz low-pass at the ClearCore sample rate
+    static const int16_t taps[5] = {
+        DspQ15(FirLowPassTap(0, 5, 500)), DspQ15(FirLowPassTap(1, 5, 500)),
+        DspQ15(FirLowPassTap(2, 5, 500)), DspQ15(FirLowPassTap(3, 5, 500)),
+        DspQ15(FirLowPassTap(4, 5, 500))
+    };
+    \endcode
+
+    \param[in] n The tap index, from 0 to \a taps - 1.
+    \param[in] taps The length of the filter.
+    \param[in] freqHz The corner frequency, below half of \a sampleHz.
+    \param[in] sampleHz The rate the filter is updated at.
+**/
+constexpr double FirLowPassTap(uint16_t n, uint16_t taps, double freqHz,
+                               double sampleHz = _CLEARCORE_SAMPLE_RATE_HZ) {
+    return FirLowPassRaw(n, taps, freqHz / sampleHz) /
+           FirLowPassSum(0, taps, freqHz / sampleHz);
+}
+
+#ifndef HIDE_FROM_DOXYGEN
+// The fixed-point arithmetic for each sample width. Both accumulate in 64
+// bits; the Cortex-M4 multiply-accumulates into a 64-bit pair in one cycle.
+template <typename T>
+struct DspTraits;
+
+template <>
+struct DspTraits<int16_t> {
+    typedef int16_t Coeff;
+    typedef int64_t Accum;
+    static const uint8_t BIQUAD_FRAC = 14;
+    static const uint8_t FIR_FRAC = 15;
+    static int16_t Saturate(int64_t value) {
+        return value > INT16_MAX ? INT16_MAX :
+               value < INT16_MIN ? INT16_MIN : value;
+    }
+    static int16_t FromQ30(int32_t q30) {
+        return Saturate((static_cast<int64_t>(q30) + (1L << 15)) >> 16);
+    }
+};
+
+template <>
+struct DspTraits<int32_t> {
+    typedef int32_t Coeff;
+    typedef int64_t Accum;
+    static const uint8_t BIQUAD_FRAC = 30;
+    static const uint8_t FIR_FRAC = 31;
+    static int32_t Saturate(int64_t value) {
+        return value > INT32_MAX ? INT32_MAX :
+               value < INT32_MIN ? INT32_MIN : value;
+    }
+    static int32_t FromQ30(int32_t q30) {
+        return q30;
+    }
+};
+#endif
+
+/**
+    \class DspFilter
+    \brief Interface shared by the fixed-point filters so that a connector can
+    run any of them on its samples.
+
+    \tparam T The sample type: int16_t for Q15 samples, int32_t for Q31 or
+    plain 32-bit samples.
+**/
+template <typename T>
+class DspFilter {
+public:
+    /**
+        \brief Filter one sample.
+
+        \param[in] input The new sample.
+        \return The filter output.
+    **/
+    virtual T Update(T input) = 0;
+
+    /**
+        \brief Set the filter history as if \a value had been the input
+        forever, so the output starts at \a value.
+
+        \param[in] value The settled input and output value.
+    **/
+    virtual void Reset(T value) = 0;
+
+    /**
+        \brief The last filter output.
+    **/
+    T LastOutput() {
+        return m_output;
+    }
+
+protected:
+    DspFilter() : m_output(0) {}
+    volatile T m_output;
+};
+
+/**
+    \class Biquad
+    \brief A cascade of SECTIONS fixed-point biquad sections, in direct form I.
+
+    Direct form I keeps the section inputs and outputs at the sample width, so
+    the only rounding is at each section's output. Q15 cascades hold their
+    coefficients in Q14; Q31 cascades keep the full Q30 coefficients. Prefer Q31 for narrow notches
+    and corners far below the sample rate.
+
+    \code{.cpp}
+    // 4th-order Butterworth low-pass at 50 Hz on a Q15 signal
+    Biquad<int16_t, 2> lowPass;
+    lowPass.Section(0, BiquadLowPass(50, 0.5412));
+    lowPass.Section(1, BiquadLowPass(50, 1.3066));
+    \endcode
+
+    \tparam T The sample type, int16_t or int32_t.
+    \tparam SECTIONS The number of second-order sections.
+**/
+template <typename T, uint8_t SECTIONS>
+class Biquad : public DspFilter<T> {
+public:
+    typedef typename DspTraits<T>::Coeff Coeff;
+    typedef typename DspTraits<T>::Accum Accum;
+
+    /**
+        \brief Construct with every section passing its input through.
+    **/
+    Biquad() : m_state() {
+        for (uint8_t i = 0; i < SECTIONS; i++) {
+            Section(i, BiquadCoeffs {1L << 30, 0, 0, 0, 0});
+        }
+    }
+
+    /**
+        \brief Set the coefficients of one section.
+
+        \param[in] index The section, from 0 to SECTIONS - 1.
+        \param[in] coeffs The section's Q30 coefficients.
+        \return True if \a index is valid.
+    **/
+    bool Section(uint8_t index, const BiquadCoeffs &coeffs) {
+        if (index >= SECTIONS) {
+            return false;
+        }
+        Coeff *c = m_coeffs[index];
+        c[0] = DspTraits<T>::FromQ30(coeffs.B0);
+        c[1] = DspTraits<T>::FromQ30(coeffs.B1);
+        c[2] = DspTraits<T>::FromQ30(coeffs.B2);
+        c[3] = DspTraits<T>::FromQ30(coeffs.A1);
+        c[4] = DspTraits<T>::FromQ30(coeffs.A2);
+        return true;
+    }
+
+    /**
+        \copydoc DspFilter::Update
+    **/
+    virtual T Update(T input) override {
+        const uint8_t frac = DspTraits<T>::BIQUAD_FRAC;
+        T x = input;
+        for (uint8_t i = 0; i < SECTIONS; i++) {
+            const Coeff *c = m_coeffs[i];
+            T *s = m_state[i];
+            Accum acc = static_cast<Accum>(1) << (frac - 1);
+            acc += static_cast<Accum>(c[0]) * x;
+            acc += static_cast<Accum>(c[1]) * s[0];
+            acc += static_cast<Accum>(c[2]) * s[1];
+            acc -= static_cast<Accum>(c[3]) * s[2];
+            acc -= static_cast<Accum>(c[4]) * s[3];
+            T y = DspTraits<T>::Saturate(acc >> frac);
+            s[1] = s[0];
+            s[0] = x;
+            s[3] = s[2];
+            s[2] = y;
+            x = y;
+        }
+        this->m_output = x;
+        return x;
+    }
+
+    /**
+        \copydoc DspFilter::Reset
+
+        Each section's history is set from its DC gain so that a cascade with
+        unity gain starts settled.
+    **/
+    virtual void Reset(T value) override {
+        const uint8_t frac = DspTraits<T>::BIQUAD_FRAC;
+        T x = value;
+        for (uint8_t i = 0; i < SECTIONS; i++) {
+            const Coeff *c = m_coeffs[i];
+            Accum den = (static_cast<Accum>(1) << frac) + c[3] + c[4];
+            Accum num = static_cast<Accum>(c[0]) + c[1] + c[2];
+            T y = den ? DspTraits<T>::Saturate(x * num / den) : x;
+            T *s = m_state[i];
+            s[0] = s[1] = x;
+            s[2] = s[3] = y;
+            x = y;
+        }
+        this->m_output = x;
+    }
+
+private:
+    // b0, b1, b2, a1, a2 of each section
+    Coeff m_coeffs[SECTIONS][5];
+    // x[n-1], x[n-2], y[n-1], y[n-2] of each section
+    T m_state[SECTIONS][4];
+};
+
+/**
+    \class Fir
+    \brief A fixed-point FIR filter of TAPS taps.
+
+    The taps are Q15 for int16_t samples and Q31 for int32_t samples. The
+    history is a circular buffer, so each update is TAPS multiply-accumulates
+    and no copying.
+
+    \code{.cpp}
+    // Average the last 8 samples
+    static const int16_t taps[8] = {4096, 4096, 4096, 4096,
+                                    4096, 4096, 4096, 4096};
+    Fir<int16_t, 8> average(taps);
+    \endcode
+
+    \tparam T The sample type, int16_t or int32_t.
+    \tparam TAPS The length of the filter.
+**/
+template <typename T, uint16_t TAPS>
+class Fir : public DspFilter<T> {
+public:
+    typedef typename DspTraits<T>::Coeff Coeff;
+    typedef typename DspTraits<T>::Accum Accum;
+
+    /**
+        \brief Construct, optionally loading the taps.
+
+        \param[in] taps TAPS coefficients, or NULL for a filter that outputs 0.
+    **/
+    Fir(const Coeff *taps = NULL) : m_taps(), m_history(), m_index(0) {
+        Taps(taps);
+    }
+
+    /**
+        \brief Load the taps.
+
+        \param[in] taps TAPS coefficients, applied with taps[0] to the newest
+        sample.
+    **/
+    void Taps(const Coeff *taps) {
+        for (uint16_t i = 0; taps && i < TAPS; i++) {
+            m_taps[i] = taps[i];
+        }
+    }
+
+    /**
+        \copydoc DspFilter::Update
+    **/
+    virtual T Update(T input) override {
+        const uint8_t frac = DspTraits<T>::FIR_FRAC;
+        m_history[m_index] = input;
+        Accum acc = static_cast<Accum>(1) << (frac - 1);
+        // Newest to oldest, split at the wrap of the circular buffer
+        uint16_t t = 0;
+        for (int32_t i = m_index; i >= 0; i--) {
+            acc += static_cast<Accum>(m_taps[t++]) * m_history[i];
+        }
+        for (int32_t i = TAPS - 1; i > m_index; i--) {
+            acc += static_cast<Accum>(m_taps[t++]) * m_history[i];
+        }
+        m_index = m_index + 1 < TAPS ? m_index + 1 : 0;
+        T y = DspTraits<T>::Saturate(acc >> frac);
+        this->m_output = y;
+        return y;
+    }
+
+    /**
+        \copydoc DspFilter::Reset
+    **/
+    virtual void Reset(T value) override {
+        for (uint16_t i = 0; i < TAPS; i++) {
+            m_history[i] = value;
+        }
+        this->m_output = value;
+    }
+
+private:
+    Coeff m_taps[TAPS];
+    T m_history[TAPS];
+    uint16_t m_index;
+};
+
+} // ClearCore namespace
+
+#endif // __DSPFILTER_H__
@@ -31,11 +31,25 @@
 #ifndef __ENCODER_INPUT_H__
 #define __ENCODER_INPUT_H__
 
+#include "DspFilter.h"
 #include "PeripheralRoute.h"
 
 /// Number of encoder samples to use for velocity calculation
 #define VEL_EST_SAMPLES 50
 
+/// Number of edges the hybrid estimator times its period over; 4 spans one
+/// full quadrature cycle so the A/B phase error cancels
+#define VEL_HYBRID_EDGES 4
+
+/// Counts in the VEL_EST_SAMPLES window at and above which the hybrid
+/// estimator uses the window instead of the edge period
+#ifndef VEL_HYBRID_WINDOW_COUNTS
+#define VEL_HYBRID_WINDOW_COUNTS 16
+#endif
+
+/// The default bandwidth of the velocity tracking observer, in Hz
+#define VEL_PLL_BANDWIDTH_DEFAULT 20
+
 namespace ClearCore {
 
 typedef void (*voidFuncPtr)(void);
@@ -52,8 +66,25 @@ typedef void (*voidFuncPtr)(void);
     and wiring information.
 **/
 class EncoderInput {
+    friend class ReplayManager;
     friend class SysManager;
 public:
+    /**
+        \enum VelocityEstimators
+        \brief The ways Velocity() can be estimated.
+    **/
+    typedef enum {
+        /// Counts over the last #VEL_EST_SAMPLES sample times. Quantized to
+        /// _CLEARCORE_SAMPLE_RATE_HZ / #VEL_EST_SAMPLES counts per second.
+        VEL_EST_WINDOW,
+        /// The time between edges at low speed and the window at high speed.
+        /// Resolves steady speeds of a few counts per second.
+        VEL_EST_HYBRID,
+        /// A second-order tracking observer (PLL) on the position. Smooth and
+        /// unquantized, lagging speed changes by about its bandwidth.
+        VEL_EST_PLL,
+    } VelocityEstimators;
+
 
 #ifndef HIDE_FROM_DOXYGEN
 
@@ -77,6 +108,30 @@ public:
         return m_hwPosn;
     }
 
+    /**
+        \brief The accumulated count of the encoder, not including shifts
+        made with Position() or AddToPosition().
+
+        Unlike Position(), this value only changes when the encoder moves, which
+        makes it suitable as a cam master.
+
+        \return A reference to the accumulated encoder count.
+    **/
+    volatile const int32_t &PositionRaw() {
+        return m_curPosn;
+    }
+
+    /**
+        \brief The position of the encoder at this instant, read from the
+        hardware counter rather than from the last sample time.
+
+        Meant for interrupt handlers that need the position at an edge, such
+        as a PositionCapture.
+
+        \return The current position count of the Encoder Input module.
+    **/
+    int32_t PositionRT();
+
     /**
         \brief Index interrupt helper function.
 
@@ -123,6 +178,48 @@ public:
     **/
     void AddToPosition(int32_t posnAdjust);
 
+    /**
+        \brief Read the current position of the encoder as a 64-bit count
+        that never wraps.
+
+        Shifts made with Position() or AddToPosition() move this position by
+        the same amount as Position(). Reads are tear-free without blocking
+        interrupts, so this may be called from the main loop, the sample
+        interrupt, or any interrupt of lower priority than the sample
+        interrupt.
+
+        \code{.cpp}
+        int64_t conveyorPosn = EncoderIn.Position64();
+        \endcode
+
+        \return The 64-bit position count of the Encoder Input module.
+    **/
+    int64_t Position64();
+
+    /**
+        \brief Set the current 64-bit position of the encoder.
+
+        Position() becomes the low 32 bits of \a newPosn.
+
+        \code{.cpp}
+        // Zero the encoder position at the start of a shift
+        EncoderIn.Position64(0);
+        \endcode
+
+        \param[in] newPosn The new position.
+    **/
+    void Position64(int64_t newPosn);
+
+    /**
+        \brief Read the accumulated count of the encoder as a 64-bit count,
+        not including shifts made with Position() or AddToPosition().
+
+        Reads follow the same rules as Position64().
+
+        \return The 64-bit accumulated encoder count.
+    **/
+    int64_t PositionRaw64();
+
     /**
         \brief Read the last index position of the encoder
 
@@ -174,6 +271,80 @@ public:
         return m_velocity;
     }
 
+    /**
+        \brief Select how Velocity() is estimated.
+
+        \code{.cpp}
+        // Track slow line speeds with the edge period
+        EncoderIn.VelocityEstimator(EncoderInput::VEL_EST_HYBRID);
+        \endcode
+
+        \param[in] estimator The estimator to use.
+    **/
+    void VelocityEstimator(VelocityEstimators estimator);
+
+    /**
+        \brief The estimator used by Velocity().
+    **/
+    VelocityEstimators VelocityEstimator() {
+        return m_estimator;
+    }
+
+    /**
+        \brief Set the bandwidth of the #VEL_EST_PLL tracking observer.
+
+        Higher bandwidths follow speed changes faster but pass more of the
+        count quantization through as noise.
+
+        \code{.cpp}
+        EncoderIn.VelocityPllBandwidth(50);
+        \endcode
+
+        \param[in] bandwidthHz The critically-damped loop's natural
+        frequency, from 1 Hz to a tenth of the sample rate.
+
+        \return True if the bandwidth is in range.
+    **/
+    bool VelocityPllBandwidth(uint16_t bandwidthHz);
+
+    /**
+        \brief Read the encoder velocity after the velocity filter (counts per
+        second).
+
+        Equal to Velocity() when no filter is set.
+
+        \code{.cpp}
+        // Read the smoothed encoder velocity
+        int32_t encoderSpeed = EncoderIn.VelocityFiltered();
+        \endcode
+
+        \return The filtered encoder input velocity in counts per second.
+    **/
+    volatile const int32_t& VelocityFiltered() {
+        return m_velocityFiltered;
+    }
+
+    /**
+        \brief Run a biquad cascade, FIR, or other DspFilter on the velocity
+        estimate every sample.
+
+        The filter takes the Velocity() estimate, in counts per second, at the
+        sample rate, #_CLEARCORE_SAMPLE_RATE_HZ, and its output is read with
+        VelocityFiltered(). The filter is reset to the present velocity before
+        it takes over.
+
+        \code{.cpp}
+        // Smooth the velocity with a 20 Hz Butterworth low-pass
+        Biquad<int32_t, 1> velFilter;
+        velFilter.Section(0, BiquadLowPass(20, 0.7071));
+        EncoderIn.VelocityFilter(&velFilter);
+        \endcode
+
+        \param[in] filter The filter, which must outlive its use, or NULL to
+        remove the filter.
+    **/
+    void VelocityFilter(DspFilter<int32_t> *filter);
+
     /**
         \brief Check if there was an index pulse in the last sample time.
 
@@ -248,10 +419,35 @@ private:
     const PeripheralRoute *m_indexInfo;
     int32_t m_curPosn;
     int32_t m_offsetAdjustment;
+    // The 64-bit position, published by Update() under a sequence count
+    // that is odd while the update is in progress. The 64-bit offset
+    // follows every change to m_offsetAdjustment.
+    volatile uint32_t m_posn64Seq;
+    int64_t m_posnRaw64;
+    int64_t m_offset64;
+    int32_t m_offsetSeen;
+    // A pending Position64() change, applied by Update()
+    int64_t m_posn64Request;
+    volatile bool m_posn64Pending;
     int32_t m_velocity;
+    int32_t m_velocityFiltered;
+    DspFilter<int32_t> *volatile m_velocityFilter;
     int16_t m_hwPosn;
     int32_t m_posnHistory[VEL_EST_SAMPLES];
     uint8_t m_posnHistoryIndex;
+    volatile VelocityEstimators m_estimator;
+    uint32_t m_sampleTick;
+    // The most recent edges, by sample tick and position, for the hybrid
+    // estimator
+    uint32_t m_edgeTick[VEL_HYBRID_EDGES];
+    int32_t m_edgePosn[VEL_HYBRID_EDGES];
+    uint8_t m_edgeIndex;
+    // Tracking observer state: position in Q16 counts, velocity in Q16
+    // counts per sample, and gains in Q30
+    int64_t m_pllPosn;
+    int32_t m_pllVel;
+    int32_t m_pllKp;
+    int32_t m_pllKi;
     bool m_enabled;
     bool m_processIndex;
     int16_t m_hwIndex;
@@ -259,11 +455,23 @@ private:
     bool m_indexDetected;
     bool m_indexInverted;
     int16_t m_stepsLast;
+    // The change in position comes from a replay instead of the PDEC
+    const volatile int16_t *m_replaySteps;
 
     void Initialize();
 
     void Update();
 
+    void VelocityFilterReset();
+
+    void Position64Apply(int32_t posnNow);
+
+    void VelocityEstimatorReset(int32_t posn);
+
+    int32_t VelocityHybrid(int32_t posn, int32_t windowDelta);
+
+    int32_t VelocityPll(int32_t posn);
+
 }; // EncoderInput
 
 } // ClearCore namespace
@@ -51,6 +51,36 @@
 #define RX_BUFFER_SIZE (128)
 #endif
 
+// Pass received frames to LwIP in the descriptor buffers they arrived in
+// rather than copying them into pool pbufs.
+#ifndef ETHERNET_RX_ZERO_COPY
+#define ETHERNET_RX_ZERO_COPY (1)
+#endif
+
+// Point the TX descriptors at the payloads of outgoing pbufs in RAM rather
+// than copying the payloads into the TX buffers.
+#ifndef ETHERNET_TX_ZERO_COPY
+#define ETHERNET_TX_ZERO_COPY (1)
+#endif
+
+// Spare buffers swapped into the RX descriptors while LwIP holds the
+// buffers of earlier frames.
+#ifndef RX_SPARE_BUFF_CNT
+#define RX_SPARE_BUFF_CNT (16)
+#endif
+
+// The number of raw EtherType channels; see EthernetRaw. 0 removes raw frame
+// handling.
+#ifndef ETHERNET_RAW_MAX
+#define ETHERNET_RAW_MAX (4)
+#endif
+
+// The longest raw frame, including its Ethernet header, passed to a raw
+// channel. Longer frames are truncated.
+#ifndef ETHERNET_RAW_FRAME_MAX
+#define ETHERNET_RAW_FRAME_MAX (1536)
+#endif
+
 /**
     \brief Ethernet receive buffer descriptor.
 
@@ -136,6 +166,14 @@ typedef struct {
     uint8_t mac[6];             /* MAC address */
 } ethInt;
 
+/**
+    \brief Called with each received frame of a raw channel's EtherType.
+
+    The frame starts with its Ethernet header.
+**/
+typedef void (*ethRawHandler)(void *arg, const uint8_t *frame,
+                              uint16_t length);
+
 typedef struct netif netInt;
 typedef struct pbuf packetBuf;
 
@@ -0,0 +1,319 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    \file EthernetIpAdapter.h
+    \brief ClearCore EtherNet/IP adapter.
+
+    Exchanges cyclic implicit (Class 1) I/O with an EtherNet/IP scanner such
+    as a PLC.
+**/
+
+#ifndef __ETHERNETIPADAPTER_H__
+#define __ETHERNETIPADAPTER_H__
+
+#include <stdint.h>
+#include "EthernetTcpClient.h"
+#include "EthernetTcpServer.h"
+#include "EthernetUdp.h"
+#include "IpAddress.h"
+
+namespace ClearCore {
+
+/// The EtherNet/IP encapsulation port, for TCP sessions and ListIdentity
+#define EIP_TCP_PORT 44818
+/// The EtherNet/IP implicit I/O port
+#define EIP_UDP_IO_PORT 2222
+
+/// The most scanners that hold an encapsulation session at once
+#ifndef EIP_SESSIONS_MAX
+#define EIP_SESSIONS_MAX 2
+#endif
+
+/// The largest encapsulation message handled, in bytes
+#ifndef EIP_ENCAP_MAX
+#define EIP_ENCAP_MAX 600
+#endif
+
+/// The largest I/O assembly in either direction, in bytes
+#ifndef EIP_IO_DATA_MAX
+#define EIP_IO_DATA_MAX 496
+#endif
+
+/// The shortest requested packet interval accepted, in microseconds
+#ifndef EIP_RPI_MIN_US
+#define EIP_RPI_MIN_US 1000
+#endif
+
+/// The assembly instances of the I/O connection: data produced to the
+/// scanner (input), consumed from it (output), and configuration
+#ifndef EIP_ASSEMBLY_INPUT
+#define EIP_ASSEMBLY_INPUT 100
+#endif
+#ifndef EIP_ASSEMBLY_OUTPUT
+#define EIP_ASSEMBLY_OUTPUT 150
+#endif
+#ifndef EIP_ASSEMBLY_CONFIG
+#define EIP_ASSEMBLY_CONFIG 151
+#endif
+
+/// The identity reported to scanners. The vendor ID is assigned by ODVA.
+#ifndef EIP_VENDOR_ID
+#define EIP_VENDOR_ID 0
+#endif
+#ifndef EIP_DEVICE_TYPE
+#define EIP_DEVICE_TYPE 0x2B
+#endif
+#ifndef EIP_PRODUCT_CODE
+#define EIP_PRODUCT_CODE 1
+#endif
+#ifndef EIP_REVISION_MAJOR
+#define EIP_REVISION_MAJOR 1
+#endif
+#ifndef EIP_REVISION_MINOR
+#define EIP_REVISION_MINOR 1
+#endif
+#ifndef EIP_PRODUCT_NAME
+#define EIP_PRODUCT_NAME "ClearCore"
+#endif
+
+/**
+    \class EthernetIpAdapter
+    \brief ClearCore EtherNet/IP adapter.
+
+    Accepts one exclusive owner Class 1 I/O connection from a scanner, set
+    up with Forward_Open over an encapsulation session on TCP port 44818.
+    While the connection is open the adapter produces the input assembly to
+    the scanner every T->O requested packet interval (RPI) and consumes the
+    output assembly the scanner sends every O->T RPI, over UDP port 2222.
+    RPIs down to #EIP_RPI_MIN_US are accepted. If the scanner stops sending
+    for its connection timeout the connection is closed.
+
+    The assemblies are application buffers passed to Begin(). The produce
+    callback runs just before each input packet is built, so it can sample
+    the connectors at the RPI; the consume callback runs when new output data
+    has arrived. In a generic Ethernet module configuration on the scanner,
+    use the assembly instances #EIP_ASSEMBLY_INPUT, #EIP_ASSEMBLY_OUTPUT, and
+    #EIP_ASSEMBLY_CONFIG (configuration size 0), the assembly sizes given to
+    Begin(), and unicast connections. The scanner's output data carries the
+    32-bit run/idle header; the input data has no header.
+
+    Packets are produced from Poll(), so the production timing is only as
+    good as the main loop's; call Poll() at least several times per RPI.
+
+    \code{.cpp}
+    struct {
+        uint32_t Inputs;
+        int32_t Position;
+    } Produced;
+    struct {
+        uint32_t Outputs;
+    } Consumed;
+
+    EthernetIpAdapter Adapter;
+
+    void Produce() {
+        Produced.Inputs = InputMgr.InputsRT().reg;
+        Produced.Position = ConnectorM0.PositionRefCommanded();
+    }
+
+    void Consume() {
+        ConnectorIO0.State(Adapter.Run() && (Consumed.Outputs & 1));
+    }
+
+    int main() {
+        EthernetMgr.Setup();
+        Adapter.Begin(reinterpret_cast<uint8_t *>(&Produced),
+                      sizeof(Produced),
+                      reinterpret_cast<uint8_t *>(&Consumed),
+                      sizeof(Consumed));
+        Adapter.ProduceCallback(Produce);
+        Adapter.ConsumeCallback(Consume);
+        while (true) {
+            Adapter.Poll();
+        }
+    }
+    \endcode
+**/
+class EthernetIpAdapter {
+
+public:
+    /**
+        \brief Called from Poll() around the exchange of I/O data.
+    **/
+    typedef void (*IoCallback)();
+
+    /**
+        \brief Construct an EtherNet/IP adapter.
+    **/
+    EthernetIpAdapter();
+
+    /**
+        \brief Start accepting sessions and I/O connections.
+
+        Call after EthernetMgr.Setup(). The buffers are used in place, so they
+        must stay valid while the adapter runs.
+
+        \param[in] produced The input assembly, sent to the scanner.
+        \param[in] producedSize The size of the input assembly, at most
+        #EIP_IO_DATA_MAX.
+        \param[in] consumed The output assembly, written by the scanner.
+        \param[in] consumedSize The size of the output assembly, at most
+        #EIP_IO_DATA_MAX.
+
+        \return True if the adapter started.
+    **/
+    bool Begin(const uint8_t *produced, uint16_t producedSize,
+               uint8_t *consumed, uint16_t consumedSize);
+
+    /**
+        \brief Set the function called just before each input packet is
+        built.
+    **/
+    void ProduceCallback(IoCallback callback) {
+        m_produceCallback = callback;
+    }
+
+    /**
+        \brief Set the function called after new output data is received.
+    **/
+    void ConsumeCallback(IoCallback callback) {
+        m_consumeCallback = callback;
+    }
+
+    /**
+        \brief Set the function called when the I/O connection times out or
+        is closed by the scanner. The output assembly keeps its last data.
+    **/
+    void ConnectionLostCallback(IoCallback callback) {
+        m_lostCallback = callback;
+    }
+
+    /**
+        \brief Serve the encapsulation sessions and exchange I/O data.
+
+        Call repeatedly from the main loop.
+    **/
+    void Poll();
+
+    /**
+        \brief Check whether an I/O connection is open.
+    **/
+    bool Connected() {
+        return m_connection.Open;
+    }
+
+    /**
+        \brief Check whether the scanner is in run mode.
+
+        \return True if an I/O connection is open and the run/idle header of
+        the scanner's last output packet says run.
+    **/
+    bool Run() {
+        return m_connection.Open && m_connection.Run;
+    }
+
+    /**
+        \brief The input (T->O) RPI of the open connection, in microseconds.
+    **/
+    uint32_t RpiUs() {
+        return m_connection.Open ? m_connection.TORpiUs : 0;
+    }
+
+    /**
+        \brief The number of input packets produced since Begin().
+    **/
+    uint32_t ProducedCount() {
+        return m_producedCount;
+    }
+
+    /**
+        \brief The number of times the production fell more than an RPI
+        behind and was resynchronized.
+    **/
+    uint32_t LateCount() {
+        return m_lateCount;
+    }
+
+private:
+    struct Session {
+        EthernetTcpClient Client;
+        uint32_t Handle;
+    };
+
+    struct IoConnection {
+        bool Open;
+        bool Run;
+        uint32_t OTConnectionId;
+        uint32_t TOConnectionId;
+        // The connection triad of the originator
+        uint16_t Serial;
+        uint16_t Vendor;
+        uint32_t OriginatorSerial;
+        uint32_t OTRpiUs;
+        uint32_t TORpiUs;
+        uint32_t TimeoutUs;
+        IpAddress Originator;
+        uint32_t LastConsumedUs;
+        uint32_t LastConsumedSeq;
+        uint32_t NextProduceUs;
+        uint32_t ProducedSeq;
+        uint16_t ProducedCipSeq;
+    };
+
+    EthernetTcpServer m_server;
+    Session m_sessions[EIP_SESSIONS_MAX];
+    EthernetUdp m_ioUdp;
+    EthernetUdp m_listUdp;
+    IoConnection m_connection;
+    const uint8_t *m_produced;
+    uint16_t m_producedSize;
+    uint8_t *m_consumed;
+    uint16_t m_consumedSize;
+    IoCallback m_produceCallback;
+    IoCallback m_consumeCallback;
+    IoCallback m_lostCallback;
+    uint32_t m_nextSessionHandle;
+    uint32_t m_nextConnectionId;
+    uint32_t m_producedCount;
+    uint32_t m_lateCount;
+    uint8_t m_rxFrame[EIP_ENCAP_MAX];
+    uint8_t m_txFrame[EIP_ENCAP_MAX];
+
+    void SessionAccept();
+    void SessionProcess(Session &session);
+    uint16_t EncapProcess(Session *session, uint16_t length);
+    uint16_t ListIdentity(uint8_t *data);
+    uint16_t CipRequest(const uint8_t *request, uint16_t length,
+                        uint8_t *reply, IpAddress originator);
+    uint16_t ForwardOpen(const uint8_t *request, uint16_t length,
+                         uint8_t *reply, bool large, IpAddress originator);
+    uint16_t ForwardClose(const uint8_t *request, uint16_t length,
+                          uint8_t *reply);
+    void ConnectionClose();
+    void IoConsume();
+    void IoProduce();
+}; // EthernetIpAdapter
+
+} // ClearCore namespace
+
+#endif // __ETHERNETIPADAPTER_H__
@@ -44,6 +44,26 @@
 
 namespace ClearCore {
 
+/// The otherwise unused interrupt that services Ethernet when
+/// EthernetManager::EventDriven() is enabled. Its handler is PTC_Handler.
+#define ETHERNET_SERVICE_IRQn PTC_IRQn
+
+/// The default time DhcpBeginAsync() waits for a DHCP server before using
+/// the fallback address, in milliseconds
+#ifndef DHCP_FALLBACK_MS
+#define DHCP_FALLBACK_MS 7500
+#endif
+
+/// Set to 0 to not keep the last DHCP lease in NVM for reuse at power-up
+#ifndef DHCP_LEASE_CACHE
+#define DHCP_LEASE_CACHE 1
+#endif
+
+/// How often the GMAC statistics registers are collected, in milliseconds
+#ifndef ETHERNET_STATS_PERIOD_MS
+#define ETHERNET_STATS_PERIOD_MS 100
+#endif
+
 /**
     \brief ClearCore Ethernet configuration manager
 
@@ -57,6 +77,75 @@ class EthernetManager {
     friend class SysManager;
 
 public:
+    /**
+        \brief Usage of one of LwIP's memory pools or of its heap.
+    **/
+    typedef struct {
+        /// The name of the pool
+        const char *Name;
+        /// The capacity; entries for a pool, bytes for the heap
+        uint32_t Size;
+        /// The amount currently allocated
+        uint32_t Used;
+        /// The most allocated at once since Setup() or MemoryPeakReset()
+        uint32_t Peak;
+        /// The number of allocations that failed
+        uint32_t Errors;
+    } MemoryStats;
+
+    /**
+        \brief Traffic and error counts of the Ethernet interface.
+    **/
+    typedef struct {
+        /// Frames received without error
+        uint32_t RxFrames;
+        /// Bytes in the frames received without error
+        uint64_t RxBytes;
+        /// Frames transmitted without error
+        uint32_t TxFrames;
+        /// Bytes in the frames transmitted without error
+        uint64_t TxBytes;
+        /// Frames dropped for a bad frame check sequence (CRC)
+        uint32_t RxCrcErrors;
+        /// Frames dropped because the receive FIFO overran
+        uint32_t RxOverruns;
+        /// Frames dropped because no receive descriptor was free
+        uint32_t RxResourceErrors;
+        /// Frames whose transmission underran
+        uint32_t TxUnderruns;
+        /// The most receive descriptors holding frames at once, of
+        /// #RX_BUFF_CNT
+        uint8_t RxDescriptorsPeak;
+        /// Failed allocations from LwIP's pools and heap, since Setup() or
+        /// MemoryPeakReset()
+        uint32_t MemoryErrors;
+        /// TCP segments retransmitted
+        uint32_t TcpRetransmits;
+    } NetworkStats;
+
+    /**
+        \brief How the local address was acquired by DhcpBeginAsync().
+    **/
+    typedef enum {
+        /// DhcpBeginAsync() has not been called
+        DHCP_STATUS_OFF,
+        /// The PHY link is down
+        DHCP_STATUS_LINK_DOWN,
+        /// Waiting for a DHCP server; there is no address yet
+        DHCP_STATUS_SEARCHING,
+        /// A DHCP server supplied the address
+        DHCP_STATUS_BOUND,
+        /// No DHCP server answered; AutoIP chose a link-local address
+        DHCP_STATUS_AUTOIP,
+        /// No DHCP server answered; the fallback static address is in use
+        DHCP_STATUS_STATIC,
+    } DhcpStatus;
+
+    /**
+        Function called when the DhcpStatus changes.
+    **/
+    typedef void (*DhcpCallback)(DhcpStatus status);
+
 #ifndef HIDE_FROM_DOXYGEN
     /**
         Public accessor for singleton instance
@@ -71,6 +160,8 @@ public:
         to activate.
 
         \note Disables transmit and receive.
+        \note Leaves the PHY alone, so it may run during the PHY's cold
+        start; PhyInitialize() follows once the PHY is ready.
     **/
     void Initialize();
 
@@ -181,6 +272,21 @@ public:
         \note The interrupt register and bits are cleared on read.
     **/
     void IrqHandlerGmac();
+
+    /**
+        \brief Interrupt handler for the Ethernet service interrupt.
+    **/
+    void IrqHandlerService();
+
+    /**
+        \brief Hold off the Ethernet service interrupt. Nests.
+    **/
+    void ServiceLock();
+
+    /**
+        \brief Release a ServiceLock().
+    **/
+    void ServiceUnlock();
 #endif
 
     /**
@@ -265,6 +371,40 @@ public:
     netif *MacInterface() {
         return &m_macInterface;
     }
+
+#if ETHERNET_RAW_MAX
+    /**
+        \brief Register the handler of a raw EtherType channel.
+
+        \param[in] etherType The EtherType of the channel.
+        \param[in] handler Called with each received frame of the EtherType,
+        from the GMAC interrupt or the Ethernet service.
+        \param[in] arg Passed to the handler.
+
+        \return True if the channel was registered.
+    **/
+    bool RawRegister(uint16_t etherType, ethRawHandler handler, void *arg);
+
+    /**
+        \brief Remove the handler of a raw EtherType channel.
+
+        \param[in] etherType The EtherType of the channel.
+    **/
+    void RawUnregister(uint16_t etherType);
+
+    /**
+        \brief Send a raw frame without waiting for TX buffers.
+
+        \param[in] destMac The destination MAC address.
+        \param[in] etherType The EtherType of the frame.
+        \param[in] payload The payload of the frame.
+        \param[in] length The length of the payload in bytes.
+
+        \return True if the frame was handed to the GMAC.
+    **/
+    bool RawSend(const uint8_t *destMac, uint16_t etherType,
+                 const uint8_t *payload, uint16_t length);
+#endif
 #endif
 
     /**
@@ -307,6 +447,82 @@ public:
         m_retransmissionCount = count;
     }
 
+    /**
+        \brief The number of LwIP memory pools.
+
+        The pools and their sizes depend on the LwIP configuration, including
+        the LWIP_MEM_PROFILE selected in lwipopts.h.
+
+        \return The number of pools that MemoryPoolStats() reports on.
+    **/
+    uint8_t MemoryPoolCount();
+
+    /**
+        \brief Get the usage of one of LwIP's memory pools.
+
+        Use the peak usage measured under the application's heaviest network
+        load to size the pools.
+
+        \code{.cpp}
+        EthernetManager::MemoryStats stats;
+        for (uint8_t i = 0; i < EthernetMgr.MemoryPoolCount(); i++) {
+            if (EthernetMgr.MemoryPoolStats(i, stats) && stats.Errors) {
+                // This pool ran out; consider enlarging it
+            }
+        }
+        \endcode
+
+        \param[in] pool The index of the pool, less than MemoryPoolCount().
+        \param[out] stats The usage of the pool.
+
+        \return True if the pool exists and Setup() has been called.
+    **/
+    bool MemoryPoolStats(uint8_t pool, MemoryStats &stats);
+
+    /**
+        \brief Get the usage of LwIP's heap, which holds PBUF_RAM packets
+        such as outgoing TCP segments and UDP packets.
+
+        \param[out] stats The usage of the heap, in bytes.
+
+        \return True if Setup() has been called.
+    **/
+    bool MemoryHeapStats(MemoryStats &stats);
+
+    /**
+        \brief Restart the peak usage and error counts of the heap and pools.
+    **/
+    void MemoryPeakReset();
+
+    /**
+        \brief Get the traffic and error counts of the Ethernet interface.
+
+        The GMAC's statistics registers are collected every
+        #ETHERNET_STATS_PERIOD_MS and when this is called, so this is cheap
+        enough to call from the main loop. When the network slows down,
+        growing CRC errors point at the cabling, receive resource errors or
+        a peak of #RX_BUFF_CNT descriptors at the receive servicing, memory
+        errors at the LwIP pools, and retransmits at the far end or the
+        network.
+
+        \code{.cpp}
+        EthernetManager::NetworkStats stats;
+        if (EthernetMgr.NetworkStatsGet(stats) && stats.RxCrcErrors) {
+            // Check the cabling
+        }
+        \endcode
+
+        \param[out] stats The counts since Setup() or NetworkStatsReset().
+
+        \return True if Setup() has been called.
+    **/
+    bool NetworkStatsGet(NetworkStats &stats);
+
+    /**
+        \brief Restart the traffic and error counts of NetworkStatsGet().
+    **/
+    void NetworkStatsReset();
+
     /**
         \brief Set up DHCP connection to retrieve local IP.
 
@@ -316,6 +532,71 @@ public:
     **/
     bool DhcpBegin();
 
+    /**
+        \brief Start DHCP without waiting for an address.
+
+        Returns at once; the address is acquired in the background by
+        Refresh() (or by the service interrupt when EventDriven() is
+        enabled), so the rest of the application can start right away.
+        If the last lease was kept in NVM, its address is requested directly
+        from the server, which takes a single exchange instead of the full
+        discovery. If no server supplies an address within \a fallbackMs,
+        the address set with DhcpFallback() is used, or AutoIP picks a
+        link-local address (169.254.x.x) when none was set. DHCP keeps
+        running, and a server that answers later replaces the fallback
+        address.
+
+        \code{.cpp}
+        void NetworkStatus(EthernetManager::DhcpStatus status) {
+            if (status == EthernetManager::DHCP_STATUS_BOUND) {
+                // EthernetMgr.LocalIp() is ready
+            }
+        }
+
+        EthernetMgr.Setup();
+        EthernetMgr.DhcpFallback(IpAddress(192, 168, 0, 100),
+                                 IpAddress(255, 255, 255, 0),
+                                 IpAddress(192, 168, 0, 1));
+        EthernetMgr.DhcpBeginAsync(NetworkStatus);
+        \endcode
+
+        \param[in] callback Optional function to call when the DhcpStatus
+        changes. It runs with the rest of the Ethernet servicing.
+        \param[in] fallbackMs How long to wait for a DHCP server before using
+        the fallback address, in milliseconds; 0 to wait indefinitely.
+
+        \return True if DHCP was started.
+
+        \note The lease is written to NVM by Refresh(), and only when its
+        address changes.
+    **/
+    bool DhcpBeginAsync(DhcpCallback callback = nullptr,
+                        uint32_t fallbackMs = DHCP_FALLBACK_MS);
+
+    /**
+        \brief Set the static address to use when no DHCP server answers.
+
+        An address of 0 selects AutoIP instead, which is the default.
+
+        \param[in] ipaddr The fallback local address.
+        \param[in] netmask The fallback netmask.
+        \param[in] gateway The fallback gateway.
+    **/
+    void DhcpFallback(IpAddress ipaddr, IpAddress netmask, IpAddress gateway) {
+        m_dhcpFallbackIp = ipaddr;
+        m_dhcpFallbackNetmask = netmask;
+        m_dhcpFallbackGateway = gateway;
+    }
+
+    /**
+        \brief How the local address was acquired by DhcpBeginAsync().
+
+        \return The current DhcpStatus.
+    **/
+    volatile const DhcpStatus &DhcpState() {
+        return m_dhcpStatus;
+    }
+
     /**
         \brief Setup LwIP with the local network interface.
         \note Should only be called once.
@@ -328,11 +609,44 @@ public:
         Sends all incoming, buffered packets to the LwIP interface. Calls
         sys_check_timeouts() to perform any necessary LwIP related tasks.
 
-        \note Must be called regularly when actively using Ethernet.
-        \note Must NOT be called from an interrupt context.
+        \note Must be called regularly when actively using Ethernet, unless
+        EventDriven() is enabled.
+        \note Must NOT be called from an interrupt context, unless
+        EventDriven() is enabled.
     **/
     void Refresh();
 
+    /**
+        \brief Service Ethernet from an interrupt instead of from Refresh().
+
+        When enabled, each received frame pends a low priority interrupt that
+        passes the frame to LwIP, and the same interrupt runs LwIP's timers
+        when the SysTick update finds them due. The main loop then no longer
+        needs to call Refresh(); calling it just pends the interrupt.
+
+        \code{.cpp}
+        EthernetMgr.Setup();
+        EthernetMgr.EventDriven(true);
+        \endcode
+
+        \param[in] enable True to service Ethernet from the interrupt.
+
+        \note LwIP callbacks run in the interrupt when enabled.
+        \note The ClearCore Ethernet classes hold off the interrupt around
+        their LwIP calls. Code that calls LwIP directly must do the same with
+        an EthernetServiceLock.
+    **/
+    void EventDriven(bool enable);
+
+    /**
+        \brief Check whether Ethernet is serviced from an interrupt.
+
+        \return True if EventDriven() servicing is enabled.
+    **/
+    volatile const bool &EventDriven() {
+        return m_eventDriven;
+    }
+
     /**
         \brief A flag to indicate whether Ethernet setup has been invoked.
 
@@ -379,8 +693,29 @@ private:
     bool m_recv;
     // DHCP flag
     bool m_dhcp;
+    // Background DHCP started by DhcpBeginAsync()
+    bool m_dhcpAsync;
+    volatile DhcpStatus m_dhcpStatus;
+    DhcpCallback m_dhcpCallback;
+    uint32_t m_dhcpFallbackMs;
+    // When the current search for a DHCP server started
+    uint32_t m_dhcpSearchStartMs;
+    bool m_dhcpFallbackActive;
+    bool m_dhcpLinkUp;
+    IpAddress m_dhcpFallbackIp;
+    IpAddress m_dhcpFallbackNetmask;
+    IpAddress m_dhcpFallbackGateway;
+    // The bound address waiting for Refresh() to write it to NVM
+    volatile uint32_t m_dhcpLeasePending;
     // Ethernet setup complete flag
     bool m_ethernetActive;
+    // Service Ethernet from the service interrupt
+    volatile bool m_eventDriven;
+    // Nesting depth of ServiceLock()
+    uint8_t m_serviceLockCount;
+    // An LwIP timeout is due at m_timeoutDueMs
+    volatile bool m_timeoutPending;
+    volatile uint32_t m_timeoutDueMs;
 
     // Receive Buffer Current Index
     uint8_t m_rxBuffIndex;
@@ -395,6 +730,13 @@ private:
     // Transmit Buffers
     uint8_t m_txBuffer[TX_BUFF_CNT][TX_BUFFER_SIZE];
 
+    // Traffic counts collected from the GMAC statistics registers
+    NetworkStats m_stats;
+    uint16_t m_statsMs;
+    volatile uint8_t m_rxDescPeak;
+    // The LwIP retransmit count at the last NetworkStatsReset()
+    uint32_t m_statsTcpRetransmitsBase;
+
     // Blocking retransmission timeout in milliseconds
     uint16_t m_retransmissionTimeout;
     // Number of transmission attempts before giving up
@@ -427,6 +769,50 @@ private:
     **/
     void ConfigureGpioPerGmac(uint32_t port, uint32_t pin);
 
+    /**
+        Add the GMAC statistics registers, which clear on read, to the
+        traffic counts. Must be called with interrupts disabled.
+    **/
+    void StatsCollect();
+
+    /**
+        The failed allocations of the LwIP pools and heap.
+    **/
+    uint32_t MemoryErrors();
+
+    /**
+        \brief Pass received frames to LwIP and run LwIP's due timers.
+    **/
+    void Service();
+
+    /**
+        \brief Pend the service interrupt if an LwIP timeout is due. Called
+        from the SysTick update.
+    **/
+    void ServiceTick();
+
+    /**
+        \brief Record when the next LwIP timeout is due for ServiceTick().
+    **/
+    void TimeoutSchedule();
+
+    /**
+        \brief Track DhcpBeginAsync()'s progress, switching to and from the
+        fallback address and reporting changes to the callback.
+    **/
+    void DhcpUpdate();
+
+    /**
+        \brief Ask the server to confirm the address of the lease kept in
+        NVM. If there is none, restart discovery when \a restart is set.
+    **/
+    void DhcpRequest(bool restart);
+
+    /**
+        \brief Write a bound lease to NVM if it differs from the kept one.
+    **/
+    void DhcpLeaseSave();
+
     /**
         Construct
     **/
@@ -434,6 +820,27 @@ private:
 
 }; // EthernetManager
 
+/**
+    \brief Holds off the Ethernet service interrupt while in scope.
+
+    LwIP is not reentrant. When EthernetManager::EventDriven() is enabled,
+    LwIP runs in the Ethernet service interrupt, so main loop code that calls
+    LwIP directly must hold a lock for the duration of the calls. The lock
+    must not be held while waiting for network activity.
+
+    \code{.cpp}
+    {
+        EthernetServiceLock lock;
+        udp_sendto(pcb, packet, &ip, port);
+    }
+    \endcode
+**/
+class EthernetServiceLock {
+public:
+    EthernetServiceLock();
+    ~EthernetServiceLock();
+}; // EthernetServiceLock
+
 } // ClearCore namespace
 
 #endif // !__ETHERNETMANAGER_H__
@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    \file EthernetRaw.h
+    \brief ClearCore raw Ethernet frame channel.
+
+    Sends and receives Ethernet frames of one EtherType directly through the
+    GMAC descriptors, bypassing LwIP.
+**/
+
+#ifndef __ETHERNETRAW_H__
+#define __ETHERNETRAW_H__
+
+#include <stdint.h>
+#include "EthernetApi.h"
+
+namespace ClearCore {
+
+/**
+    \class EthernetRaw
+    \brief ClearCore raw Ethernet frame channel.
+
+    A raw channel owns one EtherType. Received frames of that EtherType are
+    taken off the GMAC's receive descriptors and passed to the channel's
+    callback without going through LwIP, normally straight from the GMAC
+    interrupt. A frame that arrives behind one LwIP has not yet read is passed
+    on when the Ethernet service reads the frames ahead of it. Up to
+    #ETHERNET_RAW_MAX channels may be open at once; IPv4 and ARP belong to
+    LwIP and cannot be opened.
+
+    Send() copies the frame into the GMAC's transmit buffers and never waits:
+    if the buffers are busy the frame is dropped and Send() returns false.
+    Send() may be called from the main loop, from the receive callback, or
+    from an interrupt handler.
+
+    \code{.cpp}
+    EthernetRaw Raw(0x88B5);
+
+    void RawReceived(const uint8_t *srcMac, const uint8_t *payload,
+                     uint16_t length) {
+        // Echo the frame back to its sender
+        Raw.Send(srcMac, payload, length);
+    }
+
+    EthernetMgr.Setup();
+    Raw.Begin(RawReceived);
+    \endcode
+
+    \note Frames shorter than the Ethernet minimum are padded by the sender,
+    so a received payload may be longer than the one that was sent.
+**/
+class EthernetRaw {
+
+public:
+    /**
+        \brief Called with each frame received on a raw channel.
+
+        Runs in the GMAC interrupt or the Ethernet service, so it should
+        return promptly. The frame is only valid until the callback returns.
+
+        \param[in] srcMac The 6 byte MAC address of the sender.
+        \param[in] payload The frame's payload, after the Ethernet header.
+        \param[in] length The length of the payload in bytes.
+    **/
+    typedef void (*ReceiveCallback)(const uint8_t *srcMac,
+                                    const uint8_t *payload, uint16_t length);
+
+    /**
+        \brief Construct a raw channel for an EtherType.
+
+        \param[in] etherType The EtherType of the channel's frames.
+    **/
+    explicit EthernetRaw(uint16_t etherType);
+
+    /**
+        \brief Open the channel and start receiving its frames.
+
+        \code{.cpp}
+        if (!Raw.Begin(RawReceived)) {
+            // The EtherType is taken or all channels are in use
+        }
+        \endcode
+
+        \param[in] callback Called with each frame received on the channel.
+
+        \return True if the channel was opened.
+    **/
+    bool Begin(ReceiveCallback callback);
+
+    /**
+        \brief Close the channel. Its frames are dropped again.
+    **/
+    void End();
+
+    /**
+        \brief Send a frame on the channel.
+
+        \code{.cpp}
+        uint8_t broadcast[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+        uint8_t data[] = {1, 2, 3, 4};
+        Raw.Send(broadcast, data, sizeof(data));
+        \endcode
+
+        \param[in] destMac The 6 byte destination MAC address.
+        \param[in] payload The payload of the frame.
+        \param[in] length The length of the payload in bytes.
+
+        \return True if the frame was handed to the GMAC; false if the channel
+        is not open, the frame is too long, or the transmit buffers are busy.
+    **/
+    bool Send(const uint8_t *destMac, const uint8_t *payload,
+              uint16_t length);
+
+    /**
+        \brief The EtherType of the channel.
+    **/
+    uint16_t EtherType() {
+        return m_etherType;
+    }
+
+    /**
+        \brief Check whether the channel is open.
+    **/
+    bool IsOpen() {
+        return m_open;
+    }
+
+private:
+    uint16_t m_etherType;
+    ReceiveCallback m_callback;
+    bool m_open;
+
+    // Adapts the EthernetManager's raw handler to the channel's callback
+    static void FrameReceived(void *arg, const uint8_t *frame,
+                              uint16_t length);
+}; // EthernetRaw
+
+} // ClearCore namespace
+
+#endif // __ETHERNETRAW_H__
@@ -29,13 +29,24 @@
 
 #include "lwip/tcp.h"
 #include <string.h>
+#include "NumberFormat.h"
+#include "RingBuffer.h"
 #ifndef HIDE_FROM_DOXYGEN
 namespace ClearCore {
 
 /** The maximum number of allowable client connections at any given time. **/
 #define CLIENT_MAX 8
-/** The size of the buffer to hold incoming TCP data, in bytes. **/
-#define TCP_DATA_BUFFER_SIZE 600
+/** The size of the buffer to hold incoming TCP data, in bytes; a power of
+    two. **/
+#define TCP_DATA_BUFFER_SIZE 512
+/** Hold incoming TCP data in the received pbufs until it is read, rather than
+    copying it into a TCP_DATA_BUFFER_SIZE buffer per connection. The receive
+    window is then opened as the data is read. **/
+#ifndef TCP_RX_PBUF_QUEUE
+#define TCP_RX_PBUF_QUEUE 1
+#endif
+
+class EthernetTcpServer;
 
 /**
     \brief A base class for an Ethernet TCP connection.
@@ -51,13 +62,27 @@ public:
     /**
         ClearCore TCP connection state.
     **/
-    typedef struct {
+    typedef struct TcpData {
         struct tcp_pcb *pcb;    /*!< The LwIP PCB for the TCP connection. */
-        uint16_t dataHead;      /*!< The head of the incoming data buffer. */
-        uint16_t dataTail;      /*!< The tail of the incoming data buffer. */
+#if TCP_RX_PBUF_QUEUE
+        struct pbuf *rxQueue;   /*!< The incoming data not yet read. */
+        uint16_t rxOffset;      /*!< Bytes of rxQueue already read. */
+        tcp_state state;        /*!< The state of this tcp_data. */
+#else
+        RingBuffer<uint8_t> dataRing; /*!< The incoming data, in data. */
         tcp_state state;        /*!< The state of this tcp_data. */
         uint8_t data[TCP_DATA_BUFFER_SIZE]; /*!< The incoming data buffer for
                                                         this TCP connection. */
+#endif
+        uint16_t coalesceBytes; /*!< Unsent bytes that start a send, or 0 to
+                                     send every write. */
+        uint16_t coalesceMs;    /*!< The longest a write is held back. */
+        uint16_t coalesced;     /*!< Bytes held back since the last send. */
+        EthernetTcpServer *server; /*!< The server managing this connection,
+                                        if any. */
+        struct TcpData *readyNext; /*!< The next connection on the server's
+                                        ready list. */
+        bool ready;             /*!< On the server's ready list. */
     } TcpData;
 
     /**
@@ -108,6 +133,50 @@ public:
     **/
     virtual uint32_t Send(const uint8_t *buff, uint32_t size) = 0;
 
+    /**
+        \brief Send a signed integer as text.
+
+        These are named rather than Send() overloads so that Send() of a
+        small integer keeps sending it as one character.
+
+        \param[in] number The value to send.
+        \param[in] radix (optional) The base, 2 through 16. Default: 10.
+
+        \return The number of bytes written.
+    **/
+    uint32_t SendInt(int32_t number, uint8_t radix = 10) {
+        char text[FORMAT_INT_BUFFER_SIZE];
+        return Send((const uint8_t *)text, FormatInt(text, number, radix));
+    }
+
+    /**
+        \brief Send an unsigned integer as text.
+
+        \param[in] number The value to send.
+        \param[in] radix (optional) The base, 2 through 16. Default: 10.
+
+        \return The number of bytes written.
+    **/
+    uint32_t SendUint(uint32_t number, uint8_t radix = 10) {
+        char text[FORMAT_INT_BUFFER_SIZE];
+        return Send((const uint8_t *)text, FormatUint(text, number, radix));
+    }
+
+    /**
+        \brief Send a floating point number as text.
+
+        \param[in] number The value to send.
+        \param[in] precision (optional) The number of digits to send after
+        the decimal point. Default: 2.
+
+        \return The number of bytes written.
+    **/
+    uint32_t SendFloat(double number, uint8_t precision = 2) {
+        char text[FORMAT_FLOAT_BUFFER_SIZE];
+        return Send((const uint8_t *)text,
+                    FormatFloat(text, number, precision));
+    }
+
     /**
         \brief Get the local port number.
 
@@ -163,10 +232,21 @@ err_t TcpReceive(void *arg, struct tcp_pcb *tpcb, struct pbuf *p,
 **/
 err_t TcpSend(void *arg, struct tcp_pcb *tpcb, u16_t len);
 
+/**
+    Sends the data written to a TCP connection, or holds it back while the
+    connection coalesces its sends and \a hold is true.
+**/
+err_t TcpOutput(EthernetTcp::TcpData *data, uint16_t written, bool hold);
+
 /**
     Closes a TCP connection.
 **/
 void TcpClose(struct tcp_pcb *pcb, EthernetTcp::TcpData *data);
+
+/**
+    Frees a TCP connection state along with any unread incoming data.
+**/
+void TcpDataFree(EthernetTcp::TcpData *data);
 #endif // !HIDE_FROM_DOXYGEN
 
 } // ClearCore namespace
@@ -41,6 +41,11 @@ namespace ClearCore {
     TCP connection timeout greater than this value will fail, and this value
     will be used instead. **/
 #define TCP_CONNECTION_TIMEOUT_MAX 15000
+/** The default longest time SendCoalesce() holds a write back, in
+    milliseconds. **/
+#ifndef TCP_COALESCE_FLUSH_MS
+#define TCP_COALESCE_FLUSH_MS 10
+#endif
 
 /**
     \brief ClearCore TCP client class.
@@ -73,6 +78,104 @@ public:
     **/
     bool Connect(IpAddress ip, uint16_t port);
 
+    /**
+        \brief The progress of a nonblocking connect.
+    **/
+    typedef enum {
+        /// No nonblocking connect has been started
+        CONNECT_IDLE,
+        /// Waiting for the hostname to be resolved
+        CONNECT_RESOLVING,
+        /// Waiting for the server to accept the connection
+        CONNECT_CONNECTING,
+        /// The connection was established
+        CONNECT_CONNECTED,
+        /// The hostname could not be resolved, the server refused the
+        /// connection, or the connection timeout elapsed
+        CONNECT_FAILED,
+    } ConnectState;
+
+    /**
+        \brief Called once when a nonblocking connect finishes.
+
+        \param[in] client The client that was connecting.
+        \param[in] connected True if the connection was established.
+    **/
+    typedef void (*ConnectCallback)(EthernetTcpClient &client,
+                                    bool connected);
+
+    /**
+        \brief Start connecting to a remote IP address and port without
+        waiting.
+
+        Progress is reported by ConnectStatus(), which must be called
+        regularly from the main loop until the connect finishes.
+
+        \code{.cpp}
+        // Keep trying to connect without holding up the main loop
+        if (client.ConnectStatus() != EthernetTcpClient::CONNECT_CONNECTING &&
+                !client.Connected()) {
+            client.ConnectAsync(IpAddress(192, 168, 0, 10), 8888);
+        }
+        \endcode
+
+        \param[in] ip The IP address of the server.
+        \param[in] port The port of the server.
+        \param[in] callback (optional) Called from ConnectStatus() when the
+        connect finishes.
+
+        \return True if the connect was started; false if the client is
+        already connected or connecting, or no connection could be allocated.
+    **/
+    bool ConnectAsync(IpAddress ip, uint16_t port,
+                      ConnectCallback callback = nullptr);
+
+    /**
+        \brief Start resolving a hostname and connecting to it without
+        waiting.
+
+        The hostname may also be a dotted IP address. Resolved names are kept
+        in LwIP's DNS table for the TTL the DNS server gives them, so later
+        connects to the same host skip the lookup. The connection timeout
+        covers both the lookup and the connect.
+
+        \code{.cpp}
+        client.ConnectAsync("historian.local", 8888, HistorianConnected);
+        \endcode
+
+        \param[in] host The hostname of the server.
+        \param[in] port The port of the server.
+        \param[in] callback (optional) Called from ConnectStatus() when the
+        connect finishes.
+
+        \return True if the lookup or connect was started.
+    **/
+    bool ConnectAsync(const char *host, uint16_t port,
+                      ConnectCallback callback = nullptr);
+
+    /**
+        \brief Advance a nonblocking connect and get its state.
+
+        Applies the connection timeout, and calls the connect's callback once
+        the connect finishes.
+
+        \code{.cpp}
+        switch (client.ConnectStatus()) {
+            case EthernetTcpClient::CONNECT_CONNECTED:
+                client.Send("hello");
+                break;
+            case EthernetTcpClient::CONNECT_FAILED:
+                // Try again later
+                break;
+            default:
+                break;
+        }
+        \endcode
+
+        \return The state of the most recent nonblocking connect.
+    **/
+    ConnectState ConnectStatus();
+
     /**
         \brief Determines if the client is actively connected to a server.
 
@@ -120,11 +223,22 @@ public:
     **/
     int16_t Peek();
 
+    /**
+        \brief Copy received data without pulling it out of the buffer.
+
+        \param[out] dataPtr A pointer to a buffer to hold the data.
+        \param[in] length The maximum number of bytes to copy.
+
+        \return The number of bytes copied.
+    **/
+    int16_t Peek(uint8_t *dataPtr, uint32_t length);
+
     /**
         \brief Wait until all outgoing data to the server has been sent.
 
-        While the server is connected, blocks until the server has ACK'd all
-        outgoing packets.
+        While the server is connected, sends any data held back by
+        SendCoalesce(), then blocks until the server has ACK'd all outgoing
+        packets.
     **/
     void Flush();
 
@@ -150,6 +264,97 @@ public:
     **/
     uint32_t Send(const uint8_t *buff, uint32_t size) override;
 
+    /**
+        \brief Send the buffer contents to the server without copying them.
+
+        The data is sent straight from the supplied buffer rather than being
+        copied into the TCP send queue first, which saves a copy per byte for
+        large blocks of data.
+
+        \code{.cpp}
+        static const uint8_t statusBlock[1024] = {...};
+        client.SendNoCopy(statusBlock, sizeof(statusBlock));
+        \endcode
+
+        \param[in] buff A pointer to the beginning of the data to send.
+        \param[in] size The maximum number of bytes to send.
+        \return The number of bytes sent to the server.
+
+        \note The buffer must stay valid and unchanged until the server has
+        ACK'd the data, e.g. until Flush() returns. Use Send() for buffers
+        that are about to be reused.
+    **/
+    uint32_t SendNoCopy(const uint8_t *buff, uint32_t size);
+
+    /**
+        \brief The number of bytes that can be sent without waiting.
+
+        A Send() of at most this many bytes is queued in full and returns
+        without waiting for the send queue to drain.
+
+        \code{.cpp}
+        if (client.SendSpace() >= sizeof(record)) {
+            client.Send(record, sizeof(record));
+        }
+        \endcode
+
+        \return The free space in the TCP send buffer, or 0 if the connection
+        is not established or its send queue is half full.
+    **/
+    uint32_t SendSpace();
+
+    /**
+        \brief Coalesce small sends into fewer, larger packets.
+
+        Every Send() normally goes out in a TCP segment of its own. While
+        coalescing, Send() only queues the data in the TCP send buffer, and
+        the queue is sent once \a flushBytes have been held back, once the
+        oldest of them has waited \a flushMs, when SendFlush() or Flush() is
+        called, or when the send buffer is nearly full. The timeout runs
+        with the rest of the Ethernet servicing.
+
+        \code{.cpp}
+        // Send 1 kHz telemetry lines in packets of up to 1 KB, each line at
+        // most 10 ms late
+        client.SendCoalesce(1024, 10);
+        while (true) {
+            client.Send(line);
+            ...
+        }
+        \endcode
+
+        \param[in] flushBytes The number of bytes held back that starts a
+        send, up to the send buffer size; 0 stops coalescing and sends what
+        is held back.
+        \param[in] flushMs The longest a write is held back, in
+        milliseconds; 0 for no limit.
+
+        \return True if the client has a connection.
+    **/
+    bool SendCoalesce(uint16_t flushBytes,
+                      uint16_t flushMs = TCP_COALESCE_FLUSH_MS);
+
+    /**
+        \brief Send the data held back by SendCoalesce() now, without
+        waiting for it to be ACK'd.
+    **/
+    void SendFlush();
+
+    /**
+        \brief Enable or disable Nagle's algorithm on the connection.
+
+        Connections start with Nagle's algorithm disabled (TCP_NODELAY), so
+        a send goes out while earlier data is still waiting to be ACK'd.
+        With it enabled, the stack holds small segments back until the
+        earlier data is ACK'd, which also coalesces sends but can add up to
+        the server's delayed ACK time to each.
+
+        \param[in] noDelay True to disable Nagle's algorithm.
+
+        \return True if the client has a connection.
+    **/
+    bool NoDelay(bool noDelay);
+
     /**
         \brief Send a TCP packet.
 
@@ -222,6 +427,25 @@ public:
 private:
     uint16_t m_connectionTimeout;
     bool m_dnsInitialized;
+    volatile ConnectState m_connectState;
+    ConnectCallback m_connectCallback;
+    uint32_t m_connectStartMs;
+    uint16_t m_connectPort;
+
+    // Allocate the connection and send the SYN
+    bool ConnectBegin(IpAddress ip, uint16_t port);
+    // Give up on a nonblocking connect
+    void ConnectFail();
+    // LwIP callback for a nonblocking hostname lookup
+    static void ConnectResolved(const char *host, const ip_addr_t *ip,
+                                void *arg);
+
+    uint32_t SendData(const uint8_t *buff, uint32_t size, uint8_t flags);
+    bool SendQueueFull();
+#if TCP_RX_PBUF_QUEUE
+    // Consume bytes read from the receive queue and reopen the window
+    void RxQueueAdvance(uint16_t bytes);
+#endif
 
 }; // EthernetTcpClient
 
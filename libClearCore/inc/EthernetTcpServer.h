@@ -39,12 +39,41 @@ namespace ClearCore {
     This class manages an instance of a TCP server and manages interactions
     with multiple Ethernet TCP client connections.
 
+    The server keeps a list of the clients that have received data or
+    disconnected, in the order they did, so Available() finds the next
+    client to service without checking every connection. To be told of new
+    clients and new data instead of polling, register
+    ClientAcceptedCallback() and ClientDataCallback().
+
+    \code{.cpp}
+    EthernetTcpServer server(8888);
+
+    void HmiData(EthernetTcpClient client) {
+        // Data arrived from an HMI, or it disconnected
+    }
+
+    server.ClientDataCallback(HmiData);
+    server.Begin();
+    while (true) {
+        EthernetMgr.Refresh();
+        EthernetTcpClient client = server.Available();
+        while (client.BytesAvailable()) {
+            // Handle the request
+        }
+    }
+    \endcode
+
     For more detailed information on the ClearCore Ethernet system, check out
     the \ref EthernetMain informational page.
 **/
 class EthernetTcpServer : public EthernetTcp {
 
 public:
+    /**
+        Function called with a client of the server.
+    **/
+    typedef void (*ClientCallback)(EthernetTcpClient client);
+
     /**
         \brief Construct a TCP server.
 
@@ -135,6 +164,50 @@ public:
     **/
     bool Ready();
 
+    /**
+        \brief Set the function called when the server accepts a client.
+
+        It runs with the rest of the Ethernet servicing; the server keeps
+        managing the client unless the function calls Accept().
+
+        \param[in] callback The function to call, or nullptr for none.
+    **/
+    void ClientAcceptedCallback(ClientCallback callback) {
+        m_acceptedCallback = callback;
+    }
+
+    /**
+        \brief Set the function called when a client of the server receives
+        data or disconnects.
+
+        It runs with the rest of the Ethernet servicing, for clients the
+        server manages. The client also becomes the next one Available()
+        returns, after those that were ready before it.
+
+        \param[in] callback The function to call, or nullptr for none.
+    **/
+    void ClientDataCallback(ClientCallback callback) {
+        m_dataCallback = callback;
+    }
+
+#ifndef HIDE_FROM_DOXYGEN
+    /**
+        Start managing a newly accepted client. Returns false if the server
+        has no room for it.
+    **/
+    bool ClientAdd(TcpData *data);
+
+    /**
+        Put a client that received data or disconnected on the ready list.
+    **/
+    void ClientReady(TcpData *data);
+
+    /**
+        Stop managing a client.
+    **/
+    void ClientRemove(TcpData *data);
+#endif // !HIDE_FROM_DOXYGEN
+
 private:
     bool m_initialized;
 
@@ -144,6 +217,13 @@ private:
     // TCP state for connected clients.
     TcpData *m_tcpDataClient[CLIENT_MAX];
 
+    // The clients with data or a disconnect to handle, oldest first.
+    TcpData *m_readyHead;
+    TcpData *m_readyTail;
+
+    ClientCallback m_acceptedCallback;
+    ClientCallback m_dataCallback;
+
 }; // EthernetTcpServer
 
 } // ClearCore namespace
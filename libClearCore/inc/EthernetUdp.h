@@ -32,6 +32,18 @@
 
 namespace ClearCore {
 
+class SecureChannel;
+
+/// The most preallocated packets a UDP session can reserve for batch sends
+#ifndef UDP_BATCH_MAX
+#define UDP_BATCH_MAX 8
+#endif
+
+/// The most received datagrams a UDP session can hold until they are parsed
+#ifndef UDP_RX_QUEUE_MAX
+#define UDP_RX_QUEUE_MAX 8
+#endif
+
 /**
     \brief ClearCore UDP session class.
 
@@ -43,16 +55,38 @@ namespace ClearCore {
 class EthernetUdp {
 
 public:
+    /**
+        \brief What to discard when a datagram arrives to a full receive
+        queue.
+    **/
+    typedef enum {
+        /// Discard the oldest queued datagram to make room for the new one.
+        RX_DROP_OLDEST,
+        /// Discard the new datagram.
+        RX_DROP_NEWEST,
+    } ReceiveOverflowPolicy;
+
 #ifndef HIDE_FROM_DOXYGEN
+    /**
+        A received datagram waiting to be parsed.
+    **/
+    typedef struct {
+        struct pbuf *packet; /*!< The received buffer chain. */
+        ip_addr_t remoteIp;  /*!< The remote IP address of the datagram. */
+        u16_t remotePort;    /*!< The remote port of the datagram. */
+    } UdpDatagram;
+
     /**
         ClearCore UDP connection state.
     **/
     typedef struct {
         struct udp_pcb *pcb; /*!< The LwIP PCB for the UDP connection. */
-        struct pbuf *packet; /*!< The incoming data buffer. */
-        uint16_t available;  /*!< The number of available incoming bytes. */
-        ip_addr_t remoteIp;  /*!< The remote IP address of the incoming data. */
-        u16_t remotePort;    /*!< The remote port of the incoming data. */
+        UdpDatagram queue[UDP_RX_QUEUE_MAX]; /*!< The received datagrams. */
+        uint8_t head;        /*!< The index of the oldest datagram. */
+        uint8_t count;       /*!< The number of queued datagrams. */
+        uint8_t depth;       /*!< The most datagrams to queue. */
+        bool dropNewest;     /*!< Discard new datagrams when full. */
+        uint32_t overflowCount; /*!< The datagrams discarded when full. */
     } UdpData;
 #endif // !HIDE_FROM_DOXYGEN
 
@@ -65,11 +99,25 @@ public:
         \brief  Initialize the UDP session and begin listening on the specified
         local port.
 
+        Optionally reserves packets for the batch send API. The reserved
+        packets are allocated once from the LwIP heap and reused for every
+        batch, so the whole reservation (\a batchCount times \a batchSize plus
+        headers) must fit in MEM_SIZE.
+
+        \code{.cpp}
+        // Listen on port 8888 and reserve 4 packets of up to 256 bytes
+        Udp.Begin(8888, 4, 256);
+        \endcode
+
         \param[in] localPort The local port for the UDP session.
+        \param[in] batchCount The number of packets to reserve for batch
+        sends, up to #UDP_BATCH_MAX.
+        \param[in] batchSize The largest payload, in bytes, of a batch packet.
 
         \return success
     **/
-    bool Begin(uint16_t localPort);
+    bool Begin(uint16_t localPort, uint8_t batchCount = 0,
+               uint16_t batchSize = 0);
 
     /**
         \brief Disable the UDP session.
@@ -86,6 +134,108 @@ public:
     **/
     bool Connect(IpAddress remoteIp, uint16_t remotePort);
 
+    /**
+        \brief Join a multicast group to receive the packets sent to it on
+        the local port.
+
+        Joining a group rebinds the session to accept packets addressed to
+        any local address, so it keeps receiving unicast and broadcast packets
+        as well. To publish to a group, Connect() to the group address.
+
+        \code{.cpp}
+        EthernetUdp Udp;
+        Udp.Begin(5000);
+        // Subscribe to the telemetry published to 239.1.2.3, port 5000
+        Udp.MulticastJoin(IpAddress(239, 1, 2, 3));
+        \endcode
+
+        \param[in] group The multicast group address.
+
+        \return True if the group was joined.
+    **/
+    bool MulticastJoin(IpAddress group);
+
+    /**
+        \brief Leave a multicast group joined with MulticastJoin().
+
+        \param[in] group The multicast group address.
+
+        \return True if the group was left.
+    **/
+    bool MulticastLeave(IpAddress group);
+
+    /**
+        \brief Set the time-to-live of the multicast packets sent by this
+        session. The default of 1 keeps packets on the local subnet.
+
+        \code{.cpp}
+        // Allow published packets to cross up to 4 routers
+        Udp.MulticastTtl(5);
+        \endcode
+
+        \param[in] ttl The time-to-live of outgoing multicast packets.
+    **/
+    void MulticastTtl(uint8_t ttl);
+
+    /**
+        \brief Claim a reserved packet to fill in place for a batch send.
+
+        Returns a pointer straight into the payload of the next free packet
+        reserved by Begin(). Write up to BatchSizeMax() bytes there, then call
+        BatchPacketQueue() to address it. A packet is free again once the
+        Ethernet driver has transmitted it.
+
+        \code{.cpp}
+        uint8_t *payload = Udp.BatchPacketBegin();
+        if (payload) {
+            int32_t posn = ConnectorM0.PositionRefCommanded();
+            memcpy(payload, &posn, sizeof(posn));
+            Udp.BatchPacketQueue(IpAddress(192, 168, 0, 255), 8888,
+                                 sizeof(posn));
+        }
+        \endcode
+
+        \return The payload to fill in, or nullptr if every reserved packet is
+        queued or still being transmitted.
+    **/
+    uint8_t *BatchPacketBegin();
+
+    /**
+        \brief Queue the packet claimed with BatchPacketBegin() for the next
+        BatchSend().
+
+        \param[in] remoteIp The remote IP address.
+        \param[in] remotePort The remote port.
+        \param[in] size The number of payload bytes written.
+
+        \return True if the packet was queued; false if no packet was claimed
+        or \a size is larger than BatchSizeMax().
+    **/
+    bool BatchPacketQueue(IpAddress remoteIp, uint16_t remotePort,
+                          uint16_t size);
+
+    /**
+        \brief Send every queued batch packet.
+
+        All of the packets go down the stack in one pass, without allocating
+        or copying any payload data.
+
+        \code{.cpp}
+        // Publish this sample's status packets together
+        Udp.BatchSend();
+        \endcode
+
+        \return The number of packets sent.
+    **/
+    uint8_t BatchSend();
+
+    /**
+        \brief The largest payload of a batch packet, as passed to Begin().
+    **/
+    uint16_t BatchSizeMax() {
+        return m_batchSize;
+    }
+
     /**
         \brief Send the UDP packet set up with Connect().
 
@@ -128,16 +278,92 @@ public:
     uint32_t PacketWrite(const uint8_t *buffer, uint32_t size);
 
     /**
-        \brief Check for the newest incoming UDP packet.
+        \brief Set how many received datagrams the session holds until they
+        are parsed.
+
+        Datagrams that arrive between calls to PacketParse() wait in a queue
+        and are parsed oldest first. When a datagram arrives to a full queue,
+        \a policy chooses which one is discarded, and the discard is counted
+        by ReceiveOverflowCount(). The default depth of 1 with
+        #RX_DROP_OLDEST keeps only the newest datagram.
+
+        A queued datagram holds on to the Ethernet receive buffers it arrived
+        in, so keep the depth of all sessions together well below
+        PBUF_POOL_SIZE or the Ethernet driver runs out of buffers to receive
+        into.
+
+        \code{.cpp}
+        // Hold a burst of up to 4 commands, keeping the first ones to arrive
+        Udp.ReceiveQueue(4, EthernetUdp::RX_DROP_NEWEST);
+        \endcode
+
+        \param[in] depth The most datagrams to queue, from 1 to
+        #UDP_RX_QUEUE_MAX. Lowering the depth discards the oldest datagrams
+        that no longer fit.
+        \param[in] policy Which datagram to discard when the queue is full.
+
+        \return True if the depth is valid.
+    **/
+    bool ReceiveQueue(uint8_t depth,
+                      ReceiveOverflowPolicy policy = RX_DROP_OLDEST);
 
-        Checks for the newest incoming UDP packet received by the listening
-        UDP session. Moves the packet to be read from by following calls to
-        PacketRead().
+    /**
+        \brief The number of received datagrams waiting for PacketParse().
+    **/
+    uint8_t ReceiveQueued() {
+        return m_udpData.count;
+    }
+
+    /**
+        \brief The number of datagrams discarded because the receive queue
+        was full.
+
+        \return The count of discarded datagrams since Begin().
+    **/
+    uint32_t ReceiveOverflowCount() {
+        return m_udpData.overflowCount;
+    }
+
+    /**
+        \brief Check for the next incoming UDP packet.
+
+        Takes the oldest datagram from the receive queue and makes it the
+        packet read by following calls to PacketRead(). Any unread data left
+        in the previous packet is discarded.
 
         \return The size of the incoming packet in bytes.
     **/
     uint16_t PacketParse();
 
+    /**
+        \brief The buffer chain holding the current packet.
+
+        Gives direct access to the received data without copying it. The
+        payload is split across the chain; each pbuf holds \a len bytes at
+        \a payload, and \a next points to the following pbuf. The chain
+        always holds the whole packet, whatever has been read from it with
+        PacketRead(), and stays valid until the next call to PacketParse() or
+        PacketFlush(), or until PacketRead() reaches the end of the packet.
+
+        \code{.cpp}
+        if (Udp.PacketParse()) {
+            for (const struct pbuf *p = Udp.PacketChain(); p; p = p->next) {
+                CommandParse(static_cast<const uint8_t *>(p->payload),
+                             p->len);
+            }
+            Udp.PacketFlush();
+        }
+        \endcode
+
+        \return The first pbuf of the current packet, or nullptr if no packet
+        has been parsed.
+
+        \note PacketParse() must be called first to read an incoming packet.
+    **/
+    const struct pbuf *PacketChain() {
+        return m_packetParsed ? m_incomingPacket : nullptr;
+    }
+
     /**
         \brief Number of bytes available to read from the current packet.
 
@@ -175,6 +401,24 @@ public:
     **/
     void PacketFlush();
 
+    /**
+        \brief Encrypt and authenticate the session's packets.
+
+        With a channel set, PacketSend() seals each packet built with
+        PacketWrite(), and PacketParse() opens each datagram received,
+        silently dropping any that are forged, replayed, or not sealed, so
+        the rest of the API works on the plaintext. A datagram from a
+        session the channel doesn't know is answered with the channel's
+        challenge to the address it came from. Packets grow by
+        #SECURE_CHANNEL_OVERHEAD bytes on the wire. Batch sends are not
+        sealed.
+
+        \param[in] channel The channel, or null to stop sealing packets.
+    **/
+    void Secure(SecureChannel *channel) {
+        m_secure = channel;
+    }
+
     /**
         \brief Returns the remote IP address for the current packet.
 
@@ -211,8 +455,32 @@ private:
     // PacketParse() was called and we can read a packet.
     bool m_packetParsed;
 
-    uint16_t UdpPacketRead(pbuf *packet, uint16_t *available,
-                           unsigned char *buffer, uint16_t size);
+    // A packet reserved at Begin() for batch sends. The payload pointer is
+    // kept so the headers the stack adds can be stripped before reuse.
+    typedef struct {
+        struct pbuf *packet;
+        uint8_t *payload;
+        IpAddress remoteIp;
+        uint16_t remotePort;
+    } BatchPacket;
+
+    BatchPacket m_batch[UDP_BATCH_MAX];
+    uint8_t m_batchCount;
+    uint16_t m_batchSize;
+    // Slot indices in the order they were queued
+    uint8_t m_batchQueue[UDP_BATCH_MAX];
+    uint8_t m_batchQueued;
+    // The slot claimed by BatchPacketBegin(), or -1
+    int8_t m_batchOpen;
+
+    // Seals sent packets and opens received ones, if set
+    SecureChannel *m_secure;
+
+    bool BatchReserve(uint8_t count, uint16_t size);
+    void BatchRelease();
+    bool BatchPacketFree(uint8_t slot);
+    bool PacketSeal();
+    bool PacketOpen(const UdpDatagram *datagram);
 }; // EthernetUdp
 
 #ifndef HIDE_FROM_DOXYGEN
@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    \file EventManager.h
+    \brief ClearCore Event System (EVSYS) channel manager.
+
+    Routes peripheral events, such as input edges and timer overflows, to the
+    peripherals they trigger without the CPU.
+**/
+
+#ifndef __EVENTMANAGER_H__
+#define __EVENTMANAGER_H__
+
+#include <stdint.h>
+
+namespace ClearCore {
+
+/**
+    The event channels the library keeps for itself.
+**/
+typedef enum {
+    EVENT_HLFB_M0,          ///< M-0 HLFB edges to its capture timer
+    EVENT_HLFB_M1,          ///< M-1 HLFB edges to its capture timer
+    EVENT_HLFB_M2,          ///< M-2 HLFB edges to its capture timer
+    EVENT_HLFB_M3,          ///< M-3 HLFB edges to its capture timer
+    EVENT_ADC_CAPTURE,      ///< Capture timer overflows to ADC1 starts
+    EVENT_ADC_TRIGGER,      ///< Input edge to the capture timer start
+    EVENT_INPUT_COUNTER,    ///< Counter or step input edges to TCC2
+    EVENT_ESTOP,            ///< E-stop input level to the TCC0 fault input
+    EVENT_INPUT_STEP_DIR,   ///< Step input direction level to TCC2
+    EVENT_CHANNEL_COUNT,    ///< The first channel ChannelAllocate() hands out
+} EventChannels;
+
+/// Returned by ChannelAllocate() when no channel is free
+#define EVENT_CHANNEL_NONE 0xFF
+
+/**
+    \class EventManager
+    \brief ClearCore Event System (EVSYS) channel manager.
+
+    An event channel carries the events of one generator, such as an input
+    edge (EVSYS_ID_GEN_EIC_EXTINT_0 + n) or a timer overflow
+    (EVSYS_ID_GEN_TCC0_OVF), to any number of users, such as an ADC start
+    (EVSYS_ID_USER_ADC0_START) or a timer's event input
+    (EVSYS_ID_USER_TC0_EVU). The user acts in hardware within a few clocks
+    of the event, with no interrupt and no jitter from whatever the CPU is
+    doing.
+
+    The library's own routes use the fixed #EventChannels. An application
+    claims a channel with ChannelAllocate(), routes a generator to it with
+    Route(), and attaches users with UserAdd(). The user peripheral must
+    also be set up to act on events in its own EVCTRL register. Input edges
+    are most easily routed with InputManager::EventRoute(), which also
+    enables the input's event output.
+
+    Only channels 0 to 11 can take the synchronous and resynchronized paths,
+    which pick out edges and which some clocked users, such as a TCC
+    counting events, need. The asynchronous path works on every channel and
+    carries a level as well as an edge.
+
+    A peripheral that only needs to start a DMA transfer doesn't need an
+    event channel: DmaManager::ChannelTrigger() takes its DMA trigger, such
+    as TCC0_DMAC_ID_OVF, directly.
+
+    \code{.cpp}
+    // Start an ADC0 conversion on each overflow of the sample timer
+    uint8_t channel = EventMgr.ChannelAllocate();
+    EventMgr.Route(channel, EVSYS_ID_GEN_TCC0_OVF);
+    EventMgr.UserAdd(channel, EVSYS_ID_USER_ADC0_START);
+    \endcode
+**/
+class EventManager {
+public:
+    /**
+        \enum EventPaths
+        \brief How a channel carries its events.
+    **/
+    typedef enum {
+        /// Synchronized to the channel's clock; the generator and user
+        /// must share it
+        EVENT_PATH_SYNCHRONOUS,
+        /// Resynchronized to the channel's clock from the generator's
+        EVENT_PATH_RESYNCHRONIZED,
+        /// Passed straight through, edges and levels alike
+        EVENT_PATH_ASYNCHRONOUS,
+    } EventPaths;
+
+    /**
+        \enum EventEdges
+        \brief Which edges of the generator's signal make an event on the
+        synchronous and resynchronized paths.
+    **/
+    typedef enum {
+        EVENT_EDGE_NONE,        ///< No events
+        EVENT_EDGE_RISING,      ///< Rising edges
+        EVENT_EDGE_FALLING,     ///< Falling edges
+        EVENT_EDGE_BOTH,        ///< Both edges
+    } EventEdges;
+
+#ifndef HIDE_FROM_DOXYGEN
+    /**
+        Public accessor for singleton instance
+    **/
+    static EventManager &Instance();
+#endif
+
+    /**
+        \brief Claim a channel that none of the fixed #EventChannels use.
+
+        \param[in] clocked True for a channel that can take the synchronous
+        and resynchronized paths; these are scarce, so ask only if needed.
+
+        \return The channel number, or #EVENT_CHANNEL_NONE if none is free.
+    **/
+    uint8_t ChannelAllocate(bool clocked = false);
+
+    /**
+        \brief Stop a claimed channel, detach its users, and give it back.
+    **/
+    void ChannelFree(uint8_t channel);
+
+    /**
+        \brief Route a generator to a channel, replacing its last one.
+
+        \param[in] channel A channel from ChannelAllocate() or one of the
+        #EventChannels.
+        \param[in] generator The event generator, an EVSYS_ID_GEN_* value,
+        or 0 to stop the channel.
+        \param[in] path How the channel carries events.
+        \param[in] edge The edges that make events, unless the path is
+        asynchronous.
+
+        \return True if the channel was set up; false if the channel is out
+        of range or can't take the path.
+    **/
+    bool Route(uint8_t channel, uint8_t generator,
+               EventPaths path = EVENT_PATH_ASYNCHRONOUS,
+               EventEdges edge = EVENT_EDGE_RISING);
+
+    /**
+        \brief Attach a user to a channel, detaching it from any other.
+
+        \param[in] channel The channel.
+        \param[in] user The event user, an EVSYS_ID_USER_* value.
+
+        \return True if the channel and user are valid.
+    **/
+    bool UserAdd(uint8_t channel, uint8_t user);
+
+    /**
+        \brief Detach a user from its channel.
+
+        \param[in] user The event user, an EVSYS_ID_USER_* value.
+    **/
+    void UserRemove(uint8_t user);
+
+    /**
+        \brief Raise an event on a channel from software, as if the
+        generator had.
+
+        \return True if the channel is valid.
+    **/
+    bool Trigger(uint8_t channel);
+
+private:
+    // The claimed channels, one bit per channel
+    volatile uint32_t m_allocated;
+
+    /**
+        Construct
+    **/
+    EventManager() : m_allocated(0) {}
+
+    uint8_t ChannelFind(uint8_t first, uint8_t last);
+}; // EventManager
+
+} // ClearCore namespace
+
+#endif // __EVENTMANAGER_H__
@@ -0,0 +1,424 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    \file FatFileSystem.h
+    \brief ClearCore FAT32 file system on the SD card.
+
+    Reads and writes files on a FAT32 formatted micro SD card through the
+    SdCardDriver block driver.
+**/
+
+#ifndef __FATFILESYSTEM_H__
+#define __FATFILESYSTEM_H__
+
+#include <stdint.h>
+#include "SdCardDriver.h"
+
+namespace ClearCore {
+
+/// The number of card sectors the file system keeps in RAM
+#ifndef SD_FAT_CACHE_SECTORS
+#define SD_FAT_CACHE_SECTORS 2
+#endif
+
+class FatFile;
+
+/**
+    \class FatFileSystem
+    \brief ClearCore FAT32 file system on the SD card.
+
+    Mount() brings up the card and finds a FAT32 volume, either in one of the
+    partitions of the card's partition table or filling the whole card. Files
+    are named with 8.3 names, such as "LOG/RUN1.CSV"; names are not case
+    sensitive, and long file names are neither read nor created. Files may be
+    opened in existing directories, but directories are not created.
+
+    Directory and FAT sectors, as well as the partial sectors at either end of
+    a file access, are kept in a small write-back cache of
+    #SD_FAT_CACHE_SECTORS sectors. Reads and writes that cover whole sectors
+    of a file go straight between the caller's buffer and the card with the
+    card's multi-block commands, so large transfers are not copied through the
+    cache. Changes reach the card when a file is synced or closed.
+
+    \code{.cpp}
+    FatFile log;
+    if (FileSys.Mount() &&
+            FileSys.Open(log, "RUNLOG.CSV", FatFileSystem::FILE_APPEND)) {
+        const char line[] = "1,OK\n";
+        log.Write(reinterpret_cast<const uint8_t *>(line), sizeof(line) - 1);
+        log.Close();
+    }
+    \endcode
+
+    \note The file system is not safe to use from interrupt handlers.
+**/
+class FatFileSystem {
+    friend class FatFile;
+
+public:
+    /**
+        \enum OpenMode
+        \brief How Open() opens a file.
+    **/
+    typedef enum {
+        /// Read an existing file
+        FILE_READ,
+        /// Create the file, or empty an existing one, and write it
+        FILE_WRITE,
+        /// Create the file if needed, and write at its end
+        FILE_APPEND,
+    } OpenMode;
+
+#ifndef HIDE_FROM_DOXYGEN
+    /**
+        Public accessor for singleton instance.
+    **/
+    static FatFileSystem &Instance();
+#endif
+
+    /**
+        \brief Bring up the card and find its FAT32 volume.
+
+        Call again after a card is inserted or swapped. Files open on the
+        previous card must not be used afterwards.
+
+        \return True if a FAT32 volume was found.
+    **/
+    bool Mount();
+
+    /**
+        \brief Check whether a volume is mounted.
+
+        \return True if Mount() succeeded.
+    **/
+    bool Mounted() {
+        return m_mounted;
+    }
+
+    /**
+        \brief Open a file.
+
+        \code{.cpp}
+        FatFile recipe;
+        if (!FileSys.Open(recipe, "RECIPES/PART7.BIN")) {
+            // No such file
+        }
+        \endcode
+
+        \param[out] file The file object to open; it must not already be open.
+        \param[in] path The path of the file, from the root directory.
+        \param[in] mode How to open the file.
+
+        \return True if the file is open.
+    **/
+    bool Open(FatFile &file, const char *path, OpenMode mode = FILE_READ);
+
+    /**
+        \brief Check whether a file or directory exists.
+
+        \param[in] path The path to check.
+
+        \return True if the path names a file or directory.
+    **/
+    bool Exists(const char *path);
+
+    /**
+        \brief Delete a file.
+
+        The file must not be open.
+
+        \param[in] path The path of the file.
+
+        \return True if the file was deleted.
+    **/
+    bool Remove(const char *path);
+
+    /**
+        \brief Write the cached changes to the card.
+
+        Open files are not synced; see FatFile::Sync().
+
+        \return True if every change was written.
+    **/
+    bool Sync();
+
+private:
+    typedef enum {
+        DIR_FOUND,
+        DIR_NOT_FOUND,
+        DIR_ERROR,
+    } DirResult;
+
+    struct CacheEntry {
+        uint32_t Sector;
+        uint32_t LastUse;
+        bool Valid;
+        bool Dirty;
+        uint8_t Data[SD_BLOCK_SIZE];
+    };
+
+    CacheEntry m_cache[SD_FAT_CACHE_SECTORS];
+    uint32_t m_cacheClock;
+    bool m_mounted;
+
+    // Volume geometry, in sectors
+    uint32_t m_fatStart;
+    uint32_t m_fatSize;
+    uint8_t m_fatCount;
+    uint8_t m_sectorsPerCluster;
+    uint32_t m_dataStart;
+    uint32_t m_clusterCount;
+    uint32_t m_rootCluster;
+    uint32_t m_fsInfoSector;
+    // Where to start looking for a free cluster
+    uint32_t m_freeHint;
+    bool m_fsInfoDirty;
+
+    /**
+        Construct
+    **/
+    FatFileSystem();
+
+    /**
+        Find the volume's boot sector and read its geometry.
+    **/
+    bool VolumeRead(uint32_t sector);
+
+    /**
+        Get a sector from the cache, loading it from the card if \a load is
+        set. Setting \a dirty marks the sector to be written back.
+
+        \return The sector's data, or NULL on a card error. The pointer is
+        only good until the next cache access.
+    **/
+    uint8_t *CacheGet(uint32_t sector, bool load, bool dirty);
+
+    /**
+        Write a dirty cache entry back to the card.
+    **/
+    bool CacheFlush(CacheEntry &entry);
+
+    /**
+        Read or write whole sectors straight to the card, keeping the cache
+        coherent.
+    **/
+    bool SectorsRead(uint32_t sector, uint8_t *data, uint32_t count);
+    bool SectorsWrite(uint32_t sector, const uint8_t *data, uint32_t count);
+
+    uint32_t ClusterSector(uint32_t cluster) {
+        return m_dataStart + (cluster - 2) * m_sectorsPerCluster;
+    }
+
+    uint32_t ClusterBytes() {
+        return m_sectorsPerCluster * SD_BLOCK_SIZE;
+    }
+
+    bool ClusterValid(uint32_t cluster) {
+        return cluster >= 2 && cluster < m_clusterCount + 2;
+    }
+
+    /**
+        Read or write a cluster's FAT entry.
+    **/
+    bool FatGet(uint32_t cluster, uint32_t &value);
+    bool FatSet(uint32_t cluster, uint32_t value);
+
+    /**
+        Claim a free cluster and link it after \a prev, if \a prev is not 0.
+    **/
+    bool ClusterAllocate(uint32_t prev, uint32_t &cluster);
+
+    /**
+        Fill a cluster with zeros.
+    **/
+    bool ClusterZero(uint32_t cluster);
+
+    /**
+        Free a cluster chain.
+    **/
+    bool ChainFree(uint32_t cluster);
+
+    /**
+        Find the directory entry named \a name, or a free entry if \a name is
+        NULL. On return \a cluster holds the last cluster searched.
+    **/
+    DirResult DirFind(uint32_t &cluster, const uint8_t *name,
+                      uint32_t &sector, uint8_t &index);
+
+    /**
+        Add an empty file entry to a directory.
+    **/
+    bool DirEntryAdd(uint32_t dirCluster, const uint8_t *name,
+                     uint32_t &sector, uint8_t &index);
+
+    /**
+        Find the directory entry for a path.
+    **/
+    DirResult PathFind(const char *path, uint8_t *name, uint32_t &dirCluster,
+                       uint32_t &sector, uint8_t &index);
+}; // FatFileSystem
+
+/**
+    \class FatFile
+    \brief A file on the FatFileSystem.
+
+    Opened with FatFileSystem::Open(). A file opened for writing must be
+    closed, or synced, for its new contents to be found after a power loss or
+    card removal.
+
+    \code{.cpp}
+    FatFile file;
+    uint8_t buffer[2048];
+    if (FileSys.Open(file, "DATA.BIN")) {
+        int32_t count = file.Read(buffer, sizeof(buffer));
+        file.Close();
+    }
+    \endcode
+**/
+class FatFile {
+    friend class FatFileSystem;
+
+public:
+    /**
+        \brief Construct a closed file.
+    **/
+    FatFile();
+
+    /**
+        \brief Check whether the file is open.
+    **/
+    bool IsOpen() {
+        return m_open;
+    }
+
+    /**
+        \brief Read from the current position.
+
+        \param[out] data Where to put the data.
+        \param[in] length The number of bytes to read.
+
+        \return The number of bytes read, which is less than \a length at the
+        end of the file or on a card error, or -1 if the file is not open.
+    **/
+    int32_t Read(uint8_t *data, uint32_t length);
+
+    /**
+        \brief Write at the current position, extending the file as needed.
+
+        \param[in] data The data to write.
+        \param[in] length The number of bytes to write.
+
+        \return The number of bytes written, which is less than \a length if
+        the card is full or failed, or -1 if the file is not open for writing.
+    **/
+    int32_t Write(const uint8_t *data, uint32_t length);
+
+    /**
+        \brief Move the current position.
+
+        \param[in] position The new position, no further than the end of the
+        file.
+
+        \return True if the position was moved.
+    **/
+    bool Seek(uint32_t position);
+
+    /**
+        \brief The current position, in bytes from the start of the file.
+    **/
+    uint32_t Position() {
+        return m_position;
+    }
+
+    /**
+        \brief The length of the file, in bytes.
+    **/
+    uint32_t Size() {
+        return m_size;
+    }
+
+    /**
+        \brief Claim the clusters for a file of \a length bytes in advance.
+
+        Writes within the reserved length then do not need to allocate
+        clusters or update the FAT. Clusters are claimed in order from the
+        free space, so the reservation is contiguous on a card with
+        unfragmented free space. Close() frees the reserved clusters that
+        were not written.
+
+        \code{.cpp}
+        // Make room for a 16 MB log
+        log.Reserve(16UL << 20);
+        \endcode
+
+        \param[in] length The number of bytes to reserve.
+
+        \return True if the clusters were claimed.
+    **/
+    bool Reserve(uint32_t length);
+
+    /**
+        \brief Write the file's changes to the card.
+
+        \return True if every change was written.
+    **/
+    bool Sync();
+
+    /**
+        \brief Sync and close the file, freeing any reserved clusters past its
+        end.
+
+        \return True if every change was written.
+    **/
+    bool Close();
+
+private:
+    bool m_open;
+    bool m_writable;
+    // The directory entry needs updating
+    bool m_dirty;
+    uint32_t m_firstCluster;
+    uint32_t m_size;
+    uint32_t m_position;
+    // The most recently visited cluster and its place in the chain
+    uint32_t m_cluster;
+    uint32_t m_clusterIndex;
+    // Location of the file's directory entry
+    uint32_t m_dirSector;
+    uint8_t m_dirIndex;
+
+    /**
+        Find the cluster holding the \a index'th cluster of the file,
+        extending the chain if \a allocate is set.
+    **/
+    bool ClusterSeek(uint32_t index, bool allocate);
+
+    /**
+        Free the clusters of the chain past the end of the file.
+    **/
+    bool ChainTrim();
+}; // FatFile
+
+} // ClearCore namespace
+
+#endif // __FATFILESYSTEM_H__
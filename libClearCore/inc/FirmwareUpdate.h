@@ -0,0 +1,232 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    \file FirmwareUpdate.h
+    \brief ClearCore firmware update over Ethernet.
+
+    Streams a new application image into the inactive flash bank while the
+    running application carries on, then swaps banks with a single reset.
+**/
+
+#ifndef __FIRMWAREUPDATE_H__
+#define __FIRMWAREUPDATE_H__
+
+#include <stdint.h>
+#include <sam.h>
+#include "EthernetTcpClient.h"
+#include "EthernetTcpServer.h"
+
+namespace ClearCore {
+
+/// The local port a FirmwareUpdate server listens on
+#ifndef FIRMWARE_UPDATE_PORT
+#define FIRMWARE_UPDATE_PORT 8267
+#endif
+
+/// The first word of an update header, "CCFW" sent little-endian
+#define FIRMWARE_UPDATE_MAGIC 0x57464343
+
+/// The flash offset of the application, after the 16 KB bootloader
+#define FIRMWARE_UPDATE_APP_OFFSET 0x4000
+
+/// The time an update may go without data before it is abandoned, in ms
+#ifndef FIRMWARE_UPDATE_TIMEOUT_MS
+#define FIRMWARE_UPDATE_TIMEOUT_MS 10000
+#endif
+
+/**
+    \class FirmwareUpdate
+    \brief ClearCore firmware update over Ethernet.
+
+    The SAM E53 flash is two banks, and the bank in the upper half of flash
+    can be erased and written while code runs from the lower one. An update
+    client connects, sends a 12-byte header of three little-endian words
+    (#FIRMWARE_UPDATE_MAGIC, the image length, and the CRC-32 of the image),
+    then the image: the same binary that is flashed over USB, linked to run
+    at #FIRMWARE_UPDATE_APP_OFFSET. When the image is in, the server replies
+    with a single #UpdateErrors byte and closes the connection.
+
+    The running bootloader is copied into the inactive bank ahead of the
+    image, and each page is read back into the CRC as it is written, so a
+    corrupt image or a failed write is caught before anything runs it. Each
+    call to Poll() writes at most one 512-byte page, so the main loop keeps
+    running throughout.
+
+    Apply() then copies the key/value store across and swaps the banks; the
+    new firmware starts from the reset that follows. The running firmware
+    stays in the other bank, and can be restored with another update.
+
+    The image must fit in a bank below the key/value store, and the running
+    image must too: an update is refused if the running firmware reaches
+    into the upper bank.
+
+    \code{.cpp}
+    FirmwareUpdate Updater;
+
+    int main() {
+        EthernetMgr.Setup();
+        Updater.Begin();
+        while (true) {
+            Updater.Poll();
+            // Restart into the new firmware once the motors are idle
+            if (Updater.State() == FirmwareUpdate::UPDATE_READY &&
+                    ConnectorM0.StepsComplete()) {
+                Updater.Apply();
+            }
+        }
+    }
+    \endcode
+**/
+class FirmwareUpdate {
+public:
+    /**
+        \enum UpdateStates
+        \brief The progress of an update.
+    **/
+    typedef enum {
+        /// No update has been received
+        UPDATE_IDLE,
+        /// An image is being received and written
+        UPDATE_RECEIVING,
+        /// A verified image is waiting for Apply()
+        UPDATE_READY,
+        /// The last update failed; see Error()
+        UPDATE_FAILED,
+    } UpdateStates;
+
+    /**
+        \enum UpdateErrors
+        \brief Why an update failed, as also sent to the client.
+    **/
+    typedef enum {
+        /// The update succeeded
+        UPDATE_ERROR_NONE,
+        /// The header did not start with #FIRMWARE_UPDATE_MAGIC
+        UPDATE_ERROR_HEADER,
+        /// The image is empty or does not fit in a bank
+        UPDATE_ERROR_SIZE,
+        /// The running firmware reaches into the inactive bank
+        UPDATE_ERROR_UNSUPPORTED,
+        /// A flash erase or write failed
+        UPDATE_ERROR_FLASH,
+        /// The written image does not match the header's CRC-32
+        UPDATE_ERROR_CRC,
+        /// The client closed the connection before the image was in
+        UPDATE_ERROR_CONNECTION,
+        /// No data arrived for #FIRMWARE_UPDATE_TIMEOUT_MS
+        UPDATE_ERROR_TIMEOUT,
+    } UpdateErrors;
+
+    /**
+        \brief Construct a firmware update server.
+
+        \param[in] port The local port to listen on.
+    **/
+    explicit FirmwareUpdate(uint16_t port = FIRMWARE_UPDATE_PORT);
+
+    /**
+        \brief Start listening for update clients.
+
+        Call after EthernetMgr.Setup().
+    **/
+    void Begin();
+
+    /**
+        \brief Accept an update client and write the data it has sent.
+
+        Call repeatedly from the main loop. A new update replaces one waiting
+        for Apply(); clients arriving during an update are turned away.
+    **/
+    void Poll();
+
+    /**
+        \brief Swap to the received firmware.
+
+        Copies the key/value store into the running bank, swaps the banks,
+        and resets. Stop anything that must not be cut off first.
+
+        \return False if no verified update is ready or the key/value store
+        could not be copied; otherwise this does not return.
+    **/
+    bool Apply();
+
+    /**
+        \brief The progress of the current or last update.
+    **/
+    UpdateStates State() {
+        return m_state;
+    }
+
+    /**
+        \brief Why the last update failed.
+    **/
+    UpdateErrors Error() {
+        return m_error;
+    }
+
+    /**
+        \brief The image bytes received so far by the current or last update.
+    **/
+    uint32_t BytesReceived() {
+        return m_received;
+    }
+
+    /**
+        \brief The image length given by the current or last update header.
+    **/
+    uint32_t ImageLength() {
+        return m_length;
+    }
+
+    /**
+        \brief The largest image an update can hold.
+    **/
+    static uint32_t ImageCapacity();
+
+private:
+    EthernetTcpServer m_server;
+    EthernetTcpClient m_client;
+
+    UpdateStates m_state;
+    UpdateErrors m_error;
+    bool m_headerDone;
+    uint32_t m_length;
+    uint32_t m_crcExpected;
+    uint32_t m_crc;
+    uint32_t m_received;
+    // The bank offset of the page being filled
+    uint32_t m_offset;
+    uint16_t m_pageFill;
+    uint32_t m_lastDataMs;
+    uint32_t m_page[NVMCTRL_PAGE_SIZE / sizeof(uint32_t)];
+
+    void ClientAccept();
+    void Receive();
+    bool HeaderRead();
+    bool PageFlush(uint16_t imageBytes);
+    void Finish(UpdateErrors error);
+}; // FirmwareUpdate
+
+} // ClearCore namespace
+
+#endif // __FIRMWAREUPDATE_H__
@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    \file HttpServer.h
+    \brief ClearCore HTTP/1.1 server.
+
+    Serves GET requests from several keep-alive clients at once, streaming
+    each response body from a generator function.
+**/
+
+#ifndef __HTTPSERVER_H__
+#define __HTTPSERVER_H__
+
+#include <stdint.h>
+#include "EthernetTcpClient.h"
+#include "EthernetTcpServer.h"
+
+namespace ClearCore {
+
+/// The HTTP port
+#define HTTP_PORT 80
+
+/// The most clients an HttpServer serves at once. Each takes a TCP PCB, so
+/// keep this below MEMP_NUM_TCP_PCB.
+#ifndef HTTP_CLIENTS_MAX
+#define HTTP_CLIENTS_MAX 4
+#endif
+
+/// The longest request header accepted, in bytes
+#ifndef HTTP_REQUEST_MAX
+#define HTTP_REQUEST_MAX 512
+#endif
+
+/// The most body bytes asked of a generator at once
+#ifndef HTTP_CHUNK_MAX
+#define HTTP_CHUNK_MAX 512
+#endif
+
+/// How long an idle keep-alive connection stays open, in milliseconds
+#ifndef HTTP_KEEPALIVE_TIMEOUT_MS
+#define HTTP_KEEPALIVE_TIMEOUT_MS 10000
+#endif
+
+/**
+    \class HttpServer
+    \brief ClearCore HTTP/1.1 server.
+
+    Answers GET and HEAD requests for a table of routes. Each route's body
+    comes from a generator function that the server calls for one chunk at a
+    time, only when the TCP send buffer has room for it. The chunk is copied
+    straight into the TCP send queue and sent with chunked transfer encoding,
+    so a page is never held whole in RAM and its length need not be known up
+    front.
+
+    Up to #HTTP_CLIENTS_MAX connections are served at once and are kept open
+    between requests unless the client asks otherwise. Each call to Poll()
+    sends at most one chunk to each client, so a long response can't hold up
+    the main loop or the other clients.
+
+    \code{.cpp}
+    uint16_t HelloBody(char *buffer, uint16_t size, uint32_t &cursor) {
+        static const char text[] = "Hello from ClearCore";
+        uint16_t length = 0;
+        while (length < size && text[cursor]) {
+            buffer[length++] = text[cursor++];
+        }
+        return length;
+    }
+
+    const HttpServer::Route Routes[] = {
+        {"/", "text/plain", HelloBody},
+        {"/status", "application/json", HttpServer::StatusJson},
+    };
+
+    HttpServer Http;
+
+    int main() {
+        EthernetMgr.Setup();
+        Http.Begin(Routes, 2);
+        while (true) {
+            Http.Poll();
+        }
+    }
+    \endcode
+**/
+class HttpServer {
+
+public:
+    /**
+        \brief Writes the next part of a response body.
+
+        \param[out] buffer Where to write the body.
+        \param[in] size The most bytes to write, at most #HTTP_CHUNK_MAX.
+        \param[in,out] cursor Zero on the first call for a response; keeps the
+        generator's position between calls.
+
+        \return The number of bytes written. Returning 0 ends the body.
+    **/
+    typedef uint16_t (*BodyGenerator)(char *buffer, uint16_t size,
+                                      uint32_t &cursor);
+
+    /**
+        \brief A path the server answers.
+    **/
+    typedef struct {
+        /// The path, which must match the request exactly; any query string
+        /// is ignored
+        const char *Path;
+        /// The Content-Type of the response
+        const char *ContentType;
+        /// The generator of the response body
+        BodyGenerator Body;
+    } Route;
+
+    /**
+        \brief Construct an HTTP server.
+
+        \param[in] port The local port to listen on.
+    **/
+    explicit HttpServer(uint16_t port = HTTP_PORT);
+
+    /**
+        \brief Start listening for clients.
+
+        Call after EthernetMgr.Setup(). The route table is used in place, so
+        it must stay valid while the server runs.
+
+        \param[in] routes The route table.
+        \param[in] routeCount The number of entries in the table.
+    **/
+    void Begin(const Route *routes, uint8_t routeCount);
+
+    /**
+        \brief Accept new clients, read their requests, and send the next
+        parts of their responses.
+
+        Call repeatedly from the main loop.
+    **/
+    void Poll();
+
+    /**
+        \brief The number of connected clients.
+    **/
+    uint8_t ClientCount();
+
+    /**
+        \brief A generator for a JSON snapshot of the board.
+
+        Writes the status register, the real-time state of the connectors,
+        and the uptime:
+        <tt>{"status":0,"inputs":4096,"uptimeMs":12345}</tt>
+    **/
+    static uint16_t StatusJson(char *buffer, uint16_t size,
+                               uint32_t &cursor);
+
+private:
+    struct Connection {
+        EthernetTcpClient Client;
+        // The route being sent; null between requests
+        const Route *Sending;
+        // The generator's position in the body
+        uint32_t Cursor;
+        // Close once the response is sent
+        bool Close;
+        uint32_t LastActivityMs;
+    };
+
+    EthernetTcpServer m_server;
+    Connection m_connections[HTTP_CLIENTS_MAX];
+    const Route *m_routes;
+    uint8_t m_routeCount;
+    // Shared by all clients; each request and chunk is finished with before
+    // the next is read or generated
+    char m_request[HTTP_REQUEST_MAX + 1];
+    char m_chunk[HTTP_CHUNK_MAX + 7];
+
+    void ClientAccept();
+    void RequestProcess(Connection &connection);
+    void ResponseContinue(Connection &connection);
+    void ResponseError(Connection &connection, const char *status);
+}; // HttpServer
+
+} // ClearCore namespace
+
+#endif // __HTTPSERVER_H__
@@ -35,6 +35,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "NumberFormat.h"
 
 namespace ClearCore {
 /**
@@ -154,6 +155,40 @@ public:
     **/
     virtual bool SendChar(uint8_t charToSend) = 0;
 
+    /**
+        \brief Copy the characters waiting in the receive buffer into an
+        array.
+
+        Does not wait for characters to arrive.
+
+        \code{.cpp}
+        uint8_t packet[32];
+        int32_t count = ConnectorCOM1.ReadBlock(packet, sizeof(packet));
+        \endcode
+
+        \param[out] buffer The array to fill
+        \param[in] length The most characters to copy
+        \return The number of characters copied
+    **/
+    virtual int32_t ReadBlock(uint8_t *buffer, size_t length) = 0;
+
+    /**
+        \brief Copy an array of characters into the transmit buffer.
+
+        Copies as many characters as there is room for without waiting.
+
+        \code{.cpp}
+        uint8_t packet[] = {0x01, 0x03, 0x00, 0x10};
+        int32_t count = ConnectorCOM1.WriteBlock(packet, sizeof(packet));
+        \endcode
+
+        \param[in] buffer The characters to send
+        \param[in] length The number of characters in \a buffer
+        \return The number of characters queued, or -1 if the port cannot
+        send
+    **/
+    virtual int32_t WriteBlock(const uint8_t *buffer, size_t length) = 0;
+
     /**
         \brief Send carriage return and newline characters.
 
@@ -168,13 +203,26 @@ public:
 
         \param[in] buffer The array of characters to be sent
         \param[in] bufferSize The number of characters to be sent
-        \return success
+        \return success; false if SendChar() would not wait for room and
+        only some of the characters were queued
     **/
     bool Send(const char *buffer, size_t bufferSize) {
-        for (size_t iChar = 0; iChar < bufferSize; iChar++) {
-            if (!SendChar(buffer[iChar])) {
+        const uint8_t *data = reinterpret_cast<const uint8_t *>(buffer);
+        while (bufferSize) {
+            int32_t count = WriteBlock(data, bufferSize);
+            if (count < 0) {
                 return false;
             }
+            if (!count) {
+                // The transmit buffer is full; wait for room as SendChar()
+                // does, or give up if it doesn't
+                if (!SendChar(*data)) {
+                    return false;
+                }
+                count = 1;
+            }
+            data += count;
+            bufferSize -= count;
         }
         return true;
     }
@@ -239,13 +287,12 @@ public:
         \param[in] number The double precision float value to be printed.
         \param[in] precision (optional) The number of digits to print after the
         decimal point. Default: 2.
-        \note The string representation is capped at 20 characters.
+        \note The string representation is capped at 31 characters.
         \return success
     **/
     bool Send(double number, uint8_t precision = 2) {
-        char buffer[20];
-        snprintf(buffer, sizeof(buffer), "%.*f", precision, number);
-        return Send(buffer);
+        char buffer[FORMAT_FLOAT_BUFFER_SIZE];
+        return Send(buffer, FormatFloat(buffer, number, precision));
     }
 
     /**
@@ -255,11 +302,13 @@ public:
         \param[in] number The double precision float value to be printed.
         \param[in] precision (optional) The number of digits to print after the
         decimal point. Default: 2.
-        \note The string representation is capped at 20 characters.
+        \note The string representation is capped at 31 characters.
         \return success
     **/
     bool SendLine(double number, uint8_t precision = 2) {
-        return Send(number, precision) && SendLine();
+        char buffer[FORMAT_FLOAT_BUFFER_SIZE + 2];
+        uint8_t length = FormatFloat(buffer, number, precision);
+        return SendLineEnd(buffer, length);
     }
 
     /**
@@ -375,10 +424,8 @@ public:
             // Only support bases 2 through 16.
             return false;
         }
-        char strRep[2 + 8 * sizeof(number)];
-        itoa(number, strRep, radix);
-        Send((const char *)strRep);
-        return true;
+        char strRep[FORMAT_INT_BUFFER_SIZE];
+        return Send(strRep, FormatInt(strRep, number, radix));
     }
 
     /**
@@ -391,7 +438,12 @@ public:
         \return success
     **/
     bool SendLine(int32_t number, uint8_t radix = 10) {
-        return Send(number, radix) && SendLine();
+        if (radix < 2 || radix > 16) {
+            // Only support bases 2 through 16.
+            return false;
+        }
+        char strRep[FORMAT_INT_BUFFER_SIZE + 2];
+        return SendLineEnd(strRep, FormatInt(strRep, number, radix));
     }
 
     /**
@@ -407,10 +459,8 @@ public:
             // Only support bases 2 through 16.
             return false;
         }
-        char strRep[1 + 8 * sizeof(number)];
-        utoa(number, strRep, radix);
-        Send((const char *)strRep);
-        return true;
+        char strRep[FORMAT_INT_BUFFER_SIZE];
+        return Send(strRep, FormatUint(strRep, number, radix));
     }
 
     /**
@@ -423,7 +473,12 @@ public:
         \return success
     **/
     bool SendLine(uint32_t number, uint8_t radix = 10) {
-        return Send(number, radix) && SendLine();
+        if (radix < 2 || radix > 16) {
+            // Only support bases 2 through 16.
+            return false;
+        }
+        char strRep[FORMAT_INT_BUFFER_SIZE + 2];
+        return SendLineEnd(strRep, FormatUint(strRep, number, radix));
     }
 
     /**
@@ -545,6 +600,16 @@ public:
     **/
     virtual bool CharSize(uint8_t size) = 0;
 
+private:
+    /**
+        Terminate formatted text with carriage return and newline and send
+        it with one write. \a buffer must have room for two more characters.
+    **/
+    bool SendLineEnd(char *buffer, uint8_t length) {
+        buffer[length++] = '\r';
+        buffer[length++] = '\n';
+        return Send(buffer, length);
+    }
 };
 
 } // ClearCore namespace
@@ -24,6 +24,7 @@
 #define __IIRFILTER_H__
 
 #include <math.h>
+#include <sam.h>
 #include "SysTiming.h"
 
 #ifndef HIDE_FROM_DOXYGEN
@@ -77,12 +78,11 @@ public:
     };
 
     void TcSamples(uint16_t riseSamples99pct) {
-        float tcTemp = powf(.01, 1. / riseSamples99pct) * 32768 + 0.5;
-        m_tc = (tcTemp < INT16_MAX) ? tcTemp : INT16_MAX;
+        m_tc = TcFromSamples(riseSamples99pct);
     }
 
     uint16_t TcSamples() {
-        return logf(0.01) / logf(m_tc / 32768.);
+        return SamplesFromTc(m_tc);
     }
 
     uint16_t Tc_ms() {
@@ -98,11 +98,95 @@ public:
         m_z = (newSetting << 16);
     }
 
+    // The TC that reaches 99% of a step in this many samples
+    static uint16_t TcFromSamples(uint16_t riseSamples99pct) {
+        float tcTemp = powf(.01, 1. / riseSamples99pct) * 32768 + 0.5;
+        return (tcTemp < INT16_MAX) ? tcTemp : INT16_MAX;
+    }
+
+    // The samples this TC takes to reach 99% of a step
+    static uint16_t SamplesFromTc(uint16_t tc) {
+        return logf(0.01) / logf(tc / 32768.);
+    }
+
 private:
     uint16_t m_tc; // Filter time constant (positive)
     int32_t m_z;  // "Z" output/accumulator
 };
 
+//*****************************************************************************
+// NAME                                                                       *
+//  Iir16Bank class
+//
+// DESCRIPTION
+///     \brief A bank of \a N Iir16 filters updated together.
+///
+///     The filter constants and accumulators are kept in contiguous arrays so
+///     one pass updates every channel. The update is rearranged as:
+///     output = input + K*(output - input)
+///     which is a single most-significant-word multiply-accumulate per
+///     channel with K held in the upper half-word. The accumulator keeps 31
+///     bits, so inputs must be Q15 (at most INT16_MAX).
+//
+template <uint8_t N>
+class Iir16Bank {
+public:
+    Iir16Bank(void) : m_k(), m_z() {};
+
+    /**
+        Update every filter with its input and store the new outputs.
+    **/
+    void Update(const volatile uint16_t *input, volatile uint16_t *output) {
+        for (uint8_t i = 0; i < N; i++) {
+            int32_t x = static_cast<int32_t>(input[i]) << 16;
+            // (x / 2 + ((z - x) * K << 16) / 2^32) * 2
+            int32_t z = __SMMLA(m_z[i] - x, m_k[i], x >> 1) << 1;
+            m_z[i] = z;
+            output[i] = z >> 16;
+        }
+    }
+
+    /**
+        \return Return the last output of a filter
+    **/
+    uint16_t LastOutput(uint8_t index) {
+        return m_z[index] >> 16;
+    }
+
+    void Tc(uint8_t index, uint16_t newTc) {
+        m_k[index] = static_cast<int32_t>(newTc) << 16;
+    }
+
+    uint16_t Tc(uint8_t index) {
+        return m_k[index] >> 16;
+    }
+
+    void TcSamples(uint8_t index, uint16_t riseSamples99pct) {
+        Tc(index, Iir16::TcFromSamples(riseSamples99pct));
+    }
+
+    uint16_t TcSamples(uint8_t index) {
+        return Iir16::SamplesFromTc(Tc(index));
+    }
+
+    uint16_t Tc_ms(uint8_t index) {
+        return TcSamples(index) / MS_TO_SAMPLES;
+    }
+
+    void Tc_ms(uint8_t index, uint16_t riseMs99pct) {
+        TcSamples(index, riseMs99pct * MS_TO_SAMPLES);
+    }
+
+    // Reset a filter to this level
+    void Reset(uint8_t index, uint16_t newSetting) {
+        m_z[index] = newSetting << 16;
+    }
+
+private:
+    int32_t m_k[N] __attribute__((aligned(8))); // TC << 16
+    int32_t m_z[N] __attribute__((aligned(8))); // "Z" output/accumulators
+};
+
 } // ClearCore namespace
 #endif // HIDE_FROM_DOXYGEN
 #endif // #ifndef __IIRFILTER_H__
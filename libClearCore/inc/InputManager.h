@@ -32,13 +32,48 @@
 #ifndef __INPUTMANAGER_H__
 #define __INPUTMANAGER_H__
 
+#include "EventManager.h"
 #include "PeripheralRoute.h"
+#include "RingBuffer.h"
 #include "SysConnectors.h"
 
 namespace ClearCore {
 
+class Connector;
+
 typedef void (*voidFuncPtr)(void);
 
+/// The number of entries in the InputManager event FIFO; a power of 2
+#ifndef INPUT_EVENT_FIFO_SIZE
+#define INPUT_EVENT_FIFO_SIZE 32
+#endif
+
+/// The maximum number of input change handlers
+#ifndef INPUT_CHANGE_HANDLERS_MAX
+#define INPUT_CHANGE_HANDLERS_MAX 8
+#endif
+
+/// The default gate time of DigitalIn::Frequency(), in milliseconds
+#ifndef INPUT_COUNTER_GATE_MS_DEFAULT
+#define INPUT_COUNTER_GATE_MS_DEFAULT 100
+#endif
+
+/// The default debounce time of DigitalIn::FilterHardware(), in microseconds
+#ifndef INPUT_HW_FILTER_US_DEFAULT
+#define INPUT_HW_FILTER_US_DEFAULT 600
+#endif
+
+/// The bits of the onboard input filter counters, enough for any
+/// DigitalIn::FilterLength()
+#define INPUT_FILTER_BITS 16
+
+/// The onboard inputs filtered together by the InputManager, IO-0 to A-12
+#define INPUT_FILTER_PINS (CLEARCORE_PIN_A12 + 1)
+
+class MotorDriver;
+class PositionCapture;
+class QuadratureDecoder;
+
 /**
     \brief ClearCore input state access.
 
@@ -47,7 +82,12 @@ typedef void (*voidFuncPtr)(void);
 **/
 class InputManager {
     friend class DigitalIn;
+    friend class MotorDriver;
+    friend class PositionCapture;
+    friend class QuadratureDecoder;
+    friend class ReplayManager;
     friend class SerialBase;
+    friend class SysManager;
     friend class TestIO;
 public:
     /**
@@ -64,6 +104,27 @@ public:
         RISING = 4,
     } InterruptTrigger;
 
+    /**
+        \brief An input change recorded in the event FIFO.
+    **/
+    typedef struct {
+        /// The inputs that changed
+        SysConnectorState Mask;
+        /// The new state of the inputs in \a Mask
+        SysConnectorState State;
+        /// The sample tick in which the change was recorded
+        uint32_t Tick;
+        /// The CPU cycle counter when the change was recorded (see CPU_CLK)
+        uint32_t Cycles;
+    } InputEvent;
+
+    /**
+        A function called from ChangeDispatch() with the watched inputs that
+        changed and the current state of all the inputs.
+    **/
+    typedef void (*ChangeHandler)(SysConnectorState changed,
+                                  SysConnectorState state);
+
 #ifndef HIDE_FROM_DOXYGEN
     /**
         Public accessor for singleton instance.
@@ -146,6 +207,126 @@ public:
     **/
     SysConnectorState InputsRT(SysConnectorState mask = UINT32_MAX);
 
+    /**
+        \brief Select the inputs whose filtered changes are recorded in the
+        event FIFO.
+
+        Unlike InputsRisen() and InputsFallen(), which merge every edge
+        between reads, the FIFO keeps one entry for each sample in which a
+        selected input changed, so every edge and its sample time survive
+        until EventGet() reads them. For sub-sample timing of inputs with
+        external interrupts, see DigitalIn::EventEdgeTimed().
+
+        \code{.cpp}
+        // Record every change of DI-6 and DI-7
+        SysConnectorState mask;
+        mask.bit.CLEARCORE_PIN_DI6 = 1;
+        mask.bit.CLEARCORE_PIN_DI7 = 1;
+        InputMgr.EventFifoMask(mask);
+        \endcode
+
+        \param[in] mask The inputs to record; 0 (the default) records none.
+    **/
+    void EventFifoMask(SysConnectorState mask) {
+        m_eventMask.reg = mask.reg;
+    }
+
+    /**
+        \brief Read the oldest entry from the event FIFO.
+
+        \code{.cpp}
+        InputManager::InputEvent event;
+        while (InputMgr.EventGet(event)) {
+            if (event.State.bit.CLEARCORE_PIN_DI6) {
+                // A part arrived at the DI-6 sensor in sample event.Tick
+            }
+        }
+        \endcode
+
+        \param[out] event The entry read.
+
+        \return True if an entry was read; false if the FIFO is empty.
+    **/
+    bool EventGet(InputEvent &event);
+
+    /**
+        \brief The number of entries waiting in the event FIFO.
+    **/
+    uint16_t EventCount() {
+        return static_cast<uint16_t>(m_events.Count());
+    }
+
+    /**
+        \brief The number of events dropped because the event FIFO was full
+        since the last EventFifoClear().
+    **/
+    uint32_t EventOverflowCount() {
+        return m_eventOverflows;
+    }
+
+    /**
+        \brief Empty the event FIFO and clear its overflow count.
+    **/
+    void EventFifoClear();
+
+    /**
+        \brief Register a function to call when any of a set of filtered
+        inputs changes.
+
+        The sample update merges every change into a pending mask; the
+        handlers run later, from ChangeDispatch() in the main loop, so they
+        may take as long as they need. Changes that happen between two
+        dispatches are merged, and a handler runs at most once per dispatch.
+        Use the event FIFO (EventFifoMask()) if every edge must be seen.
+
+        \code{.cpp}
+        void SensorsChanged(SysConnectorState changed,
+                            SysConnectorState state) {
+            if (changed.bit.CLEARCORE_PIN_DI6 && state.bit.CLEARCORE_PIN_DI6) {
+                // A part arrived at DI-6
+            }
+        }
+
+        SysConnectorState sensors;
+        sensors.bit.CLEARCORE_PIN_DI6 = 1;
+        sensors.bit.CLEARCORE_PIN_DI7 = 1;
+        InputMgr.ChangeHandlerAdd(sensors, SensorsChanged);
+        \endcode
+
+        \param[in] mask The inputs to watch.
+        \param[in] handler The function to call.
+
+        \return True if the handler was added; false if
+        #INPUT_CHANGE_HANDLERS_MAX handlers are already registered.
+    **/
+    bool ChangeHandlerAdd(SysConnectorState mask, ChangeHandler handler);
+
+    /**
+        \brief Call the handlers of every watched input that changed since the
+        last dispatch.
+
+        Call from the main loop, or from a TaskManager event task given to
+        ChangeTask() so it only runs when there are changes.
+
+        \code{.cpp}
+        int8_t inputTask = TaskMgr.TaskAddEvent(InputDispatch);
+        InputMgr.ChangeTask(inputTask);
+        \endcode
+
+        \return The inputs whose changes were dispatched.
+    **/
+    SysConnectorState ChangeDispatch();
+
+    /**
+        \brief Signal a TaskManager event task whenever a watched input
+        changes.
+
+        \param[in] taskId The task to signal, or #TASK_INVALID to stop.
+    **/
+    void ChangeTask(int8_t taskId) {
+        m_changeTask = taskId;
+    }
+
 #ifndef HIDE_FROM_DOXYGEN
     /**
         \brief Enable or disable the interrupt on a digital input connector with
@@ -196,6 +377,85 @@ public:
         return m_interruptsEnabled;
     }
 
+    /**
+        \brief Set the debounce time of the inputs using
+        DigitalIn::FilterHardware().
+
+        The external interrupt controller debounces with a tick from the
+        32.768 kHz low power clock, divided by a power of 2, and accepts a
+        change after it holds for 3 or 7 ticks. The shortest such time that
+        is at least \a us is used, up to about 55 ms.
+
+        \code{.cpp}
+        // Debounce the hardware-filtered inputs for at least 2 ms
+        InputMgr.HardwareFilterUs(2000);
+        \endcode
+
+        \param[in] us The minimum debounce time, in microseconds.
+        \return The debounce time applied, in microseconds.
+    **/
+    uint32_t HardwareFilterUs(uint32_t us);
+
+    /**
+        \brief The debounce time of the inputs using
+        DigitalIn::FilterHardware(), in microseconds.
+    **/
+    uint32_t HardwareFilterUs() {
+        return m_hwFilterUs;
+    }
+
+    /**
+        \brief Count step and direction pulses from another controller in
+        hardware.
+
+        Each rising edge of \a step is counted by a timer through the event
+        system, up or down by the level of \a direction at the edge, so no
+        interrupt runs per pulse. The count is read once per sample, before
+        the motors update, so a MotorDriver geared to
+        StepInputStepsLastSample() replays the pulses in the same sample.
+
+        This shares its timer with the #INPUT_COUNTER connector mode and
+        IO-0's analog output waveform, so only one of them can run.
+
+        \code{.cpp}
+        // Replay a legacy controller's pulses on M-0, 2 steps per pulse,
+        // smoothed over 4 samples
+        InputMgr.StepInputStart(ConnectorDI7, ConnectorDI8);
+        ConnectorM0.GearingSmoothing(4);
+        ConnectorM0.GearingStart(InputMgr.StepInputStepsLastSample(), 2, 1);
+        \endcode
+
+        \param[in] step The input with the step pulses.
+        \param[in] direction The input with the direction level.
+        \param[in] directionInvert False to count down while \a direction is
+        high, true to count down while it is low.
+        \return True if counting started; false if an input has no external
+        interrupt or the timer is in use.
+    **/
+    bool StepInputStart(Connector &step, Connector &direction,
+                        bool directionInvert = false);
+
+    /**
+        \brief Stop counting step and direction pulses.
+    **/
+    void StepInputStop();
+
+    /**
+        \brief The signed count of step pulses received in the last sample
+        time.
+    **/
+    volatile const int16_t &StepInputStepsLastSample() {
+        return m_stepInputLast;
+    }
+
+    /**
+        \brief The signed count of step pulses received since
+        StepInputStart().
+    **/
+    volatile const int32_t &StepInputPosition() {
+        return m_stepInputPosn;
+    }
+
 #ifndef HIDE_FROM_DOXYGEN
     /**
         \brief Register the interrupt service routine to be triggered when the
@@ -218,6 +478,47 @@ public:
                              bool enable = true,
                              bool oneTime = false);
 
+    /**
+        \brief Route an external interrupt line's edges to the event system
+        so that they can trigger a peripheral directly.
+
+        The line's sense is shared with its interrupt; a handler registered
+        on the same line should use the same trigger.
+
+        \param[in] extInt The external interrupt line number.
+        \param[in] trigger The input state condition that generates events.
+        \param[in] enable True to generate events, false to stop.
+        \return true if the line is valid.
+    **/
+    bool EventOutputSet(int8_t extInt, InterruptTrigger trigger, bool enable);
+
+    /**
+        \brief Make an external interrupt line the generator of an event
+        channel, enabling the line's event output.
+
+        Attach the users with EventManager::UserAdd(). To stop, disable the
+        line's event output with EventOutputSet().
+
+        \code{.cpp}
+        // Start an ADC0 conversion on each rising edge of DI-6
+        uint8_t channel = EventMgr.ChannelAllocate();
+        InputMgr.EventRoute(ConnectorDI6.ExternalInterrupt(),
+                            InputManager::RISING, channel);
+        EventMgr.UserAdd(channel, EVSYS_ID_USER_ADC0_START);
+        \endcode
+
+        \param[in] extInt The external interrupt line number.
+        \param[in] trigger The input state condition that generates events.
+        On the asynchronous path, a level condition carries the input level.
+        \param[in] channel The event channel.
+        \param[in] path How the channel carries the events; the clocked
+        paths take the rising edges of the line's event output.
+        \return true if the line and channel are valid.
+    **/
+    bool EventRoute(int8_t extInt, InterruptTrigger trigger, uint8_t channel,
+                    EventManager::EventPaths path =
+                        EventManager::EVENT_PATH_ASYNCHRONOUS);
+
     /**
         Initialize the InputManager.
     **/
@@ -229,6 +530,12 @@ public:
     **/
     void UpdateBegin();
 
+    /**
+        Step the onboard inputs' filters on this sample's input changes,
+        ahead of the connector refresh.
+    **/
+    void FilterBankUpdate();
+
     /**
         At the end of the sample time, update Rise/Fall registers.
     **/
@@ -264,6 +571,74 @@ private:
     voidFuncPtr m_interruptServiceRoutines[EIC_NUMBER_OF_INTERRUPTS];
     // Bitmask indicating which interrupt handlers disable after triggerring
     uint16_t m_oneTimeFlags;
+    // Position captures latched ahead of each line's callback
+    PositionCapture *m_captures[EIC_NUMBER_OF_INTERRUPTS];
+    // Quadrature decoders counting each line's edges
+    QuadratureDecoder *m_decoders[EIC_NUMBER_OF_INTERRUPTS];
+    // Motors sensing their HLFB edges on each line
+    MotorDriver *m_hlfbEdges[EIC_NUMBER_OF_INTERRUPTS];
+
+    // The event FIFO, read by the main loop. Both the sample update and the
+    // EIC interrupt write it, with interrupts disabled.
+    RingBufferStatic<InputEvent, INPUT_EVENT_FIFO_SIZE> m_events;
+    volatile uint32_t m_eventOverflows;
+    // Inputs recorded each sample
+    SysConnectorState m_eventMask;
+    // Lines recorded at each edge by the interrupt, with their connector bit
+    // and the port pin to read
+    uint16_t m_eventLines;
+    uint32_t m_eventLinePinMask[EIC_NUMBER_OF_INTERRUPTS];
+    volatile uint32_t *m_eventLineIn[EIC_NUMBER_OF_INTERRUPTS];
+    uint32_t m_eventLineInMask[EIC_NUMBER_OF_INTERRUPTS];
+
+    // Change handlers, the union of their masks, and the changes not yet
+    // dispatched
+    ChangeHandler m_changeHandlers[INPUT_CHANGE_HANDLERS_MAX];
+    SysConnectorState m_changeMasks[INPUT_CHANGE_HANDLERS_MAX];
+    volatile uint8_t m_changeHandlerCount;
+    SysConnectorState m_changeWatch;
+    SysConnectorState m_changePending;
+    volatile int8_t m_changeTask;
+
+    // The pulse counter used by INPUT_COUNTER mode. TCC2 counts the line's
+    // events and is extended to 32 bits each sample.
+    int8_t m_counterExtInt;
+    uint16_t m_counterHwLast;
+    volatile uint32_t m_counterCount;
+    uint32_t m_counterGateStart;
+    uint32_t m_counterGateTicks;
+    uint32_t m_counterGateActive;
+    uint32_t m_counterGateTicksLeft;
+    volatile float m_counterFrequency;
+
+    // The step and direction input. The same timer counts the step line's
+    // events, in the direction given by the direction line's level.
+    int8_t m_stepInputExtInt;
+    int8_t m_stepInputDirExtInt;
+    uint16_t m_stepInputHwLast;
+    volatile int16_t m_stepInputLast;
+    volatile int32_t m_stepInputPosn;
+
+    // The hardware-filtered lines and the debounce time applied to them
+    uint16_t m_hwFilterLines;
+    uint32_t m_hwFilterUs;
+    uint32_t m_hwFilterPrescaler;
+
+    // The software filters of the onboard inputs, run as a bank. Each pin's
+    // count down is a column of bits across the planes, bit n for connector
+    // n, so one pass of word operations steps every filter.
+    uint32_t m_filterPins;
+    uint8_t m_filterPinPort[INPUT_FILTER_PINS];
+    uint32_t m_filterPinInMask[INPUT_FILTER_PINS];
+    uint32_t m_filterPortMasks[CLEARCORE_PORT_MAX];
+    uint32_t m_filterLength[INPUT_FILTER_BITS];
+    uint32_t m_filterCount[INPUT_FILTER_BITS];
+    // The used planes, the pins with a nonzero length, the pins counting
+    // down, and the pins whose filtered state is due this sample
+    uint8_t m_filterBits;
+    uint32_t m_filterLengthNonzero;
+    uint32_t m_filterCounting;
+    uint32_t m_filterSettled;
 
 #ifndef HIDE_FROM_DOXYGEN
     /**
@@ -281,6 +656,58 @@ private:
     **/
     uint32_t EicSense(InterruptTrigger trigger);
 
+    /**
+        Append an entry to the event FIFO, or count an overflow if it is full.
+    **/
+    void EventPush(uint32_t mask, uint32_t state);
+
+    /**
+        Start or stop recording a line's edges from its interrupt.
+    **/
+    bool EventLineSet(int8_t extInt, uint32_t pinMask, uint32_t port,
+                      uint32_t inMask, bool enable);
+
+    /**
+        Route a line's rising edges to the pulse counter, or release it.
+    **/
+    bool CounterStart(int8_t extInt);
+    void CounterStop();
+    void CounterReset();
+
+    /**
+        Extend the pulse count and close the frequency gate. Called each
+        sample.
+    **/
+    void CounterUpdate();
+
+    /**
+        Read the step input's count. Called each sample.
+    **/
+    void StepInputUpdate();
+
+    /**
+        Turn the EIC debouncer on or off for a line.
+    **/
+    bool HardwareFilterSet(int8_t extInt, bool enable);
+
+    /**
+        Choose the debounce prescaler for at least \a us microseconds.
+    **/
+    void HardwareFilterSelect(uint32_t us);
+
+    /**
+        Add an onboard input to the filter bank, read from \a inMask of
+        \a port.
+    **/
+    void FilterBankAdd(ClearCorePins pin, uint32_t port, uint32_t inMask);
+
+    /**
+        Set a banked input's filter length and restart its count down at
+        \a ticksLeft samples.
+    **/
+    void FilterBankLength(ClearCorePins pin, uint16_t length,
+                          uint16_t ticksLeft);
+
 #endif // !HIDE_FROM_DOXYGEN
 }; // InputManager
 
@@ -0,0 +1,265 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    \file KeyValueStore.h
+    \brief ClearCore journaled key/value store in flash.
+
+    Keeps small values, such as recipes and counters, in a reserved region at
+    the top of flash as an append-only log of records.
+**/
+
+#ifndef __KEYVALUESTORE_H__
+#define __KEYVALUESTORE_H__
+
+#include <stdint.h>
+#include <sam.h>
+
+namespace ClearCore {
+
+/// The number of flash blocks reserved for the store at the top of flash
+#ifndef KV_STORE_BLOCKS
+#define KV_STORE_BLOCKS 2
+#endif
+
+/// The number of keys; keys run from 0 to KV_STORE_KEYS - 1
+#ifndef KV_STORE_KEYS
+#define KV_STORE_KEYS 64
+#endif
+
+/// The largest value, in bytes
+#ifndef KV_STORE_VALUE_MAX
+#define KV_STORE_VALUE_MAX 40
+#endif
+
+/// The first address of the flash region used by the store
+#define KV_STORE_ADDR \
+    (FLASH_ADDR + FLASH_SIZE - KV_STORE_BLOCKS * NVMCTRL_BLOCK_SIZE)
+
+/**
+    \class KeyValueStore
+    \brief ClearCore journaled key/value store in flash.
+
+    Each write appends a record holding the key, the value, and a CRC to the
+    active flash block, so a write programs only the quad-words of its own
+    record instead of erasing and rewriting a page. A table in RAM holds the
+    location of each key's newest record, so reads do not search the log.
+
+    When the active block runs low on space, the store starts the next block
+    of the region and copies the newest record of each key into it, one
+    record per call to Refresh(), then erases the old block. The blocks are
+    used in turn, which spreads the flash wear across the region. Writes made
+    during compaction go to the new block. If a write finds no room, the
+    compaction it is waiting on is finished before the write returns.
+
+    Records that fail their CRC, such as one cut off by a power loss, are
+    ignored when the store is read back at power-up, and the key keeps its
+    previous value. The store is read back on first use.
+
+    The store occupies the last #KV_STORE_BLOCKS flash blocks (16 KB by
+    default), which the application must leave unused. Flash writes are
+    refused while the supply voltage is too low for them to complete.
+
+    \code{.cpp}
+    #define RECIPE_KEY 1
+
+    Recipe recipe;
+    if (KvStore.Read(RECIPE_KEY, &recipe, sizeof(recipe)) < 0) {
+        // Nothing stored yet; use the defaults
+    }
+    ...
+    KvStore.Write(RECIPE_KEY, &recipe, sizeof(recipe));
+
+    while (true) {
+        // Keep compaction moving in the background
+        KvStore.Refresh();
+        ...
+    }
+    \endcode
+
+    \note The store is not safe to use from interrupt handlers.
+**/
+class KeyValueStore {
+public:
+#ifndef HIDE_FROM_DOXYGEN
+    /**
+        Public accessor for singleton instance.
+    **/
+    static KeyValueStore &Instance();
+#endif
+
+    /**
+        \brief Store a value.
+
+        A value equal to the stored one is not written again.
+
+        \code{.cpp}
+        uint32_t cycles = 1234;
+        KvStore.Write(CYCLES_KEY, &cycles, sizeof(cycles));
+        \endcode
+
+        \param[in] key The key, from 0 to #KV_STORE_KEYS - 1.
+        \param[in] data The value to store.
+        \param[in] length The length of the value, from 1 to
+        #KV_STORE_VALUE_MAX bytes.
+
+        \return True if the value is stored.
+    **/
+    bool Write(uint16_t key, const void *data, uint8_t length);
+
+    /**
+        \brief Read a stored value.
+
+        \code{.cpp}
+        uint32_t cycles;
+        if (KvStore.Read(CYCLES_KEY, &cycles, sizeof(cycles)) < 0) {
+            cycles = 0;
+        }
+        \endcode
+
+        \param[in] key The key to read.
+        \param[out] data Where to copy the value.
+        \param[in] length The size of \a data. A longer value is cut off.
+
+        \return The length of the stored value, or -1 if the key has none.
+    **/
+    int16_t Read(uint16_t key, void *data, uint8_t length);
+
+    /**
+        \brief Check whether a key has a stored value.
+
+        \param[in] key The key to check.
+
+        \return True if the key has a value.
+    **/
+    bool Contains(uint16_t key);
+
+    /**
+        \brief Remove a key's value.
+
+        \param[in] key The key to remove.
+
+        \return True if the key no longer has a value.
+    **/
+    bool Erase(uint16_t key);
+
+    /**
+        \brief Advance a compaction by one step.
+
+        Call regularly from the main loop, for example from a TaskManager
+        task. Each call copies at most one record or checks for the end of a
+        block erase, so it returns within a few hundred microseconds.
+    **/
+    void Refresh();
+
+    /**
+        \brief Check whether a compaction is in progress.
+
+        \return True while records are still being moved to a new block.
+    **/
+    bool CompactionActive();
+
+    /**
+        \brief The number of bytes left in the active block.
+
+        Each record takes the length of its value plus 8 bytes, rounded up to
+        a multiple of 16 bytes.
+    **/
+    uint16_t FreeSpace();
+
+private:
+    typedef enum {
+        COMPACT_IDLE,
+        COMPACT_COPY,
+        COMPACT_ERASE,
+        COMPACT_ERASE_WAIT,
+    } CompactState;
+
+    // Location of each key's newest record, in quad-words from the start of
+    // the region
+    uint16_t m_index[KV_STORE_KEYS];
+    // Sequence number of the active block
+    uint32_t m_sequence;
+    uint8_t m_activeBlock;
+    // The block being compacted out, or -1
+    int8_t m_oldBlock;
+    // The next free quad-word in the active block
+    uint16_t m_writeQw;
+    // The next key to copy during compaction
+    uint16_t m_copyKey;
+    CompactState m_compactState;
+    bool m_compactPending;
+    bool m_mounted;
+
+    /**
+        Construct
+    **/
+    KeyValueStore();
+
+    /**
+        Build the index from the records in flash.
+    **/
+    bool Mount();
+
+    /**
+        Index the records of a block.
+
+        \return The first free quad-word of the block.
+    **/
+    uint16_t BlockScan(uint8_t block);
+
+    /**
+        Make room for a record in the active block, then program it.
+    **/
+    bool RecordAppend(uint16_t key, const uint32_t *record, uint8_t length);
+
+    /**
+        Program a record at the end of the active block and index it.
+    **/
+    bool RecordProgram(uint16_t key, const uint32_t *record, uint8_t length);
+
+    /**
+        Begin moving the newest records into the next block.
+    **/
+    bool CompactStart();
+
+    /**
+        Advance the compaction in progress.
+
+        \return False if the step failed rather than waited.
+    **/
+    bool CompactStep();
+
+    /**
+        Run the compaction in progress to completion.
+    **/
+    void CompactFinish();
+
+    /**
+        Make room for a record of \a qwCount quad-words in the active block.
+    **/
+    bool SpaceReserve(uint16_t qwCount);
+}; // KeyValueStore
+
+} // ClearCore namespace
+
+#endif // __KEYVALUESTORE_H__
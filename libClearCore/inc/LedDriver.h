@@ -149,6 +149,9 @@ private:
 
         This is typically called from a timer or main loop to update the
         underlying value.
+
+        \note The SysManager skips this connector in the sample rate refresh
+        because there is nothing to update.
     **/
     void Refresh() override {}
 
@@ -0,0 +1,241 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    \file LogCompressor.h
+    \brief Streaming compression of log data for small RAM.
+
+    Compresses a stream of log bytes in blocks, either as channels of
+    fixed-size records or as general bytes, and hands each block to a sink.
+**/
+
+#ifndef __LOGCOMPRESSOR_H__
+#define __LOGCOMPRESSOR_H__
+
+#include <stdint.h>
+
+namespace ClearCore {
+
+/// The most input bytes compressed as one block; at most 65535
+#ifndef LOG_COMPRESS_BLOCK_SIZE
+#define LOG_COMPRESS_BLOCK_SIZE 2048
+#endif
+
+/// The number of hash bits of the byte mode's match finder; the table takes
+/// 2 bytes per entry
+#ifndef LOG_COMPRESS_HASH_BITS
+#define LOG_COMPRESS_HASH_BITS 10
+#endif
+
+/// The most channels in a record
+#ifndef LOG_COMPRESS_CHANNELS_MAX
+#define LOG_COMPRESS_CHANNELS_MAX 32
+#endif
+
+/// The size of the header that starts every block, in bytes
+#define LOG_COMPRESS_HEADER_LEN 5
+
+/// The block types, the first byte of each block
+#define LOG_BLOCK_RAW 0x52
+#define LOG_BLOCK_DELTA 0x44
+#define LOG_BLOCK_LZ4 0x4C
+
+/**
+    \class LogCompressor
+    \brief Streaming compression of log data for small RAM.
+
+    Write() takes log bytes in pieces of any length and compresses each
+    #LOG_COMPRESS_BLOCK_SIZE of them as a block, which goes to the sink
+    function: a FatFile, ConnectorUsb or an EthernetTcpClient. A DataLogger
+    given a compressor with DataLogger::Compression() feeds it from its ring
+    and writes the blocks to its file.
+
+    In #COMPRESS_DELTA mode the bytes are fixed-size records made of integer
+    channels of 1, 2 or 4 bytes, such as positions and ADC counts. Each block
+    holds the first record as it is, then, channel by channel, the change
+    from each record to the next, zigzag encoded and bit-packed at the width
+    of the largest change. A channel that moves slowly packs into a few bits
+    per record, and one that does not move packs into none. Floats do not
+    delta well; log them as scaled integers.
+
+    In #COMPRESS_LZ4 mode the bytes are compressed with a greedy LZ4 match
+    finder, for text logs or records that repeat more than they drift.
+
+    A block that would not be smaller is stored as it is. Every block is a
+    #LOG_COMPRESS_HEADER_LEN byte header followed by its data, little-endian:
+    - Byte 0: #LOG_BLOCK_RAW, #LOG_BLOCK_DELTA or #LOG_BLOCK_LZ4.
+    - Bytes 1-2: The number of input bytes in the block.
+    - Bytes 3-4: The number of data bytes that follow the header.
+
+    The data of an #LOG_BLOCK_LZ4 block is an LZ4 block, readable with
+    LZ4_decompress_safe(). The data of a #LOG_BLOCK_DELTA block is the first
+    record, then for each channel a byte with the bit width, then the
+    zigzag encoded changes of the rest of the records at that width, packed
+    LSB first and padded to a whole byte.
+
+    \code{.cpp}
+    // Records of a position and two ADC counts, written to the card
+    // compressed while the machine runs
+    struct Sample {
+        int32_t Posn;
+        uint16_t Adc[2];
+    };
+    const uint8_t Channels[] = {4, 2, 2};
+    LogCompressor Compressor(LogCompressor::COMPRESS_DELTA, sizeof(Sample),
+                             Channels, 3);
+    DataLog.Compression(&Compressor);
+    DataLog.Start("RUN.BIN", sizeof(Sample), TakeSample);
+    \endcode
+**/
+class LogCompressor {
+public:
+    /**
+        \brief How the bytes are compressed.
+    **/
+    typedef enum {
+        /// Delta, zigzag and bit-packing of the channels of fixed-size
+        /// records
+        COMPRESS_DELTA,
+        /// LZ4 block compression of the bytes
+        COMPRESS_LZ4,
+    } CompressModes;
+
+    /**
+        \brief Takes each compressed block.
+
+        \return True if the block was taken; a false return is reported by
+        Write() or Flush().
+    **/
+    typedef bool (*SinkFunction)(const uint8_t *data, uint16_t length);
+
+    /**
+        \brief Construct a compressor.
+
+        \param[in] mode The CompressModes.
+        \param[in] recordSize The size of a record in bytes, for
+        #COMPRESS_DELTA.
+        \param[in] channelSizes The size of each channel of a record, in
+        record order: 1, 2 or 4 bytes, adding up to \a recordSize. Copied.
+        \param[in] channelCount The number of channels, up to
+        #LOG_COMPRESS_CHANNELS_MAX.
+    **/
+    LogCompressor(CompressModes mode, uint8_t recordSize = 0,
+                  const uint8_t *channelSizes = nullptr,
+                  uint8_t channelCount = 0);
+
+    /**
+        \brief Check the construction parameters.
+
+        \return True if the mode is #COMPRESS_LZ4, or the channels fit the
+        record and at least one record fits a block.
+    **/
+    bool Valid() {
+        return m_blockSize != 0;
+    }
+
+    /**
+        \brief Check whether records of a size can be written.
+
+        \return True in #COMPRESS_LZ4 mode, or if \a recordSize is the record
+        size of #COMPRESS_DELTA mode.
+    **/
+    bool RecordSizeMatch(uint8_t recordSize) {
+        return m_mode != COMPRESS_DELTA || recordSize == m_recordSize;
+    }
+
+    /**
+        \brief Set the function that takes the compressed blocks.
+    **/
+    void Sink(SinkFunction sink) {
+        m_sink = sink;
+    }
+
+    /**
+        \brief Add bytes to the stream.
+
+        Each full block is compressed and passed to the sink before this
+        returns.
+
+        \param[in] data The bytes.
+        \param[in] length The number of bytes.
+
+        \return True unless there is no sink or the sink refused a block.
+    **/
+    bool Write(const uint8_t *data, uint32_t length);
+
+    /**
+        \brief Compress and pass on the bytes held for the current block.
+
+        Call at the end of the stream. Any part record left over goes in a
+        #LOG_BLOCK_RAW block.
+
+        \return True unless the sink refused a block.
+    **/
+    bool Flush();
+
+    /**
+        \brief Forget any bytes held and clear the counts, to start a new
+        stream.
+    **/
+    void Reset();
+
+    /**
+        \brief The number of bytes written to the compressor.
+    **/
+    uint32_t BytesIn() {
+        return m_bytesIn;
+    }
+
+    /**
+        \brief The number of bytes passed to the sink, headers included.
+    **/
+    uint32_t BytesOut() {
+        return m_bytesOut;
+    }
+
+private:
+    CompressModes m_mode;
+    uint8_t m_recordSize;
+    uint8_t m_channelCount;
+    uint8_t m_channelSizes[LOG_COMPRESS_CHANNELS_MAX];
+    // The input bytes of each block; whole records in #COMPRESS_DELTA mode
+    uint16_t m_blockSize;
+    SinkFunction m_sink;
+
+    uint8_t m_in[LOG_COMPRESS_BLOCK_SIZE];
+    uint16_t m_inLength;
+    uint8_t m_out[LOG_COMPRESS_HEADER_LEN + LOG_COMPRESS_BLOCK_SIZE];
+    uint16_t m_hash[1 << LOG_COMPRESS_HASH_BITS];
+
+    uint32_t m_bytesIn;
+    uint32_t m_bytesOut;
+
+    bool BlockWrite(const uint8_t *in, uint16_t length, bool raw);
+    int32_t DeltaEncode(const uint8_t *in, uint16_t length, uint8_t *out,
+                        uint16_t size);
+    int32_t Lz4Encode(const uint8_t *in, uint16_t length, uint8_t *out,
+                      uint16_t size);
+}; // LogCompressor
+
+} // ClearCore namespace
+
+#endif // __LOGCOMPRESSOR_H__
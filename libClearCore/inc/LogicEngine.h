@@ -0,0 +1,294 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    \file LogicEngine.h
+    \brief ClearCore sample rate logic engine for I/O interlocks.
+
+    Evaluates a table of logic, timer and counter blocks over the inputs once
+    per sample and writes the results straight to outputs.
+**/
+
+#ifndef __LOGICENGINE_H__
+#define __LOGICENGINE_H__
+
+#include <stdint.h>
+#include "Connector.h"
+#include "SysConnectors.h"
+#include "SysTiming.h"
+
+namespace ClearCore {
+
+/// The most blocks a logic network may have
+#ifndef LOGIC_BLOCKS_MAX
+#define LOGIC_BLOCKS_MAX 64
+#endif
+
+/// The most outputs a logic network may drive
+#ifndef LOGIC_OUTPUTS_MAX
+#define LOGIC_OUTPUTS_MAX 16
+#endif
+#if LOGIC_OUTPUTS_MAX > 32
+#error "LOGIC_OUTPUTS_MAX must be 32 or less"
+#endif
+
+/// The number of inputs of each block
+#define LOGIC_BLOCK_INPUTS 4
+
+/// An operand reading ClearCore connector \a pin, as InputManager::InputsRT()
+#define LOGIC_IN(pin) (static_cast<uint16_t>(pin))
+/// An operand reading CCIO-8 input \a n, as CcioBoardManager::InputState()
+#define LOGIC_CCIO(n) (static_cast<uint16_t>(0x20 + (n)))
+/// An operand reading the output of block \a n
+#define LOGIC_BLOCK(n) (static_cast<uint16_t>(0x100 + (n)))
+/// An operand that is always true
+#define LOGIC_TRUE (static_cast<uint16_t>(0x7fff))
+/// Invert an operand
+#define LOGIC_NOT(op) (static_cast<uint16_t>((op) ^ 0x8000))
+/// An operand that is always false
+#define LOGIC_FALSE LOGIC_NOT(LOGIC_TRUE)
+
+/// Convert milliseconds to a timer preset
+#define LOGIC_MS(ms) (static_cast<uint32_t>(ms) * MS_TO_SAMPLES)
+
+/**
+    \class LogicEngine
+    \brief ClearCore sample rate logic engine for I/O interlocks.
+
+    A logic network is a table of blocks and a table of outputs. Once per
+    sample, right after the inputs are updated, the engine evaluates every
+    block in table order and then writes each output whose value changed,
+    so an interlock responds within one sample time however busy the main
+    loop is.
+
+    Block inputs are operands: a connector input (LOGIC_IN()), a CCIO-8 input
+    (LOGIC_CCIO()), another block's output (LOGIC_BLOCK()), or a constant,
+    each optionally inverted with LOGIC_NOT(). A block reading a block later
+    in the table sees that block's output from the previous sample, which
+    allows feedback such as a seal-in.
+
+    The evaluation time grows with the number of blocks and is at most
+    #LOGIC_BLOCKS_MAX blocks of #LOGIC_BLOCK_INPUTS inputs each;
+    CyclesLast() and CyclesMax() report what it actually costs.
+
+    The tables stay owned by the application and must remain valid while
+    the network runs.
+
+    \code{.cpp}
+    // Run the pump on IO-0 while DI-6 (start) has been pressed and DI-7
+    // (stop) has not, and hold IO-1 on for 2 s after the pump stops.
+    static const LogicEngine::Block blocks[] = {
+        // 0: latch, set by DI-6, reset by DI-7
+        {LogicEngine::LOGIC_LATCH, 2,
+         {LOGIC_IN(CLEARCORE_PIN_DI6), LOGIC_IN(CLEARCORE_PIN_DI7)}, 0},
+        // 1: off delay of the pump
+        {LogicEngine::LOGIC_OFF_DELAY, 1, {LOGIC_BLOCK(0)}, LOGIC_MS(2000)},
+    };
+    static const LogicEngine::Output outputs[] = {
+        {LOGIC_BLOCK(0), CLEARCORE_PIN_IO0},
+        {LOGIC_BLOCK(1), CLEARCORE_PIN_IO1},
+    };
+    ConnectorIO0.Mode(Connector::OUTPUT_DIGITAL);
+    ConnectorIO1.Mode(Connector::OUTPUT_DIGITAL);
+    LogicEng.Load(blocks, 2, outputs, 2);
+    \endcode
+**/
+class LogicEngine {
+    friend class SysManager;
+
+public:
+    /**
+        \enum BlockTypes
+        \brief The function of a logic block.
+    **/
+    typedef enum {
+        /// True if all of the first Count inputs are true
+        LOGIC_AND,
+        /// True if any of the first Count inputs is true
+        LOGIC_OR,
+        /// True if an odd number of the first Count inputs are true
+        LOGIC_XOR,
+        /// Set by input 0, reset by input 1; reset wins
+        LOGIC_LATCH,
+        /// True once input 0 has been true for Preset samples
+        LOGIC_ON_DELAY,
+        /// True while input 0 is true and for Preset samples after
+        LOGIC_OFF_DELAY,
+        /// True for Preset samples from each rising edge of input 0
+        LOGIC_PULSE,
+        /// True for the one sample in which input 0 rises
+        LOGIC_RISING,
+        /// True for the one sample in which input 0 falls
+        LOGIC_FALLING,
+        /// Counts rising edges of input 0, cleared while input 1 is true;
+        /// true once the count reaches Preset
+        LOGIC_COUNTER,
+        /// The number of block types
+        LOGIC_TYPE_COUNT,
+    } BlockTypes;
+
+    /**
+        \brief One block of a logic network.
+    **/
+    typedef struct {
+        /// The block's function, one of #BlockTypes
+        uint8_t Type;
+        /// The number of inputs used by a gate, 1 to #LOGIC_BLOCK_INPUTS;
+        /// other blocks use the inputs their type names
+        uint8_t Count;
+        /// The input operands
+        uint16_t In[LOGIC_BLOCK_INPUTS];
+        /// The time of a timer, in samples (see LOGIC_MS()), or the count
+        /// of a counter
+        uint32_t Preset;
+    } Block;
+
+    /**
+        \brief One output of a logic network.
+    **/
+    typedef struct {
+        /// The operand written to the output
+        uint16_t Source;
+        /// The connector written with Connector::State(), such as an IO-n
+        /// connector or a CCIO-8 pin in digital output mode
+        ClearCorePins Pin;
+    } Output;
+
+#ifndef HIDE_FROM_DOXYGEN
+    /**
+        Public accessor for singleton instance.
+    **/
+    static LogicEngine &Instance();
+#endif
+
+    /**
+        \brief Start running a logic network.
+
+        Any network already running is stopped first. Every block starts
+        false with its timers and counters cleared, and every output is
+        written in the first sample.
+
+        \param[in] blocks The blocks, evaluated in order.
+        \param[in] blockCount The number of blocks.
+        \param[in] outputs The outputs.
+        \param[in] outputCount The number of outputs.
+
+        \return True if the network started; false if a table is too long,
+        a block type or operand is invalid, or an output pin is not writable.
+    **/
+    bool Load(const Block *blocks, uint8_t blockCount,
+              const Output *outputs, uint8_t outputCount);
+
+    /**
+        \brief Stop running the network. The outputs keep their last states.
+    **/
+    void Stop();
+
+    /**
+        \brief Check whether a network is running.
+    **/
+    bool Running() {
+        return m_running;
+    }
+
+    /**
+        \brief The output of a block in the last sample.
+
+        \param[in] index The block's index in the table.
+    **/
+    bool BlockOutput(uint8_t index);
+
+    /**
+        \brief The elapsed samples of a timer block, or the count of a
+        counter block, in the last sample.
+
+        \param[in] index The block's index in the table.
+    **/
+    uint32_t BlockValue(uint8_t index);
+
+    /**
+        \brief The CPU cycles the last evaluation took.
+    **/
+    uint32_t CyclesLast() {
+        return m_cyclesLast;
+    }
+
+    /**
+        \brief The most CPU cycles an evaluation has taken.
+
+        \param[in] reset True to clear the maximum after reading it.
+    **/
+    uint32_t CyclesMax(bool reset = false);
+
+private:
+    const Block *m_blocks;
+    uint8_t m_blockCount;
+    const Output *m_outputs;
+    uint8_t m_outputCount;
+    Connector *m_outputConnectors[LOGIC_OUTPUTS_MAX];
+    volatile bool m_running;
+
+    // Sampled inputs for this evaluation
+    uint32_t m_inputs;
+    uint64_t m_ccio;
+    // Block outputs, one bit per block, and the previous input 0 of each
+    uint32_t m_blockOut[(LOGIC_BLOCKS_MAX + 31) / 32];
+    uint32_t m_blockLast[(LOGIC_BLOCKS_MAX + 31) / 32];
+    // Timer and counter accumulators
+    uint32_t m_blockValue[LOGIC_BLOCKS_MAX];
+    // The values last written to the outputs
+    uint32_t m_outputLast;
+    bool m_outputsForce;
+
+    volatile uint32_t m_cyclesLast;
+    volatile uint32_t m_cyclesMax;
+
+    /**
+        Construct
+    **/
+    LogicEngine();
+
+    /**
+        Evaluate the network and write the outputs. Called from the sample
+        rate update once the inputs are updated.
+    **/
+    void Update();
+
+    bool OperandValid(uint16_t op, uint8_t blockCount);
+    bool Operand(uint16_t op);
+
+    static bool BitGet(const uint32_t *bits, uint8_t index) {
+        return (bits[index >> 5] >> (index & 31)) & 1;
+    }
+    static void BitSet(uint32_t *bits, uint8_t index, bool value) {
+        if (value) {
+            bits[index >> 5] |= 1UL << (index & 31);
+        }
+        else {
+            bits[index >> 5] &= ~(1UL << (index & 31));
+        }
+    }
+}; // LogicEngine
+
+} // ClearCore namespace
+
+#endif // __LOGICENGINE_H__
@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    \file MemoryManager.h
+    \brief ClearCore RAM budget and usage report.
+
+    Lists the library's statically sized buffers and reports the stack, heap,
+    and lwIP pool usage at run time.
+**/
+
+#ifndef __MEMORYMANAGER_H__
+#define __MEMORYMANAGER_H__
+
+#include <stdint.h>
+#include "CcioBoardManager.h"
+#include "CcioPin.h"
+#include "DataLogger.h"
+#include "EthernetTcp.h"
+#include "ISerial.h"
+#include "SerialBase.h"
+#include "SerialUsb.h"
+#include "lwip/opt.h"
+
+namespace ClearCore {
+
+/**
+    \brief The RAM the library sets aside for each subsystem, in bytes, as
+    built.
+
+    Each size follows the build macros that set it, so the budget can be
+    checked with static_assert() after changing them.
+
+    \code{.cpp}
+    static_assert(MemoryBudget::Total < 128 * 1024, "RAM budget exceeded");
+    \endcode
+**/
+struct MemoryBudget {
+    /// Default send and receive rings of COM-0, COM-1, and the XBee port
+    static constexpr uint32_t SerialPorts = 3 * 2 * SERIAL_BUFFER_SIZE;
+    /// USB serial rings, endpoint transfer buffers, and telemetry ring
+    static constexpr uint32_t Usb = 2 * USB_SERIAL_BUFFER_SIZE +
+                                    4 * USB_SERIAL_XFER_SIZE +
+                                    USB_TELEMETRY_BUFFER_SIZE;
+    /// The CCIO-8 pin arrays of both chains
+    static constexpr uint32_t CcioPins = 2 * CCIO_PIN_CNT * sizeof(CcioPin);
+    /// The data logger's ring buffer
+    static constexpr uint32_t DataLog = DATA_LOG_BUFFER_SIZE;
+    /// The lwIP heap
+    static constexpr uint32_t LwipHeap = MEM_SIZE;
+    /// The lwIP packet buffer pool
+    static constexpr uint32_t LwipPbufPool = PBUF_POOL_SIZE * PBUF_POOL_BUFSIZE;
+    /// The sum of the above
+    static constexpr uint32_t Total = SerialPorts + Usb + CcioPins + DataLog +
+                                      LwipHeap + LwipPbufPool;
+    /// Taken from the heap for each open TCP connection
+    static constexpr uint32_t TcpConnection = sizeof(EthernetTcp::TcpData);
+};
+
+/**
+    \class MemoryManager
+    \brief ClearCore RAM usage report.
+
+    The free RAM between the heap and the stack is filled with a known
+    pattern at start-up. The deepest the stack has reached is found by
+    looking for the lowest word that no longer holds the pattern. Interrupts
+    share the main stack, so the high-water mark includes their use of it.
+
+    \code{.cpp}
+    if (MemoryMgr.FreeMin() < 4096) {
+        // The stack has come within 4 KB of the heap
+    }
+    \endcode
+**/
+class MemoryManager {
+    friend class SysManager;
+
+public:
+    /**
+        \brief Usage counters for the lwIP heap or one lwIP pool.
+    **/
+    typedef struct {
+        /// The size, in bytes for the heap or in elements for a pool
+        uint32_t Avail;
+        /// The amount in use now
+        uint32_t Used;
+        /// The most that has been in use at once
+        uint32_t Max;
+        /// The number of allocations that failed
+        uint32_t Errors;
+    } PoolStats;
+
+#ifndef HIDE_FROM_DOXYGEN
+    /**
+        Public accessor for singleton instance.
+    **/
+    static MemoryManager &Instance();
+#endif
+
+    /**
+        \brief The deepest the stack has reached since start-up, in bytes.
+
+        Scans the free RAM, so it takes time in proportion to the RAM that
+        has never been used. Call from the main loop.
+    **/
+    uint32_t StackUsedMax();
+
+    /**
+        \brief The RAM between the top of the heap and the stack pointer
+        now, in bytes.
+    **/
+    uint32_t Free();
+
+    /**
+        \brief The least free RAM there has been between the heap and the
+        stack, in bytes.
+
+        The heap top is taken as it is now, so RAM the heap has grown into
+        is not counted as free.
+    **/
+    uint32_t FreeMin();
+
+    /**
+        \brief The RAM the heap has taken from the system, in bytes.
+    **/
+    uint32_t HeapSize();
+
+    /**
+        \brief The heap bytes allocated now.
+    **/
+    uint32_t HeapUsed();
+
+    /**
+        \brief Read the lwIP heap counters.
+
+        \param[out] stats The counters.
+
+        \return True if lwIP keeps heap statistics in this build.
+    **/
+    bool LwipHeapGet(PoolStats &stats);
+
+    /**
+        \brief The number of lwIP memory pools.
+    **/
+    uint8_t LwipPoolCount();
+
+    /**
+        \brief Read the counters of one lwIP memory pool.
+
+        \param[in] pool The pool index, below LwipPoolCount().
+        \param[out] stats The counters.
+
+        \return True if the pool exists and lwIP keeps pool statistics in
+        this build.
+    **/
+    bool LwipPoolGet(uint8_t pool, PoolStats &stats);
+
+    /**
+        \brief Write the budget and the usage figures to a serial port, one
+        per line.
+
+        \code{.cpp}
+        MemoryMgr.Report(ConnectorUsb);
+        \endcode
+
+        \param[in] port Where to write the report.
+    **/
+    void Report(ISerial &port);
+
+private:
+    /**
+        Construct
+    **/
+    MemoryManager() {}
+
+    /**
+        Fill the free RAM below the stack with the paint pattern. Called at
+        start-up, before main().
+    **/
+    void Initialize();
+
+    /**
+        The lowest stack word that has been written.
+    **/
+    uint32_t StackLowest();
+}; // MemoryManager
+
+} // ClearCore namespace
+
+#endif // __MEMORYMANAGER_H__
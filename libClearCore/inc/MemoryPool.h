@@ -0,0 +1,387 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+    \file MemoryPool.h
+    \brief Fixed-block memory pools and a bump arena.
+
+    Deterministic allocation from buffers the application sizes, in place of
+    the heap, for message and packet buffers.
+**/
+
+#ifndef __MEMORYPOOL_H__
+#define __MEMORYPOOL_H__
+
+#include <stdint.h>
+#include "lwip/opt.h"
+#include "lwip/pbuf.h"
+
+namespace ClearCore {
+
+/**
+    \class MemoryPool
+    \brief A pool of equal-sized memory blocks.
+
+    The free blocks are kept on a list threaded through the blocks
+    themselves, so allocating and freeing take a fixed, short time and the
+    pool has no overhead beyond its storage. Alloc() and Free() hold off
+    interrupts for a few instructions, so blocks may be taken and returned
+    from interrupt handlers and the main loop alike.
+
+    The storage is supplied by the owner; MemoryPoolStatic holds its own.
+
+    A pool can also supply lwIP custom pbufs with PbufAlloc(), which returns
+    the block to the pool when lwIP frees the pbuf, for zero-copy sends from
+    buffers that are not taken from the lwIP heap.
+
+    \code{.cpp}
+    // 16 message buffers of 64 bytes each
+    MemoryPoolStatic<64, 16> messages;
+
+    uint8_t *msg = static_cast<uint8_t *>(messages.Alloc());
+    if (msg) {
+        // Fill in and hand off the message, then later
+        messages.Free(msg);
+    }
+    \endcode
+**/
+class MemoryPool {
+public:
+    /**
+        \brief The usage counters of a pool.
+    **/
+    typedef struct {
+        /// The size of each block in bytes
+        uint32_t BlockSize;
+        /// The number of blocks
+        uint32_t Blocks;
+        /// The blocks allocated now
+        uint32_t Used;
+        /// The most blocks that have been allocated at once
+        uint32_t Max;
+        /// The number of allocations that failed
+        uint32_t Errors;
+    } Stats;
+
+    /**
+        \brief Construct a pool with no storage; call Storage() before use.
+    **/
+    MemoryPool();
+
+    /**
+        \brief Construct a pool on the given storage.
+
+        \param[in] buffer The storage, word aligned, of at least
+        \a blockSize * \a blocks bytes.
+        \param[in] blockSize The size of a block in bytes; rounded up to a
+        whole number of words.
+        \param[in] blocks The number of blocks.
+    **/
+    MemoryPool(void *buffer, uint32_t blockSize, uint32_t blocks);
+
+    /**
+        \brief Change the storage, freeing every block. No block may be in
+        use.
+
+        \param[in] buffer The storage, word aligned, of at least
+        \a blockSize * \a blocks bytes after rounding.
+        \param[in] blockSize The size of a block in bytes; rounded up to a
+        whole number of words.
+        \param[in] blocks The number of blocks.
+
+        \return True if the storage was taken; false if the buffer is
+        missing or not word aligned, or there are no blocks.
+    **/
+    bool Storage(void *buffer, uint32_t blockSize, uint32_t blocks);
+
+    /**
+        \brief Take a block.
+
+        \return The block, word aligned, or NULL if every block is in use.
+    **/
+    void *Alloc();
+
+    /**
+        \brief Return a block taken with Alloc().
+
+        \param[in] block The block; NULL is ignored.
+
+        \return False if the block is not one of this pool's.
+    **/
+    bool Free(void *block);
+
+    /**
+        \brief Check whether memory lies in one of this pool's blocks.
+    **/
+    bool Owns(const void *ptr) const;
+
+#if LWIP_SUPPORT_CUSTOM_PBUF
+    /**
+        \brief Takes a block as an lwIP custom pbuf.
+
+        \code{.cpp}
+        struct pbuf *p = packets.PbufAlloc(PBUF_TRANSPORT, length);
+        if (p) {
+            memcpy(p->payload, reply, length);
+            udp_send(pcb, p);
+            // lwIP gives the block back to the pool when it is done
+            pbuf_free(p);
+        }
+        \endcode
+
+        \param[in] layer The headers to leave room for ahead of the payload.
+        \param[in] length The payload length.
+
+        \return The pbuf, or NULL if no block is free or the block can't
+        hold the pbuf, the headers and the payload.
+    **/
+    struct pbuf *PbufAlloc(pbuf_layer layer, uint16_t length);
+
+    /**
+        \brief The largest payload PbufAlloc() can give for a layer.
+    **/
+    uint16_t PbufPayloadMax(pbuf_layer layer) const;
+#endif
+
+    /**
+        \brief The size of each block in bytes.
+    **/
+    uint32_t BlockSize() const {
+        return m_blockSize;
+    }
+
+    /**
+        \brief The number of blocks.
+    **/
+    uint32_t Blocks() const {
+        return m_blocks;
+    }
+
+    /**
+        \brief The number of blocks free now.
+    **/
+    uint32_t Available() const {
+        return m_blocks - m_used;
+    }
+
+    /**
+        \brief Read the usage counters.
+
+        \param[in] reset True to restart the maximum from the blocks in use
+        now and clear the error count.
+    **/
+    void StatsGet(Stats &stats, bool reset = false);
+
+private:
+    // A free block holds the link to the next free block
+    struct FreeBlock {
+        FreeBlock *Next;
+    };
+
+    uint8_t *m_buffer;
+    uint32_t m_blockSize;
+    uint32_t m_blocks;
+    FreeBlock *m_free;
+    volatile uint32_t m_used;
+    volatile uint32_t m_usedMax;
+    volatile uint32_t m_errors;
+
+#if LWIP_SUPPORT_CUSTOM_PBUF
+    // The head of a block used as a custom pbuf; the payload follows
+    struct PbufBlock {
+        struct pbuf_custom Custom;
+        MemoryPool *Pool;
+    };
+
+    static void PbufFree(struct pbuf *p);
+#endif
+}; // MemoryPool
+
+/**
+    \class MemoryPoolStatic
+    \brief A MemoryPool that holds its own storage.
+
+    \tparam BLOCK_SIZE The size of a block in bytes.
+    \tparam BLOCKS The number of blocks.
+**/
+template <uint32_t BLOCK_SIZE, uint32_t BLOCKS>
+class MemoryPoolStatic : public MemoryPool {
+    static_assert(BLOCK_SIZE && BLOCKS, "The pool must have storage");
+
+public:
+    /**
+        \brief Construct a pool with every block free.
+    **/
+    MemoryPoolStatic() : MemoryPool(m_storage, BLOCK_SIZE, BLOCKS) {}
+
+private:
+    // Left uninitialized: the free list is threaded through it
+    uint32_t m_storage[(BLOCK_SIZE + 3) / 4 * BLOCKS];
+}; // MemoryPoolStatic
+
+/**
+    \class MemoryArena
+    \brief A bump allocator that is reset all at once.
+
+    Each allocation is taken from the end of the memory already handed out,
+    so it costs a few instructions and has no per-allocation overhead, but
+    memory is only given back by Reset(). This suits work done in cycles,
+    such as handling one request or one main loop pass: allocate variable
+    sized buffers freely during the cycle and reset the arena at its end.
+    Mark() and Release() give back everything allocated after a point.
+
+    The arena is meant for one context; unlike MemoryPool, it does not hold
+    off interrupts. The high-water mark persists across resets, so it shows
+    how large the arena needs to be.
+
+    \code{.cpp}
+    MemoryArenaStatic<2048> scratch;
+
+    void loop() {
+        char *line = static_cast<char *>(scratch.Alloc(lineLength + 1));
+        uint16_t *table = static_cast<uint16_t *>(
+                              scratch.Alloc(count * sizeof(uint16_t), 2));
+        // Use them, then drop everything at the end of the pass
+        scratch.Reset();
+    }
+    \endcode
+**/
+class MemoryArena {
+public:
+    /**
+        \brief Construct an arena with no storage; call Storage() before
+        use.
+    **/
+    MemoryArena();
+
+    /**
+        \brief Construct an arena on the given storage.
+
+        \param[in] buffer The storage.
+        \param[in] size The size of the storage in bytes.
+    **/
+    MemoryArena(void *buffer, uint32_t size);
+
+    /**
+        \brief Change the storage and reset the arena.
+
+        \param[in] buffer The storage.
+        \param[in] size The size of the storage in bytes.
+    **/
+    void Storage(void *buffer, uint32_t size);
+
+    /**
+        \brief Allocate memory until the next Reset().
+
+        \param[in] size The number of bytes.
+        \param[in] align (optional) The alignment, a power of two.
+        Default: 4.
+
+        \return The memory, or NULL if it doesn't fit.
+    **/
+    void *Alloc(uint32_t size, uint32_t align = 4);
+
+    /**
+        \brief Give back everything allocated.
+    **/
+    void Reset() {
+        m_used = 0;
+    }
+
+    /**
+        \brief The point that Release() returns the arena to.
+    **/
+    uint32_t Mark() const {
+        return m_used;
+    }
+
+    /**
+        \brief Give back everything allocated since Mark() returned
+        \a mark.
+    **/
+    void Release(uint32_t mark) {
+        if (mark < m_used) {
+            m_used = mark;
+        }
+    }
+
+    /**
+        \brief The size of the storage in bytes.
+    **/
+    uint32_t Size() const {
+        return m_size;
+    }
+
+    /**
+        \brief The bytes allocated now, including alignment padding.
+    **/
+    uint32_t Used() const {
+        return m_used;
+    }
+
+    /**
+        \brief The most bytes that have been allocated at once.
+
+        \param[in] reset True to restart the maximum from the bytes
+        allocated now.
+    **/
+    uint32_t UsedMax(bool reset = false);
+
+    /**
+        \brief The number of allocations that didn't fit.
+
+        \param[in] reset True to clear the count after reading it.
+    **/
+    uint32_t Errors(bool reset = false);
+
+private:
+    uint8_t *m_buffer;
+    uint32_t m_size;
+    uint32_t m_used;
+    uint32_t m_usedMax;
+    uint32_t m_errors;
+}; // MemoryArena
+
+/**
+    \class MemoryArenaStatic
+    \brief A MemoryArena that holds its own storage.
+
+    \tparam SIZE The size of the storage in bytes.
+**/
+template <uint32_t SIZE>
+class MemoryArenaStatic : public MemoryArena {
+    static_assert(SIZE, "The arena must have storage");
+
+public:
+    /**
+        \brief Construct an empty arena.
+    **/
+    MemoryArenaStatic() : MemoryArena(m_storage, SIZE) {}
+
+private:
+    uint8_t m_storage[SIZE] __attribute__((aligned(8)));
+}; // MemoryArenaStatic
+
+} // ClearCore namespace
+
+#endif // __MEMORYPOOL_H__
@@ -0,0 +1,362 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    \file ModbusRtu.h
+    \brief ClearCore Modbus RTU master and slave.
+
+    Runs the Modbus RTU protocol on a ClearCore serial port. Frame boundaries
+    are found from the timestamps of the received characters rather than from
+    a millisecond timer.
+**/
+
+#ifndef __MODBUSRTU_H__
+#define __MODBUSRTU_H__
+
+#include <stdint.h>
+#include "SerialBase.h"
+
+namespace ClearCore {
+
+/// The largest Modbus RTU frame, in bytes
+#define MODBUS_FRAME_MAX 256
+
+/// The most registers or bits the master may read or write in one request
+#define MODBUS_VALUES_MAX 125
+
+/// The default time the master waits for a response, in milliseconds
+#ifndef MODBUS_RESPONSE_TIMEOUT_MS
+#define MODBUS_RESPONSE_TIMEOUT_MS 100
+#endif
+
+/**
+    \class ModbusRtu
+    \brief ClearCore Modbus RTU master and slave.
+
+    A ModbusRtu runs on a serial port that has been set up and opened in UART
+    mode. The end of a frame is the 3.5 character silent interval of the
+    Modbus RTU standard, measured with SerialBase::RxIdleCycles(), so a frame
+    is handled as soon as Poll() sees the interval has passed. Call Poll()
+    from the main loop as often as possible.
+
+    As a slave, requests for this unit are passed to a register map callback
+    and answered. The coil, discrete input, input register, and holding
+    register read and write functions (1 to 6, 15, and 16) are supported.
+
+    \code{.cpp}
+    uint16_t holding[16];
+
+    ModbusRtu::Exceptions RegisterMap(ModbusRtu::RegisterTypes type,
+                                      uint16_t address, uint16_t count,
+                                      uint16_t *values, bool write) {
+        if (type != ModbusRtu::HOLDING_REGISTER || address + count > 16) {
+            return ModbusRtu::EXCEPTION_ILLEGAL_DATA_ADDRESS;
+        }
+        for (uint16_t i = 0; i < count; i++) {
+            if (write) {
+                holding[address + i] = values[i];
+            }
+            else {
+                values[i] = holding[address + i];
+            }
+        }
+        return ModbusRtu::EXCEPTION_NONE;
+    }
+
+    ModbusRtu Modbus(ConnectorCOM1);
+
+    int main() {
+        ConnectorCOM1.Speed(115200);
+        ConnectorCOM1.Parity(SerialBase::PARITY_E);
+        ConnectorCOM1.PortOpen();
+        Modbus.SlaveMode(1, RegisterMap);
+        while (true) {
+            Modbus.Poll();
+        }
+    }
+    \endcode
+
+    As a master, one request at a time is sent with ReadRequest() or
+    WriteRequest() and its progress is followed with RequestState().
+**/
+class ModbusRtu {
+public:
+    /**
+        The Modbus data tables.
+    **/
+    typedef enum {
+        /// Read/write single bits
+        COIL,
+        /// Read-only single bits
+        DISCRETE_INPUT,
+        /// Read-only 16-bit registers
+        INPUT_REGISTER,
+        /// Read/write 16-bit registers
+        HOLDING_REGISTER,
+    } RegisterTypes;
+
+    /**
+        Modbus exception codes.
+    **/
+    typedef enum {
+        /// The request succeeded
+        EXCEPTION_NONE = 0,
+        /// The function is not supported
+        EXCEPTION_ILLEGAL_FUNCTION = 1,
+        /// The address range is not valid
+        EXCEPTION_ILLEGAL_DATA_ADDRESS = 2,
+        /// A value in the request is not valid
+        EXCEPTION_ILLEGAL_DATA_VALUE = 3,
+        /// The request could not be carried out
+        EXCEPTION_SERVER_DEVICE_FAILURE = 4,
+    } Exceptions;
+
+    /**
+        The progress of a master request.
+    **/
+    typedef enum {
+        /// No request has been made
+        REQUEST_IDLE,
+        /// Waiting for the response
+        REQUEST_PENDING,
+        /// The response was received; read values are in Values()
+        REQUEST_DONE,
+        /// The slave answered with an exception; see RequestException()
+        REQUEST_EXCEPTION,
+        /// No valid response arrived in time
+        REQUEST_TIMEOUT,
+    } RequestStates;
+
+    /**
+        The slave register map callback.
+
+        Reads fill \a values with \a count entries starting at \a address;
+        writes store them. Coils and discrete inputs use one entry per bit,
+        with a value of 0 or 1. Large bit requests arrive in several calls of
+        up to #MODBUS_VALUES_MAX entries.
+
+        Return EXCEPTION_NONE on success or the exception to send back.
+    **/
+    typedef Exceptions (*RegisterCallback)(RegisterTypes type,
+                                           uint16_t address, uint16_t count,
+                                           uint16_t *values, bool write);
+
+    /**
+        \brief Construct a Modbus RTU master on a serial port.
+
+        \param[in] port The serial port. It must be opened in UART mode
+        before Poll() is called.
+    **/
+    explicit ModbusRtu(SerialBase &port);
+
+    /**
+        \brief Answer requests as a slave.
+
+        \code{.cpp}
+        Modbus.SlaveMode(1, RegisterMap);
+        \endcode
+
+        \param[in] unitId This slave's address, 1 to 247.
+        \param[in] callback The register map.
+
+        \return True if the slave mode was accepted.
+    **/
+    bool SlaveMode(uint8_t unitId, RegisterCallback callback);
+
+    /**
+        \brief Send requests as the bus master. This is the default.
+
+        \code{.cpp}
+        Modbus.MasterMode();
+        \endcode
+    **/
+    void MasterMode();
+
+    /**
+        \brief Send a read request.
+
+        \code{.cpp}
+        // Read holding registers 100 to 109 of slave 3
+        Modbus.ReadRequest(3, ModbusRtu::HOLDING_REGISTER, 100, 10);
+        \endcode
+
+        \param[in] unitId The slave address, 1 to 247.
+        \param[in] type The table to read.
+        \param[in] address The first entry to read.
+        \param[in] count The number of entries, 1 to #MODBUS_VALUES_MAX.
+
+        \return True if the request was sent; false in slave mode, while
+        another request is pending, or if the arguments are invalid.
+    **/
+    bool ReadRequest(uint8_t unitId, RegisterTypes type, uint16_t address,
+                     uint16_t count);
+
+    /**
+        \brief Send a write request.
+
+        A single entry is written with function 5 or 6, several with function
+        15 or 16. Unit 0 broadcasts the write; it has no response, so the
+        request is done once it has been sent.
+
+        \code{.cpp}
+        // Write two holding registers of slave 3
+        uint16_t values[] = {1200, 35};
+        Modbus.WriteRequest(3, ModbusRtu::HOLDING_REGISTER, 20, 2, values);
+        \endcode
+
+        \param[in] unitId The slave address, 1 to 247, or 0 to broadcast.
+        \param[in] type The table to write, COIL or HOLDING_REGISTER.
+        \param[in] address The first entry to write.
+        \param[in] count The number of entries, 1 to #MODBUS_VALUES_MAX.
+        \param[in] values The entries to write; coils are 0 or non-zero.
+
+        \return True if the request was sent.
+    **/
+    bool WriteRequest(uint8_t unitId, RegisterTypes type, uint16_t address,
+                      uint16_t count, const uint16_t *values);
+
+    /**
+        \brief The progress of the last master request.
+    **/
+    RequestStates RequestState() {
+        return m_requestState;
+    }
+
+    /**
+        \brief The exception code of a REQUEST_EXCEPTION response.
+    **/
+    Exceptions RequestException() {
+        return m_requestException;
+    }
+
+    /**
+        \brief The values returned by the last read request, one entry per
+        register or bit.
+
+        \code{.cpp}
+        if (Modbus.RequestState() == ModbusRtu::REQUEST_DONE) {
+            uint16_t speed = Modbus.Values()[0];
+        }
+        \endcode
+    **/
+    const uint16_t *Values() {
+        return m_values;
+    }
+
+    /**
+        \brief Set how long the master waits for a response.
+
+        \param[in] timeoutMs The response timeout, in milliseconds.
+    **/
+    void ResponseTimeout(uint32_t timeoutMs) {
+        m_responseTimeoutMs = timeoutMs;
+    }
+
+    /**
+        \brief Set the silent interval that ends a frame.
+
+        By default the interval is 3.5 character times, or 1750 us above
+        19200 baud as the Modbus standard recommends. Devices that keep their
+        frames tight at high baud rates may use a shorter interval for faster
+        turnaround.
+
+        \code{.cpp}
+        // 3.5 character times at 1 Mbaud
+        Modbus.FrameGap(39);
+        \endcode
+
+        \param[in] microseconds The interval, or 0 for the default.
+    **/
+    void FrameGap(uint32_t microseconds);
+
+    /**
+        \brief The number of frames dropped for a bad CRC, length, or
+        content.
+    **/
+    uint32_t FrameErrors() {
+        return m_frameErrors;
+    }
+
+    /**
+        \brief Receive and handle frames, and time out master requests.
+
+        Call repeatedly from the main loop.
+    **/
+    void Poll();
+
+    /**
+        \brief Compute the Modbus CRC-16 of a block of data.
+
+        \code{.cpp}
+        uint8_t frame[] = {0x01, 0x03, 0x00, 0x00, 0x00, 0x01};
+        uint16_t crc = ModbusRtu::Crc16(frame, sizeof(frame));
+        \endcode
+
+        \param[in] data The data.
+        \param[in] length The number of bytes.
+
+        \return The CRC. The low byte is sent first.
+    **/
+    static uint16_t Crc16(const uint8_t *data, uint16_t length);
+
+private:
+    SerialBase &m_port;
+
+    bool m_slave;
+    uint8_t m_unitId;
+    RegisterCallback m_callback;
+
+    // Frame buffers
+    uint8_t m_rxFrame[MODBUS_FRAME_MAX];
+    uint16_t m_rxLength;
+    bool m_rxOverflow;
+    uint8_t m_txFrame[MODBUS_FRAME_MAX];
+
+    // Silent interval that ends a frame
+    uint32_t m_frameGapUs;
+    uint32_t m_frameGapBaud;
+    uint32_t m_frameGapCycles;
+
+    // Master request in progress
+    RequestStates m_requestState;
+    Exceptions m_requestException;
+    uint8_t m_requestUnit;
+    uint8_t m_requestFunction;
+    uint16_t m_requestCount;
+    uint32_t m_requestStartMs;
+    uint32_t m_responseTimeoutMs;
+
+    uint16_t m_values[MODBUS_VALUES_MAX];
+    uint32_t m_frameErrors;
+
+    uint32_t FrameGapCycles();
+    bool FrameSend(uint16_t length);
+    void MasterProcess();
+    void SlaveProcess();
+    Exceptions SlaveRead(RegisterTypes type, uint16_t &length);
+    Exceptions SlaveWrite(RegisterTypes type, bool multiple,
+                          uint16_t &length);
+}; // ModbusRtu
+
+} // ClearCore namespace
+
+#endif // __MODBUSRTU_H__
@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    \file ModbusTcpServer.h
+    \brief ClearCore Modbus TCP server.
+
+    Answers Modbus TCP requests from several clients at once out of a table
+    of application data.
+**/
+
+#ifndef __MODBUSTCPSERVER_H__
+#define __MODBUSTCPSERVER_H__
+
+#include <stdint.h>
+#include "EthernetTcpClient.h"
+#include "EthernetTcpServer.h"
+#include "ModbusRtu.h"
+
+namespace ClearCore {
+
+/// The registered Modbus TCP port
+#define MODBUS_TCP_PORT 502
+
+/// The largest Modbus TCP frame: the 7-byte MBAP header and a 253-byte PDU
+#define MODBUS_TCP_FRAME_MAX 260
+
+/// The most clients a ModbusTcpServer serves at once
+#ifndef MODBUS_TCP_CLIENTS_MAX
+#define MODBUS_TCP_CLIENTS_MAX 4
+#endif
+
+/**
+    \class ModbusTcpServer
+    \brief ClearCore Modbus TCP server.
+
+    Accepts up to #MODBUS_TCP_CLIENTS_MAX connections and answers the coil,
+    discrete input, input register, and holding register read and write
+    functions (1 to 6, 15, and 16), the same set as a ModbusRtu slave.
+
+    Requests are served from a table of RegisterRange entries, each a view of
+    an array in the application: registers are read from and written to the
+    array in place, and an application struct made of 16-bit fields can be
+    mapped directly. Addresses outside the table go to an optional register
+    callback, which works like the ModbusRtu one. Every request must fall
+    within a single table entry.
+
+    Each call to Poll() handles at most one request from each client, so many
+    clients polling quickly can't hold up the main loop. A request is read
+    with a single copy out of the received TCP data once all of it has
+    arrived.
+
+    \code{.cpp}
+    struct {
+        uint16_t VelocityMax;
+        uint16_t AccelMax;
+        uint16_t Enable;
+    } Setpoints;
+    uint16_t Status[8];
+    uint8_t Outputs[1];
+
+    const ModbusTcpServer::RegisterRange RegisterMap[] = {
+        {ModbusRtu::HOLDING_REGISTER, 0, 3, &Setpoints, false},
+        {ModbusRtu::INPUT_REGISTER, 0, 8, Status, false},
+        {ModbusRtu::COIL, 0, 8, Outputs, false},
+    };
+
+    ModbusTcpServer Modbus;
+
+    int main() {
+        EthernetMgr.Setup();
+        Modbus.Begin(RegisterMap, 3);
+        while (true) {
+            Modbus.Poll();
+        }
+    }
+    \endcode
+**/
+class ModbusTcpServer {
+public:
+    /**
+        \brief A range of one Modbus table backed by application data.
+
+        Registers are an array of uint16_t, one per address. Coils and
+        discrete inputs are packed eight to a byte, with the first address in
+        the least significant bit of the first byte.
+    **/
+    typedef struct {
+        /// The table the range belongs to
+        ModbusRtu::RegisterTypes Type;
+        /// The first address of the range
+        uint16_t Address;
+        /// The number of registers or bits in the range
+        uint16_t Count;
+        /// The application data
+        void *Data;
+        /// True to refuse writes to a coil or holding register range
+        bool ReadOnly;
+    } RegisterRange;
+
+    /**
+        \brief Construct a Modbus TCP server.
+
+        \param[in] port The local port to listen on.
+    **/
+    explicit ModbusTcpServer(uint16_t port = MODBUS_TCP_PORT);
+
+    /**
+        \brief Start listening for clients.
+
+        Call after EthernetMgr.Setup(). The table is used in place, so it must
+        stay valid while the server runs.
+
+        \param[in] map The register table.
+        \param[in] mapCount The number of entries in the table.
+        \param[in] callback Called for addresses outside the table, or null
+        to answer them with an illegal data address exception.
+    **/
+    void Begin(const RegisterRange *map, uint8_t mapCount,
+               ModbusRtu::RegisterCallback callback = nullptr);
+
+    /**
+        \brief Accept new clients and answer their requests.
+
+        Call repeatedly from the main loop.
+    **/
+    void Poll();
+
+    /**
+        \brief The number of connected clients.
+    **/
+    uint8_t ClientCount();
+
+    /**
+        \brief The number of connections closed for a malformed MBAP header.
+    **/
+    uint32_t FrameErrors() {
+        return m_frameErrors;
+    }
+
+private:
+    EthernetTcpServer m_server;
+    EthernetTcpClient m_clients[MODBUS_TCP_CLIENTS_MAX];
+
+    const RegisterRange *m_map;
+    uint8_t m_mapCount;
+    ModbusRtu::RegisterCallback m_callback;
+
+    uint8_t m_rxFrame[MODBUS_TCP_FRAME_MAX];
+    uint8_t m_txFrame[MODBUS_TCP_FRAME_MAX];
+    uint16_t m_values[MODBUS_VALUES_MAX];
+    uint32_t m_frameErrors;
+
+    void ClientAccept();
+    void ClientProcess(EthernetTcpClient &client);
+    ModbusRtu::Exceptions RequestRead(ModbusRtu::RegisterTypes type,
+                                      uint16_t pduLength, uint16_t &length);
+    ModbusRtu::Exceptions RequestWrite(ModbusRtu::RegisterTypes type,
+                                       bool multiple, uint16_t pduLength,
+                                       uint16_t &length);
+    ModbusRtu::Exceptions Access(ModbusRtu::RegisterTypes type,
+                                 uint16_t address, uint16_t count,
+                                 uint8_t *data, bool write);
+    ModbusRtu::Exceptions CallbackAccess(ModbusRtu::RegisterTypes type,
+                                         uint16_t address, uint16_t count,
+                                         uint8_t *data, bool write);
+}; // ModbusTcpServer
+
+} // ClearCore namespace
+
+#endif // __MODBUSTCPSERVER_H__
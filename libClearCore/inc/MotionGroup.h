@@ -0,0 +1,548 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    \file MotionGroup.h
+    \brief ClearCore coordinated multi-axis motion group.
+
+    Drives a set of MotorDriver connectors along a straight line so that every
+    axis starts, accelerates, and arrives together.
+**/
+
+#ifndef __MOTIONGROUP_H__
+#define __MOTIONGROUP_H__
+
+#include <stdint.h>
+#include "MotorDriver.h"
+#include "StepGenerator.h"
+#include "SysConnectors.h"
+
+namespace ClearCore {
+
+/// The maximum number of motion groups that may exist at one time
+#ifndef MOTION_GROUP_MAX
+#define MOTION_GROUP_MAX 2
+#endif
+
+/// The largest arc radius, in steps, accepted by MotionGroup::MoveArc()
+#define ARC_RADIUS_MAX (1L << 24)
+
+/// The difference allowed between an arc's start and end radii (2 steps or
+/// 0.1% of the radius, whichever is larger)
+#define ARC_RADIUS_TOLERANCE 2.0f
+#define ARC_RADIUS_TOLERANCE_FRACT 0.001f
+
+/// The number of segments a MotionGroup's move queue holds; must be a power
+/// of two no larger than 128
+#ifndef MOTION_GROUP_QUEUE_LENGTH
+#define MOTION_GROUP_QUEUE_LENGTH 16
+#endif
+
+/// The junction deviation a MotionGroup starts with, in steps
+#ifndef JUNCTION_DEVIATION_DEFAULT
+#define JUNCTION_DEVIATION_DEFAULT 5
+#endif
+
+/**
+    \class MotionGroup
+    \brief ClearCore coordinated multi-axis motion group.
+
+    A MotionGroup links two or more MotorDriver connectors in Step and
+    Direction mode and moves them along a straight line in step space. A single
+    velocity profile is generated along the path using the group's velocity,
+    acceleration, and jerk limits; each axis receives its share of every
+    sample's path motion so all axes start and finish on the same sample.
+
+    While a group move is in progress the member axes refuse their own Move()
+    and MoveVelocity() commands. Calling MoveStopAbrupt() or MoveStopDecel()
+    on any member axis (or the axis stopping itself because of an alert, a
+    limit, or an E-stop) stops every axis in the group.
+
+    A path made of several straight and arc segments can be queued with
+    MoveQueueAdd() and MoveArcQueueAdd(). The group looks ahead over the
+    queued segments and passes through each corner as fast as the junction
+    deviation and the acceleration limit allow, instead of stopping at every
+    vertex.
+
+    \code{.cpp}
+    MotionGroup Gantry;
+
+    Gantry.AxisAdd(ConnectorM0);
+    Gantry.AxisAdd(ConnectorM1);
+    Gantry.VelMax(10000);
+    Gantry.AccelMax(100000);
+
+    int32_t dist[] = {4000, -3000};
+    Gantry.Move(dist);
+    while (!Gantry.StepsComplete()) {
+        continue;
+    }
+    \endcode
+
+    <div class="sd-disclaimer">For use with Step and Direction mode.</div>
+**/
+class MotionGroup {
+    friend class MotorManager;
+    friend class TestIO;
+
+public:
+    /**
+        \brief Construct and register the group with the MotorManager.
+
+        Up to #MOTION_GROUP_MAX groups may exist at once. Groups beyond that
+        limit refuse every move.
+    **/
+    MotionGroup();
+
+    /**
+        \brief Stop the group's axes and remove it from the MotorManager.
+    **/
+    ~MotionGroup();
+
+    /**
+        \brief Add a MotorDriver connector to the group.
+
+        The axes receive the entries of the distance array passed to Move() in
+        the order they were added. An axis should only belong to one group.
+
+        \code{.cpp}
+        // Make M-2 the next axis of the group
+        Gantry.AxisAdd(ConnectorM2);
+        \endcode
+
+        \param[in] motor The connector to add.
+
+        \return True if the axis was added; false if the group is full, is
+        moving, or the axis already belongs to this or another group.
+    **/
+    bool AxisAdd(MotorDriver &motor);
+
+    /**
+        \brief The number of axes in the group.
+
+        \return The number of axes added with AxisAdd().
+    **/
+    uint8_t AxisCount() {
+        return m_axisCount;
+    }
+
+    /**
+        \brief Sets the maximum velocity along the path, in step pulses per
+        second.
+
+        The path velocity is also limited to the slowest member axis' maximum
+        step rate.
+
+        \code{.cpp}
+        // Move along the path at up to 5000 step pulses/sec
+        Gantry.VelMax(5000);
+        \endcode
+
+        \param[in] velMax The new velocity limit
+
+        \note Takes effect on the next Move().
+    **/
+    void VelMax(uint32_t velMax) {
+        m_velMax = velMax;
+    }
+
+    /**
+        \brief Sets the maximum acceleration along the path, in step pulses
+        per second^2.
+
+        \code{.cpp}
+        // Accelerate along the path at up to 50000 step pulses/sec^2
+        Gantry.AccelMax(50000);
+        \endcode
+
+        \param[in] accelMax The new acceleration limit
+
+        \note Takes effect on the next Move().
+    **/
+    void AccelMax(uint32_t accelMax) {
+        m_path.AccelMax(accelMax);
+    }
+
+    /**
+        \brief Sets the maximum jerk along the path, in step pulses per
+        second^3. A value of 0 generates trapezoidal path profiles.
+
+        \code{.cpp}
+        // Shape the path's acceleration with S-curves
+        Gantry.JerkMax(2000000);
+        \endcode
+
+        \param[in] jerkMax The new jerk limit
+
+        \note Takes effect on the next Move().
+    **/
+    void JerkMax(uint32_t jerkMax) {
+        m_path.JerkMax(jerkMax);
+    }
+
+    /**
+        \brief Issues a coordinated straight-line move.
+
+        Every axis must be enabled, idle, and free of alerts and limits in the
+        direction it would travel. If any axis rejects the move none of the
+        axes move.
+
+        \code{.cpp}
+        // Move M-0 to 1000 and M-1 to 2500 together
+        int32_t posn[] = {1000, 2500};
+        Gantry.Move(posn, StepGenerator::MOVE_TARGET_ABSOLUTE);
+        \endcode
+
+        \param[in] dist An array with one distance or position per axis, in
+        the order the axes were added.
+        \param[in] moveTarget Whether the entries are relative distances or
+        absolute positions.
+
+        \return True if the move was accepted.
+    **/
+    bool Move(const int32_t *dist,
+              StepGenerator::MoveTarget moveTarget =
+                  StepGenerator::MOVE_TARGET_REL_END_POSN);
+
+    /**
+        \brief Issues a coordinated circular arc move.
+
+        The first two axes of the group form the plane of the arc, with
+        counterclockwise travel going from the positive direction of the first
+        axis toward the positive direction of the second. Any further axes move
+        linearly along with the arc to form a helix. The arc's center is given
+        relative to the start position, like the I and J words of a G2/G3
+        command. An end point equal to the start point makes a full circle.
+
+        The arc is computed on-board each sample, so the whole arc is one
+        command rather than a string of short linear moves.
+
+        \code{.cpp}
+        // Half circle of radius 1000 counterclockwise from (0, 0) to (2000, 0)
+        int32_t dist[] = {2000, 0};
+        Gantry.MoveArc(dist, 1000, 0, false);
+        \endcode
+
+        \param[in] dist An array with one distance or position per axis, in
+        the order the axes were added.
+        \param[in] centerX The arc center's offset from the start position
+        along the first axis.
+        \param[in] centerY The arc center's offset from the start position
+        along the second axis.
+        \param[in] clockwise True to travel clockwise.
+        \param[in] moveTarget Whether the entries of \a dist are relative
+        distances or absolute positions.
+
+        \return True if the move was accepted. An arc is rejected if the group
+        has fewer than two axes, if the radius is below 1 step or at least
+        #ARC_RADIUS_MAX, or if the start and end radii differ by more than the
+        allowed tolerance.
+    **/
+    bool MoveArc(const int32_t *dist, int32_t centerX, int32_t centerY,
+                 bool clockwise,
+                 StepGenerator::MoveTarget moveTarget =
+                     StepGenerator::MOVE_TARGET_REL_END_POSN);
+
+    /**
+        \brief Adds a straight-line segment to the end of the group's queued
+        path.
+
+        The queued path starts as soon as the first segment is added and
+        continues through the segments as they are added. Each time a segment
+        is added, the whole queue is planned again from its end back to the
+        segment in progress and then forward, so that every corner is taken
+        at the highest speed the junction deviation allows while the path can
+        still stop at the end of the last segment. The path slows to a stop
+        if the queue runs out, and picks up from rest when more segments are
+        added. Queued paths use trapezoidal profiles and #VelMax and
+        #AccelMax as they were when each segment was added; the jerk limit
+        applies only to Move() and MoveArc().
+
+        \code{.cpp}
+        // Outline a 2000 x 1000 rectangle without stopping at the corners
+        int32_t corners[][2] = {{2000, 0}, {0, 1000}, {-2000, 0}, {0, -1000}};
+        for (uint8_t i = 0; i < 4; i++) {
+            Gantry.MoveQueueAdd(corners[i]);
+        }
+        \endcode
+
+        \param[in] dist An array with one distance or position per axis, in
+        the order the axes were added. Absolute positions are relative to the
+        end of the queued path.
+        \param[in] moveTarget Whether the entries are relative distances or
+        absolute positions.
+
+        \return True if the segment was queued. It is rejected if the queue is
+        full, a Move() or MoveArc() is in progress, or an axis would refuse
+        the move.
+    **/
+    bool MoveQueueAdd(const int32_t *dist,
+                      StepGenerator::MoveTarget moveTarget =
+                          StepGenerator::MOVE_TARGET_REL_END_POSN);
+
+    /**
+        \brief Adds a circular arc segment to the end of the group's queued
+        path.
+
+        The arc is given as for MoveArc() and queued as for MoveQueueAdd().
+        The speed along the arc is also held down so that the centripetal
+        acceleration stays within #AccelMax.
+
+        \code{.cpp}
+        // A slot: two straight sides with half-circle ends
+        int32_t side[] = {4000, 0};
+        int32_t end[] = {0, 1000};
+        Gantry.MoveQueueAdd(side);
+        Gantry.MoveArcQueueAdd(end, 0, 500, false);
+        side[0] = -4000;
+        end[1] = -1000;
+        Gantry.MoveQueueAdd(side);
+        Gantry.MoveArcQueueAdd(end, 0, -500, false);
+        \endcode
+
+        \param[in] dist An array with one distance or position per axis.
+        \param[in] centerX The arc center's offset from the segment's start
+        along the first axis.
+        \param[in] centerY The arc center's offset from the segment's start
+        along the second axis.
+        \param[in] clockwise True to travel clockwise.
+        \param[in] moveTarget Whether the entries of \a dist are relative
+        distances or absolute positions.
+
+        \return True if the segment was queued.
+    **/
+    bool MoveArcQueueAdd(const int32_t *dist, int32_t centerX,
+                         int32_t centerY, bool clockwise,
+                         StepGenerator::MoveTarget moveTarget =
+                             StepGenerator::MOVE_TARGET_REL_END_POSN);
+
+    /**
+        \brief The number of queued segments that have not been finished,
+        including the one in progress.
+
+        \code{.cpp}
+        // Keep the lookahead fed
+        if (Gantry.MoveQueueCount() < MOTION_GROUP_QUEUE_LENGTH) {
+            Gantry.MoveQueueAdd(nextPoint, StepGenerator::MOVE_TARGET_ABSOLUTE);
+        }
+        \endcode
+    **/
+    uint8_t MoveQueueCount() {
+        return static_cast<uint8_t>(m_queueHead - m_queueTail);
+    }
+
+    /**
+        \brief Sets how far the path may be imagined to round off a corner,
+        in steps, when working out the speed through the corner.
+
+        The speed through a corner is that of a circle tangent to both
+        segments whose edge passes this far from the vertex, at the
+        acceleration limit. The path itself still goes through the vertex.
+        A larger deviation takes corners faster; 0 stops at every corner.
+        Segments that continue in the same direction are always joined at
+        full speed.
+
+        \code{.cpp}
+        Gantry.JunctionDeviation(20);
+        \endcode
+
+        \param[in] steps The junction deviation.
+
+        \note Takes effect on the next segment added.
+    **/
+    void JunctionDeviation(uint32_t steps) {
+        m_junctionDeviation = steps;
+    }
+
+    /**
+        \brief Stops every axis in the group immediately.
+
+        \code{.cpp}
+        Gantry.MoveStopAbrupt();
+        \endcode
+    **/
+    void MoveStopAbrupt() {
+        m_stopRequest = StepGenerator::EXTERNAL_STOP_ABRUPT;
+    }
+
+    /**
+        \brief Ramps the group to a stop along the path using the path
+        acceleration limit. A queued path stops where the ramp ends and the
+        rest of the queue is dropped.
+
+        \code{.cpp}
+        Gantry.MoveStopDecel();
+        \endcode
+    **/
+    void MoveStopDecel() {
+        if (m_stopRequest == StepGenerator::EXTERNAL_STOP_NONE) {
+            m_stopRequest = StepGenerator::EXTERNAL_STOP_DECEL;
+        }
+    }
+
+    /**
+        \brief Scales the speed along the path, from 0 to 200 percent.
+
+        The path runs faster or slower in time and its axes stay coordinated,
+        as described for StepGenerator::FeedOverride(). The override carries
+        over to later group moves. The overrides of the individual axes do
+        not apply while they are in a group move.
+
+        \code{.cpp}
+        // Feed hold
+        Gantry.FeedOverride(0);
+        \endcode
+
+        \param[in] percent The new override, in percent of the commanded
+        speed. Values above 200 are clipped.
+    **/
+    void FeedOverride(uint16_t percent) {
+        m_path.FeedOverride(percent);
+    }
+
+    /**
+        \brief The path's feed-rate override in effect, in percent.
+    **/
+    uint16_t FeedOverrideCurrent() {
+        return m_path.FeedOverrideCurrent();
+    }
+
+    /**
+        \brief Check whether the group has finished its move.
+
+        \code{.cpp}
+        if (Gantry.StepsComplete()) {
+            // All axes have reached the end of the path
+        }
+        \endcode
+
+        \return True if no group move is in progress.
+    **/
+    bool StepsComplete() {
+        return !m_active;
+    }
+
+#ifndef HIDE_FROM_DOXYGEN
+    /**
+        \brief Advance the path by one sample. Called from the fast update
+        before the motor connectors are refreshed.
+    **/
+    void Update();
+#endif
+
+private:
+    // The path profile reuses the StepGenerator's velocity planner; the
+    // "position" it generates is the distance travelled along the line.
+    class PathGenerator : public StepGenerator {
+        friend class MotionGroup;
+        virtual void OutputDirection() override {}
+    };
+
+    // The geometry of one straight or arc move. The length of the path is
+    // in steps. The ratio of each axis' travel to the path length is held in
+    // Q31 so the axis position is one multiply per sample. The arc is in the
+    // plane of the first two axes; its angle is binary, with 2^32 counts per
+    // turn, and advances with the path position. The radius moves from the
+    // start radius to the end radius along the way, so the arc meets the end
+    // point without a jump.
+    struct Segment {
+        int32_t Length;
+        int32_t AxisStart[MOTOR_CON_CNT];
+        int32_t AxisDist[MOTOR_CON_CNT];
+        int64_t AxisRatioQ31[MOTOR_CON_CNT];
+        bool Arc;
+        int32_t ArcCenter[2];
+        int64_t ArcRadiusQ8;
+        int64_t ArcRadiusRateQ40;
+        uint32_t ArcAngleStart;
+        int64_t ArcRatioQ16;
+    };
+
+    // A segment of the queued path. The planner works in steps and samples
+    // in the main loop; the sample rate interrupt follows the Qx plan, which
+    // is only written with the interrupt held off.
+    struct QueuedSegment {
+        Segment Geometry;
+        // The speed limit along the segment and into its start
+        float VelMax;
+        float JunctionVelMax;
+        float Accel;
+        // The planned speeds at the ends
+        float VelEntry;
+        float VelExit;
+        int32_t VelCruiseQx;
+        int32_t VelExitQx;
+        int32_t AccelQx;
+    };
+
+    PathGenerator m_path;
+    MotorDriver *m_axes[MOTOR_CON_CNT];
+    uint8_t m_axisCount;
+    uint32_t m_velMax;
+    volatile bool m_active;
+    volatile StepGenerator::ExternalStopRequests m_stopRequest;
+
+    // The geometry of the Move() or MoveArc() in progress, and where each
+    // axis was last sent
+    Segment m_move;
+    int32_t m_axisPosn[MOTOR_CON_CNT];
+
+    // The queued path. The main loop adds at the head and the interrupt
+    // finishes segments at the tail; the segment at the tail is in progress.
+    // The end of the path and the direction there are only used by the
+    // main loop.
+    QueuedSegment m_queue[MOTION_GROUP_QUEUE_LENGTH];
+    volatile uint8_t m_queueHead;
+    volatile uint8_t m_queueTail;
+    volatile bool m_queueActive;
+    bool m_queueStopping;
+    int64_t m_queuePosnQx;
+    int32_t m_queueVelQx;
+    int32_t m_queueEnd[MOTOR_CON_CNT];
+    float m_queueDirEnd[MOTOR_CON_CNT];
+    uint32_t m_junctionDeviation;
+    bool m_registered;
+
+    bool MoveValidate(const int32_t *dist,
+                      StepGenerator::MoveTarget moveTarget, int32_t *distRel,
+                      uint32_t &stepsPerSampleMax);
+    bool SegmentLine(Segment &seg, const int32_t *start,
+                     const int32_t *distRel);
+    bool SegmentArc(Segment &seg, const int32_t *start,
+                    const int32_t *distRel, int32_t centerX, int32_t centerY,
+                    bool clockwise, uint32_t &stepsPerSampleMax);
+    void SegmentDirections(const Segment &seg, float *dirStart,
+                           float *dirEnd);
+    bool MoveStart(uint32_t stepsPerSampleMax);
+    bool QueueAdd(const int32_t *dist, StepGenerator::MoveTarget moveTarget,
+                  bool arc, int32_t centerX, int32_t centerY, bool clockwise);
+    void QueuePlan(uint8_t first, uint8_t end, float velEntry);
+    void QueueUpdate(StepGenerator::ExternalStopRequests stop);
+    void AxesTargetsSend(const Segment &seg, int32_t posn, bool end);
+    void AxesAcquire();
+    void AxesRelease();
+    bool AxesCarrying();
+}; // MotionGroup
+
+} // ClearCore namespace
+
+#endif // __MOTIONGROUP_H__
@@ -0,0 +1,287 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    \file MotionUnits.h
+    \brief Compile-time conversion of motion parameters to step units.
+
+    An axis type holds its steps per user unit as template parameters, so a
+    move written in millimeters or revolutions is converted to the step
+    pulses, steps/sec, and steps/sec^2 that StepGenerator takes when the
+    program is compiled. Values that the StepGenerator would clip or round
+    away fail to compile when converted in a constant expression.
+**/
+
+#ifndef __MOTIONUNITS_H__
+#define __MOTIONUNITS_H__
+
+#include <stdint.h>
+#include "StepGenerator.h"
+#include "SysTiming.h"
+
+namespace ClearCore {
+
+/** The fastest velocity, in steps/sec, that VelMax() can hold in its
+    fixed-point per-sample form. **/
+#define UNITS_VEL_LIMIT \
+    (static_cast<int64_t>(INT32_MAX >> FRACT_BITS) * _CLEARCORE_SAMPLE_RATE_HZ)
+
+/** The slowest acceleration, in steps/sec^2, that AccelMax() doesn't round
+    up. **/
+#define UNITS_ACCEL_MIN \
+    ((2LL * _CLEARCORE_SAMPLE_RATE_HZ * _CLEARCORE_SAMPLE_RATE_HZ + \
+      (1LL << FRACT_BITS) - 1) >> FRACT_BITS)
+
+/** The slowest jerk, in steps/sec^3, that JerkMax() doesn't round up. **/
+#define UNITS_JERK_MIN \
+    ((1LL * _CLEARCORE_SAMPLE_RATE_HZ * _CLEARCORE_SAMPLE_RATE_HZ * \
+      _CLEARCORE_SAMPLE_RATE_HZ + (1LL << (FRACT_BITS + JERK_FRACT_BITS)) - \
+      1) >> (FRACT_BITS + JERK_FRACT_BITS))
+
+/**
+    \brief A distance in step pulses.
+**/
+struct Steps {
+    int32_t Value; ///< The step pulses
+    constexpr explicit Steps(int32_t value) : Value(value) {}
+    /// Pass to Move() and the other functions that take steps
+    constexpr operator int32_t() const {
+        return Value;
+    }
+};
+
+/**
+    \brief A velocity in steps/sec.
+**/
+struct StepsPerSec {
+    int32_t Value; ///< The steps/sec
+    constexpr explicit StepsPerSec(int32_t value) : Value(value) {}
+    /// Pass to VelMax() and MoveVelocity()
+    constexpr operator int32_t() const {
+        return Value;
+    }
+};
+
+/**
+    \brief An acceleration in steps/sec^2.
+**/
+struct StepsPerSec2 {
+    uint32_t Value; ///< The steps/sec^2
+    constexpr explicit StepsPerSec2(uint32_t value) : Value(value) {}
+    /// Pass to AccelMax() and EStopDecelMax()
+    constexpr operator uint32_t() const {
+        return Value;
+    }
+};
+
+/**
+    \brief A jerk in steps/sec^3.
+**/
+struct StepsPerSec3 {
+    uint32_t Value; ///< The steps/sec^3
+    constexpr explicit StepsPerSec3(uint32_t value) : Value(value) {}
+    /// Pass to JerkMax()
+    constexpr operator uint32_t() const {
+        return Value;
+    }
+};
+
+#ifndef HIDE_FROM_DOXYGEN
+// Not constexpr on purpose: reaching one of these while evaluating a
+// constant expression is a compile error naming the problem. Reached at
+// run time, they saturate instead.
+inline int64_t UnitsOutOfRange(int64_t limit) {
+    return limit;
+}
+inline int64_t UnitsBelowMinimum(int64_t minimum) {
+    return minimum;
+}
+
+constexpr int64_t UnitsRound(double value) {
+    return static_cast<int64_t>(value + (value < 0 ? -0.5 : 0.5));
+}
+
+constexpr int64_t UnitsRoundDiv(int64_t num, int64_t den) {
+    return (num + (num < 0 ? -den / 2 : den / 2)) / den;
+}
+
+constexpr int64_t UnitsCheck(int64_t value, int64_t low, int64_t high) {
+    return value > high ? UnitsOutOfRange(high) :
+           value < low ? UnitsOutOfRange(low) : value;
+}
+
+// Limits a rate to its minimum, but lets zero through
+constexpr int64_t UnitsCheckMin(int64_t value, int64_t minimum) {
+    return value && value < minimum ? UnitsBelowMinimum(minimum) : value;
+}
+#endif
+
+/**
+    \brief Check that a velocity fits the step output.
+
+    The fastest velocity is the step output clock rate, set with
+    MotorManager::MotorInputClocking().
+
+    \code{.cpp}
+    static_assert(UnitsVelocityFits(Spindle::PerMinute(3000), 2000000),
+                  "3000 RPM needs a faster step clock");
+    \endcode
+
+    \param[in] vel The velocity.
+    \param[in] stepRateHz The step output clock rate (Hz).
+**/
+constexpr bool UnitsVelocityFits(StepsPerSec vel, uint32_t stepRateHz) {
+    return (vel.Value < 0 ? -static_cast<int64_t>(vel.Value) : vel.Value) <=
+           stepRateHz;
+}
+
+/**
+    \brief The conversions for an axis with \a STEPS step pulses for every
+    \a UNITS user units.
+
+    Conversions from a constant fold to a constant, and a value that is out
+    of range for the StepGenerator fails to compile: distances and
+    velocities past what it can hold, and accelerations and jerks slow
+    enough that it would round them up. Conversions from whole units at
+    run time take integer math only.
+
+    \code{.cpp}
+    // A 5 mm lead screw on an 800 step/rev motor: 800 steps per 5 mm
+    typedef AxisUnits<800, 5> Gantry;
+    // 20000 steps/sec
+    constexpr StepsPerSec fast = Gantry::Velocity(125.0);
+
+    ConnectorM0.VelMax(fast);
+    ConnectorM0.AccelMax(Gantry::Accel(2000.0));
+    ConnectorM0.Move(Gantry::Distance(250));
+
+    // A rotary table with 6400 steps/rev, in RPM
+    typedef AxisUnits<6400> Table;
+    ConnectorM1.MoveVelocity(Table::PerMinute(30));
+    \endcode
+**/
+template <uint32_t STEPS, uint32_t UNITS = 1>
+class AxisUnits {
+    static_assert(STEPS > 0 && UNITS > 0, "Steps and units must not be zero");
+    static_assert(STEPS <= INT32_MAX && UNITS <= INT32_MAX,
+                  "Steps and units must fit in an int32_t");
+
+public:
+    /// Step pulses per user unit
+    static constexpr double StepsPerUnit() {
+        return static_cast<double>(STEPS) / UNITS;
+    }
+
+    /**
+        \brief Convert a distance in user units to step pulses.
+    **/
+    static constexpr Steps Distance(double units) {
+        return Steps(UnitsCheck(UnitsRound(units * STEPS / UNITS),
+                                -INT32_MAX, INT32_MAX));
+    }
+
+    /**
+        \brief Convert a distance in whole user units to step pulses.
+    **/
+    static constexpr Steps Distance(int32_t units) {
+        return Steps(UnitsCheck(UnitsRoundDiv(static_cast<int64_t>(units) *
+                                              STEPS, UNITS),
+                                -INT32_MAX, INT32_MAX));
+    }
+
+    /**
+        \brief Convert a velocity in user units/sec to steps/sec.
+    **/
+    static constexpr StepsPerSec Velocity(double unitsPerSec) {
+        return StepsPerSec(UnitsCheck(UnitsRound(unitsPerSec * STEPS / UNITS),
+                                      -UNITS_VEL_LIMIT, UNITS_VEL_LIMIT));
+    }
+
+    /**
+        \brief Convert a velocity in whole user units/sec to steps/sec.
+    **/
+    static constexpr StepsPerSec Velocity(int32_t unitsPerSec) {
+        return StepsPerSec(UnitsCheck(
+                               UnitsRoundDiv(static_cast<int64_t>(unitsPerSec) *
+                                             STEPS, UNITS),
+                               -UNITS_VEL_LIMIT, UNITS_VEL_LIMIT));
+    }
+
+    /**
+        \brief Convert a velocity in user units/minute, such as RPM for an
+        axis in revolutions, to steps/sec.
+    **/
+    static constexpr StepsPerSec PerMinute(double unitsPerMin) {
+        return Velocity(unitsPerMin / 60);
+    }
+
+    /**
+        \brief Convert a velocity in whole user units/minute to steps/sec.
+    **/
+    static constexpr StepsPerSec PerMinute(int32_t unitsPerMin) {
+        return StepsPerSec(UnitsCheck(
+                               UnitsRoundDiv(static_cast<int64_t>(unitsPerMin) *
+                                             STEPS, 60LL * UNITS),
+                               -UNITS_VEL_LIMIT, UNITS_VEL_LIMIT));
+    }
+
+    /**
+        \brief Convert an acceleration in user units/sec^2 to steps/sec^2.
+    **/
+    static constexpr StepsPerSec2 Accel(double unitsPerSec2) {
+        return StepsPerSec2(UnitsCheckMin(UnitsCheck(
+                                UnitsRound(unitsPerSec2 * STEPS / UNITS),
+                                0, UINT32_MAX), UNITS_ACCEL_MIN));
+    }
+
+    /**
+        \brief Convert an acceleration in whole user units/sec^2 to
+        steps/sec^2.
+    **/
+    static constexpr StepsPerSec2 Accel(int32_t unitsPerSec2) {
+        return StepsPerSec2(UnitsCheckMin(UnitsCheck(
+                                UnitsRoundDiv(static_cast<int64_t>(
+                                                  unitsPerSec2) * STEPS,
+                                              UNITS),
+                                0, UINT32_MAX), UNITS_ACCEL_MIN));
+    }
+
+    /**
+        \brief Convert a jerk in user units/sec^3 to steps/sec^3.
+    **/
+    static constexpr StepsPerSec3 Jerk(double unitsPerSec3) {
+        return StepsPerSec3(UnitsCheckMin(UnitsCheck(
+                                UnitsRound(unitsPerSec3 * STEPS / UNITS),
+                                0, UINT32_MAX), UNITS_JERK_MIN));
+    }
+
+    /**
+        \brief Convert step pulses back to user units, for display.
+    **/
+    static constexpr double Units(int32_t steps) {
+        return static_cast<double>(steps) * UNITS / STEPS;
+    }
+};
+
+} // ClearCore namespace
+
+#endif // __MOTIONUNITS_H__
@@ -30,12 +30,16 @@
 #include <stdint.h>
 #include "Connector.h"
 #include "DigitalIn.h"
+#include "DmaManager.h"
+#include "DspFilter.h"
 #include "PeripheralRoute.h"
+#include "PositionCapture.h"
 #include "ShiftRegister.h"
 #include "StatusManager.h"
 #include "StepGenerator.h"
 #include "SysUtils.h"
 #include "SysManager.h"
+#include "SysTiming.h"
 
 #define HLFB_CARRIER_LOSS_ERROR_LIMIT (0)
 #define HLFB_CARRIER_LOSS_STATE_CHANGE_MS_45_HZ (25)
@@ -44,9 +48,11 @@
 namespace ClearCore {
 
 /** The amount of HLFB captures to hold onto.
-    This should remain 2, as we only care about 1 capture back due to clipping
-    of the last PWM to assert move done/shutdown. **/
-#define CPM_HLFB_CAP_HISTORY 2
+    The DMA writes each period/width capture into a ring of this length (a
+    power of two). The newest capture is never used because the last PWM
+    period may be clipped to assert move done/shutdown; the rest are averaged.
+    **/
+#define CPM_HLFB_CAP_HISTORY 8
 
 /**
     Delay before the motor is considered to be enabled after an enable request.
@@ -58,6 +64,8 @@ namespace ClearCore {
 
 extern SysManager SysMgr;
 
+class DigitalInOutAnalogOut;
+
 /**
     \brief ClearCore motor connector class.
 
@@ -77,6 +85,7 @@ extern SysManager SysMgr;
     out the \ref ConnectorMain informational page.
 **/
 class MotorDriver : public DigitalIn, public StepGenerator {
+    friend class InputManager;
     friend class MotorManager;
     friend class StatusManager;
     friend class SysManager;
@@ -420,11 +429,303 @@ public:
     virtual bool Move(int32_t dist,
                       MoveTarget moveTarget = MOVE_TARGET_REL_END_POSN) override;
 
+    /**
+        \copydoc StepGenerator::MoveQueueAdd()
+    **/
+    virtual bool MoveQueueAdd(int32_t dist,
+                              MoveTarget moveTarget = MOVE_TARGET_REL_END_POSN) override;
+
     /**
         \copydoc StepGenerator::MoveVelocity()
     **/
     virtual bool MoveVelocity(int32_t velocity) override;
 
+    /**
+        \copydoc StepGenerator::GearingStart()
+
+        The MotorDriver follows the Encoder Input (EncoderIn).
+    **/
+    virtual bool GearingStart(int16_t numerator,
+                              uint16_t denominator) override;
+
+    /**
+        \brief Slaves the motor to any count that changes each sample, with a
+        fixed gear ratio.
+
+        Works as GearingStart(int16_t, uint16_t), but follows \a source
+        instead of the Encoder Input.
+
+        \code{.cpp}
+        // Send 4 steps for every pulse from another controller
+        InputMgr.StepInputStart(ConnectorDI7, ConnectorDI8);
+        ConnectorM0.GearingStart(InputMgr.StepInputStepsLastSample(), 4, 1);
+        \endcode
+
+        \param[in] source The count moved in the last sample time.
+        \param[in] numerator The step pulses per denominator counts.
+        Negative values reverse the direction.
+        \param[in] denominator The counts per numerator step pulses. Must
+        not be zero.
+
+        \return True if gearing was started.
+    **/
+    bool GearingStart(volatile const int16_t &source, int16_t numerator,
+                      uint16_t denominator);
+
+    /**
+        \copydoc StepGenerator::CamStart()
+    **/
+    virtual bool CamStart(const CamTable &cam,
+                          volatile const int32_t &masterPosn) override;
+
+    /**
+        \brief Slaves the MotorDriver to the Encoder Input through a cam
+        table.
+
+        Identical to CamStart(const CamTable &, volatile const int32_t &) with
+        the Encoder Input's count as the master position.
+
+        \code{.cpp}
+        ConnectorM0.CamStart(knife);
+        \endcode
+
+        \param[in] cam The cam table.
+
+        \return True if the cam was started.
+
+        <div class="sd-disclaimer">For use with Step and Direction mode.</div>
+    **/
+    bool CamStart(const CamTable &cam);
+
+    using StepGenerator::PositionLoopStart;
+
+    /**
+        \brief Closes a position loop around the motor through the Encoder
+        Input.
+
+        Identical to PositionLoopStart(const PositionLoop &,
+        volatile const int32_t &) with the Encoder Input's count as the
+        feedback.
+
+        \code{.cpp}
+        static const StepGenerator::PositionLoop loop = {1, 5, 50, 2, 4, 200};
+        ConnectorM0.PositionLoopStart(loop);
+        \endcode
+
+        \param[in] loop The loop settings.
+
+        \return True if the loop was started.
+
+        <div class="sd-disclaimer">For use with Step and Direction mode.</div>
+    **/
+    bool PositionLoopStart(const PositionLoop &loop);
+
+    /**
+        \brief Feed-forward output settings.
+
+        The output, in percent of its full scale, is
+        Offset + VelGain * velocity + AccelGain * acceleration, with the
+        commanded velocity in steps/sec and acceleration in steps/sec^2,
+        signed by direction.
+    **/
+    typedef struct {
+        /// The output with the axis at rest, in percent
+        float Offset;
+        /// Percent of output per step/sec
+        float VelGain;
+        /// Percent of output per step/sec^2
+        float AccelGain;
+    } FeedForward;
+
+    /**
+        \brief Send the commanded velocity and acceleration to another
+        motor's Input A PWM.
+
+        Drives a second controller, such as a ClearPath-MC in a torque mode,
+        with a signal computed from this axis' motion profile every sample,
+        so a high-inertia axis gets its torque ahead of the following error.
+        The PWM takes effect at the same time as the steps computed with it.
+        The output holds at \a Offset after FeedForwardStop().
+
+        \code{.cpp}
+        // Zero torque at 50% duty, plus 1% per 1000 steps/sec^2
+        static const MotorDriver::FeedForward ff = {50, 0, 0.001};
+        ConnectorM1.Mode(Connector::CPM_MODE_A_PWM_B_PWM);
+        ConnectorM0.FeedForwardStart(ff, ConnectorM1);
+        \endcode
+
+        \param[in] ff The output settings.
+        \param[in] output The motor whose Input A PWM is driven. It must be
+        in #CPM_MODE_A_PWM_B_PWM.
+
+        \return True if the output was started.
+
+        <div class="sd-disclaimer">For use with Step and Direction mode.</div>
+    **/
+    bool FeedForwardStart(const FeedForward &ff, MotorDriver &output);
+
+    /**
+        \brief Send the commanded velocity and acceleration to IO-0's analog
+        output.
+
+        As FeedForwardStart(const FeedForward &, MotorDriver &), but on the
+        DAC. The DAC changes as soon as it is written, so the value is held
+        back one sample to line up with the steps.
+
+        \code{.cpp}
+        ConnectorIO0.Mode(Connector::OUTPUT_ANALOG);
+        ConnectorM0.FeedForwardStart(ff, ConnectorIO0);
+        \endcode
+
+        \param[in] ff The output settings.
+        \param[in] output The analog output. It must be in #OUTPUT_ANALOG
+        mode.
+
+        \return True if the output was started.
+
+        <div class="sd-disclaimer">For use with Step and Direction mode.</div>
+    **/
+    bool FeedForwardStart(const FeedForward &ff, DigitalInOutAnalogOut &output);
+
+    /**
+        \brief Stop the feed-forward output, leaving it at its offset.
+
+        <div class="sd-disclaimer">For use with Step and Direction mode.</div>
+    **/
+    void FeedForwardStop();
+
+    /**
+        \brief The stages of an on-board homing sequence.
+
+        \see HomingStart()
+    **/
+    typedef enum {
+        /**
+            No homing sequence has been run since the last HomingCancel().
+        **/
+        HOMING_IDLE,
+        /**
+            Moving toward the home switch at the seek velocity.
+        **/
+        HOMING_SEEK,
+        /**
+            Moving off the home switch at the seek velocity.
+        **/
+        HOMING_BACK_OFF,
+        /**
+            Moving toward the home switch at the approach velocity.
+        **/
+        HOMING_APPROACH,
+        /**
+            Moving off the home switch at the approach velocity until the
+            Encoder Input sees an index pulse.
+        **/
+        HOMING_INDEX,
+        /**
+            Stopping after one of the moving stages.
+        **/
+        HOMING_STOPPING,
+        /**
+            Homing finished and the position reference has been set.
+        **/
+        HOMING_COMPLETE,
+        /**
+            Homing was canceled by an alert, a disable, an E-stop, a stop
+            command, or a stage that did not find its switch or index.
+        **/
+        HOMING_FAILED
+    } HomingStates;
+
+    /**
+        \brief Home the motor against its limit switch from the sample rate
+        interrupt.
+
+        The sequence seeks into the limit switch set by LimitSwitchNeg() (or
+        LimitSwitchPos()) at \a seekVel, backs off it by at least
+        \a backOffDist, and approaches it again at \a approachVel. The
+        commanded position seen at the switch edge on the approach becomes
+        \a homePosn. With a nonzero \a indexSearchDist the motor then moves
+        back off the switch at \a approachVel and the position at the next
+        Encoder Input index pulse becomes \a homePosn instead.
+
+        When the switch is on a connector with an external interrupt, its
+        edge on the approach is timed by the interrupt, ahead of the input
+        filter, and the position is taken back along the commanded velocity
+        to that time. The home position then repeats to within a step or so
+        at any \a approachVel. A switch on a CCIO-8 pin, or one whose
+        interrupt is in use by a PositionCapture, is only checked every
+        sample time once its input filter settles, so the home position
+        repeats to within the distance travelled in one sample at
+        \a approachVel. The index pulse is always checked every sample
+        time.
+
+        Each stage accelerates at the limit set by AccelMax() and stops at
+        the EStopDecelMax() rate, as MoveStopDecel() does. Moves commanded
+        while homing are rejected.
+
+        \code{.cpp}
+        ConnectorM0.LimitSwitchNeg(CLEARCORE_PIN_IO4);
+        // Home at the negative switch: seek at 2000 steps/s, back off 400
+        // steps, then approach at 100 steps/s
+        ConnectorM0.HomingStart(true, 2000, 100, 400);
+        while (ConnectorM0.HomingState() != MotorDriver::HOMING_COMPLETE) {
+            if (ConnectorM0.HomingState() == MotorDriver::HOMING_FAILED) {
+                break;
+            }
+        }
+        \endcode
+
+        \param[in] negDirection True to home against the negative limit
+        switch; false to home against the positive limit switch.
+        \param[in] seekVel The speed of the seek and back off stages, in
+        step pulses per second.
+        \param[in] approachVel The speed of the approach and index stages,
+        in step pulses per second.
+        \param[in] backOffDist The minimum distance to back off the switch,
+        in steps.
+        \param[in] indexSearchDist The farthest to travel looking for an
+        index pulse, in steps. 0 skips the index stage.
+        \param[in] homePosn The commanded position assigned to home.
+
+        \return True if homing started; false if the motor is moving, the
+        limit switch is not set, a velocity is 0, or the move would be
+        rejected.
+
+        <div class="sd-disclaimer">For use with Step and Direction mode.</div>
+    **/
+    bool HomingStart(bool negDirection, uint32_t seekVel,
+                     uint32_t approachVel, uint32_t backOffDist,
+                     uint32_t indexSearchDist = 0, int32_t homePosn = 0);
+
+    /**
+        \brief The current stage of the homing sequence.
+
+        \code{.cpp}
+        if (ConnectorM0.HomingState() == MotorDriver::HOMING_COMPLETE) {
+            // M-0 is homed
+        }
+        \endcode
+
+        \return The homing stage.
+
+        <div class="sd-disclaimer">For use with Step and Direction mode.</div>
+    **/
+    volatile const HomingStates &HomingState() {
+        return m_homingState;
+    }
+
+    /**
+        \brief Stop a homing sequence in progress and return to
+        #HOMING_IDLE.
+
+        \code{.cpp}
+        ConnectorM0.HomingCancel();
+        \endcode
+
+        <div class="sd-disclaimer">For use with Step and Direction mode.</div>
+    **/
+    void HomingCancel();
+
     /**
         \brief Sets the filter length in samples. The default is 3 samples.
 
@@ -590,6 +891,83 @@ public:
     **/
     bool MotorInBDuty(uint8_t duty);
 
+    /**
+        \brief The PWM on time, in counts, of a 100% duty cycle on the
+        motor's inputs.
+    **/
+    uint16_t MotorInCountMax() {
+        return m_stepsPerSampleMax;
+    }
+
+    /**
+        \brief Play a table of PWM on times on the motor's Input A, one per
+        PWM period.
+
+        The DMA writes the next entry to the timer at the end of each PWM
+        period, so a torque or velocity profile follows the carrier exactly
+        with no CPU time per entry. The table is read in place, so it must
+        stay unchanged until playback ends. MotorInADuty() calls made while
+        the table plays are overwritten at the next period. Without \a loop
+        the last entry holds once the table ends.
+
+        \code{.cpp}
+        // Ramp M-0's Input A from 0 to 100% and back over 200 PWM periods
+        static uint32_t press[200];
+        for (int i = 0; i < 200; i++) {
+            press[i] = ConnectorM0.MotorInCountMax() *
+                       (i < 100 ? i : 199 - i) / 99;
+        }
+        ConnectorM0.Mode(Connector::CPM_MODE_A_PWM_B_PWM);
+        ConnectorM0.MotorInADutyTable(press, 200);
+        \endcode
+
+        \param[in] counts The on times, 0 to MotorInCountMax().
+        \param[in] count The number of entries.
+        \param[in] loop (optional) True to repeat the table until
+        MotorInDutyTableStop(). Default: false.
+
+        \return True if playback started; false if the connector is not in
+        #CPM_MODE_A_PWM_B_PWM or no DMA channel is free.
+
+        <div class="mc-disclaimer">For use with ClearPath-MC.</div>
+    **/
+    bool MotorInADutyTable(const uint32_t *counts, uint16_t count,
+                           bool loop = false);
+
+    /**
+        \brief Play a table of PWM on times on the motor's Input B, one per
+        PWM period.
+
+        As MotorInADutyTable(), in #CPM_MODE_A_DIRECT_B_PWM or
+        #CPM_MODE_A_PWM_B_PWM.
+
+        \param[in] counts The on times, 0 to MotorInCountMax().
+        \param[in] count The number of entries.
+        \param[in] loop (optional) True to repeat the table until
+        MotorInDutyTableStop(). Default: false.
+
+        \return True if playback started.
+
+        <div class="mc-disclaimer">For use with ClearPath-MC.</div>
+    **/
+    bool MotorInBDutyTable(const uint32_t *counts, uint16_t count,
+                           bool loop = false);
+
+    /**
+        \brief Stop duty table playback on both inputs, holding the present
+        on times.
+
+        <div class="mc-disclaimer">For use with ClearPath-MC.</div>
+    **/
+    void MotorInDutyTableStop();
+
+    /**
+        \brief Check whether a duty table is playing on either input.
+
+        <div class="mc-disclaimer">For use with ClearPath-MC.</div>
+    **/
+    bool MotorInDutyTableActive();
+
     /**
         \brief Sends trigger pulse(s) to a connected ClearPath&trade; motor by
         de-asserting the enable signal for \a time_ms milliseconds.
@@ -695,6 +1073,153 @@ public:
         return m_hlfbDuty;
     }
 
+    /**
+        \brief Actions taken when the HLFB torque limit is reached.
+
+        \see HlfbTorqueLimit()
+    **/
+    typedef enum {
+        /**
+            Do not check the HLFB torque reading.
+        **/
+        TORQUE_LIMIT_OFF,
+        /**
+            Ramp the move to a stop as MoveStopDecel() does.
+        **/
+        TORQUE_LIMIT_STOP_DECEL,
+        /**
+            Stop the move immediately as MoveStopAbrupt() does.
+        **/
+        TORQUE_LIMIT_STOP_ABRUPT
+    } TorqueLimitActions;
+
+    /**
+        \brief Stop moves when the HLFB torque reading reaches a limit.
+
+        While a move is in progress, the magnitude of #HlfbPercent() is
+        compared against \a percent every sample time. When it is at or
+        above the limit for \a samples sample times in a row, \a action is
+        taken from the sample rate interrupt, so a press-to-torque move or a
+        jam stops without waiting on the main loop.
+
+        \code{.cpp}
+        // Stop M-0 when it pushes with 40% torque for 2 samples
+        ConnectorM0.HlfbMode(MotorDriver::HLFB_MODE_HAS_BIPOLAR_PWM);
+        ConnectorM0.HlfbTorqueLimit(40, 2);
+        ConnectorM0.Move(10000);
+        \endcode
+
+        \param[in] percent The torque limit, in percent.
+        \param[in] samples The number of sample times in a row the reading
+        must be at or above the limit.
+        \param[in] action What to do when the limit is reached.
+
+        \return True if the limit was set.
+
+        \note This function is only applicable when the #HlfbMode is set to
+        #HLFB_MODE_HAS_PWM or #HLFB_MODE_HAS_BIPOLAR_PWM. The HLFB reading
+        updates once per carrier period, so the response time is at least one
+        carrier period.
+    **/
+    bool HlfbTorqueLimit(float percent, uint16_t samples = 1,
+                         TorqueLimitActions action = TORQUE_LIMIT_STOP_DECEL);
+
+    /**
+        \brief Check whether the HLFB torque limit stopped a move since the
+        last call.
+
+        \code{.cpp}
+        if (ConnectorM0.HlfbTorqueLimitReached()) {
+            // M-0 reached its torque limit
+        }
+        \endcode
+
+        \return True if the torque limit was reached since the last call.
+    **/
+    bool HlfbTorqueLimitReached();
+
+    /**
+        \brief Decode the HLFB PWM as the motor's measured speed.
+
+        A ClearPath&trade; motor with its HLFB output set to measured speed
+        sends its speed as a PWM duty cycle that reaches 100% at the speed
+        chosen in its configuration. Once the equivalent speed in step
+        pulses per second is set here, each sample time HlfbSpeed() converts
+        the latest #HlfbPercent() to a velocity, optionally filtered, so
+        the motor's actual speed can be used as feedback without an
+        encoder.
+
+        In #HLFB_MODE_HAS_BIPOLAR_PWM the duty carries the direction. In
+        #HLFB_MODE_HAS_PWM it carries only the magnitude, and the velocity
+        takes the sign of the last non-zero commanded velocity.
+
+        \code{.cpp}
+        // M-0's HLFB reports 100% duty at 4000 RPM; at 800 steps per
+        // revolution that is 53333 steps/s. Smooth it with a 20 Hz low-pass.
+        static Biquad<int32_t, 1> speedFilter;
+        speedFilter.Section(0, BiquadLowPass(20, 0.7071));
+        ConnectorM0.HlfbMode(MotorDriver::HLFB_MODE_HAS_BIPOLAR_PWM);
+        ConnectorM0.HlfbSpeedFeedback(53333, &speedFilter);
+        \endcode
+
+        \param[in] fullScale The speed at 100% duty, in step pulses per
+        second, or 0 to stop decoding the speed.
+        \param[in] filter A filter to run on the velocity each sample time,
+        or nullptr for none. It must remain valid while it is in use.
+
+        \return True if the speed decoding was set; false if \a fullScale is
+        negative.
+
+        \note This function is only applicable when the #HlfbMode is set to
+        #HLFB_MODE_HAS_PWM or #HLFB_MODE_HAS_BIPOLAR_PWM. The speed reads 0
+        while there is no PWM measurement, such as while the motor is
+        disabled.
+    **/
+    bool HlfbSpeedFeedback(int32_t fullScale,
+                           DspFilter<int32_t> *filter = nullptr);
+
+    /**
+        \brief The motor's speed measured from HLFB, in step pulses per
+        second.
+
+        \code{.cpp}
+        int32_t speed = ConnectorM0.HlfbSpeed();
+        \endcode
+
+        \return The velocity decoded in the last sample time, or 0 if
+        HlfbSpeedFeedback() is not set up.
+    **/
+    volatile const int32_t &HlfbSpeed() {
+        return m_hlfbSpeed;
+    }
+
+#if CLEARCORE_ISR_PROFILE
+    /**
+        \brief Read the cycle statistics of this motor's sample rate
+        refresh.
+
+        The refresh is this connector's share of the
+        SysTiming::ISR_STAGE_CONNECTORS stage. The steps statistics cover
+        the StepGenerator's part of it, which runs in Step and Direction
+        mode only. Both are reset after they are read.
+
+        \code{.cpp}
+        SysTiming::IsrStageStats refresh, steps;
+        ConnectorM0.RefreshCyclesGet(refresh, steps);
+        if (steps.Count) {
+            uint32_t meanCycles = steps.TotalCycles / steps.Count;
+        }
+        \endcode
+
+        \param[out] refresh The cycles of the whole refresh.
+        \param[out] steps The cycles spent calculating the steps.
+
+        \note Only available when built with CLEARCORE_ISR_PROFILE set to 1.
+    **/
+    void RefreshCyclesGet(SysTiming::IsrStageStats &refresh,
+                          SysTiming::IsrStageStats &steps);
+#endif
+
     /**
         \brief Sets operational mode of the HLFB to match up with the HLFB
         configuration of a ClearPath&trade; motor.
@@ -710,9 +1235,14 @@ public:
         if (m_hlfbMode == newMode) {
             return;
         }
+        // Edge sensing reads the static level, which PWM modes do not use
+        if (newMode != HLFB_MODE_STATIC) {
+            HlfbEdgeSense(false);
+        }
         m_hlfbMode = newMode;
         m_hlfbCarrierLost = true;
         m_hlfbDuty = HLFB_DUTY_UNKNOWN;
+        m_hlfbDutyHundredths = HLFB_DUTY_UNKNOWN * 100;
     }
 
     /**
@@ -730,6 +1260,87 @@ public:
         return m_hlfbMode;
     }
 
+    /**
+        \brief Sense HLFB edges with the external interrupt controller.
+
+        Normally the HLFB level is read and filtered once per sample, so a
+        move is reported done up to a few samples after the motor asserts
+        HLFB. With edge sensing, the HLFB line is debounced in hardware by
+        the external interrupt controller for InputManager::HardwareFilterUs()
+        and each debounced edge interrupts immediately. The HLFB state in the
+        status registers then follows within one sample of the debounced
+        edge, and an in-position event is published from the interrupt the
+        moment HLFB asserts after a positional move has finished its steps.
+        See InPositionEvent() and InPositionCallback().
+
+        Only available in #HLFB_MODE_STATIC; switching to a PWM mode turns
+        edge sensing off.
+
+        \code{.cpp}
+        // Report M-0's moves done as soon as HLFB asserts
+        ConnectorM0.HlfbMode(MotorDriver::HLFB_MODE_STATIC);
+        ConnectorM0.HlfbEdgeSense(true);
+        \endcode
+
+        \param[in] enable True to sense HLFB edges.
+
+        \return True if edge sensing was changed as requested.
+    **/
+    bool HlfbEdgeSense(bool enable);
+
+    /**
+        \brief Accessor for HLFB edge sensing.
+
+        \return True if HLFB edges are sensed by the external interrupt
+        controller.
+    **/
+    bool HlfbEdgeSense() {
+        return m_hlfbEdgeSense;
+    }
+
+    /**
+        \brief Clear on read accessor for the in-position event.
+
+        The event is set by the HLFB edge interrupt when HLFB asserts while
+        the motor is enabled and a positional move has finished its steps.
+        Requires HlfbEdgeSense().
+
+        \code{.cpp}
+        uint32_t doneCycles;
+        if (ConnectorM0.InPositionEvent(doneCycles)) {
+            // M-0 reached its target; doneCycles is the CPU cycle counter
+            // at the HLFB edge
+        }
+        \endcode
+
+        \param[out] cycles The CPU cycle counter (DWT->CYCCNT) at the
+        debounced HLFB edge. Unchanged if there was no event.
+
+        \return True if an in-position event occurred since the last call.
+    **/
+    bool InPositionEvent(uint32_t &cycles);
+
+    /**
+        \brief Register a function called from the HLFB edge interrupt when
+        an in-position event occurs.
+
+        The callback runs at interrupt level with the cycle counter already
+        recorded; it should be short. Pass nullptr to remove it.
+
+        \code{.cpp}
+        void M0InPosition() {
+            ConnectorIO0.State(true);
+        }
+
+        ConnectorM0.InPositionCallback(M0InPosition);
+        \endcode
+
+        \param[in] callback The function to call.
+    **/
+    void InPositionCallback(voidFuncPtr callback) {
+        m_inPositionCallback = callback;
+    }
+
     /**
         \brief Clear on read accessor for HLFB rising edge detection.
 
@@ -1478,21 +2089,46 @@ protected:
     uint8_t m_hlfbEvt;
     // HLFB measurement mode
     HlfbModes m_hlfbMode;
-    // HLFB width, period raw measurements
-    uint16_t m_hlfbWidth[CPM_HLFB_CAP_HISTORY];
-    uint16_t m_hlfbPeriod[CPM_HLFB_CAP_HISTORY];
+    // HLFB period, width raw measurements, in the order of the TC's CC[0]
+    // and CC[1] registers so each DMA block copies one capture
+    struct HlfbCapture {
+        uint16_t Period;
+        uint16_t Width;
+    };
+    HlfbCapture m_hlfbCaptures[CPM_HLFB_CAP_HISTORY];
+    // The DMA descriptors after the channel's base descriptor, linked in a
+    // ring through the captures
+    DmacDescriptor m_hlfbDmaDesc[CPM_HLFB_CAP_HISTORY - 1]
+    __attribute__((aligned(16)));
+    // The DMA channel, the next capture to read, and the number of usable
+    // captures in the ring
+    DmaChannels m_hlfbDmaChannel;
+    uint8_t m_hlfbCaptureTail;
+    uint8_t m_hlfbCaptureValid;
     // HLFB measurement count, used to show lack of PWM
     uint16_t m_hlfbNoPwmSampleCount;
     HlfbCarrierFrequency m_hlfbCarrierFrequency;
     uint32_t m_hlfbCarrierLossStateChange_ms;
     // The last board time (in milliseconds) when PWM carrier was detected
     uint32_t m_hlfbLastCarrierDetectTime;
-    // HLFB last duty cycle
+    // HLFB last duty cycle, in percent and in hundredths of a percent
     float m_hlfbDuty;
+    int32_t m_hlfbDutyHundredths;
+    // HLFB torque limit, in hundredths of a percent
+    TorqueLimitActions m_torqueLimitAction;
+    int32_t m_torqueLimit;
+    uint16_t m_torqueLimitSamples;
+    uint16_t m_torqueLimitCount;
+    volatile bool m_torqueLimitReached;
+    // HLFB measured speed: the speed at 100% duty in steps/s, the filter,
+    // the decoded velocity and the direction of an unsigned reading
+    int32_t m_hlfbSpeedFullScale;
+    DspFilter<int32_t> *m_hlfbSpeedFilter;
+    volatile int32_t m_hlfbSpeed;
+    bool m_hlfbSpeedNegative;
     // HLFB state return
     HlfbStates m_hlfbState;
     bool m_lastHlfbInputValue;
-    bool m_hlfbPwmReadingPending;
     uint16_t m_hlfbStateChangeCounter;
 
     // Inversion mask of actual enable, direction, and HLFB state
@@ -1506,6 +2142,21 @@ protected:
 
     uint16_t m_aDutyCnt;
     uint16_t m_bDutyCnt;
+    // The DMA channels playing duty tables to Input A and B, or
+    // DMA_CHANNEL_NONE
+    uint8_t m_aDutyTableDma;
+    uint8_t m_bDutyTableDma;
+
+    // Feed-forward output, with the gains scaled to output counts per
+    // velocity and velocity change in Qx steps per sample
+    MotorDriver *volatile m_ffMotor;
+    DigitalInOutAnalogOut *volatile m_ffDac;
+    float m_ffOffset;
+    float m_ffVelScale;
+    float m_ffAccelScale;
+    int32_t m_ffFullScale;
+    int32_t m_ffVelLastQx;
+    int32_t m_ffDacPending;
 
     bool m_inFault;
 
@@ -1516,6 +2167,11 @@ protected:
 
     AlertRegMotor m_alertRegMotor;
 
+#if CLEARCORE_ISR_PROFILE
+    SysTiming::IsrStageStats m_profileRefresh;
+    SysTiming::IsrStageStats m_profileSteps;
+#endif
+
     /**
         Initialize hardware and/or internal state.
     **/
@@ -1528,6 +2184,28 @@ protected:
     **/
     void ToggleEnable();
 
+    /**
+        Compute and write the feed-forward output. Called each sample after
+        the steps are calculated.
+    **/
+    void FeedForwardUpdate();
+
+    /**
+        Scale the feed-forward settings to an output's full scale.
+    **/
+    void FeedForwardScale(const FeedForward &ff, int32_t fullScale);
+
+    /**
+        Start a duty table on Input A's or Input B's compare buffer.
+    **/
+    bool DutyTableStart(bool inputB, const uint32_t *counts, uint16_t count,
+                        bool loop);
+
+    /**
+        Stop an input's duty table and free its DMA channel.
+    **/
+    void DutyTableStop(bool inputB);
+
 private:
 
     enum ClearFaultState {
@@ -1555,10 +2233,34 @@ private:
     ClearCorePins m_eStopConnector;
     bool m_motionCancellingEStop;
 
+    // On-board homing. The stage after HOMING_STOPPING is held in
+    // m_homingNext while the motor ramps down.
+    volatile HomingStates m_homingState;
+    HomingStates m_homingNext;
+    bool m_homingNegDir;
+    int32_t m_homingSeekVel;
+    int32_t m_homingApproachVel;
+    int32_t m_homingBackOffDist;
+    int32_t m_homingIndexDist;
+    int32_t m_homingPosn;
+    // Commanded position at the start of the stage and at the home edge
+    int32_t m_homingStageStart;
+    int32_t m_homingLatch;
+    // Times the switch edge on the approach, when the switch has an
+    // external interrupt
+    PositionCapture m_homingCapture;
+    bool m_homingCaptured;
+
     bool m_shiftRegEnableReq;
     ClearFaultState m_clearFaultState;
     uint32_t m_clearFaultHlfbTimer;
 
+    // HLFB edge sensing and the in-position event it publishes
+    bool m_hlfbEdgeSense;
+    volatile bool m_inPositionEvent;
+    volatile uint32_t m_inPositionCycles;
+    voidFuncPtr m_inPositionCallback;
+
     /**
         Construct, wire in pads and LED Shift register object
     **/
@@ -1572,6 +2274,33 @@ private:
     void UpdateADuty();
     void UpdateBDuty();
 
+    /**
+        Start the DMA channel that copies HLFB captures into the capture ring.
+        Called by the MotorManager once the DMA controller is initialized.
+    **/
+    void HlfbDmaInit();
+
+    /**
+        The index in the capture ring of the next capture the DMA will fill.
+    **/
+    uint8_t HlfbCaptureHead();
+
+    /**
+        Average the new HLFB captures into the HLFB duty cycle.
+    **/
+    void HlfbCapturesProcess(bool invert);
+
+    /**
+        Convert the HLFB duty to the measured speed and filter it.
+    **/
+    void HlfbSpeedUpdate();
+
+    /**
+        Handle a debounced HLFB edge. Called from the EIC interrupt when
+        edge sensing is on.
+    **/
+    void HlfbEdge();
+
     /**
           Refresh the Motor on the SysTick time.
     **/
@@ -1628,6 +2357,44 @@ private:
     **/
     bool CheckEStopSensor();
 
+    /**
+        Advance the homing sequence. Called each sample time before the
+        steps are calculated.
+    **/
+    void HomingUpdate();
+
+    /**
+        True if the limit switch being homed against is active.
+    **/
+    bool HomingSwitchActive() {
+        return m_homingNegDir ? m_limitInfo.InNegHWLimit
+                              : m_limitInfo.InPosHWLimit;
+    }
+
+    /**
+        Start a homing stage's velocity move toward or away from the switch.
+    **/
+    void HomingMove(int32_t vel, bool toward);
+
+    /**
+        Start timing the switch edge for the approach stage.
+    **/
+    void HomingCaptureStart();
+
+    /**
+        The commanded position at the switch edge on the approach.
+    **/
+    int32_t HomingEdgePosn();
+
+    /**
+        True while a homing sequence is moving the motor.
+    **/
+    bool HomingActive() {
+        return m_homingState != HOMING_IDLE &&
+               m_homingState != HOMING_COMPLETE &&
+               m_homingState != HOMING_FAILED;
+    }
+
 }; // MotorDriver
 
 } // ClearCore namespace
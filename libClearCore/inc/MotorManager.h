@@ -28,11 +28,18 @@
 #define __MOTORMANAGER_H__
 
 #include <stdint.h>
+#include "DigitalIn.h"
 #include "HardwareMapping.h"
+#include "InputManager.h"
+#include "MotionGroup.h"
 #include "MotorDriver.h"
+#include "PositionCompare.h"
 
 namespace ClearCore {
 
+/// A motor mask selecting every MotorDriver connector; bit n selects M-n
+#define MOTOR_MASK_ALL ((1U << MOTOR_CON_CNT) - 1)
+
 /**
     \class MotorManager
     \brief ClearCore motor-connector manager.
@@ -44,6 +51,10 @@ namespace ClearCore {
     informational pages.
 **/
 class MotorManager {
+    friend class MotionGroup;
+    friend class PositionCompare;
+    friend class SyncManager;
+
 public:
     /**
         Output step rates to be sent to motors.
@@ -60,7 +71,13 @@ public:
         /**
             Select the fast speed step input rate (2 MHz, 250nS pulse width)
         **/
-        CLOCK_RATE_HIGH
+        CLOCK_RATE_HIGH,
+        /**
+            Select the very fast speed step input rate (5 MHz, 100nS pulse
+            width) for drives that accept it. Not for use with ClearPath
+            motors.
+        **/
+        CLOCK_RATE_VERY_HIGH
     } MotorClockRates;
 
     /**
@@ -85,6 +102,63 @@ public:
         MOTOR_ALL = NUM_MOTOR_PAIRS,
     } MotorPair;
 
+    /**
+        The combined progress of the motors started by MotorsEnable() or
+        MotorsClearFaults().
+    **/
+    typedef enum {
+        /**
+            At least one motor is still enabling, pulsing its enable or
+            waiting for HLFB within the allowed time.
+        **/
+        MOTORS_BUSY,
+        /**
+            Every selected motor that is requested enabled is enabled with
+            HLFB asserted.
+        **/
+        MOTORS_READY,
+        /**
+            At least one selected motor that is requested enabled is disabled
+            or has HLFB deasserted once the allowed time has run out.
+        **/
+        MOTORS_FAILED,
+    } MotorsStates;
+
+    /**
+        \brief The state of one motor, as seen at the end of a sample.
+
+        Each field holds what the MotorDriver accessor of the same name
+        returned in that sample.
+    **/
+    typedef struct {
+        /// See StepGenerator::PositionRefCommanded()
+        int32_t PositionRefCommanded;
+        /// See StepGenerator::VelocityRefCommanded()
+        int32_t VelocityRefCommanded;
+        /// See MotorDriver::HlfbPercent()
+        float HlfbPercent;
+        /// See MotorDriver::HlfbSpeed()
+        int32_t HlfbSpeed;
+        /// See MotorDriver::StatusReg()
+        MotorDriver::StatusRegMotor StatusReg;
+        /// See MotorDriver::AlertReg()
+        MotorDriver::AlertRegMotor AlertReg;
+        /// See MotorDriver::HlfbState()
+        MotorDriver::HlfbStates HlfbState;
+        /// See StepGenerator::StepsComplete()
+        bool StepsComplete;
+    } MotorSnapshot;
+
+    /**
+        \brief The state of every motor connector from the same sample.
+    **/
+    typedef struct {
+        /// The sample tick the snapshot was taken in
+        uint32_t Tick;
+        /// The motors, indexed by connector number
+        MotorSnapshot Motors[MOTOR_CON_CNT];
+    } MotorsSnapshot;
+
 #ifndef HIDE_FROM_DOXYGEN
     /**
         Public accessor for singleton instance.
@@ -95,6 +169,23 @@ public:
         Initialize hardware and/or internal state.
     **/
     void Initialize();
+
+    /**
+        Advance the registered motion groups by one sample. Called before the
+        motor connectors are refreshed.
+    **/
+    void Refresh();
+
+    /**
+        Check the registered position compares against this sample's
+        positions. Called after the connectors are refreshed.
+    **/
+    void CompareRefresh();
+
+    /**
+        Publish the motor snapshot. Called at the end of the sample.
+    **/
+    void SnapshotPublish();
 #endif
 
     /**
@@ -142,6 +233,360 @@ public:
     **/
     bool MotorModeSet(MotorPair motorPair, Connector::ConnectorModes newMode);
 
+    /**
+        \brief Starts the moves staged on the MotorDriver connectors.
+
+        Every connector with a move staged by StepGenerator::MoveStage() or
+        StepGenerator::MoveVelocityStage() starts it on the next sample time,
+        so all of the staged axes begin moving together.
+
+        \code{.cpp}
+        ConnectorM0.MoveStage(4000);
+        ConnectorM1.MoveStage(4000);
+        ConnectorM2.MoveVelocityStage(-1000);
+        MotorMgr.MovesCommit();
+        \endcode
+    **/
+    void MovesCommit() {
+        m_movesCommitPending = true;
+    }
+
+    /**
+        \brief Commits the staged moves when an input sees an edge.
+
+        The staged moves start on the first sample time after the edge, as
+        if MovesCommit() had been called from the input's interrupt. The
+        trigger fires once; arm it again for the next set of moves. Arming
+        replaces any interrupt callback registered on the input.
+
+        \code{.cpp}
+        ConnectorM0.MoveStage(4000);
+        ConnectorM1.MoveStage(4000);
+        // Start both moves on the PLC's rising edge at DI-6
+        MotorMgr.MovesArm(ConnectorDI6, InputManager::RISING);
+        \endcode
+
+        \param[in] input The input that triggers the moves. Only connectors
+        DI-6 through A-12 can trigger moves.
+        \param[in] trigger The edge that triggers the moves.
+
+        \return True if the trigger was armed.
+
+        \note Digital interrupts must be enabled with
+        InputManager::InterruptsEnabled().
+    **/
+    bool MovesArm(DigitalIn &input,
+                  InputManager::InterruptTrigger trigger =
+                      InputManager::RISING);
+
+    /**
+        \brief Disarms the trigger set by MovesArm(). Staged moves stay
+        staged.
+
+        \code{.cpp}
+        MotorMgr.MovesDisarm();
+        \endcode
+    **/
+    void MovesDisarm();
+
+    /**
+        \brief Check whether a trigger armed by MovesArm() is waiting for
+        its edge.
+
+        \return True if the trigger has not fired yet.
+    **/
+    bool MovesArmed() {
+        return m_movesArmedExtInt >= 0;
+    }
+
+    /**
+        \brief Enables or disables a set of motors together.
+
+        The motors' enable delays and HLFB waits run at the same time, so
+        bringing up several axes takes as long as the slowest one rather
+        than the sum of all of them. Poll MotorsState() for the combined
+        result.
+
+        \code{.cpp}
+        // Enable all four motors, allowing 1 s for HLFB to assert
+        MotorMgr.MotorsEnable(true, 1000);
+        while (MotorMgr.MotorsState() == MotorManager::MOTORS_BUSY) {
+            continue;
+        }
+        \endcode
+
+        \param[in] enable True to enable the motors; false to disable them.
+        \param[in] waitForHlfbTime_ms (optional) How long MotorsState() waits
+        for HLFB to assert before reporting #MOTORS_FAILED. Default: 0.
+        \param[in] motorMask (optional) The motors to change; bit n selects
+        M-n. Default: all motors.
+    **/
+    void MotorsEnable(bool enable, uint32_t waitForHlfbTime_ms = 0,
+                      uint8_t motorMask = MOTOR_MASK_ALL);
+
+    /**
+        \brief Clears the faults of a set of enabled motors together.
+
+        Every selected motor that is requested enabled pulses its enable
+        output low for \a disableTime_ms and then waits up to
+        \a waitForHlfbTime_ms for HLFB to assert, all at the same time.
+        Motors that are not requested enabled are left alone. Poll
+        MotorsState() for the combined result.
+
+        \code{.cpp}
+        // After an E-stop, clear all four motors at once
+        MotorMgr.MotorsClearFaults(10, 1000);
+        while (MotorMgr.MotorsState() == MotorManager::MOTORS_BUSY) {
+            continue;
+        }
+        if (MotorMgr.MotorsState() == MotorManager::MOTORS_FAILED) {
+            // At least one motor is still faulted
+        }
+        \endcode
+
+        \param[in] disableTime_ms How long to hold each enable output low.
+        \param[in] waitForHlfbTime_ms (optional) How long to wait for HLFB
+        to assert after the pulse. Default: 0.
+        \param[in] motorMask (optional) The motors to clear; bit n selects
+        M-n. Default: all motors.
+    **/
+    void MotorsClearFaults(uint32_t disableTime_ms,
+                           uint32_t waitForHlfbTime_ms = 0,
+                           uint8_t motorMask = MOTOR_MASK_ALL);
+
+    /**
+        \brief The combined progress of a set of motors.
+
+        \code{.cpp}
+        if (MotorMgr.MotorsState(0x3) == MotorManager::MOTORS_READY) {
+            // M-0 and M-1 are both enabled and ready
+        }
+        \endcode
+
+        \param[in] motorMask (optional) The motors to check; bit n selects
+        M-n. Default: all motors.
+
+        \return #MOTORS_BUSY until every selected motor has finished, then
+        #MOTORS_FAILED if any of them did not come up, else #MOTORS_READY.
+    **/
+    MotorsStates MotorsState(uint8_t motorMask = MOTOR_MASK_ALL);
+
+    /**
+        \brief Wires an E-stop input straight to the step outputs.
+
+        The input's external interrupt line is routed through the event
+        system to a fault input of the timer that generates the step
+        pulses. While the input is deasserted, the step outputs of the
+        selected motors are held at their idle level by the timer itself,
+        within a few clock cycles and without waiting for a sample time.
+
+        On the following sample time, each selected motor that was moving
+        stops abruptly and sets its
+        [MotionCanceledSensorEStop](@ref ClearCore::MotorDriver::AlertRegMotor::MotionCanceledSensorEStop)
+        alert. Since no steps can leave the connector once the fault trips,
+        an abrupt stop keeps the commanded position closest to the steps
+        that were sent; any steps of the tripping sample that were held back
+        are lost. To reject new moves while the input is deasserted, also
+        set it as each motor's MotorDriver::EStopConnector().
+
+        The timer is briefly stopped while it is configured, so call this
+        during setup rather than during motion.
+
+        \code{.cpp}
+        // Hold the steps of all motors in hardware while DI-6 is open
+        MotorMgr.EStopHardware(ConnectorDI6);
+        ConnectorM0.EStopConnector(CLEARCORE_PIN_DI6);
+        \endcode
+
+        \param[in] input The E-stop input; it is active (not stopping) when
+        asserted. Only connectors DI-6 through A-12 can be used.
+        \param[in] motorMask (optional) The motors to halt; bit n selects
+        M-n. Default: all motors. Zero removes the hardware E-stop.
+
+        \return True if the E-stop was set up.
+
+        \note The step outputs of the motors share one timer, so there is one
+        hardware E-stop input for all of them.
+    **/
+    bool EStopHardware(DigitalIn &input, uint8_t motorMask = MOTOR_MASK_ALL);
+
+    /**
+        \brief Check whether the hardware E-stop has tripped.
+
+        A trip latches until EStopHardwareClear() succeeds.
+
+        \code{.cpp}
+        if (MotorMgr.EStopHardwareTripped()) {
+            // Steps are being held by the hardware E-stop
+        }
+        \endcode
+
+        \return True if the step outputs are being held.
+    **/
+    bool EStopHardwareTripped();
+
+    /**
+        \brief Releases the step outputs after a hardware E-stop trip.
+
+        The release only happens once the E-stop input is asserted again.
+        Clear the motors' alerts before commanding new moves.
+
+        \code{.cpp}
+        if (MotorMgr.EStopHardwareClear()) {
+            ConnectorM0.ClearAlerts();
+        }
+        \endcode
+
+        \return True if the step outputs are released.
+    **/
+    bool EStopHardwareClear();
+
+    /**
+        \brief Reads the state of all motor connectors from one sample.
+
+        Reading the MotorDriver accessors one by one can mix values from
+        different samples, since the sample rate update changes them in
+        between. The snapshot is published once at the end of every sample
+        and copied out as a whole, so its fields are consistent with each
+        other. The read never blocks the sample rate update; if a new
+        snapshot overtakes the copy, the copy is simply taken again.
+
+        \code{.cpp}
+        MotorManager::MotorsSnapshot snapshot;
+        MotorMgr.Snapshot(snapshot);
+        for (uint8_t i = 0; i < MOTOR_CON_CNT; i++) {
+            int32_t position = snapshot.Motors[i].PositionRefCommanded;
+            int32_t velocity = snapshot.Motors[i].VelocityRefCommanded;
+            // Report position and velocity
+        }
+        \endcode
+
+        \param[out] snapshot The latest snapshot.
+    **/
+    void Snapshot(MotorsSnapshot &snapshot);
+
+    /**
+        \brief Couples the motion of a pair of MotorDriver connectors as the
+        two sides of a gantry.
+
+        The first connector of the pair (M-0 or M-2) leads: it is commanded
+        like any other axis, by moves, a MotionGroup, PVT, gearing or a cam.
+        The second connector follows, sending the leader's steps in the same
+        sample, so the sides can't skew when a move starts or stops. While
+        paired, the follower takes the leader's position and rejects moves
+        of its own, and a stop on either side, including one caused by a
+        fault or a disable, stops both. Each side then adds its skew from
+        GantrySkew() to the steps it sends.
+
+        Both connectors must be in step and direction mode with no move in
+        progress.
+
+        \code{.cpp}
+        MotorMgr.MotorModeSet(MotorManager::MOTOR_M0M1,
+                              Connector::CPM_MODE_STEP_AND_DIR);
+        MotorMgr.GantryStart(MotorManager::MOTOR_M0M1);
+        // Both M-0 and M-1 make the move
+        ConnectorM0.Move(20000);
+        \endcode
+
+        \param[in] motorPair The connectors to pair.
+
+        \return True if the pair was coupled.
+    **/
+    bool GantryStart(MotorPair motorPair);
+
+    /**
+        \brief Uncouples a gantry pair.
+
+        Each connector keeps the position of its own side, including its
+        skew, and is commanded separately again.
+
+        \param[in] motorPair The connectors to uncouple.
+
+        \return True if the pair was uncoupled; false if it is moving.
+    **/
+    bool GantryStop(MotorPair motorPair);
+
+    /**
+        \brief Check whether a pair is coupled as a gantry.
+    **/
+    bool GantryActive(MotorPair motorPair);
+
+    /**
+        \brief Sets the skew of each side of a gantry: how far, in step
+        pulses, the side's motor is offset from the gantry position.
+
+        A change in skew is taken up at #GANTRY_SKEW_STEPS_MAX steps per
+        sample, whether or not the gantry is moving, and never against the
+        direction of a move. Squaring with GantrySquare() zeroes both skews
+        with the sides on their home inputs; the skews then correct for
+        home inputs that are not square to the gantry.
+
+        \code{.cpp}
+        // M-1's home switch is mounted 12 steps early
+        MotorMgr.GantrySkew(MotorManager::MOTOR_M0M1, 0, 12);
+        \endcode
+
+        \param[in] motorPair The gantry pair.
+        \param[in] leaderSkew The skew of the leader's side.
+        \param[in] followerSkew The skew of the follower's side.
+
+        \return True if the skews were set; false if the pair isn't
+        coupled or is squaring.
+    **/
+    bool GantrySkew(MotorPair motorPair, int32_t leaderSkew,
+                    int32_t followerSkew);
+
+    /**
+        \brief Arms the squaring of a gantry on the sides' own home
+        inputs.
+
+        Squaring watches each side's home input once per sample. When a
+        side's input asserts, the side stops where it is and its position
+        is captured, while the other side keeps moving with the gantry.
+        Once both sides have found their homes the leader's move is stopped
+        and both skews are zeroed, leaving the gantry square. Command
+        the seek toward the inputs on the leader once squaring is armed, at
+        a speed the sides can stop from at once.
+
+        The home inputs are separate from the limit switches and read as
+        asserted when their state is non-zero.
+
+        \code{.cpp}
+        MotorMgr.GantrySquare(MotorManager::MOTOR_M0M1, CLEARCORE_PIN_DI6,
+                              CLEARCORE_PIN_DI7);
+        ConnectorM0.MoveVelocity(-500);
+        while (!MotorMgr.GantrySquared(MotorManager::MOTOR_M0M1)) {
+            continue;
+        }
+        ConnectorM0.PositionRefSet(0);
+        \endcode
+
+        \param[in] motorPair The gantry pair.
+        \param[in] leaderHome The leader's home input.
+        \param[in] followerHome The follower's home input.
+
+        \return True if squaring was armed.
+    **/
+    bool GantrySquare(MotorPair motorPair, ClearCorePins leaderHome,
+                      ClearCorePins followerHome);
+
+    /**
+        \brief Check whether both sides of a gantry have found their homes
+        since GantrySquare() was armed.
+    **/
+    bool GantrySquared(MotorPair motorPair);
+
+    /**
+        \brief How far, in step pulses, the follower's side was ahead of the
+        leader's when squaring found the homes: the racking that squaring
+        took out.
+
+        \return The racking of the last squaring, or 0 if it hasn't
+        finished.
+    **/
+    int32_t GantryRacking(MotorPair motorPair);
+
 protected:
     uint8_t m_gclkIndex;
     MotorClockRates m_clockRate;
@@ -156,14 +601,92 @@ private:
     (500000 / _CLEARCORE_SAMPLE_RATE_HZ * _CLEARCORE_SAMPLE_RATE_HZ)
 #define CPM_CLOCK_RATE_HIGH_HZ \
     (2000000 / _CLEARCORE_SAMPLE_RATE_HZ * _CLEARCORE_SAMPLE_RATE_HZ)
+#define CPM_CLOCK_RATE_VERY_HIGH_HZ \
+    (5000000 / _CLEARCORE_SAMPLE_RATE_HZ * _CLEARCORE_SAMPLE_RATE_HZ)
 
     bool m_initialized;
 
+    MotionGroup *m_motionGroups[MOTION_GROUP_MAX];
+    uint8_t m_motionGroupCount;
+
+    PositionCompare *m_compares[POSITION_COMPARE_MAX];
+    uint8_t m_compareCount;
+
+    // Staged moves start at the next Refresh() once a commit is pending
+    volatile bool m_movesCommitPending;
+    volatile int8_t m_movesArmedExtInt;
+
+    // The HLFB wait allowed by the last MotorsEnable()
+    uint32_t m_motorsWaitStartMs;
+    uint32_t m_motorsWaitMs;
+
+    // Double-buffered snapshot; m_snapshots[m_snapshotSeq & 1] is the
+    // latest, and the sequence advances once the buffer is filled
+    MotorsSnapshot m_snapshots[2];
+    volatile uint32_t m_snapshotSeq;
+
+    // Hardware E-stop line, halted motors and latched trip
+    int8_t m_eStopExtInt;
+    uint8_t m_eStopMotorMask;
+    volatile bool m_eStopTripped;
+
+    // Sample timer counts per sample, and the steps per sample held back
+    // while SyncManager trims the sample period
+    uint32_t m_samplePeriod;
+    uint8_t m_stepsTrim;
+
+    // Gantry squaring of each pair: the sides' home inputs, the sides that
+    // have found them (bit 0 leader, bit 1 follower) and the side positions
+    // they were found at
+    struct GantrySquaring {
+        volatile bool Armed;
+        ClearCorePins Home[2];
+        volatile uint8_t Found;
+        int32_t Capture[2];
+    };
+    GantrySquaring m_gantry[NUM_MOTOR_PAIRS];
+
     /**
         Construct, wire in the Gclk and the mode control pins
     **/
     MotorManager();
 
+    /**
+        Lower the step rate limit of every motor by \a steps per sample.
+    **/
+    void StepsTrimSet(uint8_t steps);
+
+    /**
+        Register a motion group to be updated each sample.
+    **/
+    bool MotionGroupAdd(MotionGroup *group);
+
+    /**
+        Stop updating a motion group.
+    **/
+    void MotionGroupRemove(MotionGroup *group);
+
+    /**
+        Register a position compare to be checked each sample.
+    **/
+    bool PositionCompareAdd(PositionCompare *compare);
+
+    /**
+        Capture and hold the gantry sides whose home inputs asserted while
+        squaring. Called each sample.
+    **/
+    void GantrySquareUpdate(MotorPair motorPair);
+
+    /**
+        Interrupt callback for the input armed by MovesArm().
+    **/
+    static void MovesTriggered();
+
+    /**
+        Stop the motors halted by a hardware E-stop trip. Called each sample.
+    **/
+    void EStopHardwareCheck();
+
     void PinMuxSet();
 };
 
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    \file NumberFormat.h
+    \brief ClearCore fast number to text formatting.
+
+    Formats integers and floating point numbers into a caller's buffer
+    without going through the C library's printf machinery.
+**/
+
+#ifndef __NUMBERFORMAT_H__
+#define __NUMBERFORMAT_H__
+
+#include <stdint.h>
+
+namespace ClearCore {
+
+/// The buffer size that holds any integer formatted by FormatInt() or
+/// FormatUint(), in any radix, with its terminating null
+#define FORMAT_INT_BUFFER_SIZE 34
+
+/// The buffer size that holds any number formatted by FormatFloat(), with
+/// its terminating null
+#define FORMAT_FLOAT_BUFFER_SIZE 32
+
+/// The largest precision FormatFloat() handles without falling back to
+/// snprintf()
+#define FORMAT_FLOAT_PRECISION_MAX 9
+
+/**
+    \brief Format an unsigned integer.
+
+    Decimal numbers are formatted two digits at a time from a table, and
+    power of 2 radixes with shifts, so no division by the radix is needed
+    for each digit.
+
+    \code{.cpp}
+    char text[FORMAT_INT_BUFFER_SIZE];
+    uint8_t length = FormatUint(text, 4095);
+    \endcode
+
+    \param[out] buffer At least #FORMAT_INT_BUFFER_SIZE characters. The text
+    is null terminated.
+    \param[in] value The number.
+    \param[in] radix The base, 2 through 16. Digits above 9 are lower case.
+
+    \return The number of characters written, not counting the null, or 0 if
+    the radix is not supported.
+**/
+uint8_t FormatUint(char *buffer, uint32_t value, uint8_t radix = 10);
+
+/**
+    \brief Format a signed integer.
+
+    As with itoa(), a minus sign is only written for radix 10; other
+    radixes format the two's complement bits.
+
+    \param[out] buffer At least #FORMAT_INT_BUFFER_SIZE characters. The text
+    is null terminated.
+    \param[in] value The number.
+    \param[in] radix The base, 2 through 16.
+
+    \return The number of characters written, not counting the null, or 0 if
+    the radix is not supported.
+**/
+uint8_t FormatInt(char *buffer, int32_t value, uint8_t radix = 10);
+
+/**
+    \brief Format a floating point number with a fixed number of digits
+    after the decimal point, like printf's "%.*f".
+
+    The number is scaled and rounded to an integer once, and the integer
+    and fraction digits are then formatted as integers. Precisions above
+    #FORMAT_FLOAT_PRECISION_MAX, numbers too large for the integer path,
+    and numbers that scale to within 1/1024 of a tie fall back to
+    snprintf(), so the text always matches "%.*f".
+
+    \code{.cpp}
+    char text[FORMAT_FLOAT_BUFFER_SIZE];
+    uint8_t length = FormatFloat(text, 3.14159, 3);    // "3.142"
+    \endcode
+
+    \param[out] buffer At least #FORMAT_FLOAT_BUFFER_SIZE characters. The
+    text is null terminated.
+    \param[in] value The number.
+    \param[in] precision The number of digits after the decimal point.
+
+    \return The number of characters written, not counting the null.
+**/
+uint8_t FormatFloat(char *buffer, double value, uint8_t precision = 2);
+
+} // ClearCore namespace
+
+#endif // __NUMBERFORMAT_H__
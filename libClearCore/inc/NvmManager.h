@@ -30,10 +30,16 @@
 
 #include <stdint.h>
 #include <sam.h>
+#include "atomic_utils.h"
 
 #ifndef HIDE_FROM_DOXYGEN
 namespace ClearCore {
 
+/// The number of completion callbacks an asynchronous write can hold
+#ifndef NVM_ASYNC_CALLBACK_MAX
+#define NVM_ASYNC_CALLBACK_MAX 4
+#endif
+
 /**
     \brief ClearCore Board Non-Volatile Memory Interface
 
@@ -53,6 +59,9 @@ namespace ClearCore {
     \note Access will fail if the UF2 boot loader has not been run
 **/
 class NvmManager {
+    friend class EthernetManager;
+    friend class KeyValueStore;
+
 public:
 
     /**
@@ -67,6 +76,8 @@ public:
         NVM_LOC_RESERVED_TEKNIC = 416, // Reserved 64 bytes of data for
         // Teknic use
 
+        NVM_LOC_DHCP_LEASE = NVM_LOC_RESERVED_TEKNIC,  // 416, 8 bytes
+
         NVM_LOC_USER_MAX = NVMCTRL_PAGE_SIZE - 32,   // 480
 
         NVM_LOC_HW_REVISION = NVM_LOC_USER_MAX - 18,   // 462
@@ -80,6 +91,23 @@ public:
 
     } NvmLocations;
 
+    /**
+        The state of the most recent asynchronous write
+    **/
+    typedef enum {
+        NVM_WRITE_IDLE,
+        NVM_WRITE_BUSY,
+        NVM_WRITE_DONE,
+        NVM_WRITE_FAILED,
+    } WriteStatus;
+
+    /**
+        Function called when an asynchronous write completes. Called from
+        the SysTick interrupt, or from a blocking write that finished the
+        page write, so it must return promptly.
+    **/
+    typedef void (*WriteCallback)(bool success);
+
     /**
         Public accessor for singleton instance
     **/
@@ -181,6 +209,75 @@ public:
     **/
     bool BlockWrite(NvmLocations nvmLocationStart, int lengthInBytes, uint8_t const * const p_data);
 
+    /**
+        \brief Write a block of bytes to NVM without waiting for the page write
+
+        The data goes into the page cache right away, so reads return it
+        immediately. The page write runs a step at a time from the SysTick
+        update. Writes queued before the page write starts share it.
+
+        \param[in] nvmLocationStart location to start write
+        \param[in] lengthInBytes number of bytes to write
+        \param[in] p_data pointer to the data to write
+        \param[in] callback Optional function to call when the page write
+        completes
+        \return True if the write was queued, false otherwise
+        \note Call from the main loop, not from an interrupt handler
+    **/
+    bool BlockWriteAsync(NvmLocations nvmLocationStart, int lengthInBytes,
+                         uint8_t const * const p_data,
+                         WriteCallback callback = NULL);
+
+    /**
+        \brief The state of the most recent asynchronous write
+    **/
+    WriteStatus AsyncWriteStatus() const {
+        return m_asyncStatus;
+    }
+
+    /**
+        \brief Check whether an asynchronous write is in progress
+    **/
+    bool AsyncWriteActive() const {
+        return m_asyncActive;
+    }
+
+    /**
+        \brief Erase a block of main flash, waiting for the erase
+
+        \param[in] address An address within the NVMCTRL_BLOCK_SIZE block
+        \return True if the block was erased, false if the supply is too low
+        or the controller reported an error
+        \note Code fetches from the bank being erased stall until it is done
+    **/
+    bool FlashBlockErase(uint32_t address);
+
+    /**
+        \brief Program a page of main flash, waiting for the write
+
+        \param[in] address The page-aligned address to write
+        \param[in] data The NVMCTRL_PAGE_SIZE bytes to program
+        \return True if the page was written, false if the supply is too low
+        or the controller reported an error
+        \note The page must have been erased since it was last written
+    **/
+    bool FlashPageWrite(uint32_t address, const uint32_t *data);
+
+    /**
+        \brief Check whether flash bank A is mapped first, at address 0
+    **/
+    bool FlashBankAFirst() const {
+        return NVMCTRL->STATUS.bit.AFIRST;
+    }
+
+    /**
+        \brief Swap the flash banks and reset the processor
+
+        The bank at the upper half of flash is mapped at address 0 from the
+        reset on. This does not return.
+    **/
+    void FlashBankSwap();
+
 
     /**
         \brief Get the MAC address of the ClearCore.
@@ -201,22 +298,21 @@ public:
     **/
     uint32_t SerialNumber();
 
-    bool FinishNvmWrite() {
-        while (m_pageModified || m_writeState != IDLE) {
-            if (WriteCacheToNvmProc()) {
-                continue;
-            }
-            else {
-                return false;
-            }
-        }
-        return true;
-    }
+    /**
+        Write any pending changes to NVM, waiting for the page write. An
+        asynchronous write in progress is finished here.
+    **/
+    bool FinishNvmWrite();
 
     bool Synchonized() const {
-        return !m_pageModified;
+        return !m_pageModified && m_writeState == IDLE;
     }
 
+    /**
+        Advance an asynchronous write. Called from the SysTick update.
+    **/
+    void Refresh();
+
 private:
 
     typedef enum {
@@ -232,7 +328,13 @@ private:
     int32_t *m_nvmPageCache32;
     WriteCacheState m_writeState;
     uint8_t m_quadWordIndex;
-    bool m_pageModified;
+    // Set when the cache changes; cleared when a page write takes it
+    volatile bool m_pageModified;
+    // Set while the SysTick update runs a page write
+    volatile bool m_asyncActive;
+    volatile WriteStatus m_asyncStatus;
+    WriteCallback m_asyncCallbacks[NVM_ASYNC_CALLBACK_MAX];
+    volatile uint8_t m_asyncCallbackCnt;
 
     /**
         \brief Constructor
@@ -268,6 +370,19 @@ private:
     **/
     bool WriteCacheToNvmProc();
 
+    /**
+        \brief Report the end of an asynchronous write to its callbacks
+    **/
+    void AsyncComplete(bool success);
+
+    /**
+        \brief Queue a change to the page cache for the SysTick update to
+        write, without the bounds checks of BlockWriteAsync()
+    **/
+    bool CacheWriteAsync(NvmLocations nvmLocationStart, int lengthInBytes,
+                         uint8_t const * const p_data,
+                         WriteCallback callback);
+
     bool BlockWrite();
 }; //NvmManager
 
@@ -0,0 +1,405 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    \file PidController.h
+    \brief Fixed-point PID controller template and sample rate process loop.
+
+    A PID controller in integer arithmetic that runs once per sample, and a
+    process loop that runs one from the sample rate update, reading an ADC
+    result and driving an analog output, a motor input PWM or a motor
+    velocity.
+**/
+
+#ifndef __PIDCONTROLLER_H__
+#define __PIDCONTROLLER_H__
+
+#include <stdint.h>
+#include "DspFilter.h"
+#include "SysTiming.h"
+
+namespace ClearCore {
+
+/// The maximum number of process loops run by the sample rate update
+#ifndef PID_LOOP_MAX
+#define PID_LOOP_MAX 4
+#endif
+
+/// The fractional bits of the process loop gains
+#ifndef PID_LOOP_GAIN_FRAC
+#define PID_LOOP_GAIN_FRAC 16
+#endif
+
+class DigitalInOutAnalogOut;
+class MotorDriver;
+
+/**
+    \class Pid
+    \brief A fixed-point PID controller, updated once per sample.
+
+    The gains are signed fixed point with FRAC fractional bits. The
+    proportional gain scales the error; the integral gain is the amount of
+    error added to the output each sample, and the derivative gain scales the
+    change in the measurement over one sample. GainP(), GainI() and GainD()
+    convert gains in per-second units to these at compile time.
+
+    - The derivative acts on the measurement, so a setpoint step does not
+      kick the output, and is smoothed by a first-order filter.
+    - The integrator stops accumulating while the output is held at a limit
+      in the direction the error pushes it, and is confined to the output
+      limits, so it does not wind up.
+    - The output can be slew limited to a change per sample.
+
+    The setpoint, measurement and output are integers in whatever units the
+    application uses, such as ADC counts in and DAC counts out.
+
+    \code{.cpp}
+    // Kp = 2, Ki = 40 /s, Kd = 0.001 s, with Q16 gains
+    Pid<16> loop;
+    loop.Gains(Pid<16>::GainP(2.0), Pid<16>::GainI(40.0),
+               Pid<16>::GainD(0.001));
+    loop.Limits(0, 2047);
+    int32_t output = loop.Update(setpoint, measurement);
+    \endcode
+
+    \tparam FRAC The fractional bits of the gains, at most 24.
+**/
+template <uint8_t FRAC>
+class Pid {
+public:
+    /**
+        \brief Convert a proportional gain to fixed point.
+    **/
+    static constexpr int32_t GainP(double kp) {
+        return DspFixed(kp, FRAC);
+    }
+
+    /**
+        \brief Convert an integral gain, per second, to fixed point.
+    **/
+    static constexpr int32_t GainI(double kiPerSec) {
+        return DspFixed(kiPerSec / SampleRateHz, FRAC);
+    }
+
+    /**
+        \brief Convert a derivative gain, in seconds, to fixed point.
+    **/
+    static constexpr int32_t GainD(double kdSec) {
+        return DspFixed(kdSec * SampleRateHz, FRAC);
+    }
+
+    /**
+        \brief Construct with zero gains and an output limited to 0.
+    **/
+    Pid()
+        : m_kp(0), m_ki(0), m_kd(0), m_outMin(0), m_outMax(0), m_slew(0),
+          m_derivShift(2), m_integQ(0), m_derivQ(0), m_measLast(0),
+          m_output(0), m_started(false) {}
+
+    /**
+        \brief Set the proportional, integral and derivative gains.
+
+        \param[in] kp The proportional gain.
+        \param[in] ki The integral gain per sample.
+        \param[in] kd The derivative gain per sample.
+    **/
+    void Gains(int32_t kp, int32_t ki, int32_t kd) {
+        m_kp = kp;
+        m_ki = ki;
+        m_kd = kd;
+    }
+
+    /**
+        \brief Set the range of the output.
+
+        \param[in] outMin The lowest output.
+        \param[in] outMax The highest output.
+    **/
+    void Limits(int32_t outMin, int32_t outMax) {
+        m_outMin = outMin;
+        m_outMax = outMax;
+    }
+
+    /**
+        \brief Limit the change in the output per sample.
+
+        \param[in] perSample The largest change per sample; 0 for no limit.
+    **/
+    void SlewLimit(uint32_t perSample) {
+        m_slew = perSample;
+    }
+
+    /**
+        \brief Set the derivative filter.
+
+        Each sample moves the filtered derivative 1 / 2^shift of the way to
+        the new one; the time constant is about 2^shift samples.
+
+        \param[in] shift The filter shift, from 0 (no filter) to 15.
+    **/
+    void DerivativeFilter(uint8_t shift) {
+        m_derivShift = (shift > 15) ? 15 : shift;
+    }
+
+    /**
+        \brief Restart the controller with its output at \a output.
+
+        The integrator takes up the output so the first update continues
+        smoothly from it, and the next measurement starts the derivative.
+    **/
+    void Reset(int32_t output) {
+        m_output = Clamp(output, m_outMin, m_outMax);
+        m_integQ = static_cast<int64_t>(m_output) << FRAC;
+        m_derivQ = 0;
+        m_started = false;
+    }
+
+    /**
+        \brief Run the controller for one sample.
+
+        \param[in] setpoint The target.
+        \param[in] measurement The measured value.
+        \return The new output.
+    **/
+    int32_t Update(int32_t setpoint, int32_t measurement) {
+        int32_t error = setpoint - measurement;
+        if (!m_started) {
+            m_measLast = measurement;
+            m_started = true;
+        }
+
+        // Derivative of the negated measurement, filtered
+        int64_t derivRaw =
+            -static_cast<int64_t>(m_kd) * (measurement - m_measLast);
+        m_measLast = measurement;
+        m_derivQ += (derivRaw - m_derivQ) >> m_derivShift;
+
+        int64_t integQ = m_integQ + static_cast<int64_t>(m_ki) * error;
+        int64_t outQ = static_cast<int64_t>(m_kp) * error + integQ + m_derivQ;
+        int64_t unclamped = (outQ + (1LL << (FRAC - 1))) >> FRAC;
+
+        int64_t low = m_outMin;
+        int64_t high = m_outMax;
+        if (m_slew) {
+            low = (low > m_output - static_cast<int64_t>(m_slew)) ?
+                  low : m_output - static_cast<int64_t>(m_slew);
+            high = (high < m_output + static_cast<int64_t>(m_slew)) ?
+                   high : m_output + static_cast<int64_t>(m_slew);
+        }
+        int32_t output = static_cast<int32_t>(
+                             unclamped < low ? low :
+                             unclamped > high ? high : unclamped);
+
+        // Hold the integrator while the output is held against the error
+        bool held = (unclamped > output && error > 0) ||
+                    (unclamped < output && error < 0);
+        if (!held) {
+            int64_t integMin = static_cast<int64_t>(m_outMin) << FRAC;
+            int64_t integMax = static_cast<int64_t>(m_outMax) << FRAC;
+            m_integQ = integQ < integMin ? integMin :
+                       integQ > integMax ? integMax : integQ;
+        }
+        m_output = output;
+        return output;
+    }
+
+    /**
+        \brief The last output.
+    **/
+    int32_t Output() {
+        return m_output;
+    }
+
+private:
+    int32_t m_kp;
+    int32_t m_ki;
+    int32_t m_kd;
+    int32_t m_outMin;
+    int32_t m_outMax;
+    uint32_t m_slew;
+    uint8_t m_derivShift;
+    // The integral and filtered derivative terms, with FRAC fractional bits
+    int64_t m_integQ;
+    int64_t m_derivQ;
+    int32_t m_measLast;
+    volatile int32_t m_output;
+    bool m_started;
+
+    static int32_t Clamp(int32_t value, int32_t low, int32_t high) {
+        return value < low ? low : value > high ? high : value;
+    }
+};
+
+/**
+    \class PidLoop
+    \brief A PID process loop run by the sample rate update.
+
+    A PidLoop reads an input every sample, typically an ADC result from
+    AdcManager::FilteredResult(), runs its PID controller against the
+    setpoint, and writes the output without waiting on the main loop. The
+    loop runs after the ADC results are read and before the motors are
+    refreshed, so a velocity output takes effect in the same sample.
+
+    The output drives one of:
+    - An analog output, in DAC counts.
+    - Input A or B of a motor connector in PWM mode, as a duty from 0 to 255.
+    - The velocity of a motor connector, in steps per second. The velocity
+      is commanded only when it changes, and is ramped by the motor's
+      acceleration limit.
+
+    Up to #PID_LOOP_MAX loops may exist at once. Loops beyond that never
+    start.
+
+    \code{.cpp}
+    PidLoop Heater;
+
+    // Hold A-9 at 2000 counts by driving IO-0's analog output
+    ConnectorIO0.Mode(Connector::OUTPUT_ANALOG);
+    Heater.Gains(PidLoop::GainP(1.5), PidLoop::GainI(20.0), 0);
+    Heater.Setpoint(2000);
+    Heater.StartAnalog(AdcMgr.FilteredResult(AdcManager::ADC_AIN09),
+                       ConnectorIO0);
+    \endcode
+**/
+class PidLoop : public Pid<PID_LOOP_GAIN_FRAC> {
+    friend class AdcManager;
+
+public:
+    /**
+        Construct, and register the loop to be run each sample.
+    **/
+    PidLoop();
+
+    /**
+        \brief Start driving an analog output.
+
+        The output limits are set to the DAC range.
+
+        \param[in] input The value to control. It is read every sample.
+        \param[in] output The analog output, in Connector::OUTPUT_ANALOG
+        mode.
+
+        \return True if the loop started; false if the output is not in
+        analog mode or all #PID_LOOP_MAX loops were already in use when this
+        one was made.
+    **/
+    bool StartAnalog(volatile const uint16_t &input,
+                     DigitalInOutAnalogOut &output);
+
+    /**
+        \brief Start driving the PWM duty of a motor connector's input.
+
+        The output limits are set to the duty range, 0 to 255.
+
+        \code{.cpp}
+        // Drive M-0's input A duty from the tension sensor on A-10
+        Tension.StartPwm(AdcMgr.FilteredResult(AdcManager::ADC_AIN10),
+                         ConnectorM0, false);
+        \endcode
+
+        \param[in] input The value to control. It is read every sample.
+        \param[in] motor The motor connector, in a PWM input mode.
+        \param[in] inputB True to drive input B, false for input A.
+
+        \return True if the loop started.
+    **/
+    bool StartPwm(volatile const uint16_t &input, MotorDriver &motor,
+                  bool inputB);
+
+    /**
+        \brief Start driving the velocity of a motor connector.
+
+        \code{.cpp}
+        // Hold the dancer on A-11 centered by trimming M-1's velocity
+        Dancer.StartVelocity(AdcMgr.FilteredResult(AdcManager::ADC_AIN11),
+                             ConnectorM1, 5000);
+        \endcode
+
+        \param[in] input The value to control. It is read every sample.
+        \param[in] motor The motor connector, in step and direction mode.
+        \param[in] velMax The output limits, in steps per second, are
+        -velMax to velMax.
+
+        \return True if the loop started.
+    **/
+    bool StartVelocity(volatile const uint16_t &input, MotorDriver &motor,
+                       int32_t velMax);
+
+    /**
+        \brief Stop running the loop.
+
+        The output is left at its last value; a motor velocity is ramped to
+        a stop.
+    **/
+    void Stop();
+
+    /**
+        \brief Set the target for the input.
+    **/
+    void Setpoint(int32_t setpoint) {
+        m_setpoint = setpoint;
+    }
+
+    /**
+        \brief The target for the input.
+    **/
+    int32_t Setpoint() {
+        return m_setpoint;
+    }
+
+    /**
+        \brief Check whether the loop is running.
+    **/
+    bool Active() {
+        return m_active;
+    }
+
+private:
+    typedef enum {
+        PID_OUT_ANALOG,
+        PID_OUT_PWM_A,
+        PID_OUT_PWM_B,
+        PID_OUT_VELOCITY,
+    } OutputTypes;
+
+    volatile const uint16_t *m_input;
+    DigitalInOutAnalogOut *m_analog;
+    MotorDriver *m_motor;
+    OutputTypes m_outputType;
+    volatile int32_t m_setpoint;
+    int32_t m_velocityLast;
+    volatile bool m_active;
+    // Registered with the AdcManager
+    bool m_registered;
+
+    bool StartLoop(volatile const uint16_t &input, OutputTypes outputType);
+
+    /**
+        Run the controller and write the output. Called from the sample rate
+        update.
+    **/
+    void Update();
+}; // PidLoop
+
+} // ClearCore namespace
+
+#endif // __PIDCONTROLLER_H__
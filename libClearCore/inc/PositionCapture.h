@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    \file PositionCapture.h
+    \brief ClearCore hardware position capture.
+
+    Latches a position and a CPU cycle timestamp on the edge of an external
+    interrupt input.
+**/
+
+#ifndef __POSITIONCAPTURE_H__
+#define __POSITIONCAPTURE_H__
+
+#include <stdint.h>
+#include "DigitalIn.h"
+#include "InputManager.h"
+#include "atomic_utils.h"
+
+namespace ClearCore {
+
+/// The number of captures held by a PositionCapture until they are read.
+/// Must be a power of two.
+#ifndef POSITION_CAPTURE_FIFO_LENGTH
+#define POSITION_CAPTURE_FIFO_LENGTH 8
+#endif
+
+/**
+    \class PositionCapture
+    \brief ClearCore hardware position capture.
+
+    A PositionCapture watches the external interrupt of a digital input (such
+    as DI-6 through DI-8 or A-9 through A-12) and, on the chosen edge, records
+    a position together with the value of the CPU cycle counter. The capture
+    is taken at the start of the input's interrupt, which runs at a priority
+    above the sample rate update, so the timestamp is within a few cycles of
+    the edge regardless of what the rest of the program is doing.
+
+    Captures are held in a small FIFO. The FIFO is filled from the interrupt
+    and emptied by Read() without disabling interrupts. When the FIFO is full,
+    new edges are dropped and counted by OverflowCount().
+
+    Any callback that was registered on the input with
+    DigitalIn::InterruptHandlerSet() still runs, after the capture is taken.
+
+    \code{.cpp}
+    PositionCapture Probe;
+
+    // Capture the encoder position on each rising edge of DI-6
+    Probe.StartEncoder(ConnectorDI6, InputManager::RISING);
+
+    PositionCapture::Record record;
+    while (Probe.Read(record)) {
+        // record.Position and record.Cycles hold one capture
+    }
+    \endcode
+**/
+class PositionCapture {
+    friend class InputManager;
+    friend class TestIO;
+
+public:
+    /**
+        \brief One captured edge.
+    **/
+    typedef struct {
+        /// The position at the edge
+        int32_t Position;
+        /// The CPU cycle counter at the edge (see CPU_CLK for its rate)
+        uint32_t Cycles;
+    } Record;
+
+    /**
+        Construct
+    **/
+    PositionCapture();
+
+    /**
+        \brief Start capturing a position on edges of an input.
+
+        The position is read through the given reference each time the edge
+        occurs, so it is only as current as the value behind it. For example,
+        a motor's commanded position advances once per sample time.
+
+        \code{.cpp}
+        // Latch M-0's commanded position on falling edges of DI-7
+        Probe.Start(ConnectorDI7, ConnectorM0.PositionRefCommanded(),
+                    InputManager::FALLING);
+        \endcode
+
+        \param[in] input The digital input to watch.
+        \param[in] posn The position to latch.
+        \param[in] trigger The edge that causes a capture.
+
+        \return True if capturing started; false if the input has no external
+        interrupt or the interrupt is in use by another capture.
+    **/
+    bool Start(DigitalIn &input, volatile const int32_t &posn,
+               InputManager::InterruptTrigger trigger = InputManager::RISING);
+
+    /**
+        \brief Start capturing the encoder position on edges of an input.
+
+        The encoder count is read from the position decoder at the edge itself
+        rather than from the last sample time.
+
+        \code{.cpp}
+        Probe.StartEncoder(ConnectorDI6);
+        \endcode
+
+        \param[in] input The digital input to watch.
+        \param[in] trigger The edge that causes a capture.
+
+        \return True if capturing started; false if the input has no external
+        interrupt or the interrupt is in use by another capture.
+    **/
+    bool StartEncoder(DigitalIn &input,
+                      InputManager::InterruptTrigger trigger =
+                          InputManager::RISING);
+
+    /**
+        \brief Stop capturing. Captures already in the FIFO remain readable.
+
+        \code{.cpp}
+        Probe.Stop();
+        \endcode
+    **/
+    void Stop();
+
+    /**
+        \brief Take the oldest capture from the FIFO.
+
+        \code{.cpp}
+        PositionCapture::Record record;
+        if (Probe.Read(record)) {
+            // Use record.Position
+        }
+        \endcode
+
+        \param[out] record Filled in with the oldest capture.
+
+        \return True if a capture was available.
+    **/
+    bool Read(Record &record);
+
+    /**
+        \brief The number of captures waiting in the FIFO.
+
+        \return The number of captures that Read() can return.
+    **/
+    uint8_t Count() {
+        return static_cast<uint8_t>(atomic_load_n(&m_head) -
+                                    atomic_load_n(&m_tail));
+    }
+
+    /**
+        \brief The number of edges dropped because the FIFO was full.
+
+        \return The count of dropped edges since the last Start().
+    **/
+    uint32_t OverflowCount() {
+        return m_overflowCount;
+    }
+
+private:
+    // The interrupt line in use, or -1 when stopped
+    int8_t m_extInt;
+    // The latched position source; nullptr to read the encoder
+    volatile const int32_t *m_posn;
+    Record m_fifo[POSITION_CAPTURE_FIFO_LENGTH];
+    // Written only by Latch()
+    volatile uint8_t m_head;
+    // Written only by Read()
+    volatile uint8_t m_tail;
+    volatile uint32_t m_overflowCount;
+
+    bool StartCapture(DigitalIn &input, volatile const int32_t *posn,
+                      InputManager::InterruptTrigger trigger);
+
+    /**
+        Record one capture. Called from the interrupt of the captured line.
+    **/
+    void Latch();
+}; // PositionCapture
+
+} // ClearCore namespace
+
+#endif // __POSITIONCAPTURE_H__
@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+    \file PositionCompare.h
+    \brief ClearCore position compare output.
+**/
+
+#ifndef __POSITIONCOMPARE_H__
+#define __POSITIONCOMPARE_H__
+
+#include <stdint.h>
+#include "Connector.h"
+
+namespace ClearCore {
+
+/// The maximum number of position compares that may exist at one time
+#ifndef POSITION_COMPARE_MAX
+#define POSITION_COMPARE_MAX 4
+#endif
+
+/**
+    \class PositionCompare
+    \brief ClearCore position compare output.
+
+    A PositionCompare pulses an output each time a position reaches one of a
+    series of trigger positions, such as to fire a camera or a glue valve at
+    exact places along a move. The triggers come either from a table or from
+    a fixed spacing. They are checked in the sample rate update, right after
+    the motors are refreshed, so no trigger is missed however fast the axis
+    moves.
+
+    The triggers are taken in order, each one firing when the position
+    reaches or passes it in either direction. When several triggers are
+    passed in one sample they produce a single pulse, but each is still
+    counted by TriggerCount().
+
+    The pulse starts and ends on sample time boundaries. For a motor's
+    commanded position it starts in the same sample as the motor is sent the
+    step that reaches the trigger, so it is within one sample time of the
+    step. A CCIO-8 output is written with the next CCIO-8 update, one sample
+    time later.
+
+    Up to #POSITION_COMPARE_MAX compares may exist at once. Compares beyond
+    that never start.
+
+    \code{.cpp}
+    PositionCompare Camera;
+
+    // Pulse IO-0 for 500 us every 1000 steps of M-0, starting at step 2000
+    ConnectorIO0.Mode(Connector::OUTPUT_DIGITAL);
+    Camera.StartInterval(ConnectorM0.PositionRefCommanded(), ConnectorIO0,
+                         2000, 1000, 0, 500);
+    ConnectorM0.Move(20000);
+    \endcode
+**/
+class PositionCompare {
+    friend class MotorManager;
+    friend class TestIO;
+
+public:
+    /**
+        Construct, and register the compare to be checked each sample.
+    **/
+    PositionCompare();
+
+    /**
+        \brief Start pulsing an output at each position of a table.
+
+        \code{.cpp}
+        // Dispense glue at four points along M-1's travel
+        static const int32_t dots[] = {1200, 4800, 5100, 9000};
+        Glue.StartTable(ConnectorM1.PositionRefCommanded(), ConnectorIO1,
+                        dots, 4, 2000);
+        \endcode
+
+        \param[in] posn The position to compare. It is read every sample
+        time.
+        \param[in] output The output to pulse. It must be writable, such as
+        a DigitalInOut or CcioPin in digital output mode.
+        \param[in] positions The trigger positions, in the order the position
+        will reach them. The table must remain valid while the compare is
+        active.
+        \param[in] count The number of positions in the table.
+        \param[in] pulseUs The pulse width, in microseconds. It is rounded up
+        to whole sample times.
+
+        \return True if the compare started; false if the output isn't
+        writable, the table is empty, or all #POSITION_COMPARE_MAX compares
+        were already in use when this one was made.
+    **/
+    bool StartTable(volatile const int32_t &posn, Connector &output,
+                    const int32_t *positions, uint16_t count,
+                    uint32_t pulseUs = 1000);
+
+    /**
+        \brief Start pulsing an output at evenly spaced positions.
+
+        \code{.cpp}
+        // Pulse IO-2 every 250 steps of negative travel from 0, 40 times
+        Marker.StartInterval(ConnectorM2.PositionRefCommanded(), ConnectorIO2,
+                             0, -250, 40);
+        \endcode
+
+        \param[in] posn The position to compare. It is read every sample
+        time.
+        \param[in] output The output to pulse. It must be writable, such as
+        a DigitalInOut or CcioPin in digital output mode.
+        \param[in] first The first trigger position.
+        \param[in] interval The distance from each trigger to the next. Its
+        sign is the direction of travel.
+        \param[in] count The number of triggers, or 0 to keep going until
+        Stop().
+        \param[in] pulseUs The pulse width, in microseconds. It is rounded up
+        to whole sample times.
+
+        \return True if the compare started; false if the output isn't
+        writable, the interval is 0, or all #POSITION_COMPARE_MAX compares
+        were already in use when this one was made.
+    **/
+    bool StartInterval(volatile const int32_t &posn, Connector &output,
+                       int32_t first, int32_t interval, uint32_t count = 0,
+                       uint32_t pulseUs = 1000);
+
+    /**
+        \brief Stop comparing and end any pulse in progress.
+
+        \code{.cpp}
+        Camera.Stop();
+        \endcode
+    **/
+    void Stop();
+
+    /**
+        \brief Check whether triggers remain to be reached.
+
+        \return True until the last trigger has fired or Stop() is called.
+        The last pulse may still be in progress once this is false.
+    **/
+    bool Active() {
+        return m_active;
+    }
+
+    /**
+        \brief The number of triggers reached since the last start.
+    **/
+    uint32_t TriggerCount() {
+        return m_triggerCount;
+    }
+
+private:
+    volatile const int32_t *m_posn;
+    Connector *m_output;
+    // The table, or nullptr for evenly spaced triggers
+    const int32_t *m_table;
+    int32_t m_interval;
+    // The triggers to reach; 0 for unlimited evenly spaced triggers
+    uint32_t m_count;
+    // The next trigger to reach, and its index
+    int32_t m_next;
+    uint32_t m_index;
+    // The position at the last check
+    int32_t m_posnLast;
+    uint32_t m_pulseSamples;
+    // Samples left in the pulse in progress
+    uint32_t m_pulseLeft;
+    volatile uint32_t m_triggerCount;
+    volatile bool m_active;
+    // Registered with the MotorManager
+    bool m_registered;
+
+    bool StartCompare(volatile const int32_t &posn, Connector &output,
+                      uint32_t pulseUs);
+
+    /**
+        Fire the triggers reached in this sample and time the pulse. Called
+        from the sample rate update after the motors are refreshed.
+    **/
+    void Update();
+}; // PositionCompare
+
+} // ClearCore namespace
+
+#endif // __POSITIONCOMPARE_H__
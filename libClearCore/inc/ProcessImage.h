@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+    \file ProcessImage.h
+    \brief ClearCore I/O process image.
+
+    Gathers the board's inputs into one packed image each sample, and applies
+    a packed image of output commands in one sample.
+**/
+
+#ifndef __PROCESSIMAGE_H__
+#define __PROCESSIMAGE_H__
+
+#include <stdint.h>
+#include "SysConnectors.h"
+
+namespace ClearCore {
+
+/// The number of IO-n connectors in OutputImage::Io
+#define PROCESS_IMAGE_IO_CNT (CLEARCORE_PIN_IO5 - CLEARCORE_PIN_IO0 + 1)
+
+/// The number of analog inputs in InputImage::Analog
+#define PROCESS_IMAGE_ANALOG_CNT (CLEARCORE_PIN_A12 - CLEARCORE_PIN_A9 + 1)
+
+/**
+    \class ProcessImage
+    \brief ClearCore I/O process image.
+
+    The input image holds the state of every connector, the CCIO-8 inputs
+    and the filtered analog inputs. It is latched at one point in each sample,
+    after all of the inputs have been updated, so its fields always belong
+    to the same sample. The output image holds the output commands;
+    OutputsCommit() hands them over, and they are all written in the next
+    sample.
+
+    Both images are packed structs with a fixed layout, so a network protocol
+    can copy them to and from its frames directly.
+
+    \code{.cpp}
+    // Mirror DI-6 onto IO-1, and CCIO-8 input 0 onto CCIO-8 output 1
+    const ProcessImage::InputImage &in = ProcessImg.InputsRead();
+    ProcessImage::OutputImage &out = ProcessImg.Outputs();
+    out.Mask = 1UL << CLEARCORE_PIN_IO1;
+    out.Io[CLEARCORE_PIN_IO1] = (in.Digital >> CLEARCORE_PIN_DI6) & 1;
+    out.CcioMask = 0x2;
+    out.Ccio = (in.Ccio & 0x1) << 1;
+    ProcessImg.OutputsCommit();
+    \endcode
+**/
+class ProcessImage {
+    friend class CommandBatch;
+    friend class SysManager;
+
+public:
+    /**
+        \brief The inputs of one sample.
+    **/
+    typedef struct __attribute__((packed)) {
+        /// The CCIO-8 input states; the LSB is the first pin of the first
+        /// CCIO-8 in the chain
+        uint64_t Ccio;
+        /// The sample tick the image was latched in
+        uint32_t Tick;
+        /// The filtered connector states, as InputManager::InputsRT()
+        uint32_t Digital;
+        /// The filtered analog inputs A-9 through A-12, in ADC counts, as
+        /// AdcManager::FilteredResult()
+        uint16_t Analog[PROCESS_IMAGE_ANALOG_CNT];
+    } InputImage;
+
+    /**
+        \brief The output commands applied in one sample.
+    **/
+    typedef struct __attribute__((packed)) {
+        /// The CCIO-8 outputs to write; bit n selects CCIO-8 pin n
+        uint64_t CcioMask;
+        /// The states of the CCIO-8 outputs in \a CcioMask
+        uint64_t Ccio;
+        /// The IO-n connectors to write; bit n selects IO-n
+        uint32_t Mask;
+        /// The value written with Connector::State() to each IO-n connector
+        /// in \a Mask: 0 or 1 for a digital output, the duty for PWM, or the
+        /// analog output value for IO-0
+        int16_t Io[PROCESS_IMAGE_IO_CNT];
+    } OutputImage;
+
+#ifndef HIDE_FROM_DOXYGEN
+    /**
+        Public accessor for singleton instance.
+    **/
+    static ProcessImage &Instance();
+#endif
+
+    /**
+        \brief Read the input image of the latest sample.
+
+        The image is copied from the sample rate update without blocking it.
+
+        \code{.cpp}
+        const ProcessImage::InputImage &in = ProcessImg.InputsRead();
+        if (in.Digital & (1UL << CLEARCORE_PIN_DI7)) {
+            // DI-7 is asserted
+        }
+        \endcode
+
+        \return The input image; it is not changed until the next call.
+    **/
+    const InputImage &InputsRead();
+
+    /**
+        \brief The output image being built up for the next commit.
+
+        Writing the image has no effect until OutputsCommit().
+
+        \code{.cpp}
+        ProcessImg.Outputs().Mask = 1UL << CLEARCORE_PIN_IO0;
+        ProcessImg.Outputs().Io[CLEARCORE_PIN_IO0] = 1;
+        \endcode
+
+        \return The output image.
+    **/
+    OutputImage &Outputs() {
+        return m_outputsStaged;
+    }
+
+    /**
+        \brief Write the output image in the next sample.
+
+        Every output in the image's masks is written in the same sample.
+        Committing again before then replaces the earlier image.
+
+        \code{.cpp}
+        ProcessImg.OutputsCommit();
+        \endcode
+    **/
+    void OutputsCommit();
+
+    /**
+        \brief Write several IO-n digital outputs together at the start of
+        the next sample.
+
+        The states are latched and applied before anything else in the
+        sample rate update, so every output in \a mask changes in the same
+        sample. Writes made before then are merged, the later ones winning
+        for the outputs they share.
+
+        \code{.cpp}
+        // Turn on IO-1 and IO-2 and turn off IO-3 in the same sample
+        SysConnectorState mask, value;
+        mask.bit.CLEARCORE_PIN_IO1 = 1;
+        mask.bit.CLEARCORE_PIN_IO2 = 1;
+        mask.bit.CLEARCORE_PIN_IO3 = 1;
+        value.bit.CLEARCORE_PIN_IO1 = 1;
+        value.bit.CLEARCORE_PIN_IO2 = 1;
+        ProcessImg.OutputsWrite(mask, value);
+        \endcode
+
+        \param[in] mask The connectors to write, as InputManager::InputsRT().
+        \param[in] value The states to write to the connectors in \a mask.
+        \return True if every connector in \a mask is an IO-n connector in
+        Connector::OUTPUT_DIGITAL mode; otherwise nothing is written.
+    **/
+    bool OutputsWrite(SysConnectorState mask, SysConnectorState value);
+
+private:
+    // Double-buffered input image; m_inputs[m_inputsSeq & 1] is the latest
+    InputImage m_inputs[2];
+    volatile uint32_t m_inputsSeq;
+    InputImage m_inputsRead;
+
+    OutputImage m_outputsStaged;
+    OutputImage m_outputsPending;
+    volatile bool m_outputsPendingValid;
+
+    // Digital outputs latched by OutputsWrite() for the next sample
+    uint32_t m_outputsWriteMask;
+    uint32_t m_outputsWriteValue;
+
+    /**
+        Construct
+    **/
+    ProcessImage();
+
+    /**
+        Apply the committed outputs and latch the inputs. Called from the
+        sample rate update once the inputs are updated.
+    **/
+    void Update();
+
+    /**
+        Apply the outputs latched by OutputsWrite(). Called first in the
+        sample rate update.
+    **/
+    void OutputsWriteApply();
+}; // ProcessImage
+
+} // ClearCore namespace
+
+#endif // __PROCESSIMAGE_H__
@@ -0,0 +1,251 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    \file ProgramPlayer.h
+    \brief ClearCore motion program player for programs on the SD card.
+
+    Reads a binary motion program from a file and feeds its segments to a
+    motor's move queue or to a MotionGroup as they are needed.
+**/
+
+#ifndef __PROGRAMPLAYER_H__
+#define __PROGRAMPLAYER_H__
+
+#include <stdint.h>
+#include "FatFileSystem.h"
+#include "MotionGroup.h"
+#include "MotorDriver.h"
+
+namespace ClearCore {
+
+/// The size of each of the player's two read-ahead buffers, in bytes; a
+/// multiple of the card's block size
+#ifndef PROGRAM_BUFFER_SIZE
+#define PROGRAM_BUFFER_SIZE 512
+#endif
+
+/// The first four bytes of a program file, "CCMP"
+#define PROGRAM_MAGIC 0x504D4343
+/// The program format version
+#define PROGRAM_VERSION 1
+
+/// Program segment types
+#define PROGRAM_SEG_LIMITS 1
+#define PROGRAM_SEG_MOVE 2
+#define PROGRAM_SEG_ARC 3
+#define PROGRAM_SEG_DWELL 4
+
+/// Program segment flags
+#define PROGRAM_FLAG_ABSOLUTE 0x01
+#define PROGRAM_FLAG_CLOCKWISE 0x02
+
+/**
+    \class ProgramPlayer
+    \brief ClearCore motion program player for programs on the SD card.
+
+    A program too long to hold in RAM is read from the card a buffer at a
+    time: while segments are taken from one buffer, the other holds the next
+    part of the file, and the emptied buffer is refilled on the following
+    Refresh(). Segments are decoded only as there is room for them, so a
+    single motor's move queue is kept full, and a MotionGroup is given its
+    next move as soon as it finishes the last. If the target runs out of
+    moves while the next segment has not been read yet, the player counts an
+    underrun.
+
+    A program file is little-endian and starts with an 8-byte header: the
+    magic number #PROGRAM_MAGIC, the version byte #PROGRAM_VERSION, the
+    number of axes, and two reserved bytes. Segments follow back to back,
+    each a type byte and a flags byte followed by the segment's fields:
+    - #PROGRAM_SEG_LIMITS: velocity, acceleration, and jerk limits as three
+      uint32_t, used by the moves that follow.
+    - #PROGRAM_SEG_MOVE: one int32_t distance per axis;
+      #PROGRAM_FLAG_ABSOLUTE makes them positions.
+    - #PROGRAM_SEG_ARC: one int32_t distance per axis followed by the int32_t
+      center offsets of MotionGroup::MoveArc(); #PROGRAM_FLAG_CLOCKWISE
+      selects the direction. Groups only.
+    - #PROGRAM_SEG_DWELL: a uint32_t time in milliseconds to wait after the
+      motion so far has finished.
+
+    \code{.cpp}
+    ProgramPlayer player;
+    if (FileSys.Mount() && player.Start("CONTOUR.CCM", Gantry)) {
+        while (player.State() == ProgramPlayer::PLAYER_RUNNING) {
+            player.Refresh();
+        }
+    }
+    \endcode
+
+    <div class="sd-disclaimer">For use with Step and Direction mode.</div>
+**/
+class ProgramPlayer {
+public:
+    /**
+        \enum PlayerStates
+        \brief The progress of a program.
+    **/
+    typedef enum {
+        /// No program has been started, or it was stopped
+        PLAYER_IDLE,
+        /// The program is being fed to its target
+        PLAYER_RUNNING,
+        /// Every segment has been executed
+        PLAYER_DONE,
+        /// The file could not be read, held an invalid segment, or the
+        /// target refused a move; the target was told to stop
+        PLAYER_ERROR,
+    } PlayerStates;
+
+    /**
+        \brief Construct an idle player.
+    **/
+    ProgramPlayer();
+
+    /**
+        \brief Start a single axis program on a motor's move queue.
+
+        \param[in] path The path of the program file.
+        \param[in] motor The motor to move; the program must have one axis.
+
+        \return True if the program was opened and started.
+    **/
+    bool Start(const char *path, MotorDriver &motor);
+
+    /**
+        \brief Start a program on a motion group.
+
+        \param[in] path The path of the program file.
+        \param[in] group The group to move; the program must have one axis
+        per member of the group.
+
+        \return True if the program was opened and started.
+    **/
+    bool Start(const char *path, MotionGroup &group);
+
+    /**
+        \brief Stop feeding the program, and ramp the target to a stop.
+    **/
+    void Stop();
+
+    /**
+        \brief Read ahead and feed segments to the target.
+
+        Call regularly from the main loop while the program runs.
+    **/
+    void Refresh();
+
+    /**
+        \brief The progress of the program.
+    **/
+    PlayerStates State() {
+        return m_state;
+    }
+
+    /**
+        \brief The number of segments executed so far.
+    **/
+    uint32_t SegmentCount() {
+        return m_segmentCount;
+    }
+
+    /**
+        \brief The number of times the target ran out of moves while the
+        next segment was still being read.
+    **/
+    uint32_t UnderrunCount() {
+        return m_underrunCount;
+    }
+
+private:
+    struct Buffer {
+        uint8_t Data[PROGRAM_BUFFER_SIZE];
+        uint16_t Length;
+        bool Filled;
+    };
+
+    FatFile m_file;
+    Buffer m_buffers[2];
+    // The buffer segments are taken from, and the next byte in it
+    uint8_t m_readBuffer;
+    uint16_t m_readOffset;
+    bool m_endOfFile;
+
+    MotorDriver *m_motor;
+    MotionGroup *m_group;
+    uint8_t m_axisCount;
+    PlayerStates m_state;
+    uint32_t m_segmentCount;
+    uint32_t m_underrunCount;
+    // The target has been counted as starved until the next segment
+    bool m_underrun;
+    bool m_dwellPending;
+    bool m_dwelling;
+    uint32_t m_dwellMs;
+    uint32_t m_dwellEndMs;
+
+    /**
+        Open the file and check its header.
+    **/
+    bool Open(const char *path, uint8_t axisCount);
+
+    /**
+        Fill the empty buffers from the file.
+    **/
+    bool BuffersFill();
+
+    /**
+        The number of buffered bytes not yet decoded.
+    **/
+    uint16_t BytesAvailable();
+
+    /**
+        Copy buffered bytes, taking them from the buffers if \a consume is
+        set.
+    **/
+    bool BytesRead(uint8_t *data, uint16_t length, bool consume);
+
+    /**
+        The size of a segment of type \a type, or 0 if the type is invalid.
+    **/
+    uint16_t SegmentSize(uint8_t type);
+
+    /**
+        Hand a segment to the target.
+    **/
+    bool SegmentIssue(const uint8_t *segment);
+
+    /**
+        Check whether the target can take another move, or has finished all
+        of its moves.
+    **/
+    bool TargetAccepts();
+    bool TargetIdle();
+
+    /**
+        End the program with an error.
+    **/
+    void Fail();
+}; // ProgramPlayer
+
+} // ClearCore namespace
+
+#endif // __PROGRAMPLAYER_H__
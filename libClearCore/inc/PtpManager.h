@@ -0,0 +1,276 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    \file PtpManager.h
+    \brief ClearCore IEEE 1588 (PTP) time synchronization.
+
+    Synchronizes the GMAC timestamp unit to a PTP master on the network and
+    timestamps the sample rate interrupt with the synchronized time.
+**/
+
+#ifndef __PTPMANAGER_H__
+#define __PTPMANAGER_H__
+
+#include <stdint.h>
+#include "lwip/udp.h"
+
+namespace ClearCore {
+
+/// The clock that drives the GMAC timestamp unit
+#ifndef PTP_TSU_CLK_HZ
+#define PTP_TSU_CLK_HZ CPU_CLK
+#endif
+
+/// The PTP domain to synchronize in
+#ifndef PTP_DOMAIN
+#define PTP_DOMAIN 0
+#endif
+
+/// Offsets from the master larger than this step the clock rather than slew
+#ifndef PTP_STEP_THRESHOLD_NS
+#define PTP_STEP_THRESHOLD_NS 100000
+#endif
+
+/// The offset the clock must stay within to count as locked
+#ifndef PTP_LOCK_THRESHOLD_NS
+#define PTP_LOCK_THRESHOLD_NS 10000
+#endif
+
+/// Without a Sync from the master for this long the clock is unlocked and
+/// the next master heard from is adopted
+#ifndef PTP_MASTER_TIMEOUT_MS
+#define PTP_MASTER_TIMEOUT_MS 5000
+#endif
+
+/**
+    \class PtpManager
+    \brief ClearCore IEEE 1588 (PTP) ordinary clock, slave only.
+
+    Follows a PTP version 2 master over UDP/IPv4 multicast using the
+    end-to-end delay mechanism, with one-step or two-step masters. The Sync
+    and Delay_Req messages are timestamped by the GMAC as they cross the
+    wire, and the GMAC's timestamp unit is stepped and rate-adjusted so it
+    runs on the master's time.
+
+    The synchronized time is latched at the start of every sample rate
+    interrupt, so data logged on different boards carries comparable
+    timestamps. A trigger function can be scheduled for the first sample at
+    or after a given time, which lets several boards start a move on the
+    same sample, to within one sample period.
+
+    The boards follow the first master heard from in #PTP_DOMAIN; the best
+    master clock algorithm is not run.
+
+    \code{.cpp}
+    void StartMove() {
+        ConnectorM0.Move(10000);
+    }
+
+    EthernetMgr.Setup();
+    PtpMgr.Begin();
+    while (!PtpMgr.Locked()) {
+        EthernetMgr.Refresh();
+    }
+    // Every board starts the move on its first sample at or after this time
+    PtpManager::PtpTime start = {1700000000, 0};
+    PtpMgr.SampleTrigger(start, StartMove);
+    \endcode
+**/
+class PtpManager {
+    friend class SysManager;
+    friend class EthernetManager;
+
+public:
+    /**
+        A function run from the sample rate interrupt by SampleTrigger().
+    **/
+    typedef void (*TriggerFunction)();
+
+    /**
+        \brief A PTP time: seconds and nanoseconds since the PTP epoch.
+    **/
+    typedef struct {
+        /// Whole seconds
+        uint64_t Seconds;
+        /// Nanoseconds into the second
+        uint32_t Nanoseconds;
+    } PtpTime;
+
+#ifndef HIDE_FROM_DOXYGEN
+    /**
+        Public accessor for singleton instance.
+    **/
+    static PtpManager &Instance();
+#endif
+
+    /**
+        \brief Start the timestamp unit and begin following a PTP master.
+
+        Call after EthernetMgr.Setup().
+
+        \return True if the PTP ports were opened.
+    **/
+    bool Begin();
+
+    /**
+        \brief Whether the clock is following a master within
+        #PTP_LOCK_THRESHOLD_NS.
+
+        \code{.cpp}
+        if (PtpMgr.Locked()) {
+            // Timestamps are comparable with the other boards
+        }
+        \endcode
+    **/
+    bool Locked();
+
+    /**
+        \brief The current synchronized time, read from the timestamp unit.
+    **/
+    PtpTime Time();
+
+    /**
+        \brief The synchronized time at the start of the current sample.
+
+        \code{.cpp}
+        PtpManager::PtpTime stamp = PtpMgr.SampleTime();
+        // Log the position with the sample's timestamp
+        \endcode
+    **/
+    PtpTime SampleTime();
+
+    /**
+        \brief The offset from the master measured at the last Sync, in
+        nanoseconds, before it was corrected.
+    **/
+    int32_t OffsetNs() {
+        return m_offsetNs;
+    }
+
+    /**
+        \brief The measured one-way path delay to the master, in nanoseconds.
+    **/
+    uint32_t PathDelayNs() {
+        return m_pathDelayNs;
+    }
+
+    /**
+        \brief Run a function from the sample rate interrupt at a given time.
+
+        The function runs once, on the first sample at or after \a time,
+        before the motor connectors are refreshed for that sample. It must
+        return quickly. Scheduling a new trigger replaces one still pending.
+
+        \param[in] time The time to trigger at.
+        \param[in] function The function to run, or null to cancel.
+
+        \return True if the trigger was scheduled.
+    **/
+    bool SampleTrigger(const PtpTime &time, TriggerFunction function);
+
+private:
+    // A port identity: clock identity followed by the port number
+    typedef struct {
+        uint8_t Id[10];
+    } PortIdentity;
+
+    bool m_started;
+    struct udp_pcb *m_eventPcb;
+    struct udp_pcb *m_generalPcb;
+    PortIdentity m_portId;
+
+    // The master being followed
+    PortIdentity m_masterId;
+    bool m_masterValid;
+    uint32_t m_lastSyncMs;
+
+    // The Sync being processed: master's send time and our receive time
+    uint16_t m_syncSeq;
+    int64_t m_syncTxNs;
+    int64_t m_syncRxNs;
+    int64_t m_syncCorrectionNs;
+    bool m_syncPending;
+    int8_t m_syncLogInterval;
+
+    // The outstanding Delay_Req and the Sync measurement it pairs with
+    uint16_t m_delayReqSeq;
+    bool m_delayReqPending;
+    int64_t m_delayMasterSlaveNs;
+    bool m_delayValid;
+
+    // Timestamps latched by the GMAC interrupt
+    volatile int64_t m_syncRxStamp;
+    volatile bool m_syncRxStampValid;
+    volatile int64_t m_delayReqTxStamp;
+    volatile bool m_delayReqTxStampValid;
+
+    // Servo state
+    volatile int32_t m_offsetNs;
+    volatile uint32_t m_pathDelayNs;
+    float m_driftPpb;
+    uint8_t m_lockCount;
+    uint32_t m_incrementBase;
+
+    // Sample timestamp and trigger
+    volatile int64_t m_sampleNs;
+    int64_t m_triggerNs;
+    volatile TriggerFunction m_trigger;
+
+    /**
+        Construct
+    **/
+    PtpManager();
+
+    int64_t TimeNsRead();
+    void TimeNsWrite(int64_t timeNs);
+    void TimeAdjust(int64_t offsetNs);
+    void RateAdjust(float ppb);
+
+    bool Servo(int64_t offsetNs);
+    void SyncProcess();
+    void DelayReqSend();
+
+    void EventReceive(struct pbuf *p, const ip_addr_t *addr);
+    void GeneralReceive(struct pbuf *p, const ip_addr_t *addr);
+    static void EventCallback(void *arg, struct udp_pcb *pcb, struct pbuf *p,
+                              const ip_addr_t *addr, u16_t port);
+    static void GeneralCallback(void *arg, struct udp_pcb *pcb,
+                                struct pbuf *p, const ip_addr_t *addr,
+                                u16_t port);
+
+    /**
+        Latch the PTP event timestamps. Called from the GMAC interrupt with
+        the interrupt status.
+    **/
+    void IrqHandlerTimestamp(uint32_t isr);
+
+    /**
+        Latch the sample time and run a due trigger. Called from the fast
+        update.
+    **/
+    void SampleUpdate();
+}; // PtpManager
+
+} // ClearCore namespace
+
+#endif // __PTPMANAGER_H__
@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    \file QuadratureDecoder.h
+    \brief ClearCore interrupt-driven quadrature decoder.
+
+    Decodes a second quadrature encoder on two external interrupt inputs,
+    without the position decoder peripheral used by EncoderInput.
+**/
+
+#ifndef __QUADRATUREDECODER_H__
+#define __QUADRATUREDECODER_H__
+
+#include <stdint.h>
+#include "DigitalIn.h"
+
+namespace ClearCore {
+
+/// The number of edges QuadratureDecoder::Velocity() is timed over; 4 spans
+/// one full quadrature cycle
+#define QUADRATURE_DECODER_EDGES 4
+
+/**
+    \class QuadratureDecoder
+    \brief ClearCore interrupt-driven quadrature decoder.
+
+    A QuadratureDecoder counts a quadrature encoder wired to two inputs with
+    external interrupts (DI-6 through A-12). Every edge of either input
+    interrupts, and the new A/B state is looked up against the previous one
+    in a 16-entry transition table, so each edge costs one short interrupt.
+    The EncoderInput connector keeps the hardware position decoder on DI-6
+    through DI-8, so a QuadratureDecoder suits a second, slower encoder on
+    the remaining inputs. CCIO-8 pins are read over SPI once per sample and
+    have no interrupts, so they can't be used.
+
+    The count rate is limited by interrupt latency: when both inputs change
+    before the interrupt of the first reads them, the step is ambiguous.
+    Such transitions are not counted and are reported by ErrorCount(), and
+    the shortest time seen between edges is reported by EdgeIntervalMin() so
+    that the margin to that limit can be checked in the application.
+
+    \code{.cpp}
+    QuadratureDecoder FeedEncoder;
+
+    FeedEncoder.Start(ConnectorA11, ConnectorA12);
+    int32_t feedPosn = FeedEncoder.Position();
+    \endcode
+**/
+class QuadratureDecoder {
+    friend class InputManager;
+
+public:
+    /**
+        Construct
+    **/
+    QuadratureDecoder();
+
+    /**
+        \brief Start decoding the encoder on two inputs.
+
+        Any callbacks registered on the inputs with
+        DigitalIn::InterruptHandlerSet() keep running, but the inputs
+        interrupt on both edges.
+
+        \code{.cpp}
+        FeedEncoder.Start(ConnectorA11, ConnectorA12);
+        \endcode
+
+        \param[in] inputA The input wired to the A channel.
+        \param[in] inputB The input wired to the B channel.
+
+        \return True if decoding started; false if either input has no
+        external interrupt, the inputs are the same, or an input is in use by
+        another decoder.
+    **/
+    bool Start(DigitalIn &inputA, DigitalIn &inputB);
+
+    /**
+        \brief Stop decoding. The position is kept.
+    **/
+    void Stop();
+
+    /**
+        \brief The accumulated position, in counts.
+    **/
+    int32_t Position() {
+        return m_posn;
+    }
+
+    /**
+        \brief Set the position.
+
+        \code{.cpp}
+        // Zero the feed position
+        FeedEncoder.Position(0);
+        \endcode
+
+        \param[in] newPosn The new position, in counts.
+    **/
+    void Position(int32_t newPosn);
+
+    /**
+        \brief The velocity, in counts per second, from the time taken by the
+        last #QUADRATURE_DECODER_EDGES edges.
+
+        Without new edges the estimate falls off as one count over the time
+        since the last edge, and is 0 after a second.
+    **/
+    int32_t Velocity();
+
+    /**
+        \brief The number of ambiguous transitions, where both inputs changed
+        between interrupts, since the last Start().
+    **/
+    uint32_t ErrorCount() {
+        return m_errorCount;
+    }
+
+    /**
+        \brief The shortest time between two edges since the last Start() or
+        EdgeIntervalReset(), in CPU cycles (see CPU_CLK for their rate).
+
+        The count rate at this interval is CPU_CLK / EdgeIntervalMin().
+    **/
+    uint32_t EdgeIntervalMin() {
+        return m_intervalMin;
+    }
+
+    /**
+        \brief Restart the EdgeIntervalMin() measurement.
+    **/
+    void EdgeIntervalReset() {
+        m_intervalMin = UINT32_MAX;
+    }
+
+private:
+    // The interrupt lines in use, or -1 when stopped
+    int8_t m_extIntA;
+    int8_t m_extIntB;
+    // The input pins, read straight from the port
+    volatile uint32_t *m_inA;
+    volatile uint32_t *m_inB;
+    uint32_t m_maskA;
+    uint32_t m_maskB;
+    // The last A/B state, A in bit 1
+    uint8_t m_state;
+    volatile int32_t m_posn;
+    volatile uint32_t m_errorCount;
+    volatile uint32_t m_intervalMin;
+    // The most recent counted edges, by cycle count and position
+    uint32_t m_edgeCycles[QUADRATURE_DECODER_EDGES];
+    int32_t m_edgePosn[QUADRATURE_DECODER_EDGES];
+    uint8_t m_edgeIndex;
+
+    uint8_t StateRead() {
+        return ((*m_inA & m_maskA) ? 2 : 0) | ((*m_inB & m_maskB) ? 1 : 0);
+    }
+
+    /**
+        Decode one edge. Called from the interrupt of either line.
+    **/
+    void Edge();
+}; // QuadratureDecoder
+
+} // ClearCore namespace
+
+#endif // __QUADRATUREDECODER_H__
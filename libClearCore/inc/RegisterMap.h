@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+    \file RegisterMap.h
+    \brief Binds a fieldbus register image to the process image.
+
+    A constant table says which bytes of an application register image come
+    from which field of the process image or motor snapshot, and which bytes
+    go to the output image or to application command slots.
+**/
+
+#ifndef __REGISTERMAP_H__
+#define __REGISTERMAP_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace ClearCore {
+
+/**
+    Build a RegisterMap::Binding from an image field to a source field. The
+    offsets and sizes are worked out by the compiler.
+
+    \param[in] imageType The register image struct.
+    \param[in] imageField The field of \a imageType.
+    \param[in] source The RegisterMap::MapSources the field is bound to.
+    \param[in] sourceType The struct of \a source: ProcessImage::InputImage,
+    MotorManager::MotorsSnapshot, ProcessImage::OutputImage or the command
+    struct.
+    \param[in] sourceField The field of \a sourceType.
+**/
+#define REGISTER_BIND(imageType, imageField, source, sourceType, sourceField) \
+    {offsetof(imageType, imageField), offsetof(sourceType, sourceField),      \
+     sizeof(reinterpret_cast<imageType *>(0)->imageField),                    \
+     sizeof(reinterpret_cast<sourceType *>(0)->sourceField), source}
+
+/**
+    \class RegisterMap
+    \brief Binds a fieldbus register image to the process image.
+
+    The register image is a plain application struct laid out the way a
+    protocol sees it: a Modbus ModbusTcpServer::RegisterRange, an EtherNet/IP
+    assembly or a UDP payload can all point at it, so every request is a
+    direct copy to or from the image with no per-address decoding. The
+    binding table, made with #REGISTER_BIND, is built at compile time and
+    checked with RegisterMapValid() in a static_assert.
+
+    Gather() copies the bound input and motor fields into the image, and
+    Scatter() copies the bound output and command bytes out of it and commits
+    the output image; call them around the protocol's Poll().
+
+    \code{.cpp}
+    struct ModbusImage {
+        uint16_t Inputs[2];
+        uint16_t Analog[4];
+        int32_t M0Position;
+        uint16_t OutputMask[2];
+        int16_t Io[6];
+    };
+    ModbusImage Registers;
+
+    constexpr RegisterMap::Binding Bindings[] = {
+        REGISTER_BIND(ModbusImage, Inputs, RegisterMap::MAP_INPUTS,
+                      ProcessImage::InputImage, Digital),
+        REGISTER_BIND(ModbusImage, Analog, RegisterMap::MAP_INPUTS,
+                      ProcessImage::InputImage, Analog),
+        REGISTER_BIND(ModbusImage, M0Position, RegisterMap::MAP_MOTORS,
+                      MotorManager::MotorsSnapshot,
+                      Motors[0].PositionRefCommanded),
+        REGISTER_BIND(ModbusImage, OutputMask, RegisterMap::MAP_OUTPUTS,
+                      ProcessImage::OutputImage, Mask),
+        REGISTER_BIND(ModbusImage, Io, RegisterMap::MAP_OUTPUTS,
+                      ProcessImage::OutputImage, Io),
+    };
+    static_assert(RegisterMapValid(Bindings, 5, sizeof(ModbusImage)),
+                  "Bad register map");
+
+    RegisterMap Map(Bindings, 5, &Registers);
+    const ModbusTcpServer::RegisterRange Ranges[] = {
+        {ModbusRtu::HOLDING_REGISTER, 0, sizeof(ModbusImage) / 2,
+         &Registers, false},
+    };
+
+    while (true) {
+        Map.Gather();
+        Modbus.Poll();
+        Map.Scatter();
+    }
+    \endcode
+
+    \note Values are copied byte for byte, so multi-word fields keep the
+    processor's little-endian word order in the registers.
+**/
+class RegisterMap {
+public:
+    /**
+        \brief The data a binding copies to or from.
+    **/
+    typedef enum {
+        /// The latest ProcessImage::InputImage; copied into the image
+        MAP_INPUTS,
+        /// The latest MotorManager::MotorsSnapshot; copied into the image
+        MAP_MOTORS,
+        /// The ProcessImage::OutputImage; copied from the image
+        MAP_OUTPUTS,
+        /// The application's command struct; copied from the image
+        MAP_COMMANDS,
+    } MapSources;
+
+    /**
+        \brief One field of the register image bound to one source field.
+        Build with #REGISTER_BIND.
+    **/
+    typedef struct {
+        /// The byte offset of the field in the register image
+        uint16_t ImageOffset;
+        /// The byte offset of the field in the source
+        uint16_t SourceOffset;
+        /// The size of the image field in bytes
+        uint16_t Size;
+        /// The size of the source field in bytes; must equal \a Size
+        uint16_t SourceSize;
+        /// The MapSources of the field
+        uint8_t Source;
+    } Binding;
+
+    /**
+        \brief Construct a register map.
+
+        The table, image and commands are used in place, so they must stay
+        valid while the map is used.
+
+        \param[in] bindings The binding table.
+        \param[in] count The number of entries in the table.
+        \param[in] image The register image.
+        \param[in] commands (optional) The command struct that #MAP_COMMANDS
+        bindings write to.
+    **/
+    RegisterMap(const Binding *bindings, uint8_t count, void *image,
+                void *commands = nullptr);
+
+    /**
+        \brief Copy the bound inputs and motor state into the image.
+
+        All of the copied inputs come from one sample, as do all of the motor
+        fields.
+    **/
+    void Gather();
+
+    /**
+        \brief Copy the bound outputs and commands out of the image.
+
+        The output image is committed if any output is bound, so the outputs
+        change together in the next sample.
+    **/
+    void Scatter();
+
+private:
+    const Binding *m_bindings;
+    uint8_t m_count;
+    uint8_t *m_image;
+    uint8_t *m_commands;
+    // The MapSources used by the table, one bit each
+    uint8_t m_sources;
+}; // RegisterMap
+
+/**
+    \brief Check a binding table at compile time.
+
+    Every binding must have matching sizes and lie within the image, and the
+    bindings must be in order of image offset without overlapping.
+
+    \param[in] bindings The binding table.
+    \param[in] count The number of entries in the table.
+    \param[in] imageSize The size of the register image in bytes.
+
+    \return True if the table is valid.
+**/
+constexpr bool RegisterMapValid(const RegisterMap::Binding *bindings,
+                                uint8_t count, uint16_t imageSize) {
+    return !count ||
+           (bindings[0].Size && bindings[0].Size == bindings[0].SourceSize &&
+            bindings[0].Source <= RegisterMap::MAP_COMMANDS &&
+            bindings[0].ImageOffset + bindings[0].Size <= imageSize &&
+            (count == 1 || bindings[0].ImageOffset + bindings[0].Size <=
+             bindings[1].ImageOffset) &&
+            RegisterMapValid(bindings + 1, count - 1, imageSize));
+}
+
+} // ClearCore namespace
+
+#endif // __REGISTERMAP_H__
@@ -0,0 +1,320 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+    \file ReplayManager.h
+    \brief ClearCore record and replay of the sampled inputs and commands.
+
+    Records what the sample rate update read from the hardware, and the
+    command batches it ran, so that a run can be fed back through the same
+    code in place of the hardware.
+**/
+
+#ifndef __REPLAYMANAGER_H__
+#define __REPLAYMANAGER_H__
+
+#include <stdint.h>
+#include "AdcManager.h"
+#include "CommandBatch.h"
+#include "RingBuffer.h"
+#include "SysConnectors.h"
+
+namespace ClearCore {
+
+/// The size of the header that starts each recorded command batch, in bytes
+#define REPLAY_COMMAND_HEADER_LEN 6
+
+/**
+    \class ReplayManager
+    \brief ClearCore record and replay of the sampled inputs and commands.
+
+    While recording, each sample appends one Frame with the raw input image
+    the sample read: the port input registers the connectors are filtered
+    from, the filtered CCIO-8 inputs, the converted ADC results and the
+    encoder's change in position. Each command batch that starts running is
+    appended to a separate byte stream, tagged with the index of the frame
+    it started in. The main loop drains both to wherever the run is kept,
+    such as the SD card or a host.
+
+    Replaying feeds the frames back in order, one a sample, in place of the
+    hardware reads: the connectors, CCIO-8 pins, analog inputs and encoder
+    see exactly what they saw when the run was recorded, and each batch is
+    started in the frame it started in then. Batches submitted by the
+    application are refused while replaying. With the same configuration
+    and the same starting state, the filtered inputs come out the same; each
+    sample where InputMgr.InputsRT() differs from what was recorded counts
+    as a divergence.
+
+    The ring storage is supplied by the application, and its size in each
+    ring must be a power of two. When recording, frames the main loop has
+    not drained in time are dropped and counted as overruns. When replaying,
+    the main loop keeps the rings topped up; a sample that finds no frame
+    stops the replay and flags an underrun.
+
+    Interrupt driven inputs (edge interrupts, position capture and the
+    encoder index) still come from the hardware while replaying.
+
+    \code{.cpp}
+    static ReplayManager::Frame frames[256];
+    static uint8_t commands[1024];
+    ReplayMgr.Rings(frames, 256, commands, 1024);
+    ReplayMgr.RecordStart();
+    while (recording) {
+        ReplayManager::Frame frame[16];
+        uint32_t count = ReplayMgr.FramesRead(frame, 16);
+        // Append the frames to the run file
+    }
+    \endcode
+**/
+class ReplayManager {
+    friend class CommandBatch;
+    friend class SysManager;
+
+public:
+    /**
+        \enum ReplayStates
+        \brief What the manager is doing.
+    **/
+    typedef enum {
+        /// Neither recording nor replaying
+        REPLAY_IDLE,
+        /// Appending a frame every sample
+        REPLAY_RECORDING,
+        /// Feeding a frame back every sample
+        REPLAY_REPLAYING,
+    } ReplayStates;
+
+    /**
+        \brief The input image of one sample.
+    **/
+    typedef struct __attribute__((packed)) {
+        /// The filtered CCIO-8 inputs, as CcioBoardManager::InputState()
+        uint64_t Ccio;
+        /// The raw port input registers, before filtering
+        uint32_t Ports[CLEARCORE_PORT_MAX];
+        /// The filtered connector inputs at the end of the sample, as
+        /// InputManager::InputsRT(); checked when replaying
+        uint32_t Inputs;
+        /// The converted ADC results, before filtering
+        uint16_t Adc[AdcManager::ADC_CHANNEL_COUNT];
+        /// The encoder's change in position, in counts
+        int16_t EncoderSteps;
+    } Frame;
+
+#ifndef HIDE_FROM_DOXYGEN
+    /**
+        Public accessor for singleton instance.
+    **/
+    static ReplayManager &Instance();
+#endif
+
+    /**
+        \brief Supply the rings for the frames and the command batches. Any
+        recording or replay is stopped first.
+
+        Each recorded batch takes #REPLAY_COMMAND_HEADER_LEN bytes, the
+        frame index (uint32_t) and the length (uint16_t) little-endian,
+        followed by the batch request.
+
+        \param[in] frames The frame storage.
+        \param[in] frameCount The number of frames; a power of two.
+        \param[in] commands The command storage.
+        \param[in] commandSize The size of the command storage, in bytes; a
+        power of two.
+
+        \return True if the rings were taken; false if a size is not a power
+        of two.
+    **/
+    bool Rings(Frame *frames, uint32_t frameCount,
+               uint8_t *commands, uint32_t commandSize);
+
+    /**
+        \brief Start recording a frame every sample, from frame 0.
+
+        \return True if recording started; false if there are no rings.
+    **/
+    bool RecordStart();
+
+    /**
+        \brief Start replaying the frames in the rings, from frame 0.
+
+        Fill the rings with FramesWrite() and CommandsWrite() first, and
+        keep them topped up while the replay runs.
+
+        \return True if the replay started; false if there are no rings or
+        no frames to replay.
+    **/
+    bool ReplayStart();
+
+    /**
+        \brief Stop recording or replaying. The hardware inputs take over
+        from the next sample.
+    **/
+    void Stop();
+
+    /**
+        \brief What the manager is doing.
+    **/
+    ReplayStates State() {
+        return m_state;
+    }
+
+    /**
+        \brief The number of frames recorded or replayed since the start.
+    **/
+    uint32_t Frames() {
+        return m_frames;
+    }
+
+    /**
+        \brief Take recorded frames out of the ring.
+
+        \return The number of frames read.
+    **/
+    uint32_t FramesRead(Frame *frames, uint32_t count) {
+        return m_frameRing.Read(frames, count);
+    }
+
+    /**
+        \brief Take recorded command bytes out of the ring.
+
+        \return The number of bytes read.
+    **/
+    uint32_t CommandsRead(uint8_t *data, uint32_t size) {
+        return m_commandRing.Read(data, size);
+    }
+
+    /**
+        \brief Add frames to replay to the ring.
+
+        \return The number of frames written.
+    **/
+    uint32_t FramesWrite(const Frame *frames, uint32_t count) {
+        return m_frameRing.Write(frames, count);
+    }
+
+    /**
+        \brief Add recorded command bytes to replay to the ring. Bytes may
+        be written in pieces of any size; a batch is started once it has
+        been written whole.
+
+        \return The number of bytes written.
+    **/
+    uint32_t CommandsWrite(const uint8_t *data, uint32_t size) {
+        return m_commandRing.Write(data, size);
+    }
+
+    /**
+        \brief The number of frames and batches dropped while recording
+        because the main loop had not drained the rings.
+    **/
+    uint32_t Overruns() {
+        return m_overruns;
+    }
+
+    /**
+        \brief Check whether the last replay stopped because it ran out of
+        frames.
+    **/
+    bool Underrun() {
+        return m_underrun;
+    }
+
+    /**
+        \brief The number of replayed samples whose filtered inputs differed
+        from the recording, plus the batches that could not be started in
+        the frame they were recorded in.
+    **/
+    uint32_t Divergences() {
+        return m_divergences;
+    }
+
+    /**
+        \brief The index of the first frame that diverged, valid while
+        Divergences() is not zero.
+    **/
+    uint32_t DivergenceFirst() {
+        return m_divergenceFirst;
+    }
+
+private:
+    volatile ReplayStates m_state;
+    RingBuffer<Frame> m_frameRing;
+    RingBuffer<uint8_t> m_commandRing;
+    bool m_rings;
+
+    volatile uint32_t m_frames;
+    volatile uint32_t m_overruns;
+    volatile bool m_underrun;
+    volatile uint32_t m_divergences;
+    volatile uint32_t m_divergenceFirst;
+
+    // The frame being replayed, the batch being unpacked for it, and the
+    // readings the connectors take in place of the hardware
+    Frame m_frame;
+    uint8_t m_command[BATCH_REQUEST_MAX];
+    volatile uint32_t m_ports[CLEARCORE_PORT_MAX];
+    volatile uint16_t m_adc[AdcManager::ADC_CHANNEL_COUNT];
+    volatile int16_t m_encoderSteps;
+
+    /**
+        Construct
+    **/
+    ReplayManager();
+
+    /**
+        Feed the next frame and any batch due in it to the connectors.
+        Called at the start of the sample rate update.
+    **/
+    void SampleBegin();
+
+    /**
+        Record the sample's frame, or check it against the replayed one.
+        Called once the sample's inputs have been processed.
+    **/
+    void SampleEnd();
+
+    /**
+        Record a batch that has started running. Called by CommandBatch.
+    **/
+    void CommandRecord(const uint8_t *request, uint16_t length);
+
+    /**
+        Start any batch due in the current frame.
+    **/
+    void CommandsReplay();
+
+    /**
+        Point the connectors back at the hardware.
+    **/
+    void HardwareRestore();
+
+    /**
+        Count a divergence in the current frame.
+    **/
+    void Diverged();
+}; // ReplayManager
+
+} // ClearCore namespace
+
+#endif // __REPLAYMANAGER_H__
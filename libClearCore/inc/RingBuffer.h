@@ -0,0 +1,382 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    \file RingBuffer.h
+    \brief Lock-free single-producer, single-consumer ring buffer template.
+
+    The ring buffer shared by the serial ports, USB, TCP and the input event
+    FIFO to pass data between an interrupt and the main loop.
+**/
+
+#ifndef __RINGBUFFER_H__
+#define __RINGBUFFER_H__
+
+#include <stdint.h>
+#include <string.h>
+#include "atomic_utils.h"
+
+namespace ClearCore {
+
+/**
+    \class RingBuffer
+    \brief Lock-free single-producer, single-consumer ring buffer.
+
+    One side, such as an interrupt handler, only writes and the other, such
+    as the main loop, only reads, so neither needs to disable interrupts.
+    The write index is stored only by the writer and the read index only by
+    the reader. Each publishes its index with a release store after it has
+    finished with the entries, and reads the other's with an acquire load,
+    so the entries are always seen complete. On the Cortex-M4 these compile
+    to a DMB around the index accesses; the entries themselves are plain
+    memory.
+
+    The indices run freely and are masked on access, so the whole buffer is
+    usable and its size must be a power of two. The buffer is supplied by
+    the owner, so it may be statically allocated, aligned for DMA, or swapped
+    for a larger one; RingBufferStatic holds its own.
+
+    Besides single entries and copies in and out, each side can work on the
+    entries in place: WriteSpans() and ReadSpans() give the free or
+    waiting entries as at most two contiguous spans, the second starting at
+    the beginning of the buffer, and WriteCommit() and ReadCommit() publish
+    how many were used. This lets a DMA transfer or a network stack fill or
+    drain the buffer directly.
+
+    \code{.cpp}
+    // Queue samples from an interrupt and drain them in the main loop
+    RingBufferStatic<int16_t, 64> samples;
+
+    void SampleIsr() {
+        samples.Push(ConnectorA9.State());
+    }
+
+    int16_t block[16];
+    uint32_t count = samples.Read(block, 16);
+    \endcode
+
+    \tparam T The entry type; entries are copied with memcpy.
+**/
+template <typename T>
+class RingBuffer {
+public:
+    /**
+        \brief A run of contiguous entries in the buffer.
+    **/
+    typedef struct {
+        /// The first entry
+        T *Data;
+        /// The number of entries
+        uint32_t Length;
+    } Span;
+
+    /**
+        \brief Construct a ring buffer with no storage; call Storage() before
+        use.
+    **/
+    RingBuffer() : m_buffer(nullptr), m_mask(0), m_write(0), m_read(0) {}
+
+    /**
+        \brief Construct a ring buffer on the given storage.
+
+        \param[in] buffer The entries.
+        \param[in] size The number of entries; a power of two.
+    **/
+    RingBuffer(T *buffer, uint32_t size)
+        : m_buffer(nullptr), m_mask(0), m_write(0), m_read(0) {
+        Storage(buffer, size);
+    }
+
+    /**
+        \brief Change the storage, emptying the buffer. Neither side may be
+        using the buffer.
+
+        \param[in] buffer The entries.
+        \param[in] size The number of entries; a power of two.
+
+        \return True if the storage was taken; false if the size is not a
+        power of two.
+    **/
+    bool Storage(T *buffer, uint32_t size) {
+        if (!buffer || !size || (size & (size - 1))) {
+            return false;
+        }
+        m_buffer = buffer;
+        m_mask = size - 1;
+        Clear();
+        return true;
+    }
+
+    /**
+        \brief Empty the buffer. Neither side may be using the buffer.
+    **/
+    void Clear() {
+        m_read = 0;
+        atomic_store_n(&m_write, 0);
+    }
+
+    /**
+        \brief The storage, for a DMA transfer that uses it directly.
+    **/
+    T *Data() {
+        return m_buffer;
+    }
+
+    /**
+        \brief The number of entries in the storage.
+    **/
+    uint32_t Size() const {
+        return m_mask + 1;
+    }
+
+    /**
+        \brief The number of entries waiting to be read.
+    **/
+    uint32_t Count() const {
+        return atomic_load_n(&m_write) - atomic_load_n(&m_read);
+    }
+
+    /**
+        \brief The number of entries that can be written.
+    **/
+    uint32_t Space() const {
+        return Size() - Count();
+    }
+
+    /**
+        \brief Check whether there is nothing to read.
+    **/
+    bool Empty() const {
+        return !Count();
+    }
+
+    /**
+        \brief Check whether there is no room to write.
+    **/
+    bool Full() const {
+        return !Space();
+    }
+
+    /**
+        \brief Write one entry.
+
+        \return False if the buffer is full.
+    **/
+    bool Push(const T &value) {
+        uint32_t write = m_write;
+        if (write - atomic_load_n(&m_read) > m_mask) {
+            return false;
+        }
+        m_buffer[write & m_mask] = value;
+        atomic_store_n(&m_write, write + 1);
+        return true;
+    }
+
+    /**
+        \brief Read one entry.
+
+        \return False if the buffer is empty.
+    **/
+    bool Pop(T &value) {
+        uint32_t read = m_read;
+        if (atomic_load_n(&m_write) == read) {
+            return false;
+        }
+        value = m_buffer[read & m_mask];
+        atomic_store_n(&m_read, read + 1);
+        return true;
+    }
+
+    /**
+        \brief Read an entry without removing it.
+
+        \param[out] value The entry read.
+        \param[in] offset Which waiting entry, 0 being the next to read.
+
+        \return False if there are not that many entries waiting.
+    **/
+    bool Peek(T &value, uint32_t offset = 0) const {
+        uint32_t read = m_read;
+        if (atomic_load_n(&m_write) - read <= offset) {
+            return false;
+        }
+        value = m_buffer[(read + offset) & m_mask];
+        return true;
+    }
+
+    /**
+        \brief Copy entries in, as many as there is room for.
+
+        \return The number of entries written.
+    **/
+    uint32_t Write(const T *data, uint32_t count) {
+        Span first, second;
+        uint32_t space = WriteSpans(first, second);
+        if (count > space) {
+            count = space;
+        }
+        SpansCopyIn(first, second, data, count);
+        WriteCommit(count);
+        return count;
+    }
+
+    /**
+        \brief Copy entries out, as many as are waiting.
+
+        \return The number of entries read.
+    **/
+    uint32_t Read(T *data, uint32_t count) {
+        Span first, second;
+        uint32_t waiting = ReadSpans(first, second);
+        if (count > waiting) {
+            count = waiting;
+        }
+        SpansCopyOut(first, second, data, count);
+        ReadCommit(count);
+        return count;
+    }
+
+    /**
+        \brief Get the free entries to fill in place.
+
+        \param[out] first The free entries from the write position.
+        \param[out] second The free entries from the start of the buffer,
+        after \a first wraps.
+
+        \return The number of free entries.
+    **/
+    uint32_t WriteSpans(Span &first, Span &second) {
+        uint32_t write = m_write;
+        uint32_t space = Size() - (write - atomic_load_n(&m_read));
+        SpansGet(write, space, first, second);
+        return space;
+    }
+
+    /**
+        \brief Publish entries filled in place.
+
+        \param[in] count The number of entries, from the start of the first
+        span from WriteSpans().
+    **/
+    void WriteCommit(uint32_t count) {
+        atomic_store_n(&m_write, m_write + count);
+    }
+
+    /**
+        \brief Get the waiting entries to use in place.
+
+        \param[out] first The waiting entries from the read position.
+        \param[out] second The waiting entries from the start of the
+        buffer, after \a first wraps.
+
+        \return The number of waiting entries.
+    **/
+    uint32_t ReadSpans(Span &first, Span &second) {
+        uint32_t read = m_read;
+        uint32_t count = atomic_load_n(&m_write) - read;
+        SpansGet(read, count, first, second);
+        return count;
+    }
+
+    /**
+        \brief Release entries used in place.
+
+        \param[in] count The number of entries, from the start of the first
+        span from ReadSpans().
+    **/
+    void ReadCommit(uint32_t count) {
+        atomic_store_n(&m_read, m_read + count);
+    }
+
+    /**
+        \brief Bring the write position up to date for a circular DMA
+        transfer that fills the storage on its own.
+
+        A DMA producer wraps without regard to the reader, so the reader
+        calls this before reading; anything the transfer has written more
+        than the buffer's size ahead is lost.
+
+        \param[in] position The storage index the transfer writes next.
+    **/
+    void WriteSync(uint32_t position) {
+        uint32_t read = m_read;
+        atomic_store_n(&m_write, read + ((position - read) & m_mask));
+    }
+
+private:
+    T *m_buffer;
+    uint32_t m_mask;
+    // Stored only by the writer
+    volatile uint32_t m_write;
+    // Stored only by the reader
+    volatile uint32_t m_read;
+
+    void SpansGet(uint32_t index, uint32_t count, Span &first, Span &second) {
+        uint32_t start = index & m_mask;
+        uint32_t tilWrap = Size() - start;
+        first.Data = &m_buffer[start];
+        first.Length = count < tilWrap ? count : tilWrap;
+        second.Data = m_buffer;
+        second.Length = count - first.Length;
+    }
+
+    static void SpansCopyIn(const Span &first, const Span &second,
+                            const T *data, uint32_t count) {
+        uint32_t len = count < first.Length ? count : first.Length;
+        memcpy(first.Data, data, len * sizeof(T));
+        memcpy(second.Data, data + len, (count - len) * sizeof(T));
+    }
+
+    static void SpansCopyOut(const Span &first, const Span &second,
+                             T *data, uint32_t count) {
+        uint32_t len = count < first.Length ? count : first.Length;
+        memcpy(data, first.Data, len * sizeof(T));
+        memcpy(data + len, second.Data, (count - len) * sizeof(T));
+    }
+}; // RingBuffer
+
+/**
+    \class RingBufferStatic
+    \brief A RingBuffer that holds its own storage.
+
+    \tparam T The entry type.
+    \tparam SIZE The number of entries; a power of two.
+**/
+template <typename T, uint32_t SIZE>
+class RingBufferStatic : public RingBuffer<T> {
+    static_assert(SIZE && !(SIZE & (SIZE - 1)),
+                  "The ring buffer size must be a power of two");
+
+public:
+    /**
+        \brief Construct an empty ring buffer.
+    **/
+    RingBufferStatic() : RingBuffer<T>(m_storage, SIZE), m_storage() {}
+
+private:
+    // Aligned so the storage can be a word-wide DMA source or destination
+    T m_storage[SIZE] __attribute__((aligned(4)));
+}; // RingBufferStatic
+
+} // ClearCore namespace
+
+#endif // __RINGBUFFER_H__
@@ -0,0 +1,370 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    \file ScopeCapture.h
+    \brief ClearCore sample rate triggered capture of internal signals.
+
+    Records selected variables into a RAM ring once per sample, around a
+    trigger, like a digital oscilloscope.
+**/
+
+#ifndef __SCOPECAPTURE_H__
+#define __SCOPECAPTURE_H__
+
+#include <stdint.h>
+
+namespace ClearCore {
+
+/// The size of the capture ring, in bytes
+#ifndef SCOPE_BUFFER_SIZE
+#define SCOPE_BUFFER_SIZE 8192
+#endif
+
+/// The most channels a capture may record
+#ifndef SCOPE_CHANNELS_MAX
+#define SCOPE_CHANNELS_MAX 8
+#endif
+
+/**
+    Build a ScopeCapture::Channel that reads a variable of 1, 2 or 4 bytes,
+    such as ConnectorM0.PositionRefCommanded() or
+    AdcMgr.FilteredResult(AdcManager::ADC_AIN09).
+
+    \param[in] var The variable.
+    \param[in] kind The ScopeCapture::ChannelKinds of the variable.
+**/
+#define SCOPE_VARIABLE(var, kind) {&(var), sizeof(var), kind, NULL}
+
+/**
+    Build a ScopeCapture::Channel that records the value returned by a
+    function, for a value that is computed rather than stored.
+
+    \param[in] fn A ScopeCapture::ReadFunction.
+**/
+#define SCOPE_FUNCTION(fn) {NULL, 4, ScopeCapture::SCOPE_SIGNED, fn}
+
+/**
+    \class ScopeCapture
+    \brief ClearCore sample rate triggered capture of internal signals.
+
+    Once armed, each sample, or each \a decimation samples, one record of
+    every channel is added to a ring in RAM, right after the data logger's
+    sample. A channel reads a variable directly. Only a function channel
+    costs a call, so a record takes a few cycles per channel.
+
+    A capture triggers on an edge of one channel through a level, checked
+    on every record, or when Trigger() is called, for example from an input
+    interrupt or an event handler. The ring then keeps the \a preRecords
+    records before the trigger and fills the rest with the records from the
+    trigger on. Once it is full the capture is done. Read() then copies the
+    records out, oldest first, to be sent over USB, Ethernet or to a file.
+
+    A record holds the channels in table order, each in its own size,
+    little-endian and unpadded.
+
+    \code{.cpp}
+    int32_t VelM0() {
+        return ConnectorM0.VelocityRefCommanded();
+    }
+    int32_t Inputs() {
+        return InputMgr.InputsRT().reg;
+    }
+
+    const ScopeCapture::Channel channels[] = {
+        SCOPE_VARIABLE(ConnectorM0.PositionRefCommanded(),
+                       ScopeCapture::SCOPE_SIGNED),
+        SCOPE_FUNCTION(VelM0),
+        SCOPE_VARIABLE(ConnectorM0.HlfbPercent(), ScopeCapture::SCOPE_FLOAT),
+        SCOPE_VARIABLE(AdcMgr.FilteredResult(AdcManager::ADC_AIN09),
+                       ScopeCapture::SCOPE_UNSIGNED),
+        SCOPE_FUNCTION(Inputs),
+    };
+
+    // Keep 100 records from before the move reaches 1000 steps/s
+    Scope.Setup(channels, 5);
+    Scope.TriggerLevel(1, ScopeCapture::TRIGGER_RISING, 1000);
+    Scope.Arm(100);
+    ConnectorM0.Move(20000);
+    while (Scope.State() != ScopeCapture::SCOPE_DONE) {
+        continue;
+    }
+
+    // Send the capture over USB
+    uint8_t chunk[256];
+    uint32_t length = Scope.Records() * Scope.RecordSize();
+    for (uint32_t offset = 0; offset < length; offset += sizeof(chunk)) {
+        uint32_t count = Scope.Read(offset, chunk, sizeof(chunk));
+        ConnectorUsb.SendDirect(chunk, count);
+    }
+    \endcode
+**/
+class ScopeCapture {
+    friend class SysManager;
+
+public:
+    /**
+        \enum ChannelKinds
+        \brief How a channel's value is compared with the trigger level.
+    **/
+    typedef enum {
+        /// A signed integer
+        SCOPE_SIGNED,
+        /// An unsigned integer
+        SCOPE_UNSIGNED,
+        /// A 4 byte float
+        SCOPE_FLOAT,
+    } ChannelKinds;
+
+    /**
+        \enum TriggerEdges
+        \brief The crossings of the trigger level that trigger a capture.
+    **/
+    typedef enum {
+        /// The channel rises to or above the level
+        TRIGGER_RISING,
+        /// The channel falls below the level
+        TRIGGER_FALLING,
+        /// Either crossing
+        TRIGGER_EITHER,
+    } TriggerEdges;
+
+    /**
+        \enum States
+        \brief The progress of a capture.
+    **/
+    typedef enum {
+        /// Not recording
+        SCOPE_IDLE,
+        /// Recording and waiting for the trigger
+        SCOPE_ARMED,
+        /// Recording the records after the trigger
+        SCOPE_TRIGGERED,
+        /// The capture is complete and may be read
+        SCOPE_DONE,
+    } States;
+
+    /**
+        Returns a channel's value; called from the sample rate interrupt, so
+        it must be short.
+    **/
+    typedef int32_t (*ReadFunction)();
+
+    /**
+        \brief One recorded channel; build it with #SCOPE_VARIABLE or
+        #SCOPE_FUNCTION.
+    **/
+    typedef struct {
+        /// The variable read, or NULL for a function channel
+        const volatile void *Address;
+        /// The size of the variable: 1, 2 or 4 bytes
+        uint8_t Size;
+        /// The variable's #ChannelKinds
+        uint8_t Kind;
+        /// The function called instead of reading a variable, or NULL
+        ReadFunction Read;
+    } Channel;
+
+#ifndef HIDE_FROM_DOXYGEN
+    /**
+        Public accessor for singleton instance.
+    **/
+    static ScopeCapture &Instance();
+#endif
+
+    /**
+        \brief Select the channels to record, and stop any capture.
+
+        The table is copied. The trigger is cleared.
+
+        \param[in] channels The channels, in record order.
+        \param[in] channelCount The number of channels, up to
+        #SCOPE_CHANNELS_MAX.
+        \param[in] decimation The number of samples per record.
+
+        \return True if the channels were set; false if a channel's size
+        is not 1, 2 or 4, a function channel is not 4 bytes, or not even two
+        records fit in #SCOPE_BUFFER_SIZE.
+    **/
+    bool Setup(const Channel *channels, uint8_t channelCount,
+               uint16_t decimation = 1);
+
+    /**
+        \brief Trigger on a channel crossing a level.
+
+        \param[in] channel The index of the channel in the table.
+        \param[in] edge The crossings that trigger.
+        \param[in] level The level, in the channel's units.
+
+        \return True if the trigger was set; false while recording or if
+        there is no such channel.
+    **/
+    bool TriggerLevel(uint8_t channel, TriggerEdges edge, float level);
+
+    /**
+        \brief Trigger only on Trigger().
+
+        \return True if the level trigger was cleared; false while
+        recording.
+    **/
+    bool TriggerLevelClear();
+
+    /**
+        \brief Start recording and wait for the trigger.
+
+        \param[in] preRecords The records to keep from before the trigger,
+        less than Capacity(). A trigger that comes sooner keeps the records
+        taken so far.
+
+        \return True if recording started; false if there are no channels
+        or \a preRecords is too large.
+    **/
+    bool Arm(uint32_t preRecords);
+
+    /**
+        \brief Trigger an armed capture from the next record on.
+
+        May be called from an interrupt handler.
+
+        \return True if the capture was armed.
+    **/
+    bool Trigger();
+
+    /**
+        \brief Stop recording. A capture that is not done is dropped.
+    **/
+    void Stop();
+
+    /**
+        \brief The progress of the capture.
+    **/
+    States State() {
+        return m_state;
+    }
+
+    /**
+        \brief The size of a record, in bytes.
+    **/
+    uint16_t RecordSize() {
+        return m_recordSize;
+    }
+
+    /**
+        \brief The number of records the ring holds.
+    **/
+    uint32_t Capacity() {
+        return m_capacity;
+    }
+
+    /**
+        \brief The number of records in a complete capture.
+
+        \return The records, or 0 until the capture is done.
+    **/
+    uint32_t Records() {
+        return m_state == SCOPE_DONE ? m_records : 0;
+    }
+
+    /**
+        \brief The index of the trigger record in a complete capture; the
+        number of records from before the trigger.
+    **/
+    uint32_t TriggerRecord() {
+        return m_preRecorded;
+    }
+
+    /**
+        \brief The microsecond time of the trigger record, as
+        SysTiming::Microseconds().
+    **/
+    uint32_t TriggerUs() {
+        return m_triggerUs;
+    }
+
+    /**
+        \brief The time between records, in microseconds.
+    **/
+    uint32_t RecordPeriodUs();
+
+    /**
+        \brief Copy a complete capture out, oldest record first.
+
+        \param[in] offset The byte offset into the capture.
+        \param[out] dst Where to copy to.
+        \param[in] length The most bytes to copy.
+
+        \return The number of bytes copied; 0 past the end or until the
+        capture is done.
+    **/
+    uint32_t Read(uint32_t offset, void *dst, uint32_t length);
+
+private:
+    uint8_t m_buffer[SCOPE_BUFFER_SIZE] __attribute__((aligned(4)));
+    Channel m_channels[SCOPE_CHANNELS_MAX];
+    uint8_t m_channelCount;
+    uint16_t m_recordSize;
+    uint32_t m_capacity;
+    uint16_t m_decimation;
+    uint16_t m_decimationCnt;
+    volatile States m_state;
+
+    // The slot the next record goes into, and the records held
+    uint32_t m_head;
+    uint32_t m_count;
+    // Records to keep from before the trigger, records still to take after
+    // it, and the shape of the complete capture
+    uint32_t m_preRecords;
+    uint32_t m_postLeft;
+    uint32_t m_preRecorded;
+    uint32_t m_records;
+    uint32_t m_first;
+    uint32_t m_triggerUs;
+
+    // The level trigger; m_triggerChannel is SCOPE_CHANNELS_MAX when off
+    uint8_t m_triggerChannel;
+    uint8_t m_triggerEdge;
+    uint16_t m_triggerOffset;
+    float m_triggerLevel;
+    bool m_triggerAbove;
+    bool m_triggerPrimed;
+    volatile bool m_triggerPending;
+
+    /**
+        Construct
+    **/
+    ScopeCapture();
+
+    /**
+        Take a record and advance the capture. Called from the sample rate
+        interrupt.
+    **/
+    void Sample();
+
+    /**
+        Check the level trigger against a record.
+    **/
+    bool TriggerCheck(const uint8_t *record);
+}; // ScopeCapture
+
+} // ClearCore namespace
+
+#endif // __SCOPECAPTURE_H__
@@ -37,10 +37,41 @@
 
 namespace ClearCore {
 
+/// The size of an SD card block, in bytes
+#define SD_BLOCK_SIZE 512
+
+/// The SPI clock used to bring up the card
+#ifndef SD_SPI_INIT_HZ
+#define SD_SPI_INIT_HZ 400000
+#endif
+
+/// The SPI clock used once the card is up; the SERCOM clock limits the
+/// actual rate to 5 MHz
+#ifndef SD_SPI_FAST_HZ
+#define SD_SPI_FAST_HZ 25000000
+#endif
+
+/// Error codes set by the block driver; they start at 0x80 to stay clear of
+/// the codes set by the Arduino SD library
+#define SD_ERROR_READ 0x80
+#define SD_ERROR_WRITE 0x81
+
 /**
     \brief ClearCore SD card interface
 
     This class manages access to the micro SD Card reader.
+
+    Initialize() brings the card up in SPI mode, after which BlockRead() and
+    BlockWrite() transfer whole 512-byte blocks. Transfers of more than one
+    block use the card's multi-block commands, and each block's data moves
+    by DMA. See FatFileSystem for file access.
+
+    \code{.cpp}
+    uint8_t block[SD_BLOCK_SIZE];
+    if (SdCard.Initialize() && SdCard.BlockRead(0, block)) {
+        // block holds the card's first block
+    }
+    \endcode
 **/
 class SdCardDriver : public SerialBase {
     friend class SysManager;
@@ -70,10 +101,126 @@ public:
     bool IsInFault() {
         return (m_errorCode != 0);
     }
+
+    /**
+        \brief The current error code, or 0
+    **/
+    uint8_t ErrorCode() {
+        return m_errorCode;
+    }
 #endif // HIDE_FROM_DOXYGEN
 
+    /**
+        \brief Bring up the card in the reader.
+
+        Call again after a card is inserted or swapped.
+
+        \code{.cpp}
+        if (!SdCard.Initialize()) {
+            // No card, or the card did not respond
+        }
+        \endcode
+
+        \return True if the card is ready for block transfers.
+    **/
+    bool Initialize();
+
+    /**
+        \brief Check whether a card has been brought up.
+
+        \return True if Initialize() succeeded.
+    **/
+    bool Initialized() {
+        return m_initialized;
+    }
+
+    /**
+        \brief The capacity of the card, in blocks.
+
+        \return The number of blocks read from the card's CSD register by
+        Initialize(), or 0 if no card has been brought up.
+    **/
+    uint32_t BlockCount() {
+        return m_initialized ? m_blockCount : 0;
+    }
+
+    /**
+        \brief Read blocks from the card.
+
+        \code{.cpp}
+        uint8_t blocks[4 * SD_BLOCK_SIZE];
+        SdCard.BlockRead(2048, blocks, 4);
+        \endcode
+
+        \param[in] block The first block to read.
+        \param[out] data Where to put the data; \a count blocks long.
+        \param[in] count The number of blocks to read.
+
+        \return True if every block was read.
+    **/
+    bool BlockRead(uint32_t block, uint8_t *data, uint32_t count = 1);
+
+    /**
+        \brief Write blocks to the card.
+
+        \code{.cpp}
+        SdCard.BlockWrite(2048, blocks, 4);
+        \endcode
+
+        \param[in] block The first block to write.
+        \param[in] data The data to write; \a count blocks long.
+        \param[in] count The number of blocks to write.
+
+        \return True if every block was written.
+    **/
+    bool BlockWrite(uint32_t block, const uint8_t *data, uint32_t count = 1);
+
 private:
     uint8_t m_errorCode;
+    bool m_initialized;
+    // SDHC and SDXC cards address blocks; older cards address bytes
+    bool m_blockAddressing;
+    uint32_t m_blockCount;
+
+    /**
+        Send a command and return its R1 response.
+    **/
+    uint8_t Command(uint8_t cmd, uint32_t arg);
+
+    /**
+        Send an application-specific command.
+    **/
+    uint8_t AppCommand(uint8_t cmd, uint32_t arg);
+
+    /**
+        Wait for the card to release the data line.
+    **/
+    bool WaitReady(uint32_t timeoutMs);
+
+    /**
+        Receive one data block, or a register of the given length.
+    **/
+    bool DataReceive(uint8_t *data, uint16_t length = SD_BLOCK_SIZE);
+
+    /**
+        Work out the capacity from the CSD register.
+    **/
+    static uint32_t CsdBlockCount(const uint8_t *csd);
+
+    /**
+        Send one data block with the given start token.
+    **/
+    bool DataSend(uint8_t token, const uint8_t *data);
+
+    /**
+        Transfer bytes by DMA, or byte by byte if DMA is unavailable.
+    **/
+    void Transfer(const uint8_t *writeBuf, uint8_t *readBuf, int32_t len);
+
+    /**
+        Release the card select and clock out one byte.
+    **/
+    void Deselect();
 
     /**
         Construction, wires in pins and non-volatile info.
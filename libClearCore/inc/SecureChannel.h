@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    \file SecureChannel.h
+    \brief ClearCore authenticated encryption of messages between devices.
+
+    Seals and opens messages with AES-GCM for EthernetUdp and SerialPacket.
+**/
+
+#ifndef __SECURECHANNEL_H__
+#define __SECURECHANNEL_H__
+
+#include <stdint.h>
+#include "AesManager.h"
+
+namespace ClearCore {
+
+/// The bytes ahead of a sealed message: its type, the sender's token,
+/// session and count
+#define SECURE_CHANNEL_HEADER_SIZE 17
+
+/// The bytes a sealed message adds: the header and a 16-byte tag
+#define SECURE_CHANNEL_OVERHEAD \
+    (SECURE_CHANNEL_HEADER_SIZE + AES_GCM_TAG_SIZE)
+
+/// The length of a challenge: its type and the receiver's token
+#define SECURE_CHANNEL_CHALLENGE_SIZE 5
+
+/// Open() took a challenge; it carries no message
+#define SECURE_CHANNEL_HANDSHAKE (-2)
+
+/// The most sessions whose message counters a channel tracks for replays
+#ifndef SECURE_CHANNEL_PEERS
+#define SECURE_CHANNEL_PEERS 4
+#endif
+
+/**
+    \class SecureChannel
+    \brief ClearCore authenticated encryption of messages between devices.
+
+    Every device on a channel shares one key, which is only used to derive
+    session keys. When the channel begins it draws a random 64-bit session
+    for the messages it sends and a random 32-bit token for the messages it
+    receives. A message is sealed with AES-GCM under a key derived from the
+    receiver's token and the sender's session, with the session and a count
+    of the messages sealed as its nonce. Opening it checks the 16-byte tag,
+    so a message that was forged, altered, or sealed for another session is
+    refused, including every message sealed before either end last began.
+
+    The receiver remembers the last count from each of the
+    #SECURE_CHANNEL_PEERS sessions sealed for its token and refuses a
+    message that is not newer, which stops a captured message being
+    replayed. Messages must therefore arrive in order, as they do over a
+    serial link or a UDP exchange that waits for each reply. A session is
+    never forgotten while the token lasts; when the table is full, the
+    channel draws a new token instead, which retires every session at once.
+
+    Each message carries the sender's own token, so replies are sealed for
+    whoever sent the last message opened. A receiver that refuses a message
+    from an unknown session answers with a challenge carrying its token, and
+    the sender seals for that token from then on. The first message after
+    either end begins, or after a new token, is therefore refused and must
+    be sent again; EthernetUdp and SerialPacket send the challenges.
+
+    Set a channel on an EthernetUdp or SerialPacket with its Secure()
+    function to seal everything sent and open everything received there.
+
+    \code{.cpp}
+    static const uint8_t key[16] = { ... };
+    SecureChannel Channel;
+    EthernetUdp Udp;
+
+    Channel.Begin(key, sizeof(key));
+    Udp.Begin(8888);
+    Udp.Secure(&Channel);
+    // PacketWrite(), PacketSend(), PacketParse() and PacketRead() now work
+    // on the plaintext
+    \endcode
+**/
+class SecureChannel {
+public:
+    /**
+        \brief Construct a channel with no key.
+    **/
+    SecureChannel();
+
+    /**
+        \brief Set the channel's key and draw a new session and token.
+
+        \param[in] key The key.
+        \param[in] keyLength The key length: 16, 24 or 32 bytes.
+
+        \return True if the key was set.
+    **/
+    bool Begin(const uint8_t *key, uint8_t keyLength);
+
+    /**
+        \brief Encrypt and authenticate a message.
+
+        \param[in] in The message.
+        \param[in] length The message length.
+        \param[out] out The sealed message, \a length plus
+        #SECURE_CHANNEL_OVERHEAD bytes. It must not overlap \a in.
+
+        \return The length of the sealed message, or -1 if the channel has
+        no key, the AES is busy, or the session has sealed 2^32 messages
+        and must begin again.
+    **/
+    int32_t Seal(const uint8_t *in, uint16_t length, uint8_t *out);
+
+    /**
+        \brief Check and decrypt a sealed message.
+
+        \param[in] in The sealed message.
+        \param[in] length The sealed message's length.
+        \param[out] out The message, #SECURE_CHANNEL_OVERHEAD bytes shorter.
+        It may be \a in.
+
+        \return The length of the message, #SECURE_CHANNEL_HANDSHAKE if it
+        was a challenge, or -1 if it is not authentic, is a replay, or the
+        channel has no key.
+    **/
+    int32_t Open(const uint8_t *in, uint16_t length, uint8_t *out);
+
+    /**
+        \brief Write the challenge due to the sender of a refused message.
+
+        Open() makes a challenge due when it refuses a message from a session
+        it does not know. Send the challenge back to that message's sender.
+
+        \param[out] out The challenge, #SECURE_CHANNEL_CHALLENGE_SIZE bytes.
+
+        \return The length of the challenge, or 0 if none is due.
+    **/
+    uint16_t Challenge(uint8_t *out);
+
+    /**
+        \brief The number of messages refused for a tag that did not match,
+        including messages sealed for a token this channel no longer holds.
+    **/
+    uint32_t AuthErrors() {
+        return m_authErrors;
+    }
+
+    /**
+        \brief The number of authentic messages refused as replays.
+    **/
+    uint32_t ReplayErrors() {
+        return m_replayErrors;
+    }
+
+private:
+    typedef struct {
+        uint64_t Session;
+        uint32_t Count;
+        AesManager::Key Key;
+    } Peer;
+
+    AesManager::Key m_key;
+    uint64_t m_session;
+    uint32_t m_token;
+    uint32_t m_count;
+    uint32_t m_txToken;
+    AesManager::Key m_txKey;
+    Peer m_peers[SECURE_CHANNEL_PEERS];
+    uint8_t m_peerCount;
+    bool m_challengeDue;
+    uint32_t m_authErrors;
+    uint32_t m_replayErrors;
+
+    bool KeyDerive(AesManager::Key &key, uint32_t token, uint64_t session);
+    void TokenDraw();
+    bool TxTokenSet(uint32_t token);
+}; // SecureChannel
+
+} // ClearCore namespace
+
+#endif // __SECURECHANNEL_H__
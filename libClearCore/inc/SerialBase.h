@@ -37,14 +37,22 @@
 #include "DmaManager.h"
 #include "ISerial.h"
 #include "PeripheralRoute.h"
+#include "RingBuffer.h"
 
 namespace ClearCore {
 
-/** Size of the serial send and receive buffers, in bytes (64). **/
+class DigitalIn;
+
+class Connector;
+
+/** Default size of the serial send and receive buffers, in bytes (64). **/
 #ifndef SERIAL_BUFFER_SIZE
 #define SERIAL_BUFFER_SIZE 64
 #endif
 
+/** The largest send or receive buffer a serial port can be given. **/
+#define SERIAL_BUFFER_SIZE_MAX 0x8000
+
 /** Serial receive interrupt priority level. **/
 #ifndef SERCOM_NVIC_RX_PRIORITY
 #define SERCOM_NVIC_RX_PRIORITY (static_cast<IRQn_Type>(1))
@@ -68,8 +76,9 @@ class SerialBase : public ISerial {
 
 public:
     /**
-        Break detected 'character' placed in the character stream when
-        the break condition has been detected.
+        Break detected 'character' returned ahead of the character stream
+        when the break condition has been detected. The receive buffer is
+        flushed when a break is detected.
     **/
     static const int16_t BREAK_DETECTED = int16_t(0xBDBD);
 
@@ -247,6 +256,19 @@ public:
     **/
     bool SendChar(uint8_t charToSend) override;
 
+    /**
+        \copydoc ISerial::ReadBlock(uint8_t *buffer, size_t length)
+
+        \note A detected break is skipped rather than copied; use CharGet()
+        to see #BREAK_DETECTED.
+    **/
+    int32_t ReadBlock(uint8_t *buffer, size_t length) override;
+
+    /**
+        \copydoc ISerial::WriteBlock(const uint8_t *buffer, size_t length)
+    **/
+    int32_t WriteBlock(const uint8_t *buffer, size_t length) override;
+
     /**
         \copydoc ISerial::AvailableForRead()
     **/
@@ -296,6 +318,314 @@ public:
         return m_flowControl;
     };
 
+    /**
+        \brief Drive an RS-485 transceiver's transmit enable from the UART.
+
+        The SERCOM drives the RTS pin as a transmit enable: it is asserted as
+        the first character starts and released \a guardBits bit times after
+        the last one has been shifted out, with no software in the
+        turnaround. RS-485 mode takes the place of CTS/RTS flow control, and
+        the RTS pin follows the UART whatever #RtsMode() is set to.
+
+        \code{.cpp}
+        // Half-duplex RS-485 on COM-1, holding the driver on for one bit
+        // time after each message
+        ConnectorCOM1.Rs485Mode(true, 1);
+        ConnectorCOM1.Speed(1000000);
+        ConnectorCOM1.PortOpen();
+        \endcode
+
+        \param[in] enable True to drive the transmit enable from the UART.
+        \param[in] guardBits (optional) The bit times, 0 to 7, to hold the
+        transmit enable after the last character. Default: 0.
+        \return True if the mode was set.
+    **/
+    bool Rs485Mode(bool enable, uint8_t guardBits = 0);
+
+    /**
+        \brief Return whether RS-485 transmit enable mode is on.
+    **/
+    bool Rs485Mode() {
+        return m_rs485;
+    }
+
+    /**
+        \brief Move UART data with DMA instead of one interrupt per character.
+
+        Received characters are written by DMA into a circular buffer that is
+        read directly by CharGet(), CharPeek(), and AvailableForRead().
+        Characters to send are staged in a buffer and sent by DMA in blocks,
+        with one interrupt at the end of each block. Only COM-0 and COM-1
+        support DMA; the port is re-initialized if it is open in UART mode.
+
+        \code{.cpp}
+        // Receive 1 Mbaud data on COM-1 without per-character interrupts
+        ConnectorCOM1.UartDma(true);
+        ConnectorCOM1.Speed(1000000);
+        ConnectorCOM1.PortOpen();
+        \endcode
+
+        \param[in] useDma True to use DMA for UART transfers.
+
+        \return True if the setting was applied; false if this port does not
+        support DMA.
+
+        \note The DMA fills the receive buffer set by ReceiveBuffer(). If
+        the buffer is not read quickly enough the oldest characters are
+        overwritten without warning. Serial breaks are not reported as
+        #BREAK_DETECTED and only 8-bit and smaller characters are supported.
+    **/
+    bool UartDma(bool useDma);
+
+    /**
+        \brief Return whether UART transfers use DMA.
+
+        \code{.cpp}
+        if (ConnectorCOM1.UartDma()) {
+            // COM-1 is set to use DMA in UART mode
+        }
+        \endcode
+
+        \return True if DMA is selected for UART transfers.
+    **/
+    bool UartDma() {
+        return m_uartDma;
+    }
+
+    /**
+        \brief Supply the storage for the port's receive buffer.
+
+        Every port starts with a #SERIAL_BUFFER_SIZE character buffer. A
+        larger buffer may be given to just the ports that need it.
+
+        \code{.cpp}
+        uint8_t com1Rx[1024];
+        ConnectorCOM1.ReceiveBuffer(com1Rx, sizeof(com1Rx));
+        ConnectorCOM1.PortOpen();
+        \endcode
+
+        \param[in] buffer The storage to use, or NULL to go back to the
+        port's default buffer. It must remain valid while the port is in use.
+        \param[in] size The size of \a buffer in characters. Received by DMA,
+        the buffer holds one less than this. Must be a power of 2 from 2 to
+        #SERIAL_BUFFER_SIZE_MAX.
+
+        \return True if the buffer was applied; false if the port is open or
+        the size is invalid.
+    **/
+    bool ReceiveBuffer(uint8_t *buffer, uint32_t size);
+
+    /**
+        \brief Supply the storage for the port's transmit buffer.
+
+        Every port starts with a #SERIAL_BUFFER_SIZE character buffer. A
+        larger buffer may be given to just the ports that need it.
+
+        \code{.cpp}
+        uint8_t com1Tx[512];
+        ConnectorCOM1.TransmitBuffer(com1Tx, sizeof(com1Tx));
+        ConnectorCOM1.PortOpen();
+        \endcode
+
+        \param[in] buffer The storage to use, or NULL to go back to the
+        port's default buffer. It must remain valid while the port is in use.
+        \param[in] size The size of \a buffer in characters. Must be a power
+        of 2 from 2 to #SERIAL_BUFFER_SIZE_MAX.
+
+        \return True if the buffer was applied; false if the port is open or
+        the size is invalid.
+    **/
+    bool TransmitBuffer(uint8_t *buffer, uint32_t size);
+
+    /**
+        A function called from the transmit interrupts.
+    **/
+    typedef void (*TransmitCallback)();
+
+    /**
+        \brief Choose whether sending waits for room in the transmit buffer.
+
+        By default SendChar() and Send() wait for the transmit buffer to drain
+        when it is full, which holds up the caller for as long as the queued
+        characters take to go out at the baud rate. With blocking off they
+        return false instead, after queueing as many characters as fit.
+        WriteBlock() never waits and returns the number of characters
+        queued.
+
+        \code{.cpp}
+        ConnectorCOM0.TransmitBlocking(false);
+        // Queue what fits now; the space callback resumes the rest
+        int32_t sent = ConnectorCOM0.WriteBlock(status, statusLength);
+        \endcode
+
+        \param[in] blocking True to wait for room in the transmit buffer.
+    **/
+    void TransmitBlocking(bool blocking) {
+        m_txBlocking = blocking;
+    }
+
+    /**
+        \brief Return whether sending waits for room in the transmit buffer.
+
+        \return True if SendChar() and Send() wait when the buffer is full.
+    **/
+    bool TransmitBlocking() {
+        return m_txBlocking;
+    }
+
+    /**
+        \brief Call a function when the transmit buffer has room again.
+
+        After a write leaves less than \a space characters free, \a callback
+        is called once from the transmit interrupt as soon as that much room
+        has opened up.
+
+        \code{.cpp}
+        void StatusResume() {
+            statusReady = true;
+        }
+
+        ConnectorCOM0.TransmitSpaceCallback(StatusResume, 32);
+        \endcode
+
+        \param[in] callback The function to call, or NULL to stop calling.
+        \param[in] space The free characters to wait for, at most the
+        transmit buffer size.
+
+        \note Callbacks run at interrupt level and should be short.
+    **/
+    void TransmitSpaceCallback(TransmitCallback callback, uint32_t space = 1);
+
+    /**
+        \brief Call a function when everything queued has been sent.
+
+        \a callback is called from the transmit complete interrupt once the
+        transmit buffer is empty and the last character has been shifted out
+        of the port.
+
+        \code{.cpp}
+        void DumpDone() {
+            ConnectorLed.State(false);
+        }
+
+        ConnectorCOM0.TransmitDoneCallback(DumpDone);
+        \endcode
+
+        \param[in] callback The function to call, or NULL to stop calling.
+
+        \note Callbacks run at interrupt level and should be short. Only
+        COM-0 and COM-1 report transmit completion.
+    **/
+    void TransmitDoneCallback(TransmitCallback callback) {
+        m_txDoneCallback = callback;
+    }
+
+    /**
+        \brief Check whether everything queued has been sent.
+
+        The non-blocking counterpart of WaitForTransmitIdle().
+
+        \code{.cpp}
+        if (ConnectorCOM0.TransmitDone()) {
+            // The last status dump is out; start the next one
+        }
+        \endcode
+
+        \return True once the transmit buffer is empty and the last
+        character has been shifted out of the port.
+    **/
+    bool TransmitDone() {
+        return m_txDone;
+    }
+
+    /**
+        \brief The number of CPU cycles since the last character was
+        received.
+
+        Received characters are timestamped as they are taken from the
+        SERCOM, so gaps in the character stream can be measured to a fraction
+        of a character time. With UartDma() the timestamp is taken when a call
+        to this function first sees the new characters.
+
+        \code{.cpp}
+        if (ConnectorCOM1.RxIdleCycles() > 1000 * CYCLES_PER_MICROSECOND) {
+            // Nothing has been received for at least 1 ms
+        }
+        \endcode
+
+        \return Cycles since the last received character.
+
+        \note Rolls over about every 35 seconds.
+    **/
+    uint32_t RxIdleCycles();
+
+    /**
+        A function called when a received frame ends.
+    **/
+    typedef void (*ReceiveCallback)();
+
+    /**
+        \brief The timing of a received frame.
+    **/
+    struct RxFrameInfo {
+        /// Cycle count when the first character was received
+        uint32_t StartCycle;
+        /// Cycle count when the last character was received
+        uint32_t EndCycle;
+        /// The number of characters received
+        uint32_t Length;
+    };
+
+    /**
+        \brief Delimit received frames by an idle gap, such as a Modbus RTU
+        t3.5 gap.
+
+        A frame starts with the first character received after an idle gap.
+        It ends once nothing more has been received for \a gapCycles. Idle
+        gaps are checked once per sample time. So a frame ends up to one
+        sample time after the gap has passed, and \a callback is called
+        then. RxFrameGet() returns the frame's timing, so a parser can read
+        the whole frame at once instead of polling for each character.
+
+        \code{.cpp}
+        // Frames on COM-1 are separated by at least 2 ms of idle line
+        ConnectorCOM1.RxFrameGap(2000 * CYCLES_PER_MICROSECOND);
+        SerialBase::RxFrameInfo frame;
+        if (ConnectorCOM1.RxFrameGet(frame)) {
+            ConnectorCOM1.ReadBlock(message, frame.Length);
+        }
+        \endcode
+
+        \param[in] gapCycles The idle time that ends a frame, in CPU cycles,
+        or 0 to stop delimiting frames.
+        \param[in] callback The function to call when a frame ends, or NULL.
+
+        \note Only COM-0 and COM-1 delimit frames. Callbacks run at interrupt
+        level and should be short. With UartDma() a character is timestamped
+        when it is first seen after it arrives; that is at most one sample
+        time late.
+    **/
+    void RxFrameGap(uint32_t gapCycles, ReceiveCallback callback = NULL);
+
+    /**
+        \brief Return the idle time that ends a frame.
+
+        \return The gap in CPU cycles, or 0 if frames are not delimited.
+    **/
+    uint32_t RxFrameGap() {
+        return m_rxFrameGap;
+    }
+
+    /**
+        \brief Take the timing of the last frame that ended.
+
+        \param[out] frame The frame's timing.
+
+        \return True if a frame has ended since the last call. If more than
+        one has ended, \a frame describes the newest.
+    **/
+    bool RxFrameGet(RxFrameInfo &frame);
+
     /**
         \brief Change the serial RTS mode
 
@@ -309,6 +639,7 @@ public:
         \return Returns true if the mode was set.
         \note Using #LINE_HW with #FlowControl enabled will
         assert RTS when the Serial Port is ready to receive data.
+        \note The mode is held at #LINE_HW while #Rs485Mode() is on.
     **/
     bool RtsMode(CtrlLineModes mode);
 
@@ -386,6 +717,9 @@ public:
         // Sets COM-0 to have a 9-bit character size
         ConnectorCOM1.CharSize(9);
         \endcode
+
+        \note The serial buffers hold 8 bits per character, so the ninth bit
+        of 9-bit characters is not kept.
     **/
     bool CharSize(uint8_t size) override;
 
@@ -424,6 +758,60 @@ public:
     **/
     bool SpiSsMode(CtrlLineModes mode);
 
+    /**
+        \brief Set the byte sent by SPI transfers that have no write buffer
+
+        \code{.cpp}
+        // Keep MOSI high while reading
+        ConnectorCOM0.SpiFillByte(0xFF);
+        \endcode
+
+        \param[in] fill The byte to send; 0 by default.
+    **/
+    void SpiFillByte(uint8_t fill) {
+        m_spiFill = fill;
+        m_spiFillWord = fill * 0x01010101UL;
+    }
+
+    /**
+        \brief Move four SPI bytes per DATA register access.
+
+        In this mode the SERCOM's DATA register is 32 bits wide. The bulk
+        SpiTransferData() moves 4 bytes per register access. DMA transfers
+        (SpiTransferDataAsync(), SpiTransactionQueue(), SpiPollAdd()) move
+        4 bytes per beat when their length is a multiple of 4 and their
+        buffers are 4-byte aligned. This cuts the bus and DMA overhead per
+        byte, so more of the SPI clock rate is reached. Other transfers still
+        go one byte at a time. The bytes on the wire are the same in either
+        mode. The port is re-initialized if it is open in SPI mode.
+
+        \code{.cpp}
+        // Stream a display frame buffer on COM-0 a word at a time
+        __attribute__((aligned(4))) static uint8_t frame[1024];
+        ConnectorCOM0.SpiData32(true);
+        ConnectorCOM0.PortMode(SerialBase::SPI);
+        ConnectorCOM0.PortOpen();
+        ConnectorCOM0.SpiTransferDataAsync(frame, NULL, sizeof(frame));
+        \endcode
+
+        \param[in] enable True to use 32-bit DATA accesses.
+
+        \return True if the setting was applied; false if the character size
+        is not 8 bits.
+
+        \note SPI slave mode always moves one byte at a time.
+    **/
+    bool SpiData32(bool enable);
+
+    /**
+        \brief Return whether SPI transfers use 32-bit DATA accesses.
+
+        \return True if the mode is selected by SpiData32().
+    **/
+    bool SpiData32() {
+        return m_spiData32;
+    }
+
     /**
         SPI's transmit and receive function
     **/
@@ -472,6 +860,248 @@ public:
     **/
     bool SpiAsyncWaitComplete();
 
+    /**
+        \brief Check whether an asynchronous transfer is still running.
+        \return True until the transfers started with SpiTransferDataAsync()
+        or SpiTransactionQueue() are completed.
+    **/
+    bool SpiAsyncBusy();
+
+    /**
+        \brief One SPI transfer for SpiTransactionQueue().
+
+        The transaction belongs to the caller and must stay valid until it
+        is done.
+    **/
+    struct SpiTransaction {
+        /// The data to send, or NULL to send filler bytes
+        const uint8_t *WriteBuf;
+        /// Where to put the received data, or NULL to discard it
+        uint8_t *ReadBuf;
+        /// The number of bytes to transfer
+        uint16_t Length;
+        /// The connector that is set to 0 (false) for the transfer and back
+        /// to 1 (true) afterward, or NULL to leave the chip select alone
+        Connector *ChipSelect;
+        /// Called from the DMA complete interrupt once the transfer is
+        /// done, or NULL
+        void (*Callback)(SpiTransaction *transaction);
+        /// Set once the transfer is done
+        volatile bool Done;
+#ifndef HIDE_FROM_DOXYGEN
+        // The next transaction in the queue
+        SpiTransaction *Next;
+#endif
+    };
+
+    /**
+        \brief Queue an SPI transaction to run after those already queued.
+
+        Queued transactions run back-to-back via DMA. When each one finishes,
+        the DMA complete interrupt releases its chip select, calls its
+        callback, and starts the next, so several devices on one port are
+        serviced without the application waiting between transfers.
+
+        \code{.cpp}
+        uint8_t adcCmd[3] = {0x01, 0x80, 0x00};
+        uint8_t adcData[3];
+        SerialBase::SpiTransaction adcRead =
+            {adcCmd, adcData, 3, &ConnectorIO0, NULL};
+        ConnectorCOM0.SpiTransactionQueue(adcRead);
+        while (!adcRead.Done) {
+            continue;
+        }
+        \endcode
+
+        \param[in] transaction The transfer to queue.
+
+        \return True if the transaction was queued; false if the port is not
+        open in SPI mode, has no DMA channels, or the transaction is already
+        queued or empty.
+
+        \note Callbacks run at interrupt level and should be short.
+        SpiTransferDataAsync() fails while the queue is busy.
+    **/
+    bool SpiTransactionQueue(SpiTransaction &transaction);
+
+    /**
+        \brief Check whether every queued SPI transaction is done.
+
+        \return True if the transaction queue is empty.
+    **/
+    bool SpiQueueIdle() {
+        return !m_spiQueueHead;
+    }
+
+    /**
+        \brief A transaction that SpiPollAdd() repeats on a period.
+    **/
+    struct SpiPoll {
+        /// The transfer; its ReadBuf is the shadow buffer of the device's
+        /// registers. Its Callback is used by the poll.
+        SpiTransaction Transaction;
+        /// The time between transfers, in milliseconds
+        uint16_t PeriodMs;
+        /// Called from the DMA complete interrupt after each transfer, or
+        /// NULL
+        void (*Callback)(SpiPoll *poll);
+        /// The number of transfers completed
+        volatile uint32_t Count;
+        /// The number of periods skipped because the last transfer had not
+        /// finished
+        volatile uint32_t Overruns;
+#ifndef HIDE_FROM_DOXYGEN
+        uint16_t MsLeft;
+        SpiPoll *Next;
+#endif
+    };
+
+    /**
+        \brief Repeat an SPI transaction on a period to keep a shadow copy of
+        a device's registers.
+
+        Each period the system tick queues the transaction with
+        SpiTransactionQueue(), so the DMA reads the sensor's registers into
+        the read buffer with no work in the main loop. Polls of differing
+        periods on one port share the transaction queue.
+
+        \code{.cpp}
+        // Read the 6 bytes of an IMU's accel registers every 5 ms
+        uint8_t imuCmd[7] = {0x80 | 0x12};
+        uint8_t imuData[7];
+        SerialBase::SpiPoll imuPoll =
+            {{imuCmd, imuData, 7, &ConnectorIO0, NULL}, 5};
+        ConnectorCOM0.SpiPollAdd(imuPoll);
+        ...
+        uint8_t accel[7];
+        ConnectorCOM0.SpiPollRead(imuPoll, accel);
+        \endcode
+
+        \param[in] poll The poll, which must stay valid until it is removed.
+
+        \return True if the poll was added; false if the port has no DMA
+        channels, the poll is already added, or its period or length is 0.
+
+        \note Polls only run while the port is open in SPI master mode.
+        Blocking SPI transfers must not be made while polls are added.
+    **/
+    bool SpiPollAdd(SpiPoll &poll);
+
+    /**
+        \brief Stop repeating a poll, waiting for its transfer to finish.
+
+        \param[in] poll The poll to remove.
+    **/
+    void SpiPollRemove(SpiPoll &poll);
+
+    /**
+        \brief Copy the read buffer of a poll, consistent with one transfer.
+
+        \param[in] poll The poll.
+        \param[out] dst Room for the transaction's Length bytes.
+
+        \return True if the data was copied; false if no transfer has
+        finished yet.
+    **/
+    bool SpiPollRead(SpiPoll &poll, uint8_t *dst);
+
+    /**
+        \brief Run the port as an SPI slave that exchanges one fixed-size
+        frame with the master each time it selects this ClearCore.
+
+        Each frame is moved by DMA: the bytes clocked in by the master land
+        in \a rxBuffer while the bytes of \a txBuffer are clocked out, so a
+        PLC or PC master can read a status image and write a process image
+        in one transaction without the application handling any bytes. The
+        port keeps the pinout of its master mode: MISO is driven on TX, the
+        clock is read on RX, and MOSI is read on CTS.
+
+        RTS, which carries the SERCOM slave select, is an output on the
+        board, so the master's slave select is wired to \a ss instead. Its
+        interrupt selects the SERCOM when the input turns off (low) and ends
+        the frame when it turns on (high); RTS follows the select. The
+        master must leave at least 20 us between frames for the port to
+        re-arm.
+
+        Both buffers hold two frames and belong to the port until
+        SpiSlaveStop(); use SpiSlaveRead() and SpiSlaveWrite() to exchange
+        frames with them.
+
+        \code{.cpp}
+        // Exchange 16 byte frames on COM-0, selected by DI-6
+        uint8_t rxFrames[32], txFrames[32];
+        ConnectorCOM0.PortMode(SerialBase::SPI);
+        ConnectorCOM0.PortOpen();
+        ConnectorCOM0.SpiSlaveStart(ConnectorDI6, rxFrames, txFrames, 16);
+        \endcode
+
+        \param[in] ss The input wired to the master's slave select.
+        \param[in] rxBuffer Room for two received frames.
+        \param[in] txBuffer Room for two frames to send.
+        \param[in] frameLength The number of bytes in a frame.
+        \param[in] callback Called from the slave select interrupt after each
+        complete frame, or NULL.
+
+        \return True if the slave started; false if the port is not open, has
+        no DMA channels, or \a ss has no external interrupt.
+
+        \note The master SPI transfer functions fail while the slave runs.
+        The first frame sends zeros until SpiSlaveWrite() is called.
+    **/
+    bool SpiSlaveStart(DigitalIn &ss, uint8_t *rxBuffer, uint8_t *txBuffer,
+                       uint16_t frameLength, void (*callback)() = nullptr);
+
+    /**
+        \brief Stop the SPI slave and return the port to SPI master mode.
+    **/
+    void SpiSlaveStop();
+
+    /**
+        \brief Check whether the port is running as an SPI slave.
+    **/
+    bool SpiSlaveActive() {
+        return m_spiSlave;
+    }
+
+    /**
+        \brief Copy the last complete frame received from the master.
+
+        \param[out] dst Room for one frame.
+
+        \return True if a frame was copied; false if the slave is not
+        running or no complete frame has been received yet.
+    **/
+    bool SpiSlaveRead(uint8_t *dst);
+
+    /**
+        \brief Set the frame sent to the master.
+
+        The frame is sent from the next frame the master starts after this
+        call, and then in every frame until it is written again.
+
+        \param[in] src One frame to send.
+
+        \return True if the frame was queued; false if the slave is not
+        running.
+    **/
+    bool SpiSlaveWrite(const uint8_t *src);
+
+    /**
+        \brief The number of complete frames exchanged since the slave
+        started.
+    **/
+    uint32_t SpiSlaveFrames() {
+        return m_spiSlaveFrames;
+    }
+
+    /**
+        \brief The number of frames the master ended early since the slave
+        started. Their data is dropped.
+    **/
+    uint32_t SpiSlaveShortFrames() {
+        return m_spiSlaveShortFrames;
+    }
+
     // ============================= SETUP API =================================
 
     /**
@@ -538,7 +1168,10 @@ public:
     **/
     void IrqHandlerTx();
     /**
-        Should be called by SERCOMx_1 Interrupt Vector.
+        \brief Should be called by SERCOMx_1 Interrupt Vector.
+
+        This is associated with the transmit complete (TXC) service, used to
+        chain DMA transmit blocks and to report transmit completion.
     **/
     void IrqHandler1();
     /**
@@ -553,6 +1186,33 @@ public:
         This is typically called on port exceptions.
     **/
     void IrqHandlerException();
+
+    /**
+        \brief Should be called by the DMA complete interrupt of the SPI
+        receive channel.
+
+        Finishes the current queued SPI transaction and starts the next.
+    **/
+    void IrqHandlerDma();
+
+    /**
+        \brief Called by the interrupt of the SPI slave select input.
+
+        Selects the SERCOM, or ends the frame and re-arms the DMA.
+    **/
+    void IrqHandlerSpiSlaveSs();
+
+    /**
+        \brief Called at the system tick rate to queue the polls that are
+        due.
+    **/
+    void SpiPollRefresh();
+
+    /**
+        \brief Called at the sample rate to end a received frame once its
+        idle gap has passed.
+    **/
+    void RxFrameRefresh();
 #endif
 
 protected:
@@ -566,6 +1226,8 @@ protected:
     CtrlLineModes m_ssMode;
     CtrlLineModes m_rtsMode;
     bool m_flowControl;
+    bool m_rs485;
+    uint8_t m_rs485GuardBits;
 
     // SERCOM instance
     Sercom *m_serPort;
@@ -587,6 +1249,15 @@ protected:
     // SPI dma channels
     DmaChannels m_dmaRxChannel;
     DmaChannels m_dmaTxChannel;
+    // Sent by SPI transfers that have no write buffer, as a byte and as
+    // four bytes for 32-bit DMA beats
+    uint32_t m_spiFill;
+    uint32_t m_spiFillWord;
+    // 32-bit SPI DATA accesses requested, and set up on the open port
+    bool m_spiData32;
+    bool m_spiData32Active;
+    // The SPI LENGTH setting: bytes per DATA access, or 0 for all four
+    uint8_t m_spiLength;
 
     /**
         Construct and wire this serial port into the PADs.
@@ -627,13 +1298,64 @@ protected:
     void DisableRxcInterruptUart();
 
 private:
-    // Serial Buffers
-    int16_t m_bufferIn[SERIAL_BUFFER_SIZE];
-    int16_t m_bufferOut[SERIAL_BUFFER_SIZE];
-    // Indices for head and tails of the ring buffers
-
-    volatile uint32_t m_inHead, m_inTail;
-    volatile uint32_t m_outHead, m_outTail;
+    // Serial Buffers, used unless the application supplies its own
+    uint8_t m_bufferInDefault[SERIAL_BUFFER_SIZE];
+    uint8_t m_bufferOutDefault[SERIAL_BUFFER_SIZE];
+    // Filled by the receive interrupt or DMA, drained by the transmit
+    // interrupt or DMA
+    RingBuffer<uint8_t> m_bufferIn;
+    RingBuffer<uint8_t> m_bufferOut;
+    // A break was received; reported ahead of the receive buffer
+    volatile bool m_breakDetected;
+    // Cycle count when the last character was received
+    volatile uint32_t m_rxCycle;
+    // The DMA receive position when m_rxCycle was taken
+    uint32_t m_rxCycleTail;
+    // Idle time that ends a received frame, 0 when off, and its callback
+    uint32_t m_rxFrameGap;
+    ReceiveCallback m_rxFrameCallback;
+    // The frame being received
+    volatile bool m_rxFrameActive;
+    volatile uint32_t m_rxFrameStart;
+    volatile uint32_t m_rxFrameLength;
+    // The last frame that ended, until RxFrameGet() takes it
+    RxFrameInfo m_rxFrameDone;
+    volatile bool m_rxFrameReady;
+
+    // Length of the transmit block in flight, 0 when idle
+    volatile uint16_t m_dmaTxCount;
+    // Wait for room when the transmit buffer is full
+    bool m_txBlocking;
+    // Everything queued has been shifted out
+    volatile bool m_txDone;
+    TransmitCallback m_txDoneCallback;
+    TransmitCallback m_txSpaceCallback;
+    uint32_t m_txSpace;
+    // A write left less than m_txSpace free; call m_txSpaceCallback
+    volatile bool m_txSpaceArmed;
+    // UART DMA requested, and set up on the open port
+    bool m_uartDma;
+    bool m_uartDmaActive;
+    // Queued SPI transactions; the head is in progress
+    SpiTransaction *volatile m_spiQueueHead;
+    SpiTransaction *m_spiQueueTail;
+    // Repeated SPI transactions
+    SpiPoll *m_spiPolls;
+    // SPI slave frames; each buffer holds two frames
+    volatile bool m_spiSlave;
+    DigitalIn *m_spiSlaveSs;
+    uint8_t *m_spiSlaveRx;
+    uint8_t *m_spiSlaveTx;
+    uint16_t m_spiSlaveLength;
+    void (*m_spiSlaveCallback)();
+    bool m_spiSlaveSelected;
+    // The halves the DMA uses; the other receive half holds the last frame
+    volatile uint8_t m_spiSlaveRxIndex;
+    volatile uint8_t m_spiSlaveTxIndex;
+    // The other transmit half holds a frame to send next
+    volatile bool m_spiSlaveTxPending;
+    volatile uint32_t m_spiSlaveFrames;
+    volatile uint32_t m_spiSlaveShortFrames;
 
     // Clear-on-read accumulating error register.
     SerialErrorStatusRegister m_errorRegAccum;
@@ -646,11 +1368,88 @@ private:
     void PortDisable();
 
     /**
-        Helper function to get next index in a buffer.
+        The index the receive DMA will write next.
     **/
-    uint32_t NextIndex(uint32_t currentIndex) {
-        return ((currentIndex + 1) & (SERIAL_BUFFER_SIZE - 1));
-    }
+    uint32_t DmaRxTail();
+
+    /**
+        Timestamp the characters the receive DMA has written since it was
+        last checked. Called with interrupts disabled.
+    **/
+    void DmaRxTimestamp(uint32_t now);
+
+    /**
+        Start a DMA transmit block of the staged characters. Must be called
+        with the transmit complete interrupt unable to run.
+    **/
+    void DmaTxStart();
+
+    /**
+        Publish \a count characters queued in place.
+    **/
+    void TxQueued(uint32_t count);
+
+    /**
+        After a write, arm the space callback if the buffer is short of
+        room.
+    **/
+    void TxSpaceArm();
+
+    /**
+        From the transmit interrupts, call the space callback once room has
+        opened up.
+    **/
+    void TxSpaceCheck();
+
+    /**
+        From the transmit complete interrupt, report that everything queued
+        has been sent.
+    **/
+    void TxDone();
+
+    /**
+        Stop the UART DMA channels and return to interrupt driven UART.
+    **/
+    void UartDmaStop();
+
+    /**
+        Start a DMA transfer in SPI mode.
+    **/
+    void SpiDmaStart(uint8_t const *writeBuf, uint8_t *readBuf,
+                     int32_t len);
+
+    /**
+        Set the number of bytes each 32-bit SPI DATA access moves, from 1 to
+        3, or 0 for all four. The SPI must be idle.
+    **/
+    void SpiLength(uint8_t bytes);
+
+    /**
+        The bulk SpiTransferData() with 32-bit DATA accesses.
+    **/
+    int32_t SpiTransferData32(uint8_t const *writeBuf, uint8_t *readBuf,
+                              int32_t len);
+
+    /**
+        Assert the chip select of a queued transaction and start it.
+    **/
+    void SpiTransactionStart(SpiTransaction *transaction);
+
+    /**
+        The completion callback of a poll's transaction.
+    **/
+    static void SpiPollDone(SpiTransaction *transaction);
+
+    /**
+        Reset the SERCOM into SPI slave mode. It drops any partly sent or
+        received frame.
+    **/
+    void SpiSlaveConfig();
+
+    /**
+        Point the SPI slave DMA at the current frame halves.
+    **/
+    void SpiSlaveArm();
 
     /**
         Receives characters from the DATA register and places them in the
@@ -667,6 +1466,12 @@ private:
         Helper function for setting RTS/SS pin modes
     **/
     bool RtsSsPinState(CtrlLineModes mode);
+
+    /**
+        Apply the UART transmit pinout for the flow control and RS-485
+        settings. The SERCOM must be disabled.
+    **/
+    void UartPinoutUpdate();
 };
 
 } // ClearCore namespace
@@ -207,6 +207,9 @@ private:
 
     /**
         Update connector's state.
+
+        \note The SysManager skips serial connectors in the sample rate
+        refresh because there is nothing to update.
     **/
     void Refresh() override {};
 }; // SerialDriver
@@ -0,0 +1,235 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    \file SerialPacket.h
+    \brief ClearCore framed binary packets over a serial port.
+
+    Sends and receives COBS-framed packets with a CRC over any ISerial.
+**/
+
+#ifndef __SERIALPACKET_H__
+#define __SERIALPACKET_H__
+
+#include <stdint.h>
+#include "ISerial.h"
+
+namespace ClearCore {
+
+class SecureChannel;
+
+/// The largest COBS block: the code byte and 254 data bytes
+#define SERIAL_PACKET_BLOCK_MAX 255
+
+/**
+    \class SerialPacket
+    \brief ClearCore framed binary packets over a serial port.
+
+    Each packet is sent with a CRC appended, COBS (Consistent Overhead Byte
+    Stuffing) encoded so that it contains no zero bytes, and followed by a
+    zero byte that marks the end of the frame. A receiver that starts in the
+    middle of a frame, or sees a corrupted frame, recovers at the next zero.
+
+    Received frames are decoded as the characters arrive straight into a
+    buffer supplied by the application, and the CRC is checked once the frame
+    is complete. A complete packet is reported by Poll() and, if one is set,
+    passed to a callback.
+
+    \code{.cpp}
+    uint8_t packetBuffer[64];
+    SerialPacket Packets(ConnectorUsb, packetBuffer, sizeof(packetBuffer));
+
+    int main() {
+        ConnectorUsb.PortOpen();
+        while (true) {
+            if (Packets.Poll()) {
+                // Echo the packet back
+                Packets.Send(Packets.Packet(), Packets.PacketLength());
+            }
+        }
+    }
+    \endcode
+**/
+class SerialPacket {
+public:
+    /**
+        The CRC appended to each packet.
+    **/
+    typedef enum {
+        /// No CRC
+        CRC_NONE,
+        /// CRC-16/MODBUS, 2 bytes
+        CRC_16,
+        /// CRC-32 (IEEE 802.3), 4 bytes
+        CRC_32,
+    } CrcTypes;
+
+    /**
+        A function called with each packet received. The packet is valid
+        until the next call to Poll().
+    **/
+    typedef void (*PacketCallback)(const uint8_t *packet, uint16_t length);
+
+    /**
+        \brief Construct a packet transport on a serial port.
+
+        \param[in] port The serial port.
+        \param[in] buffer The storage for received packets. It must hold the
+        longest packet plus its CRC.
+        \param[in] bufferSize The size of \a buffer.
+        \param[in] crcType The CRC to append and check.
+    **/
+    SerialPacket(ISerial &port, uint8_t *buffer, uint16_t bufferSize,
+                 CrcTypes crcType = CRC_16);
+
+    /**
+        \brief Send a packet.
+
+        Waits for room in the port's transmit buffer.
+
+        \code{.cpp}
+        uint8_t setpoint[] = {0x01, 0x10, 0x27, 0x00, 0x00};
+        Packets.Send(setpoint, sizeof(setpoint));
+        \endcode
+
+        \param[in] packet The packet.
+        \param[in] length The number of bytes in \a packet.
+
+        \return True if the packet was sent.
+    **/
+    bool Send(const uint8_t *packet, uint16_t length);
+
+    /**
+        \brief Decode the received characters until a packet is complete.
+
+        Call repeatedly from the main loop. Frames with a bad CRC or that do
+        not fit the buffer are dropped and counted.
+
+        \return True if a packet was received. It is available from Packet()
+        and PacketLength() until the next call.
+    **/
+    bool Poll();
+
+    /**
+        \brief The packet received by the last successful Poll().
+    **/
+    const uint8_t *Packet() {
+        return m_buffer;
+    }
+
+    /**
+        \brief The length of the packet received by the last successful
+        Poll(), without the CRC.
+    **/
+    uint16_t PacketLength() {
+        return m_packetLength;
+    }
+
+    /**
+        \brief Set a function to call with each packet received.
+
+        \code{.cpp}
+        void SetpointReceived(const uint8_t *packet, uint16_t length) {
+            // Handle the packet
+        }
+
+        Packets.Callback(SetpointReceived);
+        \endcode
+
+        \param[in] callback The function, or NULL for none.
+    **/
+    void Callback(PacketCallback callback) {
+        m_callback = callback;
+    }
+
+    /**
+        \brief Encrypt and authenticate the packets.
+
+        With a channel set, Send() seals each packet into \a sealBuffer
+        before framing it, and Poll() opens each frame received and drops any
+        that are forged, replayed, or not sealed. A packet from a session
+        the channel doesn't know is answered with the channel's challenge,
+        which Poll() takes without reporting a packet. Packets grow by
+        #SECURE_CHANNEL_OVERHEAD bytes on the wire, so the receive buffer
+        must hold that much more as well.
+
+        \code{.cpp}
+        uint8_t sealBuffer[64 + SECURE_CHANNEL_OVERHEAD];
+        Channel.Begin(key, sizeof(key));
+        Packets.Secure(&Channel, sealBuffer, sizeof(sealBuffer));
+        \endcode
+
+        \param[in] channel The channel, or null to stop sealing packets.
+        \param[in] sealBuffer Where packets are sealed for sending. It must
+        hold the longest packet plus #SECURE_CHANNEL_OVERHEAD.
+        \param[in] sealBufferSize The size of \a sealBuffer.
+
+        \return True if the channel was set.
+    **/
+    bool Secure(SecureChannel *channel, uint8_t *sealBuffer = nullptr,
+                uint16_t sealBufferSize = 0);
+
+    /**
+        \brief The number of frames dropped for a bad CRC, bad encoding,
+        overflowing the buffer, or failing to open on a secure transport.
+    **/
+    uint32_t PacketErrors() {
+        return m_packetErrors;
+    }
+
+private:
+    ISerial &m_port;
+    uint8_t *m_buffer;
+    uint16_t m_bufferSize;
+    CrcTypes m_crcType;
+    PacketCallback m_callback;
+
+    // Receive decode state
+    uint16_t m_rxLength;
+    uint8_t m_blockCode;
+    uint8_t m_blockRemaining;
+    bool m_rxOverflow;
+    uint16_t m_packetLength;
+    uint32_t m_packetErrors;
+
+    // Characters read from the port that are not decoded yet
+    uint8_t m_rxChunk[32];
+    uint8_t m_rxChunkPos;
+    uint8_t m_rxChunkLength;
+
+    // One COBS block being sent
+    uint8_t m_txBlock[SERIAL_PACKET_BLOCK_MAX];
+
+    SecureChannel *m_secure;
+    uint8_t *m_sealBuffer;
+    uint16_t m_sealBufferSize;
+
+    uint8_t CrcSize();
+    uint32_t CrcCalculate(const uint8_t *data, uint16_t length);
+    bool Encode(const uint8_t *packet, uint16_t length);
+    bool FrameEnd();
+    void DecodeReset();
+}; // SerialPacket
+
+} // ClearCore namespace
+
+#endif // __SERIALPACKET_H__
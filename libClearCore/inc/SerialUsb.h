@@ -58,6 +58,29 @@
 #endif
 #define BIN 2
 
+/** USB serial ring buffer size, in bytes; a power of 2. (1024) **/
+#ifndef USB_SERIAL_BUFFER_SIZE
+#define USB_SERIAL_BUFFER_SIZE 1024
+#endif
+
+/** USB serial endpoint transfer size, in bytes; a multiple of the 64 byte
+    packet size. There are two transfer buffers in each direction. (512) **/
+#ifndef USB_SERIAL_XFER_SIZE
+#define USB_SERIAL_XFER_SIZE 512
+#endif
+
+/** USB serial transmit latency, in milliseconds: the longest written data
+    waits for a full transfer buffer before it is sent anyway; 0 sends
+    each write at once. (1) **/
+#ifndef USB_SERIAL_TX_LATENCY_MS
+#define USB_SERIAL_TX_LATENCY_MS 1
+#endif
+
+/** USB telemetry record ring size, in bytes. (4096) **/
+#ifndef USB_TELEMETRY_BUFFER_SIZE
+#define USB_TELEMETRY_BUFFER_SIZE 4096
+#endif
+
 /** Serial USB timeout, in milliseconds (5000ms). **/
 #define USB_SERIAL_TIMEOUT 5000 // milliseconds
 
@@ -69,6 +92,16 @@ namespace ClearCore {
     This class provides support for emulated serial communications on the
     ClearCore's USB port.
 
+    A library built with CONF_USB_CDCD_ACM_PORTS set to 2 or 3 shows the host
+    that many serial ports, ConnectorUsb, ConnectorUsb1 and ConnectorUsb2,
+    each with its own buffers. Keeping a bulk stream on its own port keeps
+    it from delaying a console on another.
+
+    \code{.cpp}
+    ConnectorUsb.PortOpen();    // Console
+    ConnectorUsb1.PortOpen();   // Telemetry stream
+    \endcode
+
     For more detailed information on the ClearCore Connector interface, check
     out the \ref ConnectorMain informational page.
 **/
@@ -81,7 +114,13 @@ public:
         \brief Default constructor so this connector can be a global and
         constructed by SysManager
     **/
-    SerialUsb() {};
+    SerialUsb() : m_port(0) {};
+
+    /**
+        \brief Construct the connector of an additional CDC port, which is
+        not one of the ClearCorePins connectors
+    **/
+    explicit SerialUsb(uint8_t port);
 #endif
 
     ///////////////////////////////// ISerial API //////////////////////////////
@@ -137,6 +176,62 @@ public:
     **/
     bool SendChar(uint8_t charToSend) override;
 
+    /**
+        \copydoc ISerial::ReadBlock(uint8_t *buffer, size_t length)
+    **/
+    int32_t ReadBlock(uint8_t *buffer, size_t length) override;
+
+    /**
+        \copydoc ISerial::WriteBlock(const uint8_t *buffer, size_t length)
+
+        \note No characters will be sent if DTR is not asserted.
+    **/
+    int32_t WriteBlock(const uint8_t *buffer, size_t length) override;
+
+    /**
+        \brief Send a buffer and wait until it has been sent.
+
+        A buffer that is 4-byte aligned and in RAM is sent straight from the
+        caller's memory by the USB DMA, without being copied into the
+        transmit buffer.
+
+        \code{.cpp}
+        __attribute__((aligned(4))) uint8_t logBlock[4096];
+        ConnectorUsb.SendDirect(logBlock, sizeof(logBlock));
+        \endcode
+
+        \param[in] buffer The data to send.
+        \param[in] length The number of bytes in \a buffer.
+
+        \return True if all of the data was sent.
+
+        \note No characters will be sent if DTR is not asserted.
+    **/
+    bool SendDirect(const uint8_t *buffer, size_t length);
+
+    /**
+        \brief Set how long written data may wait to be sent.
+
+        Writes are gathered into a transfer buffer, which is sent once it is
+        full or once its oldest data has waited \a ms, so a stream of short
+        writes goes out in a few large transfers instead of many small ones.
+        Flush() and SendDirect() send the waiting data at once.
+
+        \code{.cpp}
+        // Send each write as soon as the endpoint is free
+        ConnectorUsb.SendLatency(0);
+        \endcode
+
+        \param[in] ms The latency in milliseconds, or 0 to send each write
+        at once. Starts at #USB_SERIAL_TX_LATENCY_MS.
+    **/
+    void SendLatency(uint16_t ms);
+
+    /**
+        \brief The latency set by SendLatency(), in milliseconds.
+    **/
+    uint16_t SendLatency();
+
     /**
         \copydoc ISerial::AvailableForRead()
     **/
@@ -295,9 +390,10 @@ public:
 private:
     // Index of this instance
     uint16_t m_index;
+    // The CDC port this connector uses
+    uint8_t m_port;
 
 #ifndef HIDE_FROM_DOXYGEN
-    explicit SerialUsb(uint16_t index);
 
     /**
         Initialize hardware and/or internal state.
@@ -311,6 +407,9 @@ private:
         \brief Update connector's state.
 
         \return Update the internal state.
+
+        \note The SysManager skips this connector in the sample rate refresh
+        because there is nothing to update.
     **/
     void Refresh() override {};
 #endif
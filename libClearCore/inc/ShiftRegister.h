@@ -34,6 +34,7 @@
 #include <stdint.h>
 #include "atomic_utils.h"
 #include "BlinkCodeDriver.h"
+#include "SysTiming.h"
 
 namespace ClearCore {
 
@@ -358,8 +359,8 @@ private:
 
     public:
         TickCounter()
-            : period(5000),
-              cc(2500),
+            : period(1000 * MS_TO_SAMPLES),
+              cc(500 * MS_TO_SAMPLES),
               count(0) {}
 
         TickCounter(uint32_t period, uint32_t cc)
@@ -495,6 +496,8 @@ private:
                                              };
 
     static const uint16_t DELAY_TIME = 25; // milliseconds
+    // The pause with every LED lit, in addition to DELAY_TIME
+    static const uint16_t SWEEP_HOLD_TIME = 50; // milliseconds
 
     // A mask that prevents sketches from changing Shift Register values that
     // aren't LEDs.
@@ -509,8 +512,8 @@ private:
         constants directly affect the associated counters and their physical
         output.
     **/
-    const uint32_t FAST_COUNTER_PERIOD = 500;
-    const uint32_t FAST_COUNTER_CC = 200;
+    const uint32_t FAST_COUNTER_PERIOD = MS_TO_LED_UPDATES(100);
+    const uint32_t FAST_COUNTER_CC = MS_TO_LED_UPDATES(40);
     TickCounter m_fastCounter;
     FadeInOutCounter m_breathingCounter;
     AnalogLedDriver m_fadeCounter;
@@ -523,11 +526,27 @@ private:
     uint32_t m_patternOutputs[LED_BLINK_CODE_MAX];
     uint32_t m_altOutput;
 
+    // The pattern outputs composed at the LED update rate: the strobe and
+    // blink code bits, and the bits left to the dimming patterns and the
+    // directly set outputs.
+    uint32_t m_patternWord;
+    uint32_t m_fadeMask;
+    uint32_t m_breathingMask;
+    uint32_t m_ioSetMask;
+
     // Set after initialization
     bool m_initialized;
     bool m_blinkCodeActive;
     bool m_blinkCodeState;
     bool m_useAltOutput;
+    // The LED sweep's next step, and when it is due
+    volatile bool m_sweepActive;
+    uint8_t m_sweepStep;
+    uint32_t m_sweepNextMs;
+    // Set while a transfer waits to be strobed into the chain
+    bool m_transferPending;
+    // Updates since the last transfer
+    uint32_t m_idleUpdates;
 
     // The values about to be written to the SPI data register.
     uint32_t m_pendingOutput;
@@ -537,7 +556,8 @@ private:
     uint32_t m_latchedOutput;
 
     /**
-        Update the shift chain and strobe.
+        Strobe the previous transfer into the shift chain, and start a new
+        transfer if the outputs have changed. Never waits on the SPI.
     **/
     void Send();
 
@@ -546,6 +566,18 @@ private:
     **/
     void Update();
 
+    /**
+        Advance the strobe pattern and recompose the pattern outputs. Called
+        at #LED_UPDATE_RATE_HZ, ahead of Update().
+    **/
+    void PatternUpdate();
+
+    /**
+        Take the next step of the LED sweep once it is due. Called from
+        Update().
+    **/
+    void DiagnosticLedSweepStep();
+
     /**
         \brief Atomic set of shift register state fields.
 
@@ -593,6 +625,21 @@ private:
     **/
     void DiagnosticLedSweep();
 
+    /**
+        \brief Start the LED sweep of DiagnosticLedSweep() without waiting
+        for it. Update() steps the sweep.
+
+        The sweep takes over the LEDs until it completes.
+    **/
+    void DiagnosticLedSweepStart();
+
+    /**
+        \brief Check whether an LED sweep is in progress.
+    **/
+    bool DiagnosticLedSweepActive() {
+        return m_sweepActive;
+    }
+
     void BlinkCode(bool blinkCodeActive, bool blinkCodeState) {
         m_blinkCodeActive = blinkCodeActive;
         m_blinkCodeState = blinkCodeState;
@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    \file SntpManager.h
+    \brief ClearCore SNTP client for wall-clock time.
+
+    Keeps the offset from the 64-bit microsecond clock of SysTiming to UTC,
+    as measured against an NTP server.
+**/
+
+#ifndef __SNTPMANAGER_H__
+#define __SNTPMANAGER_H__
+
+#include <stdint.h>
+#include "IpAddress.h"
+#include "SysTiming.h"
+#include "lwip/udp.h"
+
+namespace ClearCore {
+
+/// The default time between requests to the server once synchronized, in
+/// seconds
+#ifndef SNTP_POLL_INTERVAL_S
+#define SNTP_POLL_INTERVAL_S 64
+#endif
+
+/// The time between requests until the first reply, in milliseconds
+#ifndef SNTP_RETRY_MS
+#define SNTP_RETRY_MS 2000
+#endif
+
+/// Offsets from the server larger than this step the clock rather than slew
+#ifndef SNTP_STEP_THRESHOLD_US
+#define SNTP_STEP_THRESHOLD_US 128000
+#endif
+
+/// The fastest the clock is slewed: 500 us per second
+#ifndef SNTP_SLEW_MAX_PPM
+#define SNTP_SLEW_MAX_PPM 500
+#endif
+
+/**
+    \class SntpManager
+    \brief ClearCore SNTP client.
+
+    Polls an NTP server over UDP and keeps the offset from
+    Microseconds64(), which counts from power up, to UTC. Small corrections
+    are slewed at up to #SNTP_SLEW_MAX_PPM so the wall clock never jumps or
+    runs backwards; only the first reply, or an error of more than
+    #SNTP_STEP_THRESHOLD_US, steps it.
+
+    Timestamps can stay in the cheap boot-relative Microseconds64() form
+    as they are taken, and be converted with WallClockUs(uint64_t) when
+    they are written out.
+
+    \code{.cpp}
+    EthernetMgr.Setup();
+    EthernetMgr.DhcpBegin();
+    SntpMgr.Begin(IpAddress(192, 168, 0, 1));
+    ...
+    if (SntpMgr.Synchronized()) {
+        // Microseconds since 1970-01-01 00:00:00 UTC
+        uint64_t nowUs = SntpMgr.WallClockUs();
+    }
+    \endcode
+**/
+class SntpManager {
+    friend class SysManager;
+
+public:
+#ifndef HIDE_FROM_DOXYGEN
+    /**
+        Public accessor for singleton instance.
+    **/
+    static SntpManager &Instance();
+#endif
+
+    /**
+        \brief Start polling an NTP server.
+
+        Call after EthernetMgr.Setup(). The first request is sent right
+        away; the requests are sent with the rest of the Ethernet
+        servicing.
+
+        \param[in] server The address of the NTP server.
+        \param[in] pollSeconds The time between requests once synchronized.
+
+        \return True if the client started.
+    **/
+    bool Begin(IpAddress server, uint16_t pollSeconds = SNTP_POLL_INTERVAL_S);
+
+    /**
+        \brief Stop polling. The wall clock keeps running on the last offset.
+    **/
+    void Stop();
+
+    /**
+        \brief Whether a reply has been received from the server.
+    **/
+    bool Synchronized() {
+        return m_synchronized;
+    }
+
+    /**
+        \brief The current time, in microseconds since the Unix epoch.
+
+        \return The wall-clock time, or 0 before the first reply.
+    **/
+    uint64_t WallClockUs() {
+        return WallClockUs(Microseconds64());
+    }
+
+    /**
+        \brief Convert a Microseconds64() timestamp to wall-clock time.
+
+        \code{.cpp}
+        uint64_t stamp = Microseconds64();
+        ...
+        uint64_t utcUs = SntpMgr.WallClockUs(stamp);
+        \endcode
+
+        \param[in] localUs A Microseconds64() timestamp.
+
+        \return The same moment, in microseconds since the Unix epoch, or
+        0 before the first reply.
+    **/
+    uint64_t WallClockUs(uint64_t localUs);
+
+    /**
+        \brief The error measured by the last reply, in microseconds, before
+        it was corrected.
+    **/
+    int32_t OffsetUs() {
+        return m_offsetUs;
+    }
+
+    /**
+        \brief The network round trip of the last reply, in microseconds.
+    **/
+    uint32_t RoundTripUs() {
+        return m_roundTripUs;
+    }
+
+    /**
+        \brief The Milliseconds() time of the last reply.
+    **/
+    uint32_t LastSyncMs() {
+        return m_lastSyncMs;
+    }
+
+private:
+    struct udp_pcb *m_pcb;
+    ip_addr_t m_server;
+    uint32_t m_pollMs;
+
+    // The outstanding request: what it carried and when it left
+    uint8_t m_requestStamp[8];
+    uint64_t m_requestUs;
+    bool m_requestPending;
+
+    // Wall clock = local + m_baseUs + slew, where the slew runs at
+    // m_slewPpm from m_slewStartUs until it reaches m_slewUs
+    volatile bool m_synchronized;
+    volatile int64_t m_baseUs;
+    volatile int64_t m_slewUs;
+    volatile uint64_t m_slewStartUs;
+    volatile int32_t m_slewPpm;
+
+    volatile int32_t m_offsetUs;
+    volatile uint32_t m_roundTripUs;
+    volatile uint32_t m_lastSyncMs;
+
+    /**
+        Construct
+    **/
+    SntpManager();
+
+    // The part of the current slew applied by localUs
+    int64_t SlewApplied(uint64_t localUs);
+    // Correct the clock by the error of a reply
+    void Correct(int64_t errorUs, uint64_t localUs);
+
+    void RequestSend();
+    void Receive(struct pbuf *p, uint64_t rxUs);
+    static void RequestTimeout(void *arg);
+    static void ReceiveCallback(void *arg, struct udp_pcb *pcb,
+                                struct pbuf *p, const ip_addr_t *addr,
+                                u16_t port);
+}; // SntpManager
+
+} // ClearCore namespace
+
+#endif // __SNTPMANAGER_H__
@@ -29,6 +29,21 @@
 
 namespace ClearCore {
 
+/**
+    The number of status transitions kept in the StatusManager event log
+**/
+#ifndef STATUS_EVENT_LOG_SIZE
+#define STATUS_EVENT_LOG_SIZE 32
+#endif
+
+/**
+    When set to 1, the StatusManager event log is kept in the .noinit RAM
+    section so that the entries leading up to a reset can be read after it
+**/
+#ifndef STATUS_EVENT_LOG_PERSIST
+#define STATUS_EVENT_LOG_PERSIST 0
+#endif
+
 /**
     \brief ClearCore Status Register Manager class
 
@@ -86,11 +101,11 @@ public:
             uint32_t OutputOverloaded      : 1;
             /**
                 An output is currently overloaded on an attached CCIO-8 board
-                (driven TRUE but being pulled FALSE).
+                of either chain (driven TRUE but being pulled FALSE).
             **/
             uint32_t CcioOverloaded        : 1;
             /**
-                An established CCIO-8 link has gone offline.
+                An established CCIO-8 link of either chain has gone offline.
             **/
             uint32_t CcioLinkBroken        : 1;
             /**
@@ -118,6 +133,11 @@ public:
                 synchronize.
             **/
             uint32_t NvmDesync      : 1;
+            /**
+                The board restarted after a hard fault or a watchdog reset,
+                and the CrashManager snapshot has not been cleared.
+            **/
+            uint32_t CrashRecovered        : 1;
         } bit;
 
         /**
@@ -143,6 +163,45 @@ public:
         }
     };
 
+    /**
+        \enum EventSources
+
+        \brief The register that an event log entry was recorded from.
+    **/
+    typedef enum {
+        /// The StatusRegister
+        EVENT_SOURCE_STATUS,
+        /// The connector overloads reported by IoOverloadRT()
+        EVENT_SOURCE_IO_OVERLOAD,
+        /// A motor alert register; the \a Index is the motor connector number
+        EVENT_SOURCE_MOTOR_ALERT,
+        /// The CCIO-8 pin overloads; the \a Index selects pins 0-31 or 32-63
+        /// of CcioMgr, or 2 and 3 those of CcioMgr1
+        EVENT_SOURCE_CCIO_OVERLOAD,
+    } EventSources;
+
+    /**
+        \brief One entry of the status event log.
+
+        An entry is recorded for each sample in which any bit of its source
+        register changed.
+    **/
+    typedef struct {
+        /// The sample tick of the change; there are #MS_TO_SAMPLES ticks per
+        /// millisecond
+        uint32_t Tick;
+        /// The bits that asserted
+        uint32_t Risen;
+        /// The bits that deasserted
+        uint32_t Fallen;
+        /// The register that changed
+        uint8_t Source;
+        /// The motor number or CCIO-8 pin bank of the register
+        uint8_t Index;
+        /// The number of resets between the entry and the current boot
+        uint16_t BootsAgo;
+    } StatusEvent;
+
 #ifndef HIDE_FROM_DOXYGEN
     /**
         Public accessor for singleton instance
@@ -358,6 +417,11 @@ public:
     **/
     void Refresh();
 
+    /**
+        Advances the blink code display. Called at #LED_UPDATE_RATE_HZ.
+    **/
+    void BlinkCodeUpdate();
+
     /**
         \brief Helper to set the state of the DigitalInOutHBridge connectors
         during reset.
@@ -479,6 +543,75 @@ public:
             BlinkCodeDriver::BLINK_GROUP_APPLICATION, mask);
     }
 
+    /**
+        \brief The number of entries in the status event log.
+
+        The log keeps the most recent #STATUS_EVENT_LOG_SIZE transitions of
+        the status register, the connector overloads, the motor alert
+        registers and the CCIO-8 overloads, each with the sample tick it was
+        seen in. Unlike the StatusRisen() and StatusFallen() snapshots, this
+        keeps the order and timing of faults that come and go between polls.
+
+        When built with #STATUS_EVENT_LOG_PERSIST set to 1, the log survives
+        a reset that keeps RAM powered, such as a watchdog or software reset.
+
+        \code{.cpp}
+        // Print the time and new faults of each entry, oldest first
+        StatusManager::StatusEvent event;
+        for (uint16_t i = 0; i < StatusMgr.EventLogCount(); i++) {
+            if (StatusMgr.EventLogRead(i, event)) {
+                ConnectorUsb.Send(event.Tick / MS_TO_SAMPLES);
+                ConnectorUsb.Send(" ms: ");
+                ConnectorUsb.SendLine(event.Risen, 16);
+            }
+        }
+        \endcode
+
+        \return The number of entries available to EventLogRead().
+    **/
+    uint16_t EventLogCount();
+
+    /**
+        \brief Read one entry of the status event log.
+
+        \code{.cpp}
+        // Read the newest entry
+        StatusManager::StatusEvent event;
+        uint16_t count = StatusMgr.EventLogCount();
+        if (count && StatusMgr.EventLogRead(count - 1, event)) {
+            // Examine the event
+        }
+        \endcode
+
+        \param[in] index The entry to read; zero is the oldest.
+        \param[out] event The entry.
+
+        \return True if the entry exists.
+    **/
+    bool EventLogRead(uint16_t index, StatusEvent &event);
+
+    /**
+        \brief The number of entries that were overwritten by newer ones since
+        the log was last cleared.
+
+        \code{.cpp}
+        if (StatusMgr.EventLogLost()) {
+            // Read the log more often, or build with a larger
+            // STATUS_EVENT_LOG_SIZE
+        }
+        \endcode
+    **/
+    uint32_t EventLogLost();
+
+    /**
+        \brief Empty the status event log.
+
+        \code{.cpp}
+        StatusMgr.EventLogClear();
+        \endcode
+    **/
+    void EventLogClear();
+
 private:
     StatusRegister m_statusRegSinceStartup;
     StatusRegister m_statusRegRT;
@@ -496,6 +629,11 @@ private:
     bool m_disableMotors;
     volatile bool m_hbridgeResetting;
 
+    // The values the event log last saw
+    uint32_t m_eventOverloadPrev;
+    uint32_t m_eventAlertPrev[MOTOR_CON_CNT];
+    uint64_t m_eventCcioPrev[2];
+
     StatusManager()
         : m_statusRegSinceStartup(),
           m_statusRegRT(),
@@ -504,7 +642,10 @@ private:
           m_statusRegFallen(),
           m_faultLed(ShiftRegister::SR_NO_FEEDBACK_MASK),
           m_disableMotors(false),
-          m_hbridgeResetting(false) {}
+          m_hbridgeResetting(false),
+          m_eventOverloadPrev(0),
+          m_eventAlertPrev(),
+          m_eventCcioPrev() {}
 
     /**
         Activate a blink code.
@@ -531,6 +672,12 @@ private:
     **/
     void OverloadUpdate(uint32_t mask, bool inFault);
 
+    /**
+        Add an entry to the event log if \a prev and \a now differ.
+    **/
+    void EventRecord(uint8_t source, uint8_t index, uint32_t prev,
+                     uint32_t now);
+
 }; // StatusManager
 
 } // ClearCore namespace
@@ -43,6 +43,44 @@ namespace ClearCore
     fractional values (15). **/
 #define FRACT_BITS 15
 
+/** Jerk-limited profiles carry the jerk and the sub-LSB part of the
+    velocity with this many additional fractional bits (16). **/
+#define JERK_FRACT_BITS 16
+
+/** Number of positional moves that can wait in a StepGenerator's move queue
+    behind the active move (8). Must be a power of two. **/
+#ifndef MOVE_QUEUE_LENGTH
+#define MOVE_QUEUE_LENGTH 8
+#endif
+
+/** Number of Move() and MoveVelocity() commands from the main loop that can
+    wait for the next sample time (4). Must be a power of two. **/
+#ifndef MOVE_COMMAND_LENGTH
+#define MOVE_COMMAND_LENGTH 4
+#endif
+
+/** Number of PVT points that can be buffered ahead of the PVT segment being
+    executed (16). Must be a power of two. **/
+#ifndef PVT_QUEUE_LENGTH
+#define PVT_QUEUE_LENGTH 16
+#endif
+
+/** The most steps per sample a gantry side moves to take up a change in
+    its skew (1). **/
+#ifndef GANTRY_SKEW_STEPS_MAX
+#define GANTRY_SKEW_STEPS_MAX 1
+#endif
+
+/** The most samples the gearing input can be averaged over (16). **/
+#ifndef GEAR_SMOOTHING_MAX
+#define GEAR_SMOOTHING_MAX 16
+#endif
+
+/** The input shaper history length, in samples, that holds one ringing
+    period of \a freqHz with 10% to spare for the damping and rounding. **/
+#define INPUT_SHAPER_HISTORY_LENGTH(freqHz) \
+    ((_CLEARCORE_SAMPLE_RATE_HZ * 11) / ((freqHz) * 10) + 1)
+
     /**
         \class StepGenerator
         \brief ClearCore Step and Direction generator class
@@ -57,6 +95,7 @@ namespace ClearCore
     class StepGenerator
     {
         friend class MotorManager;
+        friend class MotionGroup;
         friend class TestIO;
 
     public:
@@ -68,8 +107,94 @@ namespace ClearCore
         {
             MOVE_TARGET_ABSOLUTE,
             MOVE_TARGET_REL_END_POSN,
+            /// On a rotary axis, reach the absolute position moving positive
+            MOVE_TARGET_ABSOLUTE_POS,
+            /// On a rotary axis, reach the absolute position moving negative
+            MOVE_TARGET_ABSOLUTE_NEG,
         } MoveTarget;
 
+        /**
+            \brief One point of a cam table: the slave position, in step
+            pulses, at a master position.
+        **/
+        struct CamPoint {
+            int32_t Master; ///< Master position
+            int32_t Slave;  ///< Slave position at the master position
+        };
+
+        /**
+            \brief A cam profile for #CamStart().
+
+            The points must be in order of strictly increasing master position
+            and may be declared const so they are kept in flash. A cyclic cam
+            repeats every time the master travels from the first point's
+            master position to the last point's; the slave advances by the
+            difference of the last and first slave positions each cycle, so a
+            rotary knife can use a non-zero advance and a reciprocating cam
+            returns to its start.
+        **/
+        struct CamTable {
+            const CamPoint *Points; ///< At least two points
+            uint16_t Count;         ///< The number of points
+            bool Cyclic;            ///< Repeat the table as the master moves
+        };
+
+        /**
+            \brief A leadscrew error table for #CompensationTable().
+
+            Entry i holds the correction, in step pulses, to add to the
+            commanded position (Start + i * 2^SpacingShift). The spacing is a
+            power of two so finding the entries around a position is a shift
+            rather than a divide. Positions between entries are interpolated;
+            positions beyond the ends use the end entries. The corrections may
+            be declared const so they are kept in flash.
+
+            Neighbouring entries should differ by less than the spacing so the
+            corrected position keeps moving in the commanded direction.
+        **/
+        struct CompTable {
+            int32_t Start;              ///< Position of the first entry
+            uint8_t SpacingShift;       ///< log2 of the entry spacing
+            const int16_t *Corrections; ///< At least two corrections
+            uint16_t Count;             ///< The number of corrections
+        };
+
+        /**
+            \brief The settings of the position loop for #PositionLoopStart().
+
+            The feedback is scaled to step pulses by StepsNum/StepsDen, so an
+            encoder with 4000 counts per revolution on a motor taking 800
+            steps per revolution uses 1/5.
+        **/
+        struct PositionLoop {
+            int16_t StepsNum;           ///< Steps per StepsDen counts
+            uint16_t StepsDen;          ///< Counts per StepsNum steps
+            uint8_t GainPercent;        ///< Share of the error fixed per sample
+            uint16_t Deadband;          ///< Largest error left uncorrected
+            uint16_t CorrectionMax;     ///< Most correction steps per sample
+            uint32_t FollowingErrorMax; ///< Error that stops the axis; 0 off
+        };
+
+        /**
+            \brief The planned profile of a positional move, from
+            #MovePreview().
+
+            The phases are in sample times, in the order they run. A move
+            that has to reverse first spends ReverseSamples stopping in the
+            current direction. AccelSamples is the ramp from the current
+            velocity to the peak velocity, which slows the axis if it is
+            moving faster than the move's velocity limit.
+        **/
+        struct MovePreviewInfo {
+            uint32_t ReverseSamples; ///< Stopping before reversing
+            uint32_t AccelSamples;   ///< Ramping to the peak velocity
+            uint32_t CruiseSamples;  ///< At the peak velocity
+            uint32_t DecelSamples;   ///< Stopping at the target
+            uint32_t TotalSamples;   ///< The whole move
+            uint32_t DurationMs;     ///< The whole move, rounded up
+            int32_t VelPeak;         ///< Step pulses/sec, signed
+        };
+
         /**
             \brief Issues a positional move for the specified distance.
 
@@ -90,7 +215,9 @@ namespace ClearCore
             \param[in] dist The distance of the move in step pulses
             \param[in] moveTarget (optional) Specify the type of movement that
             should be done. Absolute or relative to the end position of the current
-            move. Invalid will result in move relative to the end position.
+            move. Invalid will result in move relative to the end position. See
+            #RotaryModulus() for the direction of absolute moves on a rotary
+            axis.
             Default: MOVE_TARGET_REL_END_POSN
 
             <div class="sd-disclaimer">For use with Step and Direction mode.</div>
@@ -98,6 +225,730 @@ namespace ClearCore
         virtual bool Move(int32_t dist,
                           MoveTarget moveTarget = MOVE_TARGET_REL_END_POSN);
 
+        /**
+            \brief Works out the profile that #Move() would run for a
+            positional move, without starting it.
+
+            The move is planned by the same code that plans it when it
+            starts, with the pending #VelMax(), #AccelMax() and #JerkMax()
+            limits and the axis' current position, velocity and direction,
+            including the stop and reversal needed when the move can't be
+            reached in the current direction. The plan is for the move
+            issued now, so commands still waiting for the next sample time
+            and the feed-rate override are not accounted for. Phase times
+            may differ from the executed move by a sample at each phase
+            change.
+
+            \code{.cpp}
+            // Only start M-0's move if it finishes within half a second
+            StepGenerator::MovePreviewInfo preview;
+            if (ConnectorM0.MovePreview(12000, preview) &&
+                    preview.DurationMs <= 500) {
+                ConnectorM0.Move(12000);
+            }
+            \endcode
+
+            \param[in] dist The distance or position of the move.
+            \param[in] info Returns the planned profile.
+            \param[in] moveTarget The type of move, as with Move().
+
+            \return True if the move was planned; false while the axis is
+            following a MotionGroup, PVT stream, gearing or cam.
+
+            <div class="sd-disclaimer">For use with Step and Direction mode.</div>
+        **/
+        bool MovePreview(int32_t dist, MovePreviewInfo &info,
+                         MoveTarget moveTarget = MOVE_TARGET_REL_END_POSN);
+
+        /**
+            \brief Appends a positional move to the move queue.
+
+            Queued moves are started by the StepGenerator as soon as the
+            previous move finishes, in the same sample time, so no time is lost
+            between consecutive moves. The velocity, acceleration, and jerk
+            limits in effect when the move is queued are used for that move.
+
+            If the StepGenerator is idle and the queue is empty the move
+            starts immediately, just like #Move(). Calling #Move(),
+            #MoveVelocity(), or one of the stop functions discards any moves
+            remaining in the queue.
+
+            \code{.cpp}
+            // Queue up a three segment move on M-0
+            ConnectorM0.MoveQueueAdd(1000);
+            ConnectorM0.MoveQueueAdd(2500);
+            ConnectorM0.MoveQueueAdd(0, StepGenerator::MOVE_TARGET_ABSOLUTE);
+            \endcode
+
+            \param[in] dist The distance of the move in step pulses
+            \param[in] moveTarget (optional) Specify the type of movement that
+            should be done. Absolute or relative to the end position of the
+            previous move. Default: MOVE_TARGET_REL_END_POSN
+
+            \return True if the move was queued; false if the queue is full.
+
+            <div class="sd-disclaimer">For use with Step and Direction mode.</div>
+        **/
+        virtual bool MoveQueueAdd(int32_t dist,
+                                  MoveTarget moveTarget = MOVE_TARGET_REL_END_POSN);
+
+        /**
+            \brief The number of moves waiting in the move queue, not including
+            the active move.
+
+            \code{.cpp}
+            if (ConnectorM0.MoveQueueCount() < 4) {
+                // Refill M-0's move queue
+            }
+            \endcode
+
+            \return The number of queued moves.
+
+            <div class="sd-disclaimer">For use with Step and Direction mode.</div>
+        **/
+        uint8_t MoveQueueCount() {
+            return static_cast<uint8_t>(m_moveQueueHead - m_moveQueueTail);
+        }
+
+        /**
+            \brief Discards all moves waiting in the move queue.
+
+            The active move is not affected.
+
+            \code{.cpp}
+            // Let M-0 finish its current move, but don't start any others
+            ConnectorM0.MoveQueueClear();
+            \endcode
+
+            <div class="sd-disclaimer">For use with Step and Direction mode.</div>
+        **/
+        void MoveQueueClear();
+
+        /**
+            \brief Enables velocity blending between queued moves.
+
+            With blending enabled, a queued move that continues in the same
+            direction as the active move is merged into the active move when
+            it reaches its deceleration point, so the motor carries its speed
+            through the junction instead of stopping. Moves that reverse
+            direction always come to a stop first. Blending is disabled by
+            default.
+
+            \code{.cpp}
+            // Blend M-0's queued moves together
+            ConnectorM0.MoveQueueBlending(true);
+            \endcode
+
+            \param[in] enable True to blend consecutive moves.
+
+            <div class="sd-disclaimer">For use with Step and Direction mode.</div>
+        **/
+        void MoveQueueBlending(bool enable) {
+            m_moveQueueBlending = enable;
+        }
+
+        /**
+            \brief Stages a positional move to be started by
+            MotorManager::MovesCommit() or an armed trigger.
+
+            Staged moves on several axes all begin on the same sample time,
+            which separate Move() calls cannot guarantee. The move is checked
+            when it starts, as if Move() were called then. Staging a move
+            replaces any move already staged on this axis.
+
+            \code{.cpp}
+            // Start M-0 and M-1 on the same sample
+            ConnectorM0.MoveStage(4000);
+            ConnectorM1.MoveStage(-2000);
+            MotorMgr.MovesCommit();
+            \endcode
+
+            \param[in] dist The distance or position of the move.
+            \param[in] moveTarget The type of move, as with Move().
+
+            \return True if the move was staged.
+
+            <div class="sd-disclaimer">For use with Step and Direction mode.</div>
+        **/
+        bool MoveStage(int32_t dist,
+                       MoveTarget moveTarget = MOVE_TARGET_REL_END_POSN);
+
+        /**
+            \brief Stages a velocity move to be started by
+            MotorManager::MovesCommit() or an armed trigger.
+
+            \code{.cpp}
+            ConnectorM2.MoveVelocityStage(800);
+            \endcode
+
+            \param[in] velocity The velocity of the move in step
+            pulses/second.
+
+            \return True if the move was staged.
+
+            <div class="sd-disclaimer">For use with Step and Direction mode.</div>
+        **/
+        bool MoveVelocityStage(int32_t velocity);
+
+        /**
+            \brief Discards the staged move, if any.
+
+            \code{.cpp}
+            ConnectorM0.MoveStageClear();
+            \endcode
+
+            <div class="sd-disclaimer">For use with Step and Direction mode.</div>
+        **/
+        void MoveStageClear() {
+            m_staged = false;
+        }
+
+        /**
+            \brief Check whether a move is staged and waiting to start.
+
+            \code{.cpp}
+            if (!ConnectorM0.MoveStaged()) {
+                // The staged move has started
+            }
+            \endcode
+
+            \return True if a staged move has not started yet.
+
+            <div class="sd-disclaimer">For use with Step and Direction mode.</div>
+        **/
+        bool MoveStaged() {
+            return m_staged;
+        }
+
+        /**
+            \brief Sets the leadscrew error table applied to the steps sent to
+            the motor.
+
+            The commanded position reported by PositionRefCommanded() is not
+            changed; only the steps sent are corrected. A change in the
+            correction is sent only while the motor is moving in the direction
+            of the change, so setting or clearing a table never moves a
+            stopped motor.
+
+            \code{.cpp}
+            // Measured pitch error every 1024 steps from position 0
+            static const int16_t pitch[] = {0, 2, 3, 3, 1, -1, -2};
+            static const StepGenerator::CompTable screw = {0, 10, pitch, 7};
+            ConnectorM0.CompensationTable(&screw);
+            \endcode
+
+            \param[in] table The table to use, or nullptr to turn pitch
+            compensation off.
+
+            \return True if the table was accepted; false if it has fewer than
+            two entries or a spacing over 2^30.
+
+            <div class="sd-disclaimer">For use with Step and Direction mode.</div>
+        **/
+        bool CompensationTable(const CompTable *table);
+
+        /**
+            \brief Makes the axis rotary, with a position that wraps every
+            \a countsPerRev step pulses.
+
+            The commanded position stays in [0, countsPerRev), so a continuous
+            velocity move never overflows it. An absolute move takes the
+            shortest way to the target position, which may be given outside
+            one revolution; #MOVE_TARGET_ABSOLUTE_POS and
+            #MOVE_TARGET_ABSOLUTE_NEG pick the direction instead. PVT and cam
+            positions are followed the shortest way around as well. Relative
+            moves are unchanged.
+
+            MotionGroup paths treat their axes as linear.
+
+            \code{.cpp}
+            // An indexing table with 36000 step pulses per revolution
+            ConnectorM0.RotaryModulus(36000);
+            // Turn to 350 degrees by way of 0
+            ConnectorM0.Move(35000, StepGenerator::MOVE_TARGET_ABSOLUTE);
+            \endcode
+
+            \param[in] countsPerRev The step pulses per revolution, or 0 to
+            make the axis linear again.
+
+            \return True if the modulus was set; false if it is negative or
+            the axis is moving.
+
+            <div class="sd-disclaimer">For use with Step and Direction mode.</div>
+        **/
+        bool RotaryModulus(int32_t countsPerRev);
+
+        /**
+            \brief The step pulses per revolution of a rotary axis, or 0 if the
+            axis is linear.
+        **/
+        int32_t RotaryModulus() {
+            return m_rotaryModulus;
+        }
+
+        /**
+            \brief Sets software travel limits on the commanded position.
+
+            Positional moves that would end past a limit end at the limit
+            instead, and a velocity move toward a limit becomes a stop at the
+            limit, started in time to stop with the move's acceleration. If
+            the axis can't stop in time with the move's limits, such as when a
+            move is issued close to a limit at speed, it decelerates harder
+            (without jerk limiting) to stop at the limit rather than pass it.
+
+            A move starting outside the limits may still move back toward
+            them, but not further out. The limits are ignored on a rotary
+            axis and while following a MotionGroup, PVT stream, gearing, or a
+            cam.
+
+            \code{.cpp}
+            // Keep the carriage between 0 and 250000 step pulses
+            ConnectorM0.SoftLimits(0, 250000);
+            \endcode
+
+            \param[in] negLimit The lowest allowed position.
+            \param[in] posLimit The highest allowed position.
+
+            \return True if the limits were set; false if \a negLimit is not
+            below \a posLimit.
+
+            <div class="sd-disclaimer">For use with Step and Direction mode.</div>
+        **/
+        bool SoftLimits(int32_t negLimit, int32_t posLimit);
+
+        /**
+            \brief Turns the software travel limits off.
+
+            <div class="sd-disclaimer">For use with Step and Direction mode.</div>
+        **/
+        void SoftLimitsClear() {
+            m_softLimitsOn = false;
+        }
+
+        /**
+            \brief Check whether the commanded position is at or past a
+            software travel limit.
+
+            \code{.cpp}
+            if (ConnectorM0.SoftLimitReached()) {
+                // M-0 is at the end of its travel
+            }
+            \endcode
+
+            \return True if software limits are set and the position is at or
+            past one of them.
+        **/
+        bool SoftLimitReached() {
+            return m_softLimitsOn && !m_rotaryModulus &&
+                   (m_posnAbsolute <= m_softLimitNeg ||
+                    m_posnAbsolute >= m_softLimitPos);
+        }
+
+        /**
+            \brief Sets the backlash taken up when the motor reverses.
+
+            Each time the motor starts moving in the direction opposite its
+            last motion, this many extra step pulses are sent in the new
+            direction, spread over the following samples as the step rate
+            allows.
+
+            \code{.cpp}
+            // Take up 12 steps of backlash on each reversal
+            ConnectorM0.BacklashSteps(12);
+            \endcode
+
+            \param[in] steps The backlash, in step pulses. 0 turns backlash
+            compensation off.
+
+            <div class="sd-disclaimer">For use with Step and Direction mode.</div>
+        **/
+        void BacklashSteps(uint16_t steps) {
+            m_compBacklash = steps;
+        }
+
+        /**
+            \brief Closes a position loop around the motor through a feedback
+            position, such as an encoder on a stepper motor.
+
+            Every sample time the steps sent to the motor are compared with
+            the scaled feedback. Errors larger than the deadband are corrected
+            by sending extra step pulses, up to \a CorrectionMax per sample;
+            while moving they are only sent in the direction of the move, so a
+            motor that stalled or slipped catches up as it goes. The commanded
+            position reported by PositionRefCommanded() is not changed. The
+            steps sent reach the feedback a couple of sample times later,
+            which the loop allows for.
+
+            If the error grows past \a FollowingErrorMax the axis stops
+            abruptly, the loop turns off, and FollowingErrorReached() reports
+            it.
+
+            \code{.cpp}
+            // 800 steps/rev motor with a 4000 count/rev encoder. Correct half
+            // of errors over 2 steps each sample, up to 4 steps per sample,
+            // and stop if the motor falls 200 steps behind.
+            static const StepGenerator::PositionLoop loop =
+                {1, 5, 50, 2, 4, 200};
+            ConnectorM0.PositionLoopStart(loop, EncoderIn.PositionRaw());
+            \endcode
+
+            \param[in] loop The loop settings.
+            \param[in] feedback The feedback position. It is read every sample
+            time and should count the motor's own motion.
+
+            \return True if the loop was started; false if the scale is zero
+            or the gain is not 1 to 100 percent.
+
+            <div class="sd-disclaimer">For use with Step and Direction mode.</div>
+        **/
+        bool PositionLoopStart(const PositionLoop &loop,
+                               volatile const int32_t &feedback);
+
+        /**
+            \brief Turns the position loop off.
+
+            <div class="sd-disclaimer">For use with Step and Direction mode.</div>
+        **/
+        void PositionLoopStop() {
+            m_loopOn = false;
+        }
+
+        /**
+            \brief The position loop's error at the last sample time: the step
+            pulses the motor should have moved less the scaled feedback.
+        **/
+        volatile const int32_t &FollowingError() {
+            return m_loopError;
+        }
+
+        /**
+            \brief Check whether the position loop stopped the axis for a
+            following error since the last call.
+
+            \code{.cpp}
+            if (ConnectorM0.FollowingErrorReached()) {
+                // M-0 stalled
+            }
+            \endcode
+
+            \return True if the following error limit was reached since the
+            last call.
+        **/
+        bool FollowingErrorReached();
+
+        /**
+            \brief The input shapers offered by InputShaperStart().
+        **/
+        typedef enum {
+            /// Zero vibration: two impulses half a ringing period apart
+            SHAPER_ZV,
+            /// Zero vibration and derivative: three impulses over one
+            /// ringing period. Slower, but much less sensitive to error in
+            /// the frequency.
+            SHAPER_ZVD,
+        } ShaperType;
+
+        /**
+            \brief Shapes the steps sent to the motor to cancel a ringing
+            frequency of the machine.
+
+            Each sample's steps are split into impulses spread over half a
+            ringing period (ZV) or a full ringing period (ZVD), timed and
+            sized so that the ringing each impulse starts is cancelled by the
+            next. The shaping comes after the leadscrew and backlash
+            corrections and before the position loop, which follows the
+            shaped steps.
+
+            The commanded position reported by PositionRefCommanded() is not
+            shaped; the motor lags behind it by up to the length of the
+            shaper, and keeps moving for that long after the move is done.
+            InputShaperPending() tells when the motor has caught up. Steps
+            that a quick reversal would shape against the direction of the
+            move wait until the axis is idle or moving that way.
+
+            The caller supplies the history of the last samples' steps, which
+            must cover the shaper. #INPUT_SHAPER_HISTORY_LENGTH sizes it for a
+            frequency.
+
+            \code{.cpp}
+            // The arm on M-0 rings at 8 Hz with about 5% damping
+            int16_t armHistory[INPUT_SHAPER_HISTORY_LENGTH(8)];
+            ConnectorM0.InputShaperStart(StepGenerator::SHAPER_ZVD, 8, 0.05,
+                                         armHistory,
+                                         INPUT_SHAPER_HISTORY_LENGTH(8));
+            \endcode
+
+            \param[in] type The shaper to use.
+            \param[in] freqHz The undamped ringing frequency, in Hz.
+            \param[in] damping The damping ratio of the ringing, from 0 to
+            less than 1.
+            \param[in] history Storage for the shaper's history. It must
+            remain valid while the shaper is on.
+            \param[in] length The number of entries in \a history.
+
+            \return True if the shaper was turned on; false if the axis is
+            moving, the shaper is already on, or the history is too short for
+            the frequency.
+
+            <div class="sd-disclaimer">For use with Step and Direction mode.</div>
+        **/
+        bool InputShaperStart(ShaperType type, float freqHz, float damping,
+                              int16_t *history, uint16_t length);
+
+        /**
+            \brief Turns the input shaper off.
+
+            \code{.cpp}
+            if (!ConnectorM0.InputShaperPending()) {
+                ConnectorM0.InputShaperStop();
+            }
+            \endcode
+
+            \return True if the shaper is off; false if the axis is moving or
+            the shaper still has steps to send.
+
+            <div class="sd-disclaimer">For use with Step and Direction mode.</div>
+        **/
+        bool InputShaperStop();
+
+        /**
+            \brief Check whether the input shaper is on.
+
+            <div class="sd-disclaimer">For use with Step and Direction mode.</div>
+        **/
+        bool InputShaperActive() {
+            return m_shaperOn;
+        }
+
+        /**
+            \brief The steps the input shaper has taken in but not sent yet.
+
+            \code{.cpp}
+            ConnectorM0.Move(5000);
+            while (!ConnectorM0.StepsComplete() ||
+                   ConnectorM0.InputShaperPending()) {
+                continue;
+            }
+            // The motor has reached the end of the move
+            \endcode
+
+            \return The signed count of step pulses still to send, 0 once the
+            motor has caught up with the commanded position.
+
+            <div class="sd-disclaimer">For use with Step and Direction mode.</div>
+        **/
+        int32_t InputShaperPending() {
+            return m_shaperPending;
+        }
+
+        /**
+            \brief Enters PVT (position-velocity-time) streaming mode.
+
+            In PVT mode the StepGenerator follows a stream of points added
+            with #PvtPointAdd(), interpolating between consecutive points with
+            a cubic Hermite curve so that both the position and the velocity
+            of each point are met at its time. The stream starts from the
+            current position at rest.
+
+            When the stream runs out of points the StepGenerator waits at the
+            last point if that point's velocity is zero. If the velocity is
+            not zero, the underflow is counted (see #PvtUnderflowCount()) and
+            the motor ramps to a stop as if #MoveStopDecel() had been called,
+            ending PVT mode.
+
+            \code{.cpp}
+            ConnectorM0.PvtStreamStart();
+            ConnectorM0.PvtPointAdd(400, 2000, 200);
+            ConnectorM0.PvtPointAdd(800, 0, 200);
+            ConnectorM0.PvtStreamEnd();
+            \endcode
+
+            \return True if PVT mode was entered; false if a move is in
+            progress.
+
+            <div class="sd-disclaimer">For use with Step and Direction mode.</div>
+        **/
+        bool PvtStreamStart();
+
+        /**
+            \brief Appends a point to the PVT stream.
+
+            Safe to call while the stream is running. The points are consumed
+            in the order they are added.
+
+            \code{.cpp}
+            // Arrive at position 1000 moving at 5000 step pulses/sec, 50ms
+            // after the previous point
+            ConnectorM0.PvtPointAdd(1000, 5000, 50);
+            \endcode
+
+            \param[in] posn The absolute position of the point, in step pulses
+            \param[in] vel The velocity at the point, in step pulses/sec
+            \param[in] durationMs The time from the previous point to this
+            point, in milliseconds. Must not be zero.
+
+            \return True if the point was buffered; false if the buffer is
+            full, the duration is zero, or PVT mode is not active.
+
+            <div class="sd-disclaimer">For use with Step and Direction mode.</div>
+        **/
+        bool PvtPointAdd(int32_t posn, int32_t vel, uint16_t durationMs);
+
+        /**
+            \brief The number of PVT points waiting to be executed.
+
+            \code{.cpp}
+            if (ConnectorM0.PvtPointCount() < 8) {
+                // Send more points to M-0
+            }
+            \endcode
+
+            \return The number of buffered PVT points.
+
+            <div class="sd-disclaimer">For use with Step and Direction mode.</div>
+        **/
+        uint8_t PvtPointCount() {
+            return static_cast<uint8_t>(m_pvtQueueHead - m_pvtQueueTail);
+        }
+
+        /**
+            \brief Ends PVT mode once the buffered points have been executed.
+
+            The final point should have zero velocity; otherwise the motor
+            ramps to a stop after it and an underflow is counted.
+
+            \code{.cpp}
+            ConnectorM0.PvtStreamEnd();
+            \endcode
+
+            <div class="sd-disclaimer">For use with Step and Direction mode.</div>
+        **/
+        void PvtStreamEnd() {
+            m_pvtEnding = true;
+        }
+
+        /**
+            \brief The number of times the PVT stream ran out of points while
+            moving since the last #PvtStreamStart().
+
+            \code{.cpp}
+            if (ConnectorM0.PvtUnderflowCount()) {
+                // Points are not arriving fast enough; buffer more of them
+            }
+            \endcode
+
+            \return The PVT underflow count.
+
+            <div class="sd-disclaimer">For use with Step and Direction mode.</div>
+        **/
+        uint32_t PvtUnderflowCount() {
+            return m_pvtUnderflowCount;
+        }
+
+        /**
+            \brief Slaves the StepGenerator to an encoder with a fixed gear
+            ratio.
+
+            Every sample time the counts the encoder moved in that sample are
+            multiplied by numerator/denominator and sent as steps in the same
+            sample. The fraction left over is carried to the next sample so no
+            counts are lost, however long the gearing runs. If the encoder
+            outpaces the maximum step rate the motor falls behind and catches
+            up once the encoder slows.
+
+            Gearing continues until #MoveStopDecel() or #MoveStopAbrupt() is
+            called. Calling this function while geared changes the ratio.
+            Motion that would carry the axis past its SoftLimits() is
+            dropped, so the axis waits at the limit until the encoder comes
+            back.
+
+            \code{.cpp}
+            // Send 3 steps for every 2 encoder counts
+            ConnectorM0.GearingStart(3, 2);
+            \endcode
+
+            \param[in] numerator The step pulses per denominator encoder
+            counts. Negative values reverse the direction.
+            \param[in] denominator The encoder counts per numerator step
+            pulses. Must not be zero.
+
+            \return True if gearing was started.
+
+            <div class="sd-disclaimer">For use with Step and Direction mode.</div>
+        **/
+        virtual bool GearingStart(int16_t numerator, uint16_t denominator);
+
+        /**
+            \brief Average the gearing input over a number of samples.
+
+            Smooths a coarse or jittery master, such as pulses from another
+            controller, at the cost of \a samples - 1 samples of lag. Every
+            count is still sent; averaging only spreads it out.
+
+            \code{.cpp}
+            // Average the encoder over the last 4 samples
+            ConnectorM0.GearingSmoothing(4);
+            \endcode
+
+            \param[in] samples The samples to average over, from 1 (no
+            smoothing) to #GEAR_SMOOTHING_MAX.
+
+            \return True if the value was accepted; false if it is out of
+            range or gearing is active.
+
+            <div class="sd-disclaimer">For use with Step and Direction mode.</div>
+        **/
+        bool GearingSmoothing(uint8_t samples);
+
+        /**
+            \brief The number of samples the gearing input is averaged over.
+
+            <div class="sd-disclaimer">For use with Step and Direction mode.</div>
+        **/
+        uint8_t GearingSmoothing() {
+            return m_gearSmoothing;
+        }
+
+        /**
+            \brief Slaves the StepGenerator to a master position through a cam
+            table.
+
+            Every sample time the master position is looked up in the table,
+            the slave position is interpolated linearly between the points
+            around it, and the steps needed to reach it are sent in the same
+            sample. The cam engages at its first point: the master's and the
+            slave's positions when this function is called are taken to be the
+            first point's master and slave positions. A non-cyclic cam holds
+            the slave at the end point while the master is past either end of
+            the table.
+
+            The table is read by the sample rate interrupt and must remain
+            valid until the cam is stopped with #MoveStopDecel() or
+            #MoveStopAbrupt().
+
+            \code{.cpp}
+            static const StepGenerator::CamPoint knifePoints[] = {
+                {0, 0}, {800, 200}, {1200, 1000}, {2000, 1200}
+            };
+            static const StepGenerator::CamTable knife = {knifePoints, 4, true};
+            // Follow M-1's commanded position through the knife cam
+            ConnectorM0.CamStart(knife, ConnectorM1.PositionRefCommanded());
+            \endcode
+
+            \param[in] cam The cam table.
+            \param[in] masterPosn The master position to follow. It is read
+            every sample time.
+
+            \return True if the cam was started; false if a move is in
+            progress or the table is not valid. A valid table has at least two
+            points, increasing master positions, and a master span that fits
+            in an int32_t.
+
+            <div class="sd-disclaimer">For use with Step and Direction mode.</div>
+        **/
+        virtual bool CamStart(const CamTable &cam,
+                              volatile const int32_t &masterPosn);
+
         /**
             \brief Issues a velocity move at the specified velocity.
 
@@ -161,10 +1012,7 @@ namespace ClearCore
 
             <div class="sd-disclaimer">For use with Step and Direction mode.</div>
         **/
-        void PositionRefSet(int32_t posn)
-        {
-            m_posnAbsolute = posn;
-        }
+        void PositionRefSet(int32_t posn);
 
         /**
             \brief Accessor for the StepGenerator's position reference
@@ -247,6 +1095,94 @@ namespace ClearCore
         **/
         void EStopDecelMax(uint32_t decelMax);
 
+        /**
+            \brief Sets the maximum jerk in step pulses per second^3.
+
+            A non-zero jerk limit switches the StepGenerator from trapezoidal
+            to jerk-limited (S-curve) profiles: the acceleration ramps up to
+            #AccelMax and back down to zero at the jerk rate instead of
+            changing instantaneously. Setting the jerk limit to 0 (default)
+            restores trapezoidal profiles.
+
+            Like the other motion limits, the new value takes effect when the
+            next move is commanded.
+
+            \code{.cpp}
+            // Limit M-0's jerk to 2,000,000 step pulses/sec^3
+            ConnectorM0.JerkMax(2000000);
+            \endcode
+
+            \param[in] jerkMax The new jerk limit, or 0 to disable jerk
+            limiting
+
+            \note Merging a new move into a move that is still accelerating
+            restarts the acceleration ramp from zero. Stops commanded through
+            #MoveStopDecel() and the hardware limit switches are not jerk
+            limited so the stopping distance does not grow.
+
+            <div class="sd-disclaimer">For use with Step and Direction mode.</div>
+        **/
+        void JerkMax(uint32_t jerkMax);
+
+        /**
+            \brief Scales the speed of the motion in progress, from 0 to 200
+            percent.
+
+            The override runs the motion profile faster or slower in time, so
+            moves and PVT streams keep their path and their end position
+            while their velocity is scaled by the override and their
+            acceleration by the square of it. A change in the override ramps
+            in no faster than #AccelMax allows at the current speed, and the
+            override is held down so that the speed stays within the maximum
+            step rate. An override of 0 holds the motion where it is until the
+            override is raised again; moves and stops commanded while held
+            start when the motion resumes. Gearing and cam motion follow
+            their master and are not scaled.
+
+            A MotionGroup has its own override for the path of its axes.
+
+            \code{.cpp}
+            // Slow M-0 to half speed while the part is inspected
+            ConnectorM0.FeedOverride(50);
+            \endcode
+
+            \param[in] percent The new override, in percent of the commanded
+            speed. Values above 200 are clipped.
+
+            <div class="sd-disclaimer">For use with Step and Direction mode.</div>
+        **/
+        void FeedOverride(uint16_t percent);
+
+        /**
+            \brief The feed-rate override last set by FeedOverride(), in
+            percent.
+
+            <div class="sd-disclaimer">For use with Step and Direction mode.</div>
+        **/
+        uint16_t FeedOverride() {
+            return (m_overrideTargetQ15 * 100 + (1L << (FRACT_BITS - 1))) >>
+                   FRACT_BITS;
+        }
+
+        /**
+            \brief The feed-rate override in effect, in percent, while it
+            ramps toward the value set by FeedOverride().
+
+            \code{.cpp}
+            ConnectorM0.FeedOverride(0);
+            while (ConnectorM0.FeedOverrideCurrent()) {
+                continue;
+            }
+            // M-0 is held
+            \endcode
+
+            <div class="sd-disclaimer">For use with Step and Direction mode.</div>
+        **/
+        uint16_t FeedOverrideCurrent() {
+            return (m_overrideQ15 * 100 + (1L << (FRACT_BITS - 1))) >>
+                   FRACT_BITS;
+        }
+
         /**
             \brief Function to check if no steps are currently being commanded to
             the motor.
@@ -264,7 +1200,8 @@ namespace ClearCore
         **/
         bool StepsComplete()
         {
-            return MoveStateGet() == MS_IDLE;
+            return MoveStateGet() == MS_IDLE && !m_stepsExternalActive &&
+                   m_moveCommandHead == m_moveCommandTail && !m_overrideHeld;
         }
 
         /**
@@ -309,6 +1246,13 @@ namespace ClearCore
                   InNegHWLimitLast(0) {}
         };
 
+        typedef enum
+        {
+            EXTERNAL_STOP_NONE,
+            EXTERNAL_STOP_DECEL,
+            EXTERNAL_STOP_ABRUPT,
+        } ExternalStopRequests;
+
         typedef enum
         {
             MS_IDLE,
@@ -319,6 +1263,9 @@ namespace ClearCore
             MS_DECEL_VEL,
             MS_END,
             MS_CHANGE_DIR,
+            MS_PVT,
+            MS_GEAR,
+            MS_CAM,
         } MoveStates;
 
         uint32_t m_stepsPrevious;
@@ -331,6 +1278,37 @@ namespace ClearCore
         LimitStatus m_limitInfo;
 
         int32_t m_posnAbsolute;
+        // The position wraps at this count on a rotary axis; 0 if linear
+        int32_t m_rotaryModulus;
+        // Software travel limits
+        int32_t m_softLimitNeg;
+        int32_t m_softLimitPos;
+        volatile bool m_softLimitsOn;
+
+        // While a MotionGroup owns the axis, the group supplies the signed
+        // number of steps to send each sample in place of the profile
+        // generator. Stop requests made on the axis are passed back to the
+        // group so every axis in the group stops together. Steps beyond the
+        // step rate limit are carried into the following samples.
+        volatile bool m_stepsExternalActive;
+        int32_t m_stepsExternal;
+        int32_t m_stepsExternalCarry;
+        volatile ExternalStopRequests m_stepsExternalStop;
+
+        // Gantry pairing, set up by MotorManager::GantryStart(). The
+        // follower copies its leader's steps of the same sample as external
+        // steps and passes its stop requests on to the leader. Each side
+        // adds its skew, the offset of its motor from the gantry position,
+        // to the steps it sends. While squaring, a side that has found its
+        // home is held, its skew taking up the gantry's steps.
+        StepGenerator *m_gantryLeader;
+        volatile bool m_gantryOn;
+        volatile bool m_gantryHold;
+        volatile int32_t m_gantrySkew;
+        int32_t m_gantrySkewApplied;
+
+        // The count of encoder movement in the last sample, for gearing
+        volatile const int16_t *m_gearSource;
 
         volatile const bool &Direction()
         {
@@ -342,13 +1320,104 @@ namespace ClearCore
             return m_moveState;
         }
 
+        // The commanded velocity, in Qx steps per sample, signed by direction
+        int32_t VelocityCurrentQx()
+        {
+            return m_direction ? -m_velCurrentQx : m_velCurrentQx;
+        }
+
         void StepsCalculated();
 
+        // One sample of the motion profile, unscaled by the feed-rate
+        // override.
+        void ProfileStep();
+
+        // One sample of the motion profile at the feed-rate override.
+        void StepsOverridden();
+        void FeedOverrideFlush();
+
+        // Ramp the feed-rate override for a profile moving at speed steps
+        // per profile sample, and return the Q15 override to use this
+        // sample.
+        int32_t FeedOverrideRamp(int32_t speed, int32_t accelQx);
+
+        // Start the Move() and MoveVelocity() commands issued from the main
+        // loop since the last sample. Called first thing each sample, and by
+        // the commands that still block the interrupt, so commands take
+        // effect in the order they were issued.
+        void MoveCommandsTake();
+
+        void StepsExternalOutput();
+        void GantryStepsTake();
+
+        // The axis is being driven by a MotionGroup, a PVT stream, gearing,
+        // or a cam rather than by its own moves.
+        bool Following()
+        {
+            return m_stepsExternalActive || m_moveState == MS_PVT ||
+                   m_moveState == MS_GEAR || m_moveState == MS_CAM;
+        }
+
+        // Bring a position into [0, m_rotaryModulus) on a rotary axis.
+        // Positions off by no more than one revolution, as after a sample's
+        // steps, are wrapped without a divide.
+        int32_t PosnWrap(int32_t posn)
+        {
+            int32_t modulus = m_rotaryModulus;
+            if (!modulus) {
+                return posn;
+            }
+            if (posn >= modulus) {
+                posn -= modulus;
+            }
+            else if (posn < 0) {
+                posn += modulus;
+            }
+            if (posn >= 0 && posn < modulus) {
+                return posn;
+            }
+            posn %= modulus;
+            return posn < 0 ? posn + modulus : posn;
+        }
+
+        // The signed distance from posn to an absolute target, which on a
+        // rotary axis goes the way moveTarget asks, or the shortest way.
+        int32_t AbsoluteDistance(int32_t target, int32_t posn,
+                                 MoveTarget moveTarget);
+
         uint32_t StepsPrevious()
         {
             return m_stepsPrevious;
         }
 
+        // The number of steps to send this sample after compensation. Call
+        // once per sample after StepsCalculated(); the direction is always
+        // Direction().
+        uint32_t StepsCompensated();
+
+        // The number of steps to send this sample with the gantry side's
+        // skew, given the compensated steps. May change Direction() in a
+        // sample without steps while the gantry is idle.
+        uint32_t StepsGantry(uint32_t steps);
+
+        // A gantry follower is only moving while its leader is
+        bool StepsExternalMoving()
+        {
+            return m_stepsExternalActive &&
+                   (!m_gantryLeader || !m_gantryLeader->StepsComplete());
+        }
+
+        // The number of steps to send this sample after input shaping, given
+        // the compensated steps. May change Direction() while the axis is
+        // idle.
+        uint32_t StepsShaped(uint32_t steps);
+        void InputShaperFlush();
+
+        // The number of steps to send this sample after the position loop's
+        // correction, given the shaped steps. May change Direction() while
+        // the axis is idle.
+        uint32_t PositionLoopSteps(uint32_t steps);
+
         bool CheckTravelLimits();
 
         void PosLimitActive(bool isActive)
@@ -362,6 +1431,178 @@ namespace ClearCore
         }
 
     private:
+        // A positional move and the limits latched when it was queued
+        struct QueuedMove {
+            int32_t Dist;
+            MoveTarget Target;
+            int32_t VelLimitQx;
+            int32_t AccelLimitQx;
+            int32_t JerkLimitQx;
+        };
+
+        // Single-producer (main loop) single-consumer (sample rate ISR)
+        // queue of positional moves. The indices free-run and are masked
+        // with MOVE_QUEUE_LENGTH - 1.
+        QueuedMove m_moveQueue[MOVE_QUEUE_LENGTH];
+        volatile uint8_t m_moveQueueHead;
+        volatile uint8_t m_moveQueueTail;
+        bool m_moveQueueBlending;
+
+        // A PVT point with its velocity in step pulses/sample and its
+        // duration in sample times
+        struct PvtPoint {
+            int32_t Posn;
+            float Vel;
+            uint32_t Samples;
+        };
+
+        // Single-producer (main loop) single-consumer (sample rate ISR)
+        // stream of PVT points, indexed like the move queue
+        PvtPoint m_pvtQueue[PVT_QUEUE_LENGTH];
+        volatile uint8_t m_pvtQueueHead;
+        volatile uint8_t m_pvtQueueTail;
+        volatile bool m_pvtEnding;
+        volatile uint32_t m_pvtUnderflowCount;
+
+        // The PVT segment being executed. The position relative to the start
+        // of the segment is ((C3 * t + C2) * t + C1) * t, with t running from
+        // 0 to 1 over the segment.
+        bool m_pvtSegmentActive;
+        int32_t m_pvtPosnStart;
+        int32_t m_pvtPosnEnd;
+        float m_pvtVelEnd;
+        float m_pvtC1;
+        float m_pvtC2;
+        float m_pvtC3;
+        float m_pvtSampleTime;
+        uint32_t m_pvtSample;
+        uint32_t m_pvtSamples;
+
+        // Electronic gearing. The remainder is scaled by the denominator.
+        int16_t m_gearNumerator;
+        uint16_t m_gearDenominator;
+        int32_t m_gearRemainder;
+        // The last m_gearSmoothing input counts and their sum
+        int16_t m_gearHistory[GEAR_SMOOTHING_MAX];
+        int32_t m_gearHistorySum;
+        uint8_t m_gearHistoryIndex;
+        uint8_t m_gearSmoothing;
+        int32_t m_followStepsLast; // Steps sent last sample by gearing/cam
+
+        // Cam state. The cycle bases are the master and slave positions at
+        // the start of the current pass through the table; m_camIndex is the
+        // table segment found last sample, where the search starts.
+        CamTable m_cam;
+        volatile const int32_t *m_camMaster;
+        int32_t m_camMasterBase;
+        int32_t m_camSlaveBase;
+        uint16_t m_camIndex;
+
+        // Leadscrew and backlash compensation. m_compApplied is the
+        // correction that has been sent so far.
+        const CompTable *volatile m_compTable;
+        volatile int32_t m_compBacklash;
+        bool m_compLastNeg;
+        int32_t m_compApplied;
+
+        // Input shaper. The history holds the signed steps taken in over the
+        // last samples, m_shaperIndex is where this sample's go, and the
+        // impulses are m_shaperDelay samples apart with Q15 amplitudes.
+        // m_shaperFract carries the Q15 remainder of the shaped steps and
+        // m_shaperCarry the steps held back to keep the move's direction.
+        volatile bool m_shaperOn;
+        int16_t *m_shaperHistory;
+        uint16_t m_shaperLength;
+        uint16_t m_shaperIndex;
+        uint16_t m_shaperDelay;
+        uint8_t m_shaperImpulses;
+        int32_t m_shaperAmp[3];
+        int32_t m_shaperFract;
+        int32_t m_shaperCarry;
+        volatile int32_t m_shaperPending;
+
+        // Feed-rate override, in Q15 profile samples per sample. The last
+        // profile sample's steps are m_overrideSteps, with m_overrideLeftQ15
+        // of it still to run; m_overrideFract carries the Q15 remainder of
+        // the steps and m_overrideCarry the steps held back to keep the
+        // move's direction. m_overrideHeld is all the steps the profile has
+        // made that haven't been sent.
+        volatile bool m_overrideOn;
+        volatile int32_t m_overrideTargetQ15;
+        volatile int32_t m_overrideQ15;
+        int32_t m_overrideSteps;
+        int32_t m_overrideLeftQ15;
+        int32_t m_overrideFract;
+        int32_t m_overrideCarry;
+        volatile int32_t m_overrideHeld;
+
+        // Position loop. m_loopSent counts the steps to send since the loop
+        // started, before correction; the last sample's steps and correction
+        // are kept since the feedback doesn't see them yet.
+        volatile bool m_loopOn;
+        volatile bool m_loopErrorReached;
+        PositionLoop m_loop;
+        volatile const int32_t *m_loopFeedback;
+        int32_t m_loopFeedbackBase;
+        int32_t m_loopSent;
+        int32_t m_loopSentLast;
+        int32_t m_loopCorrectionLast;
+        volatile int32_t m_loopError;
+
+        // The profile of a move worked out when it starts: the command and
+        // limits it was worked out for, the ramp parameters, the target
+        // velocity and the phase the move enters.
+        struct MovePlan {
+            int32_t StepsCommanded;
+            bool DirCommanded;
+            bool VelocityMove;
+            int32_t VelLimitQx;
+            int32_t AltVelLimitQx;
+            int32_t AccelLimitQx;
+            int32_t JerkLimitQx;
+            int64_t PosnTargetQx;
+            int64_t JerkStepQx;
+            uint32_t AccelLevelMax;
+            int32_t VelTargetQx;
+            MoveStates State;
+            bool DirChange;
+            bool Direction;
+            bool DirectionOutput;
+        };
+
+        // A Move() or MoveVelocity() command on its way from the main loop
+        // to the sample rate interrupt, with the limits in effect when it
+        // was issued. A command issued to an idle axis carries its plan.
+        struct MoveCommand {
+            int32_t Value; // The distance, or the velocity
+            MoveTarget Target;
+            int32_t AltDecelLimitQx;
+            bool Planned;
+            uint32_t PlanEpoch;
+            MovePlan Plan;
+        };
+
+        // Single-producer (main loop) single-consumer (sample rate ISR)
+        // mailbox of commands, so issuing a move never blocks interrupts.
+        // The indices free-run and are masked with MOVE_COMMAND_LENGTH - 1.
+        MoveCommand m_moveCommands[MOVE_COMMAND_LENGTH];
+        volatile uint8_t m_moveCommandHead;
+        volatile uint8_t m_moveCommandTail;
+
+        // The plan of the move being started, if it was made in the main
+        // loop
+        MovePlan m_movePlan;
+        bool m_movePlanReady;
+        // Counts the samples the axis wasn't idle, so a plan made while it
+        // was idle can be checked to still hold when the command is taken
+        volatile uint32_t m_movePlanEpoch;
+
+        // A move waiting for MotorManager to start it
+        volatile bool m_staged;
+        bool m_stagedVelocity;
+        int32_t m_stagedValue;
+        MoveTarget m_stagedTarget;
+
         int32_t m_stepsCommanded;
         int32_t m_stepsSent; // Accumulated integer position
 
@@ -385,18 +1626,160 @@ namespace ClearCore
         int32_t m_velTargetQx;     // Adjusted velocity limit
         int64_t m_posnDecelQx;     // Position to start decelerating
 
+        // Jerk-limited profile state. The jerk is kept with JERK_FRACT_BITS
+        // additional fractional bits, since realistic jerk values are far
+        // below one Q-format LSB per sample^3. The acceleration of an S-curve
+        // move is always a whole number of jerk increments (the accel level).
+        int32_t m_jerkLimitQx;     // Jerk limit (extended Q), 0 = trapezoid
+        int64_t m_jerkStepQx;      // Accel increment per level (extended Q)
+        uint32_t m_accelLevel;     // Current accel level
+        uint32_t m_accelLevelMax;  // Accel level that reaches the accel limit
+        uint32_t m_velFractQx;     // Sub-LSB velocity carried between samples
+
         // Pending velocity and acceleration parameters that shouldn't be applied
         // until a Move function is called again
         int32_t m_velLimitPendingQx;      // Velocity limit
         int32_t m_altVelLimitPendingQx;   // Velocity move Velocity limit
         int32_t m_accelLimitPendingQx;    // Acceleration limit
         int32_t m_altDecelLimitPendingQx; // E-Stop Deceleration limit
+        int32_t m_jerkLimitPendingQx;     // Jerk limit
 
         virtual void OutputDirection() = 0;
         void StepsPerSampleMaxSet(uint32_t maxSteps);
 
         void AltVelMax(int32_t velMax);
 
+        /**
+            \brief Private helper that sets up the step counts for a new
+            positional move. The caller must keep the sample rate interrupt
+            from running and set the move limits and state.
+        **/
+        void MoveLatch(int32_t dist, MoveTarget moveTarget);
+
+        /**
+            \brief Private helper that works out the step count and direction
+            MoveLatch() would latch for a positional move, without latching
+            it.
+        **/
+        void MoveLatchSteps(int32_t dist, MoveTarget moveTarget,
+                            int32_t &steps, bool &dir);
+
+        /**
+            \brief Private helper that shortens a signed move distance from the
+            current position so the move ends within the software limits.
+        **/
+        int32_t SoftLimitClamp(int32_t dist);
+
+        /**
+            \brief Private helper, called each sample, that turns a move
+            heading past a software limit into a stop at the limit.
+        **/
+        void SoftLimitsCheck();
+
+        /**
+            \brief Private helper that works out the plan of a move from its
+            command and limits and the current velocity, position and
+            direction.
+        **/
+        void MovePlanCompute(MovePlan &plan)
+        {
+            MovePlanCompute(plan, m_velCurrentQx, m_posnCurrentQx,
+                            m_direction);
+        }
+
+        /**
+            \brief Private helper that works out the plan of a move from the
+            given velocity, position and direction.
+        **/
+        void MovePlanCompute(MovePlan &plan, int32_t velQx, int64_t posnQx,
+                             bool direction);
+
+        /**
+            \brief Private helper that adds the phases of a planned move
+            started at the given velocity and position to a preview.
+        **/
+        static void MovePreviewPhases(const MovePlan &plan, int32_t velQx,
+                                      int64_t posnQx, MovePreviewInfo &info);
+
+        /**
+            \brief Private helper that computes the samples a velocity ramp
+            takes with a plan's limits.
+        **/
+        static float RampSamples(float velChangeQx, const MovePlan &plan);
+
+        /**
+            \brief Private helper, called at the sample rate, that starts a
+            move from its plan.
+        **/
+        void MovePlanApply(const MovePlan &plan);
+
+        /**
+            \brief Private helper that fills in a command's limits from the
+            pending limits, and plans it if the axis is idle with nothing
+            waiting ahead of it.
+        **/
+        void MoveCommandPrepare(MoveCommand &command, bool velocityMove);
+
+        /**
+            \brief Private helper that passes a command to the interrupt. From
+            an interrupt handler, or with the mailbox full, the command is
+            applied right away with the interrupt blocked instead.
+        **/
+        void MoveCommandIssue(const MoveCommand &command);
+
+        /**
+            \brief Private helper that latches a command and its limits and
+            starts the move. The caller must keep the sample rate interrupt
+            from running.
+        **/
+        void MoveCommandApply(const MoveCommand &command);
+
+        /**
+            \brief Private helper, called at the sample rate, that starts the
+            next queued move when the active move finishes, or merges it into
+            the active move when blending.
+        **/
+        void MoveQueueService();
+
+        /**
+            \brief Private helper, called at the sample rate, that steps
+            along the PVT stream.
+        **/
+        void PvtStep();
+
+        /**
+            \brief Private helper that leaves PVT mode by ramping the current
+            PVT velocity down to zero. The caller must keep the sample rate
+            interrupt from running.
+        **/
+        void PvtStopDecel();
+
+        /**
+            \brief Private helper, called at the sample rate, that sends the
+            geared encoder motion.
+        **/
+        void GearStep();
+
+        /**
+            \brief Private helper, called at the sample rate, that moves the
+            slave to the cam position for the master position.
+        **/
+        void CamStep();
+
+        /**
+            \brief Private helper that ramps from a velocity produced outside
+            of the profile generator (in step pulses/sample, signed) down to
+            zero. The caller must keep the sample rate interrupt from running.
+        **/
+        void StopDecelFrom(float vel);
+
+        /**
+            \brief Private helper, called by MotorManager at the sample rate,
+            that starts the staged move through the virtual Move() or
+            MoveVelocity().
+        **/
+        void MoveStagedStart();
+
         /**
             \brief Private helper function for Move functions to call that
             updates the internal vel/accel limits to those set by the user.
@@ -410,7 +1793,49 @@ namespace ClearCore
             m_altVelLimitQx = m_altVelLimitPendingQx;
             m_accelLimitQx = m_accelLimitPendingQx;
             m_altDecelLimitQx = m_altDecelLimitPendingQx;
+            m_jerkLimitQx = m_jerkLimitPendingQx;
         }
+
+        /**
+            \brief Private helper that computes the distance needed to stop
+            from the given velocity with the current move's limits.
+
+            Accounts for the acceleration ramps when jerk limiting is active.
+        **/
+        int64_t StopDistanceQx(int32_t velQx)
+        {
+            return StopDistanceQx(velQx, m_accelLimitQx, m_jerkLimitQx,
+                                  m_jerkStepQx, m_accelLevelMax);
+        }
+
+        /**
+            \brief Private helper that computes the distance needed to stop
+            from the given velocity with the given limits.
+        **/
+        static int64_t StopDistanceQx(int32_t velQx, int32_t accelLimitQx,
+                                      int32_t jerkLimitQx, int64_t jerkStepQx,
+                                      uint32_t accelLevelMax);
+
+        /**
+            \brief Private helper that computes the jerk-limited peak velocity
+            for a positional move that is too short to reach the velocity
+            limit.
+        **/
+        static int32_t SCurvePeakVelocityQx(int64_t distQx,
+                                            const MovePlan &plan);
+
+        /**
+            \brief Private helper that advances one sample of a jerk-limited
+            velocity ramp.
+
+            Picks the next accel level so the acceleration returns to zero as
+            the velocity reaches its target, then integrates the position and
+            velocity.
+
+            \param[in] velRemainingQx The velocity change still to be made.
+            \param[in] increasing True when ramping the velocity up.
+        **/
+        void SCurveRampStep(int32_t velRemainingQx, bool increasing);
     };
 
 } // ClearCore namespace
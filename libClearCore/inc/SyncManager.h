@@ -0,0 +1,247 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    \file SyncManager.h
+    \brief ClearCore multi-board sample tick synchronization.
+
+    Phase-locks the sample rate interrupts of several ClearCores to a sync
+    pulse wired from one board to the others.
+**/
+
+#ifndef __SYNCMANAGER_H__
+#define __SYNCMANAGER_H__
+
+#include <stdint.h>
+#include "DigitalIn.h"
+#include "DigitalInOut.h"
+
+namespace ClearCore {
+
+/// The number of samples between sync pulses
+#ifndef SAMPLE_SYNC_PERIOD_SAMPLES
+#define SAMPLE_SYNC_PERIOD_SAMPLES 10
+#endif
+
+/// The most a slave lengthens or shortens one sample, in sample timer counts
+#ifndef SAMPLE_SYNC_TRIM_MAX
+#define SAMPLE_SYNC_TRIM_MAX 1
+#endif
+
+/// The phase error a slave must stay within to count as locked, in sample
+/// timer counts
+#ifndef SAMPLE_SYNC_LOCK_COUNTS
+#define SAMPLE_SYNC_LOCK_COUNTS 2
+#endif
+
+/// The number of sync pulses in a row within #SAMPLE_SYNC_LOCK_COUNTS needed
+/// to lock
+#ifndef SAMPLE_SYNC_LOCK_EDGES
+#define SAMPLE_SYNC_LOCK_EDGES 8
+#endif
+
+/// A slave that misses sync pulses for this many periods unlocks and holds
+/// its last rate
+#ifndef SAMPLE_SYNC_TIMEOUT_PERIODS
+#define SAMPLE_SYNC_TIMEOUT_PERIODS 4
+#endif
+
+/**
+    \class SyncManager
+    \brief ClearCore multi-board sample tick synchronization.
+
+    Each ClearCore's sample rate interrupt is timed by its own crystal, so
+    the samples of cooperating boards slowly drift apart. One board is made
+    the sync master: it drives a pulse on a digital output at the start of
+    every #SAMPLE_SYNC_PERIOD_SAMPLES samples. The other boards are sync
+    slaves: the pulse, wired to an interrupt-capable input, interrupts them
+    and they read how far into their own sample it arrived. Each slave then
+    lengthens or shortens its samples by up to #SAMPLE_SYNC_TRIM_MAX counts
+    of the sample timer to pull that phase error to zero and to match the
+    master's rate.
+
+    Once locked, every board starts its samples together, to within a
+    couple of sample timer counts plus the difference in interrupt latency
+    between boards. Moves started on the same sample then stay aligned, and
+    timestamps kept in samples advance together on every board, without
+    PTP.
+
+    The sample timer also times the step and PWM outputs of the motor
+    connectors (see MotorManager::MotorInputClocking()), so a count is one
+    period of the motor input clock. While a slave trims its samples, the
+    step rate limit of each motor is lowered by #SAMPLE_SYNC_TRIM_MAX steps
+    per sample so a shortened sample still fits every step. Set the motor
+    input clocking before starting synchronization.
+
+    \code{.cpp}
+    // On the master board, wired IO-1 to the slaves' DI-6
+    ConnectorIO1.Mode(Connector::OUTPUT_DIGITAL);
+    SyncMgr.MasterStart(ConnectorIO1);
+
+    // On each slave board
+    SyncMgr.SlaveStart(ConnectorDI6);
+    while (!SyncMgr.Locked()) {
+        continue;
+    }
+    \endcode
+**/
+class SyncManager {
+    friend class SysManager;
+
+public:
+    /**
+        \enum SyncModes
+        \brief The role of this board in sample synchronization.
+    **/
+    typedef enum {
+        /// Not synchronizing
+        SYNC_OFF,
+        /// Driving the sync pulse
+        SYNC_MASTER,
+        /// Following the sync pulse
+        SYNC_SLAVE,
+    } SyncModes;
+
+#ifndef HIDE_FROM_DOXYGEN
+    /**
+        Public accessor for singleton instance.
+    **/
+    static SyncManager &Instance();
+#endif
+
+    /**
+        \brief Drive the sync pulse on a digital output.
+
+        The output is asserted for the first sample of every
+        #SAMPLE_SYNC_PERIOD_SAMPLES, set as early in the sample rate
+        interrupt as possible.
+
+        \code{.cpp}
+        ConnectorIO1.Mode(Connector::OUTPUT_DIGITAL);
+        SyncMgr.MasterStart(ConnectorIO1);
+        \endcode
+
+        \param[in] output The output wired to the slaves. It must already be
+        in Connector::OUTPUT_DIGITAL mode.
+
+        \return True if the board is now the sync master.
+    **/
+    bool MasterStart(DigitalInOut &output);
+
+    /**
+        \brief Follow the sync pulse on an interrupt-capable input.
+
+        Takes the input's external interrupt for the pulse's rising edge and
+        runs it above the sample rate interrupt.
+
+        \code{.cpp}
+        SyncMgr.SlaveStart(ConnectorDI6);
+        \endcode
+
+        \param[in] input The input wired to the master.
+
+        \return True if the board is now a sync slave; false if the input
+        has no external interrupt.
+    **/
+    bool SlaveStart(DigitalIn &input);
+
+    /**
+        \brief Stop synchronizing.
+
+        A slave returns to its nominal sample period and releases the input's
+        interrupt; a master deasserts its output.
+    **/
+    void Stop();
+
+    /**
+        \brief The role of this board in sample synchronization.
+    **/
+    SyncModes Mode() {
+        return m_mode;
+    }
+
+    /**
+        \brief Check whether a slave is phase-locked to the master.
+
+        \return True if the last #SAMPLE_SYNC_LOCK_EDGES sync pulses arrived
+        within #SAMPLE_SYNC_LOCK_COUNTS of the start of a sample.
+    **/
+    bool Locked() {
+        return m_locked;
+    }
+
+    /**
+        \brief The phase error at the last sync pulse.
+
+        \return How far into the slave's sample the pulse arrived, in sample
+        timer counts; negative if the pulse arrived before the sample began.
+    **/
+    int32_t PhaseError() {
+        return m_phaseError;
+    }
+
+    /**
+        \brief The rate correction a slave applies to match the master.
+
+        \return The change to the sample period, in parts per million.
+        Positive values lengthen the slave's samples.
+    **/
+    float RateTrimPpm();
+
+private:
+    volatile SyncModes m_mode;
+    DigitalInOut *m_output;
+    DigitalIn *m_input;
+    int8_t m_extInt;
+    // Samples into the master's sync period
+    uint16_t m_sampleCount;
+    uint16_t m_samplesSinceEdge;
+    volatile int32_t m_phaseError;
+    // Slave period corrections in sample timer counts per sample, Q16
+    int32_t m_rateQ16;
+    volatile int32_t m_trimQ16;
+    int32_t m_trimAccQ16;
+    uint8_t m_lockEdges;
+    volatile bool m_locked;
+
+    /**
+        Construct
+    **/
+    SyncManager();
+
+    /**
+        Drive the master's pulse or trim the slave's next sample. Called at
+        the start of the sample rate interrupt.
+    **/
+    void Update();
+
+    /**
+        Measure the phase of a sync pulse and update the slave's trim.
+    **/
+    void Edge();
+
+    static void EdgeIsr();
+}; // SyncManager
+
+} // ClearCore namespace
+
+#endif // __SYNCMANAGER_H__
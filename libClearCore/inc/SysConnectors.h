@@ -151,8 +151,20 @@ typedef enum {
     CLEARCORE_PIN_CCIOH6,   ///< CCIO-8 board 8, connector 6
     CLEARCORE_PIN_CCIOH7,   ///< CCIO-8 board 8, connector 7
     CLEARCORE_PIN_CCIO_MAX,
+    // CCIO-8 Pins of the second chain, see CLEARCORE_PIN_CCIO1()
+    /// [128] Base index of the second chain's CCIO-8 connectors
+    CLEARCORE_PIN_CCIO1_BASE = CLEARCORE_PIN_CCIO_MAX,
+    /// End of the second chain's CCIO-8 connectors
+    CLEARCORE_PIN_CCIO1_MAX = CLEARCORE_PIN_CCIO1_BASE + 64,
 } ClearCorePins;
 
+/**
+    Connector \a n (0 to 63; board \a n / 8, connector \a n % 8) of the
+    CCIO-8 chain managed by CcioMgr1.
+**/
+#define CLEARCORE_PIN_CCIO1(n) \
+    ((ClearCorePins)(CLEARCORE_PIN_CCIO1_BASE + (n)))
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
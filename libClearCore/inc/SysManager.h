@@ -50,6 +50,16 @@ namespace ClearCore {
 typedef void (*voidFuncPtr)(void);
 #endif
 
+/// Set to 0 to finish the LED sweep and the Ethernet PHY initialization
+/// before the application starts, as older releases did
+#ifndef CLEARCORE_FAST_BOOT
+#define CLEARCORE_FAST_BOOT 1
+#endif
+
+/// The time the Ethernet PHY needs after power-up before it can be
+/// configured, in microseconds (300 us + 10 ms)
+#define PHY_COLD_START_US 10300
+
 /**
     \brief ClearCore Board Supervisory System Manager
 
@@ -73,6 +83,28 @@ public:
         RESET_TO_BOOTLOADER,
     } ResetModes;
 
+    /**
+        \enum BootStages
+        \brief The stages of start-up timed by BootStageUs().
+    **/
+    typedef enum {
+        /// Clocks, flash cache, brownout detection, and H-Bridge reset
+        BOOT_STAGE_CLOCKS,
+        /// The input manager and the connectors
+        BOOT_STAGE_CONNECTORS,
+        /// DMA, motors, shift register, ADC, CCIO-8, USB, and encoder input
+        BOOT_STAGE_PERIPHERALS,
+        /// Interrupt controllers and the SysTick
+        BOOT_STAGE_INTERRUPTS,
+        /// Power-on status checks and the LED sweep
+        BOOT_STAGE_STATUS,
+        /// The Ethernet MAC
+        BOOT_STAGE_ETHERNET,
+        /// The Ethernet PHY, including the wait for its cold start
+        BOOT_STAGE_PHY,
+        BOOT_STAGE_COUNT,
+    } BootStages;
+
 #ifndef HIDE_FROM_DOXYGEN
     /**
         Constructor
@@ -93,6 +125,16 @@ public:
     bool Ready() {
         return m_readyForOperations;
     }
+
+    /**
+        Add a connector to, or drop it from, the connectors refreshed at
+        the sample rate. Connectors are added as the application configures
+        them; the change takes effect at the next sample.
+
+        \param[in] pin The connector.
+        \param[in] active True to refresh the connector.
+    **/
+    void ConnectorActive(ClearCorePins pin, bool active);
 #endif
 
     /**
@@ -124,17 +166,65 @@ public:
     **/
     void ResetBoard(ResetModes mode = RESET_NORMAL);
 
+    /**
+        \brief How long a stage of start-up took.
+
+        With #CLEARCORE_FAST_BOOT set, the LED sweep runs in the background
+        after start-up, and the Ethernet PHY is configured by the SysTick
+        update once its cold start time has passed, so the application
+        starts without waiting for either. BOOT_STAGE_PHY then spans from
+        the end of the Ethernet stage until the PHY is configured.
+
+        \code{.cpp}
+        for (uint8_t i = 0; i < SysManager::BOOT_STAGE_COUNT; i++) {
+            ConnectorUsb.Send(i);
+            ConnectorUsb.Send(": ");
+            ConnectorUsb.SendLine(
+                SysMgr.BootStageUs(static_cast<SysManager::BootStages>(i)));
+        }
+        \endcode
+
+        \param[in] stage The stage of start-up.
+
+        \return The duration of the stage, in microseconds, or 0 if it has
+        not finished.
+    **/
+    uint32_t BootStageUs(BootStages stage);
+
+    /**
+        \brief The time from the start of initialization until the board was
+        ready for the application, in microseconds.
+    **/
+    uint32_t BootReadyUs() {
+        return m_bootReadyUs;
+    }
+
 #ifndef HIDE_FROM_DOXYGEN
     // Ideally these would be private, but they need to be called from C
     // interrupt handler functions that can't be friends without putting them
     // in a namespace.
     void SysTickUpdate();
     void FastUpdate();
+    void DeferredUpdate();
 #endif
 
 private:
     /// Flag to defer operations until initialized.
     bool m_readyForOperations;
+    /// Samples until the next LED pattern update.
+    uint16_t m_ledUpdateCnt;
+    /// When each stage of start-up finished, in microseconds.
+    volatile uint32_t m_bootStageEndUs[BOOT_STAGE_COUNT];
+    uint32_t m_bootReadyUs;
+    /// Set while the PHY waits to be configured by the SysTick update.
+    bool m_phyInitPending;
+    /// The configured connectors, as a mask of ClearCorePins.
+    volatile uint32_t m_connectorsActive;
+
+    /**
+        Record the end of a stage of start-up.
+    **/
+    void BootStageEnd(BootStages stage);
 
     /**
         Initialize the clock rates and interrupts.
@@ -146,11 +236,35 @@ private:
     **/
     void UpdateFastImpl();
 
+    /**
+        Update housekeeping systems at #SampleRateHz, at a lower priority
+        than the real-time fast update.
+    **/
+    void UpdateDeferredImpl();
+
     /**
         Update systems at SysTick rate.
     **/
     void UpdateSlowImpl();
 
+    /**
+        Refresh the configured connectors. Each entry of the active list is
+        dispatched to a direct call to the connector's own Refresh(). The
+        inputs still in their default digital mode are only updated when
+        their filters settle.
+    **/
+    void ConnectorsRefresh();
+
+    /**
+        Call a connector's own Refresh() directly rather than through the
+        Connector vtable, so the call is a plain branch the compiler can
+        inline.
+    **/
+    template<class T>
+    static void ConnectorRefresh(T &connector) {
+        connector.T::Refresh();
+    }
+
 };     // SysManager
 
 } // ClearCore namespace
@@ -38,15 +38,49 @@
 
 /**
     ClearCore sample rate for main interrupt processing (5 kHz).
+
+    May be defined for the whole build (library and application) as a whole
+    number of kHz from 1 kHz to 10 kHz. Time-based settings throughout the
+    library (filters, LED patterns, CCIO-8 timing, motor step rates) follow
+    the sample rate; settings given in samples do not.
 **/
 #ifndef _CLEARCORE_SAMPLE_RATE_HZ
 #define _CLEARCORE_SAMPLE_RATE_HZ (5000)
 #endif
 
+#if (_CLEARCORE_SAMPLE_RATE_HZ % 1000) != 0
+#error "_CLEARCORE_SAMPLE_RATE_HZ must be a whole number of kHz"
+#endif
+#if _CLEARCORE_SAMPLE_RATE_HZ < 1000 || _CLEARCORE_SAMPLE_RATE_HZ > 10000
+#error "_CLEARCORE_SAMPLE_RATE_HZ must be from 1 kHz to 10 kHz"
+#endif
+#if (CPU_CLK % _CLEARCORE_SAMPLE_RATE_HZ) != 0
+#error "_CLEARCORE_SAMPLE_RATE_HZ must divide CPU_CLK evenly"
+#endif
+
 /**
-    ClearCore sample rate, expressed in sample times (5).
+    Number of sample times per millisecond (5).
 **/
 #define MS_TO_SAMPLES (_CLEARCORE_SAMPLE_RATE_HZ / 1000)
+/**
+    Rate of the LED pattern and blink code update (100 Hz). The pattern
+    envelopes and blink code sequencing run at this rate; only the LED
+    dimming runs at the sample rate.
+**/
+#ifndef LED_UPDATE_RATE_HZ
+#define LED_UPDATE_RATE_HZ (100)
+#endif
+#if (_CLEARCORE_SAMPLE_RATE_HZ % LED_UPDATE_RATE_HZ) != 0
+#error "LED_UPDATE_RATE_HZ must divide _CLEARCORE_SAMPLE_RATE_HZ evenly"
+#endif
+/**
+    Number of sample times per LED update (50).
+**/
+#define LED_UPDATE_SAMPLES (_CLEARCORE_SAMPLE_RATE_HZ / LED_UPDATE_RATE_HZ)
+/**
+    Convert milliseconds to LED updates.
+**/
+#define MS_TO_LED_UPDATES(ms) ((ms) * LED_UPDATE_RATE_HZ / 1000)
 /**
     Number of CPU cycles per interrupt time (24,000).
 **/
@@ -68,13 +102,55 @@
 **/
 #define CYCLES_PER_SECOND      (CPU_CLK)
 
+/**
+    Set to 1 to measure the cycles spent in each stage of the sample rate and
+    SysTick updates, and the latency and duration of the sample rate
+    interrupt. See SysTiming::IsrStageGet() and SysTiming::IsrReport().
+**/
+#ifndef CLEARCORE_ISR_PROFILE
+#define CLEARCORE_ISR_PROFILE 0
+#endif
+
+/**
+    Set to 1 to run the sample rate update and the hot paths under it from
+    RAM, along with their lookup tables. RAM has no wait states and never
+    misses in the cache, so the update time no longer depends on what else
+    has run. Costs a few KB of RAM. Compare the IsrStageGet() and
+    SysTiming::IsrMaxCycles() results of builds with and without it.
+**/
+#ifndef CLEARCORE_ISR_IN_RAM
+#define CLEARCORE_ISR_IN_RAM 0
+#endif
+
+#if CLEARCORE_ISR_IN_RAM
+// Copied to RAM with the initialized data at start-up by the linker script.
+// Calls between RAM and flash go through linker-generated veneers.
+#define ISR_RAMFUNC __attribute__((section(".ramfunc"), noinline))
+#define ISR_RAMDATA __attribute__((section(".ramdata")))
+#else
+#define ISR_RAMFUNC
+#define ISR_RAMDATA
+#endif
+
+/**
+    Number of log2 histogram bins kept for each profiled update stage (16).
+**/
+#define ISR_STAGE_HIST_BINS 16
+
+/**
+    Number of log2 histogram bins kept for the main loop iteration time (24).
+**/
+#define LOOP_HIST_BINS 24
 
 
 namespace ClearCore {
 
+class ISerial;
+
 /** Refresh rate of ClearCore background processing.
     \note The refresh rate is 5 kHz, so the refresh occurs once every 200
-    microseconds.
+    microseconds, unless the library is built with a different
+    _CLEARCORE_SAMPLE_RATE_HZ.
  **/
 const uint16_t SampleRateHz = _CLEARCORE_SAMPLE_RATE_HZ;
 
@@ -85,9 +161,125 @@ const uint16_t SampleRateHz = _CLEARCORE_SAMPLE_RATE_HZ;
     This class provides an interface for various timing-related operations.
 **/
 class SysTiming {
+    friend class CrashManager;
     friend class SysManager;
+    friend class MotorDriver;
+    friend class SyncManager;
 
 public:
+#if CLEARCORE_ISR_PROFILE
+    /**
+        \brief The profiled stages of the sample rate and SysTick updates.
+    **/
+    typedef enum {
+        ISR_STAGE_CCIO,         ///< CCIO-8 refresh
+        ISR_STAGE_ADC,          ///< ADC update
+        ISR_STAGE_STATUS,       ///< Status register refresh
+        ISR_STAGE_USB,          ///< USB refresh (deferred)
+        ISR_STAGE_INPUT_BEGIN,  ///< Input manager update start
+        ISR_STAGE_ENCODER,      ///< Encoder input update
+        ISR_STAGE_PID,          ///< PID process loops
+        ISR_STAGE_MOTOR_MGR,    ///< Motor manager refresh (groups, commits)
+        ISR_STAGE_CONNECTORS,   ///< Connector refresh loop
+        ISR_STAGE_INPUT_END,    ///< Input manager update end
+        ISR_STAGE_LOGIC,        ///< Logic engine evaluation
+        ISR_STAGE_PROC_IMAGE,   ///< Process image outputs and input latch
+        ISR_STAGE_DATA_LOG,     ///< Data logger sample
+        ISR_STAGE_SCOPE,        ///< Scope capture record
+        ISR_STAGE_SNAPSHOT,     ///< Motor state snapshot publish
+        ISR_STAGE_SHIFT_REG,    ///< Shift register update (deferred)
+        ISR_STAGE_TIMING,       ///< Timing update
+        ISR_STAGE_CCIO_SLOW,    ///< CCIO-8 auto-rediscovery (SysTick)
+        ISR_STAGE_MOTORS_SLOW,  ///< Motor connector slow refresh (SysTick)
+        ISR_STAGE_COUNT,        // Keep at end
+    } IsrStages;
+
+    /**
+        \brief Cycle statistics for one profiled update stage.
+    **/
+    typedef struct {
+        /// The fewest cycles the stage took
+        uint32_t MinCycles;
+        /// The most cycles the stage took
+        uint32_t MaxCycles;
+        /// The number of times the stage ran
+        uint32_t Count;
+        /// The total cycles of every run; divide by Count for the mean
+        uint64_t TotalCycles;
+        /// Histogram[0] counts runs of 0 cycles; Histogram[n] counts runs of
+        /// 2^(n-1) to 2^n - 1 cycles. The last bin also counts longer runs.
+        uint32_t Histogram[ISR_STAGE_HIST_BINS];
+    } IsrStageStats;
+
+    /**
+        \brief Read the cycle statistics of an update stage.
+
+        The statistics of the stage are reset after they are read.
+
+        \code{.cpp}
+        SysTiming::IsrStageStats stats;
+        TimingMgr.IsrStageGet(SysTiming::ISR_STAGE_CONNECTORS, stats);
+        if (stats.Count) {
+            uint32_t meanCycles = stats.TotalCycles / stats.Count;
+        }
+        \endcode
+
+        \param[in] stage The stage to read.
+        \param[out] stats The statistics gathered since the last read.
+
+        \note Only available when built with CLEARCORE_ISR_PROFILE set to 1.
+    **/
+    void IsrStageGet(IsrStages stage, IsrStageStats &stats);
+
+    /**
+        \brief Read the start latency statistics of the sample rate
+        interrupt.
+
+        The latency is the time from the TCC0 overflow that requests the
+        interrupt to the start of SysManager's fast update, in CPU cycles.
+        Interrupts of higher priority and code that disables interrupts
+        delay it. The statistics are reset after they are read.
+
+        \param[out] stats The statistics gathered since the last read.
+
+        \note Only available when built with CLEARCORE_ISR_PROFILE set to 1.
+    **/
+    void IsrLatencyGet(IsrStageStats &stats);
+
+    /**
+        \brief Read the duration statistics of the sample rate interrupt,
+        in CPU cycles.
+
+        The statistics are reset after they are read.
+
+        \param[out] stats The statistics gathered since the last read.
+
+        \note Only available when built with CLEARCORE_ISR_PROFILE set to 1.
+    **/
+    void IsrDurationGet(IsrStageStats &stats);
+
+    /**
+        \brief Write the latency and duration histograms of the sample rate
+        interrupt to a serial port.
+
+        Each line is a histogram bin's lower bound in cycles and its count.
+        The statistics are reset after they are written.
+
+        \code{.cpp}
+        // Print a jitter report every 10 seconds
+        if (Milliseconds() - lastReport > 10000) {
+            lastReport = Milliseconds();
+            TimingMgr.IsrReport(ConnectorUsb);
+        }
+        \endcode
+
+        \param[in] port Where to write the report.
+
+        \note Only available when built with CLEARCORE_ISR_PROFILE set to 1.
+    **/
+    void IsrReport(ISerial &port);
+#endif
+
 #ifndef HIDE_FROM_DOXYGEN
     /**
         \brief Return the minimum and maximum fast interrupt duration cycles
@@ -143,6 +335,41 @@ public:
     **/
     void ResetMicroseconds();
 
+    /**
+        \brief Number of CPU cycles elapsed since the ClearCore was
+        initialized, as a 64-bit count that does not roll over.
+
+        The processor's 32-bit cycle counter is extended with an epoch kept
+        by the sample rate interrupt. Reading it takes no lock and is safe
+        from any interrupt priority.
+
+        \code{.cpp}
+        uint64_t start = TimingMgr.Cycles64();
+        DoWork();
+        uint64_t workCycles = TimingMgr.Cycles64() - start;
+        \endcode
+
+        \return Number of CPU cycles since board initialization.
+
+        \note ResetMicroseconds() moves this count forward, never back.
+    **/
+    uint64_t Cycles64();
+
+    /**
+        \brief Number of microseconds elapsed since the ClearCore was
+        initialized, as a 64-bit count that does not roll over.
+
+        Converted from Cycles64() with a multiply and shift rather than a
+        division, so it takes the same time for every count.
+
+        \code{.cpp}
+        uint64_t stamp = TimingMgr.Microseconds64();
+        \endcode
+
+        \return Number of microseconds since board initialization.
+    **/
+    uint64_t Microseconds64();
+
     /**
         \brief Number of milliseconds elapsed since the ClearCore was
         initialized.
@@ -181,6 +408,224 @@ public:
     **/
     void ResetMilliseconds();
 
+    /**
+        \brief How the CPU's time was shared over a measurement window.
+    **/
+    typedef struct {
+        /// The length of the window, in milliseconds
+        uint32_t WindowMs;
+        /// The share spent in the sample rate and deferred updates, in
+        /// tenths of a percent
+        uint16_t IsrPermille;
+        /// The share spent running the main loop and the other interrupts,
+        /// in tenths of a percent
+        uint16_t BusyPermille;
+        /// The share spent asleep in CpuSleep(), in tenths of a percent
+        uint16_t IdlePermille;
+    } CpuLoad;
+
+    /**
+        \brief Sleep until the next interrupt.
+
+        Executes WFI, so the core stops until an interrupt is pending; the
+        sample rate interrupt wakes it at least every sample. The time asleep
+        is counted as idle by CpuLoadGet(). The cycle counter stops while the
+        core sleeps, so the time asleep is measured with the sample rate
+        timer and added back to the cycle counter, keeping Microseconds()
+        and Cycles64() running.
+
+        To avoid sleeping through work that an interrupt has just flagged,
+        check for the work with interrupts disabled, and call CpuSleep()
+        before enabling them again. Pending interrupts still wake the core,
+        and their handlers run once interrupts are enabled.
+
+        \code{.cpp}
+        while (true) {
+            __disable_irq();
+            if (!dataReady) {
+                TimingMgr.CpuSleep();
+            }
+            __enable_irq();
+            ...
+        }
+        \endcode
+
+        \note TaskManager::Run() calls this when no task was ready, once
+        TaskManager::IdleSleep() is enabled.
+    **/
+    void CpuSleep();
+
+    /**
+        \brief Measure how the CPU's time was shared since the last call.
+
+        \code{.cpp}
+        SysTiming::CpuLoad load;
+        TimingMgr.CpuLoadGet(load);
+        if (load.IdlePermille < 100) {
+            // Less than 10% of the CPU is left
+        }
+        \endcode
+
+        \param[out] load The shares of the CPU's time.
+        \param[in] reset True to start a new window after reading.
+
+        \note Only time spent in CpuSleep() counts as idle, so a main loop
+        that never sleeps shows as fully busy.
+        \note Other interrupts, such as serial, USB, and Ethernet, count as
+        busy.
+    **/
+    void CpuLoadGet(CpuLoad &load, bool reset = true);
+
+    /**
+        \brief The library calls that can hold up the main loop, named by the
+        markers inside them.
+    **/
+    typedef enum {
+        LOOP_BLOCK_NONE,        ///< Not in a marked call
+        LOOP_BLOCK_DHCP,        ///< EthernetManager::DhcpBegin()
+        LOOP_BLOCK_TCP_CONNECT, ///< EthernetTcpClient::Connect()
+        LOOP_BLOCK_NVM_WRITE,   ///< Waiting on an NVM page write
+        LOOP_BLOCK_SERIAL_TX,   ///< A COM port waiting for transmit room
+        LOOP_BLOCK_USB_TX,      ///< A USB serial port waiting for room
+        LOOP_BLOCK_COUNT,       // Keep at end
+    } LoopBlockers;
+
+    /**
+        \brief Main loop iteration time statistics.
+    **/
+    typedef struct {
+        /// The shortest iteration, in microseconds
+        uint32_t MinUs;
+        /// The longest iteration, in microseconds
+        uint32_t MaxUs;
+        /// The number of iterations
+        uint32_t Count;
+        /// The total time of every iteration; divide by Count for the mean
+        uint64_t TotalUs;
+        /// Histogram[0] counts iterations of 0 us; Histogram[n] counts
+        /// iterations of 2^(n-1) to 2^n - 1 us. The last bin also counts
+        /// longer iterations.
+        uint32_t Histogram[LOOP_HIST_BINS];
+        /// The number of iterations longer than LoopStallThreshold()
+        uint32_t Stalls;
+        /// The marked call that took longest in the longest iteration
+        LoopBlockers MaxBlocker;
+        /// The time MaxBlocker took, in microseconds
+        uint32_t MaxBlockerUs;
+    } LoopStats;
+
+    /**
+        \brief Names a blocking library call for the main loop statistics
+        while it is in scope.
+
+        The library marks its known blocking calls with these; an
+        application can mark its own with a LoopBlockers value past
+        #LOOP_BLOCK_COUNT. Markers made from an interrupt are ignored.
+
+        \code{.cpp}
+        {
+            SysTiming::LoopBlockMarker marker(SysTiming::LOOP_BLOCK_DHCP);
+            // ...the blocking work...
+        }
+        \endcode
+    **/
+    class LoopBlockMarker {
+    public:
+        /**
+            \brief Enter a blocking call.
+        **/
+        explicit LoopBlockMarker(LoopBlockers blocker);
+        /**
+            \brief Leave the blocking call.
+        **/
+        ~LoopBlockMarker();
+    private:
+        LoopBlockers m_blocker;
+        LoopBlockers m_prev;
+        uint32_t m_startUs;
+        bool m_active;
+    };
+
+    /**
+        \brief Mark the start of a main loop iteration.
+
+        Call once per iteration, such as at the top of loop(). The time from
+        each call to the next is added to the LoopStatsGet() statistics,
+        along with the marked library call that took longest within it.
+
+        \code{.cpp}
+        void loop() {
+            TimingMgr.LoopTick();
+            // ...the application's work...
+        }
+        \endcode
+    **/
+    void LoopTick();
+
+    /**
+        \brief Read the main loop iteration statistics gathered by
+        LoopTick(). They are reset after they are read.
+
+        \param[out] stats The statistics gathered since the last read.
+    **/
+    void LoopStatsGet(LoopStats &stats);
+
+    /**
+        \brief Flag main loop iterations longer than a threshold as stalls.
+
+        An iteration is flagged as soon as it runs over, by the SysTick
+        update, so a loop stuck in a call is seen before the call returns;
+        the call it was in is kept in LoopStallBlocker() and, when tracing
+        is built in, a #TRACE_LOOP_STALL event is recorded.
+
+        \code{.cpp}
+        // Flag any iteration longer than 20 ms
+        TimingMgr.LoopStallThreshold(20000);
+        \endcode
+
+        \param[in] us The threshold in microseconds, or 0 to stop flagging.
+    **/
+    void LoopStallThreshold(uint32_t us) {
+        m_loopStallUs = us;
+    }
+
+    /**
+        \brief The main loop stall threshold, in microseconds.
+    **/
+    uint32_t LoopStallThreshold() {
+        return m_loopStallUs;
+    }
+
+    /**
+        \brief Check whether the current main loop iteration has run past
+        LoopStallThreshold().
+    **/
+    bool LoopStalled() {
+        return m_loopStalled;
+    }
+
+    /**
+        \brief The marked call the main loop was in when the last stall was
+        flagged, or #LOOP_BLOCK_NONE if it was in none.
+    **/
+    LoopBlockers LoopStallBlocker() {
+        return m_loopStallBlocker;
+    }
+
+    /**
+        \brief The marked call the main loop is in now.
+    **/
+    LoopBlockers LoopBlocker() {
+        return m_loopBlocker;
+    }
+
+    /**
+        \brief The last marked call the main loop entered.
+    **/
+    LoopBlockers LoopBlockerLast() {
+        return m_loopBlockerLast;
+    }
+
 #ifndef HIDE_FROM_DOXYGEN
     /**
         \brief Sets the SysTick period
@@ -211,7 +656,35 @@ private:
     uint32_t m_microAdjLow;
     uint32_t m_microAdjHighRemainder;
     uint32_t m_microAdjLowRemainder;
-
+    // The upper half of the 64-bit cycle count, shifted up one bit, with the
+    // top bit of the cycle counter when it was last updated in the low bit
+    volatile uint32_t m_cycleEpoch;
+    // CPU load accounting. Each total is only added to by one priority: the
+    // sample rate interrupt, the deferred update, and the main loop.
+    volatile uint64_t m_cpuFastCycles;
+    volatile uint64_t m_cpuDeferredCycles;
+    volatile uint64_t m_cpuIdleCycles;
+    uint64_t m_cpuLoadStart;
+    uint32_t m_deferredStartCycle;
+    uint32_t m_deferredStartFast;
+    // Main loop iteration statistics, and the longest marked call of the
+    // current iteration. Only the stall flag is written by the SysTick
+    // update.
+    LoopStats m_loopStats;
+    volatile uint32_t m_loopTickLast;
+    volatile bool m_loopTicking;
+    volatile uint32_t m_loopStallUs;
+    volatile bool m_loopStalled;
+    volatile LoopBlockers m_loopStallBlocker;
+    volatile LoopBlockers m_loopBlocker;
+    volatile LoopBlockers m_loopBlockerLast;
+    LoopBlockers m_loopIterBlocker;
+    uint32_t m_loopIterBlockUs;
+#if CLEARCORE_ISR_PROFILE
+    IsrStageStats m_isrStages[ISR_STAGE_COUNT];
+    IsrStageStats m_isrLatency;
+    IsrStageStats m_isrDuration;
+#endif
 
     /**
         Constructor
@@ -231,6 +704,21 @@ private:
         Updates the minimum and maximum ISR duration values.
     **/
     void IsrEnd();
+    /**
+        \brief Signal the start of the deferred update
+    **/
+    void DeferredStart();
+    /**
+        \brief Signal the end of the deferred update
+
+        Adds the time spent in the deferred update, less the sample rate
+        interrupts that preempted it, to the CPU load.
+    **/
+    void DeferredEnd();
+    /**
+        \brief Read the sample rate timer's count
+    **/
+    static uint32_t SampleTimerCount();
     /**
         \brief Update at the sample rate
 
@@ -240,6 +728,32 @@ private:
     **/
     void Update();
 
+    /**
+        Flag a main loop iteration that has run past the stall threshold.
+        Called from the SysTick update.
+    **/
+    void LoopStallCheck();
+
+#if CLEARCORE_ISR_PROFILE
+    /**
+        \brief Record the cycles spent in an update stage
+
+        \param[in] stage The stage that just finished
+        \param[in,out] startCycle The cycle counter when the stage started.
+        Set to the start of the next stage.
+    **/
+    void IsrStageEnd(IsrStages stage, uint32_t &startCycle);
+
+    /**
+        Add one run to a set of cycle statistics.
+    **/
+    static void StatsAdd(IsrStageStats &stats, uint32_t cycles);
+
+    /**
+        Copy a set of cycle statistics and reset it.
+    **/
+    static void StatsTake(IsrStageStats &src, IsrStageStats &dst);
+#endif
 };
 
 }
@@ -272,6 +786,14 @@ uint32_t Milliseconds(void);
 **/
 uint32_t Microseconds(void);
 
+/**
+    \brief Number of microseconds since the ClearCore was initialized, as a
+    64-bit count that does not roll over
+
+    \returns Microseconds
+**/
+uint64_t Microseconds64(void);
+
 /**
     \brief Blocks for operations cycles CPU cycles
 
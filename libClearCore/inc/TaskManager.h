@@ -0,0 +1,419 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    \file TaskManager.h
+    \brief ClearCore cooperative main loop task scheduler.
+
+    Runs periodic and event-triggered functions from the main loop, one at a
+    time, each to completion.
+**/
+
+#ifndef __TASKMANAGER_H__
+#define __TASKMANAGER_H__
+
+#include <stdint.h>
+
+namespace ClearCore {
+
+/// The maximum number of tasks the TaskManager can hold
+#ifndef TASK_MANAGER_MAX_TASKS
+#define TASK_MANAGER_MAX_TASKS 16
+#endif
+
+/// The task ID returned when a task could not be added
+#define TASK_INVALID (-1)
+
+/**
+    \class TaskManager
+    \brief ClearCore cooperative main loop task scheduler.
+
+    Tasks are plain functions that run from TaskManager::Run() in the main
+    loop. A periodic task becomes ready every period, tracked with the
+    Milliseconds() counter from the SysTick update. An event task becomes
+    ready when TaskSignal() is called, which is safe from an interrupt
+    handler. Each call to Run() runs every ready task once, in the order the
+    tasks were added, so tasks added first have priority.
+
+    Tasks are not preempted by one another, so a task should return promptly
+    rather than wait. A task that is still waiting to run when it becomes
+    ready again has overrun; overruns and execution times are kept for each
+    task.
+
+    When IdleSleep() is enabled, Run() sleeps until the next interrupt if no
+    task was ready, which lowers power use and lets SysTiming::CpuLoadGet()
+    report the time left over.
+
+    A task given a deadline with TaskDeadline() must finish within that time
+    of becoming ready. Each miss is counted in the task's TaskStats and kept
+    as the last DeadlineMiss, with its timing. Once WatchdogStart() has run,
+    Run() feeds the hardware watchdog only while no critical task is waiting
+    past its deadline, so a main loop that falls behind for longer than the
+    watchdog timeout resets the board instead of silently running slow. The
+    last miss is kept in RAM that is not cleared at startup, and the
+    watchdog's early warning interrupt records the task that caused the
+    reset, so both can be read after it.
+
+    \code{.cpp}
+    void BlinkTask() {
+        ConnectorLed.State(!ConnectorLed.State());
+    }
+
+    void NetworkTask() {
+        EthernetMgr.Refresh();
+    }
+
+    int main() {
+        TaskMgr.TaskAddPeriodic(NetworkTask, 1);
+        TaskMgr.TaskAddPeriodic(BlinkTask, 500);
+        while (true) {
+            TaskMgr.Run();
+        }
+    }
+    \endcode
+**/
+class TaskManager {
+    friend class SysManager;
+
+public:
+    /**
+        The function run by a task.
+    **/
+    typedef void (*TaskFunction)();
+
+    /**
+        \brief Run-time counters for one task.
+    **/
+    typedef struct {
+        /// The number of times the task has run
+        uint32_t RunCount;
+        /// The number of times the task became ready again before it ran
+        uint32_t OverrunCount;
+        /// The duration of the last run, in microseconds
+        uint32_t LastExecUs;
+        /// The longest run, in microseconds
+        uint32_t MaxExecUs;
+        /// The number of times the task missed its deadline
+        uint32_t DeadlineMissCount;
+        /// The longest time from becoming ready to finishing a run, in
+        /// microseconds
+        uint32_t MaxResponseUs;
+    } TaskStats;
+
+    /**
+        \brief A record of a missed deadline.
+    **/
+    typedef struct {
+        /// The ID of the task that missed, or #TASK_INVALID for a watchdog
+        /// early warning that found no critical task late
+        int8_t TaskId;
+        /// True if recorded by the watchdog's early warning, shortly before
+        /// the watchdog reset the board
+        bool Watchdog;
+        /// The task's deadline, in microseconds
+        uint32_t DeadlineUs;
+        /// The time from the task becoming ready to finishing its run, or to
+        /// the miss being found while it still waited, in microseconds
+        uint32_t ResponseUs;
+        /// Milliseconds() when the miss was found
+        uint32_t TimeMs;
+    } DeadlineMiss;
+
+#ifndef HIDE_FROM_DOXYGEN
+    /**
+        Public accessor for singleton instance.
+    **/
+    static TaskManager &Instance();
+#endif
+
+    /**
+        \brief Add a task that is ready every \a periodMs milliseconds.
+
+        The first run is one period after the task is added.
+
+        \code{.cpp}
+        // Poll the serial port every 5 ms
+        int8_t serialTask = TaskMgr.TaskAddPeriodic(SerialPoll, 5);
+        \endcode
+
+        \param[in] task The function to run.
+        \param[in] periodMs The task period, in milliseconds.
+
+        \return The task ID, or #TASK_INVALID if the task list is full or the
+        arguments are invalid.
+    **/
+    int8_t TaskAddPeriodic(TaskFunction task, uint32_t periodMs);
+
+    /**
+        \brief Add a task that is ready when signaled with TaskSignal().
+
+        \code{.cpp}
+        int8_t estopTask = TaskMgr.TaskAddEvent(EStopHandler);
+        \endcode
+
+        \param[in] task The function to run.
+
+        \return The task ID, or #TASK_INVALID if the task list is full or the
+        function is null.
+    **/
+    int8_t TaskAddEvent(TaskFunction task);
+
+    /**
+        \brief Make an event task ready to run.
+
+        May be called from an interrupt handler. Signaling a task again before
+        it runs counts as an overrun; the task still runs only once.
+
+        \code{.cpp}
+        void EStopIsr() {
+            TaskMgr.TaskSignal(estopTask);
+        }
+        \endcode
+
+        \param[in] taskId The ID returned by TaskAddEvent().
+
+        \return True if the task was signaled.
+    **/
+    bool TaskSignal(int8_t taskId);
+
+    /**
+        \brief Enable or disable a task.
+
+        A disabled task never becomes ready. Re-enabling a periodic task
+        restarts its period.
+
+        \code{.cpp}
+        // Stop blinking
+        TaskMgr.TaskEnable(blinkTask, false);
+        \endcode
+
+        \param[in] taskId The ID of the task.
+        \param[in] enable True to enable the task.
+
+        \return True if the task exists.
+    **/
+    bool TaskEnable(int8_t taskId, bool enable);
+
+    /**
+        \brief Set the deadline of a task.
+
+        The task misses its deadline if it has not finished running
+        \a deadlineMs milliseconds after becoming ready. While a critical
+        task waits past its deadline, Run() holds off feeding the watchdog.
+
+        \code{.cpp}
+        // The network task must run within 20 ms of becoming ready
+        TaskMgr.TaskDeadline(networkTask, 20);
+        \endcode
+
+        \param[in] taskId The ID of the task.
+        \param[in] deadlineMs The deadline, in milliseconds, or 0 for none.
+        \param[in] critical True if a late task should hold off the watchdog;
+        false to only count and record its misses.
+
+        \return True if the task exists.
+    **/
+    bool TaskDeadline(int8_t taskId, uint32_t deadlineMs,
+                      bool critical = true);
+
+    /**
+        \brief The number of deadlines missed by all tasks since startup.
+    **/
+    uint32_t DeadlineMissCount() {
+        return m_deadlineMissCount;
+    }
+
+    /**
+        \brief Read the last missed deadline, which may be from before the
+        last reset.
+
+        \code{.cpp}
+        TaskManager::DeadlineMiss miss;
+        if (TaskMgr.WatchdogReset() && TaskMgr.DeadlineMissLast(miss)) {
+            // miss.TaskId held off the watchdog for miss.ResponseUs
+        }
+        \endcode
+
+        \param[out] miss The last miss.
+
+        \return True if a miss has been recorded.
+    **/
+    bool DeadlineMissLast(DeadlineMiss &miss);
+
+    /**
+        \brief Start the hardware watchdog, fed by Run() while the critical
+        tasks meet their deadlines.
+
+        The timeout is rounded up to a whole power of two of the watchdog's
+        1.024 kHz clock, from 16 ms to 16 s. Once started, the watchdog
+        cannot be stopped, so Run() must be called well within the timeout,
+        including while the application is in a long operation.
+
+        \code{.cpp}
+        TaskMgr.TaskDeadline(networkTask, 20);
+        TaskMgr.WatchdogStart(500);
+        \endcode
+
+        \param[in] timeoutMs The time without a feed that resets the board,
+        in milliseconds.
+
+        \return True if the watchdog started; false if it is already running
+        or the timeout is out of range.
+    **/
+    bool WatchdogStart(uint32_t timeoutMs);
+
+    /**
+        \brief The watchdog timeout, in milliseconds, or 0 if it has not been
+        started.
+    **/
+    uint32_t WatchdogTimeoutMs() {
+        return m_watchdogTimeoutMs;
+    }
+
+    /**
+        \brief Check whether the last reset was caused by the watchdog.
+    **/
+    bool WatchdogReset();
+
+    /**
+        \brief Record the latest critical task before the watchdog resets
+        the board. Called from the watchdog's early warning interrupt.
+    **/
+    void IrqHandlerWatchdog();
+
+    /**
+        \brief Read the run-time counters of a task.
+
+        \code{.cpp}
+        TaskManager::TaskStats stats;
+        if (TaskMgr.TaskStatsGet(networkTask, stats) && stats.OverrunCount) {
+            // The network task is falling behind
+        }
+        \endcode
+
+        \param[in] taskId The ID of the task.
+        \param[out] stats The task's counters.
+        \param[in] reset True to clear the counters after reading them.
+
+        \return True if the task exists.
+    **/
+    bool TaskStatsGet(int8_t taskId, TaskStats &stats, bool reset = false);
+
+    /**
+        \brief The number of tasks that have been added.
+    **/
+    uint8_t TaskCount() {
+        return m_taskCount;
+    }
+
+    /**
+        \brief Sleep in Run() when no task is ready.
+
+        The sleep lasts until the next interrupt, which is at most one sample
+        period away, so code polled from the main loop alongside Run() may
+        wait up to that long.
+
+        \code{.cpp}
+        TaskMgr.IdleSleep(true);
+        \endcode
+
+        \param[in] enable True to sleep when idle.
+    **/
+    void IdleSleep(bool enable) {
+        m_idleSleep = enable;
+    }
+
+    /**
+        \brief Run every ready task once.
+
+        Call repeatedly from the main loop.
+
+        \code{.cpp}
+        while (true) {
+            TaskMgr.Run();
+        }
+        \endcode
+    **/
+    void Run();
+
+private:
+    struct Task {
+        TaskFunction Function;
+        // Zero for event tasks
+        uint32_t PeriodMs;
+        uint32_t NextReadyMs;
+        volatile bool Enabled;
+        volatile bool Ready;
+        // Zero for no deadline
+        uint32_t DeadlineUs;
+        bool Critical;
+        // Microseconds() when the task last became ready, and whether that
+        // run has already been counted as a miss
+        uint32_t ReadyUs;
+        volatile bool Missed;
+        TaskStats Stats;
+    };
+
+    Task m_tasks[TASK_MANAGER_MAX_TASKS];
+    volatile uint8_t m_taskCount;
+    bool m_idleSleep;
+    volatile uint32_t m_deadlineMissCount;
+    uint32_t m_watchdogTimeoutMs;
+
+    /**
+        Construct
+    **/
+    TaskManager();
+
+    int8_t TaskAdd(TaskFunction task, uint32_t periodMs);
+
+    /**
+        Mark the periodic tasks that are due as ready. Called from the
+        SysTick update.
+    **/
+    void Tick();
+
+    /**
+        Mark a task ready, counting an overrun if it already is.
+    **/
+    void TaskReady(Task &task);
+
+    /**
+        Check whether any task is ready.
+    **/
+    bool TaskPending();
+
+    /**
+        Record the tasks waiting past their deadlines, and feed the watchdog
+        if no critical task is.
+    **/
+    void DeadlineCheck();
+
+    /**
+        Count and record a missed deadline.
+    **/
+    void DeadlineMissRecord(int8_t taskId, uint32_t responseUs,
+                            bool watchdog);}; // TaskManager
+
+} // ClearCore namespace
+
+#endif // __TASKMANAGER_H__
@@ -0,0 +1,475 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+    \file TelemetrySchema.h
+    \brief Fixed-layout telemetry frames with a self-describing schema.
+
+    Packs the fields of a state struct named in a constant table into a frame
+    with a fixed copy sequence, and describes the frame layout to the host.
+**/
+
+#ifndef __TELEMETRYSCHEMA_H__
+#define __TELEMETRYSCHEMA_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "MotorManager.h"
+#include "ProcessImage.h"
+#include "StatusManager.h"
+
+namespace ClearCore {
+
+/// The most copy runs a field table may need; each run is a stretch of
+/// fields that follow one another in the struct
+#ifndef TELEMETRY_SCHEMA_RUNS_MAX
+#define TELEMETRY_SCHEMA_RUNS_MAX 16
+#endif
+
+/// The first byte of a data frame
+#define TELEMETRY_SCHEMA_FRAME 0x46
+/// The first byte of a schema descriptor
+#define TELEMETRY_SCHEMA_DESCRIPTOR 0x53
+/// The length of the data frame header
+#define TELEMETRY_SCHEMA_HEADER_LEN 6
+
+/**
+    Build a TelemetrySchema::Field for one field of a state struct, named as
+    it is written. The offset and sizes are worked out by the compiler.
+
+    \param[in] type The state struct.
+    \param[in] field The field of \a type; may be a field of an array
+    element, such as Motors[1].HlfbSpeed.
+    \param[in] kind The TelemetrySchema::FieldKinds of the field.
+**/
+#define SCHEMA_FIELD(type, field, kind) \
+    SCHEMA_FIELD_NAMED(type, field, kind, #field)
+
+/**
+    Build a TelemetrySchema::Field for one field of a state struct with the
+    given name.
+
+    \param[in] type The state struct.
+    \param[in] field The field of \a type.
+    \param[in] kind The TelemetrySchema::FieldKinds of the field.
+    \param[in] name The name sent in the schema descriptor.
+**/
+#define SCHEMA_FIELD_NAMED(type, field, kind, name)                    \
+    {offsetof(type, field), sizeof(reinterpret_cast<type *>(0)->field), \
+     1, kind, name}
+
+/**
+    Build a TelemetrySchema::Field for an array field of a state struct.
+
+    \param[in] type The state struct.
+    \param[in] field The array field of \a type.
+    \param[in] kind The TelemetrySchema::FieldKinds of the elements.
+**/
+#define SCHEMA_ARRAY(type, field, kind)                                 \
+    {offsetof(type, field), sizeof(reinterpret_cast<type *>(0)->field[0]), \
+     sizeof(reinterpret_cast<type *>(0)->field) /                         \
+     sizeof(reinterpret_cast<type *>(0)->field[0]), kind, #field}
+
+/**
+    \class TelemetrySchema
+    \brief Fixed-layout telemetry frames with a self-describing schema.
+
+    A constant field table, made with #SCHEMA_FIELD and #SCHEMA_ARRAY, names
+    the fields of a state struct to send, such as the tables below for the
+    MotorManager::MotorsSnapshot, the ProcessImage::InputImage and the
+    StatusManager::StatusRegister. The table is checked, sized and given a
+    schema ID by the compiler. The constructor merges the fields that follow
+    one another in the struct into copy runs, so Encode() is the frame
+    header and a fixed sequence of memcpy calls, with no formatting.
+
+    The host learns the layout once from DescriptorWrite() and then decodes
+    every frame carrying the same schema ID; a rebuild that changes the
+    layout changes the ID, so stale decoders are caught rather than misread.
+
+    A data frame is, with multi-byte values little-endian:
+    - Byte 0: #TELEMETRY_SCHEMA_FRAME.
+    - Bytes 1-4: The schema ID.
+    - Byte 5: The sequence number, one more than the last frame's.
+    - Then each field in table order, packed, as it is in memory.
+
+    A schema descriptor is:
+    - Byte 0: #TELEMETRY_SCHEMA_DESCRIPTOR.
+    - Bytes 1-4: The schema ID.
+    - Byte 5: The number of fields.
+    - Then for each field its FieldKinds, the size of each value, the
+      number of values, the length of its name, and the name.
+
+    \code{.cpp}
+    // Send the inputs each sample period over UDP, and the schema when the
+    // host asks for it
+    TelemetrySchema Schema(InputImageSchema, InputImageSchemaCount);
+    uint8_t frame[TelemetrySchemaFrameSize(InputImageSchema,
+                                           InputImageSchemaCount)];
+
+    void TelemetryTask() {
+        uint16_t length = Schema.Encode(&ProcessImg.InputsRead(), frame,
+                                        sizeof(frame));
+        Udp.Connect(hostIp, 8890);
+        Udp.PacketWrite(frame, length);
+        Udp.PacketSend();
+    }
+    \endcode
+**/
+class TelemetrySchema {
+public:
+    /**
+        \brief What a field holds, for the host to decode it.
+    **/
+    typedef enum {
+        /// A signed integer of 1, 2, 4 or 8 bytes
+        SCHEMA_SIGNED,
+        /// An unsigned integer of 1, 2, 4 or 8 bytes
+        SCHEMA_UNSIGNED,
+        /// A bit field or register of 1, 2, 4 or 8 bytes
+        SCHEMA_BITS,
+        /// A 4 byte float
+        SCHEMA_FLOAT,
+        /// A 1 byte bool
+        SCHEMA_BOOL,
+        /// The number of field kinds
+        SCHEMA_KIND_COUNT,
+    } FieldKinds;
+
+    /**
+        \brief One field of the state struct. Build with #SCHEMA_FIELD,
+        #SCHEMA_FIELD_NAMED or #SCHEMA_ARRAY.
+    **/
+    typedef struct {
+        /// The byte offset of the field in the struct
+        uint16_t Offset;
+        /// The size of each value in bytes
+        uint8_t Size;
+        /// The number of values; more than 1 for an array
+        uint8_t Count;
+        /// The FieldKinds of the values
+        uint8_t Kind;
+        /// The name sent in the schema descriptor
+        const char *Name;
+    } Field;
+
+    /**
+        \brief Construct an encoder, or a decoder, for a field table.
+
+        The table is used in place, so it must stay valid while the object
+        is used.
+
+        \param[in] fields The field table, checked with
+        TelemetrySchemaValid().
+        \param[in] count The number of entries in the table.
+    **/
+    TelemetrySchema(const Field *fields, uint8_t count);
+
+    /**
+        \brief Pack a state struct into a data frame.
+
+        \param[in] source The state struct.
+        \param[out] frame Where to put the frame.
+        \param[in] size The size of \a frame; at least FrameSize().
+
+        \return The length of the frame, or 0 if \a frame is too small or
+        the table needs more than #TELEMETRY_SCHEMA_RUNS_MAX copy runs.
+    **/
+    uint16_t Encode(const void *source, uint8_t *frame, uint16_t size);
+
+    /**
+        \brief Unpack a received data frame into a state struct.
+
+        \param[in] frame The frame.
+        \param[in] length The length of the frame.
+        \param[out] dest The state struct. Only the fields in the table are
+        written.
+
+        \return True if the frame was unpacked; false if it is not a data
+        frame of this schema.
+    **/
+    bool Decode(const uint8_t *frame, uint16_t length, void *dest);
+
+    /**
+        \brief Write the schema descriptor.
+
+        \param[out] out Where to put the descriptor.
+        \param[in] size The size of \a out; at least DescriptorSize().
+
+        \return The length of the descriptor, or 0 if \a out is too small.
+    **/
+    uint16_t DescriptorWrite(uint8_t *out, uint16_t size);
+
+    /**
+        \brief The length of the schema descriptor.
+    **/
+    uint16_t DescriptorSize() {
+        return m_descriptorSize;
+    }
+
+    /**
+        \brief The length of every data frame.
+    **/
+    uint16_t FrameSize() {
+        return m_frameSize;
+    }
+
+    /**
+        \brief The schema ID, as TelemetrySchemaId().
+    **/
+    uint32_t SchemaId() {
+        return m_id;
+    }
+
+private:
+    // A stretch of the struct copied as one block
+    struct Run {
+        uint16_t Offset;
+        uint16_t Length;
+    };
+
+    const Field *m_fields;
+    uint8_t m_count;
+    Run m_runs[TELEMETRY_SCHEMA_RUNS_MAX];
+    uint8_t m_runCount;
+    uint16_t m_frameSize;
+    uint16_t m_descriptorSize;
+    uint32_t m_id;
+    uint8_t m_sequence;
+}; // TelemetrySchema
+
+/**
+    \brief The packed length of the fields of a table.
+
+    \param[in] fields The field table.
+    \param[in] count The number of entries in the table.
+**/
+constexpr uint16_t TelemetrySchemaPayloadSize(
+    const TelemetrySchema::Field *fields, uint8_t count) {
+    return !count ? 0 :
+           fields[0].Size * fields[0].Count +
+           TelemetrySchemaPayloadSize(fields + 1, count - 1);
+}
+
+/**
+    \brief The length of a data frame of a table.
+
+    \param[in] fields The field table.
+    \param[in] count The number of entries in the table.
+**/
+constexpr uint16_t TelemetrySchemaFrameSize(
+    const TelemetrySchema::Field *fields, uint8_t count) {
+    return TELEMETRY_SCHEMA_HEADER_LEN +
+           TelemetrySchemaPayloadSize(fields, count);
+}
+
+/**
+    \brief The number of copy runs a table needs.
+
+    \param[in] fields The field table.
+    \param[in] count The number of entries in the table.
+**/
+constexpr uint8_t TelemetrySchemaRuns(const TelemetrySchema::Field *fields,
+                                     uint8_t count) {
+    return !count ? 0 :
+           (count == 1 || fields[1].Offset !=
+            fields[0].Offset + fields[0].Size * fields[0].Count) +
+           TelemetrySchemaRuns(fields + 1, count - 1);
+}
+
+/**
+    \brief Fold a string into an FNV-1a hash.
+
+    \param[in] str The string.
+    \param[in] hash The hash so far.
+**/
+constexpr uint32_t TelemetrySchemaHash(const char *str, uint32_t hash) {
+    return !*str ? hash :
+           TelemetrySchemaHash(str + 1,
+                               (hash ^ static_cast<uint8_t>(*str)) *
+                               16777619UL);
+}
+
+/**
+    \brief The schema ID of a table: an FNV-1a hash of the kind, size, count
+    and name of each field, in order.
+
+    \param[in] fields The field table.
+    \param[in] count The number of entries in the table.
+    \param[in] hash Leave at the default; the hash so far.
+**/
+constexpr uint32_t TelemetrySchemaId(const TelemetrySchema::Field *fields,
+                                     uint8_t count,
+                                     uint32_t hash = 2166136261UL) {
+    return !count ? hash :
+           TelemetrySchemaId(fields + 1, count - 1,
+                             TelemetrySchemaHash(fields[0].Name,
+                                 (((((hash ^ fields[0].Kind) * 16777619UL) ^
+                                    fields[0].Size) * 16777619UL) ^
+                                  fields[0].Count) * 16777619UL));
+}
+
+/**
+    \brief The length of a field name.
+
+    \param[in] name The name.
+**/
+constexpr uint16_t TelemetrySchemaNameLength(const char *name) {
+    return !*name ? 0 : 1 + TelemetrySchemaNameLength(name + 1);
+}
+
+/**
+    \brief Check each field of a table; see TelemetrySchemaValid().
+
+    \param[in] fields The field table.
+    \param[in] count The number of entries in the table.
+    \param[in] structSize The size of the state struct in bytes.
+**/
+constexpr bool TelemetrySchemaFieldsValid(const TelemetrySchema::Field *fields,
+                                          uint8_t count, uint16_t structSize) {
+    return !count ||
+           (fields[0].Kind < TelemetrySchema::SCHEMA_KIND_COUNT &&
+            fields[0].Count && fields[0].Name &&
+            TelemetrySchemaNameLength(fields[0].Name) <= 255 &&
+            (fields[0].Kind == TelemetrySchema::SCHEMA_FLOAT ?
+             fields[0].Size == 4 :
+             fields[0].Kind == TelemetrySchema::SCHEMA_BOOL ?
+             fields[0].Size == 1 :
+             (fields[0].Size == 1 || fields[0].Size == 2 ||
+              fields[0].Size == 4 || fields[0].Size == 8)) &&
+            fields[0].Offset + fields[0].Size * fields[0].Count <=
+            structSize &&
+            TelemetrySchemaFieldsValid(fields + 1, count - 1, structSize));
+}
+
+/**
+    \brief Check a field table at compile time.
+
+    Every field must have a valid kind and size, a name of at most 255
+    characters, and lie within the struct, and the table must need at most
+    #TELEMETRY_SCHEMA_RUNS_MAX copy runs.
+
+    \param[in] fields The field table.
+    \param[in] count The number of entries in the table.
+    \param[in] structSize The size of the state struct in bytes.
+
+    \return True if the table is valid.
+**/
+constexpr bool TelemetrySchemaValid(const TelemetrySchema::Field *fields,
+                                    uint8_t count, uint16_t structSize) {
+    return TelemetrySchemaRuns(fields, count) <= TELEMETRY_SCHEMA_RUNS_MAX &&
+           TelemetrySchemaFieldsValid(fields, count, structSize);
+}
+
+#ifndef HIDE_FROM_DOXYGEN
+#define SCHEMA_MOTOR(n)                                                      \
+    SCHEMA_FIELD(MotorManager::MotorsSnapshot,                               \
+                 Motors[n].PositionRefCommanded,                             \
+                 TelemetrySchema::SCHEMA_SIGNED),                            \
+    SCHEMA_FIELD(MotorManager::MotorsSnapshot,                               \
+                 Motors[n].VelocityRefCommanded,                             \
+                 TelemetrySchema::SCHEMA_SIGNED),                            \
+    SCHEMA_FIELD(MotorManager::MotorsSnapshot, Motors[n].HlfbPercent,        \
+                 TelemetrySchema::SCHEMA_FLOAT),                             \
+    SCHEMA_FIELD(MotorManager::MotorsSnapshot, Motors[n].HlfbSpeed,          \
+                 TelemetrySchema::SCHEMA_SIGNED),                            \
+    SCHEMA_FIELD(MotorManager::MotorsSnapshot, Motors[n].StatusReg,          \
+                 TelemetrySchema::SCHEMA_BITS),                              \
+    SCHEMA_FIELD(MotorManager::MotorsSnapshot, Motors[n].AlertReg,           \
+                 TelemetrySchema::SCHEMA_BITS),                              \
+    SCHEMA_FIELD(MotorManager::MotorsSnapshot, Motors[n].HlfbState,          \
+                 TelemetrySchema::SCHEMA_UNSIGNED),                          \
+    SCHEMA_FIELD(MotorManager::MotorsSnapshot, Motors[n].StepsComplete,      \
+                 TelemetrySchema::SCHEMA_BOOL)
+#endif
+
+static_assert(MOTOR_CON_CNT == 4, "MotorsSnapshotSchema lists four motors");
+
+/**
+    The field table of a MotorManager::MotorsSnapshot
+**/
+constexpr TelemetrySchema::Field MotorsSnapshotSchema[] = {
+    SCHEMA_FIELD(MotorManager::MotorsSnapshot, Tick,
+                 TelemetrySchema::SCHEMA_UNSIGNED),
+    SCHEMA_MOTOR(0),
+    SCHEMA_MOTOR(1),
+    SCHEMA_MOTOR(2),
+    SCHEMA_MOTOR(3),
+};
+
+#undef SCHEMA_MOTOR
+
+/**
+    The number of entries in #MotorsSnapshotSchema
+**/
+constexpr uint8_t MotorsSnapshotSchemaCount =
+    sizeof(MotorsSnapshotSchema) / sizeof(MotorsSnapshotSchema[0]);
+
+/**
+    The field table of a ProcessImage::InputImage
+**/
+constexpr TelemetrySchema::Field InputImageSchema[] = {
+    SCHEMA_FIELD(ProcessImage::InputImage, Ccio,
+                 TelemetrySchema::SCHEMA_BITS),
+    SCHEMA_FIELD(ProcessImage::InputImage, Tick,
+                 TelemetrySchema::SCHEMA_UNSIGNED),
+    SCHEMA_FIELD(ProcessImage::InputImage, Digital,
+                 TelemetrySchema::SCHEMA_BITS),
+    SCHEMA_ARRAY(ProcessImage::InputImage, Analog,
+                 TelemetrySchema::SCHEMA_UNSIGNED),
+};
+
+/**
+    The number of entries in #InputImageSchema
+**/
+constexpr uint8_t InputImageSchemaCount =
+    sizeof(InputImageSchema) / sizeof(InputImageSchema[0]);
+
+/**
+    The field table of a StatusManager::StatusRegister
+**/
+constexpr TelemetrySchema::Field StatusRegisterSchema[] = {
+    SCHEMA_FIELD_NAMED(StatusManager::StatusRegister, reg,
+                       TelemetrySchema::SCHEMA_BITS, "StatusReg"),
+};
+
+/**
+    The number of entries in #StatusRegisterSchema
+**/
+constexpr uint8_t StatusRegisterSchemaCount =
+    sizeof(StatusRegisterSchema) / sizeof(StatusRegisterSchema[0]);
+
+static_assert(TelemetrySchemaValid(MotorsSnapshotSchema,
+                                   MotorsSnapshotSchemaCount,
+                                   sizeof(MotorManager::MotorsSnapshot)),
+              "Bad MotorsSnapshotSchema");
+static_assert(TelemetrySchemaValid(InputImageSchema, InputImageSchemaCount,
+                                   sizeof(ProcessImage::InputImage)),
+              "Bad InputImageSchema");
+static_assert(TelemetrySchemaValid(StatusRegisterSchema,
+                                   StatusRegisterSchemaCount,
+                                   sizeof(StatusManager::StatusRegister)),
+              "Bad StatusRegisterSchema");
+
+} // ClearCore namespace
+
+#endif // __TELEMETRYSCHEMA_H__
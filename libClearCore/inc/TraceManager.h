@@ -0,0 +1,296 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    \file TraceManager.h
+    \brief ClearCore real-time event trace.
+
+    Records compact, timestamped events into a RAM ring or out of the ITM
+    stimulus port for timing debugging without serial prints.
+**/
+
+#ifndef __TRACEMANAGER_H__
+#define __TRACEMANAGER_H__
+
+#include <stdint.h>
+#include <sam.h>
+#include "atomic_utils.h"
+
+/**
+    Set to 1 to build in the library's trace points. When 0, TRACE_EVENT()
+    compiles to nothing.
+**/
+#ifndef CLEARCORE_TRACE
+#define CLEARCORE_TRACE 0
+#endif
+
+/// The number of records the RAM ring holds; a power of two
+#ifndef TRACE_BUFFER_RECORDS
+#define TRACE_BUFFER_RECORDS 512
+#endif
+
+/// The ITM stimulus port that events are written to in ITM mode
+#ifndef TRACE_ITM_PORT
+#define TRACE_ITM_PORT 1
+#endif
+
+#if CLEARCORE_TRACE
+/// Record a trace event
+#define TRACE_EVENT(id, arg) ClearCore::TraceMgr.Event((id), (arg))
+#else
+#define TRACE_EVENT(id, arg)
+#endif
+
+namespace ClearCore {
+
+class ISerial;
+
+/**
+    \brief Trace event IDs.
+
+    The upper byte of an ID is its group, which is enabled with
+    TraceManager::GroupsEnable(). The lower byte tells apart events of the
+    group, or the instance that raised them.
+**/
+typedef enum {
+    /// Sample rate interrupt start; the argument is the sample count
+    TRACE_FAST_UPDATE_BEGIN = 0x0000,
+    /// Sample rate interrupt end; the argument is its duration in cycles
+    TRACE_FAST_UPDATE_END = 0x0001,
+    /// CCIO-8 refresh; the argument is the output state
+    TRACE_CCIO_REFRESH = 0x0100,
+    /// Motor move accepted, plus the connector; the argument is the distance
+    TRACE_MOTOR_MOVE = 0x0200,
+    /// Serial transmit interrupt; the argument is the SERCOM address
+    TRACE_SERIAL_TX_IRQ = 0x0300,
+    /// Serial receive interrupt; the argument is the SERCOM address
+    TRACE_SERIAL_RX_IRQ = 0x0301,
+    /// Ethernet refresh
+    TRACE_ETHERNET_REFRESH = 0x0400,
+    /// Main loop stall; the argument is the SysTiming::LoopBlockers value
+    /// of the call it was in
+    TRACE_LOOP_STALL = 0x0500,
+    /// Task deadline miss; the argument is the task ID
+    TRACE_TASK_DEADLINE_MISS = 0x0600,
+    /// Watchdog early warning; the argument is the ID of the latest critical
+    /// task, or 0xFF if none was late
+    TRACE_WATCHDOG_WARNING = 0x0601,
+    /// The first of 256 IDs left for application events
+    TRACE_USER = 0x1F00,
+} TraceIds;
+
+/**
+    \brief One trace event, as stored in the RAM ring and sent by
+    TraceManager::Dump().
+**/
+typedef struct {
+    /// The CPU cycle counter when the event was recorded
+    uint32_t Cycles;
+    /// The event's argument
+    uint32_t Arg;
+    /// The event ID, one of TraceIds
+    uint16_t Id;
+    /// The low bits of the event's position in the trace; a gap means
+    /// events were overwritten before they were read
+    uint16_t Sequence;
+} TraceRecord;
+
+/**
+    \class TraceManager
+    \brief ClearCore real-time event trace.
+
+    Each event is a 12-byte TraceRecord: the cycle counter, an ID, and a
+    32-bit argument. In RAM mode events go into a ring of
+    #TRACE_BUFFER_RECORDS records that overwrites its oldest records; any
+    interrupt level may add events without locking. In ITM mode each event
+    is written to stimulus port #TRACE_ITM_PORT as three words (ID and
+    sequence, cycles, argument) for a debug probe to capture from SWO.
+
+    The library's trace points are built in with CLEARCORE_TRACE set to 1
+    and cost a load and a test when their group is disabled. Decode a dump
+    with Tools/TraceDecode/trace_decode.py.
+
+    \code{.cpp}
+    TraceMgr.GroupsEnable(UINT32_MAX);
+    TraceMgr.Mode(TraceManager::TRACE_RAM);
+    TRACE_EVENT(TRACE_USER + 1, encoderPosn);
+    // ...
+    TraceMgr.Dump(ConnectorUsb);
+    \endcode
+**/
+class TraceManager {
+public:
+    /**
+        Where events go.
+    **/
+    typedef enum {
+        /// Events are dropped
+        TRACE_OFF,
+        /// Events are kept in the RAM ring
+        TRACE_RAM,
+        /// Events are written to the ITM stimulus port
+        TRACE_ITM,
+    } TraceModes;
+
+#ifndef HIDE_FROM_DOXYGEN
+    /**
+        Public accessor for singleton instance.
+    **/
+    static TraceManager &Instance();
+#endif
+
+    /**
+        \brief Choose where events go.
+
+        \param[in] mode The new destination.
+    **/
+    void Mode(TraceModes mode) {
+        m_mode = mode;
+    }
+
+    /**
+        \brief Where events go.
+    **/
+    TraceModes Mode() {
+        return m_mode;
+    }
+
+    /**
+        \brief Choose which event groups are recorded.
+
+        \code{.cpp}
+        // Trace only the sample rate interrupt and the serial ports
+        TraceMgr.GroupsEnable(1UL << (TRACE_FAST_UPDATE_BEGIN >> 8) |
+                              1UL << (TRACE_SERIAL_TX_IRQ >> 8));
+        \endcode
+
+        \param[in] mask Bit n enables the IDs whose upper byte is n.
+    **/
+    void GroupsEnable(uint32_t mask) {
+        m_groupMask = mask;
+    }
+
+    /**
+        \brief Record an event.
+
+        Safe from any interrupt level. Prefer the TRACE_EVENT() macro, which
+        compiles out of builds without CLEARCORE_TRACE.
+
+        \param[in] id The event ID.
+        \param[in] arg The event's argument.
+    **/
+    void Event(uint16_t id, uint32_t arg) {
+        if (!(m_groupMask & (1UL << ((id >> 8) & 0x1F)))) {
+            return;
+        }
+        if (m_mode == TRACE_RAM) {
+            uint32_t index = atomic_fetch_add(&m_head, 1);
+            TraceRecord &record = m_buffer[index & (TRACE_BUFFER_RECORDS - 1)];
+            record.Cycles = DWT->CYCCNT;
+            record.Arg = arg;
+            record.Id = id;
+            // Written last, so the reader can tell the record is complete
+            atomic_store_n(&record.Sequence, static_cast<uint16_t>(index));
+        }
+        else if (m_mode == TRACE_ITM) {
+            EventItm(id, arg);
+        }
+    }
+
+    /**
+        \brief Take the oldest unread records out of the RAM ring.
+
+        Call from the main loop, not from an interrupt that may preempt an
+        event being recorded.
+
+        \param[out] records Where to copy the records.
+        \param[in] maxRecords The most records to copy.
+
+        \return The number of records copied.
+    **/
+    uint32_t Read(TraceRecord *records, uint32_t maxRecords);
+
+    /**
+        \brief Copy the newest records in the RAM ring, newest first,
+        without taking them.
+
+        Safe from an exception handler; a record that was being written when
+        it preempted is left out.
+
+        \param[out] records Where to copy the records.
+        \param[in] maxRecords The most records to copy.
+
+        \return The number of records copied.
+    **/
+    uint32_t Latest(TraceRecord *records, uint32_t maxRecords);
+
+    /**
+        \brief The number of records overwritten before they were read.
+    **/
+    uint32_t LostCount() {
+        return m_lost;
+    }
+
+    /**
+        \brief Discard every unread record.
+    **/
+    void Clear();
+
+    /**
+        \brief Send the unread records to a serial port in binary.
+
+        The dump is the four bytes "CCTR", the CPU clock rate and the record
+        count as little-endian 32-bit values, then the records. Records
+        lost while the dump is sent are replaced with ID 0xFFFF. Call from
+        the main loop.
+
+        \param[in] port Where to send the dump.
+
+        \return The number of records sent.
+    **/
+    uint32_t Dump(ISerial &port);
+
+private:
+    TraceRecord m_buffer[TRACE_BUFFER_RECORDS];
+    // Free-running count of events written and read
+    volatile uint32_t m_head;
+    uint32_t m_tail;
+    uint32_t m_lost;
+    volatile TraceModes m_mode;
+    volatile uint32_t m_groupMask;
+
+    /**
+        Construct
+    **/
+    TraceManager();
+
+    /**
+        Write an event to the ITM stimulus port.
+    **/
+    void EventItm(uint16_t id, uint32_t arg);
+}; // TraceManager
+
+extern TraceManager &TraceMgr;
+
+} // ClearCore namespace
+
+#endif // __TRACEMANAGER_H__
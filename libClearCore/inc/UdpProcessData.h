@@ -0,0 +1,311 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+    \file UdpProcessData.h
+    \brief ClearCore cyclic UDP process data exchange.
+
+    Exchanges fixed-format process data with a supervisory controller over
+    UDP, with a receive watchdog and timing statistics.
+**/
+
+#ifndef __UDPPROCESSDATA_H__
+#define __UDPPROCESSDATA_H__
+
+#include <stdint.h>
+#include "EthernetUdp.h"
+#include "IpAddress.h"
+
+namespace ClearCore {
+
+/// The largest process data payload in either direction, in bytes
+#ifndef UDP_PD_DATA_MAX
+#define UDP_PD_DATA_MAX 512
+#endif
+
+/// The size of the header that starts every process data packet, in bytes
+#define UDP_PD_HEADER_LEN 16
+
+/// The value of the first two bytes of every process data packet
+#define UDP_PD_MAGIC 0x4450
+
+/**
+    \class UdpProcessData
+    \brief ClearCore cyclic UDP process data exchange.
+
+    Sends the produced data to the peer every time Cycle() is called, and
+    takes the latest packet from the peer into the consumed data. Cycle() is
+    meant to be run as a TaskManager periodic task at the exchange period;
+    it never waits. The packets sent are allocated once in Begin() and
+    reused.
+
+    Every packet, in both directions, is a 16 byte header followed by the
+    data, all little-endian:
+    - Bytes 0-1: #UDP_PD_MAGIC.
+    - Bytes 2-3: The data length.
+    - Bytes 4-7: The sequence number, one more than the sender's last packet.
+    - Bytes 8-11: The sender's microsecond clock when the packet was sent.
+    - Bytes 12-15: The echo time: the clock value of the last packet
+      received from the other side, advanced by the time the sender held it.
+      The other side's clock minus this is the round trip time. Zero when
+      there is nothing to echo.
+
+    Packets from the peer that are late (out of sequence), the wrong size or
+    malformed are dropped and counted. If no good packet arrives for the
+    timeout, the exchange goes offline: the consumed data is overwritten
+    with the safe data (zeros unless SafeData() is set) and the consume and
+    timeout callbacks run, so the outputs are driven to a safe state.
+
+    \code{.cpp}
+    struct {
+        uint32_t Inputs;
+        int32_t Position;
+    } Produced;
+    struct {
+        uint32_t Outputs;
+    } Consumed;
+
+    UdpProcessData ProcessData;
+
+    void Produce() {
+        Produced.Inputs = InputMgr.InputsRT().reg;
+        Produced.Position = ConnectorM0.PositionRefCommanded();
+    }
+
+    void Consume() {
+        ConnectorIO0.State(Consumed.Outputs & 1);
+    }
+
+    void ExchangeTask() {
+        ProcessData.Cycle();
+    }
+
+    int main() {
+        EthernetMgr.Setup();
+        ProcessData.Begin(5000, 2, 20,
+                          reinterpret_cast<uint8_t *>(&Produced),
+                          sizeof(Produced),
+                          reinterpret_cast<uint8_t *>(&Consumed),
+                          sizeof(Consumed));
+        ProcessData.ProduceCallback(Produce);
+        ProcessData.ConsumeCallback(Consume);
+        TaskMgr.TaskAddPeriodic(ExchangeTask, 2);
+        while (true) {
+            TaskMgr.Run();
+        }
+    }
+    \endcode
+**/
+class UdpProcessData {
+
+public:
+    /**
+        \brief Called from Cycle() around the exchange of process data.
+    **/
+    typedef void (*ExchangeCallback)();
+
+    /**
+        \brief Exchange counters and timing.
+    **/
+    typedef struct {
+        /// The number of packets sent
+        uint32_t Sent;
+        /// The number of cycles a packet could not be sent
+        uint32_t SendFailed;
+        /// The number of good packets received
+        uint32_t Received;
+        /// The number of peer packets missing from the sequence
+        uint32_t Lost;
+        /// The number of peer packets dropped as repeated or out of order
+        uint32_t Stale;
+        /// The number of peer packets dropped as malformed or the wrong size
+        uint32_t Invalid;
+        /// The number of times the watchdog has expired
+        uint32_t Timeouts;
+        /// The smoothed deviation of the packet arrival interval from the
+        /// period, in microseconds
+        uint32_t JitterUs;
+        /// The largest deviation of the arrival interval from the period, in
+        /// microseconds
+        uint32_t JitterMaxUs;
+        /// The last round trip time, in microseconds
+        uint32_t RoundTripUs;
+        /// The longest round trip time, in microseconds
+        uint32_t RoundTripMaxUs;
+    } ExchangeStats;
+
+    /**
+        \brief Construct a UDP process data exchange.
+    **/
+    UdpProcessData();
+
+    /**
+        \brief Start the exchange.
+
+        Call after EthernetMgr.Setup(). The buffers are used in place, so they
+        must stay valid while the exchange runs. Until Peer() is called, the
+        peer is whoever sent the last good packet, and nothing is sent until
+        one arrives.
+
+        \param[in] localPort The local UDP port.
+        \param[in] periodMs The exchange period, the period of the task that
+        calls Cycle(). Used for the jitter statistics.
+        \param[in] timeoutMs The longest time without a good packet from the
+        peer before the exchange goes offline.
+        \param[in] produced The data sent to the peer.
+        \param[in] producedSize The size of the produced data, at most
+        #UDP_PD_DATA_MAX.
+        \param[in] consumed The data received from the peer.
+        \param[in] consumedSize The size of the consumed data, at most
+        #UDP_PD_DATA_MAX.
+
+        \return True if the exchange started.
+    **/
+    bool Begin(uint16_t localPort, uint32_t periodMs, uint32_t timeoutMs,
+               const uint8_t *produced, uint16_t producedSize,
+               uint8_t *consumed, uint16_t consumedSize);
+
+    /**
+        \brief Stop the exchange and free its packets.
+    **/
+    void End();
+
+    /**
+        \brief Send to a fixed peer rather than the sender of the last good
+        packet. Only packets from this address are accepted.
+
+        \code{.cpp}
+        ProcessData.Peer(IpAddress(192, 168, 1, 10), 5000);
+        \endcode
+
+        \param[in] ip The peer's IP address.
+        \param[in] port The peer's UDP port.
+    **/
+    void Peer(IpAddress ip, uint16_t port) {
+        m_peerIp = ip;
+        m_peerPort = port;
+        m_peerFixed = true;
+    }
+
+    /**
+        \brief Set the data copied to the consumed data when the watchdog
+        expires.
+
+        \param[in] safe The safe data, the size of the consumed data, or null
+        for zeros. Used in place.
+    **/
+    void SafeData(const uint8_t *safe) {
+        m_safe = safe;
+    }
+
+    /**
+        \brief Set the function called just before each packet is built.
+    **/
+    void ProduceCallback(ExchangeCallback callback) {
+        m_produceCallback = callback;
+    }
+
+    /**
+        \brief Set the function called after new data is received, and after
+        the safe data is applied.
+    **/
+    void ConsumeCallback(ExchangeCallback callback) {
+        m_consumeCallback = callback;
+    }
+
+    /**
+        \brief Set the function called when the watchdog expires.
+    **/
+    void TimeoutCallback(ExchangeCallback callback) {
+        m_timeoutCallback = callback;
+    }
+
+    /**
+        \brief Receive the latest packet from the peer, check the watchdog,
+        and send the produced data.
+
+        Call once per period, normally from a TaskManager periodic task.
+    **/
+    void Cycle();
+
+    /**
+        \brief Check whether good packets are arriving from the peer.
+
+        \return True from the first good packet until the watchdog expires.
+    **/
+    bool Online() {
+        return m_online;
+    }
+
+    /**
+        \brief Read the exchange counters and timing.
+
+        \code{.cpp}
+        UdpProcessData::ExchangeStats stats;
+        ProcessData.StatsGet(stats, true);
+        if (stats.Lost) {
+            // Packets went missing since the last check
+        }
+        \endcode
+
+        \param[out] stats The counters.
+        \param[in] reset True to clear the counters after reading them.
+    **/
+    void StatsGet(ExchangeStats &stats, bool reset = false);
+
+private:
+    EthernetUdp m_udp;
+    bool m_running;
+    bool m_online;
+    bool m_peerFixed;
+    IpAddress m_peerIp;
+    uint16_t m_peerPort;
+    const uint8_t *m_produced;
+    uint16_t m_producedSize;
+    uint8_t *m_consumed;
+    uint16_t m_consumedSize;
+    const uint8_t *m_safe;
+    ExchangeCallback m_produceCallback;
+    ExchangeCallback m_consumeCallback;
+    ExchangeCallback m_timeoutCallback;
+    uint32_t m_periodUs;
+    uint32_t m_timeoutUs;
+    uint32_t m_sequence;
+    // The last good packet from the peer
+    bool m_received;
+    uint32_t m_receivedSeq;
+    uint32_t m_receivedUs;
+    uint32_t m_peerTimeUs;
+    // The jitter, scaled by 16
+    uint32_t m_jitterQ4;
+    ExchangeStats m_stats;
+    uint8_t m_rxFrame[UDP_PD_HEADER_LEN + UDP_PD_DATA_MAX];
+
+    void Receive();
+    void Send();
+    void Timeout();
+}; // UdpProcessData
+
+} // ClearCore namespace
+
+#endif // __UDPPROCESSDATA_H__
@@ -62,12 +62,10 @@ extern "C" {
 #ifdef __cplusplus
 }
 #endif
-namespace ClearCore {
+#include "RingBuffer.h"
+#include "SerialUsb.h"
 
-/** USB serial buffer size, in bytes. (64) **/
-#ifndef USB_SERIAL_BUFFER_SIZE
-#define USB_SERIAL_BUFFER_SIZE 64
-#endif
+namespace ClearCore {
 
 // List of all UsbStatusReg items. Will be used to generate bitfield, enums, and
 // masks. Ensures that the three are kept up to date with each other.
@@ -166,13 +164,26 @@ USB_STATUS_REG_LIST(MASKIFY)
         circular buffer. When the buffer is full, the receipt of data is
         acknowledged, but not copied into the buffer. Data is drained from the
         buffer via the Read function. To Query the number of available bytes
-        call Available().
+        call Available(). Data is received into two multi-packet transfer
+        buffers in turn, so the host can keep sending into one while the
+        other is copied into the circular buffer.
 
     Writing:
-        Small transfers (less than a packet size) are copied into a buffer
-        and sent in the background. Larger transfers are still sent in the
-        background, but are not buffered. This means that the pointer to the
-        data must remain valid during the sending procedure.
+        Data is copied from the circular buffer into two multi-packet
+        transfer buffers in turn; one is filled while the other is being
+        sent. A buffer is sent once it is full or once its oldest data has
+        waited the SendLatency(), so short writes are coalesced into large
+        transfers; WaitForWriteFinish() sends it at once. SendDirect() sends
+        a buffer straight from the caller's memory by DMA, without copying
+        it.
+
+    Ports:
+        With CONF_USB_CDCD_ACM_PORTS above 1 the device has up to three
+        serial ports, each with its own instance, buffers, and endpoints,
+        so a bulk stream on one port does not hold up another. Port 0 is
+        UsbMgr and ConnectorUsb; the others are returned by Port(). The
+        telemetry interface and the 1200 baud bootloader request belong to
+        port 0.
 
 **/
 class UsbManager {
@@ -185,6 +196,15 @@ public:
     static UsbManager &Instance();
 #endif
 
+    /**
+        \brief The manager of a CDC serial port.
+
+        \param[in] port The port, from 0 to CONF_USB_CDCD_ACM_PORTS - 1.
+
+        \return The port's manager, or NULL if there is no such port.
+    **/
+    static UsbManager *Port(uint8_t port);
+
     /**
         \brief Change the baud rate for the port.
 
@@ -214,6 +234,37 @@ public:
 
     void WaitForWriteFinish();
 
+    /**
+        \brief Send a buffer and wait until it has been sent.
+
+        Anything already in the transmit buffer is sent first. A buffer that
+        is 4-byte aligned and in RAM is then sent straight from the caller's
+        memory by the USB DMA as one multi-packet transfer; any other buffer
+        is sent through the transmit buffer.
+
+        \code{.cpp}
+        __attribute__((aligned(4))) uint8_t logBlock[4096];
+        // Fill logBlock, then
+        UsbMgr.SendDirect(logBlock, sizeof(logBlock));
+        \endcode
+
+        \param[in] buffer The data to send.
+        \param[in] length The number of bytes in \a buffer.
+
+        \return True if all of the data was sent.
+    **/
+    bool SendDirect(const uint8_t *buffer, size_t length);
+
+    /**
+        \copydoc SerialUsb::SendLatency(uint16_t ms)
+    **/
+    void SendLatency(uint16_t ms);
+
+    /**
+        \copydoc SerialUsb::SendLatency()
+    **/
+    uint16_t SendLatency();
+
     /**
        \copydoc ISerial::AvailableForRead()
     **/
@@ -239,16 +290,103 @@ public:
     **/
     bool SendChar(uint8_t charToSend);
 
+    /**
+        \copydoc ISerial::ReadBlock(uint8_t *buffer, size_t length)
+    **/
+    int32_t ReadBlock(uint8_t *buffer, size_t length);
+
+    /**
+        \copydoc ISerial::WriteBlock(const uint8_t *buffer, size_t length)
+    **/
+    int32_t WriteBlock(const uint8_t *buffer, size_t length);
+
     /**
         \brief Returns whether USB is connected and operational.
     **/
     operator bool();
 
+    /**
+        The function called with data the host sends to the telemetry
+        interface. Called from the USB interrupt.
+    **/
+    typedef void (*TelemetryCommandFunction)(const uint8_t *data,
+            uint32_t length);
+
+    /**
+        \brief Set the size of each telemetry record and empty the record
+        ring.
+
+        Telemetry records are sent on the vendor-specific bulk IN endpoint,
+        which is only present when the library is built with
+        CONF_USB_VENDOR_EN set to 1. The CDC serial port keeps working
+        alongside it.
+
+        \code{.cpp}
+        struct MotorSample {
+            int32_t PositionRef;
+            uint32_t HlfbDuty;
+            uint32_t AnalogIn;
+        };
+        UsbMgr.TelemetryRecordSize(sizeof(MotorSample));
+        \endcode
+
+        \param[in] size The record size, in bytes. Must be a multiple of 4
+        and no more than half of #USB_TELEMETRY_BUFFER_SIZE.
+
+        \return True if the size was accepted.
+    **/
+    bool TelemetryRecordSize(uint16_t size);
+
+    /**
+        \brief Queue one telemetry record to be sent to the host.
+
+        The record is copied into the ring and sent with others in a single
+        bulk transfer straight from the ring. Records may be pushed from one
+        interrupt handler or from the main loop, but not both.
+
+        \code{.cpp}
+        MotorSample sample = {ConnectorM0.PositionRefCommanded(),
+                              0, 0};
+        UsbMgr.TelemetryPush(&sample);
+        \endcode
+
+        \param[in] record The record, TelemetryRecordSize() bytes long.
+
+        \return True if the record was queued; false if the ring is full,
+        no record size is set, or the host has not configured the interface.
+    **/
+    bool TelemetryPush(const void *record);
+
+    /**
+        \brief The number of records dropped because the ring was full.
+    **/
+    uint32_t TelemetryDropped() {
+        return m_telemetryDropped;
+    }
+
+    /**
+        \brief Whether the host has configured the telemetry interface.
+    **/
+    bool TelemetryConnected() {
+        return m_telemetryEnabled;
+    }
+
+    /**
+        \brief Set the function to call with data the host sends on the
+        vendor-specific bulk OUT endpoint, such as capture start and stop
+        commands.
+
+        \param[in] callback The function, or NULL to ignore the data.
+    **/
+    void TelemetryCommandCallback(TelemetryCommandFunction callback) {
+        m_telemetryCommandCallback = callback;
+    }
+
     const volatile usb_cdc_control_signal_t &LineState() {
         return m_lineState;
     }
 
-    UsbManager();
+    explicit UsbManager(uint8_t port = 0);
 
 private:
 
@@ -261,10 +399,44 @@ private:
     void RxProc();
 
     /**
-        Transmit any data waiting in the transmit buffer.
+        Move data from the transmit buffer into the transfer buffers, and
+        send the next one if it is full, has waited the send latency, or a
+        flush is in progress.
+
+        \param[in] sample True when called once per sample, to age the
+        waiting data.
+    **/
+    void TxPump(bool sample = false);
+
+    /**
+        Start receiving into the next transfer buffer if it is free.
+    **/
+    void RxStart();
+
+    /**
+        Forget the transfers in progress after they have been stopped.
+    **/
+    void XferReset();
+
+    /**
+        Track the host configuring the telemetry interface and send any
+        queued records.
+    **/
+    void TelemetryRefresh();
+
+    /**
+        Send the queued telemetry records if the endpoint is idle.
     **/
-    void TxPump();
+    void TelemetryPump();
+    static bool TelemetryComplete(const uint8_t ep,
+                                  const enum usb_xfer_code rc,
+                                  const uint32_t count);
+    static bool TelemetryCommandComplete(const uint8_t ep,
+                                         const enum usb_xfer_code rc,
+                                         const uint32_t count);
+    template <uint8_t port>
     static bool CBLineStateChanged(usb_cdc_control_signal_t state);
+    void LineStateChanged(usb_cdc_control_signal_t state);
     static bool TxComplete(const uint8_t ep,
                            const enum usb_xfer_code rc,
                            const uint32_t count);
@@ -274,22 +446,55 @@ private:
 
     void cdc_device_acm_init(void);
 
+    // The CDC port this instance serves
+    uint8_t m_port;
 
     // Serial Buffers
-    __attribute__((__aligned__(4))) uint8_t m_bufferIn[USB_SERIAL_BUFFER_SIZE];
-    __attribute__((__aligned__(4))) uint8_t m_bufferOut[USB_SERIAL_BUFFER_SIZE];
+    RingBufferStatic<uint8_t, USB_SERIAL_BUFFER_SIZE> m_bufferIn;
+    RingBufferStatic<uint8_t, USB_SERIAL_BUFFER_SIZE> m_bufferOut;
 
-    __attribute__((__aligned__(4))) uint8_t m_usbReadBuf[USB_SERIAL_BUFFER_SIZE];
-    __attribute__((__aligned__(4))) uint8_t m_usbWriteBuf[USB_SERIAL_BUFFER_SIZE];
-    // Indices for head and tails of the ring buffers
-    volatile uint32_t m_inHead, m_inTail;
-    volatile uint32_t m_outHead, m_outTail;
+    // Endpoint transfer buffers, used in turn
+    __attribute__((__aligned__(4)))
+    uint8_t m_usbReadBuf[2][USB_SERIAL_XFER_SIZE];
+    __attribute__((__aligned__(4)))
+    uint8_t m_usbWriteBuf[2][USB_SERIAL_XFER_SIZE];
 
     volatile bool m_sendActive;
     volatile bool m_readActive;
     usb_cdc_control_signal_t m_lineState;
-    uint8_t *m_readBufPtr;
-    uint32_t m_readBufAvail;
+    // Received data not yet copied into the ring, per transfer buffer
+    uint8_t *m_readBufPtr[2];
+    volatile uint32_t m_readBufAvail[2];
+    // The buffer the next read goes into, and the oldest one with data
+    volatile uint8_t m_readBufNext;
+    volatile uint8_t m_readBufDrain;
+    // Data waiting to be sent, per transfer buffer
+    volatile uint32_t m_writeBufCount[2];
+    // The buffer to send next
+    volatile uint8_t m_writeBufNext;
+    // The send latency, and how long the unsent data has waited, in samples
+    uint16_t m_txLatency;
+    uint16_t m_txWait;
+    // WaitForWriteFinish() is sending everything at once
+    volatile bool m_txFlush;
+    // A SendDirect() transfer is in progress, and how it finished
+    volatile bool m_sendDirect;
+    volatile bool m_sendDirectOk;
+
+    // Telemetry record ring, indexed in records. The records from the head
+    // up to m_telemetrySending are being sent.
+    __attribute__((__aligned__(4)))
+    uint8_t m_telemetryBuf[USB_TELEMETRY_BUFFER_SIZE];
+    uint16_t m_telemetryRecordSize;
+    uint16_t m_telemetryCapacity;
+    volatile uint16_t m_telemetryHead;
+    volatile uint16_t m_telemetryTail;
+    volatile uint16_t m_telemetrySending;
+    uint32_t m_telemetryDropped;
+    volatile bool m_telemetryEnabled;
+    __attribute__((__aligned__(4)))
+    uint8_t m_telemetryCommandBuf[64];
+    TelemetryCommandFunction m_telemetryCommandCallback;
 
     bool m_portOpen;
 
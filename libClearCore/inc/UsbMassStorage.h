@@ -0,0 +1,249 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    \file UsbMassStorage.h
+    \brief ClearCore USB mass storage access to the SD card.
+
+    Lets a USB host read the SD card as a disk, alongside the USB serial port.
+**/
+
+#ifndef __USBMASSSTORAGE_H__
+#define __USBMASSSTORAGE_H__
+
+#include <stdint.h>
+#include "SdCardDriver.h"
+
+namespace ClearCore {
+
+/// The size of each of the two transfer buffers, in bytes; a multiple of
+/// the card's block size. Larger buffers make longer multi-block transfers.
+#ifndef USB_MSC_BUFFER_SIZE
+#define USB_MSC_BUFFER_SIZE 4096
+#endif
+
+/**
+    \class UsbMassStorage
+    \brief ClearCore USB mass storage access to the SD card.
+
+    Building with CONF_USB_MSC_EN set to 1 adds a Mass Storage Bulk-Only
+    interface to the USB device, next to the CDC serial port, and the host
+    sees the SD card as a removable disk once Start() is called.
+
+    The host's commands are carried out by Refresh(), called from the main
+    loop, so the card is never touched from an interrupt and the card
+    accesses of FatFileSystem and DataLogger in the same loop never overlap
+    them. Reads and writes of many blocks move through two buffers: while
+    one is sent to or received from the host, the other is read from or
+    written to the card with multi-block transfers.
+
+    The host keeps its own view of the file system. By default the disk is
+    write-protected, so the application can keep logging to the card while
+    the host copies files; the host sees the files as they were when it
+    last read them. Stop() and Start() again tell the host the medium
+    changed, so it reads the card afresh. Only make the disk writable while
+    nothing on the ClearCore has the file system mounted.
+
+    \code{.cpp}
+    // Let a PC copy the logs while the machine keeps running
+    UsbMsc.Start();
+    while (true) {
+        UsbMsc.Refresh();
+        DataLog.Refresh();
+        ...
+    }
+    \endcode
+**/
+class UsbMassStorage {
+    friend class SysManager;
+
+public:
+#ifndef HIDE_FROM_DOXYGEN
+    /**
+        Public accessor for singleton instance.
+    **/
+    static UsbMassStorage &Instance();
+
+    /**
+        Note a finished IN transfer, or the host clearing the IN halt.
+        Called from the USB interrupt.
+    **/
+    void InComplete(bool unhalted);
+
+    /**
+        Note a finished OUT transfer of \a count bytes, or a cancelled one.
+        Called from the USB interrupt.
+    **/
+    void OutComplete(bool done, uint32_t count);
+
+    /**
+        Note a Bulk-Only Mass Storage Reset request from the host.
+    **/
+    void ResetRequest() {
+        m_reset = true;
+    }
+#endif
+
+    /**
+        \brief Present the SD card to the host.
+
+        Brings the card up if it is not up yet.
+
+        \param[in] writable True to let the host write to the card.
+
+        \return True if the card is presented; false if the library was
+        built without CONF_USB_MSC_EN or no card is ready.
+    **/
+    bool Start(bool writable = false);
+
+    /**
+        \brief Report the medium removed to the host.
+
+        The host sees an empty drive until Start() is called again. The
+        command the host is running, if any, finishes first.
+    **/
+    void Stop();
+
+    /**
+        \brief Check whether the card is presented to the host.
+    **/
+    bool Started() {
+        return m_started;
+    }
+
+    /**
+        \brief Check whether the host has configured the mass storage
+        interface.
+    **/
+    bool Connected() {
+        return m_enabled;
+    }
+
+    /**
+        \brief Carry out the host's commands.
+
+        Call regularly from the main loop; the transfer rate depends on how
+        often it is called.
+    **/
+    void Refresh();
+
+    /**
+        \brief The number of blocks the host has read.
+    **/
+    uint32_t BlocksRead() {
+        return m_blocksRead;
+    }
+
+    /**
+        \brief The number of blocks the host has written.
+    **/
+    uint32_t BlocksWritten() {
+        return m_blocksWritten;
+    }
+
+private:
+    typedef enum {
+        // Waiting for a command block
+        MSC_COMMAND,
+        // Sending data to the host
+        MSC_DATA_IN,
+        // Receiving data from the host
+        MSC_DATA_OUT,
+        // Waiting for the host to clear the halted IN endpoint
+        MSC_HALTED,
+        // Sending the status block
+        MSC_STATUS,
+        // Waiting for a reset after an invalid command block
+        MSC_INVALID,
+    } MscStates;
+
+    // The command block wrapper, and the status block wrapper sent back
+    uint8_t m_cbw[32] __attribute__((aligned(4)));
+    uint8_t m_csw[16] __attribute__((aligned(4)));
+    uint8_t m_buffer[2][USB_MSC_BUFFER_SIZE] __attribute__((aligned(4)));
+    // Bytes ready in each buffer; sent to the host, or written to the card
+    uint32_t m_bufferBytes[2];
+    // The buffer handed to the USB transfer, and the one handed to the card
+    uint8_t m_bufferUsb;
+    uint8_t m_bufferCard;
+
+    MscStates m_state;
+    bool m_enabled;
+    bool m_started;
+    bool m_writable;
+    // Report a medium change on the next command
+    bool m_mediaChanged;
+
+    // Set by the USB interrupt and taken by Refresh()
+    volatile bool m_outDone;
+    volatile uint32_t m_outCount;
+    volatile bool m_inDone;
+    volatile bool m_inUnhalted;
+    // The OUT transfer ended without data, or the endpoint was cleared
+    volatile bool m_outCancelled;
+    volatile bool m_reset;
+    bool m_cbwPosted;
+    bool m_usbBusy;
+
+    // The command being carried out
+    uint32_t m_tag;
+    uint32_t m_residue;
+    uint8_t m_status;
+    bool m_dirIn;
+    // Blocks still to be moved to or from the card, and the next one
+    uint32_t m_cardBlocks;
+    uint32_t m_cardBlock;
+    // Blocks still to be received from the host, and the bytes asked for by
+    // the transfer in progress
+    uint32_t m_usbBlocks;
+    uint32_t m_usbBytes;
+    bool m_cardFailed;
+
+    // Sense data of the last failed command
+    uint8_t m_senseKey;
+    uint8_t m_senseAsc;
+
+    uint32_t m_blocksRead;
+    uint32_t m_blocksWritten;
+
+    /**
+        Construct
+    **/
+    UsbMassStorage();
+
+    void StateReset();
+    void CommandRun();
+    bool Ready();
+    void Fail(uint8_t senseKey, uint8_t asc);
+    void ReplySend(uint32_t length);
+    void ReadStart(uint32_t block, uint32_t count);
+    void WriteStart(uint32_t block, uint32_t count);
+    bool UsbSend();
+    void DataInRefresh();
+    void DataOutRefresh();
+    void DataEnd();
+    void StatusSend();
+}; // UsbMassStorage
+
+} // ClearCore namespace
+
+#endif // __USBMASSSTORAGE_H__
@@ -0,0 +1,294 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    \file XBeeApi.h
+    \brief ClearCore XBee API mode frames.
+
+    Sends and receives XBee API frames, with or without escaping, over a
+    serial port.
+**/
+
+#ifndef __XBEEAPI_H__
+#define __XBEEAPI_H__
+
+#include <stdint.h>
+#include "ISerial.h"
+
+namespace ClearCore {
+
+/// The largest frame data, frame type included, that can be received
+#ifndef XBEE_API_FRAME_MAX
+#define XBEE_API_FRAME_MAX 128
+#endif
+
+/// The number of receive frame buffers
+#ifndef XBEE_API_FRAME_POOL
+#define XBEE_API_FRAME_POOL 4
+#endif
+
+/// The number of frame types that may have a callback
+#define XBEE_API_CALLBACK_MAX 8
+
+/// The number of transmit requests whose status is kept
+#define XBEE_API_TX_TRACK_MAX 8
+
+/**
+    \class XBeeApi
+    \brief ClearCore XBee API mode frames.
+
+    Runs the XBee API protocol (AP=1, or AP=2 with escaping) on a serial
+    port, usually the XBee connector. Frames are assembled as the characters
+    arrive directly into a small pool of frame buffers and their checksums
+    are verified. Each good frame is passed to the callback registered for
+    its frame type or, if there is none, queued for FrameGet().
+
+    Transmit status frames are matched to the frame IDs of the requests sent
+    with TransmitRequest(), so delivery can be checked with TransmitStatus().
+
+    \code{.cpp}
+    XBeeApi Radio(XBee);
+
+    void RxPacket(const XBeeApi::Frame &frame) {
+        // frame.Data[12] onward is the received RF data of a 0x90 frame
+    }
+
+    int main() {
+        XBee.Speed(115200);
+        XBee.PortOpen();
+        Radio.FrameCallback(0x90, RxPacket);
+
+        uint8_t telemetry[] = {1, 2, 3, 4};
+        uint8_t frameId = Radio.TransmitRequest(0x0013A20012345678,
+                                                telemetry, sizeof(telemetry));
+        while (true) {
+            Radio.Poll();
+        }
+    }
+    \endcode
+**/
+class XBeeApi {
+public:
+    /**
+        The XBee API mode.
+    **/
+    typedef enum {
+        /// AP=1, no escaping
+        API_MODE_UNESCAPED = 1,
+        /// AP=2, control characters escaped
+        API_MODE_ESCAPED = 2,
+    } ApiModes;
+
+    /**
+        The delivery state of a transmit request.
+    **/
+    typedef enum {
+        /// The frame ID is not being tracked
+        TX_UNKNOWN,
+        /// Waiting for the transmit status frame
+        TX_PENDING,
+        /// The XBee reported a successful delivery
+        TX_DELIVERED,
+        /// The XBee reported a failed delivery
+        TX_FAILED,
+    } TxStates;
+
+    /**
+        \brief One received API frame.
+    **/
+    struct Frame {
+        /// The number of bytes in Data
+        uint16_t Length;
+        /// The frame data; Data[0] is the frame type
+        uint8_t Data[XBEE_API_FRAME_MAX];
+    };
+
+    /**
+        A function called with each received frame of a type. The frame is
+        released when the function returns.
+    **/
+    typedef void (*FrameCallbackFunction)(const Frame &frame);
+
+    /**
+        \brief Construct an API frame engine on a serial port.
+
+        \param[in] port The serial port. It must be opened in UART mode
+        before Poll() is called.
+        \param[in] mode The API mode the XBee is set to.
+    **/
+    explicit XBeeApi(ISerial &port, ApiModes mode = API_MODE_ESCAPED);
+
+    /**
+        \brief Set the function to call with each frame of a type.
+
+        \code{.cpp}
+        // Handle Receive Packet frames
+        Radio.FrameCallback(0x90, RxPacket);
+        \endcode
+
+        \param[in] frameType The frame type.
+        \param[in] callback The function, or NULL to queue the frames for
+        FrameGet() again.
+
+        \return True if the callback was set; false if
+        #XBEE_API_CALLBACK_MAX types already have callbacks.
+    **/
+    bool FrameCallback(uint8_t frameType, FrameCallbackFunction callback);
+
+    /**
+        \brief Send an API frame.
+
+        \code{.cpp}
+        // Query the XBee's firmware version with AT command VR, frame ID 1
+        uint8_t atCommand[] = {0x08, 0x01, 'V', 'R'};
+        Radio.FrameSend(atCommand, sizeof(atCommand));
+        \endcode
+
+        \param[in] data The frame data, starting with the frame type.
+        \param[in] length The number of bytes in \a data.
+
+        \return True if the frame was sent.
+    **/
+    bool FrameSend(const uint8_t *data, uint16_t length);
+
+    /**
+        \brief Send RF data with a Transmit Request (0x10) frame.
+
+        \param[in] dest64 The 64-bit destination address.
+        \param[in] payload The RF data.
+        \param[in] length The number of bytes in \a payload.
+        \param[in] dest16 The 16-bit destination address, 0xFFFE if unknown.
+        \param[in] options The transmit options.
+
+        \return The frame ID used, for TransmitStatus(), or 0 if the frame was
+        not sent.
+    **/
+    uint8_t TransmitRequest(uint64_t dest64, const uint8_t *payload,
+                            uint16_t length, uint16_t dest16 = 0xFFFE,
+                            uint8_t options = 0);
+
+    /**
+        \brief The delivery state of a transmit request.
+
+        \code{.cpp}
+        if (Radio.TransmitStatus(frameId) == XBeeApi::TX_FAILED) {
+            // Resend
+        }
+        \endcode
+
+        \param[in] frameId The ID returned by TransmitRequest().
+        \param[out] deliveryStatus If not NULL, receives the delivery status
+        code of the transmit status frame.
+
+        \return The delivery state.
+    **/
+    TxStates TransmitStatus(uint8_t frameId, uint8_t *deliveryStatus = NULL);
+
+    /**
+        \brief Take the oldest received frame that has no callback.
+
+        \return The frame, or NULL if none are waiting. Pass it to
+        FrameRelease() once it has been handled.
+    **/
+    Frame *FrameGet();
+
+    /**
+        \brief Return a frame from FrameGet() to the pool.
+
+        \param[in] frame The frame.
+    **/
+    void FrameRelease(Frame *frame);
+
+    /**
+        \brief The number of frames dropped for a bad checksum, a length
+        over #XBEE_API_FRAME_MAX, or no free frame buffer.
+    **/
+    uint32_t FrameErrors() {
+        return m_frameErrors;
+    }
+
+    /**
+        \brief Receive frames and call their callbacks.
+
+        Call repeatedly from the main loop.
+    **/
+    void Poll();
+
+private:
+    typedef enum {
+        RX_START,
+        RX_LENGTH_MSB,
+        RX_LENGTH_LSB,
+        RX_DATA,
+        RX_CHECKSUM,
+    } RxStates;
+
+    struct TxTrack {
+        uint8_t FrameId;
+        uint8_t DeliveryStatus;
+        TxStates State;
+    };
+
+    ISerial &m_port;
+    ApiModes m_mode;
+
+    // Frame pool; a set bit marks a buffer in use
+    Frame m_pool[XBEE_API_FRAME_POOL];
+    uint8_t m_poolUsed;
+    // Frames waiting for FrameGet(), oldest first
+    Frame *m_ready[XBEE_API_FRAME_POOL];
+    uint8_t m_readyCount;
+
+    // Receive state
+    RxStates m_rxState;
+    bool m_rxEscape;
+    uint16_t m_rxLength;
+    uint16_t m_rxIndex;
+    uint8_t m_rxSum;
+    Frame *m_rxFrame;
+    uint32_t m_frameErrors;
+
+    uint8_t m_callbackTypes[XBEE_API_CALLBACK_MAX];
+    FrameCallbackFunction m_callbacks[XBEE_API_CALLBACK_MAX];
+    uint8_t m_callbackCount;
+
+    TxTrack m_txTrack[XBEE_API_TX_TRACK_MAX];
+    uint8_t m_txTrackNext;
+    uint8_t m_txFrameId;
+
+    // Escaped characters waiting to be sent
+    uint8_t m_txChunk[32];
+    uint8_t m_txChunkLength;
+
+    void RxByte(uint8_t data);
+    void FrameDone(Frame *frame);
+    Frame *FrameAlloc();
+    void TxStatusUpdate(uint8_t frameId, uint8_t deliveryStatus);
+    bool FrameSendParts(const uint8_t *header, uint16_t headerLength,
+                        const uint8_t *payload, uint16_t payloadLength);
+    bool TxByte(uint8_t data, bool escape = true);
+    bool TxFlush();
+}; // XBeeApi
+
+} // ClearCore namespace
+
+#endif // __XBEEAPI_H__
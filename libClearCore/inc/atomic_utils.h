@@ -55,6 +55,8 @@
 #define atomic_load_n(ptr) __atomic_load_n(ptr, __ATOMIC_CONSUME)
 #define atomic_load_n_relaxed(ptr) __atomic_load_n(ptr, __ATOMIC_RELAXED)
 
+#define atomic_thread_fence() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
 #define atomic_exchange(ptr, val, ret)                                         \
     __atomic_exchange(ptr, val, ret, __ATOMIC_ACQ_REL)
 #define atomic_exchange_n(ptr, val)                                            \
@@ -28,18 +28,26 @@
 
 #include "AdcManager.h"
 #include <cstring>
+#include <math.h>
 #include <stdio.h>
 #include <sam.h>
+#include "atomic_utils.h"
 #include "DmaManager.h"
 #include "HardwareMapping.h"
+#include "MotorDriver.h"
 #include "ShiftRegister.h"
 #include "StatusManager.h"
+#include "StepGenerator.h"
+#include "SysTiming.h"
 #include "SysUtils.h"
 
 namespace ClearCore {
 
+extern EventManager &EventMgr;
 extern ShiftRegister ShiftReg;
 extern StatusManager &StatusMgr;
+extern InputManager &InputMgr;
+extern volatile uint32_t tickCnt;
 AdcManager &AdcMgr = AdcManager::Instance();
 
 constexpr float AdcManager::ADC_INITIAL_FILTER_VALUE_V[ADC_CHANNEL_COUNT];
@@ -48,47 +56,103 @@ constexpr float AdcManager::ADC_CHANNEL_MAX_FLOAT[ADC_CHANNEL_COUNT];
 // Uncomment to generate an interrupt when the ADC result DMA transfer completes
 //#define DEBUG_ADC_RESULT_TIMING
 
+// The ADC clock, GCLK4 / 4
+#define ADC_CLOCK_HZ 12000000
+// The regular sample length, in ADC clocks
+#define ADC_SAMPLEN_DEFAULT 31
+// ADC clocks per 12-bit conversion beyond the sample length, with margin
+#define ADC_CONVERSION_CLOCKS 16
+
+// Captures are paced by TC7 overflow events. TC7 shares TC6's GCLK6 clock.
+// Input-triggered captures start the timer with an EIC event on a channel of
+// their own.
+#define ADC_CAPTURE_TIMER TC7
+#define ADC_CAPTURE_TIMER_HZ 2048000
+// Continuous conversions are paced by the same timer, starting one channel
+// per overflow so that a pass of every channel takes about a sample time
+#define ADC_CONTINUOUS_PERIOD \
+    (ADC_CAPTURE_TIMER_HZ / (SampleRateHz * AdcManager::ADC_CHANNEL_COUNT))
+#define ADC_CONTINUOUS_CLOCKS \
+    (ADC_CLOCK_HZ / (ADC_CAPTURE_TIMER_HZ / ADC_CONTINUOUS_PERIOD))
+
 /**
-    ADC conversion results DMA data destination
+    ADC conversion results, by channel
 **/
 volatile uint16_t AdcResultsRaw[AdcManager::ADC_CHANNEL_COUNT] = {0};
 
 /**
-    ADC channel selection DMA data source structure
+    ADC channel selection DMA data source structure. Each register enabled in
+    DSEQCTRL is loaded from its own word of the sequence, in register order.
 **/
-union adcDSeqCfg {
-    struct {
-        ADC_INPUTCTRL_Type INPUTCTRL; ///< Offset: 0x04 (R/W 16) Input Control
-        ADC_CTRLB_Type CTRLB;         ///< Offset: 0x06 (R/W 16) Control B
-    } bit;
-    uint32_t reg;
-#ifdef __cplusplus
-    adcDSeqCfg() {
-        reg = 0;
-    }
-    adcDSeqCfg(uint16_t inputCtrl, uint16_t ctrlb) {
-        bit.INPUTCTRL.reg = inputCtrl;
-        bit.CTRLB.reg = ctrlb;
-    }
-#endif
+struct adcDSeqCfg {
+    uint32_t INPUTCTRL; ///< Input Control
+    uint32_t CTRLB;     ///< Control B (resolution)
+    uint32_t AVGCTRL;   ///< Average Control (oversampling)
+};
+
+// ADC channel selection settings
+// The first word is the full INPUTCTRL register value that will be loaded
+// into the ADC. CTRLB and AVGCTRL are filled in by SequenceUpdate() from the
+// resolution and the per-channel oversampling.
+// Note: index matched to AdcChannels
+static adcDSeqCfg adcSequence[AdcManager::ADC_CHANNEL_COUNT] = {
+    {ADC_INPUTCTRL_MUXPOS_AIN4, 0, 0},
+    {ADC_INPUTCTRL_MUXPOS_AIN5, 0, 0},
+    {ADC_INPUTCTRL_MUXPOS_AIN6, 0, 0},
+    {ADC_INPUTCTRL_MUXPOS_AIN7, 0, 0},
+    {ADC_INPUTCTRL_MUXPOS_AIN8, 0, 0},
+    {ADC_INPUTCTRL_MUXPOS_AIN9, 0, 0},
+    {ADC_INPUTCTRL_MUXPOS_AIN10, 0, 0},
+    {ADC_INPUTCTRL_MUXPOS_AIN11, 0, 0},
 };
 
 // ADC channel selection DMA data source
-// The first argument is the full INPUTCTRL register value that will be loaded
-// into the ADC
+// The channels due for conversion in the current sequence, copied from
+// adcSequence by SequenceSchedule()
 // Note: The last position also has the Sequence stop bit enabled
 //       to alert the ADC that the sequence is finished
-// Note: index matched to AdcChannels
-static const adcDSeqCfg adcSequence[AdcManager::ADC_CHANNEL_COUNT] = {
-    adcDSeqCfg(ADC_INPUTCTRL_MUXPOS_AIN4, 0),
-    adcDSeqCfg(ADC_INPUTCTRL_MUXPOS_AIN5, 0),
-    adcDSeqCfg(ADC_INPUTCTRL_MUXPOS_AIN6, 0),
-    adcDSeqCfg(ADC_INPUTCTRL_MUXPOS_AIN7, 0),
-    adcDSeqCfg(ADC_INPUTCTRL_MUXPOS_AIN8, 0),
-    adcDSeqCfg(ADC_INPUTCTRL_MUXPOS_AIN9, 0),
-    adcDSeqCfg(ADC_INPUTCTRL_MUXPOS_AIN10, 0),
-    adcDSeqCfg(ADC_INPUTCTRL_MUXPOS_AIN11 | ADC_INPUTCTRL_DSEQSTOP, 0),
-};
+static adcDSeqCfg adcActiveSequence[AdcManager::ADC_CHANNEL_COUNT];
+// ADC conversion results DMA data destination, in sequence order
+static volatile uint16_t adcActiveResults[AdcManager::ADC_CHANNEL_COUNT];
+
+// The capture's channel sequence, repeated for every frame
+static adcDSeqCfg captureSequence[AdcManager::ADC_CHANNEL_COUNT];
+// The second block of the capture double buffer. The first block uses the
+// channel's base descriptor, and each links to the other.
+static DmacDescriptor captureDescriptor __attribute__((aligned(16)));
+
+// The continuous conversion double buffer, in channel order, and the
+// descriptor of its second half
+static volatile uint16_t
+adcContinuousResults[2][AdcManager::ADC_CHANNEL_COUNT];
+static DmacDescriptor continuousDescriptor __attribute__((aligned(16)));
+
+/**
+    Whether a channel oversampled 2^samplesLog2 times finishes within its
+    slot of the continuous conversions.
+**/
+static bool ContinuousSlotFits(uint8_t samplesLog2) {
+    return ((ADC_SAMPLEN_DEFAULT + 1 + ADC_CONVERSION_CLOCKS) << samplesLog2)
+           <= ADC_CONTINUOUS_CLOCKS;
+}
+
+/**
+    The CTRLB RESSEL value of a resolution, or UINT8_MAX if it isn't
+    supported.
+**/
+static inline uint8_t ResolutionSelect(uint8_t resolution) {
+    switch (resolution) {
+        case 8:
+            return ADC_CTRLB_RESSEL_8BIT_Val;
+        case 10:
+            return ADC_CTRLB_RESSEL_10BIT_Val;
+        case 12:
+            return ADC_CTRLB_RESSEL_12BIT_Val;
+        // 16 bit is only used for oversampling
+        default:
+            return UINT8_MAX;
+    }
+}
 
 static inline void WaitAdc() {
     while (ADC1->STATUS.bit.ADCBUSY) {
@@ -105,14 +169,54 @@ AdcManager &AdcManager::Instance() {
     Constructor
 **/
 AdcManager::AdcManager()
-    : m_initialized(false),
+    : m_alarmsEnabled(0),
+      m_alarmsRT(0),
+      m_alarmsRisen(0),
+      m_alarmsFallen(0),
+      m_statsWindow(0),
+      m_initialized(false),
       m_AdcTimeout(false),
       m_shiftRegSnapshot(UINT32_MAX),
       m_shiftRegPending(UINT32_MAX),
       m_AdcResolution(ADC_RESOLUTION_DEFAULT),
       m_AdcResPending(ADC_RESOLUTION_DEFAULT),
       m_AdcTimeoutLimit(ADC_TIMEOUT_DEFAULT),
-      m_AdcBusyCount(0) {}
+      m_AdcBusyCount(0),
+      m_captureState(CAPTURE_IDLE),
+      m_captureBuffer(nullptr),
+      m_captureBlockLength(0),
+      m_captureChannelCount(0),
+      m_capturePeriod(0),
+      m_captureSampLen(0),
+      m_captureTriggered(false),
+      m_captureRateHz(0),
+      m_captureStartUs(0),
+      m_captureStartTick(0),
+      m_triggerExtInt(-1),
+      m_triggerAxis(nullptr),
+      m_triggerEvent(CAPTURE_EVENT_MOVE_DONE),
+      m_triggerPosn(0),
+      m_triggerLast(0),
+      m_captureBurst(false),
+      m_captureWritten(0),
+      m_captureRead(0),
+      m_captureOverruns(0),
+      m_AdcSequenceSamples(0),
+      m_sequenceChange(false),
+      m_seqCount(0),
+      m_continuous(false),
+      m_continuousPending(false),
+      m_continuousBlocks(0),
+      m_continuousRead(0),
+      m_continuousSkip(false) {
+    for (uint8_t i = 0; i < ADC_CHANNEL_COUNT; i++) {
+        StatsClear(m_statsRun[i]);
+        StatsClear(m_statsDone[i]);
+        m_sampleDivider[i] = 1;
+        m_divideCount[i] = 0;
+        m_alarms[i] = Alarm();
+    }
+}
 
 /**
     Initialize the ADC to power-up state.
@@ -126,10 +230,20 @@ void AdcManager::Initialize() {
     m_AdcResPending = ADC_RESOLUTION_DEFAULT;
     m_AdcTimeoutLimit = ADC_TIMEOUT_DEFAULT;
     m_AdcBusyCount = 0;
+    m_captureState = CAPTURE_IDLE;
+    m_sequenceChange = false;
+    m_continuous = false;
+    m_continuousPending = false;
+    for (uint8_t i = 0; i < ADC_CHANNEL_COUNT; i++) {
+        m_oversamplePending[i] = 0;
+        m_resolutionPending[i] = 0;
+        m_sampleDivider[i] = 1;
+        m_divideCount[i] = 0;
+    }
 
     // Set default filter constants
     for (uint8_t i = 0; i < ADC_CHANNEL_COUNT; i++) {
-        m_analogFilter[i].Tc_ms(ADC_IIR_FILTER_TC_MS);
+        m_analogFilter.Tc_ms(i, ADC_IIR_FILTER_TC_MS);
     }
 
     // Configure internal analog inputs: Sdrvr2, Sdrvr3, VBus, 5V Ob monitor
@@ -157,6 +271,8 @@ void AdcManager::Initialize() {
 
     // Enables the peripheral clock to ADC1
     CLOCK_ENABLE(APBDMASK, ADC1_);
+    // Enables the bus clock to the capture timer
+    CLOCK_ENABLE(APBDMASK, TC7_);
 
     // Reset the ADC1 module
     ADC1->CTRLA.bit.SWRST = 1;
@@ -176,9 +292,13 @@ void AdcManager::Initialize() {
     // Setup the DMA input/result transfers
     DmaInit();
 
-    // Update INPUTCTRL from the DMA engine
+    // Update INPUTCTRL, CTRLB, and AVGCTRL from the DMA engine
     ADC1->DSEQCTRL.bit.INPUTCTRL = 1;
     SYNCBUSY_WAIT(ADC1, ADC_SYNCBUSY_INPUTCTRL);
+    ADC1->DSEQCTRL.bit.CTRLB = 1;
+    SYNCBUSY_WAIT(ADC1, ADC_SYNCBUSY_CTRLB);
+    ADC1->DSEQCTRL.bit.AVGCTRL = 1;
+    SYNCBUSY_WAIT(ADC1, ADC_SYNCBUSY_AVGCTRL);
     ADC1->DSEQCTRL.bit.AUTOSTART = 1;
 
     // Enable reference buffer compensation and set the reference to VDDANA
@@ -189,13 +309,15 @@ void AdcManager::Initialize() {
     // Note: setting sample length fairly long since the ADC readings will be
     // performed in the background, which results in more reliable readings.
     // Setting the sample length to 31 uses approximately 20% of the available
-    // time when doing 8 12-bit readings per 5 kHz interrupt slot.
-    ADC1->SAMPCTRL.reg = ADC_SAMPCTRL_SAMPLEN(31);
+    // time when doing 8 12-bit readings per 5 kHz interrupt slot (40% at the
+    // fastest supported sample rate).
+    ADC1->SAMPCTRL.reg = ADC_SAMPCTRL_SAMPLEN(ADC_SAMPLEN_DEFAULT);
     SYNCBUSY_WAIT(ADC1, ADC_SYNCBUSY_SAMPCTRL);
 
     ADC1->DBGCTRL.bit.DBGRUN = 1;
 
     // Kick off the first ADC conversion
+    SequenceSchedule();
     DmaUpdate();
 
     // Enable ADC
@@ -218,7 +340,7 @@ void AdcManager::Initialize() {
                        ADC_CHANNEL_MAX_FLOAT[i];
         m_AdcResultsConverted[i] = val;
         m_AdcResultsConvertedFiltered[i] = val;
-        m_analogFilter[i].Reset(val);
+        m_analogFilter.Reset(i, val);
     }
 
     m_initialized = true;
@@ -232,12 +354,67 @@ void AdcManager::Update() {
         return;
     }
 
+    switch (m_captureState) {
+        case CAPTURE_IDLE:
+            break;
+        case CAPTURE_STARTING:
+            // Wait for the regular sequence in progress to finish; the
+            // continuous conversions can be cut off anywhere
+            if (m_continuous || (!ADC1->STATUS.bit.ADCBUSY &&
+                                 !DmaManager::Channel(DMA_ADC_RESULTS)->
+                                 CHCTRLA.bit.ENABLE)) {
+                CaptureBegin();
+            }
+            break;
+        case CAPTURE_ARMED:
+            // The input edge has started the timer through EVSYS
+            if (m_triggerExtInt >= 0 &&
+                    (EIC->INTFLAG.reg & (1UL << m_triggerExtInt))) {
+                m_captureStartUs = Microseconds();
+                m_captureStartTick = tickCnt;
+                m_captureState = CAPTURE_RUNNING;
+            }
+            break;
+        case CAPTURE_STOPPING:
+            CaptureEnd();
+            break;
+        default:
+            break;
+    }
+
+    // The capture owns the ADC; hold the last regular results
+    if (m_captureState != CAPTURE_IDLE) {
+        FilterUpdate();
+        AlarmUpdate();
+        return;
+    }
+
+    if (m_continuousPending != m_continuous) {
+        if (m_continuous) {
+            AdcHalt();
+            RegularBegin();
+        }
+        else if (!ADC1->STATUS.bit.ADCBUSY &&
+                 !DmaManager::Channel(DMA_ADC_RESULTS)->CHCTRLA.bit.ENABLE) {
+            // Switch over between regular sequences
+            ContinuousBegin();
+        }
+    }
+
+    if (m_continuous) {
+        ContinuousUpdate();
+        FilterUpdate();
+        AlarmUpdate();
+        return;
+    }
+
     // If the previous conversion isn't complete or there are more conversions
     // still to be performed, increment the timeout counter
     if (ADC1->STATUS.bit.ADCBUSY ||
             DmaManager::Channel(DMA_ADC_RESULTS)->CHCTRLA.bit.ENABLE) {
         // If the counter is greater than the timeout, throw an error
-        if (++m_AdcBusyCount >= m_AdcTimeoutLimit) {
+        // Oversampled channels stretch the sequence over more samples
+        if (++m_AdcBusyCount >= m_AdcTimeoutLimit + m_AdcSequenceSamples) {
             m_AdcTimeout = true;
         }
     }
@@ -248,29 +425,89 @@ void AdcManager::Update() {
 
         // Copy the finished results into m_AdcResultsConverted and convert to
         // Q15
-        for (uint8_t i = 0; i < ADC_CHANNEL_COUNT; i++) {
-            // If HBridgeReset is set, do not update the VSupply value
-            if (i == ADC_VSUPPLY_MON && StatusMgr.StatusRT().bit.HBridgeReset) {
-                continue;
-            }
-            // Normalize the ADC results to a Q15 value
-            m_AdcResultsConverted[i] =
-                AdcResultsRaw[i] << (15 - m_AdcResolution);
+        for (uint8_t k = 0; k < m_seqCount; k++) {
+            ResultConvert(m_seqChannels[k], adcActiveResults[k]);
         }
 
         // Kick off next conversion sequence
-        if (m_AdcResolution != m_AdcResPending) {
+        if (m_AdcResolution != m_AdcResPending || m_sequenceChange) {
             AdcResChange();
         }
         m_shiftRegSnapshot = m_shiftRegPending;
         m_shiftRegPending = ShiftReg.LastOutput();
-        DmaUpdate();
+        SequenceSchedule();
+        if (m_seqCount) {
+            DmaUpdate();
+        }
     }
 
     // Apply IIR filtering even if the ADC values have not been updated
+    FilterUpdate();
+    AlarmUpdate();
+}
+
+void AdcManager::ResultConvert(uint8_t channel, uint16_t raw) {
+    AdcResultsRaw[channel] = raw;
+    // If HBridgeReset is set, do not update the VSupply value
+    if (channel == ADC_VSUPPLY_MON && StatusMgr.StatusRT().bit.HBridgeReset) {
+        return;
+    }
+    // Normalize the ADC results to a Q15 value
+    uint8_t bits = m_channelResolution[channel];
+    m_AdcResultsConverted[channel] = bits > 15 ? raw >> (bits - 15) :
+                                     raw << (15 - bits);
+    StatsUpdate(channel, m_AdcResultsConverted[channel]);
+}
+
+void AdcManager::ContinuousUpdate() {
+    uint32_t blocks = m_continuousBlocks;
+    if (blocks == m_continuousRead) {
+        // Each sample should complete a buffer; count the ones that don't
+        if (++m_AdcBusyCount >= m_AdcTimeoutLimit) {
+            m_AdcTimeout = true;
+        }
+        return;
+    }
+    m_AdcBusyCount = 0;
+    m_AdcTimeout = false;
+    m_continuousRead = blocks;
+    if (m_continuousSkip) {
+        // This pass was converted partly with the old settings
+        m_continuousSkip = false;
+        return;
+    }
+
+    // The other buffer is being filled and stays untouched for a pass
+    const volatile uint16_t *results = adcContinuousResults[(blocks - 1) & 1];
+    for (uint8_t i = 0; i < ADC_CHANNEL_COUNT; i++) {
+        ResultConvert(i, results[i]);
+    }
+    if (m_AdcResolution != m_AdcResPending || m_sequenceChange) {
+        // The DMA reads the new settings from the sequence as it goes
+        AdcResChange();
+        m_continuousSkip = true;
+    }
+    // The pass spanned the last sample time; a connector's readings are
+    // only good if it was in analog mode across all of it
+    m_shiftRegSnapshot = m_shiftRegPending | ShiftReg.LastOutput();
+    m_shiftRegPending = ShiftReg.LastOutput();
+}
+
+void AdcManager::FilterUpdate() {
+    const volatile uint16_t *replayResults = m_replayResults;
+    if (replayResults) {
+        for (uint8_t i = 0; i < ADC_CHANNEL_COUNT; i++) {
+            m_AdcResultsConverted[i] = replayResults[i];
+        }
+    }
+    m_analogFilter.Update(m_AdcResultsConverted,
+                          m_AdcResultsConvertedFiltered);
     for (uint8_t i = 0; i < ADC_CHANNEL_COUNT; i++) {
-        m_analogFilter[i].Update(m_AdcResultsConverted[i]);
-        m_AdcResultsConvertedFiltered[i] = m_analogFilter[i].LastOutput();
+        DspFilter<int16_t> *filter = m_customFilter[i];
+        if (filter) {
+            int16_t y = filter->Update(m_AdcResultsConverted[i]);
+            m_AdcResultsConvertedFiltered[i] = max(y, 0);
+        }
     }
 }
 
@@ -316,10 +553,10 @@ void AdcManager::DmaInit() {
     // transfer descriptor for the channel, point to 0 to stop transactions
     baseDesc->DESCADDR.reg = static_cast<uint32_t>(0);
     baseDesc->SRCADDR.reg = (uint32_t)&ADC1->RESULT.reg;
+    // The count and end address are set by SequenceSchedule()
     baseDesc->BTCNT.reg = ADC_CHANNEL_COUNT;
-
-    // End address
-    baseDesc->DSTADDR.reg = (uint32_t)(AdcResultsRaw + ADC_CHANNEL_COUNT);
+    baseDesc->DSTADDR.reg =
+        (uint32_t)(adcActiveResults + ADC_CHANNEL_COUNT);
     baseDesc->BTCTRL.reg =
         DMAC_BTCTRL_BEATSIZE_HWORD | DMAC_BTCTRL_DSTINC | DMAC_BTCTRL_VALID;
 
@@ -346,11 +583,12 @@ void AdcManager::DmaInit() {
     // Descriptors can work like linked lists. Since this is the only
     // transfer descriptor for the channel, point to 0 to stop transactions
     baseDesc->DESCADDR.reg = static_cast<uint32_t>(0);
-    // Point the src to the end of the adcSequence. The transfer will copy the
-    // data before the src addr.
-    baseDesc->SRCADDR.reg =
-        (reinterpret_cast<uint32_t>(&adcSequence)) + sizeof(adcSequence);
-    baseDesc->BTCNT.reg = ADC_CHANNEL_COUNT;
+    // Point the src to the end of the adcActiveSequence. The transfer will
+    // copy the data before the src addr. SequenceSchedule() shortens the
+    // transfer to the channels due.
+    baseDesc->SRCADDR.reg = (reinterpret_cast<uint32_t>(&adcActiveSequence)) +
+                            sizeof(adcActiveSequence);
+    baseDesc->BTCNT.reg = sizeof(adcActiveSequence) / sizeof(uint32_t);
     // The Destination is the ADC register for sequence data.
     // The sequence data is what will be moved into the ADC.
     baseDesc->DSTADDR.reg =
@@ -372,17 +610,10 @@ void AdcManager::DmaUpdate() {
 }
 
 bool AdcManager::AdcResolution(uint8_t resolution) {
-    switch (resolution) {
-        case 8:
-        case 10:
-        case 12:
-            m_AdcResPending = resolution;
-            break;
-        // 16 bit is not supported
-        default:
-            // Invalid value
-            return false;
+    if (ResolutionSelect(resolution) == UINT8_MAX) {
+        return false;
     }
+    m_AdcResPending = resolution;
     // Wait for the change to be applied in the interrupt
     while (m_AdcResPending != AdcResolution()) {
         continue;
@@ -390,28 +621,120 @@ bool AdcManager::AdcResolution(uint8_t resolution) {
     return true;
 }
 
+bool AdcManager::AdcOversampling(AdcChannels adcChannel, uint16_t samples) {
+    if (adcChannel >= ADC_CHANNEL_COUNT || !samples ||
+            samples > ADC_OVERSAMPLING_MAX || (samples & (samples - 1))) {
+        return false;
+    }
+    uint8_t samplesLog2 = 0;
+    while ((1U << samplesLog2) < samples) {
+        samplesLog2++;
+    }
+    if (m_continuousPending && !ContinuousSlotFits(samplesLog2)) {
+        return false;
+    }
+    m_oversamplePending[adcChannel] = samplesLog2;
+    m_sequenceChange = true;
+    // Wait for the change to be applied in the interrupt
+    while (m_sequenceChange) {
+        continue;
+    }
+    return true;
+}
+
+bool AdcManager::AdcChannelResolution(AdcChannels adcChannel,
+                                      uint8_t resolution) {
+    if (adcChannel >= ADC_CHANNEL_COUNT ||
+            (resolution && ResolutionSelect(resolution) == UINT8_MAX)) {
+        return false;
+    }
+    m_resolutionPending[adcChannel] = resolution;
+    m_sequenceChange = true;
+    // Wait for the change to be applied in the interrupt
+    while (m_sequenceChange) {
+        continue;
+    }
+    return true;
+}
+
+bool AdcManager::AdcSampleDivider(AdcChannels adcChannel, uint16_t divider) {
+    if (adcChannel >= ADC_CHANNEL_COUNT || !divider) {
+        return false;
+    }
+    m_sampleDivider[adcChannel] = divider;
+    // Convert in the next sequence and count from there
+    m_divideCount[adcChannel] = 0;
+    return true;
+}
+
 bool AdcManager::AdcResChange() {
-    switch (m_AdcResPending) {
-        case 8:
-            ADC1->CTRLB.bit.RESSEL = ADC_CTRLB_RESSEL_8BIT_Val;
-            break;
-        case 10:
-            ADC1->CTRLB.bit.RESSEL = ADC_CTRLB_RESSEL_10BIT_Val;
-            break;
-        case 12:
-            ADC1->CTRLB.bit.RESSEL = ADC_CTRLB_RESSEL_12BIT_Val;
-            break;
-        // 16 bit is not supported
-        default:
-            // Invalid value
-            return false;
+    uint8_t resSel = ResolutionSelect(m_AdcResPending);
+    if (resSel == UINT8_MAX) {
+        // Invalid value
+        return false;
     }
+    ADC1->CTRLB.bit.RESSEL = resSel;
 
     m_AdcResolution = m_AdcResPending;
+    SequenceUpdate();
 
     return true;
 }
 
+void AdcManager::SequenceUpdate() {
+    uint32_t conversions = 0;
+    for (uint8_t i = 0; i < ADC_CHANNEL_COUNT; i++) {
+        uint8_t samplesLog2 = m_oversamplePending[i];
+        m_oversampleLog2[i] = samplesLog2;
+        conversions += 1UL << samplesLog2;
+
+        if (!samplesLog2) {
+            uint8_t bits = m_resolutionPending[i] ? m_resolutionPending[i] :
+                           m_AdcResolution;
+            adcSequence[i].CTRLB = ADC_CTRLB_RESSEL(ResolutionSelect(bits));
+            adcSequence[i].AVGCTRL = 0;
+            m_channelResolution[i] = bits;
+            continue;
+        }
+        // Accumulate 12-bit conversions into the 16-bit result. Past 16
+        // samples the ADC shifts the sum right by itself to fit; shift the
+        // rest of the way so that each 4x of oversampling adds one bit.
+        uint8_t autoShift = samplesLog2 > 4 ? samplesLog2 - 4 : 0;
+        uint8_t shift = max((samplesLog2 + 1) / 2, autoShift);
+        adcSequence[i].CTRLB = ADC_CTRLB_RESSEL(ADC_CTRLB_RESSEL_16BIT_Val);
+        adcSequence[i].AVGCTRL = ADC_AVGCTRL_SAMPLENUM(samplesLog2) |
+                                 ADC_AVGCTRL_ADJRES(shift - autoShift);
+        m_channelResolution[i] = 12 + samplesLog2 - shift;
+    }
+    m_AdcSequenceSamples = (conversions - 1) / ADC_CONVERSIONS_PER_SAMPLE;
+    m_sequenceChange = false;
+}
+
+void AdcManager::SequenceSchedule() {
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < ADC_CHANNEL_COUNT; i++) {
+        if (m_divideCount[i] > 1) {
+            m_divideCount[i]--;
+            continue;
+        }
+        m_divideCount[i] = m_sampleDivider[i];
+        adcActiveSequence[count] = adcSequence[i];
+        m_seqChannels[count++] = i;
+    }
+    m_seqCount = count;
+    if (!count) {
+        return;
+    }
+    adcActiveSequence[count - 1].INPUTCTRL |= ADC_INPUTCTRL_DSEQSTOP;
+
+    DmacDescriptor *desc = DmaManager::BaseDescriptor(DMA_ADC_RESULTS);
+    desc->BTCNT.reg = count;
+    desc->DSTADDR.reg = reinterpret_cast<uint32_t>(adcActiveResults + count);
+    desc = DmaManager::BaseDescriptor(DMA_ADC_SEQUENCE);
+    desc->BTCNT.reg = count * sizeof(adcDSeqCfg) / sizeof(uint32_t);
+    desc->SRCADDR.reg = reinterpret_cast<uint32_t>(adcActiveSequence + count);
+}
+
 bool AdcManager::FilterTc(AdcChannels adcChannel,
                           uint16_t tc,
                           FilterUnits theUnits) {
@@ -421,13 +744,13 @@ bool AdcManager::FilterTc(AdcChannels adcChannel,
 
     switch (theUnits) {
         case AdcManager::FilterUnits::FILTER_UNIT_RAW:
-            m_analogFilter[adcChannel].Tc(tc);
+            m_analogFilter.Tc(adcChannel, tc);
             return true;
         case AdcManager::FilterUnits::FILTER_UNIT_MS:
-            m_analogFilter[adcChannel].Tc_ms(tc);
+            m_analogFilter.Tc_ms(adcChannel, tc);
             return true;
         case AdcManager::FilterUnits::FILTER_UNIT_SAMPLES:
-            m_analogFilter[adcChannel].TcSamples(tc);
+            m_analogFilter.TcSamples(adcChannel, tc);
             return true;
         default:
             // Error
@@ -435,6 +758,234 @@ bool AdcManager::FilterTc(AdcChannels adcChannel,
     }
 }
 
+bool AdcManager::FilterCustom(AdcChannels adcChannel,
+                              DspFilter<int16_t> *filter) {
+    if (adcChannel >= ADC_CHANNEL_COUNT) {
+        return false;
+    }
+    if (filter) {
+        filter->Reset(m_AdcResultsConvertedFiltered[adcChannel]);
+    }
+    m_customFilter[adcChannel] = filter;
+    if (!filter) {
+        // Resume the IIR filter from the custom filter's last output
+        __disable_irq();
+        m_analogFilter.Reset(adcChannel,
+                             m_AdcResultsConvertedFiltered[adcChannel]);
+        __enable_irq();
+    }
+    return true;
+}
+
+void AdcManager::StatsUpdate(uint8_t channel, uint16_t result) {
+    StatsAccum &accum = m_statsRun[channel];
+    accum.Count++;
+    accum.Min = min(accum.Min, result);
+    accum.Max = max(accum.Max, result);
+    accum.Sum += result;
+    accum.SumSq += static_cast<uint32_t>(result) * result;
+    if (m_statsWindow && accum.Count >= m_statsWindow) {
+        m_statsDone[channel] = accum;
+        StatsClear(accum);
+    }
+}
+
+bool AdcManager::StatsGet(AdcChannels adcChannel, AdcStats &stats,
+                          bool reset) {
+    if (adcChannel >= ADC_CHANNEL_COUNT) {
+        return false;
+    }
+    // Copy out under the lock and do the math afterward
+    __disable_irq();
+    StatsAccum accum = m_statsWindow ? m_statsDone[adcChannel] :
+                       m_statsRun[adcChannel];
+    if (reset && !m_statsWindow) {
+        StatsClear(m_statsRun[adcChannel]);
+    }
+    __enable_irq();
+
+    stats.Count = accum.Count;
+    if (!accum.Count) {
+        stats.Min = stats.Max = 0;
+        stats.Mean = stats.Rms = stats.StdDev = 0;
+        return false;
+    }
+    stats.Min = accum.Min;
+    stats.Max = accum.Max;
+    float mean = static_cast<float>(accum.Sum) / accum.Count;
+    float meanSq = static_cast<float>(accum.SumSq) / accum.Count;
+    stats.Mean = mean;
+    stats.Rms = sqrtf(meanSq);
+    stats.StdDev = sqrtf(max(meanSq - mean * mean, 0.0f));
+    return true;
+}
+
+bool AdcManager::StatsReset(AdcChannels adcChannel) {
+    if (adcChannel >= ADC_CHANNEL_COUNT) {
+        return false;
+    }
+    __disable_irq();
+    StatsClear(m_statsRun[adcChannel]);
+    StatsClear(m_statsDone[adcChannel]);
+    __enable_irq();
+    return true;
+}
+
+void AdcManager::StatsWindow(uint32_t results) {
+    __disable_irq();
+    m_statsWindow = results;
+    for (uint8_t i = 0; i < ADC_CHANNEL_COUNT; i++) {
+        StatsClear(m_statsRun[i]);
+        StatsClear(m_statsDone[i]);
+    }
+    __enable_irq();
+}
+
+bool AdcManager::AlarmSet(AdcChannels adcChannel, AlarmModes mode,
+                          uint16_t low, uint16_t high, uint16_t hysteresis,
+                          uint16_t samples) {
+    if (adcChannel >= ADC_CHANNEL_COUNT || mode > ALARM_OUTSIDE ||
+            !samples || ((mode == ALARM_INSIDE || mode == ALARM_OUTSIDE) &&
+                         low > high)) {
+        return false;
+    }
+    // Hold the channel out of the sample interrupt while it changes
+    uint8_t bit = 1U << adcChannel;
+    atomic_fetch_and(&m_alarmsEnabled, ~bit);
+    Alarm &alarm = m_alarms[adcChannel];
+    alarm.Mode = mode;
+    alarm.Low = low;
+    alarm.High = high;
+    alarm.Hysteresis = hysteresis;
+    alarm.Samples = samples;
+    alarm.Count = 0;
+    atomic_or_fetch(&m_alarmsEnabled, bit);
+    return true;
+}
+
+bool AdcManager::AlarmClear(AdcChannels adcChannel) {
+    if (adcChannel >= ADC_CHANNEL_COUNT) {
+        return false;
+    }
+    uint8_t bit = 1U << adcChannel;
+    atomic_fetch_and(&m_alarmsEnabled, ~bit);
+    Alarm &alarm = m_alarms[adcChannel];
+    if ((m_alarmsRT & bit) && alarm.Output) {
+        alarm.Output->State(!alarm.OutputActive);
+    }
+    if (atomic_fetch_and(&m_alarmsRT, ~bit) & bit) {
+        atomic_or_fetch(&m_alarmsFallen, bit);
+    }
+    alarm.Motor = nullptr;
+    alarm.Output = nullptr;
+    return true;
+}
+
+bool AdcManager::AlarmMotorStop(AdcChannels adcChannel, MotorDriver *motor,
+                                bool abrupt) {
+    if (adcChannel >= ADC_CHANNEL_COUNT) {
+        return false;
+    }
+    __disable_irq();
+    m_alarms[adcChannel].Motor = motor;
+    m_alarms[adcChannel].Abrupt = abrupt;
+    __enable_irq();
+    return true;
+}
+
+bool AdcManager::AlarmOutput(AdcChannels adcChannel, Connector *output,
+                             bool activeState) {
+    if (adcChannel >= ADC_CHANNEL_COUNT ||
+            (output && !output->IsWritable())) {
+        return false;
+    }
+    __disable_irq();
+    Alarm &alarm = m_alarms[adcChannel];
+    alarm.Output = output;
+    alarm.OutputActive = activeState;
+    if (output) {
+        output->State((m_alarmsRT & (1U << adcChannel)) ? activeState :
+                      !activeState);
+    }
+    __enable_irq();
+    return true;
+}
+
+uint8_t AdcManager::AlarmsRisen(uint8_t mask) {
+    return atomic_fetch_and(&m_alarmsRisen, ~mask) & mask;
+}
+
+uint8_t AdcManager::AlarmsFallen(uint8_t mask) {
+    return atomic_fetch_and(&m_alarmsFallen, ~mask) & mask;
+}
+
+ISR_RAMFUNC void AdcManager::AlarmUpdate() {
+    uint8_t enabled = m_alarmsEnabled;
+    if (!enabled) {
+        return;
+    }
+    uint8_t alarmsRT = m_alarmsRT;
+    for (uint8_t i = 0; i < ADC_CHANNEL_COUNT; i++) {
+        uint8_t bit = 1U << i;
+        if (!(enabled & bit)) {
+            continue;
+        }
+        Alarm &alarm = m_alarms[i];
+        int32_t value = m_AdcResultsConvertedFiltered[i];
+        bool asserted = alarmsRT & bit;
+        // An asserted alarm holds until the result is back past the
+        // hysteresis band
+        int32_t band = asserted ? alarm.Hysteresis : 0;
+        bool above = value > alarm.High - band;
+        bool below = value < alarm.Low + band;
+        bool condition;
+        switch (alarm.Mode) {
+            case ALARM_ABOVE:
+                condition = above;
+                break;
+            case ALARM_BELOW:
+                condition = below;
+                break;
+            case ALARM_INSIDE:
+                condition = value >= alarm.Low - band &&
+                            value <= alarm.High + band;
+                break;
+            case ALARM_OUTSIDE:
+            default:
+                condition = above || below;
+                break;
+        }
+
+        if (!condition) {
+            alarm.Count = 0;
+            if (!asserted) {
+                continue;
+            }
+            alarmsRT &= ~bit;
+            m_alarmsFallen |= bit;
+            if (alarm.Output) {
+                alarm.Output->State(!alarm.OutputActive);
+            }
+        }
+        else if (!asserted && ++alarm.Count >= alarm.Samples) {
+            alarmsRT |= bit;
+            m_alarmsRisen |= bit;
+            if (alarm.Output) {
+                alarm.Output->State(alarm.OutputActive);
+            }
+            if (alarm.Motor) {
+                if (alarm.Abrupt) {
+                    alarm.Motor->MoveStopAbrupt();
+                }
+                else {
+                    alarm.Motor->MoveStopDecel();
+                }
+            }
+        }
+    }
+    m_alarmsRT = alarmsRT;
+}
+
 uint16_t AdcManager::FilterTc(AdcChannels adcChannel,
                               FilterUnits theUnits) {
     if (adcChannel >= ADC_CHANNEL_COUNT) {
@@ -443,24 +994,498 @@ uint16_t AdcManager::FilterTc(AdcChannels adcChannel,
 
     switch (theUnits) {
         case AdcManager::FilterUnits::FILTER_UNIT_RAW:
-            return m_analogFilter[adcChannel].Tc();
+            return m_analogFilter.Tc(adcChannel);
         case AdcManager::FilterUnits::FILTER_UNIT_MS:
-            return m_analogFilter[adcChannel].Tc_ms();
+            return m_analogFilter.Tc_ms(adcChannel);
         case AdcManager::FilterUnits::FILTER_UNIT_SAMPLES:
-            return m_analogFilter[adcChannel].TcSamples();
+            return m_analogFilter.TcSamples(adcChannel);
         default:
             // Error
             return 0;
     }
 }
 
-#ifdef DEBUG_ADC_RESULT_TIMING
+bool AdcManager::CaptureStart(const AdcChannels *channels,
+                              uint8_t channelCount, uint32_t rateHz,
+                              uint16_t *buffer, uint16_t frames,
+                              bool triggered) {
+    if (m_captureState != CAPTURE_IDLE || !channels || !buffer ||
+            !channelCount || channelCount > ADC_CHANNEL_COUNT || !rateHz ||
+            !frames ||
+            static_cast<uint32_t>(frames) * channelCount > UINT16_MAX) {
+        return false;
+    }
+
+    // The timer starts one conversion per overflow
+    uint32_t conversionHz = rateHz * channelCount;
+    if (rateHz > ADC_CAPTURE_TIMER_HZ / channelCount ||
+            ADC_CAPTURE_TIMER_HZ / conversionHz > UINT16_MAX) {
+        return false;
+    }
+    uint16_t period = ADC_CAPTURE_TIMER_HZ / conversionHz;
+    uint32_t clocks = ADC_CLOCK_HZ / (ADC_CAPTURE_TIMER_HZ / period);
+    // Shorten the sample length as far as needed to keep up
+    if (clocks <= ADC_CONVERSION_CLOCKS) {
+        return false;
+    }
+
+    uint32_t channelsUsed = 0;
+    for (uint8_t i = 0; i < channelCount; i++) {
+        AdcChannels channel = channels[i];
+        if (channel >= ADC_CHANNEL_COUNT || (channelsUsed & (1UL << channel))) {
+            return false;
+        }
+        channelsUsed |= 1UL << channel;
+        captureSequence[i].INPUTCTRL =
+            adcSequence[channel].INPUTCTRL & ~ADC_INPUTCTRL_DSEQSTOP;
+        captureSequence[i].CTRLB =
+            ADC_CTRLB_RESSEL(ADC_CTRLB_RESSEL_12BIT_Val);
+        captureSequence[i].AVGCTRL = 0;
+    }
+
+    m_captureBuffer = buffer;
+    m_captureBlockLength = static_cast<uint32_t>(frames) * channelCount;
+    m_captureChannelCount = channelCount;
+    m_capturePeriod = period;
+    m_captureSampLen = min(clocks - ADC_CONVERSION_CLOCKS,
+                           static_cast<uint32_t>(ADC_SAMPLEN_DEFAULT));
+    m_captureTriggered = triggered;
+    m_captureRateHz = ADC_CAPTURE_TIMER_HZ / (period * channelCount);
+    m_captureWritten = 0;
+    m_captureRead = 0;
+    m_captureOverruns = 0;
+
+    // Wait for the capture to be set up in the interrupt
+    m_captureState = CAPTURE_STARTING;
+    while (m_captureState == CAPTURE_STARTING) {
+        continue;
+    }
+    return true;
+}
+
+bool AdcManager::CaptureTrigger() {
+    if (m_captureState != CAPTURE_ARMED) {
+        return false;
+    }
+    TcCount16 *timer = &ADC_CAPTURE_TIMER->COUNT16;
+    m_captureStartUs = Microseconds();
+    m_captureStartTick = tickCnt;
+    timer->CTRLA.bit.ENABLE = 1;
+    m_captureState = CAPTURE_RUNNING;
+    return true;
+}
+
+bool AdcManager::CaptureTriggerInput(Connector &input,
+                                     InputManager::InterruptTrigger edge,
+                                     bool burst) {
+    int8_t extInt = input.ExternalInterrupt();
+    if (m_captureState != CAPTURE_ARMED || extInt < 0 ||
+            m_triggerExtInt >= 0 || m_triggerAxis) {
+        return false;
+    }
+
+    // Once enabled, the timer holds off counting until the start event
+    TcCount16 *timer = &ADC_CAPTURE_TIMER->COUNT16;
+    timer->EVCTRL.reg = TC_EVCTRL_OVFEO | TC_EVCTRL_TCEI |
+                        TC_EVCTRL_EVACT_START;
+    EventMgr.UserAdd(EVENT_ADC_TRIGGER, EVSYS_ID_USER_TC7_EVU);
+    InputMgr.EventRoute(extInt, edge, EVENT_ADC_TRIGGER);
+    // The edge's interrupt flag tells Update() when the capture started
+    EIC->INTFLAG.reg = 1UL << extInt;
+
+    m_captureBurst = burst;
+    m_triggerExtInt = extInt;
+    timer->CTRLA.bit.ENABLE = 1;
+    return true;
+}
+
+bool AdcManager::CaptureTriggerMotion(StepGenerator &axis,
+                                      CaptureMotionEvent event, int32_t posn,
+                                      bool burst) {
+    if (m_captureState != CAPTURE_ARMED || m_triggerExtInt >= 0 ||
+            m_triggerAxis) {
+        return false;
+    }
+    __disable_irq();
+    m_triggerEvent = event;
+    m_triggerPosn = posn;
+    m_captureBurst = burst;
+    m_triggerLast = event == CAPTURE_EVENT_MOVE_DONE ?
+                    axis.StepsComplete() :
+                    TriggerSide(axis.PositionRefCommanded(), posn);
+    m_triggerAxis = &axis;
+    __enable_irq();
+    return true;
+}
+
+/**
+    Register a process loop to be run each sample.
+
+    Returns true if there was room for the loop.
+**/
+bool AdcManager::PidLoopAdd(PidLoop *loop) {
+    if (m_pidLoopCount >= PID_LOOP_MAX) {
+        return false;
+    }
+    m_pidLoops[m_pidLoopCount] = loop;
+    // Publish the loop only once it is in the table
+    atomic_store_n(&m_pidLoopCount, m_pidLoopCount + 1);
+    return true;
+}
+
+ISR_RAMFUNC void AdcManager::PidRefresh() {
+    for (uint8_t i = 0; i < m_pidLoopCount; i++) {
+        m_pidLoops[i]->Update();
+    }
+}
+
+void AdcManager::CaptureMotionCheck() {
+    StepGenerator *axis = m_triggerAxis;
+    if (!axis || m_captureState != CAPTURE_ARMED) {
+        return;
+    }
+    bool fire;
+    if (m_triggerEvent == CAPTURE_EVENT_MOVE_DONE) {
+        bool done = axis->StepsComplete();
+        fire = done && !m_triggerLast;
+        m_triggerLast = done;
+    }
+    else {
+        int8_t side = TriggerSide(axis->PositionRefCommanded(), m_triggerPosn);
+        fire = !side || side != m_triggerLast;
+    }
+    if (fire) {
+        m_triggerAxis = nullptr;
+        CaptureTrigger();
+    }
+}
+
+void AdcManager::CaptureStop() {
+    if (m_captureState == CAPTURE_IDLE) {
+        return;
+    }
+    // Wait for the regular sequence to be restored in the interrupt
+    m_captureState = CAPTURE_STOPPING;
+    while (m_captureState != CAPTURE_IDLE) {
+        continue;
+    }
+}
+
+const uint16_t *AdcManager::CaptureBlock() {
+    uint32_t written = m_captureWritten;
+    if (written == m_captureRead) {
+        return nullptr;
+    }
+    // DMA has moved on to the block that wasn't read; the newest full block
+    // is the only one intact
+    if (written - m_captureRead > 1) {
+        m_captureOverruns += written - m_captureRead - 1;
+        m_captureRead = written - 1;
+    }
+    return m_captureBuffer + (m_captureRead & 1) * m_captureBlockLength;
+}
+
+void AdcManager::CaptureBlockRelease() {
+    if (m_captureRead != m_captureWritten) {
+        m_captureRead++;
+    }
+}
+
+void AdcManager::IrqHandlerCapture() {
+    m_captureWritten++;
+    if (m_captureBurst) {
+        ADC_CAPTURE_TIMER->COUNT16.CTRLBSET.reg = TC_CTRLBSET_CMD_STOP;
+    }
+    // The edge's interrupt flag was cleared by an input handler before
+    // Update() saw it; date the start back by the block's duration
+    if (m_captureState == CAPTURE_ARMED) {
+        uint32_t blockUs = static_cast<uint64_t>(m_captureBlockLength) *
+                           m_capturePeriod * 1000000 / ADC_CAPTURE_TIMER_HZ;
+        m_captureStartUs = Microseconds() - blockUs;
+        m_captureStartTick = tickCnt - blockUs / SAMPLE_PERIOD_MICROSECONDS;
+        m_captureState = CAPTURE_RUNNING;
+    }
+}
+
+void AdcManager::AdcHalt() {
+    TcCount16 *timer = &ADC_CAPTURE_TIMER->COUNT16;
+    timer->CTRLA.bit.ENABLE = 0;
+    SYNCBUSY_WAIT(timer, TC_SYNCBUSY_ENABLE);
+
+    ADC1->CTRLA.bit.ENABLE = 0;
+    SYNCBUSY_WAIT(ADC1, ADC_SYNCBUSY_ENABLE);
+
+    DmaChannels channels[] = {DMA_ADC_RESULTS, DMA_ADC_SEQUENCE};
+    for (uint8_t i = 0; i < 2; i++) {
+        DmacChannel *channel = DmaManager::Channel(channels[i]);
+        channel->CHCTRLA.reg &= ~DMAC_CHCTRLA_ENABLE;
+        while (channel->CHCTRLA.bit.ENABLE) {
+            continue;
+        }
+    }
+}
+
+void AdcManager::CaptureBegin() {
+    AdcHalt();
+
+    // Conversions are started by timer events instead of by the sequence
+    ADC1->INPUTCTRL.reg =
+        captureSequence[0].INPUTCTRL | ADC_INPUTCTRL_DSEQSTOP;
+    SYNCBUSY_WAIT(ADC1, ADC_SYNCBUSY_INPUTCTRL);
+    ADC1->DSEQCTRL.bit.AUTOSTART = 0;
+    ADC1->EVCTRL.reg = ADC_EVCTRL_STARTEI;
+    ADC1->SAMPCTRL.reg = ADC_SAMPCTRL_SAMPLEN(m_captureSampLen);
+    SYNCBUSY_WAIT(ADC1, ADC_SYNCBUSY_SAMPCTRL);
+
+    /***************************************************************
+     * DMA_ADC_RESULTS Channel
+     * Fill the two blocks of the capture buffer in turn, interrupting
+     * at the end of each.
+     ***************************************************************/
+    DmacChannel *channel = DmaManager::Channel(DMA_ADC_RESULTS);
+    DmacDescriptor *baseDesc = DmaManager::BaseDescriptor(DMA_ADC_RESULTS);
+    channel->CHCTRLA.reg = DMAC_CHCTRLA_SWRST;
+    while (channel->CHCTRLA.reg == DMAC_CHCTRLA_SWRST) {
+        continue;
+    }
+    channel->CHCTRLA.reg = DMAC_CHCTRLA_TRIGSRC(ADC1_DMAC_ID_RESRDY) |
+                           DMAC_CHCTRLA_TRIGACT_BURST |
+                           DMAC_CHCTRLA_BURSTLEN_SINGLE;
+    channel->CHINTFLAG.reg = DMAC_CHINTFLAG_TCMPL;
+    channel->CHINTENSET.reg = DMAC_CHINTENSET_TCMPL;
+    NVIC_EnableIRQ(DmaManager::Irq(DMA_ADC_RESULTS));
+
+    DmacDescriptor *blockDesc[2] = {baseDesc, &captureDescriptor};
+    for (uint8_t i = 0; i < 2; i++) {
+        blockDesc[i]->DESCADDR.reg =
+            reinterpret_cast<uint32_t>(blockDesc[1 - i]);
+        blockDesc[i]->SRCADDR.reg = (uint32_t)&ADC1->RESULT.reg;
+        blockDesc[i]->BTCNT.reg = m_captureBlockLength;
+        // End address
+        blockDesc[i]->DSTADDR.reg = reinterpret_cast<uint32_t>(
+                                        m_captureBuffer +
+                                        (i + 1) * m_captureBlockLength);
+        blockDesc[i]->BTCTRL.reg =
+            DMAC_BTCTRL_BEATSIZE_HWORD | DMAC_BTCTRL_DSTINC |
+            DMAC_BTCTRL_BLOCKACT_INT | DMAC_BTCTRL_VALID;
+    }
+
+    /***************************************************************
+     * DMA_ADC_SEQUENCE Channel
+     * Feed the capture channels to the ADC, looping on one descriptor.
+     ***************************************************************/
+    channel = DmaManager::Channel(DMA_ADC_SEQUENCE);
+    baseDesc = DmaManager::BaseDescriptor(DMA_ADC_SEQUENCE);
+    channel->CHCTRLA.reg = DMAC_CHCTRLA_SWRST;
+    while (channel->CHCTRLA.reg == DMAC_CHCTRLA_SWRST) {
+        continue;
+    }
+    channel->CHCTRLA.reg = DMAC_CHCTRLA_TRIGSRC(ADC1_DMAC_ID_SEQ) |
+                           DMAC_CHCTRLA_TRIGACT_BURST |
+                           DMAC_CHCTRLA_BURSTLEN_SINGLE;
+    baseDesc->DESCADDR.reg = reinterpret_cast<uint32_t>(baseDesc);
+    baseDesc->SRCADDR.reg = reinterpret_cast<uint32_t>(
+                                captureSequence + m_captureChannelCount);
+    baseDesc->BTCNT.reg =
+        m_captureChannelCount * sizeof(adcDSeqCfg) / sizeof(uint32_t);
+    baseDesc->DSTADDR.reg = reinterpret_cast<uint32_t>(&REG_ADC1_DSEQDATA);
+    baseDesc->BTCTRL.reg = DMAC_BTCTRL_BEATSIZE_WORD | DMAC_BTCTRL_STEPSEL_SRC |
+                           DMAC_BTCTRL_VALID | DMAC_BTCTRL_SRCINC;
+
+    // Pace the conversions with the timer's overflow events
+    TcCount16 *timer = &ADC_CAPTURE_TIMER->COUNT16;
+    timer->CTRLA.bit.SWRST = 1;
+    SYNCBUSY_WAIT(timer, TC_SYNCBUSY_SWRST);
+    timer->CTRLA.reg = TC_CTRLA_MODE_COUNT16 | TC_CTRLA_PRESCALER_DIV1;
+    timer->WAVE.reg = TC_WAVE_WAVEGEN_MFRQ;
+    timer->CC[0].reg = m_capturePeriod - 1;
+    SYNCBUSY_WAIT(timer, TC_SYNCBUSY_CC0);
+    timer->EVCTRL.reg = TC_EVCTRL_OVFEO;
+
+    EventMgr.UserAdd(EVENT_ADC_CAPTURE, EVSYS_ID_USER_ADC1_START);
+    EventMgr.Route(EVENT_ADC_CAPTURE, EVSYS_ID_GEN_TC7_OVF);
+
+    ADC1->CTRLA.bit.ENABLE = 1;
+    SYNCBUSY_WAIT(ADC1, ADC_SYNCBUSY_ENABLE);
+    // Load the first channel
+    DmaUpdate();
+
+    m_captureState = CAPTURE_ARMED;
+    if (!m_captureTriggered) {
+        CaptureTrigger();
+    }
+}
+
+void AdcManager::CaptureEnd() {
+    AdcHalt();
+    if (m_triggerExtInt >= 0) {
+        InputMgr.EventOutputSet(m_triggerExtInt, InputManager::RISING, false);
+        EventMgr.UserRemove(EVSYS_ID_USER_TC7_EVU);
+        EventMgr.Route(EVENT_ADC_TRIGGER, 0);
+        m_triggerExtInt = -1;
+    }
+    m_triggerAxis = nullptr;
+    m_captureBurst = false;
+
+    if (m_continuous) {
+        ContinuousBegin();
+    }
+    else {
+        RegularBegin();
+    }
+
+    m_captureState = CAPTURE_IDLE;
+}
+
+void AdcManager::RegularBegin() {
+    DmaManager::Channel(DMA_ADC_RESULTS)->CHINTENCLR.reg =
+        DMAC_CHINTENCLR_TCMPL;
+    EventMgr.UserRemove(EVSYS_ID_USER_ADC1_START);
+    ADC1->EVCTRL.reg = 0;
+    ADC1->DSEQCTRL.bit.AUTOSTART = 1;
+    ADC1->SAMPCTRL.reg = ADC_SAMPCTRL_SAMPLEN(ADC_SAMPLEN_DEFAULT);
+    SYNCBUSY_WAIT(ADC1, ADC_SYNCBUSY_SAMPCTRL);
+    ADC1->INPUTCTRL.reg = ADC_INPUTCTRL_MUXPOS_AIN4 | ADC_INPUTCTRL_DSEQSTOP;
+    SYNCBUSY_WAIT(ADC1, ADC_SYNCBUSY_INPUTCTRL);
+    DmaInit();
+
+    m_AdcBusyCount = 0;
+    m_AdcTimeout = false;
+    SequenceSchedule();
+    DmaUpdate();
+    ADC1->CTRLA.bit.ENABLE = 1;
+    SYNCBUSY_WAIT(ADC1, ADC_SYNCBUSY_ENABLE);
+
+    m_continuous = false;
+}
+
+bool AdcManager::ContinuousMode(bool enable) {
+    if (!m_initialized) {
+        return false;
+    }
+    if (enable) {
+        for (uint8_t i = 0; i < ADC_CHANNEL_COUNT; i++) {
+            if (!ContinuousSlotFits(m_oversamplePending[i])) {
+                return false;
+            }
+        }
+    }
+    m_continuousPending = enable;
+    // Wait for the switch to be made in the interrupt; a capture defers it
+    // until the capture ends
+    while (m_continuous != enable && m_captureState == CAPTURE_IDLE) {
+        continue;
+    }
+    return true;
+}
+
+void AdcManager::ContinuousBegin() {
+    AdcHalt();
+
+    // Conversions are started by timer events instead of by the sequence
+    ADC1->INPUTCTRL.reg = adcSequence[0].INPUTCTRL | ADC_INPUTCTRL_DSEQSTOP;
+    SYNCBUSY_WAIT(ADC1, ADC_SYNCBUSY_INPUTCTRL);
+    ADC1->DSEQCTRL.bit.AUTOSTART = 0;
+    ADC1->EVCTRL.reg = ADC_EVCTRL_STARTEI;
+    ADC1->SAMPCTRL.reg = ADC_SAMPCTRL_SAMPLEN(ADC_SAMPLEN_DEFAULT);
+    SYNCBUSY_WAIT(ADC1, ADC_SYNCBUSY_SAMPCTRL);
+
+    /***************************************************************
+     * DMA_ADC_RESULTS Channel
+     * Fill the two halves of the result buffer in turn, interrupting
+     * at the end of each pass of the channels.
+     ***************************************************************/
+    DmacChannel *channel = DmaManager::Channel(DMA_ADC_RESULTS);
+    DmacDescriptor *baseDesc = DmaManager::BaseDescriptor(DMA_ADC_RESULTS);
+    channel->CHCTRLA.reg = DMAC_CHCTRLA_SWRST;
+    while (channel->CHCTRLA.reg == DMAC_CHCTRLA_SWRST) {
+        continue;
+    }
+    channel->CHCTRLA.reg = DMAC_CHCTRLA_TRIGSRC(ADC1_DMAC_ID_RESRDY) |
+                           DMAC_CHCTRLA_TRIGACT_BURST |
+                           DMAC_CHCTRLA_BURSTLEN_SINGLE;
+    channel->CHINTFLAG.reg = DMAC_CHINTFLAG_TCMPL;
+    channel->CHINTENSET.reg = DMAC_CHINTENSET_TCMPL;
+    NVIC_EnableIRQ(DmaManager::Irq(DMA_ADC_RESULTS));
+
+    DmacDescriptor *blockDesc[2] = {baseDesc, &continuousDescriptor};
+    for (uint8_t i = 0; i < 2; i++) {
+        blockDesc[i]->DESCADDR.reg =
+            reinterpret_cast<uint32_t>(blockDesc[1 - i]);
+        blockDesc[i]->SRCADDR.reg = (uint32_t)&ADC1->RESULT.reg;
+        blockDesc[i]->BTCNT.reg = ADC_CHANNEL_COUNT;
+        // End address
+        blockDesc[i]->DSTADDR.reg = reinterpret_cast<uint32_t>(
+                                        adcContinuousResults[i] +
+                                        ADC_CHANNEL_COUNT);
+        blockDesc[i]->BTCTRL.reg =
+            DMAC_BTCTRL_BEATSIZE_HWORD | DMAC_BTCTRL_DSTINC |
+            DMAC_BTCTRL_BLOCKACT_INT | DMAC_BTCTRL_VALID;
+    }
+
+    /***************************************************************
+     * DMA_ADC_SEQUENCE Channel
+     * Feed every channel to the ADC, looping on one descriptor. The
+     * settings are read straight from adcSequence, so a change made by
+     * SequenceUpdate() applies from the next channel converted.
+     ***************************************************************/
+    channel = DmaManager::Channel(DMA_ADC_SEQUENCE);
+    baseDesc = DmaManager::BaseDescriptor(DMA_ADC_SEQUENCE);
+    channel->CHCTRLA.reg = DMAC_CHCTRLA_SWRST;
+    while (channel->CHCTRLA.reg == DMAC_CHCTRLA_SWRST) {
+        continue;
+    }
+    channel->CHCTRLA.reg = DMAC_CHCTRLA_TRIGSRC(ADC1_DMAC_ID_SEQ) |
+                           DMAC_CHCTRLA_TRIGACT_BURST |
+                           DMAC_CHCTRLA_BURSTLEN_SINGLE;
+    baseDesc->DESCADDR.reg = reinterpret_cast<uint32_t>(baseDesc);
+    baseDesc->SRCADDR.reg =
+        reinterpret_cast<uint32_t>(adcSequence + ADC_CHANNEL_COUNT);
+    baseDesc->BTCNT.reg =
+        ADC_CHANNEL_COUNT * sizeof(adcDSeqCfg) / sizeof(uint32_t);
+    baseDesc->DSTADDR.reg = reinterpret_cast<uint32_t>(&REG_ADC1_DSEQDATA);
+    baseDesc->BTCTRL.reg = DMAC_BTCTRL_BEATSIZE_WORD | DMAC_BTCTRL_STEPSEL_SRC |
+                           DMAC_BTCTRL_VALID | DMAC_BTCTRL_SRCINC;
+
+    // Pace the conversions with the timer's overflow events
+    TcCount16 *timer = &ADC_CAPTURE_TIMER->COUNT16;
+    timer->CTRLA.bit.SWRST = 1;
+    SYNCBUSY_WAIT(timer, TC_SYNCBUSY_SWRST);
+    timer->CTRLA.reg = TC_CTRLA_MODE_COUNT16 | TC_CTRLA_PRESCALER_DIV1;
+    timer->WAVE.reg = TC_WAVE_WAVEGEN_MFRQ;
+    timer->CC[0].reg = ADC_CONTINUOUS_PERIOD - 1;
+    SYNCBUSY_WAIT(timer, TC_SYNCBUSY_CC0);
+    timer->EVCTRL.reg = TC_EVCTRL_OVFEO;
+
+    EventMgr.UserAdd(EVENT_ADC_CAPTURE, EVSYS_ID_USER_ADC1_START);
+    EventMgr.Route(EVENT_ADC_CAPTURE, EVSYS_ID_GEN_TC7_OVF);
+
+    m_continuousBlocks = 0;
+    m_continuousRead = 0;
+    m_continuousSkip = false;
+    m_AdcBusyCount = 0;
+    m_AdcTimeout = false;
+    m_shiftRegPending = ShiftReg.LastOutput();
+
+    ADC1->CTRLA.bit.ENABLE = 1;
+    SYNCBUSY_WAIT(ADC1, ADC_SYNCBUSY_ENABLE);
+    // Load the first channel and start pacing
+    DmaUpdate();
+    timer->CTRLA.bit.ENABLE = 1;
+
+    m_continuous = true;
+}
 
 extern "C" void DMAC_0_Handler() {
     // DMAC interrupts TERR TCMPL SUSP
     DmaManager::Channel(DMA_ADC_RESULTS)->CHINTFLAG.reg =
         DMAC_CHINTENCLR_TCMPL; // clear interrupt
+    if (AdcMgr.CaptureActive()) {
+        AdcMgr.IrqHandlerCapture();
+    }
+    else if (AdcMgr.ContinuousMode()) {
+        AdcMgr.IrqHandlerContinuous();
+    }
 }
-#endif
 
-} // ClearCore namespace
\ No newline at end of file
+} // ClearCore namespace
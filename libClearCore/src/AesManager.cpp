@@ -0,0 +1,292 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    ClearCore AES-GCM authenticated encryption on the AES peripheral
+**/
+
+#include "AesManager.h"
+#include <sam.h>
+#include <string.h>
+#include "atomic_utils.h"
+#include "DmaManager.h"
+#include "SysUtils.h"
+
+namespace ClearCore {
+
+// CTRLA.AESMODE values
+#define AES_MODE_ECB 0
+#define AES_MODE_CTR 4
+#define AES_MODE_GCM 6
+
+#define AES_BLOCK_WORDS (AES_BLOCK_SIZE / sizeof(uint32_t))
+
+AesManager &AesMgr = AesManager::Instance();
+
+static inline bool WordAligned(const void *ptr) {
+    return !(reinterpret_cast<uint32_t>(ptr) & 3);
+}
+
+AesManager &AesManager::Instance() {
+    static AesManager *instance = new AesManager();
+    return *instance;
+}
+
+AesManager::AesManager()
+    : m_busy(false),
+      m_dmaWrite(DMA_CHANNEL_NONE),
+      m_dmaRead(DMA_CHANNEL_NONE) {}
+
+void AesManager::Initialize() {
+    CLOCK_ENABLE(APBCMASK, AES_);
+    CLOCK_ENABLE(APBCMASK, TRNG_);
+    AES->CTRLA.reg = AES_CTRLA_SWRST;
+    while (AES->CTRLA.reg & AES_CTRLA_SWRST) {
+        continue;
+    }
+    TRNG->CTRLA.reg = TRNG_CTRLA_ENABLE;
+}
+
+uint32_t AesManager::Random() {
+    while (!TRNG->INTFLAG.bit.DATARDY) {
+        continue;
+    }
+    return TRNG->DATA.reg;
+}
+
+bool AesManager::KeyExpand(Key &key, const uint8_t *bytes, uint8_t length) {
+    key.Length = 0;
+    if (!bytes || (length != 16 && length != 24 && length != 32)) {
+        return false;
+    }
+    memset(key.Words, 0, sizeof(key.Words));
+    memcpy(key.Words, bytes, length);
+    key.Length = length;
+
+    if (atomic_test_and_set(&m_busy)) {
+        key.Length = 0;
+        return false;
+    }
+    // H is the encryption of a zero block
+    static const uint8_t zero[AES_BLOCK_SIZE] = {0};
+    Configure(key, AES_MODE_ECB, true);
+    BlockRun(zero, reinterpret_cast<uint8_t *>(key.Hash), AES_BLOCK_SIZE, 0);
+    AES->CTRLA.reg = 0;
+    atomic_clear(&m_busy);
+    return true;
+}
+
+bool AesManager::GcmEncrypt(const Key &key, const uint8_t *iv,
+                            const uint8_t *aad, uint16_t aadLength,
+                            const uint8_t *in, uint8_t *out, uint16_t length,
+                            uint8_t *tag) {
+    return Gcm(key, iv, aad, aadLength, in, out, length, true, tag);
+}
+
+bool AesManager::GcmDecrypt(const Key &key, const uint8_t *iv,
+                            const uint8_t *aad, uint16_t aadLength,
+                            const uint8_t *in, uint8_t *out, uint16_t length,
+                            const uint8_t *tag) {
+    uint8_t expected[AES_GCM_TAG_SIZE];
+    if (!Gcm(key, iv, aad, aadLength, in, out, length, false, expected)) {
+        return false;
+    }
+    // Compare in constant time so the timing gives nothing away
+    uint8_t diff = 0;
+    for (uint8_t i = 0; i < AES_GCM_TAG_SIZE; i++) {
+        diff |= expected[i] ^ tag[i];
+    }
+    if (diff) {
+        memset(out, 0, length);
+        return false;
+    }
+    return true;
+}
+
+void AesManager::Configure(const Key &key, uint32_t mode, bool encrypt) {
+    // The mode and key size can only be written while the AES is off
+    AES->CTRLA.reg = 0;
+    uint32_t ctrla = AES_CTRLA_AESMODE(mode) |
+                     AES_CTRLA_KEYSIZE(key.Length / 8 - 2) |
+                     AES_CTRLA_STARTMODE;
+    if (encrypt) {
+        ctrla |= AES_CTRLA_CIPHER;
+    }
+    AES->CTRLA.reg = ctrla;
+    AES->CTRLA.reg = ctrla | AES_CTRLA_ENABLE;
+    for (uint8_t i = 0; i < key.Length / sizeof(uint32_t); i++) {
+        AES->KEYWORD[i].reg = key.Words[i];
+    }
+}
+
+void AesManager::BlockRun(const uint8_t *in, uint8_t *out, uint8_t length,
+                          uint32_t control) {
+    // A short block is padded with zeros
+    uint32_t block[AES_BLOCK_WORDS] = {0};
+    memcpy(block, in, length);
+
+    AES->INTFLAG.reg = AES_INTFLAG_ENCCMP | AES_INTFLAG_GFMCMP;
+    AES->CTRLB.reg = control;
+    AES->DATABUFPTR.reg = 0;
+    // The fourth word starts the block
+    for (uint8_t i = 0; i < AES_BLOCK_WORDS; i++) {
+        AES->INDATA.reg = block[i];
+    }
+    uint32_t done = (control & AES_CTRLB_GFMUL) ? AES_INTFLAG_GFMCMP
+                                                : AES_INTFLAG_ENCCMP;
+    while (!(AES->INTFLAG.reg & done)) {
+        continue;
+    }
+    if (out) {
+        AES->DATABUFPTR.reg = 0;
+        for (uint8_t i = 0; i < AES_BLOCK_WORDS; i++) {
+            block[i] = AES->INDATA.reg;
+        }
+        memcpy(out, block, length);
+    }
+    AES->CTRLB.reg = 0;
+}
+
+bool AesManager::BlocksDma(const uint8_t *in, uint8_t *out, uint16_t blocks) {
+    if (!WordAligned(in) || !WordAligned(out)) {
+        return false;
+    }
+    if (m_dmaWrite == DMA_CHANNEL_NONE) {
+        m_dmaWrite = DmaManager::ChannelAllocate(1);
+    }
+    if (m_dmaRead == DMA_CHANNEL_NONE) {
+        m_dmaRead = DmaManager::ChannelAllocate(1);
+    }
+    if (m_dmaWrite == DMA_CHANNEL_NONE || m_dmaRead == DMA_CHANNEL_NONE) {
+        return false;
+    }
+
+    // Each trigger moves one block, four words, in or out of the AES
+    uint16_t words = blocks * AES_BLOCK_WORDS;
+    DmaBlock write = {in, &AES->INDATA.reg, words,
+                      DMAC_BTCTRL_BEATSIZE_WORD_Val, true, false, false};
+    DmaBlock read = {&AES->INDATA.reg, out, words,
+                     DMAC_BTCTRL_BEATSIZE_WORD_Val, false, true, false};
+    if (!DmaManager::ChannelTrigger(m_dmaWrite, AES_DMAC_ID_WR,
+                                    DMAC_CHCTRLA_TRIGACT_BURST_Val,
+                                    AES_BLOCK_WORDS) ||
+            !DmaManager::ChannelTrigger(m_dmaRead, AES_DMAC_ID_RD,
+                                        DMAC_CHCTRLA_TRIGACT_BURST_Val,
+                                        AES_BLOCK_WORDS) ||
+            !DmaManager::ChainBuild(m_dmaWrite, &write, 1) ||
+            !DmaManager::ChainBuild(m_dmaRead, &read, 1)) {
+        return false;
+    }
+    AES->DATABUFPTR.reg = 0;
+    DmaManager::ChannelStart(m_dmaRead);
+    DmaManager::ChannelStart(m_dmaWrite);
+    while (DmaManager::ChannelBusy(m_dmaRead)) {
+        continue;
+    }
+    return true;
+}
+
+bool AesManager::Gcm(const Key &key, const uint8_t *iv, const uint8_t *aad,
+                     uint16_t aadLength, const uint8_t *in, uint8_t *out,
+                     uint16_t length, bool encrypt, uint8_t *tag) {
+    if (!key.Length || !iv || (length && (!in || !out)) ||
+            (aadLength && !aad)) {
+        return false;
+    }
+    if (atomic_test_and_set(&m_busy)) {
+        return false;
+    }
+
+    Configure(key, AES_MODE_GCM, encrypt);
+    for (uint8_t i = 0; i < AES_BLOCK_WORDS; i++) {
+        AES->HASHKEY[i].reg = key.Hash[i];
+    }
+    // J0 is the IV followed by a 32-bit big-endian 1; the text is counted
+    // from J0 + 1
+    uint32_t j0[AES_BLOCK_WORDS];
+    memcpy(j0, iv, AES_GCM_IV_SIZE);
+    j0[3] = 0x01000000;
+    for (uint8_t i = 0; i < AES_BLOCK_WORDS - 1; i++) {
+        AES->INTVECTV[i].reg = j0[i];
+    }
+    AES->INTVECTV[3].reg = 0x02000000;
+
+    // The additional data only goes into the hash
+    for (uint16_t offset = 0; offset < aadLength; offset += AES_BLOCK_SIZE) {
+        uint16_t size = aadLength - offset;
+        BlockRun(aad + offset, nullptr,
+                 size < AES_BLOCK_SIZE ? size : AES_BLOCK_SIZE,
+                 AES_CTRLB_GFMUL);
+    }
+
+    // The text; the hardware hashes the ciphertext as it goes, and the
+    // length masks the padding of a short last block
+    AES->CIPLEN.reg = length;
+    uint16_t blocks = (length + AES_BLOCK_SIZE - 1) / AES_BLOCK_SIZE;
+    uint16_t block = 0;
+    while (block < blocks) {
+        uint16_t offset = block * AES_BLOCK_SIZE;
+        // The middle of a long message goes by DMA. The first block starts
+        // the message and the last one ends it, so the CPU runs those.
+        if (block == 1 && blocks - 2 >= AES_DMA_MIN_BLOCKS &&
+                BlocksDma(in + offset, out + offset, blocks - 2)) {
+            block = blocks - 1;
+            continue;
+        }
+        uint16_t size = length - offset;
+        uint32_t control = 0;
+        if (!block) {
+            control |= AES_CTRLB_NEWMSG;
+        }
+        if (block == blocks - 1) {
+            control |= AES_CTRLB_EOM;
+        }
+        BlockRun(in + offset, out + offset,
+                 size < AES_BLOCK_SIZE ? size : AES_BLOCK_SIZE, control);
+        block++;
+    }
+
+    // Close the hash with the bit lengths of the data and the text
+    uint32_t lengths[AES_BLOCK_WORDS] = {
+        0, __builtin_bswap32(aadLength * 8u),
+        0, __builtin_bswap32(length * 8u)
+    };
+    BlockRun(reinterpret_cast<const uint8_t *>(lengths), nullptr,
+             AES_BLOCK_SIZE, AES_CTRLB_GFMUL);
+    uint32_t hash[AES_BLOCK_WORDS];
+    for (uint8_t i = 0; i < AES_BLOCK_WORDS; i++) {
+        hash[i] = AES->GHASH[i].reg;
+    }
+
+    // The tag is the hash encrypted in counter mode from J0
+    Configure(key, AES_MODE_CTR, true);
+    for (uint8_t i = 0; i < AES_BLOCK_WORDS; i++) {
+        AES->INTVECTV[i].reg = j0[i];
+    }
+    BlockRun(reinterpret_cast<const uint8_t *>(hash), tag, AES_GCM_TAG_SIZE,
+             AES_CTRLB_NEWMSG);
+    AES->CTRLA.reg = 0;
+    atomic_clear(&m_busy);
+    return true;
+}
+
+} // ClearCore namespace
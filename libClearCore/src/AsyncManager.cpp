@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    ClearCore stackless coroutine executor
+**/
+
+#include "AsyncManager.h"
+
+namespace ClearCore {
+
+AsyncManager &AsyncMgr = AsyncManager::Instance();
+
+AsyncManager &AsyncManager::Instance() {
+    static AsyncManager *instance = new AsyncManager();
+    return *instance;
+}
+
+AsyncManager::AsyncManager()
+    : m_coroutines(),
+      m_runningCount(0) {}
+
+int8_t AsyncManager::Start(AsyncFunction function, void *arg) {
+    if (!function) {
+        return ASYNC_INVALID;
+    }
+    for (uint8_t i = 0; i < ASYNC_MANAGER_MAX_COROUTINES; i++) {
+        Coroutine &coroutine = m_coroutines[i];
+        if (!coroutine.Function) {
+            coroutine.Context = AsyncContext();
+            coroutine.Context.Arg = arg;
+            coroutine.Function = function;
+            m_runningCount++;
+            return i;
+        }
+    }
+    return ASYNC_INVALID;
+}
+
+bool AsyncManager::Cancel(int8_t id) {
+    if (!Running(id)) {
+        return false;
+    }
+    m_coroutines[id].Function = nullptr;
+    m_runningCount--;
+    return true;
+}
+
+bool AsyncManager::Running(int8_t id) {
+    return id >= 0 && id < ASYNC_MANAGER_MAX_COROUTINES &&
+           m_coroutines[id].Function;
+}
+
+void AsyncManager::Run() {
+    for (uint8_t i = 0; i < ASYNC_MANAGER_MAX_COROUTINES; i++) {
+        Coroutine &coroutine = m_coroutines[i];
+        // A coroutine may start or cancel others, including itself
+        AsyncFunction function = coroutine.Function;
+        if (function && function(coroutine.Context) == ASYNC_DONE &&
+                coroutine.Function == function) {
+            coroutine.Function = nullptr;
+            m_runningCount--;
+        }
+    }
+}
+
+} // ClearCore namespace
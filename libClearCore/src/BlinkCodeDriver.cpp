@@ -29,6 +29,11 @@
 
 #include "BlinkCodeDriver.h"
 
+static_assert(MS_TO_LED_UPDATES(2300) <= UINT16_MAX,
+              "Blink code timing must fit the 16-bit tick counters");
+static_assert(MS_TO_LED_UPDATES(50) >= 1,
+              "LED_UPDATE_RATE_HZ is too slow for the blink code strobes");
+
 namespace ClearCore {
 
 void BlinkCodeDriver::Update() {
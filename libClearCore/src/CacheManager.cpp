@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    ClearCore Cortex-M cache controller (CMCC) manager
+**/
+
+#include "CacheManager.h"
+#include <hpl_cmcc_config.h>
+#include <sam.h>
+
+namespace ClearCore {
+
+CacheManager &CacheMgr = CacheManager::Instance();
+
+CacheManager &CacheManager::Instance() {
+    static CacheManager *instance = new CacheManager();
+    return *instance;
+}
+
+CacheManager::CacheManager()
+    : m_monitorStartCycles(0) {}
+
+void CacheManager::Initialize() {
+    // The configuration can only be written while the cache is off
+    Enable(false);
+    uint32_t config = CMCC_CFG_CSIZESW(CONF_CMCC_CACHE_SIZE);
+    if (CONF_CMCC_DATA_CACHE_DISABLE) {
+        config |= CMCC_CFG_DCDIS;
+    }
+    if (CONF_CMCC_INST_CACHE_DISABLE) {
+        config |= CMCC_CFG_ICDIS;
+    }
+    if (CONF_CMCC_CLK_GATING_DISABLE) {
+        config |= CMCC_CFG_GCLKDIS;
+    }
+    CMCC->CFG.reg = config;
+    if (CONF_CMCC_ENABLE) {
+        Enable(true);
+    }
+}
+
+void CacheManager::Enable(bool enable) {
+    if (enable == Enabled()) {
+        return;
+    }
+    if (!enable) {
+        CMCC->CTRL.reg = 0;
+        while (Enabled()) {
+            continue;
+        }
+        return;
+    }
+    CMCC->MAINT0.reg = CMCC_MAINT0_INVALL;
+    CMCC->CTRL.reg = CMCC_CTRL_CEN;
+}
+
+bool CacheManager::Enabled() {
+    return CMCC->SR.reg & CMCC_SR_CSTS;
+}
+
+void CacheManager::Invalidate() {
+    // Lines can only be invalidated while the cache is off
+    if (!Enabled()) {
+        return;
+    }
+    Enable(false);
+    Enable(true);
+}
+
+void CacheManager::MonitorStart(MonitorEvent event) {
+    CMCC->MEN.reg = 0;
+    CMCC->MCFG.reg = CMCC_MCFG_MODE(event);
+    CMCC->MCTRL.reg = CMCC_MCTRL_SWRST;
+    m_monitorStartCycles = DWT->CYCCNT;
+    CMCC->MEN.reg = CMCC_MEN_MENABLE;
+}
+
+void CacheManager::MonitorStop() {
+    CMCC->MEN.reg = 0;
+}
+
+uint32_t CacheManager::MonitorCount() {
+    return CMCC->MSR.reg & CMCC_MSR_EVENT_CNT_Msk;
+}
+
+uint32_t CacheManager::MonitorRate() {
+    uint32_t count = MonitorCount();
+    uint32_t cycles = DWT->CYCCNT - m_monitorStartCycles;
+    if (!cycles) {
+        return 0;
+    }
+    return static_cast<uint32_t>(static_cast<uint64_t>(count) * 1000 /
+                                 cycles);
+}
+
+} // ClearCore namespace
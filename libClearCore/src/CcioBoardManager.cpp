@@ -32,6 +32,12 @@
 #include "SysConnectors.h"
 #include "StatusManager.h"
 #include "SysTiming.h"
+#include "TraceManager.h"
+
+static_assert(2.4 * MS_TO_SAMPLES <= UINT8_MAX,
+              "CCIO_OVERLOAD_TRIP_TICKS must fit its 8-bit cast");
+static_assert(CCIO_OVERLOAD_FOLDBACK_TICKS <= UINT16_MAX,
+              "CCIO_OVERLOAD_FOLDBACK_TICKS must fit its 16-bit counter");
 
 namespace ClearCore {
 
@@ -39,6 +45,7 @@ extern ShiftRegister ShiftReg;
 extern StatusManager &StatusMgr;
 extern volatile uint32_t tickCnt;
 CcioBoardManager &CcioMgr = CcioBoardManager::Instance();
+CcioBoardManager &CcioMgr1 = CcioBoardManager::Instance1();
 
 #define MARKER_BYTE (0xCC)
 #define CCIO_REDISCOVER_TIME_TICKS (1000 * MS_TO_SAMPLES)
@@ -65,6 +72,16 @@ inline uint64_t modifyBit(uint64_t originalNumber, uint8_t position,
            (static_cast<uint64_t>(finalBitValue) << position);
 }
 
+/**
+    Returns the index of the lowest set bit of a nonzero value
+
+    \param[in] value Bits to search
+    \return Index of the lowest set bit
+**/
+inline uint8_t LowestBit(uint64_t value) {
+    return __builtin_ctzll(value);
+}
+
 /**
     Reverses the bytes of the given 32-bit value
 
@@ -72,26 +89,55 @@ inline uint64_t modifyBit(uint64_t originalNumber, uint8_t position,
     \return Swapped value
 **/
 inline uint32_t reverseBytes(uint32_t value) {
-    uint32_t res = 0;
-    __asm("REV %[result], %[input]" : [result] "=r"(res) : [input] "r"(value));
-    return res;
+    return __REV(value);
 }
 
 CcioBoardManager &CcioBoardManager::Instance() {
-    static CcioBoardManager *instance = new CcioBoardManager();
+    static CcioBoardManager *instance =
+        new CcioBoardManager(CLEARCORE_PIN_CCIO_BASE);
     return *instance;
 }
 
+CcioBoardManager &CcioBoardManager::Instance1() {
+    static CcioBoardManager *instance =
+        new CcioBoardManager(CLEARCORE_PIN_CCIO1_BASE);
+    return *instance;
+}
+
+CcioBoardManager &CcioBoardManager::ChainByPort(SerialDriver *comInstance) {
+    if (CcioMgr1.m_serPort == comInstance ||
+            (CcioMgr.m_serPort && CcioMgr.m_serPort != comInstance)) {
+        return CcioMgr1;
+    }
+    return CcioMgr;
+}
+
+CcioBoardManager *CcioBoardManager::ChainByPin(ClearCorePins pin) {
+    if (CcioMgr.PinOnChain(pin)) {
+        return &CcioMgr;
+    }
+    if (CcioMgr1.PinOnChain(pin)) {
+        return &CcioMgr1;
+    }
+    return NULL;
+}
+
 #ifndef HIDE_FROM_DOXYGEN
-CcioBoardManager::CcioBoardManager()
-    : m_writeBuf(),
+CcioBoardManager::CcioBoardManager(ClearCorePins pinBase)
+    : m_pinBase(pinBase),
+      m_writeBuf(),
       m_readBuf(),
+      m_writeBufAlt(),
+      m_readBufAlt(),
+      m_bufAlt(false),
       m_discoverState(CCIO_SEARCH),
       m_serPort(NULL),
       m_ccioCnt(0),
       m_ccioRefreshRate(1),
       m_ccioRefreshDelay(0),
       m_throttledOutputs(0),
+      m_overloadTripping(0),
+      m_filtering(UINT64_MAX),
       m_currentInputs(0),
       m_filteredInputs(0),
       m_currentOutputs(0),
@@ -103,6 +149,14 @@ CcioBoardManager::CcioBoardManager()
       m_pulseActive(0),
       m_pulseValue(0),
       m_pulseStopPending(0),
+      m_stagedMask(0),
+      m_stagedValue(0),
+      m_seqSteps(NULL),
+      m_seqCount(0),
+      m_seqIndex(0),
+      m_seqPasses(0),
+      m_seqPass(0),
+      m_seqTicksLeft(0),
       m_consGlitchCnt(0),
       m_ccioLinkBroken(false),
       m_ccioOverloaded(0),
@@ -112,13 +166,25 @@ CcioBoardManager::CcioBoardManager()
       m_inputRegFallen(0),
       m_faultLed(ShiftRegister::SR_NO_FEEDBACK_MASK),
       m_autoRediscover(true),
-      m_lastDiscoverTime(0) {
+      m_lastDiscoverTime(0),
+      m_discoverAsync(false),
+      m_discoverSend(true),
+      m_discoverFlush0(false),
+      m_discoverFlushCnt(0),
+      m_discoverCallback(NULL),
+      m_linkFast(false),
+      m_linkFastActive(false),
+      m_linkFastFailed(false),
+      m_inputsReplay(false) {
+    for (uint8_t i = 0; i < CCIO_PIN_CNT; i++) {
+        m_ccioPins[i].m_mgr = this;
+    }
 }
 #endif
 
 void CcioBoardManager::Initialize() {
     for (uint8_t i = 0; i < CCIO_PIN_CNT; i++) {
-        m_ccioPins[i].Initialize((ClearCorePins)(i + CLEARCORE_PIN_CCIO_BASE));
+        m_ccioPins[i].Initialize((ClearCorePins)(i + m_pinBase));
     }
     CcioDiscover(NULL);
 
@@ -127,6 +193,9 @@ void CcioBoardManager::Initialize() {
     m_ccioRefreshRate = 1;
     m_ccioRefreshDelay = 0;
     m_throttledOutputs = 0;
+    m_overloadTripping = 0;
+    // Every pin starts with one sample of filtering left
+    m_filtering = UINT64_MAX;
     m_currentInputs = 0;
     m_filteredInputs = 0;
     m_currentOutputs = 0;
@@ -138,6 +207,9 @@ void CcioBoardManager::Initialize() {
     m_pulseActive = 0;
     m_pulseValue = 0;
     m_pulseStopPending = 0;
+    m_stagedMask = 0;
+    m_stagedValue = 0;
+    m_seqSteps = NULL;
     m_consGlitchCnt = 0;
     m_ccioLinkBroken = false;
     m_ccioOverloaded = 0;
@@ -145,15 +217,17 @@ void CcioBoardManager::Initialize() {
     m_inputRegRisen = 0;
     m_inputRegFallen = 0;
     m_autoRediscover = true;
+    m_linkFastActive = false;
+    m_linkFastFailed = false;
 }
 
 bool CcioBoardManager::PinState(ClearCorePins pinNum) {
-    if (pinNum < CLEARCORE_PIN_CCIO_BASE || pinNum >= CLEARCORE_PIN_CCIO_MAX) {
+    if (!PinOnChain(pinNum)) {
         return false;
     }
 
     // Reposition the pin reference to map it into a shift amount
-    int8_t bitIndex = pinNum - CLEARCORE_PIN_CCIO_BASE;
+    int8_t bitIndex = pinNum - m_pinBase;
     return ((m_filteredInputs >> bitIndex) & 1);
 }
 
@@ -187,59 +261,65 @@ uint64_t CcioBoardManager::IoOverloadAccum() {
     return retVal;
 }
 
-void CcioBoardManager::Refresh() {
+ISR_RAMFUNC void CcioBoardManager::Refresh() {
     // Don't refresh until CcioDiscover is called
     if (!m_serPort || !m_ccioCnt || m_ccioLinkBroken) {
         return;
     }
+    TRACE_EVENT(TRACE_CCIO_REFRESH, static_cast<uint32_t>(m_currentOutputs));
 
-    uint64_t mask = 1;
+    // Advance the output sequence when one is playing
+    if (m_seqSteps && !--m_seqTicksLeft) {
+        OutputSequenceNext();
+    }
 
     // Refresh pulse counts when pulses are active
-    if (m_pulseActive) {
+    uint64_t pulseUpdate = m_pulseActive & m_ccioMask;
+    if (pulseUpdate) {
         uint64_t pulsesEnded = 0;
         uint64_t pulseRise = 0;
         uint64_t pulseFall = 0;
 
-        for (uint8_t i = 0; i < CCIO_PINS_PER_BOARD * m_ccioCnt; i++) {
-            // Pulse out update
-            if (m_pulseActive & mask) {
-                CcioPin &currentPin = m_ccioPins[i];
-                if (!--currentPin.m_pulseTicksRemaining) {
-                    if (m_pulseValue & mask) {
-                        // Turn off the pulse
-                        pulseFall |= mask;
-                        currentPin.m_pulseTicksRemaining =
-                            currentPin.m_pulseOffTicks;
-                        // Increment the counter after a complete cycle
-                        if (++currentPin.m_pulseCounter >=
-                                currentPin.m_pulseStopCount &&
-                                currentPin.m_pulseStopCount) {
-                            pulsesEnded |= mask;
-                        }
-                        // If a stop is pending, handle it now that a cycle has
-                        // completed
-                        if (m_pulseStopPending & mask) {
-                            pulsesEnded |= mask;
-                            m_pulseStopPending &= ~mask;
-                        }
+        // Visit only the pins that are pulsing
+        while (pulseUpdate) {
+            uint8_t i = LowestBit(pulseUpdate);
+            uint64_t mask = 1ULL << i;
+            pulseUpdate &= pulseUpdate - 1;
+
+            CcioPin &currentPin = m_ccioPins[i];
+            if (!--currentPin.m_pulseTicksRemaining) {
+                if (m_pulseValue & mask) {
+                    // Turn off the pulse
+                    pulseFall |= mask;
+                    currentPin.m_pulseTicksRemaining =
+                        currentPin.m_pulseOffTicks;
+                    // Increment the counter after a complete cycle
+                    if (++currentPin.m_pulseCounter >=
+                            currentPin.m_pulseStopCount &&
+                            currentPin.m_pulseStopCount) {
+                        pulsesEnded |= mask;
+                    }
+                    // If a stop is pending, handle it now that a cycle has
+                    // completed
+                    if (m_pulseStopPending & mask) {
+                        pulsesEnded |= mask;
+                        m_pulseStopPending &= ~mask;
+                    }
+                }
+                else {
+                    // If a stop is pending, stop any upcoming pulses
+                    if (m_pulseStopPending & mask) {
+                        pulsesEnded |= mask;
+                        m_pulseStopPending &= ~mask;
                     }
                     else {
-                        // If a stop is pending, stop any upcoming pulses
-                        if (m_pulseStopPending & mask) {
-                            pulsesEnded |= mask;
-                            m_pulseStopPending &= ~mask;
-                        }
-                        else {
-                            // Turn on the pulse
-                            pulseRise |= mask;
-                            currentPin.m_pulseTicksRemaining =
-                                currentPin.m_pulseOnTicks;
-                        }
+                        // Turn on the pulse
+                        pulseRise |= mask;
+                        currentPin.m_pulseTicksRemaining =
+                            currentPin.m_pulseOnTicks;
                     }
                 }
             }
-            mask <<= 1;
         }
 
         // Update the pulse info with the bits that changed
@@ -258,18 +338,39 @@ void CcioBoardManager::Refresh() {
         m_ccioRefreshDelay = m_ccioRefreshRate;
     }
 
-    // Wait for the previous SPI transfer to complete
-    m_serPort->SpiAsyncWaitComplete();
-    m_serPort->SpiSsMode(SerialBase::CtrlLineModes::LINE_OFF);
+    CcioBuf *readBuf = &m_readBuf;
+    CcioBuf *writeBuf = &m_writeBuf;
+    if (m_linkFastActive) {
+        // Try again next sample rather than wait for a late transfer
+        if (m_serPort->SpiAsyncBusy()) {
+            m_ccioRefreshDelay = 1;
+            return;
+        }
+        m_serPort->SpiSsMode(SerialBase::CtrlLineModes::LINE_OFF);
+        // Start the transfer prepared by the previous refresh, then work on
+        // the data of the transfer that just finished while it runs
+        CcioBuf *sendBuf = m_bufAlt ? &m_writeBufAlt : &m_writeBuf;
+        CcioBuf *recvBuf = m_bufAlt ? &m_readBufAlt : &m_readBuf;
+        readBuf = m_bufAlt ? &m_readBuf : &m_readBufAlt;
+        writeBuf = m_bufAlt ? &m_writeBuf : &m_writeBufAlt;
+        m_bufAlt = !m_bufAlt;
+        m_serPort->SpiSsMode(SerialBase::CtrlLineModes::LINE_ON);
+        LinkTransferStart(*sendBuf, *recvBuf);
+    }
+    else {
+        // Wait for the previous SPI transfer to complete
+        m_serPort->SpiAsyncWaitComplete();
+        m_serPort->SpiSsMode(SerialBase::CtrlLineModes::LINE_OFF);
+    }
 
     // Save the current inputs and the last inputs
     uint64_t lastInputs = m_currentInputs;
 
     bool markerError =
-        m_readBuf.buf8[MAX_CCIO_DEVICES + m_ccioCnt + 1] != MARKER_BYTE;
-    m_readBuf.buf8[MAX_CCIO_DEVICES + m_ccioCnt + 1] = 0;
+        readBuf->buf8[MAX_CCIO_DEVICES + m_ccioCnt + 1] != MARKER_BYTE;
+    readBuf->buf8[MAX_CCIO_DEVICES + m_ccioCnt + 1] = 0;
     // Verify that the data read back matches what we had sent
-    if (markerError || m_lastOutputsSwapped ^ m_readBuf.buf64.outputsSwapped) {
+    if (markerError || m_lastOutputsSwapped ^ readBuf->buf64.outputsSwapped) {
         if ((m_consGlitchCnt++ >= MAX_GLITCH_LIM) && (MAX_GLITCH_LIM > 0)) {
             // Announce link broken
             m_ccioLinkBroken = true;
@@ -289,63 +390,99 @@ void CcioBoardManager::Refresh() {
     else {
         m_consGlitchCnt = 0;
         m_currentInputs =
-            (~m_readBuf.buf64.inputs) >> ((MAX_CCIO_DEVICES - m_ccioCnt)
+            (~readBuf->buf64.inputs) >> ((MAX_CCIO_DEVICES - m_ccioCnt)
                                           * CCIO_PINS_PER_BOARD);
     }
 
-    mask = 1;
     uint64_t settledChanges = 0;
-    uint64_t changedInputs = lastInputs ^ m_currentInputs;
-    uint64_t overloadedOutputSample = m_outputsWithThrottling & ~lastInputs;
-    uint64_t overloadedOutputRT = m_ccioOverloaded;
-    for (uint8_t i = 0; i < CCIO_PINS_PER_BOARD * m_ccioCnt; i++) {
+    uint64_t changedInputs = (lastInputs ^ m_currentInputs) & m_ccioMask;
+    uint64_t overloadedOutputSample =
+        m_outputsWithThrottling & ~lastInputs & m_ccioMask;
+    uint64_t throttled = m_throttledOutputs & m_ccioMask;
+    // Outputs that are neither throttled nor reading back deasserted are no
+    // longer overloaded
+    uint64_t overloadedOutputRT =
+        m_ccioOverloaded & (throttled | overloadedOutputSample);
+
+    // Each pass below visits only the pins with work to do this sample, so
+    // the cost follows the I/O activity rather than the number of pins
+    uint64_t pins = throttled;
+    while (pins) {
+        uint8_t i = LowestBit(pins);
+        pins &= pins - 1;
         CcioPin &currentPin = m_ccioPins[i];
-        if (m_throttledOutputs & mask) {
-            if (!(--currentPin.m_overloadFoldbackCnt)) {
-                // Coming out of foldback, reset the overload
-                // delay timer and restore the pin state
-                m_throttledOutputs &= ~mask;
-                currentPin.m_overloadTripCnt = CCIO_OVERLOAD_TRIP_TICKS;
-            }
-        }
-        // Read filtering update
-        else if (overloadedOutputSample & mask) {
-            // When the overload counter hits zero, signal the overload
-            if (currentPin.m_overloadTripCnt &&
-                    !--currentPin.m_overloadTripCnt) {
-                m_throttledOutputs |= mask;
-                currentPin.m_overloadFoldbackCnt = CCIO_OVERLOAD_FOLDBACK_TICKS;
-                overloadedOutputRT |= mask;
-            }
-        }
-        else {
-            // Not overloaded, reset the overload delay timer
+        if (!(--currentPin.m_overloadFoldbackCnt)) {
+            // Coming out of foldback, reset the overload
+            // delay timer and restore the pin state
+            m_throttledOutputs &= ~(1ULL << i);
             currentPin.m_overloadTripCnt = CCIO_OVERLOAD_TRIP_TICKS;
-            overloadedOutputRT &= ~mask;
         }
+    }
 
-        if (changedInputs & mask) {
-            currentPin.m_filterTicksLeft = currentPin.m_filterLength;
-            if (!currentPin.m_filterLength) {
-                settledChanges |= mask;
-            }
+    // Not overloaded, reset the overload delay timers that were counting
+    pins = overloadedOutputSample & ~throttled;
+    uint64_t tripReset = m_overloadTripping & ~pins & ~throttled;
+    m_overloadTripping = (m_overloadTripping & ~tripReset) | pins;
+    while (tripReset) {
+        uint8_t i = LowestBit(tripReset);
+        tripReset &= tripReset - 1;
+        m_ccioPins[i].m_overloadTripCnt = CCIO_OVERLOAD_TRIP_TICKS;
+    }
+
+    // Count down the overload delay of the outputs reading back deasserted
+    while (pins) {
+        uint8_t i = LowestBit(pins);
+        pins &= pins - 1;
+        CcioPin &currentPin = m_ccioPins[i];
+        // When the overload counter hits zero, signal the overload
+        if (currentPin.m_overloadTripCnt &&
+                !--currentPin.m_overloadTripCnt) {
+            uint64_t mask = 1ULL << i;
+            m_throttledOutputs |= mask;
+            m_overloadTripping &= ~mask;
+            currentPin.m_overloadFoldbackCnt = CCIO_OVERLOAD_FOLDBACK_TICKS;
+            overloadedOutputRT |= mask;
         }
-        else if (currentPin.m_filterTicksLeft &&
-                 !(--currentPin.m_filterTicksLeft)) {
+    }
+
+    // Count down the filters in progress on the inputs that held steady
+    pins = m_filtering & ~changedInputs & m_ccioMask;
+    while (pins) {
+        uint8_t i = LowestBit(pins);
+        pins &= pins - 1;
+        CcioPin &currentPin = m_ccioPins[i];
+        if (currentPin.m_filterTicksLeft &&
+                !(--currentPin.m_filterTicksLeft)) {
             // When we decrement to zero, set the filtered state
-            settledChanges |= mask;
+            settledChanges |= 1ULL << i;
+        }
+        if (!currentPin.m_filterTicksLeft) {
+            m_filtering &= ~(1ULL << i);
         }
-        mask <<= 1;
     }
 
-    // Update the filtered input value with the bits that changed
-    lastInputs = m_filteredInputs;
-    // If filtering, update the values that settled this sample
-    m_filteredInputs = (m_filteredInputs & ~settledChanges) |
-                       (m_currentInputs & settledChanges);
-    // Find the rise/fall
-    m_inputRegRisen |= (m_filteredInputs & ~lastInputs);
-    m_inputRegFallen |= (~m_filteredInputs & lastInputs);
+    // Restart the filters of the inputs that changed
+    pins = changedInputs;
+    while (pins) {
+        uint8_t i = LowestBit(pins);
+        pins &= pins - 1;
+        CcioPin &currentPin = m_ccioPins[i];
+        currentPin.m_filterTicksLeft = currentPin.m_filterLength;
+        if (currentPin.m_filterLength) {
+            m_filtering |= 1ULL << i;
+        }
+        else {
+            settledChanges |= 1ULL << i;
+        }
+    }
+
+    // Update the filtered input value with the bits that changed, unless
+    // a replay is supplying it. If filtering, update the values that
+    // settled this sample.
+    if (!m_inputsReplay) {
+        InputsApply((m_filteredInputs & ~settledChanges) |
+                    (m_currentInputs & settledChanges));
+    }
 
     // Output overloaded check if there wasn't a glitch
     if (m_consGlitchCnt == 0) {
@@ -356,7 +493,7 @@ void CcioBoardManager::Refresh() {
     }
 
     // Store the last outputs that had been sent for glitch comparison
-    m_lastOutputsSwapped = m_writeBuf.buf64.outputsSwapped;
+    m_lastOutputsSwapped = writeBuf->buf64.outputsSwapped;
     m_lastOutputs = m_currentOutputs;
 
     // Put the current outputs in the write buffer
@@ -369,22 +506,54 @@ void CcioBoardManager::Refresh() {
         ~((static_cast<uint64_t>(reverseBytes(
                                      static_cast<uint32_t>(m_outputsWithThrottling))) << 32) |
           reverseBytes(static_cast<uint32_t>(m_outputsWithThrottling >> 32)));
-    m_writeBuf.buf64.outputsSwapped =
+    writeBuf->buf64.outputsSwapped =
         outputSwapped >> ((MAX_CCIO_DEVICES - m_ccioCnt) * CCIO_PINS_PER_BOARD);
-    m_writeBuf.buf8[(MAX_CCIO_DEVICES - m_ccioCnt)] = MARKER_BYTE;
-    // Start the SPI transfer
-    m_serPort->SpiSsMode(SerialBase::CtrlLineModes::LINE_ON);
+    writeBuf->buf8[(MAX_CCIO_DEVICES - m_ccioCnt)] = MARKER_BYTE;
+    // The high-speed link sends this at the start of the next refresh
+    if (!m_linkFastActive) {
+        // Start the SPI transfer
+        m_serPort->SpiSsMode(SerialBase::CtrlLineModes::LINE_ON);
+        LinkTransferStart(m_writeBuf, m_readBuf);
+    }
+}
+
+void CcioBoardManager::LinkTransferStart(CcioBuf &writeBuf,
+        CcioBuf &readBuf) {
     m_serPort->SpiTransferDataAsync(
-        m_writeBuf.buf8 + (MAX_CCIO_DEVICES - m_ccioCnt),
-        m_readBuf.buf8 + (MAX_CCIO_DEVICES - m_ccioCnt) + 1, 2 * m_ccioCnt + 1);
+        writeBuf.buf8 + (MAX_CCIO_DEVICES - m_ccioCnt),
+        readBuf.buf8 + (MAX_CCIO_DEVICES - m_ccioCnt) + 1, 2 * m_ccioCnt + 1);
+}
+
+void CcioBoardManager::LinkFast(bool enable) {
+    m_linkFast = enable;
+    m_linkFastFailed = false;
+    if (!m_serPort || m_discoverState != CCIO_FOUND ||
+            m_linkFastActive == enable) {
+        return;
+    }
+    // Hold off the refresh, let its transfer finish, and rebuild the link
+    // at the new rate
+    m_ccioCnt = 0;
+    m_serPort->SpiAsyncWaitComplete();
+    m_discoverState = CCIO_SEARCH;
+    CcioDiscover(m_serPort);
 }
 
 void CcioBoardManager::RefreshSlow() {
+    if (m_discoverAsync) {
+        if (!DiscoverStep()) {
+            m_discoverAsync = false;
+            if (m_discoverCallback) {
+                m_discoverCallback(m_discoverState == CCIO_FOUND ?
+                                   m_ccioCnt : 0);
+            }
+        }
+        return;
+    }
     if (m_serPort && LinkBroken() && m_autoRediscover &&
             tickCnt - m_lastDiscoverTime > CCIO_REDISCOVER_TIME_TICKS) {
-        // Reset the discover state and try to remake the broken link network
-        m_discoverState = CCIO_SEARCH;
-        CcioDiscover(m_serPort);
+        // Try to remake the broken link network, a step per tick
+        m_discoverAsync = DiscoverBegin(m_serPort);
     }
 }
 
@@ -415,13 +584,21 @@ void CcioBoardManager::IoOverloadRT(uint64_t overloadState) {
     }
 }
 
+ISR_RAMFUNC void CcioBoardManager::InputsApply(uint64_t inputs) {
+    uint64_t lastInputs = m_filteredInputs;
+    m_filteredInputs = inputs;
+    // Find the rise/fall
+    m_inputRegRisen |= (inputs & ~lastInputs);
+    m_inputRegFallen |= (~inputs & lastInputs);
+}
+
 void CcioBoardManager::PinState(ClearCorePins pinNum, bool newState) {
-    if (pinNum < CLEARCORE_PIN_CCIO_BASE || pinNum >= CLEARCORE_PIN_CCIO_MAX) {
+    if (!PinOnChain(pinNum)) {
         return;
     }
 
     // Reposition the pin reference to work correctly with masking
-    uint32_t bitNum = static_cast<uint32_t>(pinNum - CLEARCORE_PIN_CCIO_BASE);
+    uint32_t bitNum = static_cast<uint32_t>(pinNum - m_pinBase);
 
     // Toggle the bit here and flush change in Refresh
     m_currentOutputs = modifyBit(m_currentOutputs, bitNum, newState);
@@ -430,14 +607,14 @@ void CcioBoardManager::PinState(ClearCorePins pinNum, bool newState) {
 void CcioBoardManager::OutputPulsesStart(ClearCorePins pinNum, uint32_t onTime,
         uint32_t offTime, uint16_t pulseCount,
         bool blockUntilDone) {
-    if (pinNum < CLEARCORE_PIN_CCIO_BASE || pinNum >= CLEARCORE_PIN_CCIO_MAX) {
+    if (!PinOnChain(pinNum)) {
         return;
     }
     if (onTime == 0 || offTime == 0) {
         return;
     }
     // Reposition the pin reference to work correctly with masking
-    pinNum = static_cast<ClearCorePins>(pinNum - CLEARCORE_PIN_CCIO_BASE);
+    pinNum = static_cast<ClearCorePins>(pinNum - m_pinBase);
     uint64_t pinMask = 1ULL << pinNum;
     // Do not start output pulses if we are in input mode
     if (!(pinMask & m_outputMask)) {
@@ -466,7 +643,71 @@ void CcioBoardManager::OutputPulsesStart(ClearCorePins pinNum, uint32_t onTime,
     }
 }
 
+void CcioBoardManager::OutputsStage(uint64_t mask, uint64_t value) {
+    m_stagedMask |= mask;
+    m_stagedValue = (m_stagedValue & ~mask) | (value & mask);
+}
+
+void CcioBoardManager::OutputsCommit() {
+    // Block the refresh so every staged pin goes out in the same frame
+    __disable_irq();
+    uint64_t mask = m_stagedMask & m_outputMask;
+    m_pulseActive &= ~mask;
+    m_currentOutputs = (m_currentOutputs & ~mask) | (m_stagedValue & mask);
+    __enable_irq();
+    m_stagedMask = 0;
+    m_stagedValue = 0;
+}
+
+bool CcioBoardManager::OutputSequenceStart(const OutputStep *steps,
+        uint16_t count, uint16_t passes) {
+    if (!steps || !count) {
+        return false;
+    }
+    uint64_t seqMask = 0;
+    for (uint16_t i = 0; i < count; i++) {
+        seqMask |= steps[i].Mask;
+    }
+
+    __disable_irq();
+    m_pulseActive &= ~seqMask;
+    m_seqCount = count;
+    m_seqIndex = 0;
+    m_seqPasses = passes;
+    m_seqPass = 0;
+    // The first step is applied by the next refresh
+    m_seqTicksLeft = 1;
+    m_seqSteps = steps;
+    __enable_irq();
+    return true;
+}
+
+void CcioBoardManager::OutputSequenceStop() {
+    m_seqSteps = NULL;
+}
+
+void CcioBoardManager::OutputSequenceNext() {
+    if (m_seqIndex == m_seqCount) {
+        m_seqIndex = 0;
+        if (m_seqPasses && ++m_seqPass >= m_seqPasses) {
+            // The last pass is done; hold the final step's states
+            m_seqSteps = NULL;
+            return;
+        }
+    }
+    const OutputStep &step = m_seqSteps[m_seqIndex++];
+    uint64_t mask = step.Mask & m_outputMask;
+    m_currentOutputs = (m_currentOutputs & ~mask) | (step.Value & mask);
+    uint32_t ticks = step.DurationMs * MS_TO_SAMPLES;
+    m_seqTicksLeft = ticks ? ticks : 1;
+}
+
 void CcioBoardManager::LinkClose() {
+    // Stop a discovery in progress and let its transfer finish
+    m_discoverAsync = false;
+    if (m_serPort) {
+        m_serPort->SpiAsyncWaitComplete();
+    }
     m_discoverState = CCIO_SEARCH;
     ShiftReg.LedPattern(m_faultLed, ShiftRegister::LED_BLINK_CCIO_COMM_ERR,
                         false);
@@ -477,11 +718,11 @@ void CcioBoardManager::LinkClose() {
 void CcioBoardManager::OutputPulsesStop(ClearCorePins pinNum,
                                         bool stopImmediately) {
     ClearCorePins ccioPinNum;
-    if (pinNum < CLEARCORE_PIN_CCIO_BASE || pinNum >= CLEARCORE_PIN_CCIO_MAX) {
+    if (!PinOnChain(pinNum)) {
         return;
     }
     // Reposition the pin reference to work correctly with masking
-    ccioPinNum = static_cast<ClearCorePins>(pinNum - CLEARCORE_PIN_CCIO_BASE);
+    ccioPinNum = static_cast<ClearCorePins>(pinNum - m_pinBase);
 
     uint64_t pinMask = 1ULL << ccioPinNum;
     if (stopImmediately) {
@@ -495,168 +736,226 @@ void CcioBoardManager::OutputPulsesStop(ClearCorePins pinNum,
 }
 
 uint8_t CcioBoardManager::CcioDiscover(SerialDriver *comInstance) {
+    // Let a discovery run by the system tick finish first
+    while (m_discoverAsync) {
+        continue;
+    }
     // Ignore calls to this function if the link has been built and is healthy
     if (m_discoverState == CCIO_FOUND || (LinkBroken() && !m_autoRediscover)) {
         return m_ccioCnt;
     }
 
-    uint8_t numFound = 0;
-    uint8_t flushCnt = 0;
-    bool sendData = true;
-    bool flush0Success = false;
+    if (!DiscoverBegin(comInstance)) {
+        return 0;
+    }
+    while (DiscoverStep()) {
+        continue;
+    }
+    return m_discoverState == CCIO_FOUND ? m_ccioCnt : 0;
+}
+
+bool CcioBoardManager::CcioDiscoverStart(SerialDriver *comInstance,
+        void (*callback)(uint8_t count)) {
+    if (m_discoverAsync || (m_discoverState == CCIO_FOUND && !LinkBroken()) ||
+            (LinkBroken() && !m_autoRediscover)) {
+        return false;
+    }
+    m_discoverCallback = callback;
+    // Keep the rediscover from starting a discovery of its own meanwhile
+    __disable_irq();
+    m_discoverAsync = DiscoverBegin(comInstance);
+    __enable_irq();
+    return m_discoverAsync;
+}
 
+bool CcioBoardManager::DiscoverBegin(SerialDriver *comInstance) {
+    // Hold off the rediscover for the time of this attempt
+    m_lastDiscoverTime = tickCnt;
     m_serPort = comInstance;
     if (!m_serPort) {
         m_faultLed = ShiftRegister::Masks::SR_NO_FEEDBACK_MASK;
-        m_lastDiscoverTime = tickCnt;
-        return 0;
+        return false;
     }
 
     m_faultLed = m_serPort->m_ledMask;
 
+    // Use the high-speed link unless it has already broken on this link
+    if (m_ccioLinkBroken && m_linkFastActive) {
+        m_linkFastFailed = true;
+    }
+    m_linkFastActive = m_linkFast && !m_linkFastFailed;
+    m_serPort->Speed(m_linkFastActive ? CCIO_FAST_BAUD_RATE :
+                     CCIO_DEFAULT_BAUD_RATE);
+
+    // The select stays asserted while probing, so the boards already on the
+    // link hold their outputs
     m_serPort->SpiSsMode(SerialBase::CtrlLineModes::LINE_ON);
-    while (m_discoverState != CCIO_FOUND) {
-        // Fail after too many attempts
-        if (flushCnt >= MAX_FLUSH_ATTEMPTS) {
-            m_ccioLinkBroken = true;
-            StatusMgr.BlinkCode(
-                BlinkCodeDriver::BLINK_GROUP_DEVICE_ERROR,
-                BlinkCodeDriver::DEVICE_ERROR_CCIO);
-            ShiftReg.LedPattern(m_faultLed,
-                                ShiftRegister::LED_BLINK_CCIO_ONLINE,
-                                false);
-            m_lastDiscoverTime = tickCnt;
-            return 0;
-        }
+    m_discoverState = CCIO_SEARCH;
+    m_discoverSend = true;
+    m_discoverFlush0 = false;
+    m_discoverFlushCnt = 0;
+    return true;
+}
+
+bool CcioBoardManager::DiscoverStep() {
+    // Each step starts a transfer and the next one checks what it read
+    if (m_serPort->SpiAsyncBusy()) {
+        return true;
+    }
+
+    // Fail after too many attempts
+    if (m_discoverFlushCnt >= MAX_FLUSH_ATTEMPTS) {
+        DiscoverFail();
+        return false;
+    }
 
-        switch (m_discoverState) {
-            case CCIO_SEARCH:
-                if (sendData) {
-                    // Flush with 1's
-                    FillBuffer(m_writeBuf.buf8, 2 * MAX_CCIO_DEVICES, 0xff);
-                    m_serPort->SpiTransferData(m_writeBuf.buf8, m_readBuf.buf8,
-                                               2 * MAX_CCIO_DEVICES);
-                    sendData = false;
+    switch (m_discoverState) {
+        case CCIO_SEARCH:
+            if (m_discoverSend) {
+                // Flush with 1's
+                FillBuffer(m_writeBuf.buf8, 2 * MAX_CCIO_DEVICES, 0xff);
+                m_serPort->SpiTransferDataAsync(m_writeBuf.buf8,
+                                                m_readBuf.buf8,
+                                                2 * MAX_CCIO_DEVICES);
+                m_discoverSend = false;
+            }
+            else {
+                // Check if any 1's got through, otherwise resend 1s
+                if (!AllEntriesEqual(m_readBuf.buf8,
+                                     2 * MAX_CCIO_DEVICES, 0)) {
+                    m_discoverState = CCIO_TEST;
+                    m_discoverFlushCnt = 0;
+                    m_discoverFlush0 = false;
+                }
+                m_discoverFlushCnt++;
+                m_discoverSend = true;
+            }
+            break;
+        case CCIO_TEST:
+            if (m_discoverSend) {
+                if (!m_discoverFlush0) {
+                    // Attempt to flush with 0's
+                    FillBuffer(m_writeBuf.buf8, 2 * MAX_CCIO_DEVICES, 0);
+                    m_serPort->SpiTransferDataAsync(m_writeBuf.buf8,
+                                                    m_readBuf.buf8,
+                                                    2 * MAX_CCIO_DEVICES);
                 }
                 else {
-                    // Check if any 1's got through, otherwise resend 1s
-                    if (!AllEntriesEqual(m_readBuf.buf8,
-                                         2 * MAX_CCIO_DEVICES, 0)) {
-                        m_discoverState = CCIO_TEST;
-                        flushCnt = 0;
-                        flush0Success = false;
-                    }
-                    flushCnt++;
-                    sendData = true;
+                    // Flush with a's, send extra byte to check for too many
+                    // CCIOs
+                    FillBuffer(m_writeBuf.buf8,
+                               2 * MAX_CCIO_DEVICES + 1, 0xaa);
+                    m_serPort->SpiTransferDataAsync(m_writeBuf.buf8,
+                                                    m_readBuf.buf8,
+                                                    2 * MAX_CCIO_DEVICES + 1);
                 }
-                break;
-            case CCIO_TEST:
-                if (sendData) {
-                    if (!flush0Success) {
-                        // Attempt to flush with 0's
-                        FillBuffer(m_writeBuf.buf8, 2 * MAX_CCIO_DEVICES, 0);
-                        m_serPort->SpiTransferData(m_writeBuf.buf8,
-                                                   m_readBuf.buf8,
-                                                   2 * MAX_CCIO_DEVICES);
-                    }
-                    else {
-                        // Flush with a's, send extra byte to check for too many
-                        // CCIOs
-                        FillBuffer(m_writeBuf.buf8,
-                                   2 * MAX_CCIO_DEVICES + 1, 0xaa);
-                        m_serPort->SpiTransferData(m_writeBuf.buf8,
-                                                   m_readBuf.buf8,
-                                                   2 * MAX_CCIO_DEVICES + 1);
+                m_discoverSend = false;
+            }
+            else {
+                if (!m_discoverFlush0) {
+                    // If 0's got through, try again with a's; otherwise
+                    // resend 0's.
+                    if (!AllEntriesEqual(m_readBuf.buf8,
+                                         2 * MAX_CCIO_DEVICES, 0xff)) {
+                        m_discoverFlush0 = true;
                     }
-                    sendData = false;
+                    m_discoverFlushCnt++;
                 }
                 else {
-                    if (!flush0Success) {
-                        // If 0's got through, try again with a's; otherwise
-                        // resend 0's.
-                        if (!AllEntriesEqual(m_readBuf.buf8,
-                                             2 * MAX_CCIO_DEVICES, 0xff)) {
-                            flush0Success = true;
+                    uint8_t i;
+                    uint8_t numFound = 0;
+                    bool foundAA = false;
+                    // Count until we see a's
+                    for (i = 0; i < 2 * MAX_CCIO_DEVICES && !foundAA; i++) {
+                        if (m_readBuf.buf8[i] == 0xaa) {
+                            foundAA = true;
                         }
-                        flushCnt++;
-                    }
-                    else {
-                        uint8_t i;
-                        bool foundAA = false;
-                        // Count until we see a's
-                        for (i = 0; i < 2 * MAX_CCIO_DEVICES && !foundAA; i++) {
-                            if (m_readBuf.buf8[i] == 0xaa) {
-                                foundAA = true;
-                            }
-                            else {
-                                numFound++;
-                            }
-                        }
-                        if (!foundAA &&
-                                m_readBuf.buf8[2 * MAX_CCIO_DEVICES] != 0xaa) {
-                            // Error state - too many CCIOs
-                            m_ccioCnt = 0;
-                            m_ccioMask = 0;
-                            m_ccioRefreshRate = RefreshRate();
-                            m_ccioLinkBroken = true;
-                            StatusMgr.BlinkCode(
-                                BlinkCodeDriver::BLINK_GROUP_DEVICE_ERROR,
-                                BlinkCodeDriver::DEVICE_ERROR_CCIO);
-                            ShiftReg.LedPattern(m_faultLed,
-                                                ShiftRegister::LED_BLINK_CCIO_ONLINE,
-                                                false);
-                            m_lastDiscoverTime = tickCnt;
-                            return 0;
+                        else {
+                            numFound++;
                         }
-                        // Break from loop
-                        m_discoverState = CCIO_FOUND;
-                        m_readBuf.Clear();
                     }
-                    sendData = true;
+                    if (!foundAA &&
+                            m_readBuf.buf8[2 * MAX_CCIO_DEVICES] != 0xaa) {
+                        // Error state - too many CCIOs
+                        m_ccioCnt = 0;
+                        m_ccioMask = 0;
+                        m_ccioRefreshRate = RefreshRate();
+                        DiscoverFail();
+                        return false;
+                    }
+                    m_discoverState = CCIO_FOUND;
+                    m_readBuf.Clear();
+                    // numFound is the number of input and output regs found
+                    // so divide by 2 to get CCIO-8 count
+                    DiscoverFinish(numFound >> 1);
+                    return false;
                 }
-                break;
-            default:
-                break;
-        }
+                m_discoverSend = true;
+            }
+            break;
+        default:
+            break;
     }
+    return true;
+}
 
-    // numFound is the number of input and output regs found
-    // so divide by 2 to get CCIO-8 count
-    numFound >>= 1;
-    m_ccioCnt = numFound;
-    m_ccioMask = (1 << (m_ccioCnt * CCIO_PINS_PER_BOARD)) - 1;
-    m_ccioRefreshRate = RefreshRate();
+void CcioBoardManager::DiscoverFail() {
+    m_ccioLinkBroken = true;
+    StatusMgr.BlinkCode(
+        BlinkCodeDriver::BLINK_GROUP_DEVICE_ERROR,
+        BlinkCodeDriver::DEVICE_ERROR_CCIO);
+    ShiftReg.LedPattern(m_faultLed,
+                        ShiftRegister::LED_BLINK_CCIO_ONLINE,
+                        false);
+    m_lastDiscoverTime = tickCnt;
+}
 
+void CcioBoardManager::DiscoverFinish(uint8_t numFound) {
     if (numFound != 0) {
         // Store the last outputs that had been sent for glitch comparison
         m_lastOutputsSwapped =
-            UINT64_MAX >> ((MAX_CCIO_DEVICES - m_ccioCnt) *
+            UINT64_MAX >> ((MAX_CCIO_DEVICES - numFound) *
                            CCIO_PINS_PER_BOARD);
 
         // Clear the outputs so that the CCIOs initialize cleanly
         m_writeBuf.Clear();
         m_writeBuf.buf64.outputsSwapped =
-            UINT64_MAX >> ((MAX_CCIO_DEVICES - m_ccioCnt) *
+            UINT64_MAX >> ((MAX_CCIO_DEVICES - numFound) *
                            CCIO_PINS_PER_BOARD);
         m_writeBuf.buf8[MAX_CCIO_DEVICES] = MARKER_BYTE;
 
         // Start the SPI transfer
         m_serPort->SpiTransferData(m_writeBuf.buf8 +
-                                   (MAX_CCIO_DEVICES - m_ccioCnt),
+                                   (MAX_CCIO_DEVICES - numFound),
                                    m_readBuf.buf8 +
-                                   (MAX_CCIO_DEVICES - m_ccioCnt) + 1,
-                                   2 * m_ccioCnt + 1);
+                                   (MAX_CCIO_DEVICES - numFound) + 1,
+                                   2 * numFound + 1);
         m_serPort->SpiSsMode(SerialBase::CtrlLineModes::LINE_OFF);
-        m_writeBuf.buf8[(MAX_CCIO_DEVICES - m_ccioCnt)] = MARKER_BYTE;
+        m_writeBuf.buf8[(MAX_CCIO_DEVICES - numFound)] = MARKER_BYTE;
         m_writeBuf.buf8[MAX_CCIO_DEVICES] = 0;
         m_serPort->SpiSsMode(SerialBase::CtrlLineModes::LINE_ON);
         m_serPort->SpiTransferData(m_writeBuf.buf8 +
-                                   (MAX_CCIO_DEVICES - m_ccioCnt),
+                                   (MAX_CCIO_DEVICES - numFound),
                                    m_readBuf.buf8 +
-                                   (MAX_CCIO_DEVICES - m_ccioCnt) + 1,
-                                   2 * m_ccioCnt + 1);
+                                   (MAX_CCIO_DEVICES - numFound) + 1,
+                                   2 * numFound + 1);
         m_serPort->SpiSsMode(SerialBase::CtrlLineModes::LINE_OFF);
 
+        // The high-speed link's first refresh sends a copy of the last
+        // transfer and processes its readback
+        m_writeBufAlt = m_writeBuf;
+        m_readBufAlt.Clear();
+        m_bufAlt = true;
+    }
+
+    // Publish the count only now that the link is set up, since the sample
+    // rate refresh may run in the middle of a discovery by the system tick
+    m_ccioCnt = numFound;
+    m_ccioMask = m_ccioCnt ? UINT64_MAX >> ((MAX_CCIO_DEVICES - m_ccioCnt) *
+                                            CCIO_PINS_PER_BOARD) : 0;
+    m_ccioRefreshRate = RefreshRate();
+
+    if (numFound != 0) {
         // We are now online and initialized
         m_ccioRefreshDelay = m_ccioRefreshRate;
         m_consGlitchCnt = 0;
@@ -671,7 +970,6 @@ uint8_t CcioBoardManager::CcioDiscover(SerialDriver *comInstance) {
                         (numFound > 0));
 
     m_lastDiscoverTime = tickCnt;
-    return numFound;
 }
 
 void CcioBoardManager::CcioRediscoverEnable(bool enable) {
@@ -679,9 +977,8 @@ void CcioBoardManager::CcioRediscoverEnable(bool enable) {
 }
 
 CcioPin *CcioBoardManager::PinByIndex(ClearCorePins connectorIndex) {
-    if (connectorIndex >= ClearCorePins::CLEARCORE_PIN_CCIO_BASE &&
-            connectorIndex < ClearCorePins::CLEARCORE_PIN_CCIO_MAX) {
-        return &m_ccioPins[connectorIndex - CLEARCORE_PIN_CCIO_BASE];
+    if (PinOnChain(connectorIndex)) {
+        return &m_ccioPins[connectorIndex - m_pinBase];
     }
     else {
         return NULL;
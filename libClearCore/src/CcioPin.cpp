@@ -33,10 +33,9 @@
 
 namespace ClearCore {
 
-extern CcioBoardManager &CcioMgr;
-
 CcioPin::CcioPin()
     : Connector(),
+      m_mgr(nullptr),
       m_dataBit(0),
       m_filterLength(3),
       m_filterTicksLeft(1),
@@ -51,7 +50,7 @@ CcioPin::CcioPin()
 
 void CcioPin::Initialize(ClearCorePins ccioPin) {
     m_clearCorePin = ccioPin;
-    m_dataBit = 1ULL << (ccioPin - CLEARCORE_PIN_CCIO_BASE);
+    m_dataBit = 1ULL << (ccioPin - m_mgr->m_pinBase);
     m_mode = ConnectorModes::INPUT_DIGITAL;
     m_filterLength = 3;
     m_filterTicksLeft = 1;
@@ -73,13 +72,13 @@ bool CcioPin::Mode(ConnectorModes newMode) {
     switch (newMode) {
         // Set up as output
         case OUTPUT_DIGITAL:
-            CcioMgr.m_outputMask |= m_dataBit;
+            m_mgr->m_outputMask |= m_dataBit;
             m_mode = newMode;
             break;
         // Set up as input
         case INPUT_DIGITAL:
-            CcioMgr.m_outputMask &= ~m_dataBit;
-            CcioMgr.m_pulseActive &= ~m_dataBit;
+            m_mgr->m_outputMask &= ~m_dataBit;
+            m_mgr->m_pulseActive &= ~m_dataBit;
             m_mode = newMode;
             break;
         // Unsupported mode, don't change anything
@@ -94,10 +93,10 @@ int16_t CcioPin::State() {
 
     switch (m_mode) {
         case OUTPUT_DIGITAL:
-            state = CcioMgr.m_currentOutputs & m_dataBit;
+            state = m_mgr->m_currentOutputs & m_dataBit;
             break;
         case INPUT_DIGITAL:
-            state = CcioMgr.m_filteredInputs & m_dataBit;
+            state = m_mgr->m_filteredInputs & m_dataBit;
             break;
         default:
             break;
@@ -112,10 +111,10 @@ bool CcioPin::State(int16_t newState) {
     switch (m_mode) {
         case OUTPUT_DIGITAL:
             if (newState) {
-                CcioMgr.m_currentOutputs |= m_dataBit;
+                m_mgr->m_currentOutputs |= m_dataBit;
             }
             else {
-                CcioMgr.m_currentOutputs &= ~m_dataBit;
+                m_mgr->m_currentOutputs &= ~m_dataBit;
             }
             success = true;
             break;
@@ -127,9 +126,18 @@ bool CcioPin::State(int16_t newState) {
     return success;
 }
 
+void CcioPin::FilterLength(uint16_t samples) {
+    // The refresh only counts down the filters flagged as in progress
+    __disable_irq();
+    m_filterLength = samples;
+    m_filterTicksLeft = samples;
+    m_mgr->m_filtering |= m_dataBit;
+    __enable_irq();
+}
+
 void CcioPin::Filter_ms(uint16_t len) {
     uint32_t samples =
-        static_cast<uint32_t>(len) * MS_TO_SAMPLES / CcioMgr.m_ccioRefreshRate;
+        static_cast<uint32_t>(len) * MS_TO_SAMPLES / m_mgr->m_ccioRefreshRate;
     if (samples > UINT16_MAX) {
         samples = UINT16_MAX;
     }
@@ -137,25 +145,25 @@ void CcioPin::Filter_ms(uint16_t len) {
 }
 
 bool CcioPin::InputRisen() {
-    return CcioMgr.InputsRisen(m_dataBit);
+    return m_mgr->InputsRisen(m_dataBit);
 }
 
 bool CcioPin::InputFallen() {
-    return CcioMgr.InputsFallen(m_dataBit);
+    return m_mgr->InputsFallen(m_dataBit);
 }
 
 bool CcioPin::IsInHwFault() {
-    return (volatile uint64_t &)(CcioMgr.m_ccioOverloaded) & m_dataBit;
+    return (volatile uint64_t &)(m_mgr->m_ccioOverloaded) & m_dataBit;
 }
 
 void CcioPin::OutputPulsesStart(uint32_t onTime, uint32_t offTime,
                                 uint16_t pulseCount, bool blockUntilDone) {
-    CcioMgr.OutputPulsesStart(m_clearCorePin, onTime, offTime, pulseCount,
+    m_mgr->OutputPulsesStart(m_clearCorePin, onTime, offTime, pulseCount,
                               blockUntilDone);
 }
 
 void CcioPin::OutputPulsesStop(bool stopImmediately) {
-    CcioMgr.OutputPulsesStop(m_clearCorePin, stopImmediately);
+    m_mgr->OutputPulsesStop(m_clearCorePin, stopImmediately);
 }
 
 } // ClearCore namespace
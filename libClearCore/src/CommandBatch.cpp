@@ -0,0 +1,355 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+    ClearCore binary command batch interpreter
+**/
+
+#include "CommandBatch.h"
+#include <sam.h>
+#include <string.h>
+#include "atomic_utils.h"
+#include "CrashManager.h"
+#include "InputManager.h"
+#include "MotorDriver.h"
+#include "MotorManager.h"
+#include "ProcessImage.h"
+#include "ReplayManager.h"
+#include "SysManager.h"
+
+namespace ClearCore {
+
+extern CrashManager &CrashMgr;
+extern InputManager &InputMgr;
+extern MotorManager &MotorMgr;
+extern ProcessImage &ProcessImg;
+extern ReplayManager &ReplayMgr;
+extern SysManager SysMgr;
+extern MotorDriver *const MotorConnectors[MOTOR_CON_CNT];
+extern volatile uint32_t tickCnt;
+
+CommandBatch &CmdBatch = CommandBatch::Instance();
+
+static inline uint16_t GetLe16(const uint8_t *data) {
+    return data[0] | (data[1] << 8);
+}
+static inline uint32_t GetLe32(const uint8_t *data) {
+    return GetLe16(data) | (static_cast<uint32_t>(GetLe16(data + 2)) << 16);
+}
+static inline void PutLe16(uint8_t *data, uint16_t value) {
+    data[0] = value & 0xFF;
+    data[1] = value >> 8;
+}
+static inline void PutLe32(uint8_t *data, uint32_t value) {
+    PutLe16(data, value & 0xFFFF);
+    PutLe16(data + 2, value >> 16);
+}
+
+// The IO-n connectors, as InputManager::InputsRT()
+static const uint32_t BATCH_IO_MASK =
+    ((1UL << PROCESS_IMAGE_IO_CNT) - 1) << CLEARCORE_PIN_IO0;
+
+CommandBatch &CommandBatch::Instance() {
+    static CommandBatch *instance = new CommandBatch();
+    return *instance;
+}
+
+CommandBatch::CommandBatch()
+    : m_state(BATCH_STATE_IDLE),
+      m_abort(false),
+      m_request(),
+      m_length(0),
+      m_recordPending(false),
+      m_count(0),
+      m_index(0),
+      m_offset(0),
+      m_waiting(false),
+      m_waitStart(0),
+      m_response(),
+      m_responseLength(0) {}
+
+uint8_t CommandBatch::CommandLength(uint8_t opcode) {
+    switch (opcode) {
+        case BATCH_OP_MOVE:
+            return 7;
+        case BATCH_OP_MOVE_VELOCITY:
+            return 6;
+        case BATCH_OP_OUTPUTS_WRITE:
+            return 9;
+        case BATCH_OP_SNAPSHOT_READ:
+            return 2;
+        case BATCH_OP_WAIT:
+            return 10;
+        default:
+            return 0;
+    }
+}
+
+bool CommandBatch::Submit(const uint8_t *request, uint16_t length) {
+    // A replay supplies the batches in place of the application
+    if (ReplayMgr.State() == ReplayManager::REPLAY_REPLAYING) {
+        return false;
+    }
+    return Load(request, length);
+}
+
+bool CommandBatch::Load(const uint8_t *request, uint16_t length) {
+    if (m_state != BATCH_STATE_IDLE || !request ||
+            length < BATCH_REQUEST_HEADER_LEN || length > BATCH_REQUEST_MAX) {
+        return false;
+    }
+
+    // Check the whole batch up front so that it only fails on the state
+    // of the machine when it runs
+    uint8_t count = request[1];
+    uint16_t offset = BATCH_REQUEST_HEADER_LEN;
+    uint32_t responseLength = BATCH_RESPONSE_HEADER_LEN;
+    for (uint8_t i = 0; i < count; i++) {
+        if (offset >= length) {
+            return false;
+        }
+        const uint8_t *command = request + offset;
+        uint8_t commandLength = CommandLength(command[0]);
+        if (!commandLength || offset + commandLength > length) {
+            return false;
+        }
+        switch (command[0]) {
+            case BATCH_OP_MOVE:
+                if (command[1] >= MOTOR_CON_CNT ||
+                        command[2] > StepGenerator::MOVE_TARGET_ABSOLUTE_NEG) {
+                    return false;
+                }
+                break;
+            case BATCH_OP_MOVE_VELOCITY:
+                if (command[1] >= MOTOR_CON_CNT) {
+                    return false;
+                }
+                break;
+            case BATCH_OP_OUTPUTS_WRITE:
+                if (GetLe32(command + 1) & ~BATCH_IO_MASK) {
+                    return false;
+                }
+                break;
+            case BATCH_OP_SNAPSHOT_READ:
+                if (command[1] & ~(BATCH_READ_INPUTS | BATCH_READ_MOTORS |
+                                   BATCH_READ_CRASH)) {
+                    return false;
+                }
+                if (command[1] & BATCH_READ_INPUTS) {
+                    responseLength += sizeof(ProcessImage::InputImage);
+                }
+                if (command[1] & BATCH_READ_MOTORS) {
+                    responseLength += sizeof(MotorManager::MotorsSnapshot);
+                }
+                if (command[1] & BATCH_READ_CRASH) {
+                    responseLength += sizeof(CrashManager::CrashSnapshot);
+                }
+                break;
+            case BATCH_OP_WAIT:
+                if (command[1] >= BATCH_WAIT_COUNT ||
+                        (command[1] == BATCH_WAIT_MOVES_DONE &&
+                         (GetLe32(command + 2) >> MOTOR_CON_CNT))) {
+                    return false;
+                }
+                break;
+            default:
+                break;
+        }
+        offset += commandLength;
+    }
+    if (offset != length || responseLength > BATCH_RESPONSE_MAX) {
+        return false;
+    }
+
+    memcpy(m_request, request, length);
+    m_length = length;
+    m_recordPending = true;
+    m_count = count;
+    m_index = 0;
+    m_offset = BATCH_REQUEST_HEADER_LEN;
+    m_waiting = false;
+    m_responseLength = BATCH_RESPONSE_HEADER_LEN;
+    m_abort = false;
+    // Publish the batch only once it is set up
+    atomic_store_n(&m_state, BATCH_STATE_RUNNING);
+    return true;
+}
+
+uint16_t CommandBatch::Response(uint8_t *buffer, uint16_t size) {
+    if (m_state != BATCH_STATE_DONE || !buffer || size < m_responseLength) {
+        return 0;
+    }
+    uint16_t length = m_responseLength;
+    memcpy(buffer, m_response, length);
+    atomic_store_n(&m_state, BATCH_STATE_IDLE);
+    return length;
+}
+
+void CommandBatch::Abort() {
+    m_abort = true;
+}
+
+ISR_RAMFUNC void CommandBatch::Update() {
+    if (m_state != BATCH_STATE_RUNNING) {
+        return;
+    }
+    if (m_abort) {
+        Finish(BATCH_ABORTED);
+        return;
+    }
+    // Tag the batch with the sample it starts in
+    if (m_recordPending) {
+        m_recordPending = false;
+        ReplayMgr.CommandRecord(m_request, m_length);
+    }
+
+    while (m_index < m_count) {
+        const uint8_t *command = m_request + m_offset;
+        if (command[0] == BATCH_OP_WAIT) {
+            bool timedOut;
+            if (!WaitMet(command, timedOut)) {
+                if (timedOut) {
+                    Finish(BATCH_TIMEOUT);
+                }
+                // Pick up from this wait in the next sample
+                return;
+            }
+        }
+        else if (!Execute(command)) {
+            Finish(BATCH_FAILED);
+            return;
+        }
+        m_offset += CommandLength(command[0]);
+        m_index++;
+    }
+    Finish(BATCH_DONE);
+}
+
+ISR_RAMFUNC bool CommandBatch::Execute(const uint8_t *command) {
+    switch (command[0]) {
+        case BATCH_OP_MOVE:
+            return MotorConnectors[command[1]]->Move(
+                       static_cast<int32_t>(GetLe32(command + 3)),
+                       static_cast<StepGenerator::MoveTarget>(command[2]));
+        case BATCH_OP_MOVE_VELOCITY:
+            return MotorConnectors[command[1]]->MoveVelocity(
+                       static_cast<int32_t>(GetLe32(command + 2)));
+        case BATCH_OP_OUTPUTS_WRITE: {
+            uint32_t mask = GetLe32(command + 1);
+            uint32_t value = GetLe32(command + 5);
+            // Write all of the outputs or none of them
+            for (uint8_t pin = CLEARCORE_PIN_IO0; pin <= CLEARCORE_PIN_IO5;
+                    pin++) {
+                if ((mask & (1UL << pin)) &&
+                        SysMgr.ConnectorByIndex(
+                            static_cast<ClearCorePins>(pin))->Mode() !=
+                        Connector::OUTPUT_DIGITAL) {
+                    return false;
+                }
+            }
+            for (uint8_t pin = CLEARCORE_PIN_IO0; pin <= CLEARCORE_PIN_IO5;
+                    pin++) {
+                if (mask & (1UL << pin)) {
+                    SysMgr.ConnectorByIndex(static_cast<ClearCorePins>(pin))->
+                    State((value >> pin) & 1);
+                }
+            }
+            return true;
+        }
+        case BATCH_OP_SNAPSHOT_READ:
+            // Both images were published at the end of the last sample
+            if (command[1] & BATCH_READ_INPUTS) {
+                const ProcessImage::InputImage &image =
+                    ProcessImg.m_inputs[ProcessImg.m_inputsSeq & 1];
+                memcpy(m_response + m_responseLength, &image, sizeof(image));
+                m_responseLength += sizeof(image);
+            }
+            if (command[1] & BATCH_READ_MOTORS) {
+                MotorManager::MotorsSnapshot snapshot;
+                MotorMgr.Snapshot(snapshot);
+                memcpy(m_response + m_responseLength, &snapshot,
+                       sizeof(snapshot));
+                m_responseLength += sizeof(snapshot);
+            }
+            if (command[1] & BATCH_READ_CRASH) {
+                const CrashManager::CrashSnapshot &crash = CrashMgr.Snapshot();
+                memcpy(m_response + m_responseLength, &crash, sizeof(crash));
+                m_responseLength += sizeof(crash);
+            }
+            return true;
+        default:
+            return false;
+    }
+}
+
+ISR_RAMFUNC bool CommandBatch::WaitMet(const uint8_t *command,
+                                       bool &timedOut) {
+    if (!m_waiting) {
+        m_waiting = true;
+        m_waitStart = tickCnt;
+    }
+    uint32_t arg = GetLe32(command + 2);
+    uint32_t timeout = GetLe32(command + 6);
+    uint32_t elapsed = tickCnt - m_waitStart;
+    bool met;
+    switch (command[1]) {
+        case BATCH_WAIT_SAMPLES:
+            met = elapsed >= arg;
+            break;
+        case BATCH_WAIT_INPUTS_ON:
+            met = (InputMgr.InputsRT().reg & arg) == arg;
+            break;
+        case BATCH_WAIT_INPUTS_OFF:
+            met = !(InputMgr.InputsRT().reg & arg);
+            break;
+        case BATCH_WAIT_MOVES_DONE:
+            met = true;
+            for (uint8_t i = 0; i < MOTOR_CON_CNT; i++) {
+                if ((arg & (1UL << i)) &&
+                        !MotorConnectors[i]->StepsComplete()) {
+                    met = false;
+                }
+            }
+            break;
+        default:
+            met = true;
+            break;
+    }
+    if (met) {
+        m_waiting = false;
+    }
+    timedOut = !met && timeout && elapsed >= timeout;
+    return met;
+}
+
+ISR_RAMFUNC void CommandBatch::Finish(BatchStatuses status) {
+    m_response[0] = m_request[0];
+    m_response[1] = status;
+    m_response[2] = m_index;
+    m_response[3] = 0;
+    PutLe32(m_response + 4, tickCnt);
+    m_waiting = false;
+    atomic_store_n(&m_state, BATCH_STATE_DONE);
+}
+
+} // ClearCore namespace
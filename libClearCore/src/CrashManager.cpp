@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+    ClearCore hard fault and watchdog crash snapshot
+**/
+
+#include "CrashManager.h"
+#include <sam.h>
+#include <string.h>
+#include "ISerial.h"
+#include "SysTiming.h"
+#include "TaskManager.h"
+
+namespace ClearCore {
+
+// Marks a snapshot saved since the last startup
+#define CRASH_MAGIC 0x43525348UL
+
+extern SysTiming &TimingMgr;
+extern TaskManager &TaskMgr;
+extern TraceManager &TraceMgr;
+extern volatile uint32_t tickCnt;
+
+CrashManager &CrashMgr = CrashManager::Instance();
+
+// Kept in the .noinit RAM section so the snapshot survives the reset
+struct CrashLog {
+    uint32_t Magic;
+    CrashManager::CrashSnapshot Snapshot;
+};
+
+static CrashLog crashLog __attribute__((section(".noinit")));
+static const CrashManager::CrashSnapshot crashNone =
+    CrashManager::CrashSnapshot();
+
+CrashManager &CrashManager::Instance() {
+    static CrashManager *instance = new CrashManager();
+    return *instance;
+}
+
+CrashManager::CrashManager()
+    : m_available(false) {
+    if (crashLog.Magic == CRASH_MAGIC) {
+        // The fault handler resets the board itself; a watchdog warning the
+        // main loop recovered from, without a watchdog reset, is not a crash
+        uint8_t resetCause = RSTC->RCAUSE.reg;
+        m_available =
+            (crashLog.Snapshot.Cause == CRASH_HARD_FAULT &&
+             (resetCause & RSTC_RCAUSE_SYST)) ||
+            (crashLog.Snapshot.Cause == CRASH_WATCHDOG &&
+             (resetCause & RSTC_RCAUSE_WDT));
+    }
+    // Report the snapshot for this startup only
+    crashLog.Magic = 0;
+}
+
+const CrashManager::CrashSnapshot &CrashManager::Snapshot() {
+    return m_available ? crashLog.Snapshot : crashNone;
+}
+
+void CrashManager::Record(CrashCauses cause, const uint32_t *frame,
+                          uint32_t excReturn, const uint32_t *callee) {
+    CrashSnapshot &snapshot = crashLog.Snapshot;
+    snapshot.Cause = cause;
+
+    // An overflowed stack may leave the frame outside of RAM; reading it
+    // would fault again
+    uint32_t sp = reinterpret_cast<uint32_t>(frame);
+    if (sp >= HSRAM_ADDR && sp + 8 * sizeof(uint32_t) <=
+            HSRAM_ADDR + HSRAM_SIZE) {
+        snapshot.R0 = frame[0];
+        snapshot.R1 = frame[1];
+        snapshot.R2 = frame[2];
+        snapshot.R3 = frame[3];
+        snapshot.R12 = frame[4];
+        snapshot.Lr = frame[5];
+        snapshot.Pc = frame[6];
+        snapshot.Xpsr = frame[7];
+    }
+    else {
+        snapshot.R0 = snapshot.R1 = snapshot.R2 = snapshot.R3 = 0;
+        snapshot.R12 = snapshot.Lr = snapshot.Pc = snapshot.Xpsr = 0;
+    }
+    memcpy(snapshot.R4To11, callee, sizeof(snapshot.R4To11));
+    snapshot.Sp = sp;
+    snapshot.ExcReturn = excReturn;
+    snapshot.Cfsr = SCB->CFSR;
+    snapshot.Hfsr = SCB->HFSR;
+    snapshot.Mmfar = SCB->MMFAR;
+    snapshot.Bfar = SCB->BFAR;
+
+    snapshot.UptimeMs = Milliseconds();
+    snapshot.Tick = tickCnt;
+    snapshot.Cycles = DWT->CYCCNT;
+    snapshot.IsrStartCycles = TimingMgr.m_isrStartCycle;
+    snapshot.IsrLastCycles = TimingMgr.m_isrLastCycles;
+    snapshot.IsrMinCycles = TimingMgr.m_isrMinCycles;
+    snapshot.IsrMaxCycles = TimingMgr.m_isrMaxCycles;
+    snapshot.LoopBlocker = TimingMgr.m_loopBlocker;
+    snapshot.TraceCount = TraceMgr.Latest(snapshot.Trace, CRASH_TRACE_RECORDS);
+
+    crashLog.Magic = CRASH_MAGIC;
+}
+
+static void ReportLine(ISerial &port, const char *label, uint32_t value) {
+    port.Send(label);
+    port.SendLine(value, 16);
+}
+
+void CrashManager::Report(ISerial &port) {
+    const CrashSnapshot &snapshot = Snapshot();
+    if (snapshot.Cause == CRASH_NONE) {
+        port.SendLine("No crash");
+        return;
+    }
+    port.SendLine(snapshot.Cause == CRASH_HARD_FAULT ? "Hard fault" :
+                  "Watchdog");
+    ReportLine(port, "PC:\t\t", snapshot.Pc);
+    ReportLine(port, "LR:\t\t", snapshot.Lr);
+    ReportLine(port, "SP:\t\t", snapshot.Sp);
+    ReportLine(port, "xPSR:\t\t", snapshot.Xpsr);
+    ReportLine(port, "EXC_RETURN:\t", snapshot.ExcReturn);
+    ReportLine(port, "R0:\t\t", snapshot.R0);
+    ReportLine(port, "R1:\t\t", snapshot.R1);
+    ReportLine(port, "R2:\t\t", snapshot.R2);
+    ReportLine(port, "R3:\t\t", snapshot.R3);
+    ReportLine(port, "R12:\t\t", snapshot.R12);
+    for (uint8_t i = 0; i < 8; i++) {
+        port.Send('R');
+        port.Send(static_cast<uint8_t>(i + 4));
+        ReportLine(port, ":\t\t", snapshot.R4To11[i]);
+    }
+    ReportLine(port, "CFSR:\t\t", snapshot.Cfsr);
+    ReportLine(port, "HFSR:\t\t", snapshot.Hfsr);
+    ReportLine(port, "MMFAR:\t\t", snapshot.Mmfar);
+    ReportLine(port, "BFAR:\t\t", snapshot.Bfar);
+    port.Send("Uptime ms:\t");
+    port.SendLine(snapshot.UptimeMs);
+    port.Send("Tick:\t\t");
+    port.SendLine(snapshot.Tick);
+    port.Send("ISR cycles:\t");
+    port.Send(snapshot.IsrLastCycles);
+    port.Send(" min ");
+    port.Send(snapshot.IsrMinCycles);
+    port.Send(" max ");
+    port.SendLine(snapshot.IsrMaxCycles);
+    port.Send("In ISR for:\t");
+    port.SendLine(snapshot.Cycles - snapshot.IsrStartCycles);
+    port.Send("Loop blocker:\t");
+    port.SendLine(snapshot.LoopBlocker);
+    for (uint32_t i = 0; i < snapshot.TraceCount; i++) {
+        const TraceRecord &record = snapshot.Trace[i];
+        port.Send("Trace ");
+        port.Send(record.Id, 16);
+        port.Send(' ');
+        port.Send(record.Arg);
+        port.Send(" at ");
+        port.SendLine(record.Cycles);
+    }
+}
+
+} // ClearCore namespace
+
+extern "C" void CrashFaultRecord(const uint32_t *frame, uint32_t excReturn,
+                                 const uint32_t *callee) {
+    ClearCore::CrashMgr.Record(ClearCore::CrashManager::CRASH_HARD_FAULT,
+                               frame, excReturn, callee);
+    NVIC_SystemReset();
+    while (true) {
+        continue;
+    }
+}
+
+extern "C" void CrashWatchdogRecord(const uint32_t *frame, uint32_t excReturn,
+                                    const uint32_t *callee) {
+    ClearCore::CrashMgr.Record(ClearCore::CrashManager::CRASH_WATCHDOG,
+                               frame, excReturn, callee);
+    ClearCore::TaskMgr.IrqHandlerWatchdog();
+}
+
+/**
+    Pass the stacked registers, the exception return value and R4-R11 to the
+    recording function. Ten registers are pushed to keep the stack 8-byte
+    aligned; R3 is only padding.
+**/
+#define CRASH_HANDLER(record)                                                  \
+    __asm volatile(                                                            \
+        "tst lr, #4\n"                                                         \
+        "ite eq\n"                                                             \
+        "mrseq r0, msp\n"                                                      \
+        "mrsne r0, psp\n"                                                      \
+        "mov r1, lr\n"                                                         \
+        "push {r3-r11, lr}\n"                                                  \
+        "add r2, sp, #4\n"                                                     \
+        "bl " #record "\n"                                                     \
+        "pop {r3-r11, pc}\n")
+
+extern "C" __attribute__((naked)) void HardFault_Handler(void) {
+    CRASH_HANDLER(CrashFaultRecord);
+}
+
+/**
+    Watchdog early warning
+**/
+extern "C" __attribute__((naked)) void WDT_Handler(void) {
+    CRASH_HANDLER(CrashWatchdogRecord);
+}
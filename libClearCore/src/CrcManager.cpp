@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    ClearCore CRC service on the Device Service Unit (DSU)
+**/
+
+#include "CrcManager.h"
+#include <sam.h>
+#include "atomic_utils.h"
+
+namespace ClearCore {
+
+#define CRC_DSU_ERRORS (DSU_STATUSA_BERR | DSU_STATUSA_FAIL | DSU_STATUSA_PERR)
+
+CrcManager &CrcMgr = CrcManager::Instance();
+
+// CRC-16 (polynomial 0xA001 reflected, initial value 0xFFFF) of each byte
+static const uint16_t Crc16Table[256] = {
+    0x0000, 0xC0C1, 0xC181, 0x0140, 0xC301, 0x03C0, 0x0280, 0xC241,
+    0xC601, 0x06C0, 0x0780, 0xC741, 0x0500, 0xC5C1, 0xC481, 0x0440,
+    0xCC01, 0x0CC0, 0x0D80, 0xCD41, 0x0F00, 0xCFC1, 0xCE81, 0x0E40,
+    0x0A00, 0xCAC1, 0xCB81, 0x0B40, 0xC901, 0x09C0, 0x0880, 0xC841,
+    0xD801, 0x18C0, 0x1980, 0xD941, 0x1B00, 0xDBC1, 0xDA81, 0x1A40,
+    0x1E00, 0xDEC1, 0xDF81, 0x1F40, 0xDD01, 0x1DC0, 0x1C80, 0xDC41,
+    0x1400, 0xD4C1, 0xD581, 0x1540, 0xD701, 0x17C0, 0x1680, 0xD641,
+    0xD201, 0x12C0, 0x1380, 0xD341, 0x1100, 0xD1C1, 0xD081, 0x1040,
+    0xF001, 0x30C0, 0x3180, 0xF141, 0x3300, 0xF3C1, 0xF281, 0x3240,
+    0x3600, 0xF6C1, 0xF781, 0x3740, 0xF501, 0x35C0, 0x3480, 0xF441,
+    0x3C00, 0xFCC1, 0xFD81, 0x3D40, 0xFF01, 0x3FC0, 0x3E80, 0xFE41,
+    0xFA01, 0x3AC0, 0x3B80, 0xFB41, 0x3900, 0xF9C1, 0xF881, 0x3840,
+    0x2800, 0xE8C1, 0xE981, 0x2940, 0xEB01, 0x2BC0, 0x2A80, 0xEA41,
+    0xEE01, 0x2EC0, 0x2F80, 0xEF41, 0x2D00, 0xEDC1, 0xEC81, 0x2C40,
+    0xE401, 0x24C0, 0x2580, 0xE541, 0x2700, 0xE7C1, 0xE681, 0x2640,
+    0x2200, 0xE2C1, 0xE381, 0x2340, 0xE101, 0x21C0, 0x2080, 0xE041,
+    0xA001, 0x60C0, 0x6180, 0xA141, 0x6300, 0xA3C1, 0xA281, 0x6240,
+    0x6600, 0xA6C1, 0xA781, 0x6740, 0xA501, 0x65C0, 0x6480, 0xA441,
+    0x6C00, 0xACC1, 0xAD81, 0x6D40, 0xAF01, 0x6FC0, 0x6E80, 0xAE41,
+    0xAA01, 0x6AC0, 0x6B80, 0xAB41, 0x6900, 0xA9C1, 0xA881, 0x6840,
+    0x7800, 0xB8C1, 0xB981, 0x7940, 0xBB01, 0x7BC0, 0x7A80, 0xBA41,
+    0xBE01, 0x7EC0, 0x7F80, 0xBF41, 0x7D00, 0xBDC1, 0xBC81, 0x7C40,
+    0xB401, 0x74C0, 0x7580, 0xB541, 0x7700, 0xB7C1, 0xB681, 0x7640,
+    0x7200, 0xB2C1, 0xB381, 0x7340, 0xB101, 0x71C0, 0x7080, 0xB041,
+    0x5000, 0x90C1, 0x9181, 0x5140, 0x9301, 0x53C0, 0x5280, 0x9241,
+    0x9601, 0x56C0, 0x5780, 0x9741, 0x5500, 0x95C1, 0x9481, 0x5440,
+    0x9C01, 0x5CC0, 0x5D80, 0x9D41, 0x5F00, 0x9FC1, 0x9E81, 0x5E40,
+    0x5A00, 0x9AC1, 0x9B81, 0x5B40, 0x9901, 0x59C0, 0x5880, 0x9841,
+    0x8801, 0x48C0, 0x4980, 0x8941, 0x4B00, 0x8BC1, 0x8A81, 0x4A40,
+    0x4E00, 0x8EC1, 0x8F81, 0x4F40, 0x8D01, 0x4DC0, 0x4C80, 0x8C41,
+    0x4400, 0x84C1, 0x8581, 0x4540, 0x8701, 0x47C0, 0x4680, 0x8641,
+    0x8201, 0x42C0, 0x4380, 0x8341, 0x4100, 0x81C1, 0x8081, 0x4040,
+};
+
+// CRC-32 of each nibble, polynomial 0xEDB88320 reflected
+static const uint32_t Crc32Table[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+    0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+    0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+};
+
+// The DSU works on the inverted CRC, as the software does between bytes
+static void DsuStart(const uint32_t *words, uint32_t count, uint32_t crc) {
+    DSU->STATUSA.reg = DSU_STATUSA_DONE | CRC_DSU_ERRORS;
+    DSU->ADDR.reg = reinterpret_cast<uint32_t>(words);
+    DSU->LENGTH.reg = DSU_LENGTH_LENGTH(count);
+    DSU->DATA.reg = ~crc;
+    DSU->CTRL.reg = DSU_CTRL_CRC;
+}
+
+static bool DsuResult(uint32_t &crc) {
+    if (DSU->STATUSA.reg & CRC_DSU_ERRORS) {
+        return false;
+    }
+    crc = ~DSU->DATA.reg;
+    return true;
+}
+
+CrcManager &CrcManager::Instance() {
+    static CrcManager *instance = new CrcManager();
+    return *instance;
+}
+
+CrcManager::CrcManager()
+    : m_dsuLock(false),
+      m_asyncActive(false),
+      m_asyncDsu(false),
+      m_asyncResult(0),
+      m_asyncCallback(nullptr),
+      m_asyncWords(nullptr),
+      m_asyncWordCount(0),
+      m_asyncCrc(0),
+      m_asyncTail(nullptr),
+      m_asyncTailLength(0) {}
+
+void CrcManager::Initialize() {
+    // The DSU comes out of reset write-protected
+    PAC->WRCTRL.reg = PAC_WRCTRL_PERID(ID_DSU) | PAC_WRCTRL_KEY_CLR;
+}
+
+uint32_t CrcManager::Crc32Software(const void *data, uint32_t length,
+                                   uint32_t crc) {
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    crc = ~crc;
+    while (length--) {
+        crc ^= *bytes++;
+        crc = (crc >> 4) ^ Crc32Table[crc & 0x0F];
+        crc = (crc >> 4) ^ Crc32Table[crc & 0x0F];
+    }
+    return ~crc;
+}
+
+uint16_t CrcManager::Crc16(const void *data, uint32_t length, uint16_t crc) {
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    while (length--) {
+        crc = (crc >> 8) ^ Crc16Table[(crc ^ *bytes++) & 0xFF];
+    }
+    return crc;
+}
+
+bool CrcManager::DsuClaim() {
+    return !atomic_test_and_set(&m_dsuLock);
+}
+
+void CrcManager::DsuRelease() {
+    atomic_clear(&m_dsuLock);
+}
+
+uint32_t CrcManager::Crc32(const void *data, uint32_t length, uint32_t crc) {
+    if (length < CRC_DSU_MIN_BYTES || !DsuClaim()) {
+        return Crc32Software(data, length, crc);
+    }
+    // The DSU reads whole, aligned words
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    uint8_t head = -reinterpret_cast<uint32_t>(bytes) & 3;
+    crc = Crc32Software(bytes, head, crc);
+    const uint32_t *words = reinterpret_cast<const uint32_t *>(bytes + head);
+    uint32_t count = (length - head) / sizeof(uint32_t);
+
+    DsuStart(words, count, crc);
+    while (!DSU->STATUSA.bit.DONE) {
+        continue;
+    }
+    if (!DsuResult(crc)) {
+        // Memory the DSU may not read, such as a protected flash region
+        crc = Crc32Software(words, count * sizeof(uint32_t), crc);
+    }
+    DsuRelease();
+
+    uint32_t done = head + count * sizeof(uint32_t);
+    return Crc32Software(bytes + done, length - done, crc);
+}
+
+bool CrcManager::Crc32Start(const void *data, uint32_t length, uint32_t crc,
+                            Crc32Callback callback) {
+    if (atomic_test_and_set(&m_asyncActive)) {
+        return false;
+    }
+    if (length < CRC_DSU_MIN_BYTES || !DsuClaim()) {
+        m_asyncResult = Crc32Software(data, length, crc);
+        atomic_clear(&m_asyncActive);
+        if (callback) {
+            callback(m_asyncResult);
+        }
+        return true;
+    }
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    uint8_t head = -reinterpret_cast<uint32_t>(bytes) & 3;
+    crc = Crc32Software(bytes, head, crc);
+    m_asyncWords = reinterpret_cast<const uint32_t *>(bytes + head);
+    m_asyncWordCount = (length - head) / sizeof(uint32_t);
+    m_asyncCrc = crc;
+    m_asyncTail = bytes + head + m_asyncWordCount * sizeof(uint32_t);
+    m_asyncTailLength = (length - head) % sizeof(uint32_t);
+    m_asyncCallback = callback;
+    DsuStart(m_asyncWords, m_asyncWordCount, crc);
+    // Hand the run to the SysTick update only once the DSU has started
+    atomic_store_n(&m_asyncDsu, true);
+    return true;
+}
+
+void CrcManager::Refresh() {
+    if (!m_asyncDsu || !DSU->STATUSA.bit.DONE) {
+        return;
+    }
+    m_asyncDsu = false;
+    uint32_t crc;
+    if (!DsuResult(crc)) {
+        crc = Crc32Software(m_asyncWords, m_asyncWordCount * sizeof(uint32_t),
+                            m_asyncCrc);
+    }
+    DsuRelease();
+    crc = Crc32Software(m_asyncTail, m_asyncTailLength, crc);
+    m_asyncResult = crc;
+    Crc32Callback callback = m_asyncCallback;
+    atomic_clear(&m_asyncActive);
+    if (callback) {
+        callback(crc);
+    }
+}
+
+} // ClearCore namespace
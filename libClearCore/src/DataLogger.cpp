@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    ClearCore sample rate data logger to the SD card
+**/
+
+#include "DataLogger.h"
+#include <string.h>
+#include "atomic_utils.h"
+#include "SysTiming.h"
+
+#define DATA_LOG_BUFFER_MASK (DATA_LOG_BUFFER_SIZE - 1)
+
+static_assert((DATA_LOG_BUFFER_SIZE & DATA_LOG_BUFFER_MASK) == 0,
+              "DATA_LOG_BUFFER_SIZE must be a power of two");
+static_assert(DATA_LOG_WRITE_SIZE % SD_BLOCK_SIZE == 0 &&
+              DATA_LOG_BUFFER_SIZE % DATA_LOG_WRITE_SIZE == 0,
+              "DATA_LOG_WRITE_SIZE must be whole blocks and divide "
+              "DATA_LOG_BUFFER_SIZE");
+
+namespace ClearCore {
+
+extern FatFileSystem &FileSys;
+
+DataLogger &DataLog = DataLogger::Instance();
+
+DataLogger &DataLogger::Instance() {
+    static DataLogger *instance = new DataLogger();
+    return *instance;
+}
+
+DataLogger::DataLogger()
+    : m_buffer(),
+      m_head(0),
+      m_tail(0),
+      m_recordCount(0),
+      m_dropCount(0),
+      m_file(),
+      m_compressor(NULL),
+      m_source(NULL),
+      m_decimation(1),
+      m_decimationCnt(1),
+      m_recordSize(0),
+      m_active(false),
+      m_failed(false),
+      m_syncMs(0) {}
+
+bool DataLogger::Start(const char *path, uint8_t recordSize,
+                       RecordFunction source, uint16_t decimation,
+                       uint32_t reserveBytes) {
+    if (m_file.IsOpen() || !recordSize || recordSize > DATA_LOG_RECORD_MAX ||
+            !decimation) {
+        return false;
+    }
+    if (m_compressor && !m_compressor->RecordSizeMatch(recordSize)) {
+        return false;
+    }
+    if (!FileSys.Mounted() && !FileSys.Mount()) {
+        return false;
+    }
+    if (!FileSys.Open(m_file, path, FatFileSystem::FILE_WRITE)) {
+        return false;
+    }
+    if (reserveBytes && !m_file.Reserve(reserveBytes)) {
+        m_file.Close();
+        return false;
+    }
+
+    m_head = 0;
+    m_tail = 0;
+    m_recordCount = 0;
+    m_dropCount = 0;
+    m_recordSize = recordSize;
+    m_source = source;
+    m_decimation = decimation;
+    m_decimationCnt = decimation;
+    m_failed = false;
+    m_syncMs = Milliseconds();
+    if (m_compressor) {
+        m_compressor->Reset();
+        m_compressor->Sink(BlockSink);
+    }
+    // Let the sample rate interrupt in once everything is set up
+    atomic_store_n(&m_active, true);
+    return true;
+}
+
+bool DataLogger::Stop() {
+    if (!m_file.IsOpen()) {
+        return false;
+    }
+    m_active = false;
+    bool success = !m_failed && BytesWrite(m_head - m_tail);
+    if (success && m_compressor && !m_compressor->Flush()) {
+        m_failed = true;
+        success = false;
+    }
+    return m_file.Close() && success;
+}
+
+bool DataLogger::Compression(LogCompressor *compressor) {
+    if (m_file.IsOpen() || (compressor && !compressor->Valid())) {
+        return false;
+    }
+    m_compressor = compressor;
+    return true;
+}
+
+bool DataLogger::Push(const void *record) {
+    if (!m_active) {
+        return false;
+    }
+    uint32_t head = m_head;
+    if (DATA_LOG_BUFFER_SIZE - (head - atomic_load_n(&m_tail)) <
+            m_recordSize) {
+        m_dropCount++;
+        return false;
+    }
+
+    // Split the record at the end of the ring
+    uint32_t offset = head & DATA_LOG_BUFFER_MASK;
+    uint32_t first = DATA_LOG_BUFFER_SIZE - offset;
+    if (first > m_recordSize) {
+        first = m_recordSize;
+    }
+    memcpy(m_buffer + offset, record, first);
+    memcpy(m_buffer, static_cast<const uint8_t *>(record) + first,
+           m_recordSize - first);
+
+    // Publish the record to Refresh() once it is complete
+    atomic_store_n(&m_head, head + m_recordSize);
+    m_recordCount++;
+    return true;
+}
+
+void DataLogger::Refresh() {
+    if (!m_active) {
+        return;
+    }
+
+    // Write each whole piece that is ready, but no more than one ring's
+    // worth per call so the main loop keeps moving
+    for (uint32_t i = 0; i < DATA_LOG_BUFFER_SIZE / DATA_LOG_WRITE_SIZE;
+            i++) {
+        if (atomic_load_n(&m_head) - m_tail < DATA_LOG_WRITE_SIZE) {
+            break;
+        }
+        if (!BytesWrite(DATA_LOG_WRITE_SIZE)) {
+            return;
+        }
+    }
+
+    if (Milliseconds() - m_syncMs >= DATA_LOG_SYNC_MS) {
+        m_syncMs = Milliseconds();
+        if (!m_file.Sync()) {
+            m_failed = true;
+            m_active = false;
+        }
+    }
+}
+
+void DataLogger::Sample() {
+    if (!m_active || !m_source || --m_decimationCnt) {
+        return;
+    }
+    m_decimationCnt = m_decimation;
+
+    uint32_t record[DATA_LOG_RECORD_MAX / sizeof(uint32_t)];
+    m_source(reinterpret_cast<uint8_t *>(record));
+    Push(record);
+}
+
+bool DataLogger::BytesWrite(uint32_t length) {
+    while (length) {
+        // Writes stay inside the ring; the pieces written while logging
+        // never cross its end
+        uint32_t offset = m_tail & DATA_LOG_BUFFER_MASK;
+        uint32_t count = DATA_LOG_BUFFER_SIZE - offset;
+        if (count > length) {
+            count = length;
+        }
+        bool written = m_compressor ?
+                       m_compressor->Write(m_buffer + offset, count) :
+                       m_file.Write(m_buffer + offset, count) ==
+                       static_cast<int32_t>(count);
+        if (!written) {
+            m_failed = true;
+            m_active = false;
+            return false;
+        }
+        // Hand the space back to the producer
+        atomic_store_n(&m_tail, m_tail + count);
+        length -= count;
+    }
+    return true;
+}
+
+bool DataLogger::BlockSink(const uint8_t *data, uint16_t length) {
+    return DataLog.m_file.Write(data, length) == length;
+}
+
+} // ClearCore namespace
@@ -0,0 +1,315 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    ClearCore change-only telemetry encoding
+**/
+
+#include "DeltaTelemetry.h"
+#include <math.h>
+#include <string.h>
+#include "SysTiming.h"
+
+namespace ClearCore {
+
+static uint64_t ZigZag(uint64_t value) {
+    return (value << 1) ^ (0 - (value >> 63));
+}
+
+static uint64_t UnZigZag(uint64_t value) {
+    return (value >> 1) ^ (0 - (value & 1));
+}
+
+static uint8_t *VarintPut(uint8_t *out, uint64_t value) {
+    while (value >= 0x80) {
+        *out++ = static_cast<uint8_t>(value) | 0x80;
+        value >>= 7;
+    }
+    *out++ = static_cast<uint8_t>(value);
+    return out;
+}
+
+static const uint8_t *VarintGet(const uint8_t *in, const uint8_t *end,
+                                uint64_t &value) {
+    value = 0;
+    for (uint8_t shift = 0; in < end && shift < 64; shift += 7) {
+        uint8_t byte = *in++;
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return in;
+        }
+    }
+    return nullptr;
+}
+
+// Read a value as raw bits, sign extending signed values
+static uint64_t ValueRead(const uint8_t *data, const DeltaTelemetry::Field &f) {
+    uint64_t value = 0;
+    memcpy(&value, data, f.Size);
+    if (f.Kind == DeltaTelemetry::TELEMETRY_SIGNED && f.Size < 8) {
+        uint64_t sign = 1ULL << (f.Size * 8 - 1);
+        value = (value ^ sign) - sign;
+    }
+    return value;
+}
+
+// Bring a decoded value back into the range of its field
+static uint64_t ValueNormalize(uint64_t value, const DeltaTelemetry::Field &f) {
+    if (f.Size == 8) {
+        return value;
+    }
+    uint64_t mask = (1ULL << (f.Size * 8)) - 1;
+    value &= mask;
+    if (f.Kind == DeltaTelemetry::TELEMETRY_SIGNED) {
+        uint64_t sign = 1ULL << (f.Size * 8 - 1);
+        value = (value ^ sign) - sign;
+    }
+    return value;
+}
+
+static float FloatGet(uint64_t value) {
+    uint32_t bits = static_cast<uint32_t>(value);
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+DeltaTelemetry::DeltaTelemetry(const Field *fields, uint8_t count,
+                               uint32_t keyframeMs)
+    : m_fields(fields),
+      m_count(count),
+      m_values(0),
+      m_frameSizeMax(2),
+      m_last(),
+      m_sequence(0),
+      m_synced(false),
+      m_keyframeRequested(false),
+      m_keyframeMs(keyframeMs),
+      m_keyframeLastMs(0),
+      m_frameCount(0),
+      m_keyframeCount(0),
+      m_byteCount(0) {
+    uint16_t valuesSize = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        const Field &field = fields[i];
+        uint8_t valueMax = (field.Kind == TELEMETRY_FLOAT) ? 4 :
+                           (field.Size == 8) ? 10 : 5;
+        m_values += field.Count;
+        valuesSize += field.Count * valueMax;
+    }
+    if (m_values > DELTA_TELEMETRY_VALUES_MAX) {
+        // Leave a table that does not fit unused
+        m_count = 0;
+        m_values = 0;
+        valuesSize = 0;
+    }
+    m_frameSizeMax = 2 + (m_values + 7) / 8 + valuesSize;
+}
+
+uint16_t DeltaTelemetry::Encode(const void *snapshot, uint8_t *frame,
+                                uint16_t size) {
+    if (!m_count || !snapshot || !frame || size < m_frameSizeMax) {
+        return 0;
+    }
+    uint32_t nowMs = Milliseconds();
+    bool keyframe = !m_synced || m_keyframeRequested ||
+                    nowMs - m_keyframeLastMs >= m_keyframeMs;
+
+    const uint8_t *data = static_cast<const uint8_t *>(snapshot);
+    uint8_t *bitmap = frame + 2;
+    uint16_t bitmapLen = keyframe ? 0 : (m_values + 7) / 8;
+    memset(bitmap, 0, bitmapLen);
+    uint8_t *out = bitmap + bitmapLen;
+
+    uint16_t index = 0;
+    for (uint8_t i = 0; i < m_count; i++) {
+        const Field &field = m_fields[i];
+        const uint8_t *fieldData = data + field.Offset;
+        for (uint8_t j = 0; j < field.Count; j++, index++) {
+            uint64_t value = ValueRead(fieldData + j * field.Size, field);
+            uint64_t &last = m_last[index];
+            if (!keyframe) {
+                if (!Changed(field, value, last)) {
+                    continue;
+                }
+                bitmap[index >> 3] |= 1 << (index & 7);
+            }
+            out = ValuePut(out, field, value, last, keyframe);
+            last = value;
+        }
+    }
+    if (out == bitmap + bitmapLen && !keyframe) {
+        // Nothing moved past its deadband
+        return 0;
+    }
+
+    frame[0] = keyframe ? DELTA_TELEMETRY_KEYFRAME : DELTA_TELEMETRY_DELTA;
+    frame[1] = m_sequence++;
+    if (keyframe) {
+        m_synced = true;
+        m_keyframeRequested = false;
+        m_keyframeLastMs = nowMs;
+        m_keyframeCount++;
+    }
+    uint16_t length = out - frame;
+    m_frameCount++;
+    m_byteCount += length;
+    return length;
+}
+
+bool DeltaTelemetry::Decode(const uint8_t *frame, uint16_t length,
+                            void *snapshot) {
+    if (!m_count || !frame || !snapshot || length < 2) {
+        return false;
+    }
+    bool keyframe = frame[0] == DELTA_TELEMETRY_KEYFRAME;
+    if (!keyframe && frame[0] != DELTA_TELEMETRY_DELTA) {
+        return false;
+    }
+    if (!keyframe && (!m_synced || frame[1] != m_sequence)) {
+        // The delta builds on a frame that never arrived
+        m_synced = false;
+        return false;
+    }
+
+    const uint8_t *end = frame + length;
+    const uint8_t *bitmap = frame + 2;
+    uint16_t bitmapLen = keyframe ? 0 : (m_values + 7) / 8;
+    const uint8_t *in = bitmap + bitmapLen;
+    if (in > end) {
+        m_synced = false;
+        return false;
+    }
+
+    uint16_t index = 0;
+    for (uint8_t i = 0; i < m_count; i++) {
+        const Field &field = m_fields[i];
+        for (uint8_t j = 0; j < field.Count; j++, index++) {
+            if (!keyframe && !(bitmap[index >> 3] & (1 << (index & 7)))) {
+                continue;
+            }
+            in = ValueGet(in, end, field, m_last[index], keyframe);
+            if (!in) {
+                m_synced = false;
+                return false;
+            }
+        }
+    }
+    if (in != end) {
+        m_synced = false;
+        return false;
+    }
+
+    // Write the snapshot only once the whole frame has been taken in
+    uint8_t *data = static_cast<uint8_t *>(snapshot);
+    index = 0;
+    for (uint8_t i = 0; i < m_count; i++) {
+        const Field &field = m_fields[i];
+        for (uint8_t j = 0; j < field.Count; j++, index++) {
+            memcpy(data + field.Offset + j * field.Size, &m_last[index],
+                   field.Size);
+        }
+    }
+
+    m_sequence = frame[1] + 1;
+    if (keyframe) {
+        m_synced = true;
+        m_keyframeCount++;
+    }
+    m_frameCount++;
+    m_byteCount += length;
+    return true;
+}
+
+bool DeltaTelemetry::Changed(const Field &field, uint64_t value,
+                             uint64_t last) {
+    if (value == last) {
+        return false;
+    }
+    switch (field.Kind) {
+        case TELEMETRY_BITS:
+            return true;
+        case TELEMETRY_FLOAT:
+            // A change to or from NaN is always sent
+            return !(fabsf(FloatGet(value) - FloatGet(last)) <=
+                     field.Deadband);
+        default: {
+            int64_t delta = static_cast<int64_t>(value - last);
+            uint64_t magnitude = (delta < 0) ? 0 - static_cast<uint64_t>(delta)
+                                 : static_cast<uint64_t>(delta);
+            return static_cast<float>(magnitude) > field.Deadband;
+        }
+    }
+}
+
+uint8_t *DeltaTelemetry::ValuePut(uint8_t *out, const Field &field,
+                                  uint64_t value, uint64_t last,
+                                  bool keyframe) {
+    switch (field.Kind) {
+        case TELEMETRY_FLOAT: {
+            uint32_t bits = static_cast<uint32_t>(value);
+            memcpy(out, &bits, sizeof(bits));
+            return out + sizeof(bits);
+        }
+        case TELEMETRY_BITS:
+            return VarintPut(out, keyframe ? value : value ^ last);
+        case TELEMETRY_SIGNED:
+            return VarintPut(out, ZigZag(keyframe ? value : value - last));
+        default:
+            return VarintPut(out, keyframe ? value : ZigZag(value - last));
+    }
+}
+
+const uint8_t *DeltaTelemetry::ValueGet(const uint8_t *in, const uint8_t *end,
+                                        const Field &field, uint64_t &value,
+                                        bool keyframe) {
+    if (field.Kind == TELEMETRY_FLOAT) {
+        if (end - in < 4) {
+            return nullptr;
+        }
+        uint32_t bits;
+        memcpy(&bits, in, sizeof(bits));
+        value = bits;
+        return in + sizeof(bits);
+    }
+
+    uint64_t coded;
+    in = VarintGet(in, end, coded);
+    if (!in) {
+        return nullptr;
+    }
+    switch (field.Kind) {
+        case TELEMETRY_BITS:
+            value = keyframe ? coded : value ^ coded;
+            break;
+        case TELEMETRY_SIGNED:
+            value = keyframe ? UnZigZag(coded) : value + UnZigZag(coded);
+            break;
+        default:
+            value = keyframe ? coded : value + UnZigZag(coded);
+            break;
+    }
+    value = ValueNormalize(value, field);
+    return in;
+}
+
+} // ClearCore namespace
@@ -30,12 +30,15 @@
 #include <sam.h>
 #include "atomic_utils.h"
 #include "InputManager.h"
+#include "SysManager.h"
+#include "SysTiming.h"
 #include "SysUtils.h"
 
 namespace ClearCore {
 
 extern ShiftRegister ShiftReg;
 extern InputManager &InputMgr;
+extern SysManager SysMgr;
 
 #define OVERLOAD_CHECK_HOLDOFF 3
 
@@ -62,12 +65,31 @@ DigitalIn::DigitalIn(
       m_inputRegRTPtr(nullptr),
       m_stateFiltered(false),
       m_filterLength(3),
-      m_filterTicksLeft(1) {}
+      m_filterTicksLeft(1),
+      m_filterHardware(false),
+      m_filterBankMask(0) {}
 
 /**
     Set connector's internal state and update filtering if required.
 **/
 void DigitalIn::Refresh() {
+    if (m_filterHardware) {
+        // The EIC has done the filtering; just track its state
+        bool state = !(EIC->PINSTATE.reg & (1UL << m_extInt));
+        if (state != m_stateFiltered) {
+            UpdateFilterState();
+        }
+        return;
+    }
+
+    if (m_filterBankMask) {
+        // The onboard inputs are counted down together by the InputManager
+        if (InputMgr.m_filterSettled & m_filterBankMask) {
+            UpdateFilterState();
+        }
+        return;
+    }
+
     if (*m_changeRegPtr & m_inputDataMask) {
         m_filterTicksLeft = m_filterLength;
 
@@ -112,11 +134,27 @@ void DigitalIn::Initialize(ClearCorePins clearCorePin) {
     ShiftReg.ShifterState(m_stateFiltered, m_ledMask);
 
     m_clearCorePin = clearCorePin;
+    if (clearCorePin >= 0 && clearCorePin < INPUT_FILTER_PINS) {
+        InputMgr.FilterBankAdd(clearCorePin, m_inputPort, m_inputDataMask);
+        InputMgr.FilterBankLength(clearCorePin, m_filterLength,
+                                  m_filterTicksLeft);
+        m_filterBankMask = 1UL << clearCorePin;
+    }
     Mode(INPUT_DIGITAL);
 }
 
+void DigitalIn::FilterLength(uint16_t length, FilterUnits units) {
+    // 1 ms = 1000 us = 5 * (200 us) = 5 sample times
+    uint16_t samples = (units == FILTER_UNIT_MS) ? 5 * length : length;
+    m_filterLength = samples;
+    m_filterTicksLeft = samples;
+    if (m_filterBankMask) {
+        InputMgr.FilterBankLength(m_clearCorePin, samples, samples);
+    }
+}
+
 int16_t DigitalIn::State() {
-    if (m_filterLength == 0) {
+    if (m_filterLength == 0 && !m_filterHardware) {
         // Pull an unfiltered, real time input value.
         return StateRT();
     }
@@ -150,9 +188,90 @@ void DigitalIn::InterruptEnable(bool enable) {
     InputMgr.InterruptEnable(m_extInt, enable);
 }
 
+bool DigitalIn::Mode(ConnectorModes newMode) {
+    // A connector the application configured is refreshed every sample
+    SysMgr.ConnectorActive(m_clearCorePin, true);
+    switch (newMode) {
+        case INPUT_DIGITAL:
+            if (m_mode == INPUT_COUNTER) {
+                InputMgr.CounterStop();
+            }
+            m_mode = newMode;
+            return true;
+        case INPUT_COUNTER:
+            if (m_mode == INPUT_COUNTER) {
+                return true;
+            }
+            if (!m_interruptAvail || !InputMgr.CounterStart(m_extInt)) {
+                return false;
+            }
+            m_mode = newMode;
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool DigitalIn::FilterHardware(bool enable) {
+    if (!m_interruptAvail) {
+        return false;
+    }
+    if (enable == m_filterHardware) {
+        return true;
+    }
+    // The filter bank no longer settles this input for the SysManager
+    SysMgr.ConnectorActive(m_clearCorePin, true);
+    if (!InputMgr.HardwareFilterSet(m_extInt, enable)) {
+        return false;
+    }
+    m_filterHardware = enable;
+    // Pick up the state from the newly selected filter
+    UpdateFilterState();
+    m_filterTicksLeft = 0;
+    if (m_filterBankMask) {
+        InputMgr.FilterBankLength(m_clearCorePin, m_filterLength, 0);
+    }
+    return true;
+}
+
+uint32_t DigitalIn::Count() {
+    return (m_mode == INPUT_COUNTER) ? InputMgr.m_counterCount : 0;
+}
+
+void DigitalIn::CountReset() {
+    if (m_mode == INPUT_COUNTER) {
+        InputMgr.CounterReset();
+    }
+}
+
+float DigitalIn::Frequency() {
+    return (m_mode == INPUT_COUNTER) ? InputMgr.m_counterFrequency : 0;
+}
+
+bool DigitalIn::FrequencyGateMs(uint16_t gateMs) {
+    if (!gateMs) {
+        return false;
+    }
+    InputMgr.m_counterGateTicks = gateMs * MS_TO_SAMPLES;
+    return true;
+}
+
+bool DigitalIn::EventEdgeTimed(bool enable) {
+    if (!m_interruptAvail) {
+        return false;
+    }
+    return InputMgr.EventLineSet(m_extInt, 1UL << m_clearCorePin, m_inputPort,
+                                 m_inputDataMask, enable);
+}
+
 // Write the current filtered pin status back to the member variables
 void DigitalIn::UpdateFilterState() {
-    m_stateFiltered = !(*m_inRegPtr & m_inputDataMask);
+    if (m_filterHardware) {
+        m_stateFiltered = !(EIC->PINSTATE.reg & (1UL << m_extInt));
+    }
+    else {
+        m_stateFiltered = !(*m_inRegPtr & m_inputDataMask);
+    }
     ShiftReg.ShifterState(m_stateFiltered, m_ledMask);
 
     // Update the SysManager Register
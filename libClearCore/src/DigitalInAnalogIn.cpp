@@ -30,6 +30,7 @@
 #include "DigitalInAnalogIn.h"
 #include "AdcManager.h"
 #include "StatusManager.h"
+#include "SysManager.h"
 #include "SysUtils.h"
 
 namespace ClearCore {
@@ -37,6 +38,7 @@ namespace ClearCore {
 extern ShiftRegister ShiftReg;
 extern AdcManager &AdcMgr;
 extern StatusManager &StatusMgr;
+extern SysManager SysMgr;
 
 DigitalInAnalogIn::DigitalInAnalogIn(ShiftRegister::Masks ledMask,
                                      ShiftRegister::Masks modeControlMask,
@@ -75,6 +77,7 @@ void DigitalInAnalogIn::Refresh() {
             }
             break;
         case INPUT_DIGITAL:
+        case INPUT_COUNTER:
             DigitalIn::Refresh();
             break;
         default:
@@ -110,11 +113,13 @@ int16_t DigitalInAnalogIn::State() {
                 state = -1;
             }
             else {
-                state = *m_adcResultConvertedFilteredPtr >>
-                        (15 - AdcMgr.AdcResolution());
+                uint8_t bits = min(AdcMgr.ChannelResolution(m_adcChannel),
+                                   15);
+                state = *m_adcResultConvertedFilteredPtr >> (15 - bits);
             }
             break;
         case INPUT_DIGITAL:
+        case INPUT_COUNTER:
             state = DigitalIn::State();
             break;
         default:
@@ -130,12 +135,29 @@ bool DigitalInAnalogIn::FilterTc(uint16_t tc,
 }
 
 bool DigitalInAnalogIn::Mode(ConnectorModes newMode) {
+    // Refresh from the next sample on; the mode change below waits on it
+    SysMgr.ConnectorActive(m_clearCorePin, true);
     // Bail out if we are already in the requested mode
     if (newMode == m_mode) {
         return true;
     }
 
+    // Leaving counter mode frees the counter for another connector
+    if (m_mode == INPUT_COUNTER) {
+        DigitalIn::Mode(INPUT_DIGITAL);
+        if (newMode == INPUT_DIGITAL) {
+            return true;
+        }
+    }
+
     switch (newMode) {
+        case INPUT_COUNTER:
+            // The counter uses the digital input path
+            if (!Mode(INPUT_DIGITAL)) {
+                return false;
+            }
+            DigitalIn::Mode(INPUT_COUNTER);
+            break;
         case INPUT_DIGITAL:
             ShiftReg.ShifterState(true, m_modeControlBitMask);
             // If the system has already been initialized, wait until the
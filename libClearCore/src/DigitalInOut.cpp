@@ -31,16 +31,59 @@
 #include "DigitalInOut.h"
 #include <sam.h>
 #include "StatusManager.h"
+#include "SysManager.h"
 #include "SysTiming.h"
 #include "SysUtils.h"
 
 #define OVERLOAD_TRIP_TICKS ((uint8_t)(2.4 * MS_TO_SAMPLES))
 #define OVERLOAD_FOLDBACK_TICKS (100 * MS_TO_SAMPLES)
 
+static_assert(2.4 * MS_TO_SAMPLES <= UINT8_MAX,
+              "OVERLOAD_TRIP_TICKS must fit its 8-bit counter");
+static_assert(OVERLOAD_FOLDBACK_TICKS <= UINT16_MAX,
+              "OVERLOAD_FOLDBACK_TICKS must fit its 16-bit counter");
+
+// The output TCs run from GCLK6, which the HLFB and capture TCs share
+#define PWM_TC_CLOCK_HZ 2048000
+#define PWM_COUNTS_16BIT 65536UL
+// The 8-bit period stops at 255 counts so a compare of 255 is never true
+#define PWM_COUNTS_8BIT_MAX 255
+
 namespace ClearCore {
 
+static const uint16_t pwmPrescalers[] = {1, 2, 4, 8, 16, 64, 256, 1024};
+
+static inline bool PwmIs16Bit(Tc *tc) {
+    return tc->COUNT8.CTRLA.bit.MODE == TC_CTRLA_MODE_COUNT16_Val;
+}
+
+static inline uint32_t PwmCounts(Tc *tc) {
+    return PwmIs16Bit(tc) ? PWM_COUNTS_16BIT : tc->COUNT8.PER.reg + 1UL;
+}
+
+static inline uint32_t PwmCcRead(Tc *tc, uint8_t channel) {
+    return PwmIs16Bit(tc) ? tc->COUNT16.CCBUF[channel].reg :
+           tc->COUNT8.CCBUF[channel].reg;
+}
+
+static inline void PwmCcWrite(Tc *tc, uint8_t channel, uint32_t cc) {
+    uint32_t syncMask = channel ? TC_SYNCBUSY_CC1 : TC_SYNCBUSY_CC0;
+    if (PwmIs16Bit(tc)) {
+        cc = min(cc, PWM_COUNTS_16BIT - 1);
+        if (tc->COUNT16.CCBUF[channel].reg != cc) {
+            SYNCBUSY_WAIT(&tc->COUNT16, syncMask);
+            tc->COUNT16.CCBUF[channel].reg = cc;
+        }
+    }
+    else if (tc->COUNT8.CCBUF[channel].reg != cc) {
+        SYNCBUSY_WAIT(&tc->COUNT8, syncMask);
+        tc->COUNT8.CCBUF[channel].reg = cc;
+    }
+}
+
 extern StatusManager &StatusMgr;
 extern ShiftRegister ShiftReg;
+extern SysManager SysMgr;
 extern volatile uint32_t tickCnt;
 
 /**
@@ -73,6 +116,7 @@ DigitalInOut::DigitalInOut(ShiftRegister::Masks ledMask,
 }
 
 bool DigitalInOut::Mode(ConnectorModes newMode) {
+    SysMgr.ConnectorActive(m_clearCorePin, true);
     // Bail out if we are already in the requested mode
     if (newMode == m_mode) {
         return true;
@@ -133,7 +177,7 @@ void DigitalInOut::Refresh() {
                 }
             }
             // If output is true and input is false, the pin is overloaded
-            else if (m_outState && !StateRT()) {
+            else if (OutputPinState() && !StateRT()) {
                 // When the overload counter hits zero, signal the overload
                 if (m_overloadTripCnt && !--m_overloadTripCnt) {
                     IsInHwFault(true);
@@ -220,11 +264,12 @@ int16_t DigitalInOut::State() {
                 break;
             }
 
-            if (m_logicInversion) {
-                state = m_tc->COUNT8.CCBUF[m_tcPadNum].reg;
-            }
-            else {
-                state = 255 - m_tc->COUNT8.CCBUF[m_tcPadNum].reg;
+            {
+                // The counts the output is on for, scaled back to 0-255
+                uint32_t counts = PwmCounts(m_tc);
+                uint32_t cc = PwmCcRead(m_tc, m_tcPadNum);
+                uint32_t on = m_logicInversion ? cc : counts - cc;
+                state = (on * UINT8_MAX + counts / 2) / counts;
             }
             break;
         default:
@@ -267,6 +312,19 @@ bool DigitalInOut::State(int16_t newState) {
     return success;
 }
 
+bool DigitalInOut::FastOutputGet(FastOutput &fast) {
+    if (m_mode != OUTPUT_DIGITAL) {
+        return false;
+    }
+    PortGroup &group = PORT->Group[m_outputPort];
+    // An inverted pin is asserted by clearing it
+    fast.m_set = m_logicInversion ? &group.OUTCLR.reg : &group.OUTSET.reg;
+    fast.m_clr = m_logicInversion ? &group.OUTSET.reg : &group.OUTCLR.reg;
+    fast.m_tgl = &group.OUTTGL.reg;
+    fast.m_mask = m_outputDataMask;
+    return true;
+}
+
 /**
     Initialize a digital input/output connector. Set to input mode.
 **/
@@ -336,22 +394,92 @@ void DigitalInOut::OutputPulsesStop(bool stopImmediately) {
 }
 
 bool DigitalInOut::PwmDuty(uint8_t newDuty) {
+    // 257 maps 255 to 65535
+    return PwmDuty16(newDuty * 257U);
+}
+
+bool DigitalInOut::PwmDuty16(uint16_t newDuty) {
     // Bail out if not in PWM output mode
     if (m_mode != OUTPUT_PWM) {
         return false;
     }
 
-    // Wait for the TC CC value to be ready to be written
-    uint8_t ccBufVal = (m_logicInversion) ? newDuty : 255 - newDuty;
-    if (m_tc->COUNT8.CCBUF[m_tcPadNum].reg != ccBufVal) {
-        uint32_t syncMask = m_tcPadNum ? TC_SYNCBUSY_CC1 : TC_SYNCBUSY_CC0;
-        SYNCBUSY_WAIT(&m_tc->COUNT8, syncMask);
-        m_tc->COUNT8.CCBUF[m_tcPadNum].reg = ccBufVal;
+    // Scale the duty to the counts of the carrier period
+    uint32_t counts = PwmCounts(m_tc);
+    uint32_t on = (static_cast<uint64_t>(newDuty) * counts + UINT16_MAX / 2) /
+                  UINT16_MAX;
+    PwmCcWrite(m_tc, m_tcPadNum, m_logicInversion ? on : counts - on);
+    ShiftReg.LedPwmValue(m_clearCorePin, newDuty >> 8);
+    return true;
+}
+
+bool DigitalInOut::PwmCarrier(uint32_t frequencyHz, bool counter16) {
+    if (!frequencyHz || (counter16 && frequencyHz > PWM_CARRIER_16BIT_MAX_HZ)
+            || (!counter16 && (frequencyHz < PWM_CARRIER_MIN_HZ ||
+                               frequencyHz > PWM_CARRIER_MAX_HZ))) {
+        return false;
+    }
+
+    // Take the smallest prescaler that fits the period in the counter
+    uint8_t prescaler = 0;
+    uint32_t counts = PWM_COUNTS_16BIT;
+    for (; prescaler < sizeof(pwmPrescalers) / sizeof(pwmPrescalers[0]);
+            prescaler++) {
+        uint32_t tcHz = PWM_TC_CLOCK_HZ / pwmPrescalers[prescaler];
+        if (counter16) {
+            if (tcHz <= static_cast<uint64_t>(frequencyHz) * counts) {
+                break;
+            }
+        }
+        else {
+            counts = (tcHz + frequencyHz / 2) / frequencyHz;
+            if (counts <= PWM_COUNTS_8BIT_MAX) {
+                break;
+            }
+        }
     }
-    ShiftReg.LedPwmValue(m_clearCorePin, newDuty);
+
+    // Carry both channels' duty over to the new period
+    uint32_t countsOld = PwmCounts(m_tc);
+    uint32_t cc[2];
+    for (uint8_t i = 0; i < 2; i++) {
+        cc[i] = (PwmCcRead(m_tc, i) * counts + countsOld / 2) / countsOld;
+    }
+
+    TcCount8 *tcCount = &m_tc->COUNT8;
+    tcCount->CTRLA.bit.ENABLE = 0;
+    SYNCBUSY_WAIT(tcCount, TC_SYNCBUSY_ENABLE);
+    tcCount->CTRLA.bit.MODE = counter16 ? TC_CTRLA_MODE_COUNT16_Val :
+                              TC_CTRLA_MODE_COUNT8_Val;
+    tcCount->CTRLA.bit.PRESCALER = prescaler;
+    if (!counter16) {
+        tcCount->PER.reg = counts - 1;
+        tcCount->PERBUF.reg = counts - 1;
+    }
+    for (uint8_t i = 0; i < 2; i++) {
+        PwmCcWrite(m_tc, i, cc[i]);
+        if (counter16) {
+            m_tc->COUNT16.CC[i].reg = m_tc->COUNT16.CCBUF[i].reg;
+        }
+        else {
+            tcCount->CC[i].reg = tcCount->CCBUF[i].reg;
+        }
+    }
+    tcCount->COUNT.reg = 0;
+    tcCount->CTRLA.bit.ENABLE = 1;
+    SYNCBUSY_WAIT(tcCount, TC_SYNCBUSY_ENABLE);
     return true;
 }
 
+float DigitalInOut::PwmCarrierHz() {
+    uint16_t prescaler = pwmPrescalers[m_tc->COUNT8.CTRLA.bit.PRESCALER];
+    return static_cast<float>(PWM_TC_CLOCK_HZ) / prescaler / PwmCounts(m_tc);
+}
+
+uint32_t DigitalInOut::PwmSteps() {
+    return PwmCounts(m_tc);
+}
+
 void DigitalInOut::IsInHwFault(bool inFault) {
     if (inFault != m_isInFault) {
         m_isInFault = inFault;
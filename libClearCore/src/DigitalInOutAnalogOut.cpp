@@ -31,17 +31,26 @@
 #include "DigitalInOutAnalogOut.h"
 #include <sam.h>
 #include "NvmManager.h"
+#include "SysManager.h"
+#include "SysTiming.h"
 #include "SysUtils.h"
 
-#define DAC_BITS    11
-#define DAC_MAX_VALUE   (UINT16_MAX >> (16 - DAC_BITS))
 #define DAC_MAX_OUTPUT_UA   20000
 #define DAC_DEFAULT_SPAN    1700
 
+// The timer that paces waveform playback; shared with INPUT_COUNTER mode
+#define DAC_WAVE_TCC        TCC2
+#define DAC_WAVE_RATE_DEFAULT_HZ 1000
+
 namespace ClearCore {
 
 extern ShiftRegister ShiftReg;
 extern NvmManager &NvmMgr;
+extern SysManager SysMgr;
+
+// Calibrated DAC commands for waveform playback. Each TCC overflow triggers
+// one beat of the base descriptor, which copies the next point into the DAC.
+static uint16_t wavePoints[DAC_WAVE_POINTS_MAX];
 
 /**
     Construct, wire in the Input/Output pair, and set pad to input mode.
@@ -56,7 +65,10 @@ DigitalInOutAnalogOut::DigitalInOutAnalogOut(
       m_analogPort(outputAnalogInfo->gpioPort),
       m_analogDataBit(outputAnalogInfo->gpioPin),
       m_dacZero(0),
-      m_dacSpan(DAC_DEFAULT_SPAN) {}
+      m_dacSpan(DAC_DEFAULT_SPAN),
+      m_wavePoints(0),
+      m_waveRateHz(DAC_WAVE_RATE_DEFAULT_HZ),
+      m_waveTimer(false) {}
 
 /**
     Do nothing if in analog output mode; otherwise call DigitalInOut's Refresh
@@ -77,10 +89,13 @@ void DigitalInOutAnalogOut::Refresh() {
 }
 
 bool DigitalInOutAnalogOut::Mode(ConnectorModes newMode) {
+    SysMgr.ConnectorActive(m_clearCorePin, true);
     if (m_mode == newMode) {
         return true;
     }
 
+    WaveStop();
+
     switch (newMode) {
         case INPUT_DIGITAL:
         case OUTPUT_DIGITAL:
@@ -271,6 +286,7 @@ void DigitalInOutAnalogOut::AnalogWrite(uint16_t value) {
     if (m_mode != OUTPUT_ANALOG) {
         return;
     }
+    WaveStop();
 
     value = min(value, DAC_MAX_VALUE);
 
@@ -286,6 +302,106 @@ void DigitalInOutAnalogOut::AnalogWrite(uint16_t value) {
     DacRegisterWrite(command);
 }
 
+bool DigitalInOutAnalogOut::WaveLoad(const uint16_t *values, uint16_t count) {
+    if (!values || !count || count > DAC_WAVE_POINTS_MAX) {
+        return false;
+    }
+    WaveStop();
+
+    for (uint16_t i = 0; i < count; i++) {
+        // The same calibration as AnalogWrite()
+        uint16_t value = min(values[i], DAC_MAX_VALUE);
+        uint16_t command = ((static_cast<uint32_t>(value) * m_dacSpan)
+                            / DAC_MAX_VALUE) + m_dacZero;
+        wavePoints[i] = min(command, DAC_MAX_VALUE);
+    }
+    m_wavePoints = count;
+    return true;
+}
+
+bool DigitalInOutAnalogOut::WaveStart(bool loop) {
+    if (m_mode != OUTPUT_ANALOG || !m_wavePoints) {
+        return false;
+    }
+    WaveStop();
+
+    // The timer is free unless the input counter has it running
+    Tcc *tcc = DAC_WAVE_TCC;
+    SET_CLOCK_SOURCE(TCC2_GCLK_ID, 0);
+    CLOCK_ENABLE(APBCMASK, TCC2_);
+    if (tcc->CTRLA.bit.ENABLE) {
+        return false;
+    }
+
+    // Find the finest prescaler that fits the period in the 16-bit counter
+    static const uint16_t prescalers[] = {1, 2, 4, 8, 16, 64, 256, 1024};
+    uint32_t rateHz = min(max(m_waveRateHz, DAC_WAVE_RATE_MIN_HZ),
+                          DAC_WAVE_RATE_MAX_HZ);
+    uint8_t prescaler = 0;
+    uint32_t period = CPU_CLK / rateHz;
+    while (period > UINT16_MAX + 1UL &&
+            prescaler < sizeof(prescalers) / sizeof(prescalers[0]) - 1) {
+        prescaler++;
+        period = CPU_CLK / (rateHz * prescalers[prescaler]);
+    }
+
+    tcc->CTRLA.reg = TCC_CTRLA_SWRST;
+    SYNCBUSY_WAIT(tcc, TCC_SYNCBUSY_SWRST);
+    tcc->CTRLA.reg = TCC_CTRLA_PRESCALER(prescaler);
+    tcc->WAVE.reg = TCC_WAVE_WAVEGEN_NFRQ;
+    tcc->PER.reg = period - 1;
+    SYNCBUSY_WAIT(tcc, TCC_SYNCBUSY_PER);
+
+    DmacChannel *channel = DmaManager::Channel(DMA_WAVE_IO0);
+    channel->CHCTRLA.reg = DMAC_CHCTRLA_SWRST;
+    while (channel->CHCTRLA.reg == DMAC_CHCTRLA_SWRST) {
+        continue;
+    }
+    channel->CHCTRLA.reg = DMAC_CHCTRLA_TRIGSRC(TCC2_DMAC_ID_OVF) |
+                           DMAC_CHCTRLA_TRIGACT_BURST;
+
+    // A single descriptor steps through the table one point per trigger.
+    // Linking it to itself repeats the table.
+    DmacDescriptor *desc = DmaManager::BaseDescriptor(DMA_WAVE_IO0);
+    desc->DESCADDR.reg = loop ? reinterpret_cast<uint32_t>(desc) : 0;
+    // The source address is the end of the incrementing transfer
+    desc->SRCADDR.reg = reinterpret_cast<uint32_t>(&wavePoints[m_wavePoints]);
+    desc->DSTADDR.reg = reinterpret_cast<uint32_t>(&DAC->DATA[0].reg);
+    desc->BTCNT.reg = m_wavePoints;
+    desc->BTCTRL.reg = DMAC_BTCTRL_BEATSIZE_HWORD | DMAC_BTCTRL_SRCINC |
+                       DMAC_BTCTRL_VALID;
+
+    // The LED isn't updated during playback; show the starting level
+    ShiftReg.LedPwmValue(m_clearCorePin,
+                         wavePoints[0] * UINT8_MAX / DAC_MAX_VALUE);
+    channel->CHCTRLA.reg |= DMAC_CHCTRLA_ENABLE;
+    m_waveTimer = true;
+    tcc->CTRLA.bit.ENABLE = 1;
+    SYNCBUSY_WAIT(tcc, TCC_SYNCBUSY_ENABLE);
+    return true;
+}
+
+void DigitalInOutAnalogOut::WaveStop() {
+    if (!m_waveTimer) {
+        return;
+    }
+    m_waveTimer = false;
+    DAC_WAVE_TCC->CTRLA.bit.ENABLE = 0;
+    SYNCBUSY_WAIT(DAC_WAVE_TCC, TCC_SYNCBUSY_ENABLE);
+
+    DmacChannel *channel = DmaManager::Channel(DMA_WAVE_IO0);
+    channel->CHCTRLA.reg &= ~DMAC_CHCTRLA_ENABLE;
+    while (channel->CHCTRLA.reg & DMAC_CHCTRLA_ENABLE) {
+        continue;
+    }
+}
+
+bool DigitalInOutAnalogOut::WaveActive() {
+    return m_waveTimer &&
+           (DmaManager::Channel(DMA_WAVE_IO0)->CHCTRLA.reg &
+            DMAC_CHCTRLA_ENABLE);
+}
+
 /**
     Load DAC calibration from NVM
 **/
@@ -347,6 +463,7 @@ void DigitalInOutAnalogOut::AnalogWriteUncalibrated(uint16_t value) {
     if (m_mode != OUTPUT_ANALOG) {
         return;
     }
+    WaveStop();
 
     value = min(value, DAC_MAX_VALUE);
 
@@ -32,6 +32,7 @@
 #include <stdlib.h>
 #include "DigitalInOut.h"
 #include "StatusManager.h"
+#include "SysManager.h"
 #include "SysTiming.h"
 #include "SysUtils.h"
 
@@ -42,13 +43,21 @@ namespace ClearCore {
 #define max(a, b) (((a) > (b)) ? (a) : (b))
 #define min(a, b) (((a) < (b)) ? (a) : (b))
 
-// PWM related constants
-#define TONE_RATE_HZ (22050)
-#define TONE_MAXIMUM_FREQ_HZ (TONE_RATE_HZ / 4)
-
 extern ShiftRegister ShiftReg;
+extern SysManager SysMgr;
 extern volatile uint32_t tickCnt;
 
+// Waveform playback buffers. Every TCC overflow triggers one descriptor,
+// which copies a point's two duty cycles into CCBUF0/1; the descriptors are
+// chained from the base descriptor in the DmaManager.
+typedef struct {
+    uint32_t Cc[2];
+} WavePoint;
+static WavePoint wavePoints[HBRIDGE_CON_CNT][HBRIDGE_WAVE_POINTS_MAX];
+static DmacDescriptor
+waveDesc[HBRIDGE_CON_CNT][HBRIDGE_WAVE_POINTS_MAX - 1]
+__attribute__((aligned(16)));
+
 DigitalInOutHBridge::DigitalInOutHBridge(ShiftRegister::Masks ledMask,
         const PeripheralRoute *inputInfo,
         const PeripheralRoute *outputInfo,
@@ -71,7 +80,10 @@ DigitalInOutHBridge::DigitalInOutHBridge(ShiftRegister::Masks ledMask,
       m_pwmBInfo(pwmBInfo),
       m_tccIrq(tccIrq),
       m_inFault(false),
-      m_forceToneDuration(false) {
+      m_forceToneDuration(false),
+      m_wavePoints(0),
+      m_waveActive(false),
+      m_waveLoop(false) {
     static Tcc *const tcc_modules[TCC_INST_NUM] = TCC_INSTS;
     m_tcc = tcc_modules[pwmAInfo->tccNum];
 }
@@ -107,6 +119,7 @@ int16_t DigitalInOutHBridge::State() {
             break;
         case OUTPUT_H_BRIDGE:
         case OUTPUT_TONE:
+        case OUTPUT_WAVE:
             // Undo the state math to return the current state value
             state =
                 static_cast<int16_t>((static_cast<int32_t>(m_tcc->CC[0].reg) -
@@ -140,6 +153,7 @@ bool DigitalInOutHBridge::State(int16_t newState) {
             }
         // Fall through
         case OUTPUT_TONE:
+        case OUTPUT_WAVE:
             // Create a PWM differential where state 0 is 50/50 duty cycles
             m_tcc->CCBUF[0].reg = halfDuty + halfDuty * newState / INT16_MAX;
             m_tcc->CCBUF[1].reg = halfDuty - halfDuty * newState / INT16_MAX;
@@ -161,6 +175,14 @@ void DigitalInOutHBridge::Refresh() {
             DigitalInOut::Refresh();
             break;
         case OUTPUT_WAVE:
+            // A single pass ends when the DMA runs out of descriptors
+            if (m_waveActive && !m_waveLoop &&
+                    !(DmaManager::Channel(static_cast<DmaChannels>(
+                          DMA_WAVE_IO4 + WaveIndex()))->CHCTRLA.reg &
+                      DMAC_CHCTRLA_ENABLE)) {
+                m_waveActive = false;
+                State(0);
+            }
             break;
         case OUTPUT_H_BRIDGE:
             break;
@@ -351,10 +373,15 @@ void DigitalInOutHBridge::ToneStop() {
 bool DigitalInOutHBridge::Mode(ConnectorModes newMode) {
     bool modeChangeSuccess = false;
 
+    SysMgr.ConnectorActive(m_clearCorePin, true);
     if (m_mode == newMode) {
         return true;
     }
 
+    if (m_mode == OUTPUT_WAVE) {
+        WaveStop();
+    }
+
     // Unless in H-Bridge, pwmA should be low and pwmB should be high
     // This makes the connector look like the other IO connectors.
     // In HBridge mode, these will be driven by the TCC
@@ -416,6 +443,111 @@ bool DigitalInOutHBridge::Mode(ConnectorModes newMode) {
     return modeChangeSuccess;
 }
 
+bool DigitalInOutHBridge::WaveLoad(const int16_t *samples, uint16_t count) {
+    if (!samples || !count || count > HBRIDGE_WAVE_POINTS_MAX) {
+        return false;
+    }
+    WaveStop();
+
+    WavePoint *points = wavePoints[WaveIndex()];
+    uint16_t halfDuty = m_tcc->PER.reg >> 1;
+    for (uint16_t i = 0; i < count; i++) {
+        // The same differential as State()
+        int32_t offset = halfDuty * max(samples[i], -INT16_MAX) / INT16_MAX;
+        points[i].Cc[0] = halfDuty + offset;
+        points[i].Cc[1] = halfDuty - offset;
+    }
+    m_wavePoints = count;
+    return true;
+}
+
+bool DigitalInOutHBridge::WaveChirp(uint16_t startFreq, uint16_t endFreq,
+                                    uint16_t count) {
+    if (!count || count > HBRIDGE_WAVE_POINTS_MAX) {
+        return false;
+    }
+    startFreq = min(startFreq, TONE_MAXIMUM_FREQ_HZ);
+    endFreq = min(endFreq, TONE_MAXIMUM_FREQ_HZ);
+
+    int16_t sweep[HBRIDGE_WAVE_POINTS_MAX];
+    int32_t angle = 0;
+    for (uint16_t i = 0; i < count; i++) {
+        int32_t freq = startFreq +
+                       (static_cast<int32_t>(endFreq) - startFreq) * i / count;
+        sweep[i] = static_cast<int16_t>(
+                       (static_cast<int32_t>(arm_sin_q15(angle)) *
+                        m_amplitude) >> 15);
+        // Advance the angle in q15 [0 +1) as ToneUpdate() does
+        angle = (angle + INT16_MAX * freq / TONE_RATE_HZ) & INT16_MAX;
+    }
+    return WaveLoad(sweep, count);
+}
+
+bool DigitalInOutHBridge::WaveStart(bool loop) {
+    if (m_mode != OUTPUT_WAVE || !m_wavePoints) {
+        return false;
+    }
+    WaveStop();
+
+    uint8_t index = WaveIndex();
+    DmaChannels dmaChannel = static_cast<DmaChannels>(DMA_WAVE_IO4 + index);
+    DmacChannel *channel = DmaManager::Channel(dmaChannel);
+    channel->CHCTRLA.reg = DMAC_CHCTRLA_SWRST;
+    while (channel->CHCTRLA.reg == DMAC_CHCTRLA_SWRST) {
+        continue;
+    }
+    uint8_t trigger = (m_pwmAInfo->tccNum == 3) ? TCC3_DMAC_ID_OVF :
+                      TCC4_DMAC_ID_OVF;
+    channel->CHCTRLA.reg = DMAC_CHCTRLA_TRIGSRC(trigger) |
+                           DMAC_CHCTRLA_TRIGACT_BLOCK;
+
+    // One descriptor per point, ending at the base descriptor for a loop
+    DmacDescriptor *baseDesc = DmaManager::BaseDescriptor(dmaChannel);
+    for (uint16_t i = 0; i < m_wavePoints; i++) {
+        DmacDescriptor *desc = i ? &waveDesc[index][i - 1] : baseDesc;
+        DmacDescriptor *next = nullptr;
+        if (i + 1 < m_wavePoints) {
+            next = &waveDesc[index][i];
+        }
+        else if (loop) {
+            next = baseDesc;
+        }
+        desc->DESCADDR.reg = reinterpret_cast<uint32_t>(next);
+        // Addresses are the end of each incrementing transfer
+        desc->SRCADDR.reg =
+            reinterpret_cast<uint32_t>(&wavePoints[index][i + 1]);
+        desc->DSTADDR.reg =
+            reinterpret_cast<uint32_t>(&m_tcc->CCBUF[0].reg) +
+            sizeof(WavePoint);
+        desc->BTCNT.reg = sizeof(WavePoint) / sizeof(uint32_t);
+        desc->BTCTRL.reg = DMAC_BTCTRL_BEATSIZE_WORD | DMAC_BTCTRL_SRCINC |
+                           DMAC_BTCTRL_DSTINC | DMAC_BTCTRL_VALID;
+    }
+
+    m_waveLoop = loop;
+    m_waveActive = true;
+    ShiftReg.LedInPwm(m_ledMask, true, m_clearCorePin);
+    channel->CHCTRLA.reg |= DMAC_CHCTRLA_ENABLE;
+    return true;
+}
+
+void DigitalInOutHBridge::WaveStop() {
+    DmacChannel *channel = DmaManager::Channel(
+                               static_cast<DmaChannels>(DMA_WAVE_IO4 +
+                                                        WaveIndex()));
+    channel->CHCTRLA.reg &= ~DMAC_CHCTRLA_ENABLE;
+    while (channel->CHCTRLA.reg & DMAC_CHCTRLA_ENABLE) {
+        continue;
+    }
+    if (m_waveActive) {
+        m_waveActive = false;
+        ShiftReg.LedInPwm(m_ledMask, false, m_clearCorePin);
+    }
+    if (m_mode == OUTPUT_WAVE) {
+        State(0);
+    }
+}
+
 void DigitalInOutHBridge::FaultState(bool isFaulted) {
     m_inFault = isFaulted;
     // Disable H-bridge driver when in an overload state
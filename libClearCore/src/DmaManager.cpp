@@ -28,6 +28,7 @@
 
 #include "DmaManager.h"
 #include <stddef.h>
+#include <string.h>
 #include <sam.h>
 #include "SysUtils.h"
 
@@ -36,21 +37,44 @@ namespace ClearCore {
 // Interrupt priority 0(High) - 7(Low)
 #define DMA_COMPLETE_PRIORITY 2
 
-#if (DMA_CHANNEL_COUNT > DMAC_CH_NUM)
-#error "Attempting to use more DMA channels than available on the device"
-#endif
+static_assert(DMA_CHANNEL_TOTAL <= DMAC_CH_NUM,
+              "Attempting to use more DMA channels than available on the "
+              "device");
+static_assert(DMA_CHANNEL_TOTAL <= 32,
+              "The allocated channels must fit the channel masks");
 
 #ifndef HIDE_FROM_DOXYGEN
 /* Active DMA descriptors */
-DmacDescriptor DmaManager::writeBackDescriptor[DMA_CHANNEL_COUNT]
+DmacDescriptor DmaManager::writeBackDescriptor[DMA_CHANNEL_TOTAL]
 __attribute__((aligned(16)));
 /* Starting DMA descriptors */
-DmacDescriptor DmaManager::descriptorBase[DMA_CHANNEL_COUNT] __attribute__((
+DmacDescriptor DmaManager::descriptorBase[DMA_CHANNEL_TOTAL] __attribute__((
             aligned(16)));
+/* Linked DMA descriptors for the allocated channels */
+DmacDescriptor DmaManager::descriptorPool[DMA_DESCRIPTOR_POOL]
+__attribute__((aligned(16)));
+uint8_t DmaManager::poolOwner[DMA_DESCRIPTOR_POOL];
+DmaCallback DmaManager::callbacks[DMA_DYNAMIC_CHANNELS];
+volatile uint32_t DmaManager::allocatedMask = 0;
 #endif
 
 DmaManager &DmaMgr = DmaManager::Instance();
 
+// The channel used for background copies and fills, claimed on first use
+static uint8_t memChannel = DMA_CHANNEL_NONE;
+static volatile bool *memDone = NULL;
+// The source of a fill, repeated to the beat size
+static uint32_t memFill;
+
+static void MemComplete(uint8_t channel, bool error) {
+    (void)channel;
+    (void)error;
+    if (memDone) {
+        *memDone = true;
+        memDone = NULL;
+    }
+}
+
 DmaManager &DmaManager::Instance() {
     static DmaManager *instance = new DmaManager();
     return *instance;
@@ -74,6 +98,10 @@ void DmaManager::Initialize() {
     NVIC_DisableIRQ(DMAC_0_IRQn);
     /* Initialize DMA interrupt priority  */
     NVIC_SetPriority(DMAC_0_IRQn, DMA_COMPLETE_PRIORITY);
+    /* Channels 1-3 have their own interrupts, the rest share DMAC_4 */
+    for (uint8_t irq = DMAC_1_IRQn; irq <= DMAC_4_IRQn; irq++) {
+        NVIC_SetPriority(static_cast<IRQn_Type>(irq), DMA_COMPLETE_PRIORITY);
+    }
 
     // Tell the DMAC where the descriptors are (must be located in SRAM)
     DMAC->BASEADDR.reg = (uint32_t)descriptorBase;
@@ -92,7 +120,16 @@ void DmaManager::Initialize() {
     DMAC->SWTRIGCTRL.reg &=
         ~((1UL << DMA_ADC_SEQUENCE) | (1UL << DMA_ADC_RESULTS) |
           (1UL << DMA_SERCOM0_SPI_TX) | (1UL << DMA_SERCOM0_SPI_RX) |
-          (1UL << DMA_SERCOM7_SPI_TX) | (1UL << DMA_SERCOM7_SPI_RX));
+          (1UL << DMA_SERCOM7_SPI_TX) | (1UL << DMA_SERCOM7_SPI_RX) |
+          (1UL << DMA_HLFB_M0) | (1UL << DMA_HLFB_M1) |
+          (1UL << DMA_HLFB_M2) | (1UL << DMA_HLFB_M3) |
+          (1UL << DMA_WAVE_IO4) | (1UL << DMA_WAVE_IO5) |
+          (1UL << DMA_WAVE_IO0) |
+          (1UL << DMA_SERCOM4_SPI_TX) | (1UL << DMA_SERCOM4_SPI_RX));
+
+    for (uint8_t i = 0; i < DMA_DESCRIPTOR_POOL; i++) {
+        poolOwner[i] = DMA_CHANNEL_NONE;
+    }
 }
 
 DmacChannel *DmaManager::Channel(DmaChannels index) {
@@ -109,4 +146,285 @@ DmacDescriptor *DmaManager::BaseDescriptor(DmaChannels index) {
     return &descriptorBase[index];
 }
 
+DmacDescriptor *DmaManager::WriteBackDescriptor(DmaChannels index) {
+    if (index >= DMA_CHANNEL_COUNT) {
+        return NULL;
+    }
+    return &writeBackDescriptor[index];
+}
+
+IRQn_Type DmaManager::Irq(DmaChannels index) {
+    if (index >= 4) {
+        return DMAC_4_IRQn;
+    }
+    return static_cast<IRQn_Type>(DMAC_0_IRQn + index);
+}
+
+uint8_t DmaManager::ChannelAllocate(uint8_t priority, DmaCallback callback) {
+    uint8_t channel = DMA_CHANNEL_NONE;
+    __disable_irq();
+    for (uint8_t i = DMA_CHANNEL_COUNT; i < DMA_CHANNEL_TOTAL; i++) {
+        if (!(allocatedMask & (1UL << i))) {
+            allocatedMask |= 1UL << i;
+            channel = i;
+            break;
+        }
+    }
+    __enable_irq();
+    if (channel == DMA_CHANNEL_NONE) {
+        return channel;
+    }
+
+    DmacChannel *dmacChannel = &DMAC->Channel[channel];
+    dmacChannel->CHCTRLA.reg = DMAC_CHCTRLA_SWRST;
+    while (dmacChannel->CHCTRLA.reg & DMAC_CHCTRLA_SWRST) {
+        continue;
+    }
+    dmacChannel->CHPRILVL.reg = DMAC_CHPRILVL_PRILVL(priority & 0x3);
+    descriptorBase[channel].BTCTRL.reg = 0;
+    callbacks[channel - DMA_CHANNEL_COUNT] = callback;
+    if (callback) {
+        dmacChannel->CHINTENSET.reg =
+            DMAC_CHINTENSET_TCMPL | DMAC_CHINTENSET_TERR;
+        // Allocated channels are all past channel 3, on the shared vector
+        NVIC_EnableIRQ(DMAC_4_IRQn);
+    }
+    return channel;
+}
+
+void DmaManager::ChannelFree(uint8_t channel) {
+    if (!Allocated(channel)) {
+        return;
+    }
+    ChannelStop(channel);
+    DMAC->Channel[channel].CHINTENCLR.reg =
+        DMAC_CHINTENCLR_TCMPL | DMAC_CHINTENCLR_TERR;
+    callbacks[channel - DMA_CHANNEL_COUNT] = NULL;
+    DescriptorsRelease(channel);
+    __disable_irq();
+    allocatedMask &= ~(1UL << channel);
+    __enable_irq();
+}
+
+bool DmaManager::ChannelTrigger(uint8_t channel, uint8_t triggerSource,
+                                uint8_t triggerAction, uint8_t burstBeats) {
+    if (!Allocated(channel) || ChannelBusy(channel) || !burstBeats ||
+            burstBeats > 16) {
+        return false;
+    }
+    DMAC->Channel[channel].CHCTRLA.reg =
+        DMAC_CHCTRLA_TRIGSRC(triggerSource) |
+        DMAC_CHCTRLA_TRIGACT(triggerAction) |
+        DMAC_CHCTRLA_BURSTLEN(burstBeats - 1);
+    return true;
+}
+
+bool DmaManager::ChainBuild(uint8_t channel, const DmaBlock *blocks,
+                            uint8_t count, bool circular) {
+    if (!Allocated(channel) || ChannelBusy(channel) || !blocks || !count) {
+        return false;
+    }
+    DescriptorsRelease(channel);
+
+    // Claim the linked descriptors before touching the chain
+    uint8_t links[DMA_DESCRIPTOR_POOL];
+    uint8_t linkCount = 0;
+    for (uint8_t i = 0; i < DMA_DESCRIPTOR_POOL && linkCount < count - 1;
+            i++) {
+        if (poolOwner[i] == DMA_CHANNEL_NONE) {
+            links[linkCount++] = i;
+        }
+    }
+    if (linkCount < count - 1) {
+        return false;
+    }
+
+    DmacDescriptor *first = &descriptorBase[channel];
+    DmacDescriptor *prev = NULL;
+    for (uint8_t i = 0; i < count; i++) {
+        const DmaBlock &block = blocks[i];
+        DmacDescriptor *desc = first;
+        if (i) {
+            poolOwner[links[i - 1]] = channel;
+            desc = &descriptorPool[links[i - 1]];
+        }
+
+        // The last block of a chain that ends interrupts if anyone listens
+        bool interrupt = block.Interrupt ||
+                         (!circular && i == count - 1 &&
+                          callbacks[channel - DMA_CHANNEL_COUNT]);
+        desc->BTCTRL.reg = DMAC_BTCTRL_VALID |
+                           DMAC_BTCTRL_BEATSIZE(block.BeatSize) |
+                           (block.SourceIncrement ? DMAC_BTCTRL_SRCINC : 0) |
+                           (block.DestinationIncrement ?
+                            DMAC_BTCTRL_DSTINC : 0) |
+                           (interrupt ? DMAC_BTCTRL_BLOCKACT_INT :
+                            DMAC_BTCTRL_BLOCKACT_NOACT);
+        desc->BTCNT.reg = block.BeatCount;
+        // Incrementing addresses are given to the DMAC as the end of the
+        // block
+        uint32_t blockBytes = block.BeatCount << block.BeatSize;
+        desc->SRCADDR.reg = reinterpret_cast<uint32_t>(block.Source) +
+                            (block.SourceIncrement ? blockBytes : 0);
+        desc->DSTADDR.reg = reinterpret_cast<uint32_t>(block.Destination) +
+                            (block.DestinationIncrement ? blockBytes : 0);
+        desc->DESCADDR.reg = 0;
+        if (prev) {
+            prev->DESCADDR.reg = reinterpret_cast<uint32_t>(desc);
+        }
+        prev = desc;
+    }
+    if (circular) {
+        prev->DESCADDR.reg = reinterpret_cast<uint32_t>(first);
+    }
+    return true;
+}
+
+bool DmaManager::ChannelStart(uint8_t channel) {
+    if (!Allocated(channel) || ChannelBusy(channel) ||
+            !descriptorBase[channel].BTCTRL.bit.VALID) {
+        return false;
+    }
+    DmacChannel *dmacChannel = &DMAC->Channel[channel];
+    dmacChannel->CHINTFLAG.reg = DMAC_CHINTFLAG_MASK;
+    dmacChannel->CHCTRLA.bit.ENABLE = 1;
+    if (!dmacChannel->CHCTRLA.bit.TRIGSRC) {
+        DMAC->SWTRIGCTRL.reg |= 1UL << channel;
+    }
+    return true;
+}
+
+void DmaManager::ChannelStop(uint8_t channel) {
+    if (!Allocated(channel)) {
+        return;
+    }
+    DmacChannel *dmacChannel = &DMAC->Channel[channel];
+    dmacChannel->CHCTRLA.bit.ENABLE = 0;
+    while (dmacChannel->CHCTRLA.bit.ENABLE) {
+        continue;
+    }
+    dmacChannel->CHINTFLAG.reg = DMAC_CHINTFLAG_MASK;
+}
+
+bool DmaManager::ChannelBusy(uint8_t channel) {
+    return Allocated(channel) && DMAC->Channel[channel].CHCTRLA.bit.ENABLE;
+}
+
+void DmaManager::IrqHandler() {
+    uint32_t pending = DMAC->INTSTATUS.reg & allocatedMask;
+    while (pending) {
+        uint8_t channel = 31 - __CLZ(pending);
+        pending &= ~(1UL << channel);
+
+        DmacChannel *dmacChannel = &DMAC->Channel[channel];
+        uint8_t flags = dmacChannel->CHINTFLAG.reg &
+                        (DMAC_CHINTFLAG_TCMPL | DMAC_CHINTFLAG_TERR);
+        dmacChannel->CHINTFLAG.reg = flags;
+        DmaCallback callback = callbacks[channel - DMA_CHANNEL_COUNT];
+        if (flags && callback) {
+            callback(channel, flags & DMAC_CHINTFLAG_TERR);
+        }
+    }
+}
+
+bool DmaManager::MemCopyAsync(void *dst, const void *src, uint32_t len,
+                              volatile bool *done) {
+    if (MemTransferStart(dst, src, len, true, done)) {
+        return true;
+    }
+    memcpy(dst, src, len);
+    *done = true;
+    return false;
+}
+
+bool DmaManager::MemSetAsync(void *dst, uint8_t value, uint32_t len,
+                             volatile bool *done) {
+    if (!MemBusy()) {
+        memFill = value * 0x01010101UL;
+        if (MemTransferStart(dst, &memFill, len, false, done)) {
+            return true;
+        }
+    }
+    memset(dst, value, len);
+    *done = true;
+    return false;
+}
+
+bool DmaManager::MemBusy() {
+    return memChannel != DMA_CHANNEL_NONE && ChannelBusy(memChannel);
+}
+
+bool DmaManager::MemTransferStart(void *dst, const void *src, uint32_t len,
+                                  bool srcIncrement, volatile bool *done) {
+    *done = false;
+    if (len < DMA_MEMCPY_THRESHOLD || MemBusy()) {
+        return false;
+    }
+    if (memChannel == DMA_CHANNEL_NONE) {
+        memChannel = ChannelAllocate(0, MemComplete);
+        if (memChannel == DMA_CHANNEL_NONE) {
+            return false;
+        }
+        // One software trigger runs the whole chain
+        ChannelTrigger(memChannel, 0, DMAC_CHCTRLA_TRIGACT_TRANSACTION_Val);
+    }
+
+    // Move words when everything is word aligned, then split the transfer
+    // into blocks the block counter can hold
+    uint8_t beatSize = DMAC_BTCTRL_BEATSIZE_BYTE_Val;
+    if (!((reinterpret_cast<uint32_t>(dst) | len |
+            (srcIncrement ? reinterpret_cast<uint32_t>(src) : 0)) & 0x3)) {
+        beatSize = DMAC_BTCTRL_BEATSIZE_WORD_Val;
+    }
+    uint32_t beats = len >> beatSize;
+    uint32_t blockCount = (beats + UINT16_MAX - 1) / UINT16_MAX;
+    if (blockCount > DMA_DESCRIPTOR_POOL + 1) {
+        return false;
+    }
+
+    DmaBlock blocks[DMA_DESCRIPTOR_POOL + 1];
+    const uint8_t *srcBytes = static_cast<const uint8_t *>(src);
+    uint8_t *dstBytes = static_cast<uint8_t *>(dst);
+    for (uint32_t i = 0; i < blockCount; i++) {
+        uint16_t blockBeats = beats > UINT16_MAX ? UINT16_MAX : beats;
+        blocks[i].Source = srcBytes;
+        blocks[i].Destination = dstBytes;
+        blocks[i].BeatCount = blockBeats;
+        blocks[i].BeatSize = beatSize;
+        blocks[i].SourceIncrement = srcIncrement;
+        blocks[i].DestinationIncrement = true;
+        blocks[i].Interrupt = false;
+        if (srcIncrement) {
+            srcBytes += blockBeats << beatSize;
+        }
+        dstBytes += blockBeats << beatSize;
+        beats -= blockBeats;
+    }
+    if (!ChainBuild(memChannel, blocks, blockCount)) {
+        return false;
+    }
+
+    memDone = done;
+    // The buffers must be written out before the DMA reads them
+    __DSB();
+    if (!ChannelStart(memChannel)) {
+        memDone = NULL;
+        return false;
+    }
+    return true;
+}
+
+bool DmaManager::Allocated(uint8_t channel) {
+    return channel >= DMA_CHANNEL_COUNT && channel < DMA_CHANNEL_TOTAL &&
+           (allocatedMask & (1UL << channel));
+}
+
+void DmaManager::DescriptorsRelease(uint8_t channel) {
+    for (uint8_t i = 0; i < DMA_DESCRIPTOR_POOL; i++) {
+        if (poolOwner[i] == channel) {
+            poolOwner[i] = DMA_CHANNEL_NONE;
+        }
+    }
+}
+
 } // ClearCore namespace
\ No newline at end of file
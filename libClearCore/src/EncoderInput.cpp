@@ -32,8 +32,12 @@
 #include "SysTiming.h"
 #include "SysUtils.h"
 #include "atomic_utils.h"
+#include <math.h>
 #include <stdlib.h>
 
+static_assert(_CLEARCORE_SAMPLE_RATE_HZ % VEL_EST_SAMPLES == 0,
+              "The velocity estimate window must divide the sample rate");
+
 #define EIC_INDEX_INTERRUPT_PRIORITY 1
 #define EIC_INTERRUPT_PRIORITY 7
 
@@ -51,6 +55,16 @@ int32_t EncoderInput::Position() {
     return atomic_load_n(&m_curPosn) + atomic_load_n(&m_offsetAdjustment);
 }
 
+int32_t EncoderInput::PositionRT() {
+    PDEC->CTRLBSET.reg = PDEC_CTRLBSET_CMD_READSYNC;
+    SYNCBUSY_WAIT(PDEC, PDEC_SYNCBUSY_COUNT);
+    int16_t hwPosn = PDEC->COUNT.reg;
+    // Update() changes these together with interrupts blocked, so they are
+    // consistent with each other here.
+    return m_curPosn + static_cast<int16_t>(hwPosn - m_hwPosn) +
+           m_offsetAdjustment;
+}
+
 int32_t EncoderInput::IndexPosition() {
     return m_indexPosn + atomic_load_n(&m_offsetAdjustment);
 }
@@ -65,6 +79,70 @@ void EncoderInput::AddToPosition(int32_t posnAdjust) {
     atomic_add_fetch(&m_offsetAdjustment, posnAdjust);
 }
 
+int64_t EncoderInput::PositionRaw64() {
+    uint32_t seq;
+    int64_t posn;
+    do {
+        seq = m_posn64Seq;
+        __DMB();
+        posn = m_posnRaw64;
+        __DMB();
+    } while ((seq & 1) || seq != m_posn64Seq);
+    return posn;
+}
+
+int64_t EncoderInput::Position64() {
+    uint32_t seq;
+    int64_t posn;
+    int32_t offsetSeen;
+    do {
+        seq = m_posn64Seq;
+        __DMB();
+        posn = m_posnRaw64 + m_offset64;
+        offsetSeen = m_offsetSeen;
+        __DMB();
+    } while ((seq & 1) || seq != m_posn64Seq);
+    // Include shifts made since the last update
+    return posn + static_cast<int32_t>(atomic_load_n(&m_offsetAdjustment) -
+                                       offsetSeen);
+}
+
+void EncoderInput::Position64(int64_t newPosn) {
+    Position(static_cast<int32_t>(newPosn));
+    m_posn64Request = newPosn;
+    if (!m_enabled) {
+        __disable_irq();
+        Position64Apply(m_curPosn);
+        __enable_irq();
+        return;
+    }
+    // Wait for the change to be applied in the interrupt
+    __DMB();
+    m_posn64Pending = true;
+    while (m_posn64Pending) {
+        continue;
+    }
+}
+
+void EncoderInput::Position64Apply(int32_t posnNow) {
+    m_posn64Seq++;
+    __DMB();
+    // Rebase the 64-bit count on the 32-bit one
+    m_posnRaw64 += static_cast<int32_t>(posnNow -
+                                        static_cast<int32_t>(m_posnRaw64));
+    int32_t offset = atomic_load_n(&m_offsetAdjustment);
+    if (m_posn64Pending || !m_enabled) {
+        m_offset64 = m_posn64Request - m_posnRaw64;
+    }
+    else {
+        m_offset64 += static_cast<int32_t>(offset - m_offsetSeen);
+    }
+    m_offsetSeen = offset;
+    __DMB();
+    m_posn64Seq++;
+    m_posn64Pending = false;
+}
+
 void EncoderInput::Enable(bool isEnabled) {
     while (PDEC->SYNCBUSY.reg);
     if (isEnabled) {
@@ -85,10 +163,12 @@ void EncoderInput::Enable(bool isEnabled) {
         int16_t currentHwPosn = PDEC->COUNT.reg;
         m_hwPosn = currentHwPosn;
         m_velocity = 0;
+        VelocityFilterReset();
         for(uint16_t i = 0; i < VEL_EST_SAMPLES; i++) {
             m_posnHistory[i] = currentHwPosn;
         }
         m_posnHistoryIndex = 0;
+        VelocityEstimatorReset(m_curPosn);
         m_enabled = true;
         __enable_irq();
 
@@ -107,6 +187,9 @@ void EncoderInput::Enable(bool isEnabled) {
         m_indexDetected = false;
         m_processIndex = false;
         m_velocity = 0;
+        VelocityFilterReset();
+        // Geared motors must not keep following the last sample's motion
+        m_stepsLast = 0;
         PDEC->CTRLA.bit.ENABLE = 0;
         PDEC->CTRLBSET.reg = PDEC_CTRLBSET_CMD_STOP;
         // Enabling peripheral mux for interrupts
@@ -151,17 +234,36 @@ EncoderInput::EncoderInput()
       m_indexInfo(&IN08n_QuadI),
       m_curPosn(0),
       m_offsetAdjustment(0),
+      m_posn64Seq(0),
+      m_posnRaw64(0),
+      m_offset64(0),
+      m_offsetSeen(0),
+      m_posn64Request(0),
+      m_posn64Pending(false),
       m_velocity(0),
+      m_velocityFiltered(0),
+      m_velocityFilter(NULL),
       m_hwPosn(0),
       m_posnHistory{0},
       m_posnHistoryIndex(0),
+      m_estimator(VEL_EST_WINDOW),
+      m_sampleTick(0),
+      m_edgeTick{0},
+      m_edgePosn{0},
+      m_edgeIndex(0),
+      m_pllPosn(0),
+      m_pllVel(0),
+      m_pllKp(0),
+      m_pllKi(0),
       m_enabled(false),
       m_processIndex(false),
       m_hwIndex(0),
       m_indexPosn(0),
       m_indexDetected(false),
       m_indexInverted(false),
-      m_stepsLast(0) {
+      m_stepsLast(0),
+      m_replaySteps(nullptr) {
+    VelocityPllBandwidth(VEL_PLL_BANDWIDTH_DEFAULT);
 }
 
 
@@ -191,7 +293,8 @@ void EncoderInput::Update() {
     PDEC->CTRLBSET.reg = PDEC_CTRLBSET_CMD_READSYNC;
     SYNCBUSY_WAIT(PDEC, PDEC_SYNCBUSY_COUNT);
     int16_t currentHwPosn = PDEC->COUNT.reg;
-    m_stepsLast = currentHwPosn - m_hwPosn;
+    const volatile int16_t *replaySteps = m_replaySteps;
+    m_stepsLast = replaySteps ? *replaySteps : currentHwPosn - m_hwPosn;
     
     m_indexDetected = m_processIndex;
     if (m_processIndex) {
@@ -200,17 +303,130 @@ void EncoderInput::Update() {
         // Re-enable the index capture interrupt
         InputMgr.InterruptEnable(m_indexInfo->extInt, true, false);
     }
+    // Adjust the measured position. Keep the hardware and accumulated
+    // positions in step for higher priority readers of PositionRT().
+    __disable_irq();
     m_hwPosn = currentHwPosn;
-    // Adjust the measured position
     int32_t posnNow = atomic_add_fetch(&m_curPosn, (int32_t)m_stepsLast);
+    __enable_irq();
     // Calculate the velocity based on the position change in the 
     // last VEL_EST_SAMPLES sample times and convert to cnts/sec
+    Position64Apply(posnNow);
     int32_t posnDelta = posnNow - m_posnHistory[m_posnHistoryIndex];
-    m_velocity = posnDelta * (_CLEARCORE_SAMPLE_RATE_HZ / VEL_EST_SAMPLES);
+    m_sampleTick++;
+    switch (m_estimator) {
+        case VEL_EST_HYBRID:
+            m_velocity = VelocityHybrid(posnNow, posnDelta);
+            break;
+        case VEL_EST_PLL:
+            m_velocity = VelocityPll(posnNow);
+            break;
+        default:
+            m_velocity =
+                posnDelta * (_CLEARCORE_SAMPLE_RATE_HZ / VEL_EST_SAMPLES);
+            break;
+    }
+    DspFilter<int32_t> *filter = m_velocityFilter;
+    m_velocityFiltered = filter ? filter->Update(m_velocity) : m_velocity;
     m_posnHistory[m_posnHistoryIndex] = posnNow;
     m_posnHistoryIndex = (m_posnHistoryIndex + 1) % VEL_EST_SAMPLES;
 }
 
+void EncoderInput::VelocityEstimator(VelocityEstimators estimator) {
+    __disable_irq();
+    VelocityEstimatorReset(atomic_load_n(&m_curPosn));
+    m_estimator = estimator;
+    __enable_irq();
+}
+
+bool EncoderInput::VelocityPllBandwidth(uint16_t bandwidthHz) {
+    if (!bandwidthHz || bandwidthHz > _CLEARCORE_SAMPLE_RATE_HZ / 10) {
+        return false;
+    }
+    // Critically damped: Kp = 2 * wn * dt, Ki = (wn * dt)^2
+    float wnDt = 2 * M_PI * bandwidthHz / _CLEARCORE_SAMPLE_RATE_HZ;
+    int32_t kp = 2 * wnDt * (1L << 30);
+    int32_t ki = wnDt * wnDt * (1L << 30);
+    __disable_irq();
+    m_pllKp = kp;
+    m_pllKi = ki;
+    __enable_irq();
+    return true;
+}
+
+void EncoderInput::VelocityEstimatorReset(int32_t posn) {
+    for (uint8_t i = 0; i < VEL_HYBRID_EDGES; i++) {
+        m_edgeTick[i] = m_sampleTick;
+        m_edgePosn[i] = posn;
+    }
+    m_edgeIndex = 0;
+    m_pllPosn = static_cast<int64_t>(posn) << 16;
+    m_pllVel = 0;
+}
+
+int32_t EncoderInput::VelocityHybrid(int32_t posn, int32_t windowDelta) {
+    // Remember the sample of every count change
+    if (m_stepsLast) {
+        m_edgeIndex = (m_edgeIndex + 1) % VEL_HYBRID_EDGES;
+        m_edgeTick[m_edgeIndex] = m_sampleTick;
+        m_edgePosn[m_edgeIndex] = posn;
+    }
+    // Fast enough for the window to resolve the speed well
+    if (abs(windowDelta) >= VEL_HYBRID_WINDOW_COUNTS) {
+        return windowDelta * (_CLEARCORE_SAMPLE_RATE_HZ / VEL_EST_SAMPLES);
+    }
+
+    // The oldest remembered edge follows the newest in the ring
+    uint8_t oldest = (m_edgeIndex + 1) % VEL_HYBRID_EDGES;
+    uint32_t span = m_edgeTick[m_edgeIndex] - m_edgeTick[oldest];
+    int32_t counts = posn - m_edgePosn[oldest];
+    uint32_t sinceEdge = m_sampleTick - m_edgeTick[m_edgeIndex];
+    if (!span || !counts || sinceEdge >= _CLEARCORE_SAMPLE_RATE_HZ) {
+        // No motion in the last second
+        return 0;
+    }
+    int32_t velocity = counts * _CLEARCORE_SAMPLE_RATE_HZ /
+                       static_cast<int32_t>(span);
+    // Without a new edge the axis is moving no faster than one count in the
+    // time since the last one, so slow down the estimate as time passes
+    if (sinceEdge) {
+        int32_t bound = _CLEARCORE_SAMPLE_RATE_HZ / sinceEdge;
+        velocity = velocity > bound ? bound :
+                   velocity < -bound ? -bound : velocity;
+    }
+    return velocity;
+}
+
+int32_t EncoderInput::VelocityPll(int32_t posn) {
+    int64_t err64 = (static_cast<int64_t>(posn) << 16) - m_pllPosn;
+    // Limit the error to 32767 counts so the products fit
+    int32_t err = err64 > INT32_MAX ? INT32_MAX :
+                  err64 < INT32_MIN ? INT32_MIN : err64;
+    m_pllVel += (static_cast<int64_t>(err) * m_pllKi) >> 30;
+    m_pllPosn += m_pllVel + ((static_cast<int64_t>(err) * m_pllKp) >> 30);
+    // Q16 counts per sample to counts per second, rounded
+    return (static_cast<int64_t>(m_pllVel) * _CLEARCORE_SAMPLE_RATE_HZ +
+            (1L << 15)) >> 16;
+}
+
+void EncoderInput::VelocityFilter(DspFilter<int32_t> *filter) {
+    __disable_irq();
+    if (filter) {
+        filter->Reset(m_velocity);
+    }
+    m_velocityFilter = filter;
+    m_velocityFiltered = m_velocity;
+    __enable_irq();
+}
+
+void EncoderInput::VelocityFilterReset() {
+    DspFilter<int32_t> *filter = m_velocityFilter;
+    if (filter) {
+        filter->Reset(0);
+    }
+    m_velocityFiltered = 0;
+}
+
 bool EncoderInput::QuadratureError() {
     return PDEC->STATUS.bit.QERR;
 }
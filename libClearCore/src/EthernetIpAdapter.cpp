@@ -0,0 +1,705 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    Implementation of the ClearCore EtherNet/IP adapter
+**/
+
+#include "EthernetIpAdapter.h"
+#include <string.h>
+#include "EthernetManager.h"
+#include "NvmManager.h"
+#include "SysTiming.h"
+
+namespace ClearCore {
+
+extern EthernetManager &EthernetMgr;
+extern NvmManager &NvmMgr;
+
+// Encapsulation header: command, length, session handle, status, sender
+// context, options. The length counts the data after the header.
+#define ENCAP_HEADER_LEN 24
+#define ENCAP_CMD_LIST_SERVICES 0x0004
+#define ENCAP_CMD_LIST_IDENTITY 0x0063
+#define ENCAP_CMD_LIST_INTERFACES 0x0064
+#define ENCAP_CMD_REGISTER_SESSION 0x0065
+#define ENCAP_CMD_UNREGISTER_SESSION 0x0066
+#define ENCAP_CMD_SEND_RR_DATA 0x006F
+#define ENCAP_STATUS_INVALID_COMMAND 0x0001
+#define ENCAP_STATUS_INVALID_LENGTH 0x0003
+#define ENCAP_STATUS_INVALID_SESSION 0x0064
+#define ENCAP_STATUS_UNSUPPORTED_PROTOCOL 0x0069
+#define ENCAP_PROTOCOL_VERSION 1
+
+// Common packet format item types
+#define CPF_NULL_ADDRESS 0x0000
+#define CPF_LIST_IDENTITY 0x000C
+#define CPF_CONNECTED_DATA 0x00B1
+#define CPF_UNCONNECTED_DATA 0x00B2
+#define CPF_LIST_SERVICES 0x0100
+#define CPF_SEQUENCED_ADDRESS 0x8002
+
+// CIP services, classes, and status
+#define CIP_GET_ATTRIBUTES_ALL 0x01
+#define CIP_FORWARD_CLOSE 0x4E
+#define CIP_FORWARD_OPEN 0x54
+#define CIP_LARGE_FORWARD_OPEN 0x5B
+#define CIP_REPLY 0x80
+#define CIP_CLASS_IDENTITY 0x01
+#define CIP_CLASS_ASSEMBLY 0x04
+#define CIP_CLASS_CONNECTION_MANAGER 0x06
+#define CIP_STATUS_CONNECTION_FAILURE 0x01
+#define CIP_STATUS_PATH_SEGMENT_ERROR 0x04
+#define CIP_STATUS_PATH_UNKNOWN 0x05
+#define CIP_STATUS_SERVICE_NOT_SUPPORTED 0x08
+#define CIP_STATUS_NOT_ENOUGH_DATA 0x13
+
+// Connection manager extended status
+#define CM_DUPLICATE_FORWARD_OPEN 0x0100
+#define CM_TRANSPORT_NOT_SUPPORTED 0x0103
+#define CM_OWNERSHIP_CONFLICT 0x0106
+#define CM_CONNECTION_NOT_FOUND 0x0107
+#define CM_INVALID_CONNECTION_TYPE 0x0108
+#define CM_INVALID_CONNECTION_SIZE 0x0109
+#define CM_RPI_NOT_SUPPORTED 0x0111
+#define CM_INVALID_CONNECTION_PATH 0x0315
+
+// Network connection parameters
+#define CONNECTION_TYPE_POINT_TO_POINT 2
+#define TRANSPORT_CLASS_MASK 0x0F
+#define TRANSPORT_CLASS_1 0x01
+
+// Class 1 packets: the CPF item count, a sequenced address item, and a
+// connected data item holding the CIP sequence count and the data. Output
+// data from the scanner also carries the 32-bit run/idle header.
+#define IO_HEADER_LEN 20
+#define IO_RUN_IDLE_LEN 4
+#define IO_RUN 0x01
+
+// The logical segments of a path, as (type, value) pairs
+#define PATH_SEGMENTS_MAX 6
+#define SEGMENT_CLASS 0x20
+#define SEGMENT_INSTANCE 0x24
+#define SEGMENT_CONNECTION_POINT 0x2C
+#define SEGMENT_ELECTRONIC_KEY 0x34
+#define SEGMENT_ELECTRONIC_KEY_LEN 10
+
+static inline uint16_t GetLe16(const uint8_t *data) {
+    return data[0] | (data[1] << 8);
+}
+static inline uint32_t GetLe32(const uint8_t *data) {
+    return GetLe16(data) | (static_cast<uint32_t>(GetLe16(data + 2)) << 16);
+}
+static inline void PutLe16(uint8_t *data, uint16_t value) {
+    data[0] = value & 0xFF;
+    data[1] = value >> 8;
+}
+static inline void PutLe32(uint8_t *data, uint32_t value) {
+    PutLe16(data, value & 0xFFFF);
+    PutLe16(data + 2, value >> 16);
+}
+
+// Split the logical segments of a path into their types and values,
+// skipping an electronic key. Returns the number of segments, or -1 if the
+// path holds anything else.
+static int8_t PathParse(const uint8_t *path, uint16_t length, uint8_t *types,
+                        uint16_t *values) {
+    int8_t count = 0;
+    uint16_t i = 0;
+    while (i < length) {
+        uint8_t segment = path[i];
+        if (segment == SEGMENT_ELECTRONIC_KEY) {
+            i += SEGMENT_ELECTRONIC_KEY_LEN;
+            continue;
+        }
+        uint8_t type = segment & 0xFC;
+        if ((type != SEGMENT_CLASS && type != SEGMENT_INSTANCE &&
+                type != SEGMENT_CONNECTION_POINT) ||
+                count == PATH_SEGMENTS_MAX) {
+            return -1;
+        }
+        types[count] = type;
+        if ((segment & 0x03) == 0 && i + 2 <= length) {
+            values[count++] = path[i + 1];
+            i += 2;
+        }
+        else if ((segment & 0x03) == 1 && i + 4 <= length) {
+            // 16-bit value after a pad byte
+            values[count++] = GetLe16(&path[i + 2]);
+            i += 4;
+        }
+        else {
+            return -1;
+        }
+    }
+    return i == length ? count : -1;
+}
+
+// The identity fields shared by ListIdentity and the Identity object:
+// vendor, device type, product code, revision, status, serial number, and
+// the product name
+static uint16_t IdentityPut(uint8_t *data) {
+    static const char name[] = EIP_PRODUCT_NAME;
+    PutLe16(&data[0], EIP_VENDOR_ID);
+    PutLe16(&data[2], EIP_DEVICE_TYPE);
+    PutLe16(&data[4], EIP_PRODUCT_CODE);
+    data[6] = EIP_REVISION_MAJOR;
+    data[7] = EIP_REVISION_MINOR;
+    PutLe16(&data[8], 0);
+    PutLe32(&data[10], NvmMgr.SerialNumber());
+    data[14] = sizeof(name) - 1;
+    memcpy(&data[15], name, sizeof(name) - 1);
+    return 15 + sizeof(name) - 1;
+}
+
+// A failed connection request: general and extended status, the
+// originator's connection triad, and no remaining path
+static uint16_t ConnectionError(uint8_t *reply, uint8_t service,
+                                uint16_t extStatus, uint16_t serial,
+                                uint16_t vendor, uint32_t originatorSerial) {
+    reply[0] = service | CIP_REPLY;
+    reply[1] = 0;
+    reply[2] = CIP_STATUS_CONNECTION_FAILURE;
+    reply[3] = 1;
+    PutLe16(&reply[4], extStatus);
+    PutLe16(&reply[6], serial);
+    PutLe16(&reply[8], vendor);
+    PutLe32(&reply[10], originatorSerial);
+    reply[14] = 0;
+    reply[15] = 0;
+    return 16;
+}
+
+// A reply with a general status and no data
+static uint16_t CipStatus(uint8_t *reply, uint8_t service, uint8_t status) {
+    reply[0] = service | CIP_REPLY;
+    reply[1] = 0;
+    reply[2] = status;
+    reply[3] = 0;
+    return 4;
+}
+
+EthernetIpAdapter::EthernetIpAdapter()
+    : m_server(EIP_TCP_PORT),
+      m_sessions(),
+      m_ioUdp(),
+      m_listUdp(),
+      m_connection(),
+      m_produced(nullptr),
+      m_producedSize(0),
+      m_consumed(nullptr),
+      m_consumedSize(0),
+      m_produceCallback(nullptr),
+      m_consumeCallback(nullptr),
+      m_lostCallback(nullptr),
+      m_nextSessionHandle(1),
+      m_nextConnectionId(0),
+      m_producedCount(0),
+      m_lateCount(0),
+      m_rxFrame(),
+      m_txFrame() {}
+
+bool EthernetIpAdapter::Begin(const uint8_t *produced, uint16_t producedSize,
+                              uint8_t *consumed, uint16_t consumedSize) {
+    if ((producedSize && !produced) || (consumedSize && !consumed) ||
+            producedSize > EIP_IO_DATA_MAX || consumedSize > EIP_IO_DATA_MAX) {
+        return false;
+    }
+    m_produced = produced;
+    m_producedSize = producedSize;
+    m_consumed = consumed;
+    m_consumedSize = consumedSize;
+    // Vary the connection IDs from one power-up to the next
+    m_nextConnectionId =
+        NvmMgr.SerialNumber() << 16 | (Milliseconds() & 0xFFFF);
+
+    // One packet is in flight while the next is built
+    if (!m_ioUdp.Begin(EIP_UDP_IO_PORT, 2, IO_HEADER_LEN + EIP_IO_DATA_MAX) ||
+            !m_listUdp.Begin(EIP_TCP_PORT)) {
+        m_ioUdp.End();
+        return false;
+    }
+    m_server.Begin();
+    return true;
+}
+
+void EthernetIpAdapter::Poll() {
+    IoConsume();
+    if (m_connection.Open &&
+            Microseconds() - m_connection.LastConsumedUs >
+            m_connection.TimeoutUs) {
+        ConnectionClose();
+    }
+    IoProduce();
+
+    // ListIdentity broadcasts from scanners browsing the network
+    if (m_listUdp.PacketParse()) {
+        int32_t length = m_listUdp.PacketRead(m_rxFrame, sizeof(m_rxFrame));
+        if (length >= ENCAP_HEADER_LEN &&
+                GetLe16(&m_rxFrame[2]) == length - ENCAP_HEADER_LEN) {
+            uint16_t replyLength =
+                EncapProcess(nullptr, length - ENCAP_HEADER_LEN);
+            if (replyLength &&
+                    m_listUdp.Connect(m_listUdp.RemoteIp(),
+                                      m_listUdp.RemotePort())) {
+                m_listUdp.PacketWrite(m_txFrame, replyLength);
+                m_listUdp.PacketSend();
+            }
+        }
+    }
+
+    SessionAccept();
+    for (uint8_t i = 0; i < EIP_SESSIONS_MAX; i++) {
+        Session &session = m_sessions[i];
+        if (!session.Client.ConnectionState()) {
+            continue;
+        }
+        if (!session.Client.Connected()) {
+            // Release the state of a connection the scanner has closed
+            session.Client.Close();
+            continue;
+        }
+        SessionProcess(session);
+    }
+}
+
+void EthernetIpAdapter::SessionAccept() {
+    while (true) {
+        EthernetTcpClient client = m_server.Accept();
+        if (!client.ConnectionState()) {
+            return;
+        }
+        uint8_t slot = 0;
+        while (slot < EIP_SESSIONS_MAX &&
+                m_sessions[slot].Client.ConnectionState()) {
+            slot++;
+        }
+        if (slot == EIP_SESSIONS_MAX) {
+            // Every slot is taken; turn the scanner away
+            client.Close();
+            continue;
+        }
+        m_sessions[slot].Client = client;
+        m_sessions[slot].Handle = 0;
+    }
+}
+
+void EthernetIpAdapter::SessionProcess(Session &session) {
+    EthernetTcpClient &client = session.Client;
+    int16_t available = client.BytesAvailable();
+    if (available < ENCAP_HEADER_LEN) {
+        return;
+    }
+    client.Peek(m_rxFrame, ENCAP_HEADER_LEN);
+    uint16_t length = GetLe16(&m_rxFrame[2]);
+    if (length > EIP_ENCAP_MAX - ENCAP_HEADER_LEN) {
+        // Too long to handle; the stream can't be resynchronized
+        client.Close();
+        return;
+    }
+    if (available < ENCAP_HEADER_LEN + length) {
+        // Wait for the rest of the message
+        return;
+    }
+    client.Read(m_rxFrame, ENCAP_HEADER_LEN + length);
+
+    uint16_t replyLength = EncapProcess(&session, length);
+    if (replyLength) {
+        client.Send(m_txFrame, replyLength);
+    }
+}
+
+uint16_t EthernetIpAdapter::EncapProcess(Session *session, uint16_t length) {
+    uint16_t command = GetLe16(&m_rxFrame[0]);
+    const uint8_t *request = &m_rxFrame[ENCAP_HEADER_LEN];
+    uint8_t *reply = &m_txFrame[ENCAP_HEADER_LEN];
+    uint16_t replyLength = 0;
+    uint32_t status = 0;
+
+    // The reply echoes the command, session handle, and sender context
+    memcpy(m_txFrame, m_rxFrame, ENCAP_HEADER_LEN);
+
+    switch (command) {
+        case ENCAP_CMD_LIST_IDENTITY:
+            replyLength = ListIdentity(reply);
+            break;
+        case ENCAP_CMD_LIST_SERVICES:
+            PutLe16(&reply[0], 1);
+            PutLe16(&reply[2], CPF_LIST_SERVICES);
+            PutLe16(&reply[4], 20);
+            PutLe16(&reply[6], ENCAP_PROTOCOL_VERSION);
+            // CIP over TCP and Class 0/1 over UDP
+            PutLe16(&reply[8], 0x0120);
+            memset(&reply[10], 0, 16);
+            memcpy(&reply[10], "Communications", 14);
+            replyLength = 26;
+            break;
+        case ENCAP_CMD_LIST_INTERFACES:
+            PutLe16(&reply[0], 0);
+            replyLength = 2;
+            break;
+        case ENCAP_CMD_REGISTER_SESSION:
+            if (!session) {
+                return 0;
+            }
+            if (length < 4) {
+                status = ENCAP_STATUS_INVALID_LENGTH;
+                break;
+            }
+            memcpy(reply, request, 4);
+            replyLength = 4;
+            if (GetLe16(&request[0]) != ENCAP_PROTOCOL_VERSION) {
+                status = ENCAP_STATUS_UNSUPPORTED_PROTOCOL;
+                break;
+            }
+            session->Handle = m_nextSessionHandle++;
+            PutLe32(&m_txFrame[4], session->Handle);
+            break;
+        case ENCAP_CMD_UNREGISTER_SESSION:
+            if (session) {
+                session->Client.Close();
+            }
+            return 0;
+        case ENCAP_CMD_SEND_RR_DATA: {
+            if (!session) {
+                return 0;
+            }
+            if (!session->Handle ||
+                    GetLe32(&m_rxFrame[4]) != session->Handle) {
+                status = ENCAP_STATUS_INVALID_SESSION;
+                break;
+            }
+            // Interface handle, timeout, and two items: a null address and
+            // the unconnected CIP request
+            uint16_t cipLength = length >= 16 ? GetLe16(&request[14]) : 0;
+            if (length < 16 || GetLe16(&request[6]) < 2 ||
+                    GetLe16(&request[8]) != CPF_NULL_ADDRESS ||
+                    GetLe16(&request[12]) != CPF_UNCONNECTED_DATA ||
+                    cipLength > length - 16) {
+                status = ENCAP_STATUS_INVALID_LENGTH;
+                break;
+            }
+            memset(reply, 0, 16);
+            PutLe16(&reply[6], 2);
+            PutLe16(&reply[12], CPF_UNCONNECTED_DATA);
+            uint16_t cipReplyLength =
+                CipRequest(&request[16], cipLength, &reply[16],
+                           session->Client.RemoteIp());
+            PutLe16(&reply[14], cipReplyLength);
+            replyLength = 16 + cipReplyLength;
+            break;
+        }
+        default:
+            if (!session) {
+                return 0;
+            }
+            status = ENCAP_STATUS_INVALID_COMMAND;
+            break;
+    }
+
+    PutLe16(&m_txFrame[2], replyLength);
+    PutLe32(&m_txFrame[8], status);
+    PutLe32(&m_txFrame[20], 0);
+    return ENCAP_HEADER_LEN + replyLength;
+}
+
+uint16_t EthernetIpAdapter::ListIdentity(uint8_t *data) {
+    PutLe16(&data[0], 1);
+    PutLe16(&data[2], CPF_LIST_IDENTITY);
+    uint8_t *item = &data[6];
+    PutLe16(&item[0], ENCAP_PROTOCOL_VERSION);
+    // The socket address is in network byte order
+    memset(&item[2], 0, 16);
+    item[3] = 2;
+    item[4] = EIP_TCP_PORT >> 8;
+    item[5] = EIP_TCP_PORT & 0xFF;
+    uint32_t ip = EthernetMgr.LocalIp();
+    memcpy(&item[6], &ip, sizeof(ip));
+    uint16_t itemLength = 18 + IdentityPut(&item[18]);
+    // Device state: operational
+    item[itemLength++] = 0x03;
+    PutLe16(&data[4], itemLength);
+    return 6 + itemLength;
+}
+
+uint16_t EthernetIpAdapter::CipRequest(const uint8_t *request,
+                                       uint16_t length, uint8_t *reply,
+                                       IpAddress originator) {
+    if (length < 2) {
+        return CipStatus(reply, 0, CIP_STATUS_NOT_ENOUGH_DATA);
+    }
+    uint8_t service = request[0];
+    uint16_t pathLength = request[1] * 2;
+    uint8_t types[PATH_SEGMENTS_MAX];
+    uint16_t values[PATH_SEGMENTS_MAX];
+    if (2 + pathLength > length ||
+            PathParse(&request[2], pathLength, types, values) != 2 ||
+            types[0] != SEGMENT_CLASS || types[1] != SEGMENT_INSTANCE ||
+            values[1] != 1) {
+        return CipStatus(reply, service, CIP_STATUS_PATH_SEGMENT_ERROR);
+    }
+    const uint8_t *data = &request[2 + pathLength];
+    uint16_t dataLength = length - 2 - pathLength;
+
+    switch (values[0]) {
+        case CIP_CLASS_CONNECTION_MANAGER:
+            if (service == CIP_FORWARD_OPEN ||
+                    service == CIP_LARGE_FORWARD_OPEN) {
+                return ForwardOpen(data, dataLength, reply,
+                                   service == CIP_LARGE_FORWARD_OPEN,
+                                   originator);
+            }
+            if (service == CIP_FORWARD_CLOSE) {
+                return ForwardClose(data, dataLength, reply);
+            }
+            break;
+        case CIP_CLASS_IDENTITY:
+            if (service == CIP_GET_ATTRIBUTES_ALL) {
+                CipStatus(reply, service, 0);
+                return 4 + IdentityPut(&reply[4]);
+            }
+            break;
+        default:
+            return CipStatus(reply, service, CIP_STATUS_PATH_UNKNOWN);
+    }
+    return CipStatus(reply, service, CIP_STATUS_SERVICE_NOT_SUPPORTED);
+}
+
+uint16_t EthernetIpAdapter::ForwardOpen(const uint8_t *request,
+                                        uint16_t length, uint8_t *reply,
+                                        bool large, IpAddress originator) {
+    uint8_t service = large ? CIP_LARGE_FORWARD_OPEN : CIP_FORWARD_OPEN;
+    // The large form widens the connection parameters to 32 bits
+    uint8_t pathOffset = large ? 40 : 36;
+    if (length < pathOffset) {
+        return CipStatus(reply, service, CIP_STATUS_NOT_ENOUGH_DATA);
+    }
+    uint32_t toConnectionId = GetLe32(&request[6]);
+    uint16_t serial = GetLe16(&request[10]);
+    uint16_t vendor = GetLe16(&request[12]);
+    uint32_t originatorSerial = GetLe32(&request[14]);
+    uint8_t timeoutMultiplier = request[18];
+    uint32_t otRpiUs = GetLe32(&request[22]);
+    uint32_t toRpiUs;
+    uint16_t otSize, toSize;
+    uint8_t otType, toType;
+    if (large) {
+        uint32_t otParams = GetLe32(&request[26]);
+        toRpiUs = GetLe32(&request[30]);
+        uint32_t toParams = GetLe32(&request[34]);
+        otSize = otParams & 0xFFFF;
+        toSize = toParams & 0xFFFF;
+        otType = (otParams >> 29) & 0x03;
+        toType = (toParams >> 29) & 0x03;
+    }
+    else {
+        uint16_t otParams = GetLe16(&request[26]);
+        toRpiUs = GetLe32(&request[28]);
+        uint16_t toParams = GetLe16(&request[32]);
+        otSize = otParams & 0x01FF;
+        toSize = toParams & 0x01FF;
+        otType = (otParams >> 13) & 0x03;
+        toType = (toParams >> 13) & 0x03;
+    }
+    uint8_t transport = request[pathOffset - 2];
+    uint16_t pathLength = request[pathOffset - 1] * 2;
+
+    uint16_t extStatus = 0;
+    uint8_t types[PATH_SEGMENTS_MAX];
+    uint16_t values[PATH_SEGMENTS_MAX];
+    int8_t segments = pathOffset + pathLength <= length ?
+                      PathParse(&request[pathOffset], pathLength, types,
+                                values) : -1;
+    if (m_connection.Open) {
+        bool duplicate = serial == m_connection.Serial &&
+                         vendor == m_connection.Vendor &&
+                         originatorSerial == m_connection.OriginatorSerial;
+        extStatus = duplicate ? CM_DUPLICATE_FORWARD_OPEN :
+                    CM_OWNERSHIP_CONFLICT;
+    }
+    else if ((transport & TRANSPORT_CLASS_MASK) != TRANSPORT_CLASS_1) {
+        extStatus = CM_TRANSPORT_NOT_SUPPORTED;
+    }
+    else if (otType != CONNECTION_TYPE_POINT_TO_POINT ||
+             toType != CONNECTION_TYPE_POINT_TO_POINT) {
+        extStatus = CM_INVALID_CONNECTION_TYPE;
+    }
+    else if (otRpiUs < EIP_RPI_MIN_US || toRpiUs < EIP_RPI_MIN_US) {
+        extStatus = CM_RPI_NOT_SUPPORTED;
+    }
+    else if (otSize != m_consumedSize + 2 + IO_RUN_IDLE_LEN ||
+             toSize != m_producedSize + 2) {
+        extStatus = CM_INVALID_CONNECTION_SIZE;
+    }
+    // The assembly class, then the configuration instance (optional), the
+    // output point, and the input point
+    else if (segments < 3 || types[0] != SEGMENT_CLASS ||
+             values[0] != CIP_CLASS_ASSEMBLY ||
+             values[segments - 2] != EIP_ASSEMBLY_OUTPUT ||
+             values[segments - 1] != EIP_ASSEMBLY_INPUT ||
+             (segments == 4 && values[1] != EIP_ASSEMBLY_CONFIG) ||
+             segments > 4) {
+        extStatus = CM_INVALID_CONNECTION_PATH;
+    }
+    if (extStatus) {
+        return ConnectionError(reply, service, extStatus, serial, vendor,
+                               originatorSerial);
+    }
+
+    uint32_t now = Microseconds();
+    uint64_t timeoutUs = static_cast<uint64_t>(otRpiUs) <<
+                         (2 + min(timeoutMultiplier, 7));
+    m_connection.Open = true;
+    m_connection.Run = false;
+    m_connection.OTConnectionId = m_nextConnectionId++;
+    m_connection.TOConnectionId = toConnectionId;
+    m_connection.Serial = serial;
+    m_connection.Vendor = vendor;
+    m_connection.OriginatorSerial = originatorSerial;
+    m_connection.OTRpiUs = otRpiUs;
+    m_connection.TORpiUs = toRpiUs;
+    m_connection.TimeoutUs = min(timeoutUs, static_cast<uint64_t>(INT32_MAX));
+    m_connection.Originator = originator;
+    m_connection.LastConsumedUs = now;
+    m_connection.LastConsumedSeq = 0;
+    m_connection.NextProduceUs = now;
+    m_connection.ProducedSeq = 0;
+    m_connection.ProducedCipSeq = 0;
+
+    CipStatus(reply, service, 0);
+    PutLe32(&reply[4], m_connection.OTConnectionId);
+    PutLe32(&reply[8], toConnectionId);
+    PutLe16(&reply[12], serial);
+    PutLe16(&reply[14], vendor);
+    PutLe32(&reply[16], originatorSerial);
+    // The actual packet intervals are the requested ones
+    PutLe32(&reply[20], otRpiUs);
+    PutLe32(&reply[24], toRpiUs);
+    reply[28] = 0;
+    reply[29] = 0;
+    return 30;
+}
+
+uint16_t EthernetIpAdapter::ForwardClose(const uint8_t *request,
+                                         uint16_t length, uint8_t *reply) {
+    if (length < 10) {
+        return CipStatus(reply, CIP_FORWARD_CLOSE, CIP_STATUS_NOT_ENOUGH_DATA);
+    }
+    uint16_t serial = GetLe16(&request[2]);
+    uint16_t vendor = GetLe16(&request[4]);
+    uint32_t originatorSerial = GetLe32(&request[6]);
+    if (!m_connection.Open || serial != m_connection.Serial ||
+            vendor != m_connection.Vendor ||
+            originatorSerial != m_connection.OriginatorSerial) {
+        return ConnectionError(reply, CIP_FORWARD_CLOSE,
+                               CM_CONNECTION_NOT_FOUND, serial, vendor,
+                               originatorSerial);
+    }
+    ConnectionClose();
+
+    CipStatus(reply, CIP_FORWARD_CLOSE, 0);
+    PutLe16(&reply[4], serial);
+    PutLe16(&reply[6], vendor);
+    PutLe32(&reply[8], originatorSerial);
+    reply[12] = 0;
+    reply[13] = 0;
+    return 14;
+}
+
+void EthernetIpAdapter::ConnectionClose() {
+    m_connection.Open = false;
+    m_connection.Run = false;
+    if (m_lostCallback) {
+        m_lostCallback();
+    }
+}
+
+void EthernetIpAdapter::IoConsume() {
+    if (!m_ioUdp.PacketParse()) {
+        return;
+    }
+    int32_t length = m_ioUdp.PacketRead(m_rxFrame, sizeof(m_rxFrame));
+    if (!m_connection.Open || length < IO_HEADER_LEN ||
+            GetLe16(&m_rxFrame[0]) != 2 ||
+            GetLe16(&m_rxFrame[2]) != CPF_SEQUENCED_ADDRESS ||
+            GetLe32(&m_rxFrame[6]) != m_connection.OTConnectionId ||
+            GetLe16(&m_rxFrame[14]) != CPF_CONNECTED_DATA ||
+            GetLe16(&m_rxFrame[16]) != m_consumedSize + 2 + IO_RUN_IDLE_LEN ||
+            length < IO_HEADER_LEN + IO_RUN_IDLE_LEN + m_consumedSize) {
+        return;
+    }
+    // Ignore a packet that arrives out of order
+    uint32_t sequence = GetLe32(&m_rxFrame[10]);
+    if (static_cast<int32_t>(sequence - m_connection.LastConsumedSeq) <= 0 &&
+            m_connection.LastConsumedSeq != 0) {
+        return;
+    }
+    m_connection.LastConsumedSeq = sequence;
+    m_connection.LastConsumedUs = Microseconds();
+    m_connection.Run = GetLe32(&m_rxFrame[IO_HEADER_LEN]) & IO_RUN;
+    memcpy(m_consumed, &m_rxFrame[IO_HEADER_LEN + IO_RUN_IDLE_LEN],
+           m_consumedSize);
+    if (m_consumeCallback) {
+        m_consumeCallback();
+    }
+}
+
+void EthernetIpAdapter::IoProduce() {
+    if (!m_connection.Open) {
+        return;
+    }
+    uint32_t now = Microseconds();
+    if (static_cast<int32_t>(now - m_connection.NextProduceUs) < 0) {
+        return;
+    }
+    // Keep to the RPI grid, unless a whole interval has been missed
+    m_connection.NextProduceUs += m_connection.TORpiUs;
+    if (static_cast<int32_t>(now - m_connection.NextProduceUs) >= 0) {
+        m_lateCount++;
+        m_connection.NextProduceUs = now + m_connection.TORpiUs;
+    }
+
+    uint8_t *packet = m_ioUdp.BatchPacketBegin();
+    if (!packet) {
+        // The last packet is still waiting to be transmitted
+        return;
+    }
+    if (m_produceCallback) {
+        m_produceCallback();
+    }
+    PutLe16(&packet[0], 2);
+    PutLe16(&packet[2], CPF_SEQUENCED_ADDRESS);
+    PutLe16(&packet[4], 8);
+    PutLe32(&packet[6], m_connection.TOConnectionId);
+    PutLe32(&packet[10], ++m_connection.ProducedSeq);
+    PutLe16(&packet[14], CPF_CONNECTED_DATA);
+    PutLe16(&packet[16], m_producedSize + 2);
+    PutLe16(&packet[18], ++m_connection.ProducedCipSeq);
+    memcpy(&packet[IO_HEADER_LEN], m_produced, m_producedSize);
+    m_ioUdp.BatchPacketQueue(m_connection.Originator, EIP_UDP_IO_PORT,
+                             IO_HEADER_LEN + m_producedSize);
+    if (m_ioUdp.BatchSend()) {
+        m_producedCount++;
+    }
+}
+
+} // ClearCore namespace
@@ -29,18 +29,35 @@
 #include "EthernetManager.h"
 #include "ethernetif.c"
 #include "lwip/init.h"
+#include "lwip/autoip.h"
 #include "lwip/dhcp.h"
+#include "lwip/prot/dhcp.h"
 #include "lwip/dns.h"
+#include "lwip/memp.h"
+#include "lwip/stats.h"
 #include "lwip/timeouts.h"
 #include "NvmManager.h"
+#include "atomic_utils.h"
+#include "PtpManager.h"
 #include "SysTiming.h"
+#include "TraceManager.h"
 
 namespace ClearCore {
 
 extern NvmManager &NvmMgr;
+extern PtpManager &PtpMgr;
 
 EthernetManager &EthernetMgr = EthernetManager::Instance();
 
+// Marks the DHCP lease kept in NVM as valid
+#define DHCP_LEASE_MAGIC 0x4C484344
+
+// The names of LwIP's memory pools, in memp_t order
+static const char *const MemoryPoolNames[] = {
+#define LWIP_MEMPOOL(name, num, size, desc) desc,
+#include "lwip/priv/memp_std.h"
+};
+
 EthernetManager &EthernetManager::Instance() {
     static EthernetManager *instance = new EthernetManager();
     return *instance;
@@ -59,8 +76,16 @@ EthernetManager::EthernetManager()
       m_portPhyTxclk(PHY_TXCLK.gpioPort), m_pinPhyTxclk(PHY_TXCLK.gpioPin),
       m_portPhyInt(PHY_INT.gpioPort), m_pinPhyInt(PHY_INT.gpioPin),
       m_phyExtInt(PHY_INT.extInt), m_phyLinkUp(false), m_phyRemoteFault(false),
-      m_phyInitFailed(false), m_recv(false), m_dhcp(false), m_ethernetActive(false),
+      m_phyInitFailed(false), m_recv(false), m_dhcp(false),
+      m_dhcpAsync(false), m_dhcpStatus(DHCP_STATUS_OFF),
+      m_dhcpCallback(nullptr), m_dhcpFallbackMs(0), m_dhcpSearchStartMs(0),
+      m_dhcpFallbackActive(false), m_dhcpLinkUp(false), m_dhcpFallbackIp(),
+      m_dhcpFallbackNetmask(), m_dhcpFallbackGateway(),
+      m_dhcpLeasePending(0), m_ethernetActive(false), m_eventDriven(false),
+      m_serviceLockCount(0), m_timeoutPending(false),
+      m_timeoutDueMs(0),
       m_rxBuffIndex(0), m_txBuffIndex(0), m_rxBuffer{0}, m_txBuffer{0},
+      m_stats(), m_statsMs(0), m_rxDescPeak(0), m_statsTcpRetransmitsBase(0),
       m_retransmissionTimeout(200), m_retransmissionCount(8),
       m_ethernetInterface({}), m_macInterface({}), m_dhcpData(nullptr) { }
 
@@ -166,14 +191,19 @@ void EthernetManager::Initialize() {
     EIC->CTRLA.bit.ENABLE = 1;
     SYNCBUSY_WAIT(EIC, EIC_SYNCBUSY_ENABLE);
 
-    // Initialize the PHY
-    PhyInitialize();
+    // The PHY is initialized by the SysManager once its cold start is over
 
     // Set up fields in our internal interface
     m_ethernetInterface.rxDesc = &m_rxDesc[0];
     m_ethernetInterface.txDesc = &m_txDesc[0];
     m_ethernetInterface.rxBuffIndex = &m_rxBuffIndex;
     m_ethernetInterface.txBuffIndex = &m_txBuffIndex;
+#if ETHERNET_RX_ZERO_COPY
+    RxZeroCopyInit(&m_ethernetInterface);
+#endif
+#if ETHERNET_TX_ZERO_COPY
+    TxZeroCopyInit(&m_ethernetInterface);
+#endif
 
     // Retrieve the MAC address from NVM and write it to the interface
     NvmMgr.MacAddress(m_ethernetInterface.mac);
@@ -341,7 +371,12 @@ void EthernetManager::IrqHandlerGmac() {
     tsr = GMAC->TSR.reg;    // Transmit status register
     rsr = GMAC->RSR.reg;    // Receive  status register
     // Need to clear the ISR (clear on read)
-    GMAC->ISR.reg;
+    uint32_t isr = GMAC->ISR.reg;
+
+    // PTP event frame sent or received; latch its timestamp
+    if (isr & (GMAC_ISR_SFR | GMAC_ISR_DRQFT)) {
+        PtpMgr.IrqHandlerTimestamp(isr);
+    }
 
     // Frame transmitted
     if (tsr & GMAC_TSR_TXCOMP) {
@@ -352,9 +387,113 @@ void EthernetManager::IrqHandlerGmac() {
     // Frame received, add a packet to packet buffer.
     if (rsr & GMAC_RSR_REC) {
         m_recv = true;
+        // Track how far the receive servicing falls behind
+        uint8_t held = 0;
+        for (uint8_t i = 0; i < RX_BUFF_CNT; i++) {
+            held += m_rxDesc[i].bit.OWN;
+        }
+        if (held > m_rxDescPeak) {
+            m_rxDescPeak = held;
+        }
+#if ETHERNET_RAW_MAX
+        // Raw frames go straight to their handlers.
+        RawDispatch(&m_ethernetInterface);
+#endif
     }
     // Clear the RSR reg
     GMAC->RSR.reg = rsr;
+
+    // Hand received frames, and transmitted frames to reclaim, to the
+    // service interrupt.
+    if (m_eventDriven && ((tsr & GMAC_TSR_TXCOMP) || (rsr & GMAC_RSR_REC))) {
+        NVIC_SetPendingIRQ(ETHERNET_SERVICE_IRQn);
+    }
+}
+
+#if ETHERNET_RAW_MAX
+bool EthernetManager::RawRegister(uint16_t etherType, ethRawHandler handler,
+                                  void *arg) {
+    return ::RawRegister(etherType, handler, arg);
+}
+
+void EthernetManager::RawUnregister(uint16_t etherType) {
+    ::RawUnregister(etherType);
+}
+
+bool EthernetManager::RawSend(const uint8_t *destMac, uint16_t etherType,
+                              const uint8_t *payload, uint16_t length) {
+    if (!m_ethernetActive) {
+        return false;
+    }
+    struct eth_hdr header;
+    memcpy(&header.dest, destMac, ETH_HWADDR_LEN);
+    memcpy(&header.src, m_ethernetInterface.mac, ETH_HWADDR_LEN);
+    header.type = PP_HTONS(etherType);
+    return ::RawSend(&m_ethernetInterface, &header, payload, length);
+}
+#endif
+
+void EthernetManager::IrqHandlerService() {
+    Service();
+}
+
+void EthernetManager::ServiceLock() {
+    NVIC_DisableIRQ(ETHERNET_SERVICE_IRQn);
+    m_serviceLockCount++;
+}
+
+void EthernetManager::ServiceUnlock() {
+    if (!m_serviceLockCount) {
+        return;
+    }
+    if (m_serviceLockCount == 1 && m_eventDriven) {
+        // The LwIP calls made under the lock may have added timeouts.
+        TimeoutSchedule();
+    }
+    if (--m_serviceLockCount == 0 && m_eventDriven) {
+        NVIC_EnableIRQ(ETHERNET_SERVICE_IRQn);
+    }
+}
+
+void EthernetManager::EventDriven(bool enable) {
+    if (enable == m_eventDriven) {
+        return;
+    }
+    if (enable) {
+        m_timeoutPending = false;
+        m_eventDriven = true;
+        // Catch up on anything received while polling.
+        NVIC_SetPendingIRQ(ETHERNET_SERVICE_IRQn);
+        if (!m_serviceLockCount) {
+            NVIC_EnableIRQ(ETHERNET_SERVICE_IRQn);
+        }
+    }
+    else {
+        NVIC_DisableIRQ(ETHERNET_SERVICE_IRQn);
+        m_eventDriven = false;
+        m_timeoutPending = false;
+    }
+}
+
+void EthernetManager::ServiceTick() {
+    // Collect the statistics before their narrower registers saturate
+    if (m_ethernetActive && ++m_statsMs >= ETHERNET_STATS_PERIOD_MS) {
+        m_statsMs = 0;
+        StatsCollect();
+    }
+    if (m_timeoutPending &&
+            static_cast<int32_t>(Milliseconds() - m_timeoutDueMs) >= 0) {
+        m_timeoutPending = false;
+        NVIC_SetPendingIRQ(ETHERNET_SERVICE_IRQn);
+    }
+}
+
+EthernetServiceLock::EthernetServiceLock() {
+    EthernetMgr.ServiceLock();
+}
+
+EthernetServiceLock::~EthernetServiceLock() {
+    EthernetMgr.ServiceUnlock();
 }
 
 uint8_t *EthernetManager::MacAddress() {
@@ -395,16 +534,119 @@ IpAddress EthernetManager::DnsIp() {
     if (!m_ethernetActive) {
         return IpAddress();
     }
+    EthernetServiceLock lock;
     return IpAddress(dns_getserver(0)->addr);
 }
 
 void EthernetManager::DnsIp(IpAddress dns) {
     if (m_ethernetActive) {
+        EthernetServiceLock lock;
         ip_addr_t dnsIp = IPADDR4_INIT(uint32_t(dns));
         dns_setserver(0, &dnsIp);
     }
 }
 
+uint8_t EthernetManager::MemoryPoolCount() {
+    return MEMP_MAX;
+}
+
+bool EthernetManager::MemoryPoolStats(uint8_t pool, MemoryStats &stats) {
+    if (!m_ethernetActive || pool >= MEMP_MAX) {
+        return false;
+    }
+    EthernetServiceLock lock;
+    const struct stats_mem *mem = lwip_stats.memp[pool];
+    stats.Name = MemoryPoolNames[pool];
+    stats.Size = mem->avail;
+    stats.Used = mem->used;
+    stats.Peak = mem->max;
+    stats.Errors = mem->err;
+    return true;
+}
+
+bool EthernetManager::MemoryHeapStats(MemoryStats &stats) {
+    if (!m_ethernetActive) {
+        return false;
+    }
+    EthernetServiceLock lock;
+    stats.Name = "HEAP";
+    stats.Size = lwip_stats.mem.avail;
+    stats.Used = lwip_stats.mem.used;
+    stats.Peak = lwip_stats.mem.max;
+    stats.Errors = lwip_stats.mem.err;
+    return true;
+}
+
+void EthernetManager::MemoryPeakReset() {
+    if (!m_ethernetActive) {
+        return;
+    }
+    EthernetServiceLock lock;
+    lwip_stats.mem.max = lwip_stats.mem.used;
+    lwip_stats.mem.err = 0;
+    for (uint8_t i = 0; i < MEMP_MAX; i++) {
+        lwip_stats.memp[i]->max = lwip_stats.memp[i]->used;
+        lwip_stats.memp[i]->err = 0;
+    }
+}
+
+uint32_t EthernetManager::MemoryErrors() {
+    uint32_t errors = lwip_stats.mem.err;
+    for (uint8_t i = 0; i < MEMP_MAX; i++) {
+        errors += lwip_stats.memp[i]->err;
+    }
+    return errors;
+}
+
+bool EthernetManager::NetworkStatsGet(NetworkStats &stats) {
+    if (!m_ethernetActive) {
+        return false;
+    }
+    __disable_irq();
+    StatsCollect();
+    stats = m_stats;
+    __enable_irq();
+    stats.RxDescriptorsPeak = m_rxDescPeak;
+
+    EthernetServiceLock lock;
+    stats.MemoryErrors = MemoryErrors();
+#if MIB2_STATS
+    stats.TcpRetransmits =
+        lwip_stats.mib2.tcpretranssegs - m_statsTcpRetransmitsBase;
+#endif
+    return true;
+}
+
+void EthernetManager::NetworkStatsReset() {
+    if (!m_ethernetActive) {
+        return;
+    }
+    __disable_irq();
+    StatsCollect();
+    m_stats = NetworkStats();
+    m_rxDescPeak = 0;
+    __enable_irq();
+#if MIB2_STATS
+    EthernetServiceLock lock;
+    m_statsTcpRetransmitsBase = lwip_stats.mib2.tcpretranssegs;
+#endif
+}
+
+void EthernetManager::StatsCollect() {
+    // Each register clears when read; read the low half of a byte count
+    // first
+    m_stats.TxBytes += GMAC->OTLO.reg;
+    m_stats.TxBytes += static_cast<uint64_t>(GMAC->OTHI.reg) << 32;
+    m_stats.TxFrames += GMAC->FT.reg;
+    m_stats.TxUnderruns += GMAC->TUR.reg;
+    m_stats.RxBytes += GMAC->ORLO.reg;
+    m_stats.RxBytes += static_cast<uint64_t>(GMAC->ORHI.reg) << 32;
+    m_stats.RxFrames += GMAC->FR.reg;
+    m_stats.RxCrcErrors += GMAC->FCSE.reg;
+    m_stats.RxOverruns += GMAC->ROE.reg;
+    m_stats.RxResourceErrors += GMAC->RRE.reg;
+}
+
 /**
     Setup a single GMAC GPIO.
 **/
@@ -414,13 +656,18 @@ void EthernetManager::ConfigureGpioPerGmac(uint32_t port, uint32_t pin) {
 }
 
 bool EthernetManager::DhcpBegin() {
+    SysTiming::LoopBlockMarker marker(SysTiming::LOOP_BLOCK_DHCP);
     struct netif *netif = &m_macInterface;
     uint32_t DHCP_TIMEOUT_MS = 1500;
 
     bool dhcpSuccess = false;
     for (uint8_t i = 0; i < 5 && !dhcpSuccess; i++) {
         // Try to get our config info from a DHCP server
-        err_t err = dhcp_start(netif);
+        err_t err;
+        {
+            EthernetServiceLock lock;
+            err = dhcp_start(netif);
+        }
 
         if (err == ERR_OK) {
             uint32_t startMs = Milliseconds();
@@ -428,6 +675,7 @@ bool EthernetManager::DhcpBegin() {
             while (dhcp_supplied_address(netif) == 0) {
                 if (Milliseconds() - startMs > DHCP_TIMEOUT_MS) {
                     // Timed out, stop the dhcp process.
+                    EthernetServiceLock lock;
                     dhcp_release_and_stop(netif);
                     break;
                 }
@@ -439,23 +687,169 @@ bool EthernetManager::DhcpBegin() {
     if (dhcpSuccess) {
         // Set up info from DHCP configuration
         m_dhcpData = netif_dhcp_data(netif);
+        m_dhcpLeasePending = netif_ip4_addr(netif)->addr;
+        DhcpLeaseSave();
     }
     m_dhcp = dhcpSuccess;
     return dhcpSuccess;
 }
 
+bool EthernetManager::DhcpBeginAsync(DhcpCallback callback,
+                                     uint32_t fallbackMs) {
+    if (!m_ethernetActive) {
+        return false;
+    }
+    struct netif *netif = &m_macInterface;
+    EthernetServiceLock lock;
+    autoip_stop(netif);
+    if (dhcp_start(netif) != ERR_OK) {
+        return false;
+    }
+    m_dhcpData = netif_dhcp_data(netif);
+    DhcpRequest(false);
+
+    m_dhcp = true;
+    m_dhcpCallback = callback;
+    m_dhcpFallbackMs = fallbackMs;
+    m_dhcpSearchStartMs = Milliseconds();
+    m_dhcpFallbackActive = false;
+    m_dhcpLinkUp = m_phyLinkUp;
+    m_dhcpStatus = DHCP_STATUS_OFF;
+    m_dhcpAsync = true;
+    // Report the starting status
+    DhcpUpdate();
+    return true;
+}
+
+void EthernetManager::DhcpRequest(bool restart) {
+    struct netif *netif = &m_macInterface;
+#if DHCP_LEASE_CACHE
+    uint32_t lease[2];
+    NvmMgr.BlockRead(NvmManager::NVM_LOC_DHCP_LEASE, sizeof(lease),
+                     reinterpret_cast<uint8_t *>(lease));
+    if (!dhcp_supplied_address(netif) && lease[0] == DHCP_LEASE_MAGIC &&
+            lease[1]) {
+        // Request the kept address directly (INIT-REBOOT). If the server
+        // refuses it or does not answer, LwIP falls back to discovery.
+        ip4_addr_set_u32(&m_dhcpData->offered_ip_addr, lease[1]);
+        m_dhcpData->state = DHCP_STATE_REBOOTING;
+        restart = true;
+    }
+#endif
+    if (restart) {
+        dhcp_network_changed(netif);
+    }
+}
+
+void EthernetManager::DhcpUpdate() {
+    if (!m_dhcpAsync) {
+        return;
+    }
+    struct netif *netif = &m_macInterface;
+
+    bool linkUp = m_phyLinkUp;
+    if (linkUp && !m_dhcpLinkUp) {
+        // Retry right away rather than waiting out DHCP's backoff
+        DhcpRequest(true);
+    }
+    m_dhcpLinkUp = linkUp;
+
+    DhcpStatus status;
+    if (dhcp_supplied_address(netif)) {
+        status = DHCP_STATUS_BOUND;
+        if (m_dhcpStatus != DHCP_STATUS_BOUND) {
+            m_dhcpLeasePending = netif_ip4_addr(netif)->addr;
+        }
+        if (m_dhcpFallbackActive) {
+            // A server answered; AutoIP leaves the server's address alone
+            m_dhcpFallbackActive = false;
+            autoip_stop(netif);
+        }
+    }
+    else {
+        if (m_dhcpStatus == DHCP_STATUS_BOUND) {
+            // The lease was lost; start timing a new search
+            m_dhcpSearchStartMs = Milliseconds();
+        }
+        if (!m_dhcpFallbackActive && m_dhcpFallbackMs &&
+                Milliseconds() - m_dhcpSearchStartMs >= m_dhcpFallbackMs) {
+            m_dhcpFallbackActive = true;
+            if (uint32_t(m_dhcpFallbackIp)) {
+                ip4_addr_t ip = {uint32_t(m_dhcpFallbackIp)};
+                ip4_addr_t netmask = {uint32_t(m_dhcpFallbackNetmask)};
+                ip4_addr_t gateway = {uint32_t(m_dhcpFallbackGateway)};
+                netif_set_addr(netif, &ip, &netmask, &gateway);
+            }
+            else {
+                autoip_start(netif);
+            }
+        }
+        if (!m_dhcpFallbackActive) {
+            status = DHCP_STATUS_SEARCHING;
+        }
+        else if (uint32_t(m_dhcpFallbackIp)) {
+            status = DHCP_STATUS_STATIC;
+        }
+        else {
+            // AutoIP probes for a free address before taking it
+            status = autoip_supplied_address(netif) ? DHCP_STATUS_AUTOIP :
+                     DHCP_STATUS_SEARCHING;
+        }
+    }
+    if (!linkUp) {
+        status = DHCP_STATUS_LINK_DOWN;
+    }
+
+    if (status != m_dhcpStatus) {
+        m_dhcpStatus = status;
+        if (m_dhcpCallback) {
+            m_dhcpCallback(status);
+        }
+    }
+}
+
+void EthernetManager::DhcpLeaseSave() {
+    uint32_t address = atomic_exchange_n(&m_dhcpLeasePending, 0);
+#if DHCP_LEASE_CACHE
+    if (address) {
+        // Only a changed lease reaches the flash
+        uint32_t lease[2] = {DHCP_LEASE_MAGIC, address};
+        NvmMgr.CacheWriteAsync(NvmManager::NVM_LOC_DHCP_LEASE, sizeof(lease),
+                               reinterpret_cast<const uint8_t *>(lease),
+                               NULL);
+    }
+#else
+    (void)address;
+#endif
+}
+
 void EthernetManager::Setup() {
     // Setup can only occur once.
     if (m_ethernetActive) {
         return;
     }
+    EthernetServiceLock lock;
     lwip_init();
     dns_init();
     NetifInit();
     m_ethernetActive = true;
+    NetworkStatsReset();
 }
 
 void EthernetManager::Refresh() {
+    TRACE_EVENT(TRACE_ETHERNET_REFRESH, 0);
+    if (m_dhcpLeasePending) {
+        DhcpLeaseSave();
+    }
+    if (m_eventDriven) {
+        // The service interrupt does the work as soon as it is unlocked.
+        NVIC_SetPendingIRQ(ETHERNET_SERVICE_IRQn);
+        return;
+    }
+    Service();
+}
+
+void EthernetManager::Service() {
     while (true) {
         // Check for an available packet.
         struct pbuf *packet = low_level_input(&m_macInterface);
@@ -465,7 +859,27 @@ void EthernetManager::Refresh() {
         // Send the packet as input to LwIP.
         ethernetif_input(&m_macInterface, packet);
     }
+#if ETHERNET_TX_ZERO_COPY
+    // Release the pbufs of transmitted frames so LwIP may reuse them.
+    PacketReap(&m_ethernetInterface);
+#endif
     sys_check_timeouts();
+    DhcpUpdate();
+
+    if (m_eventDriven) {
+        TimeoutSchedule();
+    }
+}
+
+void EthernetManager::TimeoutSchedule() {
+    // Have the SysTick update pend the service interrupt when the next LwIP
+    // timeout is due.
+    m_timeoutPending = false;
+    uint32_t sleepMs = sys_timeouts_sleeptime();
+    if (sleepMs != SYS_TIMEOUTS_SLEEPTIME_INFINITE) {
+        m_timeoutDueMs = Milliseconds() + sleepMs;
+        m_timeoutPending = true;
+    }
 }
 
 } // ClearCore namespace
\ No newline at end of file
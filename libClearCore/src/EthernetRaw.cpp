@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    ClearCore raw Ethernet frame channel
+**/
+
+#include "EthernetRaw.h"
+#include "EthernetManager.h"
+
+namespace ClearCore {
+
+extern EthernetManager &EthernetMgr;
+
+// The Ethernet header ahead of the payload: destination, source, EtherType
+#define RAW_HEADER_SRC_OFFSET 6
+#define RAW_HEADER_LENGTH 14
+
+EthernetRaw::EthernetRaw(uint16_t etherType)
+    : m_etherType(etherType),
+      m_callback(nullptr),
+      m_open(false) {}
+
+bool EthernetRaw::Begin(ReceiveCallback callback) {
+#if ETHERNET_RAW_MAX
+    if (m_open || !callback) {
+        return false;
+    }
+    m_callback = callback;
+    m_open = EthernetMgr.RawRegister(m_etherType, FrameReceived, this);
+    return m_open;
+#else
+    (void)callback;
+    return false;
+#endif
+}
+
+void EthernetRaw::End() {
+#if ETHERNET_RAW_MAX
+    if (m_open) {
+        EthernetMgr.RawUnregister(m_etherType);
+        m_open = false;
+    }
+#endif
+}
+
+bool EthernetRaw::Send(const uint8_t *destMac, const uint8_t *payload,
+                       uint16_t length) {
+#if ETHERNET_RAW_MAX
+    if (!m_open || !destMac || (length && !payload)) {
+        return false;
+    }
+    return EthernetMgr.RawSend(destMac, m_etherType, payload, length);
+#else
+    (void)destMac;
+    (void)payload;
+    (void)length;
+    return false;
+#endif
+}
+
+void EthernetRaw::FrameReceived(void *arg, const uint8_t *frame,
+                                uint16_t length) {
+    EthernetRaw *channel = static_cast<EthernetRaw *>(arg);
+    if (length < RAW_HEADER_LENGTH) {
+        return;
+    }
+    channel->m_callback(frame + RAW_HEADER_SRC_OFFSET,
+                        frame + RAW_HEADER_LENGTH,
+                        length - RAW_HEADER_LENGTH);
+}
+
+} // ClearCore namespace
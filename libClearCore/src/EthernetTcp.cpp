@@ -21,7 +21,9 @@
  */
 
 #include "EthernetTcp.h"
+#include "EthernetTcpServer.h"
 #include "lwip/tcp.h"
+#include "lwip/timeouts.h"
 #include <stdlib.h>
 
 namespace ClearCore {
@@ -45,12 +47,12 @@ uint16_t EthernetTcp::LocalPort() {
     Allows a TCP server to accept clients.
 **/
 err_t TcpAccept(void *arg, struct tcp_pcb *newpcb, err_t err) {
-    EthernetTcp::TcpData **tcpClientData = (EthernetTcp::TcpData **)arg;
+    EthernetTcpServer *server = (EthernetTcpServer *)arg;
 
     // Set the priority for the new TCP connection. Make this higher than min?
     tcp_setprio(newpcb, TCP_PRIO_MIN);
 
-    if ((tcpClientData == nullptr) || (err != ERR_OK)) {
+    if ((server == nullptr) || (err != ERR_OK)) {
         // Either the client PCBs could not be allocated or there was another
         // error that occurred during TCP connection setup.
         tcp_close(newpcb);
@@ -66,23 +68,10 @@ err_t TcpAccept(void *arg, struct tcp_pcb *newpcb, err_t err) {
 
     clientData->pcb = newpcb;
     clientData->state = ESTABLISHED;
+#if !TCP_RX_PBUF_QUEUE
+    clientData->dataRing.Storage(clientData->data, TCP_DATA_BUFFER_SIZE);
+#endif
 
-    bool accepted = false;
-
-    // Look for an open 'socket' to allow the client to connect to the server.
-    for (uint8_t iClient = 0; iClient < CLIENT_MAX; iClient++) {
-        if (tcpClientData[iClient] == nullptr) {
-            tcpClientData[iClient] = clientData;
-            accepted = true;
-            break;
-        }
-    }
-
-    if (!accepted) {
-        TcpClose(newpcb, clientData);
-        free(clientData);
-        return ERR_MEM;
-    }
     tcp_nagle_disable(newpcb);
 
     tcp_arg(newpcb, clientData);
@@ -90,6 +79,13 @@ err_t TcpAccept(void *arg, struct tcp_pcb *newpcb, err_t err) {
     tcp_err(newpcb, TcpError);
     tcp_sent(newpcb, TcpSend);
 
+    // Look for an open 'socket' to allow the client to connect to the server.
+    if (!server->ClientAdd(clientData)) {
+        TcpClose(newpcb, clientData);
+        TcpDataFree(clientData);
+        return ERR_MEM;
+    }
+
     return ERR_OK;
 }
 
@@ -133,6 +129,9 @@ void TcpError(void *arg, err_t err) {
     // At this point the TCP PCB is already free'd.
     data->pcb = nullptr;
     data->state = CLOSING;
+    if (data->server != nullptr) {
+        data->server->ClientReady(data);
+    }
 }
 
 /**
@@ -152,6 +151,9 @@ err_t TcpReceive(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err) {
     // A NULL pbuf indicates that the remote host closed the connection.
     if (p == NULL) {
         TcpClose(tpcb, tcpClientData);
+        if (tcpClientData->server != nullptr) {
+            tcpClientData->server->ClientReady(tcpClientData);
+        }
         return ERR_OK;
     }
     // If return anything other than ERR_OK or ERR_ABRT, must NOT free pbuf.
@@ -159,35 +161,44 @@ err_t TcpReceive(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err) {
         return err;
     }
     if (tcpClientData->state == ESTABLISHED) {
+#if TCP_RX_PBUF_QUEUE
+        // Queue the packet as is; the window reopens as it is read.
+        if (tcpClientData->rxQueue == nullptr) {
+            tcpClientData->rxQueue = p;
+        }
+        else {
+            pbuf_cat(tcpClientData->rxQueue, p);
+        }
+        if (tcpClientData->server != nullptr) {
+            tcpClientData->server->ClientReady(tcpClientData);
+        }
+        return ERR_OK;
+#else
         // Only copy the packet's payload if we have enough empty space to copy
         // every byte.
-        int32_t availableToRead =
-            tcpClientData->dataTail - tcpClientData->dataHead;
-        if (availableToRead  < 0) {
-            availableToRead += TCP_DATA_BUFFER_SIZE;
-        }
-        if (TCP_DATA_BUFFER_SIZE - availableToRead < p->tot_len) {
+        RingBuffer<uint8_t> &ring = tcpClientData->dataRing;
+        if (ring.Space() < p->tot_len) {
             return ERR_BUF;
         }
-        // Put received packet into the buffer.
+        // Copy the packet into the free space in place, in up to two parts.
+        RingBuffer<uint8_t>::Span first, second;
+        ring.WriteSpans(first, second);
         uint16_t bytesReceived = p->tot_len;
-        for (uint16_t i = 0; i < bytesReceived; i++) {
-            uint16_t nextIndex = (tcpClientData->dataTail + 1) %
-                                 TCP_DATA_BUFFER_SIZE;
-            // If the buffer is full drop the rest
-            if (nextIndex == tcpClientData->dataHead) {
-                bytesReceived = i;
-                break;
-            }
-            // If the buffer is not full, save the value
-            tcpClientData->data[tcpClientData->dataTail] = pbuf_get_at(p, i);
-            tcpClientData->dataTail = nextIndex;
-        }
+        uint16_t firstLength =
+            (bytesReceived < first.Length) ? bytesReceived : first.Length;
+        pbuf_copy_partial(p, first.Data, firstLength, 0);
+        pbuf_copy_partial(p, second.Data, bytesReceived - firstLength,
+                          firstLength);
+        ring.WriteCommit(bytesReceived);
         // Acknowledge the data was received.
         tcp_recved(tcpClientData->pcb, bytesReceived);
         // Must free the pbuf
         pbuf_free(p);
+        if (tcpClientData->server != nullptr) {
+            tcpClientData->server->ClientReady(tcpClientData);
+        }
         return ERR_OK;
+#endif
     }
     // If we got this far, we've received a non-empty frame without error,
     // but there's no established TCP connection.
@@ -210,6 +221,39 @@ err_t TcpSend(void *arg, struct tcp_pcb *tpcb, u16_t len) {
     return ERR_OK;
 }
 
+/**
+    Sends the data a coalescing TCP connection has held back too long.
+**/
+static void TcpCoalesceTimeout(void *arg) {
+    EthernetTcp::TcpData *data = (EthernetTcp::TcpData *)arg;
+    data->coalesced = 0;
+    if (data->pcb != nullptr) {
+        tcp_output(data->pcb);
+    }
+}
+
+err_t TcpOutput(EthernetTcp::TcpData *data, uint16_t written, bool hold) {
+    if (hold && data->coalesceBytes != 0) {
+        // The first write held back starts the clock on the whole batch.
+        if (data->coalesced == 0 && data->coalesceMs != 0) {
+            sys_timeout(data->coalesceMs, TcpCoalesceTimeout, data);
+        }
+        uint32_t coalesced = data->coalesced + written;
+        data->coalesced = (coalesced < UINT16_MAX) ? coalesced : UINT16_MAX;
+        if (coalesced < data->coalesceBytes) {
+            return ERR_OK;
+        }
+    }
+    if (data->coalesced != 0) {
+        sys_untimeout(TcpCoalesceTimeout, data);
+        data->coalesced = 0;
+    }
+    if (data->pcb == nullptr) {
+        return ERR_CONN;
+    }
+    return tcp_output(data->pcb);
+}
+
 /**
     Closes a TCP connection.
 **/
@@ -231,4 +275,22 @@ void TcpClose(struct tcp_pcb *pcb, EthernetTcp::TcpData *data) {
     }
 }
 
+void TcpDataFree(EthernetTcp::TcpData *data) {
+    if (data == nullptr) {
+        return;
+    }
+    if (data->coalesced != 0) {
+        sys_untimeout(TcpCoalesceTimeout, data);
+    }
+    if (data->server != nullptr) {
+        data->server->ClientRemove(data);
+    }
+#if TCP_RX_PBUF_QUEUE
+    if (data->rxQueue != nullptr) {
+        pbuf_free(data->rxQueue);
+    }
+#endif
+    free(data);
+}
+
 } // ClearCore namespace
\ No newline at end of file
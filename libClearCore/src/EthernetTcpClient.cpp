@@ -24,6 +24,7 @@
 
 #include "EthernetManager.h"
 #include "EthernetTcp.h"
+#include "lwip/dns.h"
 #include "SysTiming.h"
 #include "SysUtils.h"
 #include <stdlib.h>
@@ -35,14 +36,125 @@ extern EthernetManager &EthernetMgr;
 EthernetTcpClient::EthernetTcpClient()
     : EthernetTcp(),
       m_connectionTimeout(2000),
-      m_dnsInitialized(false) {}
+      m_dnsInitialized(false),
+      m_connectState(CONNECT_IDLE),
+      m_connectCallback(nullptr),
+      m_connectStartMs(0),
+      m_connectPort(0) {}
 
 EthernetTcpClient::EthernetTcpClient(TcpData *tcpData)
     : EthernetTcp(tcpData),
       m_connectionTimeout(2000),
-      m_dnsInitialized(false) {}
+      m_dnsInitialized(false),
+      m_connectState(CONNECT_IDLE),
+      m_connectCallback(nullptr),
+      m_connectStartMs(0),
+      m_connectPort(0) {}
 
 bool EthernetTcpClient::Connect(IpAddress ip, uint16_t port) {
+    if (m_connectState == CONNECT_RESOLVING ||
+            m_connectState == CONNECT_CONNECTING) {
+        // A nonblocking connect is in progress.
+        return false;
+    }
+    if (!ConnectBegin(ip, port)) {
+        return false;
+    }
+
+    SysTiming::LoopBlockMarker marker(SysTiming::LOOP_BLOCK_TCP_CONNECT);
+    uint32_t start = Milliseconds();
+    while (m_tcpData->state == CLOSED) {
+        EthernetMgr.Refresh();
+        uint32_t elapsed = Milliseconds() - start;
+        // Timeout for connection established.
+        if ((elapsed > m_connectionTimeout) || (m_tcpData->state == CLOSING)) {
+            Close();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool EthernetTcpClient::ConnectAsync(IpAddress ip, uint16_t port,
+                                     ConnectCallback callback) {
+    if (m_connectState == CONNECT_RESOLVING ||
+            m_connectState == CONNECT_CONNECTING) {
+        return false;
+    }
+    if (!ConnectBegin(ip, port)) {
+        return false;
+    }
+    m_connectCallback = callback;
+    m_connectStartMs = Milliseconds();
+    m_connectState = CONNECT_CONNECTING;
+    return true;
+}
+
+bool EthernetTcpClient::ConnectAsync(const char *host, uint16_t port,
+                                     ConnectCallback callback) {
+    if (host == nullptr || m_connectState == CONNECT_RESOLVING ||
+            m_connectState == CONNECT_CONNECTING ||
+            (m_tcpData != nullptr && Connected())) {
+        return false;
+    }
+
+    ip_addr_t ipaddr;
+    err_t err;
+    // Allow a hostname to be a string of an IP Address.
+    if (ipaddr_aton(host, &ipaddr) == 1) {
+        err = ERR_OK;
+    }
+    else {
+        m_connectPort = port;
+        // Set before the lookup; the callback may run as soon as the lock
+        // is released.
+        m_connectState = CONNECT_RESOLVING;
+        EthernetServiceLock lock;
+        err = dns_gethostbyname(host, &ipaddr, ConnectResolved, this);
+    }
+
+    if (err == ERR_OK) {
+        // Known address or a cached lookup; connect right away.
+        m_connectState = CONNECT_IDLE;
+        return ConnectAsync(IpAddress(ip4_addr_get_u32(&ipaddr)), port,
+                            callback);
+    }
+    if (err != ERR_INPROGRESS) {
+        m_connectState = CONNECT_IDLE;
+        return false;
+    }
+    m_connectCallback = callback;
+    m_connectStartMs = Milliseconds();
+    return true;
+}
+
+EthernetTcpClient::ConnectState EthernetTcpClient::ConnectStatus() {
+    if (m_connectState == CONNECT_CONNECTING) {
+        tcp_state state = m_tcpData != nullptr ? m_tcpData->state : CLOSING;
+        if (state == ESTABLISHED) {
+            m_connectState = CONNECT_CONNECTED;
+        }
+        else if (state == CLOSING) {
+            ConnectFail();
+        }
+    }
+    if ((m_connectState == CONNECT_RESOLVING ||
+            m_connectState == CONNECT_CONNECTING) &&
+            Milliseconds() - m_connectStartMs > m_connectionTimeout) {
+        ConnectFail();
+    }
+
+    ConnectState state = m_connectState;
+    if ((state == CONNECT_CONNECTED || state == CONNECT_FAILED) &&
+            m_connectCallback != nullptr) {
+        ConnectCallback callback = m_connectCallback;
+        m_connectCallback = nullptr;
+        callback(*this, state == CONNECT_CONNECTED);
+    }
+    return state;
+}
+
+bool EthernetTcpClient::ConnectBegin(IpAddress ip, uint16_t port) {
     if (m_tcpData != nullptr && Connected()) {
         // Already connected.
         return false;
@@ -53,11 +165,16 @@ bool EthernetTcpClient::Connect(IpAddress ip, uint16_t port) {
             // Couldn't allocate TCP state.
             return false;
         }
+#if !TCP_RX_PBUF_QUEUE
+        m_tcpData->dataRing.Storage(m_tcpData->data, TCP_DATA_BUFFER_SIZE);
+#endif
     }
 
+    EthernetServiceLock lock;
     m_tcpData->pcb = tcp_new();
     if (m_tcpData->pcb == nullptr) {
-        free(m_tcpData);
+        TcpDataFree(m_tcpData);
+        m_tcpData = nullptr;
         // Couldn't allocate TCP PCB.
         return false;
     }
@@ -74,23 +191,33 @@ bool EthernetTcpClient::Connect(IpAddress ip, uint16_t port) {
         Close();
         return false;
     }
+    return true;
+}
 
-    uint32_t start = Milliseconds();
-    while (m_tcpData->state == CLOSED) {
-        EthernetMgr.Refresh();
-        uint32_t elapsed = Milliseconds() - start;
-        // Timeout for connection established.
-        if ((elapsed > m_connectionTimeout) || (m_tcpData->state == CLOSING)) {
-            Close();
-            free(m_tcpData);
-            m_tcpData = nullptr;
-            return false;
-        }
+void EthernetTcpClient::ConnectFail() {
+    m_connectState = CONNECT_FAILED;
+    Close();
+}
+
+void EthernetTcpClient::ConnectResolved(const char *host,
+                                        const ip_addr_t *ip, void *arg) {
+    (void)host;
+    EthernetTcpClient *client = static_cast<EthernetTcpClient *>(arg);
+    // The lookup may have timed out, or been superseded, before it finished.
+    if (client == nullptr || client->m_connectState != CONNECT_RESOLVING) {
+        return;
     }
-    return true;
+    if (ip == NULL ||
+            !client->ConnectBegin(IpAddress(ip4_addr_get_u32(ip)),
+                                  client->m_connectPort)) {
+        client->m_connectState = CONNECT_FAILED;
+        return;
+    }
+    client->m_connectState = CONNECT_CONNECTING;
 }
 
 bool EthernetTcpClient::Connected() {
+    EthernetServiceLock lock;
     if (m_tcpData == nullptr || m_tcpData->pcb == nullptr) {
         return false;
     }
@@ -104,10 +231,16 @@ int16_t EthernetTcpClient::BytesAvailable() {
     if (m_tcpData == nullptr) {
         return 0;
     }
-    // Calculate the available data in the buffer
-    int32_t difference = m_tcpData->dataTail - m_tcpData->dataHead;
-
-    return (difference < 0) ? TCP_DATA_BUFFER_SIZE + difference : difference;
+#if TCP_RX_PBUF_QUEUE
+    EthernetServiceLock lock;
+    if (m_tcpData->rxQueue == nullptr) {
+        return 0;
+    }
+    uint32_t available = m_tcpData->rxQueue->tot_len - m_tcpData->rxOffset;
+    return min(available, INT16_MAX);
+#else
+    return m_tcpData->dataRing.Count();
+#endif
 }
 
 int16_t EthernetTcpClient::Read() {
@@ -121,23 +254,65 @@ int16_t EthernetTcpClient::Read(uint8_t *dataPtr, uint32_t length) {
         // Not initialized.
         return -1;
     }
-    uint16_t bytesRead = 0;
-    // Read from the TCP's incoming data buffer.
-    while (m_tcpData->dataTail != m_tcpData->dataHead && bytesRead < length) {
-        uint16_t nextIndex = (m_tcpData->dataHead + 1) % TCP_DATA_BUFFER_SIZE;
-        dataPtr[bytesRead++] = m_tcpData->data[m_tcpData->dataHead];
-        m_tcpData->dataHead = nextIndex;
+#if TCP_RX_PBUF_QUEUE
+    EthernetServiceLock lock;
+    if (m_tcpData->rxQueue == nullptr) {
+        return 0;
     }
+    // Read from the TCP's queue of incoming packets.
+    uint16_t bytesRead =
+        pbuf_copy_partial(m_tcpData->rxQueue, dataPtr, min(length, INT16_MAX),
+                          m_tcpData->rxOffset);
+    RxQueueAdvance(bytesRead);
+#else
+    // Read from the TCP's incoming data buffer.
+    uint16_t bytesRead = m_tcpData->dataRing.Read(dataPtr, length);
+#endif
     return bytesRead;
 }
 
 int16_t EthernetTcpClient::Peek() {
-    if (m_tcpData == nullptr || m_tcpData->dataTail == m_tcpData->dataHead) {
+#if TCP_RX_PBUF_QUEUE
+    if (m_tcpData == nullptr) {
+        // Not initialized.
+        return -1;
+    }
+    EthernetServiceLock lock;
+    if (m_tcpData->rxQueue == nullptr) {
+        // No data to read.
+        return -1;
+    }
+    return pbuf_get_at(m_tcpData->rxQueue, m_tcpData->rxOffset);
+#else
+    uint8_t peekChar;
+    if (m_tcpData == nullptr || !m_tcpData->dataRing.Peek(peekChar)) {
         // Not initialized or no data to read.
         return -1;
     }
-    int16_t peekChar = m_tcpData->data[m_tcpData->dataHead];
     return peekChar;
+#endif
+}
+
+int16_t EthernetTcpClient::Peek(uint8_t *dataPtr, uint32_t length) {
+    if (m_tcpData == nullptr) {
+        // Not initialized.
+        return -1;
+    }
+#if TCP_RX_PBUF_QUEUE
+    EthernetServiceLock lock;
+    if (m_tcpData->rxQueue == nullptr) {
+        return 0;
+    }
+    return pbuf_copy_partial(m_tcpData->rxQueue, dataPtr,
+                             min(length, INT16_MAX), m_tcpData->rxOffset);
+#else
+    uint16_t bytesRead = 0;
+    while (bytesRead < length &&
+            m_tcpData->dataRing.Peek(dataPtr[bytesRead], bytesRead)) {
+        bytesRead++;
+    }
+    return bytesRead;
+#endif
 }
 
 void EthernetTcpClient::Flush() {
@@ -145,12 +320,17 @@ void EthernetTcpClient::Flush() {
         // Not initialized or no connection.
         return;
     }
+    SendFlush();
     while (Connected()) {
-        // All outgoing data has been sent when there is nothing unsent and
-        // nothing unacked.
-        if (m_tcpData->pcb->unsent == nullptr &&
-                m_tcpData->pcb->unacked == nullptr) {
-            break;
+        {
+            EthernetServiceLock lock;
+            // All outgoing data has been sent when there is nothing unsent
+            // and nothing unacked.
+            if (m_tcpData->pcb == nullptr ||
+                    (m_tcpData->pcb->unsent == nullptr &&
+                     m_tcpData->pcb->unacked == nullptr)) {
+                break;
+            }
         }
         EthernetMgr.Refresh();
     }
@@ -160,24 +340,71 @@ void EthernetTcpClient::FlushInput() {
     if (m_tcpData == nullptr) {
         return;
     }
-    m_tcpData->dataHead = 0;
-    m_tcpData->dataTail = 0;
+#if TCP_RX_PBUF_QUEUE
+    EthernetServiceLock lock;
+    if (m_tcpData->rxQueue != nullptr) {
+        RxQueueAdvance(m_tcpData->rxQueue->tot_len - m_tcpData->rxOffset);
+    }
+#else
+    m_tcpData->dataRing.ReadCommit(m_tcpData->dataRing.Count());
+#endif
 }
 
+#if TCP_RX_PBUF_QUEUE
+void EthernetTcpClient::RxQueueAdvance(uint16_t bytes) {
+    m_tcpData->rxOffset += bytes;
+    // Free the packets that have been read completely.
+    struct pbuf *packet = m_tcpData->rxQueue;
+    while (packet != nullptr && m_tcpData->rxOffset >= packet->len) {
+        m_tcpData->rxOffset -= packet->len;
+        struct pbuf *next = packet->next;
+        if (next != nullptr) {
+            // Keep the rest of the chain when the head is freed.
+            pbuf_ref(next);
+        }
+        pbuf_free(packet);
+        packet = next;
+    }
+    m_tcpData->rxQueue = packet;
+    // Reopen the receive window by the amount read.
+    if (m_tcpData->pcb != nullptr && bytes != 0) {
+        tcp_recved(m_tcpData->pcb, bytes);
+    }
+}
+#endif
+
 void EthernetTcpClient::Close() {
+    if (m_connectState == CONNECT_RESOLVING ||
+            m_connectState == CONNECT_CONNECTING) {
+        // Abandon a nonblocking connect; a pending lookup is ignored.
+        m_connectState = CONNECT_IDLE;
+        m_connectCallback = nullptr;
+    }
     if (m_tcpData == nullptr) {
         // No connection, nothing to do.
         return;
     }
     // Close the TCP connection with FIN.
-    if (m_tcpData->state != CLOSING) {
-        TcpClose(m_tcpData->pcb, m_tcpData);
+    {
+        EthernetServiceLock lock;
+        if (m_tcpData->state != CLOSING) {
+            TcpClose(m_tcpData->pcb, m_tcpData);
+        }
     }
-    free(m_tcpData);
+    TcpDataFree(m_tcpData);
     m_tcpData = nullptr;
 }
 
 uint32_t EthernetTcpClient::Send(const uint8_t *buffer, uint32_t size) {
+    return SendData(buffer, size, TCP_WRITE_FLAG_COPY);
+}
+
+uint32_t EthernetTcpClient::SendNoCopy(const uint8_t *buffer, uint32_t size) {
+    return SendData(buffer, size, 0);
+}
+
+uint32_t EthernetTcpClient::SendData(const uint8_t *buffer, uint32_t size,
+                                     uint8_t flags) {
     if (m_tcpData == nullptr || m_tcpData->pcb == nullptr ||
             size == 0 || buffer == nullptr) {
         // State hasn't been initialized or requested zero bytes.
@@ -189,24 +416,33 @@ uint32_t EthernetTcpClient::Send(const uint8_t *buffer, uint32_t size) {
         return 0;
     }
 
-    // Check the # of bytes available in the TCP send buffer.
-    uint32_t bufferAvailable = tcp_sndbuf(m_tcpData->pcb);
-    uint32_t bytesToWrite = min(bufferAvailable, size);
-    err_t err = tcp_write(m_tcpData->pcb, buffer, bytesToWrite,
-                          TCP_WRITE_FLAG_COPY);
+    uint32_t bytesToWrite;
+    {
+        EthernetServiceLock lock;
+        if (m_tcpData->pcb == nullptr) {
+            return 0;
+        }
+        // Check the # of bytes available in the TCP send buffer.
+        uint32_t bufferAvailable = tcp_sndbuf(m_tcpData->pcb);
+        bytesToWrite = min(bufferAvailable, size);
+        err_t err = tcp_write(m_tcpData->pcb, buffer, bytesToWrite, flags);
 
-    if (err != ERR_OK) {
-        return 0;
-    }
-    // Initiate output immediately.
-    err = tcp_output(m_tcpData->pcb);
-    if (err != ERR_OK) {
-        return 0;
+        if (err != ERR_OK) {
+            return 0;
+        }
+        // Initiate output immediately, unless coalescing and there is still
+        // room to hold the data back.
+        bool hold = bytesToWrite == size &&
+                    m_tcpData->pcb->snd_queuelen < TCP_SND_QUEUELEN >> 1;
+        err = TcpOutput(m_tcpData, bytesToWrite, hold);
+        if (err != ERR_OK) {
+            return 0;
+        }
     }
     // Avoid filling the send queue.
     uint32_t TCP_SEND_TIMEOUT_MS = 5;
     uint32_t startMs = Milliseconds();
-    while (m_tcpData->pcb->snd_queuelen >= TCP_SND_QUEUELEN >> 1) {
+    while (SendQueueFull()) {
         if (Milliseconds() - startMs >= TCP_SEND_TIMEOUT_MS) {
             break;
         }
@@ -215,6 +451,62 @@ uint32_t EthernetTcpClient::Send(const uint8_t *buffer, uint32_t size) {
     return bytesToWrite;
 }
 
+bool EthernetTcpClient::SendCoalesce(uint16_t flushBytes, uint16_t flushMs) {
+    if (m_tcpData == nullptr || m_tcpData->pcb == nullptr) {
+        return false;
+    }
+    EthernetServiceLock lock;
+    m_tcpData->coalesceBytes = min(flushBytes, TCP_SND_BUF);
+    m_tcpData->coalesceMs = flushMs;
+    if (flushBytes == 0) {
+        TcpOutput(m_tcpData, 0, false);
+    }
+    return true;
+}
+
+void EthernetTcpClient::SendFlush() {
+    if (m_tcpData == nullptr) {
+        return;
+    }
+    EthernetServiceLock lock;
+    TcpOutput(m_tcpData, 0, false);
+}
+
+bool EthernetTcpClient::NoDelay(bool noDelay) {
+    if (m_tcpData == nullptr) {
+        return false;
+    }
+    EthernetServiceLock lock;
+    if (m_tcpData->pcb == nullptr) {
+        return false;
+    }
+    if (noDelay) {
+        tcp_nagle_disable(m_tcpData->pcb);
+    }
+    else {
+        tcp_nagle_enable(m_tcpData->pcb);
+    }
+    return true;
+}
+
+uint32_t EthernetTcpClient::SendSpace() {
+    if (m_tcpData == nullptr || m_tcpData->state != ESTABLISHED) {
+        return 0;
+    }
+    EthernetServiceLock lock;
+    if (m_tcpData->pcb == nullptr ||
+            m_tcpData->pcb->snd_queuelen >= TCP_SND_QUEUELEN >> 1) {
+        return 0;
+    }
+    return tcp_sndbuf(m_tcpData->pcb);
+}
+
+bool EthernetTcpClient::SendQueueFull() {
+    EthernetServiceLock lock;
+    return m_tcpData->pcb != nullptr &&
+           m_tcpData->pcb->snd_queuelen >= TCP_SND_QUEUELEN >> 1;
+}
+
 uint16_t EthernetTcpClient::RemotePort() {
     if (m_tcpData == nullptr || m_tcpData->pcb == nullptr) {
         return 0;
@@ -28,13 +28,16 @@ namespace ClearCore {
 extern EthernetManager &EthernetMgr;
 
 EthernetTcpServer::EthernetTcpServer(uint16_t port)
-    : EthernetTcp(), m_initialized(false), m_serverPort(port) {
+    : EthernetTcp(), m_initialized(false), m_serverPort(port),
+      m_readyHead(nullptr), m_readyTail(nullptr),
+      m_acceptedCallback(nullptr), m_dataCallback(nullptr) {
     for (uint8_t i = 0; i < CLIENT_MAX; i++) {
         m_tcpDataClient[i] = nullptr;
     }
 }
 
 void EthernetTcpServer::Begin() {
+    EthernetServiceLock lock;
     if (m_tcpData == nullptr) {
         // Allocate
         m_tcpData = static_cast<TcpData *>(calloc(1, sizeof(TcpData)));
@@ -51,8 +54,8 @@ void EthernetTcpServer::Begin() {
     }
     tcp_nagle_disable((m_tcpData->pcb));
 
-    // Pass the server's TCP clients array to server TCP callbacks.
-    tcp_arg(m_tcpData->pcb, &m_tcpDataClient);
+    // Pass the server to the server TCP callbacks.
+    tcp_arg(m_tcpData->pcb, this);
 
     // Bind the PCB to the local IP address and port.
     ip_addr_t ip = IPADDR4_INIT(uint32_t(EthernetMgr.LocalIp()));
@@ -78,27 +81,30 @@ void EthernetTcpServer::Begin() {
 // when data has been received from the client and is available for reading.
 EthernetTcpClient EthernetTcpServer::Available() {
     EthernetMgr.Refresh();
+    EthernetServiceLock lock;
     EthernetTcpClient client;
 
-    for (uint8_t iClient = 0; iClient < CLIENT_MAX; iClient++) {
-        TcpData *clientData = m_tcpDataClient[iClient];
-        if (clientData == nullptr) {
-            continue;
-        }
-
+    // Only the clients that received data or disconnected need a look.
+    while (m_readyHead != nullptr) {
+        TcpData *clientData = m_readyHead;
         client = EthernetTcpClient(clientData);
 
-        // Clean out stale/old/'disconnected' references.
-        if (!client.Connected() && client.BytesAvailable() == 0) {
-            free(clientData);
-            m_tcpDataClient[iClient] = nullptr;
-            continue;
-        }
-
-        // Return a client with available incoming data.
+        // Return a client with available incoming data. It stays first in
+        // line until its data has been read.
         if (client.BytesAvailable()) {
             return client;
         }
+
+        m_readyHead = clientData->readyNext;
+        if (m_readyHead == nullptr) {
+            m_readyTail = nullptr;
+        }
+        clientData->ready = false;
+
+        // Clean out stale/old/'disconnected' references.
+        if (!client.Connected()) {
+            TcpDataFree(clientData);
+        }
     }
 
     // No clients available. Return a default client with no TCP state.
@@ -110,6 +116,7 @@ EthernetTcpClient EthernetTcpServer::Available() {
 // Then, the user is responsible for keeping track of connected clients.
 EthernetTcpClient EthernetTcpServer::Accept() {
     EthernetMgr.Refresh();
+    EthernetServiceLock lock;
     EthernetTcpClient client;
 
     for (uint8_t iClient = 0; iClient < CLIENT_MAX; iClient++) {
@@ -123,13 +130,12 @@ EthernetTcpClient EthernetTcpServer::Accept() {
 
         // Clean out stale/old/'disconnected' references.
         if (!client.Connected()) {
-            free(clientData);
-            m_tcpDataClient[iClient] = nullptr;
+            TcpDataFree(clientData);
             continue;
         }
 
         // Return any valid client.
-        m_tcpDataClient[iClient] = nullptr;
+        ClientRemove(clientData);
         return client;
     }
 
@@ -154,6 +160,65 @@ uint32_t EthernetTcpServer::Send(const uint8_t *buff, uint32_t size) {
     return size;
 }
 
+bool EthernetTcpServer::ClientAdd(TcpData *data) {
+    for (uint8_t iClient = 0; iClient < CLIENT_MAX; iClient++) {
+        if (m_tcpDataClient[iClient] == nullptr) {
+            m_tcpDataClient[iClient] = data;
+            data->server = this;
+            if (m_acceptedCallback) {
+                m_acceptedCallback(EthernetTcpClient(data));
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+void EthernetTcpServer::ClientReady(TcpData *data) {
+    if (!data->ready) {
+        data->ready = true;
+        data->readyNext = nullptr;
+        if (m_readyTail != nullptr) {
+            m_readyTail->readyNext = data;
+        }
+        else {
+            m_readyHead = data;
+        }
+        m_readyTail = data;
+    }
+    if (m_dataCallback) {
+        m_dataCallback(EthernetTcpClient(data));
+    }
+}
+
+void EthernetTcpServer::ClientRemove(TcpData *data) {
+    EthernetServiceLock lock;
+    if (data->ready) {
+        TcpData *prev = nullptr;
+        TcpData *entry = m_readyHead;
+        while (entry != data) {
+            prev = entry;
+            entry = entry->readyNext;
+        }
+        if (prev != nullptr) {
+            prev->readyNext = data->readyNext;
+        }
+        else {
+            m_readyHead = data->readyNext;
+        }
+        if (m_readyTail == data) {
+            m_readyTail = prev;
+        }
+        data->ready = false;
+    }
+    for (uint8_t iClient = 0; iClient < CLIENT_MAX; iClient++) {
+        if (m_tcpDataClient[iClient] == data) {
+            m_tcpDataClient[iClient] = nullptr;
+        }
+    }
+    data->server = nullptr;
+}
+
 bool EthernetTcpServer::Ready() {
     bool full = true;
     for (uint8_t iClient = 0; iClient < CLIENT_MAX; iClient++) {
@@ -22,11 +22,24 @@
 
 #include "EthernetUdp.h"
 #include "EthernetManager.h"
+#include "SecureChannel.h"
+#include "lwip/igmp.h"
 
 namespace ClearCore {
 
 extern EthernetManager &EthernetMgr;
 
+/**
+    Discard the oldest datagram in the receive queue.
+**/
+static void UdpDropOldest(EthernetUdp::UdpData *data) {
+    EthernetUdp::UdpDatagram &datagram = data->queue[data->head];
+    pbuf_free(datagram.packet);
+    datagram.packet = nullptr;
+    data->head = (data->head + 1) % UDP_RX_QUEUE_MAX;
+    data->count--;
+}
+
 EthernetUdp::EthernetUdp():
     m_udpData({}),
           m_udpLocalPort(0),
@@ -40,9 +53,19 @@ EthernetUdp::EthernetUdp():
           m_initialized(false),
           m_packetBegun(false),
           m_packetReadyToSend(false),
-m_packetParsed(false) { }
+          m_packetParsed(false),
+          m_batch(),
+          m_batchCount(0),
+          m_batchSize(0),
+          m_batchQueue(),
+          m_batchQueued(0),
+          m_batchOpen(-1),
+          m_secure(nullptr) {
+    m_udpData.depth = 1;
+}
 
-bool EthernetUdp::Begin(uint16_t localPort) {
+bool EthernetUdp::Begin(uint16_t localPort, uint8_t batchCount,
+                        uint16_t batchSize) {
     if (m_initialized) {
         // Already initialized, nothing to do.
         return false;
@@ -50,9 +73,12 @@ bool EthernetUdp::Begin(uint16_t localPort) {
 
     m_udpLocalPort = localPort;
 
+    EthernetServiceLock lock;
     // Set up the UDP state to pass to lwIP callbacks.
     m_udpData.pcb = udp_new();
-    m_udpData.available = 0;
+    m_udpData.head = 0;
+    m_udpData.count = 0;
+    m_udpData.overflowCount = 0;
     m_udpBytesAvailable = 0;
 
     ip_addr_t ip = IPADDR4_INIT(uint32_t(EthernetMgr.LocalIp()));
@@ -63,6 +89,12 @@ bool EthernetUdp::Begin(uint16_t localPort) {
         return false;
     }
 
+    if (!BatchReserve(batchCount, batchSize)) {
+        udp_remove(m_udpData.pcb);
+        m_udpData.pcb = nullptr;
+        return false;
+    }
+
     // Register the callback function upon receiving a UDP packet.
     udp_recv(m_udpData.pcb, UdpReceive, &m_udpData);
 
@@ -80,6 +112,7 @@ void EthernetUdp::End() {
         return;
     }
 
+    EthernetServiceLock lock;
     if (m_udpData.pcb != nullptr) {
         // Remove the remote end of the PCB.
         udp_disconnect(m_udpData.pcb);
@@ -88,13 +121,11 @@ void EthernetUdp::End() {
         m_udpData.pcb = nullptr;
     }
 
-    if (m_udpData.packet != nullptr) {
-        // Free the packet. Since there may be several packets chained together,
-        pbuf_free(m_udpData.packet);
+    // Free the queued datagrams, keeping the queue settings.
+    while (m_udpData.count) {
+        UdpDropOldest(&m_udpData);
     }
 
-    m_udpData = {};
-
     if (m_incomingPacket != nullptr) {
         pbuf_free(m_incomingPacket);
         m_incomingPacket = nullptr;
@@ -105,6 +136,8 @@ void EthernetUdp::End() {
         m_outgoingPacket = nullptr;
     }
 
+    BatchRelease();
+
     m_udpLocalPort = 0;
     m_udpRemoteIpReceived = IpAddress();
     m_udpRemotePortReceived = 0;
@@ -132,17 +165,185 @@ bool EthernetUdp::Connect(IpAddress ip, uint16_t port) {
     return m_packetBegun;
 }
 
+bool EthernetUdp::MulticastJoin(IpAddress group) {
+    ip4_addr_t groupIp = IPADDR4_INIT(uint32_t(group));
+    if (!m_initialized || !ip4_addr_ismulticast(&groupIp)) {
+        return false;
+    }
+    EthernetServiceLock lock;
+    // Packets sent to the group are addressed to the group rather than the
+    // local IP, so accept any destination address on the local port.
+    if (udp_bind(m_udpData.pcb, IP4_ADDR_ANY, m_udpLocalPort) != ERR_OK) {
+        return false;
+    }
+    return igmp_joingroup_netif(EthernetMgr.MacInterface(), &groupIp) ==
+           ERR_OK;
+}
+
+bool EthernetUdp::MulticastLeave(IpAddress group) {
+    ip4_addr_t groupIp = IPADDR4_INIT(uint32_t(group));
+    if (!m_initialized || !ip4_addr_ismulticast(&groupIp)) {
+        return false;
+    }
+    EthernetServiceLock lock;
+    return igmp_leavegroup_netif(EthernetMgr.MacInterface(), &groupIp) ==
+           ERR_OK;
+}
+
+void EthernetUdp::MulticastTtl(uint8_t ttl) {
+    if (!m_initialized) {
+        return;
+    }
+    udp_set_multicast_ttl(m_udpData.pcb, ttl);
+}
+
+uint8_t *EthernetUdp::BatchPacketBegin() {
+    if (!m_initialized) {
+        return nullptr;
+    }
+    if (m_batchOpen >= 0) {
+        // The claimed packet hasn't been queued yet; hand it out again.
+        return m_batch[m_batchOpen].payload;
+    }
+
+    EthernetServiceLock lock;
+    for (uint8_t slot = 0; slot < m_batchCount; slot++) {
+        if (!BatchPacketFree(slot)) {
+            continue;
+        }
+        BatchPacket &batch = m_batch[slot];
+        struct pbuf *p = batch.packet;
+        // Strip the headers added by the last send and restore the full
+        // payload length so the application can fill it.
+        pbuf_remove_header(p,
+                           batch.payload - static_cast<uint8_t *>(p->payload));
+        p->len = p->tot_len = m_batchSize;
+        m_batchOpen = slot;
+        return batch.payload;
+    }
+    return nullptr;
+}
+
+bool EthernetUdp::BatchPacketQueue(IpAddress remoteIp, uint16_t remotePort,
+                                   uint16_t size) {
+    if (m_batchOpen < 0 || size > m_batchSize) {
+        return false;
+    }
+    BatchPacket &batch = m_batch[m_batchOpen];
+    batch.packet->len = batch.packet->tot_len = size;
+    batch.remoteIp = remoteIp;
+    batch.remotePort = remotePort;
+    m_batchQueue[m_batchQueued++] = m_batchOpen;
+    m_batchOpen = -1;
+    return true;
+}
+
+uint8_t EthernetUdp::BatchSend() {
+    if (!m_initialized || !m_batchQueued) {
+        return 0;
+    }
+    uint8_t sent = 0;
+    {
+        EthernetServiceLock lock;
+        for (uint8_t i = 0; i < m_batchQueued; i++) {
+            BatchPacket &batch = m_batch[m_batchQueue[i]];
+            ip_addr_t destinationIp = IPADDR4_INIT(uint32_t(batch.remoteIp));
+            // The stack takes its own reference to a packet it holds on to,
+            // so ours stays valid for reuse.
+            if (udp_sendto(m_udpData.pcb, batch.packet, &destinationIp,
+                           batch.remotePort) == ERR_OK) {
+                sent++;
+            }
+        }
+    }
+    m_batchQueued = 0;
+
+    EthernetMgr.Refresh();
+
+    return sent;
+}
+
+bool EthernetUdp::BatchReserve(uint8_t count, uint16_t size) {
+    if (count > UDP_BATCH_MAX || (count && !size)) {
+        return false;
+    }
+    for (m_batchCount = 0; m_batchCount < count; m_batchCount++) {
+        struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, size, PBUF_RAM);
+        if (p == nullptr) {
+            BatchRelease();
+            return false;
+        }
+        m_batch[m_batchCount].packet = p;
+        m_batch[m_batchCount].payload = static_cast<uint8_t *>(p->payload);
+    }
+    m_batchSize = size;
+    m_batchQueued = 0;
+    m_batchOpen = -1;
+    return true;
+}
+
+void EthernetUdp::BatchRelease() {
+    for (uint8_t slot = 0; slot < m_batchCount; slot++) {
+        // The driver may still hold a reference until it has transmitted the
+        // packet; the packet is freed when both are released.
+        pbuf_free(m_batch[slot].packet);
+        m_batch[slot] = BatchPacket();
+    }
+    m_batchCount = 0;
+    m_batchSize = 0;
+    m_batchQueued = 0;
+    m_batchOpen = -1;
+}
+
+bool EthernetUdp::BatchPacketFree(uint8_t slot) {
+    // A packet still referenced by the driver or the ARP queue is in flight
+    if (m_batch[slot].packet->ref != 1) {
+        return false;
+    }
+    for (uint8_t i = 0; i < m_batchQueued; i++) {
+        if (m_batchQueue[i] == slot) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool EthernetUdp::ReceiveQueue(uint8_t depth,
+                               ReceiveOverflowPolicy policy) {
+    if (!depth || depth > UDP_RX_QUEUE_MAX) {
+        return false;
+    }
+    EthernetServiceLock lock;
+    while (m_udpData.count > depth) {
+        UdpDropOldest(&m_udpData);
+        m_udpData.overflowCount++;
+    }
+    m_udpData.depth = depth;
+    m_udpData.dropNewest = policy == RX_DROP_NEWEST;
+    return true;
+}
+
 bool EthernetUdp::PacketSend() {
     if (!m_initialized || !m_packetBegun || !m_packetReadyToSend) {
         return false;
     }
-    // Try to send the outgoing data.
-    ip_addr_t destinationIp = IPADDR4_INIT(uint32_t(m_udpRemoteIpDestination));
-    err_t err = udp_sendto(m_udpData.pcb, m_outgoingPacket,
-                           &destinationIp, m_udpRemotePortDestination);
-
-    // Free the outgoing packet buffer chain.
-    pbuf_free(m_outgoingPacket);
+    err_t err = ERR_MEM;
+    if (m_secure && !PacketSeal()) {
+        // Drop a packet that can't be sealed rather than send it in the clear
+        EthernetServiceLock lock;
+        pbuf_free(m_outgoingPacket);
+    }
+    else {
+        EthernetServiceLock lock;
+        // Try to send the outgoing data.
+        ip_addr_t destinationIp =
+            IPADDR4_INIT(uint32_t(m_udpRemoteIpDestination));
+        err = udp_sendto(m_udpData.pcb, m_outgoingPacket,
+                         &destinationIp, m_udpRemotePortDestination);
+
+        // Free the outgoing packet buffer chain.
+        pbuf_free(m_outgoingPacket);
+    }
     m_outgoingPacket = nullptr;
     m_udpRemoteIpDestination = IpAddress();
     m_udpRemotePortDestination = 0;
@@ -155,6 +356,63 @@ bool EthernetUdp::PacketSend() {
     return err == ERR_OK;
 }
 
+bool EthernetUdp::PacketSeal() {
+    uint16_t length = m_outgoingPacket->tot_len;
+    struct pbuf *sealed;
+    {
+        EthernetServiceLock lock;
+        sealed = pbuf_alloc(PBUF_TRANSPORT, length + SECURE_CHANNEL_OVERHEAD,
+                            PBUF_RAM);
+    }
+    if (sealed == nullptr) {
+        return false;
+    }
+    // Packets built by PacketWrite() are a single buffer
+    if (m_secure->Seal(static_cast<uint8_t *>(m_outgoingPacket->payload),
+                       length, static_cast<uint8_t *>(sealed->payload)) < 0) {
+        EthernetServiceLock lock;
+        pbuf_free(sealed);
+        return false;
+    }
+    EthernetServiceLock lock;
+    pbuf_free(m_outgoingPacket);
+    m_outgoingPacket = sealed;
+    return true;
+}
+
+bool EthernetUdp::PacketOpen(const UdpDatagram *datagram) {
+    // Gather the chain into one buffer and decrypt it in place
+    uint16_t length = m_incomingPacket->tot_len;
+    struct pbuf *plain = pbuf_alloc(PBUF_RAW, length, PBUF_RAM);
+    if (plain != nullptr) {
+        pbuf_copy_partial(m_incomingPacket, plain->payload, length, 0);
+    }
+    pbuf_free(m_incomingPacket);
+    m_incomingPacket = nullptr;
+    if (plain == nullptr) {
+        return false;
+    }
+    uint8_t *payload = static_cast<uint8_t *>(plain->payload);
+    int32_t textLength = m_secure->Open(payload, length, payload);
+    if (textLength < 0) {
+        // Challenge the sender of a message from an unknown session; it
+        // seals for our token from then on
+        uint8_t challenge[SECURE_CHANNEL_CHALLENGE_SIZE];
+        uint16_t challengeLength = m_secure->Challenge(challenge);
+        if (challengeLength &&
+                pbuf_take(plain, challenge, challengeLength) == ERR_OK) {
+            pbuf_realloc(plain, challengeLength);
+            udp_sendto(m_udpData.pcb, plain, &datagram->remoteIp,
+                       datagram->remotePort);
+        }
+        pbuf_free(plain);
+        return false;
+    }
+    pbuf_realloc(plain, textLength);
+    m_incomingPacket = plain;
+    return true;
+}
+
 uint32_t EthernetUdp::PacketWrite(uint8_t c) {
     return PacketWrite(&c, 1);
 }
@@ -179,6 +437,7 @@ uint32_t EthernetUdp::PacketWrite(const uint8_t *buffer, uint32_t size) {
     }
 
     EthernetMgr.Refresh();
+    EthernetServiceLock lock;
 
     if (m_outgoingPacket == nullptr) {
         // Allocate a new pbuf to hold the outgoing data.
@@ -236,42 +495,38 @@ uint32_t EthernetUdp::PacketWrite(const uint8_t *buffer, uint32_t size) {
 
 uint16_t EthernetUdp::PacketParse() {
     EthernetMgr.Refresh();
-    if (!m_initialized || m_udpData.available == 0) {
+    EthernetServiceLock lock;
+    if (!m_initialized || m_udpData.count == 0) {
         return 0;
     }
 
-    // Save the state of the received packet.
-    m_udpRemoteIpReceived = IpAddress(m_udpData.remoteIp.addr);
-    m_udpRemotePortReceived = m_udpData.remotePort;
-    m_udpBytesAvailable = m_udpData.available;
-
-    // Make this packet available to read by storing a copy as a class member.
-    // This prevents the received packet from being clobbered by subsequent
-    // received packets while attempting to do a chain of read()s on the
-    // original packet.
+    // Release the previous packet, whether or not it was read to the end.
     if (m_incomingPacket != nullptr) {
         pbuf_free(m_incomingPacket);
         m_incomingPacket = nullptr;
     }
 
-    m_incomingPacket = pbuf_alloc(PBUF_TRANSPORT, m_udpData.packet->tot_len,
-                                  PBUF_RAM);
-    if (m_incomingPacket == nullptr) {
-        // Couldn't allocate a pbuf to copy the received packet into.
-        return 0;
-    }
-
-    err_t err = pbuf_copy(m_incomingPacket, m_udpData.packet);
-    if (err != ERR_OK) {
-        // Copy failed.
-        return 0;
-    }
+    // Take the received buffer chain out of the queue rather than copying
+    // it. Datagrams that arrive while this one is read queue up behind it.
+    // On a secure session, datagrams that don't open are dropped.
+    UdpDatagram *datagram;
+    do {
+        if (m_udpData.count == 0) {
+            m_packetParsed = false;
+            m_udpBytesAvailable = 0;
+            return 0;
+        }
+        datagram = &m_udpData.queue[m_udpData.head];
+        m_incomingPacket = datagram->packet;
+        datagram->packet = nullptr;
+        m_udpData.head = (m_udpData.head + 1) % UDP_RX_QUEUE_MAX;
+        m_udpData.count--;
+    } while (m_secure && !PacketOpen(datagram));
 
-    // Free the received packet so we can receive another packet while reading
-    // the one we copied.
-    pbuf_free(m_udpData.packet);
-    m_udpData.packet = nullptr;
-    m_udpData.available = 0;
+    // Save the state of the received packet.
+    m_udpRemoteIpReceived = IpAddress(datagram->remoteIp.addr);
+    m_udpRemotePortReceived = datagram->remotePort;
+    m_udpBytesAvailable = m_incomingPacket->tot_len;
 
     m_packetParsed = true;
 
@@ -298,8 +553,12 @@ int32_t EthernetUdp::PacketRead(unsigned char *dataPtr, uint16_t length) {
         length = m_udpBytesAvailable;
     }
 
-    uint16_t bytesRead = UdpPacketRead(m_incomingPacket, &m_udpBytesAvailable,
-                                       dataPtr, length);
+    EthernetServiceLock lock;
+    // Read on from where the last read ended, across the buffer chain.
+    uint16_t bytesRead =
+        pbuf_copy_partial(m_incomingPacket, dataPtr, length,
+                          m_incomingPacket->tot_len - m_udpBytesAvailable);
+    m_udpBytesAvailable -= bytesRead;
 
     if (m_udpBytesAvailable == 0) {
         // We've read all the bytes of the received packet so free it.
@@ -322,7 +581,8 @@ int16_t EthernetUdp::Peek() {
         return -1;
     }
 
-    return pbuf_get_at(m_incomingPacket, 0);
+    return pbuf_get_at(m_incomingPacket,
+                       m_incomingPacket->tot_len - m_udpBytesAvailable);
 }
 
 void EthernetUdp::PacketFlush() {
@@ -330,8 +590,11 @@ void EthernetUdp::PacketFlush() {
         return;
     }
 
+    EthernetServiceLock lock;
     pbuf_free(m_incomingPacket);
     m_incomingPacket = nullptr;
+    m_udpBytesAvailable = 0;
+    m_packetParsed = false;
 }
 
 IpAddress EthernetUdp::RemoteIp() {
@@ -342,43 +605,6 @@ uint16_t EthernetUdp::RemotePort() {
     return m_udpRemotePortReceived;
 }
 
-uint16_t EthernetUdp::UdpPacketRead(pbuf *packet, uint16_t *available,
-                                    unsigned char *buffer, uint16_t size) {
-    uint16_t bytesRead = 0;
-
-    // Read from incoming packet data as long as we have a packet to read with
-    // unread data available and there are requested bytes remaining to be read.
-    while (packet != nullptr && *available > 0 && bytesRead < size) {
-        // Calculate the location in the received packet to read from.
-        uint16_t offset = packet->tot_len - *available;
-
-        // Read byte by byte until there's nothing left to read:
-        // either we've read all available bytes, read all bytes requested,
-        // or we've exhausted the bytes available in the current pbuf and
-        // need to move on to the next pbuf in the chain to continue reading.
-        while ((*available > 0) && (bytesRead < size) &&
-                (offset < packet->len)) {
-            buffer[bytesRead++] = pbuf_get_at(packet, offset++);
-            (*available)--;
-        }
-        // If we haven't read all the bytes requested, check if we can move
-        // on to the next pbuf in the chain. If so, free the pbuf that had
-        // all of its data read.
-        if (bytesRead < size) {
-            pbuf *pbufToFree = packet;
-            packet = packet->next;
-
-            if (packet != nullptr) {
-                // Increase the ref count.
-                pbuf_ref(packet);
-            }
-            // Free the removed packet
-            pbuf_free(pbufToFree);
-        }
-    }
-    return bytesRead;
-}
-
 /**
     lwIP UDP datagram received callback.
 **/
@@ -393,17 +619,23 @@ void UdpReceive(void *arg, struct udp_pcb *pcb, struct pbuf *p,
         return;
     }
 
-    // Drop the last packet received.
-    if (data->packet != nullptr) {
-        pbuf_free(data->packet);
+    if (data->count >= data->depth) {
+        data->overflowCount++;
+        if (data->dropNewest) {
+            pbuf_free(p);
+            return;
+        }
+        UdpDropOldest(data);
     }
 
-    // Copy the remote IP, port, packet contents and number of bytes received
-    // into the UDP state.
-    ip_addr_copy(data->remoteIp, *addr);
-    data->remotePort = port;
-    data->packet = p;
-    data->available = p->tot_len;
+    // Queue the remote IP, port and packet contents behind any datagrams
+    // that haven't been parsed yet.
+    EthernetUdp::UdpDatagram &datagram =
+        data->queue[(data->head + data->count) % UDP_RX_QUEUE_MAX];
+    ip_addr_copy(datagram.remoteIp, *addr);
+    datagram.remotePort = port;
+    datagram.packet = p;
+    data->count++;
 }
 
 } // ClearCore namespace
\ No newline at end of file
@@ -50,7 +50,11 @@ err_t DnsGetHostByName(const char *hostname, ip_addr_t *remoteIp) {
     // A location for the callback function to put the resulting IP.
     uint32_t responseIp = 0;
     // Check the local DNS table.
-    err_t err = dns_gethostbyname(hostname, remoteIp, DnsFound, &responseIp);
+    err_t err;
+    {
+        EthernetServiceLock lock;
+        err = dns_gethostbyname(hostname, remoteIp, DnsFound, &responseIp);
+    }
 
     const uint16_t DNS_TIMEOUT = 2000;
     // Timeout to wait for the queued DNS request response.
@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    ClearCore Event System (EVSYS) channel manager
+**/
+
+#include "EventManager.h"
+#include <sam.h>
+#include "SysUtils.h"
+
+namespace ClearCore {
+
+// The channels past the fixed ones are shared out; the low ones are the only
+// ones with a clock
+#define EVENT_CLOCKED_CHANNELS EVSYS_SYNCH_NUM
+
+static_assert(EVENT_CHANNEL_COUNT <= EVENT_CLOCKED_CHANNELS,
+              "The fixed event channels must all have a clock");
+
+EventManager &EventMgr = EventManager::Instance();
+
+EventManager &EventManager::Instance() {
+    static EventManager *instance = new EventManager();
+    return *instance;
+}
+
+uint8_t EventManager::ChannelAllocate(bool clocked) {
+    uint8_t channel = EVENT_CHANNEL_NONE;
+    if (!clocked) {
+        // Leave the clocked channels for those who need them
+        channel = ChannelFind(EVENT_CLOCKED_CHANNELS, EVSYS_CHANNELS);
+    }
+    if (channel == EVENT_CHANNEL_NONE) {
+        channel = ChannelFind(EVENT_CHANNEL_COUNT, EVENT_CLOCKED_CHANNELS);
+    }
+    if (channel != EVENT_CHANNEL_NONE) {
+        Route(channel, 0);
+    }
+    return channel;
+}
+
+uint8_t EventManager::ChannelFind(uint8_t first, uint8_t last) {
+    uint8_t channel = EVENT_CHANNEL_NONE;
+    __disable_irq();
+    for (uint8_t i = first; i < last; i++) {
+        if (!(m_allocated & (1UL << i))) {
+            m_allocated |= 1UL << i;
+            channel = i;
+            break;
+        }
+    }
+    __enable_irq();
+    return channel;
+}
+
+void EventManager::ChannelFree(uint8_t channel) {
+    if (channel < EVENT_CHANNEL_COUNT || channel >= EVSYS_CHANNELS ||
+            !(m_allocated & (1UL << channel))) {
+        return;
+    }
+    for (uint8_t user = 0; user < EVSYS_USERS; user++) {
+        if (EVSYS->USER[user].reg == channel + 1U) {
+            EVSYS->USER[user].reg = 0;
+        }
+    }
+    Route(channel, 0);
+    __disable_irq();
+    m_allocated &= ~(1UL << channel);
+    __enable_irq();
+}
+
+bool EventManager::Route(uint8_t channel, uint8_t generator, EventPaths path,
+                         EventEdges edge) {
+    if (channel >= EVSYS_CHANNELS ||
+            (path != EVENT_PATH_ASYNCHRONOUS &&
+             channel >= EVENT_CLOCKED_CHANNELS)) {
+        return false;
+    }
+    if (channel < EVENT_CLOCKED_CHANNELS) {
+        // The edge detection and resynchronization run on the channel's
+        // clock, the 120 MHz CPU clock
+        SET_CLOCK_SOURCE(EVSYS_GCLK_ID_0 + channel, 0);
+    }
+    uint32_t config = EVSYS_CHANNEL_EVGEN(generator) |
+                      EVSYS_CHANNEL_PATH(path);
+    if (path != EVENT_PATH_ASYNCHRONOUS) {
+        config |= EVSYS_CHANNEL_EDGSEL(edge);
+    }
+    EVSYS->Channel[channel].CHANNEL.reg = config;
+    return true;
+}
+
+bool EventManager::UserAdd(uint8_t channel, uint8_t user) {
+    if (channel >= EVSYS_CHANNELS || user >= EVSYS_USERS) {
+        return false;
+    }
+    EVSYS->USER[user].reg = channel + 1;
+    return true;
+}
+
+void EventManager::UserRemove(uint8_t user) {
+    if (user < EVSYS_USERS) {
+        EVSYS->USER[user].reg = 0;
+    }
+}
+
+bool EventManager::Trigger(uint8_t channel) {
+    if (channel >= EVSYS_CHANNELS) {
+        return false;
+    }
+    EVSYS->SWEVT.reg = 1UL << channel;
+    return true;
+}
+
+} // ClearCore namespace
@@ -0,0 +1,862 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    ClearCore FAT32 file system on the SD card
+**/
+
+#include "FatFileSystem.h"
+#include <string.h>
+
+// Boot sector fields
+#define BPB_BYTES_PER_SECTOR 11
+#define BPB_SECTORS_PER_CLUSTER 13
+#define BPB_RESERVED_SECTORS 14
+#define BPB_FAT_COUNT 16
+#define BPB_ROOT_ENTRY_COUNT 17
+#define BPB_TOTAL_SECTORS_16 19
+#define BPB_FAT_SIZE_16 22
+#define BPB_TOTAL_SECTORS_32 32
+#define BPB_FAT_SIZE_32 36
+#define BPB_ROOT_CLUSTER 44
+#define BPB_FS_INFO 48
+#define BOOT_SIGNATURE 510
+
+// Partition table
+#define MBR_PARTITION_TABLE 446
+#define MBR_PARTITION_SIZE 16
+#define MBR_PARTITION_TYPE 4
+#define MBR_PARTITION_START 8
+#define PARTITION_FAT32 0x0B
+#define PARTITION_FAT32_LBA 0x0C
+
+// FSInfo sector
+#define FSINFO_LEAD_SIG 0x41615252
+#define FSINFO_STRUCT_SIG 0x61417272
+#define FSINFO_STRUCT 484
+#define FSINFO_FREE_COUNT 488
+#define FSINFO_NEXT_FREE 492
+
+// FAT entries
+#define FAT_ENTRY_MASK 0x0FFFFFFF
+#define FAT_END_OF_CHAIN 0x0FFFFFF8
+#define FAT_ENTRIES_PER_SECTOR (SD_BLOCK_SIZE / sizeof(uint32_t))
+
+// Directory entries
+#define DIR_ENTRY_SIZE 32
+#define DIR_ENTRIES_PER_SECTOR (SD_BLOCK_SIZE / DIR_ENTRY_SIZE)
+#define DIR_NAME_LENGTH 11
+#define DIR_ATTR 11
+#define DIR_CLUSTER_HIGH 20
+#define DIR_CLUSTER_LOW 26
+#define DIR_FILE_SIZE 28
+#define DIR_ENTRY_END 0x00
+#define DIR_ENTRY_FREE 0xE5
+#define ATTR_READ_ONLY 0x01
+#define ATTR_VOLUME_ID 0x08
+#define ATTR_DIRECTORY 0x10
+#define ATTR_ARCHIVE 0x20
+
+namespace ClearCore {
+
+extern SdCardDriver SdCard;
+
+FatFileSystem &FileSys = FatFileSystem::Instance();
+
+// The card's structures are little-endian and may be unaligned
+static uint16_t Le16Get(const uint8_t *data) {
+    return data[0] | (data[1] << 8);
+}
+
+static uint32_t Le32Get(const uint8_t *data) {
+    return Le16Get(data) | (static_cast<uint32_t>(Le16Get(data + 2)) << 16);
+}
+
+static void Le16Set(uint8_t *data, uint16_t value) {
+    data[0] = value;
+    data[1] = value >> 8;
+}
+
+static void Le32Set(uint8_t *data, uint32_t value) {
+    Le16Set(data, value);
+    Le16Set(data + 2, value >> 16);
+}
+
+static uint32_t EntryCluster(const uint8_t *entry) {
+    return (static_cast<uint32_t>(Le16Get(entry + DIR_CLUSTER_HIGH)) << 16) |
+           Le16Get(entry + DIR_CLUSTER_LOW);
+}
+
+static void EntryClusterSet(uint8_t *entry, uint32_t cluster) {
+    Le16Set(entry + DIR_CLUSTER_HIGH, cluster >> 16);
+    Le16Set(entry + DIR_CLUSTER_LOW, cluster);
+}
+
+/**
+    Convert the next component of a path to a padded, upper case 8.3 name,
+    and step the path past it.
+**/
+static bool NameFormat(const char *&path, uint8_t *name) {
+    memset(name, ' ', DIR_NAME_LENGTH);
+    uint8_t i = 0;
+    uint8_t limit = 8;
+    bool extension = false;
+    while (*path && *path != '/') {
+        uint8_t c = *path++;
+        if (c == '.' && !extension) {
+            extension = true;
+            i = 8;
+            limit = DIR_NAME_LENGTH;
+            continue;
+        }
+        if (c <= ' ' || c >= 0x7F || strchr("\"*+,./:;<=>?[\\]|", c) ||
+                i >= limit) {
+            return false;
+        }
+        if (c >= 'a' && c <= 'z') {
+            c -= 'a' - 'A';
+        }
+        name[i++] = c;
+    }
+    if (*path == '/') {
+        path++;
+    }
+    return name[0] != ' ';
+}
+
+FatFileSystem &FatFileSystem::Instance() {
+    static FatFileSystem *instance = new FatFileSystem();
+    return *instance;
+}
+
+FatFileSystem::FatFileSystem()
+    : m_cache(),
+      m_cacheClock(0),
+      m_mounted(false),
+      m_fatStart(0),
+      m_fatSize(0),
+      m_fatCount(0),
+      m_sectorsPerCluster(0),
+      m_dataStart(0),
+      m_clusterCount(0),
+      m_rootCluster(0),
+      m_fsInfoSector(0),
+      m_freeHint(2),
+      m_fsInfoDirty(false) {}
+
+bool FatFileSystem::Mount() {
+    if (m_mounted) {
+        Sync();
+    }
+    m_mounted = false;
+    for (uint8_t i = 0; i < SD_FAT_CACHE_SECTORS; i++) {
+        m_cache[i].Valid = false;
+    }
+
+    if (!SdCard.Initialize()) {
+        return false;
+    }
+    if (VolumeRead(0)) {
+        m_mounted = true;
+        return true;
+    }
+
+    // Not a volume; look for a FAT32 partition
+    const uint8_t *data = CacheGet(0, true, false);
+    if (!data || Le16Get(data + BOOT_SIGNATURE) != 0xAA55) {
+        return false;
+    }
+    uint32_t starts[4];
+    uint8_t partitionCount = 0;
+    for (uint8_t i = 0; i < 4; i++) {
+        const uint8_t *partition =
+            data + MBR_PARTITION_TABLE + i * MBR_PARTITION_SIZE;
+        if (partition[MBR_PARTITION_TYPE] == PARTITION_FAT32 ||
+                partition[MBR_PARTITION_TYPE] == PARTITION_FAT32_LBA) {
+            starts[partitionCount++] =
+                Le32Get(partition + MBR_PARTITION_START);
+        }
+    }
+    for (uint8_t i = 0; i < partitionCount; i++) {
+        if (VolumeRead(starts[i])) {
+            m_mounted = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool FatFileSystem::VolumeRead(uint32_t sector) {
+    const uint8_t *data = CacheGet(sector, true, false);
+    if (!data || Le16Get(data + BOOT_SIGNATURE) != 0xAA55 ||
+            (data[0] != 0xEB && data[0] != 0xE9)) {
+        return false;
+    }
+
+    // FAT12 and FAT16 volumes have a 16-bit FAT size and a fixed root
+    // directory
+    uint8_t sectorsPerCluster = data[BPB_SECTORS_PER_CLUSTER];
+    uint32_t totalSectors = Le16Get(data + BPB_TOTAL_SECTORS_16);
+    if (!totalSectors) {
+        totalSectors = Le32Get(data + BPB_TOTAL_SECTORS_32);
+    }
+    if (Le16Get(data + BPB_BYTES_PER_SECTOR) != SD_BLOCK_SIZE ||
+            !sectorsPerCluster ||
+            (sectorsPerCluster & (sectorsPerCluster - 1)) ||
+            !data[BPB_FAT_COUNT] ||
+            Le16Get(data + BPB_FAT_SIZE_16) ||
+            Le16Get(data + BPB_ROOT_ENTRY_COUNT)) {
+        return false;
+    }
+
+    m_sectorsPerCluster = sectorsPerCluster;
+    m_fatCount = data[BPB_FAT_COUNT];
+    m_fatSize = Le32Get(data + BPB_FAT_SIZE_32);
+    m_fatStart = sector + Le16Get(data + BPB_RESERVED_SECTORS);
+    m_dataStart = m_fatStart + m_fatCount * m_fatSize;
+    m_rootCluster = Le32Get(data + BPB_ROOT_CLUSTER);
+    uint16_t fsInfo = Le16Get(data + BPB_FS_INFO);
+    m_fsInfoSector = fsInfo ? sector + fsInfo : 0;
+    if (m_dataStart - sector >= totalSectors) {
+        return false;
+    }
+    m_clusterCount = (totalSectors - (m_dataStart - sector)) /
+                     m_sectorsPerCluster;
+    // Clusters past the end of the FAT cannot be used
+    if (m_clusterCount + 2 > m_fatSize * FAT_ENTRIES_PER_SECTOR) {
+        m_clusterCount = m_fatSize * FAT_ENTRIES_PER_SECTOR - 2;
+    }
+    if (!ClusterValid(m_rootCluster)) {
+        return false;
+    }
+
+    // Start the free cluster search where the last writer left off
+    m_freeHint = 2;
+    m_fsInfoDirty = false;
+    if (m_fsInfoSector) {
+        data = CacheGet(m_fsInfoSector, true, false);
+        if (data && Le32Get(data) == FSINFO_LEAD_SIG &&
+                Le32Get(data + FSINFO_STRUCT) == FSINFO_STRUCT_SIG &&
+                ClusterValid(Le32Get(data + FSINFO_NEXT_FREE))) {
+            m_freeHint = Le32Get(data + FSINFO_NEXT_FREE);
+        }
+    }
+    return true;
+}
+
+bool FatFileSystem::Open(FatFile &file, const char *path, OpenMode mode) {
+    if (!m_mounted || file.m_open || !path) {
+        return false;
+    }
+
+    uint8_t name[DIR_NAME_LENGTH];
+    uint32_t dirCluster, sector;
+    uint8_t index;
+    uint32_t firstCluster = 0;
+    uint32_t size = 0;
+    switch (PathFind(path, name, dirCluster, sector, index)) {
+        case DIR_FOUND: {
+            const uint8_t *entry = CacheGet(sector, true, false);
+            if (!entry) {
+                return false;
+            }
+            entry += index * DIR_ENTRY_SIZE;
+            if ((entry[DIR_ATTR] & ATTR_DIRECTORY) ||
+                    (mode != FILE_READ && (entry[DIR_ATTR] & ATTR_READ_ONLY))) {
+                return false;
+            }
+            firstCluster = EntryCluster(entry);
+            size = Le32Get(entry + DIR_FILE_SIZE);
+            break;
+        }
+        case DIR_NOT_FOUND:
+            if (mode == FILE_READ ||
+                    !DirEntryAdd(dirCluster, name, sector, index)) {
+                return false;
+            }
+            break;
+        default:
+            return false;
+    }
+
+    file.m_open = true;
+    file.m_writable = mode != FILE_READ;
+    file.m_dirty = false;
+    file.m_firstCluster = firstCluster;
+    file.m_size = size;
+    file.m_cluster = 0;
+    file.m_clusterIndex = 0;
+    file.m_dirSector = sector;
+    file.m_dirIndex = index;
+
+    if (mode == FILE_WRITE && firstCluster) {
+        // Point the entry away from the old chain before freeing it so a
+        // power loss cannot leave the entry on freed clusters
+        file.m_firstCluster = 0;
+        file.m_size = 0;
+        file.m_dirty = true;
+        if (!file.Sync() || !ChainFree(firstCluster)) {
+            file.m_open = false;
+            return false;
+        }
+    }
+    file.m_position = mode == FILE_APPEND ? file.m_size : 0;
+    return true;
+}
+
+bool FatFileSystem::Exists(const char *path) {
+    uint8_t name[DIR_NAME_LENGTH];
+    uint32_t dirCluster, sector;
+    uint8_t index;
+    return m_mounted && path &&
+           PathFind(path, name, dirCluster, sector, index) == DIR_FOUND;
+}
+
+bool FatFileSystem::Remove(const char *path) {
+    uint8_t name[DIR_NAME_LENGTH];
+    uint32_t dirCluster, sector;
+    uint8_t index;
+    if (!m_mounted || !path ||
+            PathFind(path, name, dirCluster, sector, index) != DIR_FOUND) {
+        return false;
+    }
+    uint8_t *entry = CacheGet(sector, true, true);
+    if (!entry) {
+        return false;
+    }
+    entry += index * DIR_ENTRY_SIZE;
+    if (entry[DIR_ATTR] & (ATTR_DIRECTORY | ATTR_READ_ONLY)) {
+        return false;
+    }
+    uint32_t firstCluster = EntryCluster(entry);
+    entry[0] = DIR_ENTRY_FREE;
+    return ChainFree(firstCluster) && Sync();
+}
+
+bool FatFileSystem::Sync() {
+    if (!m_mounted) {
+        return false;
+    }
+    if (m_fsInfoDirty) {
+        uint8_t *data = CacheGet(m_fsInfoSector, true, true);
+        if (data && Le32Get(data) == FSINFO_LEAD_SIG &&
+                Le32Get(data + FSINFO_STRUCT) == FSINFO_STRUCT_SIG) {
+            // The free count is not kept up to date, so mark it unknown for
+            // the host to recount
+            Le32Set(data + FSINFO_FREE_COUNT, UINT32_MAX);
+            Le32Set(data + FSINFO_NEXT_FREE, m_freeHint);
+        }
+        m_fsInfoDirty = false;
+    }
+
+    bool success = true;
+    for (uint8_t i = 0; i < SD_FAT_CACHE_SECTORS; i++) {
+        if (m_cache[i].Valid && m_cache[i].Dirty) {
+            success = CacheFlush(m_cache[i]) && success;
+        }
+    }
+    return success;
+}
+
+uint8_t *FatFileSystem::CacheGet(uint32_t sector, bool load, bool dirty) {
+    CacheEntry *entry = NULL;
+    for (uint8_t i = 0; i < SD_FAT_CACHE_SECTORS; i++) {
+        if (m_cache[i].Valid && m_cache[i].Sector == sector) {
+            entry = &m_cache[i];
+            break;
+        }
+    }
+
+    if (!entry) {
+        // Replace the least recently used sector
+        entry = &m_cache[0];
+        for (uint8_t i = 0; i < SD_FAT_CACHE_SECTORS && entry->Valid; i++) {
+            if (!m_cache[i].Valid ||
+                    m_cache[i].LastUse - entry->LastUse > UINT32_MAX / 2) {
+                entry = &m_cache[i];
+            }
+        }
+        if (entry->Valid && entry->Dirty && !CacheFlush(*entry)) {
+            return NULL;
+        }
+        entry->Valid = false;
+        if (load && !SdCard.BlockRead(sector, entry->Data)) {
+            return NULL;
+        }
+        entry->Sector = sector;
+        entry->Valid = true;
+        entry->Dirty = false;
+    }
+
+    entry->LastUse = m_cacheClock++;
+    entry->Dirty |= dirty;
+    return entry->Data;
+}
+
+bool FatFileSystem::CacheFlush(CacheEntry &entry) {
+    if (!SdCard.BlockWrite(entry.Sector, entry.Data)) {
+        return false;
+    }
+    // Keep the copies of the FAT the same as the first
+    if (entry.Sector >= m_fatStart && entry.Sector < m_fatStart + m_fatSize) {
+        for (uint8_t i = 1; i < m_fatCount; i++) {
+            if (!SdCard.BlockWrite(entry.Sector + i * m_fatSize,
+                                   entry.Data)) {
+                return false;
+            }
+        }
+    }
+    entry.Dirty = false;
+    return true;
+}
+
+bool FatFileSystem::SectorsRead(uint32_t sector, uint8_t *data,
+                                uint32_t count) {
+    // Cached changes to these sectors must reach the card first
+    for (uint8_t i = 0; i < SD_FAT_CACHE_SECTORS; i++) {
+        CacheEntry &entry = m_cache[i];
+        if (entry.Valid && entry.Dirty && entry.Sector - sector < count &&
+                !CacheFlush(entry)) {
+            return false;
+        }
+    }
+    return SdCard.BlockRead(sector, data, count);
+}
+
+bool FatFileSystem::SectorsWrite(uint32_t sector, const uint8_t *data,
+                                 uint32_t count) {
+    // The cached copies of these sectors are overwritten
+    for (uint8_t i = 0; i < SD_FAT_CACHE_SECTORS; i++) {
+        if (m_cache[i].Sector - sector < count) {
+            m_cache[i].Valid = false;
+        }
+    }
+    return SdCard.BlockWrite(sector, data, count);
+}
+
+bool FatFileSystem::FatGet(uint32_t cluster, uint32_t &value) {
+    const uint8_t *data =
+        CacheGet(m_fatStart + cluster / FAT_ENTRIES_PER_SECTOR, true, false);
+    if (!data) {
+        return false;
+    }
+    value = Le32Get(data + (cluster % FAT_ENTRIES_PER_SECTOR) *
+                    sizeof(uint32_t)) & FAT_ENTRY_MASK;
+    return true;
+}
+
+bool FatFileSystem::FatSet(uint32_t cluster, uint32_t value) {
+    uint8_t *data =
+        CacheGet(m_fatStart + cluster / FAT_ENTRIES_PER_SECTOR, true, true);
+    if (!data) {
+        return false;
+    }
+    data += (cluster % FAT_ENTRIES_PER_SECTOR) * sizeof(uint32_t);
+    // The top four bits are reserved and kept as they are
+    Le32Set(data, (Le32Get(data) & ~FAT_ENTRY_MASK) |
+            (value & FAT_ENTRY_MASK));
+    return true;
+}
+
+bool FatFileSystem::ClusterAllocate(uint32_t prev, uint32_t &cluster) {
+    for (uint32_t i = 0; i < m_clusterCount; i++) {
+        uint32_t candidate = 2 + (m_freeHint - 2 + i) % m_clusterCount;
+        uint32_t value;
+        if (!FatGet(candidate, value)) {
+            return false;
+        }
+        if (value) {
+            continue;
+        }
+        if (!FatSet(candidate, FAT_ENTRY_MASK) ||
+                (prev && !FatSet(prev, candidate))) {
+            return false;
+        }
+        cluster = candidate;
+        m_freeHint = ClusterValid(candidate + 1) ? candidate + 1 : 2;
+        m_fsInfoDirty = true;
+        return true;
+    }
+    return false;
+}
+
+bool FatFileSystem::ClusterZero(uint32_t cluster) {
+    uint32_t sector = ClusterSector(cluster);
+    for (uint8_t i = 0; i < m_sectorsPerCluster; i++) {
+        uint8_t *data = CacheGet(sector + i, false, true);
+        if (!data) {
+            return false;
+        }
+        memset(data, 0, SD_BLOCK_SIZE);
+    }
+    return true;
+}
+
+bool FatFileSystem::ChainFree(uint32_t cluster) {
+    while (ClusterValid(cluster)) {
+        uint32_t next;
+        if (!FatGet(cluster, next) || !FatSet(cluster, 0)) {
+            return false;
+        }
+        m_fsInfoDirty = true;
+        cluster = next;
+    }
+    return true;
+}
+
+FatFileSystem::DirResult FatFileSystem::DirFind(uint32_t &cluster,
+        const uint8_t *name, uint32_t &sector, uint8_t &index) {
+    while (true) {
+        uint32_t clusterSector = ClusterSector(cluster);
+        for (uint8_t i = 0; i < m_sectorsPerCluster; i++) {
+            const uint8_t *data = CacheGet(clusterSector + i, true, false);
+            if (!data) {
+                return DIR_ERROR;
+            }
+            for (uint8_t j = 0; j < DIR_ENTRIES_PER_SECTOR; j++) {
+                const uint8_t *entry = data + j * DIR_ENTRY_SIZE;
+                bool match;
+                if (!name) {
+                    match = entry[0] == DIR_ENTRY_END ||
+                            entry[0] == DIR_ENTRY_FREE;
+                }
+                else if (entry[0] == DIR_ENTRY_END) {
+                    return DIR_NOT_FOUND;
+                }
+                else {
+                    // Long name entries and the volume label have the
+                    // volume ID attribute set
+                    match = entry[0] != DIR_ENTRY_FREE &&
+                            !(entry[DIR_ATTR] & ATTR_VOLUME_ID) &&
+                            !memcmp(entry, name, DIR_NAME_LENGTH);
+                }
+                if (match) {
+                    sector = clusterSector + i;
+                    index = j;
+                    return DIR_FOUND;
+                }
+            }
+        }
+
+        uint32_t next;
+        if (!FatGet(cluster, next)) {
+            return DIR_ERROR;
+        }
+        if (next >= FAT_END_OF_CHAIN) {
+            return DIR_NOT_FOUND;
+        }
+        if (!ClusterValid(next)) {
+            return DIR_ERROR;
+        }
+        cluster = next;
+    }
+}
+
+bool FatFileSystem::DirEntryAdd(uint32_t dirCluster, const uint8_t *name,
+                                uint32_t &sector, uint8_t &index) {
+    uint32_t cluster = dirCluster;
+    switch (DirFind(cluster, NULL, sector, index)) {
+        case DIR_FOUND:
+            break;
+        case DIR_NOT_FOUND: {
+            // The directory is full; extend it with an empty cluster
+            uint32_t newCluster;
+            if (!ClusterAllocate(cluster, newCluster) ||
+                    !ClusterZero(newCluster)) {
+                return false;
+            }
+            sector = ClusterSector(newCluster);
+            index = 0;
+            break;
+        }
+        default:
+            return false;
+    }
+
+    uint8_t *entry = CacheGet(sector, true, true);
+    if (!entry) {
+        return false;
+    }
+    entry += index * DIR_ENTRY_SIZE;
+    memset(entry, 0, DIR_ENTRY_SIZE);
+    memcpy(entry, name, DIR_NAME_LENGTH);
+    entry[DIR_ATTR] = ATTR_ARCHIVE;
+    return true;
+}
+
+FatFileSystem::DirResult FatFileSystem::PathFind(const char *path,
+        uint8_t *name, uint32_t &dirCluster, uint32_t &sector,
+        uint8_t &index) {
+    if (*path == '/') {
+        path++;
+    }
+    dirCluster = m_rootCluster;
+    while (true) {
+        if (!NameFormat(path, name)) {
+            return DIR_ERROR;
+        }
+        uint32_t cluster = dirCluster;
+        DirResult result = DirFind(cluster, name, sector, index);
+        if (!*path || result != DIR_FOUND) {
+            // A missing directory along the path is an error, not a
+            // missing file
+            return *path && result == DIR_NOT_FOUND ? DIR_ERROR : result;
+        }
+
+        const uint8_t *entry = CacheGet(sector, true, false);
+        if (!entry) {
+            return DIR_ERROR;
+        }
+        entry += index * DIR_ENTRY_SIZE;
+        if (!(entry[DIR_ATTR] & ATTR_DIRECTORY)) {
+            return DIR_ERROR;
+        }
+        // A ".." entry leading back to the root holds cluster 0
+        dirCluster = EntryCluster(entry);
+        if (!dirCluster) {
+            dirCluster = m_rootCluster;
+        }
+    }
+}
+
+FatFile::FatFile()
+    : m_open(false),
+      m_writable(false),
+      m_dirty(false),
+      m_firstCluster(0),
+      m_size(0),
+      m_position(0),
+      m_cluster(0),
+      m_clusterIndex(0),
+      m_dirSector(0),
+      m_dirIndex(0) {}
+
+int32_t FatFile::Read(uint8_t *data, uint32_t length) {
+    if (!m_open || !data) {
+        return -1;
+    }
+    if (length > m_size - m_position) {
+        length = m_size - m_position;
+    }
+
+    FatFileSystem &fs = FileSys;
+    uint32_t clusterBytes = fs.ClusterBytes();
+    uint32_t done = 0;
+    while (done < length) {
+        if (!ClusterSeek(m_position / clusterBytes, false)) {
+            break;
+        }
+        uint32_t clusterOffset = m_position % clusterBytes;
+        uint32_t sector = fs.ClusterSector(m_cluster) +
+                          clusterOffset / SD_BLOCK_SIZE;
+        uint32_t offset = m_position % SD_BLOCK_SIZE;
+        uint32_t count = length - done;
+        if (!offset && count >= SD_BLOCK_SIZE) {
+            // Whole sectors up to the end of the cluster go straight to the
+            // caller's buffer
+            uint32_t sectors = count / SD_BLOCK_SIZE;
+            uint32_t sectorsLeft = fs.m_sectorsPerCluster -
+                                   clusterOffset / SD_BLOCK_SIZE;
+            if (sectors > sectorsLeft) {
+                sectors = sectorsLeft;
+            }
+            if (!fs.SectorsRead(sector, data + done, sectors)) {
+                break;
+            }
+            count = sectors * SD_BLOCK_SIZE;
+        }
+        else {
+            const uint8_t *cached = fs.CacheGet(sector, true, false);
+            if (!cached) {
+                break;
+            }
+            if (count > SD_BLOCK_SIZE - offset) {
+                count = SD_BLOCK_SIZE - offset;
+            }
+            memcpy(data + done, cached + offset, count);
+        }
+        done += count;
+        m_position += count;
+    }
+    return done;
+}
+
+int32_t FatFile::Write(const uint8_t *data, uint32_t length) {
+    if (!m_open || !m_writable || !data) {
+        return -1;
+    }
+    // Files are limited to 4 GB
+    if (length > UINT32_MAX - m_position) {
+        length = UINT32_MAX - m_position;
+    }
+
+    FatFileSystem &fs = FileSys;
+    uint32_t clusterBytes = fs.ClusterBytes();
+    uint32_t done = 0;
+    while (done < length) {
+        if (!ClusterSeek(m_position / clusterBytes, true)) {
+            break;
+        }
+        uint32_t clusterOffset = m_position % clusterBytes;
+        uint32_t sector = fs.ClusterSector(m_cluster) +
+                          clusterOffset / SD_BLOCK_SIZE;
+        uint32_t offset = m_position % SD_BLOCK_SIZE;
+        uint32_t count = length - done;
+        if (!offset && count >= SD_BLOCK_SIZE) {
+            uint32_t sectors = count / SD_BLOCK_SIZE;
+            uint32_t sectorsLeft = fs.m_sectorsPerCluster -
+                                   clusterOffset / SD_BLOCK_SIZE;
+            if (sectors > sectorsLeft) {
+                sectors = sectorsLeft;
+            }
+            if (!fs.SectorsWrite(sector, data + done, sectors)) {
+                break;
+            }
+            count = sectors * SD_BLOCK_SIZE;
+        }
+        else {
+            // A sector that starts past the end of the file holds nothing
+            // worth reading first
+            bool load = m_position - offset < m_size;
+            uint8_t *cached = fs.CacheGet(sector, load, true);
+            if (!cached) {
+                break;
+            }
+            if (count > SD_BLOCK_SIZE - offset) {
+                count = SD_BLOCK_SIZE - offset;
+            }
+            memcpy(cached + offset, data + done, count);
+        }
+        done += count;
+        m_position += count;
+        if (m_size < m_position) {
+            m_size = m_position;
+            m_dirty = true;
+        }
+    }
+    return done;
+}
+
+bool FatFile::Seek(uint32_t position) {
+    if (!m_open || position > m_size) {
+        return false;
+    }
+    m_position = position;
+    return true;
+}
+
+bool FatFile::Reserve(uint32_t length) {
+    if (!m_open || !m_writable) {
+        return false;
+    }
+    if (!length) {
+        return true;
+    }
+    return ClusterSeek((length - 1) / FileSys.ClusterBytes(), true) &&
+           Sync();
+}
+
+bool FatFile::Sync() {
+    if (!m_open) {
+        return false;
+    }
+    FatFileSystem &fs = FileSys;
+    if (m_dirty) {
+        uint8_t *entry = fs.CacheGet(m_dirSector, true, true);
+        if (!entry) {
+            return false;
+        }
+        entry += m_dirIndex * DIR_ENTRY_SIZE;
+        EntryClusterSet(entry, m_firstCluster);
+        Le32Set(entry + DIR_FILE_SIZE, m_size);
+        m_dirty = false;
+    }
+    return fs.Sync();
+}
+
+bool FatFile::Close() {
+    if (!m_open) {
+        return false;
+    }
+    bool success = !m_writable || (ChainTrim() && Sync());
+    m_open = false;
+    return success;
+}
+
+bool FatFile::ClusterSeek(uint32_t index, bool allocate) {
+    FatFileSystem &fs = FileSys;
+    if (!m_cluster || index < m_clusterIndex) {
+        if (!m_firstCluster) {
+            if (!allocate || !fs.ClusterAllocate(0, m_firstCluster)) {
+                return false;
+            }
+            m_dirty = true;
+        }
+        m_cluster = m_firstCluster;
+        m_clusterIndex = 0;
+    }
+
+    while (m_clusterIndex < index) {
+        uint32_t next;
+        if (!fs.FatGet(m_cluster, next)) {
+            return false;
+        }
+        if (next >= FAT_END_OF_CHAIN) {
+            if (!allocate || !fs.ClusterAllocate(m_cluster, next)) {
+                return false;
+            }
+        }
+        else if (!fs.ClusterValid(next)) {
+            return false;
+        }
+        m_cluster = next;
+        m_clusterIndex++;
+    }
+    return true;
+}
+
+bool FatFile::ChainTrim() {
+    FatFileSystem &fs = FileSys;
+    if (!m_firstCluster) {
+        return true;
+    }
+    if (!m_size) {
+        // Detach the whole chain from the entry before freeing it
+        uint32_t firstCluster = m_firstCluster;
+        m_firstCluster = 0;
+        m_cluster = 0;
+        m_dirty = true;
+        return Sync() && fs.ChainFree(firstCluster);
+    }
+
+    uint32_t next;
+    if (!ClusterSeek((m_size - 1) / fs.ClusterBytes(), false) ||
+            !fs.FatGet(m_cluster, next)) {
+        return false;
+    }
+    if (next >= FAT_END_OF_CHAIN) {
+        return true;
+    }
+    return fs.FatSet(m_cluster, FAT_ENTRY_MASK) && fs.ChainFree(next);
+}
+
+} // ClearCore namespace
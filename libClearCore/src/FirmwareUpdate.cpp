@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    Implementation of the ClearCore firmware update over Ethernet
+**/
+
+#include "FirmwareUpdate.h"
+#include <string.h>
+#include "CacheManager.h"
+#include "CrcManager.h"
+#include "KeyValueStore.h"
+#include "NvmManager.h"
+#include "SysTiming.h"
+
+// The end of the running image: the code and the initial values of the data
+extern uint32_t __etext;
+extern uint32_t __data_start__;
+extern uint32_t __data_end__;
+
+namespace ClearCore {
+
+extern CacheManager &CacheMgr;
+extern CrcManager &CrcMgr;
+extern NvmManager &NvmMgr;
+
+// The inactive bank is always mapped at the upper half of flash
+#define UPDATE_BANK_SIZE (FLASH_SIZE / 2)
+#define UPDATE_BANK_ADDR (FLASH_ADDR + UPDATE_BANK_SIZE)
+// The key/value store sits at the top of both banks' address range
+#define UPDATE_KV_SIZE (KV_STORE_BLOCKS * NVMCTRL_BLOCK_SIZE)
+
+#define UPDATE_HEADER_LEN 12
+
+static_assert(FIRMWARE_UPDATE_APP_OFFSET % NVMCTRL_BLOCK_SIZE == 0,
+              "The application must start on a flash block");
+
+static inline uint32_t Get32(const uint8_t *data) {
+    return data[0] | (data[1] << 8) | (data[2] << 16) |
+           (static_cast<uint32_t>(data[3]) << 24);
+}
+
+// The running firmware must leave the inactive bank alone, and the top of
+// its own bank free for the key/value store
+static bool RunningImageFits() {
+    uint32_t end = reinterpret_cast<uint32_t>(&__etext) +
+                   (reinterpret_cast<uint32_t>(&__data_end__) -
+                    reinterpret_cast<uint32_t>(&__data_start__));
+    return end <= FLASH_ADDR + UPDATE_BANK_SIZE - UPDATE_KV_SIZE;
+}
+
+static bool PageBlank(const uint32_t *page) {
+    for (uint16_t i = 0; i < NVMCTRL_PAGE_SIZE / sizeof(uint32_t); i++) {
+        if (page[i] != UINT32_MAX) {
+            return false;
+        }
+    }
+    return true;
+}
+
+FirmwareUpdate::FirmwareUpdate(uint16_t port)
+    : m_server(port),
+      m_client(),
+      m_state(UPDATE_IDLE),
+      m_error(UPDATE_ERROR_NONE),
+      m_headerDone(false),
+      m_length(0),
+      m_crcExpected(0),
+      m_crc(0),
+      m_received(0),
+      m_offset(0),
+      m_pageFill(0),
+      m_lastDataMs(0),
+      m_page() {}
+
+void FirmwareUpdate::Begin() {
+    m_server.Begin();
+}
+
+uint32_t FirmwareUpdate::ImageCapacity() {
+    return UPDATE_BANK_SIZE - FIRMWARE_UPDATE_APP_OFFSET - UPDATE_KV_SIZE;
+}
+
+void FirmwareUpdate::Poll() {
+    ClientAccept();
+    if (m_state == UPDATE_RECEIVING) {
+        Receive();
+    }
+    else if (m_client.ConnectionState() && !m_client.Connected()) {
+        // Release the state of a connection the client has closed
+        m_client.Close();
+    }
+}
+
+void FirmwareUpdate::ClientAccept() {
+    while (true) {
+        EthernetTcpClient client = m_server.Accept();
+        if (!client.ConnectionState()) {
+            return;
+        }
+        if (m_state == UPDATE_RECEIVING || m_client.ConnectionState()) {
+            // One update at a time
+            client.Close();
+            continue;
+        }
+        m_client = client;
+        m_state = UPDATE_RECEIVING;
+        m_error = UPDATE_ERROR_NONE;
+        m_headerDone = false;
+        m_length = 0;
+        m_received = 0;
+        m_crc = 0;
+        m_offset = 0;
+        m_pageFill = 0;
+        m_lastDataMs = Milliseconds();
+    }
+}
+
+void FirmwareUpdate::Receive() {
+    if (!m_headerDone && !HeaderRead()) {
+        return;
+    }
+
+    // Copy the running bootloader ahead of the image
+    if (m_offset < FIRMWARE_UPDATE_APP_OFFSET) {
+        memcpy(m_page, reinterpret_cast<const void *>(FLASH_ADDR + m_offset),
+               NVMCTRL_PAGE_SIZE);
+        if (!PageFlush(0)) {
+            Finish(UPDATE_ERROR_FLASH);
+        }
+        return;
+    }
+
+    uint8_t *page = reinterpret_cast<uint8_t *>(m_page);
+    uint32_t remaining = m_length - m_received;
+    int16_t available = m_client.BytesAvailable();
+    if (available > 0) {
+        uint32_t length = NVMCTRL_PAGE_SIZE - m_pageFill;
+        if (length > remaining) {
+            length = remaining;
+        }
+        if (length > static_cast<uint16_t>(available)) {
+            length = available;
+        }
+        int16_t read = m_client.Read(page + m_pageFill, length);
+        if (read > 0) {
+            m_pageFill += read;
+            m_received += read;
+            m_lastDataMs = Milliseconds();
+        }
+    }
+
+    if (m_pageFill == NVMCTRL_PAGE_SIZE ||
+            (m_pageFill && m_received == m_length)) {
+        // Pad the last page with erased flash
+        uint16_t imageBytes = m_pageFill;
+        memset(page + imageBytes, 0xFF, NVMCTRL_PAGE_SIZE - imageBytes);
+        if (!PageFlush(imageBytes)) {
+            Finish(UPDATE_ERROR_FLASH);
+            return;
+        }
+    }
+
+    if (m_received == m_length && !m_pageFill) {
+        Finish(m_crc == m_crcExpected ? UPDATE_ERROR_NONE : UPDATE_ERROR_CRC);
+    }
+    else if (!m_client.Connected()) {
+        Finish(UPDATE_ERROR_CONNECTION);
+    }
+    else if (Milliseconds() - m_lastDataMs > FIRMWARE_UPDATE_TIMEOUT_MS) {
+        Finish(UPDATE_ERROR_TIMEOUT);
+    }
+}
+
+bool FirmwareUpdate::HeaderRead() {
+    if (m_client.BytesAvailable() < UPDATE_HEADER_LEN) {
+        if (!m_client.Connected()) {
+            Finish(UPDATE_ERROR_CONNECTION);
+        }
+        else if (Milliseconds() - m_lastDataMs > FIRMWARE_UPDATE_TIMEOUT_MS) {
+            Finish(UPDATE_ERROR_TIMEOUT);
+        }
+        return false;
+    }
+    uint8_t header[UPDATE_HEADER_LEN];
+    m_client.Read(header, UPDATE_HEADER_LEN);
+    m_lastDataMs = Milliseconds();
+    m_length = Get32(&header[4]);
+    m_crcExpected = Get32(&header[8]);
+
+    if (Get32(header) != FIRMWARE_UPDATE_MAGIC) {
+        Finish(UPDATE_ERROR_HEADER);
+        return false;
+    }
+    if (!m_length || m_length > ImageCapacity()) {
+        Finish(UPDATE_ERROR_SIZE);
+        return false;
+    }
+    if (!RunningImageFits()) {
+        Finish(UPDATE_ERROR_UNSUPPORTED);
+        return false;
+    }
+    m_headerDone = true;
+    return true;
+}
+
+bool FirmwareUpdate::PageFlush(uint16_t imageBytes) {
+    uint32_t address = UPDATE_BANK_ADDR + m_offset;
+    if (!(m_offset % NVMCTRL_BLOCK_SIZE) && !NvmMgr.FlashBlockErase(address)) {
+        return false;
+    }
+    if (!NvmMgr.FlashPageWrite(address, m_page)) {
+        return false;
+    }
+    m_offset += NVMCTRL_PAGE_SIZE;
+    m_pageFill = 0;
+    if (imageBytes) {
+        // Check what the flash now holds, not what was sent
+        CacheMgr.Invalidate();
+        m_crc = CrcMgr.Crc32(reinterpret_cast<const void *>(address),
+                             imageBytes, m_crc);
+    }
+    return true;
+}
+
+void FirmwareUpdate::Finish(UpdateErrors error) {
+    m_error = error;
+    m_state = (error == UPDATE_ERROR_NONE) ? UPDATE_READY : UPDATE_FAILED;
+    if (m_client.Connected()) {
+        // The reply goes out ahead of the close
+        m_client.Send(static_cast<uint8_t>(error));
+    }
+    m_client.Close();
+}
+
+bool FirmwareUpdate::Apply() {
+    if (m_state != UPDATE_READY) {
+        return false;
+    }
+    // After the swap the running bank holds the upper half of flash, so
+    // the key/value store goes to the top of it first
+    uint32_t from = KV_STORE_ADDR;
+    uint32_t to = KV_STORE_ADDR - UPDATE_BANK_SIZE;
+    for (uint32_t offset = 0; offset < UPDATE_KV_SIZE;
+            offset += NVMCTRL_PAGE_SIZE) {
+        const uint32_t *page =
+            reinterpret_cast<const uint32_t *>(from + offset);
+        if (!(offset % NVMCTRL_BLOCK_SIZE) &&
+                !NvmMgr.FlashBlockErase(to + offset)) {
+            return false;
+        }
+        if (!PageBlank(page) && !NvmMgr.FlashPageWrite(to + offset, page)) {
+            return false;
+        }
+    }
+    NvmMgr.FlashBankSwap();
+    return true;
+}
+
+} // ClearCore namespace
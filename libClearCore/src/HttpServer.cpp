@@ -0,0 +1,315 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    Implementation of the ClearCore HTTP/1.1 server
+**/
+
+#include "HttpServer.h"
+#include <string.h>
+#include "InputManager.h"
+#include "NumberFormat.h"
+#include "StatusManager.h"
+#include "SysTiming.h"
+#include "SysUtils.h"
+
+namespace ClearCore {
+
+extern InputManager &InputMgr;
+extern StatusManager &StatusMgr;
+
+// A body chunk is framed as three hex digits of length, CRLF, the data,
+// and CRLF
+#define CHUNK_PREFIX_LEN 5
+#define CHUNK_FRAMING_LEN 7
+#if HTTP_CHUNK_MAX > 0xFFF
+#error "HTTP_CHUNK_MAX must fit in three hex digits"
+#endif
+
+static const char HttpLastChunk[] = "0\r\n\r\n";
+
+static inline char ToLower(char c) {
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+static inline bool StartsWithNoCase(const char *text, const char *prefix) {
+    while (*prefix) {
+        if (ToLower(*text++) != *prefix++) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// True if the header lines contain "name: ...value...". The name must be
+// given in lower case.
+static bool HeaderHas(const char *headers, const char *name,
+                      const char *value) {
+    uint8_t nameLength = strlen(name);
+    for (const char *line = strstr(headers, "\r\n"); line;
+            line = strstr(line, "\r\n")) {
+        line += 2;
+        if (!StartsWithNoCase(line, name) || line[nameLength] != ':') {
+            continue;
+        }
+        for (const char *c = line + nameLength + 1; *c && *c != '\r'; c++) {
+            if (StartsWithNoCase(c, value)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Append text to a buffer of a given size, truncating if needed
+static inline void Append(char *buffer, uint16_t size, uint16_t &length,
+                          const char *text) {
+    while (*text && length < size) {
+        buffer[length++] = *text++;
+    }
+}
+
+HttpServer::HttpServer(uint16_t port)
+    : m_server(port),
+      m_connections(),
+      m_routes(nullptr),
+      m_routeCount(0),
+      m_request(),
+      m_chunk() {}
+
+void HttpServer::Begin(const Route *routes, uint8_t routeCount) {
+    m_routes = routes;
+    m_routeCount = routes ? routeCount : 0;
+    m_server.Begin();
+}
+
+void HttpServer::Poll() {
+    ClientAccept();
+    for (uint8_t i = 0; i < HTTP_CLIENTS_MAX; i++) {
+        Connection &connection = m_connections[i];
+        if (!connection.Client.ConnectionState()) {
+            continue;
+        }
+        if (!connection.Client.Connected()) {
+            // Release the state of a connection the client has closed
+            connection.Client.Close();
+            connection.Sending = nullptr;
+            continue;
+        }
+        if (connection.Sending) {
+            ResponseContinue(connection);
+        }
+        else {
+            RequestProcess(connection);
+        }
+    }
+}
+
+uint8_t HttpServer::ClientCount() {
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < HTTP_CLIENTS_MAX; i++) {
+        if (m_connections[i].Client.Connected()) {
+            count++;
+        }
+    }
+    return count;
+}
+
+uint16_t HttpServer::StatusJson(char *buffer, uint16_t size,
+                                uint32_t &cursor) {
+    if (cursor) {
+        return 0;
+    }
+    cursor = 1;
+
+    char number[FORMAT_INT_BUFFER_SIZE];
+    uint16_t length = 0;
+    Append(buffer, size, length, "{\"status\":");
+    FormatUint(number, StatusMgr.StatusRT().reg);
+    Append(buffer, size, length, number);
+    Append(buffer, size, length, ",\"inputs\":");
+    FormatUint(number, InputMgr.InputsRT().reg);
+    Append(buffer, size, length, number);
+    Append(buffer, size, length, ",\"uptimeMs\":");
+    FormatUint(number, Milliseconds());
+    Append(buffer, size, length, number);
+    Append(buffer, size, length, "}");
+    return length;
+}
+
+void HttpServer::ClientAccept() {
+    while (true) {
+        EthernetTcpClient client = m_server.Accept();
+        if (!client.ConnectionState()) {
+            return;
+        }
+        uint8_t slot = 0;
+        while (slot < HTTP_CLIENTS_MAX &&
+                m_connections[slot].Client.ConnectionState()) {
+            slot++;
+        }
+        if (slot == HTTP_CLIENTS_MAX) {
+            // Every slot is taken; turn the client away
+            client.Close();
+            continue;
+        }
+        Connection &connection = m_connections[slot];
+        connection.Client = client;
+        connection.Sending = nullptr;
+        connection.Cursor = 0;
+        connection.Close = false;
+        connection.LastActivityMs = Milliseconds();
+    }
+}
+
+void HttpServer::RequestProcess(Connection &connection) {
+    EthernetTcpClient &client = connection.Client;
+    int16_t available = client.BytesAvailable();
+    if (available <= 0) {
+        if (Milliseconds() - connection.LastActivityMs >
+                HTTP_KEEPALIVE_TIMEOUT_MS) {
+            client.Close();
+        }
+        return;
+    }
+
+    // Leave the request in the receive queue until all of its header is in
+    uint16_t length = client.Peek(reinterpret_cast<uint8_t *>(m_request),
+                                  min(available, HTTP_REQUEST_MAX));
+    m_request[length] = '\0';
+    char *headerEnd = strstr(m_request, "\r\n\r\n");
+    if (!headerEnd) {
+        if (length >= HTTP_REQUEST_MAX) {
+            connection.Close = true;
+            ResponseError(connection, "431 Request Header Fields Too Large");
+        }
+        return;
+    }
+    headerEnd[2] = '\0';
+    connection.LastActivityMs = Milliseconds();
+
+    bool head = !strncmp(m_request, "HEAD ", 5);
+    if (!head && strncmp(m_request, "GET ", 4)) {
+        // A body may follow that isn't read, so the stream can't continue
+        connection.Close = true;
+        ResponseError(connection, "405 Method Not Allowed");
+        return;
+    }
+    char *path = strchr(m_request, ' ') + 1;
+    char *lineEnd = strstr(m_request, "\r\n");
+    uint16_t pathLength = strcspn(path, " ?\r");
+    // HTTP/1.1 connections stay open unless the client asks otherwise
+    connection.Close = lineEnd - path < 8 ||
+                       strncmp(lineEnd - 8, "HTTP/1.1", 8) ||
+                       HeaderHas(m_request, "connection", "close");
+
+    // Done with the request
+    uint16_t consumed = headerEnd + 4 - m_request;
+    while (consumed > 0) {
+        uint16_t bytes = min(consumed, sizeof(m_chunk));
+        client.Read(reinterpret_cast<uint8_t *>(m_chunk), bytes);
+        consumed -= bytes;
+    }
+
+    const Route *route = nullptr;
+    for (uint8_t i = 0; i < m_routeCount; i++) {
+        if (strlen(m_routes[i].Path) == pathLength &&
+                !strncmp(m_routes[i].Path, path, pathLength)) {
+            route = &m_routes[i];
+            break;
+        }
+    }
+    if (!route || !route->Body) {
+        ResponseError(connection, "404 Not Found");
+        return;
+    }
+
+    uint16_t headerLength = 0;
+    Append(m_chunk, sizeof(m_chunk), headerLength,
+           "HTTP/1.1 200 OK\r\nContent-Type: ");
+    Append(m_chunk, sizeof(m_chunk), headerLength,
+           route->ContentType ? route->ContentType : "text/plain");
+    Append(m_chunk, sizeof(m_chunk), headerLength,
+           "\r\nTransfer-Encoding: chunked\r\nConnection: ");
+    Append(m_chunk, sizeof(m_chunk), headerLength,
+           connection.Close ? "close\r\n\r\n" : "keep-alive\r\n\r\n");
+    client.Send(reinterpret_cast<uint8_t *>(m_chunk), headerLength);
+
+    if (head) {
+        if (connection.Close) {
+            client.Close();
+        }
+        return;
+    }
+    connection.Sending = route;
+    connection.Cursor = 0;
+}
+
+void HttpServer::ResponseContinue(Connection &connection) {
+    EthernetTcpClient &client = connection.Client;
+    // Only generate what can be queued right away
+    if (client.SendSpace() < HTTP_CHUNK_MAX + CHUNK_FRAMING_LEN) {
+        return;
+    }
+
+    uint16_t bodyLength = connection.Sending->Body(
+                              m_chunk + CHUNK_PREFIX_LEN, HTTP_CHUNK_MAX,
+                              connection.Cursor);
+    connection.LastActivityMs = Milliseconds();
+    if (bodyLength == 0) {
+        client.Send(reinterpret_cast<const uint8_t *>(HttpLastChunk),
+                    sizeof(HttpLastChunk) - 1);
+        connection.Sending = nullptr;
+        if (connection.Close) {
+            client.Close();
+        }
+        return;
+    }
+
+    static const char hex[] = "0123456789ABCDEF";
+    bodyLength = min(bodyLength, HTTP_CHUNK_MAX);
+    m_chunk[0] = hex[(bodyLength >> 8) & 0xF];
+    m_chunk[1] = hex[(bodyLength >> 4) & 0xF];
+    m_chunk[2] = hex[bodyLength & 0xF];
+    m_chunk[3] = '\r';
+    m_chunk[4] = '\n';
+    m_chunk[CHUNK_PREFIX_LEN + bodyLength] = '\r';
+    m_chunk[CHUNK_PREFIX_LEN + bodyLength + 1] = '\n';
+    client.Send(reinterpret_cast<uint8_t *>(m_chunk),
+                bodyLength + CHUNK_FRAMING_LEN);
+}
+
+void HttpServer::ResponseError(Connection &connection, const char *status) {
+    uint16_t length = 0;
+    Append(m_chunk, sizeof(m_chunk), length, "HTTP/1.1 ");
+    Append(m_chunk, sizeof(m_chunk), length, status);
+    Append(m_chunk, sizeof(m_chunk), length,
+           "\r\nContent-Length: 0\r\nConnection: ");
+    Append(m_chunk, sizeof(m_chunk), length,
+           connection.Close ? "close\r\n\r\n" : "keep-alive\r\n\r\n");
+    connection.Client.Send(reinterpret_cast<uint8_t *>(m_chunk), length);
+    if (connection.Close) {
+        connection.Client.Close();
+    }
+}
+
+} // ClearCore namespace
@@ -30,10 +30,23 @@
 #include "InputManager.h"
 #include <stddef.h>
 #include "atomic_utils.h"
+#include "Connector.h"
+#include "MotorDriver.h"
+#include "PositionCapture.h"
+#include "QuadratureDecoder.h"
+#include "SysTiming.h"
 #include "SysUtils.h"
+#include "TaskManager.h"
 
 namespace ClearCore {
 
+extern volatile uint32_t tickCnt;
+extern EventManager &EventMgr;
+extern TaskManager &TaskMgr;
+
+// The timer that counts pulses in INPUT_COUNTER mode
+#define INPUT_COUNTER_TCC TCC2
+
 InputManager &InputMgr = InputManager::Instance();
 
 InputManager &InputManager::Instance() {
@@ -54,7 +67,51 @@ InputManager::InputManager()
       m_interruptsMask(0),
       m_interruptsEnabled(true),
       m_interruptServiceRoutines(),
-      m_oneTimeFlags(0) {}
+      m_oneTimeFlags(0),
+      m_captures(),
+      m_decoders(),
+      m_hlfbEdges(),
+      m_events(),
+      m_eventOverflows(0),
+      m_eventMask(0),
+      m_eventLines(0),
+      m_eventLinePinMask(),
+      m_eventLineIn(),
+      m_eventLineInMask(),
+      m_changeHandlers(),
+      m_changeMasks(),
+      m_changeHandlerCount(0),
+      m_changeWatch(0),
+      m_changePending(0),
+      m_changeTask(TASK_INVALID),
+      m_counterExtInt(-1),
+      m_counterHwLast(0),
+      m_counterCount(0),
+      m_counterGateStart(0),
+      m_counterGateTicks(INPUT_COUNTER_GATE_MS_DEFAULT * MS_TO_SAMPLES),
+      m_counterGateActive(0),
+      m_counterGateTicksLeft(0),
+      m_counterFrequency(0),
+      m_stepInputExtInt(-1),
+      m_stepInputDirExtInt(-1),
+      m_stepInputHwLast(0),
+      m_stepInputLast(0),
+      m_stepInputPosn(0),
+      m_hwFilterLines(0),
+      m_hwFilterUs(0),
+      m_hwFilterPrescaler(0),
+      m_filterPins(0),
+      m_filterPinPort(),
+      m_filterPinInMask(),
+      m_filterPortMasks(),
+      m_filterLength(),
+      m_filterCount(),
+      m_filterBits(0),
+      m_filterLengthNonzero(0),
+      m_filterCounting(0),
+      m_filterSettled(0) {
+    HardwareFilterSelect(INPUT_HW_FILTER_US_DEFAULT);
+}
 
 /**
     Initialize the InputManager.
@@ -101,7 +158,9 @@ bool InputManager::InterruptHandlerSet(int8_t extInt, voidFuncPtr callback,
     // Clear any existing interrupt flag
     EIC->INTFLAG.reg = (1UL << extInt);
 
-    if (callback != nullptr) {
+    if (callback != nullptr || m_captures[extInt] != nullptr ||
+            m_decoders[extInt] != nullptr || m_hlfbEdges[extInt] != nullptr ||
+            (m_eventLines & (1UL << extInt))) {
         // Clear the existing interrupt trigger condition
         uint8_t shiftAmt = 4 * (extInt % 8);
         EIC->CONFIG[extInt / 8].reg &= ~(0xf << shiftAmt);
@@ -132,6 +191,43 @@ bool InputManager::InterruptHandlerSet(int8_t extInt, voidFuncPtr callback,
     return true;
 }
 
+bool InputManager::EventOutputSet(int8_t extInt, InterruptTrigger trigger,
+                                  bool enable) {
+    if (extInt < 0 || extInt >= EIC_NUMBER_OF_INTERRUPTS) {
+        return false; // Invalid external interrupt number
+    }
+
+    // CONFIG and EVCTRL are enable-protected
+    EIC->CTRLA.bit.ENABLE = 0;
+    SYNCBUSY_WAIT(EIC, EIC_SYNCBUSY_ENABLE);
+
+    if (enable) {
+        uint8_t shiftAmt = 4 * (extInt % 8);
+        EIC->CONFIG[extInt / 8].reg &= ~(0xf << shiftAmt);
+        EIC->CONFIG[extInt / 8].reg |=
+            static_cast<uint32_t>(EicSense(trigger) << shiftAmt);
+        EIC->EVCTRL.reg |= 1UL << extInt;
+    }
+    else {
+        EIC->EVCTRL.reg &= ~(1UL << extInt);
+    }
+
+    EIC->CTRLA.bit.ENABLE = 1;
+    SYNCBUSY_WAIT(EIC, EIC_SYNCBUSY_ENABLE);
+    return true;
+}
+
+bool InputManager::EventRoute(int8_t extInt, InterruptTrigger trigger,
+                              uint8_t channel,
+                              EventManager::EventPaths path) {
+    if (extInt < 0 || extInt >= EIC_NUMBER_OF_INTERRUPTS ||
+            !EventMgr.Route(channel, EVSYS_ID_GEN_EIC_EXTINT_0 + extInt,
+                            path, EventManager::EVENT_EDGE_RISING)) {
+        return false;
+    }
+    return EventOutputSet(extInt, trigger, true);
+}
+
 void InputManager::InterruptEnable(int8_t extInt, bool enable,
                                    bool clearPending) {
     if (extInt < 0 || extInt >= EIC_NUMBER_OF_INTERRUPTS) {
@@ -168,6 +264,11 @@ void InputManager::InterruptsEnabled(bool enable) {
 
 void InputManager::EIC_Handler(uint8_t index) {
     if (index < EIC_NUMBER_OF_INTERRUPTS) {
+        // Latch the position first to keep the capture close to the edge
+        PositionCapture *capture = m_captures[index];
+        if (capture != nullptr) {
+            capture->Latch();
+        }
         // If this is a one time interrupt, disable the interrupt.
         if (m_oneTimeFlags & (1UL << index)) {
             atomic_and_fetch(&m_interruptsMask, ~(1UL << index));
@@ -175,6 +276,20 @@ void InputManager::EIC_Handler(uint8_t index) {
         }
         // Ack the interrupt early so that we don't miss subsequent events
         EIC->INTFLAG.reg = 1UL << index;
+        // Decode after the ack so an edge during the read interrupts again
+        QuadratureDecoder *decoder = m_decoders[index];
+        if (decoder != nullptr) {
+            decoder->Edge();
+        }
+        MotorDriver *motor = m_hlfbEdges[index];
+        if (motor != nullptr) {
+            motor->HlfbEdge();
+        }
+        if (m_eventLines & (1UL << index)) {
+            uint32_t pinMask = m_eventLinePinMask[index];
+            bool state = !(*m_eventLineIn[index] & m_eventLineInMask[index]);
+            EventPush(pinMask, state ? pinMask : 0);
+        }
         voidFuncPtr callback = m_interruptServiceRoutines[index];
         if (callback != nullptr) {
             callback();
@@ -188,6 +303,10 @@ void InputManager::UpdateBegin() {
         m_inputsUnfiltered[iPort] = *m_inputPtrs[iPort];
         m_inputsUnfilteredChanges[iPort] = m_inputsUnfiltered[iPort] ^ last;
     }
+    // Before the motors refresh so geared axes follow in the same sample
+    if (m_stepInputExtInt >= 0) {
+        StepInputUpdate();
+    }
 }
 
 void InputManager::UpdateEnd() {
@@ -195,6 +314,21 @@ void InputManager::UpdateEnd() {
                     m_inputRegRT.reg & (~m_inputRegLast.reg));
     atomic_fetch_or(&m_inputRegFallen.reg,
                     (~m_inputRegRT.reg) & m_inputRegLast.reg);
+    if (m_counterExtInt >= 0) {
+        CounterUpdate();
+    }
+    uint32_t changes = (m_inputRegRT.reg ^ m_inputRegLast.reg) &
+                       m_eventMask.reg;
+    if (changes) {
+        EventPush(changes, m_inputRegRT.reg & changes);
+    }
+    changes = (m_inputRegRT.reg ^ m_inputRegLast.reg) & m_changeWatch.reg;
+    if (changes) {
+        atomic_fetch_or(&m_changePending.reg, changes);
+        if (m_changeTask != TASK_INVALID) {
+            TaskMgr.TaskSignal(m_changeTask);
+        }
+    }
     m_inputRegLast.reg = m_inputRegRT.reg;
 }
 
@@ -216,4 +350,402 @@ SysConnectorState InputManager::InputsRT(SysConnectorState mask) {
     return retVal;
 }
 
+bool InputManager::ChangeHandlerAdd(SysConnectorState mask,
+                                    ChangeHandler handler) {
+    uint8_t count = m_changeHandlerCount;
+    if (!handler || count >= INPUT_CHANGE_HANDLERS_MAX) {
+        return false;
+    }
+    m_changeHandlers[count] = handler;
+    m_changeMasks[count] = mask;
+    // Publish the handler before the sample update starts watching its mask
+    atomic_store_n(&m_changeHandlerCount, count + 1);
+    atomic_fetch_or(&m_changeWatch.reg, mask.reg);
+    return true;
+}
+
+SysConnectorState InputManager::ChangeDispatch() {
+    SysConnectorState changed;
+    changed.reg = atomic_exchange_n(&m_changePending.reg, 0);
+    if (!changed.reg) {
+        return changed;
+    }
+    SysConnectorState state = InputsRT();
+    uint8_t count = m_changeHandlerCount;
+    for (uint8_t i = 0; i < count; i++) {
+        SysConnectorState handlerChanged;
+        handlerChanged.reg = changed.reg & m_changeMasks[i].reg;
+        if (handlerChanged.reg) {
+            m_changeHandlers[i](handlerChanged, state);
+        }
+    }
+    return changed;
+}
+
+bool InputManager::EventGet(InputEvent &event) {
+    return m_events.Pop(event);
+}
+
+void InputManager::EventFifoClear() {
+    m_events.ReadCommit(m_events.Count());
+    m_eventOverflows = 0;
+}
+
+void InputManager::EventPush(uint32_t mask, uint32_t state) {
+    // Pushed from both the sample update and the EIC interrupt, which run
+    // at different priorities, so the writers take turns
+    InputEvent event;
+    event.Mask.reg = mask;
+    event.State.reg = state;
+    __disable_irq();
+    event.Tick = tickCnt;
+    event.Cycles = DWT->CYCCNT;
+    if (!m_events.Push(event)) {
+        m_eventOverflows = m_eventOverflows + 1;
+    }
+    __enable_irq();
+}
+
+bool InputManager::EventLineSet(int8_t extInt, uint32_t pinMask,
+                                uint32_t port, uint32_t inMask, bool enable) {
+    if (extInt < 0 || extInt >= EIC_NUMBER_OF_INTERRUPTS) {
+        return false;
+    }
+    if (!enable) {
+        m_eventLines &= ~(1UL << extInt);
+        // Leave the line running for anything else that uses it
+        if (!m_interruptServiceRoutines[extInt] && !m_captures[extInt] &&
+                !m_decoders[extInt] && !m_hlfbEdges[extInt]) {
+            InterruptEnable(extInt, false);
+        }
+        return true;
+    }
+    m_eventLinePinMask[extInt] = pinMask;
+    m_eventLineIn[extInt] = &PORT->Group[port].IN.reg;
+    m_eventLineInMask[extInt] = inMask;
+    m_eventLines |= (1UL << extInt);
+    // Both edges are needed; keep any callback registered on the line
+    return InterruptHandlerSet(extInt, m_interruptServiceRoutines[extInt],
+                               CHANGE, true, false);
+}
+
+bool InputManager::CounterStart(int8_t extInt) {
+    if (extInt < 0 || extInt >= EIC_NUMBER_OF_INTERRUPTS ||
+            m_counterExtInt >= 0 || m_stepInputExtInt >= 0) {
+        return false;
+    }
+    Tcc *tcc = INPUT_COUNTER_TCC;
+    SET_CLOCK_SOURCE(TCC2_GCLK_ID, 0);
+    CLOCK_ENABLE(APBCMASK, TCC2_);
+    // The timer may be pacing IO-0's analog output waveform
+    if (tcc->CTRLA.bit.ENABLE) {
+        return false;
+    }
+    tcc->CTRLA.reg = TCC_CTRLA_SWRST;
+    SYNCBUSY_WAIT(tcc, TCC_SYNCBUSY_SWRST);
+    // Count each event, wrapping at the full 16-bit range
+    tcc->EVCTRL.reg = TCC_EVCTRL_TCEI0 | TCC_EVCTRL_EVACT0_COUNT;
+    tcc->PER.reg = UINT16_MAX;
+    SYNCBUSY_WAIT(tcc, TCC_SYNCBUSY_PER);
+
+    // The TCC takes resynchronized events
+    EventMgr.UserAdd(EVENT_INPUT_COUNTER, EVSYS_ID_USER_TCC2_EV_0);
+    EventRoute(extInt, RISING, EVENT_INPUT_COUNTER,
+               EventManager::EVENT_PATH_RESYNCHRONIZED);
+
+    tcc->CTRLA.bit.ENABLE = 1;
+    SYNCBUSY_WAIT(tcc, TCC_SYNCBUSY_ENABLE);
+
+    __disable_irq();
+    m_counterHwLast = 0;
+    m_counterCount = 0;
+    m_counterGateStart = 0;
+    m_counterGateActive = m_counterGateTicks;
+    m_counterGateTicksLeft = m_counterGateActive;
+    m_counterFrequency = 0;
+    m_counterExtInt = extInt;
+    __enable_irq();
+    return true;
+}
+
+void InputManager::CounterStop() {
+    int8_t extInt = m_counterExtInt;
+    if (extInt < 0) {
+        return;
+    }
+    m_counterExtInt = -1;
+    EventOutputSet(extInt, RISING, false);
+    EventMgr.UserRemove(EVSYS_ID_USER_TCC2_EV_0);
+    EventMgr.Route(EVENT_INPUT_COUNTER, 0);
+    INPUT_COUNTER_TCC->CTRLA.bit.ENABLE = 0;
+    SYNCBUSY_WAIT(INPUT_COUNTER_TCC, TCC_SYNCBUSY_ENABLE);
+}
+
+void InputManager::CounterReset() {
+    __disable_irq();
+    // Keep the open gate's pulses so the next frequency is unaffected
+    m_counterGateStart -= m_counterCount;
+    m_counterCount = 0;
+    __enable_irq();
+}
+
+void InputManager::CounterUpdate() {
+    Tcc *tcc = INPUT_COUNTER_TCC;
+    tcc->CTRLBSET.reg = TCC_CTRLBSET_CMD_READSYNC;
+    SYNCBUSY_WAIT(tcc, TCC_SYNCBUSY_COUNT);
+    uint16_t hwCount = tcc->COUNT.reg;
+    m_counterCount += static_cast<uint16_t>(hwCount - m_counterHwLast);
+    m_counterHwLast = hwCount;
+
+    if (m_counterGateTicksLeft && --m_counterGateTicksLeft) {
+        return;
+    }
+    m_counterFrequency = static_cast<float>(m_counterCount -
+                                            m_counterGateStart) *
+                         _CLEARCORE_SAMPLE_RATE_HZ / m_counterGateActive;
+    // A new gate time takes effect from the next gate
+    m_counterGateStart = m_counterCount;
+    m_counterGateActive = m_counterGateTicks;
+    m_counterGateTicksLeft = m_counterGateActive;
+}
+
+bool InputManager::StepInputStart(Connector &step, Connector &direction,
+                                  bool directionInvert) {
+    int8_t extInt = step.ExternalInterrupt();
+    int8_t dirExtInt = direction.ExternalInterrupt();
+    if (extInt < 0 || dirExtInt < 0 || extInt == dirExtInt ||
+            m_stepInputExtInt >= 0 || m_counterExtInt >= 0) {
+        return false;
+    }
+    Tcc *tcc = INPUT_COUNTER_TCC;
+    SET_CLOCK_SOURCE(TCC2_GCLK_ID, 0);
+    CLOCK_ENABLE(APBCMASK, TCC2_);
+    // The timer may be pacing IO-0's analog output waveform
+    if (tcc->CTRLA.bit.ENABLE) {
+        return false;
+    }
+    tcc->CTRLA.reg = TCC_CTRLA_SWRST;
+    SYNCBUSY_WAIT(tcc, TCC_SYNCBUSY_SWRST);
+    // Count each step event, down while the direction event is active
+    tcc->EVCTRL.reg = TCC_EVCTRL_TCEI0 | TCC_EVCTRL_EVACT0_COUNT |
+                      TCC_EVCTRL_TCEI1 | TCC_EVCTRL_EVACT1_DIR;
+    tcc->PER.reg = UINT16_MAX;
+    SYNCBUSY_WAIT(tcc, TCC_SYNCBUSY_PER);
+
+    EventMgr.UserAdd(EVENT_INPUT_COUNTER, EVSYS_ID_USER_TCC2_EV_0);
+    EventRoute(extInt, RISING, EVENT_INPUT_COUNTER,
+               EventManager::EVENT_PATH_RESYNCHRONIZED);
+    // The direction is a level, so it takes the asynchronous path from a
+    // level-sensed line
+    EventMgr.UserAdd(EVENT_INPUT_STEP_DIR, EVSYS_ID_USER_TCC2_EV_1);
+    EventRoute(dirExtInt, directionInvert ? LOW : HIGH, EVENT_INPUT_STEP_DIR);
+
+    tcc->CTRLA.bit.ENABLE = 1;
+    SYNCBUSY_WAIT(tcc, TCC_SYNCBUSY_ENABLE);
+
+    __disable_irq();
+    m_stepInputHwLast = 0;
+    m_stepInputLast = 0;
+    m_stepInputPosn = 0;
+    m_stepInputDirExtInt = dirExtInt;
+    m_stepInputExtInt = extInt;
+    __enable_irq();
+    return true;
+}
+
+void InputManager::StepInputStop() {
+    int8_t extInt = m_stepInputExtInt;
+    if (extInt < 0) {
+        return;
+    }
+    m_stepInputExtInt = -1;
+    m_stepInputLast = 0;
+    EventOutputSet(extInt, RISING, false);
+    EventOutputSet(m_stepInputDirExtInt, HIGH, false);
+    m_stepInputDirExtInt = -1;
+    EventMgr.UserRemove(EVSYS_ID_USER_TCC2_EV_0);
+    EventMgr.UserRemove(EVSYS_ID_USER_TCC2_EV_1);
+    EventMgr.Route(EVENT_INPUT_COUNTER, 0);
+    EventMgr.Route(EVENT_INPUT_STEP_DIR, 0);
+    INPUT_COUNTER_TCC->CTRLA.bit.ENABLE = 0;
+    SYNCBUSY_WAIT(INPUT_COUNTER_TCC, TCC_SYNCBUSY_ENABLE);
+}
+
+void InputManager::StepInputUpdate() {
+    Tcc *tcc = INPUT_COUNTER_TCC;
+    tcc->CTRLBSET.reg = TCC_CTRLBSET_CMD_READSYNC;
+    SYNCBUSY_WAIT(tcc, TCC_SYNCBUSY_COUNT);
+    uint16_t hwCount = tcc->COUNT.reg;
+    // The 16-bit count wraps; the difference is right as long as fewer
+    // than 32768 pulses arrive in a sample
+    int16_t steps = static_cast<int16_t>(hwCount - m_stepInputHwLast);
+    m_stepInputHwLast = hwCount;
+    m_stepInputLast = steps;
+    m_stepInputPosn += steps;
+}
+
+uint32_t InputManager::HardwareFilterUs(uint32_t us) {
+    HardwareFilterSelect(us);
+    if (m_hwFilterLines) {
+        // DPRESCALER is enable-protected
+        EIC->CTRLA.bit.ENABLE = 0;
+        SYNCBUSY_WAIT(EIC, EIC_SYNCBUSY_ENABLE);
+        EIC->DPRESCALER.reg = m_hwFilterPrescaler;
+        EIC->CTRLA.bit.ENABLE = 1;
+        SYNCBUSY_WAIT(EIC, EIC_SYNCBUSY_ENABLE);
+    }
+    return m_hwFilterUs;
+}
+
+void InputManager::HardwareFilterSelect(uint32_t us) {
+    // Search the tick dividers (2 to 256) and hold counts (3 or 7) for the
+    // shortest debounce time that is long enough, else the longest one
+    bool found = false;
+    uint32_t bestUs = 0;
+    uint32_t bestReg = 0;
+    for (uint8_t states = 0; states < 2; states++) {
+        uint32_t holdTicks = states ? 7 : 3;
+        for (uint8_t prescaler = 0; prescaler < 8; prescaler++) {
+            uint32_t debounceUs = static_cast<uint32_t>(
+                ((holdTicks << (prescaler + 1)) * 1000000ULL) >> 15);
+            bool fits = debounceUs >= us;
+            if (fits ? (!found || debounceUs < bestUs) :
+                    (!found && debounceUs > bestUs)) {
+                found = found || fits;
+                bestUs = debounceUs;
+                bestReg = EIC_DPRESCALER_PRESCALER0(prescaler) |
+                          EIC_DPRESCALER_PRESCALER1(prescaler) |
+                          (states ? (EIC_DPRESCALER_STATES0 |
+                                     EIC_DPRESCALER_STATES1) : 0);
+            }
+        }
+    }
+    // Tick from the 32.768 kHz ultra low power clock
+    m_hwFilterPrescaler = bestReg | EIC_DPRESCALER_TICKON;
+    m_hwFilterUs = bestUs;
+}
+
+void InputManager::FilterBankAdd(ClearCorePins pin, uint32_t port,
+                                 uint32_t inMask) {
+    if (pin < 0 || pin >= INPUT_FILTER_PINS || port >= CLEARCORE_PORT_MAX) {
+        return;
+    }
+    __disable_irq();
+    m_filterPinPort[pin] = port;
+    m_filterPinInMask[pin] = inMask;
+    m_filterPortMasks[port] |= inMask;
+    m_filterPins |= 1UL << pin;
+    __enable_irq();
+}
+
+void InputManager::FilterBankLength(ClearCorePins pin, uint16_t length,
+                                    uint16_t ticksLeft) {
+    if (pin < 0 || pin >= INPUT_FILTER_PINS) {
+        return;
+    }
+    uint32_t pinMask = 1UL << pin;
+    __disable_irq();
+    uint32_t planesUsed = 0;
+    for (uint8_t bit = 0; bit < INPUT_FILTER_BITS; bit++) {
+        uint32_t bitMask = 1UL << bit;
+        m_filterLength[bit] = (length & bitMask) ?
+                              (m_filterLength[bit] | pinMask) :
+                              (m_filterLength[bit] & ~pinMask);
+        m_filterCount[bit] = (ticksLeft & bitMask) ?
+                             (m_filterCount[bit] | pinMask) :
+                             (m_filterCount[bit] & ~pinMask);
+        if (m_filterLength[bit] | m_filterCount[bit]) {
+            planesUsed = bit + 1;
+        }
+    }
+    m_filterBits = planesUsed;
+    m_filterLengthNonzero = length ? (m_filterLengthNonzero | pinMask) :
+                            (m_filterLengthNonzero & ~pinMask);
+    m_filterCounting = ticksLeft ? (m_filterCounting | pinMask) :
+                       (m_filterCounting & ~pinMask);
+    __enable_irq();
+}
+
+void InputManager::FilterBankUpdate() {
+    // Gather the changes of the banked inputs into connector order, which
+    // only costs anything in a sample where one of them changed
+    uint32_t changes = 0;
+    uint32_t portChanges = 0;
+    for (uint8_t iPort = 0; iPort < CLEARCORE_PORT_MAX; iPort++) {
+        portChanges |= m_inputsUnfilteredChanges[iPort] &
+                       m_filterPortMasks[iPort];
+    }
+    if (portChanges) {
+        for (uint8_t pin = 0; pin < INPUT_FILTER_PINS; pin++) {
+            if (m_inputsUnfilteredChanges[m_filterPinPort[pin]] &
+                    m_filterPinInMask[pin]) {
+                changes |= 1UL << pin;
+            }
+        }
+        changes &= m_filterPins;
+    }
+
+    uint32_t settled = 0;
+    uint32_t counting = m_filterCounting & ~changes;
+    if (counting) {
+        // Count every running filter down by one together, rippling the
+        // borrow up the planes; a running count is never zero, so the
+        // borrow dies out within the used planes
+        uint32_t borrow = counting;
+        uint32_t remaining = 0;
+        for (uint8_t bit = 0; bit < m_filterBits; bit++) {
+            uint32_t plane = m_filterCount[bit];
+            m_filterCount[bit] = plane ^ borrow;
+            borrow &= ~plane;
+            remaining |= m_filterCount[bit];
+        }
+        settled = counting & ~remaining;
+    }
+    if (changes) {
+        // Restart the changed inputs' filters at their lengths
+        for (uint8_t bit = 0; bit < m_filterBits; bit++) {
+            m_filterCount[bit] = (m_filterCount[bit] & ~changes) |
+                                 (m_filterLength[bit] & changes);
+        }
+        // A zero length filter passes the change straight through
+        settled |= changes & ~m_filterLengthNonzero;
+    }
+    m_filterCounting = (m_filterCounting & ~(settled | changes)) |
+                       (changes & m_filterLengthNonzero);
+    m_filterSettled = settled;
+}
+
+bool InputManager::HardwareFilterSet(int8_t extInt, bool enable) {
+    if (extInt < 0 || extInt >= EIC_NUMBER_OF_INTERRUPTS) {
+        return false;
+    }
+    // The debouncer does not work on asynchronous lines, such as HLFB
+    if (enable && (EIC->ASYNCH.reg & (1UL << extInt))) {
+        return false;
+    }
+
+    EIC->CTRLA.bit.ENABLE = 0;
+    SYNCBUSY_WAIT(EIC, EIC_SYNCBUSY_ENABLE);
+    if (enable) {
+        m_hwFilterLines |= 1UL << extInt;
+        EIC->DPRESCALER.reg = m_hwFilterPrescaler;
+        EIC->DEBOUNCEN.reg |= 1UL << extInt;
+        // The debounced state needs edge detection; without an interrupt
+        // or event on the line, watch both edges with the interrupt off
+        uint8_t shiftAmt = 4 * (extInt % 8);
+        uint32_t senseMask = EIC_CONFIG_SENSE0_Msk << shiftAmt;
+        if (!(EIC->CONFIG[extInt / 8].reg & senseMask)) {
+            EIC->CONFIG[extInt / 8].reg |=
+                static_cast<uint32_t>(EIC_CONFIG_SENSE0_BOTH << shiftAmt);
+        }
+    }
+    else {
+        m_hwFilterLines &= ~(1UL << extInt);
+        EIC->DEBOUNCEN.reg &= ~(1UL << extInt);
+    }
+    EIC->CTRLA.bit.ENABLE = 1;
+    SYNCBUSY_WAIT(EIC, EIC_SYNCBUSY_ENABLE);
+    return true;
+}
+
 } // ClearCore namespace
@@ -0,0 +1,486 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    ClearCore journaled key/value store in flash
+**/
+
+#include "KeyValueStore.h"
+#include <string.h>
+#include <sam.h>
+#include "CacheManager.h"
+#include "CrcManager.h"
+#include "NvmManager.h"
+
+// Flash is programmed a quad-word at a time, and a quad-word may only be
+// programmed once between erases
+#define KV_QW_SIZE 16
+#define KV_QW_WORDS (KV_QW_SIZE / sizeof(uint32_t))
+#define KV_QW_PER_BLOCK (NVMCTRL_BLOCK_SIZE / KV_QW_SIZE)
+
+// A record is a header word (key, length, and inverted length), a CRC word,
+// and the value, padded out to whole quad-words. A zero length record
+// removes the key.
+#define KV_RECORD_HEADER_SIZE 8
+#define KV_RECORD_QW(len) \
+    ((KV_RECORD_HEADER_SIZE + (len) + KV_QW_SIZE - 1) / KV_QW_SIZE)
+#define KV_RECORD_QW_MAX KV_RECORD_QW(KV_STORE_VALUE_MAX)
+
+// The first quad-word of a block holds the magic number and the block's
+// sequence number, which increases each time a block is started
+#define KV_BLOCK_MAGIC 0x3153564B
+#define KV_INDEX_NONE UINT16_MAX
+
+// Compaction is started once fewer quad-words than this are free
+#define KV_COMPACT_RESERVE_QW (KV_QW_PER_BLOCK / 4)
+
+#define KV_FLASH_ERRORS (NVMCTRL_INTFLAG_ADDRE | NVMCTRL_INTFLAG_PROGE | \
+                         NVMCTRL_INTFLAG_LOCKE | NVMCTRL_INTFLAG_NVME)
+
+static_assert(KV_STORE_BLOCKS >= 2,
+              "The key/value store needs at least two blocks");
+static_assert(KV_STORE_VALUE_MAX < UINT8_MAX,
+              "KV_STORE_VALUE_MAX must fit the 8-bit record length");
+static_assert(KV_STORE_KEYS * KV_RECORD_QW_MAX + 1 <=
+              KV_QW_PER_BLOCK - 2 * KV_COMPACT_RESERVE_QW,
+              "A value for every key must fit well within one block");
+static_assert(KV_STORE_BLOCKS * KV_QW_PER_BLOCK < KV_INDEX_NONE,
+              "The key/value store region is too large to index");
+
+namespace ClearCore {
+
+extern CacheManager &CacheMgr;
+extern CrcManager &CrcMgr;
+extern NvmManager &NvmMgr;
+
+KeyValueStore &KvStore = KeyValueStore::Instance();
+
+static uint32_t *QwAddr(uint16_t qwIndex) {
+    return reinterpret_cast<uint32_t *>(KV_STORE_ADDR) +
+           qwIndex * KV_QW_WORDS;
+}
+
+static uint16_t BlockStart(uint8_t block) {
+    return block * KV_QW_PER_BLOCK;
+}
+
+static uint32_t RecordCrc(const uint32_t *record, uint8_t length) {
+    uint32_t crc = CrcMgr.Crc32(record, sizeof(uint32_t));
+    return CrcMgr.Crc32(record + 2, length, crc);
+}
+
+static uint32_t RecordHeader(uint16_t key, uint8_t length) {
+    return key | (static_cast<uint32_t>(length) << 16) |
+           (static_cast<uint32_t>(~length & 0xFF) << 24);
+}
+
+static bool RecordHeaderParse(uint32_t header, uint16_t &key,
+                              uint8_t &length) {
+    key = header & 0xFFFF;
+    length = (header >> 16) & 0xFF;
+    return (header >> 24) == (~length & 0xFFu) &&
+           length <= KV_STORE_VALUE_MAX;
+}
+
+static uint8_t RecordLength(uint16_t qwIndex) {
+    return (QwAddr(qwIndex)[0] >> 16) & 0xFF;
+}
+
+static void FlashWait() {
+    while (!NVMCTRL->STATUS.bit.READY) {
+        continue;
+    }
+}
+
+// A user page write run from the SysTick update must not come between the
+// commands of a program or erase, so finish it first
+static bool QwProgram(uint32_t *addr, const uint32_t *data) {
+    NvmMgr.FinishNvmWrite();
+    FlashWait();
+    NVMCTRL->CTRLA.bit.WMODE = NVMCTRL_CTRLA_WMODE_MAN;
+    NVMCTRL->CTRLB.reg = NVMCTRL_CTRLB_CMDEX_KEY | NVMCTRL_CTRLB_CMD_PBC;
+    FlashWait();
+    NVMCTRL->INTFLAG.reg = KV_FLASH_ERRORS;
+    // Load the page buffer, then program the quad-word
+    for (uint8_t i = 0; i < KV_QW_WORDS; i++) {
+        addr[i] = data[i];
+    }
+    NVMCTRL->ADDR.reg = reinterpret_cast<uint32_t>(addr);
+    NVMCTRL->CTRLB.reg = NVMCTRL_CTRLB_CMDEX_KEY | NVMCTRL_CTRLB_CMD_WQW;
+    FlashWait();
+    return !(NVMCTRL->INTFLAG.reg & KV_FLASH_ERRORS);
+}
+
+static void BlockEraseStart(uint8_t block) {
+    NvmMgr.FinishNvmWrite();
+    FlashWait();
+    NVMCTRL->INTFLAG.reg = KV_FLASH_ERRORS;
+    NVMCTRL->ADDR.reg = reinterpret_cast<uint32_t>(QwAddr(BlockStart(block)));
+    NVMCTRL->CTRLB.reg = NVMCTRL_CTRLB_CMDEX_KEY | NVMCTRL_CTRLB_CMD_EB;
+}
+
+static bool BlockBlank(uint8_t block) {
+    const uint32_t *word = QwAddr(BlockStart(block));
+    for (uint16_t i = 0; i < KV_QW_PER_BLOCK * KV_QW_WORDS; i++) {
+        if (word[i] != UINT32_MAX) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool BlockHeaderValid(uint8_t block, uint32_t &sequence) {
+    const uint32_t *header = QwAddr(BlockStart(block));
+    sequence = header[1];
+    return header[0] == KV_BLOCK_MAGIC && header[2] == ~header[1];
+}
+
+static bool BlockHeaderProgram(uint8_t block, uint32_t sequence) {
+    uint32_t header[KV_QW_WORDS] = {KV_BLOCK_MAGIC, sequence, ~sequence, 0};
+    bool programmed = QwProgram(QwAddr(BlockStart(block)), header);
+    // The CPU cache may hold flash contents from before the program
+    CacheMgr.Invalidate();
+    return programmed;
+}
+
+KeyValueStore &KeyValueStore::Instance() {
+    static KeyValueStore *instance = new KeyValueStore();
+    return *instance;
+}
+
+KeyValueStore::KeyValueStore()
+    : m_index(),
+      m_sequence(0),
+      m_activeBlock(0),
+      m_oldBlock(-1),
+      m_writeQw(KV_QW_PER_BLOCK),
+      m_copyKey(0),
+      m_compactState(COMPACT_IDLE),
+      m_compactPending(false),
+      m_mounted(false) {}
+
+bool KeyValueStore::Write(uint16_t key, const void *data, uint8_t length) {
+    if (key >= KV_STORE_KEYS || !data || !length ||
+            length > KV_STORE_VALUE_MAX || !Mount()) {
+        return false;
+    }
+
+    uint16_t index = m_index[key];
+    if (index != KV_INDEX_NONE && RecordLength(index) == length &&
+            !memcmp(QwAddr(index) + 2, data, length)) {
+        return true;
+    }
+
+    uint32_t record[KV_RECORD_QW_MAX * KV_QW_WORDS];
+    memset(record, 0xFF, sizeof(record));
+    record[0] = RecordHeader(key, length);
+    memcpy(record + 2, data, length);
+    record[1] = RecordCrc(record, length);
+    return RecordAppend(key, record, length);
+}
+
+int16_t KeyValueStore::Read(uint16_t key, void *data, uint8_t length) {
+    if (key >= KV_STORE_KEYS || !Mount() || m_index[key] == KV_INDEX_NONE) {
+        return -1;
+    }
+
+    uint16_t index = m_index[key];
+    uint8_t storedLength = RecordLength(index);
+    if (data) {
+        memcpy(data, QwAddr(index) + 2,
+               length < storedLength ? length : storedLength);
+    }
+    return storedLength;
+}
+
+bool KeyValueStore::Contains(uint16_t key) {
+    return key < KV_STORE_KEYS && Mount() && m_index[key] != KV_INDEX_NONE;
+}
+
+bool KeyValueStore::Erase(uint16_t key) {
+    if (key >= KV_STORE_KEYS || !Mount()) {
+        return false;
+    }
+    if (m_index[key] == KV_INDEX_NONE) {
+        return true;
+    }
+
+    uint32_t record[KV_QW_WORDS];
+    memset(record, 0xFF, sizeof(record));
+    record[0] = RecordHeader(key, 0);
+    record[1] = RecordCrc(record, 0);
+    return RecordAppend(key, record, 0);
+}
+
+void KeyValueStore::Refresh() {
+    if (Mount()) {
+        CompactStep();
+    }
+}
+
+bool KeyValueStore::CompactionActive() {
+    return m_compactState != COMPACT_IDLE;
+}
+
+uint16_t KeyValueStore::FreeSpace() {
+    if (!Mount()) {
+        return 0;
+    }
+    return (KV_QW_PER_BLOCK - m_writeQw) * KV_QW_SIZE;
+}
+
+bool KeyValueStore::Mount() {
+    if (m_mounted) {
+        return true;
+    }
+
+    // Find the newest two blocks. Two valid blocks means power was lost
+    // during a compaction.
+    int8_t newest = -1;
+    int8_t older = -1;
+    uint32_t newestSequence = 0;
+    uint32_t olderSequence = 0;
+    for (uint8_t block = 0; block < KV_STORE_BLOCKS; block++) {
+        uint32_t sequence;
+        if (!BlockHeaderValid(block, sequence)) {
+            continue;
+        }
+        if (newest < 0 || sequence > newestSequence) {
+            older = newest;
+            olderSequence = newestSequence;
+            newest = block;
+            newestSequence = sequence;
+        }
+        else if (older < 0 || sequence > olderSequence) {
+            older = block;
+            olderSequence = sequence;
+        }
+    }
+
+    // Every other block must be blank before it can be started. This also
+    // clears a block whose erase or header was cut off.
+    for (uint8_t block = 0; block < KV_STORE_BLOCKS; block++) {
+        if (block != newest && block != older && !BlockBlank(block)) {
+            BlockEraseStart(block);
+            FlashWait();
+            CacheMgr.Invalidate();
+        }
+    }
+
+    if (newest < 0) {
+        // An empty store
+        if (NvmMgr.BlockWrite() || !BlockHeaderProgram(0, 1)) {
+            return false;
+        }
+        newest = 0;
+        newestSequence = 1;
+    }
+
+    memset(m_index, 0xFF, sizeof(m_index));
+    if (older >= 0) {
+        // Index the older block first so the newer records take precedence,
+        // then resume the compaction
+        BlockScan(older);
+        m_oldBlock = older;
+        m_copyKey = 0;
+        m_compactState = COMPACT_COPY;
+    }
+    m_activeBlock = newest;
+    m_sequence = newestSequence;
+    m_writeQw = BlockScan(newest);
+    m_compactPending = m_compactState == COMPACT_IDLE &&
+                       KV_QW_PER_BLOCK - m_writeQw < KV_COMPACT_RESERVE_QW;
+    m_mounted = true;
+    return true;
+}
+
+uint16_t KeyValueStore::BlockScan(uint8_t block) {
+    uint16_t qw = 1;
+    while (qw < KV_QW_PER_BLOCK) {
+        const uint32_t *record = QwAddr(BlockStart(block) + qw);
+        if (record[0] == UINT32_MAX) {
+            // Erased flash ends the log
+            break;
+        }
+        uint16_t key;
+        uint8_t length;
+        if (!RecordHeaderParse(record[0], key, length)) {
+            // A damaged header does not tell how long its record is
+            qw++;
+            continue;
+        }
+        if (key < KV_STORE_KEYS && record[1] == RecordCrc(record, length)) {
+            m_index[key] = length ? BlockStart(block) + qw : KV_INDEX_NONE;
+        }
+        qw += KV_RECORD_QW(length);
+    }
+    return qw < KV_QW_PER_BLOCK ? qw : KV_QW_PER_BLOCK;
+}
+
+bool KeyValueStore::RecordAppend(uint16_t key, const uint32_t *record,
+                                 uint8_t length) {
+    if (!SpaceReserve(KV_RECORD_QW(length))) {
+        return false;
+    }
+    if (!RecordProgram(key, record, length)) {
+        return false;
+    }
+    if (m_compactState == COMPACT_IDLE &&
+            KV_QW_PER_BLOCK - m_writeQw < KV_COMPACT_RESERVE_QW) {
+        m_compactPending = true;
+    }
+    return true;
+}
+
+bool KeyValueStore::RecordProgram(uint16_t key, const uint32_t *record,
+                                  uint8_t length) {
+    uint16_t qwCount = KV_RECORD_QW(length);
+    if (NvmMgr.BlockWrite() || KV_QW_PER_BLOCK - m_writeQw < qwCount) {
+        return false;
+    }
+
+    uint16_t index = BlockStart(m_activeBlock) + m_writeQw;
+    // Claim the space first; a record that is cut off is skipped over
+    m_writeQw += qwCount;
+    bool programmed = true;
+    for (uint16_t i = 0; i < qwCount && programmed; i++) {
+        programmed = QwProgram(QwAddr(index + i), record + i * KV_QW_WORDS);
+    }
+    CacheMgr.Invalidate();
+    if (!programmed) {
+        return false;
+    }
+    m_index[key] = length ? index : KV_INDEX_NONE;
+    return true;
+}
+
+bool KeyValueStore::SpaceReserve(uint16_t qwCount) {
+    uint16_t needed = qwCount;
+    if (m_compactState == COMPACT_COPY) {
+        // Leave room for the records that are still to be copied
+        needed += (KV_STORE_KEYS - m_copyKey) * KV_RECORD_QW_MAX;
+    }
+    if (KV_QW_PER_BLOCK - m_writeQw >= needed) {
+        return true;
+    }
+
+    CompactFinish();
+    if (KV_QW_PER_BLOCK - m_writeQw < qwCount) {
+        if (!CompactStart()) {
+            return false;
+        }
+        CompactFinish();
+    }
+    return KV_QW_PER_BLOCK - m_writeQw >= qwCount;
+}
+
+bool KeyValueStore::CompactStart() {
+    if (m_compactState != COMPACT_IDLE || NvmMgr.BlockWrite()) {
+        return false;
+    }
+
+    // Start the next block. The old block stays valid until every newest
+    // record has been copied out of it.
+    uint8_t next = (m_activeBlock + 1) % KV_STORE_BLOCKS;
+    if (!BlockHeaderProgram(next, m_sequence + 1)) {
+        // Clear whatever was programmed so the block can be started again
+        BlockEraseStart(next);
+        FlashWait();
+        CacheMgr.Invalidate();
+        return false;
+    }
+    m_oldBlock = m_activeBlock;
+    m_activeBlock = next;
+    m_sequence++;
+    m_writeQw = 1;
+    m_copyKey = 0;
+    m_compactPending = false;
+    m_compactState = COMPACT_COPY;
+    return true;
+}
+
+bool KeyValueStore::CompactStep() {
+    switch (m_compactState) {
+        case COMPACT_IDLE:
+            if (m_compactPending) {
+                return CompactStart();
+            }
+            break;
+
+        case COMPACT_COPY: {
+            uint16_t oldStart = BlockStart(m_oldBlock);
+            // Copy the next key whose newest record is in the old block
+            for (; m_copyKey < KV_STORE_KEYS; m_copyKey++) {
+                uint16_t index = m_index[m_copyKey];
+                if (index == KV_INDEX_NONE || index < oldStart ||
+                        index >= oldStart + KV_QW_PER_BLOCK) {
+                    continue;
+                }
+                uint8_t length = RecordLength(index);
+                uint32_t record[KV_RECORD_QW_MAX * KV_QW_WORDS];
+                memcpy(record, QwAddr(index),
+                       KV_RECORD_QW(length) * KV_QW_SIZE);
+                if (!RecordProgram(m_copyKey, record, length)) {
+                    return false;
+                }
+                m_copyKey++;
+                return true;
+            }
+            m_compactState = COMPACT_ERASE;
+            break;
+        }
+
+        case COMPACT_ERASE:
+            if (!NVMCTRL->STATUS.bit.READY) {
+                break;
+            }
+            BlockEraseStart(m_oldBlock);
+            m_compactState = COMPACT_ERASE_WAIT;
+            break;
+
+        case COMPACT_ERASE_WAIT:
+            if (!NVMCTRL->STATUS.bit.READY) {
+                break;
+            }
+            CacheMgr.Invalidate();
+            m_oldBlock = -1;
+            m_compactState = COMPACT_IDLE;
+            m_compactPending =
+                KV_QW_PER_BLOCK - m_writeQw < KV_COMPACT_RESERVE_QW;
+            break;
+
+        default:
+            m_compactState = COMPACT_IDLE;
+            break;
+    }
+    return true;
+}
+
+void KeyValueStore::CompactFinish() {
+    while (m_compactState != COMPACT_IDLE) {
+        if (!CompactStep()) {
+            return;
+        }
+    }
+}
+
+} // ClearCore namespace
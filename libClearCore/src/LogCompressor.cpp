@@ -0,0 +1,312 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    ClearCore streaming log compression
+**/
+
+#include "LogCompressor.h"
+#include <string.h>
+
+static_assert(LOG_COMPRESS_BLOCK_SIZE <= 65535,
+              "LOG_COMPRESS_BLOCK_SIZE must fit 16 bits");
+static_assert(LOG_COMPRESS_BLOCK_SIZE >= UINT8_MAX,
+              "LOG_COMPRESS_BLOCK_SIZE must hold the largest record");
+
+// LZ4 block format limits: a match is at least 4 bytes, the last 5 bytes
+// are always literals, and the last match starts 12 bytes before the end
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5
+#define LZ4_MATCH_LIMIT 12
+#define LZ4_DISTANCE_MAX 65535
+
+namespace ClearCore {
+
+static uint32_t Read32(const uint8_t *data) {
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static uint32_t ChannelRead(const uint8_t *data, uint8_t size) {
+    uint32_t value = 0;
+    memcpy(&value, data, size);
+    return value;
+}
+
+// The zigzag encoded change of a channel, taken at the channel's width
+static uint32_t ChannelDelta(const uint8_t *cur, const uint8_t *prev,
+                             uint8_t size) {
+    uint8_t shift = 32 - 8 * size;
+    int32_t delta = static_cast<int32_t>(
+                        (ChannelRead(cur, size) - ChannelRead(prev, size))
+                        << shift) >> shift;
+    return (static_cast<uint32_t>(delta) << 1) ^
+           static_cast<uint32_t>(delta >> 31);
+}
+
+// Write an LZ4 length of 15 or more as its extra bytes
+static uint8_t *Lz4LengthPut(uint8_t *out, uint32_t length) {
+    while (length >= 255) {
+        *out++ = 255;
+        length -= 255;
+    }
+    *out++ = static_cast<uint8_t>(length);
+    return out;
+}
+
+LogCompressor::LogCompressor(CompressModes mode, uint8_t recordSize,
+                             const uint8_t *channelSizes,
+                             uint8_t channelCount)
+    : m_mode(mode),
+      m_recordSize(recordSize),
+      m_channelCount(0),
+      m_channelSizes(),
+      m_blockSize(LOG_COMPRESS_BLOCK_SIZE),
+      m_sink(nullptr),
+      m_in(),
+      m_inLength(0),
+      m_out(),
+      m_hash(),
+      m_bytesIn(0),
+      m_bytesOut(0) {
+    if (mode != COMPRESS_DELTA) {
+        return;
+    }
+    // The channels must make up the record exactly
+    uint16_t total = 0;
+    bool valid = channelSizes && channelCount && recordSize &&
+                 channelCount <= LOG_COMPRESS_CHANNELS_MAX;
+    for (uint8_t i = 0; valid && i < channelCount; i++) {
+        uint8_t size = channelSizes[i];
+        valid = size == 1 || size == 2 || size == 4;
+        m_channelSizes[i] = size;
+        total += size;
+    }
+    if (!valid || total != recordSize) {
+        m_blockSize = 0;
+        return;
+    }
+    m_channelCount = channelCount;
+    m_blockSize = LOG_COMPRESS_BLOCK_SIZE / recordSize * recordSize;
+}
+
+bool LogCompressor::Write(const uint8_t *data, uint32_t length) {
+    if (!m_blockSize || !m_sink) {
+        return false;
+    }
+    while (length) {
+        uint32_t count = m_blockSize - m_inLength;
+        if (count > length) {
+            count = length;
+        }
+        memcpy(m_in + m_inLength, data, count);
+        m_inLength += count;
+        m_bytesIn += count;
+        data += count;
+        length -= count;
+
+        if (m_inLength == m_blockSize) {
+            m_inLength = 0;
+            if (!BlockWrite(m_in, m_blockSize, false)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool LogCompressor::Flush() {
+    if (!m_inLength) {
+        return true;
+    }
+    if (!m_sink) {
+        return false;
+    }
+    uint16_t length = m_inLength;
+    m_inLength = 0;
+    uint16_t whole = length;
+    if (m_mode == COMPRESS_DELTA) {
+        whole -= length % m_recordSize;
+    }
+    if (whole && !BlockWrite(m_in, whole, false)) {
+        return false;
+    }
+    return whole == length || BlockWrite(m_in + whole, length - whole, true);
+}
+
+void LogCompressor::Reset() {
+    m_inLength = 0;
+    m_bytesIn = 0;
+    m_bytesOut = 0;
+}
+
+bool LogCompressor::BlockWrite(const uint8_t *in, uint16_t length, bool raw) {
+    uint8_t *data = m_out + LOG_COMPRESS_HEADER_LEN;
+    int32_t dataLength = -1;
+    if (!raw) {
+        // Anything not smaller than the input is stored as it is
+        dataLength = (m_mode == COMPRESS_DELTA) ?
+                     DeltaEncode(in, length, data, length - 1) :
+                     Lz4Encode(in, length, data, length - 1);
+    }
+    uint8_t type = (m_mode == COMPRESS_DELTA) ? LOG_BLOCK_DELTA
+                   : LOG_BLOCK_LZ4;
+    if (dataLength < 0) {
+        type = LOG_BLOCK_RAW;
+        memcpy(data, in, length);
+        dataLength = length;
+    }
+
+    m_out[0] = type;
+    m_out[1] = length;
+    m_out[2] = length >> 8;
+    m_out[3] = dataLength;
+    m_out[4] = dataLength >> 8;
+    uint16_t blockLength = LOG_COMPRESS_HEADER_LEN + dataLength;
+    if (!m_sink(m_out, blockLength)) {
+        return false;
+    }
+    m_bytesOut += blockLength;
+    return true;
+}
+
+int32_t LogCompressor::DeltaEncode(const uint8_t *in, uint16_t length,
+                                   uint8_t *out, uint16_t size) {
+    uint16_t records = length / m_recordSize;
+    if (size < m_recordSize) {
+        return -1;
+    }
+    memcpy(out, in, m_recordSize);
+    uint8_t *op = out + m_recordSize;
+    const uint8_t *end = out + size;
+
+    uint8_t offset = 0;
+    for (uint8_t c = 0; c < m_channelCount; c++) {
+        uint8_t channelSize = m_channelSizes[c];
+        const uint8_t *first = in + offset;
+
+        // The width of the largest change sets the width of them all
+        uint32_t bitsUsed = 0;
+        for (uint16_t r = 1; r < records; r++) {
+            const uint8_t *cur = first + r * m_recordSize;
+            bitsUsed |= ChannelDelta(cur, cur - m_recordSize, channelSize);
+        }
+        uint8_t width = bitsUsed ? 32 - __builtin_clz(bitsUsed) : 0;
+        uint32_t bytes = ((records - 1) * width + 7) / 8;
+        if (end - op < static_cast<int32_t>(1 + bytes)) {
+            return -1;
+        }
+        *op++ = width;
+
+        uint64_t bits = 0;
+        uint8_t bitCount = 0;
+        for (uint16_t r = 1; width && r < records; r++) {
+            const uint8_t *cur = first + r * m_recordSize;
+            bits |= static_cast<uint64_t>(
+                        ChannelDelta(cur, cur - m_recordSize, channelSize))
+                    << bitCount;
+            bitCount += width;
+            while (bitCount >= 8) {
+                *op++ = static_cast<uint8_t>(bits);
+                bits >>= 8;
+                bitCount -= 8;
+            }
+        }
+        if (bitCount) {
+            *op++ = static_cast<uint8_t>(bits);
+        }
+        offset += channelSize;
+    }
+    return op - out;
+}
+
+int32_t LogCompressor::Lz4Encode(const uint8_t *in, uint16_t length,
+                                 uint8_t *out, uint16_t size) {
+    uint8_t *op = out;
+    const uint8_t *end = out + size;
+    uint16_t anchor = 0;
+    uint16_t ip = 0;
+
+    if (length > LZ4_MATCH_LIMIT) {
+        memset(m_hash, 0, sizeof(m_hash));
+        uint16_t matchLimit = length - LZ4_MATCH_LIMIT;
+        uint16_t extendLimit = length - LZ4_LAST_LITERALS;
+        while (ip < matchLimit) {
+            uint32_t sequence = Read32(in + ip);
+            uint32_t hash = static_cast<uint32_t>(sequence * 2654435761UL) >>
+                            (32 - LOG_COMPRESS_HASH_BITS);
+            uint16_t ref = m_hash[hash];
+            m_hash[hash] = ip;
+            if (ref >= ip || ip - ref > LZ4_DISTANCE_MAX ||
+                    Read32(in + ref) != sequence) {
+                ip++;
+                continue;
+            }
+
+            uint16_t matchLength = LZ4_MIN_MATCH;
+            while (ip + matchLength < extendLimit &&
+                    in[ref + matchLength] == in[ip + matchLength]) {
+                matchLength++;
+            }
+
+            // Token, literals, offset and match length
+            uint16_t literals = ip - anchor;
+            uint16_t matchExtra = matchLength - LZ4_MIN_MATCH;
+            if (end - op < 1 + literals / 255 + 1 + literals + 2 +
+                    matchExtra / 255 + 1) {
+                return -1;
+            }
+            uint8_t *token = op++;
+            *token = (literals >= 15 ? 15 : literals) << 4;
+            if (literals >= 15) {
+                op = Lz4LengthPut(op, literals - 15);
+            }
+            memcpy(op, in + anchor, literals);
+            op += literals;
+            *op++ = static_cast<uint8_t>(ip - ref);
+            *op++ = static_cast<uint8_t>((ip - ref) >> 8);
+            *token |= matchExtra >= 15 ? 15 : matchExtra;
+            if (matchExtra >= 15) {
+                op = Lz4LengthPut(op, matchExtra - 15);
+            }
+
+            ip += matchLength;
+            anchor = ip;
+        }
+    }
+
+    // The rest are literals
+    uint16_t literals = length - anchor;
+    if (end - op < 1 + literals / 255 + 1 + literals) {
+        return -1;
+    }
+    *op++ = (literals >= 15 ? 15 : literals) << 4;
+    if (literals >= 15) {
+        op = Lz4LengthPut(op, literals - 15);
+    }
+    memcpy(op, in + anchor, literals);
+    op += literals;
+    return op - out;
+}
+
+} // ClearCore namespace
@@ -0,0 +1,286 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    ClearCore sample rate logic engine
+**/
+
+#include "LogicEngine.h"
+#include <sam.h>
+#include <string.h>
+#include "atomic_utils.h"
+#include "CcioBoardManager.h"
+#include "InputManager.h"
+#include "SysManager.h"
+
+namespace ClearCore {
+
+#define LOGIC_NOT_BIT 0x8000
+#define LOGIC_CCIO_BASE LOGIC_CCIO(0)
+#define LOGIC_BLOCK_BASE LOGIC_BLOCK(0)
+
+extern CcioBoardManager &CcioMgr;
+extern InputManager &InputMgr;
+extern SysManager SysMgr;
+
+LogicEngine &LogicEng = LogicEngine::Instance();
+
+LogicEngine &LogicEngine::Instance() {
+    static LogicEngine *instance = new LogicEngine();
+    return *instance;
+}
+
+LogicEngine::LogicEngine()
+    : m_blocks(nullptr),
+      m_blockCount(0),
+      m_outputs(nullptr),
+      m_outputCount(0),
+      m_outputConnectors(),
+      m_running(false),
+      m_inputs(0),
+      m_ccio(0),
+      m_blockOut(),
+      m_blockLast(),
+      m_blockValue(),
+      m_outputLast(0),
+      m_outputsForce(false),
+      m_cyclesLast(0),
+      m_cyclesMax(0) {}
+
+bool LogicEngine::Load(const Block *blocks, uint8_t blockCount,
+                       const Output *outputs, uint8_t outputCount) {
+    Stop();
+    if ((blockCount && !blocks) || (outputCount && !outputs) ||
+            blockCount > LOGIC_BLOCKS_MAX ||
+            outputCount > LOGIC_OUTPUTS_MAX) {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < blockCount; i++) {
+        const Block &block = blocks[i];
+        if (block.Type >= LOGIC_TYPE_COUNT) {
+            return false;
+        }
+        // Gates read Count inputs; the others read the inputs they name
+        uint8_t inputs;
+        switch (block.Type) {
+            case LOGIC_AND:
+            case LOGIC_OR:
+            case LOGIC_XOR:
+                if (!block.Count || block.Count > LOGIC_BLOCK_INPUTS) {
+                    return false;
+                }
+                inputs = block.Count;
+                break;
+            case LOGIC_LATCH:
+            case LOGIC_COUNTER:
+                inputs = 2;
+                break;
+            default:
+                inputs = 1;
+                break;
+        }
+        for (uint8_t j = 0; j < inputs; j++) {
+            if (!OperandValid(block.In[j], blockCount)) {
+                return false;
+            }
+        }
+    }
+
+    for (uint8_t i = 0; i < outputCount; i++) {
+        ClearCorePins pin = outputs[i].Pin;
+        Connector *connector =
+            (pin < 0) ? nullptr : SysMgr.ConnectorByIndex(pin);
+        if (!connector || !connector->IsWritable() ||
+                !OperandValid(outputs[i].Source, blockCount)) {
+            return false;
+        }
+        m_outputConnectors[i] = connector;
+    }
+
+    m_blocks = blocks;
+    m_blockCount = blockCount;
+    m_outputs = outputs;
+    m_outputCount = outputCount;
+    memset(m_blockOut, 0, sizeof(m_blockOut));
+    memset(m_blockLast, 0, sizeof(m_blockLast));
+    memset(m_blockValue, 0, sizeof(m_blockValue));
+    m_outputsForce = true;
+    // Publish the network only once it is set up
+    atomic_store_n(&m_running, true);
+    return true;
+}
+
+void LogicEngine::Stop() {
+    m_running = false;
+}
+
+bool LogicEngine::BlockOutput(uint8_t index) {
+    if (index >= LOGIC_BLOCKS_MAX) {
+        return false;
+    }
+    return BitGet(m_blockOut, index);
+}
+
+uint32_t LogicEngine::BlockValue(uint8_t index) {
+    if (index >= LOGIC_BLOCKS_MAX) {
+        return 0;
+    }
+    return m_blockValue[index];
+}
+
+uint32_t LogicEngine::CyclesMax(bool reset) {
+    if (reset) {
+        return atomic_exchange_n(&m_cyclesMax, 0);
+    }
+    return m_cyclesMax;
+}
+
+bool LogicEngine::OperandValid(uint16_t op, uint8_t blockCount) {
+    uint16_t src = op & ~LOGIC_NOT_BIT;
+    return src < CLEARCORE_PIN_MAX ||
+           (src >= LOGIC_CCIO_BASE && src < LOGIC_CCIO_BASE + CCIO_PIN_CNT) ||
+           (src >= LOGIC_BLOCK_BASE && src < LOGIC_BLOCK_BASE + blockCount) ||
+           src == LOGIC_TRUE;
+}
+
+ISR_RAMFUNC bool LogicEngine::Operand(uint16_t op) {
+    uint16_t src = op & ~LOGIC_NOT_BIT;
+    bool value;
+    if (src < LOGIC_CCIO_BASE) {
+        value = (m_inputs >> src) & 1;
+    }
+    else if (src < LOGIC_BLOCK_BASE) {
+        value = (m_ccio >> (src - LOGIC_CCIO_BASE)) & 1;
+    }
+    else if (src == LOGIC_TRUE) {
+        value = true;
+    }
+    else {
+        value = BitGet(m_blockOut, src - LOGIC_BLOCK_BASE);
+    }
+    return value != static_cast<bool>(op & LOGIC_NOT_BIT);
+}
+
+ISR_RAMFUNC void LogicEngine::Update() {
+    if (!m_running) {
+        return;
+    }
+    uint32_t startCycles = DWT->CYCCNT;
+
+    m_inputs = InputMgr.InputsRT().reg;
+    m_ccio = CcioMgr.InputState();
+
+    for (uint8_t i = 0; i < m_blockCount; i++) {
+        const Block &block = m_blocks[i];
+        bool in0 = Operand(block.In[0]);
+        bool last = BitGet(m_blockLast, i);
+        bool out = BitGet(m_blockOut, i);
+        uint32_t &value = m_blockValue[i];
+
+        switch (block.Type) {
+            case LOGIC_AND:
+                out = in0;
+                for (uint8_t j = 1; j < block.Count; j++) {
+                    out = out && Operand(block.In[j]);
+                }
+                break;
+            case LOGIC_OR:
+                out = in0;
+                for (uint8_t j = 1; j < block.Count; j++) {
+                    out = out || Operand(block.In[j]);
+                }
+                break;
+            case LOGIC_XOR:
+                out = in0;
+                for (uint8_t j = 1; j < block.Count; j++) {
+                    out = out != Operand(block.In[j]);
+                }
+                break;
+            case LOGIC_LATCH:
+                out = !Operand(block.In[1]) && (out || in0);
+                break;
+            case LOGIC_ON_DELAY:
+                if (!in0) {
+                    value = 0;
+                }
+                else if (value < block.Preset) {
+                    value++;
+                }
+                out = in0 && value >= block.Preset;
+                break;
+            case LOGIC_OFF_DELAY:
+                if (in0) {
+                    value = 0;
+                }
+                out = in0 || (out && value++ < block.Preset);
+                break;
+            case LOGIC_PULSE:
+                if (in0 && !last && !out) {
+                    value = 0;
+                    out = true;
+                }
+                if (out && value++ >= block.Preset) {
+                    out = false;
+                }
+                break;
+            case LOGIC_RISING:
+                out = in0 && !last;
+                break;
+            case LOGIC_FALLING:
+                out = !in0 && last;
+                break;
+            case LOGIC_COUNTER:
+                if (Operand(block.In[1])) {
+                    value = 0;
+                }
+                else if (in0 && !last && value < UINT32_MAX) {
+                    value++;
+                }
+                out = value >= block.Preset;
+                break;
+            default:
+                break;
+        }
+        BitSet(m_blockOut, i, out);
+        BitSet(m_blockLast, i, in0);
+    }
+
+    for (uint8_t i = 0; i < m_outputCount; i++) {
+        bool state = Operand(m_outputs[i].Source);
+        uint32_t bit = 1UL << i;
+        // Write only changes so the outputs can still be used between them
+        if (m_outputsForce || state != static_cast<bool>(m_outputLast & bit)) {
+            m_outputConnectors[i]->State(state);
+            m_outputLast = state ? (m_outputLast | bit) : (m_outputLast & ~bit);
+        }
+    }
+    m_outputsForce = false;
+
+    uint32_t cycles = DWT->CYCCNT - startCycles;
+    m_cyclesLast = cycles;
+    if (m_cyclesMax < cycles) {
+        m_cyclesMax = cycles;
+    }
+}
+
+} // ClearCore namespace
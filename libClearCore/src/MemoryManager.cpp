@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    ClearCore RAM budget and usage report
+**/
+
+#include "MemoryManager.h"
+#include <malloc.h>
+#include <sam.h>
+#include "lwip/memp.h"
+#include "lwip/stats.h"
+
+// The paint left in RAM the stack has never reached
+#define STACK_PAINT 0xA5A5A5A5UL
+// Left unpainted below the stack pointer while painting
+#define STACK_PAINT_MARGIN 256
+
+extern uint32_t __StackTop;
+extern "C" void *_sbrk(int incr);
+
+namespace ClearCore {
+
+MemoryManager &MemoryMgr = MemoryManager::Instance();
+
+MemoryManager &MemoryManager::Instance() {
+    static MemoryManager *instance = new MemoryManager();
+    return *instance;
+}
+
+// The first word above the heap
+static uint32_t *HeapTop() {
+    uint32_t top = reinterpret_cast<uint32_t>(_sbrk(0));
+    return reinterpret_cast<uint32_t *>((top + 3) & ~3UL);
+}
+
+void MemoryManager::Initialize() {
+    uint32_t *end = reinterpret_cast<uint32_t *>(__get_MSP() -
+                    STACK_PAINT_MARGIN);
+    for (uint32_t *word = HeapTop(); word < end; word++) {
+        *word = STACK_PAINT;
+    }
+}
+
+uint32_t MemoryManager::StackLowest() {
+    uint32_t *word = HeapTop();
+    uint32_t *sp = reinterpret_cast<uint32_t *>(__get_MSP());
+    while (word < sp && *word == STACK_PAINT) {
+        word++;
+    }
+    return reinterpret_cast<uint32_t>(word);
+}
+
+uint32_t MemoryManager::StackUsedMax() {
+    return reinterpret_cast<uint32_t>(&__StackTop) - StackLowest();
+}
+
+uint32_t MemoryManager::Free() {
+    return __get_MSP() - reinterpret_cast<uint32_t>(HeapTop());
+}
+
+uint32_t MemoryManager::FreeMin() {
+    return StackLowest() - reinterpret_cast<uint32_t>(HeapTop());
+}
+
+uint32_t MemoryManager::HeapSize() {
+    return mallinfo().arena;
+}
+
+uint32_t MemoryManager::HeapUsed() {
+    return mallinfo().uordblks;
+}
+
+bool MemoryManager::LwipHeapGet(PoolStats &stats) {
+#if MEM_STATS
+    stats.Avail = lwip_stats.mem.avail;
+    stats.Used = lwip_stats.mem.used;
+    stats.Max = lwip_stats.mem.max;
+    stats.Errors = lwip_stats.mem.err;
+    return true;
+#else
+    (void)stats;
+    return false;
+#endif
+}
+
+uint8_t MemoryManager::LwipPoolCount() {
+    return MEMP_MAX;
+}
+
+bool MemoryManager::LwipPoolGet(uint8_t pool, PoolStats &stats) {
+#if MEMP_STATS
+    if (pool >= MEMP_MAX || !lwip_stats.memp[pool]) {
+        return false;
+    }
+    const struct stats_mem *mem = lwip_stats.memp[pool];
+    stats.Avail = mem->avail;
+    stats.Used = mem->used;
+    stats.Max = mem->max;
+    stats.Errors = mem->err;
+    return true;
+#else
+    (void)pool;
+    (void)stats;
+    return false;
+#endif
+}
+
+static void ReportLine(ISerial &port, const char *label, uint32_t value) {
+    port.Send(label);
+    port.SendLine(value);
+}
+
+static void ReportPool(ISerial &port, const char *label,
+                       const MemoryManager::PoolStats &stats) {
+    port.Send(label);
+    port.Send(stats.Used);
+    port.Send('/');
+    port.Send(stats.Avail);
+    port.Send(" max ");
+    port.Send(stats.Max);
+    port.Send(" err ");
+    port.SendLine(stats.Errors);
+}
+
+void MemoryManager::Report(ISerial &port) {
+    ReportLine(port, "Budget serial:\t\t", MemoryBudget::SerialPorts);
+    ReportLine(port, "Budget USB:\t\t", MemoryBudget::Usb);
+    ReportLine(port, "Budget CCIO-8:\t\t", MemoryBudget::CcioPins);
+    ReportLine(port, "Budget data log:\t", MemoryBudget::DataLog);
+    ReportLine(port, "Budget lwIP heap:\t", MemoryBudget::LwipHeap);
+    ReportLine(port, "Budget lwIP pbufs:\t", MemoryBudget::LwipPbufPool);
+    ReportLine(port, "Budget total:\t\t", MemoryBudget::Total);
+    ReportLine(port, "TCP connection:\t\t", MemoryBudget::TcpConnection);
+
+    ReportLine(port, "Stack max:\t\t", StackUsedMax());
+    ReportLine(port, "Free:\t\t\t", Free());
+    ReportLine(port, "Free min:\t\t", FreeMin());
+    ReportLine(port, "Heap size:\t\t", HeapSize());
+    ReportLine(port, "Heap used:\t\t", HeapUsed());
+
+    PoolStats stats;
+    if (LwipHeapGet(stats)) {
+        ReportPool(port, "lwIP heap:\t\t", stats);
+    }
+    for (uint8_t i = 0; i < LwipPoolCount(); i++) {
+        if (LwipPoolGet(i, stats)) {
+            port.Send("lwIP pool ");
+            port.Send(i);
+            ReportPool(port, ":\t\t", stats);
+        }
+    }
+}
+
+} // ClearCore namespace
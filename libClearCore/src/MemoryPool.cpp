@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+    ClearCore fixed-block memory pools and bump arena
+**/
+
+#include "MemoryPool.h"
+#include <sam.h>
+
+namespace ClearCore {
+
+MemoryPool::MemoryPool()
+    : m_buffer(nullptr),
+      m_blockSize(0),
+      m_blocks(0),
+      m_free(nullptr),
+      m_used(0),
+      m_usedMax(0),
+      m_errors(0) {}
+
+MemoryPool::MemoryPool(void *buffer, uint32_t blockSize, uint32_t blocks)
+    : MemoryPool() {
+    Storage(buffer, blockSize, blocks);
+}
+
+bool MemoryPool::Storage(void *buffer, uint32_t blockSize, uint32_t blocks) {
+    if (!buffer || (reinterpret_cast<uintptr_t>(buffer) & 0x3) || !blockSize ||
+            !blocks) {
+        return false;
+    }
+    blockSize = (blockSize + 3) & ~0x3UL;
+
+    // Thread the free list through the blocks in address order
+    uint8_t *block = static_cast<uint8_t *>(buffer);
+    for (uint32_t i = 0; i < blocks - 1; i++, block += blockSize) {
+        reinterpret_cast<FreeBlock *>(block)->Next =
+            reinterpret_cast<FreeBlock *>(block + blockSize);
+    }
+    reinterpret_cast<FreeBlock *>(block)->Next = nullptr;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    m_buffer = static_cast<uint8_t *>(buffer);
+    m_blockSize = blockSize;
+    m_blocks = blocks;
+    m_free = reinterpret_cast<FreeBlock *>(buffer);
+    m_used = 0;
+    m_usedMax = 0;
+    m_errors = 0;
+    __set_PRIMASK(primask);
+    return true;
+}
+
+void *MemoryPool::Alloc() {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    FreeBlock *block = m_free;
+    if (block) {
+        m_free = block->Next;
+        if (++m_used > m_usedMax) {
+            m_usedMax = m_used;
+        }
+    }
+    else {
+        m_errors++;
+    }
+    __set_PRIMASK(primask);
+    return block;
+}
+
+bool MemoryPool::Free(void *block) {
+    if (!block) {
+        return true;
+    }
+    if (!Owns(block) ||
+            (static_cast<uint8_t *>(block) - m_buffer) % m_blockSize) {
+        return false;
+    }
+    FreeBlock *freeBlock = static_cast<FreeBlock *>(block);
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    freeBlock->Next = m_free;
+    m_free = freeBlock;
+    m_used--;
+    __set_PRIMASK(primask);
+    return true;
+}
+
+bool MemoryPool::Owns(const void *ptr) const {
+    const uint8_t *byte = static_cast<const uint8_t *>(ptr);
+    return m_buffer && byte >= m_buffer &&
+           byte < m_buffer + m_blockSize * m_blocks;
+}
+
+void MemoryPool::StatsGet(Stats &stats, bool reset) {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    stats.BlockSize = m_blockSize;
+    stats.Blocks = m_blocks;
+    stats.Used = m_used;
+    stats.Max = m_usedMax;
+    stats.Errors = m_errors;
+    if (reset) {
+        m_usedMax = m_used;
+        m_errors = 0;
+    }
+    __set_PRIMASK(primask);
+}
+
+#if LWIP_SUPPORT_CUSTOM_PBUF
+/*
+    The block starts with the pbuf and the pool it came from, and the rest
+    holds the headers of the layer and the payload.
+*/
+struct pbuf *MemoryPool::PbufAlloc(pbuf_layer layer, uint16_t length) {
+    if (length > PbufPayloadMax(layer)) {
+        return NULL;
+    }
+    PbufBlock *block = static_cast<PbufBlock *>(Alloc());
+    if (!block) {
+        return NULL;
+    }
+    block->Pool = this;
+    block->Custom.custom_free_function = PbufFree;
+    uint32_t head = LWIP_MEM_ALIGN_SIZE(sizeof(PbufBlock));
+    uint32_t memLen = m_blockSize - head;
+    return pbuf_alloced_custom(layer, length, PBUF_RAM, &block->Custom,
+                               reinterpret_cast<uint8_t *>(block) + head,
+                               memLen > UINT16_MAX ? UINT16_MAX : memLen);
+}
+
+uint16_t MemoryPool::PbufPayloadMax(pbuf_layer layer) const {
+    uint32_t head = LWIP_MEM_ALIGN_SIZE(sizeof(PbufBlock)) +
+                    LWIP_MEM_ALIGN_SIZE(static_cast<uint16_t>(layer));
+    if (m_blockSize <= head) {
+        return 0;
+    }
+    uint32_t payload = m_blockSize - head;
+    return payload > UINT16_MAX ? UINT16_MAX : payload;
+}
+
+/*
+    Called by lwIP when the last reference to a pool pbuf is freed.
+*/
+void MemoryPool::PbufFree(struct pbuf *p) {
+    PbufBlock *block = reinterpret_cast<PbufBlock *>(p);
+    block->Pool->Free(block);
+}
+#endif // LWIP_SUPPORT_CUSTOM_PBUF
+
+MemoryArena::MemoryArena()
+    : m_buffer(nullptr),
+      m_size(0),
+      m_used(0),
+      m_usedMax(0),
+      m_errors(0) {}
+
+MemoryArena::MemoryArena(void *buffer, uint32_t size)
+    : MemoryArena() {
+    Storage(buffer, size);
+}
+
+void MemoryArena::Storage(void *buffer, uint32_t size) {
+    m_buffer = static_cast<uint8_t *>(buffer);
+    m_size = buffer ? size : 0;
+    m_used = 0;
+    m_usedMax = 0;
+    m_errors = 0;
+}
+
+void *MemoryArena::Alloc(uint32_t size, uint32_t align) {
+    if (!align || (align & (align - 1))) {
+        m_errors++;
+        return nullptr;
+    }
+    // Align the address rather than the offset, so any storage works
+    uintptr_t base = reinterpret_cast<uintptr_t>(m_buffer);
+    uint32_t start = ((base + m_used + align - 1) & ~(align - 1)) - base;
+    if (start > m_size || size > m_size - start) {
+        m_errors++;
+        return nullptr;
+    }
+    m_used = start + size;
+    if (m_used > m_usedMax) {
+        m_usedMax = m_used;
+    }
+    return m_buffer + start;
+}
+
+uint32_t MemoryArena::UsedMax(bool reset) {
+    uint32_t usedMax = m_usedMax;
+    if (reset) {
+        m_usedMax = m_used;
+    }
+    return usedMax;
+}
+
+uint32_t MemoryArena::Errors(bool reset) {
+    uint32_t errors = m_errors;
+    if (reset) {
+        m_errors = 0;
+    }
+    return errors;
+}
+
+} // ClearCore namespace
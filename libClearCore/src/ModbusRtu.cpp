@@ -0,0 +1,527 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    Implementation of the ClearCore Modbus RTU master and slave
+**/
+
+#include "ModbusRtu.h"
+#include <string.h>
+#include "CrcManager.h"
+#include "SysTiming.h"
+
+namespace ClearCore {
+
+// Function codes
+#define MODBUS_FC_READ_COILS 0x01
+#define MODBUS_FC_READ_DISCRETE_INPUTS 0x02
+#define MODBUS_FC_READ_HOLDING_REGISTERS 0x03
+#define MODBUS_FC_READ_INPUT_REGISTERS 0x04
+#define MODBUS_FC_WRITE_SINGLE_COIL 0x05
+#define MODBUS_FC_WRITE_SINGLE_REGISTER 0x06
+#define MODBUS_FC_WRITE_MULTIPLE_COILS 0x0F
+#define MODBUS_FC_WRITE_MULTIPLE_REGISTERS 0x10
+#define MODBUS_FC_EXCEPTION 0x80
+
+// Per-request limits of the Modbus standard
+#define MODBUS_READ_BITS_MAX 2000
+#define MODBUS_READ_REGISTERS_MAX 125
+#define MODBUS_WRITE_BITS_MAX 1968
+#define MODBUS_WRITE_REGISTERS_MAX 123
+
+#define MODBUS_UNIT_ID_MAX 247
+#define MODBUS_COIL_ON 0xFF00
+
+// Default silent interval above 19200 baud
+#define MODBUS_FRAME_GAP_FAST_US 1750
+
+// The read function code of each table
+static const uint8_t ReadFunctions[] = {
+    MODBUS_FC_READ_COILS,
+    MODBUS_FC_READ_DISCRETE_INPUTS,
+    MODBUS_FC_READ_INPUT_REGISTERS,
+    MODBUS_FC_READ_HOLDING_REGISTERS,
+};
+
+// Modbus sends 16-bit fields high byte first
+static inline uint16_t Get16(const uint8_t *data) {
+    return (data[0] << 8) | data[1];
+}
+
+static inline void Put16(uint8_t *data, uint16_t value) {
+    data[0] = value >> 8;
+    data[1] = value & 0xFF;
+}
+
+ModbusRtu::ModbusRtu(SerialBase &port)
+    : m_port(port),
+      m_slave(false),
+      m_unitId(0),
+      m_callback(nullptr),
+      m_rxFrame(),
+      m_rxLength(0),
+      m_rxOverflow(false),
+      m_txFrame(),
+      m_frameGapUs(0),
+      m_frameGapBaud(0),
+      m_frameGapCycles(0),
+      m_requestState(REQUEST_IDLE),
+      m_requestException(EXCEPTION_NONE),
+      m_requestUnit(0),
+      m_requestFunction(0),
+      m_requestCount(0),
+      m_requestStartMs(0),
+      m_responseTimeoutMs(MODBUS_RESPONSE_TIMEOUT_MS),
+      m_values(),
+      m_frameErrors(0) {}
+
+bool ModbusRtu::SlaveMode(uint8_t unitId, RegisterCallback callback) {
+    if (!unitId || unitId > MODBUS_UNIT_ID_MAX || !callback) {
+        return false;
+    }
+    m_unitId = unitId;
+    m_callback = callback;
+    m_requestState = REQUEST_IDLE;
+    m_slave = true;
+    return true;
+}
+
+void ModbusRtu::MasterMode() {
+    m_slave = false;
+    m_requestState = REQUEST_IDLE;
+}
+
+void ModbusRtu::FrameGap(uint32_t microseconds) {
+    m_frameGapUs = microseconds;
+    // Recalculate the interval on the next Poll()
+    m_frameGapBaud = 0;
+}
+
+uint16_t ModbusRtu::Crc16(const uint8_t *data, uint16_t length) {
+    return CrcManager::Crc16(data, length);
+}
+
+bool ModbusRtu::ReadRequest(uint8_t unitId, RegisterTypes type,
+                            uint16_t address, uint16_t count) {
+    if (m_slave || m_requestState == REQUEST_PENDING || !unitId ||
+            unitId > MODBUS_UNIT_ID_MAX || type > HOLDING_REGISTER ||
+            !count || count > MODBUS_VALUES_MAX ||
+            static_cast<uint32_t>(address) + count > 0x10000) {
+        return false;
+    }
+
+    m_txFrame[0] = unitId;
+    m_txFrame[1] = ReadFunctions[type];
+    Put16(&m_txFrame[2], address);
+    Put16(&m_txFrame[4], count);
+
+    m_requestUnit = unitId;
+    m_requestFunction = m_txFrame[1];
+    m_requestCount = count;
+    return FrameSend(6);
+}
+
+bool ModbusRtu::WriteRequest(uint8_t unitId, RegisterTypes type,
+                             uint16_t address, uint16_t count,
+                             const uint16_t *values) {
+    if (m_slave || m_requestState == REQUEST_PENDING ||
+            unitId > MODBUS_UNIT_ID_MAX || !values || !count ||
+            count > MODBUS_VALUES_MAX ||
+            static_cast<uint32_t>(address) + count > 0x10000) {
+        return false;
+    }
+
+    uint16_t length;
+    m_txFrame[0] = unitId;
+    Put16(&m_txFrame[2], address);
+    if (type == COIL) {
+        if (count == 1) {
+            m_txFrame[1] = MODBUS_FC_WRITE_SINGLE_COIL;
+            Put16(&m_txFrame[4], values[0] ? MODBUS_COIL_ON : 0);
+            length = 6;
+        }
+        else {
+            uint8_t byteCount = (count + 7) / 8;
+            m_txFrame[1] = MODBUS_FC_WRITE_MULTIPLE_COILS;
+            Put16(&m_txFrame[4], count);
+            m_txFrame[6] = byteCount;
+            memset(&m_txFrame[7], 0, byteCount);
+            for (uint16_t i = 0; i < count; i++) {
+                if (values[i]) {
+                    m_txFrame[7 + i / 8] |= 1 << (i & 7);
+                }
+            }
+            length = 7 + byteCount;
+        }
+    }
+    else if (type == HOLDING_REGISTER) {
+        if (count == 1) {
+            m_txFrame[1] = MODBUS_FC_WRITE_SINGLE_REGISTER;
+            Put16(&m_txFrame[4], values[0]);
+            length = 6;
+        }
+        else {
+            m_txFrame[1] = MODBUS_FC_WRITE_MULTIPLE_REGISTERS;
+            Put16(&m_txFrame[4], count);
+            m_txFrame[6] = count * 2;
+            for (uint16_t i = 0; i < count; i++) {
+                Put16(&m_txFrame[7 + i * 2], values[i]);
+            }
+            length = 7 + count * 2;
+        }
+    }
+    else {
+        // The input tables are read-only
+        return false;
+    }
+
+    m_requestUnit = unitId;
+    m_requestFunction = m_txFrame[1];
+    m_requestCount = count;
+    return FrameSend(length);
+}
+
+void ModbusRtu::Poll() {
+    if (m_rxLength < MODBUS_FRAME_MAX) {
+        int32_t count = m_port.ReadBlock(&m_rxFrame[m_rxLength],
+                                         MODBUS_FRAME_MAX - m_rxLength);
+        if (count > 0) {
+            m_rxLength += count;
+        }
+    }
+    else {
+        // Too long to be a frame; drop the rest of it
+        uint8_t discard[16];
+        while (m_port.ReadBlock(discard, sizeof(discard)) > 0) {
+            m_rxOverflow = true;
+        }
+    }
+
+    if (m_rxLength && m_port.RxIdleCycles() >= FrameGapCycles()) {
+        // The silent interval has passed, so the frame is complete. A valid
+        // frame, CRC included, has a CRC of zero.
+        if (m_rxOverflow || m_rxLength < 4 || Crc16(m_rxFrame, m_rxLength)) {
+            m_frameErrors++;
+        }
+        else if (m_slave) {
+            SlaveProcess();
+        }
+        else {
+            MasterProcess();
+        }
+        m_rxLength = 0;
+        m_rxOverflow = false;
+    }
+
+    if (!m_slave && m_requestState == REQUEST_PENDING &&
+            Milliseconds() - m_requestStartMs > m_responseTimeoutMs) {
+        m_requestState = REQUEST_TIMEOUT;
+    }
+}
+
+uint32_t ModbusRtu::FrameGapCycles() {
+    uint32_t baudRate = m_port.Speed();
+    if (baudRate != m_frameGapBaud) {
+        m_frameGapBaud = baudRate;
+        if (m_frameGapUs) {
+            m_frameGapCycles = m_frameGapUs * CYCLES_PER_MICROSECOND;
+        }
+        else if (!baudRate || baudRate > 19200) {
+            m_frameGapCycles =
+                MODBUS_FRAME_GAP_FAST_US * CYCLES_PER_MICROSECOND;
+        }
+        else {
+            // 3.5 characters of 11 bits each
+            m_frameGapCycles = static_cast<uint32_t>(
+                                   static_cast<uint64_t>(CPU_CLK) * 77 /
+                                   (2 * baudRate));
+        }
+    }
+    return m_frameGapCycles;
+}
+
+bool ModbusRtu::FrameSend(uint16_t length) {
+    uint16_t crc = Crc16(m_txFrame, length);
+    m_txFrame[length++] = crc & 0xFF;
+    m_txFrame[length++] = crc >> 8;
+
+    if (!m_slave) {
+        // Anything already received is not the response
+        m_rxLength = 0;
+        m_rxOverflow = false;
+        m_requestException = EXCEPTION_NONE;
+        m_requestStartMs = Milliseconds();
+        // Broadcasts have no response
+        m_requestState = m_requestUnit ? REQUEST_PENDING : REQUEST_DONE;
+    }
+
+    if (!m_port.Send(reinterpret_cast<const char *>(m_txFrame), length)) {
+        if (!m_slave) {
+            m_requestState = REQUEST_IDLE;
+        }
+        return false;
+    }
+    return true;
+}
+
+void ModbusRtu::MasterProcess() {
+    if (m_requestState != REQUEST_PENDING ||
+            m_rxFrame[0] != m_requestUnit) {
+        // Not the response to our request
+        return;
+    }
+
+    uint8_t function = m_rxFrame[1];
+    if (function == (m_requestFunction | MODBUS_FC_EXCEPTION) &&
+            m_rxLength == 5) {
+        m_requestException = static_cast<Exceptions>(m_rxFrame[2]);
+        m_requestState = REQUEST_EXCEPTION;
+        return;
+    }
+    if (function != m_requestFunction) {
+        m_frameErrors++;
+        return;
+    }
+
+    switch (function) {
+        case MODBUS_FC_READ_COILS:
+        case MODBUS_FC_READ_DISCRETE_INPUTS: {
+            uint8_t byteCount = (m_requestCount + 7) / 8;
+            if (m_rxFrame[2] != byteCount || m_rxLength != 5 + byteCount) {
+                m_frameErrors++;
+                return;
+            }
+            for (uint16_t i = 0; i < m_requestCount; i++) {
+                m_values[i] = (m_rxFrame[3 + i / 8] >> (i & 7)) & 1;
+            }
+            break;
+        }
+        case MODBUS_FC_READ_HOLDING_REGISTERS:
+        case MODBUS_FC_READ_INPUT_REGISTERS:
+            if (m_rxFrame[2] != m_requestCount * 2 ||
+                    m_rxLength != 5 + m_requestCount * 2) {
+                m_frameErrors++;
+                return;
+            }
+            for (uint16_t i = 0; i < m_requestCount; i++) {
+                m_values[i] = Get16(&m_rxFrame[3 + i * 2]);
+            }
+            break;
+        default:
+            // Writes echo the address and value or count
+            if (m_rxLength != 8) {
+                m_frameErrors++;
+                return;
+            }
+            break;
+    }
+    m_requestState = REQUEST_DONE;
+}
+
+void ModbusRtu::SlaveProcess() {
+    uint8_t unitId = m_rxFrame[0];
+    if (unitId != m_unitId && unitId != 0) {
+        return;
+    }
+    // Only writes may be broadcast, and they are not answered
+    bool broadcast = !unitId;
+
+    uint8_t function = m_rxFrame[1];
+    uint16_t length = 0;
+    Exceptions exception;
+    switch (function) {
+        case MODBUS_FC_READ_COILS:
+            exception = SlaveRead(COIL, length);
+            break;
+        case MODBUS_FC_READ_DISCRETE_INPUTS:
+            exception = SlaveRead(DISCRETE_INPUT, length);
+            break;
+        case MODBUS_FC_READ_HOLDING_REGISTERS:
+            exception = SlaveRead(HOLDING_REGISTER, length);
+            break;
+        case MODBUS_FC_READ_INPUT_REGISTERS:
+            exception = SlaveRead(INPUT_REGISTER, length);
+            break;
+        case MODBUS_FC_WRITE_SINGLE_COIL:
+            exception = SlaveWrite(COIL, false, length);
+            break;
+        case MODBUS_FC_WRITE_SINGLE_REGISTER:
+            exception = SlaveWrite(HOLDING_REGISTER, false, length);
+            break;
+        case MODBUS_FC_WRITE_MULTIPLE_COILS:
+            exception = SlaveWrite(COIL, true, length);
+            break;
+        case MODBUS_FC_WRITE_MULTIPLE_REGISTERS:
+            exception = SlaveWrite(HOLDING_REGISTER, true, length);
+            break;
+        default:
+            exception = EXCEPTION_ILLEGAL_FUNCTION;
+            break;
+    }
+
+    if (broadcast) {
+        return;
+    }
+    m_txFrame[0] = m_unitId;
+    if (exception != EXCEPTION_NONE) {
+        m_txFrame[1] = function | MODBUS_FC_EXCEPTION;
+        m_txFrame[2] = exception;
+        length = 3;
+    }
+    else {
+        m_txFrame[1] = function;
+    }
+    FrameSend(length);
+}
+
+ModbusRtu::Exceptions ModbusRtu::SlaveRead(RegisterTypes type,
+                                           uint16_t &length) {
+    if (!m_rxFrame[0]) {
+        // Reads cannot be broadcast
+        return EXCEPTION_ILLEGAL_FUNCTION;
+    }
+    if (m_rxLength != 8) {
+        return EXCEPTION_ILLEGAL_DATA_VALUE;
+    }
+    uint16_t address = Get16(&m_rxFrame[2]);
+    uint16_t count = Get16(&m_rxFrame[4]);
+    bool bits = type == COIL || type == DISCRETE_INPUT;
+    if (!count ||
+            count > (bits ? MODBUS_READ_BITS_MAX : MODBUS_READ_REGISTERS_MAX)) {
+        return EXCEPTION_ILLEGAL_DATA_VALUE;
+    }
+    if (static_cast<uint32_t>(address) + count > 0x10000) {
+        return EXCEPTION_ILLEGAL_DATA_ADDRESS;
+    }
+
+    Exceptions exception;
+    if (bits) {
+        uint8_t byteCount = (count + 7) / 8;
+        m_txFrame[2] = byteCount;
+        memset(&m_txFrame[3], 0, byteCount);
+        // Fetch the bits a buffer at a time
+        for (uint16_t done = 0; done < count; done += MODBUS_VALUES_MAX) {
+            uint16_t chunk = count - done;
+            if (chunk > MODBUS_VALUES_MAX) {
+                chunk = MODBUS_VALUES_MAX;
+            }
+            exception = m_callback(type, address + done, chunk, m_values,
+                                   false);
+            if (exception != EXCEPTION_NONE) {
+                return exception;
+            }
+            for (uint16_t i = 0; i < chunk; i++) {
+                if (m_values[i]) {
+                    m_txFrame[3 + (done + i) / 8] |= 1 << ((done + i) & 7);
+                }
+            }
+        }
+        length = 3 + byteCount;
+    }
+    else {
+        exception = m_callback(type, address, count, m_values, false);
+        if (exception != EXCEPTION_NONE) {
+            return exception;
+        }
+        m_txFrame[2] = count * 2;
+        for (uint16_t i = 0; i < count; i++) {
+            Put16(&m_txFrame[3 + i * 2], m_values[i]);
+        }
+        length = 3 + count * 2;
+    }
+    return EXCEPTION_NONE;
+}
+
+ModbusRtu::Exceptions ModbusRtu::SlaveWrite(RegisterTypes type,
+                                            bool multiple,
+                                            uint16_t &length) {
+    uint16_t address = Get16(&m_rxFrame[2]);
+    Exceptions exception;
+
+    if (!multiple) {
+        if (m_rxLength != 8) {
+            return EXCEPTION_ILLEGAL_DATA_VALUE;
+        }
+        uint16_t value = Get16(&m_rxFrame[4]);
+        if (type == COIL) {
+            if (value != MODBUS_COIL_ON && value != 0) {
+                return EXCEPTION_ILLEGAL_DATA_VALUE;
+            }
+            value = value ? 1 : 0;
+        }
+        m_values[0] = value;
+        exception = m_callback(type, address, 1, m_values, true);
+    }
+    else {
+        if (m_rxLength < 9) {
+            return EXCEPTION_ILLEGAL_DATA_VALUE;
+        }
+        uint16_t count = Get16(&m_rxFrame[4]);
+        uint8_t byteCount = m_rxFrame[6];
+        bool bits = type == COIL;
+        if (!count ||
+                count > (bits ? MODBUS_WRITE_BITS_MAX
+                              : MODBUS_WRITE_REGISTERS_MAX) ||
+                byteCount != (bits ? (count + 7) / 8 : count * 2) ||
+                m_rxLength != 9 + byteCount) {
+            return EXCEPTION_ILLEGAL_DATA_VALUE;
+        }
+        if (static_cast<uint32_t>(address) + count > 0x10000) {
+            return EXCEPTION_ILLEGAL_DATA_ADDRESS;
+        }
+
+        if (bits) {
+            // Store the bits a buffer at a time
+            exception = EXCEPTION_NONE;
+            for (uint16_t done = 0; done < count; done += MODBUS_VALUES_MAX) {
+                uint16_t chunk = count - done;
+                if (chunk > MODBUS_VALUES_MAX) {
+                    chunk = MODBUS_VALUES_MAX;
+                }
+                for (uint16_t i = 0; i < chunk; i++) {
+                    m_values[i] =
+                        (m_rxFrame[7 + (done + i) / 8] >> ((done + i) & 7)) & 1;
+                }
+                exception = m_callback(type, address + done, chunk, m_values,
+                                       true);
+                if (exception != EXCEPTION_NONE) {
+                    break;
+                }
+            }
+        }
+        else {
+            for (uint16_t i = 0; i < count; i++) {
+                m_values[i] = Get16(&m_rxFrame[7 + i * 2]);
+            }
+            exception = m_callback(type, address, count, m_values, true);
+        }
+    }
+
+    if (exception == EXCEPTION_NONE) {
+        // The response echoes the address and the value or count
+        memcpy(&m_txFrame[2], &m_rxFrame[2], 4);
+        length = 6;
+    }
+    return exception;
+}
+
+} // ClearCore namespace
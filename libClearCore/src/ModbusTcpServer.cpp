@@ -0,0 +1,377 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    Implementation of the ClearCore Modbus TCP server
+**/
+
+#include "ModbusTcpServer.h"
+#include <string.h>
+
+namespace ClearCore {
+
+// Function codes
+#define MODBUS_FC_READ_COILS 0x01
+#define MODBUS_FC_READ_DISCRETE_INPUTS 0x02
+#define MODBUS_FC_READ_HOLDING_REGISTERS 0x03
+#define MODBUS_FC_READ_INPUT_REGISTERS 0x04
+#define MODBUS_FC_WRITE_SINGLE_COIL 0x05
+#define MODBUS_FC_WRITE_SINGLE_REGISTER 0x06
+#define MODBUS_FC_WRITE_MULTIPLE_COILS 0x0F
+#define MODBUS_FC_WRITE_MULTIPLE_REGISTERS 0x10
+#define MODBUS_FC_EXCEPTION 0x80
+
+// Per-request limits of the Modbus standard
+#define MODBUS_READ_BITS_MAX 2000
+#define MODBUS_READ_REGISTERS_MAX 125
+#define MODBUS_WRITE_BITS_MAX 1968
+#define MODBUS_WRITE_REGISTERS_MAX 123
+
+#define MODBUS_COIL_ON 0xFF00
+
+// MBAP header: transaction ID, protocol ID, length, unit ID. The length
+// counts the unit ID and the PDU.
+#define MBAP_LEN 7
+#define MBAP_LENGTH_MIN 2
+#define MBAP_LENGTH_MAX (MODBUS_TCP_FRAME_MAX - MBAP_LEN + 1)
+
+static inline uint16_t Get16(const uint8_t *data) {
+    return (data[0] << 8) | data[1];
+}
+static inline void Put16(uint8_t *data, uint16_t value) {
+    data[0] = value >> 8;
+    data[1] = value & 0xFF;
+}
+
+ModbusTcpServer::ModbusTcpServer(uint16_t port)
+    : m_server(port),
+      m_clients(),
+      m_map(nullptr),
+      m_mapCount(0),
+      m_callback(nullptr),
+      m_rxFrame(),
+      m_txFrame(),
+      m_values(),
+      m_frameErrors(0) {}
+
+void ModbusTcpServer::Begin(const RegisterRange *map, uint8_t mapCount,
+                            ModbusRtu::RegisterCallback callback) {
+    m_map = map;
+    m_mapCount = map ? mapCount : 0;
+    m_callback = callback;
+    m_server.Begin();
+}
+
+void ModbusTcpServer::Poll() {
+    ClientAccept();
+    for (uint8_t i = 0; i < MODBUS_TCP_CLIENTS_MAX; i++) {
+        EthernetTcpClient &client = m_clients[i];
+        if (!client.ConnectionState()) {
+            continue;
+        }
+        if (!client.Connected()) {
+            // Release the state of a connection the client has closed
+            client.Close();
+            continue;
+        }
+        ClientProcess(client);
+    }
+}
+
+uint8_t ModbusTcpServer::ClientCount() {
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < MODBUS_TCP_CLIENTS_MAX; i++) {
+        if (m_clients[i].Connected()) {
+            count++;
+        }
+    }
+    return count;
+}
+
+void ModbusTcpServer::ClientAccept() {
+    while (true) {
+        EthernetTcpClient client = m_server.Accept();
+        if (!client.ConnectionState()) {
+            return;
+        }
+        uint8_t slot = 0;
+        while (slot < MODBUS_TCP_CLIENTS_MAX &&
+                m_clients[slot].ConnectionState()) {
+            slot++;
+        }
+        if (slot == MODBUS_TCP_CLIENTS_MAX) {
+            // Every slot is taken; turn the client away
+            client.Close();
+            continue;
+        }
+        m_clients[slot] = client;
+    }
+}
+
+void ModbusTcpServer::ClientProcess(EthernetTcpClient &client) {
+    int16_t available = client.BytesAvailable();
+    if (available < MBAP_LEN) {
+        return;
+    }
+    client.Peek(m_rxFrame, MBAP_LEN);
+    uint16_t mbapLength = Get16(&m_rxFrame[4]);
+    if (Get16(&m_rxFrame[2]) != 0 || mbapLength < MBAP_LENGTH_MIN ||
+            mbapLength > MBAP_LENGTH_MAX) {
+        // Not Modbus; the stream can't be resynchronized
+        m_frameErrors++;
+        client.Close();
+        return;
+    }
+    uint16_t frameLength = MBAP_LEN - 1 + mbapLength;
+    if (available < frameLength) {
+        // Wait for the rest of the request
+        return;
+    }
+    client.Read(m_rxFrame, frameLength);
+
+    uint16_t pduLength = mbapLength - 1;
+    uint8_t function = m_rxFrame[MBAP_LEN];
+    uint16_t length = 0;
+    ModbusRtu::Exceptions exception;
+    switch (function) {
+        case MODBUS_FC_READ_COILS:
+            exception = RequestRead(ModbusRtu::COIL, pduLength, length);
+            break;
+        case MODBUS_FC_READ_DISCRETE_INPUTS:
+            exception = RequestRead(ModbusRtu::DISCRETE_INPUT, pduLength,
+                                    length);
+            break;
+        case MODBUS_FC_READ_HOLDING_REGISTERS:
+            exception = RequestRead(ModbusRtu::HOLDING_REGISTER, pduLength,
+                                    length);
+            break;
+        case MODBUS_FC_READ_INPUT_REGISTERS:
+            exception = RequestRead(ModbusRtu::INPUT_REGISTER, pduLength,
+                                    length);
+            break;
+        case MODBUS_FC_WRITE_SINGLE_COIL:
+            exception = RequestWrite(ModbusRtu::COIL, false, pduLength,
+                                     length);
+            break;
+        case MODBUS_FC_WRITE_SINGLE_REGISTER:
+            exception = RequestWrite(ModbusRtu::HOLDING_REGISTER, false,
+                                     pduLength, length);
+            break;
+        case MODBUS_FC_WRITE_MULTIPLE_COILS:
+            exception = RequestWrite(ModbusRtu::COIL, true, pduLength,
+                                     length);
+            break;
+        case MODBUS_FC_WRITE_MULTIPLE_REGISTERS:
+            exception = RequestWrite(ModbusRtu::HOLDING_REGISTER, true,
+                                     pduLength, length);
+            break;
+        default:
+            exception = ModbusRtu::EXCEPTION_ILLEGAL_FUNCTION;
+            break;
+    }
+
+    // The response echoes the transaction, protocol, and unit IDs
+    memcpy(m_txFrame, m_rxFrame, MBAP_LEN);
+    if (exception != ModbusRtu::EXCEPTION_NONE) {
+        m_txFrame[MBAP_LEN] = function | MODBUS_FC_EXCEPTION;
+        m_txFrame[MBAP_LEN + 1] = exception;
+        length = 2;
+    }
+    else {
+        m_txFrame[MBAP_LEN] = function;
+    }
+    Put16(&m_txFrame[4], length + 1);
+    client.Send(m_txFrame, MBAP_LEN + length);
+}
+
+ModbusRtu::Exceptions ModbusTcpServer::RequestRead(
+    ModbusRtu::RegisterTypes type, uint16_t pduLength, uint16_t &length) {
+    const uint8_t *pdu = &m_rxFrame[MBAP_LEN];
+    if (pduLength != 5) {
+        return ModbusRtu::EXCEPTION_ILLEGAL_DATA_VALUE;
+    }
+    uint16_t address = Get16(&pdu[1]);
+    uint16_t count = Get16(&pdu[3]);
+    bool bits = type == ModbusRtu::COIL || type == ModbusRtu::DISCRETE_INPUT;
+    if (!count ||
+            count > (bits ? MODBUS_READ_BITS_MAX : MODBUS_READ_REGISTERS_MAX)) {
+        return ModbusRtu::EXCEPTION_ILLEGAL_DATA_VALUE;
+    }
+    if (static_cast<uint32_t>(address) + count > 0x10000) {
+        return ModbusRtu::EXCEPTION_ILLEGAL_DATA_ADDRESS;
+    }
+
+    uint8_t byteCount = bits ? (count + 7) / 8 : count * 2;
+    uint8_t *data = &m_txFrame[MBAP_LEN + 2];
+    memset(data, 0, byteCount);
+    ModbusRtu::Exceptions exception = Access(type, address, count, data,
+                                      false);
+    if (exception != ModbusRtu::EXCEPTION_NONE) {
+        return exception;
+    }
+    m_txFrame[MBAP_LEN + 1] = byteCount;
+    length = 2 + byteCount;
+    return ModbusRtu::EXCEPTION_NONE;
+}
+
+ModbusRtu::Exceptions ModbusTcpServer::RequestWrite(
+    ModbusRtu::RegisterTypes type, bool multiple, uint16_t pduLength,
+    uint16_t &length) {
+    uint8_t *pdu = &m_rxFrame[MBAP_LEN];
+    uint16_t address = Get16(&pdu[1]);
+    ModbusRtu::Exceptions exception;
+
+    if (!multiple) {
+        if (pduLength != 5) {
+            return ModbusRtu::EXCEPTION_ILLEGAL_DATA_VALUE;
+        }
+        if (type == ModbusRtu::COIL) {
+            uint16_t value = Get16(&pdu[3]);
+            if (value != MODBUS_COIL_ON && value != 0) {
+                return ModbusRtu::EXCEPTION_ILLEGAL_DATA_VALUE;
+            }
+            uint8_t bit = value ? 1 : 0;
+            exception = Access(type, address, 1, &bit, true);
+        }
+        else {
+            exception = Access(type, address, 1, &pdu[3], true);
+        }
+    }
+    else {
+        if (pduLength < 6) {
+            return ModbusRtu::EXCEPTION_ILLEGAL_DATA_VALUE;
+        }
+        uint16_t count = Get16(&pdu[3]);
+        uint8_t byteCount = pdu[5];
+        bool bits = type == ModbusRtu::COIL;
+        if (!count ||
+                count > (bits ? MODBUS_WRITE_BITS_MAX
+                              : MODBUS_WRITE_REGISTERS_MAX) ||
+                byteCount != (bits ? (count + 7) / 8 : count * 2) ||
+                pduLength != 6 + byteCount) {
+            return ModbusRtu::EXCEPTION_ILLEGAL_DATA_VALUE;
+        }
+        if (static_cast<uint32_t>(address) + count > 0x10000) {
+            return ModbusRtu::EXCEPTION_ILLEGAL_DATA_ADDRESS;
+        }
+        exception = Access(type, address, count, &pdu[6], true);
+    }
+
+    if (exception == ModbusRtu::EXCEPTION_NONE) {
+        // The response echoes the address and the value or count
+        memcpy(&m_txFrame[MBAP_LEN + 1], &pdu[1], 4);
+        length = 5;
+    }
+    return exception;
+}
+
+ModbusRtu::Exceptions ModbusTcpServer::Access(ModbusRtu::RegisterTypes type,
+        uint16_t address, uint16_t count, uint8_t *data, bool write) {
+    bool bits = type == ModbusRtu::COIL || type == ModbusRtu::DISCRETE_INPUT;
+    for (uint8_t iRange = 0; iRange < m_mapCount; iRange++) {
+        const RegisterRange &range = m_map[iRange];
+        if (range.Type != type || address < range.Address ||
+                static_cast<uint32_t>(address) + count >
+                static_cast<uint32_t>(range.Address) + range.Count) {
+            continue;
+        }
+        if (write && range.ReadOnly) {
+            return ModbusRtu::EXCEPTION_ILLEGAL_DATA_ADDRESS;
+        }
+
+        uint16_t offset = address - range.Address;
+        if (bits) {
+            uint8_t *table = static_cast<uint8_t *>(range.Data);
+            for (uint16_t i = 0; i < count; i++) {
+                uint16_t bit = offset + i;
+                uint8_t mask = 1 << (bit & 7);
+                if (write) {
+                    if ((data[i / 8] >> (i & 7)) & 1) {
+                        table[bit / 8] |= mask;
+                    }
+                    else {
+                        table[bit / 8] &= ~mask;
+                    }
+                }
+                else if (table[bit / 8] & mask) {
+                    data[i / 8] |= 1 << (i & 7);
+                }
+            }
+        }
+        else {
+            uint16_t *table = static_cast<uint16_t *>(range.Data) + offset;
+            for (uint16_t i = 0; i < count; i++) {
+                if (write) {
+                    table[i] = Get16(&data[i * 2]);
+                }
+                else {
+                    Put16(&data[i * 2], table[i]);
+                }
+            }
+        }
+        return ModbusRtu::EXCEPTION_NONE;
+    }
+    return CallbackAccess(type, address, count, data, write);
+}
+
+ModbusRtu::Exceptions ModbusTcpServer::CallbackAccess(
+    ModbusRtu::RegisterTypes type, uint16_t address, uint16_t count,
+    uint8_t *data, bool write) {
+    if (!m_callback) {
+        return ModbusRtu::EXCEPTION_ILLEGAL_DATA_ADDRESS;
+    }
+    bool bits = type == ModbusRtu::COIL || type == ModbusRtu::DISCRETE_INPUT;
+    // Pass the values through a buffer at a time, one entry per bit or
+    // register
+    for (uint16_t done = 0; done < count; done += MODBUS_VALUES_MAX) {
+        uint16_t chunk = count - done;
+        if (chunk > MODBUS_VALUES_MAX) {
+            chunk = MODBUS_VALUES_MAX;
+        }
+        if (write) {
+            for (uint16_t i = 0; i < chunk; i++) {
+                uint16_t entry = done + i;
+                m_values[i] = bits ? (data[entry / 8] >> (entry & 7)) & 1
+                              : Get16(&data[entry * 2]);
+            }
+        }
+        ModbusRtu::Exceptions exception =
+            m_callback(type, address + done, chunk, m_values, write);
+        if (exception != ModbusRtu::EXCEPTION_NONE) {
+            return exception;
+        }
+        if (!write) {
+            for (uint16_t i = 0; i < chunk; i++) {
+                uint16_t entry = done + i;
+                if (!bits) {
+                    Put16(&data[entry * 2], m_values[i]);
+                }
+                else if (m_values[i]) {
+                    data[entry / 8] |= 1 << (entry & 7);
+                }
+            }
+        }
+    }
+    return ModbusRtu::EXCEPTION_NONE;
+}
+
+} // ClearCore namespace
@@ -0,0 +1,781 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    Implementation of the ClearCore coordinated multi-axis motion group
+**/
+
+#include "MotionGroup.h"
+#include <math.h>
+#include <sam.h>
+#include <stdlib.h>
+#include "atomic_utils.h"
+#include "MotorManager.h"
+#include "SysTiming.h"
+#include "SysUtils.h"
+
+namespace ClearCore {
+
+// CORDIC gain compensation, 1/K in Q30
+#define CORDIC_GAIN_INV_Q30 652032874
+#define CORDIC_ITERATIONS 28
+
+// atan(2^-i) in binary angle units, 2^32 counts per turn
+static const int32_t CordicAtan[CORDIC_ITERATIONS] ISR_RAMDATA = {
+    536870912, 316933406, 167458907, 85004756, 42667331, 21354465, 10679838,
+    5340245, 2670163, 1335087, 667544, 333772, 166886, 83443, 41722, 20861,
+    10430, 5215, 2608, 1304, 652, 326, 163, 81, 41, 20, 10, 5
+};
+
+/*
+    Compute the cosine and sine of a binary angle in Q30 using shift-and-add
+    CORDIC rotations. The run time does not depend on the angle.
+*/
+ISR_RAMFUNC static void CordicCosSin(uint32_t angle, int32_t &cosQ30,
+                                     int32_t &sinQ30) {
+    // Fold the left half-plane onto the right so the rotation converges
+    bool negate = static_cast<uint32_t>(angle + (1UL << 30)) >= (1UL << 31);
+    if (negate) {
+        angle += 1UL << 31;
+    }
+    int32_t z = static_cast<int32_t>(angle);
+    int32_t x = CORDIC_GAIN_INV_Q30;
+    int32_t y = 0;
+    for (uint8_t i = 0; i < CORDIC_ITERATIONS; i++) {
+        int32_t xShift = x >> i;
+        int32_t yShift = y >> i;
+        if (z >= 0) {
+            x -= yShift;
+            y += xShift;
+            z -= CordicAtan[i];
+        }
+        else {
+            x += yShift;
+            y -= xShift;
+            z += CordicAtan[i];
+        }
+    }
+    cosQ30 = negate ? -x : x;
+    sinQ30 = negate ? -y : y;
+}
+
+MotionGroup::MotionGroup()
+    : m_path(),
+      m_axes(),
+      m_axisCount(0),
+      m_velMax(0),
+      m_active(false),
+      m_stopRequest(StepGenerator::EXTERNAL_STOP_NONE),
+      m_move(),
+      m_axisPosn(),
+      m_queue(),
+      m_queueHead(0),
+      m_queueTail(0),
+      m_queueActive(false),
+      m_queueStopping(false),
+      m_queuePosnQx(0),
+      m_queueVelQx(0),
+      m_queueEnd(),
+      m_queueDirEnd(),
+      m_junctionDeviation(JUNCTION_DEVIATION_DEFAULT),
+      m_registered(false) {
+    m_registered = MotorManager::Instance().MotionGroupAdd(this);
+}
+
+MotionGroup::~MotionGroup() {
+    // Hand the axes back before the sample rate update forgets the group
+    __disable_irq();
+    if (m_active) {
+        m_path.MoveStopAbrupt();
+        AxesRelease();
+    }
+    if (m_registered) {
+        MotorManager::Instance().MotionGroupRemove(this);
+    }
+    __enable_irq();
+}
+
+bool MotionGroup::AxisAdd(MotorDriver &motor) {
+    if (m_active || m_axisCount >= MOTOR_CON_CNT) {
+        return false;
+    }
+    // Two groups on one axis would both write its steps
+    MotorManager &motorMgr = MotorManager::Instance();
+    for (uint8_t g = 0; g < motorMgr.m_motionGroupCount; g++) {
+        MotionGroup *group = motorMgr.m_motionGroups[g];
+        for (uint8_t i = 0; i < group->m_axisCount; i++) {
+            if (group->m_axes[i] == &motor) {
+                return false;
+            }
+        }
+    }
+    for (uint8_t i = 0; i < m_axisCount; i++) {
+        if (m_axes[i] == &motor) {
+            return false;
+        }
+    }
+    m_axes[m_axisCount++] = &motor;
+    return true;
+}
+
+bool MotionGroup::Move(const int32_t *dist,
+                       StepGenerator::MoveTarget moveTarget) {
+    int32_t distRel[MOTOR_CON_CNT];
+    uint32_t stepsPerSampleMax;
+    if (!MoveValidate(dist, moveTarget, distRel, stepsPerSampleMax)) {
+        return false;
+    }
+
+    int32_t start[MOTOR_CON_CNT];
+    for (uint8_t i = 0; i < m_axisCount; i++) {
+        start[i] = m_axes[i]->m_posnAbsolute;
+    }
+    if (!SegmentLine(m_move, start, distRel)) {
+        return false;
+    }
+    if (!m_move.Length) {
+        return true;
+    }
+    return MoveStart(stepsPerSampleMax);
+}
+
+bool MotionGroup::MoveArc(const int32_t *dist, int32_t centerX,
+                          int32_t centerY, bool clockwise,
+                          StepGenerator::MoveTarget moveTarget) {
+    if (m_axisCount < 2) {
+        return false;
+    }
+    int32_t distRel[MOTOR_CON_CNT];
+    uint32_t stepsPerSampleMax;
+    if (!MoveValidate(dist, moveTarget, distRel, stepsPerSampleMax)) {
+        return false;
+    }
+
+    int32_t start[MOTOR_CON_CNT];
+    for (uint8_t i = 0; i < m_axisCount; i++) {
+        start[i] = m_axes[i]->m_posnAbsolute;
+    }
+    if (!SegmentArc(m_move, start, distRel, centerX, centerY, clockwise,
+                    stepsPerSampleMax)) {
+        return false;
+    }
+    return MoveStart(stepsPerSampleMax);
+}
+
+bool MotionGroup::MoveQueueAdd(const int32_t *dist,
+                               StepGenerator::MoveTarget moveTarget) {
+    return QueueAdd(dist, moveTarget, false, 0, 0, false);
+}
+
+bool MotionGroup::MoveArcQueueAdd(const int32_t *dist, int32_t centerX,
+                                  int32_t centerY, bool clockwise,
+                                  StepGenerator::MoveTarget moveTarget) {
+    if (m_axisCount < 2) {
+        return false;
+    }
+    return QueueAdd(dist, moveTarget, true, centerX, centerY, clockwise);
+}
+
+bool MotionGroup::MoveValidate(const int32_t *dist,
+                               StepGenerator::MoveTarget moveTarget,
+                               int32_t *distRel,
+                               uint32_t &stepsPerSampleMax) {
+    if (!m_registered || !dist || !m_axisCount || m_active) {
+        return false;
+    }
+
+    stepsPerSampleMax = UINT32_MAX;
+    bool valid = true;
+
+    for (uint8_t i = 0; i < m_axisCount; i++) {
+        MotorDriver *axis = m_axes[i];
+        if (!axis->StepsComplete()) {
+            return false;
+        }
+        if (moveTarget == StepGenerator::MOVE_TARGET_ABSOLUTE) {
+            distRel[i] = dist[i] - axis->m_posnAbsolute;
+        }
+        else {
+            distRel[i] = dist[i];
+        }
+        // Check every axis so each one reports why it refused the move
+        if (!axis->ValidateMove(distRel[i] < 0)) {
+            valid = false;
+        }
+        stepsPerSampleMax = min(stepsPerSampleMax, axis->m_stepsPerSampleMax);
+    }
+    return valid;
+}
+
+/*
+    Fill in the geometry of a straight line.
+*/
+bool MotionGroup::SegmentLine(Segment &seg, const int32_t *start,
+                              const int32_t *distRel) {
+    float lengthSq = 0;
+    uint32_t distMax = 0;
+    for (uint8_t i = 0; i < m_axisCount; i++) {
+        lengthSq += static_cast<float>(distRel[i]) * distRel[i];
+        distMax = max(distMax, static_cast<uint32_t>(abs(distRel[i])));
+    }
+
+    // The path must be at least as long as the longest axis move so that no
+    // axis is asked to step faster than the path.
+    float length = ceilf(sqrtf(lengthSq));
+    if (length >= static_cast<float>(INT32_MAX)) {
+        return false;
+    }
+    int32_t pathLength = max(static_cast<int32_t>(length),
+                             static_cast<int32_t>(distMax));
+
+    seg.Length = pathLength;
+    seg.Arc = false;
+    for (uint8_t i = 0; i < m_axisCount; i++) {
+        seg.AxisStart[i] = start[i];
+        seg.AxisDist[i] = distRel[i];
+        if (!pathLength) {
+            seg.AxisRatioQ31[i] = 0;
+            continue;
+        }
+        // Round the ratio to nearest
+        int64_t distQ31 = static_cast<int64_t>(distRel[i]) << 31;
+        seg.AxisRatioQ31[i] = (distQ31 + (distRel[i] < 0 ? -pathLength / 2
+                                                         : pathLength / 2)) /
+                              pathLength;
+    }
+    return true;
+}
+
+/*
+    Fill in the geometry of an arc, or a helix if there are more than two
+    axes. The step rate limit is lowered to leave room for the rounding of
+    the arc axes onto the step grid.
+*/
+bool MotionGroup::SegmentArc(Segment &seg, const int32_t *start,
+                             const int32_t *distRel, int32_t centerX,
+                             int32_t centerY, bool clockwise,
+                             uint32_t &stepsPerSampleMax) {
+    // Start and end points relative to the center
+    float startX = -static_cast<float>(centerX);
+    float startY = -static_cast<float>(centerY);
+    float endX = static_cast<float>(distRel[0]) - centerX;
+    float endY = static_cast<float>(distRel[1]) - centerY;
+    float radius = sqrtf(startX * startX + startY * startY);
+    float radiusEnd = sqrtf(endX * endX + endY * endY);
+    if (radius < 1.0f || radius >= static_cast<float>(ARC_RADIUS_MAX) ||
+            fabsf(radius - radiusEnd) >
+            max(ARC_RADIUS_TOLERANCE, radius * ARC_RADIUS_TOLERANCE_FRACT)) {
+        return false;
+    }
+
+    // Angles are binary, with 2^32 counts per turn
+    const float countsPerRad = 4294967296.0f / (2.0f * static_cast<float>(M_PI));
+    uint32_t angleStart = static_cast<uint32_t>(
+        static_cast<int64_t>(atan2f(startY, startX) * countsPerRad));
+    uint32_t angleEnd = static_cast<uint32_t>(
+        static_cast<int64_t>(atan2f(endY, endX) * countsPerRad));
+    // Coincident start and end points make a full circle
+    int64_t sweep = clockwise ? static_cast<uint32_t>(angleStart - angleEnd)
+                              : static_cast<uint32_t>(angleEnd - angleStart);
+    if (!sweep) {
+        sweep = 1LL << 32;
+    }
+
+    // The path length includes any linear travel of the remaining axes so
+    // they form a helix with the arc.
+    float arcLength = max(radius, radiusEnd) * (sweep / countsPerRad);
+    float lengthSq = arcLength * arcLength;
+    uint32_t distMax = 0;
+    for (uint8_t i = 2; i < m_axisCount; i++) {
+        lengthSq += static_cast<float>(distRel[i]) * distRel[i];
+        distMax = max(distMax, static_cast<uint32_t>(abs(distRel[i])));
+    }
+    float length = ceilf(sqrtf(lengthSq));
+    if (length >= static_cast<float>(INT32_MAX)) {
+        return false;
+    }
+    int32_t pathLength = max(static_cast<int32_t>(length),
+                             static_cast<int32_t>(distMax));
+
+    if (stepsPerSampleMax > 1) {
+        stepsPerSampleMax--;
+    }
+
+    seg.Length = pathLength;
+    for (uint8_t i = 0; i < m_axisCount; i++) {
+        seg.AxisStart[i] = start[i];
+        seg.AxisDist[i] = distRel[i];
+        // Round the ratio to nearest
+        int64_t distQ31 = static_cast<int64_t>(distRel[i]) << 31;
+        seg.AxisRatioQ31[i] = (distQ31 + (distRel[i] < 0 ? -pathLength / 2
+                                                         : pathLength / 2)) /
+                              pathLength;
+    }
+    seg.ArcCenter[0] = start[0] + centerX;
+    seg.ArcCenter[1] = start[1] + centerY;
+    seg.ArcRadiusQ8 = static_cast<int64_t>(radius * 256.0f + 0.5f);
+    // The change in radius per step of path, in Q8 steps scaled by 2^32
+    int64_t radiusEndQ8 = static_cast<int64_t>(radiusEnd * 256.0f + 0.5f);
+    seg.ArcRadiusRateQ40 = ((radiusEndQ8 - seg.ArcRadiusQ8) << 32) /
+                           pathLength;
+    seg.ArcAngleStart = angleStart;
+    seg.ArcRatioQ16 = (sweep << 16) / pathLength;
+    if (clockwise) {
+        seg.ArcRatioQ16 = -seg.ArcRatioQ16;
+    }
+    seg.Arc = true;
+    return true;
+}
+
+/*
+    Find the unit vectors, in step space, of the direction of travel at the
+    start and end of a segment.
+*/
+void MotionGroup::SegmentDirections(const Segment &seg, float *dirStart,
+                                    float *dirEnd) {
+    float length = static_cast<float>(seg.Length);
+    for (uint8_t i = 0; i < m_axisCount; i++) {
+        dirStart[i] = seg.AxisDist[i] / length;
+        dirEnd[i] = dirStart[i];
+    }
+    if (!seg.Arc) {
+        return;
+    }
+
+    // The arc axes take the share of the path the linear axes leave, at a
+    // tangent to the circle
+    float linearSq = 0;
+    for (uint8_t i = 2; i < m_axisCount; i++) {
+        linearSq += dirStart[i] * dirStart[i];
+    }
+    float arcShare = sqrtf(max(1.0f - linearSq, 0.0f));
+    float radius = seg.ArcRadiusQ8 / 256.0f;
+    float scale = (seg.ArcRatioQ16 < 0 ? -arcShare : arcShare) / radius;
+    float startX = static_cast<float>(seg.AxisStart[0] - seg.ArcCenter[0]);
+    float startY = static_cast<float>(seg.AxisStart[1] - seg.ArcCenter[1]);
+    float endX = startX + seg.AxisDist[0];
+    float endY = startY + seg.AxisDist[1];
+    // Counterclockwise travel is a quarter turn ahead of the radius
+    dirStart[0] = -startY * scale;
+    dirStart[1] = startX * scale;
+    dirEnd[0] = -endY * scale;
+    dirEnd[1] = endX * scale;
+}
+
+bool MotionGroup::MoveStart(uint32_t stepsPerSampleMax) {
+    // The path is never stepped faster than the slowest axis can step
+    m_path.m_stepsPerSampleMax = stepsPerSampleMax;
+    m_path.VelMax(m_velMax);
+    m_path.PositionRefSet(0);
+    // The path does not advance until the group is active
+    if (!m_path.Move(m_move.Length)) {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < m_axisCount; i++) {
+        m_axisPosn[i] = m_move.AxisStart[i];
+    }
+    m_stopRequest = StepGenerator::EXTERNAL_STOP_NONE;
+
+    // Hand all of the axes to the group on the same sample
+    __disable_irq();
+    m_queueActive = false;
+    AxesAcquire();
+    __enable_irq();
+
+    return true;
+}
+
+/*
+    Add a segment to the queued path and plan the queue again.
+
+    The plan is made without holding off the interrupt and committed with it
+    held off. If the interrupt moved on to another segment in the meantime,
+    the plan is made again.
+*/
+bool MotionGroup::QueueAdd(const int32_t *dist,
+                           StepGenerator::MoveTarget moveTarget, bool arc,
+                           int32_t centerX, int32_t centerY, bool clockwise) {
+    if (!m_registered || !dist || !m_axisCount) {
+        return false;
+    }
+
+    while (true) {
+        bool active = m_active;
+        bool running = active && m_queueActive;
+        if (active && !running) {
+            // A Move() or MoveArc() is in progress
+            return false;
+        }
+        uint8_t tail = atomic_load_n(&m_queueTail);
+        uint8_t head = m_queueHead;
+        if (static_cast<uint8_t>(head - tail) >= MOTION_GROUP_QUEUE_LENGTH) {
+            return false;
+        }
+
+        int32_t start[MOTOR_CON_CNT];
+        int32_t distRel[MOTOR_CON_CNT];
+        uint32_t stepsPerSampleMax = UINT32_MAX;
+        bool valid = true;
+        for (uint8_t i = 0; i < m_axisCount; i++) {
+            MotorDriver *axis = m_axes[i];
+            if (!running && !axis->StepsComplete()) {
+                return false;
+            }
+            start[i] = running ? m_queueEnd[i] : axis->m_posnAbsolute;
+            if (moveTarget == StepGenerator::MOVE_TARGET_ABSOLUTE) {
+                distRel[i] = dist[i] - start[i];
+            }
+            else {
+                distRel[i] = dist[i];
+            }
+            // Check every axis so each one reports why it refused the move
+            if (!axis->ValidateMove(distRel[i] < 0)) {
+                valid = false;
+            }
+            stepsPerSampleMax =
+                min(stepsPerSampleMax, axis->m_stepsPerSampleMax);
+        }
+        if (!valid) {
+            return false;
+        }
+
+        QueuedSegment &seg = m_queue[head & (MOTION_GROUP_QUEUE_LENGTH - 1)];
+        if (arc ? !SegmentArc(seg.Geometry, start, distRel, centerX, centerY,
+                              clockwise, stepsPerSampleMax)
+                : !SegmentLine(seg.Geometry, start, distRel)) {
+            return false;
+        }
+        if (!seg.Geometry.Length) {
+            return true;
+        }
+
+        // Limits in steps and samples
+        seg.AccelQx = m_path.m_accelLimitPendingQx;
+        seg.Accel = seg.AccelQx / static_cast<float>(1L << FRACT_BITS);
+        float velMax = static_cast<float>(m_velMax) / SampleRateHz;
+        velMax = min(velMax, static_cast<float>(stepsPerSampleMax));
+        if (arc) {
+            // Keep the centripetal acceleration within the limit
+            velMax = min(velMax,
+                         sqrtf(seg.Accel * seg.Geometry.ArcRadiusQ8 / 256.0f));
+        }
+        seg.VelMax = max(velMax, 1.0f / (1L << FRACT_BITS));
+
+        // The speed through the junction with the segment before, from the
+        // circle that deviates from the vertex by the junction deviation.
+        // Starting from rest, or reversing, leaves no speed at all.
+        float dirStart[MOTOR_CON_CNT];
+        float dirEnd[MOTOR_CON_CNT];
+        SegmentDirections(seg.Geometry, dirStart, dirEnd);
+        seg.JunctionVelMax = 0;
+        if (running && head != tail) {
+            const QueuedSegment &prev =
+                m_queue[(head - 1) & (MOTION_GROUP_QUEUE_LENGTH - 1)];
+            float cosTurn = 0;
+            for (uint8_t i = 0; i < m_axisCount; i++) {
+                cosTurn += m_queueDirEnd[i] * dirStart[i];
+            }
+            float velJunction = min(seg.VelMax, prev.VelMax);
+            if (cosTurn < 0.999999f) {
+                // The sine of half the angle between the segments
+                float sinHalf = sqrtf(max(0.5f * (1.0f + cosTurn), 0.0f));
+                velJunction = min(velJunction, sqrtf(
+                                      seg.Accel * m_junctionDeviation *
+                                      sinHalf / max(1.0f - sinHalf, 1e-6f)));
+            }
+            seg.JunctionVelMax = velJunction;
+        }
+
+        // Plan from the segment after the one in progress, which keeps the
+        // exit speed it was committed with, or from the start of the new path
+        // if nothing is in progress
+        uint8_t first = tail;
+        float velEntry = 0;
+        if (running && head != tail) {
+            first = tail + 1;
+            const QueuedSegment &current =
+                m_queue[tail & (MOTION_GROUP_QUEUE_LENGTH - 1)];
+            velEntry = current.VelExitQx /
+                       static_cast<float>(1L << FRACT_BITS);
+        }
+        QueuePlan(first, head + 1, velEntry);
+
+        __disable_irq();
+        if (tail != m_queueTail || active != m_active ||
+                (active && !m_queueActive)) {
+            __enable_irq();
+            continue;
+        }
+        for (uint8_t i = first; i != static_cast<uint8_t>(head + 1); i++) {
+            QueuedSegment &planned =
+                m_queue[i & (MOTION_GROUP_QUEUE_LENGTH - 1)];
+            planned.VelCruiseQx = static_cast<int32_t>(
+                                      planned.VelMax * (1L << FRACT_BITS));
+            planned.VelExitQx = static_cast<int32_t>(
+                                    planned.VelExit * (1L << FRACT_BITS));
+        }
+        m_queueHead = head + 1;
+        m_path.m_stepsPerSampleMax = stepsPerSampleMax;
+        if (!running) {
+            m_queuePosnQx = 0;
+            m_queueVelQx = 0;
+            m_queueStopping = false;
+            m_stopRequest = StepGenerator::EXTERNAL_STOP_NONE;
+            for (uint8_t i = 0; i < m_axisCount; i++) {
+                m_axisPosn[i] = start[i];
+            }
+            m_queueActive = true;
+            AxesAcquire();
+        }
+        __enable_irq();
+
+        for (uint8_t i = 0; i < m_axisCount; i++) {
+            m_queueEnd[i] = start[i] + distRel[i];
+            m_queueDirEnd[i] = dirEnd[i];
+        }
+        return true;
+    }
+}
+
+/*
+    Plan the speeds at the ends of the queued segments from first up to end.
+
+    The backward pass finds the fastest each segment may be entered and
+    still slow down for everything after it, ending at rest. The forward
+    pass then limits each segment's exit to what it can reach from its
+    entry.
+*/
+void MotionGroup::QueuePlan(uint8_t first, uint8_t end, float velEntry) {
+    float velNext = 0;
+    for (uint8_t i = end; i != first;) {
+        i--;
+        QueuedSegment &seg = m_queue[i & (MOTION_GROUP_QUEUE_LENGTH - 1)];
+        seg.VelExit = velNext;
+        float velReach = sqrtf(velNext * velNext +
+                               2.0f * seg.Accel * seg.Geometry.Length);
+        velNext = min(seg.JunctionVelMax, velReach);
+        seg.VelEntry = velNext;
+    }
+
+    float vel = velEntry;
+    for (uint8_t i = first; i != end; i++) {
+        QueuedSegment &seg = m_queue[i & (MOTION_GROUP_QUEUE_LENGTH - 1)];
+        seg.VelEntry = vel;
+        float velReach = sqrtf(vel * vel +
+                               2.0f * seg.Accel * seg.Geometry.Length);
+        seg.VelExit = min(seg.VelExit, velReach);
+        vel = seg.VelExit;
+    }
+}
+
+ISR_RAMFUNC void MotionGroup::Update() {
+    if (!m_active) {
+        return;
+    }
+
+    // The final steps of the path were sent on the previous sample. Hold
+    // the axes until they have worked off any steps they carried over.
+    if (!m_queueActive && m_path.StepsComplete()) {
+        if (!AxesCarrying()) {
+            AxesRelease();
+        }
+        return;
+    }
+
+    // A stop requested on the group or on any of its axes stops the path
+    StepGenerator::ExternalStopRequests stop = m_stopRequest;
+    m_stopRequest = StepGenerator::EXTERNAL_STOP_NONE;
+    for (uint8_t i = 0; i < m_axisCount; i++) {
+        MotorDriver *axis = m_axes[i];
+        if (axis->m_stepsExternalStop > stop) {
+            stop = axis->m_stepsExternalStop;
+        }
+        axis->m_stepsExternalStop = StepGenerator::EXTERNAL_STOP_NONE;
+    }
+    if (m_queueActive) {
+        QueueUpdate(stop);
+        return;
+    }
+    if (stop == StepGenerator::EXTERNAL_STOP_ABRUPT) {
+        m_path.MoveStopAbrupt();
+        AxesRelease();
+        return;
+    }
+    if (stop == StepGenerator::EXTERNAL_STOP_DECEL) {
+        m_path.MoveStopDecel();
+    }
+
+    m_path.StepsCalculated();
+    int32_t pathPosn = m_path.m_posnAbsolute;
+    AxesTargetsSend(m_move, pathPosn, pathPosn == m_move.Length);
+}
+
+/*
+    Advance along the queued path by one sample.
+
+    The speed ramps up at the acceleration limit to the segment's limit, and
+    is held to what still lets it slow to the planned exit speed by the end
+    of the segment. Any distance left over at the end of a segment is
+    carried into the next. The feed-rate override stretches the profile's
+    time.
+*/
+ISR_RAMFUNC void MotionGroup::QueueUpdate(
+    StepGenerator::ExternalStopRequests stop) {
+    uint8_t tail = m_queueTail;
+    uint8_t head = atomic_load_n(&m_queueHead);
+    if (stop == StepGenerator::EXTERNAL_STOP_ABRUPT || tail == head) {
+        // Stopped, or the final steps were sent on the previous sample
+        m_queueTail = head;
+        if (stop == StepGenerator::EXTERNAL_STOP_ABRUPT || !AxesCarrying()) {
+            AxesRelease();
+        }
+        return;
+    }
+    if (stop == StepGenerator::EXTERNAL_STOP_DECEL) {
+        m_queueStopping = true;
+    }
+
+    const QueuedSegment *seg = &m_queue[tail & (MOTION_GROUP_QUEUE_LENGTH - 1)];
+    int32_t vel = m_queueVelQx;
+    int32_t rate = m_path.FeedOverrideRamp(vel >> FRACT_BITS, seg->AccelQx);
+    int32_t accel = (static_cast<int64_t>(seg->AccelQx) * rate) >> FRACT_BITS;
+
+    int64_t lengthQx = static_cast<int64_t>(seg->Geometry.Length) << FRACT_BITS;
+    float remQx = static_cast<float>(lengthQx - m_queuePosnQx);
+    float velExit = static_cast<float>(seg->VelExitQx);
+    int32_t velStop = static_cast<int32_t>(
+                          sqrtf(velExit * velExit +
+                                2.0f * seg->AccelQx * remQx));
+    int32_t velNext = min(min(vel + accel, seg->VelCruiseQx), velStop);
+    if (m_queueStopping) {
+        velNext = min(velNext, max(vel - accel, 0));
+        if (!velNext || !rate) {
+            // Stop here and drop the rest of the path
+            m_queueVelQx = 0;
+            m_queueTail = head;
+            AxesRelease();
+            return;
+        }
+    }
+    m_queuePosnQx += (static_cast<int64_t>(vel + velNext) * rate) >>
+                     (FRACT_BITS + 1);
+    m_queueVelQx = velNext;
+
+    while (m_queuePosnQx >= lengthQx) {
+        tail++;
+        if (tail == head) {
+            // The end of the path
+            m_queuePosnQx = lengthQx;
+            m_queueVelQx = 0;
+            break;
+        }
+        m_queuePosnQx -= lengthQx;
+        seg = &m_queue[tail & (MOTION_GROUP_QUEUE_LENGTH - 1)];
+        lengthQx = static_cast<int64_t>(seg->Geometry.Length) << FRACT_BITS;
+    }
+    int32_t pathPosn = m_queuePosnQx >> FRACT_BITS;
+    AxesTargetsSend(seg->Geometry, pathPosn,
+                    pathPosn == seg->Geometry.Length);
+    if (tail == head) {
+        m_queuePosnQx = 0;
+    }
+    atomic_store_n(&m_queueTail, tail);
+}
+
+/*
+    Send each axis the steps to the point on a segment at a path position.
+*/
+ISR_RAMFUNC void MotionGroup::AxesTargetsSend(const Segment &seg,
+                                              int32_t posn, bool end) {
+    // The arc position is computed from the path position each sample, so
+    // the cost is fixed and no error accumulates along the arc.
+    int32_t arcQ30[2] = {0, 0};
+    int64_t radiusQ8 = 0;
+    if (seg.Arc && !end) {
+        uint32_t angle = seg.ArcAngleStart +
+                         static_cast<uint32_t>((seg.ArcRatioQ16 * posn) >> 16);
+        CordicCosSin(angle, arcQ30[0], arcQ30[1]);
+        radiusQ8 = seg.ArcRadiusQ8 + ((seg.ArcRadiusRateQ40 * posn) >> 32);
+    }
+
+    for (uint8_t i = 0; i < m_axisCount; i++) {
+        int32_t target;
+        if (end) {
+            // Land exactly on the target regardless of ratio rounding
+            target = seg.AxisStart[i] + seg.AxisDist[i];
+        }
+        else if (seg.Arc && i < 2) {
+            target = seg.ArcCenter[i] +
+                     static_cast<int32_t>((radiusQ8 * arcQ30[i] +
+                                           (1LL << 37)) >> 38);
+        }
+        else {
+            target = seg.AxisStart[i] +
+                     static_cast<int32_t>((seg.AxisRatioQ31[i] * posn) >> 31);
+        }
+        m_axes[i]->m_stepsExternal = target - m_axisPosn[i];
+        m_axisPosn[i] = target;
+    }
+}
+
+/*
+    Hand the axes to the group. Called with the sample rate interrupt held
+    off so they all start on the same sample.
+*/
+void MotionGroup::AxesAcquire() {
+    for (uint8_t i = 0; i < m_axisCount; i++) {
+        MotorDriver *axis = m_axes[i];
+        axis->m_stepsExternal = 0;
+        axis->m_stepsExternalCarry = 0;
+        axis->m_stepsExternalStop = StepGenerator::EXTERNAL_STOP_NONE;
+        axis->m_lastMoveWasPositional = true;
+        axis->m_stepsExternalActive = true;
+    }
+    m_active = true;
+}
+
+void MotionGroup::AxesRelease() {
+    for (uint8_t i = 0; i < m_axisCount; i++) {
+        MotorDriver *axis = m_axes[i];
+        axis->m_stepsExternal = 0;
+        axis->m_stepsExternalCarry = 0;
+        axis->m_stepsExternalStop = StepGenerator::EXTERNAL_STOP_NONE;
+        axis->m_stepsExternalActive = false;
+    }
+    m_queueActive = false;
+    m_active = false;
+}
+
+/*
+    Check whether any axis still has steps held back by its step rate limit.
+*/
+bool MotionGroup::AxesCarrying() {
+    for (uint8_t i = 0; i < m_axisCount; i++) {
+        if (m_axes[i]->m_stepsExternalCarry) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // ClearCore namespace
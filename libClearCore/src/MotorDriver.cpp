@@ -31,12 +31,15 @@
 #include "atomic_utils.h"
 #include "CcioBoardManager.h"
 #include "Connector.h"
+#include "DigitalInOutAnalogOut.h"
+#include "EncoderInput.h"
 #include "InputManager.h"
 #include "MotorManager.h"
 #include "StatusManager.h"
 #include "SysManager.h"
 #include "SysTiming.h"
 #include "SysUtils.h"
+#include "TraceManager.h"
 
 #define HLFB_CARRIER_LOSS_ERROR_LIMIT (0)
 #define HLFB_CARRIER_LOSS_STATE_CHANGE_MS (4)
@@ -49,15 +52,23 @@
 
 namespace ClearCore {
 
+extern EventManager &EventMgr;
+extern InputManager &InputMgr;
 extern MotorManager &MotorMgr;
 extern SysManager SysMgr;
 extern SysTiming &TimingMgr;
-extern CcioBoardManager &CcioMgr;
+extern EncoderInput EncoderIn;
 extern ShiftRegister ShiftReg;
 extern volatile uint32_t tickCnt;
 
 static Tcc *const tcc_modules[TCC_INST_NUM] = TCC_INSTS;
 
+// The DMA triggers at each TCC's overflow, for duty tables
+static const uint8_t tccOvfTriggers[TCC_INST_NUM] = {
+    TCC0_DMAC_ID_OVF, TCC1_DMAC_ID_OVF, TCC2_DMAC_ID_OVF, TCC3_DMAC_ID_OVF,
+    TCC4_DMAC_ID_OVF
+};
+
 // Needed to calculate the correct index into the CCBUF register
 // for a given TCC when constructing motor connectors.
 uint8_t TccCcNum(uint8_t tccNum) {
@@ -107,16 +118,28 @@ MotorDriver::MotorDriver(ShiftRegister::Masks enableMask,
       m_hlfbTcNum(hlfbTc),
       m_hlfbEvt(hlfbEvt),
       m_hlfbMode(HLFB_MODE_STATIC),
-      m_hlfbWidth{0, 0},
-      m_hlfbPeriod{0, 0},
+      m_hlfbCaptures(),
+      m_hlfbDmaDesc(),
+      m_hlfbDmaChannel(DMA_INVALID_CHANNEL),
+      m_hlfbCaptureTail(0),
+      m_hlfbCaptureValid(0),
       m_hlfbNoPwmSampleCount(2),
       m_hlfbCarrierFrequency(HLFB_CARRIER_45_HZ),
       m_hlfbCarrierLossStateChange_ms(HLFB_CARRIER_LOSS_STATE_CHANGE_MS_45_HZ),
       m_hlfbLastCarrierDetectTime(UINT32_MAX),
       m_hlfbDuty(HLFB_DUTY_UNKNOWN),
+      m_hlfbDutyHundredths(HLFB_DUTY_UNKNOWN * 100),
+      m_torqueLimitAction(TORQUE_LIMIT_OFF),
+      m_torqueLimit(0),
+      m_torqueLimitSamples(1),
+      m_torqueLimitCount(0),
+      m_torqueLimitReached(false),
+      m_hlfbSpeedFullScale(0),
+      m_hlfbSpeedFilter(nullptr),
+      m_hlfbSpeed(0),
+      m_hlfbSpeedNegative(false),
       m_hlfbState(HLFB_UNKNOWN),
       m_lastHlfbInputValue(false),
-      m_hlfbPwmReadingPending(false),
       m_hlfbStateChangeCounter(MS_TO_SAMPLES * HLFB_CARRIER_LOSS_STATE_CHANGE_MS_45_HZ),
       m_polarityInversions(0),
       m_enableRequestedState(false),
@@ -126,6 +149,16 @@ MotorDriver::MotorDriver(ShiftRegister::Masks enableMask,
       m_enableTriggerPulseLenMs(25),
       m_aDutyCnt(0),
       m_bDutyCnt(0),
+      m_aDutyTableDma(DMA_CHANNEL_NONE),
+      m_bDutyTableDma(DMA_CHANNEL_NONE),
+      m_ffMotor(nullptr),
+      m_ffDac(nullptr),
+      m_ffOffset(0),
+      m_ffVelScale(0),
+      m_ffAccelScale(0),
+      m_ffFullScale(0),
+      m_ffVelLastQx(0),
+      m_ffDacPending(0),
       m_inFault(false),
       m_statusRegMotor(0),
       m_statusRegMotorRisen(0),
@@ -142,11 +175,32 @@ MotorDriver::MotorDriver(ShiftRegister::Masks enableMask,
       m_limitSwitchPos(CLEARCORE_PIN_INVALID),
       m_eStopConnector(CLEARCORE_PIN_INVALID),
       m_motionCancellingEStop(false),
+      m_homingState(HOMING_IDLE),
+      m_homingNext(HOMING_IDLE),
+      m_homingNegDir(false),
+      m_homingSeekVel(0),
+      m_homingApproachVel(0),
+      m_homingBackOffDist(0),
+      m_homingIndexDist(0),
+      m_homingPosn(0),
+      m_homingStageStart(0),
+      m_homingLatch(0),
+      m_homingCapture(),
+      m_homingCaptured(false),
       m_shiftRegEnableReq(false),
       m_clearFaultState(CLEAR_FAULT_IDLE),
-      m_clearFaultHlfbTimer(0) {
+      m_clearFaultHlfbTimer(0),
+      m_hlfbEdgeSense(false),
+      m_inPositionEvent(false),
+      m_inPositionCycles(0),
+      m_inPositionCallback(nullptr) {
 
     m_interruptAvail = true;
+#if CLEARCORE_ISR_PROFILE
+    m_profileRefresh = SysTiming::IsrStageStats();
+    m_profileRefresh.MinCycles = UINT32_MAX;
+    m_profileSteps = m_profileRefresh;
+#endif
 
     Tcc *theTcc = (tcc_modules[m_aInfo->tccNum]);
     uint8_t ccIndex = m_aInfo->tccPadNum % TccCcNum(m_aInfo->tccNum);
@@ -165,10 +219,17 @@ MotorDriver::MotorDriver(ShiftRegister::Masks enableMask,
 /*
     Update the HLFB state
 */
-void MotorDriver::Refresh() {
+ISR_RAMFUNC void MotorDriver::Refresh() {
     if (!m_initialized) {
         return;
     }
+#if CLEARCORE_ISR_PROFILE
+    uint32_t refreshStart = DWT->CYCCNT;
+#endif
+
+    // Start any move posted since the last sample, so homing and the status
+    // checks below see the axis as moving
+    StepGenerator::MoveCommandsTake();
 
     // Process the HLFB input as static levels/filtering
     DigitalIn::Refresh();
@@ -189,57 +250,14 @@ void MotorDriver::Refresh() {
             if ((intFlagReg & (TC_INTFLAG_OVF | TC_INTFLAG_ERR)) ||
                 (Milliseconds() - m_hlfbLastCarrierDetectTime
                     >= HLFB_CARRIER_LOSS_STATE_CHANGE_MS)) {
-                tcCount->INTFLAG.reg = TC_INTFLAG_OVF | TC_INTFLAG_MC0 |
-                                       TC_INTFLAG_ERR | TC_INTFLAG_MC1;
+                tcCount->INTFLAG.reg = TC_INTFLAG_OVF | TC_INTFLAG_ERR;
                 // Saturating increment
                 m_hlfbNoPwmSampleCount = __QADD16(m_hlfbNoPwmSampleCount, 1U);
                 m_hlfbCarrierLost =
                     m_hlfbNoPwmSampleCount > HLFB_CARRIER_LOSS_ERROR_LIMIT;
             }
-            // Did we capture a period?
-            if (intFlagReg & TC_INTFLAG_MC0) {
-                m_hlfbLastCarrierDetectTime = Milliseconds();
-
-                if (m_hlfbNoPwmSampleCount) {
-                    // When coming out of overflow/error conditions do not use
-                    // the next measurement because the pulse may be clipped
-                    tcCount->INTFLAG.reg = TC_INTFLAG_MC0 | TC_INTFLAG_MC1;
-                    m_hlfbPwmReadingPending = false;
-                    m_hlfbNoPwmSampleCount = 0;
-                }
-                else if (intFlagReg & TC_INTFLAG_MC1) {
-                    // Save history and use only the (n-1)st item to return as the
-                    // last PWM captured might be clipped in a move done case.
-                    m_hlfbWidth[0] = m_hlfbWidth[CPM_HLFB_CAP_HISTORY - 1];
-                    m_hlfbPeriod[0] = m_hlfbPeriod[CPM_HLFB_CAP_HISTORY - 1];
-                    m_hlfbWidth[CPM_HLFB_CAP_HISTORY - 1] = tcCount->CC[1].reg;
-                    m_hlfbPeriod[CPM_HLFB_CAP_HISTORY - 1] = tcCount->CC[0].reg;
-
-                    // Both period and pulse width have been captured
-                    // If this is the first valid pulse, wait until a second
-                    // pulse is seen before announcing that a measurement is
-                    // present. This ensures that the pulse isn't being clipped
-                    // by having the signal go away.
-                    if (m_hlfbPwmReadingPending) {
-                        m_hlfbCarrierLost = false;
-                        float dutyCycle = static_cast<float>(m_hlfbWidth[0]) /
-                                          static_cast<float>(m_hlfbPeriod[0]);
-                        // Convert to floating and inflate 5-95% to 0-100%
-                        m_hlfbDuty = (dutyCycle - 0.05) * (10000. / 90.);
-
-                        if (invert) {
-                            m_hlfbDuty = 100 - m_hlfbDuty;
-                        }
-
-                        // Convert unipolar to bipolar?
-                        if (m_hlfbMode == HLFB_MODE_HAS_BIPOLAR_PWM) {
-                            m_hlfbDuty = 2.0 * (m_hlfbDuty - 50.);
-                        }
-                        m_hlfbState = HLFB_HAS_MEASUREMENT;
-                    }
-                    m_hlfbPwmReadingPending = true;
-                }
-            }
+            // Did the DMA copy in any new period/width captures?
+            HlfbCapturesProcess(invert);
 
             if (!m_hlfbCarrierLost) {
                 m_hlfbStateChangeCounter = (MS_TO_SAMPLES * m_hlfbCarrierLossStateChange_ms);
@@ -262,17 +280,22 @@ void MotorDriver::Refresh() {
         case HLFB_MODE_STATIC:
         default:
             m_hlfbDuty = HLFB_DUTY_UNKNOWN;
+            m_hlfbDutyHundredths = HLFB_DUTY_UNKNOWN * 100;
             m_hlfbState = (DigitalIn::m_stateFiltered ^ invert) ?
                           HLFB_ASSERTED : HLFB_DEASSERTED;
             break;
     }
+    if (m_hlfbSpeedFullScale) {
+        HlfbSpeedUpdate();
+    }
 
     // Read associated input connectors and write associated output connectors.
     if (m_enableConnector != CLEARCORE_PIN_INVALID) {
         // Update the Enable state with the value on the Enable connector.
         Connector *input= SysMgr.ConnectorByIndex(m_enableConnector);
         if (input->Type() == ClearCore::Connector::CCIO_DIGITAL_IN_OUT_TYPE) {
-            EnableRequest(CcioMgr.PinState(m_enableConnector));
+            EnableRequest(CcioBoardManager::ChainByPin(m_enableConnector)
+                          ->PinState(m_enableConnector));
         }
         else {
             DigitalIn *enableIn = static_cast<DigitalIn *>(input);
@@ -283,7 +306,8 @@ void MotorDriver::Refresh() {
         // Update the Input A state with the value on the Input A connector.
         Connector *input= SysMgr.ConnectorByIndex(m_inputAConnector);
         if (input->Type() == ClearCore::Connector::CCIO_DIGITAL_IN_OUT_TYPE) {
-            MotorInAState(CcioMgr.PinState(m_inputAConnector));
+            MotorInAState(CcioBoardManager::ChainByPin(m_inputAConnector)
+                          ->PinState(m_inputAConnector));
         }
         else {
             DigitalIn *inputA = static_cast<DigitalIn *>(input);
@@ -294,7 +318,8 @@ void MotorDriver::Refresh() {
         // Update the Input B state with the value on the Input B connector.
         Connector *input= SysMgr.ConnectorByIndex(m_inputBConnector);
         if (input->Type() == ClearCore::Connector::CCIO_DIGITAL_IN_OUT_TYPE) {
-            MotorInBState(CcioMgr.PinState(m_inputBConnector));
+            MotorInBState(CcioBoardManager::ChainByPin(m_inputBConnector)
+                          ->PinState(m_inputBConnector));
         }
         else {
             DigitalIn *inputB = static_cast<DigitalIn *>(input);
@@ -354,8 +379,28 @@ void MotorDriver::Refresh() {
     }
     statusRegPending.bit.InEStopSensor = (eStopInput || m_motionCancellingEStop);
 
-    // Check limits
-    if (!m_lastMoveWasPositional && m_statusRegMotor.bit.StepsActive) {
+    // Check the HLFB torque limit
+    if (m_torqueLimitAction != TORQUE_LIMIT_OFF && m_moveState != MS_IDLE &&
+            m_hlfbDutyHundredths != HLFB_DUTY_UNKNOWN * 100 &&
+            abs(m_hlfbDutyHundredths) >= m_torqueLimit) {
+        if (++m_torqueLimitCount >= m_torqueLimitSamples) {
+            m_torqueLimitCount = 0;
+            m_torqueLimitReached = true;
+            if (m_torqueLimitAction == TORQUE_LIMIT_STOP_ABRUPT) {
+                MoveStopAbrupt();
+            }
+            else {
+                MoveStopDecel();
+            }
+        }
+    }
+    else {
+        m_torqueLimitCount = 0;
+    }
+
+    // Check limits. Homing runs into the switch on purpose.
+    if (!m_lastMoveWasPositional && m_statusRegMotor.bit.StepsActive &&
+            !HomingActive()) {
         if (m_direction && m_limitInfo.InNegHWLimit) {
             alertRegPending.bit.MotionCanceledNegativeLimit = 1;
         }
@@ -371,7 +416,8 @@ void MotorDriver::Refresh() {
     statusRegPending.bit.MoveDirection = StepGenerator::m_direction;
     statusRegPending.bit.StepsActive =
         (StepGenerator::m_moveState != StepGenerator::MoveStates::MS_IDLE &&
-            StepGenerator::m_moveState != StepGenerator::MoveStates::MS_END);
+            StepGenerator::m_moveState != StepGenerator::MoveStates::MS_END) ||
+        StepGenerator::StepsExternalMoving();
     statusRegPending.bit.AtTargetPosition = m_isEnabled && 
         m_lastMoveWasPositional && !statusRegPending.bit.StepsActive &&
         m_hlfbState == HLFB_ASSERTED;
@@ -442,16 +488,42 @@ void MotorDriver::Refresh() {
 
     // Calculate the next S&D output step count
     if (Connector::m_mode == Connector::CPM_MODE_STEP_AND_DIR) {
+        if (HomingActive()) {
+            HomingUpdate();
+        }
         // Calculate the number of steps to send in the next sample time
+#if CLEARCORE_ISR_PROFILE
+        uint32_t stepsStart = DWT->CYCCNT;
+        StepGenerator::StepsCalculated();
+        SysTiming::StatsAdd(m_profileSteps, DWT->CYCCNT - stepsStart);
+#else
         StepGenerator::StepsCalculated();
+#endif
         // Check the status of the limits
         StepGenerator::CheckTravelLimits();
 
-        m_bDutyCnt = StepGenerator::m_stepsPrevious;
+        m_bDutyCnt = StepGenerator::PositionLoopSteps(
+                         StepGenerator::StepsShaped(
+                             StepGenerator::StepsGantry(
+                                 StepGenerator::StepsCompensated())));
         // Queue up the steps by writing the B duty value
         UpdateBDuty();
+        if (m_ffMotor || m_ffDac) {
+            FeedForwardUpdate();
+        }
     }
+#if CLEARCORE_ISR_PROFILE
+    SysTiming::StatsAdd(m_profileRefresh, DWT->CYCCNT - refreshStart);
+#endif
+}
+
+#if CLEARCORE_ISR_PROFILE
+void MotorDriver::RefreshCyclesGet(SysTiming::IsrStageStats &refresh,
+                                   SysTiming::IsrStageStats &steps) {
+    SysTiming::StatsTake(m_profileRefresh, refresh);
+    SysTiming::StatsTake(m_profileSteps, steps);
 }
+#endif
 
 bool MotorDriver::ValidateMove(bool negDirection) {
     bool valid = true;
@@ -480,10 +552,13 @@ bool MotorDriver::ValidateMove(bool negDirection) {
 }
 
 bool MotorDriver::Move(int32_t dist, MoveTarget moveTarget) {
+    if (HomingActive()) {
+        return false;
+    }
     bool negDir;
 
-    if (moveTarget == MOVE_TARGET_ABSOLUTE) {
-        negDir = dist - m_posnAbsolute < 0;
+    if (moveTarget != MOVE_TARGET_REL_END_POSN) {
+        negDir = AbsoluteDistance(dist, m_posnAbsolute, moveTarget) < 0;
     }
     else {
         negDir = dist < 0;
@@ -497,10 +572,37 @@ bool MotorDriver::Move(int32_t dist, MoveTarget moveTarget) {
     }
 
     m_lastMoveWasPositional = true;
+    TRACE_EVENT(TRACE_MOTOR_MOVE | m_clearCorePin, dist);
     return StepGenerator::Move(dist, moveTarget);
 }
 
+bool MotorDriver::MoveQueueAdd(int32_t dist, MoveTarget moveTarget) {
+    if (HomingActive()) {
+        return false;
+    }
+    // Only the signed distance is known up front for relative moves; the
+    // limit switches are checked again as each queued move runs.
+    bool negDir;
+
+    if (moveTarget != MOVE_TARGET_REL_END_POSN) {
+        negDir = AbsoluteDistance(dist, m_posnAbsolute, moveTarget) < 0;
+    }
+    else {
+        negDir = dist < 0;
+    }
+
+    if (!ValidateMove(negDir)) {
+        return false;
+    }
+
+    m_lastMoveWasPositional = true;
+    return StepGenerator::MoveQueueAdd(dist, moveTarget);
+}
+
 bool MotorDriver::MoveVelocity(int32_t velocity) {
+    if (HomingActive()) {
+        return false;
+    }
     if (!ValidateMove(velocity < 0)) {
         if (m_statusRegMotor.bit.StepsActive ) {
             MoveStopDecel();
@@ -511,6 +613,345 @@ bool MotorDriver::MoveVelocity(int32_t velocity) {
     return StepGenerator::MoveVelocity(velocity);
 }
 
+bool MotorDriver::GearingStart(int16_t numerator, uint16_t denominator) {
+    return GearingStart(EncoderIn.StepsLastSample(), numerator, denominator);
+}
+
+bool MotorDriver::GearingStart(volatile const int16_t &source,
+                               int16_t numerator, uint16_t denominator) {
+    if (HomingActive()) {
+        return false;
+    }
+    // The encoder may drive the motor either way, so both limits must be
+    // clear
+    bool validPos = ValidateMove(false);
+    bool validNeg = ValidateMove(true);
+    if (!validPos || !validNeg) {
+        if (m_statusRegMotor.bit.StepsActive) {
+            MoveStopDecel();
+        }
+        return false;
+    }
+    m_gearSource = &source;
+    m_lastMoveWasPositional = false;
+    return StepGenerator::GearingStart(numerator, denominator);
+}
+
+bool MotorDriver::CamStart(const CamTable &cam,
+                           volatile const int32_t &masterPosn) {
+    if (HomingActive()) {
+        return false;
+    }
+    // The cam may drive the motor either way, so both limits must be clear
+    bool validPos = ValidateMove(false);
+    bool validNeg = ValidateMove(true);
+    if (!validPos || !validNeg) {
+        if (m_statusRegMotor.bit.StepsActive) {
+            MoveStopDecel();
+        }
+        return false;
+    }
+    m_lastMoveWasPositional = false;
+    return StepGenerator::CamStart(cam, masterPosn);
+}
+
+bool MotorDriver::CamStart(const CamTable &cam) {
+    return CamStart(cam, EncoderIn.PositionRaw());
+}
+
+bool MotorDriver::PositionLoopStart(const PositionLoop &loop) {
+    return StepGenerator::PositionLoopStart(loop, EncoderIn.PositionRaw());
+}
+
+bool MotorDriver::FeedForwardStart(const FeedForward &ff,
+                                   MotorDriver &output) {
+    if (&output == this ||
+            output.m_mode != Connector::CPM_MODE_A_PWM_B_PWM) {
+        return false;
+    }
+    FeedForwardStop();
+    FeedForwardScale(ff, output.m_stepsPerSampleMax);
+    m_ffMotor = &output;
+    return true;
+}
+
+bool MotorDriver::FeedForwardStart(const FeedForward &ff,
+                                   DigitalInOutAnalogOut &output) {
+    if (output.Mode() != Connector::OUTPUT_ANALOG) {
+        return false;
+    }
+    FeedForwardStop();
+    FeedForwardScale(ff, DAC_MAX_VALUE);
+    m_ffDacPending = static_cast<int32_t>(m_ffOffset + 0.5f);
+    m_ffDac = &output;
+    return true;
+}
+
+void MotorDriver::FeedForwardStop() {
+    // Hold off the sample so its write can't land after the offset's
+    __disable_irq();
+    uint16_t offset = static_cast<uint16_t>(m_ffOffset + 0.5f);
+    if (m_ffMotor) {
+        m_ffMotor->MotorInACount(offset);
+    }
+    if (m_ffDac) {
+        m_ffDac->AnalogWrite(offset);
+    }
+    m_ffMotor = nullptr;
+    m_ffDac = nullptr;
+    __enable_irq();
+}
+
+void MotorDriver::FeedForwardScale(const FeedForward &ff, int32_t fullScale) {
+    float countsPerPercent = fullScale / 100.0f;
+    float qxToStepsPerSec = static_cast<float>(SampleRateHz) /
+                            (1UL << FRACT_BITS);
+    m_ffFullScale = fullScale;
+    m_ffOffset = max(min(ff.Offset * countsPerPercent,
+                         static_cast<float>(fullScale)), 0.0f);
+    m_ffVelScale = ff.VelGain * countsPerPercent * qxToStepsPerSec;
+    m_ffAccelScale = ff.AccelGain * countsPerPercent * qxToStepsPerSec *
+                     SampleRateHz;
+    m_ffVelLastQx = VelocityCurrentQx();
+}
+
+void MotorDriver::FeedForwardUpdate() {
+    int32_t velQx = VelocityCurrentQx();
+    float out = m_ffOffset + m_ffVelScale * velQx +
+                m_ffAccelScale * (velQx - m_ffVelLastQx);
+    m_ffVelLastQx = velQx;
+    int32_t count = max(min(static_cast<int32_t>(out + 0.5f),
+                            m_ffFullScale), 0);
+
+    MotorDriver *motor = m_ffMotor;
+    if (motor) {
+        // The duty is double buffered like the steps, so both change at
+        // the next period
+        motor->MotorInACount(count);
+    }
+    DigitalInOutAnalogOut *dac = m_ffDac;
+    if (dac) {
+        dac->AnalogWrite(m_ffDacPending);
+        m_ffDacPending = count;
+    }
+}
+
+bool MotorDriver::HomingStart(bool negDirection, uint32_t seekVel,
+                              uint32_t approachVel, uint32_t backOffDist,
+                              uint32_t indexSearchDist, int32_t homePosn) {
+    ClearCorePins homeSwitch = negDirection ? m_limitSwitchNeg
+                                            : m_limitSwitchPos;
+    if (homeSwitch == CLEARCORE_PIN_INVALID || !seekVel || !approachVel ||
+            HomingActive() || !StepsComplete()) {
+        return false;
+    }
+
+    m_homingNegDir = negDirection;
+    m_homingSeekVel = min(seekVel, (uint32_t)INT32_MAX);
+    m_homingApproachVel = min(approachVel, (uint32_t)INT32_MAX);
+    m_homingBackOffDist = min(backOffDist, (uint32_t)INT32_MAX);
+    m_homingIndexDist = min(indexSearchDist, (uint32_t)INT32_MAX);
+    m_homingPosn = homePosn;
+
+    // Starting on the switch skips the seek
+    bool onSwitch = HomingSwitchActive();
+    if (!ValidateMove(onSwitch ? !negDirection : negDirection)) {
+        return false;
+    }
+    m_lastMoveWasPositional = false;
+    m_homingStageStart = m_posnAbsolute;
+    HomingMove(m_homingSeekVel, !onSwitch);
+    // Hand the sequence to the interrupt once the first stage is moving
+    m_homingState = onSwitch ? HOMING_BACK_OFF : HOMING_SEEK;
+    return true;
+}
+
+void MotorDriver::HomingCancel() {
+    bool active = HomingActive();
+    // Release the sequence before stopping so the interrupt cannot start
+    // the next stage
+    m_homingState = HOMING_IDLE;
+    m_homingCapture.Stop();
+    if (active) {
+        MoveStopDecel();
+    }
+}
+
+bool MotorDriver::HlfbTorqueLimit(float percent, uint16_t samples,
+                                  TorqueLimitActions action) {
+    if (action != TORQUE_LIMIT_OFF && (percent <= 0 || !samples)) {
+        return false;
+    }
+    // Turn the check off while the limit changes
+    m_torqueLimitAction = TORQUE_LIMIT_OFF;
+    m_torqueLimit = static_cast<int32_t>(percent * 100);
+    m_torqueLimitSamples = samples;
+    m_torqueLimitCount = 0;
+    m_torqueLimitReached = false;
+    m_torqueLimitAction = action;
+    return true;
+}
+
+bool MotorDriver::HlfbTorqueLimitReached() {
+    return atomic_exchange_n(&m_torqueLimitReached, false);
+}
+
+bool MotorDriver::HlfbSpeedFeedback(int32_t fullScale,
+                                    DspFilter<int32_t> *filter) {
+    if (fullScale < 0) {
+        return false;
+    }
+    // Stop decoding while the setup changes
+    m_hlfbSpeedFullScale = 0;
+    m_hlfbSpeed = 0;
+    if (filter) {
+        filter->Reset(0);
+    }
+    m_hlfbSpeedFilter = filter;
+    atomic_store_n(&m_hlfbSpeedFullScale, fullScale);
+    return true;
+}
+
+ISR_RAMFUNC void MotorDriver::HlfbSpeedUpdate() {
+    int32_t speed = 0;
+    if (m_hlfbDutyHundredths != HLFB_DUTY_UNKNOWN * 100) {
+        speed = static_cast<int32_t>(
+            static_cast<int64_t>(m_hlfbDutyHundredths) *
+            m_hlfbSpeedFullScale / 10000);
+        if (m_hlfbMode == HLFB_MODE_HAS_PWM) {
+            // The reading has no direction; take the commanded one
+            int32_t velCmd = VelocityRefCommanded();
+            if (velCmd) {
+                m_hlfbSpeedNegative = velCmd < 0;
+            }
+            if (m_hlfbSpeedNegative) {
+                speed = -speed;
+            }
+        }
+    }
+    DspFilter<int32_t> *filter = m_hlfbSpeedFilter;
+    m_hlfbSpeed = filter ? filter->Update(speed) : speed;
+}
+
+void MotorDriver::HomingMove(int32_t vel, bool toward) {
+    bool negative = toward ? m_homingNegDir : !m_homingNegDir;
+    StepGenerator::MoveVelocity(negative ? -vel : vel);
+}
+
+void MotorDriver::HomingCaptureStart() {
+    ClearCorePins homeSwitch = m_homingNegDir ? m_limitSwitchNeg
+                                              : m_limitSwitchPos;
+    Connector *input = SysMgr.ConnectorByIndex(homeSwitch);
+    // The switch is active when its input reads low
+    m_homingCaptured = input->Type() != CCIO_DIGITAL_IN_OUT_TYPE &&
+                       m_homingCapture.Start(*static_cast<DigitalIn *>(input),
+                                             m_posnAbsolute,
+                                             InputManager::FALLING);
+}
+
+int32_t MotorDriver::HomingEdgePosn() {
+    PositionCapture::Record edge;
+    if (!m_homingCaptured || !m_homingCapture.Read(edge)) {
+        return m_posnAbsolute;
+    }
+    // The first edge of the approach is the switch closing; take the
+    // position back by the travel since then. The commanded position lags
+    // the steps by the same time every sample, so the offset repeats.
+    uint32_t cycles = DWT->CYCCNT - edge.Cycles;
+    int64_t travel = static_cast<int64_t>(VelocityRefCommanded()) * cycles /
+                     CPU_CLK;
+    return m_posnAbsolute - static_cast<int32_t>(travel);
+}
+
+void MotorDriver::HomingUpdate() {
+    // Anything that would stop a move also ends homing
+    if (m_alertRegMotor.reg || !m_isEnabled || m_motionCancellingEStop) {
+        if (MoveStateGet() != MS_IDLE) {
+            MoveStopDecel();
+        }
+        m_homingCapture.Stop();
+        m_homingState = HOMING_FAILED;
+        return;
+    }
+
+    bool idle = MoveStateGet() == MS_IDLE;
+    int32_t stageDist = abs(m_posnAbsolute - m_homingStageStart);
+    HomingStates next = HOMING_FAILED;
+
+    switch (m_homingState) {
+        case HOMING_SEEK:
+            if (HomingSwitchActive()) {
+                next = HOMING_BACK_OFF;
+            }
+            else if (!idle) {
+                return;
+            }
+            break;
+        case HOMING_BACK_OFF:
+            if (!HomingSwitchActive() && stageDist >= m_homingBackOffDist) {
+                next = HOMING_APPROACH;
+            }
+            else if (!idle) {
+                return;
+            }
+            break;
+        case HOMING_APPROACH:
+            if (HomingSwitchActive()) {
+                m_homingLatch = HomingEdgePosn();
+                next = m_homingIndexDist ? HOMING_INDEX : HOMING_COMPLETE;
+            }
+            else if (!idle) {
+                return;
+            }
+            m_homingCapture.Stop();
+            break;
+        case HOMING_INDEX:
+            if (EncoderIn.IndexDetected()) {
+                m_homingLatch = m_posnAbsolute;
+                next = HOMING_COMPLETE;
+            }
+            else if (!idle && stageDist < m_homingIndexDist) {
+                return;
+            }
+            break;
+        case HOMING_STOPPING:
+            if (!idle) {
+                return;
+            }
+            m_homingStageStart = m_posnAbsolute;
+            switch (m_homingNext) {
+                case HOMING_BACK_OFF:
+                    HomingMove(m_homingSeekVel, false);
+                    break;
+                case HOMING_APPROACH:
+                    HomingCaptureStart();
+                    HomingMove(m_homingApproachVel, true);
+                    break;
+                case HOMING_INDEX:
+                    HomingMove(m_homingApproachVel, false);
+                    break;
+                case HOMING_COMPLETE:
+                default:
+                    // Shift the reference so the latched point is home
+                    m_posnAbsolute = PosnWrap(m_homingPosn +
+                                              (m_posnAbsolute -
+                                               m_homingLatch));
+                    break;
+            }
+            m_homingState = m_homingNext;
+            return;
+        default:
+            return;
+    }
+
+    // Ramp down before the next stage (or before failing)
+    if (!idle) {
+        MoveStopDecel();
+    }
+    m_homingNext = next;
+    m_homingState = (next == HOMING_FAILED) ? HOMING_FAILED : HOMING_STOPPING;
+}
+
 MotorDriver::StatusRegMotor MotorDriver::StatusRegRisen() {
     return StatusRegMotor(atomic_exchange_n(&m_statusRegMotorRisen.reg, 0));
 }
@@ -584,6 +1025,82 @@ bool MotorDriver::MotorInBDuty(uint8_t duty) {
     return false;
 }
 
+bool MotorDriver::MotorInADutyTable(const uint32_t *counts, uint16_t count,
+                                    bool loop) {
+    if (Connector::m_mode != Connector::CPM_MODE_A_PWM_B_PWM) {
+        return false;
+    }
+    return DutyTableStart(false, counts, count, loop);
+}
+
+bool MotorDriver::MotorInBDutyTable(const uint32_t *counts, uint16_t count,
+                                    bool loop) {
+    if (Connector::m_mode != Connector::CPM_MODE_A_DIRECT_B_PWM &&
+            Connector::m_mode != Connector::CPM_MODE_A_PWM_B_PWM) {
+        return false;
+    }
+    return DutyTableStart(true, counts, count, loop);
+}
+
+void MotorDriver::MotorInDutyTableStop() {
+    DutyTableStop(false);
+    DutyTableStop(true);
+}
+
+bool MotorDriver::MotorInDutyTableActive() {
+    return (m_aDutyTableDma != DMA_CHANNEL_NONE &&
+            DmaManager::ChannelBusy(m_aDutyTableDma)) ||
+           (m_bDutyTableDma != DMA_CHANNEL_NONE &&
+            DmaManager::ChannelBusy(m_bDutyTableDma));
+}
+
+bool MotorDriver::DutyTableStart(bool inputB, const uint32_t *counts,
+                                 uint16_t count, bool loop) {
+    if (!counts || !count) {
+        return false;
+    }
+    DutyTableStop(inputB);
+    const PeripheralRoute *info = inputB ? m_bInfo : m_aInfo;
+    uint8_t channel = DmaManager::ChannelAllocate(2);
+    if (channel == DMA_CHANNEL_NONE) {
+        return false;
+    }
+    // One entry per overflow. The buffered compare loads at the next
+    // overflow, so each entry plays for one whole period.
+    DmaBlock block;
+    block.Source = counts;
+    block.Destination = inputB ? m_bTccBuffer : m_aTccBuffer;
+    block.BeatCount = count;
+    block.BeatSize = DMAC_BTCTRL_BEATSIZE_WORD_Val;
+    block.SourceIncrement = true;
+    block.DestinationIncrement = false;
+    block.Interrupt = false;
+    if (!DmaManager::ChannelTrigger(channel, tccOvfTriggers[info->tccNum]) ||
+            !DmaManager::ChainBuild(channel, &block, 1, loop)) {
+        DmaManager::ChannelFree(channel);
+        return false;
+    }
+    (inputB ? m_bDutyTableDma : m_aDutyTableDma) = channel;
+    return DmaManager::ChannelStart(channel);
+}
+
+void MotorDriver::DutyTableStop(bool inputB) {
+    uint8_t &channel = inputB ? m_bDutyTableDma : m_aDutyTableDma;
+    if (channel == DMA_CHANNEL_NONE) {
+        return;
+    }
+    DmaManager::ChannelFree(channel);
+    channel = DMA_CHANNEL_NONE;
+    // Hold the last on time written, so a later duty that matches the one
+    // before the table still gets written
+    if (inputB) {
+        m_bDutyCnt = *m_bTccBuffer;
+    }
+    else {
+        m_aDutyCnt = *m_aTccBuffer;
+    }
+}
+
 bool MotorDriver::MotorInACount(uint16_t count) {
     if (Connector::m_mode == Connector::CPM_MODE_A_PWM_B_PWM) {
         m_aDutyCnt = count;
@@ -632,6 +1149,12 @@ void MotorDriver::EnableTriggerPulse(uint16_t pulseCount, uint32_t time_ms,
 
 void MotorDriver::EnableRequest(bool value) {
     bool wasDisabled = !(m_isEnabled || m_isEnabling);
+
+    // An enabled motor is refreshed every sample. It stays in the refresh
+    // after a disable so the disable sequence and HLFB keep running.
+    if (value) {
+        SysMgr.ConnectorActive(m_clearCorePin, true);
+    }
     bool wasPulsing = m_enableTriggerActive;
 
     if (value != m_enableRequestedState || m_inFault) {
@@ -840,23 +1363,9 @@ void MotorDriver::Initialize(ClearCorePins clearCorePin) {
     EIC->CTRLA.bit.ENABLE = 1;
     SYNCBUSY_WAIT(EIC, EIC_SYNCBUSY_ENABLE);
 
-    // Clock the channel
-    SET_CLOCK_SOURCE(EVSYS_GCLK_ID_0 + m_hlfbEvt, 6);
-
-    EvsysChannel *theEvCh = &EVSYS->Channel[m_hlfbEvt];
-    // Configure the event user mux to connect the channel to the event
-    EVSYS->USER[EVSYS_ID_USER_TC0_EVU + m_hlfbTcNum].reg = m_hlfbEvt + 1;
-    theEvCh->CHINTFLAG.bit.EVD = 1;
-    while (theEvCh->CHSTATUS.reg & EVSYS_CHSTATUS_RDYUSR) {
-        continue;
-    }
-    // Configure the event channel to use the ExtInt event, async
-    theEvCh->CHANNEL.reg =
-        EVSYS_CHANNEL_EVGEN(EVSYS_ID_GEN_EIC_EXTINT_0 + m_hlfbInfo->extInt) |
-        EVSYS_CHANNEL_PATH_ASYNCHRONOUS;
-    while (theEvCh->CHSTATUS.reg & EVSYS_CHSTATUS_BUSYCH) {
-        continue;
-    }
+    // Connect the ExtInt event to the timer, async
+    EventMgr.UserAdd(m_hlfbEvt, EVSYS_ID_USER_TC0_EVU + m_hlfbTcNum);
+    EventMgr.Route(m_hlfbEvt, EVSYS_ID_GEN_EIC_EXTINT_0 + m_hlfbInfo->extInt);
     // Turn on timer
     tcCount->CTRLA.bit.ENABLE = 1;
     // Sync clocks
@@ -871,10 +1380,12 @@ void MotorDriver::Initialize(ClearCorePins clearCorePin) {
 }
 
 bool MotorDriver::Mode(ConnectorModes newMode) {
+    SysMgr.ConnectorActive(m_clearCorePin, true);
     // Bail out if we are already in the requested mode
     if (newMode == m_mode) {
         return true;
     }
+    MotorInDutyTableStop();
 
     switch (newMode) {
         case CPM_MODE_A_PWM_B_PWM:
@@ -942,6 +1453,219 @@ void MotorDriver::UpdateBDuty() {
     *m_bTccBuffer = m_bDutyCnt;
 }
 
+void MotorDriver::HlfbDmaInit() {
+    if (m_clearCorePin < CLEARCORE_PIN_M0 ||
+            m_clearCorePin > CLEARCORE_PIN_M3) {
+        return;
+    }
+    m_hlfbDmaChannel = static_cast<DmaChannels>(
+                           DMA_HLFB_M0 + (m_clearCorePin - CLEARCORE_PIN_M0));
+
+    static Tc *const tc_modules[TC_INST_NUM] = TC_INSTS;
+    TcCount16 *tcCount = &tc_modules[m_hlfbTcNum]->COUNT16;
+
+    DmacChannel *channel = DmaManager::Channel(m_hlfbDmaChannel);
+    // Disable and reset the channel so it is clean to setup
+    channel->CHCTRLA.reg &= ~DMAC_CHCTRLA_ENABLE;
+    channel->CHCTRLA.reg = DMAC_CHCTRLA_SWRST;
+    // Wait for the reset to finish
+    while (channel->CHCTRLA.reg == DMAC_CHCTRLA_SWRST) {
+        continue;
+    }
+
+    // The width capture (MC1) completes each PWM period. The TC DMA
+    // triggers are OVF, MC0, MC1 for each TC in turn. Each trigger copies
+    // both capture registers as one block.
+    channel->CHCTRLA.reg =
+        DMAC_CHCTRLA_TRIGSRC(TC0_DMAC_ID_MC_1 + 3 * m_hlfbTcNum) |
+        DMAC_CHCTRLA_TRIGACT_BLOCK;
+
+    // Link one descriptor per capture into a ring, starting from the base
+    // descriptor that the DMAC looks for
+    DmacDescriptor *baseDesc = DmaManager::BaseDescriptor(m_hlfbDmaChannel);
+    for (uint8_t i = 0; i < CPM_HLFB_CAP_HISTORY; i++) {
+        DmacDescriptor *desc = i ? &m_hlfbDmaDesc[i - 1] : baseDesc;
+        DmacDescriptor *next = (i + 1 < CPM_HLFB_CAP_HISTORY) ?
+                               &m_hlfbDmaDesc[i] : baseDesc;
+        desc->DESCADDR.reg = reinterpret_cast<uint32_t>(next);
+        // Addresses are the end of each incrementing transfer
+        desc->SRCADDR.reg =
+            reinterpret_cast<uint32_t>(&tcCount->CC[0].reg) +
+            sizeof(HlfbCapture);
+        desc->DSTADDR.reg =
+            reinterpret_cast<uint32_t>(&m_hlfbCaptures[i]) +
+            sizeof(HlfbCapture);
+        desc->BTCNT.reg = sizeof(HlfbCapture) / sizeof(uint16_t);
+        desc->BTCTRL.reg = DMAC_BTCTRL_BEATSIZE_HWORD | DMAC_BTCTRL_SRCINC |
+                           DMAC_BTCTRL_DSTINC | DMAC_BTCTRL_VALID;
+    }
+
+    m_hlfbCaptureTail = 0;
+    m_hlfbCaptureValid = 0;
+    channel->CHCTRLA.reg |= DMAC_CHCTRLA_ENABLE;
+}
+
+void MotorDriver::HlfbCapturesProcess(bool invert) {
+    uint8_t captureHead = HlfbCaptureHead();
+    if (captureHead == m_hlfbCaptureTail) {
+        return;
+    }
+    uint8_t newCaptures = (captureHead - m_hlfbCaptureTail) &
+                          (CPM_HLFB_CAP_HISTORY - 1);
+    m_hlfbCaptureTail = captureHead;
+    m_hlfbLastCarrierDetectTime = Milliseconds();
+
+    if (m_hlfbNoPwmSampleCount) {
+        // When coming out of overflow/error conditions do not use the
+        // captures so far because the pulse may be clipped
+        m_hlfbCaptureValid = 0;
+        m_hlfbNoPwmSampleCount = 0;
+    }
+    else {
+        m_hlfbCaptureValid = min(m_hlfbCaptureValid + newCaptures,
+                                 CPM_HLFB_CAP_HISTORY);
+    }
+
+    // Average every valid capture but the newest; the last PWM captured
+    // might be clipped in a move done case. Wait until a second pulse is
+    // seen before announcing a measurement so the pulse isn't being clipped
+    // by the signal going away.
+    if (m_hlfbCaptureValid >= 2) {
+        uint32_t widthSum = 0;
+        uint32_t periodSum = 0;
+        uint8_t index = captureHead - 1;
+        for (uint8_t i = 1; i < m_hlfbCaptureValid; i++) {
+            index = (index - 1) & (CPM_HLFB_CAP_HISTORY - 1);
+            widthSum += m_hlfbCaptures[index].Width;
+            periodSum += m_hlfbCaptures[index].Period;
+        }
+        if (periodSum) {
+            m_hlfbCarrierLost = false;
+            // Duty cycle in units of 1/50000. The width is at most the period.
+            int32_t dutyCycle = static_cast<int32_t>(
+                static_cast<uint64_t>(widthSum) * 50000 / periodSum);
+            // Inflate 5-95% to 0-100%, in hundredths of a percent
+            int32_t duty = (2 * dutyCycle - 5000) / 9;
+
+            if (invert) {
+                duty = 10000 - duty;
+            }
+
+            // Convert unipolar to bipolar?
+            if (m_hlfbMode == HLFB_MODE_HAS_BIPOLAR_PWM) {
+                duty = 2 * (duty - 5000);
+            }
+            m_hlfbDutyHundredths = duty;
+            m_hlfbDuty = duty * 0.01f;
+            m_hlfbState = HLFB_HAS_MEASUREMENT;
+        }
+    }
+}
+
+uint8_t MotorDriver::HlfbCaptureHead() {
+    if (m_hlfbDmaChannel == DMA_INVALID_CHANNEL) {
+        return m_hlfbCaptureTail;
+    }
+    // The write-back descriptor holds the state of the channel's active
+    // descriptor; its destination is the end of the capture it fills. Once
+    // that block is done its beat count is zero and the next capture is the
+    // head.
+    DmacDescriptor *writeBack =
+        DmaManager::WriteBackDescriptor(m_hlfbDmaChannel);
+    uint32_t dst = writeBack->DSTADDR.reg;
+    uint32_t base = reinterpret_cast<uint32_t>(&m_hlfbCaptures[0]);
+    if (dst <= base || dst > base + sizeof(m_hlfbCaptures)) {
+        // Not fetched yet
+        return m_hlfbCaptureTail;
+    }
+    uint8_t index = (dst - base) / sizeof(HlfbCapture) - 1;
+    if (!writeBack->BTCNT.reg) {
+        index++;
+    }
+    return index & (CPM_HLFB_CAP_HISTORY - 1);
+}
+
+bool MotorDriver::HlfbEdgeSense(bool enable) {
+    if (enable == m_hlfbEdgeSense) {
+        return true;
+    }
+    if (enable && m_hlfbMode != HLFB_MODE_STATIC) {
+        return false;
+    }
+    uint8_t extInt = m_hlfbInfo->extInt;
+    uint8_t shiftAmt = 4 * (extInt % 8);
+
+    if (!enable) {
+        InputMgr.m_hlfbEdges[extInt] = nullptr;
+        // Leave the line running for anything else that uses it
+        if (InputMgr.m_interruptServiceRoutines[extInt] == nullptr &&
+                InputMgr.m_captures[extInt] == nullptr &&
+                InputMgr.m_decoders[extInt] == nullptr &&
+                !(InputMgr.m_eventLines & (1UL << extInt))) {
+            InputMgr.InterruptEnable(extInt, false);
+        }
+        DigitalIn::FilterHardware(false);
+    }
+
+    // The debouncer needs the line synchronized to the EIC clock, so trade
+    // the asynchronous level sense used by PWM capture for debounced edges
+    EIC->CTRLA.bit.ENABLE = 0;
+    SYNCBUSY_WAIT(EIC, EIC_SYNCBUSY_ENABLE);
+    EIC->CONFIG[extInt / 8].reg &= ~(EIC_CONFIG_SENSE0_Msk << shiftAmt);
+    if (enable) {
+        EIC->ASYNCH.reg &= ~(1UL << extInt);
+        EIC->CONFIG[extInt / 8].reg |=
+            static_cast<uint32_t>(EIC_CONFIG_SENSE0_BOTH << shiftAmt);
+    }
+    else {
+        EIC->ASYNCH.reg |= 1UL << extInt;
+        EIC->CONFIG[extInt / 8].reg |=
+            static_cast<uint32_t>(EIC_CONFIG_SENSE0_HIGH_Val << shiftAmt);
+    }
+    EIC->CTRLA.bit.ENABLE = 1;
+    SYNCBUSY_WAIT(EIC, EIC_SYNCBUSY_ENABLE);
+
+    if (enable) {
+        if (!DigitalIn::FilterHardware(true)) {
+            // Put the line back the way PWM capture expects it
+            m_hlfbEdgeSense = true;
+            HlfbEdgeSense(false);
+            return false;
+        }
+        InputMgr.m_hlfbEdges[extInt] = this;
+        InputMgr.InterruptEnable(extInt, true, true);
+    }
+    m_hlfbEdgeSense = enable;
+    return true;
+}
+
+bool MotorDriver::InPositionEvent(uint32_t &cycles) {
+    if (!atomic_exchange_n(&m_inPositionEvent, false)) {
+        return false;
+    }
+    cycles = m_inPositionCycles;
+    return true;
+}
+
+void MotorDriver::HlfbEdge() {
+    // Take the timestamp before anything else
+    uint32_t cycles = DWT->CYCCNT;
+    bool invert = (m_mode == CPM_MODE_STEP_AND_DIR) &&
+                  m_polarityInversions.bit.hlfbInverted;
+    bool asserted =
+        !(EIC->PINSTATE.reg & (1UL << m_hlfbInfo->extInt)) != invert;
+    if (!asserted || !m_isEnabled || !m_lastMoveWasPositional ||
+            !StepsComplete()) {
+        return;
+    }
+    m_inPositionCycles = cycles;
+    m_inPositionEvent = true;
+    voidFuncPtr callback = m_inPositionCallback;
+    if (callback != nullptr) {
+        callback();
+    }
+}
+
 void MotorDriver::RefreshSlow() {
     if (!m_initialized) {
         return;
@@ -1004,6 +1728,10 @@ bool MotorDriver::SetConnector(ClearCorePins pin, ClearCorePins &memberPin,
         (input && IsValidInputPin(pin)) ||
         (!input && IsValidOutputPin(pin))) {
         memberPin = pin;
+        // The associated connector is serviced from this motor's refresh
+        if (pin != CLEARCORE_PIN_INVALID) {
+            SysMgr.ConnectorActive(m_clearCorePin, true);
+        }
         return true;
     }
 
@@ -1011,17 +1739,17 @@ bool MotorDriver::SetConnector(ClearCorePins pin, ClearCorePins &memberPin,
 }
 
 bool MotorDriver::IsValidOutputPin(ClearCorePins pin) {
-    // Pins IO-0 through IO-5 and all CCIO-8 connectors are the only
-    // valid digital output pins available.
+    // Pins IO-0 through IO-5 and all CCIO-8 connectors of both chains are
+    // the only valid digital output pins available.
     return (pin >= CLEARCORE_PIN_IO0 && pin <= CLEARCORE_PIN_IO5) ||
-           (pin >= CLEARCORE_PIN_CCIOA0 && pin <= CLEARCORE_PIN_CCIOH7);
+           (pin >= CLEARCORE_PIN_CCIOA0 && pin < CLEARCORE_PIN_CCIO1_MAX);
 }
 
 bool MotorDriver::IsValidInputPin(ClearCorePins pin) {
-    // Pins IO-0 through A-12 and all CCIO-8 connectors are the only
-    // valid digital input pins available.
+    // Pins IO-0 through A-12 and all CCIO-8 connectors of both chains are
+    // the only valid digital input pins available.
     return (pin >= CLEARCORE_PIN_IO0 && pin <= CLEARCORE_PIN_A12) ||
-           (pin >= CLEARCORE_PIN_CCIOA0 && pin <= CLEARCORE_PIN_CCIOH7);
+           (pin >= CLEARCORE_PIN_CCIOA0 && pin < CLEARCORE_PIN_CCIO1_MAX);
 }
 
 bool MotorDriver::CheckEStopSensor() {
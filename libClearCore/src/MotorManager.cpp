@@ -27,16 +27,24 @@
 #include "MotorManager.h"
 #include <sam.h>
 #include "AdcManager.h"
+#include "atomic_utils.h"
 #include "MotorDriver.h"
 #include "ShiftRegister.h"
 #include "SysConnectors.h"
+#include "SysManager.h"
+#include "SysTiming.h"
 #include "SysUtils.h"
 
 namespace ClearCore {
 #define MAIN_INTERRUPT_GCLK_ID    1
 
 extern MotorDriver *const MotorConnectors[MOTOR_CON_CNT];
+extern EventManager &EventMgr;
 extern ShiftRegister ShiftReg;
+extern InputManager &InputMgr;
+extern volatile uint32_t tickCnt;
+extern SysManager SysMgr;
+
 
 MotorManager &MotorMgr = MotorManager::Instance();
 
@@ -51,7 +59,23 @@ MotorManager &MotorManager::Instance() {
 MotorManager::MotorManager()
     : m_gclkIndex(MAIN_INTERRUPT_GCLK_ID),
       m_clockRate(CLOCK_RATE_NORMAL),
-      m_initialized(false) {
+      m_initialized(false),
+      m_motionGroups(),
+      m_motionGroupCount(0),
+      m_compares(),
+      m_compareCount(0),
+      m_movesCommitPending(false),
+      m_movesArmedExtInt(-1),
+      m_motorsWaitStartMs(0),
+      m_motorsWaitMs(0),
+      m_snapshots(),
+      m_snapshotSeq(0),
+      m_eStopExtInt(-1),
+      m_eStopMotorMask(0),
+      m_eStopTripped(false),
+      m_samplePeriod(0),
+      m_stepsTrim(0),
+      m_gantry() {
     m_stepPorts[MOTOR_M0M1] =  Mtr_CLK_01.gpioPort;
     m_stepPorts[MOTOR_M2M3] = Mtr_CLK_23.gpioPort;
     m_stepDataBits[MOTOR_M0M1] = Mtr_CLK_01.gpioPin;
@@ -60,11 +84,466 @@ MotorManager::MotorManager()
     m_motorModes[MOTOR_M2M3] = Connector::CPM_MODE_A_DIRECT_B_DIRECT;
 }
 
+/**
+    Register a motion group to be updated each sample.
+
+    Returns true if there was room for the group.
+**/
+bool MotorManager::MotionGroupAdd(MotionGroup *group) {
+    if (m_motionGroupCount >= MOTION_GROUP_MAX) {
+        return false;
+    }
+    m_motionGroups[m_motionGroupCount] = group;
+    // Publish the group only once it is in the table
+    atomic_store_n(&m_motionGroupCount, m_motionGroupCount + 1);
+    return true;
+}
+
+/**
+    Stop updating a motion group. The caller holds off the sample rate
+    interrupt.
+**/
+void MotorManager::MotionGroupRemove(MotionGroup *group) {
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < m_motionGroupCount; i++) {
+        if (m_motionGroups[i] != group) {
+            m_motionGroups[count++] = m_motionGroups[i];
+        }
+    }
+    m_motionGroupCount = count;
+}
+
+/**
+    Register a position compare to be checked each sample.
+
+    Returns true if there was room for the compare.
+**/
+bool MotorManager::PositionCompareAdd(PositionCompare *compare) {
+    if (m_compareCount >= POSITION_COMPARE_MAX) {
+        return false;
+    }
+    m_compares[m_compareCount] = compare;
+    // Publish the compare only once it is in the table
+    atomic_store_n(&m_compareCount, m_compareCount + 1);
+    return true;
+}
+
+/**
+    Advance the motion groups so their axes have this sample's steps ready
+    before the connectors are refreshed.
+**/
+ISR_RAMFUNC void MotorManager::Refresh() {
+    // Start all of the staged moves in this sample
+    if (m_movesCommitPending) {
+        m_movesCommitPending = false;
+        for (uint8_t iMotor = 0; iMotor < MOTOR_CON_CNT; iMotor++) {
+            MotorConnectors[iMotor]->MoveStagedStart();
+        }
+    }
+    // Ahead of the groups, so a gantry led by a group axis stops this sample
+    for (uint8_t i = 0; i < NUM_MOTOR_PAIRS; i++) {
+        if (m_gantry[i].Armed) {
+            GantrySquareUpdate(static_cast<MotorPair>(i));
+        }
+    }
+    for (uint8_t i = 0; i < m_motionGroupCount; i++) {
+        m_motionGroups[i]->Update();
+    }
+    if (m_eStopMotorMask) {
+        EStopHardwareCheck();
+    }
+}
+
+/**
+    Fire the position compares on the positions the motors just reached.
+**/
+ISR_RAMFUNC void MotorManager::CompareRefresh() {
+    for (uint8_t i = 0; i < m_compareCount; i++) {
+        m_compares[i]->Update();
+    }
+}
+
+bool MotorManager::MovesArm(DigitalIn &input,
+                            InputManager::InterruptTrigger trigger) {
+    int8_t extInt = input.ExternalInterrupt();
+    if (extInt < 0) {
+        return false;
+    }
+    MovesDisarm();
+    m_movesArmedExtInt = extInt;
+    // One-time interrupt; it disables itself when it fires
+    if (!InputMgr.InterruptHandlerSet(extInt, &MovesTriggered, trigger, true,
+                                      true)) {
+        m_movesArmedExtInt = -1;
+        return false;
+    }
+    return true;
+}
+
+void MotorManager::MovesDisarm() {
+    int8_t extInt = m_movesArmedExtInt;
+    if (extInt >= 0) {
+        m_movesArmedExtInt = -1;
+        InputMgr.InterruptHandlerSet(extInt, nullptr);
+    }
+}
+
+void MotorManager::MovesTriggered() {
+    MotorMgr.m_movesArmedExtInt = -1;
+    MotorMgr.m_movesCommitPending = true;
+}
+
+void MotorManager::MotorsEnable(bool enable, uint32_t waitForHlfbTime_ms,
+                                uint8_t motorMask) {
+    m_motorsWaitStartMs = Milliseconds();
+    m_motorsWaitMs = waitForHlfbTime_ms;
+    // Request every motor in one pass so that their enable delays, which
+    // run in each motor's refresh, overlap
+    for (uint8_t iMotor = 0; iMotor < MOTOR_CON_CNT; iMotor++) {
+        if (motorMask & (1U << iMotor)) {
+            MotorConnectors[iMotor]->EnableRequest(enable);
+        }
+    }
+}
+
+void MotorManager::MotorsClearFaults(uint32_t disableTime_ms,
+                                     uint32_t waitForHlfbTime_ms,
+                                     uint8_t motorMask) {
+    // Each motor times its own HLFB wait
+    m_motorsWaitMs = 0;
+    for (uint8_t iMotor = 0; iMotor < MOTOR_CON_CNT; iMotor++) {
+        MotorDriver *motor = MotorConnectors[iMotor];
+        if ((motorMask & (1U << iMotor)) && motor->EnableRequest()) {
+            motor->ClearFaults(disableTime_ms, waitForHlfbTime_ms);
+        }
+    }
+}
+
+MotorManager::MotorsStates MotorManager::MotorsState(uint8_t motorMask) {
+    bool waiting = Milliseconds() - m_motorsWaitStartMs < m_motorsWaitMs;
+    bool busy = false;
+    bool failed = false;
+
+    for (uint8_t iMotor = 0; iMotor < MOTOR_CON_CNT; iMotor++) {
+        MotorDriver *motor = MotorConnectors[iMotor];
+        if (!(motorMask & (1U << iMotor))) {
+            continue;
+        }
+        if (motor->ClearFaultsActive() || motor->m_enableTriggerActive ||
+                motor->m_isEnabling) {
+            busy = true;
+            continue;
+        }
+        if (!motor->EnableRequest()) {
+            continue;
+        }
+        bool hlfbOk = motor->m_hlfbMode == MotorDriver::HLFB_MODE_STATIC ||
+                      motor->m_hlfbState != MotorDriver::HLFB_DEASSERTED;
+        if (motor->m_isEnabled && hlfbOk) {
+            continue;
+        }
+        if (waiting) {
+            busy = true;
+        }
+        else {
+            failed = true;
+        }
+    }
+
+    if (busy) {
+        return MOTORS_BUSY;
+    }
+    return failed ? MOTORS_FAILED : MOTORS_READY;
+}
+
+ISR_RAMFUNC void MotorManager::SnapshotPublish() {
+    // Fill the buffer readers are not using, then publish it
+    uint32_t seq = m_snapshotSeq + 1;
+    MotorsSnapshot &snapshot = m_snapshots[seq & 1];
+    snapshot.Tick = tickCnt;
+    for (uint8_t iMotor = 0; iMotor < MOTOR_CON_CNT; iMotor++) {
+        MotorDriver *motor = MotorConnectors[iMotor];
+        MotorSnapshot &state = snapshot.Motors[iMotor];
+        state.PositionRefCommanded = motor->PositionRefCommanded();
+        state.VelocityRefCommanded = motor->VelocityRefCommanded();
+        state.HlfbPercent = motor->HlfbPercent();
+        state.HlfbSpeed = motor->HlfbSpeed();
+        state.StatusReg.reg = motor->StatusReg().reg;
+        state.AlertReg.reg = motor->AlertReg().reg;
+        state.HlfbState = motor->HlfbState();
+        state.StepsComplete = motor->StepsComplete();
+    }
+    atomic_store_n(&m_snapshotSeq, seq);
+}
+
+void MotorManager::Snapshot(MotorsSnapshot &snapshot) {
+    uint32_t seq;
+    do {
+        seq = atomic_load_n(&m_snapshotSeq);
+        snapshot = m_snapshots[seq & 1];
+        atomic_thread_fence();
+        // One newer snapshot went to the other buffer; two overwrote this
+        // one while it was being copied
+    } while (atomic_load_n_relaxed(&m_snapshotSeq) - seq >= 2);
+}
+
+bool MotorManager::GantryStart(MotorPair motorPair) {
+    if (motorPair >= NUM_MOTOR_PAIRS ||
+            m_motorModes[motorPair] != Connector::CPM_MODE_STEP_AND_DIR) {
+        return false;
+    }
+    MotorDriver *leader = MotorConnectors[motorPair * 2];
+    MotorDriver *follower = MotorConnectors[motorPair * 2 + 1];
+    if (leader->m_gantryOn) {
+        return true;
+    }
+    if (!leader->StepsComplete() || !follower->StepsComplete()) {
+        return false;
+    }
+
+    // Couple the sides between samples
+    __disable_irq();
+    m_gantry[motorPair].Armed = false;
+    m_gantry[motorPair].Found = 0;
+    for (uint8_t side = 0; side < 2; side++) {
+        MotorDriver *motor = MotorConnectors[motorPair * 2 + side];
+        motor->m_gantrySkew = 0;
+        motor->m_gantrySkewApplied = 0;
+        motor->m_gantryHold = false;
+        motor->m_gantryOn = true;
+    }
+    follower->m_gantryLeader = leader;
+    follower->m_stepsExternal = 0;
+    follower->m_stepsExternalCarry = 0;
+    follower->m_stepsExternalStop = StepGenerator::EXTERNAL_STOP_NONE;
+    follower->m_lastMoveWasPositional = true;
+    follower->m_stepsExternalActive = true;
+    __enable_irq();
+    return true;
+}
+
+bool MotorManager::GantryStop(MotorPair motorPair) {
+    if (!GantryActive(motorPair)) {
+        return true;
+    }
+    MotorDriver *leader = MotorConnectors[motorPair * 2];
+    MotorDriver *follower = MotorConnectors[motorPair * 2 + 1];
+    if (!leader->StepsComplete()) {
+        return false;
+    }
+
+    __disable_irq();
+    m_gantry[motorPair].Armed = false;
+    // Each side keeps the position of its own motor
+    int32_t posn = leader->m_posnAbsolute;
+    leader->m_posnAbsolute =
+        leader->PosnWrap(posn + leader->m_gantrySkewApplied);
+    follower->m_posnAbsolute =
+        follower->PosnWrap(posn + follower->m_gantrySkewApplied);
+    for (uint8_t side = 0; side < 2; side++) {
+        MotorDriver *motor = MotorConnectors[motorPair * 2 + side];
+        motor->m_gantryOn = false;
+        motor->m_gantryHold = false;
+        motor->m_gantrySkew = 0;
+        motor->m_gantrySkewApplied = 0;
+    }
+    follower->m_stepsExternalActive = false;
+    follower->m_stepsExternal = 0;
+    follower->m_stepsExternalCarry = 0;
+    follower->m_stepsExternalStop = StepGenerator::EXTERNAL_STOP_NONE;
+    follower->m_gantryLeader = nullptr;
+    __enable_irq();
+    return true;
+}
+
+bool MotorManager::GantryActive(MotorPair motorPair) {
+    return motorPair < NUM_MOTOR_PAIRS &&
+           MotorConnectors[motorPair * 2]->m_gantryOn;
+}
+
+bool MotorManager::GantrySkew(MotorPair motorPair, int32_t leaderSkew,
+                              int32_t followerSkew) {
+    if (!GantryActive(motorPair) || m_gantry[motorPair].Armed) {
+        return false;
+    }
+    MotorConnectors[motorPair * 2]->m_gantrySkew = leaderSkew;
+    MotorConnectors[motorPair * 2 + 1]->m_gantrySkew = followerSkew;
+    return true;
+}
+
+bool MotorManager::GantrySquare(MotorPair motorPair, ClearCorePins leaderHome,
+                                ClearCorePins followerHome) {
+    if (!GantryActive(motorPair) ||
+            !SysMgr.ConnectorByIndex(leaderHome) ||
+            !SysMgr.ConnectorByIndex(followerHome)) {
+        return false;
+    }
+    GantrySquaring &squaring = m_gantry[motorPair];
+    __disable_irq();
+    squaring.Home[0] = leaderHome;
+    squaring.Home[1] = followerHome;
+    squaring.Found = 0;
+    squaring.Capture[0] = 0;
+    squaring.Capture[1] = 0;
+    for (uint8_t side = 0; side < 2; side++) {
+        MotorDriver *motor = MotorConnectors[motorPair * 2 + side];
+        motor->m_gantrySkew = motor->m_gantrySkewApplied;
+        motor->m_gantryHold = false;
+    }
+    squaring.Armed = true;
+    __enable_irq();
+    return true;
+}
+
+bool MotorManager::GantrySquared(MotorPair motorPair) {
+    return motorPair < NUM_MOTOR_PAIRS && !m_gantry[motorPair].Armed &&
+           m_gantry[motorPair].Found == 0x3;
+}
+
+int32_t MotorManager::GantryRacking(MotorPair motorPair) {
+    if (!GantrySquared(motorPair)) {
+        return 0;
+    }
+    return m_gantry[motorPair].Capture[1] - m_gantry[motorPair].Capture[0];
+}
+
+/**
+    Hold each side of a squaring gantry as its home input asserts, and once
+    both are home, stop the gantry and call the sides square.
+**/
+ISR_RAMFUNC void MotorManager::GantrySquareUpdate(MotorPair motorPair) {
+    GantrySquaring &squaring = m_gantry[motorPair];
+    for (uint8_t side = 0; side < 2; side++) {
+        uint8_t bit = 1U << side;
+        if ((squaring.Found & bit) ||
+                !SysMgr.ConnectorByIndex(squaring.Home[side])->State()) {
+            continue;
+        }
+        // The side's motor is at the gantry position plus its skew
+        MotorDriver *motor = MotorConnectors[motorPair * 2 + side];
+        squaring.Capture[side] =
+            motor->m_posnAbsolute + motor->m_gantrySkewApplied;
+        motor->m_gantryHold = true;
+        squaring.Found |= bit;
+    }
+    if (squaring.Found != 0x3) {
+        return;
+    }
+
+    // Both sides are standing on their homes
+    MotorConnectors[motorPair * 2]->MoveStopAbrupt();
+    for (uint8_t side = 0; side < 2; side++) {
+        MotorDriver *motor = MotorConnectors[motorPair * 2 + side];
+        motor->m_gantryHold = false;
+        motor->m_gantrySkew = 0;
+        motor->m_gantrySkewApplied = 0;
+    }
+    squaring.Armed = false;
+}
+
+bool MotorManager::EStopHardware(DigitalIn &input, uint8_t motorMask) {
+    int8_t extInt = input.ExternalInterrupt();
+    if (motorMask && extInt < 0) {
+        return false;
+    }
+
+    // Hold the step (B) output of each selected motor at its idle level
+    // while the fault is present. The outputs' polarity is inverted, so
+    // idle is high.
+    uint32_t drvCtrl = 0;
+    for (uint8_t iMotor = 0; iMotor < MOTOR_CON_CNT; iMotor++) {
+        if (motorMask & (1U << iMotor)) {
+            uint8_t wo = MotorConnectors[iMotor]->m_bInfo->tccPadNum;
+            drvCtrl |= TCC_DRVCTRL_NRE(1UL << wo) | TCC_DRVCTRL_NRV(1UL << wo);
+        }
+    }
+
+    __disable_irq();
+    m_eStopMotorMask = 0;
+    m_eStopTripped = false;
+    __enable_irq();
+
+    if (m_eStopExtInt >= 0) {
+        InputMgr.EventOutputSet(m_eStopExtInt, InputManager::LOW, false);
+    }
+    m_eStopExtInt = motorMask ? extInt : -1;
+
+    // EVCTRL and DRVCTRL are enable-protected
+    TCC0->CTRLA.bit.ENABLE = 0;
+    SYNCBUSY_WAIT(TCC0, TCC_SYNCBUSY_ENABLE);
+    TCC0->DRVCTRL.reg = drvCtrl;
+    if (motorMask) {
+        TCC0->EVCTRL.reg |= TCC_EVCTRL_TCEI1 | TCC_EVCTRL_EVACT1_FAULT;
+    }
+    else {
+        TCC0->EVCTRL.reg &= ~(TCC_EVCTRL_TCEI1 | TCC_EVCTRL_EVACT1_Msk);
+    }
+    TCC0->STATUS.reg = TCC_STATUS_FAULT1;
+    TCC0->CTRLA.bit.ENABLE = 1;
+    SYNCBUSY_WAIT(TCC0, TCC_SYNCBUSY_ENABLE);
+
+    if (!motorMask) {
+        EventMgr.UserRemove(EVSYS_ID_USER_TCC0_EV_1);
+        EventMgr.Route(EVENT_ESTOP, 0);
+        return true;
+    }
+
+    // The asynchronous path carries the input level to the fault input
+    // without waiting on any clock. The event is present while the input is
+    // deasserted.
+    EventMgr.UserAdd(EVENT_ESTOP, EVSYS_ID_USER_TCC0_EV_1);
+    InputMgr.EventRoute(extInt, InputManager::LOW, EVENT_ESTOP);
+
+    __disable_irq();
+    m_eStopMotorMask = motorMask;
+    __enable_irq();
+    return true;
+}
+
+bool MotorManager::EStopHardwareTripped() {
+    return m_eStopTripped || (m_eStopMotorMask &&
+                              (TCC0->STATUS.reg & TCC_STATUS_FAULT1));
+}
+
+bool MotorManager::EStopHardwareClear() {
+    // The fault only clears once its event is no longer present
+    TCC0->STATUS.reg = TCC_STATUS_FAULT1;
+    if (TCC0->STATUS.reg & TCC_STATUS_FAULT1) {
+        return false;
+    }
+    m_eStopTripped = false;
+    return true;
+}
+
+ISR_RAMFUNC void MotorManager::EStopHardwareCheck() {
+    if (m_eStopTripped || !(TCC0->STATUS.reg & TCC_STATUS_FAULT1)) {
+        return;
+    }
+    m_eStopTripped = true;
+    // The steps are already held; bring the profiles to a stop to match
+    for (uint8_t iMotor = 0; iMotor < MOTOR_CON_CNT; iMotor++) {
+        MotorDriver *motor = MotorConnectors[iMotor];
+        if (!(m_eStopMotorMask & (1U << iMotor)) ||
+                !motor->m_statusRegMotor.bit.StepsActive) {
+            continue;
+        }
+        motor->m_alertRegMotor.bit.MotionCanceledSensorEStop = 1;
+        motor->MoveStopAbrupt();
+    }
+}
+
 /**
     Set the motor pulse rate.
 
     Returns true if successfully set.
 **/
+void MotorManager::StepsTrimSet(uint8_t steps) {
+    m_stepsTrim = steps;
+    for (uint8_t iMotor = 0; iMotor < MOTOR_CON_CNT; iMotor++) {
+        MotorConnectors[iMotor]->StepsPerSampleMaxSet(m_samplePeriod - steps);
+    }
+}
+
 bool MotorManager::MotorInputClocking(MotorClockRates newRate) {
     if (m_clockRate == newRate && m_initialized) {
         // Same rate as before, nothing to change
@@ -84,6 +563,9 @@ bool MotorManager::MotorInputClocking(MotorClockRates newRate) {
         case CLOCK_RATE_HIGH:
             clkReq = CPM_CLOCK_RATE_HIGH_HZ;
             break;
+        case CLOCK_RATE_VERY_HIGH:
+            clkReq = CPM_CLOCK_RATE_VERY_HIGH_HZ;
+            break;
         default:
             modeValid = false;
             break;
@@ -122,11 +604,10 @@ bool MotorManager::MotorInputClocking(MotorClockRates newRate) {
 
     TCC0->PER.reg = newPeriod - 1;
     TCC1->PER.reg = newPeriod - 1;
+    m_samplePeriod = newPeriod;
 
     // Notify the StepGenerators of the new maximum rate
-    for (uint8_t iMotor = 0; iMotor < MOTOR_CON_CNT; iMotor++) {
-        MotorConnectors[iMotor]->StepsPerSampleMaxSet(newPeriod);
-    }
+    StepsTrimSet(m_stepsTrim);
 
     TCC0->CTRLA.bit.ENABLE = 1; // Enable TCC0
     TCC1->CTRLA.bit.ENABLE = 1; // Enable TCC1
@@ -184,6 +665,12 @@ void MotorManager::Initialize() {
 
     PinMuxSet();
 
+    // The DMA controller is reset after the connectors are initialized, so
+    // start the HLFB capture channels here
+    for (uint8_t iMotor = 0; iMotor < MOTOR_CON_CNT; iMotor++) {
+        MotorConnectors[iMotor]->HlfbDmaInit();
+    }
+
     m_initialized = true;
 }
 
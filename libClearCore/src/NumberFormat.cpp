@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    Implementation of ClearCore fast number to text formatting
+**/
+
+#include "NumberFormat.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace ClearCore {
+
+// "00" through "99"
+static const char DigitPairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static const char Digits[] = "0123456789abcdef";
+
+static const uint32_t PowersOf10[FORMAT_FLOAT_PRECISION_MAX + 1] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000,
+    1000000000,
+};
+
+/**
+    Write the decimal digits of value so they end just before end.
+    Returns the first digit.
+**/
+static char *DecimalDigits(char *end, uint32_t value) {
+    while (value >= 100) {
+        uint32_t quotient = value / 100;
+        uint32_t pair = value - quotient * 100;
+        end -= 2;
+        memcpy(end, &DigitPairs[2 * pair], 2);
+        value = quotient;
+    }
+    if (value >= 10) {
+        end -= 2;
+        memcpy(end, &DigitPairs[2 * value], 2);
+    }
+    else {
+        *--end = '0' + value;
+    }
+    return end;
+}
+
+uint8_t FormatUint(char *buffer, uint32_t value, uint8_t radix) {
+    if (radix < 2 || radix > 16) {
+        buffer[0] = '\0';
+        return 0;
+    }
+
+    char digits[32];
+    char *end = digits + sizeof(digits);
+    char *start;
+    if (radix == 10) {
+        start = DecimalDigits(end, value);
+    }
+    else if (!(radix & (radix - 1))) {
+        // Power of 2, a whole number of bits per digit
+        uint8_t shift = __builtin_ctz(radix);
+        uint32_t mask = radix - 1;
+        start = end;
+        do {
+            *--start = Digits[value & mask];
+            value >>= shift;
+        } while (value);
+    }
+    else {
+        start = end;
+        do {
+            uint32_t quotient = value / radix;
+            *--start = Digits[value - quotient * radix];
+            value = quotient;
+        } while (value);
+    }
+
+    uint8_t length = end - start;
+    memcpy(buffer, start, length);
+    buffer[length] = '\0';
+    return length;
+}
+
+uint8_t FormatInt(char *buffer, int32_t value, uint8_t radix) {
+    if (radix != 10 || value >= 0) {
+        return FormatUint(buffer, static_cast<uint32_t>(value), radix);
+    }
+    buffer[0] = '-';
+    // Negate as unsigned so INT32_MIN does not overflow
+    return 1 + FormatUint(buffer + 1, 0U - static_cast<uint32_t>(value), 10);
+}
+
+uint8_t FormatFloat(char *buffer, double value, uint8_t precision) {
+    if (isnan(value)) {
+        strcpy(buffer, "nan");
+        return 3;
+    }
+
+    char *pos = buffer;
+    if (signbit(value)) {
+        *pos++ = '-';
+        value = -value;
+    }
+    if (isinf(value)) {
+        strcpy(pos, "inf");
+        return pos - buffer + 3;
+    }
+
+    // Keep at least 10 bits of the scaled number below the units digit, so
+    // the rounding of the multiply only matters within 1/1024 of a tie.
+    // Numbers that close to a tie go to snprintf(), which rounds the exact
+    // value.
+    const double scaledMax = 8796093022208.0;
+    const double tieWindow = 1.0 / 1024;
+    double scaled = 0;
+    double scaledWhole = 0;
+    if (precision <= FORMAT_FLOAT_PRECISION_MAX) {
+        scaled = value * PowersOf10[precision];
+        scaledWhole = floor(scaled);
+    }
+    if (precision > FORMAT_FLOAT_PRECISION_MAX || scaled >= scaledMax ||
+            fabs(scaled - scaledWhole - 0.5) < tieWindow) {
+        int length = snprintf(buffer, FORMAT_FLOAT_BUFFER_SIZE, "%.*f",
+                              precision, pos == buffer ? value : -value);
+        if (length < 0) {
+            buffer[0] = '\0';
+            return 0;
+        }
+        return (length < FORMAT_FLOAT_BUFFER_SIZE) ?
+               length : FORMAT_FLOAT_BUFFER_SIZE - 1;
+    }
+
+    uint64_t rounded = static_cast<uint64_t>(scaledWhole) +
+                       (scaled - scaledWhole > 0.5);
+    uint64_t whole = rounded / PowersOf10[precision];
+    uint32_t fraction = rounded - whole * PowersOf10[precision];
+
+    char digits[FORMAT_FLOAT_BUFFER_SIZE];
+    char *end = digits + sizeof(digits);
+    char *start = end;
+    if (precision) {
+        // Fraction digits, zero padded to the precision
+        start = DecimalDigits(end, fraction);
+        while (end - start < precision) {
+            *--start = '0';
+        }
+        *--start = '.';
+    }
+    if (whole >= PowersOf10[9]) {
+        uint32_t high = whole / PowersOf10[9];
+        uint32_t low = whole - static_cast<uint64_t>(high) * PowersOf10[9];
+        char *lowEnd = start;
+        start = DecimalDigits(start, low);
+        while (lowEnd - start < 9) {
+            *--start = '0';
+        }
+        start = DecimalDigits(start, high);
+    }
+    else {
+        start = DecimalDigits(start, static_cast<uint32_t>(whole));
+    }
+
+    uint8_t length = end - start;
+    memcpy(pos, start, length);
+    pos[length] = '\0';
+    return pos - buffer + length;
+}
+
+} // ClearCore namespace
@@ -30,6 +30,7 @@
 #include "NvmManager.h"
 #include "AdcManager.h"
 #include "StatusManager.h"
+#include "SysTiming.h"
 #include "atomic_utils.h"
 #include <cstring>
 #include <sam.h>
@@ -56,6 +57,8 @@ namespace ClearCore {
 // accesses the NVM, we'll adjust the given address to account for these
 // reserved bytes.
 #define NVM_LOCATION_TO_INDEX(loc) ((loc) + 32)
+#define NVM_FLASH_ERRORS (NVMCTRL_INTFLAG_ADDRE | NVMCTRL_INTFLAG_PROGE | \
+                          NVMCTRL_INTFLAG_LOCKE | NVMCTRL_INTFLAG_NVME)
 #define DEFAULT_MAC_ADDRESS 0x241510b00000
 
 NvmManager &NvmMgr = NvmManager::Instance();
@@ -70,7 +73,11 @@ NvmManager::NvmManager()
     : m_nvmPageCache32(reinterpret_cast<int32_t *>(m_nvmPageCache)),
       m_writeState(IDLE),
       m_quadWordIndex(0),
-      m_pageModified(false) {
+      m_pageModified(false),
+      m_asyncActive(false),
+      m_asyncStatus(NVM_WRITE_IDLE),
+      m_asyncCallbacks(),
+      m_asyncCallbackCnt(0) {
 
     PopulateCache();
 }
@@ -348,6 +355,69 @@ bool NvmManager::BlockWrite(NvmLocations nvmLocationStart, int lengthInBytes, ui
     return WriteCacheToNvm();
 }
 
+/**
+    Queue a block write to NVM without waiting for it.
+**/
+bool NvmManager::BlockWriteAsync(NvmLocations nvmLocationStart,
+                                 int lengthInBytes,
+                                 uint8_t const * const p_data,
+                                 WriteCallback callback) {
+    // Check bounds - upper
+    if (lengthInBytes < 0 || nvmLocationStart >=
+            (NvmLocations::NVM_LOC_USER_MAX - lengthInBytes + 1)) {
+        return false;
+    }
+
+    // Check bounds - if trying to write to Teknic reserved space, make
+    // sure the unlock code is set first
+    if (nvmLocationStart >=
+            (NvmLocations::NVM_LOC_RESERVED_TEKNIC - lengthInBytes + 1)) {
+        // If trying to write into the Teknic reserved space, return if the
+        // unlock code is not set
+        if (NvmMgrUnlock != 0x3fadeb) {
+            return false;
+        }
+    }
+
+    return CacheWriteAsync(nvmLocationStart, lengthInBytes, p_data, callback);
+}
+
+/**
+    Queue a block write to the page cache.
+**/
+bool NvmManager::CacheWriteAsync(NvmLocations nvmLocationStart,
+                                 int lengthInBytes,
+                                 uint8_t const * const p_data,
+                                 WriteCallback callback) {
+    int8_t *cache = &m_nvmPageCache[NVM_LOCATION_TO_INDEX(nvmLocationStart)];
+    bool changed = memcmp(cache, p_data, lengthInBytes) != 0;
+    if (!changed && !m_asyncActive && Synchonized()) {
+        // Nothing to write
+        m_asyncStatus = NVM_WRITE_DONE;
+        if (callback) {
+            callback(true);
+        }
+        return true;
+    }
+    if (callback && m_asyncCallbackCnt >= NVM_ASYNC_CALLBACK_MAX) {
+        return false;
+    }
+
+    // The SysTick update must not run the write while it is being queued
+    __disable_irq();
+    if (changed) {
+        memcpy(cache, p_data, lengthInBytes);
+        m_pageModified = true;
+    }
+    if (callback) {
+        m_asyncCallbacks[m_asyncCallbackCnt++] = callback;
+    }
+    m_asyncStatus = NVM_WRITE_BUSY;
+    m_asyncActive = true;
+    __enable_irq();
+    return true;
+}
+
 /**
     Queue the page cache to be written to NVM.
 **/
@@ -356,6 +426,52 @@ bool NvmManager::WriteCacheToNvm() {
     return FinishNvmWrite();
 }
 
+/**
+    Write the page cache to NVM, waiting for the page write.
+**/
+bool NvmManager::FinishNvmWrite() {
+    // Take over an asynchronous write. The SysTick update cannot be part way
+    // through a step while this runs from the main loop.
+    bool async = atomic_exchange_n(&m_asyncActive, false);
+    bool success = true;
+    SysTiming::LoopBlockMarker marker(SysTiming::LOOP_BLOCK_NVM_WRITE);
+    while (m_pageModified || m_writeState != IDLE) {
+        if (!WriteCacheToNvmProc()) {
+            success = false;
+            break;
+        }
+    }
+    if (async) {
+        AsyncComplete(success);
+    }
+    return success;
+}
+
+/**
+    Advance an asynchronous write by one step.
+**/
+void NvmManager::Refresh() {
+    if (!m_asyncActive) {
+        return;
+    }
+    if (!WriteCacheToNvmProc()) {
+        AsyncComplete(false);
+    }
+    else if (!m_pageModified && m_writeState == IDLE) {
+        AsyncComplete(true);
+    }
+}
+
+void NvmManager::AsyncComplete(bool success) {
+    m_asyncActive = false;
+    m_asyncStatus = success ? NVM_WRITE_DONE : NVM_WRITE_FAILED;
+    uint8_t callbackCnt = m_asyncCallbackCnt;
+    m_asyncCallbackCnt = 0;
+    for (uint8_t i = 0; i < callbackCnt; i++) {
+        m_asyncCallbacks[i](success);
+    }
+}
+
 /**
     State machine to write the page cache to NVM.
 **/
@@ -373,7 +489,9 @@ bool NvmManager::WriteCacheToNvmProc() {
         if (!m_pageModified) {
             break;
         }
-        // The page cache was modified, start the write process
+        // The page cache was modified, start the write process. Changes
+        // made from here on need another page write.
+        m_pageModified = false;
         m_writeState = CLEAR_PAGE_BUFFER;
         // Fall through
 
@@ -416,6 +534,8 @@ bool NvmManager::WriteCacheToNvmProc() {
 
         // Check the voltage and if good, erase page
         if (BlockWrite()) {
+            // The page still needs writing
+            m_pageModified = true;
             m_writeState = IDLE;
             return false;
         }
@@ -431,9 +551,12 @@ bool NvmManager::WriteCacheToNvmProc() {
 #define num32sInPb      (NVMCTRL_PAGE_SIZE / sizeof(uint32_t))
 #define num32sIn128     (CHUNK_SIZE / sizeof(uint32_t))
     case WRITE_DATA:
-        
-        // While data cannot be written while the page erase is happening, 
-        // the write can be prepared
+        // The Page Buffer cannot be written while a write command
+        // is executing in the NVM. Wait for the status ready flag before
+        // loading the next chunk so that no chunk is skipped.
+        if (!NVMCTRL->STATUS.bit.READY) {
+            break;
+        }
 
         // Tell the NVM the location of the 128-bit value to be written
         NVMCTRL->ADDR.reg =
@@ -442,17 +565,10 @@ bool NvmManager::WriteCacheToNvmProc() {
         memcpy( &addressInNvmToWrite[m_quadWordIndex], &m_nvmPageCache32[m_quadWordIndex], CHUNK_SIZE);
         m_quadWordIndex+=num32sIn128;
 
-        // The Page Buffer cannot be written while a write command 
-        // is executing in the NVM. Wait for the status ready flag.
-        if (!NVMCTRL->STATUS.bit.READY) {
-            break;
-        }
-
         // Tell the NVM controller to write the 128-bit value
         NVMCTRL->CTRLB.reg = NVMCTRL_CTRLB_CMDEX_KEY | NVMCTRL_CTRLB_CMD_WQW;
         if (m_quadWordIndex >= num32sInPb) {
             m_writeState = IDLE;
-            m_pageModified = false;
         }
         break;
 
@@ -492,6 +608,67 @@ uint32_t NvmManager::SerialNumber() {
     return static_cast<uint32_t>(Int32(NVM_LOC_SERIAL_NUMBER));
 }
 
+/**
+    Erase a block of main flash.
+**/
+bool NvmManager::FlashBlockErase(uint32_t address) {
+    // A user page write must not come between the commands of the erase
+    FinishNvmWrite();
+    if (BlockWrite()) {
+        return false;
+    }
+    while (!NVMCTRL->STATUS.bit.READY) {
+        continue;
+    }
+    NVMCTRL->INTFLAG.reg = NVM_FLASH_ERRORS;
+    NVMCTRL->ADDR.reg = address;
+    EXEC_CMD(NVMCTRL_CTRLB_CMD_EB);
+    while (!NVMCTRL->STATUS.bit.READY) {
+        continue;
+    }
+    return !(NVMCTRL->INTFLAG.reg & NVM_FLASH_ERRORS);
+}
+
+/**
+    Program a page of main flash through the page buffer.
+**/
+bool NvmManager::FlashPageWrite(uint32_t address, const uint32_t *data) {
+    FinishNvmWrite();
+    if (BlockWrite()) {
+        return false;
+    }
+    NVMCTRL->CTRLA.bit.WMODE = NVMCTRL_CTRLA_WMODE_MAN;
+    EXEC_CMD(NVMCTRL_CTRLB_CMD_PBC);
+    while (!NVMCTRL->STATUS.bit.READY) {
+        continue;
+    }
+    NVMCTRL->INTFLAG.reg = NVM_FLASH_ERRORS;
+    // Load the whole page buffer, then program it in one page write
+    volatile uint32_t *pageBuffer = reinterpret_cast<uint32_t *>(address);
+    for (uint16_t i = 0; i < num32sInPb; i++) {
+        pageBuffer[i] = data[i];
+    }
+    NVMCTRL->ADDR.reg = address;
+    EXEC_CMD(NVMCTRL_CTRLB_CMD_WP);
+    while (!NVMCTRL->STATUS.bit.READY) {
+        continue;
+    }
+    return !(NVMCTRL->INTFLAG.reg & NVM_FLASH_ERRORS);
+}
+
+/**
+    Swap the flash banks and reset.
+**/
+void NvmManager::FlashBankSwap() {
+    FinishNvmWrite();
+    __disable_irq();
+    EXEC_CMD(NVMCTRL_CTRLB_CMD_BKSWRST);
+    // The controller resets the processor once the swap is done
+    while (true) {
+        continue;
+    }
+}
+
 bool NvmManager::BlockWrite() {
     //return StatusManager::Instance().StatusRT().bit.VSupplyUnderVoltage;
     return AdcManager::Instance().ConvertedResult(AdcManager::ADC_VSUPPLY_MON) 
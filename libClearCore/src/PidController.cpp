@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    ClearCore sample rate PID process loop
+**/
+
+#include "PidController.h"
+#include "AdcManager.h"
+#include "atomic_utils.h"
+#include "DigitalInOutAnalogOut.h"
+#include "MotorDriver.h"
+
+namespace ClearCore {
+
+PidLoop::PidLoop()
+    : m_input(nullptr),
+      m_analog(nullptr),
+      m_motor(nullptr),
+      m_outputType(PID_OUT_ANALOG),
+      m_setpoint(0),
+      m_velocityLast(0),
+      m_active(false),
+      m_registered(false) {
+    m_registered = AdcManager::Instance().PidLoopAdd(this);
+}
+
+bool PidLoop::StartAnalog(volatile const uint16_t &input,
+                          DigitalInOutAnalogOut &output) {
+    if (output.Mode() != Connector::OUTPUT_ANALOG) {
+        return false;
+    }
+    Stop();
+    m_analog = &output;
+    Limits(0, DAC_MAX_VALUE);
+    return StartLoop(input, PID_OUT_ANALOG);
+}
+
+bool PidLoop::StartPwm(volatile const uint16_t &input, MotorDriver &motor,
+                       bool inputB) {
+    Connector::ConnectorModes mode = motor.Mode();
+    if (mode != Connector::CPM_MODE_A_PWM_B_PWM &&
+            !(inputB && mode == Connector::CPM_MODE_A_DIRECT_B_PWM)) {
+        return false;
+    }
+    Stop();
+    m_motor = &motor;
+    Limits(0, UINT8_MAX);
+    return StartLoop(input, inputB ? PID_OUT_PWM_B : PID_OUT_PWM_A);
+}
+
+bool PidLoop::StartVelocity(volatile const uint16_t &input,
+                            MotorDriver &motor, int32_t velMax) {
+    if (motor.Mode() != Connector::CPM_MODE_STEP_AND_DIR || velMax <= 0) {
+        return false;
+    }
+    Stop();
+    m_motor = &motor;
+    m_velocityLast = 0;
+    Limits(-velMax, velMax);
+    return StartLoop(input, PID_OUT_VELOCITY);
+}
+
+bool PidLoop::StartLoop(volatile const uint16_t &input,
+                        OutputTypes outputType) {
+    if (!m_registered) {
+        return false;
+    }
+    m_input = &input;
+    m_outputType = outputType;
+    Reset(outputType == PID_OUT_VELOCITY ? 0 : Output());
+    // Publish the loop only once it is set up
+    atomic_store_n(&m_active, true);
+    return true;
+}
+
+void PidLoop::Stop() {
+    if (!m_active) {
+        return;
+    }
+    m_active = false;
+    if (m_outputType == PID_OUT_VELOCITY) {
+        m_motor->MoveStopDecel();
+    }
+}
+
+ISR_RAMFUNC void PidLoop::Update() {
+    if (!m_active) {
+        return;
+    }
+    int32_t output = Pid::Update(m_setpoint, *m_input);
+
+    switch (m_outputType) {
+        case PID_OUT_ANALOG:
+            m_analog->AnalogWrite(output);
+            break;
+        case PID_OUT_PWM_A:
+            m_motor->MotorInADuty(output);
+            break;
+        case PID_OUT_PWM_B:
+            m_motor->MotorInBDuty(output);
+            break;
+        case PID_OUT_VELOCITY:
+            // Only a new velocity needs a new move
+            if (output != m_velocityLast) {
+                m_velocityLast = output;
+                m_motor->MoveVelocity(output);
+            }
+            break;
+    }
+}
+
+} // ClearCore namespace
@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    ClearCore hardware position capture.
+**/
+
+#include "PositionCapture.h"
+#include <sam.h>
+#include "EncoderInput.h"
+
+namespace ClearCore {
+
+// The capture line runs above the sample rate interrupt so the latch is not
+// held off by the fast update.
+#define EIC_CAPTURE_INTERRUPT_PRIORITY 1
+#define EIC_INTERRUPT_PRIORITY 7
+
+#define POSITION_CAPTURE_FIFO_MASK (POSITION_CAPTURE_FIFO_LENGTH - 1)
+
+extern EncoderInput EncoderIn;
+extern InputManager &InputMgr;
+
+PositionCapture::PositionCapture()
+    : m_extInt(-1),
+      m_posn(nullptr),
+      m_fifo(),
+      m_head(0),
+      m_tail(0),
+      m_overflowCount(0) {}
+
+bool PositionCapture::Start(DigitalIn &input, volatile const int32_t &posn,
+                            InputManager::InterruptTrigger trigger) {
+    return StartCapture(input, &posn, trigger);
+}
+
+bool PositionCapture::StartEncoder(DigitalIn &input,
+                                   InputManager::InterruptTrigger trigger) {
+    return StartCapture(input, nullptr, trigger);
+}
+
+bool PositionCapture::StartCapture(DigitalIn &input,
+                                   volatile const int32_t *posn,
+                                   InputManager::InterruptTrigger trigger) {
+    if (!input.m_interruptAvail) {
+        return false;
+    }
+    int8_t extInt = input.m_extInt;
+    if (InputMgr.m_captures[extInt] != nullptr &&
+            InputMgr.m_captures[extInt] != this) {
+        return false;
+    }
+    if (m_extInt >= 0 && m_extInt != extInt) {
+        Stop();
+    }
+
+    m_posn = posn;
+    m_overflowCount = 0;
+    atomic_store_n(&m_tail, atomic_load_n(&m_head));
+
+    m_extInt = extInt;
+    InputMgr.m_captures[extInt] = this;
+    NVIC_SetPriority((IRQn_Type)(EIC_0_IRQn + extInt),
+                     EIC_CAPTURE_INTERRUPT_PRIORITY);
+    // Keep any callback the application registered on this line
+    return InputMgr.InterruptHandlerSet(
+               extInt, InputMgr.m_interruptServiceRoutines[extInt], trigger,
+               true, false);
+}
+
+void PositionCapture::Stop() {
+    if (m_extInt < 0) {
+        return;
+    }
+    InputMgr.m_captures[m_extInt] = nullptr;
+    // Leave the line running for anything else that uses it
+    if (InputMgr.m_interruptServiceRoutines[m_extInt] == nullptr &&
+            InputMgr.m_decoders[m_extInt] == nullptr &&
+            InputMgr.m_hlfbEdges[m_extInt] == nullptr &&
+            !(InputMgr.m_eventLines & (1UL << m_extInt))) {
+        InputMgr.InterruptEnable(m_extInt, false);
+    }
+    NVIC_SetPriority((IRQn_Type)(EIC_0_IRQn + m_extInt),
+                     EIC_INTERRUPT_PRIORITY);
+    m_extInt = -1;
+}
+
+bool PositionCapture::Read(Record &record) {
+    uint8_t tail = m_tail;
+    if (tail == atomic_load_n(&m_head)) {
+        return false;
+    }
+    record = m_fifo[tail & POSITION_CAPTURE_FIFO_MASK];
+    // Release the slot only after it has been copied out
+    atomic_store_n(&m_tail, static_cast<uint8_t>(tail + 1));
+    return true;
+}
+
+void PositionCapture::Latch() {
+    // Take the timestamp before anything else
+    uint32_t cycles = DWT->CYCCNT;
+    int32_t posn = m_posn ? *m_posn : EncoderIn.PositionRT();
+
+    uint8_t head = m_head;
+    if (static_cast<uint8_t>(head - atomic_load_n(&m_tail)) >=
+            POSITION_CAPTURE_FIFO_LENGTH) {
+        m_overflowCount++;
+        return;
+    }
+    Record &record = m_fifo[head & POSITION_CAPTURE_FIFO_MASK];
+    record.Position = posn;
+    record.Cycles = cycles;
+    // Publish the record only after it has been written
+    atomic_store_n(&m_head, static_cast<uint8_t>(head + 1));
+}
+
+} // ClearCore namespace
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+    ClearCore position compare output.
+**/
+
+#include "PositionCompare.h"
+#include "atomic_utils.h"
+#include "MotorManager.h"
+#include "SysTiming.h"
+
+namespace ClearCore {
+
+PositionCompare::PositionCompare()
+    : m_posn(nullptr),
+      m_output(nullptr),
+      m_table(nullptr),
+      m_interval(0),
+      m_count(0),
+      m_next(0),
+      m_index(0),
+      m_posnLast(0),
+      m_pulseSamples(1),
+      m_pulseLeft(0),
+      m_triggerCount(0),
+      m_active(false),
+      m_registered(false) {
+    m_registered = MotorManager::Instance().PositionCompareAdd(this);
+}
+
+bool PositionCompare::StartTable(volatile const int32_t &posn,
+                                 Connector &output, const int32_t *positions,
+                                 uint16_t count, uint32_t pulseUs) {
+    if (!positions || !count) {
+        return false;
+    }
+    Stop();
+    m_table = positions;
+    m_interval = 0;
+    m_count = count;
+    m_next = positions[0];
+    return StartCompare(posn, output, pulseUs);
+}
+
+bool PositionCompare::StartInterval(volatile const int32_t &posn,
+                                    Connector &output, int32_t first,
+                                    int32_t interval, uint32_t count,
+                                    uint32_t pulseUs) {
+    if (!interval) {
+        return false;
+    }
+    Stop();
+    m_table = nullptr;
+    m_interval = interval;
+    m_count = count;
+    m_next = first;
+    return StartCompare(posn, output, pulseUs);
+}
+
+bool PositionCompare::StartCompare(volatile const int32_t &posn,
+                                   Connector &output, uint32_t pulseUs) {
+    if (!m_registered || !output.IsWritable()) {
+        return false;
+    }
+    m_posn = &posn;
+    m_output = &output;
+    m_index = 0;
+    m_posnLast = posn;
+    uint32_t samples = (pulseUs * MS_TO_SAMPLES + 999) / 1000;
+    m_pulseSamples = samples ? samples : 1;
+    m_pulseLeft = 0;
+    m_triggerCount = 0;
+    // Publish the compare to the sample rate update once it is set up
+    atomic_store_n(&m_active, true);
+    return true;
+}
+
+void PositionCompare::Stop() {
+    atomic_store_n(&m_active, false);
+    // The update may be part way through a pulse; end it here instead
+    __disable_irq();
+    if (m_pulseLeft) {
+        m_pulseLeft = 0;
+        m_output->State(false);
+    }
+    __enable_irq();
+}
+
+ISR_RAMFUNC void PositionCompare::Update() {
+    if (m_pulseLeft && !--m_pulseLeft) {
+        m_output->State(false);
+    }
+    if (!m_active) {
+        return;
+    }
+
+    int32_t posn = *m_posn;
+    int32_t from = m_posnLast - m_next;
+    m_posnLast = posn;
+    bool fired = false;
+    // Take every trigger that the position reached or passed this sample.
+    // The differences wrap along with the position.
+    while (true) {
+        int32_t to = posn - m_next;
+        if (!(from <= 0 && to >= 0) && !(from >= 0 && to <= 0)) {
+            break;
+        }
+        fired = true;
+        m_triggerCount++;
+        if (m_count && ++m_index >= m_count) {
+            m_active = false;
+            break;
+        }
+        int32_t next = m_table ? m_table[m_index]
+                               : static_cast<int32_t>(
+                                   static_cast<uint32_t>(m_next) + m_interval);
+        // Carry on toward the next trigger from the one just reached
+        from = m_next - next;
+        m_next = next;
+    }
+
+    if (fired) {
+        m_output->State(true);
+        m_pulseLeft = m_pulseSamples;
+    }
+}
+
+} // ClearCore namespace
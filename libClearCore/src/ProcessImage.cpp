@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+    ClearCore I/O process image
+**/
+
+#include "ProcessImage.h"
+#include <sam.h>
+#include "AdcManager.h"
+#include "atomic_utils.h"
+#include "CcioBoardManager.h"
+#include "InputManager.h"
+#include "SysManager.h"
+#include "SysTiming.h"
+
+namespace ClearCore {
+
+extern volatile uint32_t tickCnt;
+extern AdcManager &AdcMgr;
+extern CcioBoardManager &CcioMgr;
+extern InputManager &InputMgr;
+extern SysManager SysMgr;
+
+ProcessImage &ProcessImg = ProcessImage::Instance();
+
+ProcessImage &ProcessImage::Instance() {
+    static ProcessImage *instance = new ProcessImage();
+    return *instance;
+}
+
+ProcessImage::ProcessImage()
+    : m_inputs(),
+      m_inputsSeq(0),
+      m_inputsRead(),
+      m_outputsStaged(),
+      m_outputsPending(),
+      m_outputsPendingValid(false),
+      m_outputsWriteMask(0),
+      m_outputsWriteValue(0) {}
+
+const ProcessImage::InputImage &ProcessImage::InputsRead() {
+    uint32_t seq;
+    do {
+        seq = atomic_load_n(&m_inputsSeq);
+        m_inputsRead = m_inputs[seq & 1];
+        atomic_thread_fence();
+        // Retry only if the buffer being copied was latched over
+    } while (atomic_load_n_relaxed(&m_inputsSeq) - seq >= 2);
+    return m_inputsRead;
+}
+
+void ProcessImage::OutputsCommit() {
+    __disable_irq();
+    m_outputsPending = m_outputsStaged;
+    m_outputsPendingValid = true;
+    __enable_irq();
+}
+
+bool ProcessImage::OutputsWrite(SysConnectorState mask,
+                                SysConnectorState value) {
+    const uint32_t ioMask = ((1UL << PROCESS_IMAGE_IO_CNT) - 1) <<
+                            CLEARCORE_PIN_IO0;
+    if (mask.reg & ~ioMask) {
+        return false;
+    }
+    for (uint8_t i = 0; i < PROCESS_IMAGE_IO_CNT; i++) {
+        ClearCorePins pin = static_cast<ClearCorePins>(CLEARCORE_PIN_IO0 + i);
+        if ((mask.reg & (1UL << pin)) &&
+                SysMgr.ConnectorByIndex(pin)->Mode() !=
+                Connector::OUTPUT_DIGITAL) {
+            return false;
+        }
+    }
+    __disable_irq();
+    m_outputsWriteValue = (m_outputsWriteValue & ~mask.reg) |
+                          (value.reg & mask.reg);
+    m_outputsWriteMask |= mask.reg;
+    __enable_irq();
+    return true;
+}
+
+ISR_RAMFUNC void ProcessImage::OutputsWriteApply() {
+    uint32_t mask = m_outputsWriteMask;
+    if (!mask) {
+        return;
+    }
+    m_outputsWriteMask = 0;
+    for (uint8_t i = 0; i < PROCESS_IMAGE_IO_CNT; i++) {
+        ClearCorePins pin = static_cast<ClearCorePins>(CLEARCORE_PIN_IO0 + i);
+        Connector *connector = SysMgr.ConnectorByIndex(pin);
+        // Skip a connector whose mode has changed since it was latched
+        if ((mask & (1UL << pin)) &&
+                connector->Mode() == Connector::OUTPUT_DIGITAL) {
+            connector->State((m_outputsWriteValue >> pin) & 1);
+        }
+    }
+}
+
+void ProcessImage::Update() {
+    if (m_outputsPendingValid) {
+        m_outputsPendingValid = false;
+        for (uint8_t i = 0; i < PROCESS_IMAGE_IO_CNT; i++) {
+            if (m_outputsPending.Mask & (1UL << i)) {
+                ClearCorePins pin =
+                    static_cast<ClearCorePins>(CLEARCORE_PIN_IO0 + i);
+                SysMgr.ConnectorByIndex(pin)->State(m_outputsPending.Io[i]);
+            }
+        }
+        // The outputs go out together on the next CCIO-8 link refresh
+        uint64_t mask = m_outputsPending.CcioMask & CcioMgr.m_outputMask;
+        CcioMgr.m_pulseActive &= ~mask;
+        CcioMgr.m_currentOutputs = (CcioMgr.m_currentOutputs & ~mask) |
+                                   (m_outputsPending.Ccio & mask);
+    }
+
+    // Fill the buffer readers are not using, then publish it
+    uint32_t seq = m_inputsSeq + 1;
+    InputImage &image = m_inputs[seq & 1];
+    image.Ccio = CcioMgr.InputState();
+    image.Tick = tickCnt;
+    image.Digital = InputMgr.InputsRT().reg;
+    image.Analog[0] = AdcMgr.FilteredResult(AdcManager::ADC_AIN09);
+    image.Analog[1] = AdcMgr.FilteredResult(AdcManager::ADC_AIN10);
+    image.Analog[2] = AdcMgr.FilteredResult(AdcManager::ADC_AIN11);
+    image.Analog[3] = AdcMgr.FilteredResult(AdcManager::ADC_AIN12);
+    atomic_store_n(&m_inputsSeq, seq);
+}
+
+} // ClearCore namespace
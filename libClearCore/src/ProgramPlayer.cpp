@@ -0,0 +1,373 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    ClearCore motion program player for programs on the SD card
+**/
+
+#include "ProgramPlayer.h"
+#include <string.h>
+#include "SysTiming.h"
+
+#define PROGRAM_HEADER_SIZE 8
+#define PROGRAM_SEG_HEADER_SIZE 2
+#define PROGRAM_SEG_MAX \
+    (PROGRAM_SEG_HEADER_SIZE + (MOTOR_CON_CNT + 2) * sizeof(int32_t))
+
+static_assert(PROGRAM_BUFFER_SIZE % SD_BLOCK_SIZE == 0,
+              "PROGRAM_BUFFER_SIZE must be whole blocks");
+
+namespace ClearCore {
+
+extern FatFileSystem &FileSys;
+
+static int32_t Le32Get(const uint8_t *data) {
+    return static_cast<int32_t>(data[0] | (data[1] << 8) | (data[2] << 16) |
+                                (static_cast<uint32_t>(data[3]) << 24));
+}
+
+ProgramPlayer::ProgramPlayer()
+    : m_file(),
+      m_buffers(),
+      m_readBuffer(0),
+      m_readOffset(0),
+      m_endOfFile(false),
+      m_motor(NULL),
+      m_group(NULL),
+      m_axisCount(0),
+      m_state(PLAYER_IDLE),
+      m_segmentCount(0),
+      m_underrunCount(0),
+      m_underrun(false),
+      m_dwellPending(false),
+      m_dwelling(false),
+      m_dwellMs(0),
+      m_dwellEndMs(0) {}
+
+bool ProgramPlayer::Start(const char *path, MotorDriver &motor) {
+    if (!Open(path, 1)) {
+        return false;
+    }
+    m_motor = &motor;
+    m_group = NULL;
+    m_state = PLAYER_RUNNING;
+    Refresh();
+    return true;
+}
+
+bool ProgramPlayer::Start(const char *path, MotionGroup &group) {
+    if (!group.AxisCount() || !Open(path, group.AxisCount())) {
+        return false;
+    }
+    m_motor = NULL;
+    m_group = &group;
+    m_state = PLAYER_RUNNING;
+    Refresh();
+    return true;
+}
+
+void ProgramPlayer::Stop() {
+    if (m_state == PLAYER_RUNNING) {
+        if (m_motor) {
+            m_motor->MoveStopDecel();
+        }
+        else {
+            m_group->MoveStopDecel();
+        }
+    }
+    m_file.Close();
+    m_state = PLAYER_IDLE;
+}
+
+void ProgramPlayer::Refresh() {
+    if (m_state != PLAYER_RUNNING) {
+        return;
+    }
+    if (!BuffersFill()) {
+        Fail();
+        return;
+    }
+
+    while (true) {
+        // A dwell starts once the motion before it has finished
+        if (m_dwellPending) {
+            if (!TargetIdle()) {
+                return;
+            }
+            m_dwellPending = false;
+            m_dwelling = true;
+            m_dwellEndMs = Milliseconds() + m_dwellMs;
+        }
+        if (m_dwelling) {
+            if (static_cast<int32_t>(Milliseconds() - m_dwellEndMs) < 0) {
+                return;
+            }
+            m_dwelling = false;
+        }
+
+        if (!TargetAccepts()) {
+            return;
+        }
+
+        uint8_t segment[PROGRAM_SEG_MAX];
+        uint16_t size = 0;
+        if (BytesRead(segment, PROGRAM_SEG_HEADER_SIZE, false)) {
+            size = SegmentSize(segment[0]);
+            if (!size) {
+                Fail();
+                return;
+            }
+        }
+        if (!size || !BytesRead(segment, size, true)) {
+            if (!m_endOfFile) {
+                // Still reading; count the target going idle only once
+                if (!m_underrun && TargetIdle()) {
+                    m_underrun = true;
+                    m_underrunCount++;
+                }
+            }
+            else if (BytesAvailable()) {
+                // The file ends partway through a segment
+                Fail();
+            }
+            else if (TargetIdle()) {
+                m_file.Close();
+                m_state = PLAYER_DONE;
+            }
+            return;
+        }
+
+        if (!SegmentIssue(segment)) {
+            Fail();
+            return;
+        }
+        m_underrun = false;
+        m_segmentCount++;
+    }
+}
+
+bool ProgramPlayer::Open(const char *path, uint8_t axisCount) {
+    if (m_state == PLAYER_RUNNING || m_file.IsOpen() ||
+            !FileSys.Open(m_file, path)) {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < 2; i++) {
+        m_buffers[i].Filled = false;
+    }
+    m_readBuffer = 0;
+    m_readOffset = 0;
+    m_endOfFile = false;
+    m_segmentCount = 0;
+    m_underrunCount = 0;
+    m_underrun = false;
+    m_dwellPending = false;
+    m_dwelling = false;
+
+    uint8_t header[PROGRAM_HEADER_SIZE];
+    if (!BuffersFill() || !BytesRead(header, sizeof(header), true) ||
+            static_cast<uint32_t>(Le32Get(header)) != PROGRAM_MAGIC ||
+            header[4] != PROGRAM_VERSION || header[5] != axisCount) {
+        m_file.Close();
+        return false;
+    }
+    m_axisCount = axisCount;
+    return true;
+}
+
+bool ProgramPlayer::BuffersFill() {
+    // Fill the buffer being read first, then the one after it
+    for (uint8_t i = 0; i < 2 && !m_endOfFile; i++) {
+        Buffer &buffer = m_buffers[(m_readBuffer + i) & 1];
+        if (buffer.Filled) {
+            continue;
+        }
+        int32_t length = m_file.Read(buffer.Data, PROGRAM_BUFFER_SIZE);
+        if (length < 0) {
+            return false;
+        }
+        if (length < PROGRAM_BUFFER_SIZE) {
+            // A short read is the end of the file, unless the card failed
+            if (m_file.Position() != m_file.Size()) {
+                return false;
+            }
+            m_endOfFile = true;
+        }
+        if (length) {
+            buffer.Length = length;
+            buffer.Filled = true;
+        }
+    }
+    return true;
+}
+
+uint16_t ProgramPlayer::BytesAvailable() {
+    const Buffer &current = m_buffers[m_readBuffer];
+    const Buffer &next = m_buffers[m_readBuffer ^ 1];
+    uint16_t available = current.Filled ? current.Length - m_readOffset : 0;
+    if (next.Filled) {
+        available += next.Length;
+    }
+    return available;
+}
+
+bool ProgramPlayer::BytesRead(uint8_t *data, uint16_t length, bool consume) {
+    if (BytesAvailable() < length) {
+        return false;
+    }
+
+    uint8_t buffer = m_readBuffer;
+    uint16_t offset = m_readOffset;
+    if (!m_buffers[buffer].Filled) {
+        buffer ^= 1;
+        offset = 0;
+    }
+    while (length) {
+        if (offset == m_buffers[buffer].Length) {
+            // The rest is at the start of the other buffer
+            if (consume) {
+                m_buffers[buffer].Filled = false;
+            }
+            buffer ^= 1;
+            offset = 0;
+        }
+        uint16_t count = m_buffers[buffer].Length - offset;
+        if (count > length) {
+            count = length;
+        }
+        memcpy(data, m_buffers[buffer].Data + offset, count);
+        data += count;
+        offset += count;
+        length -= count;
+    }
+
+    if (consume) {
+        if (offset == m_buffers[buffer].Length) {
+            m_buffers[buffer].Filled = false;
+            buffer ^= 1;
+            offset = 0;
+        }
+        m_readBuffer = buffer;
+        m_readOffset = offset;
+    }
+    return true;
+}
+
+uint16_t ProgramPlayer::SegmentSize(uint8_t type) {
+    switch (type) {
+        case PROGRAM_SEG_LIMITS:
+            return PROGRAM_SEG_HEADER_SIZE + 3 * sizeof(uint32_t);
+        case PROGRAM_SEG_MOVE:
+            return PROGRAM_SEG_HEADER_SIZE + m_axisCount * sizeof(int32_t);
+        case PROGRAM_SEG_ARC:
+            // Arcs need the two axes of a plane
+            if (!m_group || m_axisCount < 2) {
+                return 0;
+            }
+            return PROGRAM_SEG_HEADER_SIZE +
+                   (m_axisCount + 2) * sizeof(int32_t);
+        case PROGRAM_SEG_DWELL:
+            return PROGRAM_SEG_HEADER_SIZE + sizeof(uint32_t);
+        default:
+            return 0;
+    }
+}
+
+bool ProgramPlayer::SegmentIssue(const uint8_t *segment) {
+    uint8_t flags = segment[1];
+    const uint8_t *fields = segment + PROGRAM_SEG_HEADER_SIZE;
+    StepGenerator::MoveTarget target = (flags & PROGRAM_FLAG_ABSOLUTE) ?
+                                       StepGenerator::MOVE_TARGET_ABSOLUTE :
+                                       StepGenerator::MOVE_TARGET_REL_END_POSN;
+    int32_t dist[MOTOR_CON_CNT];
+    switch (segment[0]) {
+        case PROGRAM_SEG_LIMITS: {
+            // Queued moves keep the limits they were queued with, so these
+            // apply from the next segment on
+            uint32_t velMax = Le32Get(fields);
+            uint32_t accelMax = Le32Get(fields + 4);
+            uint32_t jerkMax = Le32Get(fields + 8);
+            if (m_motor) {
+                m_motor->VelMax(velMax);
+                m_motor->AccelMax(accelMax);
+                m_motor->JerkMax(jerkMax);
+            }
+            else {
+                m_group->VelMax(velMax);
+                m_group->AccelMax(accelMax);
+                m_group->JerkMax(jerkMax);
+            }
+            return true;
+        }
+        case PROGRAM_SEG_MOVE:
+            if (m_motor) {
+                return m_motor->MoveQueueAdd(Le32Get(fields), target);
+            }
+            for (uint8_t i = 0; i < m_axisCount; i++) {
+                dist[i] = Le32Get(fields + i * sizeof(int32_t));
+            }
+            return m_group->Move(dist, target);
+        case PROGRAM_SEG_ARC: {
+            for (uint8_t i = 0; i < m_axisCount; i++) {
+                dist[i] = Le32Get(fields + i * sizeof(int32_t));
+            }
+            const uint8_t *center = fields + m_axisCount * sizeof(int32_t);
+            return m_group->MoveArc(dist, Le32Get(center),
+                                    Le32Get(center + 4),
+                                    flags & PROGRAM_FLAG_CLOCKWISE, target);
+        }
+        case PROGRAM_SEG_DWELL:
+            m_dwellMs = Le32Get(fields);
+            m_dwellPending = true;
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool ProgramPlayer::TargetAccepts() {
+    if (m_motor) {
+        return m_motor->MoveQueueCount() < MOVE_QUEUE_LENGTH;
+    }
+    // Groups have no queue; the next move starts when the last is done
+    return m_group->StepsComplete();
+}
+
+bool ProgramPlayer::TargetIdle() {
+    if (m_motor) {
+        return m_motor->StepsComplete() && !m_motor->MoveQueueCount();
+    }
+    return m_group->StepsComplete();
+}
+
+void ProgramPlayer::Fail() {
+    if (m_motor) {
+        m_motor->MoveStopDecel();
+    }
+    else {
+        m_group->MoveStopDecel();
+    }
+    m_file.Close();
+    m_state = PLAYER_ERROR;
+}
+
+} // ClearCore namespace
@@ -0,0 +1,521 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    ClearCore IEEE 1588 (PTP) slave clock on the GMAC timestamp unit
+**/
+
+#include "PtpManager.h"
+#include <sam.h>
+#include <string.h>
+#include "EthernetManager.h"
+#include "SysTiming.h"
+#include "lwip/igmp.h"
+
+namespace ClearCore {
+
+extern EthernetManager &EthernetMgr;
+
+PtpManager &PtpMgr = PtpManager::Instance();
+
+#define NS_PER_SEC 1000000000LL
+
+// PTP version 2 over UDP/IPv4
+#define PTP_EVENT_PORT 319
+#define PTP_GENERAL_PORT 320
+#define PTP_MULTICAST_ADDR 0xE0000181 // 224.0.1.129
+
+// Message types
+#define PTP_MSG_SYNC 0x0
+#define PTP_MSG_DELAY_REQ 0x1
+#define PTP_MSG_FOLLOW_UP 0x8
+#define PTP_MSG_DELAY_RESP 0x9
+
+// Message layout
+#define PTP_HEADER_LEN 34
+#define PTP_SYNC_LEN 44
+#define PTP_DELAY_RESP_LEN 54
+#define PTP_OFFSET_FLAGS 6
+#define PTP_OFFSET_CORRECTION 8
+#define PTP_OFFSET_SOURCE 20
+#define PTP_OFFSET_SEQ 30
+#define PTP_OFFSET_LOG_INTERVAL 33
+#define PTP_OFFSET_TIMESTAMP 34
+#define PTP_OFFSET_REQUESTER 44
+#define PTP_FLAG_TWO_STEP 0x02
+
+// PI servo gains, per second of Sync interval
+#define PTP_SERVO_KP 0.7f
+#define PTP_SERVO_KI 0.3f
+// The furthest the timestamp unit's rate is pulled, in ppb
+#define PTP_RATE_MAX_PPB 500000.0f
+// Consecutive Syncs within PTP_LOCK_THRESHOLD_NS needed to lock
+#define PTP_LOCK_COUNT 3
+// The largest correction the timestamp unit can apply in one adjustment
+#define PTP_ADJUST_MAX_NS ((1L << 30) - 1)
+
+static inline uint16_t Get16(const uint8_t *buf) {
+    return (buf[0] << 8) | buf[1];
+}
+
+// A 10-byte PTP timestamp: 48-bit seconds then 32-bit nanoseconds
+static int64_t TimestampGet(const uint8_t *buf) {
+    uint64_t seconds = 0;
+    for (uint8_t i = 0; i < 6; i++) {
+        seconds = (seconds << 8) | buf[i];
+    }
+    uint32_t ns = 0;
+    for (uint8_t i = 6; i < 10; i++) {
+        ns = (ns << 8) | buf[i];
+    }
+    return static_cast<int64_t>(seconds) * NS_PER_SEC + ns;
+}
+
+// The correction field: nanoseconds scaled by 2^16
+static int64_t CorrectionGet(const uint8_t *buf) {
+    int64_t correction = 0;
+    for (uint8_t i = 0; i < 8; i++) {
+        correction = (correction << 8) | buf[i];
+    }
+    return correction >> 16;
+}
+
+PtpManager &PtpManager::Instance() {
+    static PtpManager *instance = new PtpManager();
+    return *instance;
+}
+
+PtpManager::PtpManager()
+    : m_started(false),
+      m_eventPcb(nullptr),
+      m_generalPcb(nullptr),
+      m_portId(),
+      m_masterId(),
+      m_masterValid(false),
+      m_lastSyncMs(0),
+      m_syncSeq(0),
+      m_syncTxNs(0),
+      m_syncRxNs(0),
+      m_syncCorrectionNs(0),
+      m_syncPending(false),
+      m_syncLogInterval(0),
+      m_delayReqSeq(0),
+      m_delayReqPending(false),
+      m_delayMasterSlaveNs(0),
+      m_delayValid(false),
+      m_syncRxStamp(0),
+      m_syncRxStampValid(false),
+      m_delayReqTxStamp(0),
+      m_delayReqTxStampValid(false),
+      m_offsetNs(0),
+      m_pathDelayNs(0),
+      m_driftPpb(0),
+      m_lockCount(0),
+      m_incrementBase(0),
+      m_sampleNs(0),
+      m_triggerNs(0),
+      m_trigger(nullptr) {}
+
+bool PtpManager::Begin() {
+    if (m_started) {
+        return true;
+    }
+
+    // The clock identity is the EUI-64 formed from the MAC address
+    const uint8_t *mac = EthernetMgr.MacAddress();
+    uint8_t id[10] = {mac[0], mac[1], mac[2], 0xFF, 0xFE,
+                      mac[3], mac[4], mac[5], 0x00, 0x01
+                     };
+    memcpy(m_portId.Id, id, sizeof(id));
+
+    // Count nanoseconds at PTP_TSU_CLK_HZ; the increment per clock is kept
+    // in 1/65536 ns so the rate can be trimmed
+    m_incrementBase = (NS_PER_SEC << 16) / PTP_TSU_CLK_HZ;
+    RateAdjust(0);
+
+    EthernetServiceLock lock;
+    m_eventPcb = udp_new();
+    m_generalPcb = udp_new();
+    ip4_addr_t group = IPADDR4_INIT(PP_HTONL(PTP_MULTICAST_ADDR));
+    if (!m_eventPcb || !m_generalPcb ||
+            udp_bind(m_eventPcb, IP4_ADDR_ANY, PTP_EVENT_PORT) != ERR_OK ||
+            udp_bind(m_generalPcb, IP4_ADDR_ANY, PTP_GENERAL_PORT) != ERR_OK ||
+            igmp_joingroup_netif(EthernetMgr.MacInterface(), &group) !=
+            ERR_OK) {
+        if (m_eventPcb) {
+            udp_remove(m_eventPcb);
+            m_eventPcb = nullptr;
+        }
+        if (m_generalPcb) {
+            udp_remove(m_generalPcb);
+            m_generalPcb = nullptr;
+        }
+        return false;
+    }
+    udp_recv(m_eventPcb, EventCallback, this);
+    udp_recv(m_generalPcb, GeneralCallback, this);
+
+    // Latch the times Sync messages arrive and Delay_Req messages leave
+    GMAC->IER.reg = GMAC_IER_SFR | GMAC_IER_DRQFT;
+
+    m_started = true;
+    return true;
+}
+
+bool PtpManager::Locked() {
+    return m_masterValid && m_lockCount >= PTP_LOCK_COUNT &&
+           Milliseconds() - m_lastSyncMs < PTP_MASTER_TIMEOUT_MS;
+}
+
+PtpManager::PtpTime PtpManager::Time() {
+    int64_t timeNs = TimeNsRead();
+    PtpTime time = {static_cast<uint64_t>(timeNs / NS_PER_SEC),
+                    static_cast<uint32_t>(timeNs % NS_PER_SEC)
+                   };
+    return time;
+}
+
+PtpManager::PtpTime PtpManager::SampleTime() {
+    __disable_irq();
+    int64_t timeNs = m_sampleNs;
+    __enable_irq();
+    PtpTime time = {static_cast<uint64_t>(timeNs / NS_PER_SEC),
+                    static_cast<uint32_t>(timeNs % NS_PER_SEC)
+                   };
+    return time;
+}
+
+bool PtpManager::SampleTrigger(const PtpTime &time,
+                               TriggerFunction function) {
+    if (!m_started || time.Nanoseconds >= NS_PER_SEC) {
+        return false;
+    }
+    // Disarm while the time is changed so the sample update never sees a
+    // half-written time
+    m_trigger = nullptr;
+    m_triggerNs = static_cast<int64_t>(time.Seconds) * NS_PER_SEC +
+                  time.Nanoseconds;
+    m_trigger = function;
+    return true;
+}
+
+int64_t PtpManager::TimeNsRead() {
+    uint32_t seconds, ns;
+    // Re-read if the seconds rolled over between the two reads
+    do {
+        seconds = GMAC->TSL.reg;
+        ns = GMAC->TN.reg;
+    } while (seconds != GMAC->TSL.reg);
+    uint64_t secondsHigh = GMAC->TSH.reg & GMAC_TSH_TCS_Msk;
+    return static_cast<int64_t>((secondsHigh << 32) | seconds) * NS_PER_SEC +
+           ns;
+}
+
+void PtpManager::TimeNsWrite(int64_t timeNs) {
+    uint64_t seconds = timeNs / NS_PER_SEC;
+    GMAC->TSH.reg = GMAC_TSH_TCS(seconds >> 32);
+    GMAC->TSL.reg = static_cast<uint32_t>(seconds);
+    GMAC->TN.reg = GMAC_TN_TNS(timeNs % NS_PER_SEC);
+}
+
+void PtpManager::TimeAdjust(int64_t offsetNs) {
+    if (offsetNs > PTP_ADJUST_MAX_NS || offsetNs < -PTP_ADJUST_MAX_NS) {
+        TimeNsWrite(TimeNsRead() + offsetNs);
+    }
+    else if (offsetNs < 0) {
+        GMAC->TA.reg = GMAC_TA_ADJ | GMAC_TA_ITDT(-offsetNs);
+    }
+    else {
+        GMAC->TA.reg = GMAC_TA_ITDT(offsetNs);
+    }
+}
+
+void PtpManager::RateAdjust(float ppb) {
+    if (ppb > PTP_RATE_MAX_PPB) {
+        ppb = PTP_RATE_MAX_PPB;
+    }
+    else if (ppb < -PTP_RATE_MAX_PPB) {
+        ppb = -PTP_RATE_MAX_PPB;
+    }
+    uint32_t increment = m_incrementBase +
+                         static_cast<int32_t>(m_incrementBase * ppb * 1e-9f);
+    GMAC->TI.reg = GMAC_TI_CNS(increment >> 16);
+    GMAC->TISUBN.reg = GMAC_TISUBN_LSBTIR(increment & 0xFFFF);
+}
+
+bool PtpManager::Servo(int64_t offsetNs) {
+    m_offsetNs = (offsetNs > INT32_MAX) ? INT32_MAX :
+                 (offsetNs < INT32_MIN) ? INT32_MIN : offsetNs;
+
+    if (offsetNs > PTP_STEP_THRESHOLD_NS || offsetNs < -PTP_STEP_THRESHOLD_NS) {
+        // Too far off to slew; step the clock and start measuring again
+        TimeAdjust(-offsetNs);
+        m_lockCount = 0;
+        m_delayReqPending = false;
+        return false;
+    }
+
+    // Scale the offset to a rate over the Sync interval
+    int8_t logInterval = m_syncLogInterval;
+    if (logInterval < -7 || logInterval > 4) {
+        logInterval = 0;
+    }
+    float offsetPpb = (logInterval >= 0) ?
+                      static_cast<float>(offsetNs) / (1 << logInterval) :
+                      static_cast<float>(offsetNs) * (1 << -logInterval);
+    m_driftPpb += PTP_SERVO_KI * offsetPpb;
+    if (m_driftPpb > PTP_RATE_MAX_PPB) {
+        m_driftPpb = PTP_RATE_MAX_PPB;
+    }
+    else if (m_driftPpb < -PTP_RATE_MAX_PPB) {
+        m_driftPpb = -PTP_RATE_MAX_PPB;
+    }
+    // A positive offset means the local clock is ahead; slow it down
+    RateAdjust(-(PTP_SERVO_KP * offsetPpb + m_driftPpb));
+
+    if (offsetNs < PTP_LOCK_THRESHOLD_NS && offsetNs > -PTP_LOCK_THRESHOLD_NS) {
+        if (m_lockCount < PTP_LOCK_COUNT) {
+            m_lockCount++;
+        }
+    }
+    else {
+        m_lockCount = 0;
+    }
+    return true;
+}
+
+void PtpManager::SyncProcess() {
+    int64_t masterSlaveNs = m_syncRxNs - m_syncTxNs;
+
+    if (!m_delayValid) {
+        // Without a path delay yet, only bring the clock close enough that
+        // the delay can be measured
+        if (masterSlaveNs > PTP_STEP_THRESHOLD_NS ||
+                masterSlaveNs < -PTP_STEP_THRESHOLD_NS) {
+            m_offsetNs = (masterSlaveNs > INT32_MAX) ? INT32_MAX :
+                         (masterSlaveNs < INT32_MIN) ? INT32_MIN :
+                         masterSlaveNs;
+            TimeAdjust(-masterSlaveNs);
+            m_delayReqPending = false;
+            return;
+        }
+    }
+    else if (!Servo(masterSlaveNs - m_pathDelayNs)) {
+        // The clock was stepped, so this Sync can't pair with a Delay_Req
+        return;
+    }
+
+    if (!m_delayReqPending) {
+        m_delayMasterSlaveNs = masterSlaveNs;
+        DelayReqSend();
+    }
+}
+
+void PtpManager::DelayReqSend() {
+    struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, PTP_SYNC_LEN, PBUF_RAM);
+    if (!p) {
+        return;
+    }
+    uint8_t *buf = static_cast<uint8_t *>(p->payload);
+    memset(buf, 0, PTP_SYNC_LEN);
+    buf[0] = PTP_MSG_DELAY_REQ;
+    buf[1] = 2;
+    buf[3] = PTP_SYNC_LEN;
+    buf[4] = PTP_DOMAIN;
+    memcpy(&buf[PTP_OFFSET_SOURCE], m_portId.Id, sizeof(m_portId.Id));
+    m_delayReqSeq++;
+    buf[PTP_OFFSET_SEQ] = m_delayReqSeq >> 8;
+    buf[PTP_OFFSET_SEQ + 1] = m_delayReqSeq & 0xFF;
+    buf[PTP_OFFSET_SEQ + 2] = 0x01; // Control field: Delay_Req
+    buf[PTP_OFFSET_LOG_INTERVAL] = 0x7F;
+
+    __disable_irq();
+    m_delayReqTxStampValid = false;
+    __enable_irq();
+
+    ip_addr_t group = IPADDR4_INIT(PP_HTONL(PTP_MULTICAST_ADDR));
+    m_delayReqPending =
+        udp_sendto(m_eventPcb, p, &group, PTP_EVENT_PORT) == ERR_OK;
+    pbuf_free(p);
+}
+
+void PtpManager::EventReceive(struct pbuf *p, const ip_addr_t *addr) {
+    (void)addr;
+    uint8_t buf[PTP_SYNC_LEN];
+    if (pbuf_copy_partial(p, buf, PTP_SYNC_LEN, 0) != PTP_SYNC_LEN ||
+            (buf[0] & 0x0F) != PTP_MSG_SYNC || (buf[1] & 0x0F) != 2 ||
+            buf[4] != PTP_DOMAIN) {
+        return;
+    }
+
+    // Take the receive time the GMAC latched for this Sync
+    __disable_irq();
+    bool stampValid = m_syncRxStampValid;
+    int64_t rxNs = m_syncRxStamp;
+    m_syncRxStampValid = false;
+    __enable_irq();
+    if (!stampValid) {
+        return;
+    }
+
+    const uint8_t *source = &buf[PTP_OFFSET_SOURCE];
+    if (!m_masterValid ||
+            Milliseconds() - m_lastSyncMs >= PTP_MASTER_TIMEOUT_MS) {
+        // Follow the first master heard from
+        memcpy(m_masterId.Id, source, sizeof(m_masterId.Id));
+        m_masterValid = true;
+        m_delayValid = false;
+        m_delayReqPending = false;
+        m_lockCount = 0;
+    }
+    else if (memcmp(m_masterId.Id, source, sizeof(m_masterId.Id))) {
+        return;
+    }
+
+    m_lastSyncMs = Milliseconds();
+    m_syncSeq = Get16(&buf[PTP_OFFSET_SEQ]);
+    m_syncRxNs = rxNs;
+    m_syncLogInterval = static_cast<int8_t>(buf[PTP_OFFSET_LOG_INTERVAL]);
+    m_syncCorrectionNs = CorrectionGet(&buf[PTP_OFFSET_CORRECTION]);
+
+    if (buf[PTP_OFFSET_FLAGS] & PTP_FLAG_TWO_STEP) {
+        // The send time follows in a Follow_Up
+        m_syncPending = true;
+        return;
+    }
+    m_syncPending = false;
+    m_syncTxNs = TimestampGet(&buf[PTP_OFFSET_TIMESTAMP]) + m_syncCorrectionNs;
+    SyncProcess();
+}
+
+void PtpManager::GeneralReceive(struct pbuf *p, const ip_addr_t *addr) {
+    (void)addr;
+    uint8_t buf[PTP_DELAY_RESP_LEN];
+    uint16_t len = pbuf_copy_partial(p, buf, PTP_DELAY_RESP_LEN, 0);
+    if (len < PTP_SYNC_LEN || (buf[1] & 0x0F) != 2 ||
+            buf[4] != PTP_DOMAIN || !m_masterValid ||
+            memcmp(m_masterId.Id, &buf[PTP_OFFSET_SOURCE],
+                   sizeof(m_masterId.Id))) {
+        return;
+    }
+    uint16_t seq = Get16(&buf[PTP_OFFSET_SEQ]);
+    int64_t correctionNs = CorrectionGet(&buf[PTP_OFFSET_CORRECTION]);
+
+    switch (buf[0] & 0x0F) {
+        case PTP_MSG_FOLLOW_UP:
+            if (!m_syncPending || seq != m_syncSeq) {
+                return;
+            }
+            m_syncPending = false;
+            m_syncTxNs = TimestampGet(&buf[PTP_OFFSET_TIMESTAMP]) +
+                         m_syncCorrectionNs + correctionNs;
+            SyncProcess();
+            break;
+        case PTP_MSG_DELAY_RESP: {
+            if (len < PTP_DELAY_RESP_LEN || !m_delayReqPending ||
+                    seq != m_delayReqSeq ||
+                    memcmp(m_portId.Id, &buf[PTP_OFFSET_REQUESTER],
+                           sizeof(m_portId.Id))) {
+                return;
+            }
+            m_delayReqPending = false;
+
+            __disable_irq();
+            bool stampValid = m_delayReqTxStampValid;
+            int64_t txNs = m_delayReqTxStamp;
+            __enable_irq();
+            if (!stampValid) {
+                return;
+            }
+
+            int64_t slaveMasterNs =
+                TimestampGet(&buf[PTP_OFFSET_TIMESTAMP]) - correctionNs - txNs;
+            int64_t delayNs = (m_delayMasterSlaveNs + slaveMasterNs) / 2;
+            if (delayNs < 0 || delayNs > PTP_STEP_THRESHOLD_NS) {
+                return;
+            }
+            // Smooth the path delay once it has been measured
+            if (!m_delayValid) {
+                m_pathDelayNs = delayNs;
+                m_delayValid = true;
+            }
+            else {
+                int32_t delta = static_cast<int32_t>(delayNs) -
+                                static_cast<int32_t>(m_pathDelayNs);
+                m_pathDelayNs = m_pathDelayNs + delta / 8;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void PtpManager::EventCallback(void *arg, struct udp_pcb *pcb,
+                               struct pbuf *p, const ip_addr_t *addr,
+                               u16_t port) {
+    (void)pcb;
+    (void)port;
+    static_cast<PtpManager *>(arg)->EventReceive(p, addr);
+    pbuf_free(p);
+}
+
+void PtpManager::GeneralCallback(void *arg, struct udp_pcb *pcb,
+                                 struct pbuf *p, const ip_addr_t *addr,
+                                 u16_t port) {
+    (void)pcb;
+    (void)port;
+    static_cast<PtpManager *>(arg)->GeneralReceive(p, addr);
+    pbuf_free(p);
+}
+
+void PtpManager::IrqHandlerTimestamp(uint32_t isr) {
+    if (isr & GMAC_ISR_SFR) {
+        uint64_t seconds =
+            (static_cast<uint64_t>(GMAC->EFRSH.reg) << 32) | GMAC->EFRSL.reg;
+        m_syncRxStamp = static_cast<int64_t>(seconds) * NS_PER_SEC +
+                        GMAC->EFRN.reg;
+        m_syncRxStampValid = true;
+    }
+    if (isr & GMAC_ISR_DRQFT) {
+        uint64_t seconds =
+            (static_cast<uint64_t>(GMAC->EFTSH.reg) << 32) | GMAC->EFTSL.reg;
+        m_delayReqTxStamp = static_cast<int64_t>(seconds) * NS_PER_SEC +
+                            GMAC->EFTN.reg;
+        m_delayReqTxStampValid = true;
+    }
+}
+
+void PtpManager::SampleUpdate() {
+    if (!m_started) {
+        return;
+    }
+    int64_t now = TimeNsRead();
+    m_sampleNs = now;
+    TriggerFunction trigger = m_trigger;
+    if (trigger && now >= m_triggerNs) {
+        m_trigger = nullptr;
+        trigger();
+    }
+}
+
+} // ClearCore namespace
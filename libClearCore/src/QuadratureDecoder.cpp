@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    ClearCore interrupt-driven quadrature decoder.
+**/
+
+#include "QuadratureDecoder.h"
+#include <sam.h>
+#include "InputManager.h"
+#include "SysTiming.h"
+
+namespace ClearCore {
+
+extern InputManager &InputMgr;
+
+// Marks a transition in which both inputs changed
+#define QUAD_ERR 2
+
+// Count change for each (previous A/B state << 2 | new A/B state)
+static const int8_t QuadTransition[16] = {
+    0, 1, -1, QUAD_ERR,
+    -1, 0, QUAD_ERR, 1,
+    1, QUAD_ERR, 0, -1,
+    QUAD_ERR, -1, 1, 0
+};
+
+QuadratureDecoder::QuadratureDecoder()
+    : m_extIntA(-1),
+      m_extIntB(-1),
+      m_inA(nullptr),
+      m_inB(nullptr),
+      m_maskA(0),
+      m_maskB(0),
+      m_state(0),
+      m_posn(0),
+      m_errorCount(0),
+      m_intervalMin(UINT32_MAX),
+      m_edgeCycles{0},
+      m_edgePosn{0},
+      m_edgeIndex(0) {}
+
+bool QuadratureDecoder::Start(DigitalIn &inputA, DigitalIn &inputB) {
+    if (!inputA.m_interruptAvail || !inputB.m_interruptAvail) {
+        return false;
+    }
+    int8_t extIntA = inputA.m_extInt;
+    int8_t extIntB = inputB.m_extInt;
+    if (extIntA == extIntB) {
+        return false;
+    }
+    QuadratureDecoder *ownerA = InputMgr.m_decoders[extIntA];
+    QuadratureDecoder *ownerB = InputMgr.m_decoders[extIntB];
+    if ((ownerA && ownerA != this) || (ownerB && ownerB != this)) {
+        return false;
+    }
+    Stop();
+
+    m_inA = &PORT->Group[inputA.m_inputPort].IN.reg;
+    m_inB = &PORT->Group[inputB.m_inputPort].IN.reg;
+    m_maskA = inputA.m_inputDataMask;
+    m_maskB = inputB.m_inputDataMask;
+    m_state = StateRead();
+    m_errorCount = 0;
+    m_intervalMin = UINT32_MAX;
+    uint32_t now = DWT->CYCCNT;
+    for (uint8_t i = 0; i < QUADRATURE_DECODER_EDGES; i++) {
+        m_edgeCycles[i] = now;
+        m_edgePosn[i] = m_posn;
+    }
+
+    m_extIntA = extIntA;
+    m_extIntB = extIntB;
+    InputMgr.m_decoders[extIntA] = this;
+    InputMgr.m_decoders[extIntB] = this;
+    // Keep any callbacks the application registered on these lines
+    return InputMgr.InterruptHandlerSet(
+               extIntA, InputMgr.m_interruptServiceRoutines[extIntA],
+               InputManager::CHANGE, true, false) &&
+           InputMgr.InterruptHandlerSet(
+               extIntB, InputMgr.m_interruptServiceRoutines[extIntB],
+               InputManager::CHANGE, true, false);
+}
+
+void QuadratureDecoder::Stop() {
+    int8_t lines[2] = {m_extIntA, m_extIntB};
+    for (uint8_t i = 0; i < 2; i++) {
+        int8_t extInt = lines[i];
+        if (extInt < 0) {
+            continue;
+        }
+        InputMgr.m_decoders[extInt] = nullptr;
+        // Leave the line running for anything else that uses it
+        if (InputMgr.m_interruptServiceRoutines[extInt] == nullptr &&
+                InputMgr.m_captures[extInt] == nullptr &&
+                InputMgr.m_hlfbEdges[extInt] == nullptr &&
+                !(InputMgr.m_eventLines & (1UL << extInt))) {
+            InputMgr.InterruptEnable(extInt, false);
+        }
+    }
+    m_extIntA = -1;
+    m_extIntB = -1;
+}
+
+void QuadratureDecoder::Position(int32_t newPosn) {
+    __disable_irq();
+    int32_t shift = newPosn - m_posn;
+    m_posn = newPosn;
+    for (uint8_t i = 0; i < QUADRATURE_DECODER_EDGES; i++) {
+        m_edgePosn[i] += shift;
+    }
+    __enable_irq();
+}
+
+int32_t QuadratureDecoder::Velocity() {
+    __disable_irq();
+    uint8_t newest = m_edgeIndex;
+    uint8_t oldest = (newest + 1) % QUADRATURE_DECODER_EDGES;
+    uint32_t span = m_edgeCycles[newest] - m_edgeCycles[oldest];
+    int32_t counts = m_edgePosn[newest] - m_edgePosn[oldest];
+    uint32_t sinceEdge = DWT->CYCCNT - m_edgeCycles[newest];
+    __enable_irq();
+
+    if (!span || !counts || sinceEdge >= CPU_CLK) {
+        return 0;
+    }
+    int64_t velocity = static_cast<int64_t>(counts) * CPU_CLK / span;
+    // Without a new edge the encoder is moving no faster than one count in
+    // the time since the last one
+    int64_t bound = sinceEdge ? CPU_CLK / sinceEdge : INT32_MAX;
+    velocity = velocity > bound ? bound :
+               velocity < -bound ? -bound : velocity;
+    return static_cast<int32_t>(velocity);
+}
+
+void QuadratureDecoder::Edge() {
+    uint32_t now = DWT->CYCCNT;
+    uint8_t state = StateRead();
+    int8_t step = QuadTransition[(m_state << 2) | state];
+    m_state = state;
+    if (!step) {
+        // The other line's interrupt already counted this state
+        return;
+    }
+    if (step == QUAD_ERR) {
+        m_errorCount++;
+        return;
+    }
+    m_posn += step;
+
+    uint32_t interval = now - m_edgeCycles[m_edgeIndex];
+    if (interval < m_intervalMin) {
+        m_intervalMin = interval;
+    }
+    m_edgeIndex = (m_edgeIndex + 1) % QUADRATURE_DECODER_EDGES;
+    m_edgeCycles[m_edgeIndex] = now;
+    m_edgePosn[m_edgeIndex] = m_posn;
+}
+
+} // ClearCore namespace
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+    Fieldbus register image bound to the process image
+**/
+
+#include "RegisterMap.h"
+#include <string.h>
+#include "MotorManager.h"
+#include "ProcessImage.h"
+
+namespace ClearCore {
+
+extern MotorManager &MotorMgr;
+extern ProcessImage &ProcessImg;
+
+RegisterMap::RegisterMap(const Binding *bindings, uint8_t count, void *image,
+                         void *commands)
+    : m_bindings(bindings),
+      m_count(count),
+      m_image(static_cast<uint8_t *>(image)),
+      m_commands(static_cast<uint8_t *>(commands)),
+      m_sources(0) {
+    for (uint8_t i = 0; i < m_count; i++) {
+        m_sources |= 1 << m_bindings[i].Source;
+    }
+}
+
+void RegisterMap::Gather() {
+    const uint8_t *inputs = nullptr;
+    if (m_sources & (1 << MAP_INPUTS)) {
+        inputs = reinterpret_cast<const uint8_t *>(&ProcessImg.InputsRead());
+    }
+    MotorManager::MotorsSnapshot snapshot;
+    if (m_sources & (1 << MAP_MOTORS)) {
+        MotorMgr.Snapshot(snapshot);
+    }
+
+    for (uint8_t i = 0; i < m_count; i++) {
+        const Binding &binding = m_bindings[i];
+        const uint8_t *source;
+        switch (binding.Source) {
+            case MAP_INPUTS:
+                source = inputs;
+                break;
+            case MAP_MOTORS:
+                source = reinterpret_cast<const uint8_t *>(&snapshot);
+                break;
+            default:
+                continue;
+        }
+        memcpy(m_image + binding.ImageOffset, source + binding.SourceOffset,
+               binding.Size);
+    }
+}
+
+void RegisterMap::Scatter() {
+    uint8_t *outputs =
+        reinterpret_cast<uint8_t *>(&ProcessImg.Outputs());
+
+    for (uint8_t i = 0; i < m_count; i++) {
+        const Binding &binding = m_bindings[i];
+        uint8_t *dest;
+        switch (binding.Source) {
+            case MAP_OUTPUTS:
+                dest = outputs;
+                break;
+            case MAP_COMMANDS:
+                dest = m_commands;
+                break;
+            default:
+                continue;
+        }
+        if (dest) {
+            memcpy(dest + binding.SourceOffset,
+                   m_image + binding.ImageOffset, binding.Size);
+        }
+    }
+
+    if (m_sources & (1 << MAP_OUTPUTS)) {
+        ProcessImg.OutputsCommit();
+    }
+}
+
+} // ClearCore namespace
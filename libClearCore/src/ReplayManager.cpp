@@ -0,0 +1,255 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+    ClearCore record and replay of the sampled inputs and commands
+**/
+
+#include "ReplayManager.h"
+#include <sam.h>
+#include "atomic_utils.h"
+#include "CcioBoardManager.h"
+#include "EncoderInput.h"
+#include "InputManager.h"
+
+namespace ClearCore {
+
+extern AdcManager &AdcMgr;
+extern CcioBoardManager &CcioMgr;
+extern CommandBatch &CmdBatch;
+extern EncoderInput EncoderIn;
+extern InputManager &InputMgr;
+
+ReplayManager &ReplayMgr = ReplayManager::Instance();
+
+static inline uint16_t GetLe16(const uint8_t *data) {
+    return data[0] | (data[1] << 8);
+}
+static inline uint32_t GetLe32(const uint8_t *data) {
+    return GetLe16(data) | (static_cast<uint32_t>(GetLe16(data + 2)) << 16);
+}
+static inline void PutLe16(uint8_t *data, uint16_t value) {
+    data[0] = value & 0xFF;
+    data[1] = value >> 8;
+}
+static inline void PutLe32(uint8_t *data, uint32_t value) {
+    PutLe16(data, value & 0xFFFF);
+    PutLe16(data + 2, value >> 16);
+}
+
+ReplayManager &ReplayManager::Instance() {
+    static ReplayManager *instance = new ReplayManager();
+    return *instance;
+}
+
+ReplayManager::ReplayManager()
+    : m_state(REPLAY_IDLE),
+      m_frameRing(),
+      m_commandRing(),
+      m_rings(false),
+      m_frames(0),
+      m_overruns(0),
+      m_underrun(false),
+      m_divergences(0),
+      m_divergenceFirst(0),
+      m_frame(),
+      m_command(),
+      m_ports(),
+      m_adc(),
+      m_encoderSteps(0) {}
+
+bool ReplayManager::Rings(Frame *frames, uint32_t frameCount,
+                          uint8_t *commands, uint32_t commandSize) {
+    Stop();
+    m_rings = m_frameRing.Storage(frames, frameCount) &&
+              m_commandRing.Storage(commands, commandSize);
+    return m_rings;
+}
+
+bool ReplayManager::RecordStart() {
+    if (!m_rings) {
+        return false;
+    }
+    Stop();
+    m_frameRing.Clear();
+    m_commandRing.Clear();
+    m_frames = 0;
+    m_overruns = 0;
+    // Publish the state only once the rings are empty
+    atomic_store_n(&m_state, REPLAY_RECORDING);
+    return true;
+}
+
+bool ReplayManager::ReplayStart() {
+    if (!m_rings || m_state == REPLAY_RECORDING || m_frameRing.Empty()) {
+        return false;
+    }
+    __disable_irq();
+    m_frames = 0;
+    m_underrun = false;
+    m_divergences = 0;
+    m_divergenceFirst = 0;
+    // Point the connectors at the replayed readings. The first frame is
+    // loaded into them before the next sample reads them.
+    InputMgr.SetInputRegisters(&m_ports[PORTA], &m_ports[PORTB],
+                               &m_ports[PORTC]);
+    CcioMgr.m_inputsReplay = true;
+    AdcMgr.m_replayResults = m_adc;
+    EncoderIn.m_replaySteps = &m_encoderSteps;
+    m_state = REPLAY_REPLAYING;
+    __enable_irq();
+    return true;
+}
+
+void ReplayManager::Stop() {
+    __disable_irq();
+    if (m_state == REPLAY_REPLAYING) {
+        HardwareRestore();
+    }
+    m_state = REPLAY_IDLE;
+    __enable_irq();
+}
+
+void ReplayManager::HardwareRestore() {
+    InputMgr.SetInputRegisters(NULL, NULL, NULL);
+    AdcMgr.m_replayResults = nullptr;
+    EncoderIn.m_replaySteps = nullptr;
+    // The link only updates the inputs that change, so catch the rest up
+    CcioMgr.m_inputsReplay = false;
+    CcioMgr.InputsApply(CcioMgr.m_currentInputs);
+}
+
+ISR_RAMFUNC void ReplayManager::SampleBegin() {
+    if (m_state != REPLAY_REPLAYING) {
+        return;
+    }
+    if (!m_frameRing.Pop(m_frame)) {
+        m_underrun = true;
+        HardwareRestore();
+        m_state = REPLAY_IDLE;
+        return;
+    }
+
+    for (uint8_t i = 0; i < CLEARCORE_PORT_MAX; i++) {
+        m_ports[i] = m_frame.Ports[i];
+    }
+    for (uint8_t i = 0; i < AdcManager::ADC_CHANNEL_COUNT; i++) {
+        m_adc[i] = m_frame.Adc[i];
+    }
+    m_encoderSteps = m_frame.EncoderSteps;
+    CcioMgr.InputsApply(m_frame.Ccio);
+    CommandsReplay();
+}
+
+ISR_RAMFUNC void ReplayManager::CommandsReplay() {
+    uint8_t header[REPLAY_COMMAND_HEADER_LEN];
+    while (m_commandRing.Count() >= REPLAY_COMMAND_HEADER_LEN) {
+        for (uint8_t i = 0; i < REPLAY_COMMAND_HEADER_LEN; i++) {
+            m_commandRing.Peek(header[i], i);
+        }
+        uint32_t frame = GetLe32(header);
+        uint16_t length = GetLe16(header + 4);
+        uint32_t size = REPLAY_COMMAND_HEADER_LEN + length;
+        if (frame > m_frames) {
+            // Not due yet
+            return;
+        }
+        if (length <= BATCH_REQUEST_MAX && m_commandRing.Count() < size) {
+            // Wait for the rest of a batch that is still being written
+            return;
+        }
+
+        m_commandRing.Read(header, REPLAY_COMMAND_HEADER_LEN);
+        if (frame < m_frames || length > BATCH_REQUEST_MAX) {
+            // Too late to start in its frame, or not a batch; skip it
+            while (length) {
+                uint16_t chunk = m_commandRing.Read(
+                    m_command, length < sizeof(m_command) ? length
+                                                          : sizeof(m_command));
+                if (!chunk) {
+                    break;
+                }
+                length -= chunk;
+            }
+            Diverged();
+            continue;
+        }
+        m_commandRing.Read(m_command, length);
+        if (!CmdBatch.Load(m_command, length)) {
+            Diverged();
+        }
+    }
+}
+
+ISR_RAMFUNC void ReplayManager::SampleEnd() {
+    if (m_state == REPLAY_RECORDING) {
+        Frame frame;
+        frame.Ccio = CcioMgr.InputState();
+        for (uint8_t i = 0; i < CLEARCORE_PORT_MAX; i++) {
+            frame.Ports[i] = InputMgr.m_inputsUnfiltered[i];
+        }
+        frame.Inputs = InputMgr.InputsRT().reg;
+        for (uint8_t i = 0; i < AdcManager::ADC_CHANNEL_COUNT; i++) {
+            frame.Adc[i] = AdcMgr.m_AdcResultsConverted[i];
+        }
+        frame.EncoderSteps = EncoderIn.m_enabled ? EncoderIn.m_stepsLast : 0;
+        if (!m_frameRing.Push(frame)) {
+            m_overruns++;
+        }
+    }
+    else if (m_state == REPLAY_REPLAYING) {
+        if (InputMgr.InputsRT().reg != m_frame.Inputs) {
+            Diverged();
+        }
+    }
+    else {
+        return;
+    }
+    m_frames++;
+}
+
+ISR_RAMFUNC void ReplayManager::CommandRecord(const uint8_t *request,
+                                              uint16_t length) {
+    if (m_state != REPLAY_RECORDING) {
+        return;
+    }
+    uint32_t size = REPLAY_COMMAND_HEADER_LEN + length;
+    if (m_commandRing.Space() < size) {
+        m_overruns++;
+        return;
+    }
+    uint8_t header[REPLAY_COMMAND_HEADER_LEN];
+    PutLe32(header, m_frames);
+    PutLe16(header + 4, length);
+    m_commandRing.Write(header, REPLAY_COMMAND_HEADER_LEN);
+    m_commandRing.Write(request, length);
+}
+
+ISR_RAMFUNC void ReplayManager::Diverged() {
+    if (!m_divergences) {
+        m_divergenceFirst = m_frames;
+    }
+    m_divergences++;
+}
+
+} // ClearCore namespace
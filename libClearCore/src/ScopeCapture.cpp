@@ -0,0 +1,286 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    ClearCore sample rate triggered capture of internal signals
+**/
+
+#include "ScopeCapture.h"
+#include <string.h>
+#include "atomic_utils.h"
+#include "SysTiming.h"
+
+namespace ClearCore {
+
+extern SysTiming &TimingMgr;
+
+ScopeCapture &Scope = ScopeCapture::Instance();
+
+ScopeCapture &ScopeCapture::Instance() {
+    static ScopeCapture *instance = new ScopeCapture();
+    return *instance;
+}
+
+ScopeCapture::ScopeCapture()
+    : m_buffer(),
+      m_channels(),
+      m_channelCount(0),
+      m_recordSize(0),
+      m_capacity(0),
+      m_decimation(1),
+      m_decimationCnt(1),
+      m_state(SCOPE_IDLE),
+      m_head(0),
+      m_count(0),
+      m_preRecords(0),
+      m_postLeft(0),
+      m_preRecorded(0),
+      m_records(0),
+      m_first(0),
+      m_triggerUs(0),
+      m_triggerChannel(SCOPE_CHANNELS_MAX),
+      m_triggerEdge(TRIGGER_RISING),
+      m_triggerOffset(0),
+      m_triggerLevel(0),
+      m_triggerAbove(false),
+      m_triggerPrimed(false),
+      m_triggerPending(false) {}
+
+bool ScopeCapture::Setup(const Channel *channels, uint8_t channelCount,
+                         uint16_t decimation) {
+    Stop();
+    if (!channels || !channelCount || channelCount > SCOPE_CHANNELS_MAX ||
+            !decimation) {
+        return false;
+    }
+    uint16_t recordSize = 0;
+    for (uint8_t i = 0; i < channelCount; i++) {
+        const Channel &channel = channels[i];
+        if ((channel.Size != 1 && channel.Size != 2 && channel.Size != 4) ||
+                (channel.Read ? channel.Size != 4 : !channel.Address) ||
+                (channel.Kind == SCOPE_FLOAT && channel.Size != 4)) {
+            return false;
+        }
+        recordSize += channel.Size;
+    }
+    if (SCOPE_BUFFER_SIZE / recordSize < 2) {
+        return false;
+    }
+
+    memcpy(m_channels, channels, channelCount * sizeof(Channel));
+    m_channelCount = channelCount;
+    m_recordSize = recordSize;
+    m_capacity = SCOPE_BUFFER_SIZE / recordSize;
+    m_decimation = decimation;
+    m_triggerChannel = SCOPE_CHANNELS_MAX;
+    return true;
+}
+
+bool ScopeCapture::TriggerLevel(uint8_t channel, TriggerEdges edge,
+                                float level) {
+    if (m_state == SCOPE_ARMED || m_state == SCOPE_TRIGGERED ||
+            channel >= m_channelCount) {
+        return false;
+    }
+    uint16_t offset = 0;
+    for (uint8_t i = 0; i < channel; i++) {
+        offset += m_channels[i].Size;
+    }
+    m_triggerOffset = offset;
+    m_triggerEdge = edge;
+    m_triggerLevel = level;
+    m_triggerChannel = channel;
+    return true;
+}
+
+bool ScopeCapture::TriggerLevelClear() {
+    if (m_state == SCOPE_ARMED || m_state == SCOPE_TRIGGERED) {
+        return false;
+    }
+    m_triggerChannel = SCOPE_CHANNELS_MAX;
+    return true;
+}
+
+bool ScopeCapture::Arm(uint32_t preRecords) {
+    Stop();
+    if (!m_channelCount || preRecords >= m_capacity) {
+        return false;
+    }
+    m_preRecords = preRecords;
+    m_head = 0;
+    m_count = 0;
+    m_decimationCnt = 1;
+    m_triggerPrimed = false;
+    m_triggerPending = false;
+    // Publish the capture only once it is set up
+    atomic_store_n(&m_state, SCOPE_ARMED);
+    return true;
+}
+
+bool ScopeCapture::Trigger() {
+    if (m_state != SCOPE_ARMED) {
+        return false;
+    }
+    m_triggerPending = true;
+    return true;
+}
+
+void ScopeCapture::Stop() {
+    m_state = SCOPE_IDLE;
+}
+
+uint32_t ScopeCapture::RecordPeriodUs() {
+    return static_cast<uint32_t>(m_decimation) * 1000000UL /
+           _CLEARCORE_SAMPLE_RATE_HZ;
+}
+
+uint32_t ScopeCapture::Read(uint32_t offset, void *dst, uint32_t length) {
+    uint32_t size = m_records * m_recordSize;
+    if (m_state != SCOPE_DONE || offset >= size) {
+        return 0;
+    }
+    if (length > size - offset) {
+        length = size - offset;
+    }
+    // The capture starts at m_first and may wrap around the end of the ring
+    uint32_t ringSize = m_capacity * m_recordSize;
+    uint32_t start = m_first * m_recordSize + offset;
+    if (start >= ringSize) {
+        start -= ringSize;
+    }
+    uint32_t count = ringSize - start;
+    if (count > length) {
+        count = length;
+    }
+    uint8_t *out = static_cast<uint8_t *>(dst);
+    memcpy(out, m_buffer + start, count);
+    memcpy(out + count, m_buffer, length - count);
+    return length;
+}
+
+void ScopeCapture::Sample() {
+    States state = m_state;
+    if ((state != SCOPE_ARMED && state != SCOPE_TRIGGERED) ||
+            --m_decimationCnt) {
+        return;
+    }
+    m_decimationCnt = m_decimation;
+
+    uint8_t *record = m_buffer + m_head * m_recordSize;
+    uint8_t *field = record;
+    for (uint8_t i = 0; i < m_channelCount; i++) {
+        const Channel &channel = m_channels[i];
+        if (channel.Read) {
+            int32_t value = channel.Read();
+            memcpy(field, &value, 4);
+        }
+        else if (channel.Size == 4) {
+            uint32_t value =
+                *static_cast<const volatile uint32_t *>(channel.Address);
+            memcpy(field, &value, 4);
+        }
+        else if (channel.Size == 2) {
+            uint16_t value =
+                *static_cast<const volatile uint16_t *>(channel.Address);
+            memcpy(field, &value, 2);
+        }
+        else {
+            *field = *static_cast<const volatile uint8_t *>(channel.Address);
+        }
+        field += channel.Size;
+    }
+
+    uint32_t slot = m_head;
+    if (++m_head == m_capacity) {
+        m_head = 0;
+    }
+
+    if (state == SCOPE_TRIGGERED) {
+        if (!--m_postLeft) {
+            atomic_store_n(&m_state, SCOPE_DONE);
+        }
+        return;
+    }
+
+    // Check the level even when Trigger() was called, so that the edge
+    // detection starts from this record
+    bool levelHit = TriggerCheck(record);
+    if (!levelHit && !m_triggerPending) {
+        if (m_count < m_capacity) {
+            m_count++;
+        }
+        return;
+    }
+
+    // The records before this one are the pre-trigger part; as many as
+    // were asked for and have been taken
+    m_preRecorded = (m_count < m_preRecords) ? m_count : m_preRecords;
+    m_first = (slot >= m_preRecorded) ? slot - m_preRecorded :
+              slot + m_capacity - m_preRecorded;
+    m_records = m_preRecorded + m_capacity - m_preRecords;
+    m_postLeft = m_capacity - m_preRecords - 1;
+    m_triggerUs = TimingMgr.Microseconds();
+    atomic_store_n(&m_state, m_postLeft ? SCOPE_TRIGGERED : SCOPE_DONE);
+}
+
+bool ScopeCapture::TriggerCheck(const uint8_t *record) {
+    if (m_triggerChannel >= SCOPE_CHANNELS_MAX) {
+        return false;
+    }
+    const Channel &channel = m_channels[m_triggerChannel];
+    const uint8_t *field = record + m_triggerOffset;
+    float value;
+    if (channel.Kind == SCOPE_FLOAT) {
+        memcpy(&value, field, 4);
+    }
+    else if (channel.Size == 4) {
+        uint32_t raw;
+        memcpy(&raw, field, 4);
+        value = (channel.Kind == SCOPE_SIGNED) ?
+                static_cast<float>(static_cast<int32_t>(raw)) :
+                static_cast<float>(raw);
+    }
+    else if (channel.Size == 2) {
+        uint16_t raw;
+        memcpy(&raw, field, 2);
+        value = (channel.Kind == SCOPE_SIGNED) ?
+                static_cast<float>(static_cast<int16_t>(raw)) :
+                static_cast<float>(raw);
+    }
+    else {
+        value = (channel.Kind == SCOPE_SIGNED) ?
+                static_cast<float>(static_cast<int8_t>(*field)) :
+                static_cast<float>(*field);
+    }
+
+    bool above = value >= m_triggerLevel;
+    bool crossed = m_triggerPrimed && above != m_triggerAbove;
+    m_triggerAbove = above;
+    m_triggerPrimed = true;
+    if (!crossed) {
+        return false;
+    }
+    return m_triggerEdge == TRIGGER_EITHER ||
+           (m_triggerEdge == TRIGGER_RISING) == above;
+}
+
+} // ClearCore namespace
@@ -29,10 +29,58 @@
 
 #include "SdCardDriver.h"
 #include <sam.h>
+#include "SysTiming.h"
 #include "SysUtils.h"
 
+// SPI mode commands
+#define CMD0   0  // GO_IDLE_STATE
+#define CMD8   8  // SEND_IF_COND
+#define CMD9   9  // SEND_CSD
+#define CMD12 12  // STOP_TRANSMISSION
+#define CMD16 16  // SET_BLOCKLEN
+#define CMD17 17  // READ_SINGLE_BLOCK
+#define CMD18 18  // READ_MULTIPLE_BLOCK
+#define CMD24 24  // WRITE_BLOCK
+#define CMD25 25  // WRITE_MULTIPLE_BLOCK
+#define CMD55 55  // APP_CMD
+#define CMD58 58  // READ_OCR
+#define ACMD41 41 // SD_SEND_OP_COND
+
+// R1 response bits
+#define R1_IDLE 0x01
+#define R1_ILLEGAL_COMMAND 0x04
+
+// Data tokens
+#define TOKEN_START_BLOCK 0xFE
+#define TOKEN_START_MULTI_WRITE 0xFC
+#define TOKEN_STOP_MULTI_WRITE 0xFD
+#define DATA_RESPONSE_MASK 0x1F
+#define DATA_ACCEPTED 0x05
+
+#define SD_INIT_TIMEOUT_MS 1000
+#define SD_CMD_TIMEOUT_MS 300
+#define SD_READ_TIMEOUT_MS 100
+#define SD_WRITE_TIMEOUT_MS 500
+
 namespace ClearCore {
 
+// CRC-7 of a command frame, placed in the frame's last byte with the end bit.
+// Only CMD0 and CMD8 are checked in SPI mode, but every command carries it.
+static uint8_t Crc7(const uint8_t *data, uint8_t length) {
+    uint8_t crc = 0;
+    while (length--) {
+        uint8_t byte = *data++;
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc <<= 1;
+            if ((byte ^ crc) & 0x80) {
+                crc ^= 0x09;
+            }
+            byte <<= 1;
+        }
+    }
+    return (crc << 1) | 1;
+}
+
 /**
     Construct and wire into the board.
 **/
@@ -42,10 +90,262 @@ SdCardDriver::SdCardDriver(const PeripheralRoute *misoInfo,
                            const PeripheralRoute *mosiInfo,
                            uint8_t peripheral)
     : SerialBase(misoInfo, ssInfo, sckInfo, mosiInfo, peripheral),
-      m_errorCode(0) {
+      m_errorCode(0),
+      m_initialized(false),
+      m_blockAddressing(false),
+      m_blockCount(0) {
+    // Data blocks move a word per DATA access
+    SpiData32(true);
     PortMode(SerialBase::SPI);
     SpiClock(SCK_LOW, LEAD_SAMPLE);
     PortOpen();
 }
 
+/**
+    Bring up the card in SPI mode.
+**/
+bool SdCardDriver::Initialize() {
+    m_initialized = false;
+    if (!m_portOpen) {
+        PortOpen();
+    }
+    // The card expects MOSI high whenever the host is only reading
+    SpiFillByte(0xFF);
+    Speed(SD_SPI_INIT_HZ);
+
+    // At least 74 clocks with the card deselected put it in native mode
+    SpiSsMode(LINE_OFF);
+    SpiTransferData(NULL, NULL, 10);
+
+    // CMD0 with the card selected switches it to SPI mode
+    uint32_t startMs = Milliseconds();
+    while (Command(CMD0, 0) != R1_IDLE) {
+        if (Milliseconds() - startMs > SD_INIT_TIMEOUT_MS) {
+            Deselect();
+            return false;
+        }
+    }
+
+    // Version 2 cards answer CMD8 and echo its check pattern
+    bool version2 = false;
+    if (!(Command(CMD8, 0x1AA) & R1_ILLEGAL_COMMAND)) {
+        uint8_t r7[4];
+        SpiTransferData(NULL, r7, sizeof(r7));
+        if (r7[3] != 0xAA) {
+            Deselect();
+            return false;
+        }
+        version2 = true;
+    }
+
+    // Start initialization, telling version 2 cards that high capacity is
+    // supported, and wait for the card to leave the idle state
+    startMs = Milliseconds();
+    uint8_t r1;
+    while ((r1 = AppCommand(ACMD41, version2 ? 0x40000000 : 0)) != 0) {
+        if ((r1 & ~R1_IDLE) ||
+                Milliseconds() - startMs > SD_INIT_TIMEOUT_MS) {
+            Deselect();
+            return false;
+        }
+    }
+
+    // High capacity cards report CCS in the OCR and address blocks
+    m_blockAddressing = false;
+    if (version2) {
+        uint8_t ocr[4];
+        if (Command(CMD58, 0)) {
+            Deselect();
+            return false;
+        }
+        SpiTransferData(NULL, ocr, sizeof(ocr));
+        m_blockAddressing = ocr[0] & 0x40;
+    }
+    if (!m_blockAddressing && Command(CMD16, SD_BLOCK_SIZE)) {
+        Deselect();
+        return false;
+    }
+
+    // The CSD register comes back like a data block
+    uint8_t csd[16];
+    if (Command(CMD9, 0) || !DataReceive(csd, sizeof(csd))) {
+        Deselect();
+        return false;
+    }
+    m_blockCount = CsdBlockCount(csd);
+    Deselect();
+
+    Speed(SD_SPI_FAST_HZ);
+    m_initialized = true;
+    return true;
+}
+
+/**
+    Read blocks, using CMD18 for more than one.
+**/
+bool SdCardDriver::BlockRead(uint32_t block, uint8_t *data, uint32_t count) {
+    if (!m_initialized || !data || !count) {
+        return false;
+    }
+
+    uint32_t address = m_blockAddressing ? block : block * SD_BLOCK_SIZE;
+    bool success = !Command(count > 1 ? CMD18 : CMD17, address);
+    for (uint32_t i = 0; success && i < count; i++) {
+        success = DataReceive(data + i * SD_BLOCK_SIZE);
+    }
+    if (count > 1) {
+        // Stop the multi-block read; the next command waits out its busy
+        Command(CMD12, 0);
+    }
+    Deselect();
+
+    if (!success) {
+        SetErrorCode(SD_ERROR_READ);
+    }
+    return success;
+}
+
+/**
+    Write blocks, using CMD25 for more than one.
+**/
+bool SdCardDriver::BlockWrite(uint32_t block, const uint8_t *data,
+                              uint32_t count) {
+    if (!m_initialized || !data || !count) {
+        return false;
+    }
+
+    uint32_t address = m_blockAddressing ? block : block * SD_BLOCK_SIZE;
+    bool success;
+    if (count == 1) {
+        success = !Command(CMD24, address) &&
+                  DataSend(TOKEN_START_BLOCK, data);
+    }
+    else {
+        success = !Command(CMD25, address);
+        if (success) {
+            for (uint32_t i = 0; success && i < count; i++) {
+                success = DataSend(TOKEN_START_MULTI_WRITE,
+                                   data + i * SD_BLOCK_SIZE);
+            }
+            // The stop token ends the transfer, even after a failed block
+            SpiTransferData(TOKEN_STOP_MULTI_WRITE);
+            SpiTransferData(0xFF);
+            if (!WaitReady(SD_WRITE_TIMEOUT_MS)) {
+                success = false;
+            }
+        }
+    }
+    Deselect();
+
+    if (!success) {
+        SetErrorCode(SD_ERROR_WRITE);
+    }
+    return success;
+}
+
+uint8_t SdCardDriver::Command(uint8_t cmd, uint32_t arg) {
+    SpiSsMode(LINE_ON);
+    // A card that is still busy from a write ignores commands. CMD0 is sent
+    // before the card is known to answer at all.
+    if (cmd != CMD0 && !WaitReady(SD_CMD_TIMEOUT_MS)) {
+        return 0xFF;
+    }
+
+    uint8_t frame[6] = {
+        static_cast<uint8_t>(0x40 | cmd),
+        static_cast<uint8_t>(arg >> 24),
+        static_cast<uint8_t>(arg >> 16),
+        static_cast<uint8_t>(arg >> 8),
+        static_cast<uint8_t>(arg),
+        0
+    };
+    frame[5] = Crc7(frame, 5);
+    SpiTransferData(frame, NULL, sizeof(frame));
+    if (cmd == CMD12) {
+        // Skip the stuff byte
+        SpiTransferData(0xFF);
+    }
+
+    // The response comes within 8 bytes and starts with a 0 bit
+    uint8_t r1 = 0xFF;
+    for (uint8_t i = 0; i < 10 && (r1 & 0x80); i++) {
+        r1 = SpiTransferData(0xFF);
+    }
+    return r1;
+}
+
+uint8_t SdCardDriver::AppCommand(uint8_t cmd, uint32_t arg) {
+    Command(CMD55, 0);
+    return Command(cmd, arg);
+}
+
+bool SdCardDriver::WaitReady(uint32_t timeoutMs) {
+    uint32_t startMs = Milliseconds();
+    while (SpiTransferData(0xFF) != 0xFF) {
+        if (Milliseconds() - startMs > timeoutMs) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SdCardDriver::DataReceive(uint8_t *data, uint16_t length) {
+    uint32_t startMs = Milliseconds();
+    uint8_t token;
+    while ((token = SpiTransferData(0xFF)) == 0xFF) {
+        if (Milliseconds() - startMs > SD_READ_TIMEOUT_MS) {
+            return false;
+        }
+    }
+    if (token != TOKEN_START_BLOCK) {
+        return false;
+    }
+    Transfer(NULL, data, length);
+    // Skip the CRC
+    SpiTransferData(NULL, NULL, 2);
+    return true;
+}
+
+bool SdCardDriver::DataSend(uint8_t token, const uint8_t *data) {
+    SpiTransferData(token);
+    Transfer(data, NULL, SD_BLOCK_SIZE);
+    // The CRC is not checked in SPI mode
+    SpiTransferData(NULL, NULL, 2);
+    if ((SpiTransferData(0xFF) & DATA_RESPONSE_MASK) != DATA_ACCEPTED) {
+        return false;
+    }
+    return WaitReady(SD_WRITE_TIMEOUT_MS);
+}
+
+uint32_t SdCardDriver::CsdBlockCount(const uint8_t *csd) {
+    if ((csd[0] >> 6) == 1) {
+        // CSD version 2: C_SIZE counts 512 KB units
+        uint32_t cSize = (static_cast<uint32_t>(csd[7] & 0x3F) << 16) |
+                         (csd[8] << 8) | csd[9];
+        return (cSize + 1) << 10;
+    }
+    // CSD version 1: (C_SIZE + 1) * 2^(C_SIZE_MULT + 2) blocks of
+    // 2^READ_BL_LEN bytes
+    uint32_t cSize = ((csd[6] & 0x03) << 10) | (csd[7] << 2) | (csd[8] >> 6);
+    uint8_t cSizeMult = ((csd[9] & 0x03) << 1) | (csd[10] >> 7);
+    uint8_t readBlLen = csd[5] & 0x0F;
+    return (cSize + 1) << (cSizeMult + 2 + readBlLen - 9);
+}
+
+void SdCardDriver::Transfer(const uint8_t *writeBuf, uint8_t *readBuf,
+                            int32_t len) {
+    if (SpiTransferDataAsync(writeBuf, readBuf, len)) {
+        SpiAsyncWaitComplete();
+    }
+    else {
+        SpiTransferData(writeBuf, readBuf, len);
+    }
+}
+
+void SdCardDriver::Deselect() {
+    SpiSsMode(LINE_OFF);
+    // The card releases MISO on the next clock
+    SpiTransferData(0xFF);
+}
+
 } // ClearCore namespace
\ No newline at end of file
@@ -0,0 +1,240 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    ClearCore authenticated encryption of messages between devices
+**/
+
+#include "SecureChannel.h"
+#include <string.h>
+
+// The first byte of a frame
+#define FRAME_MESSAGE 0x4D
+#define FRAME_CHALLENGE 0x43
+
+// A message's nonce, its session and count, follows the type and token
+#define NONCE_OFFSET 5
+
+namespace ClearCore {
+
+extern AesManager &AesMgr;
+
+SecureChannel::SecureChannel()
+    : m_key(),
+      m_session(0),
+      m_token(0),
+      m_count(0),
+      m_txToken(0),
+      m_txKey(),
+      m_peers(),
+      m_peerCount(0),
+      m_challengeDue(false),
+      m_authErrors(0),
+      m_replayErrors(0) {}
+
+bool SecureChannel::Begin(const uint8_t *key, uint8_t keyLength) {
+    if (!AesMgr.KeyExpand(m_key, key, keyLength)) {
+        return false;
+    }
+    m_session = (static_cast<uint64_t>(AesMgr.Random()) << 32) |
+                AesMgr.Random();
+    m_count = 0;
+    m_challengeDue = false;
+    TokenDraw();
+    // No token is 0, so messages are sealed for no one until a challenge
+    // or a message names the receiver's token
+    m_txToken = 0;
+    if (!KeyDerive(m_txKey, 0, m_session)) {
+        m_key.Length = 0;
+        return false;
+    }
+    return true;
+}
+
+int32_t SecureChannel::Seal(const uint8_t *in, uint16_t length,
+                            uint8_t *out) {
+    if (!m_key.Length || m_count == UINT32_MAX ||
+            length > UINT16_MAX - SECURE_CHANNEL_OVERHEAD) {
+        return -1;
+    }
+    out[0] = FRAME_MESSAGE;
+    memcpy(out + 1, &m_token, sizeof(m_token));
+    memcpy(out + NONCE_OFFSET, &m_session, sizeof(m_session));
+    memcpy(out + NONCE_OFFSET + sizeof(m_session), &m_count,
+           sizeof(m_count));
+    // The count never goes back while the session lasts, so no nonce
+    // repeats under any key derived for it. The type and token are
+    // authenticated with the message.
+    if (!AesMgr.GcmEncrypt(m_txKey, out + NONCE_OFFSET, out, NONCE_OFFSET,
+                           in, out + SECURE_CHANNEL_HEADER_SIZE, length,
+                           out + SECURE_CHANNEL_HEADER_SIZE + length)) {
+        return -1;
+    }
+    m_count++;
+    return length + SECURE_CHANNEL_OVERHEAD;
+}
+
+int32_t SecureChannel::Open(const uint8_t *in, uint16_t length,
+                            uint8_t *out) {
+    if (!m_key.Length || !length) {
+        return -1;
+    }
+    if (in[0] == FRAME_CHALLENGE) {
+        // A challenge isn't authenticated; a forged one only makes this
+        // channel seal for a token no one holds until the next challenge
+        uint32_t token;
+        if (length != SECURE_CHANNEL_CHALLENGE_SIZE) {
+            return -1;
+        }
+        memcpy(&token, in + 1, sizeof(token));
+        if (!token || !TxTokenSet(token)) {
+            return -1;
+        }
+        return SECURE_CHANNEL_HANDSHAKE;
+    }
+    if (in[0] != FRAME_MESSAGE || length < SECURE_CHANNEL_OVERHEAD) {
+        return -1;
+    }
+    // Keep the header; decrypting in place overwrites it
+    uint8_t header[SECURE_CHANNEL_HEADER_SIZE];
+    memcpy(header, in, SECURE_CHANNEL_HEADER_SIZE);
+    uint32_t token;
+    uint64_t session;
+    uint32_t count;
+    memcpy(&token, header + 1, sizeof(token));
+    memcpy(&session, header + NONCE_OFFSET, sizeof(session));
+    memcpy(&count, header + NONCE_OFFSET + sizeof(session), sizeof(count));
+
+    // Our own messages reflected back are replays
+    if (session == m_session) {
+        m_replayErrors++;
+        return -1;
+    }
+
+    uint16_t textLength = length - SECURE_CHANNEL_OVERHEAD;
+    const uint8_t *text = in + SECURE_CHANNEL_HEADER_SIZE;
+    const uint8_t *tag = text + textLength;
+    Peer *peer = nullptr;
+    for (uint8_t i = 0; i < m_peerCount; i++) {
+        if (m_peers[i].Session == session) {
+            peer = &m_peers[i];
+            break;
+        }
+    }
+
+    if (peer) {
+        if (!AesMgr.GcmDecrypt(peer->Key, header + NONCE_OFFSET, header,
+                               NONCE_OFFSET, text, out, textLength, tag)) {
+            m_authErrors++;
+            return -1;
+        }
+        // Only authentic messages reach the replay check, so a forgery
+        // can't push a session's count forward
+        if (count <= peer->Count) {
+            m_replayErrors++;
+            memset(out, 0, textLength);
+            return -1;
+        }
+        peer->Count = count;
+    }
+    else {
+        // A session is only taken on for a message sealed for our current
+        // token, so it began after the token was drawn. Anything else,
+        // chiefly a message sealed before either end last began, is
+        // answered with a challenge.
+        AesManager::Key key;
+        if (!KeyDerive(key, m_token, session)) {
+            return -1;
+        }
+        if (!AesMgr.GcmDecrypt(key, header + NONCE_OFFSET, header,
+                               NONCE_OFFSET, text, out, textLength, tag)) {
+            m_authErrors++;
+            m_challengeDue = true;
+            return -1;
+        }
+        if (m_peerCount == SECURE_CHANNEL_PEERS) {
+            // Forgetting a session would let its messages be replayed, so
+            // retire them all under a new token instead
+            TokenDraw();
+            m_challengeDue = true;
+            memset(out, 0, textLength);
+            return -1;
+        }
+        peer = &m_peers[m_peerCount++];
+        peer->Session = session;
+        peer->Count = count;
+        peer->Key = key;
+    }
+
+    // Replies are sealed for the sender of the last message opened
+    TxTokenSet(token);
+    return textLength;
+}
+
+uint16_t SecureChannel::Challenge(uint8_t *out) {
+    if (!m_challengeDue) {
+        return 0;
+    }
+    m_challengeDue = false;
+    out[0] = FRAME_CHALLENGE;
+    memcpy(out + 1, &m_token, sizeof(m_token));
+    return SECURE_CHANNEL_CHALLENGE_SIZE;
+}
+
+bool SecureChannel::KeyDerive(AesManager::Key &key, uint32_t token,
+                              uint64_t session) {
+    // The shared key only encrypts zeros under the token and session as
+    // the IV, so the keystream is the session key
+    static const uint8_t zeros[32] = {0};
+    uint8_t iv[AES_GCM_IV_SIZE];
+    uint8_t bytes[sizeof(zeros)];
+    uint8_t tag[AES_GCM_TAG_SIZE];
+    memcpy(iv, &token, sizeof(token));
+    memcpy(iv + sizeof(token), &session, sizeof(session));
+    bool derived = AesMgr.GcmEncrypt(m_key, iv, nullptr, 0, zeros, bytes,
+                                     m_key.Length, tag) &&
+                   AesMgr.KeyExpand(key, bytes, m_key.Length);
+    memset(bytes, 0, sizeof(bytes));
+    return derived;
+}
+
+void SecureChannel::TokenDraw() {
+    do {
+        m_token = AesMgr.Random();
+    } while (!m_token);
+    m_peerCount = 0;
+}
+
+bool SecureChannel::TxTokenSet(uint32_t token) {
+    if (token == m_txToken) {
+        return true;
+    }
+    AesManager::Key key;
+    if (!KeyDerive(key, token, m_session)) {
+        return false;
+    }
+    m_txKey = key;
+    m_txToken = token;
+    return true;
+}
+
+} // ClearCore namespace
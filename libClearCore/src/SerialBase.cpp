@@ -30,11 +30,15 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sam.h>
 #include "atomic_utils.h"
+#include "Connector.h"
+#include "DigitalIn.h"
 #include "InputManager.h"
 #include "SysTiming.h"
 #include "SysUtils.h"
+#include "TraceManager.h"
 
 namespace ClearCore {
 
@@ -46,9 +50,42 @@ namespace ClearCore {
 // Dummy location to read/write SPI data that is unused
 static uint32_t spiDummy;
 
+// The ports running as SPI slaves, for their slave select interrupts.
+// Only COM-0 (SERCOM7) and COM-1 (SERCOM0) have DMA channels.
+static SerialBase *spiSlavePorts[2];
+
+static void SpiSlaveSsIsr0() {
+    spiSlavePorts[0]->IrqHandlerSpiSlaveSs();
+}
+
+static void SpiSlaveSsIsr1() {
+    spiSlavePorts[1]->IrqHandlerSpiSlaveSs();
+}
+
 extern volatile uint32_t tickCnt;
 extern InputManager &InputMgr;
 
+static_assert((SERIAL_BUFFER_SIZE & (SERIAL_BUFFER_SIZE - 1)) == 0,
+              "SERIAL_BUFFER_SIZE must be a power of 2");
+
+/**
+    Disable and reset a DMA channel, then set it to move one beat per trigger.
+**/
+static void DmaChannelReset(DmaChannels channelNum, uint8_t trigger) {
+    DmacChannel *channel = DmaManager::Channel(channelNum);
+    // Disable and reset the channel so it is clean to setup
+    channel->CHCTRLA.reg &= ~DMAC_CHCTRLA_ENABLE;
+    channel->CHCTRLA.reg = DMAC_CHCTRLA_SWRST;
+    // Wait for the reset to finish
+    while (channel->CHCTRLA.reg == DMAC_CHCTRLA_SWRST) {
+        continue;
+    }
+
+    channel->CHCTRLA.reg = DMAC_CHCTRLA_TRIGSRC(trigger) |
+                           DMAC_CHCTRLA_TRIGACT_BURST |
+                           DMAC_CHCTRLA_BURSTLEN_SINGLE;
+}
+
 /**
     Construct this instance and remember all the pads and bit locations.
 **/
@@ -66,6 +103,8 @@ SerialBase::SerialBase(const PeripheralRoute *ctsMisoInfo,
       m_ssMode(LINE_OFF),
       m_rtsMode(LINE_HW),
       m_flowControl(false),
+      m_rs485(false),
+      m_rs485GuardBits(0),
       m_ctsMisoInfo(ctsMisoInfo),
       m_rtsSsInfo(rtsSsInfo),
       m_rxSckInfo(rxSckInfo),
@@ -77,9 +116,48 @@ SerialBase::SerialBase(const PeripheralRoute *ctsMisoInfo,
       m_dreIrqN(static_cast<IRQn_Type>(INT32_MAX)),
       m_dmaRxChannel(DMA_INVALID_CHANNEL),
       m_dmaTxChannel(DMA_INVALID_CHANNEL),
-      m_bufferIn{0}, m_bufferOut{0},
-      m_inHead(0), m_inTail(0),
-      m_outHead(0), m_outTail(0) {
+      m_spiFill(0),
+      m_spiFillWord(0),
+      m_spiData32(false),
+      m_spiData32Active(false),
+      m_spiLength(0),
+      m_bufferInDefault{0}, m_bufferOutDefault{0},
+      m_bufferIn(m_bufferInDefault, SERIAL_BUFFER_SIZE),
+      m_bufferOut(m_bufferOutDefault, SERIAL_BUFFER_SIZE),
+      m_breakDetected(false),
+      m_rxCycle(0),
+      m_rxCycleTail(0),
+      m_rxFrameGap(0),
+      m_rxFrameCallback(NULL),
+      m_rxFrameActive(false),
+      m_rxFrameStart(0),
+      m_rxFrameLength(0),
+      m_rxFrameDone(),
+      m_rxFrameReady(false),
+      m_dmaTxCount(0),
+      m_txBlocking(true),
+      m_txDone(true),
+      m_txDoneCallback(nullptr),
+      m_txSpaceCallback(nullptr),
+      m_txSpace(1),
+      m_txSpaceArmed(false),
+      m_uartDma(false),
+      m_uartDmaActive(false),
+      m_spiQueueHead(nullptr),
+      m_spiQueueTail(nullptr),
+      m_spiPolls(nullptr),
+      m_spiSlave(false),
+      m_spiSlaveSs(nullptr),
+      m_spiSlaveRx(nullptr),
+      m_spiSlaveTx(nullptr),
+      m_spiSlaveLength(0),
+      m_spiSlaveCallback(nullptr),
+      m_spiSlaveSelected(false),
+      m_spiSlaveRxIndex(0),
+      m_spiSlaveTxIndex(0),
+      m_spiSlaveTxPending(false),
+      m_spiSlaveFrames(0),
+      m_spiSlaveShortFrames(0) {
     static Sercom *const sercom_instances[SERCOM_INST_NUM] = SERCOM_INSTS;
     m_serPort = sercom_instances[ctsMisoInfo->sercomNum];
 }
@@ -118,6 +196,7 @@ void SerialBase::PortDisable() {
     Disable the port and close it.
 **/
 void SerialBase::PortClose() {
+    SpiSlaveStop();
     if (m_portOpen) {
         // Flush the transmit buffer before closing
         WaitForTransmitIdle();
@@ -140,20 +219,173 @@ void SerialBase::WaitOneCharTime() {
 void SerialBase::FlowControl(bool useFlowControl) {
     m_flowControl = useFlowControl;
     if (m_portMode == UART && m_portOpen) {
-        // Defines the Transmit Data Pin Out
-        // 0x0 for TxD pin PAD 0, RTS pin N/A, CTS pin N/A
-        // 0x2 for TxD pin PAD 0, RTS pin PAD 2, CTS pin PAD 3
         bool sercomEnabled = m_serPort->USART.CTRLA.bit.ENABLE;
         PortDisable();
-        m_serPort->USART.CTRLA.bit.TXPO = m_flowControl ? 2 : 0;
+        UartPinoutUpdate();
+        if (sercomEnabled) {
+            PortEnable();
+        }
+    }
+}
+
+bool SerialBase::Rs485Mode(bool enable, uint8_t guardBits) {
+    if (guardBits > 7) {
+        return false;
+    }
+    m_rs485 = enable;
+    m_rs485GuardBits = guardBits;
+    if (m_portMode == UART && m_portOpen) {
+        // Let a message in progress finish under the old pinout
+        WaitForTransmitIdle();
+        bool sercomEnabled = m_serPort->USART.CTRLA.bit.ENABLE;
+        PortDisable();
+        UartPinoutUpdate();
         if (sercomEnabled) {
             PortEnable();
         }
+        RtsSsPinState(m_rs485 ? LINE_HW : m_rtsMode);
+    }
+    return true;
+}
+
+void SerialBase::UartPinoutUpdate() {
+    // Defines the Transmit Data Pin Out
+    // 0x0 for TxD pin PAD 0, RTS pin N/A, CTS pin N/A
+    // 0x2 for TxD pin PAD 0, RTS pin PAD 2, CTS pin PAD 3
+    // 0x3 for TxD pin PAD 0, XCK pin PAD 1, TE pin PAD 2; XCK is unused with
+    // the internal clock, so RX stays on PAD 1
+    m_serPort->USART.CTRLA.bit.TXPO = m_rs485 ? 3 : m_flowControl ? 2 : 0;
+    m_serPort->USART.CTRLC.bit.GTIME = m_rs485 ? m_rs485GuardBits : 0;
+}
+
+bool SerialBase::UartDma(bool useDma) {
+    // Only the SERCOMs with DMA channels can use DMA
+    if (useDma && m_serPort != SERCOM0 && m_serPort != SERCOM7) {
+        return false;
+    }
+    if (m_uartDma == useDma) {
+        return true;
+    }
+    m_uartDma = useDma;
+    if (m_portMode == UART && m_portOpen) {
+        WaitForTransmitIdle();
+        PortMode(UART);
+    }
+    return true;
+}
+
+bool SerialBase::SpiData32(bool enable) {
+    if (enable && m_charSize != 8) {
+        return false;
+    }
+    if (m_spiData32 == enable) {
+        return true;
+    }
+    m_spiData32 = enable;
+    if (m_portMode == SPI && m_portOpen && !m_spiSlave) {
+        SpiAsyncWaitComplete();
+        while (m_spiQueueHead) {
+            continue;
+        }
+        PortMode(SPI);
+    }
+    return true;
+}
+
+bool SerialBase::ReceiveBuffer(uint8_t *buffer, uint32_t size) {
+    if (m_portOpen) {
+        return false;
+    }
+    if (!buffer) {
+        buffer = m_bufferInDefault;
+        size = SERIAL_BUFFER_SIZE;
+    }
+    else if (size < 2 || size > SERIAL_BUFFER_SIZE_MAX ||
+             (size & (size - 1))) {
+        return false;
+    }
+    m_bufferIn.Storage(buffer, size);
+    FlushInput();
+    return true;
+}
+
+bool SerialBase::TransmitBuffer(uint8_t *buffer, uint32_t size) {
+    if (m_portOpen) {
+        return false;
+    }
+    if (!buffer) {
+        buffer = m_bufferOutDefault;
+        size = SERIAL_BUFFER_SIZE;
+    }
+    else if (size < 2 || size > SERIAL_BUFFER_SIZE_MAX ||
+             (size & (size - 1))) {
+        return false;
+    }
+    m_bufferOut.Storage(buffer, size);
+    Flush();
+    return true;
+}
+
+uint32_t SerialBase::RxIdleCycles() {
+    if (!m_uartDmaActive) {
+        return DWT->CYCCNT - m_rxCycle;
+    }
+    __disable_irq();
+    uint32_t now = DWT->CYCCNT;
+    DmaRxTimestamp(now);
+    __enable_irq();
+    return now - m_rxCycle;
+}
+
+void SerialBase::RxFrameGap(uint32_t gapCycles, ReceiveCallback callback) {
+    __disable_irq();
+    m_rxFrameGap = gapCycles;
+    m_rxFrameCallback = callback;
+    m_rxFrameActive = false;
+    m_rxFrameReady = false;
+    __enable_irq();
+}
+
+bool SerialBase::RxFrameGet(RxFrameInfo &frame) {
+    __disable_irq();
+    bool ready = m_rxFrameReady;
+    if (ready) {
+        frame = m_rxFrameDone;
+        m_rxFrameReady = false;
+    }
+    __enable_irq();
+    return ready;
+}
+
+void SerialBase::RxFrameRefresh() {
+    if (!m_rxFrameGap || !m_portOpen || m_portMode != UART) {
+        return;
+    }
+    __disable_irq();
+    uint32_t now = DWT->CYCCNT;
+    if (m_uartDmaActive) {
+        DmaRxTimestamp(now);
+    }
+    bool ended = m_rxFrameActive && now - m_rxCycle >= m_rxFrameGap;
+    if (ended) {
+        m_rxFrameDone.StartCycle = m_rxFrameStart;
+        m_rxFrameDone.EndCycle = m_rxCycle;
+        m_rxFrameDone.Length = m_rxFrameLength;
+        m_rxFrameActive = false;
+        m_rxFrameReady = true;
+    }
+    __enable_irq();
+    if (ended && m_rxFrameCallback) {
+        m_rxFrameCallback();
     }
 }
 
 bool SerialBase::RtsMode(CtrlLineModes mode) {
     m_rtsMode = mode;
+    // The transmit enable keeps the pin
+    if (m_rs485 && m_portMode == UART) {
+        return true;
+    }
     return RtsSsPinState(mode);
 }
 
@@ -236,6 +468,7 @@ bool SerialBase::PortMode(PortModes newMode) {
     if (newMode != SPI && newMode != UART) {
         return false;
     }
+    SpiSlaveStop();
     m_portMode = newMode;
     // If port is not open just return
     if (!m_portOpen) {
@@ -247,6 +480,8 @@ bool SerialBase::PortMode(PortModes newMode) {
     usart->CTRLA.bit.SWRST = 1;
     SYNCBUSY_WAIT(usart, SERCOM_USART_SYNCBUSY_SWRST);
 
+    m_spiData32Active = false;
+    UartDmaStop();
     Flush();
     FlushInput();
 
@@ -278,8 +513,10 @@ bool SerialBase::PortMode(PortModes newMode) {
         IdNvic = SERCOM3_0_IRQn;
     }
     else if (m_serPort == SERCOM4) {
-        m_dmaRxChannel = DMA_INVALID_CHANNEL;
-        m_dmaTxChannel = DMA_INVALID_CHANNEL;
+        m_dmaRxChannel = DMA_SERCOM4_SPI_RX;
+        m_dmaTxChannel = DMA_SERCOM4_SPI_TX;
+        dmaRxTrigger = SERCOM4_DMAC_ID_RX;
+        dmaTxTrigger = SERCOM4_DMAC_ID_TX;
         clockId = SERCOM4_GCLK_ID_CORE;
         IdNvic = SERCOM4_0_IRQn;
     }
@@ -316,6 +553,8 @@ bool SerialBase::PortMode(PortModes newMode) {
         case SPI:
             /* Data Register Empty Interrupt */
             NVIC_DisableIRQ((IRQn_Type)(IdNvic + SERCOM_USART_INTFLAG_DRE_Pos));
+            /* Transmit Complete Interrupt */
+            NVIC_DisableIRQ((IRQn_Type)(IdNvic + SERCOM_USART_INTFLAG_TXC_Pos));
             /* Receive Complete Interrupt */
             NVIC_DisableIRQ((IRQn_Type)(IdNvic + SERCOM_USART_INTFLAG_RXC_Pos));
             /* Receive Start Interrupt and errors */
@@ -347,6 +586,14 @@ bool SerialBase::PortMode(PortModes newMode) {
             m_serPort->SPI.CTRLB.bit.MSSEN = 1;
             // Receiver enable
             m_serPort->SPI.CTRLB.bit.RXEN = 1;
+            // 32-bit DATA accesses, one byte each until a bulk transfer
+            // asks for more
+            if (m_spiData32 && m_charSize == 8) {
+                m_serPort->SPI.CTRLC.reg = SERCOM_SPI_CTRLC_DATA32B;
+                m_spiLength = UINT8_MAX;
+                SpiLength(1);
+                m_spiData32Active = true;
+            }
 
             // Configure the Slave Select pin
             PMUX_SELECTION(m_rtsSsInfo->gpioPort, m_rtsSsInfo->gpioPin,
@@ -356,21 +603,9 @@ bool SerialBase::PortMode(PortModes newMode) {
             // Setup the DMA descriptors to perform asynchronous SPI transfers
             if (m_dmaRxChannel != DMA_INVALID_CHANNEL &&
                     m_dmaTxChannel != DMA_INVALID_CHANNEL) {
-                DmacChannel *channel;
                 DmacDescriptor *baseDesc;
                 // Rx channel setup
-                channel = DmaManager::Channel(m_dmaRxChannel);
-                // Disable and reset the channel so it is clean to setup
-                channel->CHCTRLA.reg &= ~DMAC_CHCTRLA_ENABLE;
-                channel->CHCTRLA.reg = DMAC_CHCTRLA_SWRST;
-                // Wait for the reset to finish
-                while (channel->CHCTRLA.reg == DMAC_CHCTRLA_SWRST) {
-                    continue;
-                }
-
-                channel->CHCTRLA.reg = DMAC_CHCTRLA_TRIGSRC(dmaRxTrigger) |
-                                       DMAC_CHCTRLA_TRIGACT_BURST |
-                                       DMAC_CHCTRLA_BURSTLEN_SINGLE;
+                DmaChannelReset(m_dmaRxChannel, dmaRxTrigger);
 
                 // Set up the Rx source descriptor since that will not change
                 baseDesc = DmaManager::BaseDescriptor(m_dmaRxChannel);
@@ -378,18 +613,7 @@ bool SerialBase::PortMode(PortModes newMode) {
                 baseDesc->SRCADDR.reg = (uint32_t)&m_serPort->SPI.DATA.reg;
 
                 // Tx channel setup
-                channel = DmaManager::Channel(m_dmaTxChannel);
-                // Disable and reset the channel so it is clean to setup
-                channel->CHCTRLA.reg &= ~DMAC_CHCTRLA_ENABLE;
-                channel->CHCTRLA.reg = DMAC_CHCTRLA_SWRST;
-                // Wait for the reset to finish
-                while (channel->CHCTRLA.reg == DMAC_CHCTRLA_SWRST) {
-                    continue;
-                }
-
-                channel->CHCTRLA.reg = DMAC_CHCTRLA_TRIGSRC(dmaTxTrigger) |
-                                       DMAC_CHCTRLA_TRIGACT_BURST |
-                                       DMAC_CHCTRLA_BURSTLEN_SINGLE;
+                DmaChannelReset(m_dmaTxChannel, dmaTxTrigger);
 
                 // Set up the Tx dest descriptor since that will not change
                 baseDesc = DmaManager::BaseDescriptor(m_dmaTxChannel);
@@ -440,9 +664,41 @@ bool SerialBase::PortMode(PortModes newMode) {
             // 0x0 Disables start of frame detection
             usart->CTRLB.bit.SFDE = 0;
 
-            // Enable Error (ERROR) and Receive complete (RXC) interrupts
-            usart->INTENSET.reg =
-                SERCOM_USART_INTENSET_RXC |  SERCOM_USART_INTENSET_ERROR;
+            if (m_uartDma && m_dmaRxChannel != DMA_INVALID_CHANNEL &&
+                    m_dmaTxChannel != DMA_INVALID_CHANNEL) {
+                DmacDescriptor *baseDesc;
+                // The Rx descriptor links to itself so the DMA fills the
+                // receive buffer circularly without any interrupts
+                DmaChannelReset(m_dmaRxChannel, dmaRxTrigger);
+                baseDesc = DmaManager::BaseDescriptor(m_dmaRxChannel);
+                baseDesc->DESCADDR.reg = reinterpret_cast<uint32_t>(baseDesc);
+                baseDesc->SRCADDR.reg = (uint32_t)&usart->DATA.reg;
+                baseDesc->DSTADDR.reg = (uint32_t)(m_bufferIn.Data() +
+                                                   m_bufferIn.Size());
+                baseDesc->BTCNT.reg = m_bufferIn.Size();
+                baseDesc->BTCTRL.reg = DMAC_BTCTRL_BEATSIZE_BYTE |
+                                       DMAC_BTCTRL_DSTINC | DMAC_BTCTRL_VALID;
+                // Nothing has been received until the channel first runs
+                DmaManager::WriteBackDescriptor(m_dmaRxChannel)->BTCNT.reg = 0;
+                m_rxCycleTail = 0;
+                DmaManager::Channel(m_dmaRxChannel)->CHCTRLA.reg |=
+                    DMAC_CHCTRLA_ENABLE;
+
+                // The Tx descriptor is filled in for each block sent
+                DmaChannelReset(m_dmaTxChannel, dmaTxTrigger);
+                baseDesc = DmaManager::BaseDescriptor(m_dmaTxChannel);
+                baseDesc->DESCADDR.reg = static_cast<uint32_t>(0);
+                baseDesc->DSTADDR.reg = (uint32_t)&usart->DATA.reg;
+
+                m_uartDmaActive = true;
+                // The DMA reads the received characters; only report errors
+                usart->INTENSET.reg = SERCOM_USART_INTENSET_ERROR;
+            }
+            else {
+                // Enable Error (ERROR) and Receive complete (RXC) interrupts
+                usart->INTENSET.reg =
+                    SERCOM_USART_INTENSET_RXC |  SERCOM_USART_INTENSET_ERROR;
+            }
 
             // Sync CTRLB
             SYNCBUSY_WAIT(usart, SERCOM_USART_SYNCBUSY_CTRLB);
@@ -455,6 +711,11 @@ bool SerialBase::PortMode(PortModes newMode) {
             NVIC_SetPriority((IRQn_Type)(IdNvic + SERCOM_USART_INTFLAG_DRE_Pos),
                              SERCOM_NVIC_TX_PRIORITY);
 
+            /* Transmit Complete Interrupt, for DMA blocks and completion */
+            NVIC_EnableIRQ((IRQn_Type)(IdNvic + SERCOM_USART_INTFLAG_TXC_Pos));
+            NVIC_SetPriority((IRQn_Type)(IdNvic + SERCOM_USART_INTFLAG_TXC_Pos),
+                             SERCOM_NVIC_TX_PRIORITY);
+
             /* Receive Complete Interrupt */
             NVIC_EnableIRQ((IRQn_Type)(IdNvic + SERCOM_USART_INTFLAG_RXC_Pos));
             NVIC_SetPriority((IRQn_Type)(IdNvic + SERCOM_USART_INTFLAG_RXC_Pos),
@@ -467,7 +728,7 @@ bool SerialBase::PortMode(PortModes newMode) {
 
             PMUX_SELECTION(m_rtsSsInfo->gpioPort, m_rtsSsInfo->gpioPin,
                            m_peripheral);
-            RtsMode(m_rtsMode);
+            RtsSsPinState(m_rs485 ? LINE_HW : m_rtsMode);
 
             // Setting Generic Clock Generator 0 as the default source
             SET_CLOCK_SOURCE(clockId, __SERCOM_USART_CLOCK_INDEX);
@@ -588,6 +849,10 @@ bool SerialBase::CharSize(uint8_t size) {
         // Note: SPI only supports 8 or 9 bit characters
         return false;
     }
+    else if (m_spiData32 && size != 8) {
+        // 32-bit SPI DATA accesses carry 8 bit characters
+        return false;
+    }
     m_charSize = size;
     bool sercomEnabled = m_serPort->USART.CTRLA.bit.ENABLE;
     PortDisable();
@@ -652,20 +917,33 @@ void SerialBase::DataOrder(DataOrders newOrder) {
     Flush transmit buffers.
 **/
 void SerialBase::Flush() {
+    if (m_uartDmaActive) {
+        // Abandon the block in flight
+        DmaManager::Channel(m_dmaTxChannel)->CHCTRLA.reg &=
+            ~DMAC_CHCTRLA_ENABLE;
+        m_dmaTxCount = 0;
+    }
     // Flush buffers
-    m_bufferOut[0] = 0;
-    m_outTail = 0;
-    m_outHead = 0;
+    m_bufferOut.Clear();
+    m_txDone = true;
 }
 
 /**
     Flush receive buffers.
 **/
 void SerialBase::FlushInput() {
+    m_breakDetected = false;
+    // A frame in progress starts over with the next character
+    m_rxFrameActive = false;
+    if (m_uartDmaActive) {
+        // Skip everything the DMA has received
+        m_rxCycleTail = DmaRxTail();
+        m_bufferIn.WriteSync(m_rxCycleTail);
+        m_bufferIn.ReadCommit(m_bufferIn.Count());
+        return;
+    }
     // Flush buffers
-    m_bufferIn[0] = 0;
-    m_inTail = 0;
-    m_inHead = 0;
+    m_bufferIn.Clear();
     EnableRxcInterruptUart();
 }
 
@@ -730,18 +1008,23 @@ void SerialBase::SpiClock(
     Attempt to get next character from serial channel.
 **/
 int16_t SerialBase::CharGet() {
+    if (m_breakDetected) {
+        m_breakDetected = false;
+        return SerialBase::BREAK_DETECTED;
+    }
+
+    if (m_uartDmaActive) {
+        m_bufferIn.WriteSync(DmaRxTail());
+    }
+
     // Return if nothing is waiting.
-    if (m_inTail == m_inHead) {
+    uint8_t returnChar;
+    if (!m_bufferIn.Pop(returnChar)) {
         return SerialBase::EOB;
     }
-
-    // Get head of buffer, wrapped.
-    int32_t nextIndex = NextIndex(m_inHead);
-    // Get head character.
-    int16_t returnChar = m_bufferIn[m_inHead];
-    // Save new head ptr.
-    m_inHead = nextIndex;
-    EnableRxcInterruptUart();
+    if (!m_uartDmaActive) {
+        EnableRxcInterruptUart();
+    }
 
     return returnChar;
 }
@@ -751,14 +1034,20 @@ int16_t SerialBase::CharGet() {
     out of the buffer.
 **/
 int16_t SerialBase::CharPeek() {
+    if (m_breakDetected) {
+        return SerialBase::BREAK_DETECTED;
+    }
+
+    if (m_uartDmaActive) {
+        m_bufferIn.WriteSync(DmaRxTail());
+    }
+
     // Return if nothing is waiting
-    if (m_inTail == m_inHead) {
+    uint8_t peekChar;
+    if (!m_bufferIn.Peek(peekChar)) {
         return SerialBase::EOB;
     }
-
-    // Get head character
-    int16_t peekChar = m_bufferIn[m_inHead];
-    return (peekChar);
+    return peekChar;
 }
 
 /**
@@ -769,32 +1058,97 @@ bool SerialBase::SendChar(uint8_t charToSend) {
     if (!m_portOpen || m_portMode == PortModes::SPI) {
         return false;
     }
-    // Calculate next location with wrap
-    uint32_t nextIndex = NextIndex(m_outTail);
 
-    // If the buffer is full, elevate the priority of the interrupt to drain
-    // the buffer and wait for some space to open up
-    while (nextIndex == m_outHead) {
+    // If the buffer is full, wait for the interrupt or the DMA block in
+    // flight to make room, unless the caller would rather not wait
+    while (m_bufferOut.Full()) {
         if (!m_portOpen) {
             return false;
         }
+        if (!m_txBlocking) {
+            TxSpaceArm();
+            return false;
+        }
+        SysTiming::LoopBlockMarker marker(SysTiming::LOOP_BLOCK_SERIAL_TX);
+        while (m_bufferOut.Full() && m_portOpen) {
+            continue;
+        }
     }
 
-    // Queue this character on tail
-    m_bufferOut[m_outTail] = charToSend;
-    m_outTail = nextIndex;
-
-    EnableDreInterruptUart();
+    // Queue this character in place; TxQueued() publishes it
+    RingBuffer<uint8_t>::Span first, second;
+    m_bufferOut.WriteSpans(first, second);
+    first.Data[0] = charToSend;
+    TxQueued(1);
     return true;
 }
 
+/**
+    Copy waiting characters out of the receive buffer
+**/
+int32_t SerialBase::ReadBlock(uint8_t *buffer, size_t length) {
+    m_breakDetected = false;
+
+    if (m_uartDmaActive) {
+        m_bufferIn.WriteSync(DmaRxTail());
+    }
+    uint32_t count = m_bufferIn.Read(buffer, length);
+
+    if (!m_uartDmaActive) {
+        EnableRxcInterruptUart();
+    }
+    return count;
+}
+
+/**
+    Copy characters into the transmit buffer
+**/
+int32_t SerialBase::WriteBlock(const uint8_t *buffer, size_t length) {
+    // Guard against sending to a closed port or an incorrect mode.
+    if (!m_portOpen || m_portMode == PortModes::SPI) {
+        return -1;
+    }
+
+    RingBuffer<uint8_t>::Span first, second;
+    uint32_t count = m_bufferOut.WriteSpans(first, second);
+    if (count > length) {
+        count = length;
+    }
+    if (!count) {
+        TxSpaceArm();
+        return 0;
+    }
+    // Copy up to the end of the ring, then the rest from its start
+    uint32_t countTilWrap = min(count, first.Length);
+    memcpy(first.Data, buffer, countTilWrap);
+    memcpy(second.Data, buffer + countTilWrap, count - countTilWrap);
+    TxQueued(count);
+    return count;
+}
+
+/**
+    Set a function to call once the transmit buffer has room again
+**/
+void SerialBase::TransmitSpaceCallback(TransmitCallback callback,
+                                       uint32_t space) {
+    __disable_irq();
+    m_txSpaceCallback = callback;
+    m_txSpace = space ? space : 1;
+    m_txSpaceArmed = false;
+    __enable_irq();
+}
+
 /**
     SPI's TX and RX function
 **/
 uint8_t SerialBase::SpiTransferData(uint8_t data) {
-    if (!m_portOpen || m_portMode != PortModes::SPI) {
+    if (!m_portOpen || m_portMode != PortModes::SPI ||
+            m_spiSlave) {
         return 0;
     }
+    if (m_spiData32Active) {
+        SpiLength(1);
+    }
     // Write data into Data register
     m_serPort->SPI.DATA.bit.DATA = data;
 
@@ -815,14 +1169,17 @@ uint8_t SerialBase::SpiTransferData(uint8_t data) {
 **/
 int32_t SerialBase::SpiTransferData(
     uint8_t const *writeBuf, uint8_t *readBuf, int32_t len) {
-    if (!m_portOpen || m_portMode != SPI) {
+    if (!m_portOpen || m_portMode != SPI || m_spiSlave) {
         return 0;
     }
+    if (m_spiData32Active) {
+        return SpiTransferData32(writeBuf, readBuf, len);
+    }
 
     int32_t iChar;
     for (iChar = 0; iChar < len; iChar++) {
         // Write data into Data register
-        m_serPort->SPI.DATA.bit.DATA = writeBuf ? *writeBuf++ : 0;
+        m_serPort->SPI.DATA.bit.DATA = writeBuf ? *writeBuf++ : m_spiFill;
 
         while (!m_serPort->SPI.INTFLAG.bit.RXC ||
                 !m_serPort->SPI.INTFLAG.bit.TXC) {
@@ -846,12 +1203,63 @@ int32_t SerialBase::SpiTransferData(
     return iChar;
 }
 
+int32_t SerialBase::SpiTransferData32(
+    uint8_t const *writeBuf, uint8_t *readBuf, int32_t len) {
+    int32_t iChar = 0;
+    while (iChar < len) {
+        // Whole words, then the 1 to 3 bytes left in one last access
+        int32_t count = len - iChar;
+        if (count >= 4) {
+            count = 4;
+            SpiLength(0);
+        }
+        else {
+            SpiLength(count);
+        }
+
+        // The byte at the lowest address is sent first
+        uint32_t word = m_spiFillWord;
+        if (writeBuf) {
+            memcpy(&word, writeBuf + iChar, count);
+        }
+        m_serPort->SPI.DATA.reg = word;
+
+        while (!m_serPort->SPI.INTFLAG.bit.RXC ||
+                !m_serPort->SPI.INTFLAG.bit.TXC) {
+            // If the port is not open, bail out
+            if (!m_portOpen) {
+                return iChar;
+            }
+            // Wait for it to complete
+            continue;
+        }
+
+        word = m_serPort->SPI.DATA.reg;
+        if (readBuf) {
+            memcpy(readBuf + iChar, &word, count);
+        }
+        iChar += count;
+    }
+
+    return iChar;
+}
+
+void SerialBase::SpiLength(uint8_t bytes) {
+    if (bytes == m_spiLength) {
+        return;
+    }
+    m_serPort->SPI.LENGTH.reg =
+        bytes ? SERCOM_SPI_LENGTH_LENEN | SERCOM_SPI_LENGTH_LEN(bytes) : 0;
+    SYNCBUSY_WAIT(&m_serPort->SPI, SERCOM_SPI_SYNCBUSY_LENGTH);
+    m_spiLength = bytes;
+}
+
 /**
     SPI's asynchronous multi-byte TX and RX function
 **/
 bool SerialBase::SpiTransferDataAsync(
     uint8_t const *writeBuf, uint8_t *readBuf, int32_t len) {
-    if (!m_portOpen || m_portMode != SPI) {
+    if (!m_portOpen || m_portMode != SPI || m_spiSlave) {
         return false;
     }
     // Setup the DMA descriptors to perform asynchronous transfers
@@ -859,20 +1267,48 @@ bool SerialBase::SpiTransferDataAsync(
             m_dmaTxChannel == DMA_INVALID_CHANNEL) {
         return false;
     }
+    // The DMA channels belong to the transaction queue while it runs
+    if (m_spiQueueHead) {
+        return false;
+    }
+
+    SpiDmaStart(writeBuf, readBuf, len);
+    return true;
+}
+
+void SerialBase::SpiDmaStart(uint8_t const *writeBuf, uint8_t *readBuf,
+                             int32_t len) {
     DmacDescriptor *baseDesc;
+    uint16_t beatSize = DMAC_BTCTRL_BEATSIZE_BYTE;
+    uint32_t const *fill = &m_spiFill;
+    uint32_t beats = len;
+
+    if (m_spiData32Active) {
+        // One 4 byte beat per DATA access when the whole transfer is words
+        if (!(len & 0x3) && !(reinterpret_cast<uint32_t>(writeBuf) & 0x3) &&
+                !(reinterpret_cast<uint32_t>(readBuf) & 0x3)) {
+            beatSize = DMAC_BTCTRL_BEATSIZE_WORD;
+            fill = &m_spiFillWord;
+            beats = len / 4;
+            SpiLength(0);
+        }
+        else {
+            SpiLength(1);
+        }
+    }
 
     // Set up the Rx dest descriptor
     baseDesc = DmaManager::BaseDescriptor(m_dmaRxChannel);
     if (readBuf) {
         baseDesc->DSTADDR.reg = (uint32_t)(readBuf + len);
         baseDesc->BTCTRL.reg =
-            DMAC_BTCTRL_BEATSIZE_BYTE | DMAC_BTCTRL_DSTINC | DMAC_BTCTRL_VALID;
+            beatSize | DMAC_BTCTRL_DSTINC | DMAC_BTCTRL_VALID;
     }
     else {
         baseDesc->DSTADDR.reg = (uint32_t)&spiDummy;
-        baseDesc->BTCTRL.reg = DMAC_BTCTRL_BEATSIZE_BYTE | DMAC_BTCTRL_VALID;
+        baseDesc->BTCTRL.reg = beatSize | DMAC_BTCTRL_VALID;
     }
-    baseDesc->BTCNT.reg = len;
+    baseDesc->BTCNT.reg = beats;
     DmaManager::Channel(m_dmaRxChannel)->CHCTRLA.reg |= DMAC_CHCTRLA_ENABLE;
 
     // Set up the Tx source descriptor
@@ -880,31 +1316,346 @@ bool SerialBase::SpiTransferDataAsync(
     if (writeBuf) {
         baseDesc->SRCADDR.reg = (uint32_t)(writeBuf + len);
         baseDesc->BTCTRL.reg =
-            DMAC_BTCTRL_BEATSIZE_BYTE | DMAC_BTCTRL_SRCINC | DMAC_BTCTRL_VALID;
+            beatSize | DMAC_BTCTRL_SRCINC | DMAC_BTCTRL_VALID;
     }
     else {
-        baseDesc->SRCADDR.reg = (uint32_t)&spiDummy;
-        baseDesc->BTCTRL.reg = DMAC_BTCTRL_BEATSIZE_BYTE | DMAC_BTCTRL_VALID;
+        baseDesc->SRCADDR.reg = (uint32_t)fill;
+        baseDesc->BTCTRL.reg = beatSize | DMAC_BTCTRL_VALID;
     }
-    baseDesc->BTCNT.reg = len;
+    baseDesc->BTCNT.reg = beats;
     DmaManager::Channel(m_dmaTxChannel)->CHCTRLA.reg |= DMAC_CHCTRLA_ENABLE;
+}
+
+bool SerialBase::SpiTransactionQueue(SpiTransaction &transaction) {
+    if (!m_portOpen || m_portMode != SPI || m_spiSlave || !transaction.Length ||
+            m_dmaRxChannel == DMA_INVALID_CHANNEL ||
+            m_dmaTxChannel == DMA_INVALID_CHANNEL) {
+        return false;
+    }
 
+    if (!m_spiQueueHead) {
+        // Let any SpiTransferDataAsync() transfer finish
+        while (DmaManager::Channel(m_dmaRxChannel)->CHCTRLA.bit.ENABLE) {
+            continue;
+        }
+    }
+
+    __disable_irq();
+    // Refuse a transaction that is still waiting in the queue
+    for (SpiTransaction *queued = m_spiQueueHead; queued;
+            queued = queued->Next) {
+        if (queued == &transaction) {
+            __enable_irq();
+            return false;
+        }
+    }
+    transaction.Done = false;
+    transaction.Next = nullptr;
+    if (m_spiQueueHead) {
+        m_spiQueueTail->Next = &transaction;
+        m_spiQueueTail = &transaction;
+    }
+    else {
+        m_spiQueueHead = &transaction;
+        m_spiQueueTail = &transaction;
+        DmacChannel *channel = DmaManager::Channel(m_dmaRxChannel);
+        channel->CHINTFLAG.reg = DMAC_CHINTFLAG_TCMPL;
+        channel->CHINTENSET.reg = DMAC_CHINTENSET_TCMPL;
+        NVIC_EnableIRQ(DmaManager::Irq(m_dmaRxChannel));
+        SpiTransactionStart(&transaction);
+    }
+    __enable_irq();
+    return true;
+}
+
+void SerialBase::SpiTransactionStart(SpiTransaction *transaction) {
+    if (transaction->ChipSelect) {
+        transaction->ChipSelect->State(false);
+    }
+    SpiDmaStart(transaction->WriteBuf, transaction->ReadBuf,
+                transaction->Length);
+}
+
+bool SerialBase::SpiPollAdd(SpiPoll &poll) {
+    if (m_dmaRxChannel == DMA_INVALID_CHANNEL ||
+            m_dmaTxChannel == DMA_INVALID_CHANNEL ||
+            !poll.PeriodMs || !poll.Transaction.Length) {
+        return false;
+    }
+    __disable_irq();
+    for (SpiPoll *added = m_spiPolls; added; added = added->Next) {
+        if (added == &poll) {
+            __enable_irq();
+            return false;
+        }
+    }
+    poll.Transaction.Callback = SpiPollDone;
+    poll.Transaction.Done = true;
+    poll.Count = 0;
+    poll.Overruns = 0;
+    poll.MsLeft = 1;
+    poll.Next = m_spiPolls;
+    m_spiPolls = &poll;
+    __enable_irq();
+    return true;
+}
+
+void SerialBase::SpiPollRemove(SpiPoll &poll) {
+    __disable_irq();
+    for (SpiPoll **link = &m_spiPolls; *link; link = &(*link)->Next) {
+        if (*link == &poll) {
+            *link = poll.Next;
+            break;
+        }
+    }
+    __enable_irq();
+    while (!poll.Transaction.Done) {
+        continue;
+    }
+}
+
+bool SerialBase::SpiPollRead(SpiPoll &poll, uint8_t *dst) {
+    uint32_t count;
+    do {
+        // A transfer in progress is writing the buffer; copy again if one
+        // ran during the copy
+        while (!poll.Transaction.Done) {
+            continue;
+        }
+        count = poll.Count;
+        if (!count) {
+            return false;
+        }
+        memcpy(dst, poll.Transaction.ReadBuf, poll.Transaction.Length);
+    } while (!poll.Transaction.Done || count != poll.Count);
     return true;
 }
 
+void SerialBase::SpiPollDone(SpiTransaction *transaction) {
+    // The transaction is the first member of its poll
+    SpiPoll *poll = reinterpret_cast<SpiPoll *>(transaction);
+    poll->Count++;
+    if (poll->Callback) {
+        poll->Callback(poll);
+    }
+}
+
+void SerialBase::SpiPollRefresh() {
+    if (!m_spiPolls || !m_portOpen || m_portMode != SPI || m_spiSlave) {
+        return;
+    }
+    for (SpiPoll *poll = m_spiPolls; poll; poll = poll->Next) {
+        if (--poll->MsLeft) {
+            continue;
+        }
+        poll->MsLeft = poll->PeriodMs;
+        if (!poll->Transaction.Done) {
+            poll->Overruns++;
+            continue;
+        }
+        SpiTransactionQueue(poll->Transaction);
+    }
+}
+
+bool SerialBase::SpiSlaveStart(DigitalIn &ss, uint8_t *rxBuffer,
+                               uint8_t *txBuffer, uint16_t frameLength,
+                               void (*callback)()) {
+    SpiSlaveStop();
+    uint8_t slot;
+    if (m_serPort == SERCOM7) {
+        slot = 0;
+    }
+    else if (m_serPort == SERCOM0) {
+        slot = 1;
+    }
+    else {
+        return false;
+    }
+    if (!m_portOpen || !rxBuffer || !txBuffer || !frameLength ||
+            ss.ExternalInterrupt() < 0) {
+        return false;
+    }
+    // Let any queued master transfers finish
+    while (m_spiQueueHead) {
+        continue;
+    }
+
+    // Set up the pins and the DMA channels as for a master, then reset the
+    // SERCOM as a slave
+    if (!PortMode(SPI)) {
+        return false;
+    }
+    m_spiSlaveSs = &ss;
+    m_spiSlaveRx = rxBuffer;
+    m_spiSlaveTx = txBuffer;
+    m_spiSlaveLength = frameLength;
+    m_spiSlaveCallback = callback;
+    m_spiSlaveSelected = false;
+    m_spiSlaveRxIndex = 0;
+    m_spiSlaveTxIndex = 0;
+    m_spiSlaveTxPending = false;
+    m_spiSlaveFrames = 0;
+    m_spiSlaveShortFrames = 0;
+    memset(txBuffer, 0, 2 * frameLength);
+
+    // The SS pad is driven by its pull: up while deselected, down while the
+    // master selects this port
+    DATA_DIRECTION_INPUT(m_rtsSsInfo->gpioPort, 1L << m_rtsSsInfo->gpioPin);
+    DATA_OUTPUT_STATE(m_rtsSsInfo->gpioPort, 1L << m_rtsSsInfo->gpioPin,
+                      true);
+    PIN_CONFIGURATION(m_rtsSsInfo->gpioPort, m_rtsSsInfo->gpioPin,
+                      PORT_PINCFG_PMUXEN | PORT_PINCFG_INEN |
+                      PORT_PINCFG_PULLEN);
+
+    SpiSlaveConfig();
+    PMUX_ENABLE(m_txMosiInfo->gpioPort, m_txMosiInfo->gpioPin);
+    SpiSlaveArm();
+
+    spiSlavePorts[slot] = this;
+    m_spiSlave = true;
+    if (!ss.InterruptHandlerSet(slot ? SpiSlaveSsIsr1 : SpiSlaveSsIsr0,
+                                InputManager::CHANGE, true)) {
+        SpiSlaveStop();
+        return false;
+    }
+    return true;
+}
+
+void SerialBase::SpiSlaveStop() {
+    if (!m_spiSlave) {
+        return;
+    }
+    m_spiSlave = false;
+    m_spiSlaveSs->InterruptHandlerSet(nullptr, InputManager::CHANGE, false);
+    DmaManager::Channel(m_dmaRxChannel)->CHCTRLA.reg &= ~DMAC_CHCTRLA_ENABLE;
+    DmaManager::Channel(m_dmaTxChannel)->CHCTRLA.reg &= ~DMAC_CHCTRLA_ENABLE;
+    PIN_CONFIGURATION(m_rtsSsInfo->gpioPort, m_rtsSsInfo->gpioPin,
+                      PORT_PINCFG_PMUXEN);
+    // Back to the master setup
+    PortMode(SPI);
+}
+
+bool SerialBase::SpiSlaveRead(uint8_t *dst) {
+    if (!m_spiSlave || !m_spiSlaveFrames) {
+        return false;
+    }
+    uint32_t frames;
+    do {
+        // The last frame is in the half the DMA is not filling; a frame
+        // ending during the copy can overwrite it, so copy again
+        frames = m_spiSlaveFrames;
+        memcpy(dst, m_spiSlaveRx + (m_spiSlaveRxIndex ^ 1) * m_spiSlaveLength,
+               m_spiSlaveLength);
+    } while (frames != m_spiSlaveFrames);
+    return true;
+}
+
+bool SerialBase::SpiSlaveWrite(const uint8_t *src) {
+    if (!m_spiSlave) {
+        return false;
+    }
+    // Keep the frame end from swapping to the half while it is written
+    m_spiSlaveTxPending = false;
+    memcpy(m_spiSlaveTx + (m_spiSlaveTxIndex ^ 1) * m_spiSlaveLength, src,
+           m_spiSlaveLength);
+    atomic_store_n(&m_spiSlaveTxPending, true);
+    return true;
+}
+
+void SerialBase::SpiSlaveConfig() {
+    SercomSpi *spi = &m_serPort->SPI;
+    spi->CTRLA.bit.SWRST = 1;
+    SYNCBUSY_WAIT(spi, SERCOM_SPI_SYNCBUSY_SWRST);
+    // The reset leaves the DATA register 8 bits wide
+    m_spiData32Active = false;
+
+    // Slave mode with the master pinout, MSB first, and an overflow flagged
+    // right away
+    spi->CTRLA.reg = SERCOM_SPI_CTRLA_MODE(0x2) |
+                     SERCOM_SPI_CTRLA_DIPO(m_ctsMisoInfo->sercomPadNum) |
+                     SERCOM_SPI_CTRLA_DOPO(m_txMosiInfo->sercomPadNum ? 2 : 0) |
+                     (m_polarity ? SERCOM_SPI_CTRLA_CPOL : 0) |
+                     (m_phase ? SERCOM_SPI_CTRLA_CPHA : 0) |
+                     SERCOM_SPI_CTRLA_IBON;
+    // 8 bit characters for the byte DMA; preload the first byte on select
+    spi->CTRLB.reg = SERCOM_SPI_CTRLB_CHSIZE(0) | SERCOM_SPI_CTRLB_PLOADEN |
+                     SERCOM_SPI_CTRLB_RXEN;
+    spi->CTRLA.bit.ENABLE = 1;
+    SYNCBUSY_WAIT(spi, SERCOM_SPI_SYNCBUSY_ENABLE);
+}
+
+void SerialBase::SpiSlaveArm() {
+    SpiDmaStart(m_spiSlaveTx + m_spiSlaveTxIndex * m_spiSlaveLength,
+                m_spiSlaveRx + m_spiSlaveRxIndex * m_spiSlaveLength,
+                m_spiSlaveLength);
+}
+
+void SerialBase::IrqHandlerSpiSlaveSs() {
+    if (!m_spiSlave) {
+        return;
+    }
+    // The select is active low; the input reads off while it is low
+    bool selected = !m_spiSlaveSs->StateRT();
+    if (selected == m_spiSlaveSelected) {
+        return;
+    }
+    m_spiSlaveSelected = selected;
+    uint32_t ssMask = 1L << m_rtsSsInfo->gpioPin;
+    if (selected) {
+        DATA_OUTPUT_STATE(m_rtsSsInfo->gpioPort, ssMask, false);
+        return;
+    }
+    DATA_OUTPUT_STATE(m_rtsSsInfo->gpioPort, ssMask, true);
+
+    DmacChannel *rxChannel = DmaManager::Channel(m_dmaRxChannel);
+    DmacChannel *txChannel = DmaManager::Channel(m_dmaTxChannel);
+    if (rxChannel->CHCTRLA.bit.ENABLE) {
+        // The master ended the frame early. Drop it, along with whatever
+        // the SERCOM has preloaded, and resend the same frame.
+        rxChannel->CHCTRLA.reg &= ~DMAC_CHCTRLA_ENABLE;
+        txChannel->CHCTRLA.reg &= ~DMAC_CHCTRLA_ENABLE;
+        while (rxChannel->CHCTRLA.bit.ENABLE ||
+                txChannel->CHCTRLA.bit.ENABLE) {
+            continue;
+        }
+        SpiSlaveConfig();
+        m_spiSlaveShortFrames++;
+        SpiSlaveArm();
+        return;
+    }
+
+    // Publish the received frame and send the next one, if written
+    m_spiSlaveRxIndex ^= 1;
+    if (m_spiSlaveTxPending) {
+        m_spiSlaveTxIndex ^= 1;
+        m_spiSlaveTxPending = false;
+    }
+    m_spiSlaveFrames++;
+    SpiSlaveArm();
+
+    if (m_spiSlaveCallback) {
+        m_spiSlaveCallback();
+    }
+}
+
 bool SerialBase::SpiAsyncWaitComplete() {
+    while (SpiAsyncBusy()) {
+        continue;
+    }
+    return true;
+}
+
+bool SerialBase::SpiAsyncBusy() {
     // If this channel is not set up to do DMA transfers, it is already done
     if (m_dmaRxChannel == DMA_INVALID_CHANNEL ||
             m_dmaTxChannel == DMA_INVALID_CHANNEL) {
-        return true;
+        return false;
     }
     // The transfer is done when all of the Rx data has been read and the
     // channel disables
-    while (m_portOpen && m_portMode == SPI &&
-            DmaManager::Channel(m_dmaRxChannel)->CHCTRLA.bit.ENABLE) {
-        continue;
-    }
-    return true;
+    return m_portOpen && m_portMode == SPI && !m_spiSlave &&
+           (m_spiQueueHead ||
+            DmaManager::Channel(m_dmaRxChannel)->CHCTRLA.bit.ENABLE);
 }
 
 void SerialBase::HandleFrameError() {
@@ -950,7 +1701,7 @@ SerialBase::SerialErrorStatusRegister SerialBase::ErrorStatusAccum(
 void SerialBase::WaitForTransmitIdle() {
     if (m_portMode == UART) {
         // Wait until the out buffer has emptied
-        while (m_outHead != m_outTail) {
+        while (!m_bufferOut.Empty()) {
             continue;
         }
 
@@ -973,27 +1724,154 @@ void SerialBase::WaitForTransmitIdle() {
     Return the number of free characters in the receive buffer
 **/
 int32_t SerialBase::AvailableForRead() {
-    int32_t difference = m_inTail - m_inHead;
-
-    if (difference < 0) {
-        return SERIAL_BUFFER_SIZE + difference;
-    }
-    else {
-        return difference;
+    // A pending break reads as one more character
+    int32_t breakCount = m_breakDetected ? 1 : 0;
+    if (m_uartDmaActive) {
+        m_bufferIn.WriteSync(DmaRxTail());
     }
+
+    return m_bufferIn.Count() + breakCount;
 }
 
 /**
     Returns the number of available characters in the transmit buffer
 **/
 int32_t SerialBase::AvailableForWrite() {
-    int32_t difference = m_outHead - m_outTail - 1;
+    return m_bufferOut.Space();
+}
+
+/**
+    Publish newly queued characters and start sending them
+**/
+void SerialBase::TxQueued(uint32_t count) {
+    // Clear the done flag along with publishing the characters, so the
+    // transmit complete interrupt can't report them sent before they are
+    __disable_irq();
+    m_bufferOut.WriteCommit(count);
+    m_txDone = false;
+    // Start sending unless a block is already in flight; the transmit
+    // complete interrupt sends what is queued behind it
+    if (m_uartDmaActive && !m_dmaTxCount) {
+        DmaTxStart();
+    }
+    __enable_irq();
+
+    if (!m_uartDmaActive) {
+        EnableDreInterruptUart();
+    }
+    TxSpaceArm();
+}
+
+/**
+    Arm the space callback if a write left the buffer short of room
+**/
+void SerialBase::TxSpaceArm() {
+    if (!m_txSpaceCallback) {
+        return;
+    }
+    // Arm before checking, so room that opens up in between still calls
+    // back rather than being missed
+    m_txSpaceArmed = true;
+    uint32_t space = min(m_txSpace, m_bufferOut.Size());
+    if (static_cast<uint32_t>(AvailableForWrite()) >= space) {
+        m_txSpaceArmed = false;
+    }
+}
+
+/**
+    Call the space callback once room has opened up
+**/
+void SerialBase::TxSpaceCheck() {
+    if (!m_txSpaceArmed) {
+        return;
+    }
+    uint32_t space = min(m_txSpace, m_bufferOut.Size());
+    if (static_cast<uint32_t>(AvailableForWrite()) >= space) {
+        m_txSpaceArmed = false;
+        if (m_txSpaceCallback) {
+            m_txSpaceCallback();
+        }
+    }
+}
 
-    if (difference < 0) {
-        difference += SERIAL_BUFFER_SIZE;
+/**
+    Report that everything queued has been sent
+**/
+void SerialBase::TxDone() {
+    if (m_txDone) {
+        return;
+    }
+    m_txDone = true;
+    if (m_txDoneCallback) {
+        m_txDoneCallback();
     }
+}
 
-    return difference;
+/**
+    Stop the UART DMA channels
+**/
+void SerialBase::UartDmaStop() {
+    if (!m_uartDmaActive) {
+        return;
+    }
+    m_serPort->USART.INTENCLR.reg = SERCOM_USART_INTENCLR_TXC;
+    DmaManager::Channel(m_dmaRxChannel)->CHCTRLA.reg &= ~DMAC_CHCTRLA_ENABLE;
+    DmaManager::Channel(m_dmaTxChannel)->CHCTRLA.reg &= ~DMAC_CHCTRLA_ENABLE;
+    m_dmaTxCount = 0;
+    m_uartDmaActive = false;
+}
+
+/**
+    Return the receive buffer index the DMA will write next
+**/
+uint32_t SerialBase::DmaRxTail() {
+    // The write-back descriptor holds the beats left before the DMA wraps
+    // back to the start of the buffer
+    uint32_t remaining =
+        DmaManager::WriteBackDescriptor(m_dmaRxChannel)->BTCNT.reg;
+    return (m_bufferIn.Size() - remaining) & (m_bufferIn.Size() - 1);
+}
+
+void SerialBase::DmaRxTimestamp(uint32_t now) {
+    uint32_t tail = DmaRxTail();
+    if (tail == m_rxCycleTail) {
+        return;
+    }
+    if (!m_rxFrameActive) {
+        m_rxFrameActive = true;
+        m_rxFrameStart = now;
+        m_rxFrameLength = 0;
+    }
+    m_rxFrameLength += (tail - m_rxCycleTail) & (m_bufferIn.Size() - 1);
+    m_rxCycleTail = tail;
+    m_rxCycle = now;
+}
+
+/**
+    Send the staged characters up to the tail or the end of the buffer
+**/
+void SerialBase::DmaTxStart() {
+    // Send the characters up to the end of the buffer; the rest follow in
+    // the next block
+    RingBuffer<uint8_t>::Span first, second;
+    m_bufferOut.ReadSpans(first, second);
+    uint16_t count = first.Length;
+    if (!count) {
+        return;
+    }
+
+    DmacDescriptor *baseDesc = DmaManager::BaseDescriptor(m_dmaTxChannel);
+    // With SRCINC set, SRCADDR is the end of the block
+    baseDesc->SRCADDR.reg = (uint32_t)(first.Data + count);
+    baseDesc->BTCNT.reg = count;
+    baseDesc->BTCTRL.reg =
+        DMAC_BTCTRL_BEATSIZE_BYTE | DMAC_BTCTRL_SRCINC | DMAC_BTCTRL_VALID;
+    m_dmaTxCount = count;
+
+    // TXC sets once the last character of the block has been shifted out
+    m_serPort->USART.INTFLAG.reg = SERCOM_USART_INTFLAG_TXC;
+    m_serPort->USART.INTENSET.reg = SERCOM_USART_INTENSET_TXC;
+    DmaManager::Channel(m_dmaTxChannel)->CHCTRLA.reg |= DMAC_CHCTRLA_ENABLE;
 }
 
 // =========================== INTERRUPT API ===============================
@@ -1004,23 +1882,28 @@ int32_t SerialBase::AvailableForWrite() {
 void SerialBase::RxProc() {
     // Must reinitialize to clear ort problems
     if (m_serPort->USART.RXERRCNT.reg != 0) {
-        // On break detected, flush inBuf and insert flag character
-        m_inTail = 0;
-        m_inHead = 0;
-        m_bufferIn[m_inTail++] = SerialBase::BREAK_DETECTED;
+        // On break detected, flush inBuf and report the break ahead of
+        // any new characters
+        m_bufferIn.Clear();
+        m_breakDetected = true;
 
         // Clear error to allow more interrupts
         m_serPort->USART.INTFLAG.bit.ERROR = 1;
     }
 
-    // Generate wrapped next location
-    uint32_t nextIndex = NextIndex(m_inTail);
-    while (m_serPort->USART.INTFLAG.bit.RXC && nextIndex != m_inHead) {
-        m_bufferIn[m_inTail] = m_serPort->USART.DATA.bit.DATA;
-        m_inTail = nextIndex;
-        nextIndex = NextIndex(m_inTail);
+    while (m_serPort->USART.INTFLAG.bit.RXC && !m_bufferIn.Full()) {
+        m_bufferIn.Push(m_serPort->USART.DATA.bit.DATA);
+        uint32_t now = DWT->CYCCNT;
+        m_rxCycle = now;
+        // The first character after an idle gap starts a frame
+        if (!m_rxFrameActive) {
+            m_rxFrameActive = true;
+            m_rxFrameStart = now;
+            m_rxFrameLength = 0;
+        }
+        m_rxFrameLength++;
     }
-    if (nextIndex == m_inHead) {
+    if (m_bufferIn.Full()) {
         DisableRxcInterruptUart();
     }
 }
@@ -1029,17 +1912,21 @@ void SerialBase::RxProc() {
     Transmit any data waiting in the tx buffer
 **/
 void SerialBase::TxPump() {
-    while (m_outHead != m_outTail) {
+    while (!m_bufferOut.Empty()) {
         if (!m_serPort->USART.INTFLAG.bit.DRE) {
             // Data register is full; can't send anything more right now
+            TxSpaceCheck();
             return;
         }
-        int32_t nextIndex = NextIndex(m_outHead);
-        m_serPort->USART.DATA.bit.DATA = m_bufferOut[m_outHead];
-        m_outHead = nextIndex;
+        uint8_t charToSend;
+        m_bufferOut.Pop(charToSend);
+        m_serPort->USART.DATA.bit.DATA = charToSend;
     }
 
     DisableDreInterruptUart();
+    TxSpaceCheck();
+    // Report completion once the last character has been shifted out
+    m_serPort->USART.INTENSET.reg = SERCOM_USART_INTENSET_TXC;
 }
 
 /**
@@ -1048,6 +1935,7 @@ void SerialBase::TxPump() {
     This should be called by SERCOMx_0 Interrupt Vector.
 **/
 void SerialBase::IrqHandlerTx() {
+    TRACE_EVENT(TRACE_SERIAL_TX_IRQ, reinterpret_cast<uint32_t>(m_serPort));
     switch (m_portMode) {
         case SPI:
             break;
@@ -1059,10 +1947,43 @@ void SerialBase::IrqHandlerTx() {
 }
 
 /**
+    Interrupt handler for the TX complete service, which chains the UART DMA
+    transmit blocks.
+
     Should be called by SERCOMx_1 Interrupt Vector.
 **/
 void SerialBase::IrqHandler1() {
-    // Does nothing
+    if (!m_uartDmaActive) {
+        // Leave the flag set for WaitForTransmitIdle(); writing the next
+        // character clears it
+        m_serPort->USART.INTENCLR.reg = SERCOM_USART_INTENCLR_TXC;
+        if (m_bufferOut.Empty()) {
+            TxDone();
+        }
+        return;
+    }
+
+    m_serPort->USART.INTFLAG.reg = SERCOM_USART_INTFLAG_TXC;
+    if (!m_dmaTxCount ||
+            DmaManager::Channel(m_dmaTxChannel)->CHCTRLA.bit.ENABLE) {
+        // No block has finished
+        if (!m_dmaTxCount) {
+            m_serPort->USART.INTENCLR.reg = SERCOM_USART_INTENCLR_TXC;
+        }
+        return;
+    }
+
+    // Release the finished block and send whatever was queued behind it
+    m_bufferOut.ReadCommit(m_dmaTxCount);
+    m_dmaTxCount = 0;
+    TxSpaceCheck();
+    if (m_bufferOut.Empty()) {
+        m_serPort->USART.INTENCLR.reg = SERCOM_USART_INTENCLR_TXC;
+        TxDone();
+    }
+    else {
+        DmaTxStart();
+    }
 }
 
 /**
@@ -1071,6 +1992,7 @@ void SerialBase::IrqHandler1() {
     This should be called by SERCOMx_2 Interrupt Vector.
 **/
 void SerialBase::IrqHandlerRx() {
+    TRACE_EVENT(TRACE_SERIAL_RX_IRQ, reinterpret_cast<uint32_t>(m_serPort));
     switch (m_portMode) {
         case SPI:
             break;
@@ -1081,6 +2003,43 @@ void SerialBase::IrqHandlerRx() {
     }
 }
 
+/**
+    DMA complete interrupt handler for the SPI receive channel.
+
+    The receive channel finishes once the last byte has been clocked in, so
+    the transfer is over on the bus.
+**/
+void SerialBase::IrqHandlerDma() {
+    DmacChannel *channel = DmaManager::Channel(m_dmaRxChannel);
+    if (!channel->CHINTFLAG.bit.TCMPL) {
+        return;
+    }
+    channel->CHINTFLAG.reg = DMAC_CHINTFLAG_TCMPL;
+
+    SpiTransaction *transaction = m_spiQueueHead;
+    if (!transaction) {
+        channel->CHINTENCLR.reg = DMAC_CHINTENCLR_TCMPL;
+        return;
+    }
+    if (transaction->ChipSelect) {
+        transaction->ChipSelect->State(true);
+    }
+
+    m_spiQueueHead = transaction->Next;
+    if (m_spiQueueHead && m_portOpen && m_portMode == SPI) {
+        SpiTransactionStart(m_spiQueueHead);
+    }
+    else {
+        m_spiQueueHead = nullptr;
+        channel->CHINTENCLR.reg = DMAC_CHINTENCLR_TCMPL;
+    }
+
+    transaction->Done = true;
+    if (transaction->Callback) {
+        transaction->Callback(transaction);
+    }
+}
+
 /**
     Interrupt handler for any serial port exceptions.
 
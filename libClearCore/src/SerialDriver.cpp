@@ -29,16 +29,15 @@
 #include <stdio.h>
 #include "CcioBoardManager.h"
 #include "SerialBase.h"
+#include "SysManager.h"
 #include "SysUtils.h"
 
-#define CCIO_DEFAULT_BAUD_RATE    500000
-
 namespace ClearCore {
 
 // LED feedback and option shift register
 extern ShiftRegister ShiftReg;
+extern SysManager SysMgr;
 // CCIO-8 management
-extern CcioBoardManager &CcioMgr;
 
 SerialDriver::SerialDriver(uint16_t index,
                            ShiftRegister::Masks feedBackLedMask,
@@ -72,7 +71,7 @@ bool SerialDriver::Mode(ConnectorModes newMode) {
     }
 
     if (m_mode == Connector::CCIO) {
-        CcioMgr.LinkClose();
+        CcioBoardManager::ChainByPort(this).LinkClose();
     }
 
     switch (newMode) {
@@ -124,10 +123,12 @@ void SerialDriver::PortOpen() {
         WaitOneCharTime();
         // LED under connector on
         ShiftReg.ShifterStateSet(m_ledMask);
+        // The received frames are ended at the sample rate
+        SysMgr.ConnectorActive(m_clearCorePin, true);
 
         // Initialize the CCIO manager
         if (m_mode == Connector::CCIO) {
-            CcioMgr.CcioDiscover(this);
+            CcioBoardManager::ChainByPort(this).CcioDiscover(this);
         }
     }
 }
@@ -135,11 +136,12 @@ void SerialDriver::PortOpen() {
 void SerialDriver::PortClose() {
     if (SerialBase::PortIsOpen()) {
         if (m_mode == Connector::CCIO) {
-            CcioMgr.LinkClose();
+            CcioBoardManager::ChainByPort(this).LinkClose();
         }
         SerialBase::PortClose();
         // LED under connector off
         ShiftReg.ShifterStateClear(m_ledMask);
+        SysMgr.ConnectorActive(m_clearCorePin, false);
     }
 }
 
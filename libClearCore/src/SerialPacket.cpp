@@ -0,0 +1,256 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    Implementation of ClearCore framed binary packets over a serial port
+**/
+
+#include "SerialPacket.h"
+#include "CrcManager.h"
+#include "SecureChannel.h"
+
+namespace ClearCore {
+
+extern CrcManager &CrcMgr;
+
+SerialPacket::SerialPacket(ISerial &port, uint8_t *buffer,
+                           uint16_t bufferSize, CrcTypes crcType)
+    : m_port(port),
+      m_buffer(buffer),
+      m_bufferSize(bufferSize),
+      m_crcType(crcType),
+      m_callback(nullptr),
+      m_rxLength(0),
+      m_blockCode(0),
+      m_blockRemaining(0),
+      m_rxOverflow(false),
+      m_packetLength(0),
+      m_packetErrors(0),
+      m_rxChunk(),
+      m_rxChunkPos(0),
+      m_rxChunkLength(0),
+      m_txBlock(),
+      m_secure(nullptr),
+      m_sealBuffer(nullptr),
+      m_sealBufferSize(0) {}
+
+uint8_t SerialPacket::CrcSize() {
+    switch (m_crcType) {
+        case CRC_16:
+            return 2;
+        case CRC_32:
+            return 4;
+        case CRC_NONE:
+        default:
+            return 0;
+    }
+}
+
+uint32_t SerialPacket::CrcCalculate(const uint8_t *data, uint16_t length) {
+    switch (m_crcType) {
+        case CRC_16:
+            return CrcManager::Crc16(data, length);
+        case CRC_32:
+            return CrcMgr.Crc32(data, length);
+        case CRC_NONE:
+        default:
+            return 0;
+    }
+}
+
+bool SerialPacket::Secure(SecureChannel *channel, uint8_t *sealBuffer,
+                          uint16_t sealBufferSize) {
+    if (channel && (!sealBuffer || sealBufferSize <= SECURE_CHANNEL_OVERHEAD)) {
+        return false;
+    }
+    m_secure = channel;
+    m_sealBuffer = sealBuffer;
+    m_sealBufferSize = sealBufferSize;
+    return true;
+}
+
+bool SerialPacket::Send(const uint8_t *packet, uint16_t length) {
+    if (!m_secure) {
+        return Encode(packet, length);
+    }
+    if (length > m_sealBufferSize - SECURE_CHANNEL_OVERHEAD) {
+        return false;
+    }
+    int32_t sealedLength = m_secure->Seal(packet, length, m_sealBuffer);
+    return sealedLength >= 0 && Encode(m_sealBuffer, sealedLength);
+}
+
+bool SerialPacket::Encode(const uint8_t *packet, uint16_t length) {
+    // The CRC is sent least significant byte first
+    uint8_t crcBytes[4];
+    uint32_t crc = CrcCalculate(packet, length);
+    uint8_t crcSize = CrcSize();
+    for (uint8_t i = 0; i < crcSize; i++) {
+        crcBytes[i] = crc >> (8 * i);
+    }
+
+    // Encode the packet and the CRC as one stream of COBS blocks. Each block
+    // holds the bytes up to the next zero, which is replaced by the block's
+    // code byte; a full block of 254 bytes has no implied zero.
+    uint32_t total = length + crcSize;
+    uint32_t index = 0;
+    uint8_t blockLength = 1;
+    while (true) {
+        bool end = index == total;
+        uint8_t data = 0;
+        if (!end) {
+            data = index < length ? packet[index] : crcBytes[index - length];
+            index++;
+        }
+        if (end || !data) {
+            m_txBlock[0] = blockLength;
+            if (!m_port.Send(reinterpret_cast<const char *>(m_txBlock),
+                             blockLength)) {
+                return false;
+            }
+            blockLength = 1;
+            if (end) {
+                break;
+            }
+            continue;
+        }
+        m_txBlock[blockLength++] = data;
+        if (blockLength == SERIAL_PACKET_BLOCK_MAX) {
+            m_txBlock[0] = blockLength;
+            if (!m_port.Send(reinterpret_cast<const char *>(m_txBlock),
+                             blockLength)) {
+                return false;
+            }
+            blockLength = 1;
+            if (index == total) {
+                // A full block at the end needs no empty block after it
+                break;
+            }
+        }
+    }
+
+    // Frame delimiter
+    return m_port.SendChar(0);
+}
+
+bool SerialPacket::Poll() {
+    while (true) {
+        if (m_rxChunkPos == m_rxChunkLength) {
+            int32_t count = m_port.ReadBlock(m_rxChunk, sizeof(m_rxChunk));
+            if (count <= 0) {
+                return false;
+            }
+            m_rxChunkPos = 0;
+            m_rxChunkLength = count;
+        }
+
+        uint8_t data = m_rxChunk[m_rxChunkPos++];
+        if (!data) {
+            if (FrameEnd()) {
+                return true;
+            }
+            continue;
+        }
+
+        if (m_blockRemaining) {
+            m_blockRemaining--;
+        }
+        else {
+            // A new block; the block before it ended with a zero unless it
+            // was full
+            bool zero = m_blockCode && m_blockCode < SERIAL_PACKET_BLOCK_MAX;
+            m_blockCode = data;
+            m_blockRemaining = data - 1;
+            if (!zero) {
+                continue;
+            }
+            data = 0;
+        }
+
+        if (m_rxLength < m_bufferSize) {
+            m_buffer[m_rxLength++] = data;
+        }
+        else {
+            m_rxOverflow = true;
+        }
+    }
+}
+
+bool SerialPacket::FrameEnd() {
+    uint8_t crcSize = CrcSize();
+    bool valid = !m_rxOverflow && !m_blockRemaining &&
+                 m_rxLength >= crcSize;
+    uint16_t length = m_rxLength - crcSize;
+
+    if (!m_rxLength && !m_blockCode) {
+        // Back-to-back delimiters; not a frame
+        DecodeReset();
+        return false;
+    }
+
+    if (valid && crcSize) {
+        uint32_t crc = CrcCalculate(m_buffer, length);
+        for (uint8_t i = 0; i < crcSize; i++) {
+            if (m_buffer[length + i] != static_cast<uint8_t>(crc >> (8 * i))) {
+                valid = false;
+                break;
+            }
+        }
+    }
+
+    DecodeReset();
+    if (valid && m_secure) {
+        // Open the packet in place
+        int32_t textLength = m_secure->Open(m_buffer, length, m_buffer);
+        if (textLength == SECURE_CHANNEL_HANDSHAKE) {
+            return false;
+        }
+        valid = textLength >= 0;
+        length = valid ? textLength : 0;
+        // Challenge the sender of a packet from an unknown session; it
+        // seals for our token from then on
+        uint8_t challenge[SECURE_CHANNEL_CHALLENGE_SIZE];
+        uint16_t challengeLength = m_secure->Challenge(challenge);
+        if (challengeLength) {
+            Encode(challenge, challengeLength);
+        }
+    }
+    if (!valid) {
+        m_packetErrors++;
+        return false;
+    }
+
+    m_packetLength = length;
+    if (m_callback) {
+        m_callback(m_buffer, length);
+    }
+    return true;
+}
+
+void SerialPacket::DecodeReset() {
+    m_rxLength = 0;
+    m_blockCode = 0;
+    m_blockRemaining = 0;
+    m_rxOverflow = false;
+}
+
+} // ClearCore namespace
@@ -28,65 +28,91 @@
 
 namespace ClearCore {
 
-extern UsbManager &UsbMgr;
+// The manager of a connector's port
+static UsbManager &Usb(uint8_t port) {
+    return *UsbManager::Port(port);
+}
 
-SerialUsb::SerialUsb(uint16_t index) :
-    m_index(index) {}
+SerialUsb::SerialUsb(uint8_t port) :
+    m_index(CLEARCORE_PIN_USB),
+    m_port(port) {
+    m_mode = USB_CDC;
+}
 
 void SerialUsb::FlushInput() {
-    UsbMgr.FlushInput();
+    Usb(m_port).FlushInput();
 }
 
 void SerialUsb::Flush() {
-    UsbMgr.WaitForWriteFinish();
+    Usb(m_port).WaitForWriteFinish();
 }
 
 bool SerialUsb::PortIsOpen() {
-    return static_cast<bool>(UsbMgr);
+    return static_cast<bool>(Usb(m_port));
 }
 
 void SerialUsb::PortOpen() {
-    UsbMgr.PortOpen();
+    Usb(m_port).PortOpen();
 }
 
 void SerialUsb::PortClose() {
-    UsbMgr.PortClose();
+    Usb(m_port).PortClose();
 }
 
 bool SerialUsb::Speed(uint32_t bitsPerSecond) {
-    return UsbMgr.Speed(bitsPerSecond);
+    return Usb(m_port).Speed(bitsPerSecond);
 }
 
 uint32_t SerialUsb::Speed() {
-    return UsbMgr.Speed();
+    return Usb(m_port).Speed();
 }
 
 int16_t SerialUsb::CharGet() {
-    return UsbMgr.CharGet();
+    return Usb(m_port).CharGet();
 }
 
 int16_t SerialUsb::CharPeek() {
-    return UsbMgr.CharPeek();
+    return Usb(m_port).CharPeek();
 }
 
 bool SerialUsb::SendChar(uint8_t charToSend) {
-    return UsbMgr.SendChar(charToSend);
+    return Usb(m_port).SendChar(charToSend);
+}
+
+int32_t SerialUsb::ReadBlock(uint8_t *buffer, size_t length) {
+    return Usb(m_port).ReadBlock(buffer, length);
+}
+
+int32_t SerialUsb::WriteBlock(const uint8_t *buffer, size_t length) {
+    return Usb(m_port).WriteBlock(buffer, length);
+}
+
+bool SerialUsb::SendDirect(const uint8_t *buffer, size_t length) {
+    return Usb(m_port).SendDirect(buffer, length);
+}
+
+void SerialUsb::SendLatency(uint16_t ms) {
+    Usb(m_port).SendLatency(ms);
+}
+
+uint16_t SerialUsb::SendLatency() {
+    return Usb(m_port).SendLatency();
 }
 
 int32_t SerialUsb::AvailableForRead() {
-    return UsbMgr.AvailableForRead();
+    return Usb(m_port).AvailableForRead();
 }
 
 int32_t SerialUsb::AvailableForWrite() {
-    return UsbMgr.AvailableForWrite();
+    return Usb(m_port).AvailableForWrite();
 }
 
 void SerialUsb::WaitForTransmitIdle() {
-    UsbMgr.WaitForWriteFinish();
+    Usb(m_port).WaitForWriteFinish();
 }
 
 SerialUsb::operator bool() {
-    return static_cast<bool>(UsbMgr);
+    return static_cast<bool>(Usb(m_port));
 }
 
 } // ClearCore namespace
@@ -34,6 +34,9 @@
 #include "SysTiming.h"
 #include "SysUtils.h"
 
+// Resend an unchanged chain this often so a corrupted transfer cannot last
+#define SR_IDLE_RESEND_SAMPLES (10 * MS_TO_SAMPLES)
+
 namespace ClearCore {
 
 /**
@@ -46,10 +49,19 @@ ShiftRegister::ShiftRegister() :
     m_patternMasks{UINT32_MAX},
     m_patternOutputs{SR_UNDERGLOW_MASK},
     m_altOutput(0),
+    m_patternWord(0),
+    m_fadeMask(0),
+    m_breathingMask(0),
+    m_ioSetMask(UINT32_MAX),
     m_initialized(false),
     m_blinkCodeActive(false),
     m_blinkCodeState(false),
     m_useAltOutput(false),
+    m_sweepActive(false),
+    m_sweepStep(0),
+    m_sweepNextMs(0),
+    m_transferPending(false),
+    m_idleUpdates(0),
     m_pendingOutput(0),
     m_lastOutput(0) {
     m_shiftInversions.reg = 0xffffffff;
@@ -118,8 +130,12 @@ void ShiftRegister::Initialize() {
     SYNCBUSY_WAIT(sercomSpi, SERCOM_SPI_SYNCBUSY_ENABLE);
 
     // Send the initial values to the chain
-    sercomSpi->DATA.reg = atomic_load_n(&m_patternOutputs[LED_BLINK_IO_SET])
-                          ^ m_shiftInversions.reg;
+    m_pendingOutput = atomic_load_n(&m_patternOutputs[LED_BLINK_IO_SET]);
+    sercomSpi->DATA.reg = m_pendingOutput ^ m_shiftInversions.reg;
+    m_transferPending = true;
+    while (!sercomSpi->INTFLAG.bit.TXC) {
+        continue;
+    }
 
     // Generate strobe and update
     Send();
@@ -136,53 +152,81 @@ void ShiftRegister::Update() {
         return;
     }
 
-    // Update Counter Outputs
-    m_patternOutputs[LED_BLINK_FAST_STROBE]  = m_fastCounter.Update();
+    if (m_sweepActive) {
+        DiagnosticLedSweepStep();
+    }
+
+    // The dimming patterns are software PWM and need every sample
     m_patternOutputs[LED_BLINK_BREATHING]    = m_breathingCounter.Update();
     m_patternOutputs[LED_BLINK_FADE]         = m_fadeCounter.Update();
 
     Send();
 }
 
+void ShiftRegister::PatternUpdate() {
+    if (!m_initialized) {
+        return;
+    }
+
+    m_patternOutputs[LED_BLINK_FAST_STROBE]  = m_fastCounter.Update();
+
+    // Resolve the pattern priorities once here rather than every sample.
+    // Higher priority patterns take their bits from the lower ones.
+    uint32_t taken = m_patternMasks[LED_BLINK_FAST_STROBE];
+    uint32_t patternWord = m_patternOutputs[LED_BLINK_FAST_STROBE] & taken;
+    if (m_blinkCodeActive) {
+        taken |= SR_UNDERGLOW_MASK;
+        patternWord &= ~SR_UNDERGLOW_MASK;
+        if (m_blinkCodeState) {
+            patternWord |= SR_UNDERGLOW_MASK;
+        }
+    }
+    m_breathingMask = m_patternMasks[LED_BLINK_BREATHING] & ~taken;
+    taken |= m_breathingMask;
+    m_fadeMask = m_patternMasks[LED_BLINK_FADE] & ~taken;
+    taken |= m_fadeMask;
+    m_ioSetMask = ~taken;
+    m_patternWord = patternWord;
+}
+
 void ShiftRegister::Send() {
-    // Wait for TX-complete interrupt flag in case we get here too quickly
-    while (!(SERCOM6->SPI.INTFLAG.bit.TXC)) {
-        continue;
+    // The transfer started by the previous update is normally long done.
+    // Rather than wait on one that is not, pick it up on the next update.
+    if (!SERCOM6->SPI.INTFLAG.bit.TXC) {
+        return;
     }
     uint32_t output;
 
-    // Strobe the output with minimum pulse width to display last transfer
-    DATA_OUTPUT_STATE(SR_LOAD.gpioPort, 1UL << SR_LOAD.gpioPin, true);
-    DATA_OUTPUT_STATE(SR_LOAD.gpioPort, 1UL << SR_LOAD.gpioPin, false);
-    while (!(SERCOM6->SPI.INTFLAG.bit.RXC)) {
-        continue;
+    if (m_transferPending) {
+        // Strobe the output with minimum pulse width to display the transfer
+        DATA_OUTPUT_STATE(SR_LOAD.gpioPort, 1UL << SR_LOAD.gpioPin, true);
+        DATA_OUTPUT_STATE(SR_LOAD.gpioPort, 1UL << SR_LOAD.gpioPin, false);
+        // The received word completes with the transmitted one
+        if (SERCOM6->SPI.INTFLAG.bit.RXC) {
+            m_latchedOutput = SERCOM6->SPI.DATA.reg ^ m_shiftInversions.reg;
+        }
+        m_lastOutput = m_pendingOutput;
+        m_transferPending = false;
     }
-    m_latchedOutput = SERCOM6->SPI.DATA.reg ^ m_shiftInversions.reg;
-    m_lastOutput = m_pendingOutput;
 
     if (m_useAltOutput) {
         output = m_altOutput;
     }
     else {
-        // Start the output with the low priority mask
-        output = m_patternOutputs[LED_BLINK_IO_SET];
-        // Start at 1 to skip the user LEDs
-        for (uint32_t i = LED_BLINK_IO_SET + 1; i < LED_BLINK_CODE_MAX; i++) {
-            // AND in the inverse of the mask to clear out the lower priority
-            // patterns.
-            output &= ~m_patternMasks[i];
-            // Set the output bits to the output of the pattern output.
-            output |= m_patternOutputs[i] & m_patternMasks[i];
-        }
-
-        if (m_blinkCodeActive) {
-            output &= ~SR_UNDERGLOW_MASK;
-            if (m_blinkCodeState) {
-                output |= SR_UNDERGLOW_MASK;
-            }
-        }
+        // Only the directly set outputs and the dimming patterns change
+        // between pattern updates; OR them into the composed pattern word.
+        output = m_patternWord |
+                 (m_patternOutputs[LED_BLINK_IO_SET] & m_ioSetMask) |
+                 (m_patternOutputs[LED_BLINK_BREATHING] & m_breathingMask) |
+                 (m_patternOutputs[LED_BLINK_FADE] & m_fadeMask);
     }
+    // Only shift when the chain needs to change, or is due a refresh
+    if (output == m_lastOutput && ++m_idleUpdates < SR_IDLE_RESEND_SAMPLES) {
+        return;
+    }
+    m_idleUpdates = 0;
     m_pendingOutput = output;
+    m_transferPending = true;
 
     // Apply inversion
     output ^= m_shiftInversions.reg;
@@ -194,49 +238,65 @@ void ShiftRegister::Send() {
     Turn all of the LEDs on briefly so the user can see that they all work.
 **/
 void ShiftRegister::DiagnosticLedSweep() {
+    DiagnosticLedSweepStart();
+    while (m_sweepActive) {
+        continue;
+    }
+}
+
+void ShiftRegister::DiagnosticLedSweepStart() {
     m_altOutput = 0;
+    m_sweepStep = 0;
+    m_sweepNextMs = Milliseconds();
     m_useAltOutput = true;
-    // Illuminate bank 2
-    for (uint8_t i = 0; i < LED_BANK_2_LEN; i++) {
-        m_altOutput |= LED_BANK_2[i];
-        Delay_ms(DELAY_TIME);
-    }
-
-    // Illuminate bank 0 and 1 simultaneously
-    uint8_t largerBankLen = (LED_BANK_1_LEN > LED_BANK_0_LEN) ? LED_BANK_1_LEN
-                            : LED_BANK_0_LEN;
-    for (uint8_t i = 0; i < largerBankLen; i++) {
-        if (i < LED_BANK_0_LEN) {
-            m_altOutput |= LED_BANK_0[i];
-        }
-        if (i < LED_BANK_1_LEN) {
-            m_altOutput |= LED_BANK_1[i];
-        }
+    m_sweepActive = true;
+}
 
-        Delay_ms(DELAY_TIME);
+void ShiftRegister::DiagnosticLedSweepStep() {
+    if (static_cast<int32_t>(Milliseconds() - m_sweepNextMs) < 0) {
+        return;
     }
-
-    Delay_ms(50);
-
-    // Turn them off the same way they were turned on
-    for (uint8_t i = 0; i < LED_BANK_2_LEN; i++) {
-        m_altOutput &= ~LED_BANK_2[i];
-        Delay_ms(DELAY_TIME);
+    // Bank 2 lights first, then banks 0 and 1 together. They go out in the
+    // same order.
+    const uint8_t largerBankLen = (LED_BANK_1_LEN > LED_BANK_0_LEN) ?
+                                  LED_BANK_1_LEN : LED_BANK_0_LEN;
+    uint8_t step = m_sweepStep++;
+    bool lighting = step < LED_BANK_2_LEN + largerBankLen;
+    if (!lighting) {
+        step -= LED_BANK_2_LEN + largerBankLen;
     }
-
-    ShifterStateSet(SR_UNDERGLOW_MASK);
-
-    for (uint8_t i = 0; i < largerBankLen; i++) {
-        if (i < LED_BANK_0_LEN) {
-            m_altOutput &= ~LED_BANK_0[i];
+    uint16_t delayMs = DELAY_TIME;
+    uint32_t leds = 0;
+    if (step < LED_BANK_2_LEN) {
+        leds = LED_BANK_2[step];
+    }
+    else if ((step -= LED_BANK_2_LEN) < largerBankLen) {
+        if (step < LED_BANK_0_LEN) {
+            leds |= LED_BANK_0[step];
         }
-        if (i < LED_BANK_1_LEN) {
-            m_altOutput &= ~LED_BANK_1[i];
+        if (step < LED_BANK_1_LEN) {
+            leds |= LED_BANK_1[step];
         }
+        if (lighting && step == largerBankLen - 1) {
+            delayMs += SWEEP_HOLD_TIME;
+        }
+        else if (!lighting && step == 0) {
+            ShifterStateSet(SR_UNDERGLOW_MASK);
+        }
+    }
+    else {
+        m_useAltOutput = false;
+        m_sweepActive = false;
+        return;
+    }
 
-        Delay_ms(DELAY_TIME);
+    if (lighting) {
+        m_altOutput |= leds;
+    }
+    else {
+        m_altOutput &= ~leds;
     }
-    m_useAltOutput = false;
+    m_sweepNextMs += delayMs;
 }
 
 } // ClearCore namespace
\ No newline at end of file
@@ -0,0 +1,242 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    ClearCore SNTP client
+**/
+
+#include "SntpManager.h"
+#include <sam.h>
+#include <string.h>
+#include "EthernetManager.h"
+#include "lwip/timeouts.h"
+
+namespace ClearCore {
+
+SntpManager &SntpMgr = SntpManager::Instance();
+
+#define US_PER_SEC 1000000LL
+
+#define NTP_PORT 123
+#define NTP_PACKET_LEN 48
+// No leap warning, version 4, client
+#define NTP_REQUEST_FLAGS 0x23
+#define NTP_MODE_SERVER 4
+#define NTP_LEAP_UNSYNCHRONIZED 3
+#define NTP_OFFSET_STRATUM 1
+#define NTP_OFFSET_ORIGINATE 24
+#define NTP_OFFSET_RECEIVE 32
+#define NTP_OFFSET_TRANSMIT 40
+// Seconds from the NTP epoch (1900) to the Unix epoch (1970)
+#define NTP_UNIX_OFFSET_S 2208988800LL
+
+// Read a big-endian 32.32 NTP timestamp as microseconds since 1970
+static int64_t NtpToUnixUs(const uint8_t *buf) {
+    uint32_t seconds = (static_cast<uint32_t>(buf[0]) << 24) |
+                       (static_cast<uint32_t>(buf[1]) << 16) |
+                       (static_cast<uint32_t>(buf[2]) << 8) | buf[3];
+    uint32_t fraction = (static_cast<uint32_t>(buf[4]) << 24) |
+                        (static_cast<uint32_t>(buf[5]) << 16) |
+                        (static_cast<uint32_t>(buf[6]) << 8) | buf[7];
+    // Times with the top bit clear are in the era that starts in 2036
+    int64_t ntpSeconds = seconds;
+    if (!(seconds & 0x80000000)) {
+        ntpSeconds += 0x100000000LL;
+    }
+    return (ntpSeconds - NTP_UNIX_OFFSET_S) * US_PER_SEC +
+           ((static_cast<uint64_t>(fraction) * US_PER_SEC) >> 32);
+}
+
+SntpManager &SntpManager::Instance() {
+    static SntpManager *instance = new SntpManager();
+    return *instance;
+}
+
+SntpManager::SntpManager()
+    : m_pcb(nullptr),
+      m_server(),
+      m_pollMs(SNTP_POLL_INTERVAL_S * 1000UL),
+      m_requestStamp(),
+      m_requestUs(0),
+      m_requestPending(false),
+      m_synchronized(false),
+      m_baseUs(0),
+      m_slewUs(0),
+      m_slewStartUs(0),
+      m_slewPpm(0),
+      m_offsetUs(0),
+      m_roundTripUs(0),
+      m_lastSyncMs(0) {}
+
+bool SntpManager::Begin(IpAddress server, uint16_t pollSeconds) {
+    Stop();
+    EthernetServiceLock lock;
+    m_pcb = udp_new();
+    if (!m_pcb || udp_bind(m_pcb, IP4_ADDR_ANY, 0) != ERR_OK) {
+        if (m_pcb) {
+            udp_remove(m_pcb);
+            m_pcb = nullptr;
+        }
+        return false;
+    }
+    udp_recv(m_pcb, ReceiveCallback, this);
+    ip_addr_set_ip4_u32(&m_server, uint32_t(server));
+    m_pollMs = (pollSeconds ? pollSeconds : 1) * 1000UL;
+    m_requestPending = false;
+    RequestTimeout(this);
+    return true;
+}
+
+void SntpManager::Stop() {
+    EthernetServiceLock lock;
+    if (!m_pcb) {
+        return;
+    }
+    sys_untimeout(RequestTimeout, this);
+    udp_remove(m_pcb);
+    m_pcb = nullptr;
+    m_requestPending = false;
+}
+
+uint64_t SntpManager::WallClockUs(uint64_t localUs) {
+    __disable_irq();
+    bool synchronized = m_synchronized;
+    int64_t wallUs = localUs + m_baseUs + SlewApplied(localUs);
+    __enable_irq();
+    return synchronized ? wallUs : 0;
+}
+
+int64_t SntpManager::SlewApplied(uint64_t localUs) {
+    if (!m_slewPpm || localUs <= m_slewStartUs) {
+        return 0;
+    }
+    int64_t applied = static_cast<int64_t>(localUs - m_slewStartUs) *
+                      m_slewPpm / US_PER_SEC;
+    // Stop once the whole correction is in
+    if ((m_slewUs >= 0) ? applied > m_slewUs : applied < m_slewUs) {
+        applied = m_slewUs;
+    }
+    return applied;
+}
+
+void SntpManager::Correct(int64_t errorUs, uint64_t localUs) {
+    __disable_irq();
+    // Fold the slew applied so far into the base
+    m_baseUs += SlewApplied(localUs);
+    if (!m_synchronized || errorUs > SNTP_STEP_THRESHOLD_US ||
+            errorUs < -SNTP_STEP_THRESHOLD_US) {
+        m_baseUs += errorUs;
+        m_slewUs = 0;
+        m_slewPpm = 0;
+    }
+    else {
+        m_slewUs = errorUs;
+        m_slewStartUs = localUs;
+        m_slewPpm = (errorUs >= 0) ? SNTP_SLEW_MAX_PPM : -SNTP_SLEW_MAX_PPM;
+    }
+    m_synchronized = true;
+    __enable_irq();
+}
+
+void SntpManager::RequestSend() {
+    struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, NTP_PACKET_LEN, PBUF_RAM);
+    if (!p) {
+        return;
+    }
+    uint8_t *buf = static_cast<uint8_t *>(p->payload);
+    memset(buf, 0, NTP_PACKET_LEN);
+    buf[0] = NTP_REQUEST_FLAGS;
+
+    // The server echoes the transmit timestamp back as the originate
+    // timestamp, which pairs the reply with this request. The local clock
+    // makes it unique.
+    m_requestUs = Microseconds64();
+    for (uint8_t i = 0; i < 8; i++) {
+        m_requestStamp[i] = static_cast<uint8_t>(m_requestUs >> (56 - 8 * i));
+    }
+    memcpy(&buf[NTP_OFFSET_TRANSMIT], m_requestStamp, 8);
+
+    m_requestPending =
+        udp_sendto(m_pcb, p, &m_server, NTP_PORT) == ERR_OK;
+    pbuf_free(p);
+}
+
+void SntpManager::RequestTimeout(void *arg) {
+    SntpManager *sntp = static_cast<SntpManager *>(arg);
+    sntp->RequestSend();
+    sys_timeout(sntp->m_synchronized ? sntp->m_pollMs : SNTP_RETRY_MS,
+                RequestTimeout, sntp);
+}
+
+void SntpManager::Receive(struct pbuf *p, uint64_t rxUs) {
+    uint8_t buf[NTP_PACKET_LEN];
+    if (!m_requestPending ||
+            pbuf_copy_partial(p, buf, NTP_PACKET_LEN, 0) != NTP_PACKET_LEN) {
+        return;
+    }
+    // Only a synchronized server's reply to the outstanding request counts
+    if ((buf[0] & 0x7) != NTP_MODE_SERVER ||
+            (buf[0] >> 6) == NTP_LEAP_UNSYNCHRONIZED ||
+            buf[NTP_OFFSET_STRATUM] == 0 ||
+            memcmp(&buf[NTP_OFFSET_ORIGINATE], m_requestStamp, 8)) {
+        return;
+    }
+    m_requestPending = false;
+
+    // t1 and t4 are on the local clock, t2 and t3 on the server's
+    int64_t t2 = NtpToUnixUs(&buf[NTP_OFFSET_RECEIVE]);
+    int64_t t3 = NtpToUnixUs(&buf[NTP_OFFSET_TRANSMIT]);
+    int64_t roundTripUs = static_cast<int64_t>(rxUs - m_requestUs) -
+                          (t3 - t2);
+    int64_t errorUs;
+    if (m_synchronized) {
+        int64_t t1 = WallClockUs(m_requestUs);
+        int64_t t4 = WallClockUs(rxUs);
+        errorUs = ((t2 - t1) + (t3 - t4)) / 2;
+    }
+    else {
+        // Nothing to compare against yet; set the clock from the reply
+        errorUs = t3 + roundTripUs / 2 -
+                  static_cast<int64_t>(rxUs + m_baseUs);
+    }
+
+    Correct(errorUs, rxUs);
+    m_offsetUs = (errorUs > INT32_MAX) ? INT32_MAX :
+                 (errorUs < INT32_MIN) ? INT32_MIN : errorUs;
+    m_roundTripUs = (roundTripUs > 0) ? roundTripUs : 0;
+    m_lastSyncMs = Milliseconds();
+}
+
+void SntpManager::ReceiveCallback(void *arg, struct udp_pcb *pcb,
+                                  struct pbuf *p, const ip_addr_t *addr,
+                                  u16_t port) {
+    (void)pcb;
+    // Take the arrival time before anything else
+    uint64_t rxUs = Microseconds64();
+    SntpManager *sntp = static_cast<SntpManager *>(arg);
+    if (port == NTP_PORT && ip_addr_cmp(addr, &sntp->m_server)) {
+        sntp->Receive(p, rxUs);
+    }
+    pbuf_free(p);
+}
+
+} // ClearCore namespace
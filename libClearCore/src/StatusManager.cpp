@@ -26,6 +26,7 @@
 #include "atomic_utils.h"
 #include "AdcManager.h"
 #include "CcioBoardManager.h"
+#include "CrashManager.h"
 #include "DigitalInOutHBridge.h"
 #include "EthernetManager.h"
 #include "HardwareMapping.h"
@@ -42,6 +43,8 @@ extern DigitalInOutHBridge *const hBridgeCon[];
 extern MotorDriver *const MotorConnectors[];
 extern AdcManager &AdcMgr;
 extern CcioBoardManager &CcioMgr;
+extern CcioBoardManager &CcioMgr1;
+extern CrashManager &CrashMgr;
 extern EthernetManager &EthernetMgr;
 extern NvmManager &NvmMgr;
 extern ShiftRegister ShiftReg;
@@ -69,6 +72,26 @@ StatusManager &StatusMgr = StatusManager::Instance();
 #define UNDER_VOLTAGE_EXIT_CNT ((uint16_t)(UNDER_VOLTAGE_EXIT_V * (1 << 15) / \
    AdcManager::ADC_CHANNEL_MAX_FLOAT[AdcManager::ADC_VSUPPLY_MON]))
 
+// Marks a valid event log; includes the size so a rebuild with a different
+// size starts a fresh log
+#define EVENT_LOG_MAGIC (0x45564C00UL + STATUS_EVENT_LOG_SIZE)
+
+#if STATUS_EVENT_LOG_PERSIST
+#define EVENT_LOG_SECTION __attribute__((section(".noinit")))
+#else
+#define EVENT_LOG_SECTION
+#endif
+
+struct StatusEventLog {
+    uint32_t Magic;
+    uint16_t Head;
+    uint16_t Count;
+    uint32_t Lost;
+    StatusManager::StatusEvent Events[STATUS_EVENT_LOG_SIZE];
+};
+
+static StatusEventLog eventLog EVENT_LOG_SECTION;
+
 
 // Ensures that only one instance of StatusManager is ever created.
 StatusManager &StatusManager::Instance() {
@@ -170,7 +193,18 @@ bool StatusManager::Initialize(ShiftRegister::Masks faultLed) {
     m_faultLed = faultLed;
     m_disableMotors = false;
     m_statusRegSinceStartup = 0;
-    ShiftReg.DiagnosticLedSweep();
+
+    // Keep a persisted log that looks intact, aging its entries by one boot
+    if (eventLog.Magic == EVENT_LOG_MAGIC &&
+            eventLog.Head < STATUS_EVENT_LOG_SIZE &&
+            eventLog.Count <= STATUS_EVENT_LOG_SIZE) {
+        for (uint16_t i = 0; i < eventLog.Count; i++) {
+            eventLog.Events[i].BootsAgo++;
+        }
+    }
+    else {
+        EventLogClear();
+    }
 
     return true;
 }
@@ -196,13 +230,16 @@ void StatusManager::Refresh() {
     statusPending.bit.AdcTimeout = AdcMgr.AdcTimeout();
     statusPending.bit.OutputOverloaded =
         static_cast<bool>(ShiftReg.OverloadActive());
-    statusPending.bit.CcioLinkBroken = CcioMgr.LinkBroken();
-    statusPending.bit.CcioOverloaded = CcioMgr.IoOverloadRT();
+    statusPending.bit.CcioLinkBroken =
+        CcioMgr.LinkBroken() || CcioMgr1.LinkBroken();
+    statusPending.bit.CcioOverloaded =
+        CcioMgr.IoOverloadRT() || CcioMgr1.IoOverloadRT();
     statusPending.bit.EthernetDisconnect = !EthernetMgr.PhyLinkActive();
     statusPending.bit.EthernetRemoteFault = EthernetMgr.PhyRemoteFault();
     statusPending.bit.EthernetPhyInitFailed = EthernetMgr.PhyInitFailed();
     statusPending.bit.SdCardError = SdCard.IsInFault();
     statusPending.bit.NvmDesync = !NvmMgr.Synchonized();
+    statusPending.bit.CrashRecovered = CrashMgr.Available();
 
     UpdateBlinkCodes(statusPending);
 
@@ -228,6 +265,26 @@ void StatusManager::Refresh() {
     atomic_or_fetch(&m_statusRegAccum.reg, statusPending.reg);
     atomic_or_fetch(&m_statusRegSinceStartup.reg, statusPending.reg);
 
+    // Log the transitions seen this sample
+    EventRecord(EVENT_SOURCE_STATUS, 0, statusPrev.reg, statusPending.reg);
+    EventRecord(EVENT_SOURCE_IO_OVERLOAD, 0, m_eventOverloadPrev,
+                m_overloadRT.reg);
+    m_eventOverloadPrev = m_overloadRT.reg;
+    for (uint8_t i = 0; i < MOTOR_CON_CNT; i++) {
+        uint32_t alerts = MotorConnectors[i]->AlertReg().reg;
+        EventRecord(EVENT_SOURCE_MOTOR_ALERT, i, m_eventAlertPrev[i], alerts);
+        m_eventAlertPrev[i] = alerts;
+    }
+    for (uint8_t i = 0; i < 2; i++) {
+        uint64_t ccioOverloads =
+            (i ? CcioMgr1 : CcioMgr).IoOverloadRT();
+        EventRecord(EVENT_SOURCE_CCIO_OVERLOAD, 2 * i, m_eventCcioPrev[i],
+                    ccioOverloads);
+        EventRecord(EVENT_SOURCE_CCIO_OVERLOAD, 2 * i + 1,
+                    m_eventCcioPrev[i] >> 32, ccioOverloads >> 32);
+        m_eventCcioPrev[i] = ccioOverloads;
+    }
+
     bool disableMotorsPrev = m_disableMotors;
 
     // Disable the MotorDrivers when the Vbus is overloaded, or the HBridge is
@@ -330,7 +387,9 @@ void StatusManager::UpdateBlinkCodes(StatusRegister status) {
             BlinkCodeDriver::BLINK_GROUP_DEVICE_ERROR,
             BlinkCodeDriver::DEVICE_ERROR_CCIO);
     }
+}
 
+void StatusManager::BlinkCodeUpdate() {
     m_blinkMgr.Update();
     ShiftReg.BlinkCode(m_blinkMgr.CodePresent(), m_blinkMgr.LedState());
 }
@@ -346,4 +405,61 @@ void StatusManager::OverloadUpdate(uint32_t mask, bool inFault) {
     m_overloadAccum.reg |= m_overloadRT.reg;
 }
 
+void StatusManager::EventRecord(uint8_t source, uint8_t index, uint32_t prev,
+                                uint32_t now) {
+    if (prev == now) {
+        return;
+    }
+
+    // Called from the sample rate interrupt, which the readers hold off
+    StatusEvent &event = eventLog.Events[eventLog.Head];
+    event.Tick = tickCnt;
+    event.Risen = ~prev & now;
+    event.Fallen = prev & ~now;
+    event.Source = source;
+    event.Index = index;
+    event.BootsAgo = 0;
+
+    if (++eventLog.Head >= STATUS_EVENT_LOG_SIZE) {
+        eventLog.Head = 0;
+    }
+    if (eventLog.Count < STATUS_EVENT_LOG_SIZE) {
+        eventLog.Count++;
+    }
+    else {
+        eventLog.Lost++;
+    }
+}
+
+uint16_t StatusManager::EventLogCount() {
+    return atomic_load_n(&eventLog.Count);
+}
+
+bool StatusManager::EventLogRead(uint16_t index, StatusEvent &event) {
+    bool found = false;
+    __disable_irq();
+    if (index < eventLog.Count) {
+        // The oldest entry is Count entries behind the head
+        uint16_t slot = eventLog.Head + STATUS_EVENT_LOG_SIZE -
+                        eventLog.Count + index;
+        event = eventLog.Events[slot % STATUS_EVENT_LOG_SIZE];
+        found = true;
+    }
+    __enable_irq();
+    return found;
+}
+
+uint32_t StatusManager::EventLogLost() {
+    return atomic_load_n(&eventLog.Lost);
+}
+
+void StatusManager::EventLogClear() {
+    __disable_irq();
+    eventLog.Head = 0;
+    eventLog.Count = 0;
+    eventLog.Lost = 0;
+    eventLog.Magic = EVENT_LOG_MAGIC;
+    __enable_irq();
+}
+
 }
\ No newline at end of file
@@ -22,9 +22,22 @@
 
 #include "StepGenerator.h"
 #include <math.h>
+#include <string.h>
+#ifndef CLEARCORE_HOST_SIM
 #include <sam.h>
+#endif
+#include "atomic_utils.h"
 #include "SysTiming.h"
 
+#ifdef CLEARCORE_HOST_SIM
+// Host simulation builds run the profile generator outside of any interrupt
+static inline void __disable_irq() {}
+static inline void __enable_irq() {}
+static inline uint32_t __get_IPSR() {
+    return 0;
+}
+#endif
+
 namespace ClearCore {
 
 #define min(a, b) (((a) < (b)) ? (a) : (b))
@@ -36,110 +49,61 @@ namespace ClearCore {
     sent, and calculates how many steps to send in the next ISR.
 */
 
-void StepGenerator::StepsCalculated() {
+ISR_RAMFUNC void StepGenerator::StepsCalculated() {
+
+    // Let a plan made while the axis was idle tell that it has moved since
+    if (m_moveState != MS_IDLE || m_stepsExternalActive) {
+        m_movePlanEpoch++;
+    }
+
+    // A MotionGroup or the gantry leader is supplying the steps for this
+    // axis
+    if (m_stepsExternalActive) {
+        if (m_gantryLeader) {
+            GantryStepsTake();
+        }
+        StepsExternalOutput();
+        return;
+    }
+
+    // Gearing and cam motion keep to their master's time
+    if (m_overrideOn && m_moveState != MS_GEAR && m_moveState != MS_CAM) {
+        StepsOverridden();
+        return;
+    }
+
+    ProfileStep();
+}
+
+ISR_RAMFUNC void StepGenerator::ProfileStep() {
+    MoveCommandsTake();
+
+    // Start or blend in the next queued move, if there is one
+    MoveQueueService();
+
+    SoftLimitsCheck();
 
     // Perform setup for a newly issued move.
     // This is handled separately from the main state machine to determine
     // determine the proper entry state and begin executing without delaying
     // until the next sample.
     if (m_moveState == MS_START) {
-        // Compute move parameters
-        m_accelCurrentQx = m_accelLimitQx;
-        m_posnTargetQx = static_cast<int64_t>(m_stepsCommanded)
-                         << FRACT_BITS;
-
-        if (m_velocityMove) {
-            if (m_altVelLimitQx && m_velCurrentQx && m_direction != m_dirCommanded) {
-                m_velTargetQx = 0;
-                m_moveDirChange = true;
-            }
-            else {
-                m_velTargetQx = m_altVelLimitQx;
-                m_moveDirChange = false;
-            }
-            if (m_velTargetQx) {
-                // Notify the system of the direction of the issued move
-                // if moving to a non-zero velocity
-                m_direction = m_dirCommanded;
-                OutputDirection();
-            }
-
-            if (m_velCurrentQx == m_velTargetQx) {
-                // Already at the correct velocity
-                m_moveState = MS_CRUISE;
-            }
-            else if (m_velCurrentQx > m_velTargetQx) {
-                // Decelerate to reach the target velocity
-                m_moveState = MS_DECEL_VEL;
-            }
-            else {
-                // Accelerate to reach the target velocity
-                m_moveState = MS_ACCEL;
-            }
+        if (m_movePlanReady) {
+            // The move was planned in the main loop
+            m_movePlanReady = false;
+            MovePlanApply(m_movePlan);
         }
         else {
-            if (m_velCurrentQx) {
-                // Currently moving, check for a change in direction
-                if (m_direction == m_dirCommanded) {
-                    // A direction change is also needed if we overshoot our target position
-                    int64_t distToStopQx = (static_cast<int64_t>(m_velCurrentQx) * m_velCurrentQx /
-                                          m_accelCurrentQx) >> 1;
-                    // The distance to stop is how many steps it will take to slow to 0 velocity
-                    // If the number of commanded steps is less than that, we cannot stop in
-                    // time and must overshoot and come back.
-                    m_moveDirChange = m_posnTargetQx - m_posnCurrentQx < distToStopQx;
-                }
-                else {
-                    m_moveDirChange = true;
-                }
-                
-            }
-            else {
-                m_moveDirChange = false;
-                m_direction = m_dirCommanded;
-                if (m_posnTargetQx != m_posnCurrentQx) {
-                    // Notify the system of the direction of the issued move
-                    OutputDirection();
-                }
-            }
-            
-            if (m_moveDirChange) {
-                m_moveState = MS_DECEL_VEL;
-                m_velTargetQx = 0;
-            }
-
-            else {
-                // If the move profile is a triangle (i.e. doesn't reach
-                // VelLimit), set the velocity limit to peak velocity so that
-                // trapezoid logic can be used.
-                // The maximum triangle move distance =
-                //     VelLimit * (AccelSamples + DecelSamples) / 2 = V*V/A
-                // Account for the steps that would have been used to accelerate
-                // to the current velocity.
-                int64_t accelStepsQx = (static_cast<int64_t>(m_velCurrentQx) *
-                                        m_velCurrentQx / 2) / m_accelLimitQx;
-                if (static_cast<int64_t>(m_velLimitQx) * m_velLimitQx /
-                        m_accelLimitQx - accelStepsQx > m_posnTargetQx) {
-                    // Multiplication by 2^FRACT_BITS to preserve Q-format
-                    int64_t vel64 =
-                        static_cast<int64_t>(sqrtf((float)(
-                                                       ((static_cast<int64_t>(m_stepsCommanded) << FRACT_BITS)
-                                                        + accelStepsQx) * m_accelLimitQx)));
-
-                    m_velTargetQx = static_cast<int32_t>(min(vel64, INT32_MAX));
-                }
-                else {
-                    m_velTargetQx = m_velLimitQx;
-                }
-                if (m_velCurrentQx > m_velTargetQx) {
-                    // Decelerate to reach the target velocity
-                    m_moveState = MS_DECEL_VEL;
-                }
-                else {
-                    // Accelerate to reach the target velocity
-                    m_moveState = MS_ACCEL;
-                }
-            }
+            MovePlan plan;
+            plan.StepsCommanded = m_stepsCommanded;
+            plan.DirCommanded = m_dirCommanded;
+            plan.VelocityMove = m_velocityMove;
+            plan.VelLimitQx = m_velLimitQx;
+            plan.AltVelLimitQx = m_altVelLimitQx;
+            plan.AccelLimitQx = m_accelLimitQx;
+            plan.JerkLimitQx = m_jerkLimitQx;
+            MovePlanCompute(plan);
+            MovePlanApply(plan);
         }
     }
 
@@ -147,45 +111,74 @@ void StepGenerator::StepsCalculated() {
     switch (m_moveState) {
         case MS_IDLE: // Idle state, waiting for a command.
             return;
+        case MS_PVT: // Following the PVT stream
+            PvtStep();
+            return;
+        case MS_GEAR: // Following the encoder
+            GearStep();
+            return;
+        case MS_CAM: // Following the master through the cam table
+            CamStep();
+            return;
         case MS_START: // Start state, this case was handled above
             break;
 
         case MS_ACCEL: // Ramp up to target speed
-            // Execute move
-            m_posnCurrentQx += m_velCurrentQx + (m_accelCurrentQx >> 1);
-            m_velCurrentQx += m_accelCurrentQx;
-
-            // Check if we reached target velocity or velocity overflow
-            if (m_velCurrentQx >= m_velTargetQx || m_velCurrentQx <= 0) {
-                // If maximum velocity reached, compute the distance overshoot
-                // from exceeding the velocity limit.
-                // Dist Over = % of sample time past when the vel was reached
-                //             * vel overshoot / 2
-                uint32_t overshootQx = m_velCurrentQx - m_velTargetQx;
-                uint32_t pctSampleOverQ32 =
-                    ((static_cast<uint64_t>(overshootQx)) << 32) /
-                    m_accelCurrentQx;
-                // Build in the divide by 2
-                uint32_t posnAdjQx =
-                    (static_cast<uint64_t>(pctSampleOverQ32) * overshootQx) >>
-                    33;
-
+            if (m_jerkLimitQx) {
+                SCurveRampStep(m_velTargetQx - m_velCurrentQx, true);
+                // Check if we reached target velocity or velocity overflow
+                if (m_velCurrentQx < m_velTargetQx && m_velCurrentQx >= 0) {
+                    break;
+                }
+                // The acceleration has ramped down to (nearly) zero by the
+                // time the target is reached, so the overshoot is negligible.
                 m_velCurrentQx = m_velTargetQx;
-                // Adjust position for overshoot.
-                // Also subtract off the distance moved in one sample time at
-                // target velocity to allow cruise state logic to determine
-                // whether we should start decelerating.
-                m_posnCurrentQx -= (posnAdjQx + m_velCurrentQx);
-                // Calculate the decel point
-                uint64_t decelDistQx = (static_cast<uint64_t>(m_velCurrentQx) *
-                                        m_velCurrentQx / m_accelCurrentQx) >> 1;
-                m_posnDecelQx = m_posnTargetQx - decelDistQx;
+                m_velFractQx = 0;
+                m_accelLevel = 0;
+                m_accelCurrentQx = 0;
+                m_posnCurrentQx -= m_velCurrentQx;
+                m_posnDecelQx = m_posnTargetQx - StopDistanceQx(m_velCurrentQx);
                 m_moveState = MS_CRUISE;
                 // Allow to fall through into cruise in case the decel
                 // needs to start immediately
             }
             else {
-                break;
+                // Execute move
+                m_posnCurrentQx += m_velCurrentQx + (m_accelCurrentQx >> 1);
+                m_velCurrentQx += m_accelCurrentQx;
+
+                // Check if we reached target velocity or velocity overflow
+                if (m_velCurrentQx >= m_velTargetQx || m_velCurrentQx <= 0) {
+                    // If maximum velocity reached, compute the distance overshoot
+                    // from exceeding the velocity limit.
+                    // Dist Over = % of sample time past when the vel was reached
+                    //             * vel overshoot / 2
+                    uint32_t overshootQx = m_velCurrentQx - m_velTargetQx;
+                    uint32_t pctSampleOverQ32 =
+                        ((static_cast<uint64_t>(overshootQx)) << 32) /
+                        m_accelCurrentQx;
+                    // Build in the divide by 2
+                    uint32_t posnAdjQx =
+                        (static_cast<uint64_t>(pctSampleOverQ32) * overshootQx) >>
+                        33;
+
+                    m_velCurrentQx = m_velTargetQx;
+                    // Adjust position for overshoot.
+                    // Also subtract off the distance moved in one sample time at
+                    // target velocity to allow cruise state logic to determine
+                    // whether we should start decelerating.
+                    m_posnCurrentQx -= (posnAdjQx + m_velCurrentQx);
+                    // Calculate the decel point
+                    uint64_t decelDistQx = (static_cast<uint64_t>(m_velCurrentQx) *
+                                            m_velCurrentQx / m_accelCurrentQx) >> 1;
+                    m_posnDecelQx = m_posnTargetQx - decelDistQx;
+                    m_moveState = MS_CRUISE;
+                    // Allow to fall through into cruise in case the decel
+                    // needs to start immediately
+                }
+                else {
+                    break;
+                }
             }
         // Fall through
 
@@ -236,8 +229,13 @@ void StepGenerator::StepsCalculated() {
 
         case MS_DECEL: // Ramp down to stopped
             // Execute move
-            m_posnCurrentQx += m_velCurrentQx - (m_accelCurrentQx >> 1);
-            m_velCurrentQx -= m_accelCurrentQx;
+            if (m_jerkLimitQx) {
+                SCurveRampStep(m_velCurrentQx, false);
+            }
+            else {
+                m_posnCurrentQx += m_velCurrentQx - (m_accelCurrentQx >> 1);
+                m_velCurrentQx -= m_accelCurrentQx;
+            }
 
             // Check for done condition: if we overshot target position or
             // decel overshot zero velocity or position overflow
@@ -255,6 +253,24 @@ void StepGenerator::StepsCalculated() {
             // When decreasing velocity, target a new velocity, not a position
             // During decel, we still need to accumulate the steps that we are
             // taking.
+            if (m_jerkLimitQx) {
+                SCurveRampStep(m_velCurrentQx - m_velTargetQx, false);
+                if (m_velCurrentQx <= m_velTargetQx) {
+                    m_velCurrentQx = m_velTargetQx;
+                    m_velFractQx = 0;
+                    m_accelLevel = 0;
+                    m_accelCurrentQx = 0;
+                    if (m_moveDirChange) {
+                        m_moveState = MS_CHANGE_DIR;
+                    }
+                    else {
+                        m_posnDecelQx =
+                            m_posnTargetQx - StopDistanceQx(m_velCurrentQx);
+                        m_moveState = MS_CRUISE;
+                    }
+                }
+                break;
+            }
             m_posnCurrentQx += m_velCurrentQx - (m_accelCurrentQx >> 1);
             m_velCurrentQx -= m_accelCurrentQx;
 
@@ -317,6 +333,7 @@ void StepGenerator::StepsCalculated() {
             m_stepsSent = 0;
             m_posnCurrentQx = m_posnCurrentQx & ~(UINT64_MAX << FRACT_BITS);
 
+            m_movePlanReady = false;
             m_moveState = MS_START;
             m_moveDirChange = false;
             break;
@@ -325,6 +342,8 @@ void StepGenerator::StepsCalculated() {
         default:
             m_posnCurrentQx = 0;
             m_velCurrentQx = 0;
+            m_velFractQx = 0;
+            m_accelLevel = 0;
             m_stepsSent = 0;
             m_stepsPrevious = 0;
             m_stepsCommanded = 0;
@@ -342,166 +361,1867 @@ void StepGenerator::StepsCalculated() {
     m_stepsSent += m_stepsPrevious;
 
     // Check move direction and increment absolute position
-    m_posnAbsolute += m_direction ? -m_stepsPrevious : m_stepsPrevious;
+    int32_t steps = m_stepsPrevious;
+    m_posnAbsolute = PosnWrap(m_posnAbsolute + (m_direction ? -steps : steps));
 }
 
 /*
-    Default constructor
+    Run the motion profile at the feed-rate override.
+
+    The override is the Q15 number of profile samples that pass each sample.
+    Each profile sample's steps are spread evenly over the time it takes, so
+    the motion keeps its shape at any rate and every step the profile makes
+    is sent. The profile runs from its own position, which is ahead of the
+    commanded position by the steps it has made that haven't been sent.
 */
-StepGenerator::StepGenerator()
-    : m_stepsPrevious(0),
-      m_stepsPerSampleMax(0),
-      m_moveState(MS_IDLE),
-      m_direction(false),
-      m_lastMoveWasPositional(true),
-	  m_limitInfo(),
-      m_posnAbsolute(0),
-      m_stepsCommanded(0),
-      m_stepsSent(0),
-      m_velocityMove(false),
-      m_moveDirChange(false),
-      m_dirCommanded(false),
-      m_velLimitQx(1),
-      m_altVelLimitQx(0),
-      m_accelLimitQx(2),
-      m_altDecelLimitQx(2),
-      m_posnCurrentQx(0),
-      m_velCurrentQx(0),
-      m_accelCurrentQx(0),
-      m_posnTargetQx(0),
-      m_velTargetQx(0),
-      m_posnDecelQx(0),
-      m_velLimitPendingQx(1),
-      m_altVelLimitPendingQx(0),
-      m_accelLimitPendingQx(2),
-      m_altDecelLimitPendingQx(2) {}
+ISR_RAMFUNC void StepGenerator::StepsOverridden() {
+    int32_t rate = FeedOverrideRamp(abs(m_overrideSteps), m_accelLimitQx);
+
+    m_posnAbsolute = PosnWrap(m_posnAbsolute + m_overrideHeld);
+    int32_t stepsRun = 0;
+    int32_t stepsQ15 = m_overrideFract;
+    while (rate > 0) {
+        if (!m_overrideLeftQ15) {
+            ProfileStep();
+            int32_t steps = m_direction ? -static_cast<int32_t>(m_stepsPrevious)
+                                        : static_cast<int32_t>(m_stepsPrevious);
+            stepsRun += steps;
+            if (m_moveState == MS_IDLE) {
+                // No more motion to stretch
+                stepsQ15 += steps << FRACT_BITS;
+                m_overrideSteps = 0;
+                break;
+            }
+            m_overrideSteps = steps;
+            m_overrideLeftQ15 = 1L << FRACT_BITS;
+        }
+        int32_t part = min(rate, m_overrideLeftQ15);
+        stepsQ15 += m_overrideSteps * part;
+        m_overrideLeftQ15 -= part;
+        rate -= part;
+    }
+    int32_t steps = (stepsQ15 >> FRACT_BITS) + m_overrideCarry;
+    m_overrideFract = stepsQ15 & ((1L << FRACT_BITS) - 1);
+
+    int32_t out;
+    int32_t outMax = m_stepsPerSampleMax;
+    if (m_moveState != MS_IDLE) {
+        // Stay with the motion's direction
+        if (m_direction) {
+            out = max(min(steps, 0), -outMax);
+        }
+        else {
+            out = min(max(steps, 0), outMax);
+        }
+    }
+    else {
+        out = max(min(steps, outMax), -outMax);
+        if (out && (out < 0) != m_direction) {
+            m_direction = out < 0;
+            OutputDirection();
+        }
+    }
+    m_overrideCarry = steps - out;
+    m_overrideHeld += stepsRun - out;
+    m_posnAbsolute = PosnWrap(m_posnAbsolute - m_overrideHeld);
+    m_stepsPrevious = abs(out);
+
+    // Back to the plain profile once the override is off and caught up
+    if (m_overrideTargetQ15 == (1L << FRACT_BITS) &&
+            m_overrideQ15 == (1L << FRACT_BITS) && !m_overrideLeftQ15 &&
+            !m_overrideHeld && !m_overrideFract) {
+        m_overrideOn = false;
+    }
+}
 
 /*
-    This function clears the current move and puts the motor in a
-    move idle state without disabling it or clearing the position.
+    Ramp the feed-rate override toward its target no faster than the
+    acceleration limit allows at the profile's speed, in steps per profile
+    sample, and keep the speed within the maximum step rate.
+*/
+ISR_RAMFUNC int32_t StepGenerator::FeedOverrideRamp(int32_t speed,
+                                                    int32_t accelQx) {
+    int32_t target = m_overrideTargetQ15;
+    if (speed) {
+        target = min(target, static_cast<int32_t>(
+                         (m_stepsPerSampleMax << FRACT_BITS) / speed));
+    }
+    int32_t rampMax = max(accelQx / (speed + 1), 1);
+    int32_t rate = m_overrideQ15;
+    if (rate < target) {
+        rate = min(rate + rampMax, target);
+    }
+    else {
+        rate = max(rate - rampMax, target);
+    }
+    m_overrideQ15 = rate;
+    return rate;
+}
 
-    This may cause an abrupt stop.
+/*
+    Drop the steps the profile has made at the feed-rate override that
+    haven't been sent. The commanded position is already where the motor is.
+    Called with the sample rate interrupt unable to run.
 */
-void StepGenerator::MoveStopAbrupt() {
-    // Block the interrupt while changing the command
-    __disable_irq();
-    m_posnCurrentQx = 0;
-    m_velCurrentQx = 0;
-    m_stepsSent = 0;
-    m_moveState = MS_IDLE;
-    m_velocityMove = false;
-    m_stepsCommanded = 0;
-    m_stepsPrevious = 0;
-    UpdatePendingMoveLimits();
-    __enable_irq();
+void StepGenerator::FeedOverrideFlush() {
+    m_overrideSteps = 0;
+    m_overrideLeftQ15 = 0;
+    m_overrideFract = 0;
+    m_overrideCarry = 0;
+    m_overrideHeld = 0;
+}
+
+void StepGenerator::FeedOverride(uint16_t percent) {
+    percent = min(percent, 200);
+    m_overrideTargetQ15 = (static_cast<int32_t>(percent) << FRACT_BITS) / 100;
+    atomic_store_n(&m_overrideOn, true);
 }
 
 /*
-    This function commands a directional move.
+    Send the steps that a MotionGroup computed for this axis.
+*/
+void StepGenerator::StepsExternalOutput() {
+    // Hold to the step rate limit, and send what is left over later
+    int32_t stepsMax = m_stepsPerSampleMax;
+    int32_t stepsWanted = m_stepsExternal + m_stepsExternalCarry;
+    int32_t steps = max(min(stepsWanted, stepsMax), -stepsMax);
+    m_stepsExternalCarry = stepsWanted - steps;
+    m_stepsExternal = 0;
 
-    The function will return true if the move was accepted.
+    bool direction = steps < 0;
+    if (steps && direction != m_direction) {
+        // Notify the system of the new direction before stepping
+        m_direction = direction;
+        OutputDirection();
+    }
+    m_stepsPrevious = abs(steps);
+    m_posnAbsolute = PosnWrap(m_posnAbsolute + steps);
+}
+
+/*
+    Copy the steps and position the gantry leader worked out this sample.
+    The leader is refreshed first, so both sides send the same steps in the
+    same sample.
+    A stop requested on the follower, such as for a fault, stops the leader
+    in the next sample.
 */
-bool StepGenerator::Move(int32_t dist, MoveTarget moveTarget) {
+void StepGenerator::GantryStepsTake() {
+    StepGenerator *leader = m_gantryLeader;
+    int32_t steps = static_cast<int32_t>(leader->m_stepsPrevious);
+    m_stepsExternal = leader->m_direction ? -steps : steps;
+    // Keep to the leader's position, which already has these steps
+    m_posnAbsolute = leader->m_posnAbsolute - m_stepsExternal;
 
-    // Block the interrupt while changing the command
-    __disable_irq();
-    // Make relative moves be based off of current position during a velocity
-    // move
-    if (m_velocityMove) {
-        m_stepsCommanded = 0;
-        m_stepsSent = 0;
+    ExternalStopRequests stop = m_stepsExternalStop;
+    m_stepsExternalStop = EXTERNAL_STOP_NONE;
+    if (stop == EXTERNAL_STOP_ABRUPT) {
+        leader->MoveStopAbrupt();
     }
-    switch (moveTarget) {
-        case MOVE_TARGET_ABSOLUTE:
-            m_stepsCommanded = dist - m_posnAbsolute;
-            break;
-        case MOVE_TARGET_REL_END_POSN:
-        default:
-            // relative end posn
-            // m_stepsCommanded += (newDir ? -dist : dist);
-            // Since the steps scale is relative to start of move to prevent
-            // overflow, the scale shifts by the number of steps taken
-            // So account for this, the current steps should be taken off of the
-            // previous commanded amount, then the new command should be added
-            // The steps send are in the direction of the commanded steps, subtract
-            // that first. Steps taken is always less than commanded, result (+)
-            m_stepsCommanded -= m_stepsSent;
-            // Convert magnitude + direction format to signed int
-            m_stepsCommanded = m_direction ? -m_stepsCommanded : m_stepsCommanded ;
-            // Now stepsCommanded and distance are signed and in the global
-            // direction. Add them
-            m_stepsCommanded += dist;
-            // Steps commanded and dir will be calculated later.
-            break;
+    else if (stop == EXTERNAL_STOP_DECEL) {
+        leader->MoveStopDecel();
     }
+}
 
-    // Zero out the steps and integer portion of current position to
-    // reduce chance of overflow
-    m_stepsSent = 0;
+/*
+    Add this gantry side's skew to the sample's steps. A change in the skew
+    is taken up at GANTRY_SKEW_STEPS_MAX steps per sample, within the
+    gantry's direction while it steps, so a side can be brought into square
+    while moving or standing still. A held side sends nothing and its skew
+    grows by the gantry's steps instead.
+*/
+ISR_RAMFUNC uint32_t StepGenerator::StepsGantry(uint32_t steps) {
+    if (!m_gantryOn) {
+        return steps;
+    }
+    int32_t in = m_direction ? -static_cast<int32_t>(steps)
+                             : static_cast<int32_t>(steps);
+    if (m_gantryHold) {
+        m_gantrySkewApplied -= in;
+        m_gantrySkew = m_gantrySkewApplied;
+        return 0;
+    }
 
-    // Zero the integer portion of the current position. We want to keep
-    // partial steps so movement is smooth.
-    m_posnCurrentQx = m_posnCurrentQx & ~(UINT64_MAX << FRACT_BITS);
+    int32_t skew = m_gantrySkew - m_gantrySkewApplied;
+    skew = max(min(skew, GANTRY_SKEW_STEPS_MAX), -GANTRY_SKEW_STEPS_MAX);
+    int32_t out = in + skew;
+    int32_t outMax = m_stepsPerSampleMax;
+    // The follower's direction only matters in samples it steps; the
+    // leader's is also the direction of its profile
+    bool turnable = m_gantryLeader ||
+                    (m_moveState == MS_IDLE && !m_stepsExternalActive);
+    if (in || !turnable) {
+        // Stay with the gantry's direction
+        if (m_direction) {
+            out = max(min(out, 0), -outMax);
+        }
+        else {
+            out = min(max(out, 0), outMax);
+        }
+    }
+    else {
+        out = max(min(out, outMax), -outMax);
+        if (out && (out < 0) != m_direction) {
+            m_direction = out < 0;
+            OutputDirection();
+        }
+    }
+    m_gantrySkewApplied += out - in;
+    return abs(out);
+}
 
-    // Determine the direction of the movements.
-    m_dirCommanded = m_stepsCommanded < 0;
+/*
+    Convert this sample's steps into the steps sent to the motor by adding
+    the change in the leadscrew and backlash correction.
 
-    // Steps commanded now needs to be a positive value.
-    m_stepsCommanded = abs(m_stepsCommanded);
+    The correction still to be sent is added to the commanded steps and the
+    result is limited to the commanded direction and the maximum step rate;
+    whatever doesn't fit waits for a later sample moving the right way.
+*/
+ISR_RAMFUNC uint32_t StepGenerator::StepsCompensated() {
+    const CompTable *table = m_compTable;
+    int32_t backlash = m_compBacklash;
+    if (!m_stepsPrevious || (!table && !backlash && !m_compApplied)) {
+        return m_stepsPrevious;
+    }
+    m_compLastNeg = m_direction;
 
-    m_velocityMove = false;
-    UpdatePendingMoveLimits();
-    m_moveState = MS_START;
+    int32_t correction = m_compLastNeg ? -backlash : 0;
+    if (table) {
+        int32_t offset = m_posnAbsolute - table->Start;
+        uint8_t shift = table->SpacingShift;
+        uint16_t last = table->Count - 1;
+        if (offset <= 0) {
+            correction += table->Corrections[0];
+        }
+        else if ((offset >> shift) >= last) {
+            correction += table->Corrections[last];
+        }
+        else {
+            uint16_t index = offset >> shift;
+            int32_t fract = offset & ((1L << shift) - 1);
+            int32_t c0 = table->Corrections[index];
+            int32_t c1 = table->Corrections[index + 1];
+            // Round to the nearest step
+            int64_t interp = static_cast<int64_t>(c1 - c0) * fract +
+                             (shift ? (1LL << (shift - 1)) : 0);
+            correction += c0 + static_cast<int32_t>(interp >> shift);
+        }
+    }
 
-    __enable_irq();
-    return true;
+    int32_t steps = m_direction ? -static_cast<int32_t>(m_stepsPrevious)
+                                : static_cast<int32_t>(m_stepsPrevious);
+    int32_t out = steps + (correction - m_compApplied);
+    int32_t outMax = m_stepsPerSampleMax;
+    if (m_direction) {
+        out = max(min(out, 0), -outMax);
+    }
+    else {
+        out = min(max(out, 0), outMax);
+    }
+    m_compApplied += out - steps;
+    return abs(out);
 }
 
 /*
-    This function commands a velocity move.
-    If there is a current move, it will be overwritten.
-*/
-bool StepGenerator::MoveVelocity(int32_t velocity) {
-    // Block the interrupt while changing the command
-    __disable_irq();
-    m_dirCommanded = (velocity < 0);
-
-    m_velocityMove = true;
+    Shape this sample's steps with the input shaper's impulses.
 
-    int32_t velAbsolute = abs(velocity);
-    AltVelMax(velAbsolute);
-    UpdatePendingMoveLimits();
-    m_stepsCommanded = INT32_MAX;
-    m_posnCurrentQx &= ~(UINT64_MAX << FRACT_BITS);
-    m_stepsSent = 0;
+    The steps taken in go into the history, and the steps sent are the sum
+    of the history at each impulse's delay weighted by its amplitude. The
+    amplitudes add up to exactly one, so every step taken in is sent once it
+    has passed through the history. While a move is in progress the steps
+    are held to its direction and the maximum step rate; whatever doesn't fit
+    is carried to later samples.
+*/
+ISR_RAMFUNC uint32_t StepGenerator::StepsShaped(uint32_t steps) {
+    if (!m_shaperOn) {
+        return steps;
+    }
+    int32_t in = m_direction ? -static_cast<int32_t>(steps)
+                             : static_cast<int32_t>(steps);
+    uint16_t index = m_shaperIndex;
+    m_shaperHistory[index] = in;
+    m_shaperIndex = (index + 1 < m_shaperLength) ? index + 1 : 0;
 
-    m_moveState = MS_START;
-    __enable_irq();
+    int32_t shapedQ15 = m_shaperFract;
+    uint16_t tap = index;
+    for (uint8_t i = 0; i < m_shaperImpulses; i++) {
+        shapedQ15 += m_shaperAmp[i] * m_shaperHistory[tap];
+        tap = (tap >= m_shaperDelay) ? tap - m_shaperDelay
+                                     : tap + m_shaperLength - m_shaperDelay;
+    }
+    int32_t shaped = (shapedQ15 >> FRACT_BITS) + m_shaperCarry;
+    m_shaperFract = shapedQ15 & ((1L << FRACT_BITS) - 1);
 
-    return true;
+    int32_t out;
+    int32_t outMax = m_stepsPerSampleMax;
+    if (m_moveState != MS_IDLE || m_stepsExternalActive) {
+        // Stay with the move's direction
+        if (m_direction) {
+            out = max(min(shaped, 0), -outMax);
+        }
+        else {
+            out = min(max(shaped, 0), outMax);
+        }
+    }
+    else {
+        out = max(min(shaped, outMax), -outMax);
+        if (out && (out < 0) != m_direction) {
+            m_direction = out < 0;
+            OutputDirection();
+        }
+    }
+    m_shaperCarry = shaped - out;
+    m_shaperPending += in - out;
+    return abs(out);
 }
 
-void StepGenerator::MoveStopDecel(uint32_t decelMax) {
-    if (decelMax != 0) {
-        EStopDecelMax(decelMax);
-        m_altDecelLimitQx = m_altDecelLimitPendingQx;
+/*
+    Drop the steps the input shaper hasn't sent yet, and move the commanded
+    position back to where the motor is. Called with the sample rate
+    interrupt unable to run.
+*/
+void StepGenerator::InputShaperFlush() {
+    if (!m_shaperOn) {
+        return;
     }
-    __disable_irq();
-    m_accelLimitQx = max(m_altDecelLimitQx, m_accelLimitQx);
-    m_velocityMove = true;
-    m_altVelLimitQx = 0;
-    m_moveState = MS_START;
-    __enable_irq();
+    memset(m_shaperHistory, 0, m_shaperLength * sizeof(m_shaperHistory[0]));
+    m_shaperFract = 0;
+    m_shaperCarry = 0;
+    m_posnAbsolute = PosnWrap(m_posnAbsolute - m_shaperPending);
+    m_shaperPending = 0;
 }
 
 /*
-    This function takes the velocity in step pulses/sec
-    and sets VelLimitQx in step pulses/sample time.
+    Add the position loop's correction to this sample's steps.
+
+    The error is between the steps the motor should have taken, without the
+    corrections, and the feedback. The steps worked out in one sample are
+    sent during the next, so the feedback read this sample has seen the steps
+    up to the sample before the last. The last sample's steps are left out of
+    the error, and the correction still on its way is taken off so it isn't
+    sent twice.
 */
-void StepGenerator::VelMax(uint32_t velMax) {
-    // Convert from step pulses/sec to step pulses/sample
-    int64_t velLim64 =
-        (static_cast<int64_t>(velMax) << FRACT_BITS) / SampleRateHz;
+ISR_RAMFUNC uint32_t StepGenerator::PositionLoopSteps(uint32_t steps) {
+    if (!m_loopOn) {
+        return steps;
+    }
+    int32_t moved = *m_loopFeedback - m_loopFeedbackBase;
+    int32_t actual = static_cast<int32_t>(
+                         static_cast<int64_t>(moved) * m_loop.StepsNum /
+                         m_loop.StepsDen);
+    int32_t error = m_loopSent - m_loopSentLast - actual;
+    m_loopError = error;
+
+    if (m_loop.FollowingErrorMax &&
+            static_cast<uint32_t>(abs(error)) > m_loop.FollowingErrorMax) {
+        m_loopOn = false;
+        m_loopErrorReached = true;
+        MoveStopAbrupt();
+        return 0;
+    }
+
+    int32_t signedSteps = m_direction ? -static_cast<int32_t>(steps)
+                                      : static_cast<int32_t>(steps);
+    int32_t correction = 0;
+    int32_t pending = error - m_loopCorrectionLast;
+    if (abs(pending) > m_loop.Deadband) {
+        correction = pending * m_loop.GainPercent / 100;
+        correction = max(min(correction,
+                             static_cast<int32_t>(m_loop.CorrectionMax)),
+                         -static_cast<int32_t>(m_loop.CorrectionMax));
+    }
+
+    int32_t out = signedSteps + correction;
+    int32_t outMax = m_stepsPerSampleMax;
+    if (m_moveState != MS_IDLE || m_stepsExternalActive) {
+        // Stay with the move's direction
+        if (m_direction) {
+            out = max(min(out, 0), -outMax);
+        }
+        else {
+            out = min(max(out, 0), outMax);
+        }
+    }
+    else {
+        out = max(min(out, outMax), -outMax);
+        if (out && (out < 0) != m_direction) {
+            m_direction = out < 0;
+            OutputDirection();
+        }
+    }
+
+    m_loopCorrectionLast = out - signedSteps;
+    m_loopSentLast = signedSteps;
+    m_loopSent += signedSteps;
+    return abs(out);
+}
+
+/*
+    Step along the PVT stream.
+
+    Each segment is a cubic Hermite curve that meets the position and
+    velocity of the points at both of its ends. The curve is evaluated
+    directly from the sample index rather than by accumulating differences so
+    rounding can't build up over a long segment.
+*/
+void StepGenerator::PvtStep() {
+    if (!m_pvtSegmentActive) {
+        uint8_t tail = m_pvtQueueTail;
+        if (tail == atomic_load_n(&m_pvtQueueHead)) {
+            m_stepsPrevious = 0;
+            m_velCurrentQx = 0;
+            if (m_pvtVelEnd != 0) {
+                // Ran out of points while moving; ramp to a stop
+                m_pvtUnderflowCount++;
+                PvtStopDecel();
+            }
+            else if (m_pvtEnding) {
+                m_moveState = MS_END;
+            }
+            return;
+        }
+
+        const PvtPoint &point = m_pvtQueue[tail & (PVT_QUEUE_LENGTH - 1)];
+        float samples = point.Samples;
+        float dist = static_cast<float>(point.Posn - m_pvtPosnEnd);
+        float velStartDist = m_pvtVelEnd * samples;
+        float velEndDist = point.Vel * samples;
+        m_pvtPosnStart = m_pvtPosnEnd;
+        m_pvtPosnEnd = point.Posn;
+        m_pvtVelEnd = point.Vel;
+        m_pvtC1 = velStartDist;
+        m_pvtC2 = 3.0f * dist - 2.0f * velStartDist - velEndDist;
+        m_pvtC3 = velStartDist + velEndDist - 2.0f * dist;
+        m_pvtSampleTime = 1.0f / samples;
+        m_pvtSample = 0;
+        m_pvtSamples = point.Samples;
+        m_pvtSegmentActive = true;
+        atomic_store_n(&m_pvtQueueTail, static_cast<uint8_t>(tail + 1));
+    }
+
+    int32_t target;
+    if (++m_pvtSample >= m_pvtSamples) {
+        target = m_pvtPosnEnd;
+        m_pvtSegmentActive = false;
+    }
+    else {
+        float t = m_pvtSample * m_pvtSampleTime;
+        target = m_pvtPosnStart +
+                 static_cast<int32_t>(
+                     lroundf(((m_pvtC3 * t + m_pvtC2) * t + m_pvtC1) * t));
+    }
+
+    // Trail the stream rather than exceed the step rate limit
+    int32_t steps = AbsoluteDistance(target, m_posnAbsolute,
+                                     MOVE_TARGET_ABSOLUTE);
+    int32_t stepsMax = m_stepsPerSampleMax;
+    steps = max(min(steps, stepsMax), -stepsMax);
+    m_velCurrentQx = abs(steps) << FRACT_BITS;
+    m_stepsExternal = steps;
+    StepsExternalOutput();
+}
+
+/*
+    Ramp down from the current PVT velocity.
+*/
+void StepGenerator::PvtStopDecel() {
+    float vel = m_pvtVelEnd;
+    if (m_pvtSegmentActive) {
+        // Derivative of the segment curve at the current sample
+        float t = m_pvtSample * m_pvtSampleTime;
+        vel = ((3.0f * m_pvtC3 * t + 2.0f * m_pvtC2) * t + m_pvtC1) *
+              m_pvtSampleTime;
+    }
+    m_pvtSegmentActive = false;
+    m_pvtQueueTail = m_pvtQueueHead;
+    StopDecelFrom(vel);
+}
+
+/*
+    Send this sample's share of the encoder motion.
+*/
+void StepGenerator::GearStep() {
+    int32_t counts = *m_gearSource;
+    int32_t divisor = m_gearDenominator;
+    if (m_gearSmoothing > 1) {
+        // Send the average of the last few samples. Each count is in the
+        // sum for m_gearSmoothing samples, so scaling the divisor by the
+        // same amount sends all of it.
+        uint8_t index = m_gearHistoryIndex;
+        m_gearHistorySum += counts - m_gearHistory[index];
+        m_gearHistory[index] = counts;
+        m_gearHistoryIndex = (index + 1 < m_gearSmoothing) ? index + 1 : 0;
+        counts = m_gearHistorySum;
+        divisor *= m_gearSmoothing;
+    }
+    int64_t countsScaled = static_cast<int64_t>(counts) * m_gearNumerator;
+    m_gearRemainder += max(min(countsScaled, INT32_MAX / 2), -INT32_MAX / 2);
+    int32_t steps = m_gearRemainder / divisor;
+
+    // Trail the encoder rather than exceed the step rate limit
+    int32_t stepsMax = m_stepsPerSampleMax;
+    steps = max(min(steps, stepsMax), -stepsMax);
+    m_gearRemainder -= steps * divisor;
+    // Bound the backlog so a long overspeed can't overflow the remainder
+    m_gearRemainder = max(min(m_gearRemainder, INT32_MAX / 2), -INT32_MAX / 2);
+    if (m_softLimitsOn && !m_rotaryModulus) {
+        int32_t stepsClamped = SoftLimitClamp(steps);
+        if (stepsClamped != steps) {
+            // Drop the motion past the limit along with any backlog, so
+            // the axis follows as soon as the encoder turns back
+            steps = stepsClamped;
+            m_gearRemainder = 0;
+        }
+    }
+
+    m_followStepsLast = steps;
+    m_velCurrentQx = abs(steps) << FRACT_BITS;
+    m_stepsExternal = steps;
+    StepsExternalOutput();
+}
+
+/*
+    Move the slave to the cam table position for the current master position.
+
+    The master rarely crosses more than one table point per sample, so the
+    segment search starts from last sample's segment and the cost stays flat
+    regardless of table size.
+*/
+void StepGenerator::CamStep() {
+    const CamPoint *points = m_cam.Points;
+    const CamPoint &first = points[0];
+    const CamPoint &last = points[m_cam.Count - 1];
+    int32_t period = last.Master - first.Master;
+    int32_t master = *m_camMaster - m_camMasterBase;
+
+    if (m_cam.Cyclic) {
+        if (master >= period || master < 0) {
+            // One divide however far the master jumped, such as when its
+            // position is reset while the cam runs
+            int32_t advance = last.Slave - first.Slave;
+            int64_t wraps = master / period;
+            if (master % period < 0) {
+                wraps--;
+            }
+            int32_t masterWrap = static_cast<int32_t>(wraps * period);
+            master -= masterWrap;
+            m_camMasterBase += masterWrap;
+            m_camSlaveBase += static_cast<int32_t>(wraps * advance);
+            m_camIndex = wraps > 0 ? 0 : m_cam.Count - 2;
+        }
+    }
+    else {
+        master = max(min(master, period), 0);
+    }
+
+    // Find the segment containing the master position
+    master += first.Master;
+    uint16_t index = m_camIndex;
+    while (index < m_cam.Count - 2 && master >= points[index + 1].Master) {
+        index++;
+    }
+    while (index > 0 && master < points[index].Master) {
+        index--;
+    }
+    m_camIndex = index;
+
+    const CamPoint &start = points[index];
+    const CamPoint &end = points[index + 1];
+    int32_t slave = start.Slave +
+                    static_cast<int32_t>(
+                        static_cast<int64_t>(end.Slave - start.Slave) *
+                        (master - start.Master) / (end.Master - start.Master));
+    int32_t target = m_camSlaveBase + slave - first.Slave;
+
+    // Trail the cam rather than exceed the step rate limit
+    int32_t steps = AbsoluteDistance(target, m_posnAbsolute,
+                                     MOVE_TARGET_ABSOLUTE);
+    int32_t stepsMax = m_stepsPerSampleMax;
+    steps = max(min(steps, stepsMax), -stepsMax);
+
+    m_followStepsLast = steps;
+    m_velCurrentQx = abs(steps) << FRACT_BITS;
+    m_stepsExternal = steps;
+    StepsExternalOutput();
+}
+
+/*
+    Hand a velocity that was produced outside of the profile generator to the
+    profile generator as a velocity move to zero so it ramps to a stop.
+*/
+void StepGenerator::StopDecelFrom(float vel) {
+    bool direction = vel < 0;
+    if (direction != m_direction) {
+        m_direction = direction;
+        OutputDirection();
+    }
+    int32_t velLimitQx = m_stepsPerSampleMax << FRACT_BITS;
+    m_velCurrentQx = min(static_cast<int32_t>(fabsf(vel) * (1 << FRACT_BITS)),
+                         velLimitQx);
+    m_posnCurrentQx = 0;
+    m_stepsSent = 0;
+    m_stepsCommanded = INT32_MAX;
+    m_dirCommanded = direction;
+    m_accelLimitQx = max(m_altDecelLimitQx, m_accelLimitQx);
+    m_jerkLimitQx = 0;
+    m_velocityMove = true;
+    m_altVelLimitQx = 0;
+    m_movePlanReady = false;
+    m_moveState = MS_START;
+}
+
+/*
+    Advance a jerk-limited velocity ramp by one sample.
+
+    Each sample, pick the highest accel level (one above, equal to, or one
+    below the current level) that still allows the acceleration to be ramped
+    back down to zero without overshooting the remaining velocity change.
+    Ramping down from level L adds L + (L-1) + ... + 1 jerk increments of
+    velocity, so the test needs no division.
+*/
+void StepGenerator::SCurveRampStep(int32_t velRemainingQx, bool increasing) {
+    int64_t velRemainingExt =
+        static_cast<int64_t>(max(velRemainingQx, 0)) << JERK_FRACT_BITS;
+    uint32_t level = min(m_accelLevel + 1, m_accelLevelMax);
+    // Only step down one level per sample to keep the jerk bounded. Always
+    // keep some acceleration while a velocity change remains so the ramp
+    // can't stall short of its target.
+    uint32_t levelMin = (m_accelLevel > 1) ? m_accelLevel - 1 : 1;
+
+    while (level > levelMin &&
+            m_jerkStepQx * (static_cast<int64_t>(level) * (level + 1) / 2) >
+            velRemainingExt) {
+        level--;
+    }
+    m_accelLevel = level;
+
+    int64_t accelExt = m_jerkStepQx * m_accelLevel;
+    m_accelCurrentQx = accelExt >> JERK_FRACT_BITS;
+
+    int64_t velExt = (static_cast<int64_t>(m_velCurrentQx) << JERK_FRACT_BITS) +
+                     m_velFractQx;
+    if (increasing) {
+        m_posnCurrentQx += m_velCurrentQx + (m_accelCurrentQx >> 1);
+        velExt += accelExt;
+    }
+    else {
+        m_posnCurrentQx += m_velCurrentQx - (m_accelCurrentQx >> 1);
+        velExt -= accelExt;
+    }
+    m_velCurrentQx = velExt >> JERK_FRACT_BITS;
+    m_velFractQx = velExt & ((1UL << JERK_FRACT_BITS) - 1);
+}
+
+/*
+    Compute how far a move with the given limits travels while stopping from
+    velocity velQx.
+
+    For a jerk-limited profile with accel limit A and jerk J the stop takes
+        v * (v / A + A / J) / 2     if the ramp reaches A (v >= A^2 / J)
+        v * sqrt(v / J)             otherwise.
+    A / J is the number of samples it takes to ramp to the accel limit.
+*/
+int64_t StepGenerator::StopDistanceQx(int32_t velQx, int32_t accelLimitQx,
+                                      int32_t jerkLimitQx, int64_t jerkStepQx,
+                                      uint32_t accelLevelMax) {
+    if (!jerkLimitQx) {
+        return (static_cast<int64_t>(velQx) * velQx / accelLimitQx) >> 1;
+    }
+    float vel = velQx;
+    float accel = accelLimitQx;
+    float jerk = static_cast<float>(jerkStepQx) / (1UL << JERK_FRACT_BITS);
+    float rampSamples = static_cast<float>(accelLevelMax);
+    float dist;
+    if (vel >= accel * rampSamples) {
+        dist = vel * (vel / accel + rampSamples) * 0.5f;
+    }
+    else {
+        dist = vel * sqrtf(vel / jerk);
+    }
+    return static_cast<int64_t>(dist);
+}
+
+/*
+    Solve for the peak velocity of a symmetric jerk-limited move that covers
+    distQx (twice StopDistanceQx(peak) == distQx).
+*/
+int32_t StepGenerator::SCurvePeakVelocityQx(int64_t distQx,
+                                            const MovePlan &plan) {
+    float dist = static_cast<float>(distQx);
+    float accel = plan.AccelLimitQx;
+    float jerk = static_cast<float>(plan.JerkStepQx) / (1UL << JERK_FRACT_BITS);
+    float rampSamples = static_cast<float>(plan.AccelLevelMax);
+    // Ramp reaches the accel limit: v^2 / A + v * A / J = dist
+    float velRamp = accel * rampSamples;
+    float vel = (sqrtf(velRamp * velRamp + 4.0f * accel * dist) - velRamp) *
+                0.5f;
+    if (vel < velRamp) {
+        // Ramp never reaches the accel limit: 2 * v^(3/2) / sqrt(J) = dist
+        vel = cbrtf(dist * dist * jerk * 0.25f);
+    }
+    int64_t vel64 = static_cast<int64_t>(vel);
+    return static_cast<int32_t>(max(min(vel64, INT32_MAX), 1));
+}
+
+/*
+    Work out how a move starts: the ramp parameters, the target velocity, and
+    the phase to enter from the current velocity and position.
+*/
+void StepGenerator::MovePlanCompute(MovePlan &plan, int32_t velQx,
+                                    int64_t posnQx, bool direction) {
+    if (plan.JerkLimitQx) {
+        // Split the acceleration limit into a whole number of jerk
+        // increments so the ramp lands exactly on the limit without
+        // exceeding the requested jerk.
+        int64_t accelLimitQx =
+            static_cast<int64_t>(plan.AccelLimitQx) << JERK_FRACT_BITS;
+        // Very low jerk limits are capped at a ramp of ~13 seconds to
+        // keep the ramp sums below from overflowing.
+        int64_t levels = (accelLimitQx + plan.JerkLimitQx - 1) /
+                         plan.JerkLimitQx;
+        plan.AccelLevelMax = max(min(levels, UINT16_MAX), 1);
+        plan.JerkStepQx = accelLimitQx / plan.AccelLevelMax;
+    }
+    else {
+        plan.AccelLevelMax = 1;
+        plan.JerkStepQx = 0;
+    }
+    plan.PosnTargetQx = static_cast<int64_t>(plan.StepsCommanded)
+                        << FRACT_BITS;
+    plan.Direction = direction;
+    plan.DirectionOutput = false;
+
+    if (plan.VelocityMove) {
+        if (plan.AltVelLimitQx && velQx &&
+                direction != plan.DirCommanded) {
+            plan.VelTargetQx = 0;
+            plan.DirChange = true;
+        }
+        else {
+            plan.VelTargetQx = plan.AltVelLimitQx;
+            plan.DirChange = false;
+        }
+        if (plan.VelTargetQx) {
+            // Notify the system of the direction of the issued move
+            // if moving to a non-zero velocity
+            plan.Direction = plan.DirCommanded;
+            plan.DirectionOutput = true;
+        }
+
+        if (velQx == plan.VelTargetQx) {
+            // Already at the correct velocity
+            plan.State = MS_CRUISE;
+        }
+        else if (velQx > plan.VelTargetQx) {
+            // Decelerate to reach the target velocity
+            plan.State = MS_DECEL_VEL;
+        }
+        else {
+            // Accelerate to reach the target velocity
+            plan.State = MS_ACCEL;
+        }
+        return;
+    }
+
+    if (velQx) {
+        // Currently moving, check for a change in direction
+        if (direction == plan.DirCommanded) {
+            // A direction change is also needed if we overshoot our target
+            // position. The distance to stop is how many steps it will take
+            // to slow to 0 velocity. If the number of commanded steps is less
+            // than that, we cannot stop in time and must overshoot and come
+            // back.
+            int64_t distToStopQx =
+                StopDistanceQx(velQx, plan.AccelLimitQx,
+                               plan.JerkLimitQx, plan.JerkStepQx,
+                               plan.AccelLevelMax);
+            plan.DirChange =
+                plan.PosnTargetQx - posnQx < distToStopQx;
+        }
+        else {
+            plan.DirChange = true;
+        }
+    }
+    else {
+        plan.DirChange = false;
+        plan.Direction = plan.DirCommanded;
+        // Notify the system of the direction of the issued move
+        plan.DirectionOutput = plan.PosnTargetQx != posnQx;
+    }
+
+    if (plan.DirChange) {
+        plan.State = MS_DECEL_VEL;
+        plan.VelTargetQx = 0;
+        return;
+    }
+
+    // If the move profile is a triangle (i.e. doesn't reach VelLimit), set
+    // the velocity limit to peak velocity so that trapezoid logic can be
+    // used.
+    // The maximum triangle move distance =
+    //     VelLimit * (AccelSamples + DecelSamples) / 2 = V*V/A
+    // Account for the steps that would have been used to accelerate to the
+    // current velocity.
+    int64_t accelStepsQx =
+        StopDistanceQx(velQx, plan.AccelLimitQx, plan.JerkLimitQx,
+                       plan.JerkStepQx, plan.AccelLevelMax);
+    if (plan.JerkLimitQx) {
+        // The jerk-limited ramps don't have a closed form that fits the
+        // trapezoid math below; solve for the peak velocity of a symmetric
+        // S-curve instead.
+        if (2 * StopDistanceQx(plan.VelLimitQx, plan.AccelLimitQx,
+                               plan.JerkLimitQx, plan.JerkStepQx,
+                               plan.AccelLevelMax) - accelStepsQx >
+                plan.PosnTargetQx) {
+            plan.VelTargetQx =
+                SCurvePeakVelocityQx(plan.PosnTargetQx + accelStepsQx, plan);
+        }
+        else {
+            plan.VelTargetQx = plan.VelLimitQx;
+        }
+    }
+    else if (static_cast<int64_t>(plan.VelLimitQx) * plan.VelLimitQx /
+             plan.AccelLimitQx - accelStepsQx > plan.PosnTargetQx) {
+        // Multiplication by 2^FRACT_BITS to preserve Q-format
+        int64_t vel64 = static_cast<int64_t>(sqrtf(static_cast<float>(
+                            (plan.PosnTargetQx + accelStepsQx) *
+                            plan.AccelLimitQx)));
+        // A zero length move, such as one clamped at a software limit,
+        // still needs a non-zero velocity to finish
+        plan.VelTargetQx = static_cast<int32_t>(max(min(vel64, INT32_MAX), 1));
+    }
+    else {
+        plan.VelTargetQx = plan.VelLimitQx;
+    }
+
+    if (velQx > plan.VelTargetQx) {
+        // Decelerate to reach the target velocity
+        plan.State = MS_DECEL_VEL;
+    }
+    else {
+        // Accelerate to reach the target velocity
+        plan.State = MS_ACCEL;
+    }
+}
+
+/*
+    The samples it takes to change the velocity by velChangeQx with a plan's
+    limits: the inverse of the ramps StopDistanceQx() measures.
+*/
+float StepGenerator::RampSamples(float velChangeQx, const MovePlan &plan) {
+    float accel = plan.AccelLimitQx;
+    if (!plan.JerkLimitQx) {
+        return velChangeQx / accel;
+    }
+    float jerk = static_cast<float>(plan.JerkStepQx) / (1UL << JERK_FRACT_BITS);
+    float rampSamples = static_cast<float>(plan.AccelLevelMax);
+    if (velChangeQx >= accel * rampSamples) {
+        return velChangeQx / accel + rampSamples;
+    }
+    return 2.0f * sqrtf(velChangeQx / jerk);
+}
+
+/*
+    Add the ramp to the plan's target velocity, the cruise, and the stop at
+    the target of a move starting at velQx and posnQx. Both kinds of ramp are
+    symmetric, so each covers the distance of its mean velocity.
+*/
+void StepGenerator::MovePreviewPhases(const MovePlan &plan, int32_t velQx,
+                                      int64_t posnQx, MovePreviewInfo &info) {
+    float vel = velQx;
+    float velTarget = plan.VelTargetQx;
+    float accelSamples = RampSamples(fabsf(velTarget - vel), plan);
+    float decelSamples = RampSamples(velTarget, plan);
+    float cruiseDist = static_cast<float>(plan.PosnTargetQx - posnQx) -
+                       (vel + velTarget) * 0.5f * accelSamples -
+                       velTarget * 0.5f * decelSamples;
+
+    info.AccelSamples = static_cast<uint32_t>(ceilf(accelSamples));
+    info.CruiseSamples =
+        (cruiseDist > 0) ? static_cast<uint32_t>(ceilf(cruiseDist / velTarget))
+        : 0;
+    info.DecelSamples = static_cast<uint32_t>(ceilf(decelSamples));
+}
+
+/*
+    Start a move from its plan. Only copies, so starting a move costs the
+    same whether or not it was planned in the main loop.
+*/
+ISR_RAMFUNC void StepGenerator::MovePlanApply(const MovePlan &plan) {
+    m_accelCurrentQx = m_accelLimitQx;
+    if (m_jerkLimitQx) {
+        m_accelLevelMax = plan.AccelLevelMax;
+        m_jerkStepQx = plan.JerkStepQx;
+        m_accelLevel = 0;
+        m_velFractQx = 0;
+    }
+    m_posnTargetQx = plan.PosnTargetQx;
+    m_velTargetQx = plan.VelTargetQx;
+    m_moveDirChange = plan.DirChange;
+    m_direction = plan.Direction;
+    if (plan.DirectionOutput) {
+        OutputDirection();
+    }
+    m_moveState = plan.State;
+}
+
+/*
+    Fill in a command's limits, and plan it in the main loop if the axis is
+    idle and no command is waiting ahead of it. Nothing the plan reads
+    changes while the axis is idle, so the plan holds until the axis moves,
+    which MoveCommandApply() checks.
+*/
+void StepGenerator::MoveCommandPrepare(MoveCommand &command,
+                                       bool velocityMove) {
+    MovePlan &plan = command.Plan;
+    plan.VelocityMove = velocityMove;
+    plan.VelLimitQx = m_velLimitPendingQx;
+    plan.AltVelLimitQx = m_altVelLimitPendingQx;
+    plan.AccelLimitQx = m_accelLimitPendingQx;
+    plan.JerkLimitQx = m_jerkLimitPendingQx;
+    command.AltDecelLimitQx = m_altDecelLimitPendingQx;
+
+    command.PlanEpoch = m_movePlanEpoch;
+    command.Planned = !__get_IPSR() && m_moveState == MS_IDLE &&
+                      m_moveCommandHead == atomic_load_n(&m_moveCommandTail);
+    if (!command.Planned) {
+        return;
+    }
+    if (velocityMove) {
+        plan.StepsCommanded = INT32_MAX;
+        plan.DirCommanded = command.Value < 0;
+    }
+    else {
+        MoveLatchSteps(command.Value, command.Target, plan.StepsCommanded,
+                       plan.DirCommanded);
+    }
+    MovePlanCompute(plan);
+}
+
+void StepGenerator::MoveCommandIssue(const MoveCommand &command) {
+    uint8_t head = m_moveCommandHead;
+    if (!__get_IPSR() &&
+            static_cast<uint8_t>(head - atomic_load_n(&m_moveCommandTail)) <
+            MOVE_COMMAND_LENGTH) {
+        m_moveCommands[head & (MOVE_COMMAND_LENGTH - 1)] = command;
+        // Publish the command to the interrupt
+        atomic_store_n(&m_moveCommandHead, static_cast<uint8_t>(head + 1));
+        return;
+    }
+    // Apply the command now, after the commands ahead of it
+    __disable_irq();
+    MoveCommandsTake();
+    MoveCommandApply(command);
+    __enable_irq();
+}
+
+ISR_RAMFUNC void StepGenerator::MoveCommandsTake() {
+    uint8_t tail = m_moveCommandTail;
+    while (tail != atomic_load_n(&m_moveCommandHead)) {
+        MoveCommandApply(m_moveCommands[tail & (MOVE_COMMAND_LENGTH - 1)]);
+        tail++;
+        atomic_store_n(&m_moveCommandTail, tail);
+    }
+}
+
+ISR_RAMFUNC void StepGenerator::MoveCommandApply(const MoveCommand &command) {
+    // The axis was handed to a MotionGroup or a follow mode since
+    if (Following()) {
+        return;
+    }
+    bool idle = m_moveState == MS_IDLE;
+    const MovePlan &plan = command.Plan;
+
+    // A directly commanded move replaces anything that was queued
+    m_moveQueueTail = m_moveQueueHead;
+    if (plan.VelocityMove) {
+        m_dirCommanded = command.Value < 0;
+        m_velocityMove = true;
+        m_stepsCommanded = INT32_MAX;
+        m_posnCurrentQx &= ~(UINT64_MAX << FRACT_BITS);
+        m_stepsSent = 0;
+    }
+    else {
+        MoveLatch(command.Value, command.Target);
+    }
+    m_velLimitQx = plan.VelLimitQx;
+    m_altVelLimitQx = plan.AltVelLimitQx;
+    m_accelLimitQx = plan.AccelLimitQx;
+    m_altDecelLimitQx = command.AltDecelLimitQx;
+    m_jerkLimitQx = plan.JerkLimitQx;
+
+    // The plan holds if the axis stayed idle since it was made, and it was
+    // made for the move just latched
+    m_movePlanReady = command.Planned && idle &&
+                      command.PlanEpoch == m_movePlanEpoch &&
+                      plan.StepsCommanded == m_stepsCommanded &&
+                      plan.DirCommanded == m_dirCommanded;
+    if (m_movePlanReady) {
+        m_movePlan = plan;
+    }
+    m_moveState = MS_START;
+}
+
+/*
+    Pull the next move out of the queue if the active move is done, or if
+    blending and the active move is about to start decelerating into a
+    junction that continues in the same direction.
+*/
+void StepGenerator::MoveQueueService() {
+    uint8_t tail = m_moveQueueTail;
+    if (tail == atomic_load_n(&m_moveQueueHead)) {
+        return;
+    }
+    const QueuedMove &next = m_moveQueue[tail & (MOVE_QUEUE_LENGTH - 1)];
+
+    switch (m_moveState) {
+        case MS_IDLE:
+        case MS_END:
+            m_limitInfo.LimitRampPos = false;
+            m_limitInfo.LimitRampNeg = false;
+            break;
+        case MS_CRUISE:
+        case MS_DECEL: {
+            if (!m_moveQueueBlending || m_velocityMove) {
+                return;
+            }
+            // Wait until the decel would begin during this sample
+            if (m_moveState == MS_CRUISE &&
+                    m_posnCurrentQx + m_velCurrentQx < m_posnDecelQx) {
+                return;
+            }
+            // Only blend moves that continue in the same direction
+            int32_t stepsRemaining = m_stepsCommanded - m_stepsSent;
+            int32_t endPosn = m_posnAbsolute +
+                              (m_direction ? -stepsRemaining : stepsRemaining);
+            int32_t dist = (next.Target == MOVE_TARGET_REL_END_POSN) ?
+                           next.Dist :
+                           AbsoluteDistance(next.Dist, endPosn, next.Target);
+            if (!dist || ((dist < 0) != m_direction)) {
+                return;
+            }
+            break;
+        }
+        default:
+            return;
+    }
+
+    MoveLatch(next.Dist, next.Target);
+    m_velLimitQx = next.VelLimitQx;
+    m_accelLimitQx = next.AccelLimitQx;
+    m_jerkLimitQx = next.JerkLimitQx;
+    m_altVelLimitQx = m_altVelLimitPendingQx;
+    m_altDecelLimitQx = m_altDecelLimitPendingQx;
+    m_movePlanReady = false;
+    m_moveState = MS_START;
+
+    atomic_store_n(&m_moveQueueTail, static_cast<uint8_t>(tail + 1));
+}
+
+/*
+    Default constructor
+*/
+StepGenerator::StepGenerator()
+    : m_stepsPrevious(0),
+      m_stepsPerSampleMax(0),
+      m_moveState(MS_IDLE),
+      m_direction(false),
+      m_lastMoveWasPositional(true),
+	  m_limitInfo(),
+      m_posnAbsolute(0),
+      m_rotaryModulus(0),
+      m_softLimitNeg(0),
+      m_softLimitPos(0),
+      m_softLimitsOn(false),
+      m_stepsExternalActive(false),
+      m_stepsExternal(0),
+      m_stepsExternalCarry(0),
+      m_stepsExternalStop(EXTERNAL_STOP_NONE),
+      m_gantryLeader(nullptr),
+      m_gantryOn(false),
+      m_gantryHold(false),
+      m_gantrySkew(0),
+      m_gantrySkewApplied(0),
+      m_gearSource(nullptr),
+      m_moveQueueHead(0),
+      m_moveQueueTail(0),
+      m_moveQueueBlending(false),
+      m_pvtQueueHead(0),
+      m_pvtQueueTail(0),
+      m_pvtEnding(false),
+      m_pvtUnderflowCount(0),
+      m_pvtSegmentActive(false),
+      m_pvtPosnStart(0),
+      m_pvtPosnEnd(0),
+      m_pvtVelEnd(0),
+      m_pvtC1(0),
+      m_pvtC2(0),
+      m_pvtC3(0),
+      m_pvtSampleTime(0),
+      m_pvtSample(0),
+      m_pvtSamples(0),
+      m_gearNumerator(1),
+      m_gearDenominator(1),
+      m_gearRemainder(0),
+      m_gearHistory(),
+      m_gearHistorySum(0),
+      m_gearHistoryIndex(0),
+      m_gearSmoothing(1),
+      m_followStepsLast(0),
+      m_cam(),
+      m_camMaster(nullptr),
+      m_camMasterBase(0),
+      m_camSlaveBase(0),
+      m_camIndex(0),
+      m_compTable(nullptr),
+      m_compBacklash(0),
+      m_compLastNeg(false),
+      m_compApplied(0),
+      m_shaperOn(false),
+      m_shaperHistory(nullptr),
+      m_shaperLength(0),
+      m_shaperIndex(0),
+      m_shaperDelay(0),
+      m_shaperImpulses(0),
+      m_shaperAmp(),
+      m_shaperFract(0),
+      m_shaperCarry(0),
+      m_shaperPending(0),
+      m_overrideOn(false),
+      m_overrideTargetQ15(1L << FRACT_BITS),
+      m_overrideQ15(1L << FRACT_BITS),
+      m_overrideSteps(0),
+      m_overrideLeftQ15(0),
+      m_overrideFract(0),
+      m_overrideCarry(0),
+      m_overrideHeld(0),
+      m_loopOn(false),
+      m_loopErrorReached(false),
+      m_loop(),
+      m_loopFeedback(nullptr),
+      m_loopFeedbackBase(0),
+      m_loopSent(0),
+      m_loopSentLast(0),
+      m_loopCorrectionLast(0),
+      m_loopError(0),
+      m_moveCommands(),
+      m_moveCommandHead(0),
+      m_moveCommandTail(0),
+      m_movePlan(),
+      m_movePlanReady(false),
+      m_movePlanEpoch(0),
+      m_staged(false),
+      m_stagedVelocity(false),
+      m_stagedValue(0),
+      m_stagedTarget(MOVE_TARGET_REL_END_POSN),
+      m_stepsCommanded(0),
+      m_stepsSent(0),
+      m_velocityMove(false),
+      m_moveDirChange(false),
+      m_dirCommanded(false),
+      m_velLimitQx(1),
+      m_altVelLimitQx(0),
+      m_accelLimitQx(2),
+      m_altDecelLimitQx(2),
+      m_posnCurrentQx(0),
+      m_velCurrentQx(0),
+      m_accelCurrentQx(0),
+      m_posnTargetQx(0),
+      m_velTargetQx(0),
+      m_posnDecelQx(0),
+      m_jerkLimitQx(0),
+      m_jerkStepQx(0),
+      m_accelLevel(0),
+      m_accelLevelMax(1),
+      m_velFractQx(0),
+      m_velLimitPendingQx(1),
+      m_altVelLimitPendingQx(0),
+      m_accelLimitPendingQx(2),
+      m_altDecelLimitPendingQx(2),
+      m_jerkLimitPendingQx(0) {}
+
+/*
+    This function clears the current move and puts the motor in a
+    move idle state without disabling it or clearing the position.
+
+    This may cause an abrupt stop.
+*/
+void StepGenerator::MoveStopAbrupt() {
+    if (m_stepsExternalActive) {
+        // Let the MotionGroup stop all of its axes
+        m_stepsExternalStop = EXTERNAL_STOP_ABRUPT;
+    }
+    // Block the interrupt while changing the command
+    __disable_irq();
+    MoveCommandsTake();
+    m_moveQueueTail = m_moveQueueHead;
+    m_pvtQueueTail = m_pvtQueueHead;
+    m_pvtSegmentActive = false;
+    m_posnCurrentQx = 0;
+    m_velCurrentQx = 0;
+    m_velFractQx = 0;
+    m_accelLevel = 0;
+    m_stepsSent = 0;
+    m_moveState = MS_IDLE;
+    m_velocityMove = false;
+    m_stepsCommanded = 0;
+    m_stepsPrevious = 0;
+    // Stop now rather than at the end of the shaper
+    InputShaperFlush();
+    FeedOverrideFlush();
+    UpdatePendingMoveLimits();
+    __enable_irq();
+}
+
+/*
+    This function commands a directional move.
+
+    The function will return true if the move was accepted.
+*/
+bool StepGenerator::Move(int32_t dist, MoveTarget moveTarget) {
+    if (Following()) {
+        return false;
+    }
+
+    MoveCommand command;
+    command.Value = dist;
+    command.Target = moveTarget;
+    MoveCommandPrepare(command, false);
+    MoveCommandIssue(command);
+    return true;
+}
+
+/*
+    Plan a positional move the way MoveCommandApply() would if it were issued
+    now, and break the plan into its phases.
+*/
+bool StepGenerator::MovePreview(int32_t dist, MovePreviewInfo &info,
+                                MoveTarget moveTarget) {
+    info = MovePreviewInfo();
+    if (Following()) {
+        return false;
+    }
+
+    MovePlan plan;
+    plan.VelocityMove = false;
+    plan.VelLimitQx = m_velLimitPendingQx;
+    plan.AltVelLimitQx = m_altVelLimitPendingQx;
+    plan.AccelLimitQx = m_accelLimitPendingQx;
+    plan.JerkLimitQx = m_jerkLimitPendingQx;
+
+    // Take the motion state of a single sample. Starting the move zeroes
+    // the integer part of the position, as MoveLatch() does.
+    __disable_irq();
+    MoveLatchSteps(dist, moveTarget, plan.StepsCommanded, plan.DirCommanded);
+    int32_t velQx = m_velCurrentQx;
+    int64_t posnQx = m_posnCurrentQx & ~(UINT64_MAX << FRACT_BITS);
+    bool direction = m_direction;
+    __enable_irq();
+
+    MovePlanCompute(plan, velQx, posnQx, direction);
+    if (plan.DirChange) {
+        // Stop in the current direction, then plan the rest of the move
+        // from rest as the MS_CHANGE_DIR state does
+        info.ReverseSamples =
+            static_cast<uint32_t>(ceilf(RampSamples(velQx, plan)));
+        posnQx += StopDistanceQx(velQx, plan.AccelLimitQx, plan.JerkLimitQx,
+                                 plan.JerkStepQx, plan.AccelLevelMax);
+        int32_t stepsStopped = posnQx >> FRACT_BITS;
+        if (direction == plan.DirCommanded) {
+            plan.StepsCommanded = stepsStopped - plan.StepsCommanded;
+        }
+        else {
+            plan.StepsCommanded += stepsStopped;
+        }
+        plan.DirCommanded = !direction;
+        velQx = 0;
+        posnQx &= ~(UINT64_MAX << FRACT_BITS);
+        MovePlanCompute(plan, velQx, posnQx, direction);
+    }
+    MovePreviewPhases(plan, velQx, posnQx, info);
+
+    info.TotalSamples = info.ReverseSamples + info.AccelSamples +
+                        info.CruiseSamples + info.DecelSamples;
+    info.DurationMs = (info.TotalSamples + MS_TO_SAMPLES - 1) / MS_TO_SAMPLES;
+    int32_t velPeak = (static_cast<int64_t>(plan.VelTargetQx) * SampleRateHz +
+                       (1 << (FRACT_BITS - 1))) >> FRACT_BITS;
+    info.VelPeak = plan.DirCommanded ? -velPeak : velPeak;
+    return true;
+}
+
+/*
+    This function sets up the step counts for a directional move.
+*/
+void StepGenerator::MoveLatch(int32_t dist, MoveTarget moveTarget) {
+    MoveLatchSteps(dist, moveTarget, m_stepsCommanded, m_dirCommanded);
+
+    // Zero out the steps and integer portion of current position to
+    // reduce chance of overflow
+    m_stepsSent = 0;
+
+    // Zero the integer portion of the current position. We want to keep
+    // partial steps so movement is smooth.
+    m_posnCurrentQx = m_posnCurrentQx & ~(UINT64_MAX << FRACT_BITS);
+
+    m_velocityMove = false;
+}
+
+/*
+    This function works out the step count and direction of a directional
+    move from the current command.
+*/
+void StepGenerator::MoveLatchSteps(int32_t dist, MoveTarget moveTarget,
+                                   int32_t &steps, bool &dir) {
+    // Make relative moves be based off of current position during a velocity
+    // move
+    int32_t stepsCommanded = m_velocityMove ? 0 : m_stepsCommanded;
+    int32_t stepsSent = m_velocityMove ? 0 : m_stepsSent;
+    switch (moveTarget) {
+        case MOVE_TARGET_ABSOLUTE:
+        case MOVE_TARGET_ABSOLUTE_POS:
+        case MOVE_TARGET_ABSOLUTE_NEG:
+            stepsCommanded = AbsoluteDistance(dist, m_posnAbsolute,
+                                              moveTarget);
+            break;
+        case MOVE_TARGET_REL_END_POSN:
+        default:
+            // relative end posn
+            // m_stepsCommanded += (newDir ? -dist : dist);
+            // Since the steps scale is relative to start of move to prevent
+            // overflow, the scale shifts by the number of steps taken
+            // So account for this, the current steps should be taken off of the
+            // previous commanded amount, then the new command should be added
+            // The steps send are in the direction of the commanded steps, subtract
+            // that first. Steps taken is always less than commanded, result (+)
+            stepsCommanded -= stepsSent;
+            // Convert magnitude + direction format to signed int
+            stepsCommanded = m_direction ? -stepsCommanded : stepsCommanded;
+            // Now stepsCommanded and distance are signed and in the global
+            // direction. Add them
+            stepsCommanded += dist;
+            // Steps commanded and dir will be calculated later.
+            break;
+    }
+
+    if (m_softLimitsOn && !m_rotaryModulus) {
+        stepsCommanded = SoftLimitClamp(stepsCommanded);
+    }
+
+    // Determine the direction of the movements.
+    dir = stepsCommanded < 0;
+
+    // Steps commanded now needs to be a positive value.
+    steps = abs(stepsCommanded);
+}
+
+/*
+    This function appends a directional move to the move queue, or starts it
+    right away if nothing is in progress.
+
+    The function will return true if the move was accepted.
+*/
+bool StepGenerator::MoveQueueAdd(int32_t dist, MoveTarget moveTarget) {
+    if (Following()) {
+        return false;
+    }
+
+    // Plan the move in case it starts right away
+    MoveCommand command;
+    command.Value = dist;
+    command.Target = moveTarget;
+    MoveCommandPrepare(command, false);
+
+    __disable_irq();
+    MoveCommandsTake();
+    if (m_moveState == MS_IDLE && m_moveQueueTail == m_moveQueueHead) {
+        MoveCommandApply(command);
+        __enable_irq();
+        return true;
+    }
+    __enable_irq();
+
+    uint8_t head = m_moveQueueHead;
+    if (static_cast<uint8_t>(head - atomic_load_n(&m_moveQueueTail)) >=
+            MOVE_QUEUE_LENGTH) {
+        return false;
+    }
+    QueuedMove &entry = m_moveQueue[head & (MOVE_QUEUE_LENGTH - 1)];
+    entry.Dist = dist;
+    entry.Target = moveTarget;
+    entry.VelLimitQx = m_velLimitPendingQx;
+    entry.AccelLimitQx = m_accelLimitPendingQx;
+    entry.JerkLimitQx = m_jerkLimitPendingQx;
+    // Publish the entry to the interrupt
+    atomic_store_n(&m_moveQueueHead, static_cast<uint8_t>(head + 1));
+    return true;
+}
+
+void StepGenerator::PositionRefSet(int32_t posn) {
+    // Let absolute moves already issued latch against the old reference
+    __disable_irq();
+    MoveCommandsTake();
+    m_posnAbsolute = PosnWrap(posn);
+    __enable_irq();
+}
+
+bool StepGenerator::RotaryModulus(int32_t countsPerRev) {
+    if (countsPerRev < 0 || !StepsComplete()) {
+        return false;
+    }
+    __disable_irq();
+    m_rotaryModulus = countsPerRev;
+    m_posnAbsolute = PosnWrap(m_posnAbsolute);
+    __enable_irq();
+    return true;
+}
+
+bool StepGenerator::PositionLoopStart(const PositionLoop &loop,
+                                      volatile const int32_t &feedback) {
+    if (!loop.StepsNum || !loop.StepsDen || !loop.GainPercent ||
+            loop.GainPercent > 100) {
+        return false;
+    }
+    // Turn the loop off while it is set up
+    m_loopOn = false;
+    m_loop = loop;
+    m_loopFeedback = &feedback;
+    m_loopFeedbackBase = feedback;
+    m_loopSent = 0;
+    m_loopSentLast = 0;
+    m_loopCorrectionLast = 0;
+    m_loopError = 0;
+    m_loopErrorReached = false;
+    atomic_store_n(&m_loopOn, true);
+    return true;
+}
+
+bool StepGenerator::FollowingErrorReached() {
+    return atomic_exchange_n(&m_loopErrorReached, false);
+}
+
+bool StepGenerator::InputShaperStart(ShaperType type, float freqHz,
+                                     float damping, int16_t *history,
+                                     uint16_t length) {
+    if (m_shaperOn || !history || !(freqHz > 0) || !(damping >= 0) ||
+            !(damping < 1) || m_moveState != MS_IDLE ||
+            m_stepsExternalActive) {
+        return false;
+    }
+    // The impulses are half a period of the damped ringing apart
+    float root = sqrtf(1.0f - damping * damping);
+    float delay = SampleRateHz / (2.0f * freqHz * root);
+    uint8_t impulses = (type == SHAPER_ZVD) ? 3 : 2;
+    // The history must reach the last impulse at the delay actually used
+    if (!(delay >= 0.5f) || delay > length) {
+        return false;
+    }
+    uint16_t delaySamples = static_cast<uint16_t>(delay + 0.5f);
+    if ((impulses - 1) * static_cast<uint32_t>(delaySamples) + 1 > length) {
+        return false;
+    }
+
+    float k = expf(-damping * static_cast<float>(M_PI) / root);
+    float scale = (type == SHAPER_ZVD) ? (1.0f + k) * (1.0f + k)
+                                        : 1.0f + k;
+    float amps[3] = {1.0f, (type == SHAPER_ZVD) ? 2.0f * k : k, k * k};
+    // Round the later impulses and give the first whatever is left, so the
+    // amplitudes add up to exactly one
+    int32_t ampFirst = 1L << FRACT_BITS;
+    for (uint8_t i = 1; i < impulses; i++) {
+        m_shaperAmp[i] = static_cast<int32_t>(
+                             amps[i] / scale * (1L << FRACT_BITS) + 0.5f);
+        ampFirst -= m_shaperAmp[i];
+    }
+    m_shaperAmp[0] = ampFirst;
+
+    memset(history, 0, length * sizeof(history[0]));
+    m_shaperHistory = history;
+    m_shaperLength = length;
+    m_shaperIndex = 0;
+    m_shaperDelay = delaySamples;
+    m_shaperImpulses = impulses;
+    m_shaperFract = 0;
+    m_shaperCarry = 0;
+    m_shaperPending = 0;
+    atomic_store_n(&m_shaperOn, true);
+    return true;
+}
+
+bool StepGenerator::InputShaperStop() {
+    __disable_irq();
+    bool idle = m_moveState == MS_IDLE && !m_stepsExternalActive &&
+                !m_shaperPending;
+    if (idle) {
+        m_shaperOn = false;
+    }
+    __enable_irq();
+    return idle;
+}
+
+bool StepGenerator::SoftLimits(int32_t negLimit, int32_t posLimit) {
+    if (negLimit >= posLimit) {
+        return false;
+    }
+    __disable_irq();
+    m_softLimitNeg = negLimit;
+    m_softLimitPos = posLimit;
+    m_softLimitsOn = true;
+    __enable_irq();
+    return true;
+}
+
+int32_t StepGenerator::SoftLimitClamp(int32_t dist) {
+    int64_t posn = m_posnAbsolute;
+    // Never push further out from a position already past a limit
+    int64_t high = max(static_cast<int64_t>(m_softLimitPos), posn);
+    int64_t low = min(static_cast<int64_t>(m_softLimitNeg), posn);
+    int64_t end = max(min(posn + dist, high), low);
+    return static_cast<int32_t>(end - posn);
+}
+
+/*
+    Velocity moves have no end to clamp, so the stop is started once the
+    distance to stop comes within two samples of the limit. Positional moves
+    end within the limits already, but one issued near a limit at speed
+    might not be able to stop in time, and would overshoot and come back.
+    The limit is checked against the commanded position, so either way the
+    move is replanned as a stop at the limit, with a harder decel if the
+    move's own can't make it. A move already slowing to reverse keeps going
+    and only gets the harder decel.
+*/
+ISR_RAMFUNC void StepGenerator::SoftLimitsCheck() {
+    if (!m_softLimitsOn || m_rotaryModulus || !m_velCurrentQx) {
+        return;
+    }
+    bool reversing = false;
+    switch (m_moveState) {
+        case MS_ACCEL:
+        case MS_CRUISE:
+            break;
+        case MS_DECEL_VEL:
+            reversing = m_moveDirChange;
+            // Otherwise positional moves only slow down here on the way to
+            // a target already within the limits
+            if (reversing || m_velocityMove) {
+                break;
+            }
+            return;
+        default:
+            return;
+    }
+
+    int64_t posn = m_posnAbsolute;
+    int64_t distSteps = m_direction ? posn - m_softLimitNeg
+                                    : m_softLimitPos - posn;
+    distSteps = max(min(distSteps, INT32_MAX), 0);
+    int64_t distQx = distSteps << FRACT_BITS;
+    int64_t stopQx = StopDistanceQx(m_velCurrentQx);
+
+    if (reversing) {
+        if (stopQx > distQx) {
+            // Finish this ramp without jerk limiting, hard enough to stop
+            // at the limit; the reversed move starts with its own decel
+            int64_t accelQx = static_cast<int64_t>(m_velCurrentQx);
+            if (distQx) {
+                accelQx = accelQx * m_velCurrentQx / (2 * distQx) + 1;
+            }
+            m_accelCurrentQx = min(max(accelQx, m_accelCurrentQx), INT32_MAX);
+            m_jerkLimitQx = 0;
+        }
+        return;
+    }
+    int64_t marginQx = 2 * static_cast<int64_t>(m_velCurrentQx);
+    if (m_velocityMove ? stopQx + marginQx < distQx
+                       : stopQx <= distQx + marginQx) {
+        return;
+    }
+
+    if (!distSteps) {
+        // At or past the limit already; stop without another step
+        m_velCurrentQx = 0;
+        m_accelCurrentQx = 0;
+        m_moveState = MS_END;
+        return;
+    }
+
+    // Replan as a positional move that ends at the limit, without speeding
+    // up on the way
+    m_stepsSent = 0;
+    m_posnCurrentQx = 0;
+    m_stepsCommanded = static_cast<int32_t>(distSteps);
+    m_dirCommanded = m_direction;
+    m_velocityMove = false;
+    m_velLimitQx = min(m_velLimitQx, m_velCurrentQx);
+
+    if (StopDistanceQx(m_velCurrentQx) > distQx) {
+        // Decelerate harder than the move's limits to stop in time
+        int64_t accelQx = static_cast<int64_t>(m_velCurrentQx) *
+                          m_velCurrentQx / (2 * distQx) + 1;
+        m_accelLimitQx = min(max(accelQx, m_accelLimitQx), INT32_MAX);
+        m_jerkLimitQx = 0;
+    }
+    m_movePlanReady = false;
+    m_moveState = MS_START;
+}
+
+int32_t StepGenerator::AbsoluteDistance(int32_t target, int32_t posn,
+                                        MoveTarget moveTarget) {
+    int32_t modulus = m_rotaryModulus;
+    if (!modulus) {
+        return target - posn;
+    }
+    int32_t dist = static_cast<int32_t>(
+                       (static_cast<int64_t>(target) - posn) % modulus);
+    if (dist < 0) {
+        dist += modulus;
+    }
+    switch (moveTarget) {
+        case MOVE_TARGET_ABSOLUTE_POS:
+            return dist;
+        case MOVE_TARGET_ABSOLUTE_NEG:
+            return dist ? dist - modulus : 0;
+        default:
+            return dist > modulus / 2 ? dist - modulus : dist;
+    }
+}
+
+void StepGenerator::MoveQueueClear() {
+    __disable_irq();
+    MoveCommandsTake();
+    m_moveQueueTail = m_moveQueueHead;
+    __enable_irq();
+}
+
+bool StepGenerator::MoveStage(int32_t dist, MoveTarget moveTarget) {
+    if (Following()) {
+        return false;
+    }
+    // Keep the interrupt from starting a half-written move
+    m_staged = false;
+    m_stagedVelocity = false;
+    m_stagedValue = dist;
+    m_stagedTarget = moveTarget;
+    atomic_store_n(&m_staged, true);
+    return true;
+}
+
+bool StepGenerator::MoveVelocityStage(int32_t velocity) {
+    if (Following()) {
+        return false;
+    }
+    m_staged = false;
+    m_stagedVelocity = true;
+    m_stagedValue = velocity;
+    atomic_store_n(&m_staged, true);
+    return true;
+}
+
+void StepGenerator::MoveStagedStart() {
+    if (!m_staged) {
+        return;
+    }
+    m_staged = false;
+    if (m_stagedVelocity) {
+        MoveVelocity(m_stagedValue);
+    }
+    else {
+        Move(m_stagedValue, m_stagedTarget);
+    }
+}
+
+bool StepGenerator::CompensationTable(const CompTable *table) {
+    if (table && (table->Count < 2 || !table->Corrections ||
+            table->SpacingShift > 30)) {
+        return false;
+    }
+    m_compTable = table;
+    return true;
+}
+
+/*
+    This function commands a velocity move.
+    If there is a current move, it will be overwritten.
+*/
+bool StepGenerator::MoveVelocity(int32_t velocity) {
+    if (Following()) {
+        return false;
+    }
+
+    int32_t velAbsolute = abs(velocity);
+    AltVelMax(velAbsolute);
+
+    MoveCommand command;
+    command.Value = velocity;
+    command.Target = MOVE_TARGET_REL_END_POSN;
+    MoveCommandPrepare(command, true);
+    MoveCommandIssue(command);
+    return true;
+}
+
+bool StepGenerator::PvtStreamStart() {
+    if (m_stepsExternalActive) {
+        return false;
+    }
+
+    __disable_irq();
+    MoveCommandsTake();
+    if (m_moveState != MS_IDLE) {
+        __enable_irq();
+        return false;
+    }
+    m_moveQueueTail = m_moveQueueHead;
+    m_pvtQueueTail = m_pvtQueueHead;
+    m_pvtEnding = false;
+    m_pvtUnderflowCount = 0;
+    m_pvtSegmentActive = false;
+    // The stream starts at rest from the current position
+    m_pvtPosnEnd = m_posnAbsolute;
+    m_pvtVelEnd = 0;
+    m_lastMoveWasPositional = true;
+    UpdatePendingMoveLimits();
+    m_moveState = MS_PVT;
+    __enable_irq();
+    return true;
+}
+
+bool StepGenerator::GearingStart(int16_t numerator, uint16_t denominator) {
+    if (!m_gearSource || !denominator || m_stepsExternalActive) {
+        return false;
+    }
+
+    __disable_irq();
+    MoveCommandsTake();
+    if (m_moveState != MS_IDLE && m_moveState != MS_GEAR) {
+        __enable_irq();
+        return false;
+    }
+    if (m_moveState == MS_IDLE) {
+        m_moveQueueTail = m_moveQueueHead;
+        m_gearRemainder = 0;
+        m_gearHistorySum = 0;
+        m_gearHistoryIndex = 0;
+        for (uint8_t i = 0; i < GEAR_SMOOTHING_MAX; i++) {
+            m_gearHistory[i] = 0;
+        }
+        m_followStepsLast = 0;
+        UpdatePendingMoveLimits();
+    }
+    else {
+        // Keep the leftover fraction when changing the ratio on the fly
+        m_gearRemainder =
+            static_cast<int64_t>(m_gearRemainder) * denominator /
+            m_gearDenominator;
+    }
+    m_gearNumerator = numerator;
+    m_gearDenominator = denominator;
+    m_moveState = MS_GEAR;
+    __enable_irq();
+    return true;
+}
+
+bool StepGenerator::GearingSmoothing(uint8_t samples) {
+    if (!samples || samples > GEAR_SMOOTHING_MAX || m_moveState == MS_GEAR) {
+        return false;
+    }
+    m_gearSmoothing = samples;
+    return true;
+}
+
+bool StepGenerator::CamStart(const CamTable &cam,
+                             volatile const int32_t &masterPosn) {
+    if (!cam.Points || cam.Count < 2 || m_stepsExternalActive ||
+            static_cast<int64_t>(cam.Points[cam.Count - 1].Master) -
+            cam.Points[0].Master > INT32_MAX) {
+        return false;
+    }
+    for (uint16_t i = 1; i < cam.Count; i++) {
+        if (cam.Points[i].Master <= cam.Points[i - 1].Master) {
+            return false;
+        }
+    }
+
+    __disable_irq();
+    MoveCommandsTake();
+    if (m_moveState != MS_IDLE) {
+        __enable_irq();
+        return false;
+    }
+    m_moveQueueTail = m_moveQueueHead;
+    m_cam = cam;
+    m_camMaster = &masterPosn;
+    m_camMasterBase = masterPosn;
+    m_camSlaveBase = m_posnAbsolute;
+    m_camIndex = 0;
+    m_followStepsLast = 0;
+    UpdatePendingMoveLimits();
+    m_moveState = MS_CAM;
+    __enable_irq();
+    return true;
+}
+
+bool StepGenerator::PvtPointAdd(int32_t posn, int32_t vel,
+                                uint16_t durationMs) {
+    if (!durationMs || m_moveState != MS_PVT) {
+        return false;
+    }
+    uint8_t head = m_pvtQueueHead;
+    if (static_cast<uint8_t>(head - atomic_load_n(&m_pvtQueueTail)) >=
+            PVT_QUEUE_LENGTH) {
+        return false;
+    }
+    PvtPoint &point = m_pvtQueue[head & (PVT_QUEUE_LENGTH - 1)];
+    point.Posn = posn;
+    point.Vel = static_cast<float>(vel) / SampleRateHz;
+    point.Samples = max(static_cast<uint32_t>(durationMs) * SampleRateHz / 1000,
+                        1UL);
+    // Publish the point to the interrupt
+    atomic_store_n(&m_pvtQueueHead, static_cast<uint8_t>(head + 1));
+    return true;
+}
+
+void StepGenerator::MoveStopDecel(uint32_t decelMax) {
+    if (m_stepsExternalActive) {
+        // Let the MotionGroup ramp all of its axes to a stop
+        if (m_stepsExternalStop == EXTERNAL_STOP_NONE) {
+            m_stepsExternalStop = EXTERNAL_STOP_DECEL;
+        }
+        return;
+    }
+    if (decelMax != 0) {
+        EStopDecelMax(decelMax);
+        m_altDecelLimitQx = m_altDecelLimitPendingQx;
+    }
+    __disable_irq();
+    MoveCommandsTake();
+    if (m_moveState == MS_PVT) {
+        PvtStopDecel();
+        __enable_irq();
+        return;
+    }
+    if (m_moveState == MS_GEAR || m_moveState == MS_CAM) {
+        StopDecelFrom(m_followStepsLast);
+        __enable_irq();
+        return;
+    }
+    m_moveQueueTail = m_moveQueueHead;
+    m_accelLimitQx = max(m_altDecelLimitQx, m_accelLimitQx);
+    // Stop with a trapezoidal ramp to keep the stopping distance short
+    m_jerkLimitQx = 0;
+    m_velocityMove = true;
+    m_altVelLimitQx = 0;
+    m_movePlanReady = false;
+    m_moveState = MS_START;
+    __enable_irq();
+}
+
+/*
+    This function takes the velocity in step pulses/sec
+    and sets VelLimitQx in step pulses/sample time.
+*/
+void StepGenerator::VelMax(uint32_t velMax) {
+    // Convert from step pulses/sec to step pulses/sample
+    int64_t velLim64 =
+        (static_cast<int64_t>(velMax) << FRACT_BITS) / SampleRateHz;
     // Enforce the max steps per sample time
     velLim64 =
         min(velLim64, static_cast<int64_t>(m_stepsPerSampleMax) << FRACT_BITS);
@@ -529,7 +2249,11 @@ void StepGenerator::AltVelMax(int32_t velMax) {
 int32_t StepGenerator::VelocityRefCommanded() {
     // Reverse the calculation in AltVelMax to get the velocity in the same
     // units that the user put in. Add half a decimal for rounding.
-    int32_t velTemp = ((static_cast<int64_t>(m_velCurrentQx) * SampleRateHz +
+    int64_t velQx = m_velCurrentQx;
+    if (m_overrideOn) {
+        velQx = (velQx * m_overrideQ15) >> FRACT_BITS;
+    }
+    int32_t velTemp = ((velQx * SampleRateHz +
                         (1 << (FRACT_BITS - 1))) >> FRACT_BITS);
     return m_direction ? -velTemp : velTemp;
 }
@@ -570,6 +2294,26 @@ void StepGenerator::EStopDecelMax(uint32_t decelMax) {
     m_altDecelLimitPendingQx = max(decelQx, m_accelLimitQx);
 }
 
+/*
+    This function takes the jerk in step pulses/sec^3 and sets
+    m_jerkLimitPendingQx in step pulses/sample^3, with JERK_FRACT_BITS
+    additional fractional bits.
+*/
+void StepGenerator::JerkMax(uint32_t jerkMax) {
+    if (!jerkMax) {
+        m_jerkLimitPendingQx = 0;
+        return;
+    }
+    uint64_t samplesCubed = static_cast<uint64_t>(SampleRateHz) *
+                            SampleRateHz * SampleRateHz;
+    uint64_t jerkLim64 = (static_cast<uint64_t>(jerkMax) <<
+                          (FRACT_BITS + JERK_FRACT_BITS)) / samplesCubed;
+    // Ensure we didn't overflow 32-bit int
+    jerkLim64 = min(jerkLim64, static_cast<uint64_t>(INT32_MAX));
+    // Enforce a non-zero jerk so the profile stays jerk limited
+    m_jerkLimitPendingQx = max(jerkLim64, 1ULL);
+}
+
 /*
     This function limits the velocity to the maximum that the step output
     can provide.
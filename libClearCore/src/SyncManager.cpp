@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    ClearCore multi-board sample tick synchronization
+**/
+
+#include "SyncManager.h"
+#include <sam.h>
+#include <stdlib.h>
+#include "InputManager.h"
+#include "MotorManager.h"
+#include "SysTiming.h"
+#include "SysUtils.h"
+
+namespace ClearCore {
+
+// The sync pulse runs above the sample rate interrupt so the sample timer is
+// read close to the edge.
+#define EIC_SYNC_INTERRUPT_PRIORITY 1
+#define EIC_INTERRUPT_PRIORITY 7
+
+// Per pulse, correct half of the phase error over the next sync period and
+// integrate an eighth of it into the rate
+#define SYNC_PHASE_GAIN_DIV (2 * SAMPLE_SYNC_PERIOD_SAMPLES)
+#define SYNC_RATE_GAIN_DIV (8 * SAMPLE_SYNC_PERIOD_SAMPLES)
+#define SYNC_TRIM_MAX_Q16 (SAMPLE_SYNC_TRIM_MAX << 16)
+
+extern MotorManager &MotorMgr;
+
+SyncManager &SyncMgr = SyncManager::Instance();
+
+SyncManager &SyncManager::Instance() {
+    static SyncManager *instance = new SyncManager();
+    return *instance;
+}
+
+SyncManager::SyncManager()
+    : m_mode(SYNC_OFF),
+      m_output(nullptr),
+      m_input(nullptr),
+      m_extInt(-1),
+      m_sampleCount(0),
+      m_samplesSinceEdge(0),
+      m_phaseError(0),
+      m_rateQ16(0),
+      m_trimQ16(0),
+      m_trimAccQ16(0),
+      m_lockEdges(0),
+      m_locked(false) {}
+
+bool SyncManager::MasterStart(DigitalInOut &output) {
+    if (output.Mode() != Connector::OUTPUT_DIGITAL) {
+        return false;
+    }
+    Stop();
+    output.State(false);
+    m_output = &output;
+    m_sampleCount = 0;
+    m_mode = SYNC_MASTER;
+    return true;
+}
+
+bool SyncManager::SlaveStart(DigitalIn &input) {
+    int8_t extInt = input.ExternalInterrupt();
+    if (extInt < 0) {
+        return false;
+    }
+    Stop();
+    m_input = &input;
+    m_extInt = extInt;
+    m_samplesSinceEdge = 0;
+    m_phaseError = 0;
+    m_rateQ16 = 0;
+    m_trimQ16 = 0;
+    m_trimAccQ16 = 0;
+    m_lockEdges = 0;
+    // Keep a shortened sample from cutting off the last step
+    MotorMgr.StepsTrimSet(SAMPLE_SYNC_TRIM_MAX);
+    m_mode = SYNC_SLAVE;
+
+    NVIC_SetPriority((IRQn_Type)(EIC_0_IRQn + extInt),
+                     EIC_SYNC_INTERRUPT_PRIORITY);
+    if (!input.InterruptHandlerSet(EdgeIsr, InputManager::RISING, true)) {
+        Stop();
+        return false;
+    }
+    return true;
+}
+
+void SyncManager::Stop() {
+    SyncModes mode = m_mode;
+    m_mode = SYNC_OFF;
+    m_locked = false;
+
+    if (mode == SYNC_MASTER) {
+        m_output->State(false);
+    }
+    else if (mode == SYNC_SLAVE) {
+        m_input->InterruptHandlerSet(nullptr, InputManager::RISING, false);
+        NVIC_SetPriority((IRQn_Type)(EIC_0_IRQn + m_extInt),
+                         EIC_INTERRUPT_PRIORITY);
+        __disable_irq();
+        TCC0->PERBUF.reg = MotorMgr.m_samplePeriod - 1;
+        TCC1->PERBUF.reg = MotorMgr.m_samplePeriod - 1;
+        __enable_irq();
+        MotorMgr.StepsTrimSet(0);
+    }
+}
+
+float SyncManager::RateTrimPpm() {
+    return static_cast<float>(m_rateQ16) * (1000000.0f / 65536.0f) /
+           MotorMgr.m_samplePeriod;
+}
+
+ISR_RAMFUNC void SyncManager::Update() {
+    switch (m_mode) {
+        case SYNC_MASTER:
+            if (m_sampleCount == 0) {
+                m_output->State(true);
+            }
+            else if (m_sampleCount == 1) {
+                m_output->State(false);
+            }
+            if (++m_sampleCount >= SAMPLE_SYNC_PERIOD_SAMPLES) {
+                m_sampleCount = 0;
+            }
+            break;
+        case SYNC_SLAVE: {
+            if (m_samplesSinceEdge <
+                    SAMPLE_SYNC_TIMEOUT_PERIODS * SAMPLE_SYNC_PERIOD_SAMPLES) {
+                m_samplesSinceEdge++;
+            }
+            else {
+                // Lost the master; hold its last rate until it returns
+                m_locked = false;
+                m_lockEdges = 0;
+                m_trimQ16 = m_rateQ16;
+            }
+            // Dither whole counts to apply the fractional trim on average.
+            // The period buffer loads at the next overflow, so this trims the
+            // sample after this one.
+            m_trimAccQ16 += m_trimQ16;
+            int32_t trim = m_trimAccQ16 >> 16;
+            m_trimAccQ16 -= trim * 65536;
+            uint32_t period = MotorMgr.m_samplePeriod - 1 + trim;
+            TCC0->PERBUF.reg = period;
+            TCC1->PERBUF.reg = period;
+            break;
+        }
+        case SYNC_OFF:
+        default:
+            break;
+    }
+}
+
+void SyncManager::EdgeIsr() {
+    SyncMgr.Edge();
+}
+
+void SyncManager::Edge() {
+    // Read the timer before anything else
+    int32_t count = SysTiming::SampleTimerCount();
+    if (m_mode != SYNC_SLAVE) {
+        return;
+    }
+
+    // An edge late in the sample is early for the next one
+    int32_t period = MotorMgr.m_samplePeriod;
+    int32_t error = (count > period / 2) ? count - period : count;
+    m_phaseError = error;
+    m_samplesSinceEdge = 0;
+
+    // A slave ahead of the master sees the edge late in its own sample and
+    // lengthens its samples
+    int32_t rate = m_rateQ16 + error * 65536 / SYNC_RATE_GAIN_DIV;
+    m_rateQ16 = max(-SYNC_TRIM_MAX_Q16, min(rate, SYNC_TRIM_MAX_Q16));
+    int32_t trim = m_rateQ16 + error * 65536 / SYNC_PHASE_GAIN_DIV;
+    m_trimQ16 = max(-SYNC_TRIM_MAX_Q16, min(trim, SYNC_TRIM_MAX_Q16));
+
+    if (abs(error) > SAMPLE_SYNC_LOCK_COUNTS) {
+        m_lockEdges = 0;
+        m_locked = false;
+    }
+    else if (m_lockEdges < SAMPLE_SYNC_LOCK_EDGES) {
+        m_locked = ++m_lockEdges >= SAMPLE_SYNC_LOCK_EDGES;
+    }
+}
+
+} // ClearCore namespace
@@ -31,7 +31,13 @@
 #include <stddef.h>
 #include <stdio.h>
 #include "AdcManager.h"
+#include "AesManager.h"
+#include "atomic_utils.h"
+#include "CacheManager.h"
 #include "CcioBoardManager.h"
+#include "CommandBatch.h"
+#include "CrcManager.h"
+#include "DataLogger.h"
 #include "DigitalIn.h"
 #include "DigitalInAnalogIn.h"
 #include "DigitalInOut.h"
@@ -40,20 +46,30 @@
 #include "DmaManager.h"
 #include "EncoderInput.h"
 #include "EthernetManager.h"
+#include "EventManager.h"
 #include "HardwareMapping.h"
 #include "InputManager.h"
 #include "LedDriver.h"
+#include "LogicEngine.h"
+#include "MemoryManager.h"
 #include "MotorDriver.h"
 #include "MotorManager.h"
 #include "NvmManager.h"
+#include "ProcessImage.h"
+#include "PtpManager.h"
+#include "ReplayManager.h"
+#include "ScopeCapture.h"
 #include "SdCardDriver.h"
 #include "SerialDriver.h"
 #include "SerialUsb.h"
 #include "ShiftRegister.h"
 #include "StatusManager.h"
+#include "SyncManager.h"
 #include "SysConnectors.h"
 #include "SysTiming.h"
 #include "SysUtils.h"
+#include "TaskManager.h"
+#include "TraceManager.h"
 #include "UsbManager.h"
 #include "XBeeDriver.h"
 
@@ -67,37 +83,54 @@ bool FastSysTick = false;
 // Interrupt priority 0(High) - 7(Low)
 #define TONE_INTERRUPT_PRIORITY 2
 #define MAIN_INTERRUPT_PRIORITY 3
+#define DEFERRED_INTERRUPT_PRIORITY 5
 #define SYSTICK_INTERRUPT_PRIORITY 6
 #define EIC_INTERRUPT_PRIORITY 7
+#define ETHERNET_SERVICE_INTERRUPT_PRIORITY 7
 
 // These must match the bootloader!
 #define DOUBLE_TAP_MAGIC            0xf01669efUL
 #define BOOT_DOUBLE_TAP_ADDRESS     (HSRAM_ADDR + HSRAM_SIZE - 4)
 
-// EVSYS channel assignments
-enum _evSysCh {
-    // Motor HLFB event generators for period/pulse-width TC mode
-    EVSYS_M0,
-    EVSYS_M1,
-    EVSYS_M2,
-    EVSYS_M3
-};
+// Update stage profiling; compiles to nothing unless CLEARCORE_ISR_PROFILE
+#if CLEARCORE_ISR_PROFILE
+#define ISR_PROFILE_START() uint32_t isrStageCycle = DWT->CYCCNT
+#define ISR_PROFILE_STAGE(stage)                                               \
+    TimingMgr.IsrStageEnd(SysTiming::stage, isrStageCycle)
+#else
+#define ISR_PROFILE_START()
+#define ISR_PROFILE_STAGE(stage)
+#endif
 
 extern volatile uint32_t tickCnt;
 extern uint32_t NvmMgrUnlock;
 
 // Create our core system objects
 extern AdcManager &AdcMgr;
+extern AesManager &AesMgr;
+extern CacheManager &CacheMgr;
+extern DataLogger &DataLog;
 extern DmaManager &DmaMgr;
 extern EthernetManager &EthernetMgr;
 extern CcioBoardManager &CcioMgr;
+extern CcioBoardManager &CcioMgr1;
+extern CommandBatch &CmdBatch;
+extern CrcManager &CrcMgr;
 EncoderInput EncoderIn;
 extern InputManager &InputMgr;
+extern LogicEngine &LogicEng;
+extern MemoryManager &MemoryMgr;
 extern MotorManager &MotorMgr;
 extern NvmManager &NvmMgr;
+extern ProcessImage &ProcessImg;
+extern PtpManager &PtpMgr;
+extern ReplayManager &ReplayMgr;
+extern ScopeCapture &Scope;
 extern StatusManager &StatusMgr;
 extern UsbManager &UsbMgr;
+extern SyncManager &SyncMgr;
 extern SysTiming &TimingMgr;
+extern TaskManager &TaskMgr;
 SdCardDriver SdCard;
 ShiftRegister ShiftReg;
 XBeeDriver XBee;
@@ -141,6 +174,12 @@ extern MotorDriver *const MotorConnectors[MOTOR_CON_CNT] = {
 };
 
 SerialUsb    ConnectorUsb;
+#if CONF_USB_CDCD_ACM_PORTS > 1
+SerialUsb    ConnectorUsb1(1);
+#endif
+#if CONF_USB_CDCD_ACM_PORTS > 2
+SerialUsb    ConnectorUsb2(2);
+#endif
 SerialDriver ConnectorCOM0;
 SerialDriver ConnectorCOM1;
 
@@ -158,10 +197,28 @@ Connector *const Connectors[CLEARCORE_PIN_MAX] = {
     &ConnectorUsb
 };
 
+// The connectors with work to do in the sample rate refresh. The LED and
+// serial connectors have nothing to refresh, so they are never listed.
+uint32_t RefreshPinsWork = 0;
+// The configured connectors being refreshed, as a mask and in pin order
+uint32_t RefreshPinMask = 0;
+uint8_t RefreshPins[CLEARCORE_PIN_MAX];
+uint8_t RefreshPinCnt = 0;
+
+// IO-0 through DI-8 start up as digital inputs. Left in that mode, the
+// InputManager filter bank does all of their sample rate work.
+#define DEFAULT_INPUT_PINS ((1UL << (CLEARCORE_PIN_DI8 + 1)) - 1)
+
 /**
     Constructor
 **/
-SysManager::SysManager() : m_readyForOperations(false) {
+SysManager::SysManager()
+    : m_readyForOperations(false),
+      m_ledUpdateCnt(LED_UPDATE_SAMPLES),
+      m_bootStageEndUs{0},
+      m_bootReadyUs(0),
+      m_phyInitPending(false),
+      m_connectorsActive(0) {
     XBee = XBeeDriver(&XBee_CTS_IN, &XBee_RTS_OUT, &XBee_Rx_IN, &XBee_Tx_OUT,
                       PER_SERCOM_ALT);
     SdCard = SdCardDriver(&MicroSD_MISO, &MicroSD_SS, &MicroSD_SCK,
@@ -202,15 +259,15 @@ SysManager::SysManager() : m_readyForOperations(false) {
                                      &IN12n_AIN12, AdcManager::ADC_AIN12);
 
     ConnectorM0 = MotorDriver(ShiftRegister::SR_EN_OUT_0_MASK, &Mtr0_An_SCTx,
-                              &Mtr0_B, &Mtr0_HLFB_SCRx, 4, EVSYS_M0);
+                              &Mtr0_B, &Mtr0_HLFB_SCRx, 4, EVENT_HLFB_M0);
     ConnectorM1 = MotorDriver(ShiftRegister::SR_EN_OUT_1_MASK, &Mtr1_An,
-                              &Mtr1_B, &Mtr1_HLFB, 5, EVSYS_M1);
+                              &Mtr1_B, &Mtr1_HLFB, 5, EVENT_HLFB_M1);
     ConnectorM2 = MotorDriver(ShiftRegister::SR_EN_OUT_2_MASK,
                               &Mtr2_An_Sdrvr2_PWMA, &Mtr2_B_Sdrvr2_PWMB,
-                              &Mtr2_HLFB_Sdrvr2_Trig, 3, EVSYS_M2);
+                              &Mtr2_HLFB_Sdrvr2_Trig, 3, EVENT_HLFB_M2);
     ConnectorM3 = MotorDriver(ShiftRegister::SR_EN_OUT_3_MASK,
                               &Mtr3_An_Sdrvr3_PWMA, &Mtr3_B_Sdrvr3_PWMB,
-                              &Mtr3_HLFB_Sdrvr3_Trig, 0, EVSYS_M3);
+                              &Mtr3_HLFB_Sdrvr3_Trig, 0, EVENT_HLFB_M3);
 
     ConnectorCOM0 = SerialDriver(0, ShiftRegister::SR_LED_COM_0_MASK,
                                  ShiftRegister::SR_UART_SPI_SEL_0_MASK,
@@ -235,6 +292,11 @@ void SysManager::Initialize() {
 
     InitClocks();
 
+    // Cache flash reads now that the flash wait states are set
+    CacheMgr.Initialize();
+    // Paint the free RAM so the stack's high-water mark can be found
+    MemoryMgr.Initialize();
+
     // Enable brownout detection on the 3.3V rail. The default fuse value is 1.7
     // Set brownout detection to ~2.5V. Default from factory is 1.7V,
     // It appears that NVM can work to as low as 1.7V
@@ -259,20 +321,36 @@ void SysManager::Initialize() {
 
     PIN_CONFIGURATION(OutFault_04or05.gpioPort, OutFault_04or05.gpioPin,
                       PORT_PINCFG_INEN);
+    BootStageEnd(BOOT_STAGE_CLOCKS);
 
     InputMgr.Initialize();
 
+    RefreshPinsWork = 0;
     for (int32_t i = 0; i < CLEARCORE_PIN_MAX; i++) {
         Connectors[i]->Initialize(static_cast<ClearCorePins>(i));
+        switch (Connectors[i]->Type()) {
+            case Connector::SHIFT_REG_TYPE:
+            case Connector::SERIAL_TYPE:
+            case Connector::SERIAL_USB_TYPE:
+                break;
+            default:
+                RefreshPinsWork |= 1UL << i;
+                break;
+        }
     }
+    BootStageEnd(BOOT_STAGE_CONNECTORS);
 
     DmaMgr.Initialize();
+    CrcMgr.Initialize();
+    AesMgr.Initialize();
     MotorMgr.Initialize();
     ShiftReg.Initialize();
     AdcMgr.Initialize();
     CcioMgr.Initialize();
+    CcioMgr1.Initialize();
     UsbMgr.Initialize();
     EncoderIn.Initialize();
+    BootStageEnd(BOOT_STAGE_PERIPHERALS);
 
     // Configure external interrupt controller
     SET_CLOCK_SOURCE(EIC_GCLK_ID, 0);
@@ -293,9 +371,14 @@ void SysManager::Initialize() {
 
     NVIC_EnableIRQ(TCC0_0_IRQn); // Enable sample rate interrupt
     NVIC_SetPriority(TCC0_0_IRQn, MAIN_INTERRUPT_PRIORITY); // Set priority
+    // The sample rate interrupt pends PendSV for its deferred work
+    NVIC_SetPriority(PendSV_IRQn, DEFERRED_INTERRUPT_PRIORITY);
 
     NVIC_EnableIRQ(GMAC_IRQn);
     NVIC_SetPriority(GMAC_IRQn, MAIN_INTERRUPT_PRIORITY);
+    // Enabled by EthernetMgr.EventDriven()
+    NVIC_SetPriority(ETHERNET_SERVICE_IRQn,
+                     ETHERNET_SERVICE_INTERRUPT_PRIORITY);
 
     NVIC_EnableIRQ(TCC4_0_IRQn); // Enable IO4 tone interrupt
     NVIC_EnableIRQ(TCC3_0_IRQn); // Enable IO5 tone interrupt
@@ -311,44 +394,255 @@ void SysManager::Initialize() {
     }
     // Set priority for SysTick interrupt (2nd lowest).
     NVIC_SetPriority(SysTick_IRQn, SYSTICK_INTERRUPT_PRIORITY);
+    BootStageEnd(BOOT_STAGE_INTERRUPTS);
 
     // Run power-on tests and detect faults if any.
     StatusMgr.Initialize(ShiftRegister::SR_UNDERGLOW_MASK);
+#if CLEARCORE_FAST_BOOT
+    // The sample rate update steps the sweep while start-up carries on
+    ShiftReg.DiagnosticLedSweepStart();
+#else
+    ShiftReg.DiagnosticLedSweep();
+#endif
+    BootStageEnd(BOOT_STAGE_STATUS);
+
+    // The MAC does not need the PHY, so set it up during the PHY's cold start
+    EthernetMgr.Initialize();
+    BootStageEnd(BOOT_STAGE_ETHERNET);
 
-    // Ethernet PHY requires 300us + 10ms minimum for a cold startup.
-    while (Microseconds() < 10300) {
+#if CLEARCORE_FAST_BOOT
+    // Leave the PHY to the SysTick update once its cold start is over
+    m_phyInitPending = true;
+#else
+    while (Microseconds() < PHY_COLD_START_US) {
         continue;
     }
+    EthernetMgr.PhyInitialize();
+    BootStageEnd(BOOT_STAGE_PHY);
+#endif
 
-    EthernetMgr.Initialize();
+    // Start-up put every connector in its default mode. The filter bank
+    // covers the default digital inputs until the application configures
+    // them; everything else start-up configured stays refreshed. The sample
+    // rate refresh rebuilds its list from the active set.
+    atomic_and_fetch(&m_connectorsActive, ~DEFAULT_INPUT_PINS);
 
+    m_bootReadyUs = Microseconds();
     m_readyForOperations = true;
 }
 
+void SysManager::BootStageEnd(BootStages stage) {
+    m_bootStageEndUs[stage] = Microseconds();
+}
+
+uint32_t SysManager::BootStageUs(BootStages stage) {
+    if (stage >= BOOT_STAGE_COUNT || !m_bootStageEndUs[stage]) {
+        return 0;
+    }
+    return m_bootStageEndUs[stage] -
+           (stage ? m_bootStageEndUs[stage - 1] : 0);
+}
+
 /**
     Update systems at the sample rate
 **/
-void SysManager::UpdateFastImpl() {
+ISR_RAMFUNC void SysManager::UpdateFastImpl() {
+    ISR_PROFILE_START();
+    // Drive or follow the sync pulse first so its timing stays fixed
+    SyncMgr.Update();
+    // A replay feeds in the recorded inputs, and any batch due, ahead of
+    // everything that reads them
+    ReplayMgr.SampleBegin();
+    // Host command batches run at the start of the sample, so that their
+    // commands take effect together
+    CmdBatch.Update();
+    // Latched outputs change at a fixed point in the sample
+    ProcessImg.OutputsWriteApply();
+    // The chains' transfers run in the background side by side
     CcioMgr.Refresh();
+    CcioMgr1.Refresh();
+    ISR_PROFILE_STAGE(ISR_STAGE_CCIO);
     AdcMgr.Update();
+    ISR_PROFILE_STAGE(ISR_STAGE_ADC);
     StatusMgr.Refresh();
-    UsbMgr.Refresh();
+    ISR_PROFILE_STAGE(ISR_STAGE_STATUS);
     InputMgr.UpdateBegin();
+    ISR_PROFILE_STAGE(ISR_STAGE_INPUT_BEGIN);
+    // Read the encoder before the motors so geared axes follow it in the
+    // same sample
+    EncoderIn.Update();
+    ISR_PROFILE_STAGE(ISR_STAGE_ENCODER);
+    // Timestamp the sample, and run a PTP trigger before the motors refresh
+    PtpMgr.SampleUpdate();
 
     if (SysMgr.Ready()) {
-        for (uint8_t i = 0; i < CLEARCORE_PIN_MAX; i++) {
-            Connectors[i]->Refresh();
-        }
+        // Process loops command their outputs ahead of the motor refresh
+        AdcMgr.PidRefresh();
+        ISR_PROFILE_STAGE(ISR_STAGE_PID);
+        // Coordinated moves hand their axes this sample's steps first
+        MotorMgr.Refresh();
+        ISR_PROFILE_STAGE(ISR_STAGE_MOTOR_MGR);
+        InputMgr.FilterBankUpdate();
+        ConnectorsRefresh();
+        // Pulse the outputs whose trigger positions were reached
+        MotorMgr.CompareRefresh();
+        // Start a capture waiting on this sample's motion
+        AdcMgr.CaptureMotionCheck();
+        ISR_PROFILE_STAGE(ISR_STAGE_CONNECTORS);
     }
 
     InputMgr.UpdateEnd();
-    EncoderIn.Update();
+    ISR_PROFILE_STAGE(ISR_STAGE_INPUT_END);
+
+    // Interlocks act on this sample's inputs
+    LogicEng.Update();
+    ISR_PROFILE_STAGE(ISR_STAGE_LOGIC);
+
+    // Every input is current now; latch the process image
+    ProcessImg.Update();
+    ISR_PROFILE_STAGE(ISR_STAGE_PROC_IMAGE);
+    ReplayMgr.SampleEnd();
+
+    // Record this sample's state once everything has updated
+    DataLog.Sample();
+    ISR_PROFILE_STAGE(ISR_STAGE_DATA_LOG);
+    Scope.Sample();
+    ISR_PROFILE_STAGE(ISR_STAGE_SCOPE);
+    MotorMgr.SnapshotPublish();
+    ISR_PROFILE_STAGE(ISR_STAGE_SNAPSHOT);
 
-    // Update subsystems in the background
-    ShiftReg.Update();
     TimingMgr.Update();
+    ISR_PROFILE_STAGE(ISR_STAGE_TIMING);
 
     tickCnt++;
+
+    // Hand the housekeeping work to the lower priority deferred update
+    SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+}
+
+void SysManager::ConnectorActive(ClearCorePins pin, bool active) {
+    if (pin < 0 || pin >= CLEARCORE_PIN_MAX) {
+        return;
+    }
+    uint32_t pinMask = 1UL << pin;
+    if (active) {
+        if (!(m_connectorsActive & pinMask)) {
+            atomic_or_fetch(&m_connectorsActive, pinMask);
+        }
+    }
+    else if (m_connectorsActive & pinMask) {
+        atomic_and_fetch(&m_connectorsActive, ~pinMask);
+    }
+}
+
+/**
+    Refresh the connectors in the RefreshPins list, in the order of the
+    Connectors table
+**/
+ISR_RAMFUNC void SysManager::ConnectorsRefresh() {
+    // Rebuild the list when a connector was configured since the last
+    // sample, so the list never changes under a refresh
+    uint32_t active = m_connectorsActive & RefreshPinsWork;
+    if (active != RefreshPinMask) {
+        RefreshPinMask = active;
+        RefreshPinCnt = 0;
+        for (uint8_t pin = 0; pin < CLEARCORE_PIN_MAX; pin++) {
+            if (active & (1UL << pin)) {
+                RefreshPins[RefreshPinCnt++] = pin;
+            }
+        }
+    }
+
+    // Publish the idle inputs whose filters settled this sample
+    uint32_t settled = InputMgr.m_filterSettled & DEFAULT_INPUT_PINS & ~active;
+    while (settled) {
+        uint8_t pin = __builtin_ctz(settled);
+        settled &= settled - 1;
+        static_cast<DigitalIn *>(Connectors[pin])->UpdateFilterState();
+    }
+
+    for (uint8_t i = 0; i < RefreshPinCnt; i++) {
+        switch (RefreshPins[i]) {
+            case CLEARCORE_PIN_IO0:
+                ConnectorRefresh(ConnectorIO0);
+                break;
+            case CLEARCORE_PIN_IO1:
+                ConnectorRefresh(ConnectorIO1);
+                break;
+            case CLEARCORE_PIN_IO2:
+                ConnectorRefresh(ConnectorIO2);
+                break;
+            case CLEARCORE_PIN_IO3:
+                ConnectorRefresh(ConnectorIO3);
+                break;
+            case CLEARCORE_PIN_IO4:
+                ConnectorRefresh(ConnectorIO4);
+                break;
+            case CLEARCORE_PIN_IO5:
+                ConnectorRefresh(ConnectorIO5);
+                break;
+            case CLEARCORE_PIN_DI6:
+                ConnectorRefresh(ConnectorDI6);
+                break;
+            case CLEARCORE_PIN_DI7:
+                ConnectorRefresh(ConnectorDI7);
+                break;
+            case CLEARCORE_PIN_DI8:
+                ConnectorRefresh(ConnectorDI8);
+                break;
+            case CLEARCORE_PIN_A9:
+                ConnectorRefresh(ConnectorA9);
+                break;
+            case CLEARCORE_PIN_A10:
+                ConnectorRefresh(ConnectorA10);
+                break;
+            case CLEARCORE_PIN_A11:
+                ConnectorRefresh(ConnectorA11);
+                break;
+            case CLEARCORE_PIN_A12:
+                ConnectorRefresh(ConnectorA12);
+                break;
+            case CLEARCORE_PIN_M0:
+                ConnectorRefresh(ConnectorM0);
+                break;
+            case CLEARCORE_PIN_M1:
+                ConnectorRefresh(ConnectorM1);
+                break;
+            case CLEARCORE_PIN_M2:
+                ConnectorRefresh(ConnectorM2);
+                break;
+            case CLEARCORE_PIN_M3:
+                ConnectorRefresh(ConnectorM3);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+/**
+    Update housekeeping systems at SampleRateHz, after the fast update.
+**/
+void SysManager::UpdateDeferredImpl() {
+    ISR_PROFILE_START();
+    UsbMgr.Refresh();
+    ISR_PROFILE_STAGE(ISR_STAGE_USB);
+    // Step the blink codes and LED patterns at the LED update rate
+    if (!--m_ledUpdateCnt) {
+        m_ledUpdateCnt = LED_UPDATE_SAMPLES;
+        StatusMgr.BlinkCodeUpdate();
+        ShiftReg.PatternUpdate();
+    }
+    // Update the LED dimming and send the shift register
+    ShiftReg.Update();
+    ISR_PROFILE_STAGE(ISR_STAGE_SHIFT_REG);
+    // End the received serial frames whose idle gap has passed
+    if (m_connectorsActive & (1UL << CLEARCORE_PIN_COM0)) {
+        ConnectorCOM0.RxFrameRefresh();
+    }
+    if (m_connectorsActive & (1UL << CLEARCORE_PIN_COM1)) {
+        ConnectorCOM1.RxFrameRefresh();
+    }
 }
 
 /**
@@ -359,12 +653,41 @@ void SysManager::UpdateSlowImpl() {
         return;
     }
 
+    ISR_PROFILE_START();
+    if (m_phyInitPending && Microseconds() >= PHY_COLD_START_US) {
+        m_phyInitPending = false;
+        EthernetMgr.PhyInitialize();
+        BootStageEnd(BOOT_STAGE_PHY);
+    }
+
     // CCIO-8 Auto-Rediscover
     CcioMgr.RefreshSlow();
+    CcioMgr1.RefreshSlow();
+    ISR_PROFILE_STAGE(ISR_STAGE_CCIO_SLOW);
 
     for (uint8_t iMotor = 0; iMotor < MOTOR_CON_CNT; iMotor++) {
         MotorConnectors[iMotor]->RefreshSlow();
     }
+    ISR_PROFILE_STAGE(ISR_STAGE_MOTORS_SLOW);
+
+    // Queue the SPI polls that are due
+    ConnectorCOM0.SpiPollRefresh();
+    ConnectorCOM1.SpiPollRefresh();
+
+    // Ready the main loop tasks that are due
+    TaskMgr.Tick();
+
+    // Flag a main loop that has been stuck too long
+    TimingMgr.LoopStallCheck();
+
+    // Advance an asynchronous NVM write
+    NvmMgr.Refresh();
+
+    // Finish a background CRC
+    CrcMgr.Refresh();
+
+    // Run the Ethernet service interrupt when an LwIP timeout is due
+    EthernetMgr.ServiceTick();
 }
 
 Connector *SysManager::ConnectorByIndex(ClearCorePins theConnector) {
@@ -372,7 +695,8 @@ Connector *SysManager::ConnectorByIndex(ClearCorePins theConnector) {
         return Connectors[theConnector];
     }
     else {
-        return CcioMgr.PinByIndex(theConnector);
+        CcioBoardManager *chain = CcioBoardManager::ChainByPin(theConnector);
+        return chain ? chain->PinByIndex(theConnector) : NULL;
     }
 }
 
@@ -398,8 +722,10 @@ void SysManager::InitClocks() {
     for (int8_t iChannel = 0; iChannel < 6; iChannel++) {
         TCC0->CC[iChannel].reg = 0;
     }
-    // Interrupt every period
+    // Interrupt every period, and offer the sample tick to the event system
+    // so EventManager routes can start peripherals in step with it
     TCC0->INTENSET.bit.OVF = 1;
+    TCC0->EVCTRL.reg |= TCC_EVCTRL_OVFEO;
 
     // Setup TCC1 which will be used by motors using PWM input on InA
     SET_CLOCK_SOURCE(TCC1_GCLK_ID, 1);
@@ -500,15 +826,23 @@ void SysManager::SysTickUpdate() {
 
 #define ACK_FAST_UPDATE_INT TCC0->INTFLAG.reg = TCC_INTFLAG_MASK
 
-void SysManager::FastUpdate() {
+ISR_RAMFUNC void SysManager::FastUpdate() {
     ACK_FAST_UPDATE_INT;
     TimingMgr.IsrStart();
+    TRACE_EVENT(TRACE_FAST_UPDATE_BEGIN, tickCnt);
     SysMgr.UpdateFastImpl();
+    TRACE_EVENT(TRACE_FAST_UPDATE_END,
+                DWT->CYCCNT - TimingMgr.m_isrStartCycle);
+    TimingMgr.IsrEnd();
+}
+
+void SysManager::DeferredUpdate() {
+    TimingMgr.DeferredStart();
+    SysMgr.UpdateDeferredImpl();
     if (FastSysTick) {
         SysMgr.UpdateSlowImpl();
     }
-
-    TimingMgr.IsrEnd();
+    TimingMgr.DeferredEnd();
 }
 
 } // ClearCore namespace
@@ -521,10 +855,36 @@ void SysManager::FastUpdate() {
 extern "C" void GMAC_Handler(void) {
     ClearCore::EthernetMgr.IrqHandlerGmac();
 }
+/**
+    Ethernet service interrupt; ETHERNET_SERVICE_IRQn borrows the unused PTC
+    vector
+**/
+extern "C" void PTC_Handler(void) {
+    ClearCore::EthernetMgr.IrqHandlerService();
+}
+
+static_assert(ClearCore::DMA_SERCOM0_SPI_RX == 2 &&
+              ClearCore::DMA_SERCOM7_SPI_RX >= 4,
+              "The SPI receive channel DMA vectors must match the channels");
+extern "C" void DMAC_2_Handler(void) {
+    // DMA_SERCOM0_SPI_RX
+    ClearCore::ConnectorCOM1.IrqHandlerDma();
+}
+extern "C" void DMAC_4_Handler(void) {
+    // Channels 4 and up share this vector; of the fixed channels only
+    // DMA_SERCOM7_SPI_RX and DMA_SERCOM4_SPI_RX interrupt, then any
+    // allocated channels
+    ClearCore::ConnectorCOM0.IrqHandlerDma();
+    ClearCore::SdCard.IrqHandlerDma();
+    ClearCore::DmaManager::IrqHandler();
+}
 
 extern "C" void SERCOM0_0_Handler(void) {
     ClearCore::ConnectorCOM1.IrqHandlerTx();
 }
+extern "C" void SERCOM0_1_Handler(void) {
+    ClearCore::ConnectorCOM1.IrqHandler1();
+}
 extern "C" void SERCOM0_2_Handler(void) {
     ClearCore::ConnectorCOM1.IrqHandlerRx();
 }
@@ -545,6 +905,9 @@ extern "C" void SERCOM2_3_Handler(void) {
 extern "C" void SERCOM7_0_Handler(void) {
     ClearCore::ConnectorCOM0.IrqHandlerTx();
 }
+extern "C" void SERCOM7_1_Handler(void) {
+    ClearCore::ConnectorCOM0.IrqHandler1();
+}
 extern "C" void SERCOM7_2_Handler(void) {
     ClearCore::ConnectorCOM0.IrqHandlerRx();
 }
@@ -631,9 +994,16 @@ extern "C" void SysTick_Handler(void) {
 /**
     Interrupt to handle ClearCore background tasks
 **/
-extern "C" void TCC0_0_Handler(void) {
+extern "C" ISR_RAMFUNC void TCC0_0_Handler(void) {
     ClearCore::SysMgr.FastUpdate();
 }
+/**
+    Interrupt to handle ClearCore housekeeping deferred from the sample rate
+    interrupt
+**/
+extern "C" void PendSV_Handler(void) {
+    ClearCore::SysMgr.DeferredUpdate();
+}
 
 extern "C" void InitSysManager() {
     // Start the ClearCore board manager
@@ -26,6 +26,12 @@
 
 #include "SysTiming.h"
 #include <sam.h>
+#include "ISerial.h"
+#include "SysUtils.h"
+#include "TraceManager.h"
+
+// CPU cycles per sample period
+#define SAMPLE_PERIOD_CYCLES (CPU_CLK / _CLEARCORE_SAMPLE_RATE_HZ)
 
 namespace ClearCore {
 
@@ -48,7 +54,36 @@ SysTiming::SysTiming() :
     m_microAdjHigh(0),
     m_microAdjLow(0),
     m_microAdjHighRemainder(0),
-    m_microAdjLowRemainder(0) {}
+    m_microAdjLowRemainder(0),
+    m_cycleEpoch(0),
+    m_cpuFastCycles(0),
+    m_cpuDeferredCycles(0),
+    m_cpuIdleCycles(0),
+    m_cpuLoadStart(0),
+    m_deferredStartCycle(0),
+    m_deferredStartFast(0),
+    m_loopStats(),
+    m_loopTickLast(0),
+    m_loopTicking(false),
+    m_loopStallUs(0),
+    m_loopStalled(false),
+    m_loopStallBlocker(LOOP_BLOCK_NONE),
+    m_loopBlocker(LOOP_BLOCK_NONE),
+    m_loopBlockerLast(LOOP_BLOCK_NONE),
+    m_loopIterBlocker(LOOP_BLOCK_NONE),
+    m_loopIterBlockUs(0) {
+    m_loopStats.MinUs = UINT32_MAX;
+#if CLEARCORE_ISR_PROFILE
+    for (uint8_t i = 0; i < ISR_STAGE_COUNT; i++) {
+        m_isrStages[i] = IsrStageStats();
+        m_isrStages[i].MinCycles = UINT32_MAX;
+    }
+    m_isrLatency = IsrStageStats();
+    m_isrLatency.MinCycles = UINT32_MAX;
+    m_isrDuration = IsrStageStats();
+    m_isrDuration.MinCycles = UINT32_MAX;
+#endif
+}
 
 
 SysTiming &SysTiming::Instance() {
@@ -58,6 +93,17 @@ SysTiming &SysTiming::Instance() {
 
 void SysTiming::IsrStart() {
     m_isrStartCycle = DWT->CYCCNT;
+#if CLEARCORE_ISR_PROFILE
+    // TCC0 has counted up from its overflow since the interrupt was
+    // requested; scale its count to CPU cycles
+    TCC0->CTRLBSET.reg = TCC_CTRLBSET_CMD_READSYNC;
+    SYNCBUSY_WAIT(TCC0, TCC_SYNCBUSY_COUNT);
+    uint32_t count = TCC0->COUNT.reg;
+    uint32_t readCycles = DWT->CYCCNT - m_isrStartCycle;
+    uint32_t latency = count * SAMPLE_PERIOD_CYCLES / (TCC0->PER.reg + 1);
+    // Leave out the time taken to read the count
+    StatsAdd(m_isrLatency, latency > readCycles ? latency - readCycles : 0);
+#endif
 }
 
 void SysTiming::IsrEnd() {
@@ -68,6 +114,84 @@ void SysTiming::IsrEnd() {
     if (m_isrMaxCycles < m_isrLastCycles) {
         m_isrMaxCycles = m_isrLastCycles;
     }
+    m_cpuFastCycles += m_isrLastCycles;
+#if CLEARCORE_ISR_PROFILE
+    StatsAdd(m_isrDuration, m_isrLastCycles);
+#endif
+}
+
+void SysTiming::DeferredStart() {
+    m_deferredStartCycle = DWT->CYCCNT;
+    m_deferredStartFast = static_cast<uint32_t>(m_cpuFastCycles);
+}
+
+void SysTiming::DeferredEnd() {
+    uint32_t cycles = DWT->CYCCNT - m_deferredStartCycle;
+    // The low word of the total is enough to find the preempting time
+    uint32_t fastCycles =
+        static_cast<uint32_t>(m_cpuFastCycles) - m_deferredStartFast;
+    m_cpuDeferredCycles += cycles - fastCycles;
+}
+
+uint32_t SysTiming::SampleTimerCount() {
+    TCC0->CTRLBSET.reg = TCC_CTRLBSET_CMD_READSYNC;
+    SYNCBUSY_WAIT(TCC0, TCC_SYNCBUSY_COUNT);
+    return TCC0->COUNT.reg;
+}
+
+void SysTiming::CpuSleep() {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    // An overflow already pending ends the sleep at once, so only one
+    // raised while asleep adds a timer period
+    bool overflowPending = NVIC_GetPendingIRQ(TCC0_0_IRQn);
+    uint32_t countStart = SampleTimerCount();
+    uint32_t cycleStart = DWT->CYCCNT;
+
+    __DSB();
+    __WFI();
+
+    uint32_t counts = SampleTimerCount() - countStart;
+    uint32_t period = TCC0->PER.reg + 1;
+    if (!overflowPending && NVIC_GetPendingIRQ(TCC0_0_IRQn)) {
+        counts += period;
+    }
+    uint32_t slept = counts * SAMPLE_PERIOD_CYCLES / period;
+    uint32_t counted = DWT->CYCCNT - cycleStart;
+    if (slept > counted) {
+        // Put back the cycles the stopped counter missed
+        DWT->CYCCNT += slept - counted;
+    }
+    else {
+        slept = counted;
+    }
+    m_cpuIdleCycles += slept;
+    __set_PRIMASK(primask);
+}
+
+void SysTiming::CpuLoadGet(CpuLoad &load, bool reset) {
+    __disable_irq();
+    uint64_t now = Cycles64();
+    uint64_t window = now - m_cpuLoadStart;
+    uint64_t isr = m_cpuFastCycles + m_cpuDeferredCycles;
+    uint64_t idle = m_cpuIdleCycles;
+    if (reset) {
+        m_cpuLoadStart = now;
+        m_cpuFastCycles = 0;
+        m_cpuDeferredCycles = 0;
+        m_cpuIdleCycles = 0;
+    }
+    __enable_irq();
+
+    if (!window) {
+        load = CpuLoad();
+        return;
+    }
+    load.WindowMs = window / (CPU_CLK / 1000);
+    load.IsrPermille = isr * 1000 / window;
+    load.IdlePermille = idle * 1000 / window;
+    uint32_t counted = load.IsrPermille + load.IdlePermille;
+    load.BusyPermille = counted < 1000 ? 1000 - counted : 0;
 }
 
 void SysTiming::GetIsrLoading(uint32_t &minSlot, uint32_t &maxSlot) {
@@ -77,6 +201,174 @@ void SysTiming::GetIsrLoading(uint32_t &minSlot, uint32_t &maxSlot) {
     m_isrMaxCycles = m_isrLastCycles;
 }
 
+#if CLEARCORE_ISR_PROFILE
+void SysTiming::IsrStageEnd(IsrStages stage, uint32_t &startCycle) {
+    StatsAdd(m_isrStages[stage], DWT->CYCCNT - startCycle);
+    // Leave the bookkeeping out of the next stage's time
+    startCycle = DWT->CYCCNT;
+}
+
+void SysTiming::StatsAdd(IsrStageStats &stats, uint32_t cycles) {
+    if (stats.MinCycles > cycles) {
+        stats.MinCycles = cycles;
+    }
+    if (stats.MaxCycles < cycles) {
+        stats.MaxCycles = cycles;
+    }
+    stats.Count++;
+    stats.TotalCycles += cycles;
+    // Bin by the number of significant bits in the cycle count
+    uint8_t bin = cycles ? 32 - __builtin_clz(cycles) : 0;
+    if (bin >= ISR_STAGE_HIST_BINS) {
+        bin = ISR_STAGE_HIST_BINS - 1;
+    }
+    stats.Histogram[bin]++;
+}
+
+void SysTiming::StatsTake(IsrStageStats &src, IsrStageStats &dst) {
+    __disable_irq();
+    dst = src;
+    src = IsrStageStats();
+    src.MinCycles = UINT32_MAX;
+    __enable_irq();
+}
+
+void SysTiming::IsrStageGet(IsrStages stage, IsrStageStats &stats) {
+    if (stage >= ISR_STAGE_COUNT) {
+        stats = IsrStageStats();
+        return;
+    }
+    StatsTake(m_isrStages[stage], stats);
+}
+
+void SysTiming::IsrLatencyGet(IsrStageStats &stats) {
+    StatsTake(m_isrLatency, stats);
+}
+
+void SysTiming::IsrDurationGet(IsrStageStats &stats) {
+    StatsTake(m_isrDuration, stats);
+}
+
+static void HistogramReport(ISerial &port, const char *label,
+                            const SysTiming::IsrStageStats &stats) {
+    port.Send(label);
+    port.Send(" count ");
+    port.Send(stats.Count);
+    if (stats.Count) {
+        port.Send(" min ");
+        port.Send(stats.MinCycles);
+        port.Send(" max ");
+        port.Send(stats.MaxCycles);
+        port.Send(" mean ");
+        port.Send(static_cast<uint32_t>(stats.TotalCycles / stats.Count));
+    }
+    port.SendLine();
+    for (uint8_t bin = 0; bin < ISR_STAGE_HIST_BINS; bin++) {
+        if (!stats.Histogram[bin]) {
+            continue;
+        }
+        port.Send(static_cast<uint32_t>(bin ? 1UL << (bin - 1) : 0));
+        port.Send('\t');
+        port.SendLine(stats.Histogram[bin]);
+    }
+}
+
+void SysTiming::IsrReport(ISerial &port) {
+    IsrStageStats stats;
+    IsrLatencyGet(stats);
+    HistogramReport(port, "Latency", stats);
+    IsrDurationGet(stats);
+    HistogramReport(port, "Duration", stats);
+}
+#endif
+
+SysTiming::LoopBlockMarker::LoopBlockMarker(LoopBlockers blocker)
+    : m_blocker(blocker),
+      m_prev(LOOP_BLOCK_NONE),
+      m_startUs(0),
+      m_active(!__get_IPSR()) {
+    if (!m_active) {
+        return;
+    }
+    m_prev = TimingMgr.m_loopBlocker;
+    m_startUs = TimingMgr.Microseconds();
+    TimingMgr.m_loopBlocker = blocker;
+    TimingMgr.m_loopBlockerLast = blocker;
+}
+
+SysTiming::LoopBlockMarker::~LoopBlockMarker() {
+    if (!m_active) {
+        return;
+    }
+    uint32_t us = TimingMgr.Microseconds() - m_startUs;
+    TimingMgr.m_loopBlocker = m_prev;
+    if (TimingMgr.m_loopIterBlockUs < us) {
+        TimingMgr.m_loopIterBlockUs = us;
+        TimingMgr.m_loopIterBlocker = m_blocker;
+    }
+}
+
+void SysTiming::LoopTick() {
+    uint32_t now = Microseconds();
+    if (!m_loopTicking) {
+        // The first call only starts the first iteration
+        m_loopTickLast = now;
+        m_loopTicking = true;
+        return;
+    }
+    uint32_t us = now - m_loopTickLast;
+    m_loopTickLast = now;
+
+    LoopStats &stats = m_loopStats;
+    if (stats.MinUs > us) {
+        stats.MinUs = us;
+    }
+    if (stats.MaxUs < us) {
+        stats.MaxUs = us;
+        stats.MaxBlocker = m_loopIterBlocker;
+        stats.MaxBlockerUs = m_loopIterBlockUs;
+    }
+    stats.Count++;
+    stats.TotalUs += us;
+    // Bin by the number of significant bits in the time
+    uint8_t bin = us ? 32 - __builtin_clz(us) : 0;
+    if (bin >= LOOP_HIST_BINS) {
+        bin = LOOP_HIST_BINS - 1;
+    }
+    stats.Histogram[bin]++;
+
+    uint32_t threshold = m_loopStallUs;
+    if (threshold && us > threshold) {
+        stats.Stalls++;
+        // Too short for the SysTick update to have caught it
+        if (!m_loopStalled) {
+            m_loopStallBlocker = m_loopIterBlocker;
+            TRACE_EVENT(TRACE_LOOP_STALL, m_loopIterBlocker);
+        }
+    }
+    m_loopStalled = false;
+    m_loopIterBlocker = LOOP_BLOCK_NONE;
+    m_loopIterBlockUs = 0;
+}
+
+void SysTiming::LoopStatsGet(LoopStats &stats) {
+    stats = m_loopStats;
+    m_loopStats = LoopStats();
+    m_loopStats.MinUs = UINT32_MAX;
+}
+
+void SysTiming::LoopStallCheck() {
+    uint32_t threshold = m_loopStallUs;
+    if (!threshold || !m_loopTicking || m_loopStalled) {
+        return;
+    }
+    if (Microseconds() - m_loopTickLast > threshold) {
+        m_loopStalled = true;
+        m_loopStallBlocker = m_loopBlocker;
+        TRACE_EVENT(TRACE_LOOP_STALL, m_loopBlocker);
+    }
+}
+
 uint32_t SysTiming::Microseconds(void) {
     // Microseconds = CPU cycles / CYCLES_PER_MICROSECOND
     // Since the cycle counter wraps before Microseconds reaches UINT32_MAX
@@ -92,6 +384,40 @@ uint32_t SysTiming::Microseconds(void) {
     }
 }
 
+// 2^64 / CYCLES_PER_MICROSECOND, rounded up. The high half of a cycle count
+// times this is the exact microsecond count for the first 2^64 /
+// CYCLES_PER_MICROSECOND cycles (40 years at 120 MHz).
+#define CYCLES_TO_US_MULT (UINT64_MAX / CYCLES_PER_MICROSECOND + 1)
+
+// The upper 64 bits of the 128-bit product, from 32-bit multiplies
+static inline uint64_t MulHigh64(uint64_t a, uint64_t b) {
+    uint64_t aLo = static_cast<uint32_t>(a);
+    uint64_t aHi = a >> 32;
+    uint64_t bLo = static_cast<uint32_t>(b);
+    uint64_t bHi = b >> 32;
+    uint64_t lh = aLo * bHi;
+    uint64_t hl = aHi * bLo;
+    uint64_t mid = ((aLo * bLo) >> 32) + static_cast<uint32_t>(lh) +
+                   static_cast<uint32_t>(hl);
+    return aHi * bHi + (lh >> 32) + (hl >> 32) + (mid >> 32);
+}
+
+uint64_t SysTiming::Cycles64() {
+    // Read the epoch first; it stays usable for half a counter period
+    // (~17.9 sec) after the interrupt last updated it
+    uint32_t epoch = m_cycleEpoch;
+    uint32_t cycleCounter = DWT->CYCCNT;
+    // The counter has crossed into the other half since the update
+    if ((cycleCounter ^ (epoch << 31)) & 0x80000000) {
+        epoch++;
+    }
+    return (static_cast<uint64_t>(epoch >> 1) << 32) | cycleCounter;
+}
+
+uint64_t SysTiming::Microseconds64() {
+    return MulHigh64(Cycles64(), CYCLES_TO_US_MULT);
+}
+
 void SysTiming::Update() {
     // Detaching a debugger can clear CoreDebug_DEMCR_TRCENA_Msk
     // so make sure it stays set to keep the cycle counter enabled
@@ -140,6 +466,12 @@ void SysTiming::Update() {
         }
     }
     m_lastIsrStartCnt = m_isrStartCycle;
+
+    // Step the 64-bit clock's epoch each time the cycle counter crosses
+    // into the other half of its range
+    if ((m_isrStartCycle ^ (m_cycleEpoch << 31)) & 0x80000000) {
+        m_cycleEpoch++;
+    }
 }
 
 void SysTiming::ResetMilliseconds() {
@@ -148,6 +480,10 @@ void SysTiming::ResetMilliseconds() {
 }
 
 void SysTiming::ResetMicroseconds() {
+    // Restart the 64-bit clock at the next whole epoch so it never goes back
+    __disable_irq();
+    uint64_t cycles = Cycles64();
+    m_cycleEpoch = static_cast<uint32_t>((cycles >> 32) + 1) << 1;
     m_microAdj = 0;
     m_microAdjHigh = 0;
     m_microAdjLow = 0;
@@ -155,6 +491,7 @@ void SysTiming::ResetMicroseconds() {
     m_microAdjLowRemainder = 0;
     m_lastIsrStartCnt -= DWT->CYCCNT;
     DWT->CYCCNT = 0;
+    __enable_irq();
 }
 
 bool SysTiming::SysTickPeriodMicroSec(uint32_t microSeconds) {
@@ -178,6 +515,10 @@ uint32_t Microseconds(void) {
     return ClearCore::TimingMgr.Microseconds();
 }
 
+uint64_t Microseconds64(void) {
+    return ClearCore::TimingMgr.Microseconds64();
+}
+
 void Delay_cycles(uint64_t cycles) {
     // Get a snapshot of the cycle counter as we enter the delay function
     uint32_t cyclesLast = DWT->CYCCNT;
@@ -0,0 +1,383 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    ClearCore cooperative main loop task scheduler
+**/
+
+#include "TaskManager.h"
+#include <sam.h>
+#include "atomic_utils.h"
+#include "SysTiming.h"
+#include "SysUtils.h"
+#include "TraceManager.h"
+
+namespace ClearCore {
+
+// Interrupt priority 0(High) - 7(Low); above everything else so the early
+// warning is recorded whatever interrupt the board is stuck in
+#define WATCHDOG_INTERRUPT_PRIORITY 0
+
+// The watchdog clock, from the 32 kHz ultra low power oscillator
+#define WATCHDOG_CLOCK_HZ 1024
+// The shortest and longest periods, as powers of two times 8 cycles
+#define WATCHDOG_PERIOD_MIN WDT_CONFIG_PER_CYC16_Val
+#define WATCHDOG_PERIOD_MAX WDT_CONFIG_PER_CYC16384_Val
+
+// Marks a valid deadline record
+#define DEADLINE_LOG_MAGIC 0x444C4D31UL
+
+extern SysTiming &TimingMgr;
+
+TaskManager &TaskMgr = TaskManager::Instance();
+
+// Kept in the .noinit RAM section so the miss that led up to a watchdog
+// reset can be read after it
+struct DeadlineLog {
+    uint32_t Magic;
+    TaskManager::DeadlineMiss Last;
+};
+
+static DeadlineLog deadlineLog __attribute__((section(".noinit")));
+
+TaskManager &TaskManager::Instance() {
+    static TaskManager *instance = new TaskManager();
+    return *instance;
+}
+
+TaskManager::TaskManager()
+    : m_tasks(),
+      m_taskCount(0),
+      m_idleSleep(false),
+      m_deadlineMissCount(0),
+      m_watchdogTimeoutMs(0) {
+    if (deadlineLog.Magic != DEADLINE_LOG_MAGIC) {
+        deadlineLog.Last = DeadlineMiss();
+        deadlineLog.Last.TaskId = TASK_INVALID;
+        deadlineLog.Magic = DEADLINE_LOG_MAGIC;
+    }
+}
+
+int8_t TaskManager::TaskAddPeriodic(TaskFunction task, uint32_t periodMs) {
+    if (!periodMs) {
+        return TASK_INVALID;
+    }
+    return TaskAdd(task, periodMs);
+}
+
+int8_t TaskManager::TaskAddEvent(TaskFunction task) {
+    return TaskAdd(task, 0);
+}
+
+int8_t TaskManager::TaskAdd(TaskFunction task, uint32_t periodMs) {
+    if (!task || m_taskCount >= TASK_MANAGER_MAX_TASKS) {
+        return TASK_INVALID;
+    }
+
+    uint8_t taskId = m_taskCount;
+    Task &newTask = m_tasks[taskId];
+    newTask.Function = task;
+    newTask.PeriodMs = periodMs;
+    newTask.NextReadyMs = Milliseconds() + periodMs;
+    newTask.Ready = false;
+    newTask.Enabled = true;
+    newTask.DeadlineUs = 0;
+    newTask.Critical = false;
+    newTask.Missed = false;
+    newTask.Stats = TaskStats();
+
+    // Publish the task to the SysTick update once it is filled in
+    atomic_store_n(&m_taskCount, taskId + 1);
+    return taskId;
+}
+
+bool TaskManager::TaskSignal(int8_t taskId) {
+    if (taskId < 0 || taskId >= m_taskCount ||
+            m_tasks[taskId].PeriodMs || !m_tasks[taskId].Enabled) {
+        return false;
+    }
+    __disable_irq();
+    TaskReady(m_tasks[taskId]);
+    __enable_irq();
+    return true;
+}
+
+bool TaskManager::TaskEnable(int8_t taskId, bool enable) {
+    if (taskId < 0 || taskId >= m_taskCount) {
+        return false;
+    }
+    Task &task = m_tasks[taskId];
+    __disable_irq();
+    if (enable && !task.Enabled) {
+        task.NextReadyMs = Milliseconds() + task.PeriodMs;
+    }
+    if (!enable) {
+        task.Ready = false;
+    }
+    task.Enabled = enable;
+    __enable_irq();
+    return true;
+}
+
+bool TaskManager::TaskDeadline(int8_t taskId, uint32_t deadlineMs,
+                               bool critical) {
+    if (taskId < 0 || taskId >= m_taskCount) {
+        return false;
+    }
+    Task &task = m_tasks[taskId];
+    __disable_irq();
+    task.DeadlineUs = deadlineMs * 1000;
+    task.Critical = critical;
+    task.Missed = false;
+    __enable_irq();
+    return true;
+}
+
+bool TaskManager::DeadlineMissLast(DeadlineMiss &miss) {
+    __disable_irq();
+    miss = deadlineLog.Last;
+    __enable_irq();
+    return miss.TimeMs || miss.TaskId != TASK_INVALID || miss.Watchdog;
+}
+
+bool TaskManager::WatchdogStart(uint32_t timeoutMs) {
+    // Round up to the watchdog's clock and then to a period
+    uint32_t cycles =
+        (static_cast<uint64_t>(timeoutMs) * WATCHDOG_CLOCK_HZ + 999) / 1000;
+    if (m_watchdogTimeoutMs || !timeoutMs ||
+            cycles > (8UL << WATCHDOG_PERIOD_MAX)) {
+        return false;
+    }
+    uint8_t period = WATCHDOG_PERIOD_MIN;
+    while ((8UL << period) < cycles) {
+        period++;
+    }
+
+    CLOCK_ENABLE(APBAMASK, WDT_);
+    WDT->CONFIG.reg = WDT_CONFIG_PER(period);
+    // Warn halfway through the period without a feed
+    WDT->EWCTRL.reg = WDT_EWCTRL_EWOFFSET(period - 1);
+    WDT->INTFLAG.reg = WDT_INTFLAG_EW;
+    WDT->INTENSET.reg = WDT_INTENSET_EW;
+    NVIC_SetPriority(WDT_IRQn, WATCHDOG_INTERRUPT_PRIORITY);
+    NVIC_EnableIRQ(WDT_IRQn);
+    WDT->CTRLA.reg = WDT_CTRLA_ENABLE;
+    SYNCBUSY_WAIT(WDT, WDT_SYNCBUSY_ENABLE);
+
+    m_watchdogTimeoutMs = (8UL << period) * 1000 / WATCHDOG_CLOCK_HZ;
+    return true;
+}
+
+bool TaskManager::WatchdogReset() {
+    return RSTC->RCAUSE.bit.WDT;
+}
+
+bool TaskManager::TaskStatsGet(int8_t taskId, TaskStats &stats, bool reset) {
+    if (taskId < 0 || taskId >= m_taskCount) {
+        return false;
+    }
+    __disable_irq();
+    stats = m_tasks[taskId].Stats;
+    if (reset) {
+        m_tasks[taskId].Stats = TaskStats();
+    }
+    __enable_irq();
+    return true;
+}
+
+void TaskManager::Run() {
+    uint8_t taskCount = m_taskCount;
+    bool ran = false;
+    for (uint8_t i = 0; i < taskCount; i++) {
+        Task &task = m_tasks[i];
+        // Take the ready time along with the flag; the task may become
+        // ready again while it runs
+        __disable_irq();
+        bool ready = task.Ready;
+        task.Ready = false;
+        uint32_t readyUs = task.ReadyUs;
+        bool missed = task.Missed;
+        __enable_irq();
+        if (!ready) {
+            continue;
+        }
+        ran = true;
+
+        uint32_t startUs = Microseconds();
+        task.Function();
+        uint32_t endUs = Microseconds();
+        uint32_t execUs = endUs - startUs;
+        uint32_t responseUs = endUs - readyUs;
+
+        __disable_irq();
+        task.Stats.RunCount++;
+        task.Stats.LastExecUs = execUs;
+        if (task.Stats.MaxExecUs < execUs) {
+            task.Stats.MaxExecUs = execUs;
+        }
+        if (task.Stats.MaxResponseUs < responseUs) {
+            task.Stats.MaxResponseUs = responseUs;
+        }
+        __enable_irq();
+
+        if (task.DeadlineUs && responseUs > task.DeadlineUs && !missed) {
+            DeadlineMissRecord(i, responseUs, false);
+        }
+    }
+
+    DeadlineCheck();
+
+    if (!ran && m_idleSleep) {
+        // Check again with interrupts held off, so a task made ready just
+        // now still wakes the sleep
+        __disable_irq();
+        if (!TaskPending()) {
+            TimingMgr.CpuSleep();
+        }
+        __enable_irq();
+    }
+}
+
+bool TaskManager::TaskPending() {
+    uint8_t taskCount = m_taskCount;
+    for (uint8_t i = 0; i < taskCount; i++) {
+        if (m_tasks[i].Ready) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void TaskManager::DeadlineCheck() {
+    uint8_t taskCount = m_taskCount;
+    uint32_t now = Microseconds();
+    bool late = false;
+    for (uint8_t i = 0; i < taskCount; i++) {
+        Task &task = m_tasks[i];
+        if (!task.DeadlineUs) {
+            continue;
+        }
+        __disable_irq();
+        uint32_t waitUs = now - task.ReadyUs;
+        bool overdue = task.Ready && waitUs > task.DeadlineUs;
+        bool found = overdue && !task.Missed;
+        if (found) {
+            task.Missed = true;
+        }
+        __enable_irq();
+        if (found) {
+            DeadlineMissRecord(i, waitUs, false);
+        }
+        late = late || (overdue && task.Critical);
+    }
+
+    if (m_watchdogTimeoutMs && !late && !WDT->SYNCBUSY.bit.CLEAR) {
+        WDT->CLEAR.reg = WDT_CLEAR_CLEAR_KEY;
+    }
+}
+
+void TaskManager::DeadlineMissRecord(int8_t taskId, uint32_t responseUs,
+                                     bool watchdog) {
+    __disable_irq();
+    DeadlineMiss &miss = deadlineLog.Last;
+    miss.TaskId = taskId;
+    miss.Watchdog = watchdog;
+    miss.DeadlineUs = (taskId == TASK_INVALID) ? 0 :
+                      m_tasks[taskId].DeadlineUs;
+    miss.ResponseUs = responseUs;
+    miss.TimeMs = Milliseconds();
+    if (!watchdog) {
+        m_tasks[taskId].Stats.DeadlineMissCount++;
+        m_deadlineMissCount++;
+    }
+    __enable_irq();
+    if (watchdog) {
+        TRACE_EVENT(TRACE_WATCHDOG_WARNING, static_cast<uint8_t>(taskId));
+    }
+    else {
+        TRACE_EVENT(TRACE_TASK_DEADLINE_MISS, taskId);
+    }
+}
+
+void TaskManager::IrqHandlerWatchdog() {
+    WDT->INTFLAG.reg = WDT_INTFLAG_EW;
+
+    // Blame the critical task that has waited longest past its deadline
+    uint8_t taskCount = m_taskCount;
+    uint32_t now = Microseconds();
+    int8_t lateId = TASK_INVALID;
+    uint32_t lateUs = 0;
+    uint32_t lateWaitUs = 0;
+    for (uint8_t i = 0; i < taskCount; i++) {
+        Task &task = m_tasks[i];
+        uint32_t waitUs = now - task.ReadyUs;
+        if (!task.DeadlineUs || !task.Critical || !task.Ready ||
+                waitUs <= task.DeadlineUs) {
+            continue;
+        }
+        if (lateId == TASK_INVALID || waitUs - task.DeadlineUs > lateUs) {
+            lateId = i;
+            lateUs = waitUs - task.DeadlineUs;
+            lateWaitUs = waitUs;
+        }
+    }
+    DeadlineMissRecord(lateId, lateWaitUs, true);
+}
+
+void TaskManager::Tick() {
+    uint8_t taskCount = m_taskCount;
+    if (!taskCount) {
+        return;
+    }
+
+    uint32_t now = Milliseconds();
+    for (uint8_t i = 0; i < taskCount; i++) {
+        Task &task = m_tasks[i];
+        if (!task.PeriodMs || !task.Enabled ||
+                static_cast<int32_t>(now - task.NextReadyMs) < 0) {
+            continue;
+        }
+        TaskReady(task);
+        task.NextReadyMs += task.PeriodMs;
+        // If whole periods were missed, count them and resynchronize rather
+        // than running the task back to back to catch up
+        if (static_cast<int32_t>(now - task.NextReadyMs) >= 0) {
+            task.Stats.OverrunCount +=
+                (now - task.NextReadyMs) / task.PeriodMs + 1;
+            task.NextReadyMs = now + task.PeriodMs;
+        }
+    }
+}
+
+void TaskManager::TaskReady(Task &task) {
+    if (task.Ready) {
+        task.Stats.OverrunCount++;
+    }
+    else {
+        // The deadline runs from the first time the task became ready
+        task.ReadyUs = Microseconds();
+        task.Missed = false;
+    }
+    task.Ready = true;
+}
+
+} // ClearCore namespace
@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+    ClearCore fixed-layout telemetry frames
+**/
+
+#include "TelemetrySchema.h"
+#include <string.h>
+
+namespace ClearCore {
+
+static inline uint32_t GetLe32(const uint8_t *data) {
+    return data[0] | (data[1] << 8) | (static_cast<uint32_t>(data[2]) << 16) |
+           (static_cast<uint32_t>(data[3]) << 24);
+}
+static inline void PutLe32(uint8_t *data, uint32_t value) {
+    data[0] = value & 0xFF;
+    data[1] = (value >> 8) & 0xFF;
+    data[2] = (value >> 16) & 0xFF;
+    data[3] = value >> 24;
+}
+
+TelemetrySchema::TelemetrySchema(const Field *fields, uint8_t count)
+    : m_fields(fields),
+      m_count(count),
+      m_runs(),
+      m_runCount(0),
+      m_frameSize(0),
+      m_descriptorSize(0),
+      m_id(TelemetrySchemaId(fields, count)),
+      m_sequence(0) {
+    // Merge the fields that follow one another into one copy each
+    uint16_t descriptorSize = TELEMETRY_SCHEMA_HEADER_LEN;
+    for (uint8_t i = 0; i < count; i++) {
+        const Field &field = fields[i];
+        uint16_t length = field.Size * field.Count;
+        if (m_runCount &&
+                m_runs[m_runCount - 1].Offset + m_runs[m_runCount - 1].Length ==
+                field.Offset) {
+            m_runs[m_runCount - 1].Length += length;
+        }
+        else if (m_runCount < TELEMETRY_SCHEMA_RUNS_MAX) {
+            m_runs[m_runCount].Offset = field.Offset;
+            m_runs[m_runCount].Length = length;
+            m_runCount++;
+        }
+        else {
+            // Too many runs; Encode() and Decode() refuse every frame
+            return;
+        }
+        m_frameSize += length;
+        descriptorSize += 4 + strlen(field.Name);
+    }
+    m_frameSize += TELEMETRY_SCHEMA_HEADER_LEN;
+    m_descriptorSize = descriptorSize;
+}
+
+uint16_t TelemetrySchema::Encode(const void *source, uint8_t *frame,
+                                 uint16_t size) {
+    if (!m_frameSize || size < m_frameSize) {
+        return 0;
+    }
+    frame[0] = TELEMETRY_SCHEMA_FRAME;
+    PutLe32(&frame[1], m_id);
+    frame[5] = m_sequence++;
+
+    const uint8_t *in = static_cast<const uint8_t *>(source);
+    uint8_t *out = frame + TELEMETRY_SCHEMA_HEADER_LEN;
+    for (uint8_t i = 0; i < m_runCount; i++) {
+        memcpy(out, in + m_runs[i].Offset, m_runs[i].Length);
+        out += m_runs[i].Length;
+    }
+    return m_frameSize;
+}
+
+bool TelemetrySchema::Decode(const uint8_t *frame, uint16_t length,
+                             void *dest) {
+    if (!m_frameSize || length != m_frameSize ||
+            frame[0] != TELEMETRY_SCHEMA_FRAME || GetLe32(&frame[1]) != m_id) {
+        return false;
+    }
+
+    const uint8_t *in = frame + TELEMETRY_SCHEMA_HEADER_LEN;
+    uint8_t *out = static_cast<uint8_t *>(dest);
+    for (uint8_t i = 0; i < m_runCount; i++) {
+        memcpy(out + m_runs[i].Offset, in, m_runs[i].Length);
+        in += m_runs[i].Length;
+    }
+    return true;
+}
+
+uint16_t TelemetrySchema::DescriptorWrite(uint8_t *out, uint16_t size) {
+    if (!m_descriptorSize || size < m_descriptorSize) {
+        return 0;
+    }
+    out[0] = TELEMETRY_SCHEMA_DESCRIPTOR;
+    PutLe32(&out[1], m_id);
+    out[5] = m_count;
+
+    uint8_t *next = out + TELEMETRY_SCHEMA_HEADER_LEN;
+    for (uint8_t i = 0; i < m_count; i++) {
+        const Field &field = m_fields[i];
+        uint8_t nameLength = strlen(field.Name);
+        *next++ = field.Kind;
+        *next++ = field.Size;
+        *next++ = field.Count;
+        *next++ = nameLength;
+        memcpy(next, field.Name, nameLength);
+        next += nameLength;
+    }
+    return m_descriptorSize;
+}
+
+} // ClearCore namespace
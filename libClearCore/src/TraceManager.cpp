@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    ClearCore real-time event trace
+**/
+
+#include "TraceManager.h"
+#include "ISerial.h"
+#include "SysTiming.h"
+
+static_assert((TRACE_BUFFER_RECORDS & (TRACE_BUFFER_RECORDS - 1)) == 0,
+              "TRACE_BUFFER_RECORDS must be a power of two");
+
+// Records sent per step of a dump
+#define TRACE_DUMP_CHUNK 16
+
+namespace ClearCore {
+
+TraceManager &TraceMgr = TraceManager::Instance();
+
+TraceManager &TraceManager::Instance() {
+    static TraceManager *instance = new TraceManager();
+    return *instance;
+}
+
+TraceManager::TraceManager()
+    : m_buffer(),
+      m_head(0),
+      m_tail(0),
+      m_lost(0),
+      m_mode(TRACE_OFF),
+      m_groupMask(0) {}
+
+void TraceManager::EventItm(uint16_t id, uint32_t arg) {
+    if (!(ITM->TCR & ITM_TCR_ITMENA_Msk) ||
+            !(ITM->TER & (1UL << TRACE_ITM_PORT))) {
+        return;
+    }
+    // Keep the three words of an event together on the port
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint32_t words[3] = {
+        id | (static_cast<uint32_t>(m_head++) << 16), DWT->CYCCNT, arg
+    };
+    for (uint8_t i = 0; i < 3; i++) {
+        while (!ITM->PORT[TRACE_ITM_PORT].u32) {
+            continue;
+        }
+        ITM->PORT[TRACE_ITM_PORT].u32 = words[i];
+    }
+    __set_PRIMASK(primask);
+}
+
+uint32_t TraceManager::Read(TraceRecord *records, uint32_t maxRecords) {
+    uint32_t count = 0;
+    while (count < maxRecords) {
+        uint32_t head = m_head;
+        if (head - m_tail > TRACE_BUFFER_RECORDS) {
+            // The ring lapped the reader
+            m_lost += head - m_tail - TRACE_BUFFER_RECORDS;
+            m_tail = head - TRACE_BUFFER_RECORDS;
+        }
+        if (m_tail == head) {
+            break;
+        }
+        records[count] = m_buffer[m_tail & (TRACE_BUFFER_RECORDS - 1)];
+        // A writer may have claimed the slot, or been partway through it,
+        // while it was copied
+        if (records[count].Sequence != static_cast<uint16_t>(m_tail) ||
+                m_head - m_tail > TRACE_BUFFER_RECORDS) {
+            continue;
+        }
+        m_tail++;
+        count++;
+    }
+    return count;
+}
+
+uint32_t TraceManager::Latest(TraceRecord *records, uint32_t maxRecords) {
+    uint32_t head = m_head;
+    uint32_t available = head < TRACE_BUFFER_RECORDS ? head :
+                         TRACE_BUFFER_RECORDS;
+    uint32_t count = 0;
+    for (uint32_t i = 1; i <= available && count < maxRecords; i++) {
+        const TraceRecord &record =
+            m_buffer[(head - i) & (TRACE_BUFFER_RECORDS - 1)];
+        if (record.Sequence == static_cast<uint16_t>(head - i)) {
+            records[count++] = record;
+        }
+    }
+    return count;
+}
+
+void TraceManager::Clear() {
+    m_tail = m_head;
+    m_lost = 0;
+}
+
+static void SendWord(ISerial &port, uint32_t word) {
+    char bytes[4] = {
+        static_cast<char>(word), static_cast<char>(word >> 8),
+        static_cast<char>(word >> 16), static_cast<char>(word >> 24)
+    };
+    port.Send(bytes, sizeof(bytes));
+}
+
+uint32_t TraceManager::Dump(ISerial &port) {
+    // Fix the length of the dump up front so events recorded while it is
+    // sent are left for the next one
+    uint32_t available = m_head - m_tail;
+    if (available > TRACE_BUFFER_RECORDS) {
+        available = TRACE_BUFFER_RECORDS;
+    }
+    port.Send("CCTR", 4);
+    SendWord(port, CPU_CLK);
+    SendWord(port, available);
+
+    uint32_t sent = 0;
+    TraceRecord records[TRACE_DUMP_CHUNK];
+    while (sent < available) {
+        uint32_t want = available - sent;
+        if (want > TRACE_DUMP_CHUNK) {
+            want = TRACE_DUMP_CHUNK;
+        }
+        uint32_t count = Read(records, want);
+        for (uint32_t i = 0; i < count; i++) {
+            SendWord(port, records[i].Cycles);
+            SendWord(port, records[i].Arg);
+            SendWord(port, records[i].Id |
+                     (static_cast<uint32_t>(records[i].Sequence) << 16));
+        }
+        sent += count;
+        if (count < want) {
+            break;
+        }
+    }
+    // Pad a dump cut short by lost records so the count stays correct
+    for (; sent < available; sent++) {
+        SendWord(port, 0);
+        SendWord(port, 0);
+        SendWord(port, 0xFFFF);
+    }
+    return available;
+}
+
+} // ClearCore namespace
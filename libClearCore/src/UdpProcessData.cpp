@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+    Implementation of the ClearCore cyclic UDP process data exchange
+**/
+
+#include "UdpProcessData.h"
+#include <string.h>
+#include "SysTiming.h"
+
+namespace ClearCore {
+
+static inline uint16_t GetLe16(const uint8_t *data) {
+    return data[0] | (data[1] << 8);
+}
+static inline uint32_t GetLe32(const uint8_t *data) {
+    return GetLe16(data) | (static_cast<uint32_t>(GetLe16(data + 2)) << 16);
+}
+static inline void PutLe16(uint8_t *data, uint16_t value) {
+    data[0] = value & 0xFF;
+    data[1] = value >> 8;
+}
+static inline void PutLe32(uint8_t *data, uint32_t value) {
+    PutLe16(data, value & 0xFFFF);
+    PutLe16(data + 2, value >> 16);
+}
+
+UdpProcessData::UdpProcessData()
+    : m_udp(),
+      m_running(false),
+      m_online(false),
+      m_peerFixed(false),
+      m_peerIp(),
+      m_peerPort(0),
+      m_produced(nullptr),
+      m_producedSize(0),
+      m_consumed(nullptr),
+      m_consumedSize(0),
+      m_safe(nullptr),
+      m_produceCallback(nullptr),
+      m_consumeCallback(nullptr),
+      m_timeoutCallback(nullptr),
+      m_periodUs(0),
+      m_timeoutUs(0),
+      m_sequence(0),
+      m_received(false),
+      m_receivedSeq(0),
+      m_receivedUs(0),
+      m_peerTimeUs(0),
+      m_jitterQ4(0),
+      m_stats(),
+      m_rxFrame() {}
+
+bool UdpProcessData::Begin(uint16_t localPort, uint32_t periodMs,
+                           uint32_t timeoutMs, const uint8_t *produced,
+                           uint16_t producedSize, uint8_t *consumed,
+                           uint16_t consumedSize) {
+    if (m_running || !periodMs || !timeoutMs ||
+            (producedSize && !produced) || (consumedSize && !consumed) ||
+            producedSize > UDP_PD_DATA_MAX || consumedSize > UDP_PD_DATA_MAX) {
+        return false;
+    }
+    // One packet is in flight while the next is built
+    if (!m_udp.Begin(localPort, 2, UDP_PD_HEADER_LEN + producedSize)) {
+        return false;
+    }
+    m_produced = produced;
+    m_producedSize = producedSize;
+    m_consumed = consumed;
+    m_consumedSize = consumedSize;
+    m_periodUs = periodMs * 1000;
+    m_timeoutUs = timeoutMs * 1000;
+    m_sequence = 0;
+    m_received = false;
+    m_online = false;
+    m_jitterQ4 = 0;
+    m_stats = ExchangeStats();
+    m_running = true;
+    return true;
+}
+
+void UdpProcessData::End() {
+    m_udp.End();
+    m_running = false;
+    m_online = false;
+}
+
+void UdpProcessData::Cycle() {
+    if (!m_running) {
+        return;
+    }
+    Receive();
+    if (m_online && Microseconds() - m_receivedUs > m_timeoutUs) {
+        Timeout();
+    }
+    Send();
+}
+
+void UdpProcessData::StatsGet(ExchangeStats &stats, bool reset) {
+    m_stats.JitterUs = m_jitterQ4 >> 4;
+    stats = m_stats;
+    if (reset) {
+        m_stats = ExchangeStats();
+    }
+}
+
+void UdpProcessData::Receive() {
+    if (!m_udp.PacketParse()) {
+        return;
+    }
+    uint32_t now = Microseconds();
+    int32_t length = m_udp.PacketRead(m_rxFrame, sizeof(m_rxFrame));
+    if (m_peerFixed && (uint32_t(m_udp.RemoteIp()) != uint32_t(m_peerIp) ||
+                        m_udp.RemotePort() != m_peerPort)) {
+        return;
+    }
+    if (length != UDP_PD_HEADER_LEN + m_consumedSize ||
+            GetLe16(&m_rxFrame[0]) != UDP_PD_MAGIC ||
+            GetLe16(&m_rxFrame[2]) != m_consumedSize) {
+        m_stats.Invalid++;
+        return;
+    }
+
+    uint32_t sequence = GetLe32(&m_rxFrame[4]);
+    if (m_received) {
+        int32_t advance = sequence - m_receivedSeq;
+        // A peer that restarts begins its sequence again at one
+        if (advance <= 0 && sequence != 1) {
+            m_stats.Stale++;
+            return;
+        }
+        if (advance > 1) {
+            m_stats.Lost += advance - 1;
+        }
+    }
+
+    if (m_online) {
+        // Smooth the arrival deviation as RTP does, with a gain of 1/16
+        int32_t deviation = (now - m_receivedUs) - m_periodUs;
+        if (deviation < 0) {
+            deviation = -deviation;
+        }
+        m_jitterQ4 += deviation - (m_jitterQ4 >> 4);
+        if (m_stats.JitterMaxUs < static_cast<uint32_t>(deviation)) {
+            m_stats.JitterMaxUs = deviation;
+        }
+    }
+    uint32_t echoUs = GetLe32(&m_rxFrame[12]);
+    if (echoUs) {
+        m_stats.RoundTripUs = now - echoUs;
+        if (m_stats.RoundTripMaxUs < m_stats.RoundTripUs) {
+            m_stats.RoundTripMaxUs = m_stats.RoundTripUs;
+        }
+    }
+
+    if (!m_peerFixed) {
+        m_peerIp = m_udp.RemoteIp();
+        m_peerPort = m_udp.RemotePort();
+    }
+    m_received = true;
+    m_receivedSeq = sequence;
+    m_receivedUs = now;
+    m_peerTimeUs = GetLe32(&m_rxFrame[8]);
+    m_online = true;
+    m_stats.Received++;
+
+    memcpy(m_consumed, &m_rxFrame[UDP_PD_HEADER_LEN], m_consumedSize);
+    if (m_consumeCallback) {
+        m_consumeCallback();
+    }
+}
+
+void UdpProcessData::Send() {
+    if (!m_peerPort) {
+        // No peer to send to yet
+        return;
+    }
+    uint8_t *packet = m_udp.BatchPacketBegin();
+    if (!packet) {
+        // The last packet is still waiting to be transmitted
+        m_stats.SendFailed++;
+        return;
+    }
+    if (m_produceCallback) {
+        m_produceCallback();
+    }
+    uint32_t now = Microseconds();
+    PutLe16(&packet[0], UDP_PD_MAGIC);
+    PutLe16(&packet[2], m_producedSize);
+    PutLe32(&packet[4], ++m_sequence);
+    PutLe32(&packet[8], now);
+    // Take the time the peer's packet was held here out of its round trip
+    PutLe32(&packet[12],
+            m_received ? m_peerTimeUs + (now - m_receivedUs) : 0);
+    memcpy(&packet[UDP_PD_HEADER_LEN], m_produced, m_producedSize);
+    m_udp.BatchPacketQueue(m_peerIp, m_peerPort,
+                           UDP_PD_HEADER_LEN + m_producedSize);
+    if (m_udp.BatchSend()) {
+        m_stats.Sent++;
+    }
+    else {
+        m_stats.SendFailed++;
+    }
+}
+
+void UdpProcessData::Timeout() {
+    m_online = false;
+    m_stats.Timeouts++;
+    if (m_safe) {
+        memcpy(m_consumed, m_safe, m_consumedSize);
+    }
+    else {
+        memset(m_consumed, 0, m_consumedSize);
+    }
+    if (m_consumeCallback) {
+        m_consumeCallback();
+    }
+    if (m_timeoutCallback) {
+        m_timeoutCallback();
+    }
+}
+
+} // ClearCore namespace
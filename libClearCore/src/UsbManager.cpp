@@ -24,6 +24,7 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sam.h>
 #include <component/usb.h>
 #include <component/mclk.h>
@@ -41,6 +42,8 @@ extern "C" {
 #include "cdcdf_acm.h"
 #include "cdcdf_acm_desc.h"
 #include "hal_usb_device.h"
+#include "mscdf.h"
+#include "vendordf.h"
 #ifdef __cplusplus
 }
 #endif
@@ -54,6 +57,12 @@ namespace ClearCore {
 
 extern SysManager SysMgr;
 UsbManager &UsbMgr = UsbManager::Instance();
+#if CDCDF_ACM_PORTS > 1
+UsbManager &UsbMgr1 = *UsbManager::Port(1);
+#endif
+#if CDCDF_ACM_PORTS > 2
+UsbManager &UsbMgr2 = *UsbManager::Port(2);
+#endif
 
 #if CONF_USBD_HS_SP
 static uint8_t single_desc_bytes[] = {
@@ -65,6 +74,74 @@ static uint8_t single_desc_bytes_hs[] = {
     CDCD_ACM_HS_DESCES_HS
 };
 #define CDCD_ECHO_BUF_SIZ CONF_USB_CDCD_ACM_DATA_BULKIN_MAXPKSZ_HS
+#elif CONF_USB_VENDOR_EN || CONF_USB_MSC_EN || CONF_USB_CDCD_ACM_PORTS > 1
+// Each pair of CDC ACM interfaces is grouped by an IAD so the host binds its
+// serial driver to them, and the vendor bulk and mass storage interfaces
+// follow
+#if CONF_USB_CDCD_ACM_PORTS > 3
+#error "CONF_USB_CDCD_ACM_PORTS must be 3 or less"
+#endif
+#if CONF_USB_CDCD_ACM_PORTS > 2 && ((CONF_USB_VENDOR_EN &&                  \
+        CONF_USB_CDCD_ACM2_DATA_BULKIN_EPADDR ==                            \
+        CONF_USB_VENDOR_BULKIN_EPADDR) || (CONF_USB_MSC_EN &&               \
+        CONF_USB_CDCD_ACM2_DATA_BULKIN_EPADDR == CONF_USB_MSC_BULKIN_EPADDR))
+#error "CDC port 2 shares an IN endpoint with another interface"
+#endif
+#define COMPOSITE_IFACE_CNT \
+    (2 * CONF_USB_CDCD_ACM_PORTS + CONF_USB_VENDOR_EN + CONF_USB_MSC_EN)
+#define COMPOSITE_CFG_DESC_LEN                                        \
+    (67 + USB_IAD_DESC_LEN +                                          \
+     (CONF_USB_CDCD_ACM_PORTS - 1) * CDCD_ACM_PORT_DESC_LEN +         \
+     (CONF_USB_VENDOR_EN + CONF_USB_MSC_EN) *                         \
+     (USB_IFACE_DESC_LEN + 2 * USB_ENDP_DESC_LEN))
+static uint8_t single_desc_bytes[] = {
+    USB_DEV_DESC_BYTES(CONF_USB_CDCD_ACM_BCDUSB, USB_CLASS_IAD,
+                       USB_SUBCLASS_IAD, USB_PROTOCOL_IAD,
+                       CONF_USB_CDCD_ACM_BMAXPKSZ0,
+                       CONF_USB_CDCD_ACM_IDVENDER,
+                       CONF_USB_CDCD_ACM_IDPRODUCT,
+                       CONF_USB_CDCD_ACM_BCDDEVICE,
+                       CONF_USB_CDCD_ACM_IMANUFACT,
+                       CONF_USB_CDCD_ACM_IPRODUCT,
+                       CONF_USB_CDCD_ACM_ISERIALNUM,
+                       CONF_USB_CDCD_ACM_BNUMCONFIG),
+    USB_CONFIG_DESC_BYTES(COMPOSITE_CFG_DESC_LEN, COMPOSITE_IFACE_CNT,
+                          CONF_USB_CDCD_ACM_BCONFIGVAL,
+                          CONF_USB_CDCD_ACM_ICONFIG,
+                          CONF_USB_CDCD_ACM_BMATTRI,
+                          CONF_USB_CDCD_ACM_BMAXPOWER),
+    USB_IAD_DESC_BYTES(CONF_USB_CDCD_ACM_COMM_BIFCNUM, 2, 0x02, 0x02, 0x00,
+                       0),
+    CDCD_ACM_COMM_IFACE_DESCES,
+    CDCD_ACM_DATA_IFACE_DESCES,
+#if CONF_USB_CDCD_ACM_PORTS > 1
+    CDCD_ACM_PORT_DESCES(0x2, CONF_USB_CDCD_ACM1_COMM_INT_EPADDR,
+                         CONF_USB_CDCD_ACM1_DATA_BULKOUT_EPADDR,
+                         CONF_USB_CDCD_ACM1_DATA_BULKIN_EPADDR),
+#endif
+#if CONF_USB_CDCD_ACM_PORTS > 2
+    CDCD_ACM_PORT_DESCES(0x4, CONF_USB_CDCD_ACM2_COMM_INT_EPADDR,
+                         CONF_USB_CDCD_ACM2_DATA_BULKOUT_EPADDR,
+                         CONF_USB_CDCD_ACM2_DATA_BULKIN_EPADDR),
+#endif
+#if CONF_USB_VENDOR_EN
+    USB_IFACE_DESC_BYTES(CONF_USB_VENDOR_BIFCNUM, 0, 2, 0xFF, 0x00, 0x00, 0),
+    USB_ENDP_DESC_BYTES(CONF_USB_VENDOR_BULKOUT_EPADDR, 2,
+                        CONF_USB_VENDOR_BULK_MAXPKSZ, 0),
+    USB_ENDP_DESC_BYTES(CONF_USB_VENDOR_BULKIN_EPADDR, 2,
+                        CONF_USB_VENDOR_BULK_MAXPKSZ, 0),
+#endif
+#if CONF_USB_MSC_EN
+    // Mass storage, SCSI transparent command set, Bulk-Only Transport
+    USB_IFACE_DESC_BYTES(CONF_USB_MSC_BIFCNUM, 0, 2, 0x08, 0x06, 0x50, 0),
+    USB_ENDP_DESC_BYTES(CONF_USB_MSC_BULKOUT_EPADDR, 2,
+                        CONF_USB_MSC_BULK_MAXPKSZ, 0),
+    USB_ENDP_DESC_BYTES(CONF_USB_MSC_BULKIN_EPADDR, 2,
+                        CONF_USB_MSC_BULK_MAXPKSZ, 0),
+#endif
+    CDCD_ACM_STR_DESCES
+};
+#define CDCD_ECHO_BUF_SIZ CONF_USB_CDCD_ACM_DATA_BULKIN_MAXPKSZ
 #else
 static uint8_t single_desc_bytes[] = {
     // Device descriptors and Configuration descriptors list.
@@ -142,6 +219,12 @@ void UsbManager::cdc_device_acm_init(void) {
 
     // usbdc_register_funcion inside
     cdcdf_acm_init();
+#if CONF_USB_VENDOR_EN
+    vendordf_init();
+#endif
+#if CONF_USB_MSC_EN
+    mscdf_init();
+#endif
 
     usbdc_start(single_desc);
     usbdc_attach();
@@ -244,19 +327,59 @@ UsbManager &UsbManager::Instance() {
     return *instance;
 }
 
-UsbManager::UsbManager() :
-    m_inHead(0),
-    m_inTail(0),
-    m_outHead(0),
-    m_outTail(0),
+UsbManager *UsbManager::Port(uint8_t port) {
+    static UsbManager *ports[CDCDF_ACM_PORTS] = {
+        &Instance(),
+#if CDCDF_ACM_PORTS > 1
+        new UsbManager(1),
+#endif
+#if CDCDF_ACM_PORTS > 2
+        new UsbManager(2),
+#endif
+    };
+    return (port < CDCDF_ACM_PORTS) ? ports[port] : nullptr;
+}
+
+UsbManager::UsbManager(uint8_t port) :
+    m_port(port),
+    m_bufferIn(),
+    m_bufferOut(),
     m_sendActive(false),
     m_readActive(false),
-    m_readBufPtr(m_usbReadBuf),
-    m_readBufAvail(0),
+    m_readBufPtr(),
+    m_readBufAvail(),
+    m_readBufNext(0),
+    m_readBufDrain(0),
+    m_writeBufCount(),
+    m_writeBufNext(0),
+    m_txLatency(USB_SERIAL_TX_LATENCY_MS * MS_TO_SAMPLES),
+    m_txWait(0),
+    m_txFlush(false),
+    m_sendDirect(false),
+    m_sendDirectOk(false),
+    m_telemetryBuf(),
+    m_telemetryRecordSize(0),
+    m_telemetryCapacity(0),
+    m_telemetryHead(0),
+    m_telemetryTail(0),
+    m_telemetrySending(0),
+    m_telemetryDropped(0),
+    m_telemetryEnabled(false),
+    m_telemetryCommandBuf(),
+    m_telemetryCommandCallback(nullptr),
     m_portOpen(false) {
     m_lineState.value = 0;
-    cdcdf_acm_register_callback(CDCDF_ACM_CB_STATE_C,
-                                (FUNC_PTR)CBLineStateChanged);
+    static const FUNC_PTR lineStateCallbacks[CDCDF_ACM_PORTS] = {
+        (FUNC_PTR)CBLineStateChanged<0>,
+#if CDCDF_ACM_PORTS > 1
+        (FUNC_PTR)CBLineStateChanged<1>,
+#endif
+#if CDCDF_ACM_PORTS > 2
+        (FUNC_PTR)CBLineStateChanged<2>,
+#endif
+    };
+    cdcdf_acm_port_register_callback(port, CDCDF_ACM_CB_STATE_C,
+                                     lineStateCallbacks[port]);
 }
 
 bool UsbManager::Initialize() {
@@ -286,7 +409,7 @@ bool UsbManager::Speed(uint32_t bitsPerSecond) {
 }
 
 uint32_t UsbManager::Speed() {
-    return cdcdf_acm_get_line_coding()->dwDTERate;
+    return cdcdf_acm_port_get_line_coding(m_port)->dwDTERate;
 }
 
 /**
@@ -300,28 +423,37 @@ uint32_t UsbManager::Speed() {
 /**
     Callback invoked when Line State Change
 **/
+template <uint8_t port>
 bool UsbManager::CBLineStateChanged(usb_cdc_control_signal_t state) {
-    UsbMgr.m_lineState = state;
+    Port(port)->LineStateChanged(state);
+    // No error
+    return false;
+}
+
+void UsbManager::LineStateChanged(usb_cdc_control_signal_t state) {
+    m_lineState = state;
     if (state.rs232.DTR) {
         // Callbacks must be registered after endpoint allocation
-        cdcdf_acm_register_callback(CDCDF_ACM_CB_READ, (FUNC_PTR)RxComplete);
-        cdcdf_acm_register_callback(CDCDF_ACM_CB_WRITE, (FUNC_PTR)TxComplete);
+        cdcdf_acm_port_register_callback(m_port, CDCDF_ACM_CB_READ,
+                                         (FUNC_PTR)RxComplete);
+        cdcdf_acm_port_register_callback(m_port, CDCDF_ACM_CB_WRITE,
+                                         (FUNC_PTR)TxComplete);
         // Start Rx
-        cdcdf_acm_read(UsbMgr.m_usbReadBuf, sizeof(UsbMgr.m_usbReadBuf));
+        RxStart();
     }
     else {
         // Callbacks must be registered after endpoint allocation
-        cdcdf_acm_register_callback(CDCDF_ACM_CB_READ, (FUNC_PTR)NULL);
-        cdcdf_acm_register_callback(CDCDF_ACM_CB_WRITE, (FUNC_PTR)NULL);
+        cdcdf_acm_port_register_callback(m_port, CDCDF_ACM_CB_READ,
+                                         (FUNC_PTR)NULL);
+        cdcdf_acm_port_register_callback(m_port, CDCDF_ACM_CB_WRITE,
+                                         (FUNC_PTR)NULL);
         // Stop Rx/Tx
-        cdcdf_acm_stop_xfer();
-        if (cdcdf_acm_get_line_coding()->dwDTERate == 1200) {
+        cdcdf_acm_port_stop_xfer(m_port);
+        XferReset();
+        if (!m_port && Speed() == 1200) {
             SysMgr.ResetBoard(SysManager::RESET_TO_BOOTLOADER);
         }
     }
-
-    // No error
-    return false;
 }
 
 bool UsbManager::PortIsOpen() {
@@ -336,10 +468,12 @@ void UsbManager::PortOpen() {
     m_portOpen = true;
 
     // Callbacks must be registered after endpoint allocation
-    cdcdf_acm_register_callback(CDCDF_ACM_CB_READ, (FUNC_PTR)RxComplete);
-    cdcdf_acm_register_callback(CDCDF_ACM_CB_WRITE, (FUNC_PTR)TxComplete);
+    cdcdf_acm_port_register_callback(m_port, CDCDF_ACM_CB_READ,
+                                     (FUNC_PTR)RxComplete);
+    cdcdf_acm_port_register_callback(m_port, CDCDF_ACM_CB_WRITE,
+                                     (FUNC_PTR)TxComplete);
     // Start Rx
-    cdcdf_acm_read(m_usbReadBuf, sizeof(m_usbReadBuf));
+    RxStart();
 }
 
 void UsbManager::PortClose() {
@@ -354,36 +488,111 @@ void UsbManager::PortClose() {
     m_portOpen = false;
 
     // Callbacks must be registered after endpoint allocation
-    cdcdf_acm_register_callback(CDCDF_ACM_CB_READ, (FUNC_PTR)NULL);
-    cdcdf_acm_register_callback(CDCDF_ACM_CB_WRITE, (FUNC_PTR)NULL);
+    cdcdf_acm_port_register_callback(m_port, CDCDF_ACM_CB_READ,
+                                     (FUNC_PTR)NULL);
+    cdcdf_acm_port_register_callback(m_port, CDCDF_ACM_CB_WRITE,
+                                     (FUNC_PTR)NULL);
     // Stop Rx/Tx
-    cdcdf_acm_stop_xfer();
+    cdcdf_acm_port_stop_xfer(m_port);
 
-    m_inHead = 0;
-    m_inTail = 0;
-    m_outHead = 0;
-    m_outTail = 0;
-    m_readBufAvail = 0;
+    m_bufferIn.Clear();
+    m_bufferOut.Clear();
+    XferReset();
+}
+
+void UsbManager::XferReset() {
+    __disable_irq();
     m_sendActive = false;
     m_readActive = false;
+    m_sendDirect = false;
+    m_readBufAvail[0] = m_readBufAvail[1] = 0;
+    m_readBufNext = m_readBufDrain = 0;
+    m_writeBufCount[0] = m_writeBufCount[1] = 0;
+    m_writeBufNext = 0;
+    m_txWait = 0;
+    __enable_irq();
 }
 
 void UsbManager::FlushInput() {
-    m_inHead = 0;
-    m_inTail = 0;
-    m_readActive = false;
-    m_readBufAvail = 0;
-    cdcdf_acm_read(m_usbReadBuf, sizeof(m_usbReadBuf));
+    __disable_irq();
+    m_bufferIn.Clear();
+    // Drop the received data; a read in progress carries on and its data
+    // is kept
+    m_readBufAvail[0] = m_readBufAvail[1] = 0;
+    m_readBufDrain = m_readBufNext;
+    __enable_irq();
+    RxStart();
 }
 
 void UsbManager::WaitForWriteFinish() {
-    while (m_outHead != m_outTail && Connected()) {
+    // Send the waiting data now instead of after the send latency
+    m_txFlush = true;
+    TxPump();
+    while ((!m_bufferOut.Empty() || m_sendActive ||
+            m_writeBufCount[0] || m_writeBufCount[1]) && Connected()) {
+        continue;
+    }
+    m_txFlush = false;
+}
+
+void UsbManager::SendLatency(uint16_t ms) {
+    uint32_t samples = static_cast<uint32_t>(ms) * MS_TO_SAMPLES;
+    m_txLatency = (samples > UINT16_MAX) ? UINT16_MAX : samples;
+}
+
+uint16_t UsbManager::SendLatency() {
+    return m_txLatency / MS_TO_SAMPLES;
+}
+
+bool UsbManager::SendDirect(const uint8_t *buffer, size_t length) {
+    uint32_t address = reinterpret_cast<uint32_t>(buffer);
+    if ((address & 0x3) || address < HSRAM_ADDR ||
+            address + length > HSRAM_ADDR + HSRAM_SIZE) {
+        // The USB DMA cannot send it in place
+        while (length) {
+            int32_t count = WriteBlock(buffer, length);
+            if (count < 0) {
+                return false;
+            }
+            buffer += count;
+            length -= count;
+        }
+        return true;
+    }
+
+    // Keep the data in order behind anything already buffered
+    WaitForWriteFinish();
+    if (!length) {
+        return true;
+    }
+
+    __disable_irq();
+    if (!Connected() || !m_portOpen || m_sendActive) {
+        __enable_irq();
+        return false;
+    }
+    m_sendActive = true;
+    m_sendDirect = true;
+    __enable_irq();
+
+    if (cdcdf_acm_port_write(m_port, const_cast<uint8_t *>(buffer),
+                             length)) {
+        m_sendDirect = false;
+        atomic_clear_seqcst(&m_sendActive);
+        return false;
+    }
+    while (m_sendDirect && Connected()) {
         continue;
     }
+    if (m_sendDirect) {
+        // Disconnected before the transfer finished
+        return false;
+    }
+    return m_sendDirectOk;
 }
 
 bool UsbManager::Connected() {
-    return cdcdf_acm_is_enabled() && LineState().rs232.DTR &&
+    return cdcdf_acm_port_is_enabled(m_port) && LineState().rs232.DTR &&
            USB->DEVICE.FSMSTATUS.bit.FSMSTATE == USB_FSMSTATUS_FSMSTATE_ON;
 }
 
@@ -394,118 +603,137 @@ UsbManager::operator bool() {
 }
 
 int16_t UsbManager::CharGet() {
-    uint32_t head = m_inHead;
-    if (m_inTail == head) {
+    uint8_t retVal;
+    if (!m_bufferIn.Pop(retVal)) {
         return -1;
     }
-    uint8_t retVal = m_bufferIn[head];
-    m_inHead = (head + 1) & (sizeof(m_bufferIn) - 1);
     RxCopyToRingBuf();
     return retVal;
 }
 
 int16_t UsbManager::CharPeek() {
-    if (m_inTail == m_inHead) {
+    uint8_t peekChar;
+    if (!m_bufferIn.Peek(peekChar)) {
         return -1;
     }
-    return m_bufferIn[m_inHead];
+    return peekChar;
 }
 
 bool UsbManager::SendChar(uint8_t charToSend) {
+    if (!Connected() || !m_portOpen) {
+        return false;
+    }
+    if (m_bufferOut.Push(charToSend)) {
+        return true;
+    }
+    SysTiming::LoopBlockMarker marker(SysTiming::LOOP_BLOCK_USB_TX);
     while (Connected() && m_portOpen) {
-        if (AvailableForWrite()) {
-            m_bufferOut[m_outTail] = charToSend;
-            m_outTail = (m_outTail + 1) & (sizeof(m_bufferOut) - 1);
+        if (m_bufferOut.Push(charToSend)) {
             return true;
         }
     }
     return false;
 }
 
+int32_t UsbManager::ReadBlock(uint8_t *buffer, size_t length) {
+    uint32_t count = m_bufferIn.Read(buffer, length);
+    RxCopyToRingBuf();
+    return count;
+}
+
+int32_t UsbManager::WriteBlock(const uint8_t *buffer, size_t length) {
+    if (!Connected() || !m_portOpen) {
+        return -1;
+    }
+    return m_bufferOut.Write(buffer, length);
+}
+
 /**
     Return the number of free characters in the receive buffer
 **/
 int32_t UsbManager::AvailableForRead() {
-    int32_t difference = m_inTail - m_inHead;
-
-    if (difference < 0) {
-        return sizeof(m_bufferIn) + difference;
-    }
-    else {
-        return difference;
-    }
+    return m_bufferIn.Count();
 }
 
 /**
     Returns the number of available characters in the transmit buffer
 **/
 int32_t UsbManager::AvailableForWrite() {
-    int32_t difference = m_outHead - m_outTail - 1;
-
-    if (difference < 0) {
-        difference += sizeof(m_bufferOut);
-    }
-
-    return difference;
+    return m_bufferOut.Space();
 }
 
 /**
     Transmit any data waiting in the tx buffer
 **/
-void UsbManager::TxPump() {
-    if (atomic_test_and_set_acqrel(&m_sendActive)) {
-        // Already sending; can't send anything more right now
+void UsbManager::TxPump(bool sample) {
+    // Called from both the USB interrupt and the deferred update
+    __disable_irq();
+    if (m_sendDirect) {
+        __enable_irq();
         return;
     }
 
-    uint32_t head = m_outHead;
-    uint32_t tail = m_outTail;
-    if (head == tail) {
-        // Nothing to send, bail out
-        atomic_clear_seqcst(&m_sendActive);
-        return;
+    // Top up the transfer buffers that are not being sent, starting with
+    // the next one to be sent, so the other only gets data once the next is
+    // full. The data sent to cdcdf_acm_write needs to be 4-byte aligned, so
+    // it is copied out of the ring into the aligned buffers.
+    uint8_t buf = m_writeBufNext;
+    for (uint8_t i = 0; i < 2; i++) {
+        uint8_t fill = buf ^ i;
+        uint32_t count = m_writeBufCount[fill];
+        if ((m_sendActive && fill == buf) || count == USB_SERIAL_XFER_SIZE ||
+                m_bufferOut.Empty()) {
+            continue;
+        }
+        m_writeBufCount[fill] = count +
+            m_bufferOut.Read(m_usbWriteBuf[fill] + count,
+                             USB_SERIAL_XFER_SIZE - count);
     }
 
-    // The data sent to cdcdf_acm_write needs to be 4-byte aligned,
-    // so copy the data into an aligned buffer before sending it out
-    uint32_t count = sizeof(m_usbWriteBuf);
-    uint8_t *inPtr = m_bufferOut + head, *outPtr = m_usbWriteBuf;
-    if (head < tail) {
-        count = min(count, tail - head);
-        for (uint32_t iChar = 0; iChar < count; iChar++) {
-            *outPtr++ = *inPtr++;
-        }
+    // Age the data that has not started sending
+    if (sample && m_txWait < UINT16_MAX &&
+            (m_writeBufCount[buf ^ 1] ||
+             (!m_sendActive && m_writeBufCount[buf]))) {
+        m_txWait++;
     }
-    else {
-        uint32_t countTilWrap = sizeof(m_bufferOut) - head;
-        count = min(count, countTilWrap + tail);
-        uint32_t loopEnd = min(countTilWrap, count);
-        for (uint32_t iChar = 0; iChar < loopEnd; iChar++) {
-            *outPtr++ = *inPtr++;
+
+    uint32_t count = m_writeBufCount[buf];
+    if (!m_sendActive && count && (count == USB_SERIAL_XFER_SIZE ||
+                                   m_txFlush || m_txWait >= m_txLatency)) {
+        m_sendActive = true;
+        if (cdcdf_acm_port_write(m_port, m_usbWriteBuf[buf], count)) {
+            // cdcdf_acm_write failed, try again on the next pump
+            m_sendActive = false;
         }
-        inPtr = m_bufferOut;
-        loopEnd = count - loopEnd;
-        for (uint32_t iChar = 0; iChar < loopEnd; iChar++) {
-            *outPtr++ = *inPtr++;
+        else if (!m_writeBufCount[buf ^ 1]) {
+            // Nothing else is waiting; the next write starts a new wait
+            m_txWait = 0;
         }
     }
-    if (cdcdf_acm_write(m_usbWriteBuf, count)) {
-        // cdcdf_acm_write failed, clear the send active flag
-        atomic_clear_seqcst(&m_sendActive);
-    }
+    __enable_irq();
 }
 
 bool UsbManager::TxComplete(const uint8_t ep,
                             const enum usb_xfer_code rc,
                             const uint32_t count) {
-    UNUSED(ep);
+    UNUSED(count);
 
-    if (rc == USB_XFER_DONE) {
-        UsbMgr.m_outHead =
-            (UsbMgr.m_outHead + count) & (sizeof(m_bufferOut) - 1);
+    UsbManager *usb = Port(cdcdf_acm_ep_port(ep));
+    if (!usb) {
+        return true;
+    }
+    if (usb->m_sendDirect) {
+        usb->m_sendDirectOk = rc == USB_XFER_DONE;
+        usb->m_sendDirect = false;
     }
-    atomic_clear_seqcst(&UsbMgr.m_sendActive);
-    UsbMgr.TxPump();
+    else {
+        // The buffer is done with whether or not the host took it
+        uint8_t buf = usb->m_writeBufNext;
+        usb->m_writeBufCount[buf] = 0;
+        usb->m_writeBufNext = buf ^ 1;
+    }
+    atomic_clear_seqcst(&usb->m_sendActive);
+    usb->TxPump();
 
     return true;
 }
@@ -513,65 +741,181 @@ bool UsbManager::TxComplete(const uint8_t ep,
 bool UsbManager::RxComplete(const uint8_t ep,
                             const enum usb_xfer_code rc,
                             const uint32_t count) {
-    UNUSED(ep);
     UNUSED(rc);
 
+    UsbManager *usb = Port(cdcdf_acm_ep_port(ep));
+    if (!usb) {
+        return true;
+    }
     __disable_irq();
-    // Make the Rx data available to be copied into the Rx ring buffer
-    UsbMgr.m_readBufAvail = count;
-    UsbMgr.m_readBufPtr = UsbMgr.m_usbReadBuf;
+    // Make the Rx data available to be copied into the Rx ring buffer. An
+    // empty transfer leaves the buffer free to read into again.
+    uint8_t buf = usb->m_readBufNext;
+    if (count) {
+        usb->m_readBufAvail[buf] = count;
+        usb->m_readBufPtr[buf] = usb->m_usbReadBuf[buf];
+        usb->m_readBufNext = buf ^ 1;
+    }
+    usb->m_readActive = false;
     __enable_irq();
-    UsbMgr.RxCopyToRingBuf();
+    usb->RxCopyToRingBuf();
     return true;
 }
 void UsbManager::Refresh(void) {
-    if (!m_sendActive && m_outHead != m_outTail) {
-        TxPump();
+    // Called on port 0 for the whole device
+    for (uint8_t i = 0; i < CDCDF_ACM_PORTS; i++) {
+        UsbManager *usb = Port(i);
+        // Fill the idle transfer buffer even while the other is being sent,
+        // and send a partly full one once it has waited the send latency
+        if (!usb->m_bufferOut.Empty() || usb->m_writeBufCount[0] ||
+                usb->m_writeBufCount[1]) {
+            usb->TxPump(true);
+        }
     }
+    TelemetryRefresh();
 }
 
-void UsbManager::RxCopyToRingBuf() {
+bool UsbManager::TelemetryRecordSize(uint16_t size) {
+    if (m_port || !size || (size & 0x3) || size > sizeof(m_telemetryBuf) / 2) {
+        return false;
+    }
     __disable_irq();
-    uint32_t space = sizeof(m_bufferIn) - 1 - AvailableForRead();
-    if (m_readBufAvail && space) {
-
-        uint32_t count = min(space, m_readBufAvail);
-        uint32_t tail = m_inTail;
-        uint8_t *inPtr = m_readBufPtr;
-        uint8_t *outPtr = &m_bufferIn[tail];
-        uint32_t countTilWrap = sizeof(m_bufferIn) - tail;
-        countTilWrap = min(countTilWrap, count);
-
-        // Copy the available data until we get to the
-        // end of input data or the ring buffer wrap point
-        for (uint32_t i = 0; i < countTilWrap; i++) {
-            *outPtr++ = *inPtr++;
-        }
-        count -= countTilWrap;
-        m_readBufPtr += countTilWrap;
-        m_readBufAvail -= countTilWrap;
-        if (count) {
-            // Account for the ring buffer wrap point
-            // and copy the remaining available data
-            outPtr = m_bufferIn;
-            for (uint32_t i = 0; i < count; i++) {
-                *outPtr++ = *inPtr++;
-            }
-            m_inTail = count;
-            m_readBufPtr += count;
-            m_readBufAvail -= count;
+    if (m_telemetrySending) {
+        __enable_irq();
+        return false;
+    }
+    m_telemetryRecordSize = size;
+    m_telemetryCapacity = sizeof(m_telemetryBuf) / size;
+    m_telemetryHead = 0;
+    m_telemetryTail = 0;
+    __enable_irq();
+    return true;
+}
+
+bool UsbManager::TelemetryPush(const void *record) {
+    uint16_t capacity = m_telemetryCapacity;
+    if (!capacity || !m_telemetryEnabled) {
+        return false;
+    }
+    uint16_t tail = m_telemetryTail;
+    uint16_t next = (tail + 1 == capacity) ? 0 : tail + 1;
+    if (next == m_telemetryHead) {
+        m_telemetryDropped++;
+        return false;
+    }
+    memcpy(&m_telemetryBuf[tail * m_telemetryRecordSize], record,
+           m_telemetryRecordSize);
+    // Publish the record once it has been copied in
+    m_telemetryTail = next;
+    TelemetryPump();
+    return true;
+}
+
+void UsbManager::TelemetryRefresh() {
+    bool enabled = vendordf_is_enabled();
+    if (enabled == m_telemetryEnabled) {
+        if (enabled) {
+            TelemetryPump();
         }
-        else {
-            m_inTail = (tail + countTilWrap) & (sizeof(m_bufferIn) - 1);
+        return;
+    }
+
+    __disable_irq();
+    m_telemetrySending = 0;
+    m_telemetryHead = 0;
+    m_telemetryTail = 0;
+    __enable_irq();
+    if (enabled) {
+        // Callbacks must be registered after endpoint allocation
+        vendordf_register_callback(VENDORDF_CB_READ,
+                                   (FUNC_PTR)TelemetryCommandComplete);
+        vendordf_register_callback(VENDORDF_CB_WRITE,
+                                   (FUNC_PTR)TelemetryComplete);
+        vendordf_read(m_telemetryCommandBuf, sizeof(m_telemetryCommandBuf));
+    }
+    m_telemetryEnabled = enabled;
+}
+
+void UsbManager::TelemetryPump() {
+    __disable_irq();
+    uint16_t head = m_telemetryHead;
+    uint16_t tail = m_telemetryTail;
+    if (m_telemetrySending || head == tail) {
+        __enable_irq();
+        return;
+    }
+    // Send the records straight out of the ring, up to its end
+    uint16_t count = (tail > head) ? tail - head : m_telemetryCapacity - head;
+    m_telemetrySending = count;
+    if (vendordf_write(&m_telemetryBuf[head * m_telemetryRecordSize],
+                       count * m_telemetryRecordSize)) {
+        m_telemetrySending = 0;
+    }
+    __enable_irq();
+}
+
+bool UsbManager::TelemetryComplete(const uint8_t ep,
+                                   const enum usb_xfer_code rc,
+                                   const uint32_t count) {
+    UNUSED(ep);
+    UNUSED(rc);
+    UNUSED(count);
+
+    uint16_t head = UsbMgr.m_telemetryHead + UsbMgr.m_telemetrySending;
+    UsbMgr.m_telemetryHead =
+        (head >= UsbMgr.m_telemetryCapacity) ? 0 : head;
+    UsbMgr.m_telemetrySending = 0;
+    UsbMgr.TelemetryPump();
+    return true;
+}
+
+bool UsbManager::TelemetryCommandComplete(const uint8_t ep,
+        const enum usb_xfer_code rc,
+        const uint32_t count) {
+    UNUSED(ep);
+
+    if (rc == USB_XFER_DONE && count && UsbMgr.m_telemetryCommandCallback) {
+        UsbMgr.m_telemetryCommandCallback(UsbMgr.m_telemetryCommandBuf,
+                                          count);
+    }
+    vendordf_read(UsbMgr.m_telemetryCommandBuf,
+                  sizeof(UsbMgr.m_telemetryCommandBuf));
+    return true;
+}
+
+void UsbManager::RxStart() {
+    __disable_irq();
+    uint8_t buf = m_readBufNext;
+    if (!m_readActive && !m_readBufAvail[buf]) {
+        m_readActive = true;
+        if (cdcdf_acm_port_read(m_port, m_usbReadBuf[buf],
+                                USB_SERIAL_XFER_SIZE)) {
+            m_readActive = false;
         }
+    }
+    __enable_irq();
+}
 
-        // If all of the available input data has been copied into the
-        // ring buffer, read more input data from the USB device
-        if (!m_readBufAvail) {
-            cdcdf_acm_read(m_usbReadBuf, sizeof(m_usbReadBuf));
+void UsbManager::RxCopyToRingBuf() {
+    __disable_irq();
+    uint8_t buf = m_readBufDrain;
+    while (m_readBufAvail[buf] && !m_bufferIn.Full()) {
+        uint32_t count =
+            m_bufferIn.Write(m_readBufPtr[buf], m_readBufAvail[buf]);
+        m_readBufPtr[buf] += count;
+        m_readBufAvail[buf] -= count;
+
+        // Move on to the other buffer once this one is empty; it is either
+        // the next oldest data or the one being read into
+        if (!m_readBufAvail[buf]) {
+            buf ^= 1;
+            m_readBufDrain = buf;
         }
     }
     __enable_irq();
+
+    // Read more input data from the USB device into a free buffer
+    RxStart();
 }
 
 } // ClearCore namespace
@@ -0,0 +1,632 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    ClearCore USB mass storage access to the SD card
+
+    Carries out the SCSI commands of the Bulk-Only Transport on the card.
+**/
+
+#include "UsbMassStorage.h"
+#include <string.h>
+#include "SysUtils.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include "mscdf.h"
+#include "usbd_config.h"
+#ifdef __cplusplus
+}
+#endif
+
+// Bulk-Only Transport wrappers
+#define CBW_SIGNATURE 0x43425355
+#define CBW_LENGTH 31
+#define CSW_SIGNATURE 0x53425355
+#define CSW_LENGTH 13
+#define CSW_STATUS_PASSED 0
+#define CSW_STATUS_FAILED 1
+#define CSW_STATUS_PHASE_ERROR 2
+
+// SCSI operation codes
+#define SCSI_TEST_UNIT_READY 0x00
+#define SCSI_REQUEST_SENSE 0x03
+#define SCSI_INQUIRY 0x12
+#define SCSI_MODE_SENSE_6 0x1A
+#define SCSI_START_STOP_UNIT 0x1B
+#define SCSI_PREVENT_ALLOW_REMOVAL 0x1E
+#define SCSI_READ_FORMAT_CAPACITIES 0x23
+#define SCSI_READ_CAPACITY_10 0x25
+#define SCSI_READ_10 0x28
+#define SCSI_WRITE_10 0x2A
+#define SCSI_VERIFY_10 0x2F
+#define SCSI_SYNCHRONIZE_CACHE_10 0x35
+#define SCSI_MODE_SENSE_10 0x5A
+
+// Sense keys and additional sense codes
+#define SENSE_NONE 0x00
+#define SENSE_NOT_READY 0x02
+#define SENSE_MEDIUM_ERROR 0x03
+#define SENSE_ILLEGAL_REQUEST 0x05
+#define SENSE_UNIT_ATTENTION 0x06
+#define SENSE_DATA_PROTECT 0x07
+#define ASC_NONE 0x00
+#define ASC_WRITE_ERROR 0x0C
+#define ASC_READ_ERROR 0x11
+#define ASC_INVALID_COMMAND 0x20
+#define ASC_LBA_OUT_OF_RANGE 0x21
+#define ASC_WRITE_PROTECTED 0x27
+#define ASC_MEDIUM_CHANGED 0x28
+#define ASC_MEDIUM_NOT_PRESENT 0x3A
+
+#define MSC_BUFFER_BLOCKS (USB_MSC_BUFFER_SIZE / SD_BLOCK_SIZE)
+
+static_assert(USB_MSC_BUFFER_SIZE % SD_BLOCK_SIZE == 0 &&
+              USB_MSC_BUFFER_SIZE >= SD_BLOCK_SIZE,
+              "USB_MSC_BUFFER_SIZE must be whole blocks");
+
+namespace ClearCore {
+
+extern SdCardDriver SdCard;
+
+UsbMassStorage &UsbMsc = UsbMassStorage::Instance();
+
+// Endpoint callbacks with the usb_d_ep_cb_xfer_t prototype; the stack passes
+// the transferred byte count in param
+static bool MscInXfer(const uint8_t ep, const enum usb_xfer_code code,
+                      void *param) {
+    (void)ep;
+    (void)param;
+    UsbMsc.InComplete(code == USB_XFER_UNHALT);
+    return true;
+}
+
+static bool MscOutXfer(const uint8_t ep, const enum usb_xfer_code code,
+                       void *param) {
+    (void)ep;
+    UsbMsc.OutComplete(code == USB_XFER_DONE,
+                       static_cast<uint32_t>(
+                           reinterpret_cast<uintptr_t>(param)));
+    return true;
+}
+
+static void MscReset() {
+    UsbMsc.ResetRequest();
+}
+
+static uint32_t BigEndian32Get(const uint8_t *data) {
+    return (static_cast<uint32_t>(data[0]) << 24) |
+           (static_cast<uint32_t>(data[1]) << 16) |
+           (static_cast<uint32_t>(data[2]) << 8) | data[3];
+}
+
+static void BigEndian32Set(uint8_t *data, uint32_t value) {
+    data[0] = value >> 24;
+    data[1] = value >> 16;
+    data[2] = value >> 8;
+    data[3] = value;
+}
+
+static uint32_t LittleEndian32Get(const uint8_t *data) {
+    return (static_cast<uint32_t>(data[3]) << 24) |
+           (static_cast<uint32_t>(data[2]) << 16) |
+           (static_cast<uint32_t>(data[1]) << 8) | data[0];
+}
+
+static void LittleEndian32Set(uint8_t *data, uint32_t value) {
+    data[0] = value;
+    data[1] = value >> 8;
+    data[2] = value >> 16;
+    data[3] = value >> 24;
+}
+
+UsbMassStorage &UsbMassStorage::Instance() {
+    static UsbMassStorage *instance = new UsbMassStorage();
+    return *instance;
+}
+
+UsbMassStorage::UsbMassStorage()
+    : m_cbw(),
+      m_csw(),
+      m_buffer(),
+      m_bufferBytes(),
+      m_bufferUsb(0),
+      m_bufferCard(0),
+      m_state(MSC_COMMAND),
+      m_enabled(false),
+      m_started(false),
+      m_writable(false),
+      m_mediaChanged(false),
+      m_outDone(false),
+      m_outCount(0),
+      m_inDone(false),
+      m_inUnhalted(false),
+      m_outCancelled(false),
+      m_reset(false),
+      m_cbwPosted(false),
+      m_usbBusy(false),
+      m_tag(0),
+      m_residue(0),
+      m_status(CSW_STATUS_PASSED),
+      m_dirIn(false),
+      m_cardBlocks(0),
+      m_cardBlock(0),
+      m_usbBlocks(0),
+      m_usbBytes(0),
+      m_cardFailed(false),
+      m_senseKey(SENSE_NONE),
+      m_senseAsc(ASC_NONE),
+      m_blocksRead(0),
+      m_blocksWritten(0) {}
+
+bool UsbMassStorage::Start(bool writable) {
+    if (!CONF_USB_MSC_EN) {
+        return false;
+    }
+    if (!SdCard.Initialized() && !SdCard.Initialize()) {
+        return false;
+    }
+    m_writable = writable;
+    // The host must drop what it read while the disk was away
+    m_mediaChanged = true;
+    m_started = true;
+    return true;
+}
+
+void UsbMassStorage::Stop() {
+    m_started = false;
+}
+
+void UsbMassStorage::Refresh() {
+    bool enabled = mscdf_is_enabled();
+    if (enabled != m_enabled) {
+        m_enabled = enabled;
+        if (enabled) {
+            // Callbacks must be registered after endpoint allocation
+            mscdf_register_xfer_callback(MSCDF_CB_READ, MscOutXfer);
+            mscdf_register_xfer_callback(MSCDF_CB_WRITE, MscInXfer);
+            mscdf_register_reset_callback(MscReset);
+        }
+        StateReset();
+    }
+    if (!m_enabled) {
+        return;
+    }
+    if (m_reset) {
+        mscdf_stop_xfer();
+        StateReset();
+    }
+
+    switch (m_state) {
+        case MSC_COMMAND:
+            if (m_outDone) {
+                m_outDone = false;
+                m_cbwPosted = false;
+                CommandRun();
+            }
+            else {
+                if (m_outCancelled) {
+                    m_outCancelled = false;
+                    m_cbwPosted = false;
+                }
+                if (!m_cbwPosted) {
+                    m_cbwPosted = !mscdf_read(m_cbw, CBW_LENGTH);
+                }
+            }
+            break;
+        case MSC_DATA_IN:
+            DataInRefresh();
+            break;
+        case MSC_DATA_OUT:
+            DataOutRefresh();
+            break;
+        case MSC_HALTED:
+            if (m_inUnhalted) {
+                m_inUnhalted = false;
+                StatusSend();
+            }
+            break;
+        case MSC_STATUS:
+            if (m_inDone) {
+                m_inDone = false;
+                m_usbBusy = false;
+                m_outCancelled = false;
+                m_state = MSC_COMMAND;
+            }
+            else if (!m_usbBusy) {
+                StatusSend();
+            }
+            break;
+        case MSC_INVALID:
+        default:
+            break;
+    }
+}
+
+void UsbMassStorage::StateReset() {
+    m_state = MSC_COMMAND;
+    m_outDone = false;
+    m_inDone = false;
+    m_inUnhalted = false;
+    m_outCancelled = false;
+    m_reset = false;
+    m_cbwPosted = false;
+    m_usbBusy = false;
+    m_bufferBytes[0] = 0;
+    m_bufferBytes[1] = 0;
+}
+
+void UsbMassStorage::CommandRun() {
+    if (m_outCount != CBW_LENGTH ||
+            LittleEndian32Get(m_cbw) != CBW_SIGNATURE) {
+        // Only a reset recovers from a command block that is not one
+        mscdf_halt(MSCDF_CB_READ);
+        mscdf_halt(MSCDF_CB_WRITE);
+        m_state = MSC_INVALID;
+        return;
+    }
+
+    m_tag = LittleEndian32Get(&m_cbw[4]);
+    m_residue = LittleEndian32Get(&m_cbw[8]);
+    m_dirIn = m_cbw[12] & 0x80;
+    m_status = CSW_STATUS_PASSED;
+    const uint8_t *cb = &m_cbw[15];
+    uint8_t *reply = m_buffer[0];
+
+    if (cb[0] == SCSI_REQUEST_SENSE) {
+        memset(reply, 0, 18);
+        reply[0] = 0x70;
+        reply[2] = m_senseKey;
+        reply[7] = 10;
+        reply[12] = m_senseAsc;
+        m_senseKey = SENSE_NONE;
+        m_senseAsc = ASC_NONE;
+        ReplySend(18);
+        return;
+    }
+    m_senseKey = SENSE_NONE;
+    m_senseAsc = ASC_NONE;
+
+    if (cb[0] == SCSI_INQUIRY) {
+        // A removable direct access device
+        static const uint8_t inquiry[36] = {
+            0x00, 0x80, 0x02, 0x02, 31, 0x00, 0x00, 0x00,
+            'T', 'e', 'k', 'n', 'i', 'c', ' ', ' ',
+            'C', 'l', 'e', 'a', 'r', 'C', 'o', 'r',
+            'e', ' ', 'S', 'D', ' ', ' ', ' ', ' ',
+            '1', '.', '0', ' '
+        };
+        memcpy(reply, inquiry, sizeof(inquiry));
+        ReplySend(sizeof(inquiry));
+        return;
+    }
+    if (m_started && m_mediaChanged) {
+        m_mediaChanged = false;
+        Fail(SENSE_UNIT_ATTENTION, ASC_MEDIUM_CHANGED);
+        DataEnd();
+        return;
+    }
+
+    switch (cb[0]) {
+        case SCSI_TEST_UNIT_READY:
+            Ready();
+            DataEnd();
+            break;
+        case SCSI_MODE_SENSE_6:
+            // No mode pages, only the write protection
+            memset(reply, 0, 4);
+            reply[0] = 3;
+            reply[2] = m_writable ? 0x00 : 0x80;
+            ReplySend(4);
+            break;
+        case SCSI_MODE_SENSE_10:
+            memset(reply, 0, 8);
+            reply[1] = 6;
+            reply[3] = m_writable ? 0x00 : 0x80;
+            ReplySend(8);
+            break;
+        case SCSI_START_STOP_UNIT:
+            // The host ejecting the disk
+            if ((cb[4] & 0x03) == 0x02) {
+                Stop();
+            }
+            DataEnd();
+            break;
+        case SCSI_READ_FORMAT_CAPACITIES:
+            if (!Ready()) {
+                DataEnd();
+                break;
+            }
+            memset(reply, 0, 12);
+            reply[3] = 8;
+            BigEndian32Set(&reply[4], SdCard.BlockCount());
+            // Formatted media, then the block length
+            BigEndian32Set(&reply[8], SD_BLOCK_SIZE);
+            reply[8] = 0x02;
+            ReplySend(12);
+            break;
+        case SCSI_READ_CAPACITY_10:
+            if (!Ready()) {
+                DataEnd();
+                break;
+            }
+            BigEndian32Set(&reply[0], SdCard.BlockCount() - 1);
+            BigEndian32Set(&reply[4], SD_BLOCK_SIZE);
+            ReplySend(8);
+            break;
+        case SCSI_READ_10:
+            ReadStart(BigEndian32Get(&cb[2]), (cb[7] << 8) | cb[8]);
+            break;
+        case SCSI_WRITE_10:
+            WriteStart(BigEndian32Get(&cb[2]), (cb[7] << 8) | cb[8]);
+            break;
+        case SCSI_PREVENT_ALLOW_REMOVAL:
+        case SCSI_VERIFY_10:
+        case SCSI_SYNCHRONIZE_CACHE_10:
+            // Every write has reached the card by its status
+            Ready();
+            DataEnd();
+            break;
+        default:
+            Fail(SENSE_ILLEGAL_REQUEST, ASC_INVALID_COMMAND);
+            DataEnd();
+            break;
+    }
+}
+
+bool UsbMassStorage::Ready() {
+    if (!m_started || !SdCard.Initialized()) {
+        Fail(SENSE_NOT_READY, ASC_MEDIUM_NOT_PRESENT);
+        return false;
+    }
+    return true;
+}
+
+void UsbMassStorage::Fail(uint8_t senseKey, uint8_t asc) {
+    m_status = CSW_STATUS_FAILED;
+    m_senseKey = senseKey;
+    m_senseAsc = asc;
+}
+
+void UsbMassStorage::ReplySend(uint32_t length) {
+    if (!m_dirIn && m_residue) {
+        // The host meant to send data
+        m_status = CSW_STATUS_PHASE_ERROR;
+        DataEnd();
+        return;
+    }
+    m_bufferUsb = 0;
+    m_bufferCard = 0;
+    m_bufferBytes[0] = min(length, m_residue);
+    m_bufferBytes[1] = 0;
+    m_cardBlocks = 0;
+    m_state = MSC_DATA_IN;
+    DataInRefresh();
+}
+
+void UsbMassStorage::ReadStart(uint32_t block, uint32_t count) {
+    if (!Ready()) {
+        DataEnd();
+        return;
+    }
+    if ((!m_dirIn && m_residue) || count * SD_BLOCK_SIZE > m_residue) {
+        m_status = CSW_STATUS_PHASE_ERROR;
+        DataEnd();
+        return;
+    }
+    if (block > SdCard.BlockCount() || count > SdCard.BlockCount() - block) {
+        Fail(SENSE_ILLEGAL_REQUEST, ASC_LBA_OUT_OF_RANGE);
+        DataEnd();
+        return;
+    }
+    m_bufferUsb = 0;
+    m_bufferCard = 0;
+    m_bufferBytes[0] = 0;
+    m_bufferBytes[1] = 0;
+    m_cardBlock = block;
+    m_cardBlocks = count;
+    m_state = MSC_DATA_IN;
+    DataInRefresh();
+}
+
+void UsbMassStorage::WriteStart(uint32_t block, uint32_t count) {
+    if (!Ready()) {
+        DataEnd();
+        return;
+    }
+    if ((m_dirIn && m_residue) || count * SD_BLOCK_SIZE > m_residue) {
+        m_status = CSW_STATUS_PHASE_ERROR;
+        DataEnd();
+        return;
+    }
+    if (!m_writable) {
+        Fail(SENSE_DATA_PROTECT, ASC_WRITE_PROTECTED);
+        DataEnd();
+        return;
+    }
+    if (block > SdCard.BlockCount() || count > SdCard.BlockCount() - block) {
+        Fail(SENSE_ILLEGAL_REQUEST, ASC_LBA_OUT_OF_RANGE);
+        DataEnd();
+        return;
+    }
+    m_bufferUsb = 0;
+    m_bufferCard = 0;
+    m_bufferBytes[0] = 0;
+    m_bufferBytes[1] = 0;
+    m_cardBlock = block;
+    m_usbBlocks = count;
+    m_cardFailed = false;
+    m_state = MSC_DATA_OUT;
+    DataOutRefresh();
+}
+
+bool UsbMassStorage::UsbSend() {
+    if (m_usbBusy || !m_bufferBytes[m_bufferUsb]) {
+        return false;
+    }
+    // Mark the transfer busy first; it may finish before the call returns
+    m_usbBusy = true;
+    if (mscdf_write(m_buffer[m_bufferUsb], m_bufferBytes[m_bufferUsb])) {
+        m_usbBusy = false;
+        return false;
+    }
+    m_residue -= m_bufferBytes[m_bufferUsb];
+    return true;
+}
+
+void UsbMassStorage::DataInRefresh() {
+    if (m_inDone) {
+        m_inDone = false;
+        m_usbBusy = false;
+        m_bufferBytes[m_bufferUsb] = 0;
+        m_bufferUsb ^= 1;
+    }
+    UsbSend();
+
+    // Read the next blocks while the last ones go to the host
+    if (m_cardBlocks && !m_bufferBytes[m_bufferCard]) {
+        uint32_t count = min(m_cardBlocks, (uint32_t)MSC_BUFFER_BLOCKS);
+        if (SdCard.BlockRead(m_cardBlock, m_buffer[m_bufferCard], count)) {
+            m_bufferBytes[m_bufferCard] = count * SD_BLOCK_SIZE;
+            m_bufferCard ^= 1;
+            m_cardBlock += count;
+            m_cardBlocks -= count;
+            m_blocksRead += count;
+            UsbSend();
+        }
+        else {
+            // Send what was read, then fail the rest
+            Fail(SENSE_MEDIUM_ERROR, ASC_READ_ERROR);
+            m_cardBlocks = 0;
+        }
+    }
+
+    if (!m_usbBusy && !m_cardBlocks && !m_bufferBytes[m_bufferUsb]) {
+        DataEnd();
+    }
+}
+
+void UsbMassStorage::DataOutRefresh() {
+    if (m_outDone) {
+        m_outDone = false;
+        m_usbBusy = false;
+        uint32_t count = m_outCount;
+        m_residue -= min(count, m_residue);
+        if (count < m_usbBytes) {
+            // The host ended the data early
+            m_usbBlocks = 0;
+        }
+        m_bufferBytes[m_bufferUsb] = count - count % SD_BLOCK_SIZE;
+        m_bufferUsb ^= 1;
+    }
+    if (m_outCancelled) {
+        m_outCancelled = false;
+        m_usbBusy = false;
+        m_usbBlocks = 0;
+    }
+
+    // Receive the next blocks while the last ones go to the card
+    if (!m_usbBusy && m_usbBlocks && !m_bufferBytes[m_bufferUsb]) {
+        uint32_t count = min(m_usbBlocks, (uint32_t)MSC_BUFFER_BLOCKS);
+        m_usbBytes = count * SD_BLOCK_SIZE;
+        m_usbBusy = true;
+        if (mscdf_read(m_buffer[m_bufferUsb], m_usbBytes)) {
+            m_usbBusy = false;
+        }
+        else {
+            m_usbBlocks -= count;
+        }
+    }
+
+    uint32_t bytes = m_bufferBytes[m_bufferCard];
+    if (bytes) {
+        uint32_t count = bytes / SD_BLOCK_SIZE;
+        // After a failed write the rest of the data is only taken in
+        if (!m_cardFailed) {
+            if (SdCard.BlockWrite(m_cardBlock, m_buffer[m_bufferCard],
+                                  count)) {
+                m_blocksWritten += count;
+            }
+            else {
+                m_cardFailed = true;
+                Fail(SENSE_MEDIUM_ERROR, ASC_WRITE_ERROR);
+            }
+        }
+        m_cardBlock += count;
+        m_bufferBytes[m_bufferCard] = 0;
+        m_bufferCard ^= 1;
+    }
+
+    if (!m_usbBusy && !m_usbBlocks && !m_bufferBytes[m_bufferCard]) {
+        DataEnd();
+    }
+}
+
+void UsbMassStorage::DataEnd() {
+    if (m_residue && m_dirIn) {
+        // Stall the rest of the data the host asked for; the status follows
+        // once the host clears the endpoint
+        m_inUnhalted = false;
+        mscdf_halt(MSCDF_CB_WRITE);
+        m_state = MSC_HALTED;
+        return;
+    }
+    if (m_residue) {
+        mscdf_halt(MSCDF_CB_READ);
+    }
+    StatusSend();
+}
+
+void UsbMassStorage::StatusSend() {
+    LittleEndian32Set(&m_csw[0], CSW_SIGNATURE);
+    LittleEndian32Set(&m_csw[4], m_tag);
+    LittleEndian32Set(&m_csw[8], m_residue);
+    m_csw[12] = m_status;
+    m_state = MSC_STATUS;
+    m_inDone = false;
+    m_usbBusy = true;
+    if (mscdf_write(m_csw, CSW_LENGTH)) {
+        m_usbBusy = false;
+    }
+}
+
+void UsbMassStorage::InComplete(bool unhalted) {
+    if (unhalted) {
+        m_inUnhalted = true;
+    }
+    else {
+        m_inDone = true;
+    }
+}
+
+void UsbMassStorage::OutComplete(bool done, uint32_t count) {
+    if (done) {
+        m_outCount = count;
+        m_outDone = true;
+    }
+    else {
+        m_outCancelled = true;
+    }
+}
+
+} // ClearCore namespace
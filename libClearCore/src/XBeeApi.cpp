@@ -0,0 +1,335 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+    Implementation of ClearCore XBee API mode frames
+**/
+
+#include "XBeeApi.h"
+
+namespace ClearCore {
+
+#define XBEE_START_DELIMITER 0x7E
+#define XBEE_ESCAPE 0x7D
+#define XBEE_ESCAPE_XOR 0x20
+#define XBEE_XON 0x11
+#define XBEE_XOFF 0x13
+
+#define XBEE_FRAME_TX_REQUEST 0x10
+#define XBEE_FRAME_TX_STATUS_LEGACY 0x89
+#define XBEE_FRAME_TX_STATUS 0x8B
+
+// Type, frame ID, 64-bit and 16-bit addresses, radius, and options
+#define XBEE_TX_REQUEST_HEADER 14
+
+XBeeApi::XBeeApi(ISerial &port, ApiModes mode)
+    : m_port(port),
+      m_mode(mode),
+      m_pool(),
+      m_poolUsed(0),
+      m_ready(),
+      m_readyCount(0),
+      m_rxState(RX_START),
+      m_rxEscape(false),
+      m_rxLength(0),
+      m_rxIndex(0),
+      m_rxSum(0),
+      m_rxFrame(nullptr),
+      m_frameErrors(0),
+      m_callbackTypes(),
+      m_callbacks(),
+      m_callbackCount(0),
+      m_txTrack(),
+      m_txTrackNext(0),
+      m_txFrameId(0),
+      m_txChunk(),
+      m_txChunkLength(0) {}
+
+bool XBeeApi::FrameCallback(uint8_t frameType,
+                            FrameCallbackFunction callback) {
+    for (uint8_t i = 0; i < m_callbackCount; i++) {
+        if (m_callbackTypes[i] != frameType) {
+            continue;
+        }
+        if (callback) {
+            m_callbacks[i] = callback;
+        }
+        else {
+            // Close the gap so the list stays packed
+            m_callbackCount--;
+            m_callbackTypes[i] = m_callbackTypes[m_callbackCount];
+            m_callbacks[i] = m_callbacks[m_callbackCount];
+        }
+        return true;
+    }
+    if (!callback) {
+        return true;
+    }
+    if (m_callbackCount >= XBEE_API_CALLBACK_MAX) {
+        return false;
+    }
+    m_callbackTypes[m_callbackCount] = frameType;
+    m_callbacks[m_callbackCount] = callback;
+    m_callbackCount++;
+    return true;
+}
+
+bool XBeeApi::FrameSend(const uint8_t *data, uint16_t length) {
+    return FrameSendParts(data, length, nullptr, 0);
+}
+
+uint8_t XBeeApi::TransmitRequest(uint64_t dest64, const uint8_t *payload,
+                                 uint16_t length, uint16_t dest16,
+                                 uint8_t options) {
+    // Frame ID 0 asks the XBee not to send a transmit status
+    if (++m_txFrameId == 0) {
+        m_txFrameId = 1;
+    }
+
+    uint8_t header[XBEE_TX_REQUEST_HEADER];
+    header[0] = XBEE_FRAME_TX_REQUEST;
+    header[1] = m_txFrameId;
+    for (uint8_t i = 0; i < 8; i++) {
+        header[2 + i] = dest64 >> (56 - 8 * i);
+    }
+    header[10] = dest16 >> 8;
+    header[11] = dest16;
+    // Maximum broadcast radius
+    header[12] = 0;
+    header[13] = options;
+
+    // Track the request before sending so a fast status is not missed
+    TxTrack &track = m_txTrack[m_txTrackNext];
+    m_txTrackNext = (m_txTrackNext + 1) % XBEE_API_TX_TRACK_MAX;
+    track.FrameId = m_txFrameId;
+    track.DeliveryStatus = 0;
+    track.State = TX_PENDING;
+
+    if (!FrameSendParts(header, sizeof(header), payload, length)) {
+        track.State = TX_UNKNOWN;
+        return 0;
+    }
+    return m_txFrameId;
+}
+
+XBeeApi::TxStates XBeeApi::TransmitStatus(uint8_t frameId,
+                                          uint8_t *deliveryStatus) {
+    if (!frameId) {
+        return TX_UNKNOWN;
+    }
+    for (uint8_t i = 0; i < XBEE_API_TX_TRACK_MAX; i++) {
+        TxTrack &track = m_txTrack[i];
+        if (track.FrameId == frameId && track.State != TX_UNKNOWN) {
+            if (deliveryStatus) {
+                *deliveryStatus = track.DeliveryStatus;
+            }
+            return track.State;
+        }
+    }
+    return TX_UNKNOWN;
+}
+
+XBeeApi::Frame *XBeeApi::FrameGet() {
+    if (!m_readyCount) {
+        return nullptr;
+    }
+    Frame *frame = m_ready[0];
+    m_readyCount--;
+    for (uint8_t i = 0; i < m_readyCount; i++) {
+        m_ready[i] = m_ready[i + 1];
+    }
+    return frame;
+}
+
+void XBeeApi::FrameRelease(Frame *frame) {
+    if (frame < m_pool || frame >= m_pool + XBEE_API_FRAME_POOL) {
+        return;
+    }
+    m_poolUsed &= ~(1U << (frame - m_pool));
+}
+
+void XBeeApi::Poll() {
+    uint8_t chunk[32];
+    int32_t count;
+    while ((count = m_port.ReadBlock(chunk, sizeof(chunk))) > 0) {
+        for (int32_t i = 0; i < count; i++) {
+            RxByte(chunk[i]);
+        }
+    }
+}
+
+XBeeApi::Frame *XBeeApi::FrameAlloc() {
+    for (uint8_t i = 0; i < XBEE_API_FRAME_POOL; i++) {
+        if (!(m_poolUsed & (1U << i))) {
+            m_poolUsed |= 1U << i;
+            return &m_pool[i];
+        }
+    }
+    return nullptr;
+}
+
+void XBeeApi::RxByte(uint8_t data) {
+    if (m_mode == API_MODE_ESCAPED) {
+        // An unescaped start delimiter always begins a new frame
+        if (data == XBEE_START_DELIMITER) {
+            if (m_rxState != RX_START) {
+                FrameRelease(m_rxFrame);
+                m_rxFrame = nullptr;
+                m_frameErrors++;
+            }
+            m_rxEscape = false;
+            m_rxState = RX_LENGTH_MSB;
+            return;
+        }
+        if (data == XBEE_ESCAPE) {
+            m_rxEscape = true;
+            return;
+        }
+        if (m_rxEscape) {
+            data ^= XBEE_ESCAPE_XOR;
+            m_rxEscape = false;
+        }
+    }
+
+    switch (m_rxState) {
+        case RX_START:
+            if (data == XBEE_START_DELIMITER) {
+                m_rxState = RX_LENGTH_MSB;
+            }
+            break;
+        case RX_LENGTH_MSB:
+            m_rxLength = data << 8;
+            m_rxState = RX_LENGTH_LSB;
+            break;
+        case RX_LENGTH_LSB:
+            m_rxLength |= data;
+            m_rxIndex = 0;
+            m_rxSum = 0;
+            // Frames that cannot be held are still read through so the
+            // parser stays aligned in unescaped mode
+            m_rxFrame = (m_rxLength && m_rxLength <= XBEE_API_FRAME_MAX)
+                        ? FrameAlloc() : nullptr;
+            m_rxState = m_rxLength ? RX_DATA : RX_START;
+            if (!m_rxLength) {
+                m_frameErrors++;
+            }
+            break;
+        case RX_DATA:
+            if (m_rxFrame) {
+                m_rxFrame->Data[m_rxIndex] = data;
+            }
+            m_rxSum += data;
+            if (++m_rxIndex == m_rxLength) {
+                m_rxState = RX_CHECKSUM;
+            }
+            break;
+        case RX_CHECKSUM:
+            m_rxState = RX_START;
+            if (!m_rxFrame || static_cast<uint8_t>(m_rxSum + data) != 0xFF) {
+                FrameRelease(m_rxFrame);
+                m_rxFrame = nullptr;
+                m_frameErrors++;
+                break;
+            }
+            m_rxFrame->Length = m_rxLength;
+            FrameDone(m_rxFrame);
+            m_rxFrame = nullptr;
+            break;
+    }
+}
+
+void XBeeApi::FrameDone(Frame *frame) {
+    uint8_t type = frame->Data[0];
+    if (type == XBEE_FRAME_TX_STATUS && frame->Length >= 6) {
+        TxStatusUpdate(frame->Data[1], frame->Data[5]);
+    }
+    else if (type == XBEE_FRAME_TX_STATUS_LEGACY && frame->Length >= 3) {
+        TxStatusUpdate(frame->Data[1], frame->Data[2]);
+    }
+
+    for (uint8_t i = 0; i < m_callbackCount; i++) {
+        if (m_callbackTypes[i] == type) {
+            m_callbacks[i](*frame);
+            FrameRelease(frame);
+            return;
+        }
+    }
+    // The pool and the ready list are the same size, so there is always room
+    m_ready[m_readyCount++] = frame;
+}
+
+void XBeeApi::TxStatusUpdate(uint8_t frameId, uint8_t deliveryStatus) {
+    for (uint8_t i = 0; i < XBEE_API_TX_TRACK_MAX; i++) {
+        TxTrack &track = m_txTrack[i];
+        if (track.FrameId == frameId && track.State == TX_PENDING) {
+            track.DeliveryStatus = deliveryStatus;
+            track.State = deliveryStatus ? TX_FAILED : TX_DELIVERED;
+            return;
+        }
+    }
+}
+
+bool XBeeApi::FrameSendParts(const uint8_t *header, uint16_t headerLength,
+                             const uint8_t *payload, uint16_t payloadLength) {
+    uint16_t length = headerLength + payloadLength;
+    if (!length || length < headerLength) {
+        return false;
+    }
+
+    m_txChunkLength = 0;
+    uint8_t sum = 0;
+    bool ok = TxByte(XBEE_START_DELIMITER, false) && TxByte(length >> 8) &&
+              TxByte(length);
+    for (uint16_t i = 0; ok && i < headerLength; i++) {
+        sum += header[i];
+        ok = TxByte(header[i]);
+    }
+    for (uint16_t i = 0; ok && i < payloadLength; i++) {
+        sum += payload[i];
+        ok = TxByte(payload[i]);
+    }
+    return ok && TxByte(0xFF - sum) && TxFlush();
+}
+
+bool XBeeApi::TxByte(uint8_t data, bool escape) {
+    // Leave room for an escaped pair
+    if (m_txChunkLength + 2 > sizeof(m_txChunk) && !TxFlush()) {
+        return false;
+    }
+    if (escape && m_mode == API_MODE_ESCAPED &&
+            (data == XBEE_START_DELIMITER || data == XBEE_ESCAPE ||
+             data == XBEE_XON || data == XBEE_XOFF)) {
+        m_txChunk[m_txChunkLength++] = XBEE_ESCAPE;
+        data ^= XBEE_ESCAPE_XOR;
+    }
+    m_txChunk[m_txChunkLength++] = data;
+    return true;
+}
+
+bool XBeeApi::TxFlush() {
+    bool ok = m_port.Send(reinterpret_cast<const char *>(m_txChunk),
+                          m_txChunkLength);
+    m_txChunkLength = 0;
+    return ok;
+}
+
+} // ClearCore namespace
@@ -47,14 +47,18 @@ struct cdcdf_acm_func_data {
 	uint8_t func_ep_out;
 	/** CDC Device ACM Enable Flag */
 	bool enabled;
+	/** CDC Device ACM Line Coding */
+	struct usb_cdc_line_coding line_coding;
+	/** CDC Device ACM Notify Line State Callback */
+	cdcdf_acm_notify_state_t notify_state;
+	/** CDC Device ACM Set Line Coding Callback */
+	cdcdf_acm_set_line_coding_t set_line_coding;
 };
 
-static struct usbdf_driver        _cdcdf_acm;
-static struct cdcdf_acm_func_data _cdcdf_acm_funcd;
-static struct usb_cdc_line_coding usbd_cdc_line_coding;
-
-static cdcdf_acm_notify_state_t    cdcdf_acm_notify_state    = NULL;
-static cdcdf_acm_set_line_coding_t cdcdf_acm_set_line_coding = NULL;
+/* Each port is a separate function driver, so each claims the next free
+ * pair of CDC interfaces when the host sets the configuration */
+static struct usbdf_driver        _cdcdf_acm[CDCDF_ACM_PORTS];
+static struct cdcdf_acm_func_data _cdcdf_acm_funcd[CDCDF_ACM_PORTS];
 
 /**
  * \brief Enable CDC ACM Function
@@ -114,7 +118,7 @@ static int32_t cdcdf_acm_enable(struct usbdf_driver *drv, struct usbd_descriptor
 		ifc = usb_find_desc(usb_desc_next(desc->sod), desc->eod, USB_DT_INTERFACE);
 	}
 	// Installed
-	_cdcdf_acm_funcd.enabled = true;
+	func_data->enabled = true;
 	return ERR_NONE;
 }
 
@@ -156,7 +160,7 @@ static int32_t cdcdf_acm_disable(struct usbdf_driver *drv, struct usbd_descripto
 		func_data->func_ep_out = 0xFF;
 	}
 
-	_cdcdf_acm_funcd.enabled = false;
+	func_data->enabled = false;
 	return ERR_NONE;
 }
 
@@ -186,11 +190,13 @@ static int32_t cdcdf_acm_ctrl(struct usbdf_driver *drv, enum usbdf_control ctrl,
 
 /**
  * \brief Process the CDC class set request
+ * \param[in] func_data The port the request is for.
  * \param[in] ep Endpoint address.
  * \param[in] req Pointer to the request.
  * \return Operation status.
  */
-static int32_t cdcdf_acm_set_req(uint8_t ep, struct usb_req *req, enum usb_ctrl_stage stage)
+static int32_t cdcdf_acm_set_req(struct cdcdf_acm_func_data *func_data, uint8_t ep, struct usb_req *req,
+                                 enum usb_ctrl_stage stage)
 {
 	struct usb_cdc_line_coding line_coding_tmp;
 	uint16_t                   len      = req->wLength;
@@ -205,15 +211,15 @@ static int32_t cdcdf_acm_set_req(uint8_t ep, struct usb_req *req, enum usb_ctrl_
 			return usbdc_xfer(ep, ctrl_buf, len, false);
 		} else {
 			memcpy(&line_coding_tmp, ctrl_buf, sizeof(struct usb_cdc_line_coding));
-			if ((NULL == cdcdf_acm_set_line_coding) || (true == cdcdf_acm_set_line_coding(&line_coding_tmp))) {
-				usbd_cdc_line_coding = line_coding_tmp;
+			if ((NULL == func_data->set_line_coding) || (true == func_data->set_line_coding(&line_coding_tmp))) {
+				func_data->line_coding = line_coding_tmp;
 			}
 			return ERR_NONE;
 		}
 	case USB_REQ_CDC_SET_CONTROL_LINE_STATE:
 		usbdc_xfer(0, NULL, 0, 0);
-		if (NULL != cdcdf_acm_notify_state) {
-			cdcdf_acm_notify_state(req->wValue);
+		if (NULL != func_data->notify_state) {
+			func_data->notify_state(req->wValue);
 		}
 		return ERR_NONE;
 	default:
@@ -223,11 +229,13 @@ static int32_t cdcdf_acm_set_req(uint8_t ep, struct usb_req *req, enum usb_ctrl_
 
 /**
  * \brief Process the CDC class get request
+ * \param[in] func_data The port the request is for.
  * \param[in] ep Endpoint address.
  * \param[in] req Pointer to the request.
  * \return Operation status.
  */
-static int32_t cdcdf_acm_get_req(uint8_t ep, struct usb_req *req, enum usb_ctrl_stage stage)
+static int32_t cdcdf_acm_get_req(struct cdcdf_acm_func_data *func_data, uint8_t ep, struct usb_req *req,
+                                 enum usb_ctrl_stage stage)
 {
 	uint16_t len = req->wLength;
 
@@ -240,7 +248,7 @@ static int32_t cdcdf_acm_get_req(uint8_t ep, struct usb_req *req, enum usb_ctrl_
 		if (sizeof(struct usb_cdc_line_coding) != len) {
 			return ERR_INVALID_DATA;
 		}
-		return usbdc_xfer(ep, (uint8_t *)&usbd_cdc_line_coding, len, false);
+		return usbdc_xfer(ep, (uint8_t *)&func_data->line_coding, len, false);
 	default:
 		return ERR_INVALID_ARG;
 	}
@@ -254,18 +262,22 @@ static int32_t cdcdf_acm_get_req(uint8_t ep, struct usb_req *req, enum usb_ctrl_
  */
 static int32_t cdcdf_acm_req(uint8_t ep, struct usb_req *req, enum usb_ctrl_stage stage)
 {
+	uint8_t port;
+
 	if (0x01 != ((req->bmRequestType >> 5) & 0x03)) { // class request
 		return ERR_NOT_FOUND;
 	}
-	if ((req->wIndex == _cdcdf_acm_funcd.func_iface[0]) || (req->wIndex == _cdcdf_acm_funcd.func_iface[1])) {
-		if (req->bmRequestType & USB_EP_DIR_IN) {
-			return cdcdf_acm_get_req(ep, req, stage);
-		} else {
-			return cdcdf_acm_set_req(ep, req, stage);
+	for (port = 0; port < CDCDF_ACM_PORTS; port++) {
+		struct cdcdf_acm_func_data *func_data = &_cdcdf_acm_funcd[port];
+		if ((req->wIndex == func_data->func_iface[0]) || (req->wIndex == func_data->func_iface[1])) {
+			if (req->bmRequestType & USB_EP_DIR_IN) {
+				return cdcdf_acm_get_req(func_data, ep, req, stage);
+			} else {
+				return cdcdf_acm_set_req(func_data, ep, req, stage);
+			}
 		}
-	} else {
-		return ERR_NOT_FOUND;
 	}
+	return ERR_NOT_FOUND;
 }
 
 /** USB Device CDC ACM Handler Struct */
@@ -276,14 +288,17 @@ static struct usbdc_handler cdcdf_acm_req_h = {NULL, (FUNC_PTR)cdcdf_acm_req};
  */
 int32_t cdcdf_acm_init(void)
 {
+	uint8_t port;
+
 	if (usbdc_get_state() > USBD_S_POWER) {
 		return ERR_DENIED;
 	}
 
-	_cdcdf_acm.ctrl      = cdcdf_acm_ctrl;
-	_cdcdf_acm.func_data = &_cdcdf_acm_funcd;
-
-	usbdc_register_function(&_cdcdf_acm);
+	for (port = 0; port < CDCDF_ACM_PORTS; port++) {
+		_cdcdf_acm[port].ctrl      = cdcdf_acm_ctrl;
+		_cdcdf_acm[port].func_data = &_cdcdf_acm_funcd[port];
+		usbdc_register_function(&_cdcdf_acm[port]);
+	}
 	usbdc_register_handler(USBDC_HDL_REQ, &cdcdf_acm_req_h);
 	return ERR_NONE;
 }
@@ -293,60 +308,88 @@ int32_t cdcdf_acm_init(void)
  */
 void cdcdf_acm_deinit(void)
 {
-	usb_d_ep_deinit(_cdcdf_acm_funcd.func_ep_in[CDCDF_ACM_COMM_EP_INDEX]);
-	usb_d_ep_deinit(_cdcdf_acm_funcd.func_ep_in[CDCDF_ACM_DATA_EP_INDEX]);
-	usb_d_ep_deinit(_cdcdf_acm_funcd.func_ep_out);
+	uint8_t port;
+
+	for (port = 0; port < CDCDF_ACM_PORTS; port++) {
+		usb_d_ep_deinit(_cdcdf_acm_funcd[port].func_ep_in[CDCDF_ACM_COMM_EP_INDEX]);
+		usb_d_ep_deinit(_cdcdf_acm_funcd[port].func_ep_in[CDCDF_ACM_DATA_EP_INDEX]);
+		usb_d_ep_deinit(_cdcdf_acm_funcd[port].func_ep_out);
+	}
 }
 
 /**
  * \brief USB CDC ACM Function Read Data
  */
-int32_t cdcdf_acm_read(uint8_t *buf, uint32_t size)
+int32_t cdcdf_acm_port_read(uint8_t port, uint8_t *buf, uint32_t size)
 {
-	if (!cdcdf_acm_is_enabled()) {
+	if (!cdcdf_acm_port_is_enabled(port)) {
 		return ERR_DENIED;
 	}
-	return usbdc_xfer(_cdcdf_acm_funcd.func_ep_out, buf, size, false);
+	return usbdc_xfer(_cdcdf_acm_funcd[port].func_ep_out, buf, size, false);
+}
+
+int32_t cdcdf_acm_read(uint8_t *buf, uint32_t size)
+{
+	return cdcdf_acm_port_read(0, buf, size);
 }
 
 /**
  * \brief USB CDC ACM Function Write Data
  */
-int32_t cdcdf_acm_write(uint8_t *buf, uint32_t size)
+int32_t cdcdf_acm_port_write(uint8_t port, uint8_t *buf, uint32_t size)
 {
-	if (!cdcdf_acm_is_enabled()) {
+	if (!cdcdf_acm_port_is_enabled(port)) {
 		return ERR_DENIED;
 	}
-	return usbdc_xfer(_cdcdf_acm_funcd.func_ep_in[CDCDF_ACM_DATA_EP_INDEX], buf, size, true);
+	return usbdc_xfer(_cdcdf_acm_funcd[port].func_ep_in[CDCDF_ACM_DATA_EP_INDEX], buf, size, true);
+}
+
+int32_t cdcdf_acm_write(uint8_t *buf, uint32_t size)
+{
+	return cdcdf_acm_port_write(0, buf, size);
 }
 
 /**
  * \brief USB CDC ACM Stop the data transfer
  */
-void cdcdf_acm_stop_xfer(void)
+void cdcdf_acm_port_stop_xfer(uint8_t port)
 {
+	if (port >= CDCDF_ACM_PORTS) {
+		return;
+	}
 	/* Stop transfer. */
-	usb_d_ep_abort(_cdcdf_acm_funcd.func_ep_in[CDCDF_ACM_DATA_EP_INDEX]);
-	usb_d_ep_abort(_cdcdf_acm_funcd.func_ep_out);
+	usb_d_ep_abort(_cdcdf_acm_funcd[port].func_ep_in[CDCDF_ACM_DATA_EP_INDEX]);
+	usb_d_ep_abort(_cdcdf_acm_funcd[port].func_ep_out);
+}
+
+void cdcdf_acm_stop_xfer(void)
+{
+	cdcdf_acm_port_stop_xfer(0);
 }
 
 /**
  * \brief USB CDC ACM Function Register Callback
  */
-int32_t cdcdf_acm_register_callback(enum cdcdf_acm_cb_type cb_type, FUNC_PTR func)
+int32_t cdcdf_acm_port_register_callback(uint8_t port, enum cdcdf_acm_cb_type cb_type, FUNC_PTR func)
 {
+	struct cdcdf_acm_func_data *func_data;
+
+	if (port >= CDCDF_ACM_PORTS) {
+		return ERR_INVALID_ARG;
+	}
+	func_data = &_cdcdf_acm_funcd[port];
 	switch (cb_type) {
 	case CDCDF_ACM_CB_READ:
-		usb_d_ep_register_callback(_cdcdf_acm_funcd.func_ep_out, USB_D_EP_CB_XFER, func);
+		usb_d_ep_register_callback(func_data->func_ep_out, USB_D_EP_CB_XFER, func);
 		break;
 	case CDCDF_ACM_CB_WRITE:
-		usb_d_ep_register_callback(_cdcdf_acm_funcd.func_ep_in[CDCDF_ACM_DATA_EP_INDEX], USB_D_EP_CB_XFER, func);
+		usb_d_ep_register_callback(func_data->func_ep_in[CDCDF_ACM_DATA_EP_INDEX], USB_D_EP_CB_XFER, func);
 		break;
 	case CDCDF_ACM_CB_LINE_CODING_C:
-		cdcdf_acm_set_line_coding = (cdcdf_acm_set_line_coding_t)func;
+		func_data->set_line_coding = (cdcdf_acm_set_line_coding_t)func;
 		break;
 	case CDCDF_ACM_CB_STATE_C:
-		cdcdf_acm_notify_state = (cdcdf_acm_notify_state_t)func;
+		func_data->notify_state = (cdcdf_acm_notify_state_t)func;
 		break;
 	default:
 		return ERR_INVALID_ARG;
@@ -354,20 +397,53 @@ int32_t cdcdf_acm_register_callback(enum cdcdf_acm_cb_type cb_type, FUNC_PTR fun
 	return ERR_NONE;
 }
 
+int32_t cdcdf_acm_register_callback(enum cdcdf_acm_cb_type cb_type, FUNC_PTR func)
+{
+	return cdcdf_acm_port_register_callback(0, cb_type, func);
+}
+
 /**
  * \brief Check whether CDC ACM Function is enabled
  */
+bool cdcdf_acm_port_is_enabled(uint8_t port)
+{
+	return port < CDCDF_ACM_PORTS && _cdcdf_acm_funcd[port].enabled;
+}
+
 bool cdcdf_acm_is_enabled(void)
 {
-	return _cdcdf_acm_funcd.enabled;
+	return cdcdf_acm_port_is_enabled(0);
+}
+
+/**
+ * \brief Return the port that uses a data endpoint
+ */
+int8_t cdcdf_acm_ep_port(uint8_t ep)
+{
+	uint8_t port;
+
+	for (port = 0; port < CDCDF_ACM_PORTS; port++) {
+		if (ep == _cdcdf_acm_funcd[port].func_ep_out || ep == _cdcdf_acm_funcd[port].func_ep_in[CDCDF_ACM_DATA_EP_INDEX]) {
+			return port;
+		}
+	}
+	return -1;
 }
 
 /**
  * \brief Return the CDC ACM line coding structure start address
  */
+const struct usb_cdc_line_coding *cdcdf_acm_port_get_line_coding(uint8_t port)
+{
+	if (port >= CDCDF_ACM_PORTS) {
+		port = 0;
+	}
+	return (const struct usb_cdc_line_coding *)&_cdcdf_acm_funcd[port].line_coding;
+}
+
 const struct usb_cdc_line_coding *cdcdf_acm_get_line_coding(void)
 {
-	return (const struct usb_cdc_line_coding *)&usbd_cdc_line_coding;
+	return cdcdf_acm_port_get_line_coding(0);
 }
 
 /**
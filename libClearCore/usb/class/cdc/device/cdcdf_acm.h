@@ -35,6 +35,11 @@
 
 #include "usbdc.h"
 #include "usb_protocol_cdc.h"
+#include "usbd_config.h"
+
+/** The number of CDC ACM ports. Functions without a port argument use
+ * port 0. */
+#define CDCDF_ACM_PORTS CONF_USB_CDCD_ACM_PORTS
 
 /** CDC ACM Class Callback Type */
 enum cdcdf_acm_cb_type { CDCDF_ACM_CB_READ, CDCDF_ACM_CB_WRITE, CDCDF_ACM_CB_LINE_CODING_C, CDCDF_ACM_CB_STATE_C };
@@ -64,6 +69,7 @@ void cdcdf_acm_deinit(void);
  * \return Operation status.
  */
 int32_t cdcdf_acm_read(uint8_t *buf, uint32_t size);
+int32_t cdcdf_acm_port_read(uint8_t port, uint8_t *buf, uint32_t size);
 
 /**
  * \brief USB CDC ACM Function Write Data
@@ -72,11 +78,13 @@ int32_t cdcdf_acm_read(uint8_t *buf, uint32_t size);
  * \return Operation status.
  */
 int32_t cdcdf_acm_write(uint8_t *buf, uint32_t size);
+int32_t cdcdf_acm_port_write(uint8_t port, uint8_t *buf, uint32_t size);
 
 /**
  * \brief USB CDC ACM Stop the currnet data transfer
  */
 void cdcdf_acm_stop_xfer(void);
+void cdcdf_acm_port_stop_xfer(uint8_t port);
 
 /**
  * \brief USB CDC ACM Function Register Callback
@@ -85,6 +93,7 @@ void cdcdf_acm_stop_xfer(void);
  * \return Operation status.
  */
 int32_t cdcdf_acm_register_callback(enum cdcdf_acm_cb_type cb_type, FUNC_PTR func);
+int32_t cdcdf_acm_port_register_callback(uint8_t port, enum cdcdf_acm_cb_type cb_type, FUNC_PTR func);
 
 /**
  * \brief Check whether CDC ACM Function is enabled
@@ -93,12 +102,21 @@ int32_t cdcdf_acm_register_callback(enum cdcdf_acm_cb_type cb_type, FUNC_PTR fun
  * \return false CDC ACM Function is disabled
  */
 bool cdcdf_acm_is_enabled(void);
+bool cdcdf_acm_port_is_enabled(uint8_t port);
+
+/**
+ * \brief Return the port that uses a data endpoint
+ * \param[in] ep The bulk IN or OUT endpoint address
+ * \return The port, or -1 if no port uses the endpoint.
+ */
+int8_t cdcdf_acm_ep_port(uint8_t ep);
 
 /**
  * \brief Return the CDC ACM line coding structure start address
  * \return Pointer to USB CDC ACM line coding data.
  */
 const struct usb_cdc_line_coding *cdcdf_acm_get_line_coding(void);
+const struct usb_cdc_line_coding *cdcdf_acm_port_get_line_coding(uint8_t port);
 
 /**
  * \brief Return version
@@ -108,6 +108,21 @@
 	    USB_ENDP_DESC_BYTES(CONF_USB_CDCD_ACM_DATA_BULKOUT_EPADDR, 2, CONF_USB_CDCD_ACM_DATA_BULKOUT_MAXPKSZ_HS, 0),   \
 	    USB_ENDP_DESC_BYTES(CONF_USB_CDCD_ACM_DATA_BULKIN_EPADDR, 2, CONF_USB_CDCD_ACM_DATA_BULKIN_MAXPKSZ_HS, 0)
 
+/** The descriptors of one additional CDC ACM port, grouped by an IAD: the
+ * communication interface comm_ifc and the data interface after it */
+#define CDCD_ACM_PORT_DESCES(comm_ifc, int_ep, bulkout_ep, bulkin_ep)                                                  \
+	USB_IAD_DESC_BYTES(comm_ifc, 2, 0x02, 0x02, 0x00, 0),                                                              \
+	    USB_IFACE_DESC_BYTES(comm_ifc, 0, 1, 0x2, 0x2, 0x0, 0), USB_CDC_HDR_DESC_BYTES(0x1001),                        \
+	    USB_CDC_CALL_MGMT_DESC_BYTES(0x01, (comm_ifc) + 1), USB_CDC_ACM_DESC_BYTES(0x02),                              \
+	    USB_CDC_UNION_DESC_BYTES(comm_ifc, (comm_ifc) + 1),                                                            \
+	    USB_ENDP_DESC_BYTES(int_ep, 3, CONF_USB_CDCD_ACM_COMM_INT_MAXPKSZ, CONF_USB_CDCD_ACM_COMM_INT_INTERVAL),      \
+	    USB_IFACE_DESC_BYTES((comm_ifc) + 1, 0, 2, 0x0A, 0x0, 0x0, 0),                                                 \
+	    USB_ENDP_DESC_BYTES(bulkout_ep, 2, CONF_USB_CDCD_ACM_DATA_BULKOUT_MAXPKSZ, 0),                                 \
+	    USB_ENDP_DESC_BYTES(bulkin_ep, 2, CONF_USB_CDCD_ACM_DATA_BULKIN_MAXPKSZ, 0)
+
+/** The length of CDCD_ACM_PORT_DESCES */
+#define CDCD_ACM_PORT_DESC_LEN (USB_IAD_DESC_LEN + 58)
+
 #define CDCD_ACM_STR_DESCES                                                                                            \
 	CONF_USB_CDCD_ACM_LANGID_DESC                                                                                      \
 	CONF_USB_CDCD_ACM_IMANUFACT_STR_DESC                                                                               \
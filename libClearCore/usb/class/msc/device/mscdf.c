@@ -0,0 +1,315 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * \file
+ *
+ * \brief USB Device Stack Mass Storage Function Implementation.
+ *
+ * Claims the Mass Storage (class 0x08) Bulk-Only Transport interface of the
+ * configuration, installs its bulk IN and OUT endpoints and answers the
+ * Get Max LUN and Bulk-Only Mass Storage Reset class requests. The SCSI
+ * commands carried on the bulk endpoints are left to the application.
+ */
+
+#include "mscdf.h"
+
+#define MSC_CLASS 0x08
+
+#define USB_REQ_MSC_GET_MAX_LUN 0xFE
+#define USB_REQ_MSC_BULK_RESET 0xFF
+
+/** USB Device Mass Storage Function Specific Data */
+struct mscdf_func_data {
+	/** Mass Storage Interface information */
+	uint8_t func_iface;
+	/** Mass Storage IN Endpoint */
+	uint8_t func_ep_in;
+	/** Mass Storage OUT Endpoint */
+	uint8_t func_ep_out;
+	/** Mass Storage Enable Flag */
+	bool enabled;
+};
+
+static struct usbdf_driver    _mscdf;
+static struct mscdf_func_data _mscdf_funcd;
+
+/** The highest logical unit number; a single unit is exposed */
+static uint8_t mscdf_max_lun = 0;
+
+static mscdf_reset_t mscdf_reset = NULL;
+
+/**
+ * \brief Enable Mass Storage Function
+ * \param[in] drv Pointer to USB device function driver
+ * \param[in] desc Pointer to USB interface descriptor
+ * \return Operation status.
+ */
+static int32_t mscdf_enable(struct usbdf_driver *drv, struct usbd_descriptors *desc)
+{
+	struct mscdf_func_data *func_data = (struct mscdf_func_data *)(drv->func_data);
+
+	usb_ep_desc_t ep_desc;
+	uint8_t *     ifc, *ep;
+
+	ifc = desc->sod;
+	if (NULL == ifc) {
+		return ERR_NOT_FOUND;
+	}
+	if (MSC_CLASS != ifc[5]) { // Not supported by this function driver
+		return ERR_NOT_FOUND;
+	}
+	if (func_data->func_iface == ifc[2]) { // Initialized
+		return ERR_ALREADY_INITIALIZED;
+	} else if (func_data->func_iface != 0xFF) { // Occupied
+		return ERR_NO_RESOURCE;
+	}
+	func_data->func_iface = ifc[2];
+
+	// Install endpoints
+	ep = usb_find_desc(ifc, desc->eod, USB_DT_ENDPOINT);
+	while (NULL != ep) {
+		ep_desc.bEndpointAddress = ep[2];
+		ep_desc.bmAttributes     = ep[3];
+		ep_desc.wMaxPacketSize   = usb_get_u16(ep + 4);
+		if (usb_d_ep_init(ep_desc.bEndpointAddress, ep_desc.bmAttributes, ep_desc.wMaxPacketSize)) {
+			return ERR_NOT_INITIALIZED;
+		}
+		if (ep_desc.bEndpointAddress & USB_EP_DIR_IN) {
+			func_data->func_ep_in = ep_desc.bEndpointAddress;
+			usb_d_ep_enable(func_data->func_ep_in);
+		} else {
+			func_data->func_ep_out = ep_desc.bEndpointAddress;
+			usb_d_ep_enable(func_data->func_ep_out);
+		}
+		desc->sod = ep;
+		ep        = usb_find_ep_desc(usb_desc_next(desc->sod), desc->eod);
+	}
+	// Installed
+	func_data->enabled = true;
+	return ERR_NONE;
+}
+
+/**
+ * \brief Disable Mass Storage Function
+ * \param[in] drv Pointer to USB device function driver
+ * \param[in] desc Pointer to USB device descriptor
+ * \return Operation status.
+ */
+static int32_t mscdf_disable(struct usbdf_driver *drv, struct usbd_descriptors *desc)
+{
+	struct mscdf_func_data *func_data = (struct mscdf_func_data *)(drv->func_data);
+
+	if (desc && MSC_CLASS != desc->sod[5]) {
+		return ERR_NOT_FOUND;
+	}
+
+	func_data->func_iface = 0xFF;
+	if (func_data->func_ep_in != 0xFF) {
+		usb_d_ep_deinit(func_data->func_ep_in);
+		func_data->func_ep_in = 0xFF;
+	}
+	if (func_data->func_ep_out != 0xFF) {
+		usb_d_ep_deinit(func_data->func_ep_out);
+		func_data->func_ep_out = 0xFF;
+	}
+
+	func_data->enabled = false;
+	return ERR_NONE;
+}
+
+/**
+ * \brief Mass Storage Control Function
+ * \param[in] drv Pointer to USB device function driver
+ * \param[in] ctrl USB device general function control type
+ * \param[in] param Parameter pointer
+ * \return Operation status.
+ */
+static int32_t mscdf_ctrl(struct usbdf_driver *drv, enum usbdf_control ctrl, void *param)
+{
+	switch (ctrl) {
+	case USBDF_ENABLE:
+		return mscdf_enable(drv, (struct usbd_descriptors *)param);
+
+	case USBDF_DISABLE:
+		return mscdf_disable(drv, (struct usbd_descriptors *)param);
+
+	case USBDF_GET_IFACE:
+		return ERR_UNSUPPORTED_OP;
+
+	default:
+		return ERR_INVALID_ARG;
+	}
+}
+
+/**
+ * \brief Process the Mass Storage class request
+ * \param[in] ep Endpoint address.
+ * \param[in] req Pointer to the request.
+ * \return Operation status.
+ */
+static int32_t mscdf_req(uint8_t ep, struct usb_req *req, enum usb_ctrl_stage stage)
+{
+	if (0x01 != ((req->bmRequestType >> 5) & 0x03)) { // class request
+		return ERR_NOT_FOUND;
+	}
+	if (req->wIndex != _mscdf_funcd.func_iface) {
+		return ERR_NOT_FOUND;
+	}
+	if (USB_DATA_STAGE == stage) {
+		return ERR_NONE;
+	}
+
+	switch (req->bRequest) {
+	case USB_REQ_MSC_GET_MAX_LUN:
+		if (!(req->bmRequestType & USB_EP_DIR_IN) || 1 != req->wLength) {
+			return ERR_INVALID_DATA;
+		}
+		return usbdc_xfer(ep, &mscdf_max_lun, 1, false);
+	case USB_REQ_MSC_BULK_RESET:
+		if ((req->bmRequestType & USB_EP_DIR_IN) || 0 != req->wLength) {
+			return ERR_INVALID_DATA;
+		}
+		usbdc_xfer(0, NULL, 0, 0);
+		if (NULL != mscdf_reset) {
+			mscdf_reset();
+		}
+		return ERR_NONE;
+	default:
+		return ERR_INVALID_ARG;
+	}
+}
+
+/** USB Device Mass Storage Handler Struct */
+static struct usbdc_handler mscdf_req_h = {NULL, (FUNC_PTR)mscdf_req};
+
+/**
+ * \brief Initialize the USB Mass Storage Function Driver
+ */
+int32_t mscdf_init(void)
+{
+	if (usbdc_get_state() > USBD_S_POWER) {
+		return ERR_DENIED;
+	}
+
+	_mscdf_funcd.func_iface  = 0xFF;
+	_mscdf_funcd.func_ep_in  = 0xFF;
+	_mscdf_funcd.func_ep_out = 0xFF;
+
+	_mscdf.ctrl      = mscdf_ctrl;
+	_mscdf.func_data = &_mscdf_funcd;
+
+	usbdc_register_function(&_mscdf);
+	usbdc_register_handler(USBDC_HDL_REQ, &mscdf_req_h);
+	return ERR_NONE;
+}
+
+/**
+ * \brief Deinitialize the USB Mass Storage Function Driver
+ */
+void mscdf_deinit(void)
+{
+	usb_d_ep_deinit(_mscdf_funcd.func_ep_in);
+	usb_d_ep_deinit(_mscdf_funcd.func_ep_out);
+}
+
+/**
+ * \brief USB Mass Storage Function Read Data
+ */
+int32_t mscdf_read(uint8_t *buf, uint32_t size)
+{
+	if (!mscdf_is_enabled()) {
+		return ERR_DENIED;
+	}
+	return usbdc_xfer(_mscdf_funcd.func_ep_out, buf, size, false);
+}
+
+/**
+ * \brief USB Mass Storage Function Write Data
+ */
+int32_t mscdf_write(uint8_t *buf, uint32_t size)
+{
+	if (!mscdf_is_enabled()) {
+		return ERR_DENIED;
+	}
+	// The host knows the length of every phase, so no ZLP ends it
+	return usbdc_xfer(_mscdf_funcd.func_ep_in, buf, size, false);
+}
+
+/**
+ * \brief USB Mass Storage Function Halt an Endpoint
+ */
+int32_t mscdf_halt(enum mscdf_cb_type ep_type)
+{
+	switch (ep_type) {
+	case MSCDF_CB_READ:
+		return usb_d_ep_halt(_mscdf_funcd.func_ep_out, USB_EP_HALT_SET);
+	case MSCDF_CB_WRITE:
+		return usb_d_ep_halt(_mscdf_funcd.func_ep_in, USB_EP_HALT_SET);
+	default:
+		return ERR_INVALID_ARG;
+	}
+}
+
+/**
+ * \brief USB Mass Storage Stop the current data transfers
+ */
+void mscdf_stop_xfer(void)
+{
+	usb_d_ep_abort(_mscdf_funcd.func_ep_in);
+	usb_d_ep_abort(_mscdf_funcd.func_ep_out);
+}
+
+/**
+ * \brief USB Mass Storage Function Register Transfer Callback
+ */
+int32_t mscdf_register_xfer_callback(enum mscdf_cb_type cb_type, usb_d_ep_cb_xfer_t func)
+{
+	switch (cb_type) {
+	case MSCDF_CB_READ:
+		usb_d_ep_register_callback(_mscdf_funcd.func_ep_out, USB_D_EP_CB_XFER, (FUNC_PTR)func);
+		break;
+	case MSCDF_CB_WRITE:
+		usb_d_ep_register_callback(_mscdf_funcd.func_ep_in, USB_D_EP_CB_XFER, (FUNC_PTR)func);
+		break;
+	default:
+		return ERR_INVALID_ARG;
+	}
+	return ERR_NONE;
+}
+
+/**
+ * \brief USB Mass Storage Function Register Reset Callback
+ */
+int32_t mscdf_register_reset_callback(mscdf_reset_t func)
+{
+	mscdf_reset = func;
+	return ERR_NONE;
+}
+
+/**
+ * \brief Check whether Mass Storage Function is enabled
+ */
+bool mscdf_is_enabled(void)
+{
+	return _mscdf_funcd.enabled;
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2020 Teknic, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * \file
+ *
+ * \brief USB Device Stack Mass Storage Function Definition.
+ */
+
+#ifndef USBDF_MSC_H_
+#define USBDF_MSC_H_
+
+#include "usbdc.h"
+
+/** Mass Storage Class Callback Type */
+enum mscdf_cb_type { MSCDF_CB_READ, MSCDF_CB_WRITE, MSCDF_CB_RESET };
+
+/** Callback invoked on a Bulk-Only Mass Storage Reset request */
+typedef void (*mscdf_reset_t)(void);
+
+/**
+ * \brief Initialize the USB Mass Storage Function Driver
+ * \return Operation status.
+ */
+int32_t mscdf_init(void);
+
+/**
+ * \brief Deinitialize the USB Mass Storage Function Driver
+ */
+void mscdf_deinit(void);
+
+/**
+ * \brief USB Mass Storage Function Read Data
+ * \param[in] buf Pointer to the buffer which receives data
+ * \param[in] size the size of data to be received
+ * \return Operation status.
+ */
+int32_t mscdf_read(uint8_t *buf, uint32_t size);
+
+/**
+ * \brief USB Mass Storage Function Write Data
+ * \param[in] buf Pointer to the buffer which stores data
+ * \param[in] size the size of data to be sent
+ * \return Operation status.
+ */
+int32_t mscdf_write(uint8_t *buf, uint32_t size);
+
+/**
+ * \brief USB Mass Storage Function Halt an Endpoint
+ *
+ * The endpoint stays halted until the host clears it, at which point its
+ * transfer callback is invoked with USB_XFER_UNHALT.
+ *
+ * \param[in] ep_type MSCDF_CB_READ for the OUT endpoint, MSCDF_CB_WRITE for
+ * the IN endpoint
+ * \return Operation status.
+ */
+int32_t mscdf_halt(enum mscdf_cb_type ep_type);
+
+/**
+ * \brief USB Mass Storage Stop the current data transfers
+ */
+void mscdf_stop_xfer(void);
+
+/**
+ * \brief USB Mass Storage Function Register Transfer Callback
+ * \param[in] cb_type MSCDF_CB_READ or MSCDF_CB_WRITE
+ * \param[in] func Pointer to callback function
+ * \return Operation status.
+ */
+int32_t mscdf_register_xfer_callback(enum mscdf_cb_type cb_type, usb_d_ep_cb_xfer_t func);
+
+/**
+ * \brief USB Mass Storage Function Register Reset Callback
+ * \param[in] func Pointer to callback function
+ * \return Operation status.
+ */
+int32_t mscdf_register_reset_callback(mscdf_reset_t func);
+
+/**
+ * \brief Check whether Mass Storage Function is enabled
+ * \return true Mass Storage Function is enabled
+ * \return false Mass Storage Function is disabled
+ */
+bool mscdf_is_enabled(void);
+
+#endif /* USBDF_MSC_H_ */